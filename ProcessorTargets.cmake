@@ -43,3 +43,9 @@ set(PROC_TARGET_10_FLAGS "-march=sandybridge -mtune=ivybridge" CACHE STRING "Pro
 
 #set(PROC_TARGET__LABEL procLabel CACHE STRING "Processor- label")
 #set(PROC_TARGET__FLAGS "procFlags" CACHE STRING "Processor- flags")
+
+# Instruction sets for which the hottest kernels (currently the AMaZE and RCD demosaic, the denoise shrinkage, the recursive gaussian blur, the HaldCLUT interpolation, the half-float and Lab conversions and the CA correction) are compiled in addition to the
+# baseline selected above; the best variant supported by the running processor is picked at runtime.
+# Only used on x86-64 with GCC, and not when building for the native processor (PROC_TARGET_NUMBER 2).
+# Supported values: AVX2, AVX512. Set to an empty string to disable.
+set(PROC_DISPATCH_TARGETS "AVX2;AVX512" CACHE STRING "Instruction sets of the runtime-dispatched kernels")
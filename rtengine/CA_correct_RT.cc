@@ -24,6 +24,7 @@
 ////////////////////////////////////////////////////////////////
 
 #include "StopWatch.h"
+#include "cpuinfo.h"
 #include "gauss.h"
 #include "median.h"
 #include "rawimagesource.h"
@@ -124,13 +125,53 @@ extern const Settings *settings;
 
 using namespace rtengine;
 
+// this file is also compiled for the instruction sets in
+// PROC_DISPATCH_TARGETS (see ca_correct_avx2.cc), which define
+// ART_SIMD_VARIANT
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_VARIANT(name) name##_base
+#define ART_SIMD_BASE_BUILD
+#endif
+
+#ifdef ART_SIMD_BASE_BUILD
+
 float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
                                      double cared, double cablue,
                                      bool avoidColourshift,
                                      const array2D<float> &rawData,
-                                     double *fitParamsTransfer,
+                                     std::vector<double> *fitParams,
                                      bool fitParamsIn, bool fitParamsOut,
                                      float *buffer, bool freeBuffer)
+{
+    typedef float *(RawImageSource::*Fn)(
+        bool, size_t, double, double, bool, const array2D<float> &,
+        std::vector<double> *, bool, bool, float *, bool);
+
+    Fn fn = &RawImageSource::CA_correct_RT_base;
+
+    switch (get_simd_level()) {
+#ifdef ART_SIMD_DISPATCH_AVX2
+    case SIMDLevel::AVX512: // there's no AVX-512 build of this one
+    case SIMDLevel::AVX2:
+        fn = &RawImageSource::CA_correct_RT_avx2;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    return (this->*fn)(autoCA, autoIterations, cared, cablue,
+                       avoidColourshift, rawData, fitParams, fitParamsIn,
+                       fitParamsOut, buffer, freeBuffer);
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+float *RawImageSource::ART_SIMD_VARIANT(CA_correct_RT)(
+    bool autoCA, size_t autoIterations, double cared, double cablue,
+    bool avoidColourshift, const array2D<float> &rawData,
+    std::vector<double> *fitParams, bool fitParamsIn, bool fitParamsOut,
+    float *buffer, bool freeBuffer)
 {
     constexpr size_t chunkSize = 2;
     constexpr bool measure = false;
@@ -221,22 +262,17 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
     // Because we can't break parallel processing, we need a switch do handle
     // the errors
     bool processpasstwo = true;
-    double fitparams[2][2][16];
+    double fitparams[2][2][16] = {};
 
     const size_t iterations = autoCA ? std::max<size_t>(autoIterations, 1) : 1;
 
-    const bool fitParamsSet =
-        fitParamsTransfer && fitParamsIn && iterations < 2;
-    if (autoCA && fitParamsSet) {
-        // use stored parameters
-        int index = 0;
-        for (int c = 0; c < 2; ++c) {
-            for (int d = 0; d < 2; ++d) {
-                for (int e = 0; e < 16; ++e) {
-                    fitparams[c][d][e] = fitParamsTransfer[index++];
-                }
-            }
-        }
+    // fitParams holds, for every iteration, the order of the polynomial fit,
+    // whether the correction pass is run, and the coefficients of the fit
+    constexpr size_t fitSize = 2 + 2 * 2 * 16;
+    const bool fitParamsSet = autoCA && fitParams && fitParamsIn &&
+                              fitParams->size() == iterations * fitSize;
+    if (autoCA && fitParams && fitParamsOut) {
+        fitParams->assign(iterations * fitSize, 0.0);
     }
 
     for (size_t it = 0; it < iterations && processpasstwo; ++it) {
@@ -274,7 +310,7 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
                                               4 * sizeof(float) * ts * tsh +
                                               4 * 64 + 63;
             char *const bufferThr = (char *)malloc(
-                (autoCA && !fitParamsSet) ? buffersize : buffersizePassTwo);
+                autoCA ? buffersize : buffersizePassTwo);
 
             char *const data =
                 (char *)((uintptr_t(bufferThr) + uintptr_t(63)) / 64 * 64);
@@ -290,7 +326,7 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
             rgb[2] =
                 (float *)(data + sizeof(float) * (ts * ts + ts * tsh) + 2 * 64);
 
-            if (autoCA && !fitParamsSet) {
+            if (autoCA) {
                 constexpr float caAutostrength = 8.f;
                 // high pass filter for R/B in vertical direction
                 float *rbhpfh =
@@ -616,6 +652,11 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
                             }
                         }
 
+                        if (fitParamsSet) {
+                            // only the interpolated G is needed
+                            continue;
+                        }
+
 #ifdef __SSE2__
                         vfloat zd25v = F2V(0.25f);
 #endif
@@ -997,7 +1038,7 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
 #ifdef _OPENMP
 #pragma omp single
 #endif
-                {
+                if (!fitParamsSet) {
                     for (int dir = 0; dir < 2; dir++)
                         for (int c = 0; c < 2; c++) {
                             if (blockdenom[dir][c]) {
@@ -1185,6 +1226,20 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
                     }
                     // fitparams[polyord*i+j] gives the coefficients of
                     // (vblock^i hblock^j) in a polynomial fit for i,j<=4
+                    if (fitParams && fitParamsOut) {
+                        double *f = fitParams->data() + it * fitSize;
+                        f[0] = polyord;
+                        f[1] = processpasstwo;
+                        std::copy(&fitparams[0][0][0],
+                                  &fitparams[0][0][0] + fitSize - 2, f + 2);
+                    }
+                } else {
+                    // use the stored parameters
+                    const double *f = fitParams->data() + it * fitSize;
+                    polyord = int(f[0]);
+                    numpar = SQR(polyord);
+                    processpasstwo = f[1] != 0;
+                    std::copy(f + 2, f + fitSize, &fitparams[0][0][0]);
                 }
                 // end of initialization for CA correction pass
                 // only executed if autoCA is true
@@ -1430,7 +1485,7 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
                         }
                         // end of border fill
 
-                        if (!autoCA || fitParamsIn) {
+                        if (!autoCA) {
 #ifdef __SSE2__
                             const vfloat onev = F2V(1.f);
                             const vfloat epsv = F2V(eps);
@@ -2066,18 +2121,6 @@ float *RawImageSource::CA_correct_RT(bool autoCA, size_t autoIterations,
         }
     }
 
-    if (autoCA && fitParamsTransfer && fitParamsOut) {
-        // store calculated parameters
-        int index = 0;
-        for (int c = 0; c < 2; ++c) {
-            for (int d = 0; d < 2; ++d) {
-                for (int e = 0; e < 16; ++e) {
-                    fitParamsTransfer[index++] = fitparams[c][d][e];
-                }
-            }
-        }
-    }
-
     if (freeBuffer) {
         free(buffer);
         buffer = nullptr;
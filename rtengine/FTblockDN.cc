@@ -27,6 +27,8 @@
 #include "array2D.h"
 #include "boxblur.h"
 #include "cplx_wavelet_dec.h"
+#include "denoise_kernels.h"
+#include "fftwplans.h"
 #include "gauss.h"
 #include "guidedfilter.h"
 #include "iccmatrices.h"
@@ -412,6 +414,16 @@ void Median_Denoise(float **src, float **dst, float upperBound, const int width,
                             iterations, numThreads, buffer);
 }
 
+void Median_Denoise(float **src, float **dst, float upperBound, int width,
+                    int height, int radius, int iterations, bool multithread)
+{
+    median_filter(src, dst, width, height, radius, multithread, upperBound);
+    for (int i = 1; i < iterations; ++i) {
+        median_filter(dst, dst, width, height, radius, multithread,
+                      upperBound);
+    }
+}
+
 void Tile_calc(int tilesize, int overlap, int kall, int imwidth, int imheight,
                int &numtiles_W, int &numtiles_H, int &tilewidth,
                int &tileheight, int &tileWskip, int &tileHskip)
@@ -479,26 +491,8 @@ void RGBtile_denoise(double scale, float *fLblox, int hblproc,
                blurbuffer); // blur neighbor weights for more robust estimation
                             // //for DCT
 
-#ifdef __SSE2__
-    __m128 tempv;
-    //__m128  noisevar_Ldetailv = _mm_set1_ps(noisevar_Ldetail);
-    __m128 onev = _mm_set1_ps(1.0f);
-
-    for (int n = 0; n < TS * TS; n += 4) { // for DCT
-        tempv = onev - xexpf(-SQRV(LVF(nbrwt[n])) /
-                             LVF(noisevar_Ldetail[blkstart + n]));
-        _mm_storeu_ps(&fLblox[blkstart + n],
-                      LVFU(fLblox[blkstart + n]) * tempv);
-    } // output neighbor averaged result
-
-#else
-
-    for (int n = 0; n < TS * TS; ++n) { // for DCT
-        fLblox[blkstart + n] *=
-            (1 - xexpf(-SQR(nbrwt[n]) / noisevar_Ldetail[blkstart + n]));
-    } // output neighbor averaged result
-
-#endif
+    denoise::get_kernels().dct_shrink(fLblox + blkstart, nbrwt,
+                                      noisevar_Ldetail + blkstart, TS * TS);
 
     //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
     // printf("vblk=%d  hlk=%d  wsqave=%f   ||   ",vblproc,hblproc,wsqave);
@@ -516,6 +510,7 @@ void RGBoutput_tile_row(double scale, float *bloxrow_L, float **Ldetail,
 
     const int numblox_W = ceil((static_cast<float>(width)) / (offset));
     const float DCTnorm = 1.0f / (4 * TS * TS); // for DCT
+    const denoise::Kernels &kernels = denoise::get_kernels();
 
     int imin = MAX(0, -top);
     int bottom = MIN(top + TS, height);
@@ -530,12 +525,10 @@ void RGBoutput_tile_row(double scale, float *bloxrow_L, float **Ldetail,
             int jmax = right - left;
             int indx = hblk * TS;
 
-            for (int j = jmin; j < jmax;
-                 ++j) { // this loop gets auto vectorized by gcc
-                Ldetail[top + i][left + j] += tilemask_out[i][j] *
-                                              bloxrow_L[(indx + i) * TS + j] *
-                                              DCTnorm; // for DCT
-            }
+            kernels.accumulate(&Ldetail[top + i][left + jmin],
+                               &tilemask_out[i][jmin],
+                               &bloxrow_L[(indx + i) * TS + jmin], DCTnorm,
+                               jmax - jmin); // for DCT
         }
     }
 }
@@ -626,8 +619,6 @@ void ShrinkAllL(double scale, wavelet_decomposition &WaveletCoeffs_L,
 
 {
     // simple wavelet shrinkage
-    const float eps = 0.01f;
-
     float *sfave = buffer[0] + 32;
     float *sfaved = buffer[1] + 64;
     float *blurBuffer = buffer[2] + 96;
@@ -649,83 +640,16 @@ void ShrinkAllL(double scale, wavelet_decomposition &WaveletCoeffs_L,
         }
     }
 
-    float levelFactor = mad_L * 5.f / static_cast<float>(level + 1);
-#ifdef __SSE2__
-    __m128 magv;
-    __m128 levelFactorv = _mm_set1_ps(levelFactor);
-    __m128 mad_Lv;
-    __m128 ninev = _mm_set1_ps(9.0f);
-    __m128 epsv = _mm_set1_ps(eps);
-    int i;
-
-    for (i = 0; i < W_L * H_L - 3; i += 4) {
-        mad_Lv = LVFU(noisevarlum[i]) * levelFactorv;
-        magv = SQRV(LVFU(WavCoeffs_L[dir][i]));
-        _mm_storeu_ps(
-            &sfave[i],
-            magv / (magv + mad_Lv * xexpf(-magv / (ninev * mad_Lv)) + epsv));
-    }
-
-    // few remaining pixels
-    for (; i < W_L * H_L; ++i) {
-        float mag = SQR(WavCoeffs_L[dir][i]);
-        sfave[i] = mag / (mag +
-                          levelFactor * noisevarlum[i] *
-                              xexpf(-mag / (9 * levelFactor * noisevarlum[i])) +
-                          eps);
-    }
-
-#else
-
-    for (int i = 0; i < W_L * H_L; ++i) {
-
-        float mag = SQR(WavCoeffs_L[dir][i]);
-        float shrinkfactor =
-            mag / (mag +
-                   levelFactor * noisevarlum[i] *
-                       xexpf(-mag / (9 * levelFactor * noisevarlum[i])) +
-                   eps);
-        sfave[i] = shrinkfactor;
-    }
-
-#endif
+    const denoise::Kernels &kernels = denoise::get_kernels();
+    const float levelFactor = mad_L * 5.f / static_cast<float>(level + 1);
+    kernels.shrink_L(WavCoeffs_L[dir], noisevarlum, levelFactor, sfave,
+                     W_L * H_L);
     const int blur_rad = max(1, int((level + 2) / scale));
     boxblur(sfave, sfaved, blurBuffer, blur_rad, blur_rad, W_L,
             H_L); // increase smoothness by locally averaging shrinkage
 
-#ifdef __SSE2__
-    __m128 sfv;
-
-    for (i = 0; i < W_L * H_L - 3; i += 4) {
-        sfv = LVFU(sfave[i]);
-        // use smoothed shrinkage unless local shrinkage is much less
-        _mm_storeu_ps(&WavCoeffs_L[dir][i],
-                      _mm_loadu_ps(&WavCoeffs_L[dir][i]) *
-                          (SQRV(LVFU(sfaved[i])) + SQRV(sfv)) /
-                          (LVFU(sfaved[i]) + sfv + epsv));
-    }
-
-    // few remaining pixels
-    for (; i < W_L * H_L; ++i) {
-        float sf = sfave[i];
-
-        // use smoothed shrinkage unless local shrinkage is much less
-        WavCoeffs_L[dir][i] *=
-            (SQR(sfaved[i]) + SQR(sf)) / (sfaved[i] + sf + eps);
-    } // now luminance coefficients are denoised
-
-#else
-
-    for (int i = 0; i < W_L * H_L; ++i) {
-        float sf = sfave[i];
-
-        // use smoothed shrinkage unless local shrinkage is much less
-        WavCoeffs_L[dir][i] *=
-            (SQR(sfaved[i]) + SQR(sf)) / (sfaved[i] + sf + eps);
-
-    } // now luminance coefficients are denoised
-
-#endif
+    // now luminance coefficients are denoised
+    kernels.apply_shrink(WavCoeffs_L[dir], sfave, sfaved, W_L * H_L);
 }
 
 void ShrinkAllAB(double scale, wavelet_decomposition &WaveletCoeffs_L,
@@ -736,8 +660,6 @@ void ShrinkAllAB(double scale, wavelet_decomposition &WaveletCoeffs_L,
 
 {
     // simple wavelet shrinkage
-    const float eps = 0.01f;
-
     if (autoch && noisevar_ab <= 0.001f) {
         noisevar_ab = 0.02f;
     }
@@ -763,95 +685,17 @@ void ShrinkAllAB(double scale, wavelet_decomposition &WaveletCoeffs_L,
 
     if (noisevar_ab > 0.001f) {
         madab = useNoiseCCurve ? madab : madab * noisevar_ab;
-#ifdef __SSE2__
-        __m128 onev = _mm_set1_ps(1.f);
-        __m128 mad_abrv = _mm_set1_ps(madab);
-
-        __m128 rmadLm9v = onev / _mm_set1_ps(mad_L * 9.f);
-        __m128 mad_abv;
-        __m128 mag_Lv, mag_abv;
-        int coeffloc_ab;
-
-        for (coeffloc_ab = 0; coeffloc_ab < H_ab * W_ab - 3; coeffloc_ab += 4) {
-            mad_abv = LVFU(noisevarchrom[coeffloc_ab]) * mad_abrv;
-
-            mag_Lv = LVFU(WavCoeffs_L[dir][coeffloc_ab]);
-            mag_abv = SQRV(LVFU(WavCoeffs_ab[dir][coeffloc_ab]));
-            mag_Lv = (SQRV(mag_Lv))*rmadLm9v;
-            _mm_storeu_ps(&sfaveab[coeffloc_ab],
-                          (onev - xexpf(-(mag_abv / mad_abv) - (mag_Lv))));
-        }
-
-        // few remaining pixels
-        for (; coeffloc_ab < H_ab * W_ab; ++coeffloc_ab) {
-            float mag_L = SQR(WavCoeffs_L[dir][coeffloc_ab]);
-            float mag_ab = SQR(WavCoeffs_ab[dir][coeffloc_ab]);
-            sfaveab[coeffloc_ab] =
-                (1.f - xexpf(-(mag_ab / (noisevarchrom[coeffloc_ab] * madab)) -
-                             (mag_L / (9.f * mad_L))));
-        } // now chrominance coefficients are denoised
-
-#else
-
-        for (int i = 0; i < H_ab; ++i) {
-            for (int j = 0; j < W_ab; ++j) {
-                int coeffloc_ab = i * W_ab + j;
-                float mag_L = SQR(WavCoeffs_L[dir][coeffloc_ab]);
-                float mag_ab = SQR(WavCoeffs_ab[dir][coeffloc_ab]);
-                sfaveab[coeffloc_ab] =
-                    (1.f -
-                     xexpf(-(mag_ab / (noisevarchrom[coeffloc_ab] * madab)) -
-                           (mag_L / (9.f * mad_L))));
-            }
-        } // now chrominance coefficients are denoised
-
-#endif
+        const denoise::Kernels &kernels = denoise::get_kernels();
+        kernels.shrink_AB(WavCoeffs_L[dir], WavCoeffs_ab[dir], noisevarchrom,
+                          madab, mad_L, sfaveab, W_ab * H_ab);
 
         const int blur_rad = max(1, int((level + 2) / scale));
         boxblur(sfaveab, sfaveabd, blurBuffer, blur_rad, blur_rad, W_ab,
                 H_ab); // increase smoothness by locally averaging shrinkage
-#ifdef __SSE2__
-        __m128 epsv = _mm_set1_ps(eps);
-        __m128 sfabv;
-        __m128 sfaveabv;
-
-        for (coeffloc_ab = 0; coeffloc_ab < H_ab * W_ab - 3; coeffloc_ab += 4) {
-            sfabv = LVFU(sfaveab[coeffloc_ab]);
-            sfaveabv = LVFU(sfaveabd[coeffloc_ab]);
-
-            // use smoothed shrinkage unless local shrinkage is much less
-            _mm_storeu_ps(&WavCoeffs_ab[dir][coeffloc_ab],
-                          LVFU(WavCoeffs_ab[dir][coeffloc_ab]) *
-                              (SQRV(sfaveabv) + SQRV(sfabv)) /
-                              (sfaveabv + sfabv + epsv));
-        }
-
-        // few remaining pixels
-        for (; coeffloc_ab < H_ab * W_ab; ++coeffloc_ab) {
-            // modification Jacques feb 2013
-            float sfab = sfaveab[coeffloc_ab];
-
-            // use smoothed shrinkage unless local shrinkage is much less
-            WavCoeffs_ab[dir][coeffloc_ab] *=
-                (SQR(sfaveabd[coeffloc_ab]) + SQR(sfab)) /
-                (sfaveabd[coeffloc_ab] + sfab + eps);
-        } // now chrominance coefficients are denoised
-
-#else
-
-        for (int i = 0; i < H_ab; ++i) {
-            for (int j = 0; j < W_ab; ++j) {
-                int coeffloc_ab = i * W_ab + j;
-                float sfab = sfaveab[coeffloc_ab];
-
-                // use smoothed shrinkage unless local shrinkage is much less
-                WavCoeffs_ab[dir][coeffloc_ab] *=
-                    (SQR(sfaveabd[coeffloc_ab]) + SQR(sfab)) /
-                    (sfaveabd[coeffloc_ab] + sfab + eps);
-            } // now chrominance coefficients are denoised
-        }
 
-#endif
+        // now chrominance coefficients are denoised
+        kernels.apply_shrink(WavCoeffs_ab[dir], sfaveab, sfaveabd,
+                             W_ab * H_ab);
     }
 }
 
@@ -860,7 +704,7 @@ bool WaveletDenoiseAll_BiShrinkL(double scale,
                                  float *noisevarlum, float madL[8][3])
 {
     int maxlvl = min(WaveletCoeffs_L.maxlevel(), 5);
-    const float eps = 0.01f;
+    const denoise::Kernels &kernels = denoise::get_kernels();
 
     int maxWL = 0, maxHL = 0;
 
@@ -918,102 +762,17 @@ bool WaveletDenoiseAll_BiShrinkL(double scale,
                         float mad_Lr = madL[lvl][dir - 1];
 
                         float levelFactor = mad_Lr * 5.f / (lvl + 1);
-#ifdef __SSE2__
-                        __m128 mad_Lv;
-                        __m128 ninev = _mm_set1_ps(9.0f);
-                        __m128 epsv = _mm_set1_ps(eps);
-                        __m128 mag_Lv;
-                        __m128 levelFactorv = _mm_set1_ps(levelFactor);
-                        int coeffloc_L;
-
-                        for (coeffloc_L = 0; coeffloc_L < Hlvl_L * Wlvl_L - 3;
-                             coeffloc_L += 4) {
-                            mad_Lv =
-                                LVFU(noisevarlum[coeffloc_L]) * levelFactorv;
-                            mag_Lv = SQRV(LVFU(WavCoeffs_L[dir][coeffloc_L]));
-                            _mm_storeu_ps(
-                                &sfave[coeffloc_L],
-                                mag_Lv / (mag_Lv +
-                                          mad_Lv * xexpf(-mag_Lv /
-                                                         (mad_Lv * ninev)) +
-                                          epsv));
-                        }
+                        kernels.shrink_L(WavCoeffs_L[dir], noisevarlum,
+                                         levelFactor, sfave, Wlvl_L * Hlvl_L);
 
-                        for (; coeffloc_L < Hlvl_L * Wlvl_L; ++coeffloc_L) {
-                            float mag_L = SQR(WavCoeffs_L[dir][coeffloc_L]);
-                            sfave[coeffloc_L] =
-                                mag_L /
-                                (mag_L +
-                                 levelFactor * noisevarlum[coeffloc_L] *
-                                     xexpf(-mag_L / (9.f * levelFactor *
-                                                     noisevarlum[coeffloc_L])) +
-                                 eps);
-                        }
-
-#else
-
-                        for (int i = 0; i < Hlvl_L; ++i) {
-                            for (int j = 0; j < Wlvl_L; ++j) {
-
-                                int coeffloc_L = i * Wlvl_L + j;
-                                float mag_L = SQR(WavCoeffs_L[dir][coeffloc_L]);
-                                sfave[coeffloc_L] =
-                                    mag_L /
-                                    (mag_L +
-                                     levelFactor * noisevarlum[coeffloc_L] *
-                                         xexpf(-mag_L /
-                                               (9.f * levelFactor *
-                                                noisevarlum[coeffloc_L])) +
-                                     eps);
-                            }
-                        }
-
-#endif
                         const int blur_rad = max(1, int((lvl + 2) / scale));
                         boxblur(sfave, sfaved, blurBuffer, blur_rad, blur_rad,
                                 Wlvl_L, Hlvl_L); // increase smoothness by
                                                  // locally averaging shrinkage
-#ifdef __SSE2__
-                        __m128 sfavev;
-                        __m128 sf_Lv;
-
-                        for (coeffloc_L = 0; coeffloc_L < Hlvl_L * Wlvl_L - 3;
-                             coeffloc_L += 4) {
-                            sfavev = LVFU(sfaved[coeffloc_L]);
-                            sf_Lv = LVFU(sfave[coeffloc_L]);
-                            _mm_storeu_ps(&WavCoeffs_L[dir][coeffloc_L],
-                                          LVFU(WavCoeffs_L[dir][coeffloc_L]) *
-                                              (SQRV(sfavev) + SQRV(sf_Lv)) /
-                                              (sfavev + sf_Lv + epsv));
-                            // use smoothed shrinkage unless local shrinkage is
-                            // much less
-                        }
-
-                        // few remaining pixels
-                        for (; coeffloc_L < Hlvl_L * Wlvl_L; ++coeffloc_L) {
-                            float sf_L = sfave[coeffloc_L];
-                            // use smoothed shrinkage unless local shrinkage is
-                            // much less
-                            WavCoeffs_L[dir][coeffloc_L] *=
-                                (SQR(sfaved[coeffloc_L]) + SQR(sf_L)) /
-                                (sfaved[coeffloc_L] + sf_L + eps);
-                        } // now luminance coeffs are denoised
-
-#else
-
-                        for (int i = 0; i < Hlvl_L; ++i) {
-                            for (int j = 0; j < Wlvl_L; ++j) {
-                                int coeffloc_L = i * Wlvl_L + j;
-                                float sf_L = sfave[coeffloc_L];
-                                // use smoothed shrinkage unless local shrinkage
-                                // is much less
-                                WavCoeffs_L[dir][coeffloc_L] *=
-                                    (SQR(sfaved[coeffloc_L]) + SQR(sf_L)) /
-                                    (sfaved[coeffloc_L] + sf_L + eps);
-                            } // now luminance coeffs are denoised
-                        }
 
-#endif
+                        // now luminance coeffs are denoised
+                        kernels.apply_shrink(WavCoeffs_L[dir], sfave, sfaved,
+                                             Wlvl_L * Hlvl_L);
                     }
                 }
             }
@@ -1036,6 +795,7 @@ bool WaveletDenoiseAll_BiShrinkAB(double scale,
                                   bool autoch)
 {
     int maxlvl = WaveletCoeffs_L.maxlevel();
+    const denoise::Kernels &kernels = denoise::get_kernels();
 
     if (autoch && noisevar_ab <= 0.001f) {
         noisevar_ab = 0.02f;
@@ -1118,72 +878,11 @@ bool WaveletDenoiseAll_BiShrinkAB(double scale,
                                 : SQR(noisevar_ab) * madab[lvl][dir - 1];
 
                         if (noisevar_ab > 0.001f) {
-
-#ifdef __SSE2__
-                            __m128 onev = _mm_set1_ps(1.f);
-                            __m128 mad_abrv = _mm_set1_ps(mad_abr);
-                            __m128 rmad_Lm9v = onev / _mm_set1_ps(mad_Lr * 9.f);
-                            __m128 mad_abv;
-                            __m128 mag_Lv, mag_abv;
-                            __m128 tempabv;
-                            int coeffloc_ab;
-
-                            for (coeffloc_ab = 0;
-                                 coeffloc_ab < Hlvl_ab * Wlvl_ab - 3;
-                                 coeffloc_ab += 4) {
-                                mad_abv =
-                                    LVFU(noisevarchrom[coeffloc_ab]) * mad_abrv;
-
-                                tempabv = LVFU(WavCoeffs_ab[dir][coeffloc_ab]);
-                                mag_Lv = LVFU(WavCoeffs_L[dir][coeffloc_ab]);
-                                mag_abv = SQRV(tempabv);
-                                mag_Lv = SQRV(mag_Lv) * rmad_Lm9v;
-                                _mm_storeu_ps(
-                                    &WavCoeffs_ab[dir][coeffloc_ab],
-                                    tempabv * SQRV((onev -
-                                                    xexpf(-(mag_abv / mad_abv) -
-                                                          (mag_Lv)))));
-                            }
-
-                            // few remaining pixels
-                            for (; coeffloc_ab < Hlvl_ab * Wlvl_ab;
-                                 ++coeffloc_ab) {
-                                float mag_L =
-                                    SQR(WavCoeffs_L[dir][coeffloc_ab]);
-                                float mag_ab =
-                                    SQR(WavCoeffs_ab[dir][coeffloc_ab]);
-                                WavCoeffs_ab[dir][coeffloc_ab] *= SQR(
-                                    1.f -
-                                    xexpf(
-                                        -(mag_ab / (noisevarchrom[coeffloc_ab] *
-                                                    mad_abr)) -
-                                        (mag_L /
-                                         (9.f * mad_Lr))) /*satfactor_a*/);
-                            } // now chrominance coefficients are denoised
-
-#else
-
-                            for (int i = 0; i < Hlvl_ab; ++i) {
-                                for (int j = 0; j < Wlvl_ab; ++j) {
-                                    int coeffloc_ab = i * Wlvl_ab + j;
-
-                                    float mag_L =
-                                        SQR(WavCoeffs_L[dir][coeffloc_ab]);
-                                    float mag_ab =
-                                        SQR(WavCoeffs_ab[dir][coeffloc_ab]);
-
-                                    WavCoeffs_ab[dir][coeffloc_ab] *= SQR(
-                                        1.f -
-                                        xexpf(
-                                            -(mag_ab /
-                                              (noisevarchrom[coeffloc_ab] *
-                                               mad_abr)) -
-                                            (mag_L /
-                                             (9.f * mad_Lr))) /*satfactor_a*/);
-                                }
-                            } // now chrominance coefficients are denoised
-
-#endif
+                            // now chrominance coefficients are denoised
+                            kernels.shrink_AB_inplace(
+                                WavCoeffs_L[dir], WavCoeffs_ab[dir],
+                                noisevarchrom, mad_abr, mad_Lr,
+                                Wlvl_ab * Hlvl_ab);
                         }
                     }
                 }
@@ -1592,9 +1291,11 @@ void detail_recovery(int width, int height, LabImage *labdn,
                      float **fLbloxArray, size_t blox_array_size,
                      float params_Ldetail, int detail_thresh,
                      array2D<float> &tilemask_in, array2D<float> &tilemask_out,
-                     fftwf_plan *plan_forward_blox,
-                     fftwf_plan *plan_backward_blox, int max_numblox_W,
-                     double scale, bool denoise_aggressive)
+                     const FFTWPlanCache::Plan *plan_forward_blox,
+                     const FFTWPlanCache::Plan *plan_backward_blox,
+                     int max_numblox_W,
+                     double scale, bool denoise_aggressive,
+                     const CancelToken &cancel)
 {
     const auto compute_detail = [](float d) -> float {
         return SQR(static_cast<float>(SQR(100. - d) + 50. * (100. - d)) * TS *
@@ -1665,6 +1366,9 @@ void detail_recovery(int width, int height, LabImage *labdn,
 #endif
 
         for (int vblk = 0; vblk < numblox_H; ++vblk) {
+            if (cancel && cancel()) {
+                continue;
+            }
 
             int top = (vblk - blkrad) * offset;
             float *datarow = pBuf + blkrad * offset;
@@ -1740,7 +1444,7 @@ void detail_recovery(int width, int height, LabImage *labdn,
             //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
             // fftwf_print_plan (plan_forward_blox);
             int plan_idx = int(numblox_W != max_numblox_W);
-            fftwf_execute_r2r(plan_forward_blox[plan_idx], Lblox,
+            fftwf_execute_r2r(plan_forward_blox[plan_idx].get(), Lblox,
                               fLblox); // DCT an entire row of tiles
             //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
             // now process the vblk row of blocks for noise reduction
@@ -1752,7 +1456,7 @@ void detail_recovery(int width, int height, LabImage *labdn,
             //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
             // now perform inverse FT of an entire row of blocks
-            fftwf_execute_r2r(plan_backward_blox[plan_idx], fLblox,
+            fftwf_execute_r2r(plan_backward_blox[plan_idx].get(), fLblox,
                               fLblox); // for DCT
             int topproc = (vblk - blkrad) * offset;
             // add row of blocks to output image tile
@@ -2117,41 +1821,33 @@ void RGB_denoise(ImProcData &im, int kall, Imagefloat *src, Imagefloat *dst,
                 (offset)) +
             2 * blkrad;
 
-        // these are needed only for creation of the plans and will be freed
-        // before entering the parallel loop
-        fftwf_plan plan_forward_blox[2];
-        fftwf_plan plan_backward_blox[2];
+        // the plans come from the shared cache (and the wisdom of the
+        // previous sessions), so measuring is needed only for new sizes
+        FFTWPlanCache::Plan plan_forward_blox[2];
+        FFTWPlanCache::Plan plan_backward_blox[2];
 
         if (denoiseLuminance) {
+            // only used for the alignment, the buffers of the parallel loop
+            // are allocated in the same way
             float *Lbloxtmp = reinterpret_cast<float *>(
                 fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
             float *fLbloxtmp = reinterpret_cast<float *>(
                 fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
 
-            int nfwd[2] = {TS, TS};
-
-            // for DCT:
-            fftw_r2r_kind fwdkind[2] = {FFTW_REDFT10, FFTW_REDFT10};
-            fftw_r2r_kind bwdkind[2] = {FFTW_REDFT01, FFTW_REDFT01};
+            auto cache = FFTWPlanCache::getInstance();
+            const int numblox[2] = {max_numblox_W, min_numblox_W};
 
             // Creating the plans with FFTW_MEASURE instead of FFTW_ESTIMATE
-            // speeds up the execute a bit
-            plan_forward_blox[0] =
-                fftwf_plan_many_r2r(2, nfwd, max_numblox_W, Lbloxtmp, nullptr,
-                                    1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS,
-                                    fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-            plan_backward_blox[0] =
-                fftwf_plan_many_r2r(2, nfwd, max_numblox_W, fLbloxtmp, nullptr,
-                                    1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS,
-                                    bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-            plan_forward_blox[1] =
-                fftwf_plan_many_r2r(2, nfwd, min_numblox_W, Lbloxtmp, nullptr,
-                                    1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS,
-                                    fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-            plan_backward_blox[1] =
-                fftwf_plan_many_r2r(2, nfwd, min_numblox_W, fLbloxtmp, nullptr,
-                                    1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS,
-                                    bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+            // speeds up the execute a bit. The inverse DCT is executed in
+            // place
+            for (int i = 0; i < 2; ++i) {
+                plan_forward_blox[i] = cache->many_r2r_2d(
+                    TS, TS, numblox[i], Lbloxtmp, fLbloxtmp, FFTW_REDFT10,
+                    FFTW_REDFT10, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+                plan_backward_blox[i] = cache->many_r2r_2d(
+                    TS, TS, numblox[i], fLbloxtmp, fLbloxtmp, FFTW_REDFT01,
+                    FFTW_REDFT01, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+            }
             fftwf_free(Lbloxtmp);
             fftwf_free(fLbloxtmp);
         }
@@ -2743,7 +2439,7 @@ void RGB_denoise(ImProcData &im, int kall, Imagefloat *src, Imagefloat *dst,
                             delete bdecomp;
 
                             if (!memoryAllocationFailed) {
-                                if (denoiseLuminance) {
+                                if (denoiseLuminance && !im.cancelled()) {
                                     int edge = 0;
 
                                     if (nrQuality == QUALITY_STANDARD) {
@@ -2798,7 +2494,7 @@ void RGB_denoise(ImProcData &im, int kall, Imagefloat *src, Imagefloat *dst,
                     if (!memoryAllocationFailed) {
                         // wavelet denoised L channel
                         //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                        if (denoiseLuminance) {
+                        if (denoiseLuminance && Lin) {
                             // now do detail recovery using block DCT to detect
                             // patterns missed by wavelet denoise
                             // blocks are not the same thing as tiles!
@@ -2809,7 +2505,7 @@ void RGB_denoise(ImProcData &im, int kall, Imagefloat *src, Imagefloat *dst,
                                 dnparams.luminanceDetailThreshold, tilemask_in,
                                 tilemask_out, plan_forward_blox,
                                 plan_backward_blox, max_numblox_W, scale,
-                                nrQuality == QUALITY_HIGH);
+                                nrQuality == QUALITY_HIGH, im.cancel);
                         }
                         //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
                         // transform denoised "Lab" to output RGB
@@ -3034,13 +2730,6 @@ void RGB_denoise(ImProcData &im, int kall, Imagefloat *src, Imagefloat *dst,
             }
         }
 
-        if (denoiseLuminance) {
-            // destroy the plans
-            fftwf_destroy_plan(plan_forward_blox[0]);
-            fftwf_destroy_plan(plan_backward_blox[0]);
-            fftwf_destroy_plan(plan_forward_blox[1]);
-            fftwf_destroy_plan(plan_backward_blox[1]);
-        }
         // } while (memoryAllocationFailed && numTries < 2 &&
         // (options.rgbDenoiseThreadLimit == 0) && !ponder);
 
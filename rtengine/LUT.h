@@ -47,6 +47,12 @@
  *
  *          LUT<float> my_lut (10,0); // this will extrapolate on either side
  *
+ *      whole rows or planes of values are interpolated at once (with
+ *      gathers on processors supporting them) by:
+ *
+ *          my_lut.apply(in, out, n);         // out[i] = my_lut[in[i]]
+ *          my_lut.apply(rows, W, H, 65535.f); // rows[y][x] = my_lut[rows[y][x] * 65535]
+ *
  *      shotcuts:
  *
  *          LUTf stands for LUT<float>
@@ -68,6 +74,7 @@
 #include <glibmm.h>
 #endif
 
+#include "lut_kernels.h"
 #include "noncopyable.h"
 #include "opthelper.h"
 #include "rt_math.h"
@@ -515,6 +522,53 @@ public:
         return (p1 + p2 * diff);
     }
 
+    /// interpolates the n values in[i] * scale, with the same results as
+    /// operator[](float) (and so honouring all the clipping flags, unlike the
+    /// vfloat operators). in and out can be the same array
+    template <typename U = T, typename = typename std::enable_if<
+                                  std::is_same<U, float>::value>::type>
+    void apply(const float *in, float *out, int n, float scale = 1.f) const
+    {
+        const auto &kernels = rtengine::lut::get_kernels();
+        if (kernels.interpolate) {
+            const rtengine::lut::Table table = {data, int(size), int(clip)};
+            kernels.interpolate(table, scale, n, in, out);
+            return;
+        }
+
+        int i = 0;
+#ifdef __SSE2__
+        if (clip == (LUT_CLIP_BELOW | LUT_CLIP_ABOVE)) {
+            const vfloat scalev = F2V(scale);
+            for (; i < n - 3; i += 4) {
+                STVFU(out[i], (*this)[LVFU(in[i]) * scalev]);
+            }
+        } else if (clip == LUT_CLIP_BELOW) {
+            const vfloat scalev = F2V(scale);
+            for (; i < n - 3; i += 4) {
+                STVFU(out[i], cb(LVFU(in[i]) * scalev));
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            out[i] = (*this)[in[i] * scale];
+        }
+    }
+
+    /// in-place version of apply() for the H rows of W values of a plane
+    template <typename U = T, typename = typename std::enable_if<
+                                  std::is_same<U, float>::value>::type>
+    void apply(float **rows, int W, int H, float scale = 1.f,
+               bool multiThread = true) const
+    {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) if (multiThread)
+#endif
+        for (int y = 0; y < H; ++y) {
+            apply(rows[y], rows[y], W, scale);
+        }
+    }
+
 #ifndef NDEBUG
     // Debug facility ; dump the content of the LUT in a file. No control of the
     // filename is done
@@ -681,6 +735,29 @@ public:
         maxsv = F2V(size - 2);
         sizeiv = _mm_set1_epi32((int)(size - 1));
         sizev = F2V(size - 1);
+#endif
+    }
+
+    /// uses an external buffer of s + 3 elements (like the ones allocated by
+    /// the LUT itself), which is not freed by the LUT
+    void share(T *buffer, int s, int flags = LUT_CLIP_BELOW | LUT_CLIP_ABOVE)
+    {
+        if (owner && data) {
+            delete[] data;
+        }
+
+        dirty = false;
+        clip = flags;
+        data = buffer;
+        owner = 0;
+        size = s;
+        upperBound = size - 1;
+        maxs = size - 2;
+        maxsf = (float)maxs;
+#ifdef __SSE2__
+        maxsv = F2V(size - 2);
+        sizeiv = _mm_set1_epi32((int)(size - 1));
+        sizev = F2V(size - 1);
 #endif
     }
 };
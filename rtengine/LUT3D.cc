@@ -36,7 +36,9 @@ void LUT3D::init(int dim, initializer &f, bool input_is_01)
     dim_minus_one_ = dim - 1;
     input_is_01_ = input_is_01;
 
-    lut_.resize(SQR(dim_) * dim_ * 3);
+    // one float of padding, for the 4-wide loads of apply()
+    lut_.resize(SQR(dim_) * dim_ * 3 + 1);
+    lut_.data[SQR(dim_) * dim_ * 3] = 0.f;
     size_t index = 0;
     float r, g, b;
     for (int i = 0; i < dim_; ++i) {
@@ -71,6 +73,66 @@ bool LUT3D::operator()(float &r, float &g, float &b)
 
 LUT3D::operator bool() const { return !lut_.isEmpty(); }
 
+void LUT3D::apply(const float *src, float *dst, int n) const
+{
+    const float dimMinusOne = dim_minus_one_;
+    const float scale = input_is_01_ ? dimMinusOne : dimMinusOne / 65535.f;
+    const int sR = 3 * dim_ * dim_;
+    const int sG = 3 * dim_;
+    const int sB = 3;
+    const float *lut = lut_.data;
+
+    for (int i = 0; i < n; ++i, src += 3, dst += 3) {
+        // NaNs become 0
+        const float r = LIM(src[0] * scale, 0.f, dimMinusOne);
+        const float g = LIM(src[1] * scale, 0.f, dimMinusOne);
+        const float b = LIM(src[2] * scale, 0.f, dimMinusOne);
+        const int ir = r;
+        const int ig = g;
+        const int ib = b;
+        const float fx = r - ir;
+        const float fy = g - ig;
+        const float fz = b - ib;
+        // offsets of the upper corner on each axis (0 on the last samples,
+        // where the weight is 0 anyway)
+        const int hR = ir < dim_ - 1 ? sR : 0;
+        const int hG = ig < dim_ - 1 ? sG : 0;
+        const int hB = ib < dim_ - 1 ? sB : 0;
+
+        // the tetrahedron goes from the lower corner to the upper one,
+        // moving first along the axis with the largest fraction, then along
+        // the two largest ones
+        const float fmax = max(fx, fy, fz);
+        const float fmin = min(fx, fy, fz);
+        const float fmid = (fx + fy + fz) - fmax - fmin;
+        const int first = fx == fmax ? hR : (fy == fmax ? hG : hB);
+        const int last = fx == fmin ? hR : (fy == fmin ? hG : hB);
+        const int all = hR + hG + hB;
+        const float *p = lut + ir * sR + ig * sG + ib * sB;
+
+#ifdef __SSE2__
+        // the 4th lane is the next lut entry, and it is not used
+        const vfloat v = F2V(1.f - fmax) * LVFU(p[0]) +
+                         F2V(fmax - fmid) * LVFU(p[first]) +
+                         F2V(fmid - fmin) * LVFU(p[all - last]) +
+                         F2V(fmin) * LVFU(p[all]);
+        float out[4];
+        STVFU(out[0], v);
+        dst[0] = out[0];
+        dst[1] = out[1];
+        dst[2] = out[2];
+#else
+        const float w0 = 1.f - fmax;
+        const float w1 = fmax - fmid;
+        const float w2 = fmid - fmin;
+        for (int c = 0; c < 3; ++c) {
+            dst[c] = w0 * p[c] + w1 * p[first + c] + w2 * p[all - last + c] +
+                     fmin * p[all + c];
+        }
+#endif
+    }
+}
+
 // Tetrahedral interpolation, adapted from OpenColorIO
 //  https://github.com/AcademySoftwareFoundation/OpenColorIO
 //
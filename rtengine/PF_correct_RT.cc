@@ -29,6 +29,10 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "../rtgui/myflatcurve.h"
 #include "StopWatch.h"
 #include "gauss.h"
@@ -42,15 +46,88 @@
 namespace rtengine {
 
 namespace {
+
+// Chrominance weighted average of the a and b channels over a
+// (2 * halfwin - 1)^2 window (clipped at the borders), for the pixels of rows
+// [y0, y1) with a weight below threshfactor. Uses running sums, first along
+// the columns and then along each row, so the cost doesn't depend on the
+// window size. The sums are kept in double precision, as they are updated by
+// adding and subtracting values over the whole image.
+void fringe_window_average(const Imagefloat *lab, const float *fringe,
+                           float threshfactor, int halfwin, int y0, int y1,
+                           float **outa, float **outb)
+{
+    const int width = lab->getWidth();
+    const int height = lab->getHeight();
+
+    std::vector<double> colw(width, 0.0);
+    std::vector<double> cola(width, 0.0);
+    std::vector<double> colb(width, 0.0);
+
+    const auto add_row = [&](int i, double sign) -> void {
+        const float *wt = fringe + i * width;
+        const float *a = lab->r(i);
+        const float *b = lab->b(i);
+        for (int j = 0; j < width; ++j) {
+            colw[j] += sign * wt[j];
+            cola[j] += sign * (wt[j] * a[j]);
+            colb[j] += sign * (wt[j] * b[j]);
+        }
+    };
+
+    // start one row above the window of y0, which is removed in the first
+    // iteration
+    for (int i = std::max(0, y0 - halfwin);
+         i < std::min(height, y0 + halfwin - 1); ++i) {
+        add_row(i, 1.0);
+    }
+
+    for (int i = y0; i < y1; ++i) {
+        if (i + halfwin - 1 < height) {
+            add_row(i + halfwin - 1, 1.0);
+        }
+        if (i - halfwin >= 0) {
+            add_row(i - halfwin, -1.0);
+        }
+
+        double norm = 0.0, atot = 0.0, btot = 0.0;
+        for (int j = 0; j < std::min(width, halfwin - 1); ++j) {
+            norm += colw[j];
+            atot += cola[j];
+            btot += colb[j];
+        }
+
+        for (int j = 0; j < width; ++j) {
+            if (j + halfwin - 1 < width) {
+                norm += colw[j + halfwin - 1];
+                atot += cola[j + halfwin - 1];
+                btot += colb[j + halfwin - 1];
+            }
+            if (j - halfwin >= 0) {
+                norm -= colw[j - halfwin];
+                atot -= cola[j - halfwin];
+                btot -= colb[j - halfwin];
+            }
+
+            // test for pixel darker than some fraction of neighbourhood
+            // ave, near an edge, more saturated than average
+            if (fringe[i * width + j] < threshfactor) {
+                outa[i][j] = atot / norm;
+                outb[i][j] = btot / norm;
+            }
+        }
+    }
+}
+
 // Defringe in Lab mode
 void PF_correct_RT(const rtengine::ProcParams *params, Imagefloat *lab,
                    double radius, int thresh, bool multiThread)
 {
     BENCHFUN
-    std::unique_ptr<FlatCurve> chCurve;
+    CurveLUT chCurve;
     if (params->defringe.huecurve.size() &&
         FlatCurveType(params->defringe.huecurve.at(0)) > FCT_Linear) {
-        chCurve.reset(new FlatCurve(params->defringe.huecurve));
+        chCurve.set(FlatCurve(params->defringe.huecurve), multiThread);
     }
 
     const int width = lab->getWidth(), height = lab->getHeight();
@@ -104,7 +181,7 @@ void PF_correct_RT(const rtengine::ProcParams *params, Imagefloat *lab,
                     const float HH = xatan2f(lab->b(i, j), lab->r(i, j));
 #endif
                     float chparam =
-                        chCurve->getVal((Color::huelab_to_huehsv2(HH))) -
+                        chCurve(Color::huelab_to_huehsv2(HH)) -
                         0.5f; // get C=f(H)
 
                     if (chparam < 0.f) {
@@ -142,89 +219,36 @@ void PF_correct_RT(const rtengine::ProcParams *params, Imagefloat *lab,
             1.f / (SQR(thresh / 33.f) * chromave * 5.0f + chromave);
         const int halfwin = std::ceil(2 * radius) + 1;
 
-// Issue 1674:
-// often, colour fringe is not evenly distributed, e.g. a lot in contrasty
-// regions and none in the sky. so it's better to schedule dynamic and let every
-// thread only process 16 rows, to avoid running big threads out of work
-// Measured it and in fact gives better performance than without
-// schedule(dynamic,16). Of course, there could be a better choice for the
-// chunk_size than 16 Issue 1972: Split this loop in three parts to avoid most
-// of the min and max-operations
+        // neighbourhood average of pixels weighted by chrominance. The
+        // results go to tmpa and tmpb (no longer needed), so that all the
+        // averages are computed from the original values
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 16)
+#pragma omp parallel if (multiThread)
+        {
+            const int tid = omp_get_thread_num();
+            const int nthreads = omp_get_num_threads();
+            const int blk = height / nthreads;
+            const int y0 = tid * blk;
+            const int y1 = tid < nthreads - 1 ? y0 + blk : height;
+            fringe_window_average(lab, fringe.get(), threshfactor, halfwin, y0,
+                                  y1, tmpa, tmpb);
+        }
+#else
+        fringe_window_average(lab, fringe.get(), threshfactor, halfwin, 0,
+                              height, tmpa, tmpb);
 #endif
 
+#ifdef _OPENMP
+#pragma omp parallel for if (multiThread)
+#endif
         for (int i = 0; i < height; i++) {
-            int j = 0;
-            for (; j < halfwin - 1; j++) {
-
-                // test for pixel darker than some fraction of neighbourhood
-                // ave, near an edge, more saturated than average
-                if (fringe[i * width + j] < threshfactor) {
-                    float atot = 0.f, btot = 0.f, norm = 0.f;
-
-                    for (int i1 = std::max(0, i - halfwin + 1);
-                         i1 < std::min(height, i + halfwin); i1++)
-                        for (int j1 = 0; j1 < j + halfwin; j1++) {
-                            // neighbourhood average of pixels weighted by
-                            // chrominance
-                            const float wt = fringe[i1 * width + j1];
-                            atot += wt * lab->r(i1, j1);
-                            btot += wt * lab->b(i1, j1);
-                            norm += wt;
-                        }
-
-                    lab->r(i, j) = atot / norm;
-                    lab->b(i, j) = btot / norm;
-                }
-            }
-
-            for (; j < width - halfwin + 1; j++) {
-
-                // test for pixel darker than some fraction of neighbourhood
-                // ave, near an edge, more saturated than average
-                if (fringe[i * width + j] < threshfactor) {
-                    float atot = 0.f, btot = 0.f, norm = 0.f;
-
-                    for (int i1 = std::max(0, i - halfwin + 1);
-                         i1 < std::min(height, i + halfwin); i1++)
-                        for (int j1 = j - halfwin + 1; j1 < j + halfwin; j1++) {
-                            // neighbourhood average of pixels weighted by
-                            // chrominance
-                            const float wt = fringe[i1 * width + j1];
-                            atot += wt * lab->r(i1, j1);
-                            btot += wt * lab->b(i1, j1);
-                            norm += wt;
-                        }
-
-                    lab->r(i, j) = atot / norm;
-                    lab->b(i, j) = btot / norm;
-                }
-            }
-
-            for (; j < width; j++) {
-
-                // test for pixel darker than some fraction of neighbourhood
-                // ave, near an edge, more saturated than average
+            for (int j = 0; j < width; j++) {
                 if (fringe[i * width + j] < threshfactor) {
-                    float atot = 0.f, btot = 0.f, norm = 0.f;
-
-                    for (int i1 = std::max(0, i - halfwin + 1);
-                         i1 < std::min(height, i + halfwin); i1++)
-                        for (int j1 = j - halfwin + 1; j1 < width; j1++) {
-                            // neighbourhood average of pixels weighted by
-                            // chrominance
-                            const float wt = fringe[i1 * width + j1];
-                            atot += wt * lab->r(i1, j1);
-                            btot += wt * lab->b(i1, j1);
-                            norm += wt;
-                        }
-
-                    lab->r(i, j) = atot / norm;
-                    lab->b(i, j) = btot / norm;
+                    lab->r(i, j) = tmpa[i][j];
+                    lab->b(i, j) = tmpb[i][j];
                 }
             }
-        } // end of ab channel averaging
+        }
     }
 }
 
@@ -0,0 +1,67 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "alignedbuffer.h"
+#include "settings.h"
+#include <cstddef>
+#include <glib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+bool has_numa_nodes()
+{
+#ifdef __linux__
+    return g_file_test("/sys/devices/system/node/node1", G_FILE_TEST_IS_DIR);
+#else
+    return false;
+#endif
+}
+
+} // namespace
+
+void first_touch(void *data, size_t size)
+{
+#ifdef _OPENMP
+    static const bool numa = has_numa_nodes();
+    if (!numa || !settings || !settings->numa_first_touch) {
+        return;
+    }
+
+    // the memory is not initialized yet, so writing to it is harmless. With
+    // the default policy of the kernel, every page is placed on the node of
+    // the thread which touches it first
+    constexpr size_t page = 4096;
+    char *p = static_cast<char *>(data);
+    const ptrdiff_t n = (size + page - 1) / page;
+
+#pragma omp parallel for schedule(static) if (!omp_in_parallel())
+    for (ptrdiff_t i = 0; i < n; ++i) {
+        p[i * page] = 0;
+    }
+#endif
+}
+
+} // namespace rtengine
@@ -20,21 +20,86 @@
  */
 #pragma once
 
+#include "planepool.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <utility>
 
 namespace rtengine {
 
-// Aligned buffer that should be faster
+/** @brief Distribute the first touch of the pages of a fresh allocation among
+ * the OpenMP threads, in contiguous bands (i.e. bands of rows for the image
+ * planes), so that on NUMA machines each band is placed on the node of the
+ * thread which typically processes it. Does nothing on single node machines
+ * or when settings->numa_first_touch is off.
+ */
+void first_touch(void *data, size_t size);
+
+// Aligned buffer that should be faster. The large blocks come from the
+// PlanePool, so that the pages of the temporary planes are reused
 template <class T> class AlignedBuffer {
 
 private:
+    static constexpr size_t FIRST_TOUCH_MIN_SIZE = size_t(4) << 20;
+
     void *real;
     char alignment;
     size_t allocatedSize;
     int unitSize;
+    size_t capacity; // of the block of the PlanePool, 0 if from malloc
+
+    void release()
+    {
+        if (capacity) {
+            PlanePool::getInstance()->release(real, capacity);
+        } else if (real) {
+            free(real);
+        }
+        real = nullptr;
+        capacity = 0;
+    }
+
+    // replaces the block with one of at least space bytes, keeping its
+    // content like realloc does. fresh is set if the new block has never
+    // been used
+    bool reallocate(size_t space, bool &fresh)
+    {
+        const bool empty = !real;
+        void *r = nullptr;
+        size_t cap = 0;
+        bool pooled_fresh = true;
+
+        if (space >= PlanePool::MIN_SIZE) {
+            if (capacity >= space && capacity / 2 <= space) {
+                return true;
+            }
+            r = PlanePool::getInstance()->acquire(space, cap, pooled_fresh);
+        } else if (!capacity) {
+            r = realloc(real, space);
+            if (r) {
+                real = r;
+                fresh = empty;
+            }
+            return r != nullptr;
+        } else {
+            r = malloc(space);
+        }
+        if (!r) {
+            return false;
+        }
+
+        if (!empty) {
+            memcpy(r, real, std::min(allocatedSize + alignment, space));
+        }
+        release();
+        real = r;
+        capacity = cap;
+        fresh = empty && pooled_fresh;
+        return true;
+    }
 
 public:
     T *data;
@@ -48,19 +113,14 @@ public:
      */
     AlignedBuffer(size_t size = 0, size_t align = 16)
         : real(nullptr), alignment(align), allocatedSize(0), unitSize(0),
-          data(nullptr)
+          capacity(0), data(nullptr)
     {
         if (size) {
             resize(size);
         }
     }
 
-    ~AlignedBuffer()
-    {
-        if (real) {
-            free(real);
-        }
-    }
+    ~AlignedBuffer() { release(); }
 
     /** @brief Return true if there's no memory allocated
      */
@@ -77,10 +137,7 @@ public:
     bool resize(size_t size, int structSize = 0)
     {
         if (size == 0) {
-            if (real) {
-                free(real);
-            }
-            real = nullptr;
+            release();
             data = nullptr;
             allocatedSize = 0;
             unitSize = 0;
@@ -90,22 +147,25 @@ public:
         size_t elemsz = structSize ? structSize : sizeof(T);
         size_t amount = size * elemsz;
         if (amount != allocatedSize) {
-            unitSize = elemsz;
-            allocatedSize = amount;
             size_t space = amount + alignment;
-            real = realloc(real, space);
-            void *p = real;
+            bool fresh = false;
+            void *p = nullptr;
+            if (reallocate(space, fresh)) {
+                p = real;
+            }
             if (!p || (alignment && !std::align(alignment, amount, p, space))) {
-                if (real) {
-                    free(real);
-                    real = nullptr;
-                    data = nullptr;
-                    allocatedSize = 0;
-                    unitSize = 0;
-                    return false;
-                }
+                release();
+                data = nullptr;
+                allocatedSize = 0;
+                unitSize = 0;
+                return false;
             }
+            unitSize = elemsz;
+            allocatedSize = amount;
             data = static_cast<T *>(p);
+            if (fresh && amount >= FIRST_TOUCH_MIN_SIZE) {
+                first_touch(p, amount);
+            }
         }
 
         return true;
@@ -116,6 +176,7 @@ public:
         std::swap(real, other.real);
         std::swap(alignment, other.alignment);
         std::swap(allocatedSize, other.allocatedSize);
+        std::swap(capacity, other.capacity);
         std::swap(data, other.data);
     }
 
@@ -28,6 +28,7 @@
 
 #include "../rtgui/multilangmgr.h"
 #include "StopWatch.h"
+#include "cpuinfo.h"
 #include "median.h"
 #include "opthelper.h"
 #include "rawimagesource.h"
@@ -35,13 +36,69 @@
 #include "rtengine.h"
 #include "sleef.h"
 
+// this allows to pass AMAZETS to the code. On some machines larger AMAZETS is
+// faster. If AMAZETS is undefined, the tile size is 160 (the fastest on modern
+// x86/64 machines), or AMAZETS_LARGE on processors with at least 2MB of L2
+// cache: larger tiles waste less work on the borders, but need about 60 bytes
+// of working set per pixel
+#ifndef AMAZETS
+#define AMAZETS 160
+#define AMAZETS_LARGE 224
+#else
+#define AMAZETS_LARGE AMAZETS
+#endif
+
+// this file is also compiled for the instruction sets in
+// PROC_DISPATCH_TARGETS (see demosaic_avx2.cc), which define ART_SIMD_VARIANT
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_VARIANT(name) name##_base
+#define ART_SIMD_BASE_BUILD
+#endif
+
 namespace rtengine {
 
+#ifdef ART_SIMD_BASE_BUILD
+
 void RawImageSource::amaze_demosaic_RT(int winx, int winy, int winw, int winh,
                                        const array2D<float> &rawData,
                                        array2D<float> &red,
                                        array2D<float> &green,
                                        array2D<float> &blue)
+{
+    typedef void (RawImageSource::*Fn)(
+        int, int, int, int, const array2D<float> &, array2D<float> &,
+        array2D<float> &, array2D<float> &);
+
+    const bool large = get_l2_cache_size() >= 2 * 1024 * 1024;
+    Fn fn = large ? &RawImageSource::amaze_demosaic_RT_base<AMAZETS_LARGE>
+                  : &RawImageSource::amaze_demosaic_RT_base<AMAZETS>;
+
+    switch (get_simd_level()) {
+#ifdef ART_SIMD_DISPATCH_AVX512
+    case SIMDLevel::AVX512:
+        fn = large ? &RawImageSource::amaze_demosaic_RT_avx512<AMAZETS_LARGE>
+                   : &RawImageSource::amaze_demosaic_RT_avx512<AMAZETS>;
+        break;
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX2
+    case SIMDLevel::AVX2:
+        fn = large ? &RawImageSource::amaze_demosaic_RT_avx2<AMAZETS_LARGE>
+                   : &RawImageSource::amaze_demosaic_RT_avx2<AMAZETS>;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    (this->*fn)(winx, winy, winw, winh, rawData, red, green, blue);
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+template <int TS>
+void RawImageSource::ART_SIMD_VARIANT(amaze_demosaic_RT)(
+    int winx, int winy, int winw, int winh, const array2D<float> &rawData,
+    array2D<float> &red, array2D<float> &green, array2D<float> &blue)
 {
     BENCHFUN
 
@@ -57,16 +114,10 @@ void RawImageSource::amaze_demosaic_RT(int winx, int winy, int winw, int winh,
     const float clip_pt = 1.0 / initialGain;
     const float clip_pt8 = 0.8 / initialGain;
 
-// this allows to pass AMAZETS to the code. On some machines larger AMAZETS is
-// faster If AMAZETS is undefined it will be set to 160, which is the fastest on
-// modern x86/64 machines
-#ifndef AMAZETS
-#define AMAZETS 160
-#endif
     // Tile size; the image is processed in square tiles to lower memory
     // requirements and facilitate multi-threading We assure that Tile size is a
     // multiple of 32 in the range [96;992]
-    constexpr int ts = (AMAZETS & 992) < 96 ? 96 : (AMAZETS & 992);
+    constexpr int ts = (TS & 992) < 96 ? 96 : (TS & 992);
     constexpr int tsh = ts / 2; // half of Tile size
 
     // offset of R pixel within a Bayer quartet
@@ -2594,4 +2645,15 @@ void RawImageSource::amaze_demosaic_RT(int winx, int winy, int winw, int winh,
         plistener->setProgress(1.0);
     }
 }
+
+template void RawImageSource::ART_SIMD_VARIANT(amaze_demosaic_RT)<AMAZETS>(
+    int, int, int, int, const array2D<float> &, array2D<float> &,
+    array2D<float> &, array2D<float> &);
+#if AMAZETS_LARGE != AMAZETS
+template void
+RawImageSource::ART_SIMD_VARIANT(amaze_demosaic_RT)<AMAZETS_LARGE>(
+    int, int, int, int, const array2D<float> &, array2D<float> &,
+    array2D<float> &, array2D<float> &);
+#endif
+
 } // namespace rtengine
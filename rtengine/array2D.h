@@ -60,6 +60,7 @@
 #include <csignal> // for raise()
 #include <cstdio>
 #include <cstring>
+#include <utility>
 
 #include "alignedbuffer.h"
 #include "noncopyable.h"
@@ -284,6 +285,20 @@ public:
         }
     }
 
+    void swap(array2D<T> &other)
+    {
+        std::swap(width_, other.width_);
+        std::swap(height_, other.height_);
+        const unsigned int flgs = flags_;
+        flags_ = other.flags_;
+        other.flags_ = flgs;
+        const bool owner = owner_;
+        owner_ = other.owner_;
+        other.owner_ = owner;
+        std::swap(ptr_, other.ptr_);
+        buf_.swap(other.buf_);
+    }
+
     int width() const { return width_; }
     int height() const { return height_; }
 
@@ -1308,6 +1308,173 @@ static void gamma_correct(const float *in, float *out, const int width,
     }
 }
 
+// RT: BEGIN parallel line detection
+//
+// The image is split into horizontal strips, processed by LSD in parallel.
+// Each strip is extended by LSD_STRIP_OVERLAP rows on both sides, and keeps
+// the lines whose midpoint falls inside its own rows. The segments of a line
+// that were cut at the border between two strips are then joined again. All
+// the strips use the detection threshold of the whole image.
+#define LSD_STRIP_MIN_HEIGHT 128
+#define LSD_STRIP_OVERLAP 16
+
+// true if the LSD lines a (above) and b (below) are two parts of the same
+// line cut at row y
+static int lsd_is_same_line(const double *a, const double *b, const double y)
+{
+    const double amin = fmin(a[1], a[3]), amax = fmax(a[1], a[3]);
+    const double bmin = fmin(b[1], b[3]), bmax = fmax(b[1], b[3]);
+    if (!(amin < y && amax > y && bmin < y && bmax > y)) {
+        return FALSE;
+    }
+
+    const double alen = hypot(a[2] - a[0], a[3] - a[1]);
+    const double blen = hypot(b[2] - b[0], b[3] - b[1]);
+    if (alen <= 0.0 || blen <= 0.0) {
+        return FALSE;
+    }
+    const double ax = (a[2] - a[0]) / alen, ay = (a[3] - a[1]) / alen;
+    const double bx = (b[2] - b[0]) / blen, by = (b[3] - b[1]) / blen;
+    // same direction and polarity (within about 2 degrees)
+    if (ax * bx + ay * by <= 0.0 || fabs(ax * by - ay * bx) > 0.035) {
+        return FALSE;
+    }
+
+    // the end points of b are on the line through a
+    const double tol = fmax(2.0, fmax(a[4], b[4]));
+    for (int i = 0; i < 4; i += 2) {
+        const double d = (b[i] - a[0]) * ay - (b[i + 1] - a[1]) * ax;
+        if (fabs(d) > tol) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// stores in b the union of the collinear lines a and b
+static void lsd_join_lines(const double *a, double *b)
+{
+    const double dx = a[2] - a[0], dy = a[3] - a[1];
+    const double *pts[4] = {a, a + 2, b, b + 2};
+    int lo = 0, hi = 0;
+    double tlo = 0.0, thi = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        const double t = (pts[i][0] - a[0]) * dx + (pts[i][1] - a[1]) * dy;
+        if (i == 0 || t < tlo) {
+            tlo = t;
+            lo = i;
+        }
+        if (i == 0 || t > thi) {
+            thi = t;
+            hi = i;
+        }
+    }
+    const double x1 = pts[lo][0], y1 = pts[lo][1];
+    const double x2 = pts[hi][0], y2 = pts[hi][1];
+    const int a_longer =
+        hypot(dx, dy) > hypot(b[2] - b[0], b[3] - b[1]) ? TRUE : FALSE;
+    b[0] = x1;
+    b[1] = y1;
+    b[2] = x2;
+    b[3] = y2;
+    b[4] = fmax(a[4], b[4]);
+    if (a_longer) {
+        b[5] = a[5];
+    }
+    b[6] = fmax(a[6], b[6]);
+}
+
+// same interface as LineSegmentDetection with the parameters used here
+static double *lsd_detect_parallel(int *n_out, double *img, const int width,
+                                   const int height)
+{
+    int nstrips = 1;
+#ifdef _OPENMP
+    nstrips = MIN(omp_get_max_threads(), height / LSD_STRIP_MIN_HEIGHT);
+#endif
+    if (nstrips <= 1) {
+        return LineSegmentDetection(n_out, img, width, height, LSD_SCALE,
+                                    LSD_SIGMA_SCALE, LSD_QUANT, LSD_ANG_TH,
+                                    LSD_LOG_EPS, LSD_DENSITY_TH, LSD_N_BINS,
+                                    NULL, NULL, NULL, 0, 0);
+    }
+
+    double **strip_lines = (double **)calloc(nstrips, sizeof(double *));
+    int *strip_count = (int *)calloc(nstrips, sizeof(int));
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int s = 0; s < nstrips; ++s) {
+        const int r0 = (int64_t)height * s / nstrips;
+        const int r1 = (int64_t)height * (s + 1) / nstrips;
+        const int e0 = MAX(r0 - LSD_STRIP_OVERLAP, 0);
+        const int e1 = MIN(r1 + LSD_STRIP_OVERLAP, height);
+        int n = 0;
+        double *lines = LineSegmentDetection(
+            &n, img + (size_t)e0 * width, width, e1 - e0, LSD_SCALE,
+            LSD_SIGMA_SCALE, LSD_QUANT, LSD_ANG_TH, LSD_LOG_EPS,
+            LSD_DENSITY_TH, LSD_N_BINS, NULL, NULL, NULL, width, height);
+        int kept = 0;
+        for (int i = 0; i < n; ++i) {
+            double *l = lines + 7 * i;
+            l[1] += e0;
+            l[3] += e0;
+            const double ym = 0.5 * (l[1] + l[3]);
+            if (ym >= r0 && ym < r1) {
+                memmove(lines + 7 * kept, l, 7 * sizeof(double));
+                ++kept;
+            }
+        }
+        strip_lines[s] = lines;
+        strip_count[s] = kept;
+    }
+
+    // join the lines cut at the strip borders: a joined line replaces its
+    // part in the lower strip, so that it can be extended again at the next
+    // border
+    for (int s = 0; s + 1 < nstrips; ++s) {
+        const double y = (int64_t)height * (s + 1) / nstrips;
+        for (int i = 0; i < strip_count[s]; ++i) {
+            double *a = strip_lines[s] + 7 * i;
+            for (int j = 0; j < strip_count[s + 1]; ++j) {
+                double *b = strip_lines[s + 1] + 7 * j;
+                if (a[4] >= 0.0 && b[4] >= 0.0 && lsd_is_same_line(a, b, y)) {
+                    lsd_join_lines(a, b);
+                    a[4] = -1.0; // removed
+                    break;
+                }
+            }
+        }
+    }
+
+    int total = 0;
+    for (int s = 0; s < nstrips; ++s) {
+        total += strip_count[s];
+    }
+    double *res = (double *)malloc(sizeof(double) * 7 * MAX(total, 1));
+    int n = 0;
+    for (int s = 0; s < nstrips; ++s) {
+        for (int i = 0; i < strip_count[s]; ++i) {
+            const double *l = strip_lines[s] + 7 * i;
+            if (l[4] >= 0.0) {
+                memcpy(res + 7 * n, l, 7 * sizeof(double));
+                ++n;
+            }
+        }
+        free(strip_lines[s]);
+    }
+    free(strip_lines);
+    free(strip_count);
+
+    *n_out = n;
+    return res;
+}
+
+#undef LSD_STRIP_MIN_HEIGHT
+#undef LSD_STRIP_OVERLAP
+// RT: END parallel line detection
+
 // do actual line_detection based on LSD algorithm and return results according
 // to this module's conventions
 static int line_detect(float *in, const int width, const int height,
@@ -1355,10 +1522,8 @@ static int line_detect(float *in, const int width, const int height,
     // call the line segment detector LSD;
     // LSD stores the number of found lines in lines_count.
     // it returns structural details as vector 'double lines[7 * lines_count]'
-    lsd_lines = LineSegmentDetection(&lines_count, greyscale, width, height,
-                                     LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
-                                     LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH,
-                                     LSD_N_BINS, NULL, NULL, NULL);
+    // RT: the image is processed in strips in parallel
+    lsd_lines = lsd_detect_parallel(&lines_count, greyscale, width, height);
 
     if (lines_count > 0) {
         // aggregate lines data into our own structures
@@ -1080,7 +1080,13 @@ __attribute__((constructor)) static void invConstructor()
 {
     if (inv)
         return;
+    // RT: fill the whole table upfront, so that it is never written to by
+    // the LSD calls (running in parallel on the strips of an image)
     inv = (double *)malloc(sizeof(double) * TABSIZE);
+    inv[0] = 0.0;
+    for (int i = 1; i < TABSIZE; ++i) {
+        inv[i] = 1.0 / (double)i;
+    }
 }
 
 __attribute__((destructor)) static void invDestructor()
@@ -2093,7 +2099,8 @@ double * LineSegmentDetection( int * n_out,
                                double scale, double sigma_scale, double quant,
                                double ang_th, double log_eps, double density_th,
                                int n_bins,
-                               int ** reg_img, int * reg_x, int * reg_y )
+                               int ** reg_img, int * reg_x, int * reg_y,
+                               int nt_X, int nt_Y )
 {
   image_double image;
   ntuple_list out = new_ntuple_list(7);
@@ -2157,8 +2164,15 @@ double * LineSegmentDetection( int * n_out,
      whose logarithm value is
        log10(11) + 5/2 * (log10(X) + log10(Y)).
   */
-  logNT = 5.0 * ( log10( (double) xsize ) + log10( (double) ysize ) ) / 2.0
-          + log10(11.0);
+  /* RT: if nt_X and nt_Y are positive, img is a part of an image of that
+     size, and the number of tests is the one of the whole image */
+  if( nt_X > 0 && nt_Y > 0 )
+    logNT = 5.0 * ( log10( (double) xsize * nt_X / X )
+                    + log10( (double) ysize * nt_Y / Y ) ) / 2.0
+            + log10(11.0);
+  else
+    logNT = 5.0 * ( log10( (double) xsize ) + log10( (double) ysize ) ) / 2.0
+            + log10(11.0);
   min_reg_size = (int) (-logNT/log10(p)); /* minimal number of points in region
                                              that can give a meaningful event */
 
@@ -2293,7 +2307,7 @@ double * lsd_scale_region( int * n_out,
 
   return LineSegmentDetection( n_out, img, X, Y, scale, sigma_scale, quant,
                                ang_th, log_eps, density_th, n_bins,
-                               reg_img, reg_x, reg_y );
+                               reg_img, reg_x, reg_y, 0, 0 );
 }
 
 /*----------------------------------------------------------------------------*/
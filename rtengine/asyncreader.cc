@@ -0,0 +1,280 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "asyncreader.h"
+#include "settings.h"
+#include <glib/gstdio.h>
+#include <iostream>
+#include <memory>
+
+#ifdef ART_USE_LIBURING
+#include <cerrno>
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+constexpr size_t CHUNK_SIZE = 1 << 20;
+constexpr size_t MAX_QUEUED = 256;
+// threads of the blocking fallback
+constexpr int NUM_THREADS = 4;
+
+#ifdef ART_USE_LIBURING
+constexpr unsigned QUEUE_DEPTH = 32;
+// files read at the same time by the io_uring thread
+constexpr size_t MAX_IN_FLIGHT = 16;
+#endif
+
+} // namespace
+
+AsyncReader *AsyncReader::getInstance()
+{
+    static AsyncReader instance;
+    return &instance;
+}
+
+void AsyncReader::init()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!stop_) {
+        return;
+    }
+    stop_ = false;
+
+#ifdef ART_USE_LIBURING
+    std::unique_ptr<io_uring> ring(new io_uring);
+    const int err = io_uring_queue_init(QUEUE_DEPTH, ring.get(), 0);
+    if (err == 0) {
+        io_uring *r = ring.release();
+        threads_.emplace_back([this, r]() { run_uring(r); });
+        return;
+    } else if (settings->verbose) {
+        std::cout << "AsyncReader: io_uring not available ("
+                  << g_strerror(-err) << "), using blocking reads"
+                  << std::endl;
+    }
+#endif
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        threads_.emplace_back([this]() { run_blocking(); });
+    }
+}
+
+void AsyncReader::cleanup()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        threads.swap(threads_);
+    }
+    cond_.notify_all();
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::deque<Request> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending.swap(queue_);
+    }
+    for (auto &req : pending) {
+        finish(req, false);
+    }
+}
+
+void AsyncReader::prefetch(const Glib::ustring &fname, Callback done)
+{
+    std::deque<Request> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) {
+            dropped.push_back(Request{fname, std::move(done)});
+        } else {
+            queue_.push_back(Request{fname, std::move(done)});
+            while (queue_.size() > MAX_QUEUED) {
+                dropped.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+        }
+    }
+    cond_.notify_one();
+    for (auto &req : dropped) {
+        finish(req, false);
+    }
+}
+
+bool AsyncReader::pop(Request &req, bool wait)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wait) {
+        cond_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+    }
+    if (stop_ || queue_.empty()) {
+        return false;
+    }
+    req = std::move(queue_.front());
+    queue_.pop_front();
+    return true;
+}
+
+void AsyncReader::finish(Request &req, bool ok)
+{
+    if (settings->verbose > 1) {
+        std::cout << "AsyncReader: " << (ok ? "read " : "failed to read ")
+                  << req.fname << std::endl;
+    }
+    if (req.done) {
+        req.done(ok);
+    }
+}
+
+void AsyncReader::run_blocking()
+{
+    std::vector<char> buf(CHUNK_SIZE);
+    Request req;
+    while (pop(req, true)) {
+        FILE *f = g_fopen(req.fname.c_str(), "rb");
+        bool ok = f != nullptr;
+        if (f) {
+            while (fread(buf.data(), 1, buf.size(), f) == buf.size()) {
+            }
+            ok = !ferror(f);
+            fclose(f);
+        }
+        finish(req, ok);
+    }
+}
+
+#ifdef ART_USE_LIBURING
+
+void AsyncReader::run_uring(void *r)
+{
+    io_uring *ring = static_cast<io_uring *>(r);
+
+    struct Slot {
+        Request req;
+        int fd;
+        off_t offset;
+        off_t size;
+        std::vector<char> buf;
+    };
+    std::vector<Slot> slots(MAX_IN_FLIGHT);
+    std::vector<Slot *> free_slots;
+    for (auto &s : slots) {
+        s.fd = -1;
+        s.buf.resize(CHUNK_SIZE);
+        free_slots.push_back(&s);
+    }
+
+    const auto submit = [&](Slot *s) -> void {
+        io_uring_sqe *sqe = io_uring_get_sqe(ring);
+        io_uring_prep_read(sqe, s->fd, s->buf.data(), s->buf.size(),
+                           s->offset);
+        io_uring_sqe_set_data(sqe, s);
+    };
+
+    const auto release = [&](Slot *s, bool ok) -> void {
+        close(s->fd);
+        s->fd = -1;
+        Request req = std::move(s->req);
+        free_slots.push_back(s);
+        finish(req, ok);
+    };
+
+    bool stopping = false;
+    while (!stopping || free_slots.size() < slots.size()) {
+        // start reading the new requests. Opening a file might block, but
+        // only this thread
+        bool wait = free_slots.size() == slots.size();
+        Request req;
+        int num_submitted = 0;
+        while (!stopping && !free_slots.empty() && pop(req, wait)) {
+            wait = false;
+            const int fd = g_open(req.fname.c_str(), O_RDONLY, 0);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                finish(req, fd >= 0);
+                continue;
+            }
+            Slot *s = free_slots.back();
+            free_slots.pop_back();
+            s->req = std::move(req);
+            s->fd = fd;
+            s->offset = 0;
+            s->size = st.st_size;
+            submit(s);
+            ++num_submitted;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping = stop_;
+        }
+        if (num_submitted) {
+            io_uring_submit(ring);
+            num_submitted = 0;
+        }
+        if (free_slots.size() == slots.size()) {
+            continue;
+        }
+
+        // wait for a completion, but not for too long, to pick up the new
+        // requests in the meantime
+        io_uring_cqe *cqe = nullptr;
+        __kernel_timespec ts = {0, 10 * 1000 * 1000};
+        if (io_uring_wait_cqe_timeout(ring, &cqe, &ts) != 0) {
+            continue;
+        }
+        do {
+            Slot *s = static_cast<Slot *>(io_uring_cqe_get_data(cqe));
+            const int res = cqe->res;
+            io_uring_cqe_seen(ring, cqe);
+
+            if (res < 0 && res != -EAGAIN && res != -EINTR) {
+                release(s, false);
+            } else {
+                s->offset += std::max(res, 0);
+                if (res == 0 || s->offset >= s->size) {
+                    release(s, true);
+                } else {
+                    submit(s);
+                    ++num_submitted;
+                }
+            }
+        } while (io_uring_peek_cqe(ring, &cqe) == 0);
+        if (num_submitted) {
+            io_uring_submit(ring);
+        }
+    }
+
+    io_uring_queue_exit(ring);
+    delete ring;
+}
+
+#endif // ART_USE_LIBURING
+
+} // namespace rtengine
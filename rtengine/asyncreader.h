@@ -0,0 +1,81 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <glibmm.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Background reading of files that are going to be needed soon (raw files
+ * about to be decoded, thumbnail cache files), so that the thread pool
+ * workers processing them find the data in the OS file cache instead of
+ * waiting for the disk.
+ *
+ * The reads are done by dedicated threads, not by the thread pool. On Linux,
+ * when built with liburing (ART_USE_LIBURING), a single thread keeps many
+ * reads in flight through io_uring; otherwise (or if io_uring is not
+ * available at runtime) a few threads do plain blocking reads.
+ */
+class AsyncReader: public NonCopyable {
+public:
+    /// called from an I/O thread when the file has been read (ok is false if
+    /// it couldn't be read, or the request was dropped). It should only
+    /// hand over the work to other threads
+    typedef std::function<void(bool ok)> Callback;
+
+    static AsyncReader *getInstance();
+
+    void init();
+    void cleanup();
+
+    /// queues the reading of fname. When too many requests are pending, the
+    /// oldest ones are dropped
+    void prefetch(const Glib::ustring &fname, Callback done = Callback());
+
+private:
+    AsyncReader(): stop_(true) {}
+
+    struct Request {
+        Glib::ustring fname;
+        Callback done;
+    };
+
+    bool pop(Request &req, bool wait);
+    void finish(Request &req, bool ok);
+    void run_blocking();
+#ifdef ART_USE_LIBURING
+    void run_uring(void *ring);
+#endif
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Request> queue_;
+    std::vector<std::thread> threads_;
+    bool stop_;
+};
+
+} // namespace rtengine
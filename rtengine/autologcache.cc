@@ -0,0 +1,187 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "autologcache.h"
+#include "../rtgui/options.h"
+#include "imagesource.h"
+#include "settings.h"
+#include "utils.h"
+#include <glib/gstdio.h>
+#include <iostream>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+constexpr size_t MAX_ENTRIES = 1000;
+// bump when the analysis in getAutoLog() changes, to discard the old entries
+constexpr int VERSION = 1;
+
+} // namespace
+
+AutoLogCache *AutoLogCache::getInstance()
+{
+    static AutoLogCache instance;
+    return &instance;
+}
+
+void AutoLogCache::init()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    fname_ = Glib::build_filename(options.cacheBaseDir, "autolog_info");
+    if (!Glib::file_test(fname_, Glib::FILE_TEST_EXISTS)) {
+        return;
+    }
+
+    try {
+        Glib::KeyFile kf;
+        kf.load_from_file(fname_);
+        if (!kf.has_group("General") ||
+            kf.get_integer("General", "Version") != VERSION) {
+            return;
+        }
+        // the groups are stored from the most recently used
+        for (auto &group : kf.get_groups()) {
+            if (group == "General" || entries_.size() >= MAX_ENTRIES) {
+                continue;
+            }
+            Entry e;
+            e.key = group;
+            e.info.vmin = kf.get_double(group, "Min");
+            e.info.vmax = kf.get_double(group, "Max");
+            e.info.gray = kf.get_double(group, "Gray");
+            entries_.push_back(e);
+        }
+    } catch (Glib::Exception &exc) {
+        entries_.clear();
+        if (settings->verbose) {
+            std::cout << "AutoLogCache: error reading " << fname_ << ": "
+                      << exc.what() << std::endl;
+        }
+    }
+}
+
+void AutoLogCache::cleanup()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!dirty_ || fname_.empty()) {
+        return;
+    }
+
+    Glib::KeyFile kf;
+    kf.set_integer("General", "Version", VERSION);
+    for (auto &e : entries_) {
+        const Glib::ustring group = e.key;
+        kf.set_double(group, "Min", e.info.vmin);
+        kf.set_double(group, "Max", e.info.vmax);
+        kf.set_double(group, "Gray", e.info.gray);
+    }
+
+    // write to a temporary file first, so that concurrent instances never
+    // read a partial file
+    const Glib::ustring tmp = fname_ + ".tmp";
+    bool ok = false;
+    try {
+        ok = kf.save_to_file(tmp);
+    } catch (Glib::Exception &) {
+    }
+    if (ok && g_rename(tmp.c_str(), fname_.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(fname_.c_str());
+        ok = g_rename(tmp.c_str(), fname_.c_str()) == 0;
+    }
+    if (!ok) {
+        g_remove(tmp.c_str());
+        if (settings->verbose) {
+            std::cout << "AutoLogCache: error writing " << fname_ << std::endl;
+        }
+    }
+    dirty_ = false;
+}
+
+std::string AutoLogCache::get_key(ImageSource *imgsrc,
+                                  const procparams::ProcParams &params)
+{
+    const auto md5 = getMD5(imgsrc->getFileName(), true);
+    if (md5.empty()) {
+        return "";
+    }
+
+    // only the parameters that affect the image analysed by getAutoLog(),
+    // which is rendered with neutral exposure and raw settings
+    procparams::ProcParams pp;
+    pp.raw = params.raw;
+    pp.icm = params.icm;
+    pp.filmNegative = params.filmNegative;
+
+    const std::string data =
+        pp.to_data() + "\n" + std::to_string(imgsrc->isRAW());
+    return md5 + "-" +
+           Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, data);
+}
+
+bool AutoLogCache::get(const std::string &key, Info &info)
+{
+    if (key.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            info = it->info;
+            if (it != entries_.begin()) {
+                entries_.splice(entries_.begin(), entries_, it);
+                dirty_ = true;
+            }
+            if (settings->verbose) {
+                std::cout << "AutoLogCache: using " << key << std::endl;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void AutoLogCache::put(const std::string &key, const Info &info)
+{
+    if (key.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            entries_.erase(it);
+            break;
+        }
+    }
+    entries_.push_front(Entry{key, info});
+    if (entries_.size() > MAX_ENTRIES) {
+        entries_.pop_back();
+    }
+    dirty_ = true;
+}
+
+} // namespace rtengine
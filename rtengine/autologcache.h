@@ -0,0 +1,75 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include "procparams.h"
+#include <glibmm.h>
+#include <list>
+#include <mutex>
+#include <string>
+
+namespace rtengine {
+
+class ImageSource;
+
+/**
+ * Persistent cache of the statistics of the downscaled image analysed by
+ * ImProcFunctions::getAutoLog(), so that the automatic log encoding
+ * parameters are not recomputed from the image source every time the same
+ * image is processed (e.g. in the batch queue).
+ *
+ * Works like DenoiseInfoCache, storing the entries in
+ * <cacheBaseDir>/autolog_info.
+ */
+class AutoLogCache: public NonCopyable {
+public:
+    struct Info {
+        float vmin; ///< lowest luminance (with some headroom), in [0, 1]
+        float vmax; ///< highest luminance (with some headroom)
+        float gray; ///< average mid-tone luminance, or 0 if not found
+    };
+
+    static AutoLogCache *getInstance();
+
+    void init();
+    void cleanup();
+
+    /// returns an empty string if the image can't be identified
+    static std::string get_key(ImageSource *imgsrc,
+                               const procparams::ProcParams &params);
+
+    bool get(const std::string &key, Info &info);
+    void put(const std::string &key, const Info &info);
+
+private:
+    AutoLogCache(): dirty_(false) {}
+
+    struct Entry {
+        std::string key;
+        Info info;
+    };
+
+    std::mutex mutex_;
+    std::list<Entry> entries_; // most recently used first
+    Glib::ustring fname_;
+    bool dirty_;
+};
+
+} // namespace rtengine
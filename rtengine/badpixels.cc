@@ -609,10 +609,12 @@ int RawImageSource::interpolateBadPixelsXtrans(const PixelsMap &bitmapBads)
  *  For each pixel compare its value to the average of similar color surrounding
  *  (Taken from Emil Martinec idea)
  *  (Optimized by Ingo Weyrich 2013, 2015, and 2019)
+ *  If found is not null, the pixels marked are also appended to it.
  */
 int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh,
                                       const bool findHotPixels,
-                                      const bool findDeadPixels) const
+                                      const bool findDeadPixels,
+                                      std::vector<badPix> *found) const
 {
     BENCHFUN
     const bool is_xtrans = ri->getSensorType() == ST_FUJI_XTRANS;
@@ -629,6 +631,7 @@ int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh,
         array2D<float> cfablur(W, 5, ARRAY2D_CLEAR_DATA);
         int firstRow = -1;
         int lastRow = -1;
+        std::vector<badPix> foundThr;
 
         std::array<float, 25> medbuf;
 
@@ -658,6 +661,67 @@ int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh,
             }
         };
 
+        // difference between row i and the median of the same color pixels
+        // around, stored in cfablur[destRow]
+        const auto blur_row = [&](int i, int destRow) -> void {
+            float *dst = cfablur[destRow];
+            int j = 2;
+            if (is_xtrans) {
+                for (; j < W - 2; ++j) {
+                    dst[j] = rawData[i][j] -
+                             med_xt(ri->XTRANSFC(i, j), i - 2, j - 2);
+                }
+                return;
+            }
+#ifdef __SSE2__
+            for (; j < W - 5; j += 4) {
+                const vfloat temp = median(
+                    LVFU(rawData[i - 2][j - 2]), LVFU(rawData[i - 2][j]),
+                    LVFU(rawData[i - 2][j + 2]), LVFU(rawData[i][j - 2]),
+                    LVFU(rawData[i][j]), LVFU(rawData[i][j + 2]),
+                    LVFU(rawData[i + 2][j - 2]), LVFU(rawData[i + 2][j]),
+                    LVFU(rawData[i + 2][j + 2]));
+                STVFU(dst[j], LVFU(rawData[i][j]) - temp);
+            }
+#endif
+            for (; j < W - 2; ++j) {
+                const float temp = median(
+                    rawData[i - 2][j - 2], rawData[i - 2][j],
+                    rawData[i - 2][j + 2], rawData[i][j - 2], rawData[i][j],
+                    rawData[i][j + 2], rawData[i + 2][j - 2],
+                    rawData[i + 2][j], rawData[i + 2][j + 2]);
+                dst[j] = rawData[i][j] - temp;
+            }
+        };
+
+        const auto evaluate_row = [&](int rr) -> void {
+            const int rr0 = rr % 5;
+            for (int cc = 2; cc < W - 2; ++cc) {
+                // evaluate pixel for heat/death
+                float pixdev = cfablur[rr0][cc];
+
+                if (!findDeadPixels && pixdev <= 0.f) {
+                    continue;
+                }
+
+                if (!findHotPixels && pixdev >= 0.f) {
+                    continue;
+                }
+
+                pixdev = fabsf(pixdev);
+                float hfnbrave = -pixdev;
+                sum5x5(cfablur, cc - 2, hfnbrave);
+                if (pixdev > varthresh * hfnbrave) {
+                    // mark the pixel as "bad"
+                    bpMap.set(cc, rr);
+                    if (found) {
+                        foundThr.emplace_back(cc, rr);
+                    }
+                    ++counter;
+                }
+            } // end of pixel evaluation
+        };
+
 #ifdef _OPENMP
 // note, static scheduling is important in this implementation
 #pragma omp for schedule(static) nowait
@@ -668,62 +732,15 @@ int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh,
                 firstRow = i;
                 if (firstRow > 2) {
                     for (int row = firstRow - 2; row < firstRow; ++row) {
-                        const int destRow = row % 5;
-                        for (int j = 2; j < W - 2; ++j) {
-                            const float temp =
-                                is_xtrans ? med_xt(ri->XTRANSFC(row, j),
-                                                   row - 2, j - 2)
-                                          : median(rawData[row - 2][j - 2],
-                                                   rawData[row - 2][j],
-                                                   rawData[row - 2][j + 2],
-                                                   rawData[row][j - 2],
-                                                   rawData[row][j],
-                                                   rawData[row][j + 2],
-                                                   rawData[row + 2][j - 2],
-                                                   rawData[row + 2][j],
-                                                   rawData[row + 2][j + 2]);
-                            cfablur[destRow][j] = rawData[row][j] - temp;
-                        }
+                        blur_row(row, row % 5);
                     }
                 }
             }
             lastRow = i;
-            const int destRow = i % 5;
-            for (int j = 2; j < W - 2; ++j) {
-                const float temp =
-                    is_xtrans ? med_xt(ri->XTRANSFC(i, j), i - 2, j - 2)
-                              : median(rawData[i - 2][j - 2], rawData[i - 2][j],
-                                       rawData[i - 2][j + 2], rawData[i][j - 2],
-                                       rawData[i][j], rawData[i][j + 2],
-                                       rawData[i + 2][j - 2], rawData[i + 2][j],
-                                       rawData[i + 2][j + 2]);
-                cfablur[destRow][j] = rawData[i][j] - temp;
-            }
+            blur_row(i, i % 5);
 
             if (i - 1 > firstRow) {
-                const int rr = i - 2;
-                const int rr0 = rr % 5;
-                for (int cc = 2; cc < W - 2; ++cc) {
-                    // evaluate pixel for heat/death
-                    float pixdev = cfablur[rr0][cc];
-
-                    if (!findDeadPixels && pixdev <= 0.f) {
-                        continue;
-                    }
-
-                    if (!findHotPixels && pixdev >= 0.f) {
-                        continue;
-                    }
-
-                    pixdev = fabsf(pixdev);
-                    float hfnbrave = -pixdev;
-                    sum5x5(cfablur, cc - 2, hfnbrave);
-                    if (pixdev > varthresh * hfnbrave) {
-                        // mark the pixel as "bad"
-                        bpMap.set(cc, rr);
-                        ++counter;
-                    }
-                } // end of pixel evaluation
+                evaluate_row(i - 2);
             }
         }
 
@@ -731,50 +748,24 @@ int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh,
             // cfa pixel heat/death evaluation
             for (int rr = lastRow - 1; rr < lastRow + 1; ++rr) {
                 const int i = rr + 2;
-                const int destRow = i % 5;
                 if (i >= H - 2) {
+                    const int destRow = i % 5;
                     for (int j = 2; j < W - 2; j++) {
                         cfablur[destRow][j] = 0.f;
                     }
                 } else {
-                    for (int j = 2; j < W - 2; ++j) {
-                        const float temp =
-                            is_xtrans
-                                ? med_xt(ri->XTRANSFC(i, j), i - 2, j - 2)
-                                : median(
-                                      rawData[i - 2][j - 2], rawData[i - 2][j],
-                                      rawData[i - 2][j + 2], rawData[i][j - 2],
-                                      rawData[i][j], rawData[i][j + 2],
-                                      rawData[i + 2][j - 2], rawData[i + 2][j],
-                                      rawData[i + 2][j + 2]);
-                        cfablur[destRow][j] = rawData[i][j] - temp;
-                    }
+                    blur_row(i, i % 5);
                 }
-
-                const int rr0 = rr % 5;
-                for (int cc = 2; cc < W - 2; ++cc) {
-                    // evaluate pixel for heat/death
-                    float pixdev = cfablur[rr0][cc];
-
-                    if (!findDeadPixels && pixdev <= 0.f) {
-                        continue;
-                    }
-
-                    if (!findHotPixels && pixdev >= 0.f) {
-                        continue;
-                    }
-
-                    pixdev = fabsf(pixdev);
-                    float hfnbrave = -pixdev;
-                    sum5x5(cfablur, cc - 2, hfnbrave);
-                    if (pixdev > varthresh * hfnbrave) {
-                        // mark the pixel as "bad"
-                        bpMap.set(cc, rr);
-                        ++counter;
-                    }
-                } // end of pixel evaluation
+                evaluate_row(rr);
             }
         }
+
+        if (found && !foundThr.empty()) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            found->insert(found->end(), foundThr.begin(), foundThr.end());
+        }
     } // end of parallel processing
 
     return counter;
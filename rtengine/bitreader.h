@@ -0,0 +1,74 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace rtengine {
+
+// Primitives shared by the MSB-first variable length (Golomb/Rice style)
+// bitstream readers of the raw decoders (CRX, Fuji compressed)
+
+// index of the highest set bit of v, which must be non-zero
+inline int bitreader_highest_bit(uint32_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 31 - __builtin_clz(v);
+#elif defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanReverse(&idx, v);
+    return idx;
+#else
+    int idx = 31;
+    while (!(v & 0x80000000u)) {
+        v <<= 1;
+        --idx;
+    }
+    return idx;
+#endif
+}
+
+// number of zero bits preceding the first set bit of v (non-zero), i.e. the
+// length of the unary prefix at the top of v
+inline int bitreader_leading_zeros(uint32_t v)
+{
+    return 31 - bitreader_highest_bit(v);
+}
+
+// big-endian 32-bit load from a possibly unaligned address
+inline uint32_t bitreader_load_be32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__GNUC__) || defined(__clang__)
+    v = __builtin_bswap32(v);
+#else
+    v = (v >> 24) | ((v >> 8) & 0xff00u) | ((v << 8) & 0xff0000u) | (v << 24);
+#endif
+#endif
+    return v;
+}
+
+} // namespace rtengine
@@ -21,9 +21,14 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <glibmm/ustring.h>
 #include <list>
 #include <map>
 #include <memory>
+#include <string>
 #include <type_traits>
 #include <unordered_map>
 
@@ -40,6 +45,18 @@ template <typename T>
 struct has_hash<T, decltype(std::hash<T>()(std::declval<T>()), void())>
     : std::true_type {};
 
+// hash used to pick the shard of a ShardedCache
+template <typename K> struct ShardHash {
+    size_t operator()(const K &key) const { return std::hash<K>()(key); }
+};
+
+template <> struct ShardHash<Glib::ustring> {
+    size_t operator()(const Glib::ustring &key) const
+    {
+        return std::hash<std::string>()(key.raw());
+    }
+};
+
 } // namespace cache_helper
 
 template <class K, class V> class Cache {
@@ -53,9 +70,12 @@ public:
         virtual void onDestroy() = 0;
     };
 
-    Cache(unsigned long _size, Hook *_hook = nullptr)
+    /// max_weight, if not 0, bounds the total weight of the entries (as
+    /// given to the setters) in addition to their number
+    Cache(unsigned long _size, Hook *_hook = nullptr,
+          unsigned long _max_weight = 0)
         : store_size(std::max(_size, static_cast<unsigned long>(1))),
-          hook(_hook)
+          max_weight(_max_weight), total_weight(0), hook(_hook)
     {
     }
 
@@ -82,19 +102,29 @@ public:
         return present;
     }
 
-    bool set(const K &key, const V &value)
+    bool set(const K &key, const V &value, unsigned long weight = 0)
     {
-        return set(key, value, Mode::UNCOND);
+        return set(key, value, Mode::UNCOND, weight);
     }
 
-    bool replace(const K &key, const V &value)
+    bool replace(const K &key, const V &value, unsigned long weight = 0)
     {
-        return set(key, value, Mode::KNOWN);
+        return set(key, value, Mode::KNOWN, weight);
     }
 
-    bool insert(const K &key, const V &value)
+    bool insert(const K &key, const V &value, unsigned long weight = 0)
     {
-        return set(key, value, Mode::UNKNOWN);
+        return set(key, value, Mode::UNKNOWN, weight);
+    }
+
+    /// true if the key is present, without touching the LRU order
+    bool contains(const K &key) const
+    {
+        mutex.lock();
+        const bool present = store.find(key) != store.end();
+        mutex.unlock();
+
+        return present;
     }
 
     bool remove(const K &key)
@@ -110,6 +140,20 @@ public:
         return present;
     }
 
+    /// discards the least recently used entry, returns false if the cache
+    /// is empty
+    bool evict()
+    {
+        mutex.lock();
+        const bool present = !lru_list.empty();
+        if (present) {
+            discard();
+        }
+        mutex.unlock();
+
+        return present;
+    }
+
     void resize(unsigned long size)
     {
         mutex.lock();
@@ -130,9 +174,21 @@ public:
         }
         lru_list.clear();
         store.clear();
+        total_weight = 0;
         mutex.unlock();
     }
 
+    unsigned long getMaxWeight() const { return max_weight; }
+
+    unsigned long getWeight() const
+    {
+        mutex.lock();
+        const unsigned long ret = total_weight;
+        mutex.unlock();
+
+        return ret;
+    }
+
 private:
     struct Value;
 
@@ -149,6 +205,7 @@ private:
     struct Value {
         V value;
         LruListIterator lru_list_it;
+        unsigned long weight;
     };
 
     enum class Mode { UNCOND, KNOWN, UNKNOWN };
@@ -159,11 +216,22 @@ private:
         if (hook) {
             hook->onDiscard(store_it->first, store_it->second->value);
         }
+        total_weight -= store_it->second->weight;
         store.erase(store_it);
         lru_list.pop_back();
     }
 
-    bool set(const K &key, const V &value, Mode mode)
+    // discards the least recently used entries (but never the most recent
+    // one) until the total weight fits
+    void fit_weight()
+    {
+        while (max_weight && total_weight > max_weight &&
+               lru_list.size() > 1) {
+            discard();
+        }
+    }
+
+    bool set(const K &key, const V &value, Mode mode, unsigned long weight)
     {
         mutex.lock();
         const StoreIterator store_it = store.find(key);
@@ -174,8 +242,11 @@ private:
                     discard();
                 }
                 lru_list.push_front(store.end());
-                std::unique_ptr<Value> v(new Value{value, lru_list.begin()});
+                std::unique_ptr<Value> v(
+                    new Value{value, lru_list.begin(), weight});
                 lru_list.front() = store.emplace(key, std::move(v)).first;
+                total_weight += weight;
+                fit_weight();
             }
         } else {
             if (mode == Mode::UNCOND || mode == Mode::KNOWN) {
@@ -185,6 +256,10 @@ private:
                 lru_list.splice(lru_list.begin(), lru_list,
                                 store_it->second->lru_list_it);
                 store_it->second->value = value;
+                total_weight += weight;
+                total_weight -= store_it->second->weight;
+                store_it->second->weight = weight;
+                fit_weight();
             }
         }
         mutex.unlock();
@@ -198,14 +273,161 @@ private:
             hook->onRemove(store_it->first, store_it->second->value);
         }
         lru_list.erase(store_it->second->lru_list_it);
+        total_weight -= store_it->second->weight;
         store.erase(store_it);
     }
 
     unsigned long store_size;
+    const unsigned long max_weight;
+    unsigned long total_weight;
     Hook *const hook;
     mutable MyMutex mutex;
     Store store;
     mutable LruList lru_list;
 };
 
+/**
+ * Drop-in replacement of Cache for the caches looked up concurrently by many
+ * threads (e.g. the thumbnail workers). The keys are distributed by hash over
+ * N independent Caches, each with its own lock and LRU list, and with 1/N of
+ * the entry and weight limits. The eviction order is therefore LRU only
+ * within each shard, so this is not suitable for very small caches.
+ *
+ * The hook callbacks are the same as for Cache, but can be called from
+ * several threads at once; onDestroy() is called once.
+ */
+template <class K, class V, unsigned N = 8,
+          class Hash = cache_helper::ShardHash<K>>
+class ShardedCache {
+public:
+    using Hook = typename Cache<K, V>::Hook;
+
+    ShardedCache(unsigned long _size, Hook *_hook = nullptr,
+                 unsigned long _max_weight = 0)
+        : hook(_hook), shard_hook(_hook), next_evict(0)
+    {
+        const unsigned long size = (_size + N - 1) / N;
+        const unsigned long max_weight = (_max_weight + N - 1) / N;
+        for (auto &s : shards) {
+            s.reset(new Cache<K, V>(size, _hook ? &shard_hook : nullptr,
+                                    max_weight));
+        }
+    }
+
+    ~ShardedCache()
+    {
+        if (hook) {
+            for (auto &s : shards) {
+                s->resize(0);
+            }
+            hook->onDestroy();
+        }
+    }
+
+    bool get(const K &key, V &value) const
+    {
+        return shard(key).get(key, value);
+    }
+
+    bool set(const K &key, const V &value, unsigned long weight = 0)
+    {
+        return shard(key).set(key, value, weight);
+    }
+
+    bool replace(const K &key, const V &value, unsigned long weight = 0)
+    {
+        return shard(key).replace(key, value, weight);
+    }
+
+    bool insert(const K &key, const V &value, unsigned long weight = 0)
+    {
+        return shard(key).insert(key, value, weight);
+    }
+
+    bool contains(const K &key) const { return shard(key).contains(key); }
+
+    bool remove(const K &key) { return shard(key).remove(key); }
+
+    /// discards the least recently used entry of one of the shards, returns
+    /// false if the cache is empty
+    bool evict()
+    {
+        const unsigned start = next_evict++;
+        for (unsigned i = 0; i < N; ++i) {
+            if (shards[(start + i) % N]->evict()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void resize(unsigned long size)
+    {
+        for (auto &s : shards) {
+            s->resize((size + N - 1) / N);
+        }
+    }
+
+    void clear()
+    {
+        for (auto &s : shards) {
+            s->clear();
+        }
+    }
+
+    unsigned long getMaxWeight() const
+    {
+        unsigned long ret = 0;
+        for (auto &s : shards) {
+            ret += s->getMaxWeight();
+        }
+        return ret;
+    }
+
+    unsigned long getWeight() const
+    {
+        unsigned long ret = 0;
+        for (auto &s : shards) {
+            ret += s->getWeight();
+        }
+        return ret;
+    }
+
+private:
+    // forwards everything but onDestroy(), which must be called only once
+    class ShardHook: public Hook {
+    public:
+        explicit ShardHook(Hook *h): hook(h) {}
+        void onDiscard(const K &key, const V &value) override
+        {
+            hook->onDiscard(key, value);
+        }
+        void onDisplace(const K &key, const V &value) override
+        {
+            hook->onDisplace(key, value);
+        }
+        void onRemove(const K &key, const V &value) override
+        {
+            hook->onRemove(key, value);
+        }
+        void onDestroy() override {}
+
+    private:
+        Hook *const hook;
+    };
+
+    Cache<K, V> &shard(const K &key) const
+    {
+        // mix the high bits in, std::hash is the identity for integers
+        size_t h = Hash()(key);
+        h ^= h >> 16;
+        return *shards[h % N];
+    }
+
+    Hook *const hook;
+    ShardHook shard_hook;
+    std::array<std::unique_ptr<Cache<K, V>>, N> shards;
+    std::atomic<unsigned> next_evict;
+};
+
 } // namespace rtengine
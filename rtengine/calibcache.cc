@@ -0,0 +1,387 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "calibcache.h"
+#include "../rtgui/options.h"
+#include "settings.h"
+#include <cstdint>
+#include <cstring>
+#include <glib/gstdio.h>
+#include <glibmm.h>
+#include <iostream>
+#include <unistd.h>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+// bump when the format of the files, or the way the templates and the hot
+// pixels are computed, changes
+constexpr uint32_t VERSION = 1;
+constexpr char INDEX_MAGIC[4] = {'A', 'R', 'C', 'I'};
+constexpr char DATA_MAGIC[4] = {'A', 'R', 'C', 'D'};
+
+void put_u32(std::string &out, uint32_t v)
+{
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+void put_str(std::string &out, const std::string &s)
+{
+    put_u32(out, s.size());
+    out.append(s);
+}
+
+bool get_u32(const std::string &in, size_t &pos, uint32_t &v)
+{
+    if (pos + sizeof(v) > in.size()) {
+        return false;
+    }
+    memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
+
+bool get_str(const std::string &in, size_t &pos, std::string &s)
+{
+    uint32_t n;
+    if (!get_u32(in, pos, n) || pos + n > in.size()) {
+        return false;
+    }
+    s.assign(in, pos, n);
+    pos += n;
+    return true;
+}
+
+bool read_file(const Glib::ustring &fname, std::string &out)
+{
+    try {
+        out = Glib::file_get_contents(fname);
+        return true;
+    } catch (Glib::Exception &) {
+        return false;
+    }
+}
+
+// writes to a temporary file first, so that concurrent readers (possibly in
+// other processes) never see a partial file
+bool write_file(const Glib::ustring &fname, const std::string &data)
+{
+    std::string tmp = fname + ".XXXXXX";
+    const int fd = Glib::mkstemp(tmp);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    FILE *f = g_fopen(tmp.c_str(), "wb");
+    if (!f) {
+        g_remove(tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok && g_rename(tmp.c_str(), fname.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(fname.c_str());
+        ok = g_rename(tmp.c_str(), fname.c_str()) == 0;
+    }
+    if (!ok) {
+        g_remove(tmp.c_str());
+    }
+    return ok;
+}
+
+std::string checksum(const std::string &key)
+{
+    return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, key);
+}
+
+} // namespace
+
+CalibrationCache::CalibrationCache(const char *name): name_(name), dirty_(false)
+{
+}
+
+std::string CalibrationCache::stamp(const Glib::ustring &fname)
+{
+    GStatBuf st;
+    if (g_stat(fname.c_str(), &st) != 0) {
+        return "";
+    }
+    return std::to_string(st.st_size) + ":" +
+           std::to_string(int64_t(st.st_mtime));
+}
+
+std::string CalibrationCache::key(const std::list<Glib::ustring> &fnames)
+{
+    std::string ret;
+    for (auto &f : fnames) {
+        auto s = stamp(f);
+        if (s.empty()) {
+            return "";
+        }
+        ret += f.raw() + '\0' + s + '\n';
+    }
+    return ret;
+}
+
+Glib::ustring CalibrationCache::dir()
+{
+    return Glib::build_filename(options.cacheBaseDir, "calibration", name_);
+}
+
+Glib::ustring CalibrationCache::dataFile(const std::string &key,
+                                         const char *ext)
+{
+    return Glib::build_filename(dir(), checksum(key) + ext);
+}
+
+void CalibrationCache::loadIndex()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    index_.clear();
+    dirty_ = false;
+
+    std::string data;
+    if (!read_file(Glib::build_filename(dir(), "index"), data)) {
+        return;
+    }
+
+    size_t pos = sizeof(INDEX_MAGIC);
+    uint32_t version, n;
+    if (data.size() < pos || memcmp(data.data(), INDEX_MAGIC, pos) != 0 ||
+        !get_u32(data, pos, version) || version != VERSION ||
+        !get_u32(data, pos, n)) {
+        return;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        std::string fname;
+        Entry e;
+        if (!get_str(data, pos, fname) || !get_str(data, pos, e.stamp) ||
+            !get_str(data, pos, e.info)) {
+            index_.clear();
+            return;
+        }
+        e.seen = false;
+        index_[fname] = std::move(e);
+    }
+}
+
+bool CalibrationCache::getInfo(const Glib::ustring &fname,
+                               const std::string &stamp, std::string &info)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(fname.raw());
+    if (stamp.empty() || it == index_.end() || it->second.stamp != stamp) {
+        return false;
+    }
+    it->second.seen = true;
+    info = it->second.info;
+    return true;
+}
+
+void CalibrationCache::putInfo(const Glib::ustring &fname,
+                               const std::string &stamp,
+                               const std::string &info)
+{
+    if (stamp.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto &e = index_[fname.raw()];
+    e.stamp = stamp;
+    e.info = info;
+    e.seen = true;
+    dirty_ = true;
+}
+
+void CalibrationCache::saveIndex(const std::set<std::string> &used_keys)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = index_.begin(); it != index_.end();) {
+        if (!it->second.seen) {
+            it = index_.erase(it);
+            dirty_ = true;
+        } else {
+            ++it;
+        }
+    }
+
+    const auto d = dir();
+    if (dirty_) {
+        std::string data(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        put_u32(data, VERSION);
+        put_u32(data, index_.size());
+        for (auto &p : index_) {
+            put_str(data, p.first);
+            put_str(data, p.second.stamp);
+            put_str(data, p.second.info);
+        }
+        g_mkdir_with_parents(d.c_str(), 0777);
+        if (write_file(Glib::build_filename(d, "index"), data)) {
+            dirty_ = false;
+        } else if (settings->verbose) {
+            std::cout << "Calibration cache: error writing the index in " << d
+                      << std::endl;
+        }
+    }
+
+    // remove the data of the templates that don't exist anymore
+    std::set<std::string> used;
+    for (auto &k : used_keys) {
+        used.insert(checksum(k));
+    }
+    try {
+        Glib::Dir entries(d);
+        for (auto &name : entries) {
+            const auto dot = name.find('.');
+            if (dot == std::string::npos || name == "index") {
+                continue;
+            }
+            const auto ext = name.substr(dot);
+            if ((ext == ".tpl" || ext == ".hot") &&
+                used.find(name.substr(0, dot)) == used.end()) {
+                g_remove(Glib::build_filename(d, name).c_str());
+            }
+        }
+    } catch (Glib::Exception &) {
+    }
+}
+
+bool CalibrationCache::read(const std::string &key, const char *ext,
+                            std::string &out)
+{
+    std::string data;
+    if (key.empty() || !read_file(dataFile(key, ext), data)) {
+        return false;
+    }
+
+    size_t pos = sizeof(DATA_MAGIC);
+    uint32_t version;
+    std::string k;
+    if (data.size() < pos || memcmp(data.data(), DATA_MAGIC, pos) != 0 ||
+        !get_u32(data, pos, version) || version != VERSION ||
+        !get_str(data, pos, k) || k != key) {
+        return false;
+    }
+    out = data.substr(pos);
+    return true;
+}
+
+void CalibrationCache::write(const std::string &key, const char *ext,
+                             const std::string &data)
+{
+    if (key.empty()) {
+        return;
+    }
+
+    std::string buf(DATA_MAGIC, sizeof(DATA_MAGIC));
+    put_u32(buf, VERSION);
+    put_str(buf, key);
+    buf += data;
+
+    const auto d = dir();
+    g_mkdir_with_parents(d.c_str(), 0777);
+    if (!write_file(dataFile(key, ext), buf) && settings->verbose) {
+        std::cout << "Calibration cache: error writing in " << d << std::endl;
+    }
+}
+
+bool CalibrationCache::loadTemplate(const std::string &key, int height,
+                                    int width, float **data)
+{
+    std::string buf;
+    if (!read(key, ".tpl", buf)) {
+        return false;
+    }
+
+    size_t pos = 0;
+    uint32_t h, w;
+    if (!get_u32(buf, pos, h) || !get_u32(buf, pos, w) ||
+        h != uint32_t(height) || w != uint32_t(width) ||
+        buf.size() - pos != size_t(height) * width * sizeof(float)) {
+        return false;
+    }
+    for (int row = 0; row < height; ++row) {
+        memcpy(data[row], buf.data() + pos, width * sizeof(float));
+        pos += width * sizeof(float);
+    }
+    return true;
+}
+
+void CalibrationCache::saveTemplate(const std::string &key, int height,
+                                    int width, const float *const *data)
+{
+    std::string buf;
+    buf.reserve(2 * sizeof(uint32_t) + size_t(height) * width * sizeof(float));
+    put_u32(buf, height);
+    put_u32(buf, width);
+    for (int row = 0; row < height; ++row) {
+        buf.append(reinterpret_cast<const char *>(data[row]),
+                   width * sizeof(float));
+    }
+    write(key, ".tpl", buf);
+}
+
+bool CalibrationCache::loadHotPixels(const std::string &key,
+                                     std::vector<badPix> &out)
+{
+    std::string buf;
+    if (!read(key, ".hot", buf)) {
+        return false;
+    }
+
+    size_t pos = 0;
+    uint32_t n;
+    if (!get_u32(buf, pos, n) ||
+        buf.size() - pos != size_t(n) * 2 * sizeof(uint16_t)) {
+        return false;
+    }
+    out.clear();
+    out.reserve(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        uint16_t xy[2];
+        memcpy(xy, buf.data() + pos, sizeof(xy));
+        pos += sizeof(xy);
+        out.push_back(badPix(xy[0], xy[1]));
+    }
+    return true;
+}
+
+void CalibrationCache::saveHotPixels(const std::string &key,
+                                     const std::vector<badPix> &pix)
+{
+    std::string buf;
+    buf.reserve(sizeof(uint32_t) + pix.size() * 2 * sizeof(uint16_t));
+    put_u32(buf, pix.size());
+    for (auto &p : pix) {
+        const uint16_t xy[2] = {p.x, p.y};
+        buf.append(reinterpret_cast<const char *>(xy), sizeof(xy));
+    }
+    write(key, ".hot", buf);
+}
+
+} // namespace rtengine
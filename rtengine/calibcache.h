@@ -0,0 +1,89 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include "pixelsmap.h"
+#include <glibmm/ustring.h>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Persistent cache of the dark frame and flat field managers, kept in
+ * <cacheBaseDir>/calibration/<name>.
+ *
+ * The index maps every file of the calibration directory (identified by its
+ * path, size and modification time) to the metadata used for matching it
+ * against the images, so that rescanning the directory doesn't need to parse
+ * the files again. The templates averaged from several files and the hot
+ * pixels extracted from the dark frames are stored next to it, keyed by the
+ * list of source files, so that they are computed only once.
+ */
+class CalibrationCache: public NonCopyable {
+public:
+    explicit CalibrationCache(const char *name);
+
+    /// identifies the current version of a file, empty if it doesn't exist
+    static std::string stamp(const Glib::ustring &fname);
+    /// key of the data computed from the given files
+    static std::string key(const std::list<Glib::ustring> &fnames);
+
+    void loadIndex();
+    /// an empty info marks a file which is not a usable calibration frame
+    bool getInfo(const Glib::ustring &fname, const std::string &stamp,
+                 std::string &info);
+    void putInfo(const Glib::ustring &fname, const std::string &stamp,
+                 const std::string &info);
+    /** writes the index, keeping only the files seen since loadIndex(), and
+        removes the stored data whose key is not in used_keys */
+    void saveIndex(const std::set<std::string> &used_keys);
+
+    bool loadTemplate(const std::string &key, int height, int width,
+                      float **data);
+    void saveTemplate(const std::string &key, int height, int width,
+                      const float *const *data);
+    bool loadHotPixels(const std::string &key, std::vector<badPix> &out);
+    void saveHotPixels(const std::string &key, const std::vector<badPix> &pix);
+
+private:
+    struct Entry {
+        std::string stamp;
+        std::string info;
+        bool seen;
+    };
+
+    Glib::ustring dir();
+    Glib::ustring dataFile(const std::string &key, const char *ext);
+    bool read(const std::string &key, const char *ext, std::string &out);
+    void write(const std::string &key, const char *ext,
+               const std::string &data);
+
+    const char *name_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> index_;
+    bool dirty_;
+};
+
+} // namespace rtengine
@@ -2,10 +2,14 @@
  *  This file is part of RawTherapee.
  */
 #include "camconst.h"
+#include "../rtgui/options.h"
 #include "rt_math.h"
 #include "settings.h"
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <glib/gstdio.h>
+#include <unistd.h>
 
 // cJSON is a very minimal JSON parser lib in C, not for threaded stuff etc, so
 // if we're going to use JSON more than just here we should probably replace
@@ -767,91 +771,126 @@ void CameraConst::update_globalGreenEquilibration(bool other)
     globalGreenEquilibration = (other ? 1 : 0);
 }
 
-bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
+namespace {
+
+// bump when the format of the index changes
+constexpr uint32_t INDEX_VERSION = 1;
+constexpr char INDEX_MAGIC[4] = {'A', 'R', 'C', 'C'};
+
+void put_u32(std::string &out, uint32_t v)
 {
-    // read the file into a single long string
-    const char *filename = filename_.c_str();
-    FILE *stream = fopen(filename, "rt");
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
 
-    if (stream == nullptr) {
-        fprintf(stderr, "Could not open camera constants file \"%s\": %s\n",
-                filename, strerror(errno));
+void put_str(std::string &out, const std::string &s)
+{
+    put_u32(out, s.size());
+    out.append(s);
+}
+
+bool get_u32(const std::string &in, size_t &pos, uint32_t &v)
+{
+    if (pos + sizeof(v) > in.size()) {
         return false;
     }
+    memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
 
-    size_t bufsize = 16384;
-    size_t increment = 2 * bufsize;
-    size_t datasize = 0, ret;
-    char *buf = (char *)malloc(bufsize);
-
-    while ((ret = fread(&buf[datasize], 1, bufsize - datasize, stream)) != 0) {
-        datasize += ret;
-
-        if (datasize == bufsize) { // we need more memory
-            bufsize += increment;
-            void *temp =
-                realloc(buf, bufsize);  // try to realloc buffer with new size
-            if (!temp) {                // realloc failed
-                temp = malloc(bufsize); // alloc now buffer
-                if (temp) {             // alloc worked
-                    memcpy(
-                        temp, buf,
-                        bufsize -
-                            increment); // copy old buffer content to new buffer
-                    free(buf);          // free old buffer
-                } else {                // alloc didn't work, break
-                    break;
-                }
-            }
-            buf = (char *)temp; // assign new buffer
-            increment *= 2;     // double increment
+// returns the position and size of the string, without copying it
+bool get_str(const std::string &in, size_t &pos, size_t &off, size_t &len)
+{
+    uint32_t n;
+    if (!get_u32(in, pos, n) || pos + n > in.size()) {
+        return false;
+    }
+    off = pos;
+    len = n;
+    pos += n;
+    return true;
+}
+
+// identifies the current version of the source files of the index
+std::string sources_key(const std::vector<Glib::ustring> &files)
+{
+    std::string ret;
+    for (auto &f : files) {
+        GStatBuf st;
+        if (g_stat(f.c_str(), &st) != 0) {
+            return "";
         }
+        ret += f.raw() + '\0' + std::to_string(st.st_size) + ":" +
+               std::to_string(int64_t(st.st_mtime)) + '\n';
     }
+    return ret;
+}
 
-    if (!feof(stream)) {
-        fclose(stream);
-        free(buf);
-        fprintf(stderr, "Failed to read camera constants file \"%s\"\n",
-                filename);
+// writes to a temporary file first, so that concurrent readers (possibly in
+// other processes) never see a partial file
+bool write_index(const Glib::ustring &fname, const std::string &data)
+{
+    std::string tmp = fname + ".XXXXXX";
+    const int fd = Glib::mkstemp(tmp);
+    if (fd < 0) {
         return false;
     }
+    close(fd);
+    FILE *f = g_fopen(tmp.c_str(), "wb");
+    if (!f) {
+        g_remove(tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
 
-    fclose(stream);
-
-    if (datasize == bufsize) {
-        buf = (char *)realloc(buf, datasize + 1);
+    if (ok && g_rename(tmp.c_str(), fname.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(fname.c_str());
+        ok = g_rename(tmp.c_str(), fname.c_str()) == 0;
     }
+    if (!ok) {
+        g_remove(tmp.c_str());
+    }
+    return ok;
+}
+
+} // namespace
 
-    buf[datasize] = '\0';
+bool CameraConstantsStore::compile_camera_constants_file(
+    const Glib::ustring &filename_, std::string &out, uint32_t &count)
+{
+    const char *filename = filename_.c_str();
+    std::string buf;
+    try {
+        buf = Glib::file_get_contents(filename_);
+    } catch (Glib::Exception &exc) {
+        fprintf(stderr, "Could not open camera constants file \"%s\": %s\n",
+                filename, exc.what().c_str());
+        return false;
+    }
 
     // remove comments
-    cJSON_Minify(buf);
+    cJSON_Minify(&buf[0]);
 
     // parse
-    cJSON *jsroot = cJSON_Parse(buf);
+    cJSON *jsroot = cJSON_Parse(buf.c_str());
 
     if (!jsroot) {
         char str[128];
         const char *ep = cJSON_GetErrorPtr() - 10;
 
-        if ((uintptr_t)ep < (uintptr_t)buf) {
-            ep = buf;
+        if ((uintptr_t)ep < (uintptr_t)buf.c_str()) {
+            ep = buf.c_str();
         }
 
         strncpy(str, ep, sizeof(str));
         str[sizeof(str) - 1] = '\0';
         fprintf(stderr, "JSON parse error in file \"%s\" near '%s'\n", filename,
                 str);
-        free(buf);
         return false;
     }
 
-    free(buf);
-    /*{
-        char *js_str = cJSON_Print(jsroot);
-        printf("%s\n", js_str);
-        free(js_str);
-    }*/
     cJSON *js = cJSON_GetObjectItem(jsroot, "camera_constants");
 
     if (!js) {
@@ -874,6 +913,13 @@ bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
             is_array = true;
         }
 
+        char *entry = cJSON_PrintUnformatted(js);
+        if (!entry) {
+            goto parse_error;
+        }
+        const std::string entry_str(entry);
+        free(entry);
+
         while (ji != nullptr) {
             if (ji->type != cJSON_String) {
                 fprintf(
@@ -882,48 +928,21 @@ bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
                 goto parse_error;
             }
 
+            // validate the entry now, so that errors are reported when the
+            // file is compiled rather than when the camera is used
             CameraConst *cc =
                 CameraConst::parseEntry((void *)js, ji->valuestring);
 
             if (!cc) {
                 goto parse_error;
             }
+            delete cc;
 
             Glib::ustring make_model(ji->valuestring);
-            make_model = make_model.uppercase();
-
-            const auto ret = mCameraConstants.emplace(make_model, cc);
-
-            if (ret.second) { // entry inserted into map
-                if (settings->verbose > 1) {
-                    printf("Add camera constants for \"%s\"\n",
-                           make_model.c_str());
-                }
-            } else {
-                // The CameraConst already exist for this camera make/model ->
-                // we merge the values
-                CameraConst *existingcc = ret.first->second;
-
-                // updating the dcraw matrix
-                existingcc->update_dcrawMatrix(cc->get_dcrawMatrix());
-                // deleting all the existing levels, replaced by the new ones
-                existingcc->update_Levels(cc);
-                existingcc->update_Crop(cc);
-                existingcc->update_rawMask(cc);
-                existingcc->update_pdafPattern(cc->get_pdafPattern());
-                existingcc->update_pdafOffset(cc->get_pdafOffset());
-                if (cc->has_globalGreenEquilibration()) {
-                    existingcc->update_globalGreenEquilibration(
-                        cc->get_globalGreenEquilibration());
-                }
-
-                if (settings->verbose > 1) {
-                    printf("Merging camera constants for \"%s\"\n",
-                           make_model.c_str());
-                }
-
-                delete cc;
-            }
+            put_str(out, make_model.uppercase());
+            put_str(out, ji->valuestring);
+            put_str(out, entry_str);
+            ++count;
 
             if (is_array) {
                 ji = ji->next;
@@ -938,11 +957,95 @@ bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
 
 parse_error:
     fprintf(stderr, "failed to parse camera constants file \"%s\"\n", filename);
-    mCameraConstants.clear();
     cJSON_Delete(jsroot);
     return false;
 }
 
+bool CameraConstantsStore::load_index(std::string &&data,
+                                      const std::string &key)
+{
+    index_.clear();
+    index_data_ = std::move(data);
+
+    const std::string &in = index_data_;
+    size_t pos = sizeof(INDEX_MAGIC);
+    uint32_t version, count;
+    size_t off, len;
+    if (in.size() < pos || memcmp(in.data(), INDEX_MAGIC, pos) != 0 ||
+        !get_u32(in, pos, version) || version != INDEX_VERSION ||
+        !get_str(in, pos, off, len) || in.compare(off, len, key) != 0 ||
+        !get_u32(in, pos, count)) {
+        index_data_.clear();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        size_t koff, klen;
+        IndexEntry e;
+        if (!get_str(in, pos, koff, klen) ||
+            !get_str(in, pos, e.name_off, e.name_len) ||
+            !get_str(in, pos, e.json_off, e.json_len)) {
+            index_.clear();
+            index_data_.clear();
+            return false;
+        }
+        index_[in.substr(koff, klen)].push_back(e);
+    }
+    return true;
+}
+
+CameraConst *CameraConstantsStore::build(const std::string &key)
+{
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+
+    CameraConst *ret = nullptr;
+    for (auto &e : it->second) {
+        const std::string name = index_data_.substr(e.name_off, e.name_len);
+        const std::string json = index_data_.substr(e.json_off, e.json_len);
+        cJSON *js = cJSON_Parse(json.c_str());
+        CameraConst *cc =
+            js ? CameraConst::parseEntry((void *)js, name.c_str()) : nullptr;
+        cJSON_Delete(js);
+        if (!cc) {
+            // can only happen if the index is corrupted
+            continue;
+        }
+
+        if (!ret) { // first entry for this camera make/model
+            if (settings->verbose > 1) {
+                printf("Add camera constants for \"%s\"\n", key.c_str());
+            }
+            ret = cc;
+        } else {
+            // The CameraConst already exist for this camera make/model ->
+            // we merge the values
+
+            // updating the dcraw matrix
+            ret->update_dcrawMatrix(cc->get_dcrawMatrix());
+            // deleting all the existing levels, replaced by the new ones
+            ret->update_Levels(cc);
+            ret->update_Crop(cc);
+            ret->update_rawMask(cc);
+            ret->update_pdafPattern(cc->get_pdafPattern());
+            ret->update_pdafOffset(cc->get_pdafOffset());
+            if (cc->has_globalGreenEquilibration()) {
+                ret->update_globalGreenEquilibration(
+                    cc->get_globalGreenEquilibration());
+            }
+
+            if (settings->verbose > 1) {
+                printf("Merging camera constants for \"%s\"\n", key.c_str());
+            }
+
+            delete cc;
+        }
+    }
+    return ret;
+}
+
 CameraConstantsStore::CameraConstantsStore() {}
 
 CameraConstantsStore::~CameraConstantsStore()
@@ -968,10 +1071,11 @@ void CameraConstantsStore::init(Glib::ustring baseDir,
     // note that the order is relevant, later files ones override earlier ones
     static const char *builtin_files[] = {"dcraw.json", "rt.json",
                                           "camconst.json", "cammatrices.json"};
+    std::vector<Glib::ustring> files;
     for (size_t i = 0; i < sizeof(builtin_files) / sizeof(const char *); ++i) {
         Glib::ustring f(Glib::build_filename(baseDir, builtin_files[i]));
         if (Glib::file_test(f, Glib::FILE_TEST_EXISTS)) {
-            parse_camera_constants_file(f);
+            files.push_back(f);
         }
     }
 
@@ -979,8 +1083,50 @@ void CameraConstantsStore::init(Glib::ustring baseDir,
         Glib::build_filename(userSettingsDir, "camconst.json"));
 
     if (Glib::file_test(userFile, Glib::FILE_TEST_EXISTS)) {
-        parse_camera_constants_file(userFile);
+        files.push_back(userFile);
+    }
+
+    MyMutex::MyLock lock(mutex_);
+
+    for (auto &p : mCameraConstants) {
+        delete p.second;
+    }
+    mCameraConstants.clear();
+
+    // the entries are parsed only when their camera is requested, from a
+    // compiled index of the files which is regenerated when they change
+    const std::string key = sources_key(files);
+    const Glib::ustring index_file =
+        Glib::build_filename(options.cacheBaseDir, "camconst.idx");
+    if (!key.empty()) {
+        try {
+            if (load_index(Glib::file_get_contents(index_file), key)) {
+                return;
+            }
+        } catch (Glib::Exception &) {
+        }
+    }
+
+    std::string data(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    put_u32(data, INDEX_VERSION);
+    put_str(data, key);
+    std::string entries;
+    uint32_t count = 0;
+    for (auto &f : files) {
+        if (!compile_camera_constants_file(f, entries, count)) {
+            // like before, an invalid file disables all the constants
+            entries.clear();
+            count = 0;
+        }
     }
+    put_u32(data, count);
+    data += entries;
+
+    if (!key.empty() && !write_index(index_file, data) && settings->verbose) {
+        printf("Could not write the camera constants index \"%s\"\n",
+               index_file.c_str());
+    }
+    load_index(std::move(data), key);
 }
 
 CameraConstantsStore *CameraConstantsStore::getInstance()
@@ -995,11 +1141,14 @@ CameraConst *CameraConstantsStore::get(const char make[], const char model[])
     key += " ";
     key += model;
     key = key.uppercase();
-    std::map<std::string, CameraConst *>::iterator it;
-    it = mCameraConstants.find(key);
+
+    MyMutex::MyLock lock(mutex_);
+
+    auto it = mCameraConstants.find(key);
 
     if (it == mCameraConstants.end()) {
-        return nullptr;
+        // also remember the cameras without constants
+        it = mCameraConstants.emplace(key, build(key)).first;
     }
 
     return it->second;
@@ -4,9 +4,13 @@
  */
 #pragma once
 
+#include "../rtgui/threadutils.h"
 #include <array>
+#include <cstdint>
 #include <glibmm.h>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace rtengine {
 
@@ -60,12 +64,31 @@ public:
     void update_rawMask(CameraConst *other);
 };
 
+/**
+ * The camera constants files are compiled into an index (in the cache
+ * directory, regenerated when any of them changes) holding the JSON entries
+ * of every camera make/model, in order. The CameraConst of a camera is built
+ * from them on first request.
+ */
 class CameraConstantsStore {
 private:
+    struct IndexEntry {
+        size_t name_off;
+        size_t name_len;
+        size_t json_off;
+        size_t json_len;
+    };
+
+    MyMutex mutex_;
     std::map<std::string, CameraConst *> mCameraConstants;
+    std::string index_data_;
+    std::unordered_map<std::string, std::vector<IndexEntry>> index_;
 
     CameraConstantsStore();
-    bool parse_camera_constants_file(Glib::ustring filename);
+    bool compile_camera_constants_file(const Glib::ustring &filename,
+                                       std::string &out, uint32_t &count);
+    bool load_index(std::string &&data, const std::string &key);
+    CameraConst *build(const std::string &key);
 
 public:
     ~CameraConstantsStore();
@@ -16,8 +16,11 @@
  *  along with ART.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "bitreader.h"
 #include "dcraw.h"
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 #if defined __GNUC__ && !defined __clang__ // silence warning
 #pragma GCC diagnostic push
@@ -548,17 +551,6 @@ namespace {
 
 // this should be divisible by 4
 #define CRX_BUF_SIZE 0x10000
-#if !defined(_WIN32) ||                                                        \
-    (defined(__GNUC__) && !defined(__INTRINSIC_SPECIAL__BitScanReverse))
-/* __INTRINSIC_SPECIAL__BitScanReverse found in MinGW32-W64 v7.30 headers, may
- * be there is a better solution? */
-typedef uint32_t DWORD;
-libraw_inline void _BitScanReverse(DWORD *Index, unsigned long Mask)
-{
-    *Index = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(Mask);
-}
-#define _byteswap_ulong(x) __builtin_bswap32(x)
-#endif
 
 #ifdef _OPENMP
 #define LIBRAW_USE_OPENMP
@@ -683,6 +675,7 @@ struct CrxImage {
     uint8_t encType;
     uint8_t tileCols;
     uint8_t tileRows;
+    uint8_t decodeSkip; // number of finest wavelet levels not decoded
     CrxTile *tiles;
     uint64_t mdatOffset;
     uint64_t mdatSize;
@@ -753,20 +746,22 @@ libraw_inline int crxBitstreamGetZeros(CrxBitstream *bitStrm)
     int32_t result = 0;
 
     if (bitStrm->bitData) {
-        _BitScanReverse((DWORD *)&nonZeroBit, (DWORD)bitStrm->bitData);
+        nonZeroBit = rtengine::bitreader_highest_bit(bitStrm->bitData);
         result = 31 - nonZeroBit;
-        bitStrm->bitData <<= 32 - nonZeroBit;
+        // (a shift by 32 would be undefined)
+        bitStrm->bitData =
+            nonZeroBit ? bitStrm->bitData << (32 - nonZeroBit) : 0;
         bitStrm->bitsLeft -= 32 - nonZeroBit;
     } else {
         uint32_t bitsLeft = bitStrm->bitsLeft;
         while (1) {
             while (bitStrm->curPos + 4 <= bitStrm->curBufSize) {
-                nextData = _byteswap_ulong(
-                    *(uint32_t *)(bitStrm->mdatBuf + bitStrm->curPos));
+                nextData = rtengine::bitreader_load_be32(bitStrm->mdatBuf +
+                                                         bitStrm->curPos);
                 bitStrm->curPos += 4;
                 crxFillBuffer(bitStrm);
                 if (nextData) {
-                    _BitScanReverse((DWORD *)&nonZeroBit, (DWORD)nextData);
+                    nonZeroBit = rtengine::bitreader_highest_bit(nextData);
                     result = bitsLeft + 31 - nonZeroBit;
                     bitStrm->bitData = nextData << (32 - nonZeroBit);
                     bitStrm->bitsLeft = nonZeroBit;
@@ -782,7 +777,7 @@ libraw_inline int crxBitstreamGetZeros(CrxBitstream *bitStrm)
                 break;
             bitsLeft += 8;
         }
-        _BitScanReverse((DWORD *)&nonZeroBit, (DWORD)nextData);
+        nonZeroBit = nextData ? rtengine::bitreader_highest_bit(nextData) : 0;
         result = (uint32_t)(bitsLeft + 7 - nonZeroBit);
         bitStrm->bitData = nextData << (32 - nonZeroBit);
         bitStrm->bitsLeft = nonZeroBit;
@@ -801,8 +796,8 @@ libraw_inline uint32_t crxBitstreamGetBits(CrxBitstream *bitStrm, int bits)
     if (bitsLeft < bits) {
         // get them from stream
         if (bitStrm->curPos + 4 <= bitStrm->curBufSize) {
-            nextWord = _byteswap_ulong(
-                *(uint32_t *)(bitStrm->mdatBuf + bitStrm->curPos));
+            nextWord = rtengine::bitreader_load_be32(bitStrm->mdatBuf +
+                                                     bitStrm->curPos);
             bitStrm->curPos += 4;
             crxFillBuffer(bitStrm);
             bitStrm->bitsLeft = 32 - (bits - bitsLeft);
@@ -2377,6 +2372,75 @@ static unsigned sgetn(int n, unsigned char *s)
     return result;
 }
 
+// decodes a single tile of the given plane, whose top left corner is at
+// (imageRow, imageCol). Tiles (and the planes of a tile) have their own
+// buffers and decoding state, so they can be decoded concurrently
+int crxDecodeTile(CrxImage *img, CrxTile *tile, uint32_t planeNumber,
+                  int imageRow, int imageCol)
+{
+    CrxPlaneComp *planeComp = tile->comps + planeNumber;
+    uint64_t tileMdatOffset = tile->dataOffset + tile->mdatQPDataSize +
+                              tile->mdatExtraSize + planeComp->dataOffset;
+
+    // decode single tile
+    if (crxSetupSubbandData(img, planeComp, tile, tileMdatOffset))
+        return -1;
+
+    if (img->levels && img->decodeSkip) {
+        // reduced resolution: stop at the low band of a coarser level, and
+        // replicate each sample to fill the full-size tile
+        const int top = img->levels - 1 - img->decodeSkip;
+        const int f = 1 << img->decodeSkip;
+        if (crxIdwt53FilterInitialize(planeComp, top + 1, tile->qStep))
+            return -1;
+        const int w = planeComp->wvltTransform[top].width;
+        std::vector<int32_t> line(tile->width);
+        for (int i = 0; i < planeComp->wvltTransform[top].height; ++i) {
+            if (crxIdwt53FilterDecode(planeComp, top, tile->qStep) ||
+                crxIdwt53FilterTransform(planeComp, top))
+                return -1;
+            int32_t *lineData = crxIdwt53FilterGetLine(planeComp, top);
+            for (int j = 0; j < tile->width; ++j)
+                line[j] = lineData[std::min(j / f, w - 1)];
+            for (int k = i * f; k < std::min((i + 1) * f, int(tile->height));
+                 ++k)
+                crxConvertPlaneLine(img, imageRow + k, imageCol, planeNumber,
+                                    line.data(), tile->width);
+        }
+    } else if (img->levels) {
+        if (crxIdwt53FilterInitialize(planeComp, img->levels, tile->qStep))
+            return -1;
+        for (int i = 0; i < tile->height; ++i) {
+            if (crxIdwt53FilterDecode(planeComp, img->levels - 1,
+                                      tile->qStep) ||
+                crxIdwt53FilterTransform(planeComp, img->levels - 1))
+                return -1;
+            int32_t *lineData =
+                crxIdwt53FilterGetLine(planeComp, img->levels - 1);
+            crxConvertPlaneLine(img, imageRow + i, imageCol, planeNumber,
+                                lineData, tile->width);
+        }
+    } else {
+        // we have the only subband in this case
+        if (!planeComp->subBands->dataSize) {
+            memset(planeComp->subBands->bandBuf, 0,
+                   planeComp->subBands->bandSize);
+            return 0;
+        }
+
+        for (int i = 0; i < tile->height; ++i) {
+            if (crxDecodeLine(planeComp->subBands->bandParam,
+                              planeComp->subBands->bandBuf))
+                return -1;
+            int32_t *lineData = (int32_t *)planeComp->subBands->bandBuf;
+            crxConvertPlaneLine(img, imageRow + i, imageCol, planeNumber,
+                                lineData, tile->width);
+        }
+    }
+
+    return 0;
+}
+
 } // namespace
 
 int DCraw::crxDecodePlane(void *p, uint32_t planeNumber)
@@ -2387,46 +2451,8 @@ int DCraw::crxDecodePlane(void *p, uint32_t planeNumber)
         int imageCol = 0;
         for (int tCol = 0; tCol < img->tileCols; tCol++) {
             CrxTile *tile = img->tiles + tRow * img->tileCols + tCol;
-            CrxPlaneComp *planeComp = tile->comps + planeNumber;
-            uint64_t tileMdatOffset = tile->dataOffset + tile->mdatQPDataSize +
-                                      tile->mdatExtraSize +
-                                      planeComp->dataOffset;
-
-            // decode single tile
-            if (crxSetupSubbandData(img, planeComp, tile, tileMdatOffset))
+            if (crxDecodeTile(img, tile, planeNumber, imageRow, imageCol))
                 return -1;
-
-            if (img->levels) {
-                if (crxIdwt53FilterInitialize(planeComp, img->levels,
-                                              tile->qStep))
-                    return -1;
-                for (int i = 0; i < tile->height; ++i) {
-                    if (crxIdwt53FilterDecode(planeComp, img->levels - 1,
-                                              tile->qStep) ||
-                        crxIdwt53FilterTransform(planeComp, img->levels - 1))
-                        return -1;
-                    int32_t *lineData =
-                        crxIdwt53FilterGetLine(planeComp, img->levels - 1);
-                    crxConvertPlaneLine(img, imageRow + i, imageCol,
-                                        planeNumber, lineData, tile->width);
-                }
-            } else {
-                // we have the only subband in this case
-                if (!planeComp->subBands->dataSize) {
-                    memset(planeComp->subBands->bandBuf, 0,
-                           planeComp->subBands->bandSize);
-                    return 0;
-                }
-
-                for (int i = 0; i < tile->height; ++i) {
-                    if (crxDecodeLine(planeComp->subBands->bandParam,
-                                      planeComp->subBands->bandBuf))
-                        return -1;
-                    int32_t *lineData = (int32_t *)planeComp->subBands->bandBuf;
-                    crxConvertPlaneLine(img, imageRow + i, imageCol,
-                                        planeNumber, lineData, tile->width);
-                }
-            }
             imageCol += tile->width;
         }
         imageRow += img->tiles[tRow * img->tileCols].height;
@@ -3156,14 +3182,41 @@ int crxFreeImageData(CrxImage *img)
 void DCraw::crxLoadDecodeLoop(void *img, int nPlanes)
 {
 #ifdef LIBRAW_USE_OPENMP
-    int results[4]; // nPlanes is always <= 4
-#pragma omp parallel for
-    for (int32_t plane = 0; plane < nPlanes; ++plane)
-        results[plane] = crxDecodePlane(img, plane);
+    // decode all the (tile, plane) pairs in parallel, instead of one thread
+    // per plane -- which would use at most 4 threads
+    CrxImage *image = (CrxImage *)img;
+    struct Task {
+        CrxTile *tile;
+        int plane;
+        int row;
+        int col;
+    };
+    std::vector<Task> tasks;
+    int imageRow = 0;
+    for (int tRow = 0; tRow < image->tileRows; tRow++) {
+        int imageCol = 0;
+        for (int tCol = 0; tCol < image->tileCols; tCol++) {
+            CrxTile *tile = image->tiles + tRow * image->tileCols + tCol;
+            for (int32_t plane = 0; plane < nPlanes; ++plane)
+                tasks.push_back({tile, plane, imageRow, imageCol});
+            imageCol += tile->width;
+        }
+        imageRow += image->tiles[tRow * image->tileCols].height;
+    }
 
-    for (int32_t plane = 0; plane < nPlanes; ++plane)
-        if (results[plane])
-            derror();
+    int failed = 0;
+#pragma omp parallel for schedule(dynamic) reduction(| : failed)
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        const Task &t = tasks[i];
+        try {
+            failed |= crxDecodeTile(image, t.tile, t.plane, t.row, t.col);
+        } catch (...) { // exceptions must not escape the parallel region
+            failed = 1;
+        }
+    }
+
+    if (failed)
+        derror();
 #else
     for (int32_t plane = 0; plane < nPlanes; ++plane)
         if (crxDecodePlane(img, plane))
@@ -3238,6 +3291,19 @@ void DCraw::crxLoadRaw()
         derror();
     free(hdrBuf);
 
+    // skip the finest wavelet levels as long as the planes stay at least
+    // RT_decode_min_size pixels large (only for lossy files, which have
+    // more than one level)
+    img.decodeSkip = 0;
+    if (RT_decode_min_size > 0) {
+        while (img.decodeSkip + 1 < img.levels &&
+               std::min(img.planeWidth, img.planeHeight) >>
+                       (img.decodeSkip + 1) >=
+                   RT_decode_min_size)
+            ++img.decodeSkip;
+    }
+    RT_decode_reduced = img.decodeSkip > 0;
+
     crxLoadDecodeLoop(&img, hdr.nPlanes);
 
     if (img.encType == 3)
@@ -782,6 +782,132 @@ void Ciecam02::jch2xyz_ciecam02float(vfloat &x, vfloat &y, vfloat &z, vfloat J,
 }
 #endif
 
+void Ciecam02::initViewingConditions(ViewingConditions &vc, float xw,
+                                     float yw, float zw, float c, float nc,
+                                     float n, float nbb, float ncb, float fl,
+                                     float cz, float d, float aw)
+{
+    vc.xw = xw;
+    vc.yw = yw;
+    vc.zw = zw;
+    vc.c = c;
+    vc.nc = nc;
+    vc.n = n;
+    vc.nbb = nbb;
+    vc.ncb = ncb;
+    vc.fl = fl;
+    vc.cz = cz;
+    vc.d = d;
+    vc.aw = aw;
+
+    float rw, gw, bw;
+    xyz_to_cat02float(rw, gw, bw, xw, yw, zw);
+    vc.adapt[0] = ((yw * d) / rw) + (1.f - d);
+    vc.adapt[1] = ((yw * d) / gw) + (1.f - d);
+    vc.adapt[2] = ((yw * d) / bw) + (1.f - d);
+    vc.ncncb = (961.53846f) * nc * ncb;
+    vc.jexp = c * cz * 0.5f;
+    vc.reccmcz = 1.f / (c * cz);
+}
+
+void Ciecam02::xyz2jch_ciecam02float(float *J, float *C, float *h,
+                                     const float *x, const float *y,
+                                     const float *z, int count,
+                                     const ViewingConditions &vc)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat adaptrv = F2V(vc.adapt[0]);
+    const vfloat adaptgv = F2V(vc.adapt[1]);
+    const vfloat adaptbv = F2V(vc.adapt[2]);
+    const vfloat flv = F2V(vc.fl);
+    const vfloat nbbv = F2V(vc.nbb);
+    const vfloat recawv = F2V(1.f / vc.aw);
+    const vfloat jexpv = F2V(vc.jexp);
+    const vfloat ncncbv = F2V(vc.ncncb);
+    const vfloat pow1v = F2V(vc.n);
+    const vfloat twopiv = F2V(2.f * rtengine::RT_PI);
+    const vfloat rad2degv = F2V(180.f / rtengine::RT_PI);
+
+    for (; i < count - 3; i += 4) {
+        vfloat r, g, b;
+        xyz_to_cat02float(r, g, b, LVFU(x[i]), LVFU(y[i]), LVFU(z[i]));
+        vfloat rp, gp, bp;
+        cat02_to_hpefloat(rp, gp, bp, r * adaptrv, g * adaptgv, b * adaptbv);
+        // gamut correction M.H.Brill S.Susstrunk
+        rp = vmaxf(rp, ZEROV);
+        gp = vmaxf(gp, ZEROV);
+        bp = vmaxf(bp, ZEROV);
+        const vfloat rpa = nonlinear_adaptationfloat(rp, flv);
+        const vfloat gpa = nonlinear_adaptationfloat(gp, flv);
+        const vfloat bpa = nonlinear_adaptationfloat(bp, flv);
+
+        const vfloat ca = rpa - ((F2V(12.0f) * gpa) - bpa) / F2V(11.0f);
+        const vfloat cb = F2V(0.11111111f) * (rpa + gpa - (bpa + bpa));
+
+        vfloat myh = xatan2f(cb, ca);
+        myh = vself(vmaskf_lt(myh, ZEROV), myh + twopiv, myh);
+
+        vfloat a =
+            ((rpa + rpa) + gpa + (F2V(0.05f) * bpa) - F2V(0.305f)) * nbbv;
+        a = vmaxf(a, ZEROV); // gamut correction M.H.Brill S.Susstrunk
+
+        const vfloat jv = pow_F(a * recawv, jexpv);
+
+        const vfloat e = ncncbv * (xcosf(myh + F2V(2.0f)) + F2V(3.8f));
+        const vfloat t = (e * vsqrtf((ca * ca) + (cb * cb))) /
+                         (rpa + gpa + (F2V(1.05f) * bpa));
+
+        STVFU(C[i], pow_F(t, F2V(0.9f)) * jv * pow1v);
+        STVFU(J[i], jv * jv * F2V(100.0f));
+        STVFU(h[i], myh * rad2degv);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        xyz2jch_ciecam02float(J[i], C[i], h[i], vc.aw, vc.fl, x[i], y[i],
+                              z[i], vc.xw, vc.yw, vc.zw, vc.c, vc.nc, vc.n,
+                              vc.nbb, vc.ncb, vc.cz, vc.d);
+    }
+}
+
+void Ciecam02::jch2xyz_ciecam02float(float *x, float *y, float *z,
+                                     const float *J, const float *C,
+                                     const float *h, int count,
+                                     const ViewingConditions &vc)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat xwv = F2V(vc.xw);
+    const vfloat ywv = F2V(vc.yw);
+    const vfloat zwv = F2V(vc.zw);
+    const vfloat ncv = F2V(vc.nc);
+    const vfloat pow1v = F2V(vc.n);
+    const vfloat nbbv = F2V(vc.nbb);
+    const vfloat ncbv = F2V(vc.ncb);
+    const vfloat flv = F2V(vc.fl);
+    const vfloat dv = F2V(vc.d);
+    const vfloat awv = F2V(vc.aw);
+    const vfloat reccmczv = F2V(vc.reccmcz);
+
+    for (; i < count - 3; i += 4) {
+        vfloat xv, yv, zv;
+        jch2xyz_ciecam02float(xv, yv, zv, LVFU(J[i]), LVFU(C[i]), LVFU(h[i]),
+                              xwv, ywv, zwv, ncv, pow1v, nbbv, ncbv, flv, dv,
+                              awv, reccmczv);
+        STVFU(x[i], xv);
+        STVFU(y[i], yv);
+        STVFU(z[i], zv);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        jch2xyz_ciecam02float(x[i], y[i], z[i], J[i], C[i], h[i], vc.xw,
+                              vc.yw, vc.zw, vc.c, vc.nc, vc.n, vc.nbb, vc.ncb,
+                              vc.fl, vc.cz, vc.d, vc.aw);
+    }
+}
+
 float Ciecam02::nonlinear_adaptationfloat(float c, float fl)
 {
     float p;
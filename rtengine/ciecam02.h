@@ -124,6 +124,38 @@ public:
         vfloat nbb, vfloat ncb, vfloat pfl, vfloat cz, vfloat d);
 
 #endif
+
+    /**
+     * Viewing conditions of the batch conversions, together with the terms
+     * depending only on them (which the per-pixel functions recompute for
+     * every pixel).
+     */
+    struct ViewingConditions {
+        float xw, yw, zw, c, nc, n, nbb, ncb, fl, cz, d, aw;
+        float adapt[3]; // chromatic adaptation of the CAT02 channels
+        float ncncb;    // eccentricity factor
+        float jexp;     // exponent of the forward lightness
+        float reccmcz;  // exponent of the inverse lightness
+    };
+
+    static void initViewingConditions(ViewingConditions &vc, float xw,
+                                      float yw, float zw, float c, float nc,
+                                      float n, float nbb, float ncb, float fl,
+                                      float cz, float d, float aw);
+
+    /**
+     * Batch versions of xyz2jch_ciecam02float and jch2xyz_ciecam02float, on
+     * count values of planar rows. The output rows must not overlap the
+     * input ones.
+     */
+    static void xyz2jch_ciecam02float(float *J, float *C, float *h,
+                                      const float *x, const float *y,
+                                      const float *z, int count,
+                                      const ViewingConditions &vc);
+    static void jch2xyz_ciecam02float(float *x, float *y, float *z,
+                                      const float *J, const float *C,
+                                      const float *h, int count,
+                                      const ViewingConditions &vc);
 };
 } // namespace rtengine
 #endif
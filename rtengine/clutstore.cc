@@ -2,6 +2,7 @@
 #include <unordered_map>
 
 #include "clutstore.h"
+#include "haldclut_kernels.h"
 
 #include "iccstore.h"
 #include "imagefloat.h"
@@ -10,12 +11,16 @@
 #include "rt_math.h"
 #include "settings.h"
 #include "stdimagesource.h"
+#include "utils.h"
 
+#include <cstring>
 #include <fstream>
 #include <giomm.h>
+#include <glib/gstdio.h>
 #include <iostream>
 #include <locale.h>
 #include <sstream>
+#include <unistd.h>
 
 #include "../rtgui/multilangmgr.h"
 #include "../rtgui/options.h"
@@ -105,12 +110,179 @@ bool loadFile(const Glib::ustring &filename,
     return res;
 }
 
+// On-disk cache of the decoded HaldCLUTs. The entries are memory mapped, so
+// that all the ART processes using the same CLUT share a single copy of the
+// lattice. Every entry is a header of HALD_CACHE_HEADER_SIZE bytes (magic,
+// version, byte order mark and level) followed by the lattice as produced by
+// loadFile()
+constexpr char HALD_CACHE_MAGIC[8] = {'A', 'R', 'T', 'H', 'A', 'L', 'D', '\n'};
+constexpr std::uint32_t HALD_CACHE_VERSION = 1;
+constexpr std::uint32_t HALD_CACHE_BYTE_ORDER_MARK = 0x01020304;
+// keeps the lattice aligned to a cache line in the mapping
+constexpr std::size_t HALD_CACHE_HEADER_SIZE = 64;
+
+Glib::ustring get_hald_cache_dir()
+{
+    return Glib::build_filename(options.cacheBaseDir, "haldclut");
+}
+
+// number of uint16 values in the lattice of a CLUT of the given level
+std::size_t get_lattice_size(unsigned int level)
+{
+    const std::size_t side = std::size_t(level) * level * level;
+    return side * side * 4 + 4;
+}
+
+GMappedFile *map_hald_cache(const Glib::ustring &path, unsigned int &level)
+{
+    GMappedFile *f = g_mapped_file_new(path.c_str(), FALSE, nullptr);
+    if (!f) {
+        return nullptr;
+    }
+
+    const char *data = g_mapped_file_get_contents(f);
+    const std::size_t size = g_mapped_file_get_length(f);
+    std::uint32_t header[3] = {0, 0, 0}; // version, bom, level
+    bool ok = size >= HALD_CACHE_HEADER_SIZE &&
+              memcmp(data, HALD_CACHE_MAGIC, sizeof(HALD_CACHE_MAGIC)) == 0;
+    if (ok) {
+        memcpy(header, data + sizeof(HALD_CACHE_MAGIC), sizeof(header));
+        ok = header[0] == HALD_CACHE_VERSION &&
+             header[1] == HALD_CACHE_BYTE_ORDER_MARK && header[2] > 1 &&
+             header[2] <= 16 &&
+             size == HALD_CACHE_HEADER_SIZE +
+                         get_lattice_size(header[2]) * sizeof(std::uint16_t);
+    }
+    if (!ok) {
+        g_mapped_file_unref(f);
+        if (settings->verbose) {
+            std::cout << "HaldCLUT cache: invalid entry " << path << std::endl;
+        }
+        g_remove(path.c_str());
+        return nullptr;
+    }
+
+    // keep track of the use across sessions
+    g_utime(path.c_str(), nullptr);
+
+    level = header[2];
+    return f;
+}
+
+// removes the least recently used entries until the cache fits in
+// settings->clut_disk_cache_size
+void trim_hald_cache(const Glib::ustring &keep)
+{
+    const std::size_t max_size =
+        std::size_t(std::max(settings->clut_disk_cache_size, 0)) * 1024 *
+        1024;
+    const auto dir_name = get_hald_cache_dir();
+    const auto dir = Gio::File::create_for_path(dir_name);
+
+    struct FileInfo {
+        Glib::ustring name;
+        Glib::TimeVal mtime;
+        std::size_t size;
+    };
+    std::vector<FileInfo> files;
+    std::size_t total = 0;
+
+    try {
+        auto enumerator = dir->enumerate_children(
+            "standard::name,standard::size,time::modified");
+        while (auto file = enumerator->next_file()) {
+            files.push_back({file->get_name(), file->modification_time(),
+                             std::size_t(file->get_size())});
+            total += files.back().size;
+        }
+    } catch (Glib::Exception &) {
+    }
+
+    if (total <= max_size) {
+        return;
+    }
+
+    std::sort(files.begin(), files.end(),
+              [](const FileInfo &lhs, const FileInfo &rhs) {
+                  return lhs.mtime < rhs.mtime;
+              });
+
+    for (auto &f : files) {
+        if (total <= max_size) {
+            break;
+        }
+        const Glib::ustring pth = Glib::build_filename(dir_name, f.name);
+        if (pth == keep) {
+            continue;
+        }
+        // entries still mapped by other processes stay valid on POSIX
+        // systems, and fail to be removed on Windows
+        if (g_remove(pth.c_str()) == 0) {
+            total -= f.size;
+            if (settings->verbose > 1) {
+                std::cout << "HaldCLUT cache: removed " << pth << std::endl;
+            }
+        }
+    }
+}
+
+void store_hald_cache(const Glib::ustring &path, unsigned int level,
+                      const AlignedBuffer<std::uint16_t> &clut_image)
+{
+    const auto dir = get_hald_cache_dir();
+    if (g_mkdir_with_parents(dir.c_str(), 0777) != 0) {
+        return;
+    }
+
+    // write to a temporary file first, so that concurrent readers
+    // (possibly in other processes) never see a partial entry
+    std::string tmp = path + ".XXXXXX";
+    const int fd = Glib::mkstemp(tmp);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    FILE *f = g_fopen(tmp.c_str(), "wb");
+    if (!f) {
+        g_remove(tmp.c_str());
+        return;
+    }
+
+    char header[HALD_CACHE_HEADER_SIZE] = {};
+    const std::uint32_t values[3] = {HALD_CACHE_VERSION,
+                                     HALD_CACHE_BYTE_ORDER_MARK, level};
+    memcpy(header, HALD_CACHE_MAGIC, sizeof(HALD_CACHE_MAGIC));
+    memcpy(header + sizeof(HALD_CACHE_MAGIC), values, sizeof(values));
+    fwrite(header, sizeof(header), 1, f);
+    fwrite(clut_image.data, sizeof(std::uint16_t), get_lattice_size(level),
+           f);
+    bool ok = !ferror(f);
+    fclose(f);
+
+    if (ok && g_rename(tmp.c_str(), path.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(path.c_str());
+        ok = g_rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    if (!ok) {
+        g_remove(tmp.c_str());
+        if (settings->verbose) {
+            std::cout << "HaldCLUT cache: error writing " << path << std::endl;
+        }
+        return;
+    }
+    if (settings->verbose > 1) {
+        std::cout << "HaldCLUT cache: stored " << path << std::endl;
+    }
+    trim_hald_cache(path);
+}
+
 #ifdef __SSE2__
-vfloat2 getClutValues(const AlignedBuffer<std::uint16_t> &clut_image,
-                      size_t index)
+vfloat2 getClutValues(const std::uint16_t *clut_data, size_t index)
 {
-    const vint v_values = _mm_loadu_si128(
-        reinterpret_cast<const vint *>(clut_image.data + index));
+    const vint v_values =
+        _mm_loadu_si128(reinterpret_cast<const vint *>(clut_data + index));
 #ifdef __SSE4_1__
     return {_mm_cvtepi32_ps(_mm_cvtepu16_epi32(v_values)),
             _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(v_values, 8)))};
@@ -134,31 +306,63 @@ vfloat2 getClutValues(const AlignedBuffer<std::uint16_t> &clut_image,
 } // namespace
 
 rtengine::HaldCLUT::HaldCLUT()
-    : clut_level(0), flevel_minus_one(0.0f), flevel_minus_two(0.0f),
-      clut_profile("sRGB")
+    : clut_mapping(nullptr), clut_data(nullptr), clut_level(0),
+      flevel_minus_one(0.0f), flevel_minus_two(0.0f), clut_profile("sRGB")
 {
 }
 
-rtengine::HaldCLUT::~HaldCLUT() {}
+rtengine::HaldCLUT::~HaldCLUT()
+{
+    if (clut_mapping) {
+        g_mapped_file_unref(clut_mapping);
+    }
+}
 
 bool rtengine::HaldCLUT::load(const Glib::ustring &filename)
 {
-    if (loadFile(filename, "", clut_image, clut_level)) {
-        Glib::ustring name, ext;
-        rtengine::CLUTStore::splitClutFilename(filename, name, ext,
-                                               clut_profile);
-
-        clut_filename = filename;
-        clut_level *= clut_level;
-        flevel_minus_one = static_cast<float>(clut_level - 1) / 65535.0f;
-        flevel_minus_two = static_cast<float>(clut_level - 2);
-        return true;
+    Glib::ustring cache_path;
+    if (settings->clut_disk_cache_size > 0) {
+        const auto md5 = getMD5(filename, true);
+        if (!md5.empty()) {
+            cache_path = Glib::build_filename(get_hald_cache_dir(),
+                                              md5 + ".arthald");
+        }
+    }
+
+    if (!cache_path.empty()) {
+        clut_mapping = map_hald_cache(cache_path, clut_level);
     }
 
-    return false;
+    if (clut_mapping) {
+        clut_data = reinterpret_cast<const std::uint16_t *>(
+            g_mapped_file_get_contents(clut_mapping) +
+            HALD_CACHE_HEADER_SIZE);
+    } else if (loadFile(filename, "", clut_image, clut_level)) {
+        clut_data = clut_image.data;
+        if (!cache_path.empty()) {
+            store_hald_cache(cache_path, clut_level, clut_image);
+        }
+    } else {
+        return false;
+    }
+
+    Glib::ustring name, ext;
+    rtengine::CLUTStore::splitClutFilename(filename, name, ext, clut_profile);
+
+    clut_filename = filename;
+    clut_level *= clut_level;
+    flevel_minus_one = static_cast<float>(clut_level - 1) / 65535.0f;
+    flevel_minus_two = static_cast<float>(clut_level - 2);
+    return true;
 }
 
-rtengine::HaldCLUT::operator bool() const { return !clut_image.isEmpty(); }
+rtengine::HaldCLUT::operator bool() const { return clut_data != nullptr; }
+
+std::size_t rtengine::HaldCLUT::getMemorySize() const
+{
+    const std::size_t nodes = std::size_t(clut_level) * clut_level * clut_level;
+    return clut_data ? (nodes * 4 + 4) * sizeof(std::uint16_t) : 0;
+}
 
 Glib::ustring rtengine::HaldCLUT::getFilename() const { return clut_filename; }
 
@@ -196,21 +400,21 @@ void rtengine::HaldCLUT::getRGB(float strength, std::size_t line_size,
 
         float tmp1[4] ALIGNED16;
         tmp1[0] =
-            intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp1[1] = intp<float>(re, clut_image.data[index + 5],
-                              clut_image.data[index + 1]);
-        tmp1[2] = intp<float>(re, clut_image.data[index + 6],
-                              clut_image.data[index + 2]);
+            intp<float>(re, clut_data[index + 4], clut_data[index]);
+        tmp1[1] = intp<float>(re, clut_data[index + 5],
+                              clut_data[index + 1]);
+        tmp1[2] = intp<float>(re, clut_data[index + 6],
+                              clut_data[index + 2]);
 
         index = (color + level) * 4;
 
         float tmp2[4] ALIGNED16;
         tmp2[0] =
-            intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp2[1] = intp<float>(re, clut_image.data[index + 5],
-                              clut_image.data[index + 1]);
-        tmp2[2] = intp<float>(re, clut_image.data[index + 6],
-                              clut_image.data[index + 2]);
+            intp<float>(re, clut_data[index + 4], clut_data[index]);
+        tmp2[1] = intp<float>(re, clut_data[index + 5],
+                              clut_data[index + 1]);
+        tmp2[2] = intp<float>(re, clut_data[index + 6],
+                              clut_data[index + 2]);
 
         out_rgbx[0] = intp<float>(gr, tmp2[0], tmp1[0]);
         out_rgbx[1] = intp<float>(gr, tmp2[1], tmp1[1]);
@@ -219,20 +423,20 @@ void rtengine::HaldCLUT::getRGB(float strength, std::size_t line_size,
         index = (color + level_square) * 4;
 
         tmp1[0] =
-            intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp1[1] = intp<float>(re, clut_image.data[index + 5],
-                              clut_image.data[index + 1]);
-        tmp1[2] = intp<float>(re, clut_image.data[index + 6],
-                              clut_image.data[index + 2]);
+            intp<float>(re, clut_data[index + 4], clut_data[index]);
+        tmp1[1] = intp<float>(re, clut_data[index + 5],
+                              clut_data[index + 1]);
+        tmp1[2] = intp<float>(re, clut_data[index + 6],
+                              clut_data[index + 2]);
 
         index = (color + level + level_square) * 4;
 
         tmp2[0] =
-            intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp2[1] = intp<float>(re, clut_image.data[index + 5],
-                              clut_image.data[index + 1]);
-        tmp2[2] = intp<float>(re, clut_image.data[index + 6],
-                              clut_image.data[index + 2]);
+            intp<float>(re, clut_data[index + 4], clut_data[index]);
+        tmp2[1] = intp<float>(re, clut_data[index + 5],
+                              clut_data[index + 1]);
+        tmp2[2] = intp<float>(re, clut_data[index + 6],
+                              clut_data[index + 2]);
 
         tmp1[0] = intp<float>(gr, tmp2[0], tmp1[0]);
         tmp1[1] = intp<float>(gr, tmp2[1], tmp1[1]);
@@ -255,12 +459,12 @@ void rtengine::HaldCLUT::getRGB(float strength, std::size_t line_size,
 
         const vfloat v_r = PERMUTEPS(v_rgb, _MM_SHUFFLE(0, 0, 0, 0));
 
-        vfloat2 v_clut_values = getClutValues(clut_image, index);
+        vfloat2 v_clut_values = getClutValues(clut_data, index);
         vfloat v_tmp1 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
 
         index = (color + level) * 4;
 
-        v_clut_values = getClutValues(clut_image, index);
+        v_clut_values = getClutValues(clut_data, index);
         vfloat v_tmp2 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
 
         const vfloat v_g = PERMUTEPS(v_rgb, _MM_SHUFFLE(1, 1, 1, 1));
@@ -269,12 +473,12 @@ void rtengine::HaldCLUT::getRGB(float strength, std::size_t line_size,
 
         index = (color + level_square) * 4;
 
-        v_clut_values = getClutValues(clut_image, index);
+        v_clut_values = getClutValues(clut_data, index);
         v_tmp1 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
 
         index = (color + level + level_square) * 4;
 
-        v_clut_values = getClutValues(clut_image, index);
+        v_clut_values = getClutValues(clut_data, index);
         v_tmp2 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
 
         v_tmp1 = vintpf(v_g, v_tmp2, v_tmp1);
@@ -288,6 +492,31 @@ void rtengine::HaldCLUT::getRGB(float strength, std::size_t line_size,
     }
 }
 
+void rtengine::HaldCLUT::getRGB(float strength, std::size_t line_size,
+                                const float *r, const float *g, const float *b,
+                                float *out_r, float *out_g, float *out_b) const
+{
+    const auto &kernels = haldclut::get_kernels();
+    if (kernels.apply) {
+        const haldclut::Lattice lut = {clut_data, int(clut_level),
+                                       flevel_minus_one, flevel_minus_two};
+        kernels.apply(lut, strength, line_size, r, g, b, out_r, out_g, out_b);
+        return;
+    }
+
+    constexpr std::size_t CHUNK = 64;
+    float out_rgbx[4 * CHUNK] ALIGNED16;
+    for (std::size_t i = 0; i < line_size; i += CHUNK) {
+        const std::size_t n = std::min(CHUNK, line_size - i);
+        getRGB(strength, n, r + i, g + i, b + i, out_rgbx);
+        for (std::size_t j = 0; j < n; ++j) {
+            out_r[i + j] = out_rgbx[4 * j];
+            out_g[i + j] = out_rgbx[4 * j + 1];
+            out_b[i + j] = out_rgbx[4 * j + 2];
+        }
+    }
+}
+
 rtengine::CLUTStore::CLUTName
 rtengine::CLUTStore::getClutDisplayName(const Glib::ustring &filename)
 {
@@ -436,7 +665,6 @@ rtengine::CLUTStore &rtengine::CLUTStore::getInstance()
 std::shared_ptr<rtengine::HaldCLUT>
 rtengine::CLUTStore::getHaldClut(const Glib::ustring &filename) const
 {
-    MyMutex::MyLock lock(mutex_);
     std::shared_ptr<rtengine::HaldCLUT> result;
 
     const Glib::ustring full_filename =
@@ -444,12 +672,31 @@ rtengine::CLUTStore::getHaldClut(const Glib::ustring &filename) const
             ? Glib::ustring(Glib::build_filename(options.clutsDir, filename))
             : filename;
 
-    if (!cache.get(full_filename, result)) {
-        std::unique_ptr<rtengine::HaldCLUT> clut(new rtengine::HaldCLUT);
+    {
+        MyMutex::MyLock lock(mutex_);
+        if (cache.get(full_filename, result)) {
+            return result;
+        }
+    }
 
-        if (clut->load(full_filename)) {
-            result = std::move(clut);
-            cache.insert(full_filename, result);
+    // decode without holding the lock, so that different CLUTs can be
+    // loaded in parallel. If the same CLUT is requested concurrently, the
+    // first copy that makes it to the cache is shared
+    std::shared_ptr<rtengine::HaldCLUT> clut(new rtengine::HaldCLUT);
+    if (!clut->load(full_filename)) {
+        return result;
+    }
+
+    MyMutex::MyLock lock(mutex_);
+    if (!cache.get(full_filename, result)) {
+        result = clut;
+        if (cache.insert(full_filename, result)) {
+            cache_hook_.bytes += result->getMemorySize();
+        }
+        const std::size_t limit =
+            std::size_t(std::max(settings->clut_cache_memory_limit, 0)) *
+            1024 * 1024;
+        while (limit && cache_hook_.bytes > limit && cache.evict()) {
         }
     }
 
@@ -1034,7 +1281,7 @@ inline float CTL_shaper_func(float a, bool inv)
 } // namespace
 
 rtengine::CLUTStore::CLUTStore()
-    : cache(options.clutCacheSize)
+    : cache(options.clutCacheSize, &cache_hook_)
 #ifdef ART_USE_OCIO
       ,
       ocio_cache_(options.clutCacheSize)
@@ -1517,11 +1764,9 @@ bool CLUTApplication::set_num_threads(int num_threads)
 
 inline void CLUTApplication::do_apply(int W, float *r, float *g, float *b)
 {
-    AlignedBuffer<float> buf_out_rgbx(4 * W); // Line buffer for CLUT
     AlignedBuffer<float> buf_clutr(W);
     AlignedBuffer<float> buf_clutg(W);
     AlignedBuffer<float> buf_clutb(W);
-    float *out_rgbx = buf_out_rgbx.data;
     float *clutr = buf_clutr.data;
     float *clutg = buf_clutg.data;
     float *clutb = buf_clutb.data;
@@ -1575,7 +1820,7 @@ inline void CLUTApplication::do_apply(int W, float *r, float *g, float *b)
         sourceB = Color::gamma_srgbclipped(sourceB);
     }
 
-    hald_clut_->getRGB(strength_, W, clutr, clutg, clutb, out_rgbx);
+    hald_clut_->getRGB(strength_, W, clutr, clutg, clutb, clutr, clutg, clutb);
 
     for (int j = 0; j < W; j++) {
         float &sourceR = clutr[j];
@@ -1583,9 +1828,9 @@ inline void CLUTApplication::do_apply(int W, float *r, float *g, float *b)
         float &sourceB = clutb[j];
 
         // Apply inverse gamma sRGB
-        sourceR = Color::igamma_srgb(out_rgbx[j * 4 + 0]);
-        sourceG = Color::igamma_srgb(out_rgbx[j * 4 + 1]);
-        sourceB = Color::igamma_srgb(out_rgbx[j * 4 + 2]);
+        sourceR = Color::igamma_srgb(sourceR);
+        sourceG = Color::igamma_srgb(sourceG);
+        sourceB = Color::igamma_srgb(sourceB);
     }
 
     if (!clut_and_working_profiles_are_same_) {
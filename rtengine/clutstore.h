@@ -57,9 +57,21 @@ public:
 
     void getRGB(float strength, std::size_t line_size, const float *r,
                 const float *g, const float *b, float *out_rgbx) const;
+    /// same as above, with planar output rows (which can be the same as the
+    /// input ones)
+    void getRGB(float strength, std::size_t line_size, const float *r,
+                const float *g, const float *b, float *out_r, float *out_g,
+                float *out_b) const;
+
+    /// size (in bytes) of the lattice
+    std::size_t getMemorySize() const;
 
 private:
     AlignedBuffer<std::uint16_t> clut_image;
+    // mapping of the on-disk cache entry holding the lattice, when the
+    // lattice is not in clut_image
+    GMappedFile *clut_mapping;
+    const std::uint16_t *clut_data;
     unsigned int clut_level;
     float flevel_minus_one;
     float flevel_minus_two;
@@ -112,7 +124,34 @@ public:
 private:
     CLUTStore();
 
-    mutable Cache<Glib::ustring, std::shared_ptr<HaldCLUT>> cache;
+    typedef Cache<Glib::ustring, std::shared_ptr<HaldCLUT>> HaldCache;
+
+    // keeps track of the memory used by the HaldCLUTs in the cache
+    class HaldCacheHook: public HaldCache::Hook {
+    public:
+        HaldCacheHook(): bytes(0) {}
+        void onDiscard(const Glib::ustring &key,
+                       const std::shared_ptr<HaldCLUT> &value) override
+        {
+            bytes -= value->getMemorySize();
+        }
+        void onDisplace(const Glib::ustring &key,
+                        const std::shared_ptr<HaldCLUT> &value) override
+        {
+            bytes -= value->getMemorySize();
+        }
+        void onRemove(const Glib::ustring &key,
+                      const std::shared_ptr<HaldCLUT> &value) override
+        {
+            bytes -= value->getMemorySize();
+        }
+        void onDestroy() override {}
+
+        std::size_t bytes;
+    };
+
+    mutable HaldCacheHook cache_hook_;
+    mutable HaldCache cache;
 #ifdef ART_USE_OCIO
     typedef std::pair<OCIO::ConstProcessorRcPtr, std::string> OCIOCacheEntry;
     mutable Cache<Glib::ustring, OCIOCacheEntry> ocio_cache_;
@@ -18,6 +18,8 @@
  */
 
 #include "color.h"
+#include "../rtgui/options.h"
+#include "colorconv_kernels.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
 #include "linalgebra.h"
@@ -25,6 +27,9 @@
 #include "opthelper.h"
 #include "rtengine.h"
 #include "sleef.h"
+#include <glib/gstdio.h>
+#include <iostream>
+#include <unistd.h>
 
 namespace rtengine {
 
@@ -76,6 +81,23 @@ float PQ_inv(float X)
                            6.277394636015326f);
 }
 
+// bump whenever the computation of any of the shared tables changes
+constexpr uint32_t COLOR_TABLES_VERSION = 1;
+constexpr char COLOR_TABLES_MAGIC[8] = {'A', 'R', 'T', 'C', 'T', 'A', 'B', 0};
+
+struct ColorTablesHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint32_t count;
+    uint32_t float_size;
+};
+
+// tables start at multiples of the cache line size
+size_t color_tables_padded(size_t bytes) { return (bytes + 63) / 64 * 64; }
+
+GMappedFile *color_tables_file = nullptr;
+
 } // namespace
 
 extern const Settings *settings;
@@ -181,11 +203,30 @@ void MunsellDebugInfo::reinitValues()
 
 void Color::init()
 {
+    constexpr auto maxindex = 65536;
 
-    /*******************************************/
+    if (settings->color_tables_cache) {
+        // the tables are computed once, and then mapped read-only by all the
+        // processes, so that their memory is shared
+        const auto fname =
+            Glib::build_filename(options.cacheBaseDir, "color_tables");
+        if (!mapTables(fname, maxindex)) {
+            computeTables(maxindex);
+            saveTables(fname, maxindex);
+        }
+    } else {
+        computeTables(maxindex);
+    }
 
-    constexpr auto maxindex = 65536;
+    // shares the buffer with gammatab_srgb but has different clip flags
+    gamma2curve.share(gammatab_srgb, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
 
+    initMunsell();
+    linearGammaTRC = cmsBuildGamma(nullptr, 1.0);
+}
+
+void Color::computeTables(int maxindex)
+{
     cachef(maxindex, LUT_CLIP_BELOW);
     cachefy(maxindex, LUT_CLIP_BELOW);
     gammatab(maxindex, 0);
@@ -248,11 +289,6 @@ void Color::init()
                 gammatab_srgb[i] = gammatab_srgb1[i] = gamma2(i / 65535.0);
             }
             gammatab_srgb *= 65535.f;
-            gamma2curve.share(
-                gammatab_srgb,
-                LUT_CLIP_BELOW |
-                    LUT_CLIP_ABOVE); // shares the buffer with gammatab_srgb but
-                                     // has different clip flags
         }
 #ifdef _OPENMP
 #pragma omp section
@@ -316,16 +352,6 @@ void Color::init()
             igammatab_24_17[i] = 65535.0 * igamma24_17(i / 65535.0);
         }
 
-#ifdef _OPENMP
-#pragma omp section
-#endif
-        initMunsell();
-
-#ifdef _OPENMP
-#pragma omp section
-#endif
-        linearGammaTRC = cmsBuildGamma(nullptr, 1.0);
-
 #ifdef _OPENMP
 #pragma omp section
 #endif
@@ -336,11 +362,140 @@ void Color::init()
     }
 }
 
+std::vector<std::pair<LUTf *, int>> Color::sharedTables()
+{
+    // the clip flags must match the ones used by computeTables
+    return {{&cachef, LUT_CLIP_BELOW},
+            {&cachefy, LUT_CLIP_BELOW},
+            {&igammatab_srgb, 0},
+            {&igammatab_srgb1, 0},
+            {&gammatab_srgb, 0},
+            {&gammatab_srgb1, 0},
+            {&denoiseGammaTab, 0},
+            {&denoiseIGammaTab, 0},
+            {&igammatab_24_17, 0},
+            {&gammatab_24_17a, LUT_CLIP_ABOVE | LUT_CLIP_BELOW},
+            {&gammatab, 0},
+            {&jzazbz_pq_, 0},
+            {&jzazbz_pq_inv_, 0}};
+}
+
+bool Color::mapTables(const Glib::ustring &fname, int size)
+{
+    const auto tables = sharedTables();
+    const size_t table_bytes =
+        color_tables_padded((size + 3) * sizeof(float));
+    const size_t thumb_bytes = color_tables_padded(size + 3);
+    const size_t header_bytes = color_tables_padded(sizeof(ColorTablesHeader));
+    const size_t total =
+        header_bytes + tables.size() * table_bytes + thumb_bytes;
+
+    GMappedFile *mf = g_mapped_file_new(fname.c_str(), FALSE, nullptr);
+    if (!mf) {
+        return false;
+    }
+
+    char *data = g_mapped_file_get_contents(mf);
+    ColorTablesHeader hdr;
+    bool ok = g_mapped_file_get_length(mf) == total;
+    if (ok) {
+        memcpy(&hdr, data, sizeof(hdr));
+        ok = memcmp(hdr.magic, COLOR_TABLES_MAGIC, sizeof(hdr.magic)) == 0 &&
+             hdr.version == COLOR_TABLES_VERSION && hdr.size == size_t(size) &&
+             hdr.count == tables.size() && hdr.float_size == sizeof(float);
+    }
+    if (!ok) {
+        g_mapped_file_unref(mf);
+        if (settings->verbose) {
+            std::cout << "Color tables: invalid file " << fname << std::endl;
+        }
+        return false;
+    }
+
+    // the LUTs only read their data: the mapping is read-only, so that the
+    // pages are shared by all the processes
+    char *p = data + header_bytes;
+    for (auto &t : tables) {
+        t.first->share(reinterpret_cast<float *>(p), size, t.second);
+        p += table_bytes;
+    }
+    gammatabThumb.share(reinterpret_cast<uint8_t *>(p), size, 0);
+
+    color_tables_file = mf;
+    if (settings->verbose) {
+        std::cout << "Color tables mapped from " << fname << std::endl;
+    }
+    return true;
+}
+
+void Color::saveTables(const Glib::ustring &fname, int size)
+{
+    const auto tables = sharedTables();
+    const size_t table_bytes =
+        color_tables_padded((size + 3) * sizeof(float));
+    const size_t thumb_bytes = color_tables_padded(size + 3);
+    const size_t header_bytes = color_tables_padded(sizeof(ColorTablesHeader));
+
+    ColorTablesHeader hdr;
+    memcpy(hdr.magic, COLOR_TABLES_MAGIC, sizeof(hdr.magic));
+    hdr.version = COLOR_TABLES_VERSION;
+    hdr.size = size;
+    hdr.count = tables.size();
+    hdr.float_size = sizeof(float);
+
+    // several processes might be starting at the same time: write to a
+    // private temporary file, and then move it into place
+    std::string tmp = fname + ".XXXXXX";
+    const int fd = Glib::mkstemp(tmp);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    FILE *f = g_fopen(tmp.c_str(), "wb");
+    if (!f) {
+        g_remove(tmp.c_str());
+        return;
+    }
+
+    std::vector<char> buf(std::max(table_bytes, thumb_bytes));
+    memcpy(buf.data(), &hdr, sizeof(hdr));
+    bool ok = fwrite(buf.data(), 1, header_bytes, f) == header_bytes;
+    for (size_t i = 0; ok && i < tables.size(); ++i) {
+        std::fill(buf.begin(), buf.end(), 0);
+        memcpy(buf.data(), &(*tables[i].first)[0], size * sizeof(float));
+        ok = fwrite(buf.data(), 1, table_bytes, f) == table_bytes;
+    }
+    if (ok) {
+        std::fill(buf.begin(), buf.end(), 0);
+        memcpy(buf.data(), &gammatabThumb[0], size);
+        ok = fwrite(buf.data(), 1, thumb_bytes, f) == thumb_bytes;
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok && g_rename(tmp.c_str(), fname.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(fname.c_str());
+        ok = g_rename(tmp.c_str(), fname.c_str()) == 0;
+    }
+    if (!ok) {
+        g_remove(tmp.c_str());
+    }
+    if (settings->verbose) {
+        std::cout << "Color tables: " << (ok ? "saved to " : "error writing ")
+                  << fname << std::endl;
+    }
+}
+
 void Color::cleanup()
 {
     if (linearGammaTRC) {
         cmsFreeToneCurve(linearGammaTRC);
     }
+    if (color_tables_file) {
+        // the LUTs don't own the mapped buffers, and are not used anymore
+        g_mapped_file_unref(color_tables_file);
+        color_tables_file = nullptr;
+    }
 }
 
 void Color::rgb2lab01(const Glib::ustring &profile,
@@ -1446,6 +1601,74 @@ void Color::RGB2L(float *R, float *G, float *B, float *L, const float wp[3][3],
     }
 }
 
+void Color::rgb2lab(const float *R, const float *G, const float *B, float *L,
+                    float *a, float *b, const float ws[3][3], int width)
+{
+    const auto &k = colorconv::get_kernels();
+    int i = k.rgb2lab ? k.rgb2lab(R, G, B, L, a, b, ws, width) : 0;
+#ifdef __SSE2__
+    vfloat wsv[3][3];
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            wsv[r][c] = F2V(ws[r][c]);
+        }
+    }
+    for (; i < width - 3; i += 4) {
+        vfloat lv, av, bv;
+        rgb2lab(LVFU(R[i]), LVFU(G[i]), LVFU(B[i]), lv, av, bv, wsv);
+        STVFU(L[i], lv);
+        STVFU(a[i], av);
+        STVFU(b[i], bv);
+    }
+#endif
+    for (; i < width; ++i) {
+        rgb2lab(R[i], G[i], B[i], L[i], a[i], b[i], ws);
+    }
+}
+
+void Color::lab2rgb(const float *L, const float *a, const float *b, float *R,
+                    float *G, float *B, const float iws[3][3], int width)
+{
+    const auto &k = colorconv::get_kernels();
+    int i = k.lab2rgb ? k.lab2rgb(L, a, b, R, G, B, iws, width) : 0;
+#ifdef __SSE2__
+    vfloat iwsv[3][3];
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            iwsv[r][c] = F2V(iws[r][c]);
+        }
+    }
+    for (; i < width - 3; i += 4) {
+        vfloat rv, gv, bv;
+        lab2rgb(LVFU(L[i]), LVFU(a[i]), LVFU(b[i]), rv, gv, bv, iwsv);
+        STVFU(R[i], rv);
+        STVFU(G[i], gv);
+        STVFU(B[i], bv);
+    }
+#endif
+    for (; i < width; ++i) {
+        lab2rgb(L[i], a[i], b[i], R[i], G[i], B[i], iws);
+    }
+}
+
+void Color::XYZ2Lab(const float *X, const float *Y, const float *Z, float *L,
+                    float *a, float *b, int width)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i < width - 3; i += 4) {
+        vfloat lv, av, bv;
+        XYZ2Lab(LVFU(X[i]), LVFU(Y[i]), LVFU(Z[i]), lv, av, bv);
+        STVFU(L[i], lv);
+        STVFU(a[i], av);
+        STVFU(b[i], bv);
+    }
+#endif
+    for (; i < width; ++i) {
+        XYZ2Lab(X[i], Y[i], Z[i], L[i], a[i], b[i]);
+    }
+}
+
 void Color::XYZ2Lab(float X, float Y, float Z, float &L, float &a, float &b)
 {
 
@@ -21,6 +21,8 @@
 #pragma once
 
 #include <array>
+#include <utility>
+#include <vector>
 #include <glibmm.h>
 
 #include "LUT.h"
@@ -96,6 +98,11 @@ private:
 
     // Separated from init() to keep the code clear
     static void initMunsell();
+    static void computeTables(int size);
+    // the tables of size entries that can be shared between processes
+    static std::vector<std::pair<LUTf *, int>> sharedTables();
+    static bool mapTables(const Glib::ustring &fname, int size);
+    static void saveTables(const Glib::ustring &fname, int size);
     static double hue2rgb(double p, double q, double t);
     static float hue2rgbfloat(float p, float q, float t);
 #ifdef __SSE2__
@@ -452,6 +459,38 @@ public:
         }
     }
 
+#ifdef __SSE2__
+    /// vector version of rgb2hsvdcp(). h, s and v are computed for all the
+    /// lanes, the returned mask tells which ones are valid (i.e. not in the
+    /// negative area)
+    static inline vmask rgb2hsvdcp(vfloat r, vfloat g, vfloat b, vfloat &h,
+                                   vfloat &s, vfloat &v)
+    {
+        const vfloat zerov = F2V(0.f);
+        const vfloat sixv = F2V(6.f);
+        const vfloat var_Min = vminf(r, vminf(g, b));
+        const vfloat var_Max = vmaxf(r, vmaxf(g, b));
+        const vfloat del_Max = var_Max - var_Min;
+        v = var_Max / F2V(65535.f);
+
+        const vmask r_max = vmaskf_eq(r, var_Max);
+        const vmask g_max = vmaskf_eq(g, var_Max);
+        const vfloat num = vself(r_max, g - b, vself(g_max, b - r, r - g));
+        const vfloat off =
+            vself(r_max, zerov, vself(g_max, F2V(2.f), F2V(4.f)));
+        h = off + num / del_Max;
+        h = vself(vmaskf_lt(h, zerov), h + sixv,
+                  vself(vmaskf_gt(h, sixv), h - sixv, h));
+        s = del_Max / var_Max;
+
+        const vmask grey = vmaskf_lt(vabsf(del_Max), F2V(0.00001f));
+        h = vself(grey, zerov, h);
+        s = vself(grey, zerov, s);
+
+        return vmaskf_ge(var_Min, zerov);
+    }
+#endif
+
     static inline void rgb2hsvtc(float r, float g, float b, float &h, float &s,
                                  float &v)
     {
@@ -542,6 +581,31 @@ public:
         }
     }
 
+#ifdef __SSE2__
+    static inline void hsv2rgbdcp(vfloat h, vfloat s, vfloat v, vfloat &r,
+                                  vfloat &g, vfloat &b)
+    {
+        const vfloat sector = _mm_cvtepi32_ps(_mm_cvttps_epi32(h));
+        const vfloat f = h - sector;
+
+        v *= F2V(65535.f);
+        const vfloat vs = v * s;
+        const vfloat p = v - vs;
+        const vfloat q = v - f * vs;
+        const vfloat t = p + v - q;
+
+        const vmask s1 = vmaskf_eq(sector, F2V(1.f));
+        const vmask s2 = vmaskf_eq(sector, F2V(2.f));
+        const vmask s3 = vmaskf_eq(sector, F2V(3.f));
+        const vmask s4 = vmaskf_eq(sector, F2V(4.f));
+        const vmask s5 = vmaskf_eq(sector, F2V(5.f));
+
+        r = vself(s1, q, vself(vorm(s2, s3), p, vself(s4, t, v)));
+        g = vself(vorm(s1, s2), v, vself(s3, q, vself(vorm(s4, s5), p, t)));
+        b = vself(s2, t, vself(vorm(s3, s4), v, vself(s5, q, p)));
+    }
+#endif
+
     static void hsv2rgb(float h, float s, float v, int &r, int &g, int &b);
 
     /**
@@ -682,6 +746,20 @@ public:
     static void RGB2L(float *X, float *Y, float *Z, float *L,
                       const float wp[3][3], int width);
 
+    /**
+     * @brief Row versions of rgb2lab(), lab2rgb() and XYZ2Lab(), converting
+     * width pixels (4 at a time when SSE2 is available). The output arrays
+     * may be the same as the input ones
+     */
+    static void rgb2lab(const float *R, const float *G, const float *B,
+                        float *L, float *a, float *b, const float ws[3][3],
+                        int width);
+    static void lab2rgb(const float *L, const float *a, const float *b,
+                        float *R, float *G, float *B, const float iws[3][3],
+                        int width);
+    static void XYZ2Lab(const float *X, const float *Y, const float *Z,
+                        float *L, float *a, float *b, int width);
+
     template <class T>
     static void rgb2lab(float R, float G, float B, float &l, float &a, float &b,
                         const T ws[3][3])
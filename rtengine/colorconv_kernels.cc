@@ -0,0 +1,199 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "colorconv_kernels.h"
+#include "color.h"
+#include "cpuinfo.h"
+
+// this file is also compiled with AVX2 enabled by colorconv_avx2.cc, which
+// defines ART_SIMD_VARIANT. The baseline build only contains the dispatcher
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_BASE_BUILD
+#endif
+
+#ifndef ART_SIMD_BASE_BUILD
+#include <immintrin.h>
+#endif
+
+namespace rtengine {
+
+namespace colorconv {
+
+#ifndef ART_SIMD_BASE_BUILD
+
+namespace {
+
+constexpr int N = 8;
+
+inline __m256 set1(float v) { return _mm256_set1_ps(v); }
+
+// linear interpolation in a LUT, with the same clamping of the index as
+// LUT::operator[](vfloat)
+inline __m256 lookup(const LUTf &lut, __m256 idx)
+{
+    const float *data = &lut[0];
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxs = set1(float(lut.getSize() - 2));
+    const __m256 upper = set1(float(lut.getSize() - 1));
+    const __m256i i =
+        _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(idx, zero), maxs));
+    const __m256 lo = _mm256_i32gather_ps(data, i, 4);
+    const __m256 hi = _mm256_i32gather_ps(data + 1, i, 4);
+    const __m256 diff =
+        _mm256_min_ps(_mm256_max_ps(idx, zero), upper) - _mm256_cvtepi32_ps(i);
+    return _mm256_fmadd_ps(diff, hi - lo, lo);
+}
+
+inline void transform(const __m256 m[3][3], __m256 a, __m256 b, __m256 c,
+                      __m256 &x, __m256 &y, __m256 &z)
+{
+    x = m[0][0] * a + m[0][1] * b + m[0][2] * c;
+    y = m[1][0] * a + m[1][1] * b + m[1][2] * c;
+    z = m[2][0] * a + m[2][1] * b + m[2][2] * c;
+}
+
+inline void load_matrix(const float src[3][3], __m256 dst[3][3])
+{
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            dst[i][j] = set1(src[i][j]);
+        }
+    }
+}
+
+int rgb2lab(const float *R, const float *G, const float *B, float *L, float *a,
+            float *b, const float ws[3][3], int width)
+{
+    __m256 m[3][3];
+    load_matrix(ws, m);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxval = set1(MAXVALF);
+    const __m256 d50x = set1(Color::D50x);
+    const __m256 d50z = set1(Color::D50z);
+    const __m256 c500 = set1(500.f);
+    const __m256 c200 = set1(200.f);
+
+    int i = 0;
+    for (; i + N <= width; i += N) {
+        __m256 X, Y, Z;
+        transform(m, _mm256_loadu_ps(R + i), _mm256_loadu_ps(G + i),
+                  _mm256_loadu_ps(B + i), X, Y, Z);
+        const __m256 x = X / d50x;
+        const __m256 z = Z / d50z;
+
+        const __m256 hi = _mm256_max_ps(x, _mm256_max_ps(Y, z));
+        const __m256 lo = _mm256_min_ps(x, _mm256_min_ps(Y, z));
+        if (!_mm256_testz_ps(_mm256_or_ps(_mm256_cmp_ps(hi, maxval, _CMP_GT_OQ),
+                                          _mm256_cmp_ps(lo, zero, _CMP_LT_OQ)),
+                             _mm256_castsi256_ps(_mm256_set1_epi32(-1)))) {
+            // out of the range of the tables, as in the SSE2 version
+            alignas(32) float xyz[3][N];
+            _mm256_store_ps(xyz[0], X);
+            _mm256_store_ps(xyz[1], Y);
+            _mm256_store_ps(xyz[2], Z);
+            for (int k = 0; k < N; ++k) {
+                Color::XYZ2Lab(xyz[0][k], xyz[1][k], xyz[2][k], L[i + k],
+                               a[i + k], b[i + k]);
+            }
+            continue;
+        }
+
+        const __m256 fx = lookup(Color::cachef, x);
+        const __m256 fy = lookup(Color::cachef, Y);
+        const __m256 fz = lookup(Color::cachef, z);
+        _mm256_storeu_ps(L + i, lookup(Color::cachefy, Y));
+        _mm256_storeu_ps(a + i, c500 * (fx - fy));
+        _mm256_storeu_ps(b + i, c200 * (fy - fz));
+    }
+    return i;
+}
+
+inline __m256 f2xyz(__m256 f)
+{
+    const __m256 res1 = f * f * f;
+    const __m256 res2 = (set1(116.f) * f - set1(16.f)) * set1(Color::kappaInvf);
+    return _mm256_blendv_ps(
+        res2, res1, _mm256_cmp_ps(f, set1(Color::epsilonExpInv3f), _CMP_GT_OQ));
+}
+
+int lab2rgb(const float *L, const float *a, const float *b, float *R, float *G,
+            float *B, const float iws[3][3], int width)
+{
+    __m256 m[3][3];
+    load_matrix(iws, m);
+    const __m256 c327d68 = set1(327.68f);
+    const __m256 c65535 = set1(65535.f);
+
+    int i = 0;
+    for (; i + N <= width; i += N) {
+        const __m256 l = _mm256_loadu_ps(L + i) / c327d68;
+        const __m256 aa = _mm256_loadu_ps(a + i) / c327d68;
+        const __m256 bb = _mm256_loadu_ps(b + i) / c327d68;
+        const __m256 fy = set1(Color::c1By116) * l + set1(Color::c16By116);
+        const __m256 fx = set1(0.002f) * aa + fy;
+        const __m256 fz = fy - set1(0.005f) * bb;
+        const __m256 x = c65535 * f2xyz(fx) * set1(Color::D50x);
+        const __m256 z = c65535 * f2xyz(fz) * set1(Color::D50z);
+        const __m256 y =
+            c65535 *
+            _mm256_blendv_ps(l / set1(float(Color::kappa)), fy * fy * fy,
+                             _mm256_cmp_ps(l, set1(float(Color::epskap)),
+                                           _CMP_GT_OQ));
+        __m256 r, g, bl;
+        transform(m, x, y, z, r, g, bl);
+        _mm256_storeu_ps(R + i, r);
+        _mm256_storeu_ps(G + i, g);
+        _mm256_storeu_ps(B + i, bl);
+    }
+    return i;
+}
+
+} // namespace
+
+void ART_SIMD_VARIANT(fill_kernels)(Kernels &k)
+{
+    k.rgb2lab = rgb2lab;
+    k.lab2rgb = lab2rgb;
+}
+
+#else // ART_SIMD_BASE_BUILD
+
+const Kernels &get_kernels()
+{
+    static const Kernels kernels = []() -> Kernels {
+        Kernels k = {nullptr, nullptr};
+        switch (get_simd_level()) {
+        case SIMDLevel::AVX512:
+        case SIMDLevel::AVX2:
+#ifdef ART_SIMD_DISPATCH_AVX2
+            fill_kernels_avx2(k);
+#endif
+            break;
+        default:
+            break;
+        }
+        return k;
+    }();
+    return kernels;
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+} // namespace colorconv
+
+} // namespace rtengine
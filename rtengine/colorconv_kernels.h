@@ -0,0 +1,48 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "LUT.h"
+
+namespace rtengine {
+
+namespace colorconv {
+
+// AVX2 builds of the row versions of Color::rgb2lab() and Color::lab2rgb(),
+// selected at runtime (see PROC_DISPATCH_TARGETS in ProcessorTargets.cmake).
+// They convert the pixels 8 at a time, the lookups in the cube root tables
+// being done with gathers, and return the number of pixels processed; the
+// remaining ones are left to the SSE2 code of color.cc. The function pointers
+// are null when no variant is available.
+struct Kernels {
+    int (*rgb2lab)(const float *R, const float *G, const float *B, float *L,
+                   float *a, float *b, const float ws[3][3], int width);
+    int (*lab2rgb)(const float *L, const float *a, const float *b, float *R,
+                   float *G, float *B, const float iws[3][3], int width);
+};
+
+const Kernels &get_kernels();
+
+#ifdef ART_SIMD_DISPATCH_AVX2
+void fill_kernels_avx2(Kernels &k);
+#endif
+
+} // namespace colorconv
+
+} // namespace rtengine
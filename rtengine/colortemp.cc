@@ -22,6 +22,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 namespace rtengine {
 
@@ -251,49 +252,138 @@ void spectrum_to_xyz_blackbody(double _temp, double &x, double &y, double &z)
     assert(z >= 0);
 }
 
-void temp2mulxyz(double temp, double &Xxyz, double &Zxyz)
+void blackbody2xyz(double temp, double &Xxyz, double &Zxyz)
 {
+    // if temperature is between 2000K and 4000K we use blackbody, because
+    // there will be no Daylight reference below 4000K... of course, the
+    // previous version of RT used the "magical" but wrong formula of
+    // U.Fuchs (Ufraw).
     double x, y, z;
+    spectrum_to_xyz_blackbody(temp, x, y, z);
 
-    // otherwise we use the Temp+Green generic solution
-    if (temp <= INITIALBLACKBODY) {
-        // if temperature is between 2000K and 4000K we use blackbody, because
-        // there will be no Daylight reference below 4000K... of course, the
-        // previous version of RT used the "magical" but wrong formula of
-        // U.Fuchs (Ufraw).
-        spectrum_to_xyz_blackbody(temp, x, y, z);
-    } else {
-        // from 4000K up to 25000K: using the D illuminant (daylight) which is
-        // standard
-        double x_D, y_D;
-
-        if (temp <= 7000) {
-            x_D = -4.6070e9 / (temp * temp * temp) + 2.9678e6 / (temp * temp) +
-                  0.09911e3 / temp + 0.244063;
-        } else if (temp <= 25000) {
-            x_D = -2.0064e9 / (temp * temp * temp) + 1.9018e6 / (temp * temp) +
-                  0.24748e3 / temp + 0.237040;
-        } else /*if (temp > 25000)*/ {
-            x_D = -2.0064e9 / (temp * temp * temp) + 1.9018e6 / (temp * temp) +
-                  0.24748e3 / temp + 0.237040 -
-                  ((temp - 25000) / 25000) *
-                      0.025; // Jacques empirical adjustment for very high temp
-                             // (underwater !)
-        }
+    Xxyz = x / y;
+    Zxyz = (1.0 - x - y) / y;
+}
 
-        y_D = -3.0 * x_D * x_D + 2.87 * x_D - 0.275; // modify blue / red action
-        // calculate D -daylight in function of s0, s1, s2 and temp ==> x_D y_D
-        // S(lamda)=So(lambda)+m1*s1(lambda)+m2*s2(lambda)
-        double interm = 0.0241 + 0.2562 * x_D - 0.734 * y_D;
-        double m1 = (-1.3515 - 1.7703 * x_D + 5.9114 * y_D) / interm;
-        double m2 = (0.03 - 31.4424 * x_D + 30.0717 * y_D) / interm;
-        spectrum_to_xyz_daylight(m1, m2, x, y, z);
+void daylight2xyz(double temp, double &Xxyz, double &Zxyz)
+{
+    // from 4000K up to 25000K: using the D illuminant (daylight) which is
+    // standard
+    double x, y, z;
+    double x_D, y_D;
+
+    if (temp <= 7000) {
+        x_D = -4.6070e9 / (temp * temp * temp) + 2.9678e6 / (temp * temp) +
+              0.09911e3 / temp + 0.244063;
+    } else if (temp <= 25000) {
+        x_D = -2.0064e9 / (temp * temp * temp) + 1.9018e6 / (temp * temp) +
+              0.24748e3 / temp + 0.237040;
+    } else /*if (temp > 25000)*/ {
+        x_D = -2.0064e9 / (temp * temp * temp) + 1.9018e6 / (temp * temp) +
+              0.24748e3 / temp + 0.237040 -
+              ((temp - 25000) / 25000) *
+                  0.025; // Jacques empirical adjustment for very high temp
+                         // (underwater !)
     }
 
+    y_D = -3.0 * x_D * x_D + 2.87 * x_D - 0.275; // modify blue / red action
+    // calculate D -daylight in function of s0, s1, s2 and temp ==> x_D y_D
+    // S(lamda)=So(lambda)+m1*s1(lambda)+m2*s2(lambda)
+    double interm = 0.0241 + 0.2562 * x_D - 0.734 * y_D;
+    double m1 = (-1.3515 - 1.7703 * x_D + 5.9114 * y_D) / interm;
+    double m2 = (0.03 - 31.4424 * x_D + 30.0717 * y_D) / interm;
+    spectrum_to_xyz_daylight(m1, m2, x, y, z);
+
     Xxyz = x / y;
     Zxyz = (1.0 - x - y) / y;
 }
 
+// The spectral integration above is too expensive to be repeated for every
+// step of the bisection in mul2temp() (and hence for every slider movement
+// or auto WB computation), so the white point of each temperature is
+// precomputed once per process on a grid uniform in mired (1e6/T), which is
+// close to perceptually uniform, and linearly interpolated. Each of the
+// pieces of daylight2xyz() and the blackbody range are tabulated separately,
+// so that the discontinuities at their boundaries are preserved.
+class TempXYZTable {
+public:
+    static const TempXYZTable &getInstance()
+    {
+        static const TempXYZTable instance;
+        return instance;
+    }
+
+    void get(double temp, double &Xxyz, double &Zxyz) const
+    {
+        size_t i = 0;
+        while (i + 1 < segments_.size() && temp > segments_[i].maxtemp()) {
+            ++i;
+        }
+        segments_[i].get(temp, Xxyz, Zxyz);
+    }
+
+private:
+    static constexpr double MIRED_STEP = 0.1;
+
+    class Segment {
+    public:
+        Segment(double mintemp, double maxtemp,
+                void (*func)(double, double &, double &))
+            : maxtemp_(maxtemp)
+        {
+            lo_ = 1e6 / maxtemp;
+            const double hi = 1e6 / mintemp;
+            const int n = std::ceil((hi - lo_) / MIRED_STEP);
+            step_ = (hi - lo_) / n;
+            X_.resize(n + 1);
+            Z_.resize(n + 1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int i = 0; i <= n; ++i) {
+                func(1e6 / (lo_ + i * step_), X_[i], Z_[i]);
+            }
+        }
+
+        double maxtemp() const { return maxtemp_; }
+
+        void get(double temp, double &Xxyz, double &Zxyz) const
+        {
+            const int last = X_.size() - 1;
+            const double f =
+                LIM((1e6 / temp - lo_) / step_, 0.0, double(last));
+            const int i = std::min(int(f), last - 1);
+            const double d = f - i;
+            Xxyz = X_[i] + d * (X_[i + 1] - X_[i]);
+            Zxyz = Z_[i] + d * (Z_[i + 1] - Z_[i]);
+        }
+
+    private:
+        double maxtemp_;
+        double lo_;
+        double step_;
+        std::vector<double> X_;
+        std::vector<double> Z_;
+    };
+
+    TempXYZTable()
+    {
+        segments_.emplace_back(MINTEMP, INITIALBLACKBODY, &blackbody2xyz);
+        segments_.emplace_back(INITIALBLACKBODY, 7000, &daylight2xyz);
+        segments_.emplace_back(7000, 25000, &daylight2xyz);
+        segments_.emplace_back(25000, MAXTEMP, &daylight2xyz);
+    }
+
+    std::vector<Segment> segments_;
+};
+
+constexpr double TempXYZTable::MIRED_STEP;
+
+void temp2mulxyz(double temp, double &Xxyz, double &Zxyz)
+{
+    TempXYZTable::getInstance().get(temp, Xxyz, Zxyz);
+}
+
 } // namespace
 
 ColorTemp::ColorTemp()
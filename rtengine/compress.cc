@@ -22,6 +22,10 @@
 #include <giomm.h>
 #include <glib/gstdio.h>
 #include <glibmm.h>
+#include <zlib.h>
+#ifdef ART_USE_ZSTD
+#include <zstd.h>
+#endif
 
 namespace rtengine {
 
@@ -75,6 +79,85 @@ std::string decompress(const std::vector<uint8_t> &src)
     return std::string(&(res[0]));
 }
 
+Codec resolve_codec(Codec codec)
+{
+#ifdef ART_USE_ZSTD
+    return codec == Codec::ZLIB ? Codec::ZLIB : Codec::ZSTD;
+#else
+    return Codec::ZLIB;
+#endif
+}
+
+const char *codec_name(Codec codec)
+{
+    return resolve_codec(codec) == Codec::ZSTD ? "zstd" : "zlib";
+}
+
+bool codec_from_name(const std::string &name, Codec &codec)
+{
+    if (name == "zlib") {
+        codec = Codec::ZLIB;
+        return true;
+#ifdef ART_USE_ZSTD
+    } else if (name == "zstd") {
+        codec = Codec::ZSTD;
+        return true;
+#endif
+    }
+    return false;
+}
+
+std::vector<uint8_t> compress_buffer(const void *src, size_t size,
+                                     Codec codec, int level)
+{
+    std::vector<uint8_t> res;
+    const bool fast = codec == Codec::FASTEST;
+    codec = resolve_codec(codec);
+
+#ifdef ART_USE_ZSTD
+    if (codec == Codec::ZSTD) {
+        res.resize(ZSTD_compressBound(size));
+        size_t n = ZSTD_compress(res.data(), res.size(), src, size,
+                                 level < 0 ? (fast ? 1 : 3) : level);
+        if (ZSTD_isError(n)) {
+            res.clear();
+        } else {
+            res.resize(n);
+        }
+        return res;
+    }
+#endif
+
+    uLongf n = compressBound(size);
+    res.resize(n);
+    if (compress2(res.data(), &n, static_cast<const Bytef *>(src), size,
+                  level < 0 ? (fast ? 1 : Z_DEFAULT_COMPRESSION) : level) !=
+        Z_OK) {
+        res.clear();
+    } else {
+        res.resize(n);
+    }
+    return res;
+}
+
+bool decompress_buffer(const std::vector<uint8_t> &src, Codec codec,
+                       void *dst, size_t size)
+{
+    codec = resolve_codec(codec);
+
+#ifdef ART_USE_ZSTD
+    if (codec == Codec::ZSTD) {
+        size_t n = ZSTD_decompress(dst, size, src.data(), src.size());
+        return !ZSTD_isError(n) && n == size;
+    }
+#endif
+
+    uLongf n = size;
+    return uncompress(static_cast<Bytef *>(dst), &n, src.data(),
+                      src.size()) == Z_OK &&
+           n == size;
+}
+
 namespace {
 
 bool convert_to(const std::string &src_fname, const std::string &dest_fname,
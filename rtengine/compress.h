@@ -26,9 +26,31 @@
 
 namespace rtengine {
 
+/// codecs for binary blobs (e.g. cached image data). ZSTD is available only
+/// if ART is built with libzstd; FASTEST picks it when possible, and zlib
+/// (at a low compression level) otherwise
+enum class Codec { ZLIB, ZSTD, FASTEST };
+
 std::vector<uint8_t> compress(const std::string &src, int level = -1);
 std::string decompress(const std::vector<uint8_t> &src);
 
+/// the codec actually used for the given one (i.e. resolves FASTEST, and
+/// falls back to zlib when zstd is not available)
+Codec resolve_codec(Codec codec);
+/// name of the codec, used e.g. to tag the compressed data in files
+const char *codec_name(Codec codec);
+/// returns false if the name is unknown or the codec is not available
+bool codec_from_name(const std::string &name, Codec &codec);
+
+/// compresses size bytes from src. level -1 means the default of the codec.
+/// Returns an empty vector on failure
+std::vector<uint8_t> compress_buffer(const void *src, size_t size,
+                                     Codec codec, int level = -1);
+/// decompresses src into dst, which must be exactly size bytes long once
+/// uncompressed
+bool decompress_buffer(const std::vector<uint8_t> &src, Codec codec,
+                       void *dst, size_t size);
+
 bool decompress_to(const std::string &src_fname, const std::string &dest_fname);
 bool compress_to(const std::string &src_fname, const std::string &dest_fname);
 
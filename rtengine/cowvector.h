@@ -0,0 +1,143 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * A std::vector whose copies share the same storage until one of them is
+ * modified. Used for the potentially large lists of the ProcParams (drawn
+ * strokes, spots), which are copied for every history step and every
+ * update of the pipeline, but change rarely.
+ *
+ * Reading goes through the const members, or through the conversion to
+ * const std::vector<T> &. Any non-const access makes the storage private
+ * first, so references obtained that way must not be kept across copies of
+ * the container.
+ */
+template <class T>
+class CowVector {
+public:
+    using vector_type = std::vector<T>;
+    using value_type = T;
+    using size_type = typename vector_type::size_type;
+    using iterator = typename vector_type::iterator;
+    using const_iterator = typename vector_type::const_iterator;
+
+    CowVector() = default;
+    CowVector(const vector_type &v): data_(std::make_shared<vector_type>(v))
+    {
+    }
+    CowVector(vector_type &&v)
+        : data_(std::make_shared<vector_type>(std::move(v)))
+    {
+    }
+
+    CowVector &operator=(const vector_type &v)
+    {
+        data_ = std::make_shared<vector_type>(v);
+        return *this;
+    }
+
+    CowVector &operator=(vector_type &&v)
+    {
+        data_ = std::make_shared<vector_type>(std::move(v));
+        return *this;
+    }
+
+    const vector_type &get() const { return data_ ? *data_ : empty_(); }
+    operator const vector_type &() const { return get(); }
+
+    size_type size() const { return data_ ? data_->size() : 0; }
+    bool empty() const { return !data_ || data_->empty(); }
+
+    const_iterator begin() const { return get().begin(); }
+    const_iterator end() const { return get().end(); }
+    const_iterator cbegin() const { return get().begin(); }
+    const_iterator cend() const { return get().end(); }
+    const T &operator[](size_type i) const { return (*data_)[i]; }
+    const T &at(size_type i) const { return get().at(i); }
+    const T &front() const { return data_->front(); }
+    const T &back() const { return data_->back(); }
+
+    iterator begin() { return mutate().begin(); }
+    iterator end() { return mutate().end(); }
+    T &operator[](size_type i) { return mutate()[i]; }
+    T &at(size_type i) { return mutate().at(i); }
+    T &front() { return mutate().front(); }
+    T &back() { return mutate().back(); }
+
+    void push_back(const T &v) { mutate().push_back(v); }
+    void push_back(T &&v) { mutate().push_back(std::move(v)); }
+    template <class... Args>
+    void emplace_back(Args &&...args)
+    {
+        mutate().emplace_back(std::forward<Args>(args)...);
+    }
+    void pop_back() { mutate().pop_back(); }
+    iterator insert(const_iterator pos, const T &v)
+    {
+        auto off = pos - begin_();
+        auto &d = mutate();
+        return d.insert(d.begin() + off, v);
+    }
+    iterator erase(const_iterator pos)
+    {
+        auto off = pos - begin_();
+        auto &d = mutate();
+        return d.erase(d.begin() + off);
+    }
+    void resize(size_type n) { mutate().resize(n); }
+    void reserve(size_type n) { mutate().reserve(n); }
+    void clear() { data_.reset(); }
+    void swap(CowVector &other) { data_.swap(other.data_); }
+
+    bool operator==(const CowVector &other) const
+    {
+        return data_ == other.data_ || get() == other.get();
+    }
+    bool operator!=(const CowVector &other) const { return !(*this == other); }
+
+private:
+    static const vector_type &empty_()
+    {
+        static const vector_type e;
+        return e;
+    }
+
+    const_iterator begin_() const { return get().begin(); }
+
+    vector_type &mutate()
+    {
+        if (!data_) {
+            data_ = std::make_shared<vector_type>();
+        } else if (data_.use_count() > 1) {
+            data_ = std::make_shared<vector_type>(*data_);
+        }
+        return *data_;
+    }
+
+    std::shared_ptr<vector_type> data_;
+};
+
+} // namespace rtengine
@@ -0,0 +1,112 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "cpuinfo.h"
+#include "settings.h"
+#include <cstdint>
+#include <iostream>
+#include <unistd.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <vector>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+SIMDLevel detect_simd_level()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+#ifdef ART_SIMD_DISPATCH_AVX512
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq") &&
+        __builtin_cpu_supports("avx512vl")) {
+        return SIMDLevel::AVX512;
+    }
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SIMDLevel::AVX2;
+    }
+#endif
+#endif
+    return SIMDLevel::BASE;
+}
+
+size_t detect_l2_cache_size()
+{
+#if defined(WIN32)
+    DWORD len = 0;
+    GetLogicalProcessorInformation(nullptr, &len);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(
+        len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION) + 1);
+    if (GetLogicalProcessorInformation(info.data(), &len)) {
+        for (auto &i : info) {
+            if (i.Relationship == RelationCache && i.Cache.Level == 2) {
+                return i.Cache.Size;
+            }
+        }
+    }
+#elif defined(__APPLE__)
+    int64_t sz = 0;
+    size_t len = sizeof(sz);
+    if (sysctlbyname("hw.l2cachesize", &sz, &len, nullptr, 0) == 0 && sz > 0) {
+        return sz;
+    }
+#elif defined(_SC_LEVEL2_CACHE_SIZE)
+    const long sz = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (sz > 0) {
+        return sz;
+    }
+#endif
+    return 0;
+}
+
+} // namespace
+
+SIMDLevel get_simd_level()
+{
+    static const SIMDLevel level = []() {
+        const SIMDLevel l = detect_simd_level();
+        if (settings && settings->verbose) {
+            const char *names[] = {"base", "AVX2", "AVX-512"};
+            std::cout << "using " << names[int(l)] << " SIMD kernels"
+                      << std::endl;
+        }
+        return l;
+    }();
+    return level;
+}
+
+size_t get_l2_cache_size()
+{
+    static const size_t size = detect_l2_cache_size();
+    return size;
+}
+
+} // namespace rtengine
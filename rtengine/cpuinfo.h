@@ -0,0 +1,38 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+
+namespace rtengine {
+
+// Runtime detection of the processor features used to select the fastest
+// variant of some kernels (see PROC_DISPATCH_TARGETS in
+// ProcessorTargets.cmake)
+
+enum class SIMDLevel { BASE, AVX2, AVX512 };
+
+/// the best SIMD level supported by both the processor and the build
+SIMDLevel get_simd_level();
+
+/// size (in bytes) of the L2 cache of a core, 0 if unknown
+size_t get_l2_cache_size();
+
+} // namespace rtengine
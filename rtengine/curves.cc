@@ -31,6 +31,7 @@
 
 #include "LUT.h"
 #include "array2D.h"
+#include "cache.h"
 #include "ciecam02.h"
 #include "color.h"
 #include "curves.h"
@@ -49,6 +50,28 @@ namespace curves {
 const std::vector<double> filmcurve_def = {
     DCT_Spline, 0, 0, 0.11, 0.09, 0.32, 0.47, 0.66, 0.87, 1, 1};
 
+namespace {
+
+// 256KB per table for the usual 65536 entries
+Cache<std::string, std::shared_ptr<const LUTf>> lut_cache(64);
+
+} // namespace
+
+std::shared_ptr<const LUTf>
+get_cached_lut(const std::string &key,
+               const std::function<void(LUTf &)> &build)
+{
+    std::shared_ptr<const LUTf> ret;
+    if (!lut_cache.get(key, ret)) {
+        // concurrent misses on the same key just build the table twice
+        std::shared_ptr<LUTf> lut(new LUTf());
+        build(*lut);
+        ret = lut;
+        lut_cache.set(key, ret);
+    }
+    return ret;
+}
+
 } // namespace curves
 
 bool sanitizeCurve(std::vector<double> &curve)
@@ -209,20 +232,59 @@ void Curve::getControlPoint(int cpNum, double &x, double &y) const
     }
 }
 
+void CurveLUT::set(const Curve &curve, bool multithread)
+{
+    // a few samples per polyline segment keep the error of the linear
+    // interpolation well below the one of the polyline itself
+    const int n = curve.getPolylineSize();
+    const int size = n > 0 ? LIM(n * 4, 1024, 65536) : 65536;
+
+    lut_(size, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+    scale_ = size - 1;
+
+    const double s = 1.0 / (size - 1);
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int i = 0; i < size; ++i) {
+        lut_[i] = curve.getVal(i * s);
+    }
+}
+
 //
 void ToneCurve::Reset() { lutToneCurve.reset(); }
 
 // Fill a LUT with X/Y, ranged 0xffff
+namespace {
+
+void fill_tone_curve_lut(const Curve &pCurve, LUTf &lut)
+{
+    lut(65536);
+
+    for (int i = 0; i < 65536; i++) {
+        lut[i] = (float)pCurve.getVal(float(i) / 65535.f) * 65535.f;
+    }
+}
+
+} // namespace
+
 void ToneCurve::Set(const Curve &pCurve, float whitecoeff)
 {
     this->whitecoeff = whitecoeff;
     this->curve = &pCurve;
     this->whitept = 65535.f * whitecoeff;
-    lutToneCurve(65536);
+    fill_tone_curve_lut(pCurve, lutToneCurve);
+}
 
-    for (int i = 0; i < 65536; i++) {
-        lutToneCurve[i] = (float)pCurve.getVal(float(i) / 65535.f) * 65535.f;
-    }
+void ToneCurve::Set(const Curve &pCurve, float whitecoeff,
+                    const std::string &cache_key)
+{
+    this->whitecoeff = whitecoeff;
+    this->curve = &pCurve;
+    this->whitept = 65535.f * whitecoeff;
+    lutToneCurve = *curves::get_cached_lut(
+        cache_key,
+        [&pCurve](LUTf &lut) -> void { fill_tone_curve_lut(pCurve, lut); });
 }
 
 // this is a generic cubic spline implementation, to clean up we could probably
@@ -523,289 +585,358 @@ void PerceptualToneCurve::BatchApply(
         }
     };
 
-    for (size_t i = start; i < end; ++i) {
-        float r = CLIP(rc[i]);
-        float g = CLIP(gc[i]);
-        float b = CLIP(bc[i]);
-        // float r = rc[i];
-        // float g = gc[i];
-        // float b = bc[i];
-
-        to_prophoto(r, g, b);
-
-        { // fix out of gamut blues. Apply a variation of this trick:
-          // https://acescentral.com/t/colour-artefacts-or-breakup-using-aces/520/8
-          // matrix hand-tuned by visual inspection (!!)
-            // [ 1.0 0.0  0.0
-            //   0.0 0.94 0.06
-            //   0.0 0.0  1.0 ]
-            float hue, sat, val;
-            Color::rgb2hsv(r, g, b, hue, sat, val);
-            hue *= 360.f;
-            constexpr float blue_hue = 250.f;
-            constexpr float blue_hue_inner = 20.f;
-            constexpr float blue_hue_outer = 40.f;
-            constexpr float blue_sat_lower = 0.65f;
-            float dist = std::abs(hue - blue_hue);
-            if (dist <= blue_hue_outer && sat >= blue_sat_lower) {
-                float gg = intp(0.94f, g, b);
-                float d = std::max(dist - blue_hue_inner, 0.f);
-                float x = 1.f - d / (blue_hue_outer - blue_hue_inner);
-                x = scurve(x);
-                float xx = (sat - blue_sat_lower) / (1.f - blue_sat_lower);
-                xx = scurve(xx);
-                g = intp(x * xx, gg, g);
+    Ciecam02::ViewingConditions vc;
+    Ciecam02::initViewingConditions(vc, xw, yw, zw, c, nc, pow1, nbb, ncb, fl,
+                                    cz, d, aw);
+
+    // the pixels not handled by the fast paths are converted to and from
+    // JCh in batches, one chunk of the row at a time
+    constexpr size_t CHUNK = 64;
+    float px[CHUNK], py[CHUNK], pz[CHUNK];
+    float pJ[CHUNK], pC[CHUNK], ph[CHUNK];
+    float pr[CHUNK], pg[CHUNK], pb[CHUNK];
+    float sr[CHUNK], sg[CHUNK], sb[CHUNK];
+    float adr[CHUNK], adg[CHUNK], adb[CHUNK];
+    float lum[CHUNK];
+    size_t idx[CHUNK];
+    bool ok[CHUNK];
+
+    for (size_t chunk = start; chunk < end; chunk += CHUNK) {
+        const size_t chunk_end = std::min(chunk + CHUNK, end);
+        int n = 0;
+
+        for (size_t i = chunk; i < chunk_end; ++i) {
+            float r = CLIP(rc[i]);
+            float g = CLIP(gc[i]);
+            float b = CLIP(bc[i]);
+            // float r = rc[i];
+            // float g = gc[i];
+            // float b = bc[i];
+
+            to_prophoto(r, g, b);
+
+            { // fix out of gamut blues. Apply a variation of this trick:
+              // https://acescentral.com/t/colour-artefacts-or-breakup-using-aces/520/8
+              // matrix hand-tuned by visual inspection (!!)
+                // [ 1.0 0.0  0.0
+                //   0.0 0.94 0.06
+                //   0.0 0.0  1.0 ]
+                float hue, sat, val;
+                Color::rgb2hsv(r, g, b, hue, sat, val);
+                hue *= 360.f;
+                constexpr float blue_hue = 250.f;
+                constexpr float blue_hue_inner = 20.f;
+                constexpr float blue_hue_outer = 40.f;
+                constexpr float blue_sat_lower = 0.65f;
+                float dist = std::abs(hue - blue_hue);
+                if (dist <= blue_hue_outer && sat >= blue_sat_lower) {
+                    float gg = intp(0.94f, g, b);
+                    float d = std::max(dist - blue_hue_inner, 0.f);
+                    float x = 1.f - d / (blue_hue_outer - blue_hue_inner);
+                    x = scurve(x);
+                    float xx = (sat - blue_sat_lower) / (1.f - blue_sat_lower);
+                    xx = scurve(xx);
+                    g = intp(x * xx, gg, g);
+                }
             }
-        }
 
-        float std_r = r;
-        float std_g = g;
-        float std_b = b;
-        stdTC.Apply(std_r, std_g, std_b);
-        to_working(std_r, std_g, std_b);
-
-        float ar = r;
-        float ag = g;
-        float ab = b;
-        adobeTC.Apply(ar, ag, ab);
-
-        if (ar >= 65535.f && ag >= 65535.f && ab >= 65535.f) {
-            // clip fast path, will also avoid strange colours of clipped
-            // highlights
-            // rc[i] = gc[i] = bc[i] = 65535.f;
-            rc[i] = 65535.f;
-            gc[i] = 65535.f;
-            bc[i] = 65535.f;
-            continue;
-        }
+            float std_r = r;
+            float std_g = g;
+            float std_b = b;
+            stdTC.Apply(std_r, std_g, std_b);
+            to_working(std_r, std_g, std_b);
+
+            float ar = r;
+            float ag = g;
+            float ab = b;
+            adobeTC.Apply(ar, ag, ab);
+
+            if (ar >= 65535.f && ag >= 65535.f && ab >= 65535.f) {
+                // clip fast path, will also avoid strange colours of clipped
+                // highlights
+                // rc[i] = gc[i] = bc[i] = 65535.f;
+                rc[i] = 65535.f;
+                gc[i] = 65535.f;
+                bc[i] = 65535.f;
+                continue;
+            }
 
-        if (ar <= 0.f && ag <= 0.f && ab <= 0.f) {
-            // rc[i] = gc[i] = bc[i] = 0;
-            rc[i] = 0.f;
-            gc[i] = 0.f;
-            bc[i] = 0.f;
-            continue;
-        }
+            if (ar <= 0.f && ag <= 0.f && ab <= 0.f) {
+                // rc[i] = gc[i] = bc[i] = 0;
+                rc[i] = 0.f;
+                gc[i] = 0.f;
+                bc[i] = 0.f;
+                continue;
+            }
 
-        // ProPhoto constants for luminance, that is xyz_prophoto[1][]
-        constexpr float Yr = 0.2880402f;
-        constexpr float Yg = 0.7118741f;
-        constexpr float Yb = 0.0000857f;
-
-        // we use the Adobe (RGB-HSV hue-stabilized) curve to decide luminance,
-        // which generally leads to a less contrasty result compared to a pure
-        // luminance curve. We do this to be more compatible with the most
-        // popular curves.
-        const float oldLuminance = r * Yr + g * Yg + b * Yb;
-        const float newLuminance = ar * Yr + ag * Yg + ab * Yb;
-        const float Lcoef = newLuminance / oldLuminance;
-        r = LIM<float>(r * Lcoef, 0.f, 65535.f);
-        g = LIM<float>(g * Lcoef, 0.f, 65535.f);
-        b = LIM<float>(b * Lcoef, 0.f, 65535.f);
+            // ProPhoto constants for luminance, that is xyz_prophoto[1][]
+            constexpr float Yr = 0.2880402f;
+            constexpr float Yg = 0.7118741f;
+            constexpr float Yb = 0.0000857f;
+
+            // we use the Adobe (RGB-HSV hue-stabilized) curve to decide
+            // luminance, which generally leads to a less contrasty result
+            // compared to a pure luminance curve. We do this to be more
+            // compatible with the most popular curves.
+            const float oldLuminance = r * Yr + g * Yg + b * Yb;
+            const float newLuminance = ar * Yr + ag * Yg + ab * Yb;
+            const float Lcoef = newLuminance / oldLuminance;
+            r = LIM<float>(r * Lcoef, 0.f, 65535.f);
+            g = LIM<float>(g * Lcoef, 0.f, 65535.f);
+            b = LIM<float>(b * Lcoef, 0.f, 65535.f);
+
+            float x, y, z;
+            Color::Prophotoxyz(r, g, b, x, y, z);
+
+            px[n] = x * 0.0015259022f;
+            py[n] = y * 0.0015259022f;
+            pz[n] = z * 0.0015259022f;
+            pr[n] = r;
+            pg[n] = g;
+            pb[n] = b;
+            sr[n] = std_r;
+            sg[n] = std_g;
+            sb[n] = std_b;
+            adr[n] = ar;
+            adg[n] = ag;
+            adb[n] = ab;
+            lum[n] = newLuminance;
+            idx[n] = i;
+            ++n;
+        }
 
         // move to JCh so we can modulate chroma based on the global
         // contrast-related chroma scaling factor
-        float x, y, z;
-        Color::Prophotoxyz(r, g, b, x, y, z);
-
-        float J, C, h;
-        Ciecam02::xyz2jch_ciecam02float(
-            J, C, h, aw, fl, x * 0.0015259022f, y * 0.0015259022f,
-            z * 0.0015259022f, xw, yw, zw, c, nc, pow1, nbb, ncb, cz, d);
-
-        if (!std::isfinite(J) || !std::isfinite(C) || !std::isfinite(h)) {
-            // this can happen for dark noise colours or colours outside human
-            // gamut. Then we just return the curve's result.
-            to_working(r, g, b);
-            rc[i] = CLIP(intp(strength, r, std_r));
-            gc[i] = CLIP(intp(strength, g, std_g));
-            bc[i] = CLIP(intp(strength, b, std_b));
-
-            continue;
-        }
-
-        float cmul = state.cmul_contrast; // chroma scaling factor
-
-        // depending on color, the chroma scaling factor can be fine-tuned below
+        Ciecam02::xyz2jch_ciecam02float(pJ, pC, ph, px, py, pz, n, vc);
+
+        for (int k = 0; k < n; ++k) {
+            const size_t i = idx[k];
+            float r = pr[k];
+            float g = pg[k];
+            float b = pb[k];
+            const float std_r = sr[k];
+            const float std_g = sg[k];
+            const float std_b = sb[k];
+            const float newLuminance = lum[k];
+            const float J = pJ[k];
+            float &C = pC[k];
+            const float h = ph[k];
+            ok[k] = false;
+
+            if (!std::isfinite(J) || !std::isfinite(C) || !std::isfinite(h)) {
+                // this can happen for dark noise colours or colours outside
+                // human gamut. Then we just return the curve's result.
+                to_working(r, g, b);
+                rc[i] = CLIP(intp(strength, r, std_r));
+                gc[i] = CLIP(intp(strength, g, std_g));
+                bc[i] = CLIP(intp(strength, b, std_b));
+
+                continue;
+            }
 
-        {
-            // decrease chroma scaling slightly of extremely saturated colors
-            float saturated_scale_factor = 0.95f;
-            constexpr float lolim =
-                35.f; // lower limit, below this chroma all colors will keep
-                      // original chroma scaling factor
-            constexpr float hilim =
-                60.f; // high limit, above this chroma the chroma scaling factor
-                      // is multiplied with the saturated scale factor value
-                      // above
-
-            if (C < lolim) {
-                // chroma is low enough, don't scale
-                saturated_scale_factor = 1.f;
-            } else if (C < hilim) {
-                // S-curve transition between low and high limit
-                float x = (C - lolim) /
-                          (hilim - lolim); // x = [0..1], 0 at lolim, 1 at hilim
-
-                if (x < 0.5f) {
-                    x = 2.f * SQR(x);
+            float cmul = state.cmul_contrast; // chroma scaling factor
+
+            // depending on color, the chroma scaling factor can be fine-tuned
+            // below
+
+            {
+                // decrease chroma scaling slightly of extremely saturated
+                // colors
+                float saturated_scale_factor = 0.95f;
+                constexpr float lolim =
+                    35.f; // lower limit, below this chroma all colors will
+                          // keep original chroma scaling factor
+                constexpr float hilim =
+                    60.f; // high limit, above this chroma the chroma scaling
+                          // factor is multiplied with the saturated scale
+                          // factor value above
+
+                if (C < lolim) {
+                    // chroma is low enough, don't scale
+                    saturated_scale_factor = 1.f;
+                } else if (C < hilim) {
+                    // S-curve transition between low and high limit
+                    // x = [0..1], 0 at lolim, 1 at hilim
+                    float x = (C - lolim) / (hilim - lolim);
+
+                    if (x < 0.5f) {
+                        x = 2.f * SQR(x);
+                    } else {
+                        x = 1.f - 2.f * SQR(1 - x);
+                    }
+
+                    saturated_scale_factor =
+                        (1.f - x) + saturated_scale_factor * x;
                 } else {
-                    x = 1.f - 2.f * SQR(1 - x);
+                    // do nothing, high saturation color, keep scale factor
                 }
 
-                saturated_scale_factor = (1.f - x) + saturated_scale_factor * x;
-            } else {
-                // do nothing, high saturation color, keep scale factor
+                cmul *= saturated_scale_factor;
             }
 
-            cmul *= saturated_scale_factor;
-        }
-
-        {
-            // increase chroma scaling slightly of shadows
-            float nL =
-                Color::gamma2curve[newLuminance]; // apply gamma so we make
-                                                  // comparison and transition
-                                                  // with a more perceptual
-                                                  // lightness scale
-            float dark_scale_factor = 1.20f;
-            // float dark_scale_factor = 1.0 + state.debug.p2 / 100.0f;
-            constexpr float lolim = 0.15f;
-            constexpr float hilim = 0.50f;
-
-            if (nL < lolim) {
-                // do nothing, keep scale factor
-            } else if (nL < hilim) {
-                // S-curve transition
-                float x = (nL - lolim) /
-                          (hilim - lolim); // x = [0..1], 0 at lolim, 1 at hilim
-
-                if (x < 0.5f) {
-                    x = 2.f * SQR(x);
+            {
+                // increase chroma scaling slightly of shadows
+                // apply gamma so we make comparison and transition with a
+                // more perceptual lightness scale
+                float nL = Color::gamma2curve[newLuminance];
+                float dark_scale_factor = 1.20f;
+                // float dark_scale_factor = 1.0 + state.debug.p2 / 100.0f;
+                constexpr float lolim = 0.15f;
+                constexpr float hilim = 0.50f;
+
+                if (nL < lolim) {
+                    // do nothing, keep scale factor
+                } else if (nL < hilim) {
+                    // S-curve transition
+                    // x = [0..1], 0 at lolim, 1 at hilim
+                    float x = (nL - lolim) / (hilim - lolim);
+
+                    if (x < 0.5f) {
+                        x = 2.f * SQR(x);
+                    } else {
+                        x = 1.f - 2.f * SQR(1 - x);
+                    }
+
+                    dark_scale_factor = dark_scale_factor * (1.0f - x) + x;
                 } else {
-                    x = 1.f - 2.f * SQR(1 - x);
+                    dark_scale_factor = 1.f;
                 }
 
-                dark_scale_factor = dark_scale_factor * (1.0f - x) + x;
-            } else {
-                dark_scale_factor = 1.f;
+                cmul *= dark_scale_factor;
             }
 
-            cmul *= dark_scale_factor;
-        }
-
-        {
-            // to avoid strange CIECAM02 chroma errors on
-            // close-to-shadow-clipping colors we reduce chroma scaling
-            // towards 1.0 for black colors
-            float dark_scale_factor = 1.f / cmul;
-            constexpr float lolim = 4.f;
-            constexpr float hilim = 7.f;
-
-            if (J < lolim) {
-                // do nothing, keep scale factor
-            } else if (J < hilim) {
-                // S-curve transition
-                float x = (J - lolim) / (hilim - lolim);
-
-                if (x < 0.5f) {
-                    x = 2.f * SQR(x);
+            {
+                // to avoid strange CIECAM02 chroma errors on
+                // close-to-shadow-clipping colors we reduce chroma scaling
+                // towards 1.0 for black colors
+                float dark_scale_factor = 1.f / cmul;
+                constexpr float lolim = 4.f;
+                constexpr float hilim = 7.f;
+
+                if (J < lolim) {
+                    // do nothing, keep scale factor
+                } else if (J < hilim) {
+                    // S-curve transition
+                    float x = (J - lolim) / (hilim - lolim);
+
+                    if (x < 0.5f) {
+                        x = 2.f * SQR(x);
+                    } else {
+                        x = 1.f - 2.f * SQR(1 - x);
+                    }
+
+                    dark_scale_factor = dark_scale_factor * (1.f - x) + x;
                 } else {
-                    x = 1.f - 2.f * SQR(1 - x);
+                    dark_scale_factor = 1.f;
                 }
 
-                dark_scale_factor = dark_scale_factor * (1.f - x) + x;
-            } else {
-                dark_scale_factor = 1.f;
+                cmul *= dark_scale_factor;
             }
 
-            cmul *= dark_scale_factor;
+            C *= cmul;
+            ok[k] = true;
         }
 
-        C *= cmul;
-
-        Ciecam02::jch2xyz_ciecam02float(x, y, z, J, C, h, xw, yw, zw, c, nc,
-                                        pow1, nbb, ncb, fl, cz, d, aw);
+        Ciecam02::jch2xyz_ciecam02float(px, py, pz, pJ, pC, ph, n, vc);
 
-        if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) {
-            // can happen for colours on the rim of being outside gamut, that
-            // worked without chroma scaling but not with. Then we return only
-            // the curve's result.
-            to_working(r, g, b);
-
-            // rc[i] = r;
-            // gc[i] = g;
-            // bc[i] = b;
-            rc[i] = intp(strength, r, std_r);
-            gc[i] = intp(strength, g, std_g);
-            bc[i] = intp(strength, b, std_b);
-
-            continue;
-        }
+        for (int k = 0; k < n; ++k) {
+            if (!ok[k]) {
+                continue;
+            }
 
-        Color::xyz2Prophoto(x, y, z, r, g, b);
-        r *= 655.35f;
-        g *= 655.35f;
-        b *= 655.35f;
-        r = LIM<float>(r, 0.f, 65535.f);
-        g = LIM<float>(g, 0.f, 65535.f);
-        b = LIM<float>(b, 0.f, 65535.f);
+            const size_t i = idx[k];
+            float r = pr[k];
+            float g = pg[k];
+            float b = pb[k];
+            const float x = px[k];
+            const float y = py[k];
+            const float z = pz[k];
+            const float std_r = sr[k];
+            const float std_g = sg[k];
+            const float std_b = sb[k];
+            const float ar = adr[k];
+            const float ag = adg[k];
+            const float ab = adb[k];
+
+            if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) {
+                // can happen for colours on the rim of being outside gamut,
+                // that worked without chroma scaling but not with. Then we
+                // return only the curve's result.
+                to_working(r, g, b);
+
+                // rc[i] = r;
+                // gc[i] = g;
+                // bc[i] = b;
+                rc[i] = intp(strength, r, std_r);
+                gc[i] = intp(strength, g, std_g);
+                bc[i] = intp(strength, b, std_b);
+
+                continue;
+            }
 
-        {
-            // limit saturation increase in rgb space to avoid severe clipping
-            // and flattening in extreme highlights
-
-            // we use the RGB-HSV hue-stable "Adobe" curve as reference. For
-            // S-curve contrast it increases saturation greatly, but desaturates
-            // extreme highlights and thus provide a smooth transition to the
-            // white point. However the desaturation effect is quite strong so
-            // we make a weighting
-            const float as = Color::rgb2s(ar, ag, ab);
-            const float s = Color::rgb2s(r, g, b);
-
-            const float sat_scale =
-                as <= 0.f ? 1.f
-                          : s / as; // saturation scale compared to Adobe curve
-            float keep = 0.2f;
-            constexpr float lolim =
-                1.00f; // only mix in the Adobe curve if we have increased
-                       // saturation compared to it
-            constexpr float hilim = 1.20f;
-
-            if (sat_scale < lolim) {
-                // saturation is low enough, don't desaturate
-                keep = 1.f;
-            } else if (sat_scale < hilim) {
-                // S-curve transition
-                float x = (sat_scale - lolim) /
-                          (hilim - lolim); // x = [0..1], 0 at lolim, 1 at hilim
-
-                if (x < 0.5f) {
-                    x = 2.f * SQR(x);
+            Color::xyz2Prophoto(x, y, z, r, g, b);
+            r *= 655.35f;
+            g *= 655.35f;
+            b *= 655.35f;
+            r = LIM<float>(r, 0.f, 65535.f);
+            g = LIM<float>(g, 0.f, 65535.f);
+            b = LIM<float>(b, 0.f, 65535.f);
+
+            {
+                // limit saturation increase in rgb space to avoid severe
+                // clipping and flattening in extreme highlights
+
+                // we use the RGB-HSV hue-stable "Adobe" curve as reference.
+                // For S-curve contrast it increases saturation greatly, but
+                // desaturates extreme highlights and thus provide a smooth
+                // transition to the white point. However the desaturation
+                // effect is quite strong so we make a weighting
+                const float as = Color::rgb2s(ar, ag, ab);
+                const float s = Color::rgb2s(r, g, b);
+
+                // saturation scale compared to Adobe curve
+                const float sat_scale = as <= 0.f ? 1.f : s / as;
+                float keep = 0.2f;
+                constexpr float lolim =
+                    1.00f; // only mix in the Adobe curve if we have increased
+                           // saturation compared to it
+                constexpr float hilim = 1.20f;
+
+                if (sat_scale < lolim) {
+                    // saturation is low enough, don't desaturate
+                    keep = 1.f;
+                } else if (sat_scale < hilim) {
+                    // S-curve transition
+                    // x = [0..1], 0 at lolim, 1 at hilim
+                    float x = (sat_scale - lolim) / (hilim - lolim);
+
+                    if (x < 0.5f) {
+                        x = 2.f * SQR(x);
+                    } else {
+                        x = 1.f - 2.f * SQR(1 - x);
+                    }
+
+                    keep = (1.f - x) + keep * x;
                 } else {
-                    x = 1.f - 2.f * SQR(1 - x);
+                    // do nothing, very high increase, keep minimum amount
                 }
 
-                keep = (1.f - x) + keep * x;
-            } else {
-                // do nothing, very high increase, keep minimum amount
+                if (keep < 1.f) {
+                    // mix in some of the Adobe curve result
+                    r = intp(keep, r, ar);
+                    g = intp(keep, g, ag);
+                    b = intp(keep, b, ab);
+                }
             }
 
-            if (keep < 1.f) {
-                // mix in some of the Adobe curve result
-                r = intp(keep, r, ar);
-                g = intp(keep, g, ag);
-                b = intp(keep, b, ab);
-            }
+            to_working(r, g, b);
+            // rc[i] = r;
+            // gc[i] = g;
+            // bc[i] = b;
+            rc[i] = CLIP(intp(strength, r, std_r));
+            gc[i] = CLIP(intp(strength, g, std_g));
+            bc[i] = CLIP(intp(strength, b, std_b));
         }
-
-        to_working(r, g, b);
-        // rc[i] = r;
-        // gc[i] = g;
-        // bc[i] = b;
-        rc[i] = CLIP(intp(strength, r, std_r));
-        gc[i] = CLIP(intp(strength, g, std_g));
-        bc[i] = CLIP(intp(strength, b, std_b));
     }
 }
 
@@ -19,7 +19,9 @@
  */
 #pragma once
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -52,6 +54,44 @@ namespace curves {
 
 extern const std::vector<double> filmcurve_def;
 
+/**
+ * Process-wide cache of the LUTs built from the curves of the tools, shared
+ * by all the pipelines (main preview, detail crops, batch processing), so
+ * that the tables are rebuilt only when the parameters of a curve change.
+ * build is called to fill a new table only when nothing is stored for key,
+ * which must capture everything the content of the table depends on (see
+ * LUTKey).
+ */
+std::shared_ptr<const LUTf>
+get_cached_lut(const std::string &key,
+               const std::function<void(LUTf &)> &build);
+
+/// builder for the keys of get_cached_lut
+class LUTKey {
+public:
+    explicit LUTKey(const char *name): key_(name) { key_.push_back('\0'); }
+
+    LUTKey &operator<<(double v)
+    {
+        key_.append(reinterpret_cast<const char *>(&v), sizeof(v));
+        return *this;
+    }
+
+    LUTKey &operator<<(const std::vector<double> &v)
+    {
+        *this << double(v.size());
+        for (double d : v) {
+            *this << d;
+        }
+        return *this;
+    }
+
+    const std::string &str() const { return key_; }
+
+private:
+    std::string key_;
+};
+
 } // namespace curves
 
 class DiagonalCurve;
@@ -169,6 +209,9 @@ public:
     void AddPolygons();
     int getSize() const; // return the number of control points
     void getControlPoint(int cpNum, double &x, double &y) const;
+    // number of points of the polyline approximating the curve (0 when the
+    // curve is not approximated)
+    int getPolylineSize() const { return poly_x.size(); }
     virtual double getVal(double t) const = 0;
     virtual void getVal(const std::vector<double> &t,
                         std::vector<double> &res) const = 0;
@@ -219,6 +262,33 @@ public:
     bool isIdentity() const override { return kind == FCT_Empty; };
 };
 
+/**
+ * A Curve sampled once into a LUT, for the tools that evaluate it per pixel.
+ * The input is clipped to [0, 1] and the result is interpolated linearly
+ * between the samples, whose number depends on the resolution of the
+ * polyline of the curve.
+ */
+class CurveLUT {
+public:
+    CurveLUT(): scale_(0.f) {}
+    explicit CurveLUT(const Curve &curve, bool multithread = true)
+    {
+        set(curve, multithread);
+    }
+
+    void set(const Curve &curve, bool multithread = true);
+
+    float operator()(float x) const { return lut_[x * scale_]; }
+#ifdef __SSE2__
+    vfloat operator()(vfloat x) const { return lut_[x * F2V(scale_)]; }
+#endif
+    operator bool() const { return lut_; }
+
+private:
+    LUTf lut_;
+    float scale_;
+};
+
 namespace curves {
 
 inline void setLutVal(const LUTf &lut, const Curve *curve, float &val)
@@ -244,6 +314,9 @@ public:
 
     void Reset();
     void Set(const Curve &pCurve, float whitecoeff = 1.f);
+    // same as above, but the LUT is taken from curves::get_cached_lut()
+    void Set(const Curve &pCurve, float whitecoeff,
+             const std::string &cache_key);
     operator bool(void) const { return lutToneCurve; }
 };
 
@@ -252,11 +325,10 @@ public:
     void Apply(float &r, float &g, float &b) const;
 
     // Applies the tone curve to `r`, `g`, `b` arrays, starting at `r[start]`
-    // and ending at `r[end]` (and respectively for `b` and `g`). Uses SSE
-    // and requires that `r`, `g`, and `b` pointers have the same alignment.
-    // void BatchApply(
-    //         const size_t start, const size_t end,
-    //         float *r, float *g, float *b) const;
+    // and ending at `r[end]` (and respectively for `b` and `g`). Uses SSE,
+    // with no alignment requirements.
+    void BatchApply(const size_t start, const size_t end, float *r, float *g,
+                    float *b) const;
 };
 
 class AdobeToneCurve: public ToneCurve {
@@ -265,6 +337,9 @@ private:
 
 public:
     void Apply(float &r, float &g, float &b) const;
+    // same as StandardToneCurve::BatchApply()
+    void BatchApply(const size_t start, const size_t end, float *r, float *g,
+                    float *b) const;
 };
 
 class SatAndValueBlendingToneCurve: public ToneCurve {
@@ -275,19 +350,23 @@ public:
 class WeightedStdToneCurve: public ToneCurve {
 private:
     float Triangle(float refX, float refY, float X2) const;
-    // #ifdef __SSE2__
-    //     vfloat Triangle(vfloat refX, vfloat refY, vfloat X2) const;
-    // #endif
+#ifdef __SSE2__
+    vfloat Triangle(vfloat refX, vfloat refY, vfloat X2) const;
+#endif
 public:
     void Apply(float &r, float &g, float &b) const;
-    // void BatchApply(const size_t start, const size_t end, float *r, float *g,
-    // float *b) const;
+    // same as StandardToneCurve::BatchApply()
+    void BatchApply(const size_t start, const size_t end, float *r, float *g,
+                    float *b) const;
 };
 
 class LuminanceToneCurve: public ToneCurve {
 public:
     // void Apply(float& r, float& g, float& b) const;
     void Apply(float &r, float &g, float &b, const float ws[3][3]) const;
+    // same as StandardToneCurve::BatchApply()
+    void BatchApply(const size_t start, const size_t end, float *r, float *g,
+                    float *b, const float ws[3][3]) const;
 };
 
 class PerceptualToneCurveState {
@@ -365,61 +444,36 @@ inline void StandardToneCurve::Apply(float &r, float &g, float &b) const
     curves::setLutVal(lutToneCurve, curve, b);
 }
 
-// inline void StandardToneCurve::BatchApply(
-//         const size_t start, const size_t end,
-//         float *r, float *g, float *b) const {
-//     assert (lutToneCurve);
-//     assert (lutToneCurve.getClip() & LUT_CLIP_BELOW);
-//     assert (lutToneCurve.getClip() & LUT_CLIP_ABOVE);
-
-//     // All pointers must have the same alignment for SSE usage. In the loop
-//     body below,
-//     // we will only check `r`, assuming that the same result would hold for
-//     `g` and `b`. assert (reinterpret_cast<uintptr_t>(r) % 16 ==
-//     reinterpret_cast<uintptr_t>(g) % 16); assert
-//     (reinterpret_cast<uintptr_t>(g) % 16 == reinterpret_cast<uintptr_t>(b) %
-//     16);
-
-//     size_t i = start;
-//     while (true) {
-//         if (i >= end) {
-//             // If we get to the end before getting to an aligned address,
-//             just return.
-//             // (Or, for non-SSE mode, if we get to the end.)
-//             return;
-// #ifdef __SSE2__
-//         } else if (reinterpret_cast<uintptr_t>(&r[i]) % 16 == 0) {
-//             // Otherwise, we get to the first aligned address; go to the SSE
-//             part. break;
-// #endif
-//         }
-//         r[i] = lutToneCurve[r[i]];
-//         g[i] = lutToneCurve[g[i]];
-//         b[i] = lutToneCurve[b[i]];
-//         i++;
-//     }
-
-// #ifdef __SSE2__
-//     for (; i + 3 < end; i += 4) {
-//         vfloat r_val = LVF(r[i]);
-//         vfloat g_val = LVF(g[i]);
-//         vfloat b_val = LVF(b[i]);
-//         r_val = lutToneCurve[r_val];
-//         g_val = lutToneCurve[g_val];
-//         b_val = lutToneCurve[b_val];
-//         STVF(r[i], r_val);
-//         STVF(g[i], g_val);
-//         STVF(b[i], b_val);
-//     }
-
-//     // Remainder in non-SSE.
-//     for (; i < end; ++i) {
-//         r[i] = lutToneCurve[r[i]];
-//         g[i] = lutToneCurve[g[i]];
-//         b[i] = lutToneCurve[b[i]];
-//     }
-// #endif
-// }
+inline void StandardToneCurve::BatchApply(const size_t start,
+                                          const size_t end, float *r, float *g,
+                                          float *b) const
+{
+    assert(lutToneCurve);
+
+    size_t i = start;
+#ifdef __SSE2__
+    const vfloat c65535v = F2V(65535.f);
+    for (; i + 3 < end; i += 4) {
+        const vfloat rv = LVFU(r[i]);
+        const vfloat gv = LVFU(g[i]);
+        const vfloat bv = LVFU(b[i]);
+        if (curve && _mm_movemask_ps((vfloat)vmaskf_gt(
+                         vmaxf(rv, vmaxf(gv, bv)), c65535v))) {
+            // values above the range of the LUT are taken from the curve
+            for (size_t k = i; k < i + 4; ++k) {
+                Apply(r[k], g[k], b[k]);
+            }
+            continue;
+        }
+        STVFU(r[i], lutToneCurve[vmaxf(rv, ZEROV)]);
+        STVFU(g[i], lutToneCurve[vmaxf(gv, ZEROV)]);
+        STVFU(b[i], lutToneCurve[vmaxf(bv, ZEROV)]);
+    }
+#endif
+    for (; i < end; ++i) {
+        Apply(r[i], g[i], b[i]);
+    }
+}
 
 // Tone curve according to Adobe's reference implementation
 // values in 0xffff space
@@ -472,6 +526,47 @@ inline void AdobeToneCurve::RGBTone(float &r, float &g, float &b) const
     g = b + ((r - b) * (gold - bold) / (rold - bold));
 }
 
+inline void AdobeToneCurve::BatchApply(const size_t start, const size_t end,
+                                       float *r, float *g, float *b) const
+{
+    assert(lutToneCurve);
+
+    size_t i = start;
+#ifdef __SSE2__
+    // the cases of Apply() all amount to applying the curve to the largest
+    // and smallest channel, and interpolating the middle one
+    const vfloat c65535v = F2V(65535.f);
+    const vfloat whiteptv = F2V(whitept);
+    for (; i + 3 < end; i += 4) {
+        const vfloat rv = vclampf(LVFU(r[i]), ZEROV, whiteptv);
+        const vfloat gv = vclampf(LVFU(g[i]), ZEROV, whiteptv);
+        const vfloat bv = vclampf(LVFU(b[i]), ZEROV, whiteptv);
+        const vfloat maxv = vmaxf(rv, vmaxf(gv, bv));
+        if (curve && _mm_movemask_ps((vfloat)vmaskf_gt(maxv, c65535v))) {
+            for (size_t k = i; k < i + 4; ++k) {
+                Apply(r[k], g[k], b[k]);
+            }
+            continue;
+        }
+        const vfloat minv = vminf(rv, vminf(gv, bv));
+        const vfloat newmaxv = lutToneCurve[maxv];
+        const vfloat newminv = lutToneCurve[minv];
+        const auto tone = [&](vfloat v) -> vfloat {
+            return vself(vmaskf_eq(v, maxv), newmaxv,
+                         vself(vmaskf_eq(v, minv), newminv,
+                               newminv + ((newmaxv - newminv) * (v - minv) /
+                                          (maxv - minv))));
+        };
+        STVFU(r[i], tone(rv));
+        STVFU(g[i], tone(gv));
+        STVFU(b[i], tone(bv));
+    }
+#endif
+    for (; i < end; ++i) {
+        Apply(r[i], g[i], b[i]);
+    }
+}
+
 // Modifying the Luminance channel only
 inline void LuminanceToneCurve::Apply(float &ir, float &ig, float &ib,
                                       const float ws[3][3]) const
@@ -499,6 +594,47 @@ inline void LuminanceToneCurve::Apply(float &ir, float &ig, float &ib,
     ib = b;
 }
 
+inline void LuminanceToneCurve::BatchApply(const size_t start, const size_t end,
+                                           float *r, float *g, float *b,
+                                           const float ws[3][3]) const
+{
+    assert(lutToneCurve);
+
+    size_t i = start;
+#ifdef __SSE2__
+    vfloat vws[3][3];
+    for (int j = 0; j < 3; ++j) {
+        for (int k = 0; k < 3; ++k) {
+            vws[j][k] = F2V(ws[j][k]);
+        }
+    }
+    const vfloat c65535v = F2V(65535.f);
+    const vfloat whiteptv = F2V(whitept);
+    const vfloat epsv = F2V(0.00001f);
+    for (; i + 3 < end; i += 4) {
+        const vfloat rv = vclampf(LVFU(r[i]), ZEROV, whiteptv);
+        const vfloat gv = vclampf(LVFU(g[i]), ZEROV, whiteptv);
+        const vfloat bv = vclampf(LVFU(b[i]), ZEROV, whiteptv);
+        const vfloat lumv = Color::rgbLuminance(rv, gv, bv, vws);
+        if (curve && _mm_movemask_ps((vfloat)vmaskf_gt(lumv, c65535v))) {
+            for (size_t k = i; k < i + 4; ++k) {
+                Apply(r[k], g[k], b[k], ws);
+            }
+            continue;
+        }
+        const vfloat coefv =
+            lutToneCurve[vmaxf(lumv, ZEROV)] /
+            vself(vmaskf_eq(lumv, ZEROV), epsv, lumv);
+        STVFU(r[i], vclampf(rv * coefv, ZEROV, whiteptv));
+        STVFU(g[i], vclampf(gv * coefv, ZEROV, whiteptv));
+        STVFU(b[i], vclampf(bv * coefv, ZEROV, whiteptv));
+    }
+#endif
+    for (; i < end; ++i) {
+        Apply(r[i], g[i], b[i], ws);
+    }
+}
+
 inline float WeightedStdToneCurve::Triangle(float a, float a1, float b) const
 {
     if (a != b) {
@@ -517,18 +653,17 @@ inline float WeightedStdToneCurve::Triangle(float a, float a1, float b) const
     return a1;
 }
 
-// #ifdef __SSE2__
-// inline vfloat WeightedStdToneCurve::Triangle(vfloat a, vfloat a1, vfloat b)
-// const
-// {
-//         vmask eqmask = vmaskf_eq(b, a);
-//         vfloat a2 = a1 - a;
-//         vmask cmask = vmaskf_lt(b, a);
-//         vfloat b3 = vself(cmask, b, F2V(65535.f) - b);
-//         vfloat a3 = vself(cmask, a, F2V(65535.f) - a);
-//         return vself(eqmask, a1, b + a2 * b3 / a3);
-// }
-// #endif
+#ifdef __SSE2__
+inline vfloat WeightedStdToneCurve::Triangle(vfloat a, vfloat a1,
+                                             vfloat b) const
+{
+    const vfloat a2 = a1 - a;
+    const vmask cmask = vmaskf_lt(b, a);
+    const vfloat b3 = vself(cmask, b, F2V(whitept) - b);
+    const vfloat a3 = vself(cmask, a, F2V(whitept) - a);
+    return vself(vmaskf_eq(b, a), a1, b + a2 * b3 / a3);
+}
+#endif
 
 // Tone curve modifying the value channel only, preserving hue and saturation
 // values in 0xffff space
@@ -565,76 +700,54 @@ inline void WeightedStdToneCurve::Apply(float &ir, float &ig, float &ib) const
     ib = b;
 }
 
-// inline void WeightedStdToneCurve::BatchApply(const size_t start, const size_t
-// end, float *r, float *g, float *b) const {
-//     assert (lutToneCurve);
-//     assert (lutToneCurve.getClip() & LUT_CLIP_BELOW);
-//     assert (lutToneCurve.getClip() & LUT_CLIP_ABOVE);
-
-//     // All pointers must have the same alignment for SSE usage. In the loop
-//     body below,
-//     // we will only check `r`, assuming that the same result would hold for
-//     `g` and `b`. assert (reinterpret_cast<uintptr_t>(r) % 16 ==
-//     reinterpret_cast<uintptr_t>(g) % 16); assert
-//     (reinterpret_cast<uintptr_t>(g) % 16 == reinterpret_cast<uintptr_t>(b) %
-//     16);
-
-//     size_t i = start;
-//     while (true) {
-//         if (i >= end) {
-//             // If we get to the end before getting to an aligned address,
-//             just return.
-//             // (Or, for non-SSE mode, if we get to the end.)
-//             return;
-// #ifdef __SSE2__
-//         } else if (reinterpret_cast<uintptr_t>(&r[i]) % 16 == 0) {
-//             // Otherwise, we get to the first aligned address; go to the SSE
-//             part. break;
-// #endif
-//         }
-//         Apply(r[i], g[i], b[i]);
-//         i++;
-//     }
-
-// #ifdef __SSE2__
-//     const vfloat c65535v = F2V(65535.f);
-//     const vfloat zd5v = F2V(0.5f);
-//     const vfloat zd25v = F2V(0.25f);
-
-//     for (; i + 3 < end; i += 4) {
-//         vfloat r_val = vclampf(LVF(r[i]), ZEROV, c65535v);
-//         vfloat g_val = vclampf(LVF(g[i]), ZEROV, c65535v);
-//         vfloat b_val = vclampf(LVF(b[i]), ZEROV, c65535v);
-//         vfloat r1 = lutToneCurve[r_val];
-//         vfloat g1 = Triangle(r_val, r1, g_val);
-//         vfloat b1 = Triangle(r_val, r1, b_val);
-
-//         vfloat g2 = lutToneCurve[g_val];
-//         vfloat r2 = Triangle(g_val, g2, r_val);
-//         vfloat b2 = Triangle(g_val, g2, b_val);
-
-//         vfloat b3 = lutToneCurve[b_val];
-//         vfloat r3 = Triangle(b_val, b3, r_val);
-//         vfloat g3 = Triangle(b_val, b3, g_val);
-
-//         vfloat r_old = LVF(r[i]);
-//         vfloat g_old = LVF(g[i]);
-//         vfloat b_old = LVF(b[i]);
-//         vfloat r_new = vclampf(r1 * zd5v + r2 * zd25v + r3 * zd25v, ZEROV,
-//         c65535v); vfloat g_new = vclampf(g1 * zd25v + g2 * zd5v + g3 * zd25v,
-//         ZEROV, c65535v); vfloat b_new = vclampf(b1 * zd25v + b2 * zd25v + b3
-//         * zd5v, ZEROV, c65535v); r_old = r_new; g_old = g_new; b_old = b_new;
-//         STVF(r[i], r_old);
-//         STVF(g[i], g_old);
-//         STVF(b[i], b_old);
-//     }
-
-//     // Remainder in non-SSE.
-//     for (; i < end; ++i) {
-//         Apply(r[i], g[i], b[i]);
-//     }
-// #endif
-// }
+inline void WeightedStdToneCurve::BatchApply(const size_t start,
+                                             const size_t end, float *r,
+                                             float *g, float *b) const
+{
+    assert(lutToneCurve);
+
+    size_t i = start;
+#ifdef __SSE2__
+    const vfloat c65535v = F2V(65535.f);
+    const vfloat whiteptv = F2V(whitept);
+    const vfloat zd5v = F2V(0.5f);
+    const vfloat zd25v = F2V(0.25f);
+
+    for (; i + 3 < end; i += 4) {
+        const vfloat rv = vclampf(LVFU(r[i]), ZEROV, whiteptv);
+        const vfloat gv = vclampf(LVFU(g[i]), ZEROV, whiteptv);
+        const vfloat bv = vclampf(LVFU(b[i]), ZEROV, whiteptv);
+        if (curve && _mm_movemask_ps((vfloat)vmaskf_gt(
+                         vmaxf(rv, vmaxf(gv, bv)), c65535v))) {
+            for (size_t k = i; k < i + 4; ++k) {
+                Apply(r[k], g[k], b[k]);
+            }
+            continue;
+        }
+        const vfloat r1 = lutToneCurve[rv];
+        const vfloat g1 = Triangle(rv, r1, gv);
+        const vfloat b1 = Triangle(rv, r1, bv);
+
+        const vfloat g2 = lutToneCurve[gv];
+        const vfloat r2 = Triangle(gv, g2, rv);
+        const vfloat b2 = Triangle(gv, g2, bv);
+
+        const vfloat b3 = lutToneCurve[bv];
+        const vfloat r3 = Triangle(bv, b3, rv);
+        const vfloat g3 = Triangle(bv, b3, gv);
+
+        STVFU(r[i], vclampf(r1 * zd5v + r2 * zd25v + r3 * zd25v, ZEROV,
+                            whiteptv));
+        STVFU(g[i], vclampf(g1 * zd25v + g2 * zd5v + g3 * zd25v, ZEROV,
+                            whiteptv));
+        STVFU(b[i], vclampf(b1 * zd25v + b2 * zd25v + b3 * zd5v, ZEROV,
+                            whiteptv));
+    }
+#endif
+    for (; i < end; ++i) {
+        Apply(r[i], g[i], b[i]);
+    }
+}
 
 // Tone curve modifying the value channel only, preserving hue and saturation
 // values in 0xffff space
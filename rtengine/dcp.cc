@@ -741,6 +741,31 @@ inline float hue_interpolate(float f0, float hue0, float f1, float hue1)
     return res;
 }
 
+#ifdef __SSE2__
+// fmod(a, 360.f), exact when |a| < 360 (by far the most common case)
+inline vfloat vfmod360(vfloat a)
+{
+    const vfloat v360 = F2V(360.f);
+    const vfloat m = a - v360 * _mm_cvtepi32_ps(_mm_cvttps_epi32(a / v360));
+    return vself(vmaskf_ge(vabsf(a), v360), m, a);
+}
+
+// vector version of hue_interpolate()
+inline vfloat hue_interpolate(vfloat f0, vfloat hue0, vfloat f1, vfloat hue1)
+{
+    const vfloat h1 = vfmod360(hue0);
+    const vfloat h2 = vfmod360(hue1);
+    const vmask swap = vmaskf_gt(h1, h2);
+    const vfloat lo = vself(swap, h2, h1);
+    const vfloat hi = vself(swap, h1, h2);
+    const vfloat flo = vself(swap, f1, f0);
+    const vfloat fhi = vself(swap, f0, f1);
+    const vfloat lo360 = lo + F2V(360.f);
+    const vfloat wrapped = vfmod360((flo * fhi) * lo360 + fhi * (hi - lo360));
+    return vself(vmaskf_gt(hi - lo, F2V(180.f)), wrapped, flo * lo + fhi * hi);
+}
+#endif // __SSE2__
+
 } // namespace
 
 struct DCPProfile::ApplyState::Data {
@@ -760,7 +785,8 @@ DCPProfile::DCPProfile(const Glib::ustring &filename)
     : has_color_matrix_1(false), has_color_matrix_2(false),
       has_forward_matrix_1(false), has_forward_matrix_2(false),
       has_tone_curve(false), has_baseline_exposure_offset(false),
-      will_interpolate(false), valid(false), baseline_exposure_offset(0.0)
+      will_interpolate(false), valid(false), baseline_exposure_offset(0.0),
+      hue_sat_map_mix_(-1.f)
 {
     delta_info.hue_step = delta_info.val_step = look_info.hue_step =
         look_info.val_step = 0;
@@ -1223,10 +1249,9 @@ void DCPProfile::apply(Imagefloat *img, int preferred_illuminant,
     const TMatrix work_matrix =
         ICCStore::getInstance()->workingSpaceInverseMatrix(working_space);
 
-    const std::vector<HsbModify> delta_base =
-        makeHueSatMap(white_balance, preferred_illuminant);
+    const auto delta_base = makeHueSatMap(white_balance, preferred_illuminant);
 
-    if (delta_base.empty()) {
+    if (!delta_base) {
         apply_hue_sat_map = false;
     }
 
@@ -1297,7 +1322,61 @@ void DCPProfile::apply(Imagefloat *img, int preferred_illuminant,
 #endif
 
         for (int y = 0; y < img->getHeight(); ++y) {
-            for (int x = 0; x < img->getWidth(); x++) {
+            int x = 0;
+#ifdef __SSE2__
+            float *const rrow = img->r(y);
+            float *const grow = img->g(y);
+            float *const brow = img->b(y);
+            const vfloat zerov = F2V(0.f);
+            const vfloat sixv = F2V(6.f);
+
+            for (; x < img->getWidth() - 3; x += 4) {
+                const vfloat r = LVFU(rrow[x]);
+                const vfloat g = LVFU(grow[x]);
+                const vfloat b = LVFU(brow[x]);
+                vfloat newr = F2V(pro_photo[0][0]) * r +
+                              F2V(pro_photo[0][1]) * g +
+                              F2V(pro_photo[0][2]) * b;
+                vfloat newg = F2V(pro_photo[1][0]) * r +
+                              F2V(pro_photo[1][1]) * g +
+                              F2V(pro_photo[1][2]) * b;
+                vfloat newb = F2V(pro_photo[2][0]) * r +
+                              F2V(pro_photo[2][1]) * g +
+                              F2V(pro_photo[2][2]) * b;
+
+                vfloat h, s, v;
+                const vmask valid =
+                    Color::rgb2hsvdcp(newr, newg, newb, h, s, v);
+                // the lanes in the negative area get just the matrix, their
+                // hsv values are zeroed so that hsdApply stays in range
+                h = vself(valid, h, zerov);
+                s = vself(valid, s, zerov);
+                v = vself(valid, v, zerov);
+
+                hsdApply(delta_info, *delta_base, h, s, v);
+
+                // RT range correction
+                h = vself(vmaskf_lt(h, zerov), h + sixv,
+                          vself(vmaskf_ge(h, sixv), h - sixv, h));
+
+                vfloat hr, hg, hb;
+                Color::hsv2rgbdcp(h, s, v, hr, hg, hb);
+                newr = vself(valid, hr, newr);
+                newg = vself(valid, hg, newg);
+                newb = vself(valid, hb, newb);
+
+                STVFU(rrow[x], F2V(work[0][0]) * newr +
+                                   F2V(work[0][1]) * newg +
+                                   F2V(work[0][2]) * newb);
+                STVFU(grow[x], F2V(work[1][0]) * newr +
+                                   F2V(work[1][1]) * newg +
+                                   F2V(work[1][2]) * newb);
+                STVFU(brow[x], F2V(work[2][0]) * newr +
+                                   F2V(work[2][1]) * newg +
+                                   F2V(work[2][2]) * newb);
+            }
+#endif
+            for (; x < img->getWidth(); x++) {
                 float newr = pro_photo[0][0] * img->r(y, x) +
                              pro_photo[0][1] * img->g(y, x) +
                              pro_photo[0][2] * img->b(y, x);
@@ -1316,7 +1395,7 @@ void DCPProfile::apply(Imagefloat *img, int preferred_illuminant,
 
                 if (LIKELY(Color::rgb2hsvdcp(newr, newg, newb, h, s, v))) {
 
-                    hsdApply(delta_info, delta_base, h, s, v);
+                    hsdApply(delta_info, *delta_base, h, s, v);
 
                     // RT range correction
                     if (h < 0.0f) {
@@ -1412,7 +1491,91 @@ void DCPProfile::step2ApplyTile(float *rc, float *gc, float *bc, int width,
         }
     } else {
         for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
+            int x = 0;
+#ifdef __SSE2__
+            const vfloat zerov = F2V(0.f);
+            const vfloat onev = F2V(1.f);
+            const vfloat sixv = F2V(6.f);
+            const vfloat maxv = F2V(65535.5f);
+            const vfloat exp_scalev = F2V(exp_scale);
+            const auto &pro_photo = as_in.data->pro_photo;
+            const auto &work = as_in.data->work;
+
+            for (; x < width - 3; x += 4) {
+                float *const pr = rc + y * tile_width + x;
+                float *const pg = gc + y * tile_width + x;
+                float *const pb = bc + y * tile_width + x;
+                const vfloat r = LVFU(*pr) * exp_scalev;
+                const vfloat g = LVFU(*pg) * exp_scalev;
+                const vfloat b = LVFU(*pb) * exp_scalev;
+
+                vfloat newr, newg, newb;
+
+                if (as_in.data->already_pro_photo) {
+                    newr = r;
+                    newg = g;
+                    newb = b;
+                } else {
+                    newr = F2V(pro_photo[0][0]) * r +
+                           F2V(pro_photo[0][1]) * g + F2V(pro_photo[0][2]) * b;
+                    newg = F2V(pro_photo[1][0]) * r +
+                           F2V(pro_photo[1][1]) * g + F2V(pro_photo[1][2]) * b;
+                    newb = F2V(pro_photo[2][0]) * r +
+                           F2V(pro_photo[2][1]) * g + F2V(pro_photo[2][2]) * b;
+                }
+
+                // with looktable and tonecurve we need to clip
+                newr = vmaxf(newr, zerov);
+                newg = vmaxf(newg, zerov);
+                newb = vmaxf(newb, zerov);
+
+                if (as_in.data->apply_look_table) {
+                    vfloat h, s, v;
+                    Color::rgb2hsvdcp(vminf(newr, maxv), vminf(newg, maxv),
+                                      vminf(newb, maxv), h, s, v);
+
+                    hsdApply(look_info, look_table, h, s, v);
+                    s = vmaxf(vminf(s, onev), zerov);
+                    v = vmaxf(vminf(v, onev), zerov);
+
+                    // RT range correction
+                    h = vself(vmaskf_lt(h, zerov), h + sixv,
+                              vself(vmaskf_ge(h, sixv), h - sixv, h));
+
+                    Color::hsv2rgbdcp(h, s, v, newr, newg, newb);
+                }
+
+                if (as_in.data->use_tone_curve) {
+                    float tr[4] ALIGNED16;
+                    float tg[4] ALIGNED16;
+                    float tb[4] ALIGNED16;
+                    STVF(tr[0], newr);
+                    STVF(tg[0], newg);
+                    STVF(tb[0], newb);
+                    tone_curve.BatchApply(0, 4, tr, tg, tb);
+                    newr = LVF(tr[0]);
+                    newg = LVF(tg[0]);
+                    newb = LVF(tb[0]);
+                }
+
+                if (as_in.data->already_pro_photo) {
+                    STVFU(*pr, newr);
+                    STVFU(*pg, newg);
+                    STVFU(*pb, newb);
+                } else {
+                    STVFU(*pr, F2V(work[0][0]) * newr +
+                                   F2V(work[0][1]) * newg +
+                                   F2V(work[0][2]) * newb);
+                    STVFU(*pg, F2V(work[1][0]) * newr +
+                                   F2V(work[1][1]) * newg +
+                                   F2V(work[1][2]) * newb);
+                    STVFU(*pb, F2V(work[2][0]) * newr +
+                                   F2V(work[2][1]) * newg +
+                                   F2V(work[2][2]) * newb);
+                }
+            }
+#endif
+            for (; x < width; x++) {
                 float r = rc[y * tile_width + x];
                 float g = gc[y * tile_width + x];
                 float b = bc[y * tile_width + x];
@@ -1805,28 +1968,34 @@ DCPProfile::Matrix DCPProfile::makeXyzCam(const ColorTemp &white_balance,
     return res;
 }
 
-std::vector<DCPProfile::HsbModify>
+std::shared_ptr<const std::vector<DCPProfile::HsbModify>>
 DCPProfile::makeHueSatMap(const ColorTemp &white_balance,
                           int preferred_illuminant) const
 {
+    typedef std::shared_ptr<const std::vector<HsbModify>> Ptr;
+    // the tables owned by the profile are returned without copying them
+    const auto unowned = [](const std::vector<HsbModify> &t) -> Ptr {
+        return Ptr(Ptr(), &t);
+    };
+
     if (deltas_1.empty()) {
-        return std::vector<HsbModify>();
+        return Ptr();
     }
 
     if (deltas_2.empty()) {
-        return deltas_1;
+        return unowned(deltas_1);
     }
 
     if (preferred_illuminant == 1) {
-        return deltas_1;
+        return unowned(deltas_1);
     } else if (preferred_illuminant == 2) {
-        return deltas_2;
+        return unowned(deltas_2);
     }
 
     // Interpolate based on color temperature
     if (temperature_1 <= 0.0 || temperature_2 <= 0.0 ||
         temperature_1 == temperature_2) {
-        return deltas_1;
+        return unowned(deltas_1);
     }
 
     const bool reverse = temperature_1 > temperature_2;
@@ -1849,27 +2018,37 @@ DCPProfile::makeHueSatMap(const ColorTemp &white_balance,
     }
 
     if (mix >= 1.0) {
-        return deltas_1;
+        return unowned(deltas_1);
     } else if (mix <= 0.0) {
-        return deltas_2;
+        return unowned(deltas_2);
     }
 
-    // Interpolate between the tables.
-    std::vector<HsbModify> res(delta_info.array_count);
-
     const float w1 = mix;
     const float w2 = 1.0f - w1;
 
+    // the white balance rarely changes between two renders, so the last
+    // interpolated table is kept
+    MyMutex::MyLock lock(hue_sat_map_mutex_);
+    if (hue_sat_map_ && hue_sat_map_mix_ == w1) {
+        return hue_sat_map_;
+    }
+
+    // Interpolate between the tables.
+    std::shared_ptr<std::vector<HsbModify>> res(
+        new std::vector<HsbModify>(delta_info.array_count));
+
     for (unsigned int i = 0; i < delta_info.array_count; ++i) {
-        res[i].hue_shift = hue_interpolate(w1, deltas_1[i].hue_shift, w2,
-                                           deltas_2[i].hue_shift);
-        res[i].sat_scale =
+        (*res)[i].hue_shift = hue_interpolate(w1, deltas_1[i].hue_shift, w2,
+                                              deltas_2[i].hue_shift);
+        (*res)[i].sat_scale =
             w1 * deltas_1[i].sat_scale + w2 * deltas_2[i].sat_scale;
-        res[i].val_scale =
+        (*res)[i].val_scale =
             w1 * deltas_1[i].val_scale + w2 * deltas_2[i].val_scale;
     }
 
-    return res;
+    hue_sat_map_ = res;
+    hue_sat_map_mix_ = w1;
+    return hue_sat_map_;
 }
 
 void DCPProfile::hsdApply(const HsdTableInfo &table_info,
@@ -2030,14 +2209,162 @@ void DCPProfile::hsdApply(const HsdTableInfo &table_info,
     }
 }
 
+#ifdef __SSE2__
+void DCPProfile::hsdApply(const HsdTableInfo &table_info,
+                          const std::vector<HsbModify> &table_base, vfloat &h,
+                          vfloat &s, vfloat &v) const
+{
+    // Same as the scalar version, on 4 pixels at a time. The table entries
+    // of the lanes are loaded one by one and transposed
+    static_assert(sizeof(HsbModify) == 3 * sizeof(float),
+                  "HsbModify must be made of 3 packed floats");
+
+    const float *const base = &table_base[0].hue_shift;
+    const vfloat zerov = F2V(0.f);
+    const vfloat onev = F2V(1.f);
+
+    struct Entry {
+        vfloat hue_shift;
+        vfloat sat_scale;
+        vfloat val_scale;
+    };
+
+    const auto fetch = [base](vfloat index) -> Entry {
+        int idx[4] ALIGNED16;
+        _mm_store_si128(reinterpret_cast<__m128i *>(idx),
+                        _mm_cvttps_epi32(index));
+        vfloat e[4];
+        for (int i = 0; i < 4; ++i) {
+            const float *p = base + 3 * idx[i];
+            e[i] = _mm_movelh_ps(
+                _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(p))),
+                _mm_load_ss(p + 2));
+        }
+        _MM_TRANSPOSE4_PS(e[0], e[1], e[2], e[3]);
+        return {e[0], e[1], e[2]};
+    };
+
+    // interpolation along the hue axis
+    const auto hue_lerp = [&](vfloat f0, vfloat i0, vfloat f1,
+                              vfloat i1) -> Entry {
+        const Entry e0 = fetch(i0);
+        const Entry e1 = fetch(i1);
+        return {hue_interpolate(f0, e0.hue_shift, f1, e1.hue_shift),
+                f0 * e0.sat_scale + f1 * e1.sat_scale,
+                f0 * e0.val_scale + f1 * e1.val_scale};
+    };
+
+    const auto trunc = [](vfloat a) -> vfloat {
+        return _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    };
+
+    const vfloat h_scaled = h * F2V(table_info.pc.h_scale);
+    const vfloat s_scaled = s * F2V(table_info.pc.s_scale);
+
+    // the hue index is clamped also in the 3D case, so that lanes with
+    // invalid values can't read outside of the table
+    vfloat h_index0 = vmaxf(trunc(h_scaled), zerov);
+    const vfloat s_index0 = vmaxf(
+        vminf(trunc(s_scaled), F2V(table_info.pc.max_sat_index0)), zerov);
+
+    const vfloat max_hue_index0 = F2V(table_info.pc.max_hue_index0);
+    const vmask hue_wrap = vmaskf_ge(h_index0, max_hue_index0);
+    const vfloat h_index1 =
+        vself(hue_wrap, zerov, h_index0 + onev);
+    h_index0 = vself(hue_wrap, max_hue_index0, h_index0);
+
+    const vfloat h_fract1 = h_scaled - h_index0;
+    const vfloat s_fract1 = s_scaled - s_index0;
+    const vfloat h_fract0 = onev - h_fract1;
+    const vfloat s_fract0 = onev - s_fract1;
+
+    const vfloat hue_step = F2V(table_info.pc.hue_step);
+
+    vfloat v_encoded = v;
+    vfloat hue_shift;
+    vfloat sat_scale;
+    vfloat val_scale;
+
+    if (table_info.val_divisions < 2) {
+        const vfloat e00_index = h_index0 * hue_step + s_index0;
+        const vfloat e01_index = e00_index + (h_index1 - h_index0) * hue_step;
+
+        const Entry e0 = hue_lerp(h_fract0, e00_index, h_fract1, e01_index);
+        const Entry e1 =
+            hue_lerp(h_fract0, e00_index + onev, h_fract1, e01_index + onev);
+
+        hue_shift =
+            hue_interpolate(s_fract0, e0.hue_shift, s_fract1, e1.hue_shift);
+        sat_scale = s_fract0 * e0.sat_scale + s_fract1 * e1.sat_scale;
+        val_scale = s_fract0 * e0.val_scale + s_fract1 * e1.val_scale;
+    } else {
+        if (table_info.srgb_gamma) {
+            v_encoded = Color::gammatab_srgb1[v * F2V(65535.f)];
+        }
+
+        const vfloat v_scaled = v_encoded * F2V(table_info.pc.v_scale);
+        const vfloat v_index0 = vmaxf(
+            vminf(trunc(v_scaled), F2V(table_info.pc.max_val_index0)), zerov);
+        const vfloat v_fract1 = v_scaled - v_index0;
+        const vfloat v_fract0 = onev - v_fract1;
+
+        const vfloat val_step = F2V(table_info.pc.val_step);
+        const vfloat e00_index =
+            v_index0 * val_step + h_index0 * hue_step + s_index0;
+        const vfloat e01_index = e00_index + (h_index1 - h_index0) * hue_step;
+        const vfloat e10_index = e00_index + val_step;
+        const vfloat e11_index = e01_index + val_step;
+
+        // interpolation along the hue and value axes, at offset along the
+        // saturation axis
+        const auto hv_lerp = [&](vfloat offset) -> Entry {
+            const Entry e0 = hue_lerp(h_fract0, e00_index + offset, h_fract1,
+                                      e01_index + offset);
+            const Entry e1 = hue_lerp(h_fract0, e10_index + offset, h_fract1,
+                                      e11_index + offset);
+            return {
+                hue_interpolate(v_fract0, e0.hue_shift, v_fract1, e1.hue_shift),
+                v_fract0 * e0.sat_scale + v_fract1 * e1.sat_scale,
+                v_fract0 * e0.val_scale + v_fract1 * e1.val_scale};
+        };
+
+        const Entry e0 = hv_lerp(zerov);
+        const Entry e1 = hv_lerp(onev);
+
+        hue_shift =
+            hue_interpolate(s_fract0, e0.hue_shift, s_fract1, e1.hue_shift);
+        sat_scale = s_fract0 * e0.sat_scale + s_fract1 * e1.sat_scale;
+        val_scale = s_fract0 * e0.val_scale + s_fract1 * e1.val_scale;
+    }
+
+    hue_shift *= F2V(6.0f / 360.0f); // Convert to internal hue range.
+
+    h += hue_shift;
+    s *= sat_scale; // No clipping here, we are RT float :-)
+
+    if (table_info.srgb_gamma) {
+        v = Color::igammatab_srgb1[v_encoded * val_scale * F2V(65535.f)];
+    } else {
+        v *= val_scale;
+    }
+}
+#endif // __SSE2__
+
 bool DCPProfile::isValid() { return valid; }
 
 DCPStore *DCPStore::getInstance()
 {
     static DCPStore instance;
+    lazyInit().wait();
     return &instance;
 }
 
+LazyInit &DCPStore::lazyInit()
+{
+    static LazyInit li;
+    return li;
+}
+
 DCPStore::~DCPStore()
 {
     for (auto &p : profile_cache) {
@@ -31,6 +31,7 @@
 #include "colortemp.h"
 #include "curves.h"
 #include "imagefloat.h"
+#include "lazyinit.h"
 #include "noncopyable.h"
 
 namespace rtengine {
@@ -120,11 +121,17 @@ private:
     Matrix makeXyzCam(const ColorTemp &white_balance, const Triple &pre_mul,
                       const Matrix &cam_wb_matrix, int preferred_illuminant,
                       bool use_fwd_matrix) const;
-    std::vector<HsbModify> makeHueSatMap(const ColorTemp &white_balance,
-                                         int preferred_illuminant) const;
+    std::shared_ptr<const std::vector<HsbModify>>
+    makeHueSatMap(const ColorTemp &white_balance,
+                  int preferred_illuminant) const;
     void hsdApply(const HsdTableInfo &table_info,
                   const std::vector<HsbModify> &table_base, float &h, float &s,
                   float &v) const;
+#ifdef __SSE2__
+    void hsdApply(const HsdTableInfo &table_info,
+                  const std::vector<HsbModify> &table_base, vfloat &h,
+                  vfloat &s, vfloat &v) const;
+#endif
 
     Matrix color_matrix_1;
     Matrix color_matrix_2;
@@ -149,6 +156,12 @@ private:
     short light_source_1;
     short light_source_2;
 
+    // the last HueSatMap interpolated by makeHueSatMap(), and the weight of
+    // deltas_1 used for it
+    mutable MyMutex hue_sat_map_mutex_;
+    mutable float hue_sat_map_mix_;
+    mutable std::shared_ptr<const std::vector<HsbModify>> hue_sat_map_;
+
     AdobeToneCurve tone_curve;
 };
 
@@ -156,6 +169,8 @@ class DCPStore final: public NonCopyable {
 public:
     ~DCPStore();
     static DCPStore *getInstance();
+    /// deferred loading of the profiles, see rtengine::init
+    static LazyInit &lazyInit();
 
     void init(const Glib::ustring &rt_profile_dir, bool loadAll = true);
 
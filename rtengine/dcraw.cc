@@ -27,10 +27,12 @@
 /*RT*/#endif
 
 #include "opthelper.h"
+#include <atomic>
 #include <utility>
 #include <vector>
 //#define BENCHMARK
 #include "StopWatch.h"
+#include "bitreader.h"
 #include "halffloat.h"
 
 using rtengine::DNG_FP24ToFloat;
@@ -1193,12 +1195,88 @@ void CLASS lossless_dnglj92_load_raw()
     }
 }
 
+// Decodes the tiles in parallel with lj92, which keeps all its state in the
+// decoder. Returns false, leaving the file position unchanged, for the files
+// it can't handle (lossy DCT tiles, restart markers, DNG older than 1.1),
+// which are then decoded serially by lossless_dng_load_raw()
+bool CLASS lossless_dng_load_raw_tiled()
+{
+  if (tile_length >= INT_MAX || !ifp->data || dng_version < 0x1010000)
+    return false;
+
+  const size_t tiles_wide = (raw_width + tile_width - 1) / tile_width;
+  const size_t tiles_high = (raw_height + tile_length - 1) / tile_length;
+  const size_t count = tiles_wide * tiles_high;
+  const int save = ftell(ifp);
+  std::vector<size_t> offset(count);
+  for (size_t t = 0; t < count; ++t) {
+    offset[t] = get4();
+    if (offset[t] >= size_t(ifp->size)) {
+      fseek(ifp, save, SEEK_SET);
+      return false;
+    }
+  }
+
+  std::atomic<bool> failed(false);
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t t = 0; t < count; ++t) {
+    if (failed) {
+      continue;
+    }
+    lj92 lj;
+    int jwidth, jheight, jbps;
+    if (lj92_open(&lj, reinterpret_cast<uint8_t *>(ifp->data) + offset[t],
+                  ifp->size - offset[t], &jwidth, &jheight, &jbps)) {
+      failed = true;
+      continue;
+    }
+    const int clrs = lj92_components(lj);
+    const size_t samples = size_t(jwidth) * clrs;
+    std::vector<ushort> buf(samples * jheight);
+    const int err = lj92_decode(lj, buf.data(), samples, 0, nullptr, 0);
+    lj92_close(lj);
+    if (err) {
+      failed = true;
+      continue;
+    }
+
+    // same layout as in lossless_dng_load_raw()
+    unsigned jwide = jwidth;
+    if (filters || (colors == 1 && clrs > 1)) jwide *= clrs;
+    jwide /= MIN (is_raw, tiff_samples);
+    const unsigned trow = (t / tiles_wide) * tile_length;
+    const unsigned tcol = (t % tiles_wide) * tile_width;
+    unsigned row = 0, col = 0;
+    for (int jrow = 0; jrow < jheight; ++jrow) {
+      ushort *rp = &buf[jrow * samples];
+      for (unsigned jcol = 0; jcol < jwide; ++jcol) {
+        adobe_copy_pixel (trow+row, tcol+col, &rp);
+        if (++col >= tile_width || col >= raw_width)
+          row += 1 + (col = 0);
+      }
+    }
+  }
+
+  if (failed) {
+    fseek(ifp, save, SEEK_SET);
+    return false;
+  }
+  fseek(ifp, save + 4 * count, SEEK_SET);
+  return true;
+}
+
 void CLASS lossless_dng_load_raw()
 {
   unsigned save, trow=0, tcol=0, jwide, jrow, jcol, row, col, i, j;
   struct jhead jh;
   ushort *rp;
 
+  if (lossless_dng_load_raw_tiled()) {
+    return;
+  }
+
   while (trow < raw_height) {
     save = ftell(ifp);
     if (tile_length < INT_MAX)
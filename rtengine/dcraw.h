@@ -48,6 +48,7 @@ public:
           RT_blacklevel_from_constant(ThreeValBool::X),
           RT_matrix_from_constant(ThreeValBool::X), RT_baseline_exposure(0),
           RT_OpcodeList2_start(-1), RT_OpcodeList2_len(0),
+          RT_decode_min_size(0), RT_decode_reduced(false),
           getbithuff(this, ifp, zero_after_ff), nikbithuff(ifp)
     {
         shrink = 0;
@@ -166,6 +167,11 @@ protected:
     double RT_baseline_exposure;
     int RT_OpcodeList2_start;
     int RT_OpcodeList2_len;
+    // if > 0, decoders that support it (currently CR3) may skip the finest
+    // detail as long as the planes keep at least this size. The raw buffer
+    // keeps its full size, with the decoded samples replicated
+    int RT_decode_min_size;
+    bool RT_decode_reduced; // set by the decoder if the above was used
 
     struct PanasonicRW2Info {
         ushort bpp;
@@ -384,6 +390,7 @@ protected:
     void canon_sraw_load_raw();
     void adobe_copy_pixel(unsigned row, unsigned col, ushort **rp);
     void lossless_dng_load_raw();
+    bool lossless_dng_load_raw_tiled();
     void lossless_dnglj92_load_raw();
     void packed_dng_load_raw();
     void deflate_dng_load_raw();
@@ -22,6 +22,7 @@
 #include "mytime.h"
 #include "refreshmap.h"
 #include "rt_math.h"
+#include <algorithm>
 
 namespace {
 
@@ -45,7 +46,8 @@ Crop::Crop(ImProcCoordinator *parent, EditDataProvider *editDataProvider,
       cropw(-1), croph(-1), trafx(0), trafy(0), trafw(-1), trafh(-1),
       rqcropx(0), rqcropy(0), rqcropw(-1), rqcroph(-1), borderRequested(32),
       upperBorder(0), leftBorder(0), cropAllocated(false),
-      cropImageListener(nullptr), parent(parent), isDetailWindow(isDetailWindow)
+      cropImageListener(nullptr), parent(parent), isDetailWindow(isDetailWindow),
+      shared_result_(false), interrupted_todo_(0)
 {
     for (int i = 0; i < 3; ++i) {
         bufs_[i] = nullptr;
@@ -69,6 +71,12 @@ Crop::~Crop()
     }
 
     MyMutex::MyLock processingLock(parent->mProcessing);
+    auto &res = parent->crop_results_;
+    res.erase(std::remove_if(res.begin(), res.end(),
+                             [this](const ImProcCoordinator::CropResult &r) {
+                                 return r.owner == this;
+                             }),
+              res.end());
     freeAll();
 }
 
@@ -181,6 +189,25 @@ void Crop::update(int todo)
         todo = ALL;
     }
 
+    todo |= interrupted_todo_;
+    interrupted_todo_ = 0;
+
+    if (useSharedResult()) {
+        shared_result_ = true;
+        return;
+    } else if (shared_result_) {
+        // the buffers were not updated by the last call
+        shared_result_ = false;
+        todo = ALL;
+    }
+
+    // the input of STAGE_1 changes whenever something before it is redone
+    if (!settings->preview_step_checkpoints || (todo & (ALL & ~RGBCURVE))) {
+        step_checkpoints_.invalidate();
+    }
+    ImProcFunctions::StepCheckpoints *checkpoints =
+        settings->preview_step_checkpoints ? &step_checkpoints_ : nullptr;
+
     // Tells to the ImProcFunctions' tool what is the preview scale, which may
     // lead to some simplifications
     parent->ipf.setScale(skip);
@@ -269,6 +296,12 @@ void Crop::update(int todo)
         baseCrop = denoiseCrop;
     }
 
+    if (parent->ipf.cancelled()) {
+        interrupted_todo_ = todo;
+        step_checkpoints_.invalidate();
+        return;
+    }
+
     // has to be called after setCropSizes! Tools prior to this point can't
     // handle the Edit mechanism, but that shouldn't be a problem.
     createBuffer(cropw, croph);
@@ -429,7 +462,8 @@ void Crop::update(int todo)
         pipeline_stop_[1] =
             stop ||
             parent->ipf.process(ImProcFunctions::Pipeline::PREVIEW,
-                                ImProcFunctions::Stage::STAGE_1, bufs_[0]);
+                                ImProcFunctions::Stage::STAGE_1, bufs_[0],
+                                checkpoints);
 
         if (workingCrop != baseCrop) {
             delete workingCrop;
@@ -443,7 +477,8 @@ void Crop::update(int todo)
         pipeline_stop_[2] =
             stop ||
             parent->ipf.process(ImProcFunctions::Pipeline::PREVIEW,
-                                ImProcFunctions::Stage::STAGE_2, bufs_[1]);
+                                ImProcFunctions::Stage::STAGE_2, bufs_[1],
+                                checkpoints);
     }
     stop = stop || pipeline_stop_[2];
 
@@ -453,13 +488,27 @@ void Crop::update(int todo)
         pipeline_stop_[3] =
             stop ||
             parent->ipf.process(ImProcFunctions::Pipeline::PREVIEW,
-                                ImProcFunctions::Stage::STAGE_3, bufs_[2]);
+                                ImProcFunctions::Stage::STAGE_3, bufs_[2],
+                                checkpoints);
     }
     stop = stop || pipeline_stop_[3];
 
+    if (stop) {
+        // the stages skipped because of stop didn't see their new input
+        step_checkpoints_.invalidate();
+    }
+
     // all pipette buffer processing should be finished now
     PipetteBuffer::setReady();
 
+    if (parent->ipf.cancelled()) {
+        // superseded by a newer update, which redoes the same work: keep
+        // showing the previous image
+        interrupted_todo_ = todo;
+        step_checkpoints_.invalidate();
+        return;
+    }
+
     parent->ipf.rgb2monitor(bufs_[2], cropImg);
 
     if (cropImageListener) {
@@ -498,14 +547,86 @@ void Crop::update(int todo)
         cropImageListener->setDetailedCrop(final, finaltrue, params.icm,
                                            params.crop, rqcropx, rqcropy,
                                            rqcropw, rqcroph, skip);
-        delete final;
-        delete finaltrue;
         delete cropImgtrue;
+
+        // make the result available to the other crops
+        auto &res = parent->crop_results_;
+        res.erase(std::remove_if(res.begin(), res.end(),
+                                 [this](const ImProcCoordinator::CropResult &r) {
+                                     return r.owner == this;
+                                 }),
+                  res.end());
+        res.push_back(ImProcCoordinator::CropResult{
+            this, skip, parent->ipf.getPreviewProxy(),
+            LIM(rqcropx, 0, parent->fullw - 1),
+            LIM(rqcropy, 0, parent->fullh - 1), std::unique_ptr<Image8>(final),
+            std::unique_ptr<Image8>(finaltrue)});
     }
 }
 
+bool Crop::useSharedResult()
+{
+    if (!isDetailWindow || !cropImageListener) {
+        return false;
+    }
+
+    // the edit tools need the pipette buffer of this crop
+    if (const auto editProvider = PipetteBuffer::getDataProvider()) {
+        if (editProvider->getCurrSubscriber()) {
+            return false;
+        }
+    }
+
+    const int x1 = LIM(rqcropx, 0, parent->fullw - 1);
+    const int y1 = LIM(rqcropy, 0, parent->fullh - 1);
+    const int finalW = std::min(rqcropw, cropw - leftBorder);
+    const int finalH = std::min(rqcroph, croph - upperBorder);
+    const int proxy = parent->ipf.getPreviewProxy();
+
+    for (auto &r : parent->crop_results_) {
+        if (r.owner == this || r.skip != skip || r.proxy != proxy) {
+            continue;
+        }
+
+        const int dx = x1 - r.x;
+        const int dy = y1 - r.y;
+
+        if (dx < 0 || dy < 0 || dx % skip || dy % skip) {
+            continue;
+        }
+
+        const int ox = dx / skip;
+        const int oy = dy / skip;
+
+        if (ox + finalW > r.img->getWidth() ||
+            oy + finalH > r.img->getHeight()) {
+            continue;
+        }
+
+        Image8 final(finalW, finalH);
+        Image8 finaltrue(finalW, finalH);
+        const int rW = r.img->getWidth();
+
+        for (int i = 0; i < finalH; i++) {
+            memcpy(final.data + 3 * i * finalW,
+                   r.img->data + 3 * ((i + oy) * rW + ox), 3 * finalW);
+            memcpy(finaltrue.data + 3 * i * finalW,
+                   r.imgtrue->data + 3 * ((i + oy) * rW + ox), 3 * finalW);
+        }
+
+        ProcParams &params = parent->params;
+        cropImageListener->setDetailedCrop(&final, &finaltrue, params.icm,
+                                           params.crop, rqcropx, rqcropy,
+                                           rqcropw, rqcroph, skip);
+        return true;
+    }
+
+    return false;
+}
+
 void Crop::freeAll()
 {
+    step_checkpoints_.invalidate();
 
     if (cropAllocated) {
         if (origCrop) {
@@ -832,6 +953,17 @@ int Crop::get_skip()
     return skip;
 }
 
+int Crop::get_requested_skip()
+{
+    MyMutex::MyLock lock(cropMutex);
+    if (cropImageListener) {
+        int x, y, w, h, s;
+        cropImageListener->getWindow(x, y, w, h, s);
+        return s;
+    }
+    return skip;
+}
+
 int Crop::getLeftBorder()
 {
     MyMutex::MyLock lock(cropMutex);
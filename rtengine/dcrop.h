@@ -44,6 +44,7 @@ protected:
     Imagefloat *denoiseCrop;
     Imagefloat *bufs_[3];
     std::array<bool, 4> pipeline_stop_;
+    ImProcFunctions::StepCheckpoints step_checkpoints_;
     Image8
         *cropImg; // "one chunk" allocation ; displayed image in monitor color
                   // space, showing the output profile as well (soft-proofing
@@ -80,6 +81,15 @@ protected:
     EditUniqueID getCurrEditID();
     bool setCropSizes(int cropX, int cropY, int cropW, int cropH, int skip,
                       bool internal);
+    // sends the part of a result of another crop covering this one to the
+    // listener, if any (see ImProcCoordinator::crop_results_)
+    bool useSharedResult();
+    // true if the buffers hold the result of an older update, because the
+    // last one came from another crop
+    bool shared_result_;
+    // steps of an update abandoned halfway (see ImProcFunctions::
+    // shouldAbort()), whose buffers must be recomputed by the next one
+    int interrupted_todo_;
     void freeAll();
 
     friend class ImProcCoordinator;
@@ -108,6 +118,9 @@ public:
     void setListener(DetailedCropListener *il) override;
     void destroy() override {}
     int get_skip();
+    // skip of the window currently asked by the listener, which can differ
+    // from get_skip() until the next update
+    int get_requested_skip();
     int getLeftBorder();
     int getUpperBorder();
 };
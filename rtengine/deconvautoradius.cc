@@ -236,6 +236,19 @@ float calcRadiusXtrans(const float *const *rawData, int W, int H,
 } // namespace
 
 bool RawImageSource::getDeconvAutoRadius(float *out)
+{
+    if (out && deconvRadius >= 0.f) {
+        *out = deconvRadius;
+        return true;
+    }
+    const bool ret = computeDeconvAutoRadius(out);
+    if (out && ret) {
+        deconvRadius = *out;
+    }
+    return ret;
+}
+
+bool RawImageSource::computeDeconvAutoRadius(float *out)
 {
     const float clipVal = (ri->get_white(1) - ri->get_cblack(1)) * scale_mul[1];
     if (ri->getSensorType() == ST_BAYER) {
@@ -0,0 +1,152 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "deepzoom.h"
+#include "imagefloat.h"
+#include "rescale.h"
+#include "rtengine.h"
+#include "tiling.h"
+#include <algorithm>
+#include <atomic>
+#include <glib/gstdio.h>
+#include <glibmm.h>
+#include <memory>
+
+namespace rtengine {
+
+namespace {
+
+int num_levels(int width, int height)
+{
+    int n = 1;
+    for (int d = std::max(width, height); d > 1; d = (d + 1) / 2) {
+        ++n;
+    }
+    return n;
+}
+
+int save_tile(const Imagefloat *img, const TileGrid::Tile &t,
+              const std::string &fname, const std::string &format,
+              int quality)
+{
+    Imagefloat tile(t.x2 - t.x1, t.y2 - t.y1, img);
+    int plen = 0;
+    const char *pdata = nullptr;
+    img->getOutputProfileData(plen, pdata);
+    tile.setOutputProfile(pdata, plen);
+
+    for (int y = t.y1; y < t.y2; ++y) {
+        std::copy(img->r(y) + t.x1, img->r(y) + t.x2, tile.r(y - t.y1));
+        std::copy(img->g(y) + t.x1, img->g(y) + t.x2, tile.g(y - t.y1));
+        std::copy(img->b(y) + t.x1, img->b(y) + t.x2, tile.b(y - t.y1));
+    }
+    return format == "png" ? tile.saveAsPNG(fname, 8)
+                           : tile.saveAsJPEG(fname, quality);
+}
+
+} // namespace
+
+int saveDeepZoom(const Imagefloat *img, const Glib::ustring &fname,
+                 int tile_size, int overlap, const std::string &format,
+                 int quality, ProgressListener *pl)
+{
+    const int width = img->getWidth();
+    const int height = img->getHeight();
+    if (width <= 0 || height <= 0 || tile_size <= 0 ||
+        (format != "jpg" && format != "png")) {
+        return 1;
+    }
+    overlap = std::max(overlap, 0);
+
+    const Glib::ustring base = fname.substr(0, fname.find_last_of('.'));
+    const Glib::ustring dir = base + "_files";
+    const int levels = num_levels(width, height);
+
+    // the tiles of all the levels, for the progress
+    int total = 0;
+    for (int l = 0, w = width, h = height; l < levels; ++l) {
+        total += TileGrid(w, h, tile_size, 0).size();
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    std::atomic<int> done(0);
+    std::atomic<int> err(0);
+    std::unique_ptr<Imagefloat> scaled;
+    const Imagefloat *cur = img;
+
+    for (int level = levels - 1; level >= 0 && !err; --level) {
+        if (level < levels - 1) {
+            std::unique_ptr<Imagefloat> half(
+                new Imagefloat((cur->getWidth() + 1) / 2,
+                               (cur->getHeight() + 1) / 2, cur));
+            rescaleArea(cur, half.get(), 2, true);
+            scaled = std::move(half);
+            cur = scaled.get();
+        }
+
+        const std::string ldir =
+            Glib::build_filename(dir, std::to_string(level));
+        if (g_mkdir_with_parents(ldir.c_str(), 0777) != 0) {
+            return 1;
+        }
+
+        const TileGrid grid(cur->getWidth(), cur->getHeight(), tile_size,
+                            overlap);
+        grid.parallel_for(
+            [&](const TileGrid::Tile &t) -> void {
+                if (err) {
+                    return;
+                }
+                const int col = t.x / tile_size;
+                const int row = t.y / tile_size;
+                const std::string tname = Glib::build_filename(
+                    ldir, std::to_string(col) + "_" + std::to_string(row) +
+                              "." + format);
+                if (save_tile(cur, t, tname, format, quality) != 0) {
+                    err = 1;
+                }
+                ++done;
+            },
+            true);
+
+        if (pl) {
+            pl->setProgress(double(done) / total);
+        }
+    }
+
+    if (err) {
+        return 1;
+    }
+
+    const Glib::ustring dzi = Glib::ustring::compose(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\"\n"
+        "  Format=\"%1\" Overlap=\"%2\" TileSize=\"%3\">\n"
+        "  <Size Width=\"%4\" Height=\"%5\"/>\n"
+        "</Image>\n",
+        format, overlap, tile_size, width, height);
+    try {
+        Glib::file_set_contents(fname, dzi);
+    } catch (Glib::Exception &) {
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace rtengine
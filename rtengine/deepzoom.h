@@ -0,0 +1,41 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glibmm/ustring.h>
+#include <string>
+
+namespace rtengine {
+
+class Imagefloat;
+class ProgressListener;
+
+/**
+ * Writes img as a Deep Zoom image: the fname descriptor (.dzi), and the
+ * pyramid of tiles in the "<fname without extension>_files" directory, with
+ * one subdirectory per level, from 0 (a single pixel) to the full size.
+ * Each level halves the next one by averaging 2x2 blocks, and its tiles are
+ * extended by overlap pixels on the sides shared with their neighbours.
+ * format is "jpg" (with the given quality) or "png". Returns 0 on success.
+ */
+int saveDeepZoom(const Imagefloat *img, const Glib::ustring &fname,
+                 int tile_size, int overlap, const std::string &format,
+                 int quality, ProgressListener *pl = nullptr);
+
+} // namespace rtengine
@@ -0,0 +1,277 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "defectmap.h"
+#include "../rtgui/options.h"
+#include "imagedata.h"
+#include "settings.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cstring>
+#include <glib/gstdio.h>
+#include <glibmm.h>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+// bump when the format of the files, or the detection of the hot and dead
+// pixels, changes
+constexpr uint32_t VERSION = 1;
+constexpr char MAGIC[4] = {'A', 'R', 'D', 'M'};
+
+void put_u32(std::string &out, uint32_t v)
+{
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+void put_str(std::string &out, const std::string &s)
+{
+    put_u32(out, s.size());
+    out.append(s);
+}
+
+bool get_u32(const std::string &in, size_t &pos, uint32_t &v)
+{
+    if (pos + sizeof(v) > in.size()) {
+        return false;
+    }
+    memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
+
+bool get_str(const std::string &in, size_t &pos, std::string &s)
+{
+    uint32_t n;
+    if (!get_u32(in, pos, n) || pos + n > in.size()) {
+        return false;
+    }
+    s.assign(in, pos, n);
+    pos += n;
+    return true;
+}
+
+// writes to a temporary file first, so that concurrent readers (possibly in
+// other processes) never see a partial file
+bool write_file(const Glib::ustring &fname, const std::string &data)
+{
+    std::string tmp = fname + ".XXXXXX";
+    const int fd = Glib::mkstemp(tmp);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    FILE *f = g_fopen(tmp.c_str(), "wb");
+    if (!f) {
+        g_remove(tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok && g_rename(tmp.c_str(), fname.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(fname.c_str());
+        ok = g_rename(tmp.c_str(), fname.c_str()) == 0;
+    }
+    if (!ok) {
+        g_remove(tmp.c_str());
+    }
+    return ok;
+}
+
+std::string checksum(const std::string &s)
+{
+    return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, s);
+}
+
+Glib::ustring dir()
+{
+    return Glib::build_filename(options.cacheBaseDir, "defects");
+}
+
+// a pixel is a defect if it was flagged in more than half of the images
+inline bool is_defect(uint32_t hits, uint32_t images)
+{
+    return 2 * hits > images;
+}
+
+} // namespace
+
+DefectMap *DefectMap::getInstance()
+{
+    static DefectMap instance;
+    return &instance;
+}
+
+std::string DefectMap::key(const FramesData *idata, int width, int height,
+                           int thresh, bool hot, bool dead)
+{
+    if (settings->defect_map_min_images <= 0 || !idata ||
+        idata->getSerialNumber().empty()) {
+        return "";
+    }
+    return idata->getMake() + '\0' + idata->getModel() + '\0' +
+           idata->getSerialNumber() + '\0' + std::to_string(width) + 'x' +
+           std::to_string(height) + ':' + std::to_string(thresh) +
+           (hot ? "h" : "") + (dead ? "d" : "");
+}
+
+DefectMap::Entry &DefectMap::load(const std::string &key)
+{
+    auto it = maps_.find(key);
+    if (it != maps_.end()) {
+        return it->second;
+    }
+
+    Entry &e = maps_[key];
+    e.images = 0;
+
+    std::string data;
+    try {
+        data = Glib::file_get_contents(
+            Glib::build_filename(dir(), checksum(key)));
+    } catch (Glib::Exception &) {
+        return e;
+    }
+
+    size_t pos = sizeof(MAGIC);
+    uint32_t version, images, nseen, n;
+    std::string k;
+    if (data.size() < pos || memcmp(data.data(), MAGIC, pos) != 0 ||
+        !get_u32(data, pos, version) || version != VERSION ||
+        !get_str(data, pos, k) || k != key || !get_u32(data, pos, images) ||
+        !get_u32(data, pos, nseen)) {
+        return e;
+    }
+    std::vector<std::string> seen(nseen);
+    for (auto &s : seen) {
+        if (!get_str(data, pos, s)) {
+            return e;
+        }
+    }
+    if (!get_u32(data, pos, n) ||
+        data.size() - pos != size_t(n) * 2 * sizeof(uint32_t)) {
+        return e;
+    }
+    e.hits.reserve(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t p, h;
+        get_u32(data, pos, p);
+        get_u32(data, pos, h);
+        e.hits[p] = h;
+    }
+    e.images = images;
+    e.seen = std::move(seen);
+    return e;
+}
+
+void DefectMap::save(const std::string &key, const Entry &e)
+{
+    std::string data(MAGIC, sizeof(MAGIC));
+    put_u32(data, VERSION);
+    put_str(data, key);
+    put_u32(data, e.images);
+    put_u32(data, e.seen.size());
+    for (auto &s : e.seen) {
+        put_str(data, s);
+    }
+    put_u32(data, e.hits.size());
+    for (auto &p : e.hits) {
+        put_u32(data, p.first);
+        put_u32(data, p.second);
+    }
+
+    const auto d = dir();
+    g_mkdir_with_parents(d.c_str(), 0777);
+    if (!write_file(Glib::build_filename(d, checksum(key)), data) &&
+        settings->verbose) {
+        std::cout << "Defect map: error writing in " << d << std::endl;
+    }
+}
+
+bool DefectMap::get(const std::string &key, std::vector<badPix> &out)
+{
+    if (key.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const Entry &e = load(key);
+    if (e.images < uint32_t(settings->defect_map_min_images)) {
+        return false;
+    }
+    out.clear();
+    for (auto &p : e.hits) {
+        if (is_defect(p.second, e.images)) {
+            out.emplace_back(p.first & 0xffff, p.first >> 16);
+        }
+    }
+    return true;
+}
+
+void DefectMap::add(const std::string &key, const Glib::ustring &image,
+                    std::vector<badPix> &&pixels)
+{
+    if (key.empty()) {
+        return;
+    }
+
+    auto pix = std::make_shared<std::vector<badPix>>(std::move(pixels));
+    ThreadPool::add_task(ThreadPool::Priority::LOWEST, [this, key, image,
+                                                        pix]() -> void {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const uint32_t min_images = settings->defect_map_min_images;
+        Entry &e = load(key);
+        const auto id = checksum(image.raw());
+        if (e.images >= min_images ||
+            std::find(e.seen.begin(), e.seen.end(), id) != e.seen.end()) {
+            return;
+        }
+        e.seen.push_back(id);
+        ++e.images;
+        for (auto &p : *pix) {
+            ++e.hits[uint32_t(p.y) << 16 | p.x];
+        }
+
+        // drop the pixels that can't become defects anymore
+        const uint32_t left = min_images - e.images;
+        for (auto it = e.hits.begin(); it != e.hits.end();) {
+            if (!is_defect(it->second + left, min_images)) {
+                it = e.hits.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (e.images >= min_images) {
+            e.seen.clear();
+        }
+
+        save(key, e);
+    });
+}
+
+} // namespace rtengine
@@ -0,0 +1,76 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include "pixelsmap.h"
+#include <cstdint>
+#include <glibmm/ustring.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rtengine {
+
+class FramesData;
+
+/**
+ * Hot and dead pixels learned for every camera body (identified by its
+ * serial number), kept in <cacheBaseDir>/defects.
+ *
+ * The pixels flagged by the hot/dead pixel filter are accumulated over the
+ * images of the body. Once settings->defect_map_min_images different images
+ * have been seen, the pixels flagged in the majority of them are considered
+ * defects of the sensor, and are used instead of scanning the raw data.
+ * Pixels flagged only because of the content of a few images never reach
+ * the majority, and are dropped as soon as they can't anymore.
+ */
+class DefectMap: public NonCopyable {
+public:
+    static DefectMap *getInstance();
+
+    /** identifies the sensor and the parameters of the filter; empty if the
+        maps are disabled or the body has no serial number */
+    static std::string key(const FramesData *idata, int width, int height,
+                           int thresh, bool hot, bool dead);
+
+    /// the defective pixels, false if not enough images have been seen yet
+    bool get(const std::string &key, std::vector<badPix> &out);
+    /// adds the pixels flagged in the given image (in the background)
+    void add(const std::string &key, const Glib::ustring &image,
+             std::vector<badPix> &&pixels);
+
+private:
+    struct Entry {
+        uint32_t images;
+        std::vector<std::string> seen; // checksums of the images added
+        std::unordered_map<uint32_t, uint32_t> hits; // (y << 16 | x) -> count
+    };
+
+    DefectMap() = default;
+
+    Entry &load(const std::string &key);
+    void save(const std::string &key, const Entry &e);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> maps_;
+};
+
+} // namespace rtengine
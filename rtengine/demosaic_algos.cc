@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -1861,6 +1862,62 @@ void RawImageSource::nodemosaic(bool bw)
     }
 }
 
+// averages each colour over factor x factor blocks of the CFA (2x2 for
+// Bayer and 3x3 for X-Trans contain all the colours), and fills the block
+// with the result. Much cheaper than any interpolation, and equivalent to it
+// when the output is shown at a scale of 1:factor or smaller
+void RawImageSource::superpixel_demosaic(int factor)
+{
+    red(W, H);
+    green(W, H);
+    blue(W, H);
+
+    const bool xtrans = ri->getSensorType() == ST_FUJI_XTRANS;
+    const auto color = [&](int i, int j) -> int {
+        const int c = xtrans ? ri->XTRANSFC(i, j) : FC(i, j);
+        return c == 3 ? 1 : c;
+    };
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int y = 0; y < H; y += factor) {
+        for (int x = 0; x < W; x += factor) {
+            float sum[3];
+            int n[3];
+            // blocks cut by the image borders might miss a colour: extend
+            // them until they have all
+            for (int e = 0; e <= factor; ++e) {
+                sum[0] = sum[1] = sum[2] = 0.f;
+                n[0] = n[1] = n[2] = 0;
+                const int y2 = std::min(y + factor + e, H);
+                const int x2 = std::min(x + factor + e, W);
+                for (int i = std::max(y - e, 0); i < y2; ++i) {
+                    for (int j = std::max(x - e, 0); j < x2; ++j) {
+                        const int c = color(i, j);
+                        sum[c] += rawData[i][j];
+                        ++n[c];
+                    }
+                }
+                if (n[0] && n[1] && n[2]) {
+                    break;
+                }
+            }
+            const float r = n[0] ? sum[0] / n[0] : 0.f;
+            const float g = n[1] ? sum[1] / n[1] : 0.f;
+            const float b = n[2] ? sum[2] / n[2] : 0.f;
+            for (int i = y, iend = std::min(y + factor, H); i < iend; ++i) {
+                for (int j = x, jend = std::min(x + factor, W); j < jend;
+                     ++j) {
+                    red[i][j] = r;
+                    green[i][j] = g;
+                    blue[i][j] = b;
+                }
+            }
+        }
+    }
+}
+
 /*
  *      Redistribution and use in source and binary forms, with or without
  *      modification, are permitted provided that the following conditions are
@@ -0,0 +1,48 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// AVX-512 build of the AMaZE and RCD demosaic kernels, selected at runtime by
+// RawImageSource::amaze_demosaic_RT() and RawImageSource::rcd_demosaic()
+
+#ifdef ART_SIMD_DISPATCH_AVX512
+
+// all the headers must be included before switching the target, so that the
+// inline functions they define are still compiled for the baseline
+// instruction set (the linker is free to pick any of the copies)
+#include "../rtgui/multilangmgr.h"
+#include "StopWatch.h"
+#include "cpuinfo.h"
+#include "median.h"
+#include "opthelper.h"
+#include "rawimagesource.h"
+#include "rt_math.h"
+#include "rtengine.h"
+#include "sleef.h"
+#include <cmath>
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma")
+
+#define ART_SIMD_VARIANT(name) name##_avx512
+#include "amaze_demosaic_RT.cc"
+#include "rcd_demosaic.cc"
+
+#pragma GCC pop_options
+
+#endif // ART_SIMD_DISPATCH_AVX512
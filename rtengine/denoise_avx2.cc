@@ -0,0 +1,41 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// AVX2 build of the denoise kernels, selected at runtime by
+// denoise::get_kernels()
+
+#ifdef ART_SIMD_DISPATCH_AVX2
+
+// all the headers must be included before switching the target, so that the
+// inline functions they define are still compiled for the baseline
+// instruction set (the linker is free to pick any of the copies)
+#include "cpuinfo.h"
+#include "denoise_kernels.h"
+#include "opthelper.h"
+#include "rt_math.h"
+#include "sleef.h"
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+#define ART_SIMD_VARIANT(name) name##_avx2
+#include "denoise_kernels.cc"
+
+#pragma GCC pop_options
+
+#endif // ART_SIMD_DISPATCH_AVX2
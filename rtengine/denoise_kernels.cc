@@ -0,0 +1,207 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "denoise_kernels.h"
+#include "cpuinfo.h"
+#include "opthelper.h"
+#include "rt_math.h"
+#include "sleef.h"
+
+// this file is also compiled for the instruction sets in
+// PROC_DISPATCH_TARGETS (see denoise_avx2.cc), which define ART_SIMD_VARIANT
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_VARIANT(name) name##_base
+#define ART_SIMD_BASE_BUILD
+#endif
+
+namespace rtengine {
+
+namespace denoise {
+
+namespace {
+
+constexpr float eps = 0.01f;
+
+void shrink_L(const float *c, const float *noisevar, float levelFactor,
+              float *sf, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat levelFactorv = F2V(levelFactor);
+    const vfloat ninev = F2V(9.f);
+    const vfloat epsv = F2V(eps);
+
+    for (; i < n - 3; i += 4) {
+        const vfloat mad_Lv = LVFU(noisevar[i]) * levelFactorv;
+        const vfloat magv = SQRV(LVFU(c[i]));
+        STVFU(sf[i],
+              magv / (magv + mad_Lv * xexpf(-magv / (ninev * mad_Lv)) + epsv));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        const float mag = SQR(c[i]);
+        sf[i] = mag / (mag +
+                       levelFactor * noisevar[i] *
+                           xexpf(-mag / (9.f * levelFactor * noisevar[i])) +
+                       eps);
+    }
+}
+
+void shrink_AB(const float *c_L, const float *c_ab, const float *noisevar,
+               float mad_ab, float mad_L, float *sf, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat onev = F2V(1.f);
+    const vfloat mad_abrv = F2V(mad_ab);
+    const vfloat rmadLm9v = onev / F2V(mad_L * 9.f);
+
+    for (; i < n - 3; i += 4) {
+        const vfloat mad_abv = LVFU(noisevar[i]) * mad_abrv;
+        const vfloat mag_abv = SQRV(LVFU(c_ab[i]));
+        const vfloat mag_Lv = SQRV(LVFU(c_L[i])) * rmadLm9v;
+        STVFU(sf[i], onev - xexpf(-(mag_abv / mad_abv) - mag_Lv));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        const float mag_L = SQR(c_L[i]);
+        const float mag_ab = SQR(c_ab[i]);
+        sf[i] = 1.f - xexpf(-(mag_ab / (noisevar[i] * mad_ab)) -
+                            (mag_L / (9.f * mad_L)));
+    }
+}
+
+void shrink_AB_inplace(const float *c_L, float *c_ab, const float *noisevar,
+                       float mad_ab, float mad_L, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat onev = F2V(1.f);
+    const vfloat mad_abrv = F2V(mad_ab);
+    const vfloat rmadLm9v = onev / F2V(mad_L * 9.f);
+
+    for (; i < n - 3; i += 4) {
+        const vfloat mad_abv = LVFU(noisevar[i]) * mad_abrv;
+        const vfloat abv = LVFU(c_ab[i]);
+        const vfloat mag_abv = SQRV(abv);
+        const vfloat mag_Lv = SQRV(LVFU(c_L[i])) * rmadLm9v;
+        STVFU(c_ab[i],
+              abv * SQRV(onev - xexpf(-(mag_abv / mad_abv) - mag_Lv)));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        const float mag_L = SQR(c_L[i]);
+        const float mag_ab = SQR(c_ab[i]);
+        c_ab[i] *= SQR(1.f - xexpf(-(mag_ab / (noisevar[i] * mad_ab)) -
+                                   (mag_L / (9.f * mad_L))));
+    }
+}
+
+void apply_shrink(float *c, const float *sf, const float *sf_blur, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat epsv = F2V(eps);
+
+    for (; i < n - 3; i += 4) {
+        const vfloat sfv = LVFU(sf[i]);
+        const vfloat sfbv = LVFU(sf_blur[i]);
+        // use smoothed shrinkage unless local shrinkage is much less
+        STVFU(c[i],
+              LVFU(c[i]) * (SQRV(sfbv) + SQRV(sfv)) / (sfbv + sfv + epsv));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        c[i] *= (SQR(sf_blur[i]) + SQR(sf[i])) / (sf_blur[i] + sf[i] + eps);
+    }
+}
+
+void dct_shrink(float *blox, const float *nbrwt, const float *noisevar, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat onev = F2V(1.f);
+
+    for (; i < n - 3; i += 4) {
+        const vfloat tempv =
+            onev - xexpf(-SQRV(LVFU(nbrwt[i])) / LVFU(noisevar[i]));
+        STVFU(blox[i], LVFU(blox[i]) * tempv);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        blox[i] *= (1 - xexpf(-SQR(nbrwt[i]) / noisevar[i]));
+    }
+}
+
+void accumulate(float *dst, const float *mask, const float *src, float norm,
+                int n)
+{
+    // this loop gets auto vectorized by gcc
+    for (int i = 0; i < n; ++i) {
+        dst[i] += mask[i] * src[i] * norm;
+    }
+}
+
+} // namespace
+
+void ART_SIMD_VARIANT(fill_kernels)(Kernels &k)
+{
+    k.shrink_L = shrink_L;
+    k.shrink_AB = shrink_AB;
+    k.shrink_AB_inplace = shrink_AB_inplace;
+    k.apply_shrink = apply_shrink;
+    k.dct_shrink = dct_shrink;
+    k.accumulate = accumulate;
+}
+
+#ifdef ART_SIMD_BASE_BUILD
+
+const Kernels &get_kernels()
+{
+    static const Kernels kernels = []() -> Kernels {
+        Kernels k;
+        switch (get_simd_level()) {
+#ifdef ART_SIMD_DISPATCH_AVX512
+        case SIMDLevel::AVX512:
+            fill_kernels_avx512(k);
+            break;
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX2
+        case SIMDLevel::AVX2:
+            fill_kernels_avx2(k);
+            break;
+#endif
+        default:
+            fill_kernels_base(k);
+            break;
+        }
+        return k;
+    }();
+    return kernels;
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+} // namespace denoise
+
+} // namespace rtengine
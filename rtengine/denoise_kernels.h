@@ -0,0 +1,66 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+namespace rtengine {
+
+namespace denoise {
+
+// Per-coefficient kernels of the wavelet shrinkage and of the DCT detail
+// recovery used by RGB_denoise(). They are compiled also for the
+// instruction sets in PROC_DISPATCH_TARGETS (see ProcessorTargets.cmake), and
+// get_kernels() returns the best variant supported by the processor. All the
+// buffers have n elements.
+struct Kernels {
+    /// wavelet shrinkage factors of the luminance coefficients c
+    void (*shrink_L)(const float *c, const float *noisevar, float levelFactor,
+                     float *sf, int n);
+    /// wavelet shrinkage factors of the chrominance coefficients c_ab
+    void (*shrink_AB)(const float *c_L, const float *c_ab,
+                      const float *noisevar, float mad_ab, float mad_L,
+                      float *sf, int n);
+    /// like shrink_AB, but applies the squared factors to c_ab directly
+    void (*shrink_AB_inplace)(const float *c_L, float *c_ab,
+                              const float *noisevar, float mad_ab, float mad_L,
+                              int n);
+    /// multiplies c by the combination of the local (sf) and smoothed
+    /// (sf_blur) shrinkage factors
+    void (*apply_shrink)(float *c, const float *sf, const float *sf_blur,
+                         int n);
+    /// shrinkage of the DCT coefficients of a block
+    void (*dct_shrink)(float *blox, const float *nbrwt, const float *noisevar,
+                       int n);
+    /// dst += mask * src * norm
+    void (*accumulate)(float *dst, const float *mask, const float *src,
+                       float norm, int n);
+};
+
+const Kernels &get_kernels();
+
+void fill_kernels_base(Kernels &k);
+#ifdef ART_SIMD_DISPATCH_AVX2
+void fill_kernels_avx2(Kernels &k);
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX512
+void fill_kernels_avx512(Kernels &k);
+#endif
+
+} // namespace denoise
+
+} // namespace rtengine
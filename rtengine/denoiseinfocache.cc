@@ -0,0 +1,252 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "denoiseinfocache.h"
+#include "../rtgui/options.h"
+#include "colortemp.h"
+#include "imagesource.h"
+#include "settings.h"
+#include "utils.h"
+#include <glib/gstdio.h>
+#include <iostream>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+constexpr size_t MAX_ENTRIES = 1000;
+// bump when the estimation algorithm changes, to discard the old entries
+constexpr int VERSION = 1;
+
+template <class T>
+bool get_list(const Glib::KeyFile &kf, const Glib::ustring &group,
+              const char *name, T *out, size_t n)
+{
+    const auto v = kf.get_double_list(group, name);
+    if (v.size() != n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = v[i];
+    }
+    return true;
+}
+
+template <class T>
+void set_list(Glib::KeyFile &kf, const Glib::ustring &group, const char *name,
+              const T *in, size_t n)
+{
+    kf.set_double_list(group, name, std::vector<double>(in, in + n));
+}
+
+} // namespace
+
+DenoiseInfoCache *DenoiseInfoCache::getInstance()
+{
+    static DenoiseInfoCache instance;
+    return &instance;
+}
+
+void DenoiseInfoCache::init()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    fname_ = Glib::build_filename(options.cacheBaseDir, "denoise_info");
+    if (!Glib::file_test(fname_, Glib::FILE_TEST_EXISTS)) {
+        return;
+    }
+
+    try {
+        Glib::KeyFile kf;
+        kf.load_from_file(fname_);
+        if (!kf.has_group("General") ||
+            kf.get_integer("General", "Version") != VERSION) {
+            return;
+        }
+        // the groups are stored from the most recently used
+        for (auto &group : kf.get_groups()) {
+            if (group == "General" || entries_.size() >= MAX_ENTRIES) {
+                continue;
+            }
+            Entry e;
+            e.key = group;
+            e.chM = kf.get_double(group, "chM");
+            e.chrominance = kf.get_double(group, "Chrominance");
+            e.chrominanceRedGreen = kf.get_double(group, "ChrominanceRedGreen");
+            e.chrominanceBlueYellow =
+                kf.get_double(group, "ChrominanceBlueYellow");
+            if (get_list(kf, group, "MaxR", e.max_r, 9) &&
+                get_list(kf, group, "MaxB", e.max_b, 9) &&
+                get_list(kf, group, "ChM", e.ch_M, 9)) {
+                entries_.push_back(e);
+            }
+        }
+    } catch (Glib::Exception &exc) {
+        entries_.clear();
+        if (settings->verbose) {
+            std::cout << "DenoiseInfoCache: error reading " << fname_ << ": "
+                      << exc.what() << std::endl;
+        }
+    }
+}
+
+void DenoiseInfoCache::cleanup()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!dirty_ || fname_.empty()) {
+        return;
+    }
+
+    Glib::KeyFile kf;
+    kf.set_integer("General", "Version", VERSION);
+    for (auto &e : entries_) {
+        const Glib::ustring group = e.key;
+        kf.set_double(group, "chM", e.chM);
+        kf.set_double(group, "Chrominance", e.chrominance);
+        kf.set_double(group, "ChrominanceRedGreen", e.chrominanceRedGreen);
+        kf.set_double(group, "ChrominanceBlueYellow", e.chrominanceBlueYellow);
+        set_list(kf, group, "MaxR", e.max_r, 9);
+        set_list(kf, group, "MaxB", e.max_b, 9);
+        set_list(kf, group, "ChM", e.ch_M, 9);
+    }
+
+    // write to a temporary file first, so that concurrent instances never
+    // read a partial file
+    const Glib::ustring tmp = fname_ + ".tmp";
+    bool ok = false;
+    try {
+        ok = kf.save_to_file(tmp);
+    } catch (Glib::Exception &) {
+    }
+    if (ok && g_rename(tmp.c_str(), fname_.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(fname_.c_str());
+        ok = g_rename(tmp.c_str(), fname_.c_str()) == 0;
+    }
+    if (!ok) {
+        g_remove(tmp.c_str());
+        if (settings->verbose) {
+            std::cout << "DenoiseInfoCache: error writing " << fname_
+                      << std::endl;
+        }
+    }
+    dirty_ = false;
+}
+
+std::string DenoiseInfoCache::get_key(ImageSource *imgsrc,
+                                      const ColorTemp &wb,
+                                      const procparams::ProcParams &params)
+{
+    const auto md5 = getMD5(imgsrc->getFileName(), true);
+    if (md5.empty()) {
+        return "";
+    }
+
+    // only the parameters used by denoiseComputeParams() for getting and
+    // analysing the image
+    procparams::ProcParams pp;
+    pp.exposure = params.exposure;
+    pp.raw = params.raw;
+    pp.icm = params.icm;
+    pp.coarse = params.coarse;
+    pp.filmNegative = params.filmNegative;
+    pp.denoise.colorSpace = params.denoise.colorSpace;
+    pp.denoise.aggressive = params.denoise.aggressive;
+    pp.denoise.gamma = params.denoise.gamma;
+
+    // the white balance as resolved by the pipeline (e.g. for auto WB)
+    const std::string data =
+        pp.to_data() + "\n" + std::to_string(imgsrc->isRAW()) + " " +
+        std::to_string(wb.getTemp()) + " " + std::to_string(wb.getGreen()) +
+        " " + std::to_string(wb.getEqual());
+    return md5 + "-" +
+           Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, data);
+}
+
+bool DenoiseInfoCache::get(const std::string &key, Info &info)
+{
+    if (key.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            const Entry &e = *it;
+            info.chM = e.chM;
+            for (int i = 0; i < 9; ++i) {
+                info.max_r[i] = e.max_r[i];
+                info.max_b[i] = e.max_b[i];
+                info.ch_M[i] = e.ch_M[i];
+            }
+            info.chrominance = e.chrominance;
+            info.chrominanceRedGreen = e.chrominanceRedGreen;
+            info.chrominanceBlueYellow = e.chrominanceBlueYellow;
+            info.valid = true;
+
+            if (it != entries_.begin()) {
+                entries_.splice(entries_.begin(), entries_, it);
+                dirty_ = true;
+            }
+            if (settings->verbose) {
+                std::cout << "DenoiseInfoCache: using " << key << std::endl;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void DenoiseInfoCache::put(const std::string &key, const Info &info)
+{
+    if (key.empty() || !info.valid) {
+        return;
+    }
+
+    Entry e;
+    e.key = key;
+    e.chM = info.chM;
+    for (int i = 0; i < 9; ++i) {
+        e.max_r[i] = info.max_r[i];
+        e.max_b[i] = info.max_b[i];
+        e.ch_M[i] = info.ch_M[i];
+    }
+    e.chrominance = info.chrominance;
+    e.chrominanceRedGreen = info.chrominanceRedGreen;
+    e.chrominanceBlueYellow = info.chrominanceBlueYellow;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            entries_.erase(it);
+            break;
+        }
+    }
+    entries_.push_front(e);
+    if (entries_.size() > MAX_ENTRIES) {
+        entries_.pop_back();
+    }
+    dirty_ = true;
+}
+
+} // namespace rtengine
@@ -0,0 +1,80 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "improcfun.h"
+#include "noncopyable.h"
+#include <glibmm.h>
+#include <list>
+#include <mutex>
+#include <string>
+
+namespace rtengine {
+
+class ColorTemp;
+class ImageSource;
+
+/**
+ * Persistent cache of the automatic chrominance noise estimates computed by
+ * ImProcFunctions::denoiseComputeParams(), so that the editor, the batch
+ * queue and later sessions share the (expensive) analysis of an image
+ * instead of repeating it for every pipeline.
+ *
+ * Entries are keyed by the identity of the image file (see getMD5()) and by
+ * the parameters that influence the estimate, and the most recently used ones
+ * are kept in <cacheBaseDir>/denoise_info across sessions.
+ */
+class DenoiseInfoCache: public NonCopyable {
+public:
+    typedef ImProcFunctions::DenoiseInfoStore Info;
+
+    static DenoiseInfoCache *getInstance();
+
+    void init();
+    void cleanup();
+
+    /// returns an empty string if the image can't be identified
+    static std::string get_key(ImageSource *imgsrc, const ColorTemp &wb,
+                               const procparams::ProcParams &params);
+
+    /// on success, sets the estimate fields of info and marks it as valid
+    bool get(const std::string &key, Info &info);
+    void put(const std::string &key, const Info &info);
+
+private:
+    DenoiseInfoCache(): dirty_(false) {}
+
+    struct Entry {
+        std::string key;
+        float chM;
+        float max_r[9];
+        float max_b[9];
+        float ch_M[9];
+        double chrominance;
+        double chrominanceRedGreen;
+        double chrominanceBlueYellow;
+    };
+
+    std::mutex mutex_;
+    std::list<Entry> entries_; // most recently used first
+    Glib::ustring fname_;
+    bool dirty_;
+};
+
+} // namespace rtengine
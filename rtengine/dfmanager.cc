@@ -25,12 +25,50 @@
 #include <giomm.h>
 #include <glibmm/ustring.h>
 #include <iostream>
+#include <locale>
+#include <set>
 #include <sstream>
 
 namespace rtengine {
 
 extern const Settings *settings;
 
+namespace {
+
+// the metadata of a dark frame file, as stored in the CalibrationCache index
+struct FileInfo {
+    std::string make;
+    std::string model;
+    int iso;
+    double shutter;
+    time_t timestamp;
+
+    std::string format() const
+    {
+        std::ostringstream s;
+        s.imbue(std::locale::classic());
+        s.precision(17);
+        s << make << '\n' << model << '\n' << iso << ' ' << shutter << ' '
+          << int64_t(timestamp);
+        return s.str();
+    }
+
+    bool parse(const std::string &info)
+    {
+        std::istringstream s(info);
+        s.imbue(std::locale::classic());
+        int64_t t;
+        if (!std::getline(s, make) || !std::getline(s, model) ||
+            !(s >> iso >> shutter >> t)) {
+            return false;
+        }
+        timestamp = t;
+        return true;
+    }
+};
+
+} // namespace
+
 // *********************** class DFInfo **************************************
 
 inline DFInfo &DFInfo::operator=(const DFInfo &o)
@@ -106,6 +144,13 @@ double DFInfo::distance(const std::string &mak, const std::string &mod, int iso,
     return sqrt(dISO * dISO + dShutter * dShutter);
 }
 
+std::string DFInfo::templateKey() const
+{
+    return CalibrationCache::key(pathNames.empty()
+                                     ? std::list<Glib::ustring>{pathname}
+                                     : pathNames);
+}
+
 RawImage *DFInfo::getRawImage()
 {
     if (ri) {
@@ -113,16 +158,25 @@ RawImage *DFInfo::getRawImage()
     }
 
     updateRawImage();
-    updateBadPixelList(ri);
+
+    if (!hotPixelsValid) {
+        updateBadPixelList(ri);
+    }
 
     return ri;
 }
 
 std::vector<badPix> &DFInfo::getHotPixels()
 {
-    if (!ri) {
-        updateRawImage();
-        updateBadPixelList(ri);
+    if (!hotPixelsValid) {
+        if (cache && cache->loadHotPixels(templateKey(), badPixels)) {
+            hotPixelsValid = true;
+        } else {
+            if (!ri) {
+                updateRawImage();
+            }
+            updateBadPixelList(ri);
+        }
     }
 
     return badPixels;
@@ -153,6 +207,13 @@ void DFInfo::updateRawImage()
                               ri->getSensorType() == ST_FUJI_XTRANS)
                                  ? 1
                                  : 3);
+
+            // the average of the same files computed in an earlier session
+            const std::string tkey = cache ? templateKey() : "";
+            if (cache && cache->loadTemplate(tkey, H, rSize, ri->data)) {
+                return;
+            }
+
             acc_t **acc = new acc_t *[H];
 
             for (int row = 0; row < H; row++) {
@@ -208,6 +269,10 @@ void DFInfo::updateRawImage()
             }
 
             delete[] acc;
+
+            if (cache) {
+                cache->saveTemplate(tkey, H, rSize, ri->data);
+            }
         }
     } else {
         ri = new RawImage(pathname);
@@ -291,11 +356,28 @@ void DFInfo::updateBadPixelList(RawImage *df)
                   << " pixels from darkframe:" << df->get_filename().c_str()
                   << std::endl;
     }
+
+    hotPixelsValid = true;
+    if (cache) {
+        cache->saveHotPixels(templateKey(), badPixels);
+    }
 }
 
 // ************************* class DFManager *********************************
 
-void DFManager::init(const Glib::ustring &pathname)
+DFManager::DFManager(): initialized(false), cache_("darkframes") {}
+
+void DFManager::init(const Glib::ustring &pathname, bool lazy)
+{
+    if (lazy) {
+        lazy_.set([this, pathname]() { scan(pathname); });
+    } else {
+        lazy_.discard();
+        scan(pathname);
+    }
+}
+
+void DFManager::scan(const Glib::ustring &pathname)
 {
     if (pathname.empty()) {
         return;
@@ -322,6 +404,7 @@ void DFManager::init(const Glib::ustring &pathname)
 
     dfList.clear();
     bpList.clear();
+    cache_.loadIndex();
 
     for (size_t i = 0; i < names.size(); i++) {
         size_t lastdot = names[i].find_last_of('.');
@@ -344,6 +427,7 @@ void DFManager::init(const Glib::ustring &pathname)
     }
 
     // Where multiple shots exist for same group, move filename to list
+    std::set<std::string> used_keys;
     for (dfList_t::iterator iter = dfList.begin(); iter != dfList.end();
          ++iter) {
         DFInfo &i = iter->second;
@@ -352,6 +436,8 @@ void DFManager::init(const Glib::ustring &pathname)
             i.pathNames.push_back(i.pathname);
             i.pathname.clear();
         }
+        i.cache = &cache_;
+        used_keys.insert(i.templateKey());
 
         if (settings->verbose) {
             if (!i.pathname.empty()) {
@@ -370,6 +456,8 @@ void DFManager::init(const Glib::ustring &pathname)
         }
     }
 
+    cache_.saveIndex(used_keys);
+
     currentPath = pathname;
     return;
 }
@@ -405,39 +493,60 @@ DFInfo *DFManager::addFileInfo(const Glib::ustring &filename, bool pool)
             return nullptr;
         }
 
-        RawImage ri(filename);
-        int res = ri.loadRaw(false); // Read information about shot
-
-        if (res != 0) {
-            return nullptr;
-        }
-
         dfList_t::iterator iter;
 
         if (!pool) {
+            RawImage ri(filename);
+            int res = ri.loadRaw(false); // Read information about shot
+
+            if (res != 0) {
+                return nullptr;
+            }
+
             DFInfo n(filename, "", "", 0, 0, 0);
             iter = dfList.emplace("", n);
             return &(iter->second);
         }
 
-        FramesData idata(filename);
+        // the metadata of the files seen by an earlier scan is in the index
+        FileInfo fi;
+        const std::string stamp = CalibrationCache::stamp(filename);
+        std::string info;
+
+        if (cache_.getInfo(filename, stamp, info)) {
+            if (!fi.parse(info)) {
+                return nullptr;
+            }
+        } else {
+            RawImage ri(filename);
+            int res = ri.loadRaw(false); // Read information about shot
+
+            if (res != 0) {
+                cache_.putInfo(filename, stamp, "");
+                return nullptr;
+            }
+
+            FramesData idata(filename);
+            fi.make = ((Glib::ustring)idata.getMake()).uppercase();
+            fi.model = ((Glib::ustring)idata.getModel()).uppercase();
+            fi.iso = idata.getISOSpeed();
+            fi.shutter = idata.getShutterSpeed();
+            fi.timestamp = idata.getDateTimeAsTS();
+            cache_.putInfo(filename, stamp, fi.format());
+        }
+
         /* Files are added in the map, divided by same maker/model,ISO and
          * shutter*/
-        std::string key(
-            DFInfo::key(((Glib::ustring)idata.getMake()).uppercase(),
-                        ((Glib::ustring)idata.getModel()).uppercase(),
-                        idata.getISOSpeed(), idata.getShutterSpeed()));
+        std::string key(DFInfo::key(fi.make, fi.model, fi.iso, fi.shutter));
         iter = dfList.find(key);
 
         if (iter == dfList.end()) {
-            DFInfo n(filename, ((Glib::ustring)idata.getMake()).uppercase(),
-                     ((Glib::ustring)idata.getModel()).uppercase(),
-                     idata.getISOSpeed(), idata.getShutterSpeed(),
-                     idata.getDateTimeAsTS());
+            DFInfo n(filename, fi.make, fi.model, fi.iso, fi.shutter,
+                     fi.timestamp);
             iter = dfList.emplace(key, n);
         } else {
             while (iter != dfList.end() && iter->second.key() == key &&
-                   ABS(iter->second.timestamp - idata.getDateTimeAsTS()) >
+                   ABS(iter->second.timestamp - fi.timestamp) >
                        60 * 60 * 6) { // 6 hour difference
                 ++iter;
             }
@@ -445,10 +554,8 @@ DFInfo *DFManager::addFileInfo(const Glib::ustring &filename, bool pool)
             if (iter != dfList.end()) {
                 iter->second.pathNames.push_back(filename);
             } else {
-                DFInfo n(filename, ((Glib::ustring)idata.getMake()).uppercase(),
-                         ((Glib::ustring)idata.getModel()).uppercase(),
-                         idata.getISOSpeed(), idata.getShutterSpeed(),
-                         idata.getDateTimeAsTS());
+                DFInfo n(filename, fi.make, fi.model, fi.iso, fi.shutter,
+                         fi.timestamp);
                 iter = dfList.emplace(key, n);
             }
         }
@@ -463,6 +570,8 @@ DFInfo *DFManager::addFileInfo(const Glib::ustring &filename, bool pool)
 
 void DFManager::getStat(int &totFiles, int &totTemplates)
 {
+    lazy_.wait();
+
     totFiles = 0;
     totTemplates = 0;
 
@@ -531,6 +640,8 @@ RawImage *DFManager::searchDarkFrame(const std::string &mak,
                                      const std::string &mod, int iso,
                                      double shut, time_t t)
 {
+    lazy_.wait();
+
     DFInfo *df = find(((Glib::ustring)mak).uppercase(),
                       ((Glib::ustring)mod).uppercase(), iso, shut, t);
 
@@ -543,6 +654,8 @@ RawImage *DFManager::searchDarkFrame(const std::string &mak,
 
 RawImage *DFManager::searchDarkFrame(const Glib::ustring filename)
 {
+    lazy_.wait();
+
     for (dfList_t::iterator iter = dfList.begin(); iter != dfList.end();
          ++iter) {
         if (iter->second.pathname.compare(filename) == 0) {
@@ -560,6 +673,8 @@ RawImage *DFManager::searchDarkFrame(const Glib::ustring filename)
 }
 std::vector<badPix> *DFManager::getHotPixels(const Glib::ustring filename)
 {
+    lazy_.wait();
+
     for (dfList_t::iterator iter = dfList.begin(); iter != dfList.end();
          ++iter) {
         if (iter->second.pathname.compare(filename) == 0) {
@@ -573,6 +688,8 @@ std::vector<badPix> *DFManager::getHotPixels(const std::string &mak,
                                              const std::string &mod, int iso,
                                              double shut, time_t t)
 {
+    lazy_.wait();
+
     DFInfo *df = find(((Glib::ustring)mak).uppercase(),
                       ((Glib::ustring)mod).uppercase(), iso, shut, t);
 
@@ -652,6 +769,8 @@ std::vector<badPix> *DFManager::getBadPixels(const std::string &mak,
                                              const std::string &mod,
                                              const std::string &serial)
 {
+    lazy_.wait();
+
     bpList_t::iterator iter;
     bool found = false;
 
@@ -17,6 +17,8 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include "calibcache.h"
+#include "lazyinit.h"
 #include "pixelsmap.h"
 #include "rawimage.h"
 #include <cmath>
@@ -36,17 +38,19 @@ public:
     int iso;           ///< ISO (gain)
     double shutter;    ///< shutter or exposure time in sec
     time_t timestamp;  ///< seconds since 1 Jan 1970
+    CalibrationCache *cache; ///< where the template and hot pixels are kept
 
     DFInfo(const Glib::ustring &name, const std::string &mak,
            const std::string &mod, int iso, double shut, time_t t)
         : pathname(name), maker(mak), model(mod), iso(iso), shutter(shut),
-          timestamp(t), ri(nullptr)
+          timestamp(t), cache(nullptr), ri(nullptr), hotPixelsValid(false)
     {
     }
 
     DFInfo(const DFInfo &o)
         : pathname(o.pathname), maker(o.maker), model(o.model), iso(o.iso),
-          shutter(o.shutter), timestamp(o.timestamp), ri(nullptr)
+          shutter(o.shutter), timestamp(o.timestamp), cache(o.cache),
+          ri(nullptr), hotPixelsValid(false)
     {
     }
     ~DFInfo()
@@ -67,6 +71,8 @@ public:
     static std::string key(const std::string &mak, const std::string &mod,
                            int iso, double shut);
     std::string key() { return key(maker, model, iso, shutter); }
+    /// identifies the source files, for the CalibrationCache
+    std::string templateKey() const;
 
     RawImage *getRawImage();
     std::vector<badPix> &getHotPixels();
@@ -74,6 +80,7 @@ public:
 protected:
     RawImage *ri;                  ///< Dark Frame raw data
     std::vector<badPix> badPixels; ///< Extracted hot pixels
+    bool hotPixelsValid;
 
     void updateBadPixelList(RawImage *df);
     void updateRawImage();
@@ -81,8 +88,15 @@ protected:
 
 class DFManager {
 public:
-    void init(const Glib::ustring &pathname);
-    Glib::ustring getPathname() { return currentPath; };
+    DFManager();
+
+    /// with lazy set, the directory is scanned on first use
+    void init(const Glib::ustring &pathname, bool lazy = false);
+    Glib::ustring getPathname()
+    {
+        lazy_.wait();
+        return currentPath;
+    };
     void getStat(int &totFiles, int &totTemplate);
     RawImage *searchDarkFrame(const std::string &mak, const std::string &mod,
                               int iso, double shut, time_t t);
@@ -102,6 +116,9 @@ protected:
     bpList_t bpList;
     bool initialized;
     Glib::ustring currentPath;
+    CalibrationCache cache_;
+    LazyInit lazy_;
+    void scan(const Glib::ustring &pathname);
     DFInfo *addFileInfo(const Glib::ustring &filename, bool pool = true);
     DFInfo *find(const std::string &mak, const std::string &mod, int isospeed,
                  double shut, time_t t);
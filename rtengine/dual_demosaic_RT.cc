@@ -136,7 +136,8 @@ void RawImageSource::dual_demosaic_RT(
             array2D<float> &redTmp = L; // L is not needed anymore => reuse it
             array2D<float> greenTmp(winw, winh);
             array2D<float> blueTmp(winw, winh);
-            vng4_demosaic(rawData, redTmp, greenTmp, blueTmp);
+            // only where the blend mask doesn't discard the result
+            vng4_demosaic(rawData, redTmp, greenTmp, blueTmp, blend);
 #ifdef _OPENMP
 #pragma omp parallel for schedule(dynamic, 16)
 #endif
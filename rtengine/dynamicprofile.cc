@@ -247,6 +247,7 @@ void set_customdata(Glib::KeyFile &kf, const Glib::ustring &group,
 bool DynamicProfileRules::loadRules(bool force_builtins)
 {
     dynamicRules.clear();
+    compile();
     Glib::KeyFile kf;
 
     Glib::ustring rules_file =
@@ -310,6 +311,7 @@ bool DynamicProfileRules::loadRules(bool force_builtins)
     }
 
     std::sort(dynamicRules.begin(), dynamicRules.end());
+    compile();
     rulesLoaded = true;
     return true;
 }
@@ -365,6 +367,120 @@ const std::vector<DynamicProfileRule> &DynamicProfileRules::getRules()
 void DynamicProfileRules::setRules(const std::vector<DynamicProfileRule> &r)
 {
     dynamicRules = r;
+    compile();
+}
+
+DynamicProfileRules::Matcher::Matcher(const DynamicProfileRule::Optional &o)
+    : enabled(o.enabled), is_regex(o.value.find("re:") == 0)
+{
+    if (!enabled) {
+        return;
+    }
+
+    if (is_regex) {
+        try {
+            regex = Glib::Regex::create(o.value.substr(3),
+                                        Glib::REGEX_CASELESS |
+                                            Glib::REGEX_OPTIMIZE);
+        } catch (Glib::RegexError &) {
+            // an invalid regexp never matches
+        }
+    } else {
+        value = o.value.casefold();
+    }
+}
+
+bool DynamicProfileRules::Matcher::operator()(const Glib::ustring &val) const
+{
+    if (!enabled) {
+        return true;
+    } else if (is_regex) {
+        return regex && regex->match(val);
+    } else {
+        return value == val.casefold();
+    }
+}
+
+DynamicProfileRules::CompiledRule::CompiledRule(const DynamicProfileRule &r)
+    : rule(&r), lens(r.lens), imagetype(r.imagetype), filetype(r.filetype),
+      software(r.software), camera(r.camera)
+{
+}
+
+bool DynamicProfileRules::CompiledRule::matches(
+    const rtengine::FramesMetaData *im) const
+{
+    // the cheap numeric checks first
+    const DynamicProfileRule &r = *rule;
+    return (r.iso(im->getISOSpeed()) && r.fnumber(im->getFNumber()) &&
+            r.focallen(im->getFocalLen()) &&
+            r.shutterspeed(im->getShutterSpeed()) &&
+            r.expcomp(im->getExpComp()) && camera(im->getCamera()) &&
+            lens(im->getLens()) &&
+            imagetype(im->isRAW() ? "raw" : "nonraw") &&
+            filetype(getFileExtension(im->getFileName())) &&
+            software(im->getSoftware()) && r.customdata(im));
+}
+
+void DynamicProfileRules::compile()
+{
+    compiled_.clear();
+    by_camera_.clear();
+    any_camera_.clear();
+
+    compiled_.reserve(dynamicRules.size());
+    for (size_t i = 0; i < dynamicRules.size(); ++i) {
+        compiled_.emplace_back(dynamicRules[i]);
+        auto &c = compiled_.back();
+        if (c.camera.enabled && !c.camera.is_regex) {
+            by_camera_[c.camera.value.raw()].push_back(i);
+            // already checked by the lookup
+            c.camera.enabled = false;
+        } else {
+            any_camera_.push_back(i);
+        }
+    }
+}
+
+std::vector<const DynamicProfileRule *>
+DynamicProfileRules::getMatchingRules(const rtengine::FramesMetaData *im) const
+{
+    std::vector<const DynamicProfileRule *> ret;
+
+    static const std::vector<size_t> none;
+    auto it = by_camera_.find(Glib::ustring(im->getCamera()).casefold().raw());
+    const auto &exact = it != by_camera_.end() ? it->second : none;
+
+    // both lists are sorted, merge them to keep the order of the rules
+    size_t i = 0, j = 0;
+    while (i < exact.size() || j < any_camera_.size()) {
+        size_t idx;
+        if (j == any_camera_.size() ||
+            (i < exact.size() && exact[i] < any_camera_[j])) {
+            idx = exact[i++];
+        } else {
+            idx = any_camera_[j++];
+        }
+        if (compiled_[idx].matches(im)) {
+            ret.push_back(compiled_[idx].rule);
+        }
+    }
+
+    return ret;
+}
+
+bool DynamicProfileRules::usesMakernotes()
+{
+    for (auto &rule : getRules()) {
+        if (rule.customdata.enabled) {
+            for (auto &p : rule.customdata.value) {
+                if (p.first.find("ExifTool.MakerNotes.") == 0) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
 }
 
 void DynamicProfileRules::init(const Glib::ustring &base_dir)
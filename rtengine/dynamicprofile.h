@@ -20,6 +20,7 @@
 
 #include "../rtgui/options.h"
 #include <glibmm.h>
+#include <unordered_map>
 #include <vector>
 
 class DynamicProfileRule {
@@ -77,14 +78,54 @@ protected:
     std::vector<DynamicProfileRule> dynamicRules;
     bool rulesLoaded;
 
+    /// the rules matching the image, in order
+    std::vector<const DynamicProfileRule *>
+    getMatchingRules(const rtengine::FramesMetaData *im) const;
+
 public:
     bool loadRules(bool force_builtins = false);
     bool storeRules();
     const std::vector<DynamicProfileRule> &getRules();
     void setRules(const std::vector<DynamicProfileRule> &r);
+    /// true if some rule matches on the exiftool makernotes
+    bool usesMakernotes();
 
     static void init(const Glib::ustring &base_dir);
 
 private:
+    /** Optional with the regular expression compiled and the string
+        casefolded in advance */
+    struct Matcher {
+        bool enabled;
+        bool is_regex;
+        Glib::RefPtr<Glib::Regex> regex;
+        Glib::ustring value;
+
+        explicit Matcher(const DynamicProfileRule::Optional &o);
+        bool operator()(const Glib::ustring &val) const;
+    };
+
+    struct CompiledRule {
+        const DynamicProfileRule *rule;
+        Matcher lens;
+        Matcher imagetype;
+        Matcher filetype;
+        Matcher software;
+        // camera is checked by the index when it is not a regexp
+        Matcher camera;
+
+        explicit CompiledRule(const DynamicProfileRule &r);
+        bool matches(const rtengine::FramesMetaData *im) const;
+    };
+
+    /** prepares the rules for matching: the rules with an exact camera
+        are indexed by the casefolded camera name, the others are always
+        evaluated */
+    void compile();
+
+    std::vector<CompiledRule> compiled_;
+    std::unordered_map<std::string, std::vector<size_t>> by_camera_;
+    std::vector<size_t> any_camera_;
+
     static Glib::ustring builtin_rules_file_;
 };
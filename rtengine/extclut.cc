@@ -121,15 +121,29 @@ std::string generate_params(const CLUTParamDescriptorList &params,
 }
 
 std::pair<std::string, std::string>
-get_cache_keys(const Glib::ustring &filename,
+get_cache_keys(const Glib::ustring &filename, const Glib::ustring &workdir,
+               const std::vector<Glib::ustring> &argv,
                const CLUTParamDescriptorList &params,
                const CLUTParamValueMap &values)
 {
     auto md5 = getMD5(filename, true);
     auto json = get_params_json(params, values);
+    // the arguments of the command that are files (typically the script
+    // generating the LUT) are part of the key too, so that editing them
+    // invalidates the cached LUTs
+    std::string cmd;
+    for (auto &a : argv) {
+        const auto pth = Glib::path_is_absolute(a)
+                             ? std::string(a)
+                             : Glib::build_filename(workdir, a);
+        cmd += "\n" + a;
+        if (Glib::file_test(pth, Glib::FILE_TEST_IS_REGULAR)) {
+            cmd += " " + getMD5(pth, true);
+        }
+    }
     auto csum = Glib::Checksum::compute_checksum(
-        Glib::Checksum::CHECKSUM_SHA256,
-        Glib::filename_from_utf8(filename) + "\n" + md5 + "\n" + json);
+        Glib::Checksum::CHECKSUM_SHA256, Glib::filename_from_utf8(filename) +
+                                             "\n" + md5 + "\n" + json + cmd);
     return std::make_pair(csum, csum + ".clfz");
 }
 
@@ -148,6 +162,8 @@ std::string find_in_cache(MyMutex &mtx, const std::string &key)
         {
             MyMutex::MyLock lck(mtx);
             if (decompress_to(name, templ)) {
+                // keep track of the use for trim_cache()
+                g_utime(name.c_str(), nullptr);
                 if (settings->verbose > 1) {
                     std::cout << "extlut cache hit: " << key << std::endl;
                 }
@@ -322,14 +338,14 @@ bool ExternalLUT3D::SubprocessManager::process(
 // ExternalLUT3D
 //-----------------------------------------------------------------------------
 
-std::unique_ptr<Cache<std::string, OCIO::ConstProcessorRcPtr>>
+std::unique_ptr<Cache<std::string, OCIO::ConstCPUProcessorRcPtr>>
     ExternalLUT3D::cache_;
 MyMutex ExternalLUT3D::disk_cache_mutex_;
 ExternalLUT3D::SubprocessManager ExternalLUT3D::smgr_;
 
 void ExternalLUT3D::init()
 {
-    cache_.reset(new Cache<std::string, OCIO::ConstProcessorRcPtr>(
+    cache_.reset(new Cache<std::string, OCIO::ConstCPUProcessorRcPtr>(
         options.clutCacheSize * 4));
 }
 
@@ -455,20 +471,22 @@ bool ExternalLUT3D::set_param_values(const CLUTParamValueMap &values)
         return false;
     }
     bool success = true;
-    OCIO::ConstProcessorRcPtr lut;
+    OCIO::ConstCPUProcessorRcPtr proc;
     std::pair<std::string, std::string> key =
-        get_cache_keys(filename_, params_, values);
-    bool found = cache_->get(key.first, lut);
+        get_cache_keys(filename_, workdir_, argv_, params_, values);
+    bool found = cache_->get(key.first, proc);
     if (!found) {
         if (settings->verbose) {
             std::cout << "computing 3dlut for " << filename_ << std::endl;
         }
         std::string pn = generate_params(params_, values);
         std::string fn = find_in_cache(disk_cache_mutex_, key.second);
+        bool stored = false;
         if (fn.empty()) {
             fn = recompute_lut(pn);
             if (!fn.empty()) {
                 store_in_cache(disk_cache_mutex_, key.second, fn);
+                stored = true;
             }
         }
 
@@ -477,8 +495,12 @@ bool ExternalLUT3D::set_param_values(const CLUTParamValueMap &values)
             OCIO::FileTransformRcPtr t = OCIO::FileTransform::Create();
             t->setSrc(fn.c_str());
             t->setInterpolation(OCIO::INTERP_BEST);
-            lut = config->getProcessor(t);
-            cache_->set(key.first, lut);
+            // the optimized CPU processor is cached (and shared by all the
+            // users of the same LUT), so that it is finalized only once
+            proc = config->getProcessor(t)->getOptimizedCPUProcessor(
+                OCIO::BIT_DEPTH_F32, OCIO::BIT_DEPTH_F32,
+                OCIO::OPTIMIZATION_DEFAULT);
+            cache_->set(key.first, proc);
         } catch (...) {
             ok_ = false;
             success = false;
@@ -490,16 +512,12 @@ bool ExternalLUT3D::set_param_values(const CLUTParamValueMap &values)
         if (!fn.empty()) {
             g_remove(fn.c_str());
         }
-    }
-    if (lut) {
-        try {
-            proc_ = lut->getOptimizedCPUProcessor(OCIO::BIT_DEPTH_F32,
-                                                  OCIO::BIT_DEPTH_F32,
-                                                  OCIO::OPTIMIZATION_DEFAULT);
-        } catch (...) {
-            ok_ = false;
-            success = false;
+        if (stored) {
+            trim_cache();
         }
+    }
+    if (proc) {
+        proc_ = proc;
     } else {
         ok_ = success = false;
     }
@@ -510,58 +528,59 @@ void ExternalLUT3D::trim_cache()
 {
     MyMutex::MyLock lck(disk_cache_mutex_);
 
-    size_t num_files = 0;
     const size_t max_num_files =
         std::min(size_t(options.clutCacheSize) * 100, options.maxCacheEntries);
+    const size_t max_size =
+        size_t(std::max(settings->extlut_disk_cache_size, 0)) * 1024 * 1024;
     const auto dir_name = Glib::build_filename(options.cacheBaseDir, "extlut");
     const auto dir = Gio::File::create_for_path(dir_name);
 
-    try {
-        auto enumerator = dir->enumerate_children("");
-
-        while (num_files <= max_num_files && enumerator->next_file()) {
-            ++num_files;
-        }
-    } catch (Glib::Exception &) {
-    }
-
-    if (num_files <= max_num_files) {
-        return;
-    }
-
-    using FNameMTime = std::pair<Glib::ustring, Glib::TimeVal>;
-    std::vector<FNameMTime> files;
+    struct FileInfo {
+        Glib::ustring name;
+        Glib::TimeVal mtime;
+        size_t size;
+    };
+    std::vector<FileInfo> files;
+    size_t total_size = 0;
 
     try {
-        auto enumerator =
-            dir->enumerate_children("standard::name,time::modified");
+        auto enumerator = dir->enumerate_children(
+            "standard::name,standard::size,time::modified");
         while (auto file = enumerator->next_file()) {
-            files.emplace_back(file->get_name(), file->modification_time());
+            files.push_back({file->get_name(), file->modification_time(),
+                             size_t(file->get_size())});
+            total_size += files.back().size;
         }
     } catch (Glib::Exception &) {
     }
 
-    if (files.size() <= max_num_files) {
+    const auto too_big = [&]() -> bool {
+        return files.size() > max_num_files ||
+               (max_size && total_size > max_size);
+    };
+
+    if (!too_big()) {
         return;
     }
 
     std::sort(files.begin(), files.end(),
-              [](const FNameMTime &lhs, const FNameMTime &rhs) {
-                  return lhs.second < rhs.second;
+              [](const FileInfo &lhs, const FileInfo &rhs) {
+                  return lhs.mtime > rhs.mtime;
               });
 
-    auto cache_entries = files.size();
     size_t num_removed = 0;
-    for (auto entry = files.begin(); cache_entries-- > max_num_files; ++entry) {
-        const auto &name = entry->first;
-        auto pth = Glib::build_filename(dir_name, name);
+    while (!files.empty() && too_big()) {
+        const auto &entry = files.back();
+        auto pth = Glib::build_filename(dir_name, entry.name);
         auto error = g_remove(pth.c_str());
         if (error && settings->verbose) {
-            std::cerr << "extlut - error removing cache file: " << name
+            std::cerr << "extlut - error removing cache file: " << entry.name
                       << std::endl;
         } else {
             ++num_removed;
         }
+        total_size -= entry.size;
+        files.pop_back();
     }
 
     if (settings->verbose > 1) {
@@ -61,7 +61,8 @@ private:
                            std::unique_ptr<subprocess::SubprocessInfo>>
             procs_;
     };
-    static std::unique_ptr<Cache<std::string, OCIO::ConstProcessorRcPtr>>
+    // optimized CPU processors, keyed by the LUT and the parameter values
+    static std::unique_ptr<Cache<std::string, OCIO::ConstCPUProcessorRcPtr>>
         cache_;
     static MyMutex disk_cache_mutex_;
     static SubprocessManager smgr_;
@@ -22,11 +22,54 @@
 #include "median.h"
 #include "rawimage.h"
 #include "utils.h"
+#include <locale>
+#include <set>
+#include <sstream>
 
 namespace rtengine {
 
 extern const Settings *settings;
 
+namespace {
+
+// the metadata of a flat field file, as stored in the CalibrationCache index
+struct FileInfo {
+    std::string make;
+    std::string model;
+    std::string lens;
+    double focal;
+    double aperture;
+    time_t timestamp;
+    time_t raw_timestamp;
+
+    std::string format() const
+    {
+        std::ostringstream s;
+        s.imbue(std::locale::classic());
+        s.precision(17);
+        s << make << '\n' << model << '\n' << lens << '\n' << focal << ' '
+          << aperture << ' ' << int64_t(timestamp) << ' '
+          << int64_t(raw_timestamp);
+        return s.str();
+    }
+
+    bool parse(const std::string &info)
+    {
+        std::istringstream s(info);
+        s.imbue(std::locale::classic());
+        int64_t t1, t2;
+        if (!std::getline(s, make) || !std::getline(s, model) ||
+            !std::getline(s, lens) || !(s >> focal >> aperture >> t1 >> t2)) {
+            return false;
+        }
+        timestamp = t1;
+        raw_timestamp = t2;
+        return true;
+    }
+};
+
+} // namespace
+
 // *********************** class ffInfo **************************************
 
 inline ffInfo &ffInfo::operator=(const ffInfo &o)
@@ -112,6 +155,13 @@ double ffInfo::distance(const std::string &mak, const std::string &mod,
     return sqrt(dfocallength * dfocallength + dAperture * dAperture);
 }
 
+std::string ffInfo::templateKey() const
+{
+    return CalibrationCache::key(pathNames.empty()
+                                     ? std::list<Glib::ustring>{pathname}
+                                     : pathNames);
+}
+
 RawImage *ffInfo::getRawImage()
 {
     if (ri) {
@@ -132,6 +182,22 @@ void ffInfo::updateRawImage()
 {
     typedef unsigned int acc_t;
 
+    const auto row_size = [](RawImage *r) {
+        return r->get_width() * ((r->getSensorType() == ST_BAYER ||
+                                  r->getSensorType() == ST_FUJI_XTRANS ||
+                                  r->get_colors() == 1)
+                                     ? 1
+                                     : 3);
+    };
+    // the (averaged and filtered) data of the same files computed in an
+    // earlier session
+    const std::string tkey = cache ? templateKey() : "";
+    const auto load_cached = [&]() {
+        return cache &&
+               cache->loadTemplate(tkey, ri->get_height(), row_size(ri),
+                                   ri->data);
+    };
+
     // averaging of flatfields if more than one is found matching the same key.
     // this may not be necessary, as flatfield is further blurred before being
     // applied to the processed image.
@@ -148,11 +214,12 @@ void ffInfo::updateRawImage()
             int W = ri->get_width();
             ri->compress_image(0);
             ri->set_prefilters();
-            int rSize = W * ((ri->getSensorType() == ST_BAYER ||
-                              ri->getSensorType() == ST_FUJI_XTRANS ||
-                              ri->get_colors() == 1)
-                                 ? 1
-                                 : 3);
+            int rSize = row_size(ri);
+
+            if (load_cached()) {
+                return;
+            }
+
             acc_t **acc = new acc_t *[H];
 
             for (int row = 0; row < H; row++) {
@@ -219,6 +286,10 @@ void ffInfo::updateRawImage()
         } else {
             ri->compress_image(0);
             ri->set_prefilters();
+
+            if (load_cached()) {
+                return;
+            }
         }
     }
 
@@ -250,12 +321,28 @@ void ffInfo::updateRawImage()
         memcpy(ri->data[0], cfatmp, W * H * sizeof(float));
 
         free(cfatmp);
+
+        if (cache) {
+            cache->saveTemplate(tkey, H, row_size(ri), ri->data);
+        }
     }
 }
 
 // ************************* class FFManager *********************************
 
-void FFManager::init(const Glib::ustring &pathname)
+FFManager::FFManager(): initialized(false), cache_("flatfields") {}
+
+void FFManager::init(const Glib::ustring &pathname, bool lazy)
+{
+    if (lazy) {
+        lazy_.set([this, pathname]() { scan(pathname); });
+    } else {
+        lazy_.discard();
+        scan(pathname);
+    }
+}
+
+void FFManager::scan(const Glib::ustring &pathname)
 {
     if (pathname.empty()) {
         return;
@@ -282,6 +369,7 @@ void FFManager::init(const Glib::ustring &pathname)
     }
 
     ffList.clear();
+    cache_.loadIndex();
 
     for (size_t i = 0; i < names.size(); i++) {
         try {
@@ -291,6 +379,7 @@ void FFManager::init(const Glib::ustring &pathname)
     }
 
     // Where multiple shots exist for same group, move filename to list
+    std::set<std::string> used_keys;
     for (ffList_t::iterator iter = ffList.begin(); iter != ffList.end();
          ++iter) {
         ffInfo &i = iter->second;
@@ -299,6 +388,8 @@ void FFManager::init(const Glib::ustring &pathname)
             i.pathNames.push_back(i.pathname);
             i.pathname.clear();
         }
+        i.cache = &cache_;
+        used_keys.insert(i.templateKey());
 
         if (settings->verbose) {
             if (!i.pathname.empty()) {
@@ -317,6 +408,8 @@ void FFManager::init(const Glib::ustring &pathname)
         }
     }
 
+    cache_.saveIndex(used_keys);
+
     currentPath = pathname;
     return;
 }
@@ -352,37 +445,63 @@ ffInfo *FFManager::addFileInfo(const Glib::ustring &filename, bool pool)
             return nullptr;
         }
 
-        RawImage ri(filename);
-        int res = ri.loadRaw(false); // Read information about shot
-
-        if (res != 0) {
-            return nullptr;
-        }
-
         ffList_t::iterator iter;
 
         if (!pool) {
+            RawImage ri(filename);
+            int res = ri.loadRaw(false); // Read information about shot
+
+            if (res != 0) {
+                return nullptr;
+            }
+
             ffInfo n(filename, "", "", "", 0, 0, 0);
             iter = ffList.emplace("", n);
             return &(iter->second);
         }
 
-        FramesData idata(filename);
+        // the metadata of the files seen by an earlier scan is in the index
+        FileInfo fi;
+        const std::string stamp = CalibrationCache::stamp(filename);
+        std::string info;
+
+        if (cache_.getInfo(filename, stamp, info)) {
+            if (!fi.parse(info)) {
+                return nullptr;
+            }
+        } else {
+            RawImage ri(filename);
+            int res = ri.loadRaw(false); // Read information about shot
+
+            if (res != 0) {
+                cache_.putInfo(filename, stamp, "");
+                return nullptr;
+            }
+
+            FramesData idata(filename);
+            fi.make = idata.getMake();
+            fi.model = idata.getModel();
+            fi.lens = idata.getLens();
+            fi.focal = idata.getFocalLen();
+            fi.aperture = idata.getFNumber();
+            fi.timestamp = idata.getDateTimeAsTS();
+            fi.raw_timestamp = ri.get_timestamp();
+            cache_.putInfo(filename, stamp, fi.format());
+        }
+
         /* Files are added in the map, divided by same maker/model,lens and
          * aperture*/
-        std::string key(ffInfo::key(idata.getMake(), idata.getModel(),
-                                    idata.getLens(), idata.getFocalLen(),
-                                    idata.getFNumber()));
+        std::string key(
+            ffInfo::key(fi.make, fi.model, fi.lens, fi.focal, fi.aperture));
         iter = ffList.find(key);
 
         if (iter == ffList.end()) {
-            ffInfo n(filename, idata.getMake(), idata.getModel(),
-                     idata.getLens(), idata.getFocalLen(), idata.getFNumber(),
-                     idata.getDateTimeAsTS());
+            ffInfo n(filename, fi.make, fi.model, fi.lens, fi.focal,
+                     fi.aperture, fi.timestamp);
             iter = ffList.emplace(key, n);
         } else {
             while (iter != ffList.end() && iter->second.key() == key &&
-                   ABS(iter->second.timestamp - ri.get_timestamp()) >
+                   ABS(iter->second.timestamp - fi.raw_timestamp) >
                        60 * 60 * 6) { // 6 hour difference
                 ++iter;
             }
@@ -390,9 +509,8 @@ ffInfo *FFManager::addFileInfo(const Glib::ustring &filename, bool pool)
             if (iter != ffList.end()) {
                 iter->second.pathNames.push_back(filename);
             } else {
-                ffInfo n(filename, idata.getMake(), idata.getModel(),
-                         idata.getLens(), idata.getFocalLen(),
-                         idata.getFNumber(), idata.getDateTimeAsTS());
+                ffInfo n(filename, fi.make, fi.model, fi.lens, fi.focal,
+                         fi.aperture, fi.timestamp);
                 iter = ffList.emplace(key, n);
             }
         }
@@ -407,6 +525,8 @@ ffInfo *FFManager::addFileInfo(const Glib::ustring &filename, bool pool)
 
 void FFManager::getStat(int &totFiles, int &totTemplates)
 {
+    lazy_.wait();
+
     totFiles = 0;
     totTemplates = 0;
 
@@ -477,6 +597,8 @@ RawImage *FFManager::searchFlatField(const std::string &mak,
                                      const std::string &len, double focal,
                                      double apert, time_t t)
 {
+    lazy_.wait();
+
     ffInfo *ff = find(mak, mod, len, focal, apert, t);
 
     if (ff) {
@@ -488,6 +610,8 @@ RawImage *FFManager::searchFlatField(const std::string &mak,
 
 RawImage *FFManager::searchFlatField(const Glib::ustring filename)
 {
+    lazy_.wait();
+
     for (ffList_t::iterator iter = ffList.begin(); iter != ffList.end();
          ++iter) {
         if (iter->second.pathname.compare(filename) == 0) {
@@ -17,6 +17,8 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include "calibcache.h"
+#include "lazyinit.h"
 #include "rawimage.h"
 #include <cmath>
 #include <glibmm/ustring.h>
@@ -36,19 +38,20 @@ public:
     double aperture;    ///< aperture in stops
     double focallength; ///< focal length in mm
     time_t timestamp;   ///< seconds since 1 Jan 1970
+    CalibrationCache *cache; ///< where the template is kept
 
     ffInfo(const Glib::ustring &name, const std::string &mak,
            const std::string &mod, const std::string &len, double focal,
            double apert, time_t t)
         : pathname(name), maker(mak), model(mod), lens(len), aperture(apert),
-          focallength(focal), timestamp(t), ri(nullptr)
+          focallength(focal), timestamp(t), cache(nullptr), ri(nullptr)
     {
     }
 
     ffInfo(const ffInfo &o)
         : pathname(o.pathname), maker(o.maker), model(o.model), lens(o.lens),
           aperture(o.aperture), focallength(o.focallength),
-          timestamp(o.timestamp), ri(nullptr)
+          timestamp(o.timestamp), cache(o.cache), ri(nullptr)
     {
     }
     ~ffInfo()
@@ -70,6 +73,8 @@ public:
     static std::string key(const std::string &mak, const std::string &mod,
                            const std::string &len, double focal, double apert);
     std::string key() { return key(maker, model, lens, focallength, aperture); }
+    /// identifies the source files, for the CalibrationCache
+    std::string templateKey() const;
 
     RawImage *getRawImage();
 
@@ -81,8 +86,15 @@ protected:
 
 class FFManager {
 public:
-    void init(const Glib::ustring &pathname);
-    Glib::ustring getPathname() { return currentPath; };
+    FFManager();
+
+    /// with lazy set, the directory is scanned on first use
+    void init(const Glib::ustring &pathname, bool lazy = false);
+    Glib::ustring getPathname()
+    {
+        lazy_.wait();
+        return currentPath;
+    };
     void getStat(int &totFiles, int &totTemplate);
     RawImage *searchFlatField(const std::string &mak, const std::string &mod,
                               const std::string &len, double focallength,
@@ -94,6 +106,9 @@ protected:
     ffList_t ffList;
     bool initialized;
     Glib::ustring currentPath;
+    CalibrationCache cache_;
+    LazyInit lazy_;
+    void scan(const Glib::ustring &pathname);
     ffInfo *addFileInfo(const Glib::ustring &filename, bool pool = true);
     ffInfo *find(const std::string &mak, const std::string &mod,
                  const std::string &len, double focal, double apert, time_t t);
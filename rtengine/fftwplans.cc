@@ -0,0 +1,245 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fftwplans.h"
+#include "../rtgui/options.h"
+#include "settings.h"
+#include <glib/gstdio.h>
+#include <iostream>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+// the sizes depend on the image dimensions for some of the tools, so keep
+// only the most recently used plans
+constexpr size_t MAX_PLANS = 32;
+
+} // namespace
+
+FFTWPlanCache *FFTWPlanCache::getInstance()
+{
+    static FFTWPlanCache instance;
+    return &instance;
+}
+
+void FFTWPlanCache::init()
+{
+#ifdef RT_FFTW3F_OMP
+    fftwf_init_threads();
+#endif
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    wisdom_file_ = Glib::build_filename(options.cacheBaseDir, "fftw_wisdom");
+    FILE *f = g_fopen(wisdom_file_.c_str(), "r");
+    if (f) {
+        // fails harmlessly if written by a different FFTW version
+        const bool ok = fftwf_import_wisdom_from_file(f);
+        fclose(f);
+        if (settings->verbose) {
+            std::cout << "FFTW wisdom " << (ok ? "loaded from " : "invalid: ")
+                      << wisdom_file_ << std::endl;
+        }
+    }
+}
+
+void FFTWPlanCache::cleanup()
+{
+    // destroyed after releasing the lock, see the deleter in get()
+    std::list<std::pair<Key, Plan>> plans;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    plans.swap(plans_);
+
+    if (wisdom_file_.empty()) {
+        return;
+    }
+
+    // write to a temporary file first, so that concurrent instances never
+    // read a partial file
+    const Glib::ustring tmp = wisdom_file_ + ".tmp";
+    FILE *f = g_fopen(tmp.c_str(), "w");
+    if (!f) {
+        return;
+    }
+    fftwf_export_wisdom_to_file(f);
+    bool ok = !ferror(f);
+    fclose(f);
+
+    if (ok && g_rename(tmp.c_str(), wisdom_file_.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(wisdom_file_.c_str());
+        ok = g_rename(tmp.c_str(), wisdom_file_.c_str()) == 0;
+    }
+    if (!ok) {
+        g_remove(tmp.c_str());
+        if (settings->verbose) {
+            std::cout << "FFTW wisdom: error writing " << wisdom_file_
+                      << std::endl;
+        }
+    }
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::dft_r2c_2d(int n0, int n1, float *in,
+                                              fftwf_complex *out,
+                                              unsigned flags, int nthreads)
+{
+    return get(Type::DFT_R2C, n0, n1, 1, 0, 0, flags, nthreads, in, out);
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::dft_c2r_2d(int n0, int n1,
+                                              fftwf_complex *in, float *out,
+                                              unsigned flags, int nthreads)
+{
+    return get(Type::DFT_C2R, n0, n1, 1, 0, 0, flags, nthreads, in, out);
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::r2r_2d(int n0, int n1, float *in,
+                                          float *out, fftwf_r2r_kind kind0,
+                                          fftwf_r2r_kind kind1, unsigned flags,
+                                          int nthreads)
+{
+    return get(Type::R2R, n0, n1, 1, kind0, kind1, flags, nthreads, in, out);
+}
+
+FFTWPlanCache::Plan
+FFTWPlanCache::many_r2r_2d(int n0, int n1, int howmany, float *in, float *out,
+                           fftwf_r2r_kind kind0, fftwf_r2r_kind kind1,
+                           unsigned flags, int nthreads)
+{
+    return get(Type::MANY_R2R, n0, n1, howmany, kind0, kind1, flags, nthreads,
+               in, out);
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::get(Type type, int n0, int n1, int howmany,
+                                       int kind0, int kind1, unsigned flags,
+                                       int nthreads, const void *in,
+                                       const void *out)
+{
+#ifndef RT_FFTW3F_OMP
+    nthreads = 1;
+#endif
+
+    const bool inplace = in == out;
+    const int align_in =
+        fftwf_alignment_of(static_cast<float *>(const_cast<void *>(in)));
+    const int align_out =
+        inplace
+            ? align_in
+            : fftwf_alignment_of(static_cast<float *>(const_cast<void *>(out)));
+    const Key key(type, n0, n1, howmany, kind0, kind1, flags, nthreads,
+                  align_in, align_out, inplace);
+
+    // destroyed after releasing the lock, see the deleter below
+    Plan evicted;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = plans_.begin(); it != plans_.end(); ++it) {
+        if (it->first == key) {
+            plans_.splice(plans_.begin(), plans_, it);
+            return plans_.front().second;
+        }
+    }
+
+    // the planner can overwrite the buffers, so plan on scratch buffers with
+    // the same alignment as the given ones
+    const size_t real_size = size_t(n0) * n1 * howmany * sizeof(float);
+    const size_t complex_size =
+        size_t(n0) * (n1 / 2 + 1) * sizeof(fftwf_complex);
+    size_t in_size = real_size, out_size = real_size;
+    if (type == Type::DFT_R2C) {
+        out_size = complex_size;
+    } else if (type == Type::DFT_C2R) {
+        in_size = complex_size;
+    }
+    if (inplace) {
+        in_size = out_size = in_size > out_size ? in_size : out_size;
+    }
+
+    constexpr size_t pad = 64; // more than the largest SIMD alignment
+    char *buf_in = static_cast<char *>(fftwf_malloc(in_size + pad));
+    char *buf_out =
+        inplace ? buf_in : static_cast<char *>(fftwf_malloc(out_size + pad));
+    if (!buf_in || !buf_out) {
+        fftwf_free(buf_in);
+        if (!inplace) {
+            fftwf_free(buf_out);
+        }
+        return Plan();
+    }
+    float *scratch_in = reinterpret_cast<float *>(buf_in + align_in);
+    float *scratch_out = reinterpret_cast<float *>(buf_out + align_out);
+
+#ifdef RT_FFTW3F_OMP
+    fftwf_plan_with_nthreads(nthreads);
+#endif
+
+    fftwf_plan p = nullptr;
+    switch (type) {
+    case Type::DFT_R2C:
+        p = fftwf_plan_dft_r2c_2d(
+            n0, n1, scratch_in, reinterpret_cast<fftwf_complex *>(scratch_out),
+            flags);
+        break;
+    case Type::DFT_C2R:
+        p = fftwf_plan_dft_c2r_2d(n0, n1,
+                                  reinterpret_cast<fftwf_complex *>(scratch_in),
+                                  scratch_out, flags);
+        break;
+    case Type::R2R:
+        p = fftwf_plan_r2r_2d(n0, n1, scratch_in, scratch_out,
+                              fftwf_r2r_kind(kind0), fftwf_r2r_kind(kind1),
+                              flags);
+        break;
+    case Type::MANY_R2R: {
+        const int n[2] = {n0, n1};
+        const fftwf_r2r_kind kind[2] = {fftwf_r2r_kind(kind0),
+                                        fftwf_r2r_kind(kind1)};
+        p = fftwf_plan_many_r2r(2, n, howmany, scratch_in, nullptr, 1, n0 * n1,
+                                scratch_out, nullptr, 1, n0 * n1, kind, flags);
+        break;
+    }
+    }
+
+    fftwf_free(buf_in);
+    if (!inplace) {
+        fftwf_free(buf_out);
+    }
+
+    if (!p) {
+        return Plan();
+    }
+
+    // the planner is not thread-safe, and fftwf_destroy_plan() is part of it
+    plans_.emplace_front(key, Plan(p, [this](fftwf_plan plan) -> void {
+                             std::lock_guard<std::mutex> lock(mutex_);
+                             fftwf_destroy_plan(plan);
+                         }));
+    if (plans_.size() > MAX_PLANS) {
+        evicted = plans_.back().second;
+        plans_.pop_back();
+    }
+
+    return plans_.front().second;
+}
+
+} // namespace rtengine
@@ -0,0 +1,86 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include <fftw3.h>
+#include <glibmm.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace rtengine {
+
+/**
+ * Process-wide cache of FFTW plans, shared by the FFT based tools (denoise,
+ * Fattal, Convolution).
+ *
+ * Plans are created once per transform type, size, thread count and
+ * alignment of the buffers, on internal scratch buffers. The returned plans
+ * must therefore be executed with the new-array functions
+ * (fftwf_execute_dft_r2c(), fftwf_execute_r2r()...) on buffers with the same
+ * alignment and in-place-ness as the ones given when asking for the plan.
+ * The buffers passed to the get functions are never accessed.
+ *
+ * The planner wisdom is saved to <cacheBaseDir>/fftw_wisdom at exit, and
+ * loaded at startup, so that plans of the sizes seen in previous sessions are
+ * created without measuring again.
+ */
+class FFTWPlanCache: public NonCopyable {
+public:
+    typedef std::shared_ptr<fftwf_plan_s> Plan;
+
+    static FFTWPlanCache *getInstance();
+
+    void init();
+    void cleanup();
+
+    /// nthreads is ignored if FFTW has been built without threads support
+    Plan dft_r2c_2d(int n0, int n1, float *in, fftwf_complex *out,
+                    unsigned flags, int nthreads = 1);
+    Plan dft_c2r_2d(int n0, int n1, fftwf_complex *in, float *out,
+                    unsigned flags, int nthreads = 1);
+    Plan r2r_2d(int n0, int n1, float *in, float *out, fftwf_r2r_kind kind0,
+                fftwf_r2r_kind kind1, unsigned flags, int nthreads = 1);
+    /// howmany n0 x n1 transforms, stored contiguously
+    Plan many_r2r_2d(int n0, int n1, int howmany, float *in, float *out,
+                     fftwf_r2r_kind kind0, fftwf_r2r_kind kind1,
+                     unsigned flags, int nthreads = 1);
+
+private:
+    FFTWPlanCache() = default;
+
+    enum class Type { DFT_R2C, DFT_C2R, R2R, MANY_R2R };
+
+    // type, n0, n1, howmany, kind0, kind1, flags, nthreads, alignment of in
+    // and out, in-place
+    typedef std::tuple<Type, int, int, int, int, int, unsigned, int, int, int,
+                       bool>
+        Key;
+
+    Plan get(Type type, int n0, int n1, int howmany, int kind0, int kind1,
+             unsigned flags, int nthreads, const void *in, const void *out);
+
+    std::mutex mutex_;
+    std::list<std::pair<Key, Plan>> plans_; // most recently used first
+    Glib::ustring wisdom_file_;
+};
+
+} // namespace rtengine
@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -446,6 +447,88 @@ bool rtengine::ImProcCoordinator::getFilmNegativeSpot(int x, int y,
     return true;
 }
 
+bool rtengine::estimateFilmNegativeReference(const Glib::ustring &fname,
+                                             bool isRaw,
+                                             const procparams::ProcParams &pp,
+                                             RGB &refInput)
+{
+    using procparams::RAWParams;
+    using procparams::WBParams;
+
+    int errorCode = 0;
+    InitialImage *ii = InitialImage::load(fname, isRaw, &errorCode);
+    if (errorCode || !ii) {
+        return false;
+    }
+
+    ImageSource *imgsrc = ii->getImageSource();
+    imgsrc->setCurrentFrame(pp.raw.bayersensor.imageNum);
+
+    ColorTemp currWB;
+    if (pp.wb.enabled) {
+        switch (pp.wb.method) {
+        case WBParams::CAMERA:
+            currWB = imgsrc->getWB();
+            break;
+        case WBParams::CUSTOM_TEMP:
+            currWB = ColorTemp(pp.wb.temperature, pp.wb.green, pp.wb.equal,
+                               "Custom");
+            break;
+        case WBParams::CUSTOM_MULT_LEGACY:
+            currWB = ColorTemp(pp.wb.mult[0], pp.wb.mult[1], pp.wb.mult[2],
+                               1.0);
+            break;
+        case WBParams::CUSTOM_MULT: {
+            double rm = pp.wb.mult[0];
+            double gm = pp.wb.mult[1];
+            double bm = pp.wb.mult[2];
+            imgsrc->wbCamera2Mul(rm, gm, bm);
+            currWB = ColorTemp(rm, gm, bm);
+        } break;
+        case WBParams::AUTO:
+        default:
+            break;
+        }
+    }
+
+    // the medians don't need a good demosaic, only a fast one: the estimate
+    // is done on a downscaled image anyway, as in the editor
+    RAWParams raw = pp.raw;
+    raw.bayersensor.method = RAWParams::BayerSensor::Method::FAST;
+    raw.xtranssensor.method = RAWParams::XTransSensor::Method::FAST;
+    imgsrc->preprocess(raw, pp.lensProf, pp.coarse, false, currWB);
+    imgsrc->demosaic(raw, false, 0.0);
+
+    if (pp.wb.enabled && pp.wb.method == WBParams::AUTO) {
+        double rm, gm, bm;
+        imgsrc->getAutoWBMultipliers(rm, gm, bm);
+        if (rm != -1.) {
+            currWB = ColorTemp(rm, gm, bm, pp.wb.equal);
+        } else {
+            currWB.useDefaults(pp.wb.equal);
+        }
+    }
+
+    int fw, fh;
+    imgsrc->getFullSize(fw, fh, 0);
+    const int skip = std::max(std::max(fw, fh) / 1024, 1);
+    PreviewProps prev(0, 0, fw, fh, skip);
+    int w, h;
+    imgsrc->getSize(prev, w, h);
+
+    Imagefloat img(w, h);
+    imgsrc->getImage(currWB, 0, &img, prev, pp.exposure, raw);
+    if (pp.filmNegative.colorSpace != FilmNegativeParams::ColorSpace::INPUT) {
+        imgsrc->convertColorSpace(&img, pp.icm, currWB);
+    }
+
+    refInput = getMedians(&img, 20);
+
+    ii->decreaseRef();
+    return true;
+}
+
+
 // ---------- >>> legacy mode >>> ---------------
 
 // For backwards compatibility with profiles saved by RT 5.7 - 5.8
@@ -281,26 +281,35 @@ void CLASS copy_line_to_bayer(struct fuji_compressed_block *info, int cur_line,
 
 inline void CLASS fuji_zerobits(struct fuji_compressed_block *info, int *count)
 {
-    uchar zero = 0;
     *count = 0;
 
-    while (zero == 0) {
-        zero = (info->cur_buf[info->cur_pos] >> (7 - info->cur_bit)) & 1;
-        info->cur_bit++;
-        info->cur_bit &= 7;
+    // look at the remaining bits of the current byte all at once, finding
+    // the terminating 1 with a bit scan instead of testing one bit at a time
+    while (true) {
+        const uint32_t bits =
+            (uint32_t(info->cur_buf[info->cur_pos]) << info->cur_bit) & 0xff;
 
-        if (!info->cur_bit) {
-            ++info->cur_pos;
+        if (bits) {
+            const int zeros = rtengine::bitreader_leading_zeros(bits) - 24;
+            *count += zeros;
+            info->cur_bit += zeros + 1;
+
+            if (info->cur_bit == 8) {
+                info->cur_bit = 0;
+                ++info->cur_pos;
 #ifndef MYFILE_MMAP
-            fuji_fill_buffer(info);
+                fuji_fill_buffer(info);
 #endif
+            }
+            return;
         }
 
-        if (zero) {
-            break;
-        }
-
-        ++*count;
+        *count += 8 - info->cur_bit;
+        info->cur_bit = 0;
+        ++info->cur_pos;
+#ifndef MYFILE_MMAP
+        fuji_fill_buffer(info);
+#endif
     }
 }
 
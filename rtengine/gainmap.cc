@@ -26,7 +26,6 @@
 #include "gainmap.h"
 #include "rawimage.h"
 #include "rawimagesource.h"
-#include "rescale.h"
 
 namespace rtengine {
 
@@ -192,27 +191,54 @@ void RawImageSource::apply_gain_map(unsigned short black[4],
         fblack[i] = black[i];
     }
 
-    // now we can apply each gain map to raw_data
-    array2D<float> mvals;
-    for (auto &m : maps) {
-        mvals(m.map_points_h, m.map_points_v, &(m.map_gain[0]), 0);
-
-        const float col_scale = float(m.map_points_h - 1) / float(W);
-        const float row_scale = float(m.map_points_v - 1) / float(H);
-
-        const unsigned yend = std::min(unsigned(H), m.bottom);
-        const unsigned xend = std::min(unsigned(W), m.right);
+    // apply all the maps in a single pass over the rows of rawData: each map
+    // covers one of the four CFA positions, so that every row is touched by
+    // two of them
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> line;
 
 #ifdef _OPENMP
-#pragma omp parallel for
+#pragma omp for
 #endif
-        for (unsigned y = m.top; y < yend; y += m.row_pitch) {
-            float ys = y * row_scale;
-            for (unsigned x = m.left; x < xend; x += m.col_pitch) {
-                float xs = x * col_scale;
-                float f = getBilinearValue(mvals, xs, ys) * scale_factor;
-                float b = fblack[FC(y, x)];
-                rawData[y][x] = CLIP((rawData[y][x] - b) * f + b);
+        for (int y = 0; y < H; ++y) {
+            for (auto &m : maps) {
+                const unsigned yend = std::min(unsigned(H), m.bottom);
+                if (unsigned(y) < m.top || unsigned(y) >= yend ||
+                    (y - m.top) % m.row_pitch) {
+                    continue;
+                }
+
+                // interpolate the map vertically once per row...
+                const int mw = m.map_points_h;
+                const int mh = m.map_points_v;
+                const float row_scale = float(mh - 1) / float(H);
+                const float ys = y * row_scale;
+                const int yi = std::min(int(ys), mh - 1);
+                const int yi1 = std::min(yi + 1, mh - 1);
+                const float yf = ys - yi;
+                const float *g0 = &m.map_gain[yi * mw];
+                const float *g1 = &m.map_gain[yi1 * mw];
+                line.resize(mw);
+                for (int i = 0; i < mw; ++i) {
+                    line[i] = (yf * g1[i] + (1.f - yf) * g0[i]) * scale_factor;
+                }
+
+                // ...and then only horizontally for each pixel
+                const float col_scale = float(mw - 1) / float(W);
+                const unsigned xend = std::min(unsigned(W), m.right);
+                const float b = fblack[FC(y, m.left)];
+                float *row = rawData[y];
+                for (unsigned x = m.left; x < xend; x += m.col_pitch) {
+                    const float xs = x * col_scale;
+                    const int xi = std::min(int(xs), mw - 1);
+                    const int xi1 = std::min(xi + 1, mw - 1);
+                    const float xf = xs - xi;
+                    const float f = xf * line[xi1] + (1.f - xf) * line[xi];
+                    row[x] = CLIP((row[x] - b) * f + b);
+                }
             }
         }
     }
@@ -24,118 +24,291 @@
  */
 
 #include "gamutwarning.h"
+#include "opthelper.h"
+#include "sleef.h"
 #include <iostream>
+#include <list>
+#include <mutex>
+#include <vector>
 
 namespace rtengine {
 
+namespace {
+
+// Lab grid of the classifier: L in [0, 100], a and b in [-128, 128]. Each
+// cell records whether its 8 corners are all in gamut, all out of gamut, or
+// mixed. Only the pixels in the mixed cells (and the ones outside of the
+// grid) need the exact test through lcms
+constexpr int GRID_L = 33;
+constexpr int GRID_AB = 65;
+constexpr float AB_RANGE = 128.f;
+
+enum CellClass : uint8_t { CELL_IN = 0, CELL_OUT = 1, CELL_MIXED = 2 };
+
+// number of classifiers kept for reuse (e.g. when switching between the
+// editors, or toggling the gamut check)
+constexpr size_t MAX_CACHED_CLASSIFIERS = 4;
+
+} // namespace
+
+class GamutWarning::Classifier {
+public:
+    // the transforms are kept alive, so that the key can't be reused
+    ICCStore::Transform lab2ref;
+    ICCStore::Transform lab2softproof;
+    ICCStore::Transform softproof2ref;
+    std::vector<uint8_t> cells;
+
+    bool matches(const GamutWarning &gw) const
+    {
+        return lab2ref == gw.lab2ref && lab2softproof == gw.lab2softproof &&
+               softproof2ref == gw.softproof2ref;
+    }
+};
+
 GamutWarning::GamutWarning(cmsHPROFILE gamutprof, RenderingIntent intent,
                            bool gamutbpc)
-    : lab2ref(nullptr), lab2softproof(nullptr), softproof2ref(nullptr)
 {
+    ICCStore *store = ICCStore::getInstance();
     cmsHPROFILE iprof = cmsCreateLab4Profile(nullptr);
     if (cmsIsMatrixShaper(gamutprof) &&
         !cmsIsCLUT(gamutprof, intent, LCMS_USED_AS_OUTPUT)) {
-        cmsHPROFILE aces = ICCStore::getInstance()->workingSpace("ACESp0");
+        cmsHPROFILE aces = store->workingSpace("ACESp0");
         if (aces) {
-            lab2ref =
-                cmsCreateTransform(iprof, TYPE_Lab_FLT, aces, TYPE_RGB_FLT,
-                                   INTENT_ABSOLUTE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            lab2softproof =
-                cmsCreateTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT,
-                                   INTENT_ABSOLUTE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            softproof2ref = cmsCreateTransform(
+            lab2ref = store->getTransform(iprof, TYPE_Lab_FLT, aces,
+                                          TYPE_RGB_FLT,
+                                          INTENT_ABSOLUTE_COLORIMETRIC,
+                                          cmsFLAGS_NOOPTIMIZE);
+            lab2softproof = store->getTransform(iprof, TYPE_Lab_FLT, gamutprof,
+                                                TYPE_RGB_FLT,
+                                                INTENT_ABSOLUTE_COLORIMETRIC,
+                                                cmsFLAGS_NOOPTIMIZE);
+            softproof2ref = store->getTransform(
                 gamutprof, TYPE_RGB_FLT, aces, TYPE_RGB_FLT,
                 INTENT_ABSOLUTE_COLORIMETRIC,
-                cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE |
+                cmsFLAGS_NOOPTIMIZE |
                     (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
         }
     } else {
-        lab2ref = nullptr;
-        lab2softproof =
-            cmsCreateTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT,
-                               INTENT_ABSOLUTE_COLORIMETRIC,
-                               cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-        softproof2ref = cmsCreateTransform(
+        lab2softproof = store->getTransform(iprof, TYPE_Lab_FLT, gamutprof,
+                                            TYPE_RGB_FLT,
+                                            INTENT_ABSOLUTE_COLORIMETRIC,
+                                            cmsFLAGS_NOOPTIMIZE);
+        softproof2ref = store->getTransform(
             gamutprof, TYPE_RGB_FLT, iprof, TYPE_Lab_FLT,
             INTENT_ABSOLUTE_COLORIMETRIC,
-            cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE |
+            cmsFLAGS_NOOPTIMIZE |
                 (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
     }
 
+    if (!softproof2ref || !lab2softproof) {
+        softproof2ref.reset();
+        lab2softproof.reset();
+    }
+    cmsCloseProfile(iprof);
+
     if (!softproof2ref) {
-        if (lab2softproof) {
-            cmsDeleteTransform(lab2softproof);
-            lab2softproof = nullptr;
+        return;
+    }
+
+    // the transforms are shared by content by the ICCStore, so they identify
+    // the classifier
+    static std::mutex cache_mutex;
+    static std::list<std::shared_ptr<const Classifier>> cache;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            if ((*it)->matches(*this)) {
+                classifier_ = *it;
+                cache.splice(cache.begin(), cache, it);
+                return;
+            }
         }
-    } else if (!lab2softproof) {
-        if (softproof2ref) {
-            cmsDeleteTransform(softproof2ref);
-            softproof2ref = nullptr;
+    }
+
+    std::shared_ptr<Classifier> c(new Classifier());
+    c->lab2ref = lab2ref;
+    c->lab2softproof = lab2softproof;
+    c->softproof2ref = softproof2ref;
+
+    // test the grid nodes, one L plane at a time
+    constexpr int plane = GRID_AB * GRID_AB;
+    std::vector<uint8_t> nodes(GRID_L * plane);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> src(3 * plane), buf1(3 * plane), buf2(3 * plane);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (int l = 0; l < GRID_L; ++l) {
+            for (int i = 0, idx = 0; i < GRID_AB; ++i) {
+                for (int j = 0; j < GRID_AB; ++j, idx += 3) {
+                    src[idx] = 100.f * l / (GRID_L - 1);
+                    src[idx + 1] = 2.f * AB_RANGE * i / (GRID_AB - 1) - AB_RANGE;
+                    src[idx + 2] = 2.f * AB_RANGE * j / (GRID_AB - 1) - AB_RANGE;
+                }
+            }
+            check(&src[0], &buf1[0], &buf2[0], plane, &nodes[l * plane]);
         }
     }
-    cmsCloseProfile(iprof);
+
+    constexpr int cl = GRID_L - 1;
+    constexpr int cab = GRID_AB - 1;
+    c->cells.resize(cl * cab * cab);
+    for (int l = 0; l < cl; ++l) {
+        for (int i = 0; i < cab; ++i) {
+            for (int j = 0; j < cab; ++j) {
+                int n = 0;
+                for (int k = 0; k < 8; ++k) {
+                    n += nodes[(l + (k >> 2)) * plane +
+                               (i + ((k >> 1) & 1)) * GRID_AB + j + (k & 1)];
+                }
+                c->cells[(l * cab + i) * cab + j] =
+                    n == 0 ? CELL_IN : (n == 8 ? CELL_OUT : CELL_MIXED);
+            }
+        }
+    }
+
+    classifier_ = c;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.push_front(classifier_);
+    if (cache.size() > MAX_CACHED_CLASSIFIERS) {
+        cache.pop_back();
+    }
 }
 
-GamutWarning::~GamutWarning()
+void GamutWarning::check(float *src, float *buf1, float *buf2, int n,
+                         uint8_t *out) const
 {
-    if (softproof2ref) {
-        cmsDeleteTransform(softproof2ref);
+    float delta_max = lab2ref ? 0.0001f : 4.9999f;
+    cmsDoTransform(lab2softproof.get(), src, buf2, n);
+    // since we are checking for out-of-gamut, we do want to clamp here!
+    for (int i = 0; i < n * 3; ++i) {
+        buf2[i] = LIM01(buf2[i]);
     }
+    cmsDoTransform(softproof2ref.get(), buf2, buf1, n);
+
+    float *proofdata = buf1;
+    float *refdata = src;
+
     if (lab2ref) {
-        cmsDeleteTransform(lab2ref);
-    }
-    if (lab2softproof) {
-        cmsDeleteTransform(lab2softproof);
+        cmsDoTransform(lab2ref.get(), src, buf2, n);
+        refdata = buf2;
+
+        int iy = 0;
+        for (int j = 0; j < n; ++j) {
+            float delta = max(std::abs(proofdata[iy] - refdata[iy]),
+                              std::abs(proofdata[iy + 1] - refdata[iy + 1]),
+                              std::abs(proofdata[iy + 2] - refdata[iy + 2]));
+            iy += 3;
+            out[j] = delta > delta_max;
+        }
+    } else {
+        int iy = 0;
+        for (int j = 0; j < n; ++j) {
+            cmsCIELab lab1 = {proofdata[iy], proofdata[iy + 1],
+                              proofdata[iy + 2]};
+            cmsCIELab lab2 = {refdata[iy], refdata[iy + 1], refdata[iy + 2]};
+            iy += 3;
+            float delta = cmsDeltaE(&lab1, &lab2);
+            out[j] = delta > delta_max;
+        }
     }
 }
 
-void GamutWarning::markLine(Image8 *image, int y, float *srcbuf, float *buf1,
-                            float *buf2)
+void GamutWarning::markLine(Image8 *image, int y, const float *L,
+                            const float *a, const float *b, float *srcbuf,
+                            float *buf1, float *buf2, int *posbuf)
 {
-    if (softproof2ref) {
-        const int width = image->getWidth();
-
-        float delta_max = lab2ref ? 0.0001f : 4.9999f;
-        cmsDoTransform(lab2softproof, srcbuf, buf2, width);
-        // since we are checking for out-of-gamut, we do want to clamp here!
-        for (int i = 0; i < width * 3; ++i) {
-            buf2[i] = LIM01(buf2[i]);
-        }
-        cmsDoTransform(softproof2ref, buf2, buf1, width);
+    if (!softproof2ref) {
+        return;
+    }
 
-        float *proofdata = buf1;
-        float *refdata = srcbuf;
+    const int width = image->getWidth();
+    const uint8_t *cells = &classifier_->cells[0];
+    constexpr int cl = GRID_L - 1;
+    constexpr int cab = GRID_AB - 1;
+    constexpr float lscale = cl / (100.f * 327.68f);
+    constexpr float abscale = cab / (2.f * AB_RANGE * 327.68f);
+    constexpr float aboffset = AB_RANGE * 327.68f;
 
-        if (lab2ref) {
-            cmsDoTransform(lab2ref, srcbuf, buf2, width);
-            refdata = buf2;
+    // the pixels to test exactly are collected in posbuf
+    int nmixed = 0;
+    const auto classify = [&](int j, int idx, bool in_grid) -> void {
+        const uint8_t c = in_grid ? cells[idx] : uint8_t(CELL_MIXED);
+        if (c == CELL_OUT) {
+            mark(image, y, j);
+        } else if (c == CELL_MIXED) {
+            posbuf[nmixed++] = j;
+        }
+    };
 
-            int iy = 0;
-            for (int j = 0; j < width; ++j) {
-                float delta =
-                    max(std::abs(proofdata[iy] - refdata[iy]),
-                        std::abs(proofdata[iy + 1] - refdata[iy + 1]),
-                        std::abs(proofdata[iy + 2] - refdata[iy + 2]));
-                iy += 3;
+    int j = 0;
+#ifdef __SSE2__
+    const vfloat lscalev = F2V(lscale);
+    const vfloat abscalev = F2V(abscale);
+    const vfloat aboffsetv = F2V(aboffset);
+    const vfloat zerov = ZEROV;
+    const vfloat lmaxv = F2V(float(cl));
+    const vfloat abmaxv = F2V(float(cab));
+    const vfloat lclampv = F2V(cl - 1e-3f);
+    const vfloat abclampv = F2V(cab - 1e-3f);
+    const vfloat abstridev = F2V(float(cab));
+    const vfloat lstridev = F2V(float(cab * cab));
+    int idx[4];
+    for (; j < width - 3; j += 4) {
+        const vfloat lv = LVFU(L[j]) * lscalev;
+        const vfloat av = (LVFU(a[j]) + aboffsetv) * abscalev;
+        const vfloat bv = (LVFU(b[j]) + aboffsetv) * abscalev;
+        const vmask in_grid =
+            vandm(vandm(vmaskf_ge(lv, zerov), vmaskf_le(lv, lmaxv)),
+                  vandm(vandm(vmaskf_ge(av, zerov), vmaskf_le(av, abmaxv)),
+                        vandm(vmaskf_ge(bv, zerov), vmaskf_le(bv, abmaxv))));
+        // the cell coordinates are small integers, so they are exact also
+        // as floats
+        const auto cell = [&](vfloat v, vfloat hi) -> vfloat {
+            return _mm_cvtepi32_ps(
+                _mm_cvttps_epi32(vminf(vmaxf(v, zerov), hi)));
+        };
+        const vfloat iv = cell(lv, lclampv) * lstridev +
+                          cell(av, abclampv) * abstridev +
+                          cell(bv, abclampv);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(idx),
+                         _mm_cvttps_epi32(iv));
+        const int in = _mm_movemask_ps((vfloat)in_grid);
+        for (int k = 0; k < 4; ++k) {
+            classify(j + k, idx[k], in & (1 << k));
+        }
+    }
+#endif
+    for (; j < width; ++j) {
+        const float lv = L[j] * lscale;
+        const float av = (a[j] + aboffset) * abscale;
+        const float bv = (b[j] + aboffset) * abscale;
+        const bool in_grid = lv >= 0.f && lv <= cl && av >= 0.f &&
+                             av <= cab && bv >= 0.f && bv <= cab;
+        const int il = int(LIM(lv, 0.f, cl - 1e-3f));
+        const int ia = int(LIM(av, 0.f, cab - 1e-3f));
+        const int ib = int(LIM(bv, 0.f, cab - 1e-3f));
+        classify(j, (il * cab + ia) * cab + ib, in_grid);
+    }
 
-                if (delta > delta_max) {
-                    mark(image, y, j);
-                }
-            }
-        } else {
-            int iy = 0;
-            for (int j = 0; j < width; ++j) {
-                cmsCIELab lab1 = {proofdata[iy], proofdata[iy + 1],
-                                  proofdata[iy + 2]};
-                cmsCIELab lab2 = {refdata[iy], refdata[iy + 1],
-                                  refdata[iy + 2]};
-                iy += 3;
-                float delta = cmsDeltaE(&lab1, &lab2);
-                if (delta > delta_max) {
-                    mark(image, y, j);
-                }
+    if (nmixed) {
+        for (int i = 0, iy = 0; i < nmixed; ++i, iy += 3) {
+            const int k = posbuf[i];
+            srcbuf[iy] = L[k] / 327.68f;
+            srcbuf[iy + 1] = a[k] / 327.68f;
+            srcbuf[iy + 2] = b[k] / 327.68f;
+        }
+        // the results can overwrite buf1, as the i-th one is written after
+        // the i-th pixel of buf1 is read
+        uint8_t *out = reinterpret_cast<uint8_t *>(buf1);
+        check(srcbuf, buf1, buf2, nmixed, out);
+        for (int i = 0; i < nmixed; ++i) {
+            if (out[i]) {
+                mark(image, y, posbuf[i]);
             }
         }
     }
@@ -28,22 +28,39 @@
 #include "iccstore.h"
 #include "image8.h"
 #include "noncopyable.h"
+#include <cstdint>
+#include <memory>
 
 namespace rtengine {
 
 class GamutWarning: public NonCopyable {
 public:
     GamutWarning(cmsHPROFILE gamutprof, RenderingIntent intent, bool bpc);
-    ~GamutWarning();
-    void markLine(Image8 *image, int y, float *srcbuf, float *buf1,
-                  float *buf2);
+
+    /// marks the out-of-gamut pixels of row y of image, given the Lab values
+    /// (scaled as in Imagefloat) of the row. The buffers must hold 3 floats
+    /// (resp. 1 int) per pixel
+    void markLine(Image8 *image, int y, const float *L, const float *a,
+                  const float *b, float *srcbuf, float *buf1, float *buf2,
+                  int *posbuf);
 
 private:
+    class Classifier;
+
+    // exact test, through lcms, of n interleaved Lab pixels in src.
+    // out[i] is set to 1 if the i-th one is out of gamut, 0 otherwise
+    void check(float *src, float *buf1, float *buf2, int n,
+               uint8_t *out) const;
     void mark(Image8 *image, int i, int j);
 
-    cmsHTRANSFORM lab2ref;
-    cmsHTRANSFORM lab2softproof;
-    cmsHTRANSFORM softproof2ref;
+    // shared with the other pipelines through the ICCStore
+    ICCStore::Transform lab2ref;
+    ICCStore::Transform lab2softproof;
+    ICCStore::Transform softproof2ref;
+
+    // the gamut baked on a Lab grid, shared by the instances with the same
+    // transforms
+    std::shared_ptr<const Classifier> classifier_;
 };
 
 } // namespace rtengine
@@ -19,6 +19,7 @@
 #include "gauss.h"
 #include "alignedbuffer.h"
 #include "boxblur.h"
+#include "gauss_kernels.h"
 #include "opthelper.h"
 #include "rt_math.h"
 #include <cmath>
@@ -1015,6 +1016,56 @@ void gaussVerticalSse(T **src, T **dst, const int W, const int H,
 }
 #endif
 
+#ifdef __SSE2__
+// the wider-vector variants of gaussHorizontalSse() and gaussVerticalSse(),
+// if supported by the processor
+const rtengine::gauss::Kernels *getWideKernels(const int W, const int H)
+{
+    const auto &k = rtengine::gauss::get_kernels();
+    return (k.horizontal && W >= 4 && H >= 4) ? &k : nullptr;
+}
+
+rtengine::gauss::YvVCoeffs getYvVCoeffs(const float sigma)
+{
+    double b1, b2, b3, B, M[3][3];
+    calculateYvVFactors<double>(sigma, b1, b2, b3, B, M);
+
+    rtengine::gauss::YvVCoeffs c;
+    c.B = B;
+    c.b1 = b1;
+    c.b2 = b2;
+    c.b3 = b3;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++) {
+            c.M[i][j] = M[i][j] * (1.0 + b2 + (b1 - b3) * b3) /
+                        ((1.0 + b1 - b2 + b3) * (1.0 - b1 - b2 - b3));
+        }
+    return c;
+}
+
+template <class T>
+void gaussHorizontalWide(T **src, T **dst, const int W, const int H,
+                         const float sigma)
+{
+    if (auto k = getWideKernels(W, H)) {
+        k->horizontal(src, dst, W, H, getYvVCoeffs(sigma));
+    } else {
+        gaussHorizontalSse<T>(src, dst, W, H, sigma);
+    }
+}
+
+template <class T>
+void gaussVerticalWide(T **src, T **dst, const int W, const int H,
+                       const float sigma)
+{
+    if (auto k = getWideKernels(W, H)) {
+        k->vertical(src, dst, W, H, getYvVCoeffs(sigma));
+    } else {
+        gaussVerticalSse<T>(src, dst, W, H, sigma);
+    }
+}
+#endif
+
 #ifdef __SSE2__
 template <class T>
 void gaussVerticalSsemult(T **RESTRICT src, T **RESTRICT dst, const int W,
@@ -1858,7 +1909,7 @@ void gaussianBlurImpl(T **src, T **dst, const int W, const int H,
                     } else if (sigma <= GAUSS_7X7_LIMIT && src != dst) {
                         gauss7x7mult(src, dst, W, H, sigma);
                     } else {
-                        gaussHorizontalSse<T>(src, src, W, H, sigma);
+                        gaussHorizontalWide<T>(src, src, W, H, sigma);
                         gaussVerticalSsemult<T>(src, dst, W, H, sigma);
                     }
                     break;
@@ -1870,15 +1921,15 @@ void gaussianBlurImpl(T **src, T **dst, const int W, const int H,
                     } else if (sigma <= GAUSS_7X7_LIMIT && src != dst) {
                         gauss7x7div(src, dst, buffer2, W, H, sigma);
                     } else {
-                        gaussHorizontalSse<T>(src, dst, W, H, sigma);
+                        gaussHorizontalWide<T>(src, dst, W, H, sigma);
                         gaussVerticalSsediv<T>(dst, dst, buffer2, W, H, sigma);
                     }
                     break;
                 }
 
                 case GAUSS_STANDARD: {
-                    gaussHorizontalSse<T>(src, dst, W, H, sigma);
-                    gaussVerticalSse<T>(dst, dst, W, H, sigma);
+                    gaussHorizontalWide<T>(src, dst, W, H, sigma);
+                    gaussVerticalWide<T>(dst, dst, W, H, sigma);
                     break;
                 }
                 }
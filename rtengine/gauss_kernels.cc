@@ -0,0 +1,326 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gauss_kernels.h"
+#include "alignedbuffer.h"
+#include "cpuinfo.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// this file is also compiled for the instruction sets in
+// PROC_DISPATCH_TARGETS (see gauss_avx2.cc), which define ART_SIMD_VARIANT.
+// The baseline build only contains the dispatcher, since gauss.cc already
+// has SSE2 versions of the passes
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_BASE_BUILD
+#endif
+
+namespace rtengine {
+
+namespace gauss {
+
+#ifndef ART_SIMD_BASE_BUILD
+
+namespace {
+
+#ifdef __AVX512F__
+constexpr int N = 16;
+#else
+constexpr int N = 8;
+#endif
+
+typedef float vec __attribute__((vector_size(N * sizeof(float))));
+typedef float v8 __attribute__((vector_size(8 * sizeof(float))));
+typedef int v8i __attribute__((vector_size(8 * sizeof(int))));
+
+inline vec load(const float *p)
+{
+    vec v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store(float *p, const vec &v) { std::memcpy(p, &v, sizeof(v)); }
+
+// K vectors processed together, so that a strip of the vertical pass spans
+// whole cache lines
+template <int K> struct VecK {
+    vec v[K];
+
+    VecK operator+(const VecK &o) const
+    {
+        VecK r;
+        for (int k = 0; k < K; ++k) {
+            r.v[k] = v[k] + o.v[k];
+        }
+        return r;
+    }
+
+    VecK operator-(const VecK &o) const
+    {
+        VecK r;
+        for (int k = 0; k < K; ++k) {
+            r.v[k] = v[k] - o.v[k];
+        }
+        return r;
+    }
+
+    VecK operator*(float f) const
+    {
+        VecK r;
+        for (int k = 0; k < K; ++k) {
+            r.v[k] = v[k] * f;
+        }
+        return r;
+    }
+};
+
+template <int K> inline VecK<K> loadK(const float *p)
+{
+    VecK<K> r;
+    for (int k = 0; k < K; ++k) {
+        r.v[k] = load(p + k * N);
+    }
+    return r;
+}
+
+template <int K> inline void storeK(float *p, const VecK<K> &r)
+{
+    for (int k = 0; k < K; ++k) {
+        store(p + k * N, r.v[k]);
+    }
+}
+
+// Young-van Vliet causal and anti-causal passes over n >= 4 samples, with
+// the Triggs-Sdika boundary conditions, for a scalar or a group of vectors
+// E. in(j) reads the input samples, which are all consumed before out(j, v)
+// is called, and t is a buffer of n elements (it can be the storage of the
+// input, as sample j is read before t[j] is written)
+template <class E, class In, class Out>
+inline void yvv(int n, const YvVCoeffs &c, In in, E *t, Out out)
+{
+    const E first = in(0);
+    const E last = in(n - 1);
+
+    E Tm3 = first * (c.B + c.b1 + c.b2 + c.b3);
+    E Tm2 = in(1) * c.B + Tm3 * c.b1 + first * (c.b2 + c.b3);
+    t[0] = Tm3;
+    E R = in(2) * c.B + Tm2 * c.b1 + Tm3 * c.b2 + first * c.b3;
+    t[1] = Tm2;
+    t[2] = R;
+
+    for (int j = 3; j < n; ++j) {
+        const E T = R;
+        R = in(j) * c.B + T * c.b1 + Tm2 * c.b2 + Tm3 * c.b3;
+        t[j] = R;
+        Tm3 = Tm2;
+        Tm2 = T;
+    }
+
+    const E &T = last;
+    const E temp2Wp1 = T + (R - T) * c.M[2][0] + (Tm2 - T) * c.M[2][1] +
+                       (Tm3 - T) * c.M[2][2];
+    const E temp2W = T + (R - T) * c.M[1][0] + (Tm2 - T) * c.M[1][1] +
+                     (Tm3 - T) * c.M[1][2];
+    R = T + (R - T) * c.M[0][0] + (Tm2 - T) * c.M[0][1] +
+        (Tm3 - T) * c.M[0][2];
+    Tm2 = Tm2 * c.B + R * c.b1 + temp2W * c.b2 + temp2Wp1 * c.b3;
+    Tm3 = Tm3 * c.B + Tm2 * c.b1 + R * c.b2 + temp2W * c.b3;
+    out(n - 1, R);
+    out(n - 2, Tm2);
+    out(n - 3, Tm3);
+
+    // R = out[j + 1], Tm2 = out[j + 2], Tm3 = out[j + 3]
+    std::swap(R, Tm3);
+    for (int j = n - 4; j >= 0; --j) {
+        const E T = R;
+        R = t[j] * c.B + T * c.b1 + Tm2 * c.b2 + Tm3 * c.b3;
+        out(j, R);
+        Tm3 = Tm2;
+        Tm2 = T;
+    }
+}
+
+// 8x8 transposition of the rows r[0..7]
+inline void transpose8(v8 r[8])
+{
+    const v8i lo = {0, 8, 1, 9, 4, 12, 5, 13};
+    const v8i hi = {2, 10, 3, 11, 6, 14, 7, 15};
+    const v8i lo2 = {0, 1, 8, 9, 4, 5, 12, 13};
+    const v8i hi2 = {2, 3, 10, 11, 6, 7, 14, 15};
+    const v8i lo4 = {0, 1, 2, 3, 8, 9, 10, 11};
+    const v8i hi4 = {4, 5, 6, 7, 12, 13, 14, 15};
+
+    v8 t[8], u[8];
+    for (int k = 0; k < 8; k += 2) {
+        t[k] = __builtin_shuffle(r[k], r[k + 1], lo);
+        t[k + 1] = __builtin_shuffle(r[k], r[k + 1], hi);
+    }
+    for (int k = 0; k < 8; k += 4) {
+        u[k] = __builtin_shuffle(t[k], t[k + 2], lo2);
+        u[k + 1] = __builtin_shuffle(t[k], t[k + 2], hi2);
+        u[k + 2] = __builtin_shuffle(t[k + 1], t[k + 3], lo2);
+        u[k + 3] = __builtin_shuffle(t[k + 1], t[k + 3], hi2);
+    }
+    for (int k = 0; k < 4; ++k) {
+        r[k] = __builtin_shuffle(u[k], u[k + 4], lo4);
+        r[k + 4] = __builtin_shuffle(u[k], u[k + 4], hi4);
+    }
+}
+
+void horizontal(float **src, float **dst, int W, int H, const YvVCoeffs &c)
+{
+    // 8 rows at a time (the filter is cheap compared to the transpositions,
+    // so wider vectors don't help here), transposed in t so that lane k holds
+    // row i + k
+    AlignedBuffer<float> buf(size_t(W) * 8, 64);
+    v8 *t = reinterpret_cast<v8 *>(buf.data);
+
+    const int nblocks = H / 8;
+    const int rest = H % 8;
+    const int W8 = W - W % 8;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 4)
+#endif
+    for (int b = 0; b < nblocks + rest; ++b) {
+        if (b < nblocks) {
+            const int i = b * 8;
+            v8 r[8];
+            for (int j = 0; j < W8; j += 8) {
+                for (int k = 0; k < 8; ++k) {
+                    std::memcpy(&r[k], src[i + k] + j, sizeof(v8));
+                }
+                transpose8(r);
+                for (int k = 0; k < 8; ++k) {
+                    t[j + k] = r[k];
+                }
+            }
+            for (int j = W8; j < W; ++j) {
+                for (int k = 0; k < 8; ++k) {
+                    t[j][k] = src[i + k][j];
+                }
+            }
+
+            yvv<v8>(
+                W, c, [t](int j) -> v8 { return t[j]; }, t,
+                [t](int j, const v8 &v) -> void { t[j] = v; });
+
+            for (int j = 0; j < W8; j += 8) {
+                for (int k = 0; k < 8; ++k) {
+                    r[k] = t[j + k];
+                }
+                transpose8(r);
+                for (int k = 0; k < 8; ++k) {
+                    std::memcpy(dst[i + k] + j, &r[k], sizeof(v8));
+                }
+            }
+            for (int j = W8; j < W; ++j) {
+                for (int k = 0; k < 8; ++k) {
+                    dst[i + k][j] = t[j][k];
+                }
+            }
+        } else {
+            const int i = nblocks * 8 + (b - nblocks);
+            const float *s = src[i];
+            float *d = dst[i];
+            yvv<float>(
+                W, c, [s](int j) -> float { return s[j]; }, buf.data,
+                [d](int j, float v) -> void { d[j] = v; });
+        }
+    }
+}
+
+void vertical(float **src, float **dst, int W, int H, const YvVCoeffs &c)
+{
+    // strips of K vectors; the remaining columns use single vectors and then
+    // scalars
+    constexpr int K = 2;
+    typedef VecK<K> Strip;
+    AlignedBuffer<float> buf(size_t(H) * K * N, 64);
+    Strip *t = reinterpret_cast<Strip *>(buf.data);
+
+    const int nstrips = W / (K * N);
+    const int nvec = (W - nstrips * K * N) / N;
+    const int first_scalar = nstrips * K * N + nvec * N;
+    const int ntotal = nstrips + nvec + (W - first_scalar);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 2)
+#endif
+    for (int b = 0; b < ntotal; ++b) {
+        if (b < nstrips) {
+            const int i = b * K * N;
+            yvv<Strip>(
+                H, c, [=](int j) -> Strip { return loadK<K>(src[j] + i); }, t,
+                [=](int j, const Strip &v) -> void { storeK(dst[j] + i, v); });
+        } else if (b < nstrips + nvec) {
+            const int i = nstrips * K * N + (b - nstrips) * N;
+            vec *tv = reinterpret_cast<vec *>(t);
+            yvv<vec>(
+                H, c, [=](int j) -> vec { return load(src[j] + i); }, tv,
+                [=](int j, const vec &v) -> void { store(dst[j] + i, v); });
+        } else {
+            const int i = first_scalar + (b - nstrips - nvec);
+            float *tf = reinterpret_cast<float *>(t);
+            yvv<float>(
+                H, c, [=](int j) -> float { return src[j][i]; }, tf,
+                [=](int j, float v) -> void { dst[j][i] = v; });
+        }
+    }
+}
+
+} // namespace
+
+void ART_SIMD_VARIANT(fill_kernels)(Kernels &k)
+{
+    k.horizontal = horizontal;
+    k.vertical = vertical;
+}
+
+#else // ART_SIMD_BASE_BUILD
+
+const Kernels &get_kernels()
+{
+    static const Kernels kernels = []() -> Kernels {
+        Kernels k = {nullptr, nullptr};
+        switch (get_simd_level()) {
+#ifdef ART_SIMD_DISPATCH_AVX512
+        case SIMDLevel::AVX512:
+            fill_kernels_avx512(k);
+            break;
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX2
+        case SIMDLevel::AVX2:
+            fill_kernels_avx2(k);
+            break;
+#endif
+        default:
+            break;
+        }
+        return k;
+    }();
+    return kernels;
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+} // namespace gauss
+
+} // namespace rtengine
@@ -0,0 +1,62 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+namespace rtengine {
+
+namespace gauss {
+
+/// coefficients of the Young-van Vliet recursive gaussian, with the
+/// Triggs-Sdika boundary matrix M already normalized for the float kernels
+struct YvVCoeffs {
+    float B;
+    float b1;
+    float b2;
+    float b3;
+    float M[3][3];
+};
+
+// Wider-vector variants of the separable passes of gaussianBlur(), compiled
+// for the instruction sets in PROC_DISPATCH_TARGETS (see
+// ProcessorTargets.cmake). The function pointers are null when the
+// processor supports none of them, and the SSE2 code of gauss.cc is used.
+// Like the rest of gauss.cc, the passes are meant to be called from inside
+// an OpenMP parallel region, and src can be the same as dst.
+struct Kernels {
+    /// horizontal pass: blocks of rows are transposed so that every vector
+    /// lane filters a different row
+    void (*horizontal)(float **src, float **dst, int W, int H,
+                       const YvVCoeffs &c);
+    /// vertical pass on vertical strips of columns
+    void (*vertical)(float **src, float **dst, int W, int H,
+                     const YvVCoeffs &c);
+};
+
+const Kernels &get_kernels();
+
+#ifdef ART_SIMD_DISPATCH_AVX2
+void fill_kernels_avx2(Kernels &k);
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX512
+void fill_kernels_avx512(Kernels &k);
+#endif
+
+} // namespace gauss
+
+} // namespace rtengine
@@ -32,6 +32,7 @@
 #include "boxblur.h"
 #include "imagefloat.h"
 #include "rescale.h"
+#include "scratcharena.h"
 #include "sleef.h"
 
 namespace rtengine {
@@ -73,19 +74,18 @@ int calculate_subsampling(int w, int h, int r)
     return LIM(r / 2, 2, 4);
 }
 
-} // namespace
-
-void guidedFilter(const array2D<float> &guide, const array2D<float> &src,
-                  array2D<float> &dst, int r, float epsilon, bool multithread,
-                  int subsampling)
+// w and h are the size at which the coefficients of the filter are
+// computed, normally the size of the guide divided by subsampling
+void guided_filter(const array2D<float> &guide,
+                   const std::vector<const array2D<float> *> &src,
+                   const std::vector<array2D<float> *> &dst, int r,
+                   float epsilon, bool multithread, int subsampling, size_t w,
+                   size_t h)
 {
+    assert(src.size() == dst.size());
 
-    const int W = src.width();
-    const int H = src.height();
-
-    if (subsampling <= 0) {
-        subsampling = calculate_subsampling(W, H, r);
-    }
+    const int W = guide.width();
+    const int H = guide.height();
 
     enum Op { MUL, DIVEPSILON, ADD, SUB, ADDMUL, SUBMUL };
 
@@ -134,8 +134,6 @@ void guidedFilter(const array2D<float> &guide, const array2D<float> &src,
 
     // use the terminology of the paper (Algorithm 2)
     const array2D<float> &I = guide;
-    const array2D<float> &p = src;
-    array2D<float> &q = dst;
 
     const auto f_subsample = [=](array2D<float> &d,
                                  const array2D<float> &s) -> void {
@@ -155,75 +153,81 @@ void guidedFilter(const array2D<float> &guide, const array2D<float> &src,
 
     // const auto f_upsample = f_subsample;
 
-    const size_t w = W / subsampling;
-    const size_t h = H / subsampling;
-
     const auto f_mean = [multithread](array2D<float> &d, array2D<float> &s,
                                       int rad) -> void {
         rad = LIM(rad, 0, (min(s.width(), s.height()) - 1) / 2 - 1);
         boxblur(s, d, rad, s.width(), s.height(), multithread);
     };
 
-    array2D<float> I1(w, h, ARRAY2D_ALIGNED);
-    array2D<float> p1(w, h, ARRAY2D_ALIGNED);
+    float r1 = float(r) / subsampling;
 
+    // the statistics of the guide are shared by all the channels
+    ScratchPlane I1(w, h);
     f_subsample(I1, I);
-    f_subsample(p1, p);
-
     DEBUG_DUMP(I);
-    DEBUG_DUMP(p);
     DEBUG_DUMP(I1);
-    DEBUG_DUMP(p1);
-
-    float r1 = float(r) / subsampling;
 
-    array2D<float> meanI(w, h, ARRAY2D_ALIGNED);
+    ScratchPlane meanI(w, h);
     f_mean(meanI, I1, r1);
     DEBUG_DUMP(meanI);
 
-    array2D<float> meanp(w, h, ARRAY2D_ALIGNED);
-    f_mean(meanp, p1, r1);
-    DEBUG_DUMP(meanp);
+    ScratchPlane varI(w, h);
+    apply(MUL, varI, I1, I1);
+    f_mean(varI, varI, r1);
+    apply(SUBMUL, varI, meanI, meanI, varI);
+    DEBUG_DUMP(varI);
+
+    const size_t n = src.size();
+    std::vector<std::unique_ptr<ScratchPlane>> meana(n);
+    std::vector<std::unique_ptr<ScratchPlane>> meanb(n);
+    ScratchPlane meanp(w, h);
 
-    array2D<float> &corrIp = p1;
-    apply(MUL, corrIp, I1, p1);
-    f_mean(corrIp, corrIp, r1);
-    DEBUG_DUMP(corrIp);
+    for (size_t i = 0; i < n; ++i) {
+        const array2D<float> &p = *src[i];
 
-    array2D<float> &corrI = I1;
-    apply(MUL, corrI, I1, I1);
-    f_mean(corrI, corrI, r1);
-    DEBUG_DUMP(corrI);
+        meanb[i].reset(new ScratchPlane(w, h));
+        array2D<float> &p1 = *meanb[i];
+        f_subsample(p1, p);
+        DEBUG_DUMP(p);
+        DEBUG_DUMP(p1);
 
-    array2D<float> &varI = corrI;
-    apply(SUBMUL, varI, meanI, meanI, corrI);
-    DEBUG_DUMP(varI);
+        f_mean(meanp, p1, r1);
+        DEBUG_DUMP(meanp);
 
-    array2D<float> &covIp = corrIp;
-    apply(SUBMUL, covIp, meanI, meanp, corrIp);
-    DEBUG_DUMP(covIp);
+        array2D<float> &corrIp = p1;
+        apply(MUL, corrIp, I1, p1);
+        f_mean(corrIp, corrIp, r1);
+        DEBUG_DUMP(corrIp);
 
-    array2D<float> &a = varI;
-    apply(DIVEPSILON, a, covIp, varI);
-    DEBUG_DUMP(a);
+        array2D<float> &covIp = corrIp;
+        apply(SUBMUL, covIp, meanI, meanp, corrIp);
+        DEBUG_DUMP(covIp);
 
-    array2D<float> &b = covIp;
-    apply(SUBMUL, b, a, meanI, meanp);
-    DEBUG_DUMP(b);
+        meana[i].reset(new ScratchPlane(w, h));
+        array2D<float> &a = *meana[i];
+        apply(DIVEPSILON, a, covIp, varI);
+        DEBUG_DUMP(a);
 
-    array2D<float> &meana = a;
-    f_mean(meana, a, r1);
-    DEBUG_DUMP(meana);
+        array2D<float> &b = covIp;
+        apply(SUBMUL, b, a, meanI, meanp);
+        DEBUG_DUMP(b);
 
-    array2D<float> &meanb = b;
-    f_mean(meanb, b, r1);
-    DEBUG_DUMP(meanb);
+        f_mean(a, a, r1);
+        DEBUG_DUMP(a);
+
+        f_mean(b, b, r1);
+        DEBUG_DUMP(b);
+    }
 
     // speedup by heckflosse67
-    const int Ws = meana.width();
-    const int Hs = meana.height();
-    const int Wd = q.width();
-    const int Hd = q.height();
+    //
+    // all the channels are upsampled in a single pass, so that the bilinear
+    // weights and the guide are computed/read only once per pixel. The guide
+    // value is read before writing the outputs, so that dst can alias it
+    const int Ws = w;
+    const int Hs = h;
+    const int Wd = W;
+    const int Hd = H;
     const float col_scale = float(Ws) / float(Wd);
     const float row_scale = float(Hs) / float(Hd);
 
@@ -231,39 +235,110 @@ void guidedFilter(const array2D<float> &guide, const array2D<float> &src,
 #pragma omp parallel for if (multithread)
 #endif
     for (int y = 0; y < Hd; ++y) {
-        float ymrs = y * row_scale;
+        const float ymrs = y * row_scale;
+        const int yi = std::min(int(ymrs), Hs - 1);
+        const float yf = ymrs - yi;
+        const int yi1 = std::min(yi + 1, Hs - 1);
         for (int x = 0; x < Wd; ++x) {
-            q[y][x] = getBilinearValue(meana, x * col_scale, ymrs) * I[y][x] +
-                      getBilinearValue(meanb, x * col_scale, ymrs);
+            const float xs = x * col_scale;
+            const int xi = std::min(int(xs), Ws - 1);
+            const float xf = xs - xi;
+            const int xi1 = std::min(xi + 1, Ws - 1);
+
+            const auto interp = [&](const array2D<float> &s) -> float {
+                float b = xf * s[yi][xi1] + (1.f - xf) * s[yi][xi];
+                float t = xf * s[yi1][xi1] + (1.f - xf) * s[yi1][xi];
+                return yf * t + (1.f - yf) * b;
+            };
+
+            const float Iv = I[y][x];
+            for (size_t i = 0; i < n; ++i) {
+                (*dst[i])[y][x] = interp(*meana[i]) * Iv + interp(*meanb[i]);
+            }
         }
     }
 }
 
+} // namespace
+
+void guidedFilter(const array2D<float> &guide,
+                  const std::vector<const array2D<float> *> &src,
+                  const std::vector<array2D<float> *> &dst, int r,
+                  float epsilon, bool multithread, int subsampling)
+{
+    const int W = guide.width();
+    const int H = guide.height();
+
+    if (subsampling <= 0) {
+        subsampling = calculate_subsampling(W, H, r);
+    }
+
+    guided_filter(guide, src, dst, r, epsilon, multithread, subsampling,
+                  W / subsampling, H / subsampling);
+}
+
+void guidedUpsample(const array2D<float> &guide,
+                    const std::vector<const array2D<float> *> &src,
+                    const std::vector<array2D<float> *> &dst, int r,
+                    float epsilon, bool multithread)
+{
+    assert(!src.empty());
+
+    const int w = src[0]->width();
+    const int h = src[0]->height();
+    const int subsampling = max(int(float(guide.width()) / w + 0.5f), 1);
+
+    guided_filter(guide, src, dst, r, epsilon, multithread, subsampling, w, h);
+}
+
+void guidedFilter(const array2D<float> &guide, const array2D<float> &src,
+                  array2D<float> &dst, int r, float epsilon, bool multithread,
+                  int subsampling)
+{
+    guidedFilter(guide, {&src}, {&dst}, r, epsilon, multithread,
+                 subsampling);
+}
+
 void guidedFilterLog(const array2D<float> &guide, float base,
-                     array2D<float> &chan, int r, float eps, bool multithread,
-                     int subsampling)
+                     const std::vector<array2D<float> *> &chans, int r,
+                     float eps, bool multithread, int subsampling)
 {
+    for (auto c : chans) {
+        array2D<float> &chan = *c;
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
-    for (int y = 0; y < chan.height(); ++y) {
-        for (int x = 0; x < chan.width(); ++x) {
-            chan[y][x] = xlin2log(max(chan[y][x], 0.f), base);
+        for (int y = 0; y < chan.height(); ++y) {
+            for (int x = 0; x < chan.width(); ++x) {
+                chan[y][x] = xlin2log(max(chan[y][x], 0.f), base);
+            }
         }
     }
 
-    guidedFilter(guide, chan, chan, r, eps, multithread, subsampling);
+    std::vector<const array2D<float> *> src(chans.begin(), chans.end());
+    guidedFilter(guide, src, chans, r, eps, multithread, subsampling);
 
+    for (auto c : chans) {
+        array2D<float> &chan = *c;
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
-    for (int y = 0; y < chan.height(); ++y) {
-        for (int x = 0; x < chan.width(); ++x) {
-            chan[y][x] = xlog2lin(max(chan[y][x], 0.f), base);
+        for (int y = 0; y < chan.height(); ++y) {
+            for (int x = 0; x < chan.width(); ++x) {
+                chan[y][x] = xlog2lin(max(chan[y][x], 0.f), base);
+            }
         }
     }
 }
 
+void guidedFilterLog(const array2D<float> &guide, float base,
+                     array2D<float> &chan, int r, float eps, bool multithread,
+                     int subsampling)
+{
+    guidedFilterLog(guide, base, std::vector<array2D<float> *>{&chan}, r, eps,
+                    multithread, subsampling);
+}
+
 void guidedFilterLog(float base, array2D<float> &chan, int r, float eps,
                      bool multithread, int subsampling)
 {
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "array2D.h"
+#include <vector>
 
 namespace rtengine {
 
@@ -28,6 +29,29 @@ void guidedFilter(const array2D<float> &guide, const array2D<float> &src,
                   array2D<float> &dst, int r, float epsilon, bool multithread,
                   int subsampling = 0);
 
+/**
+ * Filters each src[i] into dst[i] with the same guide. The statistics of the
+ * guide are computed only once, and all the outputs are produced in a single
+ * pass, so this is cheaper than calling guidedFilter() on each channel. dst
+ * can alias src and the guide.
+ */
+void guidedFilter(const array2D<float> &guide,
+                  const std::vector<const array2D<float> *> &src,
+                  const std::vector<array2D<float> *> &dst, int r,
+                  float epsilon, bool multithread, int subsampling = 0);
+
+/**
+ * Joint upsampling of the low resolution planes src (all of the same size)
+ * to the resolution of the guide, by computing the coefficients of the
+ * guided filter at the size of src and applying them to the full resolution
+ * guide. r is expressed in pixels of the guide. dst must have the size of
+ * the guide.
+ */
+void guidedUpsample(const array2D<float> &guide,
+                    const std::vector<const array2D<float> *> &src,
+                    const std::vector<array2D<float> *> &dst, int r,
+                    float epsilon, bool multithread);
+
 void guidedFilterLog(float base, array2D<float> &chan, int r, float eps,
                      bool multithread, int subsampling = 0);
 
@@ -35,4 +59,9 @@ void guidedFilterLog(const array2D<float> &guide, float base,
                      array2D<float> &chan, int r, float eps, bool multithread,
                      int subsampling = 0);
 
+/// multi-channel version of the above, see guidedFilter()
+void guidedFilterLog(const array2D<float> &guide, float base,
+                     const std::vector<array2D<float> *> &chans, int r,
+                     float eps, bool multithread, int subsampling = 0);
+
 } // namespace rtengine
@@ -0,0 +1,203 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "haldclut_kernels.h"
+#include "cpuinfo.h"
+#include <cstring>
+
+// this file is also compiled for the instruction sets in
+// PROC_DISPATCH_TARGETS (see haldclut_avx2.cc), which define
+// ART_SIMD_VARIANT. The baseline build only contains the dispatcher, since
+// clutstore.cc already has an SSE2 version of the interpolation
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_BASE_BUILD
+#endif
+
+#ifndef ART_SIMD_BASE_BUILD
+#include <immintrin.h>
+#endif
+
+namespace rtengine {
+
+namespace haldclut {
+
+#ifndef ART_SIMD_BASE_BUILD
+
+namespace {
+
+#ifdef __AVX512F__
+constexpr int N = 16;
+#else
+constexpr int N = 8;
+#endif
+
+typedef float vec __attribute__((vector_size(N * sizeof(float))));
+typedef int veci __attribute__((vector_size(N * sizeof(int))));
+
+inline vec load(const float *p)
+{
+    vec v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store(float *p, const vec &v) { std::memcpy(p, &v, sizeof(v)); }
+
+inline vec lerp(const vec &t, const vec &hi, const vec &lo)
+{
+    return t * (hi - lo) + lo;
+}
+
+// gathers the 32-bit words at base[idx]
+inline veci gather(const int *base, const veci &idx)
+{
+#ifdef __AVX512F__
+    return (veci)_mm512_i32gather_epi32((__m512i)idx, base, 4);
+#else
+    return (veci)_mm256_i32gather_epi32(base, (__m256i)idx, 4);
+#endif
+}
+
+struct RGB {
+    vec r;
+    vec g;
+    vec b;
+};
+
+// every node is 8 bytes, so two 32-bit gathers fetch red|green and
+// blue|padding of N nodes
+inline RGB fetch(const int *base, const veci &node)
+{
+    const veci rg = gather(base, node * 2);
+    const veci bx = gather(base, node * 2 + 1);
+    return {__builtin_convertvector(rg & 0xffff, vec),
+            __builtin_convertvector((rg >> 16) & 0xffff, vec),
+            __builtin_convertvector(bx & 0xffff, vec)};
+}
+
+inline RGB lerp(const vec &t, const RGB &hi, const RGB &lo)
+{
+    return {lerp(t, hi.r, lo.r), lerp(t, hi.g, lo.g), lerp(t, hi.b, lo.b)};
+}
+
+// interpolation along red of the two nodes of the cell edge starting at
+// node
+inline RGB edge(const int *base, const veci &node, const vec &dr)
+{
+    return lerp(dr, fetch(base, node + 1), fetch(base, node));
+}
+
+inline void axis(const vec &v, const Lattice &lut, veci &cell, vec &frac)
+{
+    const vec zero = vec{} + 0.f;
+    const vec max_cell = zero + lut.max_cell;
+    const vec f = v * lut.scale;
+    vec c = f > zero ? f : zero;
+    c = c < max_cell ? c : max_cell;
+    cell = __builtin_convertvector(c, veci);
+    frac = f - __builtin_convertvector(cell, vec);
+}
+
+void apply_block(const Lattice &lut, float strength, const float *r,
+                 const float *g, const float *b, float *out_r, float *out_g,
+                 float *out_b)
+{
+    const int *base = reinterpret_cast<const int *>(lut.data);
+    const int level = lut.level;
+    const int level_square = level * level;
+
+    const vec vr = load(r);
+    const vec vg = load(g);
+    const vec vb = load(b);
+
+    veci ir, ig, ib;
+    vec dr, dg, db;
+    axis(vr, lut, ir, dr);
+    axis(vg, lut, ig, dg);
+    axis(vb, lut, ib, db);
+
+    const veci node = ir + ig * level + ib * level_square;
+    const RGB lo = lerp(dg, edge(base, node + level, dr), edge(base, node, dr));
+    const RGB hi = lerp(dg, edge(base, node + level + level_square, dr),
+                        edge(base, node + level_square, dr));
+    const RGB out = lerp(db, hi, lo);
+
+    const vec s = vec{} + strength;
+    store(out_r, lerp(s, out.r, vr));
+    store(out_g, lerp(s, out.g, vg));
+    store(out_b, lerp(s, out.b, vb));
+}
+
+void apply(const Lattice &lut, float strength, int n, const float *r,
+           const float *g, const float *b, float *out_r, float *out_g,
+           float *out_b)
+{
+    int i = 0;
+    for (; i + N <= n; i += N) {
+        apply_block(lut, strength, r + i, g + i, b + i, out_r + i, out_g + i,
+                    out_b + i);
+    }
+    if (i < n) {
+        // the last partial block goes through zero-padded copies
+        float tmp[6][N] = {};
+        const std::size_t sz = (n - i) * sizeof(float);
+        std::memcpy(tmp[0], r + i, sz);
+        std::memcpy(tmp[1], g + i, sz);
+        std::memcpy(tmp[2], b + i, sz);
+        apply_block(lut, strength, tmp[0], tmp[1], tmp[2], tmp[3], tmp[4],
+                    tmp[5]);
+        std::memcpy(out_r + i, tmp[3], sz);
+        std::memcpy(out_g + i, tmp[4], sz);
+        std::memcpy(out_b + i, tmp[5], sz);
+    }
+}
+
+} // namespace
+
+void ART_SIMD_VARIANT(fill_kernels)(Kernels &k) { k.apply = apply; }
+
+#else // ART_SIMD_BASE_BUILD
+
+const Kernels &get_kernels()
+{
+    static const Kernels kernels = []() -> Kernels {
+        Kernels k = {nullptr};
+        switch (get_simd_level()) {
+#ifdef ART_SIMD_DISPATCH_AVX512
+        case SIMDLevel::AVX512:
+            fill_kernels_avx512(k);
+            break;
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX2
+        case SIMDLevel::AVX2:
+            fill_kernels_avx2(k);
+            break;
+#endif
+        default:
+            break;
+        }
+        return k;
+    }();
+    return kernels;
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+} // namespace haldclut
+
+} // namespace rtengine
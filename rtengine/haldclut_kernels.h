@@ -0,0 +1,63 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace rtengine {
+
+namespace haldclut {
+
+/// the lattice of a HaldCLUT, as stored by HaldCLUT::load(): level^3 nodes
+/// of 4 uint16 (red, green, blue and padding), red varying fastest
+struct Lattice {
+    const std::uint16_t *data;
+    int level;
+    /// (level - 1) / 65535, maps the input values to lattice coordinates
+    float scale;
+    /// level - 2, the last cell of every axis
+    float max_cell;
+};
+
+// Wider-vector variants of HaldCLUT::getRGB() working on planar rows, with
+// every vector lane interpolating a different pixel. They are compiled for
+// the instruction sets in PROC_DISPATCH_TARGETS (see ProcessorTargets.cmake);
+// the function pointers are null when the processor supports none of them,
+// and the SSE2 code of clutstore.cc is used.
+struct Kernels {
+    /// trilinear interpolation of the n pixels (r, g, b), in [0, 65535],
+    /// blended with the input by strength. The output rows can be the same
+    /// as the input ones
+    void (*apply)(const Lattice &lut, float strength, int n, const float *r,
+                  const float *g, const float *b, float *out_r, float *out_g,
+                  float *out_b);
+};
+
+const Kernels &get_kernels();
+
+#ifdef ART_SIMD_DISPATCH_AVX2
+void fill_kernels_avx2(Kernels &k);
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX512
+void fill_kernels_avx512(Kernels &k);
+#endif
+
+} // namespace haldclut
+
+} // namespace rtengine
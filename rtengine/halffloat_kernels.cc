@@ -0,0 +1,118 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "halffloat_kernels.h"
+#include "cpuinfo.h"
+#include <cstring>
+
+// this file is also compiled with F16C enabled by halffloat_avx2.cc, which
+// defines ART_SIMD_VARIANT. The baseline build only contains the dispatcher
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_BASE_BUILD
+#endif
+
+#ifndef ART_SIMD_BASE_BUILD
+#include <immintrin.h>
+#endif
+
+namespace rtengine {
+
+namespace halffloat {
+
+#ifndef ART_SIMD_BASE_BUILD
+
+namespace {
+
+constexpr int N = 8;
+
+void to_half(const float *src, float scale, int n, std::uint16_t *dst)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    int i = 0;
+    for (; i + N <= n; i += N) {
+        const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), s);
+        const __m128i h = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), h);
+    }
+    if (i < n) {
+        // the last partial block goes through zero-padded copies
+        float tmp[N] = {};
+        std::uint16_t out[N];
+        std::memcpy(tmp, src + i, (n - i) * sizeof(float));
+        const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(tmp), s);
+        const __m128i h = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), h);
+        std::memcpy(dst + i, out, (n - i) * sizeof(std::uint16_t));
+    }
+}
+
+void to_float(const std::uint16_t *src, float scale, int n, float *dst)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    int i = 0;
+    for (; i + N <= n; i += N) {
+        const __m128i h =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtph_ps(h), s));
+    }
+    if (i < n) {
+        std::uint16_t tmp[N] = {};
+        float out[N];
+        std::memcpy(tmp, src + i, (n - i) * sizeof(std::uint16_t));
+        const __m128i h =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(tmp));
+        _mm256_storeu_ps(out, _mm256_mul_ps(_mm256_cvtph_ps(h), s));
+        std::memcpy(dst + i, out, (n - i) * sizeof(float));
+    }
+}
+
+} // namespace
+
+void ART_SIMD_VARIANT(fill_kernels)(Kernels &k)
+{
+    k.to_half = to_half;
+    k.to_float = to_float;
+}
+
+#else // ART_SIMD_BASE_BUILD
+
+const Kernels &get_kernels()
+{
+    static const Kernels kernels = []() -> Kernels {
+        Kernels k = {nullptr, nullptr};
+        switch (get_simd_level()) {
+        case SIMDLevel::AVX512:
+        case SIMDLevel::AVX2:
+#ifdef ART_SIMD_DISPATCH_AVX2
+            fill_kernels_avx2(k);
+#endif
+            break;
+        default:
+            break;
+        }
+        return k;
+    }();
+    return kernels;
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+} // namespace halffloat
+
+} // namespace rtengine
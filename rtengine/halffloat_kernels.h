@@ -0,0 +1,49 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+
+namespace rtengine {
+
+namespace halffloat {
+
+// F16C conversions of rows between float and binary16, used by HalfImage.
+// They are compiled only for the AVX2 target of PROC_DISPATCH_TARGETS (see
+// ProcessorTargets.cmake), every processor supporting AVX2 also has F16C;
+// the function pointers are null otherwise, and the scalar DNG_FloatToHalf()
+// and DNG_HalfToFloat() of halffloat.h are used.
+struct Kernels {
+    /// dst[i] = binary16(src[i] * scale), rounded to nearest
+    void (*to_half)(const float *src, float scale, int n, std::uint16_t *dst);
+    /// dst[i] = float(src[i]) * scale
+    void (*to_float)(const std::uint16_t *src, float scale, int n,
+                     float *dst);
+};
+
+const Kernels &get_kernels();
+
+#ifdef ART_SIMD_DISPATCH_AVX2
+void fill_kernels_avx2(Kernels &k);
+#endif
+
+} // namespace halffloat
+
+} // namespace rtengine
@@ -0,0 +1,115 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "halfimage.h"
+#include "halffloat.h"
+#include "halffloat_kernels.h"
+
+namespace rtengine {
+
+namespace {
+
+// the values are scaled to [0, 1] before the conversion, so that the whole
+// range of the image [0, 65535] (and some headroom) stays below the largest
+// binary16 number (65504)
+constexpr float TO_HALF = 1.f / 65535.f;
+constexpr float TO_FLOAT = 65535.f;
+
+void to_half(const float *src, int n, std::uint16_t *dst)
+{
+    const auto &k = halffloat::get_kernels();
+    if (k.to_half) {
+        k.to_half(src, TO_HALF, n, dst);
+    } else {
+        for (int i = 0; i < n; ++i) {
+            dst[i] = DNG_FloatToHalf(src[i] * TO_HALF);
+        }
+    }
+}
+
+void to_float(const std::uint16_t *src, int n, float *dst)
+{
+    const auto &k = halffloat::get_kernels();
+    if (k.to_float) {
+        k.to_float(src, TO_FLOAT, n, dst);
+    } else {
+        for (int i = 0; i < n; ++i) {
+            dst[i] = DNG_HalfToFloat(src[i]) * TO_FLOAT;
+        }
+    }
+}
+
+} // namespace
+
+HalfImage::HalfImage(const Imagefloat *src, int x, int y, int w, int h,
+                     bool multithread)
+    : width_(w), height_(h), mode_(src->mode()),
+      color_space_(src->colorSpace())
+{
+    const size_t sz = size_t(w) * size_t(h);
+    for (auto &p : planes_) {
+        p.resize(sz);
+    }
+
+    float *const *chan[3] = {src->r.ptrs, src->g.ptrs, src->b.ptrs};
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int row = 0; row < h; ++row) {
+        for (int c = 0; c < 3; ++c) {
+            to_half(chan[c][row + y] + x, w,
+                    &planes_[c][size_t(row) * size_t(w)]);
+        }
+    }
+}
+
+HalfImage::HalfImage(const Imagefloat *src, bool multithread)
+    : HalfImage(src, 0, 0, src->getWidth(), src->getHeight(), multithread)
+{
+}
+
+size_t HalfImage::getMemorySize() const
+{
+    return 3 * planes_[0].size() * sizeof(std::uint16_t);
+}
+
+void HalfImage::copyTo(Imagefloat *dst, bool multithread) const
+{
+    copyTo(dst, 0, 0, multithread);
+    dst->assignColorSpace(color_space_);
+    dst->assignMode(mode_);
+}
+
+void HalfImage::copyTo(Imagefloat *dst, int x, int y, bool multithread) const
+{
+    float *const *chan[3] = {dst->r.ptrs, dst->g.ptrs, dst->b.ptrs};
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int row = 0; row < height_; ++row) {
+        for (int c = 0; c < 3; ++c) {
+            to_float(&planes_[c][size_t(row) * size_t(width_)], width_,
+                     chan[c][row + y] + x);
+        }
+    }
+}
+
+} // namespace rtengine
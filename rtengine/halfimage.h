@@ -0,0 +1,65 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "imagefloat.h"
+#include "noncopyable.h"
+#include <cstdint>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Copy of (a region of) an Imagefloat with the planes stored as binary16,
+ * i.e. in half the memory. Meant for the images that are kept aside while
+ * the pipeline works on something else (see settings->half_float_buffers):
+ * the values keep 11 significant bits, which is plenty for display and for
+ * most of the output, but the round trip is not lossless.
+ *
+ * The conversions use F16C when the processor supports it (see
+ * halffloat_kernels.h).
+ */
+class HalfImage: public NonCopyable {
+public:
+    /// copies the w x h region of src at (x, y)
+    HalfImage(const Imagefloat *src, int x, int y, int w, int h,
+              bool multithread);
+    explicit HalfImage(const Imagefloat *src, bool multithread);
+
+    int getWidth() const { return width_; }
+    int getHeight() const { return height_; }
+    size_t getMemorySize() const;
+
+    /// copies the image to dst, which must be of the same size, together
+    /// with its mode and colour space
+    void copyTo(Imagefloat *dst, bool multithread) const;
+    /// copies the pixels to the region of dst at (x, y), leaving its mode and
+    /// colour space alone
+    void copyTo(Imagefloat *dst, int x, int y, bool multithread) const;
+
+private:
+    int width_;
+    int height_;
+    Imagefloat::Mode mode_;
+    Glib::ustring color_space_;
+    std::vector<std::uint16_t> planes_[3];
+};
+
+} // namespace rtengine
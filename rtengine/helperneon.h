@@ -0,0 +1,603 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The subset of the SSE2 intrinsics used by ART, implemented with NEON for
+// 64-bit Arm (e.g. Apple Silicon), so that the __SSE2__ code paths can be
+// compiled on those processors as well. Included by helpersse2.h in place of
+// <x86intrin.h>; the build defines __SSE2__ on aarch64 (see CMakeLists.txt).
+//
+// The vector types keep the lane layout of the GCC x86 definitions
+// (__m128i is made of two 64-bit integers), so that the vector operators
+// used by the code behave the same. The SSE4.1, AVX and F16C intrinsics are
+// not provided, the code using them is never enabled on Arm.
+
+#pragma once
+
+#ifndef __aarch64__
+#error helperneon.h is only for 64-bit Arm
+#endif
+
+#include <arm_neon.h>
+#include <stdint.h>
+
+typedef float32x4_t __m128;
+typedef int64x2_t __m128i;
+typedef float64x2_t __m128d;
+
+#define ART_NEON_INLINE static inline __attribute__((always_inline))
+
+#define ART_F2U(a) vreinterpretq_u32_f32(a)
+#define ART_U2F(a) vreinterpretq_f32_u32(a)
+#define ART_I2S32(a) vreinterpretq_s32_s64(a)
+#define ART_S322I(a) vreinterpretq_s64_s32(a)
+#define ART_D2U(a) vreinterpretq_u64_f64(a)
+#define ART_U2D(a) vreinterpretq_f64_u64(a)
+
+#define _MM_SHUFFLE(z, y, x, w) (((z) << 6) | ((y) << 4) | ((x) << 2) | (w))
+
+//-----------------------------------------------------------------------------
+// float
+//-----------------------------------------------------------------------------
+
+ART_NEON_INLINE __m128 _mm_setzero_ps() { return vdupq_n_f32(0.f); }
+ART_NEON_INLINE __m128 _mm_set1_ps(float a) { return vdupq_n_f32(a); }
+
+ART_NEON_INLINE __m128 _mm_set_ps(float e3, float e2, float e1, float e0)
+{
+    const float v[4] = {e0, e1, e2, e3};
+    return vld1q_f32(v);
+}
+
+ART_NEON_INLINE __m128 _mm_setr_ps(float e0, float e1, float e2, float e3)
+{
+    const float v[4] = {e0, e1, e2, e3};
+    return vld1q_f32(v);
+}
+
+ART_NEON_INLINE __m128 _mm_set_ss(float a)
+{
+    return vsetq_lane_f32(a, vdupq_n_f32(0.f), 0);
+}
+
+ART_NEON_INLINE __m128 _mm_load_ps(const float *p) { return vld1q_f32(p); }
+ART_NEON_INLINE __m128 _mm_loadu_ps(const float *p) { return vld1q_f32(p); }
+
+ART_NEON_INLINE __m128 _mm_load_ss(const float *p)
+{
+    return vsetq_lane_f32(*p, vdupq_n_f32(0.f), 0);
+}
+
+ART_NEON_INLINE void _mm_store_ps(float *p, __m128 a) { vst1q_f32(p, a); }
+ART_NEON_INLINE void _mm_storeu_ps(float *p, __m128 a) { vst1q_f32(p, a); }
+
+ART_NEON_INLINE float _mm_cvtss_f32(__m128 a) { return vgetq_lane_f32(a, 0); }
+
+ART_NEON_INLINE __m128 _mm_add_ss(__m128 a, __m128 b)
+{
+    return vsetq_lane_f32(vgetq_lane_f32(a, 0) + vgetq_lane_f32(b, 0), a, 0);
+}
+
+ART_NEON_INLINE __m128 _mm_and_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vandq_u32(ART_F2U(a), ART_F2U(b)));
+}
+
+ART_NEON_INLINE __m128 _mm_andnot_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vbicq_u32(ART_F2U(b), ART_F2U(a)));
+}
+
+// same as SSE: the second operand is returned if any of the two is NaN
+ART_NEON_INLINE __m128 _mm_min_ps(__m128 a, __m128 b)
+{
+    return vbslq_f32(vcltq_f32(a, b), a, b);
+}
+
+ART_NEON_INLINE __m128 _mm_max_ps(__m128 a, __m128 b)
+{
+    return vbslq_f32(vcgtq_f32(a, b), a, b);
+}
+
+ART_NEON_INLINE __m128 _mm_sqrt_ps(__m128 a) { return vsqrtq_f32(a); }
+
+// one Newton-Raphson step brings the estimate to the precision of rcpps
+ART_NEON_INLINE __m128 _mm_rcp_ps(__m128 a)
+{
+    const float32x4_t r = vrecpeq_f32(a);
+    return vmulq_f32(r, vrecpsq_f32(a, r));
+}
+
+ART_NEON_INLINE __m128 _mm_cmpeq_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vceqq_f32(a, b));
+}
+
+ART_NEON_INLINE __m128 _mm_cmpneq_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vmvnq_u32(vceqq_f32(a, b)));
+}
+
+ART_NEON_INLINE __m128 _mm_cmplt_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vcltq_f32(a, b));
+}
+
+ART_NEON_INLINE __m128 _mm_cmple_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vcleq_f32(a, b));
+}
+
+ART_NEON_INLINE __m128 _mm_cmpgt_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vcgtq_f32(a, b));
+}
+
+ART_NEON_INLINE __m128 _mm_cmpge_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(vcgeq_f32(a, b));
+}
+
+ART_NEON_INLINE __m128 _mm_cmpunord_ps(__m128 a, __m128 b)
+{
+    return ART_U2F(
+        vmvnq_u32(vandq_u32(vceqq_f32(a, a), vceqq_f32(b, b))));
+}
+
+ART_NEON_INLINE int _mm_movemask_ps(__m128 a)
+{
+    static const int32_t shift[4] = {0, 1, 2, 3};
+    const uint32x4_t sign = vshrq_n_u32(ART_F2U(a), 31);
+    return vaddvq_u32(vshlq_u32(sign, vld1q_s32(shift)));
+}
+
+ART_NEON_INLINE __m128 _mm_unpacklo_ps(__m128 a, __m128 b)
+{
+    return vzip1q_f32(a, b);
+}
+
+ART_NEON_INLINE __m128 _mm_unpackhi_ps(__m128 a, __m128 b)
+{
+    return vzip2q_f32(a, b);
+}
+
+ART_NEON_INLINE __m128 _mm_movelh_ps(__m128 a, __m128 b)
+{
+    return vcombine_f32(vget_low_f32(a), vget_low_f32(b));
+}
+
+ART_NEON_INLINE __m128 _mm_movehl_ps(__m128 a, __m128 b)
+{
+    return vcombine_f32(vget_high_f32(b), vget_high_f32(a));
+}
+
+#ifdef __clang__
+#define _mm_shuffle_ps(a, b, imm)                                              \
+    __builtin_shufflevector((__m128)(a), (__m128)(b), (imm)&3,                 \
+                            ((imm) >> 2) & 3, (((imm) >> 4) & 3) + 4,          \
+                            (((imm) >> 6) & 3) + 4)
+#else
+#define _mm_shuffle_ps(a, b, imm)                                              \
+    __builtin_shuffle((__m128)(a), (__m128)(b),                                \
+                      (uint32x4_t){(imm)&3, ((imm) >> 2) & 3,                  \
+                                   (((imm) >> 4) & 3) + 4,                     \
+                                   (((imm) >> 6) & 3) + 4})
+#endif
+
+#define _MM_TRANSPOSE4_PS(row0, row1, row2, row3)                              \
+    do {                                                                       \
+        const __m128 t0_ = _mm_unpacklo_ps((row0), (row1));                    \
+        const __m128 t1_ = _mm_unpackhi_ps((row0), (row1));                    \
+        const __m128 t2_ = _mm_unpacklo_ps((row2), (row3));                    \
+        const __m128 t3_ = _mm_unpackhi_ps((row2), (row3));                    \
+        (row0) = _mm_movelh_ps(t0_, t2_);                                      \
+        (row1) = _mm_movehl_ps(t2_, t0_);                                      \
+        (row2) = _mm_movelh_ps(t1_, t3_);                                      \
+        (row3) = _mm_movehl_ps(t3_, t1_);                                      \
+    } while (0)
+
+//-----------------------------------------------------------------------------
+// conversions and casts
+//-----------------------------------------------------------------------------
+
+ART_NEON_INLINE __m128 _mm_cvtepi32_ps(__m128i a)
+{
+    return vcvtq_f32_s32(ART_I2S32(a));
+}
+
+// rounds to nearest even, the default rounding mode of SSE
+ART_NEON_INLINE __m128i _mm_cvtps_epi32(__m128 a)
+{
+    return ART_S322I(vcvtnq_s32_f32(a));
+}
+
+ART_NEON_INLINE __m128i _mm_cvttps_epi32(__m128 a)
+{
+    return ART_S322I(vcvtq_s32_f32(a));
+}
+
+ART_NEON_INLINE int _mm_cvt_ss2si(__m128 a)
+{
+    return vgetq_lane_s32(vcvtnq_s32_f32(a), 0);
+}
+
+ART_NEON_INLINE __m128 _mm_castsi128_ps(__m128i a)
+{
+    return vreinterpretq_f32_s64(a);
+}
+
+ART_NEON_INLINE __m128i _mm_castps_si128(__m128 a)
+{
+    return vreinterpretq_s64_f32(a);
+}
+
+ART_NEON_INLINE __m128 _mm_castpd_ps(__m128d a)
+{
+    return vreinterpretq_f32_f64(a);
+}
+
+//-----------------------------------------------------------------------------
+// integer
+//-----------------------------------------------------------------------------
+
+ART_NEON_INLINE __m128i _mm_setzero_si128() { return vdupq_n_s64(0); }
+
+ART_NEON_INLINE __m128i _mm_set1_epi32(int a)
+{
+    return ART_S322I(vdupq_n_s32(a));
+}
+
+ART_NEON_INLINE __m128i _mm_set1_epi8(char a)
+{
+    return vreinterpretq_s64_s8(vdupq_n_s8(a));
+}
+
+ART_NEON_INLINE __m128i _mm_set_epi32(int e3, int e2, int e1, int e0)
+{
+    const int32_t v[4] = {e0, e1, e2, e3};
+    return ART_S322I(vld1q_s32(v));
+}
+
+ART_NEON_INLINE __m128i _mm_cvtsi32_si128(int a)
+{
+    return ART_S322I(vsetq_lane_s32(a, vdupq_n_s32(0), 0));
+}
+
+ART_NEON_INLINE int _mm_cvtsi128_si32(__m128i a)
+{
+    return vgetq_lane_s32(ART_I2S32(a), 0);
+}
+
+ART_NEON_INLINE __m128i _mm_load_si128(const __m128i *p)
+{
+    return vreinterpretq_s64_u8(vld1q_u8(reinterpret_cast<const uint8_t *>(p)));
+}
+
+ART_NEON_INLINE __m128i _mm_loadu_si128(const __m128i *p)
+{
+    return vreinterpretq_s64_u8(vld1q_u8(reinterpret_cast<const uint8_t *>(p)));
+}
+
+ART_NEON_INLINE void _mm_store_si128(__m128i *p, __m128i a)
+{
+    vst1q_u8(reinterpret_cast<uint8_t *>(p), vreinterpretq_u8_s64(a));
+}
+
+ART_NEON_INLINE void _mm_storeu_si128(__m128i *p, __m128i a)
+{
+    vst1q_u8(reinterpret_cast<uint8_t *>(p), vreinterpretq_u8_s64(a));
+}
+
+ART_NEON_INLINE __m128i _mm_add_epi32(__m128i a, __m128i b)
+{
+    return ART_S322I(vaddq_s32(ART_I2S32(a), ART_I2S32(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_sub_epi32(__m128i a, __m128i b)
+{
+    return ART_S322I(vsubq_s32(ART_I2S32(a), ART_I2S32(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_and_si128(__m128i a, __m128i b)
+{
+    return vandq_s64(a, b);
+}
+
+ART_NEON_INLINE __m128i _mm_andnot_si128(__m128i a, __m128i b)
+{
+    return vbicq_s64(b, a);
+}
+
+ART_NEON_INLINE __m128i _mm_or_si128(__m128i a, __m128i b)
+{
+    return vorrq_s64(a, b);
+}
+
+ART_NEON_INLINE __m128i _mm_xor_si128(__m128i a, __m128i b)
+{
+    return veorq_s64(a, b);
+}
+
+ART_NEON_INLINE __m128i _mm_cmpeq_epi32(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_u32(vceqq_s32(ART_I2S32(a), ART_I2S32(b)));
+}
+
+// the shift counts don't need to be constants, as with SSE
+ART_NEON_INLINE __m128i _mm_slli_epi32(__m128i a, int c)
+{
+    return vreinterpretq_s64_u32(
+        vshlq_u32(vreinterpretq_u32_s64(a), vdupq_n_s32(c)));
+}
+
+ART_NEON_INLINE __m128i _mm_srli_epi32(__m128i a, int c)
+{
+    return vreinterpretq_s64_u32(
+        vshlq_u32(vreinterpretq_u32_s64(a), vdupq_n_s32(-c)));
+}
+
+ART_NEON_INLINE __m128i _mm_srai_epi32(__m128i a, int c)
+{
+    return ART_S322I(vshlq_s32(ART_I2S32(a), vdupq_n_s32(-(c > 31 ? 31 : c))));
+}
+
+ART_NEON_INLINE __m128i _mm_unpacklo_epi8(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_s8(
+        vzip1q_s8(vreinterpretq_s8_s64(a), vreinterpretq_s8_s64(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_unpacklo_epi16(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_s16(
+        vzip1q_s16(vreinterpretq_s16_s64(a), vreinterpretq_s16_s64(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_unpacklo_epi32(__m128i a, __m128i b)
+{
+    return ART_S322I(vzip1q_s32(ART_I2S32(a), ART_I2S32(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_unpacklo_epi64(__m128i a, __m128i b)
+{
+    return vzip1q_s64(a, b);
+}
+
+ART_NEON_INLINE __m128i _mm_unpackhi_epi64(__m128i a, __m128i b)
+{
+    return vzip2q_s64(a, b);
+}
+
+ART_NEON_INLINE __m128i _mm_max_epu8(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_u8(
+        vmaxq_u8(vreinterpretq_u8_s64(a), vreinterpretq_u8_s64(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_adds_epi8(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_s8(
+        vqaddq_s8(vreinterpretq_s8_s64(a), vreinterpretq_s8_s64(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_adds_epu8(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_u8(
+        vqaddq_u8(vreinterpretq_u8_s64(a), vreinterpretq_u8_s64(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_subs_epu8(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_u8(
+        vqsubq_u8(vreinterpretq_u8_s64(a), vreinterpretq_u8_s64(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_cmpgt_epi8(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_u8(
+        vcgtq_s8(vreinterpretq_s8_s64(a), vreinterpretq_s8_s64(b)));
+}
+
+ART_NEON_INLINE __m128i _mm_cmplt_epi8(__m128i a, __m128i b)
+{
+    return vreinterpretq_s64_u8(
+        vcltq_s8(vreinterpretq_s8_s64(a), vreinterpretq_s8_s64(b)));
+}
+
+#ifdef __clang__
+#define _mm_shuffle_epi32(a, imm)                                              \
+    vreinterpretq_s64_s32(__builtin_shufflevector(                             \
+        vreinterpretq_s32_s64(a), vreinterpretq_s32_s64(a), (imm)&3,           \
+        ((imm) >> 2) & 3, ((imm) >> 4) & 3, ((imm) >> 6) & 3))
+#define _mm_shufflelo_epi16(a, imm)                                            \
+    vreinterpretq_s64_s16(__builtin_shufflevector(                             \
+        vreinterpretq_s16_s64(a), vreinterpretq_s16_s64(a), (imm)&3,           \
+        ((imm) >> 2) & 3, ((imm) >> 4) & 3, ((imm) >> 6) & 3, 4, 5, 6, 7))
+#define _mm_shufflehi_epi16(a, imm)                                            \
+    vreinterpretq_s64_s16(__builtin_shufflevector(                             \
+        vreinterpretq_s16_s64(a), vreinterpretq_s16_s64(a), 0, 1, 2, 3,        \
+        ((imm)&3) + 4, (((imm) >> 2) & 3) + 4, (((imm) >> 4) & 3) + 4,         \
+        (((imm) >> 6) & 3) + 4))
+#else
+#define _mm_shuffle_epi32(a, imm)                                              \
+    vreinterpretq_s64_s32(__builtin_shuffle(                                   \
+        vreinterpretq_s32_s64(a),                                              \
+        (uint32x4_t){(imm)&3, ((imm) >> 2) & 3, ((imm) >> 4) & 3,              \
+                     ((imm) >> 6) & 3}))
+#define _mm_shufflelo_epi16(a, imm)                                            \
+    vreinterpretq_s64_s16(__builtin_shuffle(                                   \
+        vreinterpretq_s16_s64(a),                                              \
+        (uint16x8_t){(imm)&3, ((imm) >> 2) & 3, ((imm) >> 4) & 3,              \
+                     ((imm) >> 6) & 3, 4, 5, 6, 7}))
+#define _mm_shufflehi_epi16(a, imm)                                            \
+    vreinterpretq_s64_s16(__builtin_shuffle(                                   \
+        vreinterpretq_s16_s64(a),                                              \
+        (uint16x8_t){0, 1, 2, 3, ((imm)&3) + 4, (((imm) >> 2) & 3) + 4,        \
+                     (((imm) >> 4) & 3) + 4, (((imm) >> 6) & 3) + 4}))
+#endif
+
+//-----------------------------------------------------------------------------
+// double
+//-----------------------------------------------------------------------------
+
+ART_NEON_INLINE __m128d _mm_set_pd(double e1, double e0)
+{
+    const double v[2] = {e0, e1};
+    return vld1q_f64(v);
+}
+
+ART_NEON_INLINE __m128d _mm_load_sd(const double *p)
+{
+    return vsetq_lane_f64(*p, vdupq_n_f64(0.0), 0);
+}
+
+ART_NEON_INLINE void _mm_storeu_pd(double *p, __m128d a) { vst1q_f64(p, a); }
+
+ART_NEON_INLINE __m128d _mm_add_pd(__m128d a, __m128d b)
+{
+    return vaddq_f64(a, b);
+}
+
+ART_NEON_INLINE __m128d _mm_sub_pd(__m128d a, __m128d b)
+{
+    return vsubq_f64(a, b);
+}
+
+ART_NEON_INLINE __m128d _mm_mul_pd(__m128d a, __m128d b)
+{
+    return vmulq_f64(a, b);
+}
+
+ART_NEON_INLINE __m128d _mm_div_pd(__m128d a, __m128d b)
+{
+    return vdivq_f64(a, b);
+}
+
+ART_NEON_INLINE __m128d _mm_sqrt_pd(__m128d a) { return vsqrtq_f64(a); }
+
+ART_NEON_INLINE __m128d _mm_min_pd(__m128d a, __m128d b)
+{
+    return vbslq_f64(vcltq_f64(a, b), a, b);
+}
+
+ART_NEON_INLINE __m128d _mm_max_pd(__m128d a, __m128d b)
+{
+    return vbslq_f64(vcgtq_f64(a, b), a, b);
+}
+
+ART_NEON_INLINE __m128d _mm_and_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(vandq_u64(ART_D2U(a), ART_D2U(b)));
+}
+
+ART_NEON_INLINE __m128d _mm_andnot_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(vbicq_u64(ART_D2U(b), ART_D2U(a)));
+}
+
+ART_NEON_INLINE __m128d _mm_xor_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(veorq_u64(ART_D2U(a), ART_D2U(b)));
+}
+
+ART_NEON_INLINE __m128d _mm_cmpeq_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(vceqq_f64(a, b));
+}
+
+ART_NEON_INLINE __m128d _mm_cmpneq_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(veorq_u64(vceqq_f64(a, b), vdupq_n_u64(~uint64_t(0))));
+}
+
+ART_NEON_INLINE __m128d _mm_cmplt_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(vcltq_f64(a, b));
+}
+
+ART_NEON_INLINE __m128d _mm_cmple_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(vcleq_f64(a, b));
+}
+
+ART_NEON_INLINE __m128d _mm_cmpgt_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(vcgtq_f64(a, b));
+}
+
+ART_NEON_INLINE __m128d _mm_cmpge_pd(__m128d a, __m128d b)
+{
+    return ART_U2D(vcgeq_f64(a, b));
+}
+
+ART_NEON_INLINE __m128 _mm_cvtpd_ps(__m128d a)
+{
+    return vcombine_f32(vcvt_f32_f64(a), vdup_n_f32(0.f));
+}
+
+ART_NEON_INLINE __m128i _mm_cvtpd_epi32(__m128d a)
+{
+    return ART_S322I(
+        vcombine_s32(vqmovn_s64(vcvtnq_s64_f64(a)), vdup_n_s32(0)));
+}
+
+ART_NEON_INLINE __m128i _mm_cvttpd_epi32(__m128d a)
+{
+    return ART_S322I(vcombine_s32(vqmovn_s64(vcvtq_s64_f64(a)), vdup_n_s32(0)));
+}
+
+ART_NEON_INLINE __m128d _mm_cvtepi32_pd(__m128i a)
+{
+    return vcvtq_f64_s64(vmovl_s32(vget_low_s32(ART_I2S32(a))));
+}
+
+//-----------------------------------------------------------------------------
+// flush to zero (the FZ bit of FPCR)
+//-----------------------------------------------------------------------------
+
+#define _MM_FLUSH_ZERO_MASK 0x8000
+#define _MM_FLUSH_ZERO_ON 0x8000
+#define _MM_FLUSH_ZERO_OFF 0x0000
+
+ART_NEON_INLINE unsigned int art_neon_get_flush_zero_mode()
+{
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    return (fpcr & (uint64_t(1) << 24)) ? _MM_FLUSH_ZERO_ON : _MM_FLUSH_ZERO_OFF;
+}
+
+ART_NEON_INLINE void art_neon_set_flush_zero_mode(unsigned int mode)
+{
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    if (mode == _MM_FLUSH_ZERO_ON) {
+        fpcr |= uint64_t(1) << 24;
+    } else {
+        fpcr &= ~(uint64_t(1) << 24);
+    }
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+}
+
+#define _MM_GET_FLUSH_ZERO_MODE() art_neon_get_flush_zero_mode()
+#define _MM_SET_FLUSH_ZERO_MODE(mode) art_neon_set_flush_zero_mode(mode)
+
+#undef ART_F2U
+#undef ART_U2F
+#undef ART_I2S32
+#undef ART_S322I
+#undef ART_D2U
+#undef ART_U2D
@@ -22,7 +22,11 @@
 #define INLINE inline
 #endif
 
+#ifdef __aarch64__
+#include "helperneon.h"
+#else
 #include <x86intrin.h>
+#endif
 
 #include <stdint.h>
 
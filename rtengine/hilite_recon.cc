@@ -24,9 +24,11 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <cstring>
 
 #include "array2D.h"
 #include "guidedfilter.h"
@@ -456,6 +458,7 @@ void RawImageSource::HLRecovery_inpaint(int blur)
     miny = std::max(0, miny - blurBorder);
     maxx = std::min(width - 1, maxx + blurBorder);
     maxy = std::min(height - 1, maxy + blurBorder);
+    hlSaveRegion(minx, miny, maxx, maxy);
     const int blurWidth = maxx - minx + 1;
     const int blurHeight = maxy - miny + 1;
     const int bufferWidth = blurWidth + ((16 - (blurWidth % 16)) & 15);
@@ -1381,19 +1384,10 @@ void RawImageSource::HLRecovery_inpaint(int blur)
         }
         if (blur > 0) { // no use of 2nd guidedFilter if Blur = 0 (slider to
                         // 1)..speed-up and very small differences.
-            guidedFilter(guide, rbuf, rbuf, rad2, 0.01f * 65535.f, true, 1);
+            guidedFilter(guide, {&rbuf, &gbuf, &bbuf}, {&rbuf, &gbuf, &bbuf},
+                         rad2, 0.01f * 65535.f, true, 1);
             if (plistener) {
-                progress += 0.03;
-                plistener->setProgress(progress);
-            }
-            guidedFilter(guide, gbuf, gbuf, rad2, 0.01f * 65535.f, true, 1);
-            if (plistener) {
-                progress += 0.03;
-                plistener->setProgress(progress);
-            }
-            guidedFilter(guide, bbuf, bbuf, rad2, 0.01f * 65535.f, true, 1);
-            if (plistener) {
-                progress += 0.03;
+                progress += 0.09;
                 plistener->setProgress(progress);
             }
         }
@@ -1579,6 +1573,10 @@ void RawImageSource::highlight_recovery_opposed(float scale_mul[3],
                                 clips[2] / scalecoeffs[2]};
 
     int x1 = W, y1 = H, x2 = 0, y2 = 0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(min : x1, y1) reduction(max : x2, y2)      \
+    reduction(|| : anyclipped) schedule(dynamic, 16)
+#endif
     for (int y = 0; y < H; ++y) {
         for (int x = 0; x < W; ++x) {
             for (int c = 0; c < 3; ++c) {
@@ -1604,6 +1602,7 @@ void RawImageSource::highlight_recovery_opposed(float scale_mul[3],
     x2 = std::min(x2 + 1, W - 1);
     y1 = std::max(y1 - 1, 0);
     y2 = std::min(y2 + 1, H - 1);
+    hlSaveRegion(x1, y1, x2, y2);
 
     const int cW = x2 - x1 + 1;
     const int cH = y2 - y1 + 1;
@@ -1773,4 +1772,104 @@ void RawImageSource::highlight_recovery_opposed(float scale_mul[3],
     }
 }
 
+void RawImageSource::hlSaveRegion(int x1, int y1, int x2, int y2)
+{
+    constexpr int T = HLBackup::TILE;
+
+    hlBackup.tiles.clear();
+    for (int y = y1 / T * T; y <= y2; y += T) {
+        for (int x = x1 / T * T; x <= x2; x += T) {
+            hlBackup.tiles.emplace_back(x, y);
+        }
+    }
+    hlBackup.data.resize(hlBackup.tiles.size() * 3 * T * T);
+
+    float **chan[3] = {red, green, blue};
+    const int n = hlBackup.tiles.size();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < n; ++i) {
+        const int x = hlBackup.tiles[i].first;
+        const int y = hlBackup.tiles[i].second;
+        const int w = std::min(T, W - x);
+        const int h = std::min(T, H - y);
+        float *dst = &hlBackup.data[size_t(i) * 3 * T * T];
+        for (int c = 0; c < 3; ++c) {
+            for (int yy = 0; yy < h; ++yy) {
+                memcpy(dst + (c * T + yy) * T, chan[c][y + yy] + x,
+                       w * sizeof(float));
+            }
+        }
+    }
+}
+
+void RawImageSource::hlDropUnchanged()
+{
+    constexpr int T = HLBackup::TILE;
+
+    float **chan[3] = {red, green, blue};
+    const int n = hlBackup.tiles.size();
+    std::vector<char> changed(n, false);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < n; ++i) {
+        const int x = hlBackup.tiles[i].first;
+        const int y = hlBackup.tiles[i].second;
+        const int w = std::min(T, W - x);
+        const int h = std::min(T, H - y);
+        const float *src = &hlBackup.data[size_t(i) * 3 * T * T];
+        for (int c = 0; c < 3 && !changed[i]; ++c) {
+            for (int yy = 0; yy < h && !changed[i]; ++yy) {
+                changed[i] = memcmp(src + (c * T + yy) * T,
+                                    chan[c][y + yy] + x,
+                                    w * sizeof(float)) != 0;
+            }
+        }
+    }
+
+    int k = 0;
+    for (int i = 0; i < n; ++i) {
+        if (changed[i]) {
+            if (k != i) {
+                hlBackup.tiles[k] = hlBackup.tiles[i];
+                std::copy_n(&hlBackup.data[size_t(i) * 3 * T * T], 3 * T * T,
+                            &hlBackup.data[size_t(k) * 3 * T * T]);
+            }
+            ++k;
+        }
+    }
+    hlBackup.tiles.resize(k);
+    hlBackup.tiles.shrink_to_fit();
+    hlBackup.data.resize(size_t(k) * 3 * T * T);
+    hlBackup.data.shrink_to_fit();
+}
+
+void RawImageSource::hlRestore()
+{
+    constexpr int T = HLBackup::TILE;
+
+    float **chan[3] = {red, green, blue};
+    const int n = hlBackup.tiles.size();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < n; ++i) {
+        const int x = hlBackup.tiles[i].first;
+        const int y = hlBackup.tiles[i].second;
+        const int w = std::min(T, W - x);
+        const int h = std::min(T, H - y);
+        const float *src = &hlBackup.data[size_t(i) * 3 * T * T];
+        for (int c = 0; c < 3; ++c) {
+            for (int yy = 0; yy < h; ++yy) {
+                memcpy(chan[c][y + yy] + x, src + (c * T + yy) * T,
+                       w * sizeof(float));
+            }
+        }
+    }
+
+    hlBackup = HLBackup();
+}
+
 } // namespace rtengine
@@ -19,7 +19,9 @@
  */
 
 #include "../rtgui/mydiagonalcurve.h"
+#include "../rtgui/options.h"
 #include "array2D.h"
+#include "calibcache.h"
 #include "color.h"
 #include "curves.h"
 #include "iccstore.h"
@@ -29,7 +31,11 @@
 #include "rtthumbnail.h"
 // #define BENCHMARK
 // #include "StopWatch.h"
+#include <cstring>
+#include <glib/gstdio.h>
+#include <glibmm.h>
 #include <iostream>
+#include <unistd.h>
 
 namespace rtengine {
 
@@ -417,6 +423,161 @@ double get_expcomp(const FramesMetaData *md)
     return 0.0;
 }
 
+
+// bump when the format of the files, or the computation of the curves,
+// changes
+constexpr uint32_t CACHE_VERSION = 1;
+constexpr char CACHE_MAGIC[4] = {'A', 'R', 'H', 'M'};
+
+void put_u32(std::string &out, uint32_t v)
+{
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+void put_curve(std::string &out, const std::vector<double> &c)
+{
+    put_u32(out, c.size());
+    out.append(reinterpret_cast<const char *>(c.data()),
+               c.size() * sizeof(double));
+}
+
+bool get_u32(const std::string &in, size_t &pos, uint32_t &v)
+{
+    if (pos + sizeof(v) > in.size()) {
+        return false;
+    }
+    memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
+
+bool get_curve(const std::string &in, size_t &pos, std::vector<double> &c)
+{
+    uint32_t n;
+    if (!get_u32(in, pos, n) || n == 0 ||
+        pos + size_t(n) * sizeof(double) > in.size()) {
+        return false;
+    }
+    c.resize(n);
+    memcpy(c.data(), in.data() + pos, n * sizeof(double));
+    pos += n * sizeof(double);
+    return true;
+}
+
+// writes to a temporary file first, so that concurrent readers (possibly in
+// other processes) never see a partial file
+bool write_file(const Glib::ustring &fname, const std::string &data)
+{
+    std::string tmp = fname + ".XXXXXX";
+    const int fd = Glib::mkstemp(tmp);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    FILE *f = g_fopen(tmp.c_str(), "wb");
+    if (!f) {
+        g_remove(tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok && g_rename(tmp.c_str(), fname.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(fname.c_str());
+        ok = g_rename(tmp.c_str(), fname.c_str()) == 0;
+    }
+    if (!ok) {
+        g_remove(tmp.c_str());
+    }
+    return ok;
+}
+
+Glib::ustring cache_dir()
+{
+    return Glib::build_filename(options.cacheBaseDir, "histmatching");
+}
+
+Glib::ustring cache_file(const std::string &key)
+{
+    return Glib::build_filename(
+        cache_dir(),
+        Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, key));
+}
+
+// identifies the raw file (by its size and modification time) and the input
+// profile settings the curves are matched with; empty if the file doesn't
+// exist
+std::string cache_key(const Glib::ustring &fname,
+                      const ColorManagementParams &cp)
+{
+    const auto stamp = CalibrationCache::stamp(fname);
+    if (stamp.empty()) {
+        return "";
+    }
+    return fname.raw() + '\0' + stamp + '\0' + cp.inputProfile.raw() + '\0' +
+           CalibrationCache::stamp(cp.inputProfile) + '\0' +
+           std::to_string(cp.dcpIlluminant) + (cp.toneCurve ? "t" : "") +
+           (cp.applyLookTable ? "l" : "") +
+           (cp.applyBaselineExposureOffset ? "b" : "") +
+           (cp.applyHueSatMap ? "h" : "");
+}
+
+bool cache_load(const std::string &key, std::vector<double> &curve,
+                std::vector<double> &curve2)
+{
+    if (key.empty()) {
+        return false;
+    }
+
+    std::string data;
+    try {
+        data = Glib::file_get_contents(cache_file(key));
+    } catch (Glib::Exception &) {
+        return false;
+    }
+
+    size_t pos = sizeof(CACHE_MAGIC);
+    uint32_t version, n;
+    std::vector<double> c, c2;
+    if (data.size() < pos || memcmp(data.data(), CACHE_MAGIC, pos) != 0 ||
+        !get_u32(data, pos, version) || version != CACHE_VERSION ||
+        !get_u32(data, pos, n) || pos + n > data.size() ||
+        data.compare(pos, n, key) != 0) {
+        return false;
+    }
+    pos += n;
+    if (!get_curve(data, pos, c) || !get_curve(data, pos, c2) ||
+        pos != data.size()) {
+        return false;
+    }
+    curve = std::move(c);
+    curve2 = std::move(c2);
+    return true;
+}
+
+void cache_save(const std::string &key, const std::vector<double> &curve,
+                const std::vector<double> &curve2)
+{
+    if (key.empty()) {
+        return;
+    }
+
+    std::string data(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    put_u32(data, CACHE_VERSION);
+    put_u32(data, key.size());
+    data += key;
+    put_curve(data, curve);
+    put_curve(data, curve2);
+
+    const auto d = cache_dir();
+    g_mkdir_with_parents(d.c_str(), 0777);
+    if (!write_file(cache_file(key), data) && settings->verbose) {
+        std::cout << "histogram matching: error writing in " << d
+                  << std::endl;
+    }
+}
+
 } // namespace
 
 void RawImageSource::getAutoMatchedToneCurve(const ColorManagementParams &cp,
@@ -449,6 +610,24 @@ void RawImageSource::getAutoMatchedToneCurve(const ColorManagementParams &cp,
         return;
     }
 
+    const std::string key = cache_key(getFileName(), cp);
+    if (cache_load(key, outCurve, outCurve2)) {
+        if (settings->verbose) {
+            std::cout << "tone curve found in the disk cache" << std::endl;
+        }
+        histMatchingCache = outCurve;
+        histMatchingCache2 = outCurve2;
+        histMatchingParams = cp;
+        return;
+    }
+
+    const auto store = [&]() -> void {
+        histMatchingCache = outCurve;
+        histMatchingCache2 = outCurve2;
+        histMatchingParams = cp;
+        cache_save(key, outCurve, outCurve2);
+    };
+
     outCurve = {DCT_Linear};
     outCurve2 = {DCT_Linear};
 
@@ -482,9 +661,7 @@ void RawImageSource::getAutoMatchedToneCurve(const ColorManagementParams &cp,
                              "generating a neutral curve"
                           << std::endl;
             }
-            histMatchingCache = outCurve;
-            histMatchingCache2 = outCurve2;
-            histMatchingParams = cp;
+            store();
             return;
         } else if (w * 10 < fw) {
             if (settings->verbose) {
@@ -492,9 +669,7 @@ void RawImageSource::getAutoMatchedToneCurve(const ColorManagementParams &cp,
                              "too small: "
                           << w << "x" << h << std::endl;
             }
-            histMatchingCache = outCurve;
-            histMatchingCache2 = outCurve2;
-            histMatchingParams = cp;
+            store();
             return;
         }
         skip = LIM(skip * fh / h, 6,
@@ -521,9 +696,7 @@ void RawImageSource::getAutoMatchedToneCurve(const ColorManagementParams &cp,
                              "generating a neutral curve"
                           << std::endl;
             }
-            histMatchingCache = outCurve;
-            histMatchingCache2 = outCurve2;
-            histMatchingParams = cp;
+            store();
             return;
         }
         target.reset(thumb->processImage(neutral, sensor_type, fh / skip,
@@ -669,9 +842,7 @@ void RawImageSource::getAutoMatchedToneCurve(const ColorManagementParams &cp,
                   << outCurve.size() / 2 << " control points" << std::endl;
     }
 
-    histMatchingCache = outCurve;
-    histMatchingCache2 = outCurve2;
-    histMatchingParams = cp;
+    store();
 }
 
 } // namespace rtengine
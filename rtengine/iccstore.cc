@@ -42,6 +42,7 @@
 #endif // ART_LCMS2_FAST_FLOAT
 
 #include "cJSON.h"
+#include "cache.h"
 #include "color.h"
 #include "linalgebra.h"
 
@@ -353,12 +354,15 @@ class ICCStore::Implementation {
     using NameMap = std::map<Glib::ustring, Glib::ustring>;
 
     static constexpr const char *DEFAULT_WORKING_SPACE = "Rec2020";
+    // number of transforms kept by getTransform()
+    static constexpr unsigned long TRANSFORM_CACHE_SIZE = 32;
 
 public:
     Implementation()
         : loadAll(true), xyz(createXYZProfile()), srgb(cmsCreate_sRGBProfile()),
           thumb_monitor_xform_(nullptr),
-          monitor_profile_hash_("000000000000000000000000000000000")
+          monitor_profile_hash_("000000000000000000000000000000000"),
+          transforms_(TRANSFORM_CACHE_SIZE)
     {
         // cmsErrorAction(LCMS_ERROR_SHOW);
 
@@ -697,6 +701,48 @@ public:
         return monitor_profile_hash_;
     }
 
+    ICCStore::Transform getTransform(cmsHPROFILE iprof, cmsUInt32Number ifmt,
+                                     cmsHPROFILE oprof, cmsUInt32Number ofmt,
+                                     cmsUInt32Number intent,
+                                     cmsUInt32Number flags, cmsHPROFILE proof,
+                                     cmsUInt32Number proof_intent)
+    {
+        flags |= cmsFLAGS_NOCACHE;
+        if (!proof) {
+            proof_intent = 0;
+        }
+
+        const auto hash = [](cmsHPROFILE prof) -> std::string {
+            if (!prof) {
+                return "-";
+            }
+            return Glib::Checksum::compute_checksum(
+                Glib::Checksum::CHECKSUM_MD5, ProfileContent(prof).getData());
+        };
+        const std::string key = hash(iprof) + hash(oprof) + hash(proof) +
+                                "." + std::to_string(ifmt) + "." +
+                                std::to_string(ofmt) + "." +
+                                std::to_string(intent) + "." +
+                                std::to_string(proof_intent) + "." +
+                                std::to_string(flags);
+
+        ICCStore::Transform ret;
+        if (transforms_.get(key, ret)) {
+            return ret;
+        }
+
+        cmsHTRANSFORM xform =
+            proof ? cmsCreateProofingTransform(iprof, ifmt, oprof, ofmt, proof,
+                                               intent, proof_intent, flags)
+                  : cmsCreateTransform(iprof, ifmt, oprof, ofmt, intent,
+                                       flags);
+        if (xform) {
+            ret.reset(xform, cmsDeleteTransform);
+            transforms_.set(key, ret);
+        }
+        return ret;
+    }
+
     bool getProfileMatrix(const Glib::ustring &name, Mat33<float> &out)
     {
         auto prof = getProfile(name);
@@ -1119,6 +1165,9 @@ private:
 
     cmsHTRANSFORM thumb_monitor_xform_;
     std::string monitor_profile_hash_;
+
+    // key: hashes of the profiles, formats, intents and flags
+    Cache<std::string, ICCStore::Transform> transforms_;
 };
 
 ICCStore *ICCStore::getInstance()
@@ -1253,6 +1302,16 @@ const std::string &ICCStore::getThumbnailMonitorHash() const
     return implementation->getThumbnailMonitorHash();
 }
 
+ICCStore::Transform
+ICCStore::getTransform(cmsHPROFILE iprof, cmsUInt32Number ifmt,
+                       cmsHPROFILE oprof, cmsUInt32Number ofmt,
+                       cmsUInt32Number intent, cmsUInt32Number flags,
+                       cmsHPROFILE proof, cmsUInt32Number proof_intent)
+{
+    return implementation->getTransform(iprof, ifmt, oprof, ofmt, intent,
+                                        flags, proof, proof_intent);
+}
+
 bool ICCStore::getProfileMatrix(const Glib::ustring &name, Mat33<float> &out)
 {
     return implementation->getProfileMatrix(name, out);
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -115,6 +116,26 @@ public:
     cmsHTRANSFORM getThumbnailMonitorTransform();
     const std::string &getThumbnailMonitorHash() const;
 
+    /// ref-counted handle to a shared lcms transform, which stays valid for
+    /// as long as the handle is alive
+    typedef std::shared_ptr<void> Transform;
+
+    /**
+     * Returns the transform from iprof to oprof (soft-proofing through proof
+     * with proof_intent, if not null), reusing the one created by a previous
+     * call with the same profiles, formats, intents and flags. The profiles
+     * are compared by content. cmsFLAGS_NOCACHE is always added, so that the
+     * transform can be used by several threads at once.
+     *
+     * @note like cmsCreateTransform(), it must be called with lcmsMutex held
+     * @return an empty handle if the transform can't be created
+     */
+    Transform getTransform(cmsHPROFILE iprof, cmsUInt32Number ifmt,
+                           cmsHPROFILE oprof, cmsUInt32Number ofmt,
+                           cmsUInt32Number intent, cmsUInt32Number flags,
+                           cmsHPROFILE proof = nullptr,
+                           cmsUInt32Number proof_intent = INTENT_PERCEPTUAL);
+
     bool getProfileMatrix(const Glib::ustring &name, Mat33<float> &out);
     static bool getProfileMatrix(cmsHPROFILE prof, Mat33<float> &out);
     static bool getProfileParametricTRC(cmsHPROFILE prof, float &out_gamma,
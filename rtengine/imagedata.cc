@@ -166,6 +166,11 @@ FramesData::FramesData(const Glib::ustring &fname, bool only_make_model)
             software = pos->print();
         }
 
+        if (find_tag(Exiv2::serialNumber)) {
+            serial = validateUtf8(pos->print(&exif));
+            serial.erase(serial.find_last_not_of(' ') + 1);
+        }
+
         if (find_tag(Exiv2::exposureTime)) {
             shutter = pos->toFloat();
         }
@@ -849,23 +849,7 @@ void Imagefloat::rgb_to_lab(bool multithread)
 #pragma omp parallel for if (multithread)
 #endif
     for (int y = 0; y < height; ++y) {
-        int x = 0;
-#ifdef __SSE2__
-        vfloat Rv, Gv, Bv;
-        vfloat Lv, av, bv;
-        for (; x < width - 3; x += 4) {
-            Rv = LVF(r(y, x));
-            Gv = LVF(g(y, x));
-            Bv = LVF(b(y, x));
-            Color::rgb2lab(Rv, Gv, Bv, Lv, av, bv, vws_);
-            STVF(g(y, x), Lv);
-            STVF(r(y, x), av);
-            STVF(b(y, x), bv);
-        }
-#endif
-        for (; x < width; ++x) {
-            rgb_to_lab(y, x, g(y, x), r(y, x), b(y, x));
-        }
+        Color::rgb2lab(r(y), g(y), b(y), g(y), r(y), b(y), ws_, width);
     }
 }
 
@@ -943,28 +927,7 @@ void Imagefloat::lab_to_rgb(bool multithread)
 #pragma omp parallel for if (multithread)
 #endif
     for (int y = 0; y < height; ++y) {
-        // float X, Y, Z;
-        int x = 0;
-#ifdef __SSE2__
-        vfloat Lv, av, bv;
-        vfloat Rv, Gv, Bv;
-        for (; x < width - 3; x += 4) {
-            Lv = LVF(g(y, x));
-            av = LVF(r(y, x));
-            bv = LVF(b(y, x));
-            Color::lab2rgb(Lv, av, bv, Rv, Gv, Bv, viws_);
-            STVF(r(y, x), Rv);
-            STVF(g(y, x), Gv);
-            STVF(b(y, x), Bv);
-        }
-#endif
-        for (; x < width; ++x) {
-            Color::lab2rgb(this->g(y, x), this->r(y, x), this->b(y, x),
-                           this->r(y, x), this->g(y, x), this->b(y, x), iws_);
-            // Color::Lab2XYZ(this->g(y, x), this->r(y, x), this->b(y, x), X, Y,
-            // Z); Color::xyz2rgb(X, Y, Z, this->r(y, x), this->g(y, x),
-            // this->b(y, x), iws_);
-        }
+        Color::lab2rgb(g(y), r(y), b(y), r(y), g(y), b(y), iws_, width);
     }
 }
 
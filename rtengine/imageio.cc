@@ -22,13 +22,20 @@
 #include "../rtgui/version.h"
 #include "myfile.h"
 #include "rt_math.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
 #include <glib/gstdio.h>
+#include <memory>
 #include <png.h>
 #include <tiff.h>
 #include <tiffio.h>
+#include <vector>
+#include <zlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef WIN32
 #include <winsock2.h>
@@ -87,6 +94,174 @@ FILE *g_fopen_withBinaryAndLock(const Glib::ustring &fname)
     return f;
 }
 
+// Applies the TIFF predictor to a scanline of samples samples of bps bits, in
+// place (same as horDiff*() and fpDiff() in libtiff's tif_predict.c)
+void tiff_predict(unsigned char *line, int samples, int bps, bool fp)
+{
+    constexpr int stride = 3; // samples per pixel
+
+    if (fp) {
+        const int bytes = bps / 8;
+        std::vector<unsigned char> tmp(line, line + samples * bytes);
+        for (int count = 0; count < samples; ++count) {
+            for (int byte = 0; byte < bytes; ++byte) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                line[(bytes - byte - 1) * samples + count] =
+                    tmp[bytes * count + byte];
+#else
+                line[byte * samples + count] = tmp[bytes * count + byte];
+#endif
+            }
+        }
+        for (int i = samples * bytes - 1; i >= stride; --i) {
+            line[i] -= line[i - stride];
+        }
+    } else if (bps == 8) {
+        for (int i = samples - 1; i >= stride; --i) {
+            line[i] -= line[i - stride];
+        }
+    } else if (bps == 16) {
+        uint16_t *wp = reinterpret_cast<uint16_t *>(line);
+        for (int i = samples - 1; i >= stride; --i) {
+            wp[i] -= wp[i - stride];
+        }
+    } else if (bps == 32) {
+        uint32_t *wp = reinterpret_cast<uint32_t *>(line);
+        for (int i = samples - 1; i >= stride; --i) {
+            wp[i] -= wp[i - stride];
+        }
+    }
+}
+
+// Lets libjpeg decode directly at a reduced scale (1/2, 1/4 or 1/8), as long
+// as the result is still at least maxw_hint x maxh_hint. Must be called
+// after jpeg_read_header()
+void jpeg_set_scale_hint(jpeg_decompress_struct &cinfo, int maxw_hint,
+                         int maxh_hint)
+{
+    if (maxw_hint > 0 && maxh_hint > 0) {
+        int w = cinfo.image_width;
+        int h = cinfo.image_height;
+        int d1 = w / maxw_hint;
+        int d2 = h / maxh_hint;
+        int d = std::min(d1, d2);
+        if (d > 1) {
+            cinfo.scale_num = 1;
+            int l = std::min(d, 8);
+            for (d = 1; (d << 1) <= l; d = d << 1) {
+            }
+            cinfo.scale_denom = d;
+        }
+    }
+}
+
+// Streaming downscaler for the PNG and TIFF loaders: averages blocks of
+// factor x factor pixels of the (3 samples per pixel) scanlines as they are
+// decoded, and returns an output scanline, in the same format as the input,
+// every factor rows
+class RowDownscaler {
+public:
+    enum class Type { UINT8, UINT16, FLOAT };
+
+    // the integer factor for which the result is still at least
+    // maxw_hint x maxh_hint, 1 if no downscaling is possible
+    static int factor(int w, int h, int maxw_hint, int maxh_hint)
+    {
+        if (maxw_hint <= 0 || maxh_hint <= 0) {
+            return 1;
+        }
+        return std::max(std::min(w / maxw_hint, h / maxh_hint), 1);
+    }
+
+    // the type of the samples, false if the format is not supported
+    static bool get_type(int bps, IIOSampleFormat fmt, Type &out)
+    {
+        if (bps == 8) {
+            out = Type::UINT8;
+        } else if (bps == 16 && fmt == IIOSF_UNSIGNED_SHORT) {
+            out = Type::UINT16;
+        } else if (bps == 32 && (fmt & (IIOSF_FLOAT32 | IIOSF_LOGLUV24 |
+                                        IIOSF_LOGLUV32))) {
+            out = Type::FLOAT;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    RowDownscaler(int width, int factor, Type type)
+        : factor_(factor), out_width_(width / factor), type_(type), rows_(0),
+          acc_(out_width_ * 3), out_(out_width_ * 3 * sample_size())
+    {
+    }
+
+    int out_width() const { return out_width_; }
+
+    // returns the downscaled row if complete, nullptr otherwise
+    unsigned char *add(const unsigned char *row)
+    {
+        switch (type_) {
+        case Type::UINT8:
+            accumulate(row);
+            break;
+        case Type::UINT16:
+            accumulate(reinterpret_cast<const uint16_t *>(row));
+            break;
+        case Type::FLOAT:
+            accumulate(reinterpret_cast<const float *>(row));
+            break;
+        }
+
+        if (++rows_ < factor_) {
+            return nullptr;
+        }
+
+        const float s = 1.f / (factor_ * factor_);
+        for (size_t i = 0; i < acc_.size(); ++i) {
+            const float v = acc_[i] * s;
+            switch (type_) {
+            case Type::UINT8:
+                out_[i] = v + 0.5f;
+                break;
+            case Type::UINT16:
+                reinterpret_cast<uint16_t *>(out_.data())[i] = v + 0.5f;
+                break;
+            case Type::FLOAT:
+                reinterpret_cast<float *>(out_.data())[i] = v;
+                break;
+            }
+        }
+        std::fill(acc_.begin(), acc_.end(), 0.f);
+        rows_ = 0;
+        return out_.data();
+    }
+
+private:
+    size_t sample_size() const
+    {
+        return type_ == Type::UINT8 ? 1 : (type_ == Type::UINT16 ? 2 : 4);
+    }
+
+    template <class T> void accumulate(const T *row)
+    {
+        for (int x = 0, i = 0; x < out_width_; ++x, i += 3) {
+            for (int k = 0; k < factor_; ++k) {
+                const T *p = row + (x * factor_ + k) * 3;
+                acc_[i] += p[0];
+                acc_[i + 1] += p[1];
+                acc_[i + 2] += p[2];
+            }
+        }
+    }
+
+    const int factor_;
+    const int out_width_;
+    const Type type_;
+    int rows_;
+    std::vector<float> acc_;
+    std::vector<unsigned char> out_;
+};
+
 } // namespace
 
 Glib::ustring ImageIO::errorMsg[6] = {"Success",
@@ -204,7 +379,7 @@ int ImageIO::getPNGSampleFormat(const Glib::ustring &fname,
     }
 }
 
-int ImageIO::loadPNG(const Glib::ustring &fname)
+int ImageIO::loadPNG(const Glib::ustring &fname, int maxw_hint, int maxh_hint)
 {
 
     FILE *file = g_fopen(fname.c_str(), "rb");
@@ -327,7 +502,21 @@ int ImageIO::loadPNG(const Glib::ustring &fname)
     png_get_IHDR(png, info, &width, &height, &bit_depth, &color_type,
                  &interlace_type, &compression_type, &filter_method);
 
-    allocate(width, height);
+    RowDownscaler::Type dstype;
+    const int factor =
+        RowDownscaler::get_type(bit_depth,
+                                bit_depth == 16 ? IIOSF_UNSIGNED_SHORT
+                                                : IIOSF_UNSIGNED_CHAR,
+                                dstype)
+            ? RowDownscaler::factor(width, height, maxw_hint, maxh_hint)
+            : 1;
+    std::unique_ptr<RowDownscaler> downscaler;
+    if (factor > 1) {
+        downscaler.reset(new RowDownscaler(width, factor, dstype));
+        allocate(downscaler->out_width(), height / factor);
+    } else {
+        allocate(width, height);
+    }
 
     int rowlen = width * 3 * bit_depth / 8;
     unsigned char *row = new unsigned char[rowlen];
@@ -352,7 +541,11 @@ int ImageIO::loadPNG(const Glib::ustring &fname)
             }
         }
 
-        setScanline(i, row, bit_depth);
+        if (!downscaler) {
+            setScanline(i, row, bit_depth);
+        } else if (unsigned char *out = downscaler->add(row)) {
+            setScanline(i / factor, out, bit_depth);
+        }
 
         if (pl && !(i % 100)) {
             pl->setProgress((double)(i + 1) / height);
@@ -394,7 +587,8 @@ int ImageIO::loadPNG(const Glib::ustring &fname)
 // #endif
 // }
 
-int ImageIO::loadJPEGFromMemory(const char *buffer, int bufsize)
+int ImageIO::loadJPEGFromMemory(const char *buffer, int bufsize,
+                                int maxw_hint, int maxh_hint, Region *region)
 {
     jpeg_decompress_struct cinfo;
     jpeg_create_decompress(&cinfo);
@@ -439,6 +633,7 @@ int ImageIO::loadJPEGFromMemory(const char *buffer, int bufsize)
         setup_read_icc_profile(&cinfo);
 
         jpeg_read_header(&cinfo, TRUE);
+        jpeg_set_scale_hint(cinfo, maxw_hint, maxh_hint);
 
         deleteLoadedProfileData();
         loadedProfileDataJpg = true;
@@ -458,31 +653,78 @@ int ImageIO::loadJPEGFromMemory(const char *buffer, int bufsize)
         unsigned int width = cinfo.output_width;
         unsigned int height = cinfo.output_height;
 
+        // the part of the image to keep: columns [x0, x0 + width), rows
+        // [y0, y0 + height)
+        unsigned int x0 = 0, y0 = 0;
+        if (region) {
+            region->full_width = width;
+            region->full_height = height;
+            const auto start = [](double c, int size, int full) -> int {
+                return LIM(int(c * full + 0.5) - size / 2, 0,
+                           std::max(full - size, 0));
+            };
+            region->x = start(region->center_x, region->width, width);
+            region->y = start(region->center_y, region->height, height);
+            region->width = LIM(region->width, 1, int(width) - region->x);
+            region->height = LIM(region->height, 1, int(height) - region->y);
+            x0 = region->x;
+            y0 = region->y;
+            width = region->width;
+            height = region->height;
+        }
+
+        // the decoded columns start at xoff <= x0
+        unsigned int xoff = 0;
+#ifdef LIBJPEG_TURBO_VERSION
+        if (region) {
+            // libjpeg-turbo can decode only the iMCU columns containing the
+            // region (xoff and w are widened to their boundaries), and skip
+            // the rows above it without decoding them
+            JDIMENSION xo = x0, w = width;
+            jpeg_crop_scanline(&cinfo, &xo, &w);
+            xoff = xo;
+            if (y0 > 0 && jpeg_skip_scanlines(&cinfo, y0) != y0) {
+                jpeg_destroy_decompress(&cinfo);
+                return IMIO_READERROR;
+            }
+        }
+#endif
+
         allocate(width, height);
 
-        std::vector<unsigned char> vrow(width * 3);
+        std::vector<unsigned char> vrow(cinfo.output_width *
+                                        cinfo.output_components);
         unsigned char *row = &(vrow[0]); // new unsigned char[width * 3];
+        unsigned char *src = row + (x0 - xoff) * cinfo.output_components;
 
-        while (cinfo.output_scanline < height) {
+        while (cinfo.output_scanline < y0 + height) {
             if (jpeg_read_scanlines(&cinfo, &row, 1) < 1) {
-                jpeg_finish_decompress(&cinfo);
                 jpeg_destroy_decompress(&cinfo);
                 // delete [] row;
                 return IMIO_READERROR;
             }
 
-            setScanline(cinfo.output_scanline - 1, row, 8,
-                        cinfo.num_components);
+            // without libjpeg-turbo, the rows above the region are decoded
+            // and thrown away
+            if (cinfo.output_scanline > y0) {
+                setScanline(cinfo.output_scanline - 1 - y0, src, 8,
+                            cinfo.num_components);
+            }
 
             if (pl && !(cinfo.output_scanline % 100)) {
                 pl->setProgress((double)(cinfo.output_scanline) /
-                                cinfo.output_height);
+                                (y0 + height));
             }
         }
 
         // delete [] row;
 
-        jpeg_finish_decompress(&cinfo);
+        if (cinfo.output_scanline < cinfo.output_height) {
+            // the rows below the region are not needed
+            jpeg_abort_decompress(&cinfo);
+        } else {
+            jpeg_finish_decompress(&cinfo);
+        }
         jpeg_destroy_decompress(&cinfo);
 
         if (pl) {
@@ -537,20 +779,7 @@ int ImageIO::loadJPEG(const Glib::ustring &fname, int maxw_hint, int maxh_hint)
         }
 
         cinfo.out_color_space = JCS_RGB;
-        if (maxw_hint > 0 && maxh_hint > 0) {
-            int w = cinfo.image_width;
-            int h = cinfo.image_height;
-            int d1 = w / maxw_hint;
-            int d2 = h / maxh_hint;
-            int d = std::min(d1, d2);
-            if (d > 1) {
-                cinfo.scale_num = 1;
-                int l = std::min(d, 8);
-                for (d = 1; (d << 1) <= l; d = d << 1) {
-                }
-                cinfo.scale_denom = d;
-            }
-        }
+        jpeg_set_scale_hint(cinfo, maxw_hint, maxh_hint);
 
         deleteLoadedProfileData();
         loadedProfileDataJpg = true;
@@ -763,7 +992,8 @@ void tiff_Unmap(thandle_t, tdata_t, toff_t) { return; }
 
 } // namespace
 
-int ImageIO::loadTIFF(const Glib::ustring &fname)
+int ImageIO::loadTIFF(const Glib::ustring &fname, int maxw_hint,
+                      int maxh_hint)
 {
 
     static MyMutex thumbMutex;
@@ -873,7 +1103,18 @@ int ImageIO::loadTIFF(const Glib::ustring &fname)
         embProfile = nullptr;
     }
 
-    allocate(width, height);
+    RowDownscaler::Type dstype;
+    const int factor =
+        RowDownscaler::get_type(bitspersample, sampleFormat, dstype)
+            ? RowDownscaler::factor(width, height, maxw_hint, maxh_hint)
+            : 1;
+    std::unique_ptr<RowDownscaler> downscaler;
+    if (factor > 1) {
+        downscaler.reset(new RowDownscaler(width, factor, dstype));
+        allocate(downscaler->out_width(), height / factor);
+    } else {
+        allocate(width, height);
+    }
 
     unsigned char *linebuffer =
         new unsigned char[TIFFScanlineSize(in) *
@@ -919,7 +1160,14 @@ int ImageIO::loadTIFF(const Glib::ustring &fname)
             }
         }
 
-        setScanline(row, linebuffer, bitspersample);
+        if (!downscaler) {
+            setScanline(row, linebuffer, bitspersample);
+        } else if (unsigned char *out = downscaler->add(linebuffer)) {
+            setScanline(row / factor, out, bitspersample);
+        } else if (row >= (height / factor) * factor) {
+            // the remaining rows don't make a complete output row
+            break;
+        }
 
         if (pl && !(row % 100)) {
             pl->setProgress((double)(row + 1) / height);
@@ -1095,6 +1343,11 @@ int ImageIO::saveJPEG(const Glib::ustring &fname, int quality,
         return IMIO_HEADERERROR;
     }
 
+    // the metadata is written together with the image data, so that the
+    // file doesn't need to be rewritten afterwards
+    std::vector<std::pair<int, std::string>> segments;
+    const bool embed_metadata = getJpegMetadataSegments(fname, segments);
+
     FILE *const file = g_fopen_withBinaryAndLock(fname);
 
     if (!file) {
@@ -1185,6 +1438,13 @@ int ImageIO::saveJPEG(const Glib::ustring &fname, int quality,
 
         jpeg_start_compress(&cinfo, TRUE);
 
+        for (auto &s : segments) {
+            jpeg_write_marker(
+                &cinfo, s.first,
+                reinterpret_cast<const JOCTET *>(s.second.data()),
+                s.second.size());
+        }
+
         // write icc profile to the output
         if (profileData) {
             write_icc_profile(&cinfo, (JOCTET *)profileData, profileLength);
@@ -1248,7 +1508,7 @@ int ImageIO::saveJPEG(const Glib::ustring &fname, int quality,
         return IMIO_CANNOTWRITEFILE;
     }
 
-    if (!saveMetadata(fname)) {
+    if (!embed_metadata && !saveMetadata(fname)) {
         g_remove(fname.c_str());
         return IMIO_CANNOTWRITEFILE;
     }
@@ -1280,8 +1540,12 @@ int ImageIO::saveTIFF(const Glib::ustring &fname, int bps, bool isFloat,
     unsigned char *linebuffer = new unsigned char[lineWidth];
 
     // little hack to get libTiff to use proper byte order (see
-    // TIFFClienOpen()):
-    const char *mode = "w";
+    // TIFFClienOpen()). Classic TIFF files use 32 bit offsets, so switch to
+    // BigTIFF when the uncompressed pixel data (plus some room for the
+    // metadata) gets close to 4 GB
+    const bool bigtiff = uint64_t(lineWidth) * height + (uint64_t(64) << 20) >=
+                         (uint64_t(1) << 32);
+    const char *mode = bigtiff ? "w8" : "w";
 #ifdef WIN32
     FILE *file = g_fopen_withBinaryAndLock(fname);
     int fileno = _fileno(file);
@@ -1302,14 +1566,11 @@ int ImageIO::saveTIFF(const Glib::ustring &fname, int bps, bool isFloat,
         pl->setProgress(0.0);
     }
 
-    bool needsReverse = false;
-
     TIFFSetField(out, TIFFTAG_SOFTWARE, RTNAME " " RTVERSION);
     TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
     TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
     TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
     TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, 3);
-    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, height);
     TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, bps);
     TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
     TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
@@ -1354,38 +1615,86 @@ int ImageIO::saveTIFF(const Glib::ustring &fname, int bps, bool isFloat,
         TIFFSetField(out, TIFFTAG_ICCPROFILE, profileLength, profileData);
     }
 
-    for (int row = 0; row < height; row++) {
-        getScanline(row, linebuffer, bps, isFloat);
+    // Compressed images are split in strips that are compressed in parallel
+    // (with the same predictor and zlib settings libtiff would use), and then
+    // written in order as raw strips. Huge uncompressed images are split too,
+    // as a single strip can't be larger than 4 GB
+    const int rows_per_strip =
+        uncompressed && !bigtiff
+            ? height
+            : LIM((1 << 20) / std::max(lineWidth, 1), 1, height);
+    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, rows_per_strip);
 
-        if (bps == 16) {
-            if (needsReverse && !uncompressed && isFloat) {
-                for (int i = 0; i < lineWidth; i += 2) {
-                    char temp = linebuffer[i];
-                    linebuffer[i] = linebuffer[i + 1];
-                    linebuffer[i + 1] = temp;
+    if (!uncompressed) {
+        const int num_strips = (height + rows_per_strip - 1) / rows_per_strip;
+#ifdef _OPENMP
+        const int chunk = 4 * omp_get_max_threads();
+#else
+        const int chunk = 1;
+#endif
+        const bool fp = (bps == 16 || bps == 32) && isFloat;
+        std::vector<std::vector<Bytef>> strips(chunk);
+        std::vector<int> status(chunk);
+
+        for (int first = 0; first < num_strips && writeOk; first += chunk) {
+            const int last = std::min(first + chunk, num_strips);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+            for (int s = first; s < last; ++s) {
+                const int y0 = s * rows_per_strip;
+                const int y1 = std::min(y0 + rows_per_strip, height);
+                std::vector<Bytef> raw(size_t(y1 - y0) * lineWidth);
+                for (int row = y0; row < y1; ++row) {
+                    unsigned char *line = &raw[size_t(row - y0) * lineWidth];
+                    getScanline(row, line, bps, isFloat);
+                    tiff_predict(line, width * 3, bps, fp);
                 }
+                auto &dst = strips[s - first];
+                uLongf len = compressBound(raw.size());
+                dst.resize(len);
+                status[s - first] =
+                    compress2(dst.data(), &len, raw.data(), raw.size(),
+                              Z_DEFAULT_COMPRESSION);
+                dst.resize(len);
             }
-        } else if (bps == 32) {
-            if (needsReverse && !uncompressed) {
-                for (int i = 0; i < lineWidth; i += 4) {
-                    char temp = linebuffer[i];
-                    linebuffer[i] = linebuffer[i + 3];
-                    linebuffer[i + 3] = temp;
-                    temp = linebuffer[i + 1];
-                    linebuffer[i + 1] = linebuffer[i + 2];
-                    linebuffer[i + 2] = temp;
+
+            for (int s = first; s < last && writeOk; ++s) {
+                auto &dst = strips[s - first];
+                if (status[s - first] != Z_OK ||
+                    TIFFWriteRawStrip(out, s, dst.data(), dst.size()) < 0) {
+                    writeOk = false;
                 }
             }
+
+            if (pl) {
+                pl->setProgress(double(last) / num_strips);
+            }
         }
 
-        if (TIFFWriteScanline(out, linebuffer, row, 0) < 0) {
+        if (!writeOk) {
             TIFFClose(out);
+#ifdef WIN32
+            fclose(file);
+#endif
             delete[] linebuffer;
+            g_remove(fname.c_str());
             return IMIO_CANNOTWRITEFILE;
         }
+    } else {
+        for (int row = 0; row < height; row++) {
+            getScanline(row, linebuffer, bps, isFloat);
 
-        if (pl && !(row % 100)) {
-            pl->setProgress((double)(row + 1) / height);
+            if (TIFFWriteScanline(out, linebuffer, row, 0) < 0) {
+                TIFFClose(out);
+                delete[] linebuffer;
+                return IMIO_CANNOTWRITEFILE;
+            }
+
+            if (pl && !(row % 100)) {
+                pl->setProgress((double)(row + 1) / height);
+            }
         }
     }
 
@@ -1459,11 +1768,11 @@ int ImageIO::load(const Glib::ustring &fname, int maxw_hint, int maxh_hint)
 {
 
     if (hasPngExtension(fname)) {
-        return loadPNG(fname);
+        return loadPNG(fname, maxw_hint, maxh_hint);
     } else if (hasJpegExtension(fname)) {
         return loadJPEG(fname, maxw_hint, maxh_hint);
     } else if (hasTiffExtension(fname)) {
-        return loadTIFF(fname);
+        return loadTIFF(fname, maxw_hint, maxh_hint);
     } else {
         return IMIO_FILETYPENOTSUPPORTED;
     }
@@ -1524,15 +1833,11 @@ void ImageIO::deleteLoadedProfileData()
     loadedProfileData = nullptr;
 }
 
-bool ImageIO::saveMetadata(const Glib::ustring &fname) const
+bool ImageIO::loadMetadata() const
 {
-    if (metadataInfo.filename().empty()) {
-        return true;
-    }
-
-    bool has_meta = true;
     try {
         metadataInfo.load();
+        return true;
     } catch (std::exception &exc) {
         // if (settings->verbose) {
         //     std::cout << "EXIF LOAD ERROR: " << exc.what() << std::endl;
@@ -1541,18 +1846,37 @@ bool ImageIO::saveMetadata(const Glib::ustring &fname) const
             pl->error(Glib::ustring::compose(
                 M("METADATA_LOAD_ERROR"), metadataInfo.filename(), exc.what()));
         }
-        has_meta = false;
+        return false;
+    }
+}
+
+bool ImageIO::getJpegMetadataSegments(
+    const Glib::ustring &fname,
+    std::vector<std::pair<int, std::string>> &segments) const
+{
+    if (metadataInfo.filename().empty() || !loadMetadata()) {
+        return true;
+    }
+
+    try {
+        segments = metadataInfo.getJpegSegments(pl, fname, !profileData);
+        return true;
+    } catch (std::exception &) {
+        // fall back to saveMetadata() on the encoded file
+        segments.clear();
+        return false;
     }
+}
 
-    if (has_meta) {
+bool ImageIO::saveMetadata(const Glib::ustring &fname) const
+{
+    if (metadataInfo.filename().empty()) {
+        return true;
+    }
+
+    if (loadMetadata()) {
         try {
-            metadataInfo.saveToImage(pl, fname, false);
-            if (!profileData) {
-                Exiv2Metadata outmd(fname);
-                outmd.load();
-                outmd.exifData()["Exif.Photo.ColorSpace"] = 1;
-                outmd.saveToImage(nullptr, fname, true);
-            }
+            metadataInfo.saveToImage(pl, fname, false, !profileData);
         } catch (std::exception &exc) {
             // std::cout << "EXIF ERROR: " << exc.what() << std::endl;
             // return false;
@@ -92,10 +92,15 @@ public:
     int load(const Glib::ustring &fname, int maxw_hint = 0, int maxh_hint = 0);
     int save(const Glib::ustring &fname) const;
 
-    int loadPNG(const Glib::ustring &fname);
+    // for PNG and TIFF, the hints make the rows be box-filtered by an
+    // integer factor while they are read, so that the full resolution image
+    // is never allocated
+    int loadPNG(const Glib::ustring &fname, int maxw_hint = 0,
+                int maxh_hint = 0);
     int loadJPEG(const Glib::ustring &fname, int maxw_hint = 0,
                  int maxh_hint = 0);
-    int loadTIFF(const Glib::ustring &fname);
+    int loadTIFF(const Glib::ustring &fname, int maxw_hint = 0,
+                 int maxh_hint = 0);
     static int getPNGSampleFormat(const Glib::ustring &fname,
                                   IIOSampleFormat &sFormat,
                                   IIOSampleArrangement &sArrangement);
@@ -103,7 +108,26 @@ public:
                                    IIOSampleFormat &sFormat,
                                    IIOSampleArrangement &sArrangement);
 
-    int loadJPEGFromMemory(const char *buffer, int bufsize);
+    // a part of an image to decode: width x height pixels (of the image as
+    // scaled by the hints) around (center_x, center_y), given relative to
+    // the image size. On return, x, y, width and height are the area actually
+    // decoded, and full_width and full_height the size of the whole image
+    struct Region {
+        double center_x;
+        double center_y;
+        int width;
+        int height;
+        int x;
+        int y;
+        int full_width;
+        int full_height;
+    };
+
+    // maxw_hint and maxh_hint work as in loadJPEG(): the image can be decoded
+    // at a reduced size, not smaller than the hints. If region is given,
+    // only that part is decoded
+    int loadJPEGFromMemory(const char *buffer, int bufsize, int maxw_hint = 0,
+                           int maxh_hint = 0, Region *region = nullptr);
     int loadPPMFromMemory(const char *buffer, int width, int height, bool swap,
                           int bps);
 
@@ -119,9 +143,22 @@ public:
 
     void setMetadata(const Exiv2Metadata &info) { metadataInfo = info; }
     void setOutputProfile(const char *pdata, int plen);
+    void getOutputProfileData(int &length, const char *&pdata) const
+    {
+        length = profileLength;
+        pdata = profileData;
+    }
 
     bool saveMetadata(const Glib::ustring &fname) const;
 
+private:
+    bool loadMetadata() const;
+    /** the metadata as JPEG APP segments. Returns false if they can't be
+        generated, in which case saveMetadata() must be used instead */
+    bool getJpegMetadataSegments(
+        const Glib::ustring &fname,
+        std::vector<std::pair<int, std::string>> &segments) const;
+
     MyMutex &mutex();
 };
 
@@ -76,6 +76,15 @@ public:
                             const ColorTemp &wb = ColorTemp()) {};
     virtual void demosaic(const RAWParams &raw, bool autoContrast,
                           double &contrastThreshold) {};
+    // demosaics only the area of the (full resolution) region pp, plus the
+    // border needed by the algorithm, leaving the rest of the output
+    // untouched. Returns false if this is not possible with the given params,
+    // in which case nothing is done
+    virtual bool demosaicRegion(const RAWParams &raw, int tran,
+                                const PreviewProps &pp)
+    {
+        return false;
+    }
     virtual void flushRawData() {};
     virtual void flushRGB() {};
     virtual void HLRecovery_Global(const ExposureParams &hrp) {};
@@ -87,6 +96,10 @@ public:
                                      // demosaic has been modified
 
     virtual void setBorder(unsigned int border) {}
+    // if factor > 1, the following calls to demosaic() average the CFA data
+    // in factor x factor superpixels instead of interpolating it. Only meant
+    // for previews at a scale of at least factor
+    virtual void setPreviewBinning(int factor) {}
     virtual void setCurrentFrame(unsigned int frameNum) = 0;
     virtual int getFrameCount() = 0;
     virtual int getFlatFieldAutoClipValue() = 0;
@@ -27,9 +27,11 @@
 #include "profilestore.h"
 #include "settings.h"
 #include "subprocess.h"
+#include "threadpool.h"
 #include "utils.h"
 #include <glib/gstdio.h>
 #include <iostream>
+#include <sstream>
 #include <unistd.h>
 
 namespace rtengine {
@@ -54,25 +56,90 @@ std::ostream &operator<<(std::ostream &out, const S &s)
     }
 }
 
-inline void exec_sync(const Glib::ustring &usrdir, const Glib::ustring &sysdir,
-                      const Glib::ustring &workdir,
-                      const std::vector<Glib::ustring> &argv,
-                      bool search_in_path, std::string *out, std::string *err)
+// environment of the external commands. The extra search path is passed
+// explicitly instead of modifying PATH, so that several commands can run
+// concurrently
+std::vector<std::string> get_env(const Glib::ustring &usrdir,
+                                 const Glib::ustring &sysdir)
 {
-    auto pth = Glib::getenv("PATH");
-    auto extrapath = Glib::build_filename(usrdir, "bin") +
-                     G_SEARCHPATH_SEPARATOR_S +
-                     Glib::build_filename(sysdir, "bin");
+    std::vector<Glib::ustring> extrapath = {
+        Glib::build_filename(usrdir, "bin"),
+        Glib::build_filename(sysdir, "bin")};
 #ifdef BUILD_BUNDLE
-    extrapath += G_SEARCHPATH_SEPARATOR_S + options.ART_base_dir;
+    extrapath.push_back(options.ART_base_dir);
 #endif // BUILD_BUNDLE
     auto epth = Glib::getenv("ART_EXIFTOOL_BASE_DIR");
     if (!epth.empty()) {
-        extrapath += G_SEARCHPATH_SEPARATOR_S + epth;
+        extrapath.push_back(epth);
     }
-    Glib::setenv("PATH", extrapath + G_SEARCHPATH_SEPARATOR_S + pth);
-    subprocess::exec_sync(workdir, argv, search_in_path, out, err);
-    Glib::setenv("PATH", pth);
+    return subprocess::get_env(extrapath);
+}
+
+// writes img to p as a PFM (RGB floats in [0, 1], rows from bottom to top)
+// or as a 16 bit binary PPM, followed by the output ICC profile of the image
+// (if any) until the end of the input
+bool write_piped_image(subprocess::SubprocessInfo &p, IImagefloat *img,
+                       bool isFloat, ProgressListener *plistener)
+{
+    const int W = img->getWidth();
+    const int H = img->getHeight();
+
+    std::ostringstream hdr;
+    if (isFloat) {
+        const uint16_t one = 1;
+        const bool little_endian = *reinterpret_cast<const uint8_t *>(&one);
+        hdr << "PF\n"
+            << W << " " << H << "\n"
+            << (little_endian ? "-1.0" : "1.0") << "\n";
+    } else {
+        hdr << "P6\n" << W << " " << H << "\n65535\n";
+    }
+    const std::string h = hdr.str();
+    if (!p.write(h.c_str(), h.size())) {
+        return false;
+    }
+
+    std::vector<char> row(size_t(W) * 3 * (isFloat ? sizeof(float) : 2));
+    for (int i = 0; i < H; ++i) {
+        if (isFloat) {
+            const int y = H - 1 - i;
+            float *dst = reinterpret_cast<float *>(&row[0]);
+            for (int x = 0; x < W; ++x) {
+                dst[3 * x] = img->r(y, x) / 65535.f;
+                dst[3 * x + 1] = img->g(y, x) / 65535.f;
+                dst[3 * x + 2] = img->b(y, x) / 65535.f;
+            }
+        } else {
+            const int y = i;
+            uint8_t *dst = reinterpret_cast<uint8_t *>(&row[0]);
+            for (int x = 0; x < W; ++x) {
+                const float rgb[3] = {img->r(y, x), img->g(y, x),
+                                      img->b(y, x)};
+                for (int c = 0; c < 3; ++c) {
+                    const uint16_t v = CLIP(rgb[c]) + 0.5f;
+                    *dst++ = v >> 8;
+                    *dst++ = v & 0xff;
+                }
+            }
+        }
+        if (!p.write(&row[0], row.size())) {
+            return false;
+        }
+        if (plistener && (i & 255) == 255) {
+            plistener->setProgress(0.9 * i / H);
+        }
+    }
+
+    auto iio = dynamic_cast<const ImageIO *>(img);
+    if (iio) {
+        int len = 0;
+        const char *icc = nullptr;
+        iio->getOutputProfileData(len, icc);
+        if (icc && len > 0 && !p.write(icc, len)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 } // namespace
@@ -90,6 +157,32 @@ void ImageIOManager::init(const Glib::ustring &base_dir,
     g_mkdir_with_parents(d.c_str(), 0777);
     raw_cache_.reset(new RAWCache(std::max(settings->imgio_raw_cache_size, 1),
                                   &raw_cache_hook_));
+    subprocess::ProcessPool::getInstance()->init(
+        settings->imgio_max_processes);
+}
+
+void ImageIOManager::exec(const Command &c,
+                          const std::vector<Glib::ustring> &args,
+                          std::string *out, std::string *err)
+{
+    // requests from outside of the thread pool come from the interactive
+    // parts of the GUI (e.g. opening an image in the editor), so they go
+    // first
+    const auto prio = ThreadPool::is_worker() ? ThreadPool::current_priority()
+                                              : ThreadPool::Priority::HIGH;
+    auto pool = subprocess::ProcessPool::getInstance();
+    auto argv = subprocess::split_command_line(c.cmd);
+    auto env = get_env(usrdir_, sysdir_);
+
+    if (c.server) {
+        std::vector<std::string> request(args.begin(), args.end());
+        if (!pool->exec_server(prio, c.dir, argv, env, request, out)) {
+            throw(subprocess::error() << "server reported a failure");
+        }
+    } else {
+        argv.insert(argv.end(), args.begin(), args.end());
+        pool->exec_sync(prio, c.dir, argv, true, env, out, err);
+    }
 }
 
 void ImageIOManager::do_init(const Glib::ustring &dirname)
@@ -146,7 +239,9 @@ void ImageIOManager::do_init(const Glib::ustring &dirname)
                         k.model = kf.get_string(raw_group, "Model").lowercase();
                     }
 
-                    raw_loaders_[k] = Pair(dirname, cmd);
+                    const bool server = kf.has_key(raw_group, "Server") &&
+                                        kf.get_boolean(raw_group, "Server");
+                    raw_loaders_[k] = Command(dirname, cmd, server);
 
                     if (settings->verbose > 1) {
                         std::cout << "Found RAW loader for (extension, make, "
@@ -174,10 +269,16 @@ void ImageIOManager::do_init(const Glib::ustring &dirname)
                     savefmt = kf.get_string(group, "SaveFormat").lowercase();
                 }
 
+                const bool server = kf.has_key(group, "Server") &&
+                                    kf.get_boolean(group, "Server");
+                // servers get their requests on the standard input already
+                const bool pipe = !server && kf.has_key(group, "Pipe") &&
+                                  kf.get_boolean(group, "Pipe");
+
                 Glib::ustring cmd;
                 if (kf.has_key(group, "ReadCommand")) {
                     cmd = kf.get_string(group, "ReadCommand");
-                    loaders_[ext] = Pair(dirname, cmd);
+                    loaders_[ext] = Command(dirname, cmd, server);
 
                     if (settings->verbose > 1) {
                         std::cout << "Found loader for extension \"" << ext
@@ -187,7 +288,7 @@ void ImageIOManager::do_init(const Glib::ustring &dirname)
 
                 if (kf.has_key(group, "WriteCommand")) {
                     cmd = kf.get_string(group, "WriteCommand");
-                    savers_[savefmt] = Pair(dirname, cmd);
+                    savers_[savefmt] = Command(dirname, cmd, server, pipe);
                     Glib::ustring lbl;
                     if (kf.has_key(group, "Label")) {
                         lbl = kf.get_string(group, "Label");
@@ -288,20 +389,17 @@ bool ImageIOManager::load(const Glib::ustring &fileName,
     auto fmt = fmts_[ext];
     Glib::ustring outname = fname_to_utf8(templ) + get_ext(fmt);
     // int exit_status = -1;
-    auto &dir = it->second.first;
-    auto &cmd = it->second.second;
-    std::vector<Glib::ustring> argv = subprocess::split_command_line(cmd);
-    argv.push_back(fileName);
-    argv.push_back(outname);
-    argv.push_back(std::to_string(maxw_hint));
-    argv.push_back(std::to_string(maxh_hint));
+    auto &cmd = it->second.cmd;
+    std::vector<Glib::ustring> args = {fileName, outname,
+                                       std::to_string(maxw_hint),
+                                       std::to_string(maxh_hint)};
     std::string sout, serr;
     bool ok = true;
     if (settings->verbose) {
         std::cout << "loading " << fileName << " with " << cmd << std::endl;
     }
     try {
-        exec_sync(usrdir_, sysdir_, dir, argv, true, &sout, &serr);
+        exec(it->second, args, &sout, &serr);
     } catch (subprocess::error &err) {
         if (settings->verbose) {
             std::cout << "  exec error: " << err.what() << std::endl;
@@ -412,6 +510,11 @@ bool ImageIOManager::save(IImagefloat *img, const std::string &ext,
         plistener->setProgress(0.0);
     }
 
+    auto fmt = fmts_[ext];
+    if (it->second.pipe) {
+        return save_piped(it->second, img, fmt, fileName, plistener);
+    }
+
     std::string templ = Glib::build_filename(
         Glib::get_tmp_dir(),
         Glib::ustring::compose("ART-save-%1-XXXXXX",
@@ -420,7 +523,6 @@ bool ImageIOManager::save(IImagefloat *img, const std::string &ext,
     if (fd < 0) {
         return false;
     }
-    auto fmt = fmts_[ext];
     Glib::ustring tmpname = fname_to_utf8(templ) + get_ext(fmt);
 
     bool ok = false;
@@ -455,17 +557,14 @@ bool ImageIOManager::save(IImagefloat *img, const std::string &ext,
     }
 
     if (ok) {
-        auto &dir = it->second.first;
-        auto &cmd = it->second.second;
-        std::vector<Glib::ustring> argv = subprocess::split_command_line(cmd);
-        argv.push_back(tmpname);
-        argv.push_back(fileName);
+        auto &cmd = it->second.cmd;
+        std::vector<Glib::ustring> args = {tmpname, fileName};
         std::string sout, serr;
         if (settings->verbose) {
             std::cout << "saving " << fileName << " with " << cmd << std::endl;
         }
         try {
-            exec_sync(usrdir_, sysdir_, dir, argv, true, &sout, &serr);
+            exec(it->second, args, &sout, &serr);
         } catch (subprocess::error &err) {
             if (settings->verbose) {
                 std::cout << "  exec error: " << err.what() << std::endl;
@@ -495,6 +594,58 @@ bool ImageIOManager::save(IImagefloat *img, const std::string &ext,
     return ok;
 }
 
+bool ImageIOManager::save_piped(const Command &c, IImagefloat *img,
+                                Format fmt, const Glib::ustring &fileName,
+                                ProgressListener *plistener)
+{
+    if (fmt == FMT_UNKNOWN) {
+        return false;
+    }
+    const bool isFloat = (fmt == FMT_TIFF_FLOAT || fmt == FMT_TIFF_FLOAT16);
+
+    const auto prio = ThreadPool::is_worker() ? ThreadPool::current_priority()
+                                              : ThreadPool::Priority::HIGH;
+    auto argv = subprocess::split_command_line(c.cmd);
+    argv.push_back("-");
+    argv.push_back(fileName);
+
+    if (settings->verbose) {
+        std::cout << "saving " << fileName << " with " << c.cmd
+                  << " (piped)" << std::endl;
+    }
+    bool ok = true;
+    std::string sout;
+    try {
+        subprocess::ProcessPool::getInstance()->exec_pipe(
+            prio, c.dir, argv, get_env(usrdir_, sysdir_),
+            [&](subprocess::SubprocessInfo &p) -> bool {
+                return write_piped_image(p, img, isFloat, plistener);
+            },
+            &sout);
+    } catch (subprocess::error &err) {
+        if (settings->verbose) {
+            std::cout << "  exec error: " << err.what() << std::endl;
+        }
+        ok = false;
+    }
+    if (settings->verbose > 1 && !sout.empty()) {
+        std::cout << "  output: " << sout << std::flush;
+    }
+
+    // the pixels are sent without metadata, so add it to the encoded file
+    // (if Exiv2 supports its format)
+    auto iio = dynamic_cast<const ImageIO *>(img);
+    if (ok && iio && !iio->saveMetadata(fileName) && settings->verbose) {
+        std::cout << "  could not save the metadata to " << fileName
+                  << std::endl;
+    }
+
+    if (plistener) {
+        plistener->setProgress(1.0);
+    }
+    return ok;
+}
+
 ImageIOManager::Format ImageIOManager::getFormat(const Glib::ustring &fname)
 {
     auto ext = std::string(getFileExtension(fname).lowercase());
@@ -559,7 +710,7 @@ Glib::ustring get_cache_name(const Glib::ustring &fname)
 
 } // namespace
 
-bool ImageIOManager::do_loadRaw(const Pair &p, const Glib::ustring &fname,
+bool ImageIOManager::do_loadRaw(const Command &c, const Glib::ustring &fname,
                                 Glib::ustring &out_dng_name)
 {
     Glib::ustring outname;
@@ -578,11 +729,8 @@ bool ImageIOManager::do_loadRaw(const Pair &p, const Glib::ustring &fname,
     // }
     // Glib::ustring outname = fname_to_utf8(templ) + ".dng";
 
-    auto &dir = p.first;
-    auto &cmd = p.second;
-    std::vector<Glib::ustring> argv = subprocess::split_command_line(cmd);
-    argv.push_back(fname);
-    argv.push_back(outname);
+    auto &cmd = c.cmd;
+    std::vector<Glib::ustring> args = {fname, outname};
 
     std::string sout, serr;
     bool ok = true;
@@ -590,7 +738,7 @@ bool ImageIOManager::do_loadRaw(const Pair &p, const Glib::ustring &fname,
         std::cout << "loading RAW " << fname << " with " << cmd << std::endl;
     }
     try {
-        exec_sync(usrdir_, sysdir_, dir, argv, true, &sout, &serr);
+        exec(c, args, &sout, &serr);
     } catch (subprocess::error &err) {
         if (settings->verbose) {
             std::cout << "  exec error: " << err.what() << std::endl;
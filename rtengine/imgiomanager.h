@@ -80,19 +80,40 @@ public:
                  const std::string &model, Glib::ustring &out_dng_name);
 
 private:
-    typedef std::pair<Glib::ustring, Glib::ustring> Pair;
+    struct Command {
+        Glib::ustring dir;
+        Glib::ustring cmd;
+        // if true, cmd is a persistent server (see subprocess::ProcessPool)
+        bool server;
+        // if true, a saver gets the image on its standard input instead of
+        // in a temporary file (see save_piped())
+        bool pipe;
+
+        Command(const Glib::ustring &d = "", const Glib::ustring &c = "",
+                bool s = false, bool p = false)
+            : dir(d), cmd(c), server(s), pipe(p)
+        {
+        }
+    };
 
     void do_init(const Glib::ustring &dir);
     static Glib::ustring get_ext(Format f);
 
-    bool do_loadRaw(const Pair &p, const Glib::ustring &fname,
+    void exec(const Command &c, const std::vector<Glib::ustring> &args,
+              std::string *out, std::string *err);
+
+    bool save_piped(const Command &c, IImagefloat *img, Format fmt,
+                    const Glib::ustring &fileName,
+                    ProgressListener *plistener);
+
+    bool do_loadRaw(const Command &c, const Glib::ustring &fname,
                     Glib::ustring &out_dng_name);
 
     Glib::ustring sysdir_;
     Glib::ustring usrdir_;
 
-    std::unordered_map<std::string, Pair> loaders_;
-    std::unordered_map<std::string, Pair> savers_;
+    std::unordered_map<std::string, Command> loaders_;
+    std::unordered_map<std::string, Command> savers_;
     std::unordered_map<std::string, Format> fmts_;
     std::map<std::string, SaveFormatInfo> savelbls_;
     std::unordered_map<std::string, procparams::FilePartialProfile>
@@ -131,7 +152,7 @@ private:
             return r > 0;
         }
     };
-    std::map<RawKey, Pair> raw_loaders_;
+    std::map<RawKey, Command> raw_loaders_;
 
     typedef Cache<Glib::ustring, Glib::ustring> RAWCache;
 
@@ -28,9 +28,13 @@
 #include "improcfun.h"
 #include "procevents.h"
 #include "rtengine.h"
+#include "stagecache.h"
 
+#include <chrono>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace rtengine {
 
@@ -70,6 +74,8 @@ protected:
                      // output profile as well (soft-proofing enabled, which
                      // then correspond to workimg) or not
     Image8 *workimg; // internal image in output color space for analysis
+    // previous contents of previmg, to find the area changed by an update
+    std::vector<unsigned char> previmg_backup_;
 
     ImageSource *imgsrc;
 
@@ -90,6 +96,29 @@ protected:
     int scale;
     bool highDetailPreprocessComputed;
     bool highDetailRawComputed;
+    // true if only the area of the detail windows has been demosaiced with
+    // the high detail method; the rest is done by the next update
+    bool highDetailRawPartial;
+    // true if the preview has been demosaiced with the 1-pass variant of the
+    // X-Trans method of the profile (see updatePreviewImage())
+    bool highDetailRawOnePass;
+    // superpixel size used by the last demosaic of the preview, 1 if the
+    // CFA has been interpolated (see updatePreviewImage())
+    int rawBinning;
+    // minimum scale at which the detail crops can use the fast
+    // approximations of the detail level tools, 0 if they can't (set by
+    // process())
+    int preview_proxy_;
+    // true while process() replaces the approximated crops with the exact
+    // ones: the crop updates are then interrupted by newer changes
+    bool preview_refining_;
+    // true if the last crop updates were interrupted by newer changes
+    // (always while refining, otherwise only within the frame budget after
+    // the last complete refresh, so that drags still show progress)
+    bool preview_refine_cancelled_;
+    std::chrono::steady_clock::time_point last_crop_refresh_;
+    // true once the whole frame has been demosaiced at least once
+    bool rawComputed;
     bool allocated;
 
     void freeAll();
@@ -114,6 +143,11 @@ protected:
     int waveformScale;
     bool waveform_dirty;
     array2D<int> waveformRed, waveformGreen, waveformBlue, waveformLuma;
+    /// Sampling step of the histograms, vectorscopes and waveforms: larger
+    /// than 1 while more updates are pending (e.g. during slider drags), in
+    /// which case they are recomputed with all the pixels when idle
+    int hist_stride_;
+    bool hist_sampled_;
     // ------------------------------------------------------------------------------------
 
     int fw, fh, tr, fullw, fullh;
@@ -140,6 +174,21 @@ protected:
 
     std::vector<Crop *> crops;
 
+    // final images of the crops computed since the last parameter change,
+    // so that a detail window covered by another crop at the same scale
+    // (e.g. overlapping detail windows) doesn't run the pipeline again.
+    // Protected by mProcessing
+    struct CropResult {
+        const Crop *owner;
+        int skip;
+        int proxy;
+        int x; // position of the top left corner of the images, at full scale
+        int y;
+        std::unique_ptr<Image8> img;
+        std::unique_ptr<Image8> imgtrue;
+    };
+    std::vector<CropResult> crop_results_;
+
     bool resultValid;
 
     MyMutex minit; // to gain mutually exclusive access to ... to what exactly?
@@ -150,7 +199,11 @@ protected:
     void reallocAll();
     void allocCache(Imagefloat *&imgfloat);
     void setScale(int prevscale);
+    int getPreviewScale(int prevscale);
     void updatePreviewImage(int todo, bool panningRelatedChange);
+    bool demosaicDetailRegion(const RAWParams &rp);
+    bool processStage(ImProcFunctions::Stage stage, Imagefloat *img,
+                      size_t cache_extra);
     void updateWB();
 
     void notifyHistogramChanged();
@@ -162,6 +215,12 @@ protected:
     bool updateVectorscopeHS();
     /// Updates all waveforms. Returns true unless not updated.
     bool updateWaveforms();
+    // recomputes the histograms computed with sampling, at the end of
+    // process()
+    void refreshSampledHistograms();
+
+    PipelineStageCache stage_cache_;
+    ImProcFunctions::StepCheckpoints step_checkpoints_;
 
     MyMutex mProcessing;
     ProcParams params;
@@ -229,6 +288,7 @@ public:
     void getAutoCrop(double ratio, int &x, int &y, int &w, int &h) override;
     bool getHighQualComputed() override;
     void setHighQualComputed() override;
+    int getPreviewBinning() override { return rawBinning; }
     void setMonitorProfile(const Glib::ustring &profile,
                            RenderingIntent intent) override;
     void getMonitorProfile(Glib::ustring &profile,
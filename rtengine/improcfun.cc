@@ -17,6 +17,7 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <cmath>
+#include <cstring>
 #include <glib.h>
 #include <glibmm.h>
 #ifdef _OPENMP
@@ -36,12 +37,16 @@
 #include "imagesource.h"
 #include "improccoordinator.h"
 #include "improcfun.h"
+#include "memoryusage.h"
 #include "mytime.h"
+#include "pipelineprofiler.h"
 #include "refreshmap.h"
+#include "rescale.h"
 #include "rt_math.h"
 #include "rtengine.h"
 #include "rtthumbnail.h"
 #include "utils.h"
+#include <algorithm>
 
 namespace rtengine {
 
@@ -55,17 +60,14 @@ ImProcFunctions::ImProcFunctions(const ProcParams *iparams, bool imultiThread)
       dcpProf(nullptr), dcpApplyState(nullptr), pipetteBuffer(nullptr),
       lumimul{}, offset_x(0), offset_y(0), full_width(-1), full_height(-1),
       histToneCurve(nullptr), histCCurve(nullptr), histLCurve(nullptr),
-      show_sharpening_mask(false), plistener(nullptr), progress_step(0),
-      progress_end(1)
+      show_sharpening_mask(false), preview_proxy_(0), proxy_used_(false),
+      in_proxy_(false), cancelled_(false), uninterruptible_(false),
+      plistener(nullptr), progress_step(0), progress_end(1),
+      timings_(nullptr)
 {
 }
 
-ImProcFunctions::~ImProcFunctions()
-{
-    if (monitorTransform) {
-        cmsDeleteTransform(monitorTransform);
-    }
-}
+ImProcFunctions::~ImProcFunctions() {}
 
 void ImProcFunctions::setScale(double iscale) { scale = iscale; }
 
@@ -74,12 +76,10 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
                                           bool softProof, GamutCheck gamutCheck)
 {
     // set up monitor transform
-    if (monitorTransform) {
-        cmsDeleteTransform(monitorTransform);
-    }
     gamutWarning.reset(nullptr);
 
     monitorTransform = nullptr;
+    monitor_xform_.reset();
     monitor = nullptr;
 
     if (settings->color_mgmt_mode !=
@@ -168,16 +168,16 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
                     make_gamma_table(softproof, cmsSigBlueTRCTag);
                 }
 
-                monitorTransform = cmsCreateProofingTransform(
+                monitor_xform_ = ICCStore::getInstance()->getTransform(
                     iprof, TYPE_RGB_FLT, // TYPE_Lab_FLT,
-                    monitor, TYPE_RGB_FLT, softproof, monitorIntent, outIntent,
-                    flags);
+                    monitor, TYPE_RGB_FLT, monitorIntent, flags, softproof,
+                    outIntent);
 
                 if (softproof) {
                     cmsCloseProfile(softproof);
                 }
 
-                if (monitorTransform) {
+                if (monitor_xform_) {
                     softProofCreated = true;
                 }
 
@@ -220,9 +220,14 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
                 flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
             }
 
-            monitorTransform =
-                cmsCreateTransform(iprof, TYPE_RGB_FLT, monitor, TYPE_RGB_FLT,
-                                   monitorIntent, flags);
+            monitor_xform_ = ICCStore::getInstance()->getTransform(
+                iprof, TYPE_RGB_FLT, monitor, TYPE_RGB_FLT, monitorIntent,
+                flags);
+        }
+        monitorTransform = monitor_xform_.get();
+        monitor_lut_.reset();
+        if (monitorTransform && settings->fast_monitor_transform) {
+            bake_monitor_transform();
         }
 
         if (gamutCheck && gamutprof) {
@@ -547,8 +552,160 @@ namespace {
 
 constexpr int NUM_PIPELINE_STEPS = 23;
 
+// 2x2 box downscaling, with the last row/column replicated for odd sizes
+void proxy_downscale(const float *const *src, int W, int H, float **dst,
+                     bool multithread)
+{
+    const int w = (W + 1) / 2;
+    const int h = (H + 1) / 2;
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < h; ++y) {
+        const int y0 = 2 * y;
+        const int y1 = std::min(y0 + 1, H - 1);
+        for (int x = 0; x < w; ++x) {
+            const int x0 = 2 * x;
+            const int x1 = std::min(x0 + 1, W - 1);
+            dst[y][x] = 0.25f * (src[y0][x0] + src[y0][x1] + src[y1][x0] +
+                                 src[y1][x1]);
+        }
+    }
+}
+
+// dst += bilinear upscaling of (out - in), which are half the size of dst
+void proxy_add_delta(const array2D<float> &out, const array2D<float> &in,
+                     float **dst, int W, int H, bool multithread)
+{
+    ScratchPlane delta(out.width(), out.height());
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < out.height(); ++y) {
+        for (int x = 0; x < out.width(); ++x) {
+            delta[y][x] = out[y][x] - in[y][x];
+        }
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        // the centre of the proxy pixel i is at 2 * i + 0.5
+        const float sy = std::max((y - 0.5f) * 0.5f, 0.f);
+        for (int x = 0; x < W; ++x) {
+            const float sx = std::max((x - 0.5f) * 0.5f, 0.f);
+            dst[y][x] += getBilinearValue(delta, sx, sy);
+        }
+    }
+}
+
 } // namespace
 
+bool ImProcFunctions::getAndResetProxyUsed()
+{
+    const bool ret = proxy_used_;
+    proxy_used_ = false;
+    return ret;
+}
+
+bool ImProcFunctions::proxyActive() const
+{
+    return preview_proxy_ > 0 && !in_proxy_ && scale >= preview_proxy_;
+}
+
+void ImProcFunctions::setCancelCheck(const std::function<bool()> &check)
+{
+    cancel_check_ = check;
+    cancelled_ = false;
+}
+
+bool ImProcFunctions::shouldAbort()
+{
+    if (!cancel_check_ || uninterruptible_) {
+        return false;
+    }
+    if (!cancelled_ && cancel_check_()) {
+        cancelled_ = true;
+    }
+    return cancelled_;
+}
+
+CancelToken ImProcFunctions::cancelToken()
+{
+    if (!cancel_check_) {
+        return CancelToken();
+    }
+    return [this]() -> bool { return shouldAbort(); };
+}
+
+bool ImProcFunctions::runProxy(Imagefloat *img,
+                               const std::function<void(Imagefloat *)> &op)
+{
+    const int W = img->getWidth();
+    const int H = img->getHeight();
+    if (!proxyActive() || W < 2 || H < 2) {
+        op(img);
+        return false;
+    }
+
+    Imagefloat proxy((W + 1) / 2, (H + 1) / 2, img);
+    const int w = proxy.getWidth();
+    const int h = proxy.getHeight();
+    proxy_downscale(img->r.ptrs, W, H, proxy.r.ptrs, multiThread);
+    proxy_downscale(img->g.ptrs, W, H, proxy.g.ptrs, multiThread);
+    proxy_downscale(img->b.ptrs, W, H, proxy.b.ptrs, multiThread);
+    std::unique_ptr<Imagefloat> in(proxy.copy());
+
+    const double s = scale;
+    scale = s * 2;
+    in_proxy_ = true;
+    op(&proxy);
+    in_proxy_ = false;
+    scale = s;
+
+    proxy.setMode(img->mode(), multiThread);
+    float **out_planes[3] = {proxy.r.ptrs, proxy.g.ptrs, proxy.b.ptrs};
+    float **in_planes[3] = {in->r.ptrs, in->g.ptrs, in->b.ptrs};
+    float **dst_planes[3] = {img->r.ptrs, img->g.ptrs, img->b.ptrs};
+    for (int c = 0; c < 3; ++c) {
+        array2D<float> out(w, h, out_planes[c], ARRAY2D_BYREFERENCE);
+        array2D<float> src(w, h, in_planes[c], ARRAY2D_BYREFERENCE);
+        proxy_add_delta(out, src, dst_planes[c], W, H, multiThread);
+    }
+
+    proxy_used_ = true;
+    return true;
+}
+
+bool ImProcFunctions::runProxy(array2D<float> &Y,
+                               const std::function<void(array2D<float> &)> &op)
+{
+    const int W = Y.width();
+    const int H = Y.height();
+    if (!proxyActive() || W < 2 || H < 2) {
+        op(Y);
+        return false;
+    }
+
+    // not aligned, some operators (e.g. local contrast) need contiguous rows
+    array2D<float> proxy((W + 1) / 2, (H + 1) / 2);
+    proxy_downscale(Y, W, H, proxy, multiThread);
+    ScratchPlane in(proxy.width(), proxy.height(), proxy);
+
+    const double s = scale;
+    scale = s * 2;
+    in_proxy_ = true;
+    op(proxy);
+    in_proxy_ = false;
+    scale = s;
+
+    proxy_add_delta(proxy, in, Y, W, H, multiThread);
+
+    proxy_used_ = true;
+    return true;
+}
+
 void ImProcFunctions::setProgressListener(ProgressListener *pl,
                                           int num_previews)
 {
@@ -561,92 +718,508 @@ void ImProcFunctions::setProgressListener(ProgressListener *pl,
     }
 }
 
+namespace {
+
+const char *pipeline_name(ImProcFunctions::Pipeline pipeline)
+{
+    switch (pipeline) {
+    case ImProcFunctions::Pipeline::THUMBNAIL:
+        return "THUMBNAIL";
+    case ImProcFunctions::Pipeline::NAVIGATOR:
+        return "NAVIGATOR";
+    case ImProcFunctions::Pipeline::PREVIEW:
+        return "PREVIEW";
+    default:
+        return "OUTPUT";
+    }
+}
+
+} // namespace
+
 template <class Ret, class Method>
-Ret ImProcFunctions::apply(Method op, Imagefloat *img)
+Ret ImProcFunctions::apply(const char *name, Method op, Imagefloat *img)
 {
     if (plistener) {
         float percent = float(++progress_step) / float(progress_end);
         plistener->setProgress(percent);
     }
+    PipelineProfiler::Scope prof(pipeline_name(cur_pipeline), name, &scratch_,
+                                 timings_);
+    MemoryUsage::Scope mem(name);
+    ScratchArena::Scope scratch(&scratch_);
     return (this->*op)(img);
 }
 
-bool ImProcFunctions::process(Pipeline pipeline, Stage stage, Imagefloat *img)
+namespace {
+
+typedef std::function<bool(const ProcParams &, const ProcParams &)>
+    SameInputs;
+
+template <class T> SameInputs inputs(T ProcParams::*field)
 {
-    bool stop = false;
-    cur_pipeline = pipeline;
+    return [field](const ProcParams &a, const ProcParams &b) -> bool {
+        return a.*field == b.*field;
+    };
+}
+
+template <class T, class... Rest>
+SameInputs inputs(T ProcParams::*field, Rest... rest)
+{
+    SameInputs tail = inputs(rest...);
+    return [field, tail](const ProcParams &a, const ProcParams &b) -> bool {
+        return a.*field == b.*field && tail(a, b);
+    };
+}
+
+} // namespace
 
-#define STEP_(op) apply<void>(&ImProcFunctions::op, img)
-#define STEP_s_(op) apply<bool>(&ImProcFunctions::op, img)
+void ImProcFunctions::StepCheckpoints::invalidate(Stage from)
+{
+    for (int i = int(from); i < 4; ++i) {
+        records_[i] = Record();
+    }
+}
+
+std::vector<ImProcFunctions::Step> ImProcFunctions::getSteps(Pipeline pipeline,
+                                                             Stage stage)
+{
+    std::vector<Step> steps;
+
+#define STEP_(op, ...)                                                         \
+    steps.push_back(Step{#op,                                                  \
+                         [this](Imagefloat *img) -> bool {                     \
+                             apply<void>(#op, &ImProcFunctions::op, img);      \
+                             return false;                                     \
+                         },                                                    \
+                         inputs(__VA_ARGS__), false, false})
+#define STEP_s_(op, ...)                                                       \
+    steps.push_back(Step{#op,                                                  \
+                         [this](Imagefloat *img) -> bool {                     \
+                             return apply<bool>(#op, &ImProcFunctions::op,     \
+                                                img);                          \
+                         },                                                    \
+                         inputs(__VA_ARGS__), false, false})
+#define STEP_p_(op, ...)                                                       \
+    STEP_(op, __VA_ARGS__);                                                    \
+    steps.back().pointwise = [this](RowOp &o) -> bool { return op##Op(o); }
+
+    const auto dcp_step = [&]() -> void {
+        steps.push_back(Step{"dcpProfile",
+                             [this](Imagefloat *img) -> bool {
+                                 dcpProfile(img, dcpProf, dcpApplyState,
+                                            multiThread);
+                                 return false;
+                             },
+                             inputs(&ProcParams::icm), false, false});
+        steps.back().pointwise = [this](RowOp &op) -> bool {
+            op = RowOp();
+            if (dcpProf && dcpApplyState) {
+                DCPProfile *dcp = dcpProf;
+                const DCPProfile::ApplyState *as = dcpApplyState;
+                op = [dcp, as](int thread_id, int W, float *r, float *g,
+                               float *b) -> void {
+                    dcp->step2ApplyTile(r, g, b, W, 1, 1, *as);
+                };
+            }
+            return true;
+        };
+    };
+    // the disabled operators that don't have a pointwise form can still be
+    // skipped when fusing the neighbouring ones, unless they have to fill a
+    // pipette buffer or a histogram
+    const auto noop_if = [&](std::function<bool()> disabled) -> void {
+        steps.back().pointwise = [this, disabled](RowOp &op) -> bool {
+            op = RowOp();
+            return (!pipetteBuffer ||
+                    pipetteBuffer->getEditID() == EUID_None) &&
+                   disabled();
+        };
+    };
 
     switch (stage) {
     case Stage::STAGE_0:
-        STEP_(dehaze);
-        STEP_(dynamicRangeCompression);
+        STEP_(dehaze, &ProcParams::dehaze);
+        STEP_(dynamicRangeCompression, &ProcParams::fattal);
         break;
     case Stage::STAGE_1:
-        STEP_(channelMixer);
-        STEP_(exposure);
-        STEP_(hslEqualizer);
-        stop = STEP_s_(toneEqualizer);
+        STEP_(channelMixer, &ProcParams::chmixer);
+        STEP_(exposure, &ProcParams::exposure);
+        STEP_(hslEqualizer, &ProcParams::hsl);
+        STEP_s_(toneEqualizer, &ProcParams::toneEqualizer);
         if (params->icm.workingProfile == "ProPhoto") {
-            proPhotoBlue(img, multiThread);
+            steps.push_back(Step{"proPhotoBlue",
+                                 [this](Imagefloat *img) -> bool {
+                                     proPhotoBlue(img, multiThread);
+                                     return false;
+                                 },
+                                 inputs(&ProcParams::icm), true, false});
         }
         break;
     case Stage::STAGE_2:
         if (params->icm.dcp_look_early) {
-            dcpProfile(img, dcpProf, dcpApplyState, multiThread);
+            dcp_step();
         }
-        linked_mask_mgr_.init(*params);
         if (pipeline == Pipeline::OUTPUT || pipeline == Pipeline::PREVIEW) {
-            stop = STEP_s_(sharpening);
-            if (!stop) {
-                STEP_(impulsedenoise);
-                STEP_(defringe);
-            }
+            STEP_s_(sharpening, &ProcParams::sharpening);
+            STEP_(impulsedenoise, &ProcParams::impulseDenoise);
+            STEP_(defringe, &ProcParams::defringe);
         }
-        stop = stop || STEP_s_(colorCorrection);
-        stop = stop || STEP_s_(guidedSmoothing);
+        STEP_s_(colorCorrection, &ProcParams::colorcorrection);
+        STEP_s_(guidedSmoothing, &ProcParams::smoothing,
+                &ProcParams::denoise);
         break;
     case Stage::STAGE_3:
-        STEP_(creativeGradients);
-        stop = stop || STEP_s_(textureBoost);
-        if (!stop) {
-            STEP_(filmGrain);
-            STEP_(logEncoding);
-            STEP_(saturationVibrance);
-            if (!params->icm.dcp_look_early) {
-                dcpProfile(img, dcpProf, dcpApplyState, multiThread);
+        STEP_(creativeGradients, &ProcParams::gradient,
+              &ProcParams::pcvignette, &ProcParams::crop);
+        STEP_s_(textureBoost, &ProcParams::textureBoost);
+        steps.back().detail_only = true;
+        STEP_(filmGrain, &ProcParams::grain);
+        steps.back().detail_only = true;
+        STEP_(logEncoding, &ProcParams::logenc);
+        STEP_p_(saturationVibrance, &ProcParams::saturation);
+        if (!params->icm.dcp_look_early) {
+            dcp_step();
+        }
+        if (!params->filmSimulation.after_tone_curve) {
+            STEP_p_(filmSimulation, &ProcParams::filmSimulation);
+        }
+        STEP_(toneCurve, &ProcParams::toneCurve, &ProcParams::logenc);
+        steps.back().has_side_effects = histToneCurve != nullptr;
+        noop_if([this]() -> bool {
+            return !params->toneCurve.enabled &&
+                   !(histToneCurve && *histToneCurve);
+        });
+        if (params->filmSimulation.after_tone_curve) {
+            STEP_p_(filmSimulation, &ProcParams::filmSimulation);
+        }
+        STEP_p_(rgbCurves, &ProcParams::rgbCurves);
+        STEP_(labAdjustments, &ProcParams::labCurve);
+        steps.back().has_side_effects = histCCurve || histLCurve;
+        noop_if([this]() -> bool { return !params->labCurve.enabled; });
+        STEP_p_(softLight, &ProcParams::softlight);
+        STEP_s_(localContrast, &ProcParams::localContrast);
+        steps.back().detail_only = true;
+        STEP_(blackAndWhite, &ProcParams::blackwhite);
+        if (pipeline == Pipeline::PREVIEW && params->prsharpening.enabled) {
+            steps.push_back(Step{"prsharpening",
+                                 [this](Imagefloat *img) -> bool {
+                                     double s = scale;
+                                     int fw = full_width * s,
+                                         fh = full_height * s;
+                                     int imw, imh;
+                                     double s2 =
+                                         resizeScale(params, fw, fh, imw, imh);
+                                     scale = std::max(s * s2, 1.0);
+                                     apply<bool>("prsharpening",
+                                                 &ImProcFunctions::prsharpening,
+                                                 img);
+                                     scale = s;
+                                     return false;
+                                 },
+                                 inputs(&ProcParams::prsharpening,
+                                        &ProcParams::resize, &ProcParams::crop),
+                                 true, false});
+        }
+        break;
+    }
+
+#undef STEP_
+#undef STEP_s_
+#undef STEP_p_
+
+    return steps;
+}
+
+bool ImProcFunctions::canResume()
+{
+    // a pending deltaE color pick and the edit pipettes need the operators to
+    // actually run
+    if (deltaE.x >= 0 && !deltaE.ok) {
+        return false;
+    }
+    if (pipetteBuffer && pipetteBuffer->getEditID() != EUID_None) {
+        return false;
+    }
+    // linked masks are shared between the operators of STAGE_2 and STAGE_3
+    // through linked_mask_mgr_, which in turn is shared by all the pipelines
+    for (auto t : params->get_maskable()) {
+        for (auto &m : t->get_masks()) {
+            if (m.enabled && m.linkedMask.enabled) {
+                return false;
             }
-            if (!params->filmSimulation.after_tone_curve) {
-                STEP_(filmSimulation);
+        }
+    }
+    return true;
+}
+
+bool ImProcFunctions::process(Pipeline pipeline, Stage stage, Imagefloat *img,
+                              StepCheckpoints *checkpoints)
+{
+    bool stop = false;
+    cur_pipeline = pipeline;
+    uninterruptible_ = (stage == Stage::STAGE_0);
+
+    if (stage == Stage::STAGE_2) {
+        linked_mask_mgr_.init(*params);
+    }
+
+    std::vector<Step> steps = getSteps(pipeline, stage);
+    if (pipeline == Pipeline::THUMBNAIL &&
+        std::max(img->getWidth(), img->getHeight()) <=
+            settings->thumbnail_detail_skip_size) {
+        steps.erase(std::remove_if(steps.begin(), steps.end(),
+                                   [](const Step &s) -> bool {
+                                       return s.detail_only;
+                                   }),
+                    steps.end());
+    }
+    StepCheckpoints::Record *rec = nullptr;
+    size_t start = 0;   // first step to execute
+    size_t changed = 0; // first step whose inputs changed since the last run
+
+    if (checkpoints) {
+        // the output of this stage is going to change
+        if (stage != Stage::STAGE_3) {
+            checkpoints->invalidate(Stage(int(stage) + 1));
+        }
+
+        rec = &checkpoints->records_[int(stage)];
+        if (!canResume() || !rec->params ||
+            rec->params->icm != params->icm || rec->scale != scale ||
+            rec->offset_x != offset_x || rec->offset_y != offset_y ||
+            rec->full_width != full_width ||
+            rec->full_height != full_height || rec->dcp != dcpProf ||
+            rec->sharpening_mask != show_sharpening_mask ||
+            rec->proxy != proxyActive()) {
+            *rec = StepCheckpoints::Record();
+        } else {
+            while (changed < steps.size() && changed < rec->steps.size() &&
+                   !steps[changed].has_side_effects &&
+                   std::strcmp(rec->steps[changed], steps[changed].name) == 0 &&
+                   steps[changed].same_inputs(*rec->params, *params)) {
+                ++changed;
             }
-            STEP_(toneCurve);
-            if (params->filmSimulation.after_tone_curve) {
-                STEP_(filmSimulation);
+        }
+
+        if (rec->img && rec->resume <= changed &&
+            rec->img->getWidth() == img->getWidth() &&
+            rec->img->getHeight() == img->getHeight()) {
+            rec->img->copyTo(img);
+            start = rec->resume;
+        } else if (rec->img_half && rec->resume <= changed &&
+                   rec->img_half->getWidth() == img->getWidth() &&
+                   rec->img_half->getHeight() == img->getHeight()) {
+            rec->img_half->copyTo(img, multiThread);
+            start = rec->resume;
+        } else {
+            rec->img.reset();
+            rec->img_half.reset();
+            rec->resume = 0;
+        }
+
+        rec->steps.clear();
+        for (auto &s : steps) {
+            rec->steps.push_back(s.name);
+        }
+        rec->params.reset(new ProcParams(*params));
+        rec->scale = scale;
+        rec->offset_x = offset_x;
+        rec->offset_y = offset_y;
+        rec->full_width = full_width;
+        rec->full_height = full_height;
+        rec->dcp = dcpProf;
+        rec->sharpening_mask = show_sharpening_mask;
+        rec->proxy = proxyActive();
+    }
+
+    for (size_t i = start; i < steps.size(); ++i) {
+        if (stop && !steps[i].always) {
+            continue;
+        }
+        // STAGE_0 results can be cached by the callers as soon as they are
+        // computed, so it is never interrupted
+        if (stage != Stage::STAGE_0 && shouldAbort()) {
+            return true;
+        }
+        if (rec && i == changed && i > rec->resume && !stop) {
+            // move the checkpoint right before the operator being edited
+            if (settings->half_float_buffers) {
+                rec->img.reset();
+                rec->img_half.reset(new HalfImage(img, multiThread));
+            } else {
+                rec->img_half.reset();
+                rec->img.reset(img->copy());
             }
-            STEP_(rgbCurves);
-            STEP_(labAdjustments);
-            STEP_(softLight);
+            rec->resume = i;
         }
-        stop = stop || STEP_s_(localContrast);
+
+        // consecutive pointwise operators are executed in a single pass over
+        // the image, stopping at the position of the checkpoint (if any)
+        size_t end = i;
+        std::vector<RowOp> ops;
         if (!stop) {
-            STEP_(blackAndWhite);
+            for (RowOp op; end < steps.size() && steps[end].pointwise &&
+                           !(end > i && rec && end == changed) &&
+                           steps[end].pointwise(op);
+                 ++end) {
+                if (op) {
+                    ops.push_back(op);
+                }
+            }
         }
-        if (pipeline == Pipeline::PREVIEW && params->prsharpening.enabled) {
-            double s = scale;
-            int fw = full_width * s, fh = full_height * s;
-            int imw, imh;
-            double s2 = resizeScale(params, fw, fh, imw, imh);
-            scale = std::max(s * s2, 1.0);
-            STEP_s_(prsharpening);
-            scale = s;
+
+        if (end > i) {
+            if (plistener) {
+                progress_step += int(end - i);
+                plistener->setProgress(float(progress_step) /
+                                       float(progress_end));
+            }
+            if (!ops.empty()) {
+                PipelineProfiler::Scope prof(pipeline_name(cur_pipeline),
+                                             "pointwise", &scratch_, timings_);
+                MemoryUsage::Scope mem("pointwise");
+                applyRowOps(img, ops);
+            }
+            i = end - 1;
+        } else {
+            stop = steps[i].run(img) || stop;
         }
-        break;
     }
+
+    uninterruptible_ = false;
     return stop;
 }
 
+void ImProcFunctions::applyRowOps(Imagefloat *img,
+                                  const std::vector<RowOp> &ops)
+{
+    if (ops.empty()) {
+        return;
+    }
+
+    img->setMode(Imagefloat::Mode::RGB, multiThread);
+
+    const int W = img->getWidth();
+    const int H = img->getHeight();
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multiThread)
+#endif
+    for (int y = 0; y < H; ++y) {
+#ifdef _OPENMP
+        const int thread_id = omp_get_thread_num();
+#else
+        const int thread_id = 0;
+#endif
+        float *r = img->r(y);
+        float *g = img->g(y);
+        float *b = img->b(y);
+        for (auto &op : ops) {
+            op(thread_id, W, r, g, b);
+        }
+    }
+}
+
+namespace {
+
+bool uses_masks(const std::vector<Mask> &masks)
+{
+    for (auto &m : masks) {
+        if (m.enabled &&
+            (m.parametricMask.enabled || m.areaMask.enabled ||
+             m.deltaEMask.enabled || m.drawnMask.enabled ||
+             m.externalMask.enabled)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+int ImProcFunctions::getTileHalo(Stage stage)
+{
+    constexpr int GLOBAL = -1;
+    const double s = std::max(scale, 1e-3);
+    int halo = 0;
+
+    // the operators are applied in sequence, so their halos add up
+    const auto add = [&](double h) -> void { halo += int(std::ceil(h)); };
+
+    switch (stage) {
+    case Stage::STAGE_0:
+        // dehaze and dynamic range compression both estimate their
+        // parameters on the whole image
+        if (params->dehaze.enabled || params->fattal.enabled) {
+            return GLOBAL;
+        }
+        break;
+    case Stage::STAGE_1:
+        if (params->toneEqualizer.enabled) {
+            return GLOBAL;
+        }
+        if (params->hsl.enabled && params->hsl.smoothing > 0) {
+            const float smooth =
+                std::pow(10.f, LIM01(params->hsl.smoothing / 10.f)) - 1.f;
+            add(2 * 25 / s * smooth + 2);
+        }
+        break;
+    case Stage::STAGE_2:
+        if (params->sharpening.enabled) {
+            const int h = getSharpeningHalo(params->sharpening);
+            if (h < 0) {
+                return GLOBAL;
+            }
+            halo += h;
+        }
+        if (params->impulseDenoise.enabled) {
+            add(8);
+        }
+        if (params->defringe.enabled) {
+            add(3 * params->defringe.radius / s +
+                std::ceil(2 * params->defringe.radius / s) + 2);
+        }
+        if (params->colorcorrection.enabled &&
+            uses_masks(params->colorcorrection.masks)) {
+            return GLOBAL;
+        }
+        if (params->smoothing.enabled) {
+            return GLOBAL;
+        }
+        break;
+    case Stage::STAGE_3:
+        if (params->textureBoost.enabled || params->localContrast.enabled ||
+            params->grain.enabled) {
+            return GLOBAL;
+        }
+        if (params->logenc.enabled && params->logenc.regularization > 0) {
+            if (full_width <= 0 || full_height <= 0) {
+                return GLOBAL;
+            }
+            add(2 * std::max(full_width, full_height) / 30.0 + 2);
+        }
+        break;
+    }
+
+    return halo;
+}
+
+int ImProcFunctions::getSharpeningHalo(const SharpeningParams &sp)
+{
+    const double s = std::max(scale, 1e-3);
+    if (!sp.enabled) {
+        return 0;
+    } else if (sp.method == "psf") {
+        return -1;
+    } else if (sp.method == "rld") {
+        // several iterations of a gaussian of the given sigma
+        return int(
+            std::ceil(4 * 3 * (sp.deconvradius + sp.deconvCornerBoost) / s + 8));
+    } else {
+        return int(std::ceil(3 * std::max(sp.radius, sp.edges_radius) / s + 8));
+    }
+}
+
 int ImProcFunctions::setDeltaEData(EditUniqueID id, double x, double y)
 {
     deltaE.ok = false;
@@ -21,35 +21,54 @@
 #define _IMPROCFUN_H_
 
 #include "LUT.h"
+#include "LUT3D.h"
 #include "color.h"
 #include "coord2d.h"
 #include "cplx_wavelet_dec.h"
 #include "curves.h"
 #include "dcp.h"
 #include "gamutwarning.h"
+#include "halfimage.h"
 #include "image16.h"
 #include "image8.h"
 #include "imagefloat.h"
 #include "labimage.h"
 #include "lcp.h"
 #include "masks.h"
+#include "noncopyable.h"
 #include "pipettebuffer.h"
 #include "procparams.h"
+#include "scratcharena.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
 
 namespace rtengine {
 
 using namespace procparams;
 
+class ProcessingTimings;
+
+// polled by the long-running operators in their outer loops: when it
+// returns true, the result is not needed anymore and they can skip the rest
+// of the work (leaving the output in an undefined state)
+typedef std::function<bool()> CancelToken;
+
 struct ImProcData {
     const ProcParams *params;
     double scale;
     bool multiThread;
+    CancelToken cancel;
 
     explicit ImProcData(const ProcParams *p = nullptr, double s = 1.0,
-                        bool m = true)
-        : params(p), scale(s), multiThread(m)
+                        bool m = true, const CancelToken &c = CancelToken())
+        : params(p), scale(s), multiThread(m), cancel(c)
     {
     }
+
+    bool cancelled() const { return cancel && cancel(); }
 };
 
 class ImProcFunctions {
@@ -65,7 +84,13 @@ public:
     void updateColorProfiles(const Glib::ustring &monitorProfile,
                              RenderingIntent monitorIntent, bool softProof,
                              GamutCheck gamutCheck);
-    void setMonitorTransform(cmsHTRANSFORM xform) { monitorTransform = xform; }
+    // xform is not owned by ImProcFunctions
+    void setMonitorTransform(cmsHTRANSFORM xform)
+    {
+        monitor_xform_.reset();
+        monitor_lut_.reset();
+        monitorTransform = xform;
+    }
 
     void setDCPProfile(DCPProfile *dcp, const DCPProfile::ApplyState &as)
     {
@@ -76,6 +101,8 @@ public:
     void setPipetteBuffer(PipetteBuffer *pb) { pipetteBuffer = pb; }
 
     void setProgressListener(ProgressListener *pl, int num_previews);
+    // the operators run by process() add their time to timings, if not null
+    void setTimings(ProcessingTimings *timings) { timings_ = timings; }
     //----------------------------------------------------------------------
 
     //----------------------------------------------------------------------
@@ -83,12 +110,81 @@ public:
     //----------------------------------------------------------------------
     enum class Stage { STAGE_0, STAGE_1, STAGE_2, STAGE_3 };
     enum class Pipeline { THUMBNAIL, NAVIGATOR, PREVIEW, OUTPUT };
-    bool process(Pipeline pipeline, Stage stage, Imagefloat *img);
+
+    // Per-operator state of a pipeline, used by process() to re-execute only
+    // the operators of a stage whose inputs changed since the previous run.
+    // For each stage, it records the parameters seen by each operator and a
+    // snapshot of the image as it was before the first operator that changed
+    // the last time, so that editing the same tool again can resume from
+    // there. Each pipeline instance (e.g. each Crop) needs its own object.
+    class StepCheckpoints: public NonCopyable {
+    public:
+        // discards what was recorded for the given stage and the following
+        // ones; to be called when their input changes for reasons not
+        // captured by the parameters of the stages (e.g. a new raw image)
+        void invalidate(Stage from = Stage::STAGE_0);
+
+    private:
+        friend class ImProcFunctions;
+
+        struct Record {
+            Record(): resume(0), scale(0), offset_x(0), offset_y(0),
+                      full_width(0), full_height(0), dcp(nullptr),
+                      sharpening_mask(false), proxy(false) {}
+
+            std::vector<const char *> steps;
+            std::unique_ptr<ProcParams> params;
+            size_t resume; // index of the step whose input is in img
+            std::unique_ptr<Imagefloat> img;
+            // used instead of img when settings->half_float_buffers is set
+            std::unique_ptr<HalfImage> img_half;
+
+            // processing state not captured by params
+            double scale;
+            int offset_x;
+            int offset_y;
+            int full_width;
+            int full_height;
+            const DCPProfile *dcp;
+            bool sharpening_mask;
+            bool proxy;
+        };
+
+        Record records_[4];
+    };
+
+    bool process(Pipeline pipeline, Stage stage, Imagefloat *img,
+                 StepCheckpoints *checkpoints = nullptr);
+    // number of pixels of context needed around a tile by the operators of
+    // the given stage, or -1 if some of them need to see the whole image
+    int getTileHalo(Stage stage);
+    // same for the given sharpening alone
+    int getSharpeningHalo(const SharpeningParams &sp);
 
     void setViewport(int ox, int oy, int fw, int fh);
     void setOutputHistograms(LUTu *histToneCurve, LUTu *histCCurve,
                              LUTu *histLCurve);
     void setShowSharpeningMask(bool yes);
+    // enables the fast approximations of the detail level operators when
+    // the preview scale is at least min_scale (0 disables them). Meant to be
+    // enabled only around the updates of the detail crops, while the user is
+    // interacting with the tools
+    void setPreviewProxy(int min_scale) { preview_proxy_ = min_scale; }
+    int getPreviewProxy() const { return preview_proxy_; }
+    // true if some operator used an approximation since the last call
+    bool getAndResetProxyUsed();
+    // check called before each operator of STAGE_1 and later; when it
+    // returns true, process() gives up and cancelled() is set until the
+    // next call of setCancelCheck()
+    void setCancelCheck(const std::function<bool()> &check);
+    bool cancelled() const { return cancelled_; }
+    // polled by the operators themselves (from any thread): true if the
+    // current processing has been superseded and can be abandoned. Never
+    // true during STAGE_0, whose results are cached by the callers
+    bool shouldAbort();
+    // token wrapping shouldAbort(), for the operators outside of this class
+    // (empty if there's no cancel check)
+    CancelToken cancelToken();
     //----------------------------------------------------------------------
 
     //----------------------------------------------------------------------
@@ -163,8 +259,10 @@ public:
                     const procparams::ColorManagementParams &icm,
                     bool consider_histogram_settings = true);
 
+    /// if inplace is true, the conversion overwrites img, which is returned
     Imagefloat *rgb2out(Imagefloat *img,
-                        const procparams::ColorManagementParams &icm);
+                        const procparams::ColorManagementParams &icm,
+                        bool inplace = false);
 
     void rgb2lab(Imagefloat &src, LabImage &dst,
                  const Glib::ustring &workingSpace);
@@ -238,6 +336,9 @@ public:
 private:
     cmsHPROFILE monitor;
     cmsHTRANSFORM monitorTransform;
+    ICCStore::Transform monitor_xform_; // owner of monitorTransform, if any
+    std::unique_ptr<LUT3D> monitor_lut_; // monitorTransform baked, see
+                                         // bake_monitor_transform()
     std::unique_ptr<GamutWarning> gamutWarning;
 
     const ProcParams *params;
@@ -262,21 +363,43 @@ private:
     LUTu *histLCurve;
 
     bool show_sharpening_mask;
+    int preview_proxy_;
+    bool proxy_used_;
+    bool in_proxy_;
+    std::function<bool()> cancel_check_;
+    std::atomic<bool> cancelled_;
+    bool uninterruptible_;
 
     ProgressListener *plistener;
     int progress_step;
     int progress_end;
+    ProcessingTimings *timings_;
 
     LinkedMaskManager linked_mask_mgr_;
 
+    // temporaries of the operators, reused across runs of the pipeline
+    ScratchArena scratch_;
+
 private:
+    // bakes monitorTransform (from RGB_FLT) into monitor_lut_
+    void bake_monitor_transform();
+
+    bool proxyActive() const;
+    // if the approximations are active, runs op on a half size copy of img
+    // (with the scale adjusted accordingly) and adds the upscaled difference
+    // to img; otherwise runs op on img, and returns false
+    bool runProxy(Imagefloat *img, const std::function<void(Imagefloat *)> &op);
+    bool runProxy(array2D<float> &Y,
+                  const std::function<void(array2D<float> &)> &op);
+
     void transformLuminanceOnly(Imagefloat *original, Imagefloat *transformed,
                                 int cx, int cy, int oW, int oH, int fW, int fH,
                                 bool creative);
     void transformGeneral(bool highQuality, Imagefloat *original,
                           Imagefloat *transformed, int cx, int cy, int sx,
                           int sy, int oW, int oH, int fW, int fH,
-                          const LensCorrection *pLCPMap);
+                          const LensCorrection *pLCPMap,
+                          const std::string &lens_key);
     void transformLCPCAOnly(Imagefloat *original, Imagefloat *transformed,
                             int cx, int cy, const LensCorrection *pLCPMap);
 
@@ -291,7 +414,50 @@ private:
     bool needsLCP();
     bool needsLensfun();
 
-    template <class Ret, class Method> Ret apply(Method op, Imagefloat *img);
+    template <class Ret, class Method>
+    Ret apply(const char *name, Method op, Imagefloat *img);
+
+    // a pointwise operator prepared for the current parameters, applied in
+    // place to a row of W pixels in RGB mode. thread_id is the index of the
+    // calling thread in the loop over the rows
+    typedef std::function<void(int thread_id, int W, float *r, float *g,
+                               float *b)>
+        RowOp;
+
+    // pointwise forms of the operators, which process() fuses into a single
+    // pass over the image. They return false if the operator can't be
+    // executed pointwise (e.g. because it fills a pipette buffer), otherwise
+    // op is set to the operator, or left empty if there's nothing to do
+    bool saturationVibranceOp(RowOp &op);
+    bool filmSimulationOp(RowOp &op);
+    bool rgbCurvesOp(RowOp &op, bool ignore_pipette = false);
+    bool softLightOp(RowOp &op);
+    // applies ops to every row of img
+    void applyRowOps(Imagefloat *img, const std::vector<RowOp> &ops);
+
+    typedef std::function<bool(const ProcParams &, const ProcParams &)>
+        SameInputs;
+
+    struct Step {
+        const char *name;
+        std::function<bool(Imagefloat *)> run;
+        // true if the operator would produce the same result with both sets
+        // of parameters
+        SameInputs same_inputs;
+        // executed even after a previous step has returned true (stop)
+        bool always;
+        // produces something else than the image (e.g. histograms), so it
+        // can't be skipped
+        bool has_side_effects;
+        // set for the operators that have a pointwise form (see RowOp)
+        std::function<bool(RowOp &)> pointwise;
+        // the operator only affects the fine detail, so the THUMBNAIL
+        // pipeline skips it for small thumbnails (see
+        // Settings::thumbnail_detail_skip_size)
+        bool detail_only;
+    };
+    std::vector<Step> getSteps(Pipeline pipeline, Stage stage);
+    bool canResume();
 };
 
 } // namespace rtengine
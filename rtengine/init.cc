@@ -18,22 +18,30 @@
  */
 #include "../rtgui/profilestorecombobox.h"
 #include "../rtgui/threadutils.h"
+#include "asyncreader.h"
+#include "autologcache.h"
 #include "camconst.h"
 #include "curves.h"
 #include "dcp.h"
+#include "denoiseinfocache.h"
 #include "dfmanager.h"
 #include "ffmanager.h"
+#include "fftwplans.h"
 #include "iccstore.h"
 #include "imgiomanager.h"
 #include "improccoordinator.h"
 #include "improcfun.h"
 #include "masks.h"
 #include "metadata.h"
+#include "pipelineprofiler.h"
+#include "planepool.h"
 #include "profilestore.h"
+#include "rawdecodecache.h"
 #include "rawimagesource.h"
 #include "rtengine.h"
 #include "rtlensfun.h"
 #include "rtthumbnail.h"
+#include "subprocess.h"
 #include "threadpool.h"
 #include <fftw3.h>
 
@@ -48,6 +56,9 @@
 namespace rtengine {
 
 std::unique_ptr<ThreadPool> ThreadPool::instance_;
+thread_local int ThreadPool::worker_index_ = -1;
+thread_local ThreadPool::Priority ThreadPool::current_priority_ =
+    ThreadPool::Priority::NORMAL;
 
 const Settings *settings;
 
@@ -71,6 +82,31 @@ int init(const Settings *s, Glib::ustring baseDir,
 #endif
     }
     ThreadPool::init(num_threads);
+    PipelineProfiler::getInstance()->init();
+
+    // the lensfun database, the DCP profiles and the dark frame and flat
+    // field directories are loaded on first use; in the GUI, they are also
+    // preloaded in the background, so that they are usually ready when the
+    // first image is opened
+    LFDatabase::lazyInit().set([=]() {
+        if (s->lensfunDbDirectory.empty()) {
+            if (!LFDatabase::init(s->lensfunDbDirectory)) {
+                LFDatabase::init(
+                    Glib::build_filename(baseDir, "share", "lensfun"));
+            }
+        } else if (Glib::path_is_absolute(s->lensfunDbDirectory)) {
+            LFDatabase::init(s->lensfunDbDirectory);
+        } else {
+            LFDatabase::init(
+                Glib::build_filename(baseDir, s->lensfunDbDirectory));
+        }
+    });
+    DCPStore::lazyInit().set([=]() {
+        DCPStore::getInstance()->init(
+            Glib::build_filename(baseDir, "dcpprofiles"), loadAll);
+    });
+    dfm.init(s->darkFramesPath, true);
+    ffm.init(s->flatFieldsPath, true);
 
 #ifdef _OPENMP
 #pragma omp parallel sections if (!settings->verbose)
@@ -78,22 +114,6 @@ int init(const Settings *s, Glib::ustring baseDir,
     {
 #ifdef _OPENMP
 #pragma omp section
-#endif
-        {
-            if (s->lensfunDbDirectory.empty()) {
-                if (!LFDatabase::init(s->lensfunDbDirectory)) {
-                    LFDatabase::init(
-                        Glib::build_filename(baseDir, "share", "lensfun"));
-                }
-            } else if (Glib::path_is_absolute(s->lensfunDbDirectory)) {
-                LFDatabase::init(s->lensfunDbDirectory);
-            } else {
-                LFDatabase::init(
-                    Glib::build_filename(baseDir, s->lensfunDbDirectory));
-            }
-        }
-#ifdef _OPENMP
-#pragma omp section
 #endif
         {
             ProfileStore::getInstance()->init(loadAll);
@@ -108,29 +128,21 @@ int init(const Settings *s, Glib::ustring baseDir,
         }
 #ifdef _OPENMP
 #pragma omp section
-#endif
-        {
-            DCPStore::getInstance()->init(
-                Glib::build_filename(baseDir, "dcpprofiles"), loadAll);
-        }
-#ifdef _OPENMP
-#pragma omp section
 #endif
         {
             CameraConstantsStore::getInstance()->init(baseDir, userSettingsDir);
         }
-#ifdef _OPENMP
-#pragma omp section
-#endif
-        {
-            dfm.init(s->darkFramesPath);
-        }
-#ifdef _OPENMP
-#pragma omp section
-#endif
-        {
-            ffm.init(s->flatFieldsPath);
-        }
+    }
+
+    if (loadAll) {
+        ThreadPool::add_task(ThreadPool::Priority::LOW,
+                             []() { LFDatabase::lazyInit().wait(); });
+        ThreadPool::add_task(ThreadPool::Priority::LOW,
+                             []() { DCPStore::lazyInit().wait(); });
+        ThreadPool::add_task(ThreadPool::Priority::LOW,
+                             []() { dfm.getPathname(); });
+        ThreadPool::add_task(ThreadPool::Priority::LOW,
+                             []() { ffm.getPathname(); });
     }
 
     Color::init();
@@ -138,6 +150,11 @@ int init(const Settings *s, Glib::ustring baseDir,
 
     DynamicProfileRules::init(baseDir);
     ImageIOManager::getInstance()->init(baseDir, userSettingsDir);
+    RawDecodeCache::getInstance()->init();
+    FFTWPlanCache::getInstance()->init();
+    DenoiseInfoCache::getInstance()->init();
+    AutoLogCache::getInstance()->init();
+    AsyncReader::getInstance()->init();
 #ifdef ART_USE_OCIO
     ExternalLUT3D::init();
 #endif
@@ -155,11 +172,18 @@ int init(const Settings *s, Glib::ustring baseDir,
 
 void cleanup()
 {
+    PipelineProfiler::getInstance()->flush();
+    AsyncReader::getInstance()->cleanup();
     Exiv2Metadata::cleanup();
+    RawDecodeCache::getInstance()->cleanup();
+    DenoiseInfoCache::getInstance()->cleanup();
+    AutoLogCache::getInstance()->cleanup();
+    subprocess::ProcessPool::getInstance()->cleanup();
     ProcParams::cleanup();
     Color::cleanup();
     RawImageSource::cleanup();
 
+    FFTWPlanCache::getInstance()->cleanup();
 #ifdef RT_FFTW3F_OMP
     fftwf_cleanup_threads();
 #else
@@ -170,6 +194,7 @@ void cleanup()
     ExternalLUT3D::cleanup();
 #endif
     ExternalMaskManager::cleanup();
+    PlanePool::getInstance()->cleanup();
 }
 
 StagedImageProcessor *StagedImageProcessor::create(InitialImage *initialImage)
@@ -190,7 +215,19 @@ Settings::Settings()
       xmp_sidecar_style(XmpSidecarStyle::STD),
       metadata_xmp_sync(MetadataXmpSync::NONE), thread_pool_size(0),
       ctl_scripts_fast_preview(false),
-      os_monitor_profile(StdMonitorProfile::SRGB), imgio_raw_cache_size(10)
+      os_monitor_profile(StdMonitorProfile::SRGB), imgio_raw_cache_size(10),
+      imgio_max_processes(0), raw_decode_cache_size(0), output_tile_size(0),
+      preview_stage_cache_size(128), preview_step_checkpoints(true),
+      preview_proxy_skip(3), preview_progressive(true),
+      preview_frame_budget(100),
+      scratch_arena_memory_limit(512), fattal_multigrid(false),
+      fast_monitor_transform(true), clut_cache_memory_limit(256),
+      clut_disk_cache_size(512), extlut_disk_cache_size(256),
+      half_float_buffers(false), early_crop(true),
+      mask_processing_scale(1), histogram_live_stride(4),
+      color_tables_cache(false), metadata_cache_memory_limit(64),
+      defect_map_min_images(0), numa_first_touch(true),
+      plane_pool_memory_limit(512), plane_swap_threshold(0)
 {
 }
 
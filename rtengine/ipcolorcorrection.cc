@@ -793,8 +793,9 @@ bool ImProcFunctions::colorCorrection(Imagefloat *rgb)
 #pragma omp for
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int i = 0; i < n; ++i) {
+            for (int i = 0; i < n;) {
                 if (!params->colorcorrection.masks[i].enabled) {
+                    ++i;
                     continue;
                 }
                 if (lut[i]) {
@@ -820,16 +821,33 @@ bool ImProcFunctions::colorCorrection(Imagefloat *rgb)
                         rgb->b(y, x) = intp(blend, u, rgb->b(y, x));
                         rgb->r(y, x) = intp(blend, v, rgb->r(y, x));
                     }
-                } else {
-                    int x = 0;
-#ifdef __SSE2__
-                    for (; x < W - 3; x += 4) {
-                        vfloat Yv = LVF(rgb->g(y, x));
-                        vfloat uv = LVF(rgb->b(y, x));
-                        vfloat vv = LVF(rgb->r(y, x));
+                    ++i;
+                    continue;
+                }
 
-                        vfloat blendv = LVFU(abmask[i][y][x]);
-                        vfloat lblendv = LVFU(Lmask[i][y][x]);
+                // the adjustments of the regions up to the next LUT one are
+                // all pointwise, so apply them one pixel at a time instead of
+                // one row at a time, loading and storing each pixel only once
+                int end = i + 1;
+                while (end < n &&
+                       !(params->colorcorrection.masks[end].enabled &&
+                         lut[end])) {
+                    ++end;
+                }
+
+                int x = 0;
+#ifdef __SSE2__
+                for (; x < W - 3; x += 4) {
+                    vfloat Yv = LVF(rgb->g(y, x));
+                    vfloat uv = LVF(rgb->b(y, x));
+                    vfloat vv = LVF(rgb->r(y, x));
+
+                    for (int k = i; k < end; ++k) {
+                        if (!params->colorcorrection.masks[k].enabled) {
+                            continue;
+                        }
+                        vfloat blendv = LVFU(abmask[k][y][x]);
+                        vfloat lblendv = LVFU(Lmask[k][y][x]);
 
                         vmask some_blend = vmaskf_gt(blendv, ZEROV);
                         vmask some_lblend = vmaskf_gt(lblendv, ZEROV);
@@ -839,42 +857,48 @@ bool ImProcFunctions::colorCorrection(Imagefloat *rgb)
                             vfloat u_newv = uv;
                             vfloat v_newv = vv;
 
-                            CDL_v(i, Y_newv, u_newv, v_newv);
+                            CDL_v(k, Y_newv, u_newv, v_newv);
 
                             Yv = vintpf(lblendv, Y_newv, Yv);
                             uv = vintpf(blendv, u_newv, uv);
                             vv = vintpf(blendv, v_newv, vv);
                         }
-                        STVF(rgb->g(y, x), Yv);
-                        STVF(rgb->b(y, x), uv);
-                        STVF(rgb->r(y, x), vv);
                     }
+                    STVF(rgb->g(y, x), Yv);
+                    STVF(rgb->b(y, x), uv);
+                    STVF(rgb->r(y, x), vv);
+                }
 #endif // __SSE2__
-                    for (; x < W; ++x) {
-                        float Y = rgb->g(y, x);
-                        float u = rgb->b(y, x);
-                        float v = rgb->r(y, x);
-
-                        float blend = abmask[i][y][x];
-                        float lblend = Lmask[i][y][x];
+                for (; x < W; ++x) {
+                    float Y = rgb->g(y, x);
+                    float u = rgb->b(y, x);
+                    float v = rgb->r(y, x);
+
+                    for (int k = i; k < end; ++k) {
+                        if (!params->colorcorrection.masks[k].enabled) {
+                            continue;
+                        }
+                        float blend = abmask[k][y][x];
+                        float lblend = Lmask[k][y][x];
 
                         if (blend > 0.f || lblend > 0.f) {
                             float Y_new = Y;
                             float u_new = u;
                             float v_new = v;
 
-                            CDL(i, Y_new, u_new, v_new);
+                            CDL(k, Y_new, u_new, v_new);
 
                             Y = intp(lblend, Y_new, Y);
                             u = intp(blend, u_new, u);
                             v = intp(blend, v_new, v);
                         }
-
-                        rgb->g(y, x) = Y;
-                        rgb->b(y, x) = u;
-                        rgb->r(y, x) = v;
                     }
+
+                    rgb->g(y, x) = Y;
+                    rgb->b(y, x) = u;
+                    rgb->r(y, x) = v;
                 }
+                i = end;
             }
         }
     }
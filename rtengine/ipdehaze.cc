@@ -30,13 +30,15 @@
 
 #include "guidedfilter.h"
 #include "improcfun.h"
+#include "opthelper.h"
 #include "rescale.h"
 #include "rt_algo.h"
 #include "rt_math.h"
+#include "sleef.h"
 // #include "gauss.h"
 #include "boxblur.h"
+#include <algorithm>
 #include <iostream>
-#include <queue>
 
 extern Options options;
 
@@ -91,6 +93,12 @@ int get_dark_channel(const array2D<float> &R, const array2D<float> &G,
     const int W = R.width();
     const int H = R.height();
 
+#ifdef __SSE2__
+    const vfloat ambientv[3] = {F2V(ambient ? ambient[0] : 1.f),
+                                F2V(ambient ? ambient[1] : 1.f),
+                                F2V(ambient ? ambient[2] : 1.f)};
+#endif
+
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
@@ -99,8 +107,25 @@ int get_dark_channel(const array2D<float> &R, const array2D<float> &G,
         for (int x = 0; x < W; x += patchsize) {
             float val = RT_INFINITY_F;
             const int pW = min(x + patchsize, W);
+#ifdef __SSE2__
+            vfloat valv = F2V(RT_INFINITY_F);
+#endif
             for (int yy = y; yy < pH; ++yy) {
-                for (int xx = x; xx < pW; ++xx) {
+                int xx = x;
+#ifdef __SSE2__
+                for (; xx < pW - 3; xx += 4) {
+                    vfloat r = LVFU(R[yy][xx]);
+                    vfloat g = LVFU(G[yy][xx]);
+                    vfloat b = LVFU(B[yy][xx]);
+                    if (ambient) {
+                        r /= ambientv[0];
+                        g /= ambientv[1];
+                        b /= ambientv[2];
+                    }
+                    valv = vminf(valv, vminf(r, vminf(g, b)));
+                }
+#endif
+                for (; xx < pW; ++xx) {
                     float r = R[yy][xx];
                     float g = G[yy][xx];
                     float b = B[yy][xx];
@@ -112,6 +137,9 @@ int get_dark_channel(const array2D<float> &R, const array2D<float> &G,
                     val = min(val, r, g, b);
                 }
             }
+#ifdef __SSE2__
+            val = min(val, vhmin(valv));
+#endif
             if (clip) {
                 val = LIM01(val);
             }
@@ -133,13 +161,12 @@ float estimate_ambient_light(const array2D<float> &R, const array2D<float> &G,
     const int W = R.width();
     const int H = R.height();
 
-    const auto get_percentile = [](std::priority_queue<float> &q,
+    // the n-th smallest value, with n = size * prcnt
+    const auto get_percentile = [](std::vector<float> &v,
                                    float prcnt) -> float {
-        size_t n = LIM<size_t>(q.size() * prcnt, 1, q.size());
-        while (q.size() > n) {
-            q.pop();
-        }
-        return q.top();
+        size_t n = LIM<size_t>(v.size() * prcnt, 1, v.size());
+        std::nth_element(v.begin(), v.begin() + (n - 1), v.end());
+        return v[n - 1];
     };
 
     const auto OOG = [](float val, float high) -> bool {
@@ -148,11 +175,12 @@ float estimate_ambient_light(const array2D<float> &R, const array2D<float> &G,
 
     float darklim = RT_INFINITY_F;
     {
-        std::priority_queue<float> p;
+        std::vector<float> p;
+        p.reserve(npatches);
         for (int y = 0; y < H; y += patchsize) {
             for (int x = 0; x < W; x += patchsize) {
                 if (!OOG(dark[y][x], 1.f - 1e-5f)) {
-                    p.push(dark[y][x]);
+                    p.push_back(dark[y][x]);
                 }
             }
         }
@@ -181,7 +209,8 @@ float estimate_ambient_light(const array2D<float> &R, const array2D<float> &G,
 
     float bright_lim = RT_INFINITY_F;
     {
-        std::priority_queue<float> l;
+        std::vector<float> l;
+        l.reserve(patches.size() * patchsize * patchsize);
 
         for (auto &p : patches) {
             const int pW = min(p.first + patchsize, W);
@@ -189,7 +218,7 @@ float estimate_ambient_light(const array2D<float> &R, const array2D<float> &G,
 
             for (int y = p.second; y < pH; ++y) {
                 for (int x = p.first; x < pW; ++x) {
-                    l.push(R[y][x] + G[y][x] + B[y][x]);
+                    l.push_back(R[y][x] + G[y][x] + B[y][x]);
                 }
             }
         }
@@ -427,8 +456,6 @@ void ImProcFunctions::dehaze(Imagefloat *img)
 
     DEBUG_DUMP(t_tilde);
 
-    array2D<bool> add_haze(W, H);
-
     FlatCurve strength_curve(params->dehaze.strength, false);
     strength_curve.setIdentityValue(0.5);
     LUTf strength(65536);
@@ -447,7 +474,6 @@ void ImProcFunctions::dehaze(Imagefloat *img)
                                           img->b(y, x), ws) *
                       maxchan;
             float s = strength[Y];
-            add_haze[y][x] = s < 0;
             dark[y][x] = 1.f - std::abs(s) * dark[y][x];
         }
     }
@@ -481,6 +507,11 @@ void ImProcFunctions::dehaze(Imagefloat *img)
         for (int x = 0; x < W; ++x) {
             // ensure that the transmission is such that to avoid clipping...
             float rgb[3] = {img->r(y, x), img->g(y, x), img->b(y, x)};
+            // the sign of the strength is recomputed here rather than kept
+            // in a full size mask, the pixel hasn't been modified yet
+            const bool add_haze =
+                strength[Color::rgbLuminance(rgb[0], rgb[1], rgb[2], ws) *
+                         maxchan] < 0;
             // ... t >= tl to avoid negative values
             float tl = 1.f - min(rgb[0] / ambient[0], rgb[1] / ambient[1],
                                  rgb[2] / ambient[2]);
@@ -502,7 +533,7 @@ void ImProcFunctions::dehaze(Imagefloat *img)
                 float Y = Color::rgbLuminance(rgb[0], rgb[1], rgb[2], ws);
                 float YY = (Y - ambientY) / mt + ambientY;
                 if (Y > 1e-5f) {
-                    if (add_haze[y][x]) {
+                    if (add_haze) {
                         YY = Y + Y - YY;
                     }
                     float f = YY / Y;
@@ -515,7 +546,7 @@ void ImProcFunctions::dehaze(Imagefloat *img)
                 float g = (rgb[1] - ambient[1]) / mt + ambient[1];
                 float b = (rgb[2] - ambient[2]) / mt + ambient[2];
 
-                if (add_haze[y][x]) {
+                if (add_haze) {
                     ir += (ir - r);
                     ig += (ig - g);
                     ib += (ib - b);
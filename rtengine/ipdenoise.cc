@@ -17,6 +17,7 @@
  */
 
 #include "ipdenoise.h"
+#include "denoiseinfocache.h"
 #include "imagesource.h"
 #include "improcfun.h"
 #include "mytime.h"
@@ -603,8 +604,6 @@ void RGB_denoise_info(ImProcData &im, Imagefloat *src, Imagefloat *provicalc,
                 }
             }
 
-            int datalen = labdn->W * labdn->H;
-
             // now perform basic wavelet denoise
             // last two arguments of wavelet decomposition are max number of
             // wavelet decomposition levels; and whether to subsample the image
@@ -632,15 +631,14 @@ void RGB_denoise_info(ImProcData &im, Imagefloat *src, Imagefloat *provicalc,
 #endif
                 {
                     adecomp = new wavelet_decomposition(
-                        labdn->data + datalen, labdn->W, labdn->H, levwav, 1);
+                        labdn->a[0], labdn->W, labdn->H, levwav, 1);
                 }
 #ifdef _OPENMP
 #pragma omp section
 #endif
                 {
                     bdecomp = new wavelet_decomposition(
-                        labdn->data + 2 * datalen, labdn->W, labdn->H, levwav,
-                        1);
+                        labdn->b[0], labdn->W, labdn->H, levwav, 1);
                 }
             }
 
@@ -847,6 +845,20 @@ void ImProcFunctions::denoiseComputeParams(ImageSource *imgsrc,
         return;
     }
 
+    // the estimate of the same image might have been computed by another
+    // pipeline, or in a previous session
+    const std::string cache_key =
+        DenoiseInfoCache::get_key(imgsrc, currWB, *params);
+    if (DenoiseInfoCache::getInstance()->get(cache_key, store)) {
+        dnparams.chrominance =
+            store.chrominance * dnparams.chrominanceAutoFactor;
+        dnparams.chrominanceRedGreen =
+            store.chrominanceRedGreen * dnparams.chrominanceAutoFactor;
+        dnparams.chrominanceBlueYellow =
+            store.chrominanceBlueYellow * dnparams.chrominanceAutoFactor;
+        return;
+    }
+
     if (settings->verbose) {
         std::cout << "Denoise: computing auto chrominance params..."
                   << std::endl;
@@ -1148,6 +1160,7 @@ void ImProcFunctions::denoiseComputeParams(ImageSource *imgsrc,
             store.chrominanceBlueYellow * dnparams.chrominanceAutoFactor;
 
         store.valid = true;
+        DenoiseInfoCache::getInstance()->put(cache_key, store);
 
         // printf("DENOISE STORE FINAL:\n  chM = %.6f", store.chM);
         // printf("  max_r = {");
@@ -1170,7 +1183,7 @@ void ImProcFunctions::denoiseComputeParams(ImageSource *imgsrc,
 }
 
 void ImProcFunctions::denoise(ImageSource *imgsrc, const ColorTemp &currWB,
-                              Imagefloat *img, const DenoiseInfoStore &store,
+                              Imagefloat *image, const DenoiseInfoStore &store,
                               const procparams::DenoiseParams &dnparams)
 {
     if (!dnparams.enabled) {
@@ -1182,80 +1195,87 @@ void ImProcFunctions::denoise(ImageSource *imgsrc, const ColorTemp &currWB,
         plistener->setProgress(0);
     }
 
-    procparams::DenoiseParams denoiseParams = dnparams;
-    denoise::NoiseCurve noiseLCurve;
-    denoise::NoiseCurve noiseCCurve;
+    // when zoomed out, the approximation computed at half size is good
+    // enough while editing
+    runProxy(image, [&](Imagefloat *img) -> void {
+        procparams::DenoiseParams denoiseParams = dnparams;
+        denoise::NoiseCurve noiseLCurve;
+        denoise::NoiseCurve noiseCCurve;
 
-    const int W = img->getWidth();
-    const int H = img->getHeight();
+        const int W = img->getWidth();
+        const int H = img->getHeight();
 
-    Imagefloat *calclum = nullptr;
-    {
-        const int fw = W;
-        const int fh = H;
-        // we only need image reduced to 1/4 here
-        calclum = new Imagefloat((fw + 1) / 2,
-                                 (fh + 1) / 2); // for luminance denoise curve
+        Imagefloat *calclum = nullptr;
+        {
+            const int fw = W;
+            const int fh = H;
+            // we only need image reduced to 1/4 here
+            // for luminance denoise curve
+            calclum = new Imagefloat((fw + 1) / 2, (fh + 1) / 2);
 #ifdef _OPENMP
 #pragma omp parallel for if (multiThread)
 #endif
 
-        for (int ii = 0; ii < fh; ii += 2) {
-            for (int jj = 0; jj < fw; jj += 2) {
-                calclum->r(ii >> 1, jj >> 1) = img->r(ii, jj);
-                calclum->g(ii >> 1, jj >> 1) = img->g(ii, jj);
-                calclum->b(ii >> 1, jj >> 1) = img->b(ii, jj);
+            for (int ii = 0; ii < fh; ii += 2) {
+                for (int jj = 0; jj < fw; jj += 2) {
+                    calclum->r(ii >> 1, jj >> 1) = img->r(ii, jj);
+                    calclum->g(ii >> 1, jj >> 1) = img->g(ii, jj);
+                    calclum->b(ii >> 1, jj >> 1) = img->b(ii, jj);
+                }
             }
+            imgsrc->convertColorSpace(calclum, params->icm, currWB);
         }
-        imgsrc->convertColorSpace(calclum, params->icm, currWB);
-    }
 
-    float nresi, highresi;
-    DenoiseInfoStore &dnstore = const_cast<DenoiseInfoStore &>(store);
+        float nresi, highresi;
+        DenoiseInfoStore &dnstore = const_cast<DenoiseInfoStore &>(store);
 
-    adjust_params(denoiseParams, scale);
+        adjust_params(denoiseParams, scale);
 
-    noiseCCurve.Set(
-        {FCT_MinMaxCPoints, 0.05, 0.50, 0.35, 0.35, 0.35, 0.05, 0.35, 0.35});
+        noiseCCurve.Set({FCT_MinMaxCPoints, 0.05, 0.50, 0.35, 0.35, 0.35, 0.05,
+                         0.35, 0.35});
 
-    if (plistener) {
-        plistener->setProgress(0.1);
-    }
+        if (plistener) {
+            plistener->setProgress(0.1);
+        }
 
-    ImProcData im(params, scale, multiThread);
-    double ecomp = params->exposure.enabled ? params->exposure.expcomp : 0.0;
-    ExposureParams expparams;
-    expparams.enabled = true;
-    expparams.expcomp = ecomp;
+        ImProcData im(params, scale, multiThread, cancelToken());
+        double ecomp =
+            params->exposure.enabled ? params->exposure.expcomp : 0.0;
+        ExposureParams expparams;
+        expparams.enabled = true;
+        expparams.expcomp = ecomp;
 
-    if (ecomp > 0) {
-        expcomp(img, &expparams);
-    }
+        if (ecomp > 0) {
+            expcomp(img, &expparams);
+        }
 
-    denoise::RGB_denoise(im, 0, img, img, calclum, dnstore.ch_M, dnstore.max_r,
-                         dnstore.max_b, true /*imgsrc->isRAW()*/, denoiseParams,
-                         0, noiseLCurve, noiseCCurve, nresi, highresi);
+        denoise::RGB_denoise(im, 0, img, img, calclum, dnstore.ch_M,
+                             dnstore.max_r, dnstore.max_b,
+                             true /*imgsrc->isRAW()*/, denoiseParams, 0,
+                             noiseLCurve, noiseCCurve, nresi, highresi);
 
-    if (plistener) {
-        plistener->setProgress(0.8);
-    }
+        if (plistener) {
+            plistener->setProgress(0.8);
+        }
 
-    if (denoiseParams.smoothingEnabled) {
-        denoise::denoiseGuidedSmoothing(im, img);
-        if (denoiseParams.nlStrength) {
-            img->setMode(Imagefloat::Mode::YUV, multiThread);
-            array2D<float> tmp(img->getWidth(), img->getHeight(), img->g.ptrs,
-                               ARRAY2D_BYREFERENCE);
-            denoise::NLMeans(tmp, 65535.f, denoiseParams.nlStrength,
-                             denoiseParams.nlDetail, scale, multiThread);
-            img->setMode(Imagefloat::Mode::RGB, multiThread);
+        if (denoiseParams.smoothingEnabled && !im.cancelled()) {
+            denoise::denoiseGuidedSmoothing(im, img);
+            if (denoiseParams.nlStrength) {
+                img->setMode(Imagefloat::Mode::YUV, multiThread);
+                array2D<float> tmp(img->getWidth(), img->getHeight(),
+                                   img->g.ptrs, ARRAY2D_BYREFERENCE);
+                denoise::NLMeans(tmp, 65535.f, denoiseParams.nlStrength,
+                                 denoiseParams.nlDetail, scale, multiThread,
+                                 im.cancel);
+                img->setMode(Imagefloat::Mode::RGB, multiThread);
+            }
         }
-    }
 
-    if (ecomp > 0) {
-        expparams.expcomp = -ecomp;
-        expcomp(img, &expparams);
-    }
+        if (ecomp > 0) {
+            expparams.expcomp = -ecomp;
+            expcomp(img, &expparams);
+        }
+    });
 
     if (plistener) {
         plistener->setProgress(1);
@@ -74,6 +74,12 @@ void Median_Denoise(float **src, float **dst, int width, int height,
                     Median medianType, int iterations, int numThreads,
                     float **buffer = nullptr);
 
+// square window of any radius, see median_filter() in rt_algo.h. The cost
+// per pixel doesn't depend on the radius, so larger windows are better than
+// repeating the fixed size ones
+void Median_Denoise(float **src, float **dst, float upperBound, int width,
+                    int height, int radius, int iterations, bool multithread);
+
 void WaveletDenoiseAll_info(
     int levwav, wavelet_decomposition &WaveletCoeffs_a,
     wavelet_decomposition &WaveletCoeffs_b, float **noisevarlum,
@@ -90,7 +96,8 @@ void detail_mask(const array2D<float> &src, array2D<float> &mask, float scaling,
                  float blur_radius, bool multithread);
 
 void NLMeans(array2D<float> &img, float normcoeff, int strength,
-             int detail_thresh, float scale, bool multithread);
+             int detail_thresh, float scale, bool multithread,
+             const CancelToken &cancel = CancelToken());
 
 } // namespace denoise
 } // namespace rtengine
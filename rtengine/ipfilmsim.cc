@@ -32,22 +32,30 @@ namespace rtengine {
 
 void ImProcFunctions::filmSimulation(Imagefloat *img)
 {
-    if (!params->filmSimulation.enabled) {
-        return;
+    RowOp op;
+    filmSimulationOp(op);
+    if (op) {
+        applyRowOps(img, {op});
     }
+}
 
-    img->setMode(Imagefloat::Mode::RGB, multiThread);
+bool ImProcFunctions::filmSimulationOp(RowOp &op)
+{
+    op = RowOp();
+    if (!params->filmSimulation.enabled) {
+        return true;
+    }
 
 #ifdef _OPENMP
     int num_threads = multiThread ? omp_get_max_threads() : 1;
 #else
     int num_threads = 1;
 #endif
-    CLUTApplication clut(
+    std::shared_ptr<CLUTApplication> clut(new CLUTApplication(
         params->filmSimulation.clutFilename, params->icm.workingProfile,
-        float(params->filmSimulation.strength) / 100.f, num_threads);
+        float(params->filmSimulation.strength) / 100.f, num_threads));
 
-    if (clut) {
+    if (*clut) {
         CLUTApplication::Quality q = CLUTApplication::Quality::HIGHEST;
         switch (cur_pipeline) {
         case Pipeline::THUMBNAIL:
@@ -64,8 +72,11 @@ void ImProcFunctions::filmSimulation(Imagefloat *img)
         default:
             break;
         }
-        if (clut.set_param_values(params->filmSimulation.lut_params, q)) {
-            clut(img);
+        if (clut->set_param_values(params->filmSimulation.lut_params, q)) {
+            op = [clut](int thread_id, int W, float *r, float *g,
+                        float *b) -> void {
+                clut->apply(thread_id, W, r, g, b);
+            };
         } else if (plistener) {
             plistener->error(
                 Glib::ustring::compose(M("TP_FILMSIMULATION_LABEL") + " - " +
@@ -79,6 +90,7 @@ void ImProcFunctions::filmSimulation(Imagefloat *img)
                 ? "(" + M("GENERAL_NONE") + ")"
                 : params->filmSimulation.clutFilename));
     }
+    return true;
 }
 
 } // namespace rtengine
@@ -70,6 +70,15 @@ void ImProcFunctions::hslEqualizer(Imagefloat *img)
         }
     };
 
+#ifdef __SSE2__
+    const auto hue01v = [=](vfloat h) -> vfloat {
+        const vfloat onev = F2V(1.f);
+        vfloat v = h * F2V(1.f / pi2);
+        v = vself(vmaskf_lt(v, ZEROV), v + onev, v);
+        return vself(vmaskf_gt(v, onev), v - onev, v);
+    };
+#endif
+
     const auto tolin = [](float y, float base) -> float {
         float v = (y - 0.5f) * 2.f;
         return SGN(v) * LIM01(xlog2lin(std::abs(v), base));
@@ -95,7 +104,16 @@ void ImProcFunctions::hslEqualizer(Imagefloat *img)
 #pragma omp parallel for if (multiThread)
 #endif
     for (int y = 0; y < H; ++y) {
-        for (int x = 0; x < W; ++x) {
+        int x = 0;
+#ifdef __SSE2__
+        for (; x < W - 3; x += 4) {
+            const vfloat u = LVFU(img->b(y, x));
+            const vfloat v = LVFU(img->r(y, x));
+            STVFU(img->r(y, x), xatan2f(u, v));
+            STVFU(img->b(y, x), vsqrtf(SQRV(u) + SQRV(v)));
+        }
+#endif
+        for (; x < W; ++x) {
             float h, s;
             float u = img->b(y, x);
             float v = img->r(y, x);
@@ -106,13 +124,20 @@ void ImProcFunctions::hslEqualizer(Imagefloat *img)
     }
 
     if (!scurve.isIdentity()) {
+        const CurveLUT slut(scurve, multiThread);
 #ifdef _OPENMP
 #pragma omp parallel for if (multiThread)
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x < W - 3; x += 4) {
+                STVFU(mask[y][x], slut(hue01v(LVFU(img->r(y, x)))));
+            }
+#endif
+            for (; x < W; ++x) {
                 float h = img->r(y, x);
-                float f = scurve.getVal(hue01(h));
+                float f = slut(hue01(h));
                 mask[y][x] = f;
             }
         }
@@ -123,33 +148,61 @@ void ImProcFunctions::hslEqualizer(Imagefloat *img)
             guidedFilter(Y, mask, mask, radius, eps, multiThread);
         }
 
-        FlatCurve coeff(
-            {FCT_MinMaxCPoints, 0.25, 0.0, 0.5, 0.18, 1, 1, 0, 0.35});
+        const CurveLUT coeff(
+            FlatCurve({FCT_MinMaxCPoints, 0.25, 0.0, 0.5, 0.18, 1, 1, 0, 0.35}),
+            multiThread);
 
+#ifdef __SSE2__
+        const vfloat onev = F2V(1.f);
+        const vfloat twov = F2V(2.f);
+        const vfloat halfv = F2V(0.5f);
+        const vfloat ln2v = F2V(xlogf(2.f));
+#endif
 #ifdef _OPENMP
 #pragma omp parallel for if (multiThread)
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x < W - 3; x += 4) {
+                // same as the scalar code below, with tolin() inlined
+                const vfloat m = (LVFU(mask[y][x]) - halfv) * twov;
+                const vfloat f = vmulsignf(
+                    vminf(xexpf(vabsf(m) * ln2v) - onev, onev), m);
+                const vfloat b = LVFU(img->b(y, x));
+                const vfloat c = coeff(b);
+                const vfloat s = onev + vself(vmaskf_lt(f, ZEROV), c, onev - c);
+                STVFU(img->b(y, x),
+                      b * (onev + vmulsignf(pow_F(vabsf(f), s), f)));
+            }
+#endif
+            for (; x < W; ++x) {
                 float f = tolin(mask[y][x], 2.f); // 10.f);
                 // float s = LIM01(img->b(y, x) * 4.f);
                 // img->b(y, x) *= 1.f + (f >= 0.f ? pow_F(s, 1.8f) :
                 // pow_F(s, 1.f/1.8f)) * f;
-                float s = 1.f + (f < 0 ? coeff.getVal(img->b(y, x))
-                                       : 1.f - coeff.getVal(img->b(y, x)));
+                float s = 1.f + (f < 0 ? coeff(img->b(y, x))
+                                       : 1.f - coeff(img->b(y, x)));
                 img->b(y, x) *= 1.f + SGN(f) * pow_F(LIM01(std::abs(f)), s);
             }
         }
     }
 
     if (!lcurve.isIdentity()) {
+        const CurveLUT llut(lcurve, multiThread);
 #ifdef _OPENMP
 #pragma omp parallel for if (multiThread)
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x < W - 3; x += 4) {
+                STVFU(mask[y][x], llut(hue01v(LVFU(img->r(y, x)))));
+            }
+#endif
+            for (; x < W; ++x) {
                 float h = img->r(y, x);
-                float f = lcurve.getVal(hue01(h));
+                float f = llut(hue01(h));
                 mask[y][x] = f;
             }
         }
@@ -172,13 +225,20 @@ void ImProcFunctions::hslEqualizer(Imagefloat *img)
     }
 
     if (!hcurve.isIdentity()) {
+        const CurveLUT hlut(hcurve, multiThread);
 #ifdef _OPENMP
 #pragma omp parallel for if (multiThread)
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x < W - 3; x += 4) {
+                STVFU(mask[y][x], hlut(hue01v(LVFU(img->r(y, x)))));
+            }
+#endif
+            for (; x < W; ++x) {
                 float h = img->r(y, x);
-                float f = hcurve.getVal(hue01(h));
+                float f = hlut(hue01(h));
                 mask[y][x] = f;
             }
         }
@@ -206,7 +266,16 @@ void ImProcFunctions::hslEqualizer(Imagefloat *img)
 #pragma omp parallel for if (multiThread)
 #endif
     for (int y = 0; y < H; ++y) {
-        for (int x = 0; x < W; ++x) {
+        int x = 0;
+#ifdef __SSE2__
+        for (; x < W - 3; x += 4) {
+            const vfloat s = LVFU(img->b(y, x));
+            const vfloat2 sincosval = xsincosf(LVFU(img->r(y, x)));
+            STVFU(img->b(y, x), s * sincosval.x);
+            STVFU(img->r(y, x), s * sincosval.y);
+        }
+#endif
+        for (; x < W; ++x) {
             float h = img->r(y, x);
             float s = img->b(y, x);
             float u, v;
@@ -173,23 +173,31 @@ void get_L_curve(LUTf &out, int brightness, int contrast,
     }
 }
 
+void get_ab_curve(LUTf &out, const std::vector<double> &curve, int skip)
+{
+    // the table doesn't depend on the image, so it is shared with the other
+    // pipelines
+    out = *curves::get_cached_lut(
+        (curves::LUTKey("labcurve_ab") << curve << skip).str(),
+        [&](LUTf &lut) -> void {
+            std::unique_ptr<DiagonalCurve> dCurve;
+
+            // create a curve if needed
+            if (!curve.empty() && curve[0] != 0) {
+                dCurve.reset(
+                    new DiagonalCurve(curve, CURVES_MIN_POLY_POINTS / skip));
+            }
+            lut(65536);
+            fillCurveArray(dCurve.get(), lut, skip,
+                           dCurve && !dCurve->isIdentity());
+        });
+}
+
 void get_ab_curves(LUTf &aout, LUTf &bout, const std::vector<double> &acurve,
                    const std::vector<double> &bcurve, int skip)
 {
-    std::unique_ptr<DiagonalCurve> dCurve;
-
-    // create a curve if needed
-    if (!acurve.empty() && acurve[0] != 0) {
-        dCurve.reset(new DiagonalCurve(acurve, CURVES_MIN_POLY_POINTS / skip));
-    }
-    fillCurveArray(dCurve.get(), aout, skip, dCurve && !dCurve->isIdentity());
-
-    dCurve = nullptr;
-
-    if (!bcurve.empty() && bcurve[0] != 0) {
-        dCurve.reset(new DiagonalCurve(bcurve, CURVES_MIN_POLY_POINTS / skip));
-    }
-    fillCurveArray(dCurve.get(), bout, skip, dCurve && !dCurve->isIdentity());
+    get_ab_curve(aout, acurve, skip);
+    get_ab_curve(bout, bcurve, skip);
 }
 
 void lab_adjustments(const ImProcData &im, Imagefloat *img, LUTf &lcurve,
@@ -256,7 +256,8 @@ void evaluate_params(wavelet_decomposition &wd, float *mean, float *meanN,
 
 void local_contrast_wavelets(array2D<float> &Y,
                              const LocalContrastParams::Region &params,
-                             double scale, bool multiThread)
+                             double scale, bool multiThread,
+                             const CancelToken &cancel)
 {
     const int W = Y.width();
     const int H = Y.height();
@@ -267,13 +268,22 @@ void local_contrast_wavelets(array2D<float> &Y,
         --wavelet_level;
     }
     int skip = scale;
+#ifdef _OPENMP
+    int nthreads = multiThread ? omp_get_num_procs() : 1;
+#else
+    int nthreads = 1;
+#endif
     wavelet_decomposition wd(static_cast<float *>(Y), W, H, wavelet_level, 1,
-                             skip);
+                             skip, nthreads);
 
     // if (wd.memoryAllocationFailed) {
     //     return;
     // }
 
+    if (cancel && cancel()) {
+        return;
+    }
+
     const float contrast = params.contrast;
     int maxlvl = wd.maxlevel();
 
@@ -372,6 +382,10 @@ void local_contrast_wavelets(array2D<float> &Y,
     }
 
     for (int dir = 1; dir < 4; dir++) {
+        if (cancel && cancel()) {
+            return;
+        }
+
         for (int level = 0; level < maxlvl; ++level) {
             int W_L = wd.level_W(level);
             int H_L = wd.level_H(level);
@@ -482,13 +496,19 @@ bool ImProcFunctions::localContrast(Imagefloat *rgb)
 
         array2D<float> L(W, H, rgb->g.ptrs);
 
+        const CancelToken cancel = cancelToken();
+
         for (int i = 0; i < n; ++i) {
             if (!params->localContrast.masks[i].enabled) {
                 continue;
+            } else if (shouldAbort()) {
+                break;
             }
 
             auto &r = params->localContrast.regions[i];
-            local_contrast_wavelets(L, r, scale, multiThread);
+            runProxy(L, [&](array2D<float> &LL) -> void {
+                local_contrast_wavelets(LL, r, scale, multiThread, cancel);
+            });
             const auto &blend = mask[i];
 #ifdef _OPENMP
 #pragma omp parallel for if (multiThread)
@@ -22,6 +22,7 @@
 #include <omp.h>
 #endif
 
+#include "autologcache.h"
 #include "curves.h"
 #include "guidedfilter.h"
 #include "imagesource.h"
@@ -302,10 +303,10 @@ void log_encode(Imagefloat *rgb, const ProcParams *params, float scale,
     }
 }
 
-} // namespace
-
-void ImProcFunctions::getAutoLog(ImageSource *imgsrc,
-                                 LogEncodingParams &lparams)
+// the statistics of a downscaled rendering of the image, with neutral
+// exposure and raw settings
+AutoLogCache::Info get_autolog_info(ImageSource *imgsrc,
+                                    const ColorManagementParams &icm)
 {
     constexpr int SCALE = 10;
     int fw, fh, tr = TR_NONE;
@@ -316,9 +317,9 @@ void ImProcFunctions::getAutoLog(ImageSource *imgsrc,
     neutral.exposure.enabled = true;
     imgsrc->getImage(imgsrc->getWB(), tr, &img, pp, neutral.exposure,
                      neutral.raw);
-    imgsrc->convertColorSpace(&img, params->icm, imgsrc->getWB());
+    imgsrc->convertColorSpace(&img, icm, imgsrc->getWB());
     TMatrix ws =
-        ICCStore::getInstance()->workingSpaceMatrix(params->icm.workingProfile);
+        ICCStore::getInstance()->workingSpaceMatrix(icm.workingProfile);
 
     float vmin = RT_INFINITY;
     float vmax = -RT_INFINITY;
@@ -346,6 +347,63 @@ void ImProcFunctions::getAutoLog(ImageSource *imgsrc,
     vmin *= 0.5f;
     vmax *= 1.5f;
 
+    AutoLogCache::Info info;
+    info.vmin = vmin;
+    info.vmax = vmax;
+    info.gray = 0.f;
+
+    if (vmax > vmin) {
+        // the mid-tones are averaged regardless of lparams.autogain, so that
+        // the cached result serves both modes
+        const float dynamic_range = -xlogf(vmin / vmax) / xlogf(2.f);
+        double tot = 0.f;
+        int n = 0;
+        float gmax = std::min(vmax / 2.f, 0.25f);
+        float gmin = std::max(
+            vmin * std::pow(2.f, std::max((dynamic_range - 1.f) / 2.f, 1.f)),
+            0.05f);
+        if (settings->verbose) {
+            std::cout << "AutoLog: gray boundaries: " << gmin << ", " << gmax
+                      << std::endl;
+        }
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                float l = Y[y][x];
+                if (l >= gmin && l <= gmax) {
+                    tot += l;
+                    ++n;
+                }
+            }
+        }
+        if (n > 0) {
+            info.gray = tot / n;
+            if (settings->verbose) {
+                std::cout << "         " << n << " gray samples" << std::endl;
+            }
+        }
+    }
+
+    return info;
+}
+
+} // namespace
+
+void ImProcFunctions::getAutoLog(ImageSource *imgsrc,
+                                 LogEncodingParams &lparams)
+{
+    // the analysis depends only on the image and on a few upstream
+    // parameters, so it is shared by all the pipelines processing the same
+    // image, and across sessions
+    AutoLogCache::Info info;
+    const std::string cache_key = AutoLogCache::get_key(imgsrc, *params);
+    if (!AutoLogCache::getInstance()->get(cache_key, info)) {
+        info = get_autolog_info(imgsrc, params->icm);
+        AutoLogCache::getInstance()->put(cache_key, info);
+    }
+
+    const float vmin = info.vmin;
+    const float vmax = info.vmax;
+
     if (vmax > vmin) {
         const float log2 = xlogf(2.f);
         float dynamic_range = -xlogf(vmin / vmax) / log2;
@@ -355,36 +413,18 @@ void ImProcFunctions::getAutoLog(ImageSource *imgsrc,
         }
 
         if (lparams.autogain) {
-            double tot = 0.f;
-            int n = 0;
-            float gmax = std::min(vmax / 2.f, 0.25f);
-            float gmin = std::max(
-                vmin *
-                    std::pow(2.f, std::max((dynamic_range - 1.f) / 2.f, 1.f)),
-                0.05f);
-            if (settings->verbose) {
-                std::cout << "         gray boundaries: " << gmin << ", "
-                          << gmax << std::endl;
-            }
-            for (int y = 0; y < h; ++y) {
-                for (int x = 0; x < w; ++x) {
-                    float l = Y[y][x];
-                    if (l >= gmin && l <= gmax) {
-                        tot += l;
-                        ++n;
-                    }
+            if (info.gray > 0.f) {
+                lparams.gain = gray2ev(info.gray);
+                if (settings->verbose) {
+                    std::cout << "         computed gain: " << lparams.gain
+                              << std::endl;
                 }
-            }
-            if (n > 0) {
-                lparams.gain = gray2ev(tot / n);
+            } else {
                 if (settings->verbose) {
-                    std::cout << "         computed gain from " << n
-                              << " samples: " << lparams.gain << std::endl;
+                    std::cout << "         no samples found in range, "
+                                 "resorting to default gain value"
+                              << std::endl;
                 }
-            } else if (settings->verbose) {
-                std::cout << "         no samples found in range, resorting to "
-                             "default gain value"
-                          << std::endl;
                 lparams.gain = LogEncodingParams().gain;
             }
         }
@@ -399,6 +439,7 @@ void ImProcFunctions::getAutoLog(ImageSource *imgsrc,
     }
 }
 
+
 void ImProcFunctions::logEncoding(Imagefloat *rgb)
 {
     if (params->logenc.enabled) {
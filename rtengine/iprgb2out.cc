@@ -25,7 +25,9 @@
 #include "improcfun.h"
 #include "rtengine.h"
 #include "settings.h"
+#include "sleef.h"
 #include <glibmm.h>
+#include <vector>
 
 #define BENCHMARK
 #include "StopWatch.h"
@@ -84,6 +86,53 @@ inline void copyAndClamp(Imagefloat *src, unsigned char *dst,
     }
 }
 
+// the monitor transform is baked into a LUT of MONITOR_LUT_DIM^3 samples, on
+// the [0,1] cube of the gamma encoded output space. The LUT stores the
+// monitor values raised to MONITOR_LUT_SHAPER, which roughly linearizes them
+// and so keeps the interpolation error small in the shadows. With these
+// values the error stays below 0.5/255 (e.g. ~0.31/255 from sRGB to a
+// gamma 2.2 Display P3), the pixels outside of the cube are converted by
+// lcms
+constexpr int MONITOR_LUT_DIM = 33;
+constexpr float MONITOR_LUT_SHAPER = 2.2f;
+
+class MonitorLutInitializer: public LUT3D::initializer {
+public:
+    explicit MonitorLutInitializer(const float *data): data_(data) {}
+
+    void operator()(float &r, float &g, float &b) override
+    {
+        r = data_[0];
+        g = data_[1];
+        b = data_[2];
+        data_ += 3;
+    }
+
+private:
+    const float *data_;
+};
+
+// out = max(out, 0)^(1/MONITOR_LUT_SHAPER)
+inline void unshape_monitor_line(float *out, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const vfloat expv = F2V(1.f / MONITOR_LUT_SHAPER);
+    for (; i < n - 3; i += 4) {
+        STVFU(out[i], pow_F(vmaxf(LVFU(out[i]), ZEROV), expv));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = out[i] > 0.f ? pow_F(out[i], 1.f / MONITOR_LUT_SHAPER) : 0.f;
+    }
+}
+
+inline bool in_unit_cube(const float *rgb)
+{
+    return rgb[0] >= 0.f && rgb[0] <= 1.f && rgb[1] >= 0.f &&
+           rgb[1] <= 1.f && rgb[2] >= 0.f && rgb[2] <= 1.f;
+}
+
 class ARTOutputProfile {
 public:
     ARTOutputProfile(cmsHPROFILE prof,
@@ -229,6 +278,31 @@ private:
 
 } // namespace
 
+void ImProcFunctions::bake_monitor_transform()
+{
+    constexpr int dim = MONITOR_LUT_DIM;
+    constexpr int n = dim * dim * dim;
+    std::vector<float> grid(3 * n);
+    for (int i = 0, idx = 0; i < dim; ++i) {
+        for (int j = 0; j < dim; ++j) {
+            for (int k = 0; k < dim; ++k, idx += 3) {
+                grid[idx] = float(i) / (dim - 1);
+                grid[idx + 1] = float(j) / (dim - 1);
+                grid[idx + 2] = float(k) / (dim - 1);
+            }
+        }
+    }
+    std::vector<float> out(3 * n);
+    cmsDoTransform(monitorTransform, &grid[0], &out[0], n);
+    for (auto &v : out) {
+        v = std::pow(std::max(v, 0.f), MONITOR_LUT_SHAPER);
+    }
+
+    MonitorLutInitializer init(&out[0]);
+    monitor_lut_.reset(new LUT3D());
+    monitor_lut_->init(dim, init);
+}
+
 void ImProcFunctions::rgb2monitor(Imagefloat *img, Image8 *image,
                                   bool bypass_out)
 {
@@ -253,6 +327,7 @@ void ImProcFunctions::rgb2monitor(Imagefloat *img, Image8 *image,
         const int W = img->getWidth();
         const int H = img->getHeight();
         unsigned char *data = image->data;
+        const LUT3D *lut = bypass_out ? nullptr : monitor_lut_.get();
 
         // cmsDoTransform is relatively expensive
 #ifdef _OPENMP
@@ -265,16 +340,17 @@ void ImProcFunctions::rgb2monitor(Imagefloat *img, Image8 *image,
             AlignedBuffer<float> gwBuf1;
             AlignedBuffer<float> gwBuf2;
             AlignedBuffer<float> gwSrcBuf;
+            AlignedBuffer<int> gwPosBuf;
 
             if (gamutWarning) {
                 gwSrcBuf.resize(3 * W);
                 gwBuf1.resize(3 * W);
                 gwBuf2.resize(3 * W);
+                gwPosBuf.resize(W);
             }
 
             float *buffer = pBuf.data;
             float *outbuffer = mBuf.data;
-            float *gwbuffer = gwSrcBuf.data;
 
 #ifdef _OPENMP
 #pragma omp for schedule(dynamic, 16)
@@ -285,19 +361,6 @@ void ImProcFunctions::rgb2monitor(Imagefloat *img, Image8 *image,
                 const int ix = i * 3 * W;
                 int iy = 0;
 
-                if (gamutWarning) {
-                    float *rL = inimg->g(i);
-                    float *ra = inimg->r(i);
-                    float *rb = inimg->b(i);
-
-                    for (int j = 0; j < W; j++) {
-                        gwbuffer[iy++] = rL[j] / 327.68f;
-                        gwbuffer[iy++] = ra[j] / 327.68f;
-                        gwbuffer[iy++] = rb[j] / 327.68f;
-                    }
-                }
-
-                iy = 0;
                 if (!bypass_out) {
                     float *rr = img->r(i);
                     float *rg = img->g(i);
@@ -320,12 +383,25 @@ void ImProcFunctions::rgb2monitor(Imagefloat *img, Image8 *image,
                     }
                 }
 
-                cmsDoTransform(monitorTransform, buffer, outbuffer, W);
+                if (lut) {
+                    lut->apply(buffer, outbuffer, W);
+                    unshape_monitor_line(outbuffer, 3 * W);
+                    for (int j = 0; j < 3 * W; j += 3) {
+                        if (!in_unit_cube(buffer + j)) {
+                            cmsDoTransform(monitorTransform, buffer + j,
+                                           outbuffer + j, 1);
+                        }
+                    }
+                } else {
+                    cmsDoTransform(monitorTransform, buffer, outbuffer, W);
+                }
                 copyAndClampLine(outbuffer, data + ix, W);
 
                 if (gamutWarning) {
-                    gamutWarning->markLine(image, i, gwSrcBuf.data, gwBuf1.data,
-                                           gwBuf2.data);
+                    gamutWarning->markLine(image, i, inimg->g(i), inimg->r(i),
+                                           inimg->b(i), gwSrcBuf.data,
+                                           gwBuf1.data, gwBuf2.data,
+                                           gwPosBuf.data);
                 }
             }
         } // End of parallelization
@@ -379,7 +455,7 @@ Image8 *ImProcFunctions::rgb2out(Imagefloat *img, int cx, int cy, int cw,
     if (oprof) {
         img->setMode(Imagefloat::Mode::RGB, true);
 
-        cmsHTRANSFORM hTransform = nullptr;
+        ICCStore::Transform hTransform;
 
         ARTOutputProfile op(oprof, icm, img->colorSpace(), 256);
 
@@ -393,7 +469,7 @@ Image8 *ImProcFunctions::rgb2out(Imagefloat *img, int cx, int cy, int cw,
             lcmsMutex->lock();
             auto iprof =
                 ICCStore::getInstance()->workingSpace(img->colorSpace());
-            hTransform = cmsCreateTransform(
+            hTransform = ICCStore::getInstance()->getTransform(
                 iprof, TYPE_RGB_FLT, oprof, TYPE_RGB_FLT, icm.outputIntent,
                 flags); // NOCACHE is important for thread safety
             lcmsMutex->unlock();
@@ -432,15 +508,11 @@ Image8 *ImProcFunctions::rgb2out(Imagefloat *img, int cx, int cy, int cw,
                 if (op) {
                     op(buffer, outbuffer, cw);
                 } else {
-                    cmsDoTransform(hTransform, buffer, outbuffer, cw);
+                    cmsDoTransform(hTransform.get(), buffer, outbuffer, cw);
                 }
                 copyAndClampLine(outbuffer, data + ix, cw);
             }
         } // End of parallelization
-
-        if (hTransform) {
-            cmsDeleteTransform(hTransform);
-        }
     } else {
         const auto xyz_rgb =
             ICCStore::getInstance()->workingSpaceInverseMatrix(profile);
@@ -452,7 +524,8 @@ Image8 *ImProcFunctions::rgb2out(Imagefloat *img, int cx, int cy, int cw,
 
 Imagefloat *
 ImProcFunctions::rgb2out(Imagefloat *img,
-                         const procparams::ColorManagementParams &icm)
+                         const procparams::ColorManagementParams &icm,
+                         bool inplace)
 {
     // BENCHFUN
 
@@ -461,7 +534,9 @@ ImProcFunctions::rgb2out(Imagefloat *img,
     const int cw = img->getWidth();
     const int ch = img->getHeight();
 
-    Imagefloat *image = new Imagefloat(cw, ch);
+    // all the conversions below work pixel by pixel (or row by row through
+    // temporary buffers), so they can write to the input image directly
+    Imagefloat *image = inplace ? img : new Imagefloat(cw, ch);
     cmsHPROFILE oprof = ICCStore::getInstance()->getProfile(icm.outputProfile);
 
     if (oprof) {
@@ -490,13 +565,13 @@ ImProcFunctions::rgb2out(Imagefloat *img,
             lcmsMutex->lock();
             cmsHPROFILE iprof =
                 ICCStore::getInstance()->workingSpace(img->colorSpace());
-            cmsHTRANSFORM hTransform =
-                cmsCreateTransform(iprof, TYPE_RGB_FLT, oprof, TYPE_RGB_FLT,
-                                   icm.outputIntent, flags);
+            ICCStore::Transform hTransform =
+                ICCStore::getInstance()->getTransform(iprof, TYPE_RGB_FLT,
+                                                      oprof, TYPE_RGB_FLT,
+                                                      icm.outputIntent, flags);
             lcmsMutex->unlock();
 
-            image->ExecCMSTransform(hTransform, img, multiThread);
-            cmsDeleteTransform(hTransform);
+            image->ExecCMSTransform(hTransform.get(), img, multiThread);
         }
     } else if (icm.outputProfile !=
                procparams::ColorManagementParams::NoProfileString) {
@@ -521,8 +596,17 @@ ImProcFunctions::rgb2out(Imagefloat *img,
             }
         }
     } else {
-        img->copyTo(image);
+        if (!inplace) {
+            img->copyTo(image);
+        }
         image->setMode(Imagefloat::Mode::RGB, multiThread);
+        return image;
+    }
+
+    if (inplace) {
+        // same state as a freshly allocated output image
+        image->assignColorSpace("sRGB");
+        image->assignMode(Imagefloat::Mode::RGB);
     }
 
     return image;
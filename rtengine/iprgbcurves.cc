@@ -59,6 +59,14 @@ void RGBCurve(const std::vector<double> &curvePoints, LUTf &outCurve, int skip)
     }
 }
 
+std::shared_ptr<const LUTf> get_curve(const std::vector<double> &curvePoints,
+                                      int skip)
+{
+    return curves::get_cached_lut(
+        (curves::LUTKey("rgbcurve") << curvePoints << skip).str(),
+        [&](LUTf &lut) -> void { RGBCurve(curvePoints, lut, skip); });
+}
+
 } // namespace
 
 void ImProcFunctions::rgbCurves(Imagefloat *img)
@@ -81,11 +89,6 @@ void ImProcFunctions::rgbCurves(Imagefloat *img)
 
     img->setMode(Imagefloat::Mode::RGB, multiThread);
 
-    LUTf rCurve, gCurve, bCurve;
-    RGBCurve(params->rgbCurves.rcurve, rCurve, scale);
-    RGBCurve(params->rgbCurves.gcurve, gCurve, scale);
-    RGBCurve(params->rgbCurves.bcurve, bCurve, scale);
-
     const int W = img->getWidth();
     const int H = img->getHeight();
 
@@ -116,38 +119,54 @@ void ImProcFunctions::rgbCurves(Imagefloat *img)
         }
     }
 
-    if (rCurve || gCurve || bCurve) { // if any of the RGB curves is engaged
-#ifdef _OPENMP
-#pragma omp parallel for if (multiThread)
-#endif
-        for (int y = 0; y < H; ++y) {
-            int x = 0;
-#ifdef __SSE2__
-            for (; x < W - 3; x += 4) {
-                if (rCurve) {
-                    STVF(img->r(y, x), rCurve[LVF(img->r(y, x))]);
-                }
-                if (gCurve) {
-                    STVF(img->g(y, x), gCurve[LVF(img->g(y, x))]);
-                }
-                if (bCurve) {
-                    STVF(img->b(y, x), bCurve[LVF(img->b(y, x))]);
-                }
-            }
-#endif // __SSE2__
-            for (; x < W; ++x) {
-                if (rCurve) {
-                    img->r(y, x) = rCurve[img->r(y, x)];
-                }
-                if (gCurve) {
-                    img->g(y, x) = gCurve[img->g(y, x)];
-                }
-                if (bCurve) {
-                    img->b(y, x) = bCurve[img->b(y, x)];
-                }
-            }
-        }
+    RowOp op;
+    rgbCurvesOp(op, true);
+    if (op) {
+        applyRowOps(img, {op});
+    }
+}
+
+bool ImProcFunctions::rgbCurvesOp(RowOp &op, bool ignore_pipette)
+{
+    op = RowOp();
+    if (!ignore_pipette && pipetteBuffer &&
+        (pipetteBuffer->getEditID() == EUID_RGB_R ||
+         pipetteBuffer->getEditID() == EUID_RGB_G ||
+         pipetteBuffer->getEditID() == EUID_RGB_B)) {
+        // the pipette buffer is filled by rgbCurves()
+        return false;
     }
+
+    if (!params->rgbCurves.enabled) {
+        return true;
+    }
+
+    // index 0, 1, 2: R, G, B
+    const std::array<std::shared_ptr<const LUTf>, 3> curves = {
+        get_curve(params->rgbCurves.rcurve, scale),
+        get_curve(params->rgbCurves.gcurve, scale),
+        get_curve(params->rgbCurves.bcurve, scale)};
+
+    if (!*curves[0] && !*curves[1] && !*curves[2]) {
+        return true;
+    }
+
+    op = [curves](int thread_id, int W, float *r, float *g, float *b) -> void {
+        const LUTf &rCurve = *curves[0];
+        const LUTf &gCurve = *curves[1];
+        const LUTf &bCurve = *curves[2];
+
+        if (rCurve) {
+            rCurve.apply(r, r, W);
+        }
+        if (gCurve) {
+            gCurve.apply(g, g, W);
+        }
+        if (bCurve) {
+            bCurve.apply(b, b, W);
+        }
+    };
+    return true;
 }
 
 } // namespace rtengine
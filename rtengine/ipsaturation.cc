@@ -42,44 +42,51 @@ float apply_vibrance(float x, float vib)
 
 void ImProcFunctions::saturationVibrance(Imagefloat *rgb)
 {
-    if (params->saturation.enabled &&
-        (params->saturation.saturation || params->saturation.vibrance)) {
-        rgb->setMode(Imagefloat::Mode::RGB, multiThread);
-        const int W = rgb->getWidth();
-        const int H = rgb->getHeight();
-        const float saturation = 1.f + params->saturation.saturation / 100.f;
-        const float vibrance = 1.f - params->saturation.vibrance / 1000.f;
-        TMatrix ws = ICCStore::getInstance()->workingSpaceMatrix(
-            params->icm.workingProfile);
-        const float noise = pow_F(2.f, -16.f);
-        const bool vib = params->saturation.vibrance;
+    RowOp op;
+    saturationVibranceOp(op);
+    if (op) {
+        applyRowOps(rgb, {op});
+    }
+}
 
-#ifdef _OPENMP
-#pragma omp parallel for if (multiThread)
-#endif
-        for (int i = 0; i < H; ++i) {
-            for (int j = 0; j < W; ++j) {
-                float &r = rgb->r(i, j);
-                float &g = rgb->g(i, j);
-                float &b = rgb->b(i, j);
-                float l = Color::rgbLuminance(r, g, b, ws);
-                float rl = r - l;
-                float gl = g - l;
-                float bl = b - l;
-                if (vib) {
-                    rl = apply_vibrance(rl, vibrance);
-                    gl = apply_vibrance(gl, vibrance);
-                    bl = apply_vibrance(bl, vibrance);
-                    assert(rl == rl);
-                    assert(gl == gl);
-                    assert(bl == bl);
-                }
-                r = max(l + saturation * rl, noise);
-                g = max(l + saturation * gl, noise);
-                b = max(l + saturation * bl, noise);
+bool ImProcFunctions::saturationVibranceOp(RowOp &op)
+{
+    op = RowOp();
+    if (!params->saturation.enabled ||
+        (!params->saturation.saturation && !params->saturation.vibrance)) {
+        return true;
+    }
+
+    const float saturation = 1.f + params->saturation.saturation / 100.f;
+    const float vibrance = 1.f - params->saturation.vibrance / 1000.f;
+    TMatrix ws =
+        ICCStore::getInstance()->workingSpaceMatrix(params->icm.workingProfile);
+    const float noise = pow_F(2.f, -16.f);
+    const bool vib = params->saturation.vibrance;
+
+    op = [=](int thread_id, int W, float *rr, float *gg, float *bb) -> void {
+        for (int j = 0; j < W; ++j) {
+            float &r = rr[j];
+            float &g = gg[j];
+            float &b = bb[j];
+            float l = Color::rgbLuminance(r, g, b, ws);
+            float rl = r - l;
+            float gl = g - l;
+            float bl = b - l;
+            if (vib) {
+                rl = apply_vibrance(rl, vibrance);
+                gl = apply_vibrance(gl, vibrance);
+                bl = apply_vibrance(bl, vibrance);
+                assert(rl == rl);
+                assert(gl == gl);
+                assert(bl == bl);
             }
+            r = max(l + saturation * rl, noise);
+            g = max(l + saturation * gl, noise);
+            b = max(l + saturation * bl, noise);
         }
-    }
+    };
+    return true;
 }
 
 } // namespace rtengine
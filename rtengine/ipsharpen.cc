@@ -516,32 +516,6 @@ void rescale_kernel(const array2D<float> &src, array2D<float> &k)
     }
 }
 
-bool flip_kernel(array2D<float> &kernel)
-{
-    const int k = kernel.width();
-    bool res = false;
-
-    float magnitude = std::abs(kernel[k / 2][k / 2]);
-    for (int y = 0; y < k; ++y) {
-        for (int x = 0; x < k; ++x) {
-            magnitude = std::max(magnitude, std::abs(kernel[y][x]));
-        }
-    }
-
-    for (int y = 0; y < k; ++y) {
-        for (int x = 0; x < k; ++x) {
-            float d = std::abs(kernel[y][x] - kernel[k - 1 - y][k - 1 - x]) /
-                      magnitude;
-            if (d > 1e-5f) {
-                res = true;
-                kernel[y][x] = kernel[k - 1 - y][k - 1 - x];
-            }
-        }
-    }
-
-    return res;
-}
-
 void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
                           const SharpeningParams &shparam,
                           const ImProcData &data, ProgressListener *plistener)
@@ -630,6 +604,7 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
 
     array2D<float> lum(W, H);
     array2D<float> tmp(W, H);
+    array2D<float> tmp2(W, H);
     array2D<float> out(W, H);
 
 #ifdef _OPENMP
@@ -643,13 +618,7 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
         }
     }
 
-    Convolution conv(kernel, W, H, data.multiThread);
-    Convolution *flipconv = &conv;
-    std::unique_ptr<Convolution> flipconv_ptr;
-    if (flip_kernel(kernel)) {
-        flipconv_ptr.reset(new Convolution(kernel, W, H, data.multiThread));
-        flipconv = flipconv_ptr.get();
-    }
+    TiledConvolution conv(kernel, W, H, data.multiThread);
 
     LUTf loglut(65536);
     for (int i = 1; i < 65536; ++i) {
@@ -700,15 +669,15 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
             }
         }
 
-        (*flipconv)(tmp, tmp);
+        conv(tmp, tmp2, true);
 
 #ifdef _OPENMP
 #pragma omp parallel for if (data.multiThread)
 #endif
         for (int y = 0; y < H; ++y) {
             for (int x = 0; x < W; ++x) {
-                lum[y][x] *= tmp[y][x];
-                assert(std::isfinite(tmp[y][x]));
+                lum[y][x] *= tmp2[y][x];
+                assert(std::isfinite(tmp2[y][x]));
                 assert(std::isfinite(lum[y][x]));
 
                 check_stop(y, x);
@@ -355,9 +355,9 @@ void guided_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
         const int W = R.width();
         const int H = R.height();
 
-        array2D<float> iR(W, H, R, ARRAY2D_ALIGNED);
-        array2D<float> iG(W, H, G, ARRAY2D_ALIGNED);
-        array2D<float> iB(W, H, B, ARRAY2D_ALIGNED);
+        ScratchPlane iR(W, H, R);
+        ScratchPlane iG(W, H, G);
+        ScratchPlane iB(W, H, B);
 
         const bool rgb = (chan == Channel::LC);
         const bool luminance = (chan == Channel::L);
@@ -367,7 +367,7 @@ void guided_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
             rtengine::guidedFilterLog(10.f, G, r, epsilon, multithread);
             rtengine::guidedFilterLog(10.f, B, r, epsilon, multithread);
         } else {
-            array2D<float> guide(W, H, ARRAY2D_ALIGNED);
+            ScratchPlane guide(W, H);
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
@@ -378,9 +378,8 @@ void guided_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
                     guide[y][x] = xlin2log(max(l, 0.f), 10.f);
                 }
             }
-            rtengine::guidedFilterLog(guide, 10.f, R, r, epsilon, multithread);
-            rtengine::guidedFilterLog(guide, 10.f, G, r, epsilon, multithread);
-            rtengine::guidedFilterLog(guide, 10.f, B, r, epsilon, multithread);
+            rtengine::guidedFilterLog(guide, 10.f, {&R, &G, &B}, r, epsilon,
+                                      multithread);
 
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
@@ -475,9 +474,9 @@ void gaussian_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
         blur(B);
     } else {
         const bool luminance = (chan == Channel::L);
-        array2D<float> iR(W, H, R, ARRAY2D_ALIGNED);
-        array2D<float> iG(W, H, G, ARRAY2D_ALIGNED);
-        array2D<float> iB(W, H, B, ARRAY2D_ALIGNED);
+        ScratchPlane iR(W, H, R);
+        ScratchPlane iG(W, H, G);
+        ScratchPlane iB(W, H, B);
 
         blur(R);
         blur(G);
@@ -505,7 +504,7 @@ void gaussian_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
 void nlmeans_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
                        const TMatrix &ws, const TMatrix &iws, Channel chan,
                        int strength, int detail, int iterations, double scale,
-                       bool multithread)
+                       bool multithread, const CancelToken &cancel)
 {
     array2D<float> iY;
     const int W = R.width(), H = R.height();
@@ -522,7 +521,8 @@ void nlmeans_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
             }
         }
         for (int i = 0; i < iterations; ++i) {
-            denoise::NLMeans(iY, 1.f, strength, detail, scale, multithread);
+            denoise::NLMeans(iY, 1.f, strength, detail, scale, multithread,
+                             cancel);
         }
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
@@ -550,9 +550,12 @@ void nlmeans_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
         }
 
         for (int i = 0; i < iterations; ++i) {
-            denoise::NLMeans(R, 1.f, strength, detail, scale, multithread);
-            denoise::NLMeans(G, 1.f, strength, detail, scale, multithread);
-            denoise::NLMeans(B, 1.f, strength, detail, scale, multithread);
+            denoise::NLMeans(R, 1.f, strength, detail, scale, multithread,
+                             cancel);
+            denoise::NLMeans(G, 1.f, strength, detail, scale, multithread,
+                             cancel);
+            denoise::NLMeans(B, 1.f, strength, detail, scale, multithread,
+                             cancel);
         }
 
         if (chan == Channel::C) {
@@ -571,6 +574,50 @@ void nlmeans_smoothing(array2D<float> &R, array2D<float> &G, array2D<float> &B,
     }
 }
 
+// A bank of normally distributed samples, computed once and shared by all
+// the images. The noise of every block of BLOCK x BLOCK pixels is read from
+// it at an offset derived from the seed and the position of the block, so
+// that the noise is deterministic and doesn't repeat visibly. The samples are
+// independent, so the blocks don't show seams.
+class NoiseBank {
+public:
+    static constexpr int SIZE = 1024;
+    static constexpr int BLOCK = 128;
+
+    static const NoiseBank &get()
+    {
+        static const NoiseBank instance;
+        return instance;
+    }
+
+    /// the BLOCK samples of row y of the block (bx, by), starting at x = 0
+    const float *row(uint32_t seed, int bx, int by, int y) const
+    {
+        uint32_t h = seed * 0x9e3779b1u ^ uint32_t(by) * 0x85ebca6bu ^
+                     uint32_t(bx) * 0xc2b2ae35u;
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+        const int ox = (h & 0xffff) % (SIZE - BLOCK + 1);
+        const int oy = h >> 16;
+        return &data_[((oy + y) & (SIZE - 1)) * SIZE + ox];
+    }
+
+private:
+    NoiseBank(): data_(SIZE * SIZE)
+    {
+        RandomNumberGenerator rng(42);
+        NormalDistribution d;
+        for (auto &v : data_) {
+            v = d(rng);
+        }
+    }
+
+    std::vector<float> data_;
+};
+
 void add_noise(array2D<float> &R, array2D<float> &G, array2D<float> &B,
                const TMatrix &ws, int strength, int coarseness, double scale,
                Channel chan, bool multithread)
@@ -584,8 +631,6 @@ void add_noise(array2D<float> &R, array2D<float> &G, array2D<float> &B,
         LIM01(float(strength) / (chan == Channel::L ? 200.f : 100.f)) / scale;
     const float radius = (0.5f + 1.75f * float(coarseness) / 100.f) / scale;
 
-    RandomNumberGenerator rng(42 + int(chan) + coarseness);
-
     array2D<float> kernel;
     {
         const int sz = int(std::ceil(radius)) * 2 + 1;
@@ -609,42 +654,70 @@ void add_noise(array2D<float> &R, array2D<float> &G, array2D<float> &B,
     }
     Convolution conv(kernel, W, H, multithread);
 
-    constexpr uint32_t normd_size = 5233;
-    float normd[normd_size];
-    NormalDistribution d;
-    for (uint32_t i = 0; i < normd_size; ++i) {
-        normd[i] = d(rng);
-    }
+    const NoiseBank &bank = NoiseBank::get();
+    constexpr int BLOCK = NoiseBank::BLOCK;
 
     const auto noise = [&](array2D<float> &a, int chan) -> void {
         constexpr float chan_sd[5] = {1.f, 0.7f, 1.f, 1.3f};
         const float c01 = float(coarseness) / 100.f;
         const float c = 655.35f / (20.f + std::pow(c01, 0.5f) * 80.f);
         const float sd = chan_sd[chan];
+        // different seeds for the channels and for the regions
+        const uint32_t seed = ((42 + coarseness) * 256 + strength) * 4 + chan;
+#ifdef __SSE2__
+        const vfloat cv = F2V(c);
+        const vfloat sdv = F2V(sd);
+        const vfloat zerov = F2V(0.f);
+#endif
 
-        array2D<float> noisebuf(W, H);
+        ScratchPlane noisebuf(W, H);
 
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                float v = a[y][x];
-                // float mu = LIM01(v) * c;
-                float mu = std::max(v, 0.f) * c;
-                float r = normd[rng.randint(normd_size)] * sd;
-                float m = mu + sqrtf(mu) * r;
-                noisebuf[y][x] = m / c - v;
+            for (int bx = 0; bx * BLOCK < W; ++bx) {
+                const float *normd = bank.row(seed, bx, y / BLOCK, y % BLOCK);
+                const int x0 = bx * BLOCK;
+                const int end = std::min(x0 + BLOCK, W);
+                int x = x0;
+#ifdef __SSE2__
+                for (; x < end - 3; x += 4) {
+                    const vfloat v = LVFU(a[y][x]);
+                    const vfloat mu = vmaxf(v, zerov) * cv;
+                    const vfloat r = LVFU(normd[x - x0]) * sdv;
+                    const vfloat m = mu + vsqrtf(mu) * r;
+                    STVFU(noisebuf[y][x], m / cv - v);
+                }
+#endif
+                for (; x < end; ++x) {
+                    float v = a[y][x];
+                    // float mu = LIM01(v) * c;
+                    float mu = std::max(v, 0.f) * c;
+                    float r = normd[x - x0] * sd;
+                    float m = mu + sqrtf(mu) * r;
+                    noisebuf[y][x] = m / c - v;
+                }
             }
         }
 
         conv(noisebuf, noisebuf);
 
+#ifdef __SSE2__
+        const vfloat sfv = F2V(sf);
+#endif
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x < W - 3; x += 4) {
+                STVFU(a[y][x],
+                      vmaxf(LVFU(a[y][x]) + sfv * LVFU(noisebuf[y][x]), zerov));
+            }
+#endif
+            for (; x < W; ++x) {
                 float n = noisebuf[y][x];
                 // a[y][x] += sf * n;
                 a[y][x] = std::max(a[y][x] + sf * n, 0.f);
@@ -679,7 +752,7 @@ void add_noise(array2D<float> &R, array2D<float> &G, array2D<float> &B,
             }
         }
     } else {
-        array2D<float> Y(W, H);
+        ScratchPlane Y(W, H);
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
@@ -731,9 +804,9 @@ void halation(array2D<float> &R, array2D<float> &G, array2D<float> &B, int size,
     const int H = R.height();
 
     Convolution conv(kernel, W, H, multithread);
-    array2D<float> hR(W, H);
-    array2D<float> hG(W, H);
-    array2D<float> hB(W, H);
+    ScratchPlane hR(W, H);
+    ScratchPlane hG(W, H);
+    ScratchPlane hB(W, H);
     conv(R, hR);
     conv(G, hG);
     conv(B, hB);
@@ -971,7 +1044,7 @@ bool ImProcFunctions::guidedSmoothing(Imagefloat *rgb)
             params->icm.workingProfile);
 
         for (int i = 0; i < n; ++i) {
-            if (!params->smoothing.masks[i].enabled) {
+            if (!params->smoothing.masks[i].enabled || shouldAbort()) {
                 continue;
             }
 
@@ -1029,7 +1102,8 @@ bool ImProcFunctions::guidedSmoothing(Imagefloat *rgb)
                 }
             } else if (r.mode == SmoothingParams::Region::Mode::NLMEANS) {
                 nlmeans_smoothing(R, G, B, ws, iws, ch, r.nlstrength,
-                                  r.nldetail, r.iterations, scale, multiThread);
+                                  r.nldetail, r.iterations, scale, multiThread,
+                                  cancelToken());
             } else if (r.mode == SmoothingParams::Region::Mode::LENS ||
                        r.mode == SmoothingParams::Region::Mode::MOTION) {
                 ImProcData im(params, scale, multiThread);
@@ -44,39 +44,46 @@ inline float sl(float blend, float x)
 
 void ImProcFunctions::softLight(Imagefloat *rgb)
 {
+    RowOp op;
+    softLightOp(op);
+    if (op) {
+        applyRowOps(rgb, {op});
+    }
+}
+
+bool ImProcFunctions::softLightOp(RowOp &op)
+{
+    op = RowOp();
     const bool sl_enabled =
         params->softlight.enabled && params->softlight.strength > 0;
     if (!sl_enabled) {
-        return;
+        return true;
     }
 
-    rgb->setMode(Imagefloat::Mode::RGB, multiThread);
-
     const float blend = params->softlight.strength / 100.f;
 
-    LUTf f(65536);
+    std::shared_ptr<LUTf> f(new LUTf(65536));
     for (int i = 0; i < 65536; ++i) {
-        f[i] = sl(blend, i);
+        (*f)[i] = sl(blend, i);
     }
 
-    const auto apply = [&](float x) -> float {
-        if (x <= 65535.f) {
-            return f[x];
-        } else {
-            return x;
-        }
-    };
+    op = [f](int thread_id, int W, float *r, float *g, float *b) -> void {
+        const LUTf &lut = *f;
+        const auto apply = [&lut](float x) -> float {
+            if (x <= 65535.f) {
+                return lut[x];
+            } else {
+                return x;
+            }
+        };
 
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-    for (int y = 0; y < rgb->getHeight(); ++y) {
-        for (int x = 0; x < rgb->getWidth(); ++x) {
-            rgb->r(y, x) = apply(rgb->r(y, x));
-            rgb->g(y, x) = apply(rgb->g(y, x));
-            rgb->b(y, x) = apply(rgb->b(y, x));
+        for (int x = 0; x < W; ++x) {
+            r[x] = apply(r[x]);
+            g[x] = apply(g[x]);
+            b[x] = apply(b[x]);
         }
-    }
+    };
+    return true;
 }
 
 } // namespace rtengine
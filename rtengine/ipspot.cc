@@ -25,6 +25,9 @@
 #include "procparams.h"
 #include "rt_math.h"
 #include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <set>
 
 #define BENCHMARK
@@ -81,13 +84,13 @@ inline float feather_factor(float x, float radius, float sigma)
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-void heal_laplace_loop(Imagefloat *img, const array2D<int32_t> &mask)
+// successive over-relaxation on the pixels of img where mask is non-zero
+// (the outer frame of img is never updated)
+void heal_sor(Imagefloat *img, const array2D<int32_t> &mask, int iterations)
 {
     const int width = img->getWidth();
     const int height = img->getHeight();
 
-    const int MAX_ITER = std::min(std::max(width, height) * 2, 1000);
-
     constexpr float w = 1.4f;
     constexpr float w1 = 1.f - w;
     constexpr float w2 = w / 4.f;
@@ -107,30 +110,32 @@ void heal_laplace_loop(Imagefloat *img, const array2D<int32_t> &mask)
     const vfloat w2v = F2V(w2);
     const vint iZEROv = vcast_vi_i(0);
 
-    const auto vnext = [&](float **chan, int x, int y) -> void {
+    const auto vnext = [&](float **chan, int x, int y, vmask m) -> void {
         vfloat cur = LVFU(chan[y][x]);
         vfloat left = LVFU(chan[y][x - 1]);
         vfloat top = LVFU(chan[y - 1][x]);
         vfloat right = LVFU(chan[y][x + 1]);
         vfloat bottom = LVFU(chan[y + 1][x]);
         vfloat upd = cur * w1v + (left + top + right + bottom) * w2v;
-        STVFU(chan[y][x], upd);
+        STVFU(chan[y][x], vself(m, upd, cur));
     };
 #endif
 
-    for (int iter = 0; iter < MAX_ITER; ++iter) {
+    for (int iter = 0; iter < iterations; ++iter) {
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 16)
+#pragma omp parallel for schedule(dynamic, 16) if (height > 64)
 #endif
         for (int y = 1; y < height - 1; ++y) {
             int x = 1;
 #ifdef __SSE2__
             for (; x < width - 1 - 3; x += 4) {
-                vint m = _mm_loadu_si128(reinterpret_cast<vint *>(&mask[y][x]));
-                if (vtest(vnotm(vmaski_eq(m, iZEROv)))) {
-                    vnext(img->r.ptrs, x, y);
-                    vnext(img->g.ptrs, x, y);
-                    vnext(img->b.ptrs, x, y);
+                vint mv =
+                    _mm_loadu_si128(reinterpret_cast<vint *>(&mask[y][x]));
+                vmask m = vnotm(vmaski_eq(mv, iZEROv));
+                if (vtest(m)) {
+                    vnext(img->r.ptrs, x, y, m);
+                    vnext(img->g.ptrs, x, y, m);
+                    vnext(img->b.ptrs, x, y, m);
                 }
             }
 #endif
@@ -145,6 +150,102 @@ void heal_laplace_loop(Imagefloat *img, const array2D<int32_t> &mask)
     }
 }
 
+// Solves the Laplace equation on the pixels of img where mask is non-zero,
+// using the other pixels and the outer frame as boundary conditions.
+//
+// SOR alone needs a number of iterations proportional to the size of the
+// area to reach a smooth solution, so it is used directly only on small
+// areas. Larger ones are solved recursively at half resolution first, and
+// the interpolated coarse solution is then refined by a few SOR iterations
+// at full resolution (a cascadic multigrid scheme)
+void heal_laplace_loop(Imagefloat *img, const array2D<int32_t> &mask)
+{
+    constexpr int MIN_SIZE = 16;
+    constexpr int BASE_ITER = 100;
+    constexpr int REFINE_ITER = 30;
+
+    const int width = img->getWidth();
+    const int height = img->getHeight();
+
+    if (std::min(width, height) <= MIN_SIZE) {
+        heal_sor(img, mask, BASE_ITER);
+        return;
+    }
+
+    const int cw = (width + 1) / 2;
+    const int ch = (height + 1) / 2;
+    Imagefloat coarse(cw, ch);
+    array2D<int32_t> cmask(cw, ch);
+
+    // a coarse pixel is a boundary condition if any of the pixels it covers
+    // is, with the average value of those
+#ifdef _OPENMP
+#pragma omp parallel for if (ch > 64)
+#endif
+    for (int cy = 0; cy < ch; ++cy) {
+        for (int cx = 0; cx < cw; ++cx) {
+            float fixed[3] = {0.f, 0.f, 0.f};
+            float all[3] = {0.f, 0.f, 0.f};
+            int nfixed = 0, nall = 0;
+            for (int y = 2 * cy; y <= std::min(2 * cy + 1, height - 1); ++y) {
+                for (int x = 2 * cx; x <= std::min(2 * cx + 1, width - 1);
+                     ++x) {
+                    const float v[3] = {img->r(y, x), img->g(y, x),
+                                        img->b(y, x)};
+                    const bool f = !mask[y][x] || x == 0 || y == 0 ||
+                                   x == width - 1 || y == height - 1;
+                    for (int c = 0; c < 3; ++c) {
+                        all[c] += v[c];
+                        if (f) {
+                            fixed[c] += v[c];
+                        }
+                    }
+                    nfixed += f;
+                    ++nall;
+                }
+            }
+            cmask[cy][cx] = !nfixed;
+            const float *v = nfixed ? fixed : all;
+            const float s = 1.f / (nfixed ? nfixed : nall);
+            coarse.r(cy, cx) = v[0] * s;
+            coarse.g(cy, cx) = v[1] * s;
+            coarse.b(cy, cx) = v[2] * s;
+        }
+    }
+
+    heal_laplace_loop(&coarse, cmask);
+
+    // bilinear interpolation of the coarse solution, whose pixel centers are
+    // at (2 * c + 0.5) in full resolution coordinates
+#ifdef _OPENMP
+#pragma omp parallel for if (height > 64)
+#endif
+    for (int y = 1; y < height - 1; ++y) {
+        const float fy = std::max(std::min((y - 0.5f) * 0.5f, ch - 1.f), 0.f);
+        const int y0 = std::min(int(fy), ch - 2);
+        const float wy = fy - y0;
+        for (int x = 1; x < width - 1; ++x) {
+            if (mask[y][x]) {
+                const float fx =
+                    std::max(std::min((x - 0.5f) * 0.5f, cw - 1.f), 0.f);
+                const int x0 = std::min(int(fx), cw - 2);
+                const float wx = fx - x0;
+                const auto interp = [&](float **c) -> float {
+                    const float top = intp(wx, c[y0][x0 + 1], c[y0][x0]);
+                    const float bot =
+                        intp(wx, c[y0 + 1][x0 + 1], c[y0 + 1][x0]);
+                    return intp(wy, bot, top);
+                };
+                img->r(y, x) = interp(coarse.r.ptrs);
+                img->g(y, x) = interp(coarse.g.ptrs);
+                img->b(y, x) = interp(coarse.b.ptrs);
+            }
+        }
+    }
+
+    heal_sor(img, mask, REFINE_ITER);
+}
+
 void heal(Imagefloat *src, Imagefloat *dst, int src_x, int src_y, int dst_x,
           int dst_y, int x1, int x2, int y1, int y2, int center_x, int center_y,
           float radius, float featherRadius, float opacity, int detail)
@@ -217,6 +318,112 @@ void heal(Imagefloat *src, Imagefloat *dst, int src_x, int src_y, int dst_x,
 
 //-----------------------------------------------------------------------------
 
+// The spot areas read from the image source (and converted to the working
+// space), so that adding or editing a spot doesn't need to read again the
+// areas of all the other ones
+class SpotImageCache {
+public:
+    struct Key {
+        const ImageSource *imgsrc;
+        Glib::ustring fname;
+        int tr;
+        int x;
+        int y;
+        int width;
+        int height;
+        int skip;
+        ColorTemp wb;
+        procparams::ExposureParams exposure;
+        procparams::RAWParams raw;
+        bool convert;
+        procparams::ColorManagementParams icm;
+        procparams::FilmNegativeParams filmNegative;
+        bool denoise;
+        procparams::DenoiseParams denoiseParams;
+        std::vector<double> denoiseStore;
+
+        bool operator==(const Key &k) const
+        {
+            return imgsrc == k.imgsrc && tr == k.tr && x == k.x && y == k.y &&
+                   width == k.width && height == k.height && skip == k.skip &&
+                   convert == k.convert && denoise == k.denoise &&
+                   fname == k.fname && wb == k.wb && exposure == k.exposure &&
+                   raw == k.raw && (!convert || icm == k.icm) &&
+                   filmNegative == k.filmNegative &&
+                   (!denoise || (denoiseParams == k.denoiseParams &&
+                                 denoiseStore == k.denoiseStore));
+        }
+    };
+
+    static SpotImageCache &get_instance()
+    {
+        static SpotImageCache instance;
+        return instance;
+    }
+
+    bool get(const Key &key, Imagefloat *img)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->key == key && it->img->getWidth() == img->getWidth() &&
+                it->img->getHeight() == img->getHeight()) {
+                entries_.splice(entries_.begin(), entries_, it);
+                entries_.front().img->copyTo(img);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void set(const Key &key, const Imagefloat *img)
+    {
+        const size_t bytes = bytes_of(img);
+        if (bytes > MAX_BYTES / 4) {
+            return;
+        }
+
+        Entry e;
+        e.key = key;
+        e.img.reset(img->copy());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->key == key) {
+                bytes_ -= bytes_of(it->img.get());
+                entries_.erase(it);
+                break;
+            }
+        }
+        entries_.push_front(std::move(e));
+        bytes_ += bytes;
+        while (bytes_ > MAX_BYTES) {
+            bytes_ -= bytes_of(entries_.back().img.get());
+            entries_.pop_back();
+        }
+    }
+
+private:
+    static constexpr size_t MAX_BYTES = size_t(64) * 1024 * 1024;
+
+    struct Entry {
+        Key key;
+        std::unique_ptr<Imagefloat> img;
+    };
+
+    static size_t bytes_of(const Imagefloat *img)
+    {
+        return size_t(img->getWidth()) * img->getHeight() * 3 * sizeof(float);
+    }
+
+    SpotImageCache(): bytes_(0) {}
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    size_t bytes_;
+};
+
+//-----------------------------------------------------------------------------
+
 } // namespace
 
 class SpotBox {
@@ -719,6 +926,51 @@ void ImProcFunctions::removeSpots(rtengine::Imagefloat *img,
         }
     };
 
+    const auto read_area = [&](const PreviewProps &spp,
+                               Imagefloat *img) -> void {
+        SpotImageCache::Key key;
+        key.imgsrc = imgsrc;
+        key.fname = imgsrc->getFileName();
+        key.tr = tr;
+        key.x = spp.getX();
+        key.y = spp.getY();
+        key.width = img->getWidth();
+        key.height = img->getHeight();
+        key.skip = spp.getSkip();
+        key.wb = currWB;
+        key.exposure = params->exposure;
+        key.raw = params->raw;
+        key.convert = cmp;
+        if (cmp) {
+            key.icm = *cmp;
+        }
+        key.filmNegative = params->filmNegative;
+        key.denoise = cmp && params->denoise.enabled && dnstore &&
+                      std::max(img->getWidth(), img->getHeight()) > 16;
+        if (key.denoise) {
+            key.denoiseParams = params->denoise;
+            auto &ds = key.denoiseStore;
+            ds.push_back(dnstore->valid);
+            ds.push_back(dnstore->chM);
+            ds.insert(ds.end(), dnstore->max_r, dnstore->max_r + 9);
+            ds.insert(ds.end(), dnstore->max_b, dnstore->max_b + 9);
+            ds.insert(ds.end(), dnstore->ch_M, dnstore->ch_M + 9);
+            ds.push_back(dnstore->chrominance);
+            ds.push_back(dnstore->chrominanceRedGreen);
+            ds.push_back(dnstore->chrominanceBlueYellow);
+        }
+
+        auto &cache = SpotImageCache::get_instance();
+        if (!cache.get(key, img)) {
+            imgsrc->getImage(currWB, tr, img, spp, params->exposure,
+                             params->raw);
+            if (cmp) {
+                convert(img);
+            }
+            cache.set(key, img);
+        }
+    };
+
     for (auto entry : params->spot.entries) {
         std::shared_ptr<SpotBox> srcSpotBox(
             new SpotBox(entry, SpotBox::Type::SOURCE));
@@ -746,13 +998,7 @@ void ImProcFunctions::removeSpots(rtengine::Imagefloat *img,
         imgsrc->getSize(spp, w, h);
         *srcSpotBox /= pp.getSkip();
         srcSpotBox->allocImage();
-        Imagefloat *srcImage = srcSpotBox->getImage();
-
-        imgsrc->getImage(currWB, tr, srcSpotBox->getImage(), spp,
-                         params->exposure, params->raw);
-        if (cmp) {
-            convert(srcImage);
-        }
+        read_area(spp, srcSpotBox->getImage());
         assert(srcSpotBox->checkImageSize());
 
         // Destination area
@@ -761,12 +1007,7 @@ void ImProcFunctions::removeSpots(rtengine::Imagefloat *img,
                 pp.getSkip());
         *dstSpotBox /= pp.getSkip();
         dstSpotBox->allocImage();
-        Imagefloat *dstImage = dstSpotBox->getImage();
-        imgsrc->getImage(currWB, tr, dstSpotBox->getImage(), spp,
-                         params->exposure, params->raw);
-        if (cmp) {
-            convert(dstImage);
-        }
+        read_area(spp, dstSpotBox->getImage());
         assert(dstSpotBox->checkImageSize());
 
         // Update the intersectionArea between src and dest
@@ -794,28 +1035,50 @@ void ImProcFunctions::removeSpots(rtengine::Imagefloat *img,
         }
     }
 
-    // Process spots and copy them downstream
+    // Process spots and copy them downstream. A spot depends on the earlier
+    // ones whose destination overlaps its own areas, so the spots are
+    // grouped in levels of mutually independent ones, processed in parallel
 
-    for (auto i = requiredSpots.begin(); i != requiredSpots.end(); i++) {
+    const auto depends = [&](int j, int i) -> bool {
+        const auto &d = dstSpotBoxs.at(i)->intersectionArea;
+        return d.intersects(srcSpotBoxs.at(j)->intersectionArea) ||
+               d.intersects(dstSpotBoxs.at(j)->intersectionArea);
+    };
+
+    std::vector<std::vector<int>> levels;
+    std::vector<int> spotLevel(srcSpotBoxs.size(), 0);
+    for (auto i = requiredSpots.begin(); i != requiredSpots.end(); ++i) {
+        int lvl = 0;
+        for (auto j = requiredSpots.begin(); j != i; ++j) {
+            if (spotLevel[*j] >= lvl && depends(*i, *j)) {
+                lvl = spotLevel[*j] + 1;
+            }
+        }
+        spotLevel[*i] = lvl;
+        if (lvl >= int(levels.size())) {
+            levels.resize(lvl + 1);
+        }
+        levels[lvl].push_back(*i);
+    }
+
+    for (auto &level : levels) {
         // Process
-        srcSpotBoxs.at(*i)->processIntersectionWith(*dstSpotBoxs.at(*i));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (level.size() > 1)
+#endif
+        for (size_t k = 0; k < level.size(); ++k) {
+            srcSpotBoxs.at(level[k])->processIntersectionWith(
+                *dstSpotBoxs.at(level[k]));
+        }
 
         // Propagate
-        std::set<int> positiveSpots; // For DEBUG purpose only !
-        auto j = i;
-        ++j;
-        while (j != requiredSpots.end()) {
-            bool intersectionFound = false;
-            int i_ = *i;
-            int j_ = *j;
-            intersectionFound |=
+        for (int i_ : level) {
+            for (auto j = requiredSpots.upper_bound(i_);
+                 j != requiredSpots.end(); ++j) {
+                int j_ = *j;
                 dstSpotBoxs.at(i_)->copyImgTo(*srcSpotBoxs.at(j_));
-            intersectionFound |=
                 dstSpotBoxs.at(i_)->copyImgTo(*dstSpotBoxs.at(j_));
-            if (intersectionFound) {
-                positiveSpots.insert(j_);
             }
-            ++j;
         }
     }
 
@@ -55,18 +55,18 @@ void texture_boost(array2D<float> &Y,
     int W = Y.width();
     int H = Y.height();
 
-    array2D<float> tmpY(ARRAY2D_ALIGNED);
+    std::unique_ptr<ScratchPlane> tmpY;
     array2D<float> *src = &Y;
     if (fradius > 1.f && delta > 1.01f) {
         W = int(W * delta + 0.5f);
         H = int(H * delta + 0.5f);
-        tmpY(W, H);
-        rescaleBilinear(Y, tmpY, multithread);
-        src = &tmpY;
+        tmpY.reset(new ScratchPlane(W, H));
+        rescaleBilinear(Y, *tmpY, multithread);
+        src = tmpY.get();
     }
 
-    array2D<float> mid(W, H, ARRAY2D_ALIGNED);
-    array2D<float> base(W, H, ARRAY2D_ALIGNED);
+    ScratchPlane mid(W, H);
+    ScratchPlane base(W, H);
 
 #ifdef __SSE2__
     const vfloat v65535 = F2V(65535.f);
@@ -232,7 +232,7 @@ bool ImProcFunctions::textureBoost(Imagefloat *rgb)
 
         rgb->setMode(Imagefloat::Mode::YUV, multiThread);
 
-        array2D<float> Y(W, H, rgb->g.ptrs, ARRAY2D_ALIGNED);
+        ScratchPlane Y(W, H, rgb->g.ptrs);
 
         for (int i = 0; i < n; ++i) {
             if (!params->textureBoost.masks[i].enabled) {
@@ -241,8 +241,11 @@ bool ImProcFunctions::textureBoost(Imagefloat *rgb)
 
             auto &r = params->textureBoost.regions[i];
             if (r.strength != 0) {
-                texture_boost(Y, r, scale, multiThread,
-                              scale == 1 || cur_pipeline == Pipeline::OUTPUT);
+                runProxy(Y, [&](array2D<float> &YY) -> void {
+                    texture_boost(YY, r, scale, multiThread,
+                                  scale == 1 ||
+                                      cur_pipeline == Pipeline::OUTPUT);
+                });
                 const auto &blend = mask[i];
 
 #ifdef _OPENMP
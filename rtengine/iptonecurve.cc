@@ -44,6 +44,18 @@ inline void apply(const Curve &c, Imagefloat *rgb, int W, int H,
     }
 }
 
+template <class Curve>
+inline void batch_apply(const Curve &c, Imagefloat *rgb, int W, int H,
+                        bool multithread)
+{
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        c.BatchApply(0, W, rgb->r.ptrs[y], rgb->g.ptrs[y], rgb->b.ptrs[y]);
+    }
+}
+
 void apply_tc(Imagefloat *rgb, const ToneCurve &tc,
               ToneCurveParams::TcMode curveMode,
               const Glib::ustring &working_profile,
@@ -69,14 +81,14 @@ void apply_tc(Imagefloat *rgb, const ToneCurve &tc,
         }
     } else if (curveMode == ToneCurveParams::TcMode::STD) {
         const StandardToneCurve &c = static_cast<const StandardToneCurve &>(tc);
-        apply(c, rgb, W, H, multithread);
+        batch_apply(c, rgb, W, H, multithread);
     } else if (curveMode == ToneCurveParams::TcMode::WEIGHTEDSTD) {
         const WeightedStdToneCurve &c =
             static_cast<const WeightedStdToneCurve &>(tc);
-        apply(c, rgb, W, H, multithread);
+        batch_apply(c, rgb, W, H, multithread);
     } else if (curveMode == ToneCurveParams::TcMode::FILMLIKE) {
         const AdobeToneCurve &c = static_cast<const AdobeToneCurve &>(tc);
-        apply(c, rgb, W, H, multithread);
+        batch_apply(c, rgb, W, H, multithread);
     } else if (curveMode == ToneCurveParams::TcMode::SATANDVALBLENDING) {
         const SatAndValueBlendingToneCurve &c =
             static_cast<const SatAndValueBlendingToneCurve &>(tc);
@@ -91,9 +103,8 @@ void apply_tc(Imagefloat *rgb, const ToneCurve &tc,
 #pragma omp parallel for if (multithread)
 #endif
         for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                c.Apply(rgb->r(y, x), rgb->g(y, x), rgb->b(y, x), ws);
-            }
+            c.BatchApply(0, W, rgb->r.ptrs[y], rgb->g.ptrs[y], rgb->b.ptrs[y],
+                         ws);
         }
     } else if (curveMode == ToneCurveParams::TcMode::NEUTRAL) {
         const NeutralToneCurve &c = static_cast<const NeutralToneCurve &>(tc);
@@ -420,13 +431,18 @@ private:
 void apply_satcurve(Imagefloat *rgb, const FlatCurve &curve,
                     const DiagonalCurve &curve2,
                     const Glib::ustring &working_profile, float whitept,
-                    bool multithread)
+                    const std::string &lut_key, bool multithread)
 {
-    LUTf sat;
+    std::shared_ptr<const LUTf> lut;
     const bool use_lut = (whitept == 1.f);
     if (use_lut) {
-        satcurve_lut(curve, sat, whitept);
+        lut = curves::get_cached_lut(
+            lut_key, [&curve, whitept](LUTf &sat) -> void {
+                satcurve_lut(curve, sat, whitept);
+            });
     }
+    const LUTf dummy;
+    const LUTf &sat = use_lut ? *lut : dummy;
 
     TMatrix ws = ICCStore::getInstance()->workingSpaceMatrix(working_profile);
     TMatrix iws =
@@ -610,23 +626,31 @@ void ImProcFunctions::toneCurve(Imagefloat *img)
         const bool single_curve =
             params->toneCurve.curveMode == params->toneCurve.curveMode2;
 
+        const float gray =
+            (params->logenc.enabled ? params->logenc.targetGray / 100.0
+                                    : 0.18f);
+        const int ppn = CURVES_MIN_POLY_POINTS / max(int(scale), 1);
+
+        // the LUTs of the curves are shared with the other pipelines through
+        // curves::get_cached_lut(), so their keys must include all the
+        // parameters the curves are built from
         ToneCurve tc;
         std::unique_ptr<Curve> basecurve;
+        const bool rolloff =
+            params->toneCurve.basecurve == ToneCurveParams::BcMode::ROLLOFF;
         if (params->toneCurve.basecurve != ToneCurveParams::BcMode::LINEAR) {
-            float gray =
-                (params->logenc.enabled ? params->logenc.targetGray / 100.0
-                                        : 0.18f);
-            bool ro =
-                params->toneCurve.basecurve == ToneCurveParams::BcMode::ROLLOFF;
-            basecurve.reset(
-                new ToneMapCurve(1.f, whitept, 1.f / 65535.f, gray, gray, ro));
+            basecurve.reset(new ToneMapCurve(1.f, whitept, 1.f / 65535.f, gray,
+                                             gray, rolloff));
         }
 
         ImProcData im(params, scale, multiThread);
         if (!(single_curve && params->toneCurve.curveMode ==
                                   ToneCurveParams::TcMode::NEUTRAL)) {
             if (basecurve) {
-                tc.Set(*basecurve, whitept);
+                tc.Set(*basecurve, whitept,
+                       (curves::LUTKey("tonecurve_base")
+                        << whitept << gray << rolloff)
+                           .str());
                 apply_tc(img, tc, ToneCurveParams::TcMode::STD,
                          params->icm.workingProfile, params->icm.outputProfile,
                          100, whitept, nullptr, multiThread);
@@ -690,10 +714,10 @@ void ImProcFunctions::toneCurve(Imagefloat *img)
             return c;
         };
 
-        DiagonalCurve tcurve2(adjust(params->toneCurve.curve2),
-                              CURVES_MIN_POLY_POINTS / max(int(scale), 1));
-        DiagonalCurve tcurve1(adjust(params->toneCurve.curve),
-                              CURVES_MIN_POLY_POINTS / max(int(scale), 1));
+        DiagonalCurve tcurve2(adjust(params->toneCurve.curve2), ppn);
+        DiagonalCurve tcurve1(adjust(params->toneCurve.curve), ppn);
+        // ccurve depends only on the contrast, the gray point and whitept
+        const int contrast = ccurve ? params->toneCurve.contrast : 0;
         DoubleCurve dcurve(tcurve1, tcurve2);
         std::unique_ptr<Curve> dccurve;
         Curve *tcurve = &dcurve;
@@ -708,14 +732,21 @@ void ImProcFunctions::toneCurve(Imagefloat *img)
         }
 
         if (single_curve) {
-            tc.Set(*tcurve, whitept);
+            tc.Set(*tcurve, whitept,
+                   (curves::LUTKey("tonecurve")
+                    << whitept << gray << contrast << params->toneCurve.curve
+                    << params->toneCurve.curve2 << ppn)
+                       .str());
             apply_tc(img, tc, params->toneCurve.curveMode,
                      params->icm.workingProfile, params->icm.outputProfile,
                      params->toneCurve.perceptualStrength, whitept,
                      basecurve.get(), multiThread);
         } else {
             if (ccurve) {
-                tc.Set(*ccurve, whitept);
+                tc.Set(*ccurve, whitept,
+                       (curves::LUTKey("tonecurve_contrast")
+                        << whitept << gray << contrast)
+                           .str());
                 apply_tc(img, tc, params->toneCurve.curveMode,
                          params->icm.workingProfile, params->icm.outputProfile,
                          100, whitept, nullptr, multiThread);
@@ -726,7 +757,10 @@ void ImProcFunctions::toneCurve(Imagefloat *img)
             }
 
             if (!tcurve1.isIdentity()) {
-                tc.Set(tcurve1, whitept);
+                tc.Set(tcurve1, whitept,
+                       (curves::LUTKey("tonecurve_curve")
+                        << whitept << params->toneCurve.curve << ppn)
+                           .str());
                 apply_tc(img, tc, params->toneCurve.curveMode,
                          params->icm.workingProfile, params->icm.outputProfile,
                          params->toneCurve.perceptualStrength, whitept, nullptr,
@@ -738,7 +772,10 @@ void ImProcFunctions::toneCurve(Imagefloat *img)
             }
 
             if (!tcurve2.isIdentity()) {
-                tc.Set(tcurve2, whitept);
+                tc.Set(tcurve2, whitept,
+                       (curves::LUTKey("tonecurve_curve")
+                        << whitept << params->toneCurve.curve2 << ppn)
+                           .str());
                 apply_tc(img, tc, params->toneCurve.curveMode2,
                          params->icm.workingProfile, params->icm.outputProfile,
                          params->toneCurve.perceptualStrength, whitept, nullptr,
@@ -753,12 +790,13 @@ void ImProcFunctions::toneCurve(Imagefloat *img)
         }
 
         auto satcurve_pts = params->toneCurve.saturation;
-        const FlatCurve satlcurve(satcurve_pts, false,
-                                  CURVES_MIN_POLY_POINTS / max(int(scale), 1));
+        const FlatCurve satlcurve(satcurve_pts, false, ppn);
         const DiagonalCurve satccurve(params->toneCurve.saturation2);
         if (!satlcurve.isIdentity() || !satccurve.isIdentity()) {
-            apply_satcurve(img, satlcurve, satccurve,
-                           params->icm.workingProfile, whitept, multiThread);
+            apply_satcurve(
+                img, satlcurve, satccurve, params->icm.workingProfile, whitept,
+                (curves::LUTKey("tonecurve_sat") << satcurve_pts << ppn).str(),
+                multiThread);
         }
     } else if (editImgFloat) {
         const int W = img->getWidth();
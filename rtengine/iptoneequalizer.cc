@@ -67,7 +67,7 @@ void tone_eq(array2D<float> &R, array2D<float> &G, array2D<float> &B,
 {
     const int W = R.width();
     const int H = R.height();
-    array2D<float> Y(W, H, ARRAY2D_ALIGNED);
+    ScratchPlane Y(W, H);
 
     const auto log2 = [](float x) -> float {
         static const float l2 = xlogf(2);
@@ -121,30 +121,54 @@ void tone_eq(array2D<float> &R, array2D<float> &G, array2D<float> &B,
     }
 
     if (pp.regularization > 1) {
-        array2D<float> Y2(W, H, ARRAY2D_ALIGNED);
         constexpr float base_epsilon = 0.004f;
         constexpr float base_posterization = 5.f;
 
+        radius = 350.f / scale;
+        epsilon = base_epsilon;
+        const int reg = 5 - std::min(pp.regularization, 4);
+
+        // the exposure map is very smooth at these radii, so the filters are
+        // computed on a box-downscaled copy of the luminance, and the result
+        // is upsampled using the full resolution luminance as the guide
+        const int f = max(min(radius / 32, max(W, H) / 256), 1);
+        const int w = max(W / f, 1);
+        const int h = max(H / f, 1);
+        ScratchPlane Ys(w, h);
+        ScratchPlane Y2s(w, h);
+
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
-        for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                float l = LIM(log2(std::max(Y[y][x], 1e-9f)), centers[0],
-                              centers[11]);
-                float ll = round(l * base_posterization) / base_posterization;
-                Y2[y][x] = Y[y][x];
-                Y[y][x] = exp2(ll);
+        for (int y = 0; y < h; ++y) {
+            const int y1 = min(y * f + f, H);
+            for (int x = 0; x < w; ++x) {
+                const int x1 = min(x * f + f, W);
+                float sum = 0.f, sum_post = 0.f;
+                for (int yy = y * f; yy < y1; ++yy) {
+                    for (int xx = x * f; xx < x1; ++xx) {
+                        float l = LIM(log2(std::max(Y[yy][xx], 1e-9f)),
+                                      centers[0], centers[11]);
+                        float ll = round(l * base_posterization) /
+                                   base_posterization;
+                        sum += Y[yy][xx];
+                        sum_post += exp2(ll);
+                    }
+                }
+                const float n = (y1 - y * f) * (x1 - x * f);
+                Y2s[y][x] = sum / n;
+                Ys[y][x] = sum_post / n;
             }
         }
-        radius = 350.f / scale;
-        epsilon = base_epsilon;
-        rtengine::guidedFilter(Y2, Y, Y, radius, epsilon, multithread);
 
-        int reg = 5 - std::min(pp.regularization, 4);
         if (reg > 1) {
-            rtengine::guidedFilter(Y2, Y, Y, radius * (reg - 1), epsilon / 100,
+            rtengine::guidedFilter(Y2s, Ys, Ys, max(radius / f, 1), epsilon,
                                    multithread);
+            rtengine::guidedUpsample(Y, {&Ys}, {&Y}, radius * (reg - 1),
+                                     epsilon / 100, multithread);
+        } else {
+            rtengine::guidedUpsample(Y, {&Ys}, {&Y}, radius, epsilon,
+                                     multithread);
         }
     }
 
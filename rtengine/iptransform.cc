@@ -22,12 +22,15 @@
 #include <omp.h>
 #endif
 #include "../rtgui/multilangmgr.h"
+#include "cache.h"
 #include "lensexif.h"
 #include "mytime.h"
 #include "opthelper.h"
 #include "perspectivecorrection.h"
 #include "rt_math.h"
 #include "rtlensfun.h"
+#include <iomanip>
+#include <sstream>
 
 namespace rtengine {
 
@@ -587,7 +590,7 @@ void ImProcFunctions::transform(Imagefloat *original, Imagefloat *transformed,
     float focusDist = metadata->getFocusDist();
     double fNumber = metadata->getFNumber();
 
-    std::unique_ptr<const LensCorrection> pLCPMap;
+    std::shared_ptr<const LensCorrection> pLCPMap;
 
     if (params->lensProf.useExif()) {
         auto corr = new ExifLensCorrection(metadata, oW, oH, params->coarse,
@@ -604,14 +607,11 @@ void ImProcFunctions::transform(Imagefloat *original, Imagefloat *transformed,
             params->lensProf, metadata, oW, oH, params->coarse, rawRotationDeg);
     } else if (needsLCP()) { // don't check focal length to allow distortion
                              // correction for lenses without chip
-        const std::shared_ptr<LCPProfile> pLCPProf =
-            LCPStore::getInstance()->getProfile(params->lensProf.lcpFile);
-
-        if (pLCPProf) {
-            pLCPMap.reset(new LCPMapper(pLCPProf, focalLen, focalLen35mm,
-                                        focusDist, fNumber, false, false, oW,
-                                        oH, params->coarse, rawRotationDeg));
-        } else if (!params->lensProf.lcpFile.empty() && plistener) {
+        pLCPMap = LCPStore::getInstance()->getMapper(
+            params->lensProf.lcpFile, focalLen, focalLen35mm, focusDist,
+            fNumber, false, false, oW, oH, params->coarse, rawRotationDeg);
+
+        if (!pLCPMap && !params->lensProf.lcpFile.empty() && plistener) {
             plistener->error(Glib::ustring::compose(M("ERROR_MSG_FILE_READ"),
                                                     params->lensProf.lcpFile));
         }
@@ -631,6 +631,20 @@ void ImProcFunctions::transform(Imagefloat *original, Imagefloat *transformed,
     const bool do_encode = highQuality && (needs_transform_general ||
                                            needs_perspective || needs_lcp_ca);
 
+    // identifies the distortion mapping of pLCPMap, see transformGeneral()
+    std::string lens_key;
+    if (pLCPMap && params->lensProf.useDist) {
+        const auto &lp = params->lensProf;
+        std::ostringstream buf;
+        buf << metadata->getFileName() << '\n' << int(lp.lcMode) << '\n'
+            << lp.lcpFile << '\n' << lp.lfCameraMake << '\n'
+            << lp.lfCameraModel << '\n' << lp.lfLens << '\n' << oW << ' '
+            << oH << ' ' << params->coarse.rotate << ' '
+            << params->coarse.hflip << ' ' << params->coarse.vflip << ' '
+            << rawRotationDeg;
+        lens_key = buf.str();
+    }
+
     if (!(needs_dist_rot_ca || needs_perspective) && needs_luminance) {
         transformLuminanceOnly(original, transformed, cx, cy, oW, oH, fW, fH,
                                false);
@@ -662,7 +676,7 @@ void ImProcFunctions::transform(Imagefloat *original, Imagefloat *transformed,
 
         if (needs_transform_general) {
             transformGeneral(highQuality, original, dest, dest_x, dest_y, sx,
-                             sy, oW, oH, fW, fH, pLCPMap.get());
+                             sy, oW, oH, fW, fH, pLCPMap.get(), lens_key);
         } else {
             dest = original;
         }
@@ -1048,6 +1062,66 @@ float calcPCVignetteFactor(const pcv_params &pcv, int x, int y)
     return val;
 }
 
+/**
+ * Lens distortion mapping of a tile, evaluated only every STEP pixels and
+ * bilinearly interpolated in between. The mapping is smooth enough that the
+ * error is a tiny fraction of a pixel, whereas evaluating the lens model
+ * (LCP or lensfun) for every pixel dominates the cost of transformGeneral().
+ */
+class DistortionGrid {
+public:
+    static constexpr int STEP = 8;
+
+    DistortionGrid(const LensCorrection *lc, int W, int H, int cx, int cy,
+                   double ascale, bool multithread)
+        : nx_((W - 1) / STEP + 2), ny_((H - 1) / STEP + 2), ascale_(ascale),
+          dx_(nx_ * ny_), dy_(nx_ * ny_)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+        for (int i = 0; i < ny_; ++i) {
+            for (int j = 0; j < nx_; ++j) {
+                double x = j * STEP, y = i * STEP;
+                lc->correctDistortion(x, y, cx, cy, ascale);
+                // stored relative to the undistorted position, for accuracy
+                dx_[i * nx_ + j] = x - ascale * j * STEP;
+                dy_[i * nx_ + j] = y - ascale * i * STEP;
+            }
+        }
+    }
+
+    // same as correctDistortion(x_d, y_d, cx, cy, ascale) of the lens
+    // correction, for the pixel (x, y) of the tile
+    void get(int x, int y, double &x_d, double &y_d) const
+    {
+        const int gx = x / STEP;
+        const int gy = y / STEP;
+        const float fx = float(x - gx * STEP) / STEP;
+        const float fy = float(y - gy * STEP) / STEP;
+        const size_t i = size_t(gy) * nx_ + gx;
+        const auto interp = [=](const std::vector<float> &d) -> float {
+            const float top = d[i] + fx * (d[i + 1] - d[i]);
+            const float bot = d[i + nx_] + fx * (d[i + nx_ + 1] - d[i + nx_]);
+            return top + fy * (bot - top);
+        };
+        x_d = ascale_ * x + interp(dx_);
+        y_d = ascale_ * y + interp(dy_);
+    }
+
+private:
+    int nx_;
+    int ny_;
+    double ascale_;
+    std::vector<float> dx_;
+    std::vector<float> dy_;
+};
+
+// the grids of the last tiles processed, e.g. the preview and the detail
+// windows
+Cache<std::string, std::shared_ptr<const DistortionGrid>>
+    distortion_grid_cache(8);
+
 } // namespace
 
 void ImProcFunctions::transformLuminanceOnly(Imagefloat *original,
@@ -1124,7 +1198,8 @@ void ImProcFunctions::transformLuminanceOnly(Imagefloat *original,
 void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original,
                                        Imagefloat *transformed, int cx, int cy,
                                        int sx, int sy, int oW, int oH, int fW,
-                                       int fH, const LensCorrection *pLCPMap)
+                                       int fH, const LensCorrection *pLCPMap,
+                                       const std::string &lens_key)
 {
     // set up stuff, depending on the mode we are
     bool enableLCPDist = pLCPMap && params->lensProf.useDist;
@@ -1184,6 +1259,25 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original,
     const bool use_enc = highQuality;
     constexpr float invalid = 0.f;
 
+    // the lens distortion is evaluated on a coarse grid, which is kept across
+    // calls as long as the lens and the geometry of the tile are the same
+    std::shared_ptr<const DistortionGrid> grid;
+    if (enableLCPDist) {
+        std::ostringstream buf;
+        buf << lens_key << '\n' << cx << ' ' << cy << ' '
+            << transformed->getWidth() << ' ' << transformed->getHeight()
+            << ' ' << std::setprecision(17) << ascale;
+        const std::string key = buf.str();
+        if (lens_key.empty() || !distortion_grid_cache.get(key, grid)) {
+            grid.reset(new DistortionGrid(pLCPMap, transformed->getWidth(),
+                                          transformed->getHeight(), cx, cy,
+                                          ascale, multiThread));
+            if (!lens_key.empty()) {
+                distortion_grid_cache.set(key, grid);
+            }
+        }
+    }
+
 #if defined(__GNUC__) && __GNUC__ >= 7 // silence warning
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
@@ -1202,8 +1296,7 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original,
             double x_d = x, y_d = y;
 
             if (enableLCPDist) {
-                pLCPMap->correctDistortion(x_d, y_d, cx, cy,
-                                           ascale); // must be first transform
+                grid->get(x, y, x_d, y_d); // must be first transform
             } else {
                 x_d *= ascale;
                 y_d *= ascale;
@@ -19,18 +19,42 @@
 
 #include <cstring>
 #include <memory>
+#include <new>
 
+#include "imagefloat.h"
 #include "labimage.h"
 
 namespace rtengine {
 
-LabImage::LabImage(int w, int h): W(w), H(h) { allocLab(w, h); }
+LabImage::LabImage(int w, int h): buffer_(0, 64), owner_(true), W(w), H(h)
+{
+    allocLab(w, h);
+}
+
+LabImage::LabImage(Imagefloat &img, bool multithread)
+    : owner_(false), W(img.getWidth()), H(img.getHeight()), data(nullptr)
+{
+    img.setMode(Imagefloat::Mode::LAB, multithread);
+
+    L = new float *[H];
+    a = new float *[H];
+    b = new float *[H];
+    for (int i = 0; i < H; ++i) {
+        L[i] = img.g(i);
+        a[i] = img.r(i);
+        b[i] = img.b(i);
+    }
+}
 
 LabImage::~LabImage() { deleteLab(); }
 
 void LabImage::CopyFrom(LabImage *Img)
 {
-    memcpy(data, Img->data, W * H * 3 * sizeof(float));
+    for (int i = 0; i < H; ++i) {
+        memcpy(L[i], Img->L[i], W * sizeof(float));
+        memcpy(a[i], Img->a[i], W * sizeof(float));
+        memcpy(b[i], Img->b[i], W * sizeof(float));
+    }
 }
 
 void LabImage::getPipetteData(float &v1, float &v2, float &v3, int posX,
@@ -66,23 +90,20 @@ void LabImage::allocLab(size_t w, size_t h)
     a = new float *[h];
     b = new float *[h];
 
-    data = new float[w * h * 3];
-    float *index = data;
-
-    for (size_t i = 0; i < h; i++) {
-        L[i] = index + i * w;
-    }
-
-    index += w * h;
-
-    for (size_t i = 0; i < h; i++) {
-        a[i] = index + i * w;
+    // each plane starts on a 64-byte boundary
+    const size_t plane = (w * h + 15) / 16 * 16;
+    if (!buffer_.resize(3 * plane)) {
+        delete[] L;
+        delete[] a;
+        delete[] b;
+        throw std::bad_alloc();
     }
-
-    index += w * h;
+    data = buffer_.data;
 
     for (size_t i = 0; i < h; i++) {
-        b[i] = index + i * w;
+        L[i] = data + i * w;
+        a[i] = data + plane + i * w;
+        b[i] = data + 2 * plane + i * w;
     }
 }
 
@@ -91,9 +112,17 @@ void LabImage::deleteLab()
     delete[] L;
     delete[] a;
     delete[] b;
-    delete[] data;
+    if (owner_) {
+        buffer_.resize(0);
+    }
+    data = nullptr;
 }
 
-void LabImage::reallocLab() { allocLab(W, H); }
+void LabImage::reallocLab()
+{
+    if (owner_) {
+        allocLab(W, H);
+    }
+}
 
 } // namespace rtengine
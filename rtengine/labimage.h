@@ -19,20 +19,35 @@
 #ifndef _LABIMAGE_H_
 #define _LABIMAGE_H_
 
+#include "alignedbuffer.h"
+
 namespace rtengine {
 
+class Imagefloat;
+
+/*
+ * The L, a and b planes are 64-byte aligned, with contiguous rows (as
+ * expected by the wavelet decompositions working on them)
+ */
 class LabImage {
 private:
     void allocLab(size_t w, size_t h);
 
+    AlignedBuffer<float> buffer_;
+    bool owner_;
+
 public:
     int W, H;
-    float *data;
+    float *data; // start of the L plane, nullptr for views of an Imagefloat
     float **L;
     float **a;
     float **b;
 
     LabImage(int w, int h);
+    /** converts img to Lab in place and references its planes (L = g, a = r,
+        b = b), without copying them; img must outlive the view. The rows
+        are those of img, so they are not contiguous */
+    LabImage(Imagefloat &img, bool multithread);
     ~LabImage();
 
     // Copies image data in Img into this instance.
@@ -0,0 +1,120 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace rtengine {
+
+/**
+ * Deferred initialisation of a store of the engine.
+ *
+ * The initialisation function is registered with set(), and run exactly once
+ * by the first caller of wait(): typically the accessors of the store on
+ * first use, or a background task. Concurrent callers block until it is
+ * done. Calls from the thread running the initialisation itself return
+ * immediately, so that the function can use the public interface of its
+ * store.
+ */
+class LazyInit: public NonCopyable {
+public:
+    LazyInit(): state_(DONE) { done_.set_value(); }
+
+    /// registers f, replacing any initialisation not started yet
+    void set(std::function<void()> f)
+    {
+        discard();
+        std::lock_guard<std::mutex> lock(mutex_);
+        func_ = std::move(f);
+        done_ = std::promise<void>();
+        ready_ = done_.get_future().share();
+        state_ = PENDING;
+    }
+
+    /// drops the pending initialisation, if any (waiting for a running one)
+    void discard()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (state_ == PENDING) {
+                func_ = nullptr;
+                state_ = DONE;
+                done_.set_value();
+                return;
+            }
+        }
+        wait();
+    }
+
+    /// runs the pending initialisation, or waits for it to complete
+    void wait()
+    {
+        std::shared_future<void> ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (state_ == DONE ||
+                (state_ == RUNNING && runner_ == std::this_thread::get_id())) {
+                return;
+            }
+            if (state_ == PENDING) {
+                state_ = RUNNING;
+                runner_ = std::this_thread::get_id();
+                auto f = std::move(func_);
+                lock.unlock();
+                f();
+                lock.lock();
+                state_ = DONE;
+                done_.set_value();
+                return;
+            }
+            ready = ready_;
+        }
+        ready.wait();
+    }
+
+    /// readiness of the store, without triggering the initialisation
+    std::shared_future<void> ready() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_ == DONE ? done_future_() : ready_;
+    }
+
+private:
+    enum State { PENDING, RUNNING, DONE };
+
+    static std::shared_future<void> done_future_()
+    {
+        std::promise<void> p;
+        p.set_value();
+        return p.get_future().share();
+    }
+
+    mutable std::mutex mutex_;
+    State state_;
+    std::thread::id runner_;
+    std::function<void()> func_;
+    std::promise<void> done_;
+    std::shared_future<void> ready_;
+};
+
+} // namespace rtengine
@@ -24,6 +24,8 @@
 
 #include <algorithm>
 #include <cstring>
+#include <iomanip>
+#include <sstream>
 
 #include <glib/gstdio.h>
 
@@ -896,7 +898,37 @@ Glib::ustring rtengine::LCPStore::getDefaultCommonDirectory() const
     return dir;
 }
 
-rtengine::LCPStore::LCPStore(unsigned int _cache_size): cache(_cache_size) {}
+rtengine::LCPStore::LCPStore(unsigned int _cache_size)
+    : cache(_cache_size), mappers(16)
+{
+}
+
+std::shared_ptr<const rtengine::LCPMapper> rtengine::LCPStore::getMapper(
+    const Glib::ustring &filename, float focalLength, float focalLength35mm,
+    float focusDist, float aperture, bool vignette, bool useCADistP,
+    int fullWidth, int fullHeight, const CoarseTransformParams &coarse,
+    int rawRotationDeg) const
+{
+    std::ostringstream buf;
+    buf << filename << '\n' << std::setprecision(9) << focalLength << ' '
+        << focalLength35mm << ' ' << focusDist << ' ' << aperture << ' '
+        << vignette << ' ' << useCADistP << ' ' << fullWidth << ' '
+        << fullHeight << ' ' << coarse.rotate << ' ' << rawRotationDeg;
+    const std::string key = buf.str();
+
+    std::shared_ptr<const LCPMapper> res;
+    if (!mappers.get(key, res)) {
+        const std::shared_ptr<LCPProfile> prof = getProfile(filename);
+        if (!prof) {
+            return nullptr;
+        }
+        res.reset(new LCPMapper(prof, focalLength, focalLength35mm, focusDist,
+                                aperture, vignette, useCADistP, fullWidth,
+                                fullHeight, coarse, rawRotationDeg));
+        mappers.set(key, res);
+    }
+    return res;
+}
 
 // if !vignette then geometric and CA
 rtengine::LCPMapper::LCPMapper(const std::shared_ptr<LCPProfile> &pProf,
@@ -1142,7 +1174,38 @@ void rtengine::LCPMapper::processVignetteLine3Channels(int width, int y,
     float yd = ((float)y - mc.y0) * mc.rfy;
     yd *= yd;
     const LCPModelCommon::VignParam vignParam = mc.vign_param;
-    for (int x = 0; x < width; x++) {
+    int x = 0;
+#ifdef __SSE2__
+    const vfloat fourv = F2V(4.f);
+    const vfloat zerov = F2V(0.f);
+    const vfloat ydv = F2V(yd);
+    const vfloat p0 = F2V(vignParam[0]);
+    const vfloat p1 = F2V(vignParam[1]);
+    const vfloat p2 = F2V(vignParam[2]);
+    const vfloat p3 = F2V(vignParam[3]);
+    const vfloat x0v = F2V(mc.x0);
+    const vfloat rfxv = F2V(mc.rfx);
+
+    vfloat xv = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    for (; x < width - 3; x += 4) {
+        const vfloat xdv = (xv - x0v) * rfxv;
+        const vfloat rsqr = xdv * xdv + ydv;
+        const vfloat vignFactorv =
+            rsqr * (p0 + rsqr * (p1 - p2 * rsqr + p3 * rsqr * rsqr));
+        // spread the factors of the 4 pixels over their 12 values
+        const vfloat f[3] = {
+            _mm_shuffle_ps(vignFactorv, vignFactorv, _MM_SHUFFLE(1, 0, 0, 0)),
+            _mm_shuffle_ps(vignFactorv, vignFactorv, _MM_SHUFFLE(2, 2, 1, 1)),
+            _mm_shuffle_ps(vignFactorv, vignFactorv, _MM_SHUFFLE(3, 3, 3, 2))};
+        for (int k = 0; k < 3; ++k) {
+            vfloat valv = LVFU(line[3 * x + 4 * k]);
+            valv += valv * vselfzero(vmaskf_gt(valv, zerov), f[k]);
+            STVFU(line[3 * x + 4 * k], valv);
+        }
+        xv += fourv;
+    }
+#endif // __SSE2__
+    for (; x < width; x++) {
         const float xd = ((float)x - mc.x0) * mc.rfx;
         const float rsqr = xd * xd + yd;
         const float vignetteFactor =
@@ -130,12 +130,22 @@ private:
                                         // it's buggy in GCC!
 };
 
+class LCPMapper;
+
 class LCPStore {
 public:
     static LCPStore *getInstance();
 
     bool isValidLCPFileName(const Glib::ustring &filename) const;
     std::shared_ptr<LCPProfile> getProfile(const Glib::ustring &filename) const;
+    // same as constructing a LCPMapper from getProfile(filename), but the
+    // last mappers created are kept and shared across images taken with the
+    // same parameters. Returns nullptr if the profile can't be loaded
+    std::shared_ptr<const LCPMapper>
+    getMapper(const Glib::ustring &filename, float focalLength,
+              float focalLength35mm, float focusDist, float aperture,
+              bool vignette, bool useCADistP, int fullWidth, int fullHeight,
+              const CoarseTransformParams &coarse, int rawRotationDeg) const;
     Glib::ustring getDefaultCommonDirectory() const;
 
 private:
@@ -143,6 +153,7 @@ private:
 
     // Maps file name to profile as cache
     mutable Cache<Glib::ustring, std::shared_ptr<LCPProfile>> cache;
+    mutable Cache<std::string, std::shared_ptr<const LCPMapper>> mappers;
 };
 
 class LensCorrection {
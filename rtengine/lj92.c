@@ -49,8 +49,11 @@ typedef struct _ljp {
     u16 *linearize; // Linearization table
     int linlen;
     int sssshist[16];
+    int components; // interleaved components (SOF3)
+    int comptable[4]; // Huffman table of each component (SOS)
+    int restart;      // restart interval (DRI), not supported
 
-    // Huffman table - only one supported, and probably needed
+    // Huffman table - only one supported with SLOW_HUFF
 #ifdef SLOW_HUFF
     int *maxcode;
     int *mincode;
@@ -59,8 +62,10 @@ typedef struct _ljp {
     int *huffsize;
     int *huffcode;
 #else
-    u16 *hufflut;
+    u16 *hufflut; // the table in use
     int huffbits;
+    u16 *huffluts[4]; // all the tables, by id
+    int huffbitss[4];
 #endif
     // Parse state
     int cnt;
@@ -92,9 +97,11 @@ static int parseHuff(ljp *self)
     u8 *huffhead =
         &self->data
              [self->ix]; // xstruct.unpack('>HB16B',self.data[self.ix:self.ix+19])
+    unsigned int hufflen = BEH(huffhead[0]);
+#ifdef SLOW_HUFF
     u8 *bits = &huffhead[2];
     bits[0] = 0; // Because table starts from 1
-    unsigned int hufflen = BEH(huffhead[0]);
+#endif
     if ((self->ix + hufflen) >= self->datalen)
         return ret;
 #ifdef SLOW_HUFF
@@ -225,56 +232,67 @@ static int parseHuff(ljp *self)
     self->huffcode = NULL;
     ret = LJ92_ERROR_NONE;
 #else
-    /* Calculate huffman direct lut */
-    // How many bits in the table - find highest entry
-    u8 *huffvals = &self->data[self->ix + 19];
-    int maxbits = 16;
-    while (maxbits > 0) {
-        if (bits[maxbits])
-            break;
-        maxbits--;
-    }
-    self->huffbits = maxbits;
-    /* Now fill the lut */
-    u16 *hufflut = (u16 *)malloc((1 << maxbits) * sizeof(u16));
-    if (hufflut == NULL)
-        return LJ92_ERROR_NO_MEMORY;
-    self->hufflut = hufflut;
-    int i = 0;
-    int hv = 0;
-    int rv = 0;
-    int vl = 0; // i
-    int hcode;
-    int bitsused = 1;
-#ifdef DEBUG
-    printf("%04x:%x:%d:%x\n", i, huffvals[hv], bitsused,
-           1 << (maxbits - bitsused));
-#endif
-    while (i < 1 << maxbits) {
-        if (bitsused > maxbits) {
-            break; // Done. Should never get here!
-        }
-        if (vl >= bits[bitsused]) {
-            bitsused++;
-            vl = 0;
-            continue;
+    /* Calculate huffman direct lut, for each of the tables of the segment.
+       The data is not modified, so that it can be shared between decoders */
+    int pos = self->ix + 2;
+    const int end = self->ix + hufflen;
+    while (pos + 17 <= end) {
+        const int id = self->data[pos] & 3;
+        u8 tbits[17];
+        tbits[0] = 0; // Because table starts from 1
+        memcpy(&tbits[1], &self->data[pos + 1], 16);
+        int count = 0;
+        for (int b = 1; b <= 16; b++)
+            count += tbits[b];
+        if (pos + 17 + count > end)
+            return ret;
+        u8 *huffvals = &self->data[pos + 17];
+        // How many bits in the table - find highest entry
+        int maxbits = 16;
+        while (maxbits > 0) {
+            if (tbits[maxbits])
+                break;
+            maxbits--;
         }
-        if (rv == 1 << (maxbits - bitsused)) {
-            rv = 0;
-            vl++;
-            hv++;
-#ifdef DEBUG
-            printf("%04x:%x:%d:%x\n", i, huffvals[hv], bitsused,
-                   1 << (maxbits - bitsused));
-#endif
-            continue;
+        /* Now fill the lut */
+        u16 *hufflut = (u16 *)calloc(1 << maxbits, sizeof(u16));
+        if (hufflut == NULL)
+            return LJ92_ERROR_NO_MEMORY;
+        int i = 0;
+        int hv = 0;
+        int rv = 0;
+        int vl = 0; // i
+        int hcode;
+        int bitsused = 1;
+        while (i < 1 << maxbits) {
+            if (bitsused > maxbits) {
+                break; // Done. Should never get here!
+            }
+            if (vl >= tbits[bitsused]) {
+                bitsused++;
+                vl = 0;
+                continue;
+            }
+            if (rv == 1 << (maxbits - bitsused)) {
+                rv = 0;
+                vl++;
+                hv++;
+                continue;
+            }
+            hcode = huffvals[hv];
+            hufflut[i] = hcode << 8 | bitsused;
+            i++;
+            rv++;
         }
-        hcode = huffvals[hv];
-        hufflut[i] = hcode << 8 | bitsused;
-        // printf("%d %d %d\n",i,bitsused,hcode);
-        i++;
-        rv++;
+        free(self->huffluts[id]);
+        self->huffluts[id] = hufflut;
+        self->huffbitss[id] = maxbits;
+        // the last table defined is the default one
+        self->hufflut = hufflut;
+        self->huffbits = maxbits;
+        pos += 17 + count;
     }
+    self->ix = end;
     ret = LJ92_ERROR_NONE;
 #endif
     return ret;
@@ -287,6 +305,9 @@ static int parseSof3(ljp *self)
     self->y = BEH(self->data[self->ix + 3]);
     self->x = BEH(self->data[self->ix + 5]);
     self->bits = self->data[self->ix + 2];
+    self->components = self->data[self->ix + 7];
+    if (self->components < 1 || self->components > 4)
+        return LJ92_ERROR_CORRUPT;
     self->ix += BEH(self->data[self->ix]);
     return LJ92_ERROR_NONE;
 }
@@ -549,6 +570,91 @@ static int parsePred6(ljp *self)
     return ret;
 }
 
+#ifndef SLOW_HUFF
+// scans with several interleaved components: each one has its own predictor
+// state and Huffman table, and the output rows hold x * components samples
+static int parseScanMulti(ljp *self, int compcount, int pred)
+{
+    int ret = LJ92_ERROR_CORRUPT;
+    self->ix += BEH(self->data[self->ix]);
+    self->cnt = 0;
+    self->b = 0;
+    int write = self->writelen;
+    const int w = self->x * compcount;
+    int c = 0;
+    u16 *out = self->image;
+    u16 *thisrow = self->outrow[0];
+    u16 *lastrow = self->outrow[1];
+
+    for (int row = 0; row < self->y; row++) {
+        for (int i = 0; i < w; i++) {
+            const int comp = i % compcount;
+            int Px;
+            if (row == 0 && i < compcount) {
+                Px = 1 << (self->bits - 1);
+            } else if (row == 0) {
+                Px = thisrow[i - compcount];
+            } else if (i < compcount) {
+                Px = lastrow[i]; // Use value above for first pixel in row
+            } else {
+                const int left = thisrow[i - compcount];
+                const int up = lastrow[i];
+                const int upleft = lastrow[i - compcount];
+                switch (pred) {
+                case 1:
+                    Px = left;
+                    break;
+                case 2:
+                    Px = up;
+                    break;
+                case 3:
+                    Px = upleft;
+                    break;
+                case 4:
+                    Px = left + up - upleft;
+                    break;
+                case 5:
+                    Px = left + ((up - upleft) >> 1);
+                    break;
+                case 6:
+                    Px = up + ((left - upleft) >> 1);
+                    break;
+                case 7:
+                    Px = (left + up) >> 1;
+                    break;
+                default:
+                    Px = 0;
+                    break; // No prediction... should not be used
+                }
+            }
+            self->hufflut = self->huffluts[self->comptable[comp]];
+            self->huffbits = self->huffbitss[self->comptable[comp]];
+            int diff = nextdiff(self, Px);
+            int v = (u16)((Px + diff) % 65536);
+            int linear;
+            if (self->linearize) {
+                if (v > self->linlen)
+                    return LJ92_ERROR_CORRUPT;
+                linear = self->linearize[v];
+            } else
+                linear = v;
+            thisrow[i] = v;
+            out[c++] = linear;
+            if (--write == 0) {
+                out += self->skiplen;
+                write = self->writelen;
+            }
+        }
+        u16 *temprow = lastrow;
+        lastrow = thisrow;
+        thisrow = temprow;
+        if (self->ix >= self->datalen + 2)
+            return ret;
+    }
+    return LJ92_ERROR_NONE;
+}
+#endif
+
 static int parseScan(ljp *self)
 {
     int ret = LJ92_ERROR_CORRUPT;
@@ -558,6 +664,22 @@ static int parseScan(ljp *self)
     int pred = self->data[self->ix + 3 + 2 * compcount];
     if (pred < 0 || pred > 7)
         return ret;
+    if (self->restart)
+        return ret; // restart markers are not handled
+#ifndef SLOW_HUFF
+    if (compcount < 1 || compcount > 4 || compcount != self->components)
+        return ret;
+    for (int i = 0; i < compcount; i++) {
+        int t = (self->data[self->ix + 4 + 2 * i] >> 4) & 3;
+        if (!self->huffluts[t])
+            return ret;
+        self->comptable[i] = t;
+    }
+    if (compcount > 1)
+        return parseScanMulti(self, compcount, pred);
+    self->hufflut = self->huffluts[self->comptable[0]];
+    self->huffbits = self->huffbitss[self->comptable[0]];
+#endif
     if (pred == 6)
         return parsePred6(self); // Fast path
     self->ix += BEH(self->data[self->ix]);
@@ -660,6 +782,13 @@ static int parseImage(ljp *self)
             ret = parseSof3(self);
         else if (nextMarker == 0xfe) // Comment
             ret = parseBlock(self, nextMarker);
+        else if (nextMarker == 0xdd) { // Restart interval
+            self->restart = BEH(self->data[self->ix + 2]);
+            ret = parseBlock(self, nextMarker);
+        } else if (nextMarker >= 0xc0 && nextMarker <= 0xcf &&
+                   nextMarker != 0xc4 && nextMarker != 0xc8 &&
+                   nextMarker != 0xcc) // Not lossless Huffman coded
+            ret = LJ92_ERROR_CORRUPT;
         else if (nextMarker == 0xd9) // End of image
             break;
         else if (nextMarker == 0xda) {
@@ -701,7 +830,10 @@ static void free_memory(ljp *self)
     free(self->huffcode);
     self->huffcode = NULL;
 #else
-    free(self->hufflut);
+    for (int i = 0; i < 4; i++) {
+        free(self->huffluts[i]);
+        self->huffluts[i] = NULL;
+    }
     self->hufflut = NULL;
 #endif
     free(self->rowcache);
@@ -722,13 +854,14 @@ int lj92_open(lj92 *lj, uint8_t *data, int datalen, int *width, int *height,
     int ret = findSoI(self);
 
     if (ret == LJ92_ERROR_NONE) {
-        u16 *rowcache = (u16 *)calloc(self->x * 2, sizeof(u16));
+        const int w = self->x * self->components;
+        u16 *rowcache = (u16 *)calloc(w * 2, sizeof(u16));
         if (rowcache == NULL)
             ret = LJ92_ERROR_NO_MEMORY;
         else {
             self->rowcache = rowcache;
             self->outrow[0] = rowcache;
-            self->outrow[1] = &rowcache[self->x];
+            self->outrow[1] = &rowcache[w];
         }
     }
 
@@ -761,6 +894,12 @@ int lj92_decode(lj92 lj, uint16_t *target, int writeLength, int skipLength,
     return ret;
 }
 
+int lj92_components(lj92 lj)
+{
+    ljp *self = lj;
+    return self ? self->components : 0;
+}
+
 void lj92_close(lj92 lj)
 {
     ljp *self = lj;
@@ -49,6 +49,10 @@ int lj92_open(lj92 *lj,                   // Return handle here
               int *bitdepth); // Width, height and bitdepth
 
 /* Release a decoder object */
+// number of interleaved components: each row of the decoded image holds
+// width * components samples
+int lj92_components(lj92 lj);
+
 void lj92_close(lj92 lj);
 
 /*
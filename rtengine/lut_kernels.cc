@@ -0,0 +1,147 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lut_kernels.h"
+#include "LUT.h"
+#include "cpuinfo.h"
+#include <cstring>
+
+// this file is also compiled for the instruction sets in
+// PROC_DISPATCH_TARGETS (see lut_avx2.cc), which define ART_SIMD_VARIANT.
+// The baseline build only contains the dispatcher, since LUT.h already has
+// an SSE2 version of the interpolation
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_BASE_BUILD
+#endif
+
+#ifndef ART_SIMD_BASE_BUILD
+#include <immintrin.h>
+#endif
+
+namespace rtengine {
+
+namespace lut {
+
+#ifndef ART_SIMD_BASE_BUILD
+
+namespace {
+
+#ifdef __AVX512F__
+constexpr int N = 16;
+#else
+constexpr int N = 8;
+#endif
+
+typedef float vec __attribute__((vector_size(N * sizeof(float))));
+typedef int veci __attribute__((vector_size(N * sizeof(int))));
+
+inline vec load(const float *p)
+{
+    vec v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store(float *p, const vec &v) { std::memcpy(p, &v, sizeof(v)); }
+
+// gathers the floats at base[idx]
+inline vec gather(const float *base, const veci &idx)
+{
+#ifdef __AVX512F__
+    return (vec)_mm512_i32gather_ps((__m512i)idx, base, 4);
+#else
+    return (vec)_mm256_i32gather_ps(base, (__m256i)idx, 4);
+#endif
+}
+
+// same results as LUT<float>::operator[](float), including for NaNs
+void interpolate_block(const Table &lut, float scale, const float *in,
+                       float *out)
+{
+    const vec zero = vec{} + 0.f;
+    const vec maxs = zero + float(lut.size - 2);
+
+    const vec x = load(in) * scale;
+    // NaNs fail the comparison, and end up in the first cell
+    vec c = x > zero ? x : zero;
+    c = c < maxs ? c : maxs;
+    const veci i = __builtin_convertvector(c, veci);
+    const vec lo = gather(lut.data, i);
+    const vec hi = gather(lut.data + 1, i);
+    vec res = (x - __builtin_convertvector(i, vec)) * (hi - lo) + lo;
+
+    if (lut.clip & LUT_CLIP_BELOW) {
+        res = x >= zero ? res : zero + lut.data[0];
+    }
+    if (lut.clip & LUT_CLIP_ABOVE) {
+        res = x > maxs ? zero + lut.data[lut.size - 1] : res;
+    }
+    store(out, res);
+}
+
+void interpolate(const Table &lut, float scale, int n, const float *in,
+                 float *out)
+{
+    int i = 0;
+    for (; i + N <= n; i += N) {
+        interpolate_block(lut, scale, in + i, out + i);
+    }
+    if (i < n) {
+        // the last partial block goes through zero-padded copies
+        float tmp[2][N] = {};
+        const std::size_t sz = (n - i) * sizeof(float);
+        std::memcpy(tmp[0], in + i, sz);
+        interpolate_block(lut, scale, tmp[0], tmp[1]);
+        std::memcpy(out + i, tmp[1], sz);
+    }
+}
+
+} // namespace
+
+void ART_SIMD_VARIANT(fill_kernels)(Kernels &k) { k.interpolate = interpolate; }
+
+#else // ART_SIMD_BASE_BUILD
+
+const Kernels &get_kernels()
+{
+    static const Kernels kernels = []() -> Kernels {
+        Kernels k = {nullptr};
+        switch (get_simd_level()) {
+#ifdef ART_SIMD_DISPATCH_AVX512
+        case SIMDLevel::AVX512:
+            fill_kernels_avx512(k);
+            break;
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX2
+        case SIMDLevel::AVX2:
+            fill_kernels_avx2(k);
+            break;
+#endif
+        default:
+            break;
+        }
+        return k;
+    }();
+    return kernels;
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
+} // namespace lut
+
+} // namespace rtengine
@@ -0,0 +1,58 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+namespace rtengine {
+
+namespace lut {
+
+/// the table of a LUTf, as seen by the kernels
+struct Table {
+    const float *data;
+    /// number of entries
+    int size;
+    /// combination of LUT_CLIP_BELOW and LUT_CLIP_ABOVE
+    int clip;
+};
+
+// Wider-vector variants of the interpolation of LUT<float>::operator[](float)
+// over arrays of values, with the entries fetched by gathers. They are
+// compiled for the instruction sets in PROC_DISPATCH_TARGETS (see
+// ProcessorTargets.cmake); the function pointers are null when the processor
+// supports none of them, and LUT::apply() uses the SSE2 (or NEON, see
+// helperneon.h) shuffle-based code instead.
+struct Kernels {
+    /// interpolates the n values in[i] * scale, honouring the clipping flags
+    /// of the table. in and out can be the same array
+    void (*interpolate)(const Table &lut, float scale, int n, const float *in,
+                        float *out);
+};
+
+const Kernels &get_kernels();
+
+#ifdef ART_SIMD_DISPATCH_AVX2
+void fill_kernels_avx2(Kernels &k);
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX512
+void fill_kernels_avx512(Kernels &k);
+#endif
+
+} // namespace lut
+
+} // namespace rtengine
@@ -35,11 +35,18 @@
 #include "rescale.h"
 #include "rt_algo.h"
 #include "rt_math.h"
+#include "scratcharena.h"
 #include "sleef.h"
 #include "stdimagesource.h"
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <mutex>
 
 namespace rtengine {
 
+extern const Settings *settings;
+
 using procparams::AreaMask;
 using procparams::DrawnMask;
 using procparams::Mask;
@@ -62,13 +69,6 @@ bool generate_area_mask(int ox, int oy, int width, int height,
 
     Coord origin(ox, oy);
 
-    const auto inside = [&](int x, int y) -> bool {
-        return (x >= 0 && x < global_mask.width() && y >= 0 &&
-                y < global_mask.height());
-    };
-
-    const int dir[] = {1, 1, 1, -1, -1, 1, -1, -1};
-
     constexpr float bgcolor = 0.f; // background layer, no effect applied
     constexpr float fgcolor =
         1.f - bgcolor; // foreground layer, full effect applied
@@ -130,35 +130,43 @@ bool generate_area_mask(int ox, int oy, int width, int height,
             global_min_feather =
                 rtengine::min<double>(global_min_feather, min_feather);
 
-            const auto get = [&](int x, int y) -> Coord {
-                PolarCoord p(Coord(x, y));
-                double r, a;
-                p.get(r, a);
-                p.set(r, a - area->angle);
-                CoordD ret(p);
-                ret += center;
-                ret -= origin;
-                // return ret;
-                double rx, ry;
-                ret.get(rx, ry);
-                return Coord(int(rx + 0.5), int(ry + 0.5));
-            };
-
-            // draw the (bounded) ellipse
-            for (int x = 0, n = int(a_min); x < n; ++x) {
-                int yy = r * std::sqrt(a * a - float(x * x));
-                for (int y = 0, m = std::min(yy, int(b_min)); y < m; ++y) {
-                    for (int d = 0; d < 4; ++d) {
-                        int dx = dir[2 * d], dy = dir[2 * d + 1];
-                        Coord point = get(dx * x, dy * y);
-                        for (int i = -1; i < 2; ++i) {
-                            for (int j = -1; j < 2; ++j) {
-                                if (inside(point.x + i, point.y + j)) {
-                                    shape_mask[point.y + j][point.x + i] =
-                                        color;
-                                }
-                            }
-                        }
+            // draw the (bounded) ellipse: each pixel of its bounding box is
+            // mapped back to the coordinates of the shape, and filled if it
+            // is within one pixel (the margin) from its border
+            const double angle = area->angle / 180.0 * RT_PI;
+            const float cos_a = std::cos(angle);
+            const float sin_a = std::sin(angle);
+            const float cx = center.x - origin.x;
+            const float cy = center.y - origin.y;
+            constexpr float margin = 1.f;
+            const float hw = a_min + margin;
+            const float hh = b_min + margin;
+            const float ext_x = std::abs(hw * cos_a) + std::abs(hh * sin_a);
+            const float ext_y = std::abs(hw * sin_a) + std::abs(hh * cos_a);
+            const int x0 = std::max(int(cx - ext_x) - 1, 0);
+            const int x1 =
+                std::min(int(cx + ext_x) + 1, shape_mask.width() - 1);
+            const int y0 = std::max(int(cy - ext_y) - 1, 0);
+            const int y1 =
+                std::min(int(cy + ext_y) + 1, shape_mask.height() - 1);
+            const float a2 = a * a;
+            const float r2 = r * r;
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+            for (int y = y0; y <= y1; ++y) {
+                const float dy = y - cy;
+                for (int x = x0; x <= x1; ++x) {
+                    const float dx = x - cx;
+                    const float u =
+                        std::max(std::abs(dx * cos_a - dy * sin_a) - margin,
+                                 0.f);
+                    const float v =
+                        std::max(std::abs(dx * sin_a + dy * cos_a) - margin,
+                                 0.f);
+                    if (u < a_min && v < b_min && v * v < r2 * (a2 - u * u)) {
+                        shape_mask[y][x] = color;
                     }
                 }
             }
@@ -390,113 +398,190 @@ bool generate_area_mask(int ox, int oy, int width, int height,
     return true;
 }
 
-bool generate_drawn_mask(int ox, int oy, int width, int height,
-                         const DrawnMask &drawnMask,
-                         const array2D<float> &guide, bool multithread,
-                         array2D<float> &mask)
-{
-    if (drawnMask.isTrivial()) {
-        return false;
+// Rasterisation of the strokes of a drawn mask, before smoothing and
+// feathering. Each stroke adds its value to a disc of pixels, which is filled
+// one row span at a time; overlapping strokes of the same group (i.e. with
+// the same eraser mode and hardness) don't accumulate.
+class StrokeRaster {
+public:
+    StrokeRaster(int ox, int oy, int width, int height, int mask_w, int mask_h,
+                 bool add)
+        : ox_(ox), oy_(oy), width_(width), height_(height), mask_w_(mask_w),
+          mask_h_(mask_h), add_(add), radius_(-1), neg_(false),
+          hardness_(-1.0), val_(0.f), curflag_(1),
+          mask_(size_t(mask_w) * mask_h, 0.f),
+          flag_(size_t(mask_w) * mask_h, 0)
+    {
     }
 
-    const int mask_w = guide.width();
-    const int mask_h = guide.height();
+    bool same_geometry(const StrokeRaster &other) const
+    {
+        return ox_ == other.ox_ && oy_ == other.oy_ &&
+               width_ == other.width_ && height_ == other.height_ &&
+               mask_w_ == other.mask_w_ && mask_h_ == other.mask_h_ &&
+               add_ == other.add_;
+    }
 
-    const bool add = drawnMask.mode != DrawnMask::INTERSECT;
+    // true if the strokes drawn so far are the first ones of the given list
+    bool is_prefix_of(const std::vector<DrawnMask::Stroke> &strokes) const
+    {
+        return strokes_.size() <= strokes.size() &&
+               std::equal(strokes_.begin(), strokes_.end(), strokes.begin());
+    }
 
-    mask(mask_w, mask_h);
-    const float bgcolor = 0.f;
-    mask.fill(bgcolor);
-
-    struct StrokeEval {
-        StrokeEval(int ox, int oy, int width, int height, int mask_w,
-                   int mask_h)
-            : ox_(ox), oy_(oy), width_(width), height_(height), mask_w_(mask_w),
-              mask_h_(mask_h), radius_(-1), lx_(0), ly_(0), neg_(false)
-        {
-            curflag_ = 1;
-            flag_.resize(mask_w_ * mask_h_, 0);
-        }
+    void draw(const DrawnMask::Stroke &s)
+    {
+        strokes_.push_back(s);
 
-        void update(const DrawnMask::Stroke &s)
-        {
-            int r = std::min(width_, height_) * s.radius * 0.25;
+        const int r = std::min(width_, height_) * s.radius * 0.25;
+        if (r != radius_ || neg_ != s.erase || hardness_ != s.opacity) {
+            if (neg_ != s.erase || hardness_ != s.opacity || !s.radius) {
+                ++curflag_;
+            }
+
+            radius_ = r;
+            neg_ = s.erase;
+            hardness_ = s.opacity;
 
-            if (r != radius_ || neg_ != s.erase || hardness_ != s.opacity) {
-                if (neg_ != s.erase || hardness_ != s.opacity || !s.radius) {
-                    ++curflag_;
+            const float f = LIM01(hardness_);
+            val_ = (neg_ ? -1.f : 1.f) + (1.f - f) * (neg_ ? 0.99f : -0.99f);
+
+            // half width of the disc at each row
+            span_.resize(2 * radius_ + 1);
+            for (int dy = -radius_; dy <= radius_; ++dy) {
+                const int d2 = SQR(radius_) - SQR(dy);
+                int hw = std::sqrt(float(d2));
+                while (SQR(hw + 1) <= d2) {
+                    ++hw;
+                }
+                while (SQR(hw) > d2) {
+                    --hw;
                 }
+                span_[dy + radius_] = hw;
+            }
+        }
 
-                radius_ = r;
-                neg_ = s.erase;
-                hardness_ = s.opacity;
-
-                int w = 2 * radius_ + 1;
-                int h = 2 * radius_ + 1;
-                const float f = LIM01(hardness_);
-                const float val =
-                    (neg_ ? -1.f : 1.f) + (1.f - f) * (neg_ ? 0.99f : -0.99f);
-
-                buf_(w, h);
-                for (int y = 0; y < h; ++y) {
-                    for (int x = 0; x < w; ++x) {
-                        float d =
-                            std::sqrt(SQR(x - radius_) + SQR(y - radius_));
-                        if (d <= radius_) {
-                            buf_[y][x] = val;
-                        } else {
-                            buf_[y][x] = RT_NAN;
-                        }
-                    }
+        const int cx = width_ * s.x - ox_;
+        const int cy = height_ * s.y - oy_;
+        const int ly = std::max(cy - radius_, 0);
+        const int uy = std::min(cy + radius_, mask_h_ - 1);
+        for (int y = ly; y <= uy; ++y) {
+            const int hw = span_[y - cy + radius_];
+            const int lx = std::max(cx - hw, 0);
+            const int ux = std::min(cx + hw, mask_w_ - 1);
+            float *m = &mask_[size_t(y) * mask_w_];
+            uint16_t *fl = &flag_[size_t(y) * mask_w_];
+            for (int x = lx; x <= ux; ++x) {
+                if (fl[x] == curflag_) {
+                    continue;
+                }
+                fl[x] = curflag_;
+                if (!add_) {
+                    m[x] = LIM01(m[x] + val_);
+                } else if (signf(m[x]) == signf(val_)) {
+                    m[x] = LIM(m[x] + val_, -1.f, 1.f);
+                } else {
+                    m[x] = LIM(LIM01(m[x]) + val_, -1.f, 1.f);
                 }
             }
+        }
+    }
 
-            int cx = width_ * s.x - ox_;
-            int cy = height_ * s.y - oy_;
-            lx_ = cx - radius_;
-            ly_ = cy - radius_;
-            lx = std::max(cx - radius_, 0);
-            ly = std::max(cy - radius_, 0);
-            ux = std::min(cx + radius_, mask_w_ - 1);
-            uy = std::min(cy + radius_, mask_h_ - 1);
+    float get(int x, int y) const { return mask_[size_t(y) * mask_w_ + x]; }
+    bool is_bg(int x, int y) const
+    {
+        return flag_[size_t(y) * mask_w_ + x] == 0;
+    }
+    size_t num_pixels() const { return mask_.size(); }
+    size_t num_drawn() const { return strokes_.size(); }
+
+private:
+    int ox_;
+    int oy_;
+    int width_;
+    int height_;
+    int mask_w_;
+    int mask_h_;
+    bool add_;
+
+    int radius_;
+    bool neg_;
+    double hardness_;
+    float val_;
+    std::vector<int> span_;
+    uint16_t curflag_;
+
+    std::vector<DrawnMask::Stroke> strokes_;
+    std::vector<float> mask_;
+    std::vector<uint16_t> flag_;
+};
+
+// The last stroke rasterisations, one per pipeline geometry. While painting,
+// each run of the pipeline sees the strokes of the previous one plus the new
+// ones, so only the latter need to be drawn.
+class StrokeRasterCache {
+public:
+    static StrokeRasterCache &get_instance()
+    {
+        static StrokeRasterCache instance;
+        return instance;
+    }
+
+    // returns a copy of the cached raster for the geometry of r if its
+    // strokes are the first ones of the given list, r otherwise
+    StrokeRaster get(const StrokeRaster &r,
+                     const std::vector<DrawnMask::Stroke> &strokes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &e : entries_) {
+            if (e.same_geometry(r) && e.is_prefix_of(strokes)) {
+                return e;
+            }
         }
+        return r;
+    }
 
-        bool operator()(int x, int y, float &val)
-        {
-            val = buf_[y - ly_][x - lx_];
-            size_t idx = y * mask_w_ + x;
-            if (!xisnanf(val) && flag_[idx] != curflag_) {
-                flag_[idx] = curflag_;
-                return true;
+    void set(const StrokeRaster &r)
+    {
+        if (r.num_pixels() > MAX_PIXELS) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->same_geometry(r)) {
+                entries_.erase(it);
+                break;
             }
-            return false;
         }
+        entries_.push_front(r);
+        if (entries_.size() > MAX_ENTRIES) {
+            entries_.pop_back();
+        }
+    }
 
-        bool is_bg(int x, int y) const { return flag_[y * mask_w_ + x] == 0; }
-
-        int lx;
-        int ly;
-        int ux;
-        int uy;
-
-    private:
-        int ox_;
-        int oy_;
-        int width_;
-        int height_;
-        int mask_w_;
-        int mask_h_;
-        int radius_;
-        int lx_;
-        int ly_;
-        bool neg_;
-        double hardness_;
-
-        array2D<float> buf_;
-        std::vector<uint16_t> flag_;
-        std::vector<size_t> flagmods_;
-        uint16_t curflag_;
-    };
+private:
+    static constexpr size_t MAX_ENTRIES = 4;
+    static constexpr size_t MAX_PIXELS = 4 * 1024 * 1024;
+
+    StrokeRasterCache() = default;
+
+    std::mutex mutex_;
+    std::list<StrokeRaster> entries_;
+};
+
+bool generate_drawn_mask(int ox, int oy, int width, int height,
+                         const DrawnMask &drawnMask,
+                         const array2D<float> &guide, bool multithread,
+                         array2D<float> &mask)
+{
+    if (drawnMask.isTrivial()) {
+        return false;
+    }
+
+    const int mask_w = guide.width();
+    const int mask_h = guide.height();
+
+    const bool add = drawnMask.mode != DrawnMask::INTERSECT;
 
     const auto DUMP = [&](const char *name) -> void {
 #if 0
@@ -513,28 +598,28 @@ bool generate_drawn_mask(int ox, int oy, int width, int height,
     };
 
     double maxradius = 0.0;
-    StrokeEval se(ox, oy, width, height, mask_w, mask_h);
-
-    for (size_t i = 0; i < drawnMask.strokes.size(); ++i) {
-        const auto &s = drawnMask.strokes[i];
-        se.update(s);
+    for (const auto &s : drawnMask.strokes) {
         maxradius = std::max(maxradius, s.radius);
-        for (int y = se.ly; y <= se.uy; ++y) {
-            for (int x = se.lx; x <= se.ux; ++x) {
-                float v = 0.f;
-                if (se(x, y, v)) {
-                    // mask[y][x] = LIM(mask[y][x] + v, -1.f, 1.f);
-                    if (add) {
-                        if (signf(mask[y][x]) == signf(v)) {
-                            mask[y][x] = LIM(mask[y][x] + v, -1.f, 1.f);
-                        } else {
-                            mask[y][x] = LIM(LIM01(mask[y][x]) + v, -1.f, 1.f);
-                        }
-                    } else {
-                        mask[y][x] = LIM01(mask[y][x] + v);
-                    }
-                }
-            }
+    }
+
+    StrokeRaster se = StrokeRasterCache::get_instance().get(
+        StrokeRaster(ox, oy, width, height, mask_w, mask_h, add),
+        drawnMask.strokes);
+    const bool changed = se.num_drawn() < drawnMask.strokes.size();
+    for (size_t i = se.num_drawn(); i < drawnMask.strokes.size(); ++i) {
+        se.draw(drawnMask.strokes[i]);
+    }
+    if (changed) {
+        StrokeRasterCache::get_instance().set(se);
+    }
+
+    mask(mask_w, mask_h);
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < mask_h; ++y) {
+        for (int x = 0; x < mask_w; ++x) {
+            mask[y][x] = se.get(x, y);
         }
     }
     DUMP("/tmp/after-strokes.tif");
@@ -584,12 +669,13 @@ bool generate_drawn_mask(int ox, int oy, int width, int height,
     DUMP("/tmp/after-feather.tif");
 
     if (!ccurve.isIdentity()) {
+        const CurveLUT clut(ccurve, multithread);
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
         for (int y = 0; y < mask_h; ++y) {
             for (int x = 0; x < mask_w; ++x) {
-                mask[y][x] = ccurve.getVal(mask[y][x]);
+                mask[y][x] = clut(mask[y][x]);
             }
         }
     }
@@ -649,61 +735,289 @@ void rgb2lab(Imagefloat::Mode mode, float R, float G, float B, float &L,
     }
 }
 
+// row version of the above
+void rgb2lab(Imagefloat::Mode mode, const float *R, const float *G,
+             const float *B, float *L, float *a, float *b, const float ws[3][3],
+             int W)
+{
+    switch (mode) {
+    case Imagefloat::Mode::RGB:
+        Color::rgb2lab(R, G, B, L, a, b, ws, W);
+        return;
+    case Imagefloat::Mode::YUV:
+        for (int x = 0; x < W; ++x) {
+            Color::yuv2rgb(G[x], B[x], R[x], L[x], a[x], b[x], ws);
+        }
+        Color::rgb2lab(L, a, b, L, a, b, ws, W);
+        return;
+    case Imagefloat::Mode::XYZ:
+        Color::XYZ2Lab(R, G, B, L, a, b, W);
+        return;
+    case Imagefloat::Mode::LAB:
+        std::copy(G, G + W, L);
+        std::copy(R, R + W, a);
+        std::copy(B, B + W, b);
+        return;
+    default:
+        assert(false);
+        std::fill(L, L + W, 0.f);
+        std::fill(a, a + W, 0.f);
+        std::fill(b, b + W, 0.f);
+        return;
+    }
+}
+
+// CIEDE2000 distance from the reference colours of the deltaE masks,
+// in single precision (the formulas are those of cmsCIE2000DeltaE()), with
+// the terms depending only on the reference computed once
 class DeltaEEvaluator {
 public:
     DeltaEEvaluator(const std::vector<Mask> &masks)
     {
-        masks_.reserve(masks.size());
+        refs_.reserve(masks.size());
         for (auto &m : masks) {
-            masks_.push_back(m.deltaEMask);
-            refs_.push_back(cmsCIELab());
-            auto &de = masks_.back();
-            auto &v = refs_.back();
-            double h = de.H * 2.f * RT_PI / 360.f;
-            v.L = de.L * 100.f;
-            v.a = de.C * std::cos(h) * 100.f;
-            v.b = de.C * std::sin(h) * 100.f;
+            const auto &de = m.deltaEMask;
+            refs_.push_back(Ref());
+            auto &r = refs_.back();
+            r.enabled = de.enabled && (de.weight_L + de.weight_C +
+                                       de.weight_H != 0);
+            const double h = de.H * 2.f * RT_PI / 360.f;
+            r.L = de.L * 100.f;
+            r.a = de.C * std::cos(h) * 100.f;
+            r.b = de.C * std::sin(h) * 100.f;
+            r.C = std::sqrt(SQR(r.a) + SQR(r.b));
+            const auto K = [](int w) -> float { return w ? 100.f / w : 1000.f; };
+            r.kl = K(de.weight_L);
+            r.kc = K(de.weight_C);
+            r.kh = K(de.weight_H);
+            r.range = de.range;
+            r.decay = 1.f + LIM01(std::abs(de.decay) / 100.f);
+            r.strength = de.strength < 100 ? de.strength / 100.f : 1.f;
+            r.invert = de.decay < 0.f;
         }
     }
 
-    float operator()(size_t idx, float L, float a, float b)
+    // writes the mask values of the W pixels at L, a, b to out
+    void operator()(size_t idx, const float *L, const float *a,
+                    const float *b, float *out, int W) const
     {
-        auto &m = masks_[idx];
-        if (!m.enabled || m.weight_L + m.weight_C + m.weight_H == 0) {
-            return 1.f;
-        }
-        cmsCIELab c = {L * 100.f, a * 100.f, b * 100.f};
         auto &r = refs_[idx];
-        const auto W = [](int w) -> double { return w ? 100.0 / w : 1000.0; };
-        auto d = cmsCIE2000DeltaE(&r, &c, W(m.weight_L), W(m.weight_C),
-                                  W(m.weight_H));
-        float decay = std::abs(m.decay);
-        bool invert = m.decay < 0.f;
-        float ret = getval(m.range, 1.0 + LIM01(decay / 100.0), d);
-        if (m.strength < 100) {
-            ret *= float(m.strength) / 100.f;
+        if (!r.enabled) {
+            std::fill(out, out + W, 1.f);
+            return;
+        }
+        int x = 0;
+#ifdef __SSE2__
+        const vfloat c100v = F2V(100.f);
+        for (; x < W - 3; x += 4) {
+            const vfloat d = distance(r, LVFU(L[x]) * c100v,
+                                      LVFU(a[x]) * c100v, LVFU(b[x]) * c100v);
+            STVFU(out[x], getval(r, d));
+        }
+#endif
+        for (; x < W; ++x) {
+            out[x] = getval(r, distance(r, L[x] * 100.f, a[x] * 100.f,
+                                        b[x] * 100.f));
         }
-        if (invert) {
-            ret = 1.f - ret;
+        if (r.strength != 1.f || r.invert) {
+            for (x = 0; x < W; ++x) {
+                out[x] = finish(r, out[x]);
+            }
         }
-        return ret;
     }
 
 private:
-    float getval(float range, float decay, float d)
+    struct Ref {
+        bool enabled;
+        float L;
+        float a;
+        float b;
+        float C;
+        float kl;
+        float kc;
+        float kh;
+        float range;
+        float decay;
+        float strength;
+        bool invert;
+    };
+
+    static constexpr float pow25_7 = 6103515625.f; // 25^7
+    static constexpr float deg = 180.f / RT_PI_F;
+    static constexpr float rad = RT_PI_F / 180.f;
+
+    static float pow7(float x)
+    {
+        const float x2 = x * x;
+        return x2 * x2 * x2 * x;
+    }
+
+    static float hue(float b, float a)
     {
-        if (d <= range * 0.4f) {
+        if (a == 0.f && b == 0.f) {
+            return 0.f;
+        }
+        float h = xatan2f(b, a) * deg;
+        return h < 0.f ? h + 360.f : h;
+    }
+
+    static float distance(const Ref &r, float L, float a, float b)
+    {
+        const float C = std::sqrt(SQR(a) + SQR(b));
+        const float mC7 = pow7((r.C + C) * 0.5f);
+        const float G = 0.5f * (1.f - std::sqrt(mC7 / (mC7 + pow25_7)));
+
+        const float a_p = (1.f + G) * r.a;
+        const float C_p = std::sqrt(SQR(a_p) + SQR(r.b));
+        const float h_p = hue(r.b, a_p);
+        const float a_ps = (1.f + G) * a;
+        const float C_ps = std::sqrt(SQR(a_ps) + SQR(b));
+        const float h_ps = hue(b, a_ps);
+
+        const float meanC_p = (C_p + C_ps) * 0.5f;
+        const float hsum = h_ps + h_p;
+        const float hdiff = h_ps - h_p;
+        const float meanh_p = std::abs(hdiff) <= 180.000001f
+                                  ? hsum * 0.5f
+                                  : (hsum < 360.f ? (hsum + 360.f) * 0.5f
+                                                  : (hsum - 360.f) * 0.5f);
+        const float delta_h = hdiff <= -180.000001f
+                                  ? hdiff + 360.f
+                                  : (hdiff > 180.f ? hdiff - 360.f : hdiff);
+        const float delta_L = L - r.L;
+        const float delta_C = C_ps - C_p;
+        const float delta_H =
+            2.f * std::sqrt(C_ps * C_p) * xsinf(delta_h * rad * 0.5f);
+
+        const float T = 1.f - 0.17f * xcosf((meanh_p - 30.f) * rad) +
+                        0.24f * xcosf(2.f * meanh_p * rad) +
+                        0.32f * xcosf((3.f * meanh_p + 6.f) * rad) -
+                        0.2f * xcosf((4.f * meanh_p - 63.f) * rad);
+        const float mL = SQR((L + r.L) * 0.5f - 50.f);
+        const float Sl = 1.f + 0.015f * mL / std::sqrt(20.f + mL);
+        const float Sc = 1.f + 0.045f * meanC_p;
+        const float Sh = 1.f + 0.015f * meanC_p * T;
+
+        const float delta_ro =
+            30.f * xexpf(-SQR((meanh_p - 275.f) / 25.f));
+        const float mCp7 = pow7(meanC_p);
+        const float Rc = 2.f * std::sqrt(mCp7 / (mCp7 + pow25_7));
+        const float Rt = -xsinf(2.f * delta_ro * rad) * Rc;
+
+        const float dl = delta_L / (Sl * r.kl);
+        const float dc = delta_C / (Sc * r.kc);
+        const float dh = delta_H / (Sh * r.kh);
+        return std::sqrt(std::max(SQR(dl) + SQR(dc) + SQR(dh) + Rt * dc * dh,
+                                  0.f));
+    }
+
+    static float getval(const Ref &r, float d)
+    {
+        if (d <= r.range * 0.4f) {
             return 1.f;
-        } else if (d >= range * 5.f) {
+        } else if (d >= r.range * 5.f) {
             return 0.f;
         } else {
             // Generalised logistic function (see Wikipedia)
-            return 1.f - 1.f / (1 + 100.f * xexpf(-decay * (d - range)));
+            return 1.f - 1.f / (1 + 100.f * xexpf(-r.decay * (d - r.range)));
         }
     }
 
-    std::vector<DeltaEMask> masks_;
-    std::vector<cmsCIELab> refs_;
+    static float finish(const Ref &r, float v)
+    {
+        v *= r.strength;
+        return r.invert ? 1.f - v : v;
+    }
+
+#ifdef __SSE2__
+    static vfloat pow7(vfloat x)
+    {
+        const vfloat x2 = x * x;
+        return x2 * x2 * x2 * x;
+    }
+
+    static vfloat hue(vfloat b, vfloat a)
+    {
+        const vfloat zerov = F2V(0.f);
+        const vfloat h = xatan2f(b, a) * F2V(deg);
+        const vfloat ret = vself(vmaskf_lt(h, zerov), h + F2V(360.f), h);
+        return vself(vandm(vmaskf_eq(a, zerov), vmaskf_eq(b, zerov)), zerov,
+                     ret);
+    }
+
+    static vfloat distance(const Ref &r, vfloat L, vfloat a, vfloat b)
+    {
+        const vfloat zerov = F2V(0.f);
+        const vfloat onev = F2V(1.f);
+        const vfloat halfv = F2V(0.5f);
+        const vfloat c360v = F2V(360.f);
+        const vfloat radv = F2V(rad);
+        const vfloat pow25_7v = F2V(pow25_7);
+        const vfloat rLv = F2V(r.L);
+        const vfloat rbv = F2V(r.b);
+
+        const vfloat C = vsqrtf(SQRV(a) + SQRV(b));
+        const vfloat mC7 = pow7((F2V(r.C) + C) * halfv);
+        const vfloat G = halfv * (onev - vsqrtf(mC7 / (mC7 + pow25_7v)));
+
+        const vfloat a_p = (onev + G) * F2V(r.a);
+        const vfloat C_p = vsqrtf(SQRV(a_p) + SQRV(rbv));
+        const vfloat h_p = hue(rbv, a_p);
+        const vfloat a_ps = (onev + G) * a;
+        const vfloat C_ps = vsqrtf(SQRV(a_ps) + SQRV(b));
+        const vfloat h_ps = hue(b, a_ps);
+
+        const vfloat meanC_p = (C_p + C_ps) * halfv;
+        const vfloat hsum = h_ps + h_p;
+        const vfloat hdiff = h_ps - h_p;
+        const vfloat meanh_p =
+            halfv *
+            vself(vmaskf_le(vabsf(hdiff), F2V(180.000001f)), hsum,
+                  vself(vmaskf_lt(hsum, c360v), hsum + c360v, hsum - c360v));
+        const vfloat delta_h =
+            vself(vmaskf_le(hdiff, F2V(-180.000001f)), hdiff + c360v,
+                  vself(vmaskf_gt(hdiff, F2V(180.f)), hdiff - c360v, hdiff));
+        const vfloat delta_L = L - rLv;
+        const vfloat delta_C = C_ps - C_p;
+        const vfloat delta_H =
+            F2V(2.f) * vsqrtf(C_ps * C_p) * xsinf(delta_h * radv * halfv);
+
+        const vfloat T =
+            onev - F2V(0.17f) * xcosf((meanh_p - F2V(30.f)) * radv) +
+            F2V(0.24f) * xcosf(F2V(2.f) * meanh_p * radv) +
+            F2V(0.32f) * xcosf((F2V(3.f) * meanh_p + F2V(6.f)) * radv) -
+            F2V(0.2f) * xcosf((F2V(4.f) * meanh_p - F2V(63.f)) * radv);
+        const vfloat mL = SQRV((L + rLv) * halfv - F2V(50.f));
+        const vfloat Sl = onev + F2V(0.015f) * mL / vsqrtf(F2V(20.f) + mL);
+        const vfloat Sc = onev + F2V(0.045f) * meanC_p;
+        const vfloat Sh = onev + F2V(0.015f) * meanC_p * T;
+
+        const vfloat delta_ro =
+            F2V(30.f) * xexpf(-SQRV((meanh_p - F2V(275.f)) / F2V(25.f)));
+        const vfloat mCp7 = pow7(meanC_p);
+        const vfloat Rc = F2V(2.f) * vsqrtf(mCp7 / (mCp7 + pow25_7v));
+        const vfloat Rt = -xsinf(F2V(2.f) * delta_ro * radv) * Rc;
+
+        const vfloat dl = delta_L / (Sl * F2V(r.kl));
+        const vfloat dc = delta_C / (Sc * F2V(r.kc));
+        const vfloat dh = delta_H / (Sh * F2V(r.kh));
+        return vsqrtf(
+            vmaxf(SQRV(dl) + SQRV(dc) + SQRV(dh) + Rt * dc * dh, zerov));
+    }
+
+    static vfloat getval(const Ref &r, vfloat d)
+    {
+        const vfloat onev = F2V(1.f);
+        const vfloat rangev = F2V(r.range);
+        const vfloat ret =
+            onev - onev / (onev + F2V(100.f) *
+                                      xexpf(F2V(-r.decay) * (d - rangev)));
+        return vself(vmaskf_le(d, rangev * F2V(0.4f)), onev,
+                     vself(vmaskf_ge(d, rangev * F2V(5.f)), F2V(0.f), ret));
+    }
+#endif // __SSE2__
+
+    std::vector<Ref> refs_;
 };
 
 bool contrast_threshold_mask(int width, int height, float scale,
@@ -777,12 +1091,13 @@ bool mask_postprocess(int width, int height, float scale,
     }
 
     if (!ccurve.isIdentity()) {
+        const CurveLUT clut(ccurve, multithread);
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
         for (int y = 0; y < H; ++y) {
             for (int x = 0; x < W; ++x) {
-                mask[y][x] = ccurve.getVal(mask[y][x]);
+                mask[y][x] = clut(mask[y][x]);
             }
         }
     }
@@ -792,7 +1107,7 @@ bool mask_postprocess(int width, int height, float scale,
             10.f * (101.f - float(LIM(smoothing, 0, 100)));
         const float radius = (max(width, height) / radius_coeff);
         const float epsilon = 0.015f;
-        array2D<float> threshold(W, H);
+        ScratchPlane threshold(W, H);
         constexpr float l = 0.0;
         constexpr float h = 0.25;
         float f = LIM01(float(smoothing) / 100.f);
@@ -824,6 +1139,188 @@ bool mask_postprocess(int width, int height, float scale,
     return true;
 }
 
+// identifies the content of the input of generateMasks()
+uint64_t image_fingerprint(Imagefloat *rgb, bool multithread)
+{
+    const int W = rgb->getWidth();
+    const int H = rgb->getHeight();
+    std::vector<uint64_t> rows(H);
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        uint64_t h = 14695981039346656037ULL;
+        const float *channels[3] = {rgb->r(y), rgb->g(y), rgb->b(y)};
+        for (auto row : channels) {
+            for (int x = 0; x < W; ++x) {
+                uint32_t v;
+                memcpy(&v, row + x, sizeof(v));
+                h = (h ^ v) * 1099511628211ULL;
+            }
+        }
+        rows[y] = h;
+    }
+
+    uint64_t res = uint64_t(W) << 32 | uint64_t(H);
+    for (auto h : rows) {
+        res = (res ^ h) * 1099511628211ULL;
+    }
+    return res;
+}
+
+// Masks computed by generateMasks(), so that they are not generated again
+// when only the adjustments of a tool change. An entry is identified by the
+// parameters of the mask, the content of the input image and the geometry of
+// the pipeline. The total memory used is bounded, the least recently used
+// entries are dropped first.
+class MaskCache {
+public:
+    struct Key {
+        Glib::ustring toolname;
+        Mask mask;
+        uint64_t input;
+        Imagefloat::Mode mode;
+        Glib::ustring color_space;
+        int offset_x;
+        int offset_y;
+        int full_width;
+        int full_height;
+        double scale;
+        int processing_scale;
+
+        bool operator==(const Key &k) const
+        {
+            return input == k.input && mode == k.mode &&
+                   offset_x == k.offset_x &&
+                   offset_y == k.offset_y && full_width == k.full_width &&
+                   full_height == k.full_height && scale == k.scale &&
+                   processing_scale == k.processing_scale &&
+                   toolname == k.toolname && color_space == k.color_space &&
+                   mask == k.mask;
+        }
+    };
+
+    static MaskCache &get_instance()
+    {
+        static MaskCache instance;
+        return instance;
+    }
+
+    // the masks to retrieve/store are the non-null ones among Lmask and
+    // abmask; they must have the same size
+    bool get(const Key &key, array2D<float> *Lmask, array2D<float> *abmask,
+             bool multithread)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->key == key && it->has_L == bool(Lmask) &&
+                it->has_ab == bool(abmask) &&
+                it->width == (Lmask ? Lmask : abmask)->width() &&
+                it->height == (Lmask ? Lmask : abmask)->height()) {
+                entries_.splice(entries_.begin(), entries_, it);
+                const Entry &e = entries_.front();
+                if (Lmask) {
+                    copy(e.L.data(), e.width, e.height, *Lmask, multithread);
+                }
+                if (abmask) {
+                    copy(e.ab.data(), e.width, e.height, *abmask,
+                         multithread);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void set(const Key &key, const array2D<float> *Lmask,
+             const array2D<float> *abmask, bool multithread)
+    {
+        const array2D<float> *m = Lmask ? Lmask : abmask;
+        const int W = m->width();
+        const int H = m->height();
+        const size_t bytes = size_t(W) * H * sizeof(float) *
+                             (int(bool(Lmask)) + int(bool(abmask)));
+        if (bytes > MAX_BYTES / 4) {
+            return;
+        }
+
+        Entry e;
+        e.key = key;
+        e.width = W;
+        e.height = H;
+        e.has_L = Lmask != nullptr;
+        e.has_ab = abmask != nullptr;
+        if (Lmask) {
+            copy(*Lmask, e.L, multithread);
+        }
+        if (abmask) {
+            copy(*abmask, e.ab, multithread);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->key == key) {
+                bytes_ -= it->bytes();
+                entries_.erase(it);
+                break;
+            }
+        }
+        entries_.push_front(std::move(e));
+        bytes_ += bytes;
+        while (bytes_ > MAX_BYTES) {
+            bytes_ -= entries_.back().bytes();
+            entries_.pop_back();
+        }
+    }
+
+private:
+    static constexpr size_t MAX_BYTES = size_t(128) * 1024 * 1024;
+
+    struct Entry {
+        Key key;
+        int width;
+        int height;
+        bool has_L;
+        bool has_ab;
+        std::vector<float> L;
+        std::vector<float> ab;
+
+        size_t bytes() const { return (L.size() + ab.size()) * sizeof(float); }
+    };
+
+    static void copy(const float *src, int W, int H, array2D<float> &dst,
+                     bool multithread)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+        for (int y = 0; y < H; ++y) {
+            memcpy(dst[y], src + size_t(y) * W, W * sizeof(float));
+        }
+    }
+
+    static void copy(const array2D<float> &src, std::vector<float> &dst,
+                     bool multithread)
+    {
+        const int W = src.width();
+        const int H = src.height();
+        dst.resize(size_t(W) * H);
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+        for (int y = 0; y < H; ++y) {
+            memcpy(&dst[size_t(y) * W], src[y], W * sizeof(float));
+        }
+    }
+
+    MaskCache(): bytes_(0) {}
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    size_t bytes_;
+};
+
 } // namespace
 
 //-----------------------------------------------------------------------------
@@ -948,7 +1445,7 @@ bool LinkedMaskManager::is_needed(const Glib::ustring &toolname,
 
 std::unique_ptr<ExternalMaskManager> ExternalMaskManager::instance_;
 
-ExternalMaskManager::ExternalMaskManager(): cache_(4) {}
+ExternalMaskManager::ExternalMaskManager(): bytes_(0) {}
 
 ExternalMaskManager *ExternalMaskManager::getInstance()
 {
@@ -959,6 +1456,140 @@ void ExternalMaskManager::init() { instance_.reset(new ExternalMaskManager()); }
 
 void ExternalMaskManager::cleanup() { instance_.reset(nullptr); }
 
+float ExternalMaskManager::Plane::get_bilinear(float x, float y) const
+{
+    constexpr float scale = 1.f / 65535.f;
+    x = std::max(x, 0.f);
+    y = std::max(y, 0.f);
+    const int xi = std::min(int(x), width - 1);
+    const int yi = std::min(int(y), height - 1);
+    const float xf = x - xi;
+    const float yf = y - yi;
+    const int xi1 = std::min(xi + 1, width - 1);
+    const int yi1 = std::min(yi + 1, height - 1);
+
+    const uint16_t *r0 = data.data + size_t(yi) * width;
+    const uint16_t *r1 = data.data + size_t(yi1) * width;
+    const float b = xf * r0[xi1] + (1.f - xf) * r0[xi];
+    const float t = xf * r1[xi1] + (1.f - xf) * r1[xi];
+    return (yf * t + (1.f - yf) * b) * scale;
+}
+
+std::shared_ptr<ExternalMaskManager::Plane>
+ExternalMaskManager::get_plane(const std::string &key, int factor)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = planes_.begin(); it != planes_.end(); ++it) {
+        if ((!factor || (*it)->factor == factor) && (*it)->key == key) {
+            planes_.splice(planes_.begin(), planes_, it);
+            return planes_.front();
+        }
+    }
+    return nullptr;
+}
+
+void ExternalMaskManager::store_plane(const std::shared_ptr<Plane> &plane)
+{
+    const size_t limit =
+        size_t(std::max(settings->external_mask_cache_memory_limit, 0)) *
+        1024 * 1024;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = planes_.begin(); it != planes_.end(); ++it) {
+        if ((*it)->factor == plane->factor && (*it)->key == plane->key) {
+            bytes_ -= (*it)->bytes();
+            planes_.erase(it);
+            break;
+        }
+    }
+    planes_.push_front(plane);
+    bytes_ += plane->bytes();
+    // the planes being used by a pipeline stay alive until it is done
+    // with them, even if they are dropped here
+    while (bytes_ > limit && !planes_.empty()) {
+        bytes_ -= planes_.back()->bytes();
+        planes_.pop_back();
+    }
+}
+
+std::shared_ptr<ExternalMaskManager::Plane>
+ExternalMaskManager::load_plane(const std::string &key,
+                                const Glib::ustring &filename,
+                                bool multithread)
+{
+    StdImageSource src;
+    if (src.load(filename) != 0) {
+        return nullptr;
+    }
+    ImageIO *imio = src.getImageIO();
+    const int W = imio->getWidth();
+    const int H = imio->getHeight();
+    Imagefloat img(W, H);
+    PreviewProps pp(0, 0, W, H, 1);
+    imio->getStdImage(ColorTemp(), TR_NONE, &img, pp);
+
+    std::shared_ptr<Plane> ret = std::make_shared<Plane>();
+    ret->key = key;
+    ret->factor = 1;
+    ret->width = ret->src_width = W;
+    ret->height = ret->src_height = H;
+    if (!ret->data.resize(size_t(W) * H)) {
+        return nullptr;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        uint16_t *row = ret->data.data + size_t(y) * W;
+        for (int x = 0; x < W; ++x) {
+            row[x] = uint16_t(LIM01(img.g(y, x) / 65535.f) * 65535.f + 0.5f);
+        }
+    }
+
+    return ret;
+}
+
+std::shared_ptr<ExternalMaskManager::Plane>
+ExternalMaskManager::downsample(const Plane &src, int factor,
+                                bool multithread)
+{
+    // box filter, the value at (x, y) being the average of the
+    // factor x factor block starting at (x * factor, y * factor)
+    std::shared_ptr<Plane> ret = std::make_shared<Plane>();
+    ret->key = src.key;
+    ret->factor = factor;
+    ret->width = (src.width + factor - 1) / factor;
+    ret->height = (src.height + factor - 1) / factor;
+    ret->src_width = src.width;
+    ret->src_height = src.height;
+    if (!ret->data.resize(size_t(ret->width) * ret->height)) {
+        return nullptr;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < ret->height; ++y) {
+        uint16_t *row = ret->data.data + size_t(y) * ret->width;
+        const int y1 = std::min((y + 1) * factor, src.height);
+        for (int x = 0; x < ret->width; ++x) {
+            const int x1 = std::min((x + 1) * factor, src.width);
+            uint32_t sum = 0;
+            for (int yy = y * factor; yy < y1; ++yy) {
+                const uint16_t *s = src.data.data + size_t(yy) * src.width;
+                for (int xx = x * factor; xx < x1; ++xx) {
+                    sum += s[xx];
+                }
+            }
+            const uint32_t n = (y1 - y * factor) * (x1 - x * factor);
+            row[x] = uint16_t((sum + n / 2) / n);
+        }
+    }
+
+    return ret;
+}
+
 bool ExternalMaskManager::apply_mask(
     const Glib::ustring &filename, bool inverted, double feather, int offset_x,
     int offset_y, int full_width, int full_height, const array2D<float> &guide,
@@ -966,47 +1597,37 @@ bool ExternalMaskManager::apply_mask(
 {
     std::string key =
         Glib::filename_from_utf8(filename) + "\n" + getMD5(filename, true);
-    std::shared_ptr<array2D<float>> mask;
-    if (!cache_.get(key, mask)) {
-        StdImageSource src;
-        if (src.load(filename) != 0) {
-            if (plistener && !filename.empty()) {
-                plistener->error(Glib::ustring::compose(
-                    M("EXTERNAL_MASK_LOAD_FAILED_WARNING"), filename));
+    std::shared_ptr<Plane> full;
+    const auto get_full = [&]() -> bool {
+        full = get_plane(key, 1);
+        if (!full) {
+            full = load_plane(key, filename, multithread);
+            if (!full) {
+                if (plistener && !filename.empty()) {
+                    plistener->error(Glib::ustring::compose(
+                        M("EXTERNAL_MASK_LOAD_FAILED_WARNING"), filename));
+                }
+                return false;
             }
-            return false;
+            store_plane(full);
         }
-        ImageIO *imio = src.getImageIO();
-        const int W = imio->getWidth();
-        const int H = imio->getHeight();
-        Imagefloat img(W, H);
-        PreviewProps pp(0, 0, W, H, 1);
-        imio->getStdImage(ColorTemp(), TR_NONE, &img, pp);
-
-        mask = std::make_shared<array2D<float>>();
-        array2D<float> &a = *mask;
-        a(W, H);
+        return true;
+    };
 
-#ifdef _OPENMP
-#pragma omp parallel for if (multithread)
-#endif
-        for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                a[y][x] = LIM01(img.g(y, x) / 65535.f);
-            }
+    // the mask is decoded again only if none of its versions is cached
+    std::shared_ptr<Plane> plane = get_plane(key, 0);
+    if (!plane) {
+        if (!get_full()) {
+            return false;
         }
-
-        cache_.set(key, mask);
+        plane = full;
     }
 
-    const array2D<float> &a = *mask;
-
+    const int W = plane->src_width;
+    const int H = plane->src_height;
     const int dW = full_width;
     const int dH = full_height;
 
-    const int W = a.width();
-    const int H = a.height();
-
     if (plistener) {
         int mask_ratio = int(float(W) / float(H) * 100 + 0.5);
         int image_ratio =
@@ -1019,6 +1640,34 @@ bool ExternalMaskManager::apply_mask(
     const float col_scale = float(W) / float(dW);
     const float row_scale = float(H) / float(dH);
 
+    // when the pipeline runs at a reduced scale, sample a downsampled copy
+    // of the mask, which is smaller to keep and doesn't alias
+    int factor = 1;
+    while (factor * 2 <= std::min(col_scale, row_scale) &&
+           std::min(W, H) / (factor * 2) >= 16) {
+        factor *= 2;
+    }
+    if (plane->factor != factor) {
+        plane = get_plane(key, factor);
+    }
+    if (!plane) {
+        if (!full && !get_full()) {
+            return false;
+        }
+        plane = factor > 1 ? downsample(*full, factor, multithread) : full;
+        if (!plane) {
+            plane = full;
+            factor = 1;
+        } else if (plane != full) {
+            store_plane(plane);
+        }
+    }
+    full.reset();
+    const Plane &a = *plane;
+    // the pixels of the downsampled copy are centered on their block
+    const float offset = 0.5f * (factor - 1);
+    const float f = 1.f / factor;
+
     const int oW = guide.width();
     const int oH = guide.height();
     (*out)(oW, oH);
@@ -1027,10 +1676,10 @@ bool ExternalMaskManager::apply_mask(
 #pragma omp parallel for if (multithread)
 #endif
     for (int y = 0; y < oH; ++y) {
-        float sy = (y + offset_y) * row_scale;
+        float sy = ((y + offset_y) * row_scale - offset) * f;
         for (int x = 0; x < oW; ++x) {
-            float sx = (x + offset_x) * col_scale;
-            float val = getBilinearValue(a, sx, sy);
+            float sx = ((x + offset_x) * col_scale - offset) * f;
+            float val = a.get_bilinear(sx, sy);
             if (inverted) {
                 val = 1.f - val;
             }
@@ -1064,9 +1713,9 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
         !masks[show_mask_idx].enabled) {
         show_mask_idx = -1;
     }
-    std::vector<std::unique_ptr<FlatCurve>> hmask(n);
-    std::vector<std::unique_ptr<FlatCurve>> cmask(n);
-    std::vector<std::unique_ptr<FlatCurve>> lmask(n);
+    std::vector<CurveLUT> hmask(n);
+    std::vector<CurveLUT> cmask(n);
+    std::vector<CurveLUT> lmask(n);
     std::vector<float> ldetail(n);
     std::vector<bool> needed(n, true);
 
@@ -1092,20 +1741,22 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
         if (r.parametricMask.enabled && !r.parametricMask.hue.empty() &&
             r.parametricMask.hue[0] != FCT_Linear &&
             r.parametricMask.hue != dflt.parametricMask.hue) {
-            hmask[i].reset(new FlatCurve(r.parametricMask.hue, true));
+            hmask[i].set(FlatCurve(r.parametricMask.hue, true), multithread);
             has_mask = true;
         }
         if (r.parametricMask.enabled &&
             !r.parametricMask.chromaticity.empty() &&
             r.parametricMask.chromaticity[0] != FCT_Linear &&
             r.parametricMask.chromaticity != dflt.parametricMask.chromaticity) {
-            cmask[i].reset(new FlatCurve(r.parametricMask.chromaticity, false));
+            cmask[i].set(FlatCurve(r.parametricMask.chromaticity, false),
+                         multithread);
             has_mask = true;
         }
         if (r.parametricMask.enabled && !r.parametricMask.lightness.empty() &&
             r.parametricMask.lightness[0] != FCT_Linear &&
             r.parametricMask.lightness != dflt.parametricMask.lightness) {
-            lmask[i].reset(new FlatCurve(r.parametricMask.lightness, false));
+            lmask[i].set(FlatCurve(r.parametricMask.lightness, false),
+                         multithread);
             has_mask = true;
             ldetail[i] = LIM01(float(r.parametricMask.lightnessDetail) / 100.f);
         }
@@ -1117,7 +1768,6 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
     assert(!abmask || abmask->size() == size_t(n));
     assert(!Lmask || Lmask->size() == size_t(n));
 
-    bool has_lmask = false;
     for (int i = 0; i < end_idx; ++i) {
         if (!needed[i]) {
             continue;
@@ -1127,11 +1777,55 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
         }
         if (Lmask) {
             (*Lmask)[i](W, H, ARRAY2D_CLEAR_DATA);
-            has_lmask = true;
         }
     }
 
-    array2D<float> guide(W, H);
+    // reuse the masks generated by a previous run on the same input. Linked
+    // masks depend on the other tools, so they are always generated again
+    std::vector<bool> cacheable(n, false);
+    std::vector<bool> cached(n, false);
+    MaskCache::Key cache_key;
+    bool has_cacheable = false;
+    for (int i = 0; i < end_idx; ++i) {
+        if (needed[i] && !masks[i].linkedMask.enabled && (Lmask || abmask)) {
+            cacheable[i] = true;
+            has_cacheable = true;
+        }
+    }
+    if (has_cacheable) {
+        cache_key.toolname = toolname;
+        cache_key.input = image_fingerprint(rgb, multithread);
+        cache_key.mode = mode;
+        cache_key.color_space = rgb->colorSpace();
+        cache_key.offset_x = offset_x;
+        cache_key.offset_y = offset_y;
+        cache_key.full_width = full_width;
+        cache_key.full_height = full_height;
+        cache_key.scale = scale;
+        cache_key.processing_scale = settings->mask_processing_scale;
+        for (int i = 0; i < end_idx; ++i) {
+            if (cacheable[i]) {
+                cache_key.mask = masks[i];
+                if (MaskCache::get_instance().get(
+                        cache_key, Lmask ? &(*Lmask)[i] : nullptr,
+                        abmask ? &(*abmask)[i] : nullptr, multithread)) {
+                    cached[i] = true;
+                    needed[i] = false;
+                }
+            }
+        }
+    }
+
+    bool any_needed = false;
+    bool has_lmask = false;
+    for (int i = 0; i < end_idx; ++i) {
+        if (needed[i]) {
+            any_needed = true;
+            has_lmask = Lmask != nullptr;
+        }
+    }
+
+    ScratchPlane guide(W, H);
     TMatrix ws = ICCStore::getInstance()->workingSpaceMatrix(rgb->colorSpace());
     float wp[3][3];
     for (int i = 0; i < 3; ++i) {
@@ -1140,34 +1834,70 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
         }
     }
 
+    // optionally, the parametric and deltaE masks are evaluated on a
+    // downscaled copy of the input, and then brought back to full resolution
+    // by a guided upsampling (which also performs their blur)
+    const int proc_scale = settings->mask_processing_scale;
+    const bool reduced = has_mask && any_needed && proc_scale > 1 &&
+                         std::min(W, H) / proc_scale >= 256;
+    std::unique_ptr<Imagefloat> small;
+    std::unique_ptr<ScratchPlane> small_guide;
+    std::vector<array2D<float>> small_blend;
+    if (reduced) {
+        small.reset(new Imagefloat((W + proc_scale - 1) / proc_scale,
+                                   (H + proc_scale - 1) / proc_scale, rgb));
+        rescaleArea(rgb, small.get(), proc_scale, multithread);
+        small_guide.reset(
+            new ScratchPlane(small->getWidth(), small->getHeight()));
+        small_blend.resize(n);
+        for (int i = 0; i < end_idx; ++i) {
+            if (needed[i]) {
+                small_blend[i](small->getWidth(), small->getHeight());
+            }
+        }
+    }
+    Imagefloat *const src = reduced ? small.get() : rgb;
+    array2D<float> &sguide = reduced ? *small_guide : guide;
+    const int sW = src->getWidth();
+    const int sH = src->getHeight();
+    const double sscale = reduced ? scale * proc_scale : scale;
+
     array2D<float> LL;
     if (has_lmask) {
-        LL(W, H);
+        LL(sW, sH);
 
         constexpr float base_posterization = 40.f;
 #ifdef _OPENMP
-#pragma omp parallel for if (multithread)
+#pragma omp parallel if (multithread)
 #endif
-        for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                float a, b;
-                rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x),
-                        guide[y][x], a, b, wp);
-                guide[y][x] /= 32768.f;
-                float l = guide[y][x];
-                float ll = round(l * base_posterization) / base_posterization;
-                LL[y][x] = ll;
-                assert(std::isfinite(LL[y][x]));
-            }
-        }
-        const float radius =
-            max(max(full_width, W), max(full_height, H)) / 30.f;
+        {
+            std::vector<float> abuf(sW);
+            std::vector<float> bbuf(sW);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+            for (int y = 0; y < sH; ++y) {
+                rgb2lab(mode, src->r(y), src->g(y), src->b(y), sguide[y],
+                        &abuf[0], &bbuf[0], wp, sW);
+                for (int x = 0; x < sW; ++x) {
+                    sguide[y][x] /= 32768.f;
+                    float l = sguide[y][x];
+                    float ll =
+                        round(l * base_posterization) / base_posterization;
+                    LL[y][x] = ll;
+                    assert(std::isfinite(LL[y][x]));
+                }
+            }
+        }
+        const float radius = max(max(full_width, W), max(full_height, H)) /
+                             (30.f * (reduced ? proc_scale : 1));
         const float epsilon = 0.001f;
-        int r2 = 10.f / scale;
+        int r2 = 10.f / sscale;
         if (r2 > 0) {
-            rtengine::guidedFilter(guide, guide, guide, r2, 0.01f, multithread);
+            rtengine::guidedFilter(sguide, sguide, sguide, r2, 0.01f,
+                                   multithread);
         }
-        rtengine::guidedFilter(guide, LL, LL, radius, epsilon, multithread);
+        rtengine::guidedFilter(sguide, LL, LL, radius, epsilon, multithread);
 
 #if 0
         if (W > 300) {
@@ -1189,95 +1919,135 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
 
     DeltaEEvaluator dE(masks);
 
+    if (any_needed)
 #ifdef _OPENMP
 #pragma omp parallel if (multithread)
 #endif
     {
+        float cBuffer[sW];
+        float hBuffer[sW];
+        float lBuffer[sW];
+        float aBuffer[sW];
+        float bBuffer[sW];
+        float blend[sW];
+        float llBuffer[sW];
+
+        // blend *= curve(v)
+        const auto apply_curve = [&](const CurveLUT &curve, const float *v) {
+            int x = 0;
 #ifdef __SSE2__
-        float cBuffer[W];
-        float hBuffer[W];
-        float lBuffer[W];
-        float aBuffer[W];
-        float bBuffer[W];
+            for (; x < sW - 3; x += 4) {
+                STVFU(blend[x], LVFU(blend[x]) * curve(LVFU(v[x])));
+            }
 #endif
+            for (; x < sW; ++x) {
+                blend[x] *= curve(v[x]);
+            }
+        };
 #ifdef _OPENMP
 #pragma omp for schedule(dynamic, 16)
 #endif
-        for (int y = 0; y < H; ++y) {
+        for (int y = 0; y < sH; ++y) {
 #ifdef __SSE2__
-            for (int x = 0; x < W; ++x) {
-                rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x),
-                        lBuffer[x], aBuffer[x], bBuffer[x], wp);
+            rgb2lab(mode, src->r(y), src->g(y), src->b(y), lBuffer, aBuffer,
+                    bBuffer, wp, sW);
+            for (int x = 0; x < sW; ++x) {
                 lBuffer[x] /= 32768.f;
                 aBuffer[x] /= 42000.f;
                 bBuffer[x] /= 42000.f;
             }
             if (has_mask) {
                 // vectorized precalculation
-                Color::Lab2Lch(aBuffer, bBuffer, cBuffer, hBuffer, W);
-                for (int x = 0; x < W; ++x) {
-                    cBuffer[x] *= c_factor;
-                }
+                Color::Lab2Lch(aBuffer, bBuffer, cBuffer, hBuffer, sW);
             }
-#endif
-            for (int x = 0; x < W; ++x) {
-#ifdef __SSE2__
-                const float l = lBuffer[x]; // / 32768.f;
-                const float a = aBuffer[x]; // / 42000.f;
-                const float b = bBuffer[x]; // / 42000.f;
 #else
+            for (int x = 0; x < sW; ++x) {
                 float l, a, b;
-                rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x), l, a, b,
+                rgb2lab(mode, src->r(y, x), src->g(y, x), src->b(y, x), l, a, b,
                         wp);
-                l /= 32768.f;
-                a /= 42000.f;
-                b /= 42000.f;
-#endif
-                guide[y][x] = LIM01(l);
-                // if (has_lmask) {
-                //     l = intp(ldetail, LL[y][x], l);
-                // }
-
+                lBuffer[x] = l / 32768.f;
+                aBuffer[x] = a / 42000.f;
+                bBuffer[x] = b / 42000.f;
                 if (has_mask) {
-#ifdef __SSE2__
-                    // use precalculated values
-                    float c = cBuffer[x];
-                    float h = hBuffer[x];
-#else
-                    float c, h;
-                    Color::Lab2Lch(a, b, c, h);
-                    c *= c_factor;
+                    Color::Lab2Lch(aBuffer[x], bBuffer[x], cBuffer[x],
+                                   hBuffer[x]);
+                }
+            }
 #endif
-                    c = xlin2log(c, 50.f);
+            for (int x = 0; x < sW; ++x) {
+                sguide[y][x] = LIM01(lBuffer[x]);
+            }
 
-                    h = Color::huelab_to_huehsv2(h);
-                    h += 1.f / 6.f; // offset the hue because we start from
-                                    // purple instead of red
-                    if (h > 1.f) {
-                        h -= 1.f;
-                    }
-                    h = xlin2log(h, 3.f);
+            if (!has_mask) {
+                continue;
+            }
 
-                    for (int i = 0; i < end_idx; ++i) {
-                        if (!needed[i]) {
-                            continue;
-                        }
-                        auto &hm = hmask[i];
-                        auto &cm = cmask[i];
-                        auto &lm = lmask[i];
-                        float ll =
-                            has_lmask ? intp(ldetail[i], LL[y][x], l) : l;
-                        float blend = /*LIM01*/ (dE(i, l, a, b) *
-                                                 (hm ? hm->getVal(h) : 1.f) *
-                                                 (cm ? cm->getVal(c) : 1.f) *
-                                                 (lm ? lm->getVal(ll) : 1.f));
-                        if (Lmask) {
-                            (*Lmask)[i][y][x] = blend;
-                        }
-                        if (abmask) {
-                            (*abmask)[i][y][x] = blend;
-                        }
+            // the coordinates of the curves, shared by all the masks
+            for (int x = 0; x < sW; ++x) {
+                cBuffer[x] = xlin2log(cBuffer[x] * c_factor, 50.f);
+
+                float h = Color::huelab_to_huehsv2(hBuffer[x]);
+                h += 1.f / 6.f; // offset the hue because we start from
+                                // purple instead of red
+                if (h > 1.f) {
+                    h -= 1.f;
+                }
+                hBuffer[x] = xlin2log(h, 3.f);
+            }
+
+            // one mask at a time, so that the inner loops are simple enough
+            // to be vectorised
+            for (int i = 0; i < end_idx; ++i) {
+                if (!needed[i]) {
+                    continue;
+                }
+                dE(i, lBuffer, aBuffer, bBuffer, blend, sW);
+
+                if (hmask[i]) {
+                    apply_curve(hmask[i], hBuffer);
+                }
+                if (cmask[i]) {
+                    apply_curve(cmask[i], cBuffer);
+                }
+                if (lmask[i] && has_lmask) {
+                    for (int x = 0; x < sW; ++x) {
+                        llBuffer[x] = intp(ldetail[i], LL[y][x], lBuffer[x]);
                     }
+                    apply_curve(lmask[i], llBuffer);
+                } else if (lmask[i]) {
+                    apply_curve(lmask[i], lBuffer);
+                }
+
+                if (reduced) {
+                    std::copy(blend, blend + sW, small_blend[i][y]);
+                    continue;
+                }
+                if (Lmask) {
+                    std::copy(blend, blend + sW, (*Lmask)[i][y]);
+                }
+                if (abmask) {
+                    std::copy(blend, blend + sW, (*abmask)[i][y]);
+                }
+            }
+        }
+    }
+
+    if (reduced) {
+        // the full resolution guide, for the upsampling and the other masks
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+        {
+            std::vector<float> abuf(W);
+            std::vector<float> bbuf(W);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+            for (int y = 0; y < H; ++y) {
+                rgb2lab(mode, rgb->r(y), rgb->g(y), rgb->b(y), guide[y],
+                        &abuf[0], &bbuf[0], wp, W);
+                for (int x = 0; x < W; ++x) {
+                    guide[y][x] = LIM01(guide[y][x] / 32768.f);
                 }
             }
         }
@@ -1299,7 +2069,27 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
             float blur = masks[i].parametricMask.enabled
                              ? masks[i].parametricMask.blur
                              : 0.f;
-            if (blur > NO_BLUR) {
+            if (reduced) {
+                // without blur, the smallest radius that still follows the
+                // edges of the guide
+                int r1 = 2 * proc_scale;
+                int r2 = 2 * proc_scale;
+                if (blur > NO_BLUR) {
+                    blur = blur < 0.f ? -1.f / blur : 1.f + blur;
+                    r1 = max(int(4 / scale * blur + 0.5), r1);
+                    r2 = max(int(25 / scale * blur + 0.5), r2);
+                }
+                if (abmask) {
+                    rtengine::guidedUpsample(guide, {&small_blend[i]},
+                                             {&(*abmask)[i]}, r1, 0.001,
+                                             multithread);
+                }
+                if (Lmask) {
+                    rtengine::guidedUpsample(guide, {&small_blend[i]},
+                                             {&(*Lmask)[i]}, r2, 0.0001,
+                                             multithread);
+                }
+            } else if (blur > NO_BLUR) {
                 blur = blur < 0.f ? -1.f / blur : 1.f + blur;
                 int r1 = max(int(4 / scale * blur + 0.5), 1);
                 int r2 = max(int(25 / scale * blur + 0.5), 1);
@@ -1398,6 +2188,22 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
         }
     };
 
+    const auto store_linked = [&](int i) -> void {
+        if (Lmask || abmask) {
+            const array2D<float> *m1 = nullptr;
+            const array2D<float> *m2 = nullptr;
+            if (Lmask && abmask) {
+                m1 = &((*abmask)[i]);
+                m2 = &((*Lmask)[i]);
+            } else if (Lmask) {
+                m1 = &((*Lmask)[i]);
+            } else {
+                m1 = &((*abmask)[i]);
+            }
+            mmgr.store_mask(toolname, masks[i].name, m1, m2, multithread);
+        }
+    };
+
     for (int i = 0; i < end_idx; ++i) {
         if (!needed[i]) {
             continue;
@@ -1526,18 +2332,19 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
             }
         }
 
-        if (Lmask || abmask) {
-            const array2D<float> *m1 = nullptr;
-            const array2D<float> *m2 = nullptr;
-            if (Lmask && abmask) {
-                m1 = &((*abmask)[i]);
-                m2 = &((*Lmask)[i]);
-            } else if (Lmask) {
-                m1 = &((*Lmask)[i]);
-            } else {
-                m1 = &((*abmask)[i]);
-            }
-            mmgr.store_mask(toolname, masks[i].name, m1, m2, multithread);
+        if (cacheable[i]) {
+            cache_key.mask = masks[i];
+            MaskCache::get_instance().set(
+                cache_key, Lmask ? &(*Lmask)[i] : nullptr,
+                abmask ? &(*abmask)[i] : nullptr, multithread);
+        }
+
+        store_linked(i);
+    }
+
+    for (int i = 0; i < end_idx; ++i) {
+        if (cached[i]) {
+            store_linked(i);
         }
     }
 
@@ -1554,19 +2361,28 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
         auto *smask = abmask ? abmask : Lmask;
 
 #ifdef _OPENMP
-#pragma omp parallel for if (multithread)
+#pragma omp parallel if (multithread)
 #endif
-        for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                auto blend = smask ? (*smask)[show_mask_idx][y][x] : 0.f;
-                float l, a, b;
-                rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x), l, a, b,
-                        wp);
-                a = 0.f;
-                b = blend * 42000.f;
-                l = LIM(l + 32768.f * blend, 0.f, 32768.f);
-                Color::lab2rgb(l, a, b, rgb->r(y, x), rgb->g(y, x),
-                               rgb->b(y, x), iwp);
+        {
+            std::vector<float> lbuf(W);
+            std::vector<float> abuf(W);
+            std::vector<float> bbuf(W);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+            for (int y = 0; y < H; ++y) {
+                float *l = &lbuf[0];
+                float *a = &abuf[0];
+                float *b = &bbuf[0];
+                rgb2lab(mode, rgb->r(y), rgb->g(y), rgb->b(y), l, a, b, wp, W);
+                for (int x = 0; x < W; ++x) {
+                    auto blend = smask ? (*smask)[show_mask_idx][y][x] : 0.f;
+                    a[x] = 0.f;
+                    b[x] = blend * 42000.f;
+                    l[x] = LIM(l[x] + 32768.f * blend, 0.f, 32768.f);
+                }
+                Color::lab2rgb(l, a, b, rgb->r(y), rgb->g(y), rgb->b(y), iwp,
+                               W);
             }
         }
         rgb->assignMode(Imagefloat::Mode::RGB);
@@ -1592,26 +2408,37 @@ void fillPipetteMasks(Imagefloat *rgb, PlanarWhateverData<float> *editWhatever,
     const auto mode = rgb->mode();
 
 #ifdef _OPENMP
-#pragma omp parallel for if (multithread)
+#pragma omp parallel if (multithread)
 #endif
-    for (int y = 0; y < H; ++y) {
-        for (int x = 0; x < W; ++x) {
-            float v = 0.f;
-            float l, a, b;
-            rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x), l, a, b,
-                    wp);
-            switch (id) {
-            case MasksEditID::H:
-                v = Color::huelab_to_huehsv2(xatan2f(b, a));
-                break;
-            case MasksEditID::C:
-                v = LIM01<float>(std::sqrt(SQR(a) + SQR(b) + 0.001f) / 48000.f);
-                break;
-            case MasksEditID::L:
-                v = LIM01<float>(l / 32768.f);
-                break;
+    {
+        std::vector<float> lbuf(W);
+        std::vector<float> abuf(W);
+        std::vector<float> bbuf(W);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int y = 0; y < H; ++y) {
+            rgb2lab(mode, rgb->r(y), rgb->g(y), rgb->b(y), &lbuf[0], &abuf[0],
+                    &bbuf[0], wp, W);
+            for (int x = 0; x < W; ++x) {
+                float v = 0.f;
+                const float l = lbuf[x];
+                const float a = abuf[x];
+                const float b = bbuf[x];
+                switch (id) {
+                case MasksEditID::H:
+                    v = Color::huelab_to_huehsv2(xatan2f(b, a));
+                    break;
+                case MasksEditID::C:
+                    v = LIM01<float>(std::sqrt(SQR(a) + SQR(b) + 0.001f) /
+                                     48000.f);
+                    break;
+                case MasksEditID::L:
+                    v = LIM01<float>(l / 32768.f);
+                    break;
+                }
+                editWhatever->v(y, x) = v;
             }
-            editWhatever->v(y, x) = v;
         }
     }
 }
@@ -20,11 +20,14 @@
 
 #pragma once
 
+#include "alignedbuffer.h"
 #include "array2D.h"
-#include "cache.h"
 #include "imagefloat.h"
 #include "labimage.h"
 #include "procparams.h"
+#include <list>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -63,7 +66,39 @@ public:
 private:
     ExternalMaskManager();
 
-    Cache<std::string, std::shared_ptr<array2D<float>>> cache_;
+    // a decoded mask, as 16 bit values, at full resolution (factor 1) or
+    // downsampled by a power of 2
+    struct Plane {
+        std::string key;
+        int factor;
+        int width;
+        int height;
+        int src_width; // size at full resolution
+        int src_height;
+        AlignedBuffer<uint16_t> data;
+
+        size_t bytes() const
+        {
+            return size_t(width) * height * sizeof(uint16_t);
+        }
+        float get_bilinear(float x, float y) const;
+    };
+
+    // factor 0 stands for any resolution
+    std::shared_ptr<Plane> get_plane(const std::string &key, int factor);
+    void store_plane(const std::shared_ptr<Plane> &plane);
+    std::shared_ptr<Plane> load_plane(const std::string &key,
+                                      const Glib::ustring &filename,
+                                      bool multithread);
+    static std::shared_ptr<Plane> downsample(const Plane &src, int factor,
+                                             bool multithread);
+
+    // the planes in use, most recent first; their total size is bounded by
+    // settings->external_mask_cache_memory_limit
+    std::mutex mutex_;
+    std::list<std::shared_ptr<Plane>> planes_;
+    size_t bytes_;
+
     static std::unique_ptr<ExternalMaskManager> instance_;
 };
 
@@ -0,0 +1,142 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memoryusage.h"
+#include "procparams.h"
+#include <algorithm>
+#include <vector>
+
+namespace rtengine {
+
+namespace {
+
+thread_local MemoryUsage::Scope *current_scope = nullptr;
+
+size_t mask_planes(const procparams::MaskableParams &p, bool enabled)
+{
+    if (!enabled) {
+        return 0;
+    }
+    size_t n = 0;
+    for (auto &m : p.get_masks()) {
+        n += m.enabled;
+    }
+    // one plane per mask, plus the temporaries to generate them
+    return n ? n + 2 : 0;
+}
+
+} // namespace
+
+MemoryUsage::Scope::Scope(const char *name)
+    : name_(name), parent_(current_scope), current_(0), peak_(0)
+{
+    current_scope = this;
+}
+
+MemoryUsage::Scope::~Scope()
+{
+    current_scope = parent_;
+    if (!parent_) {
+        return;
+    }
+
+    parent_->peak_ = std::max(parent_->peak_, parent_->current_ + peak_);
+    parent_->current_ += current_;
+
+    Scope *root = parent_;
+    while (root->parent_) {
+        root = root->parent_;
+    }
+    int64_t &p = root->nested_[name_];
+    p = std::max(p, peak_);
+}
+
+void MemoryUsage::Scope::print(std::ostream &out) const
+{
+    constexpr double MB = 1024.0 * 1024.0;
+
+    std::vector<std::pair<std::string, int64_t>> v(nested_.begin(),
+                                                   nested_.end());
+    std::sort(v.begin(), v.end(),
+              [](const std::pair<std::string, int64_t> &a,
+                 const std::pair<std::string, int64_t> &b) -> bool {
+                  return a.second > b.second;
+              });
+    out << name_ << ": peak buffer memory " << int(peak_ / MB) << " MB"
+        << std::endl;
+    for (auto &p : v) {
+        if (p.second >= MB) {
+            out << "  " << p.first << ": " << int(p.second / MB) << " MB"
+                << std::endl;
+        }
+    }
+}
+
+void MemoryUsage::account(int64_t bytes)
+{
+    Scope *s = current_scope;
+    if (s) {
+        s->current_ += bytes;
+        s->peak_ = std::max(s->peak_, s->current_);
+    }
+}
+
+size_t estimate_peak_memory(int width, int height,
+                            const procparams::ProcParams &params)
+{
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    // raw data (as read and as float), demosaiced image, working image and
+    // output image
+    size_t planes = 1 + 1 + 3 + 3 + 3;
+
+    if (params.denoise.enabled) {
+        planes += 6;
+        if (params.denoise.nlStrength > 0) {
+            planes += 3;
+        }
+    }
+    if (params.localContrast.enabled) {
+        planes += 3;
+    }
+    if (params.textureBoost.enabled) {
+        planes += 3;
+    }
+    if (params.smoothing.enabled) {
+        planes += 3;
+    }
+    if (params.dehaze.enabled) {
+        planes += 3;
+    }
+    if (params.fattal.enabled) {
+        planes += 2;
+    }
+    // the masks of the different tools are not alive at the same time
+    planes += std::max(
+        {mask_planes(params.localContrast, params.localContrast.enabled),
+         mask_planes(params.textureBoost, params.textureBoost.enabled),
+         mask_planes(params.smoothing, params.smoothing.enabled),
+         mask_planes(params.colorcorrection,
+                     params.colorcorrection.enabled)});
+
+    return size_t(width) * size_t(height) * planes * sizeof(float);
+}
+
+} // namespace rtengine
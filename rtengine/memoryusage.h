@@ -0,0 +1,86 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace rtengine {
+
+namespace procparams {
+class ProcParams;
+} // namespace procparams
+
+/**
+ * Accounting of the memory used by the image buffers (i.e. the blocks of the
+ * PlanePool, which back AlignedBuffer, array2D and the image planes).
+ *
+ * A Scope tracks the bytes acquired and released by its thread while it is
+ * alive, and their high-water mark. Scopes nest: the outermost one (e.g. a
+ * whole processing job) also collects the peak of each of the scopes opened
+ * inside it (e.g. the operators). Buffers allocated by other threads, like
+ * the workers of a parallel loop, are not accounted for, which in practice
+ * only misses small per-thread buffers.
+ */
+class MemoryUsage {
+public:
+    class Scope: public NonCopyable {
+    public:
+        explicit Scope(const char *name);
+        ~Scope();
+
+        /// high-water mark of the bytes acquired in the scope so far
+        int64_t peak() const { return peak_; }
+        /// peak of the nested scopes, by name (only for the outermost one)
+        const std::map<std::string, int64_t> &nested() const
+        {
+            return nested_;
+        }
+
+        void print(std::ostream &out) const;
+
+    private:
+        friend class MemoryUsage;
+
+        const char *name_;
+        Scope *parent_;
+        int64_t current_;
+        int64_t peak_;
+        std::map<std::string, int64_t> nested_;
+    };
+
+    /// called by the PlanePool when blocks are handed out (positive bytes)
+    /// or given back (negative bytes)
+    static void account(int64_t bytes);
+};
+
+/**
+ * Rough estimate of the peak memory (in bytes) needed to develop a
+ * width x height raw file with the given parameters: raw data, demosaiced
+ * image and working buffers, plus the extra buffers of the most
+ * memory-hungry tools and of the masks.
+ */
+size_t estimate_peak_memory(int width, int height,
+                            const procparams::ProcParams &params);
+
+} // namespace rtengine
@@ -18,11 +18,16 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <giomm.h>
 #include <glib/gstdio.h>
 #include <iostream>
+#include <condition_variable>
 #include <mutex>
 #include <set>
+#include <stdexcept>
+#include <thread>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -34,6 +39,7 @@
 #include "metadata.h"
 #include "settings.h"
 #include "subprocess.h"
+#include "threadpool.h"
 
 namespace rtengine {
 
@@ -74,6 +80,29 @@ private:
 #endif // EXIV2_TEST_VERSION
 
 constexpr size_t IMAGE_CACHE_SIZE = 200;
+// the memory limit of the image cache is the one that matters, this is only
+// to bound the bookkeeping for files with very little metadata
+constexpr size_t IMAGE_CACHE_MAX_ENTRIES = 10000;
+
+// rough estimate of the memory used by the parsed metadata of an image
+size_t metadata_weight(Exiv2::Image *img)
+{
+    constexpr size_t datum_overhead = 128;
+    size_t ret = sizeof(*img);
+    for (auto &d : img->exifData()) {
+        ret += datum_overhead + d.size();
+    }
+    for (auto &d : img->iptcData()) {
+        ret += datum_overhead + d.size();
+    }
+    for (auto &d : img->xmpData()) {
+        ret += datum_overhead + d.size();
+    }
+    return ret;
+}
+
+// current directory prefetch, older ones stop when this changes
+std::atomic<unsigned> prefetch_generation(0);
 
 std::unique_ptr<Exiv2::Image> open_exiv2(const Glib::ustring &fname,
                                          bool check_exif)
@@ -142,7 +171,7 @@ const char *exiftool_xmp_config =
 
 class Exiftool {
 public:
-    Exiftool(): initialized_(false) {}
+    Exiftool(): live_(0), available_(true) {}
 
     std::pair<std::string, int> mktemp(const Glib::ustring &fname,
                                        const Glib::ustring &ctx = "")
@@ -235,56 +264,16 @@ public:
     bool exec(const std::vector<Glib::ustring> &argv, std::string *out,
               std::string *err)
     {
-        std::unique_lock<std::mutex> lck(mutex_);
-
-        init();
-        if (!p_) {
-            return false;
-        }
-
-        for (auto &a : argv) {
-            if (!p_->write(a.c_str(), a.bytes()) || !p_->write("\n", 1)) {
-                return cleanup();
-            }
-        }
-        if (!p_->write("-execute\n", 9)) {
-            return cleanup();
-        }
-        if (!p_->flush()) {
-            return cleanup();
-        }
-
-        std::string line;
-        std::ostringstream buf;
         if (err) {
             *err = "";
         }
-        while (true) {
-            int c = p_->read();
-            if (c == EOF) {
-                return cleanup();
-#ifdef WIN32
-            } else if (c == '\r') {
-                continue;
-#endif // WIN32
-            } else if (c == '\n') {
-                if (line == "{ready}") {
-                    break;
-                } else {
-                    if (out) {
-                        buf << line << '\n';
-                    }
-                    line = "";
-                }
-            } else {
-                line.push_back(c);
-            }
-        }
-        if (out) {
-            *out = buf.str();
+        auto p = acquire();
+        if (!p) {
+            return false;
         }
-
-        return true;
+        const bool ok = run(p.get(), argv, out);
+        release(ok ? std::move(p) : nullptr);
+        return ok;
     }
 
     bool embed_procparams(const Glib::ustring &fname, const std::string &data)
@@ -316,11 +305,13 @@ public:
 
     void shutdown()
     {
-        if (p_) {
-            p_->write("-stay_open\n0\n", 13);
-            p_->flush();
+        std::lock_guard<std::mutex> lck(mutex_);
+        for (auto &p : idle_) {
+            p->write("-stay_open\n0\n", 13);
+            p->flush();
         }
-        cleanup();
+        live_ -= idle_.size();
+        idle_.clear();
     }
 
 private:
@@ -336,48 +327,136 @@ private:
         return exiftool;
     }
 
-    bool cleanup()
+    // the exiftool processes are persistent (-stay_open): each one serves a
+    // request at a time, and up to max_processes() of them run in parallel
+    static int max_processes()
     {
-        p_.reset(nullptr);
-        return false;
+        return std::min(std::max(int(std::thread::hardware_concurrency()), 1),
+                        4);
     }
 
-    void init()
+    std::unique_ptr<subprocess::SubprocessInfo> acquire()
     {
-        if (!initialized_) {
-            initialized_ = true;
-            auto e = get_bin();
-            if (e.empty()) {
-                p_.reset(nullptr);
-                if (settings->verbose) {
-                    std::cout << "exiftool disabled or not found" << std::endl;
-                }
-            } else {
-                if (settings->verbose) {
-                    std::cout << "starting exiftool... " << std::flush;
-                }
-                std::vector<Glib::ustring> argv = {
-                    e,      "-stay_open",       "true",     "-@",
-                    "-",    "-common_args",     "-charset", "filename=utf8",
-                    "-api", "WindowsLongPath=0"};
-                try {
-                    p_ = subprocess::popen("", argv, true, true, true);
-                    if (settings->verbose) {
-                        std::cout << (p_ ? "OK" : "ERROR!") << std::endl;
-                    }
-                } catch (subprocess::error &exc) {
-                    p_.reset(nullptr);
-                    if (settings->verbose) {
-                        std::cout << "ERROR: " << exc.what() << std::endl;
+        std::unique_lock<std::mutex> lck(mutex_);
+        cond_.wait(lck, [this]() {
+            return !available_ || !idle_.empty() || live_ < max_processes();
+        });
+        if (!available_) {
+            return nullptr;
+        }
+        if (!idle_.empty()) {
+            auto p = std::move(idle_.back());
+            idle_.pop_back();
+            return p;
+        }
+        ++live_;
+        lck.unlock();
+
+        auto p = start();
+
+        if (!p) {
+            lck.lock();
+            --live_;
+            // don't try again if exiftool can't be started at all
+            if (live_ == 0) {
+                available_ = false;
+            }
+            cond_.notify_all();
+        }
+        return p;
+    }
+
+    void release(std::unique_ptr<subprocess::SubprocessInfo> p)
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        if (p) {
+            idle_.push_back(std::move(p));
+        } else {
+            --live_;
+        }
+        cond_.notify_one();
+    }
+
+    std::unique_ptr<subprocess::SubprocessInfo> start()
+    {
+        auto e = get_bin();
+        if (e.empty()) {
+            if (settings->verbose) {
+                std::cout << "exiftool disabled or not found" << std::endl;
+            }
+            return nullptr;
+        }
+        if (settings->verbose) {
+            std::cout << "starting exiftool... " << std::flush;
+        }
+        std::vector<Glib::ustring> argv = {
+            e,      "-stay_open",       "true",     "-@",
+            "-",    "-common_args",     "-charset", "filename=utf8",
+            "-api", "WindowsLongPath=0"};
+        std::unique_ptr<subprocess::SubprocessInfo> p;
+        try {
+            p = subprocess::popen("", argv, true, true, true);
+            if (settings->verbose) {
+                std::cout << (p ? "OK" : "ERROR!") << std::endl;
+            }
+        } catch (subprocess::error &exc) {
+            if (settings->verbose) {
+                std::cout << "ERROR: " << exc.what() << std::endl;
+            }
+        }
+        return p;
+    }
+
+    static bool run(subprocess::SubprocessInfo *p,
+                    const std::vector<Glib::ustring> &argv, std::string *out)
+    {
+        for (auto &a : argv) {
+            if (!p->write(a.c_str(), a.bytes()) || !p->write("\n", 1)) {
+                return false;
+            }
+        }
+        if (!p->write("-execute\n", 9)) {
+            return false;
+        }
+        if (!p->flush()) {
+            return false;
+        }
+
+        std::string line;
+        std::ostringstream buf;
+        while (true) {
+            int c = p->read();
+            if (c == EOF) {
+                return false;
+#ifdef WIN32
+            } else if (c == '\r') {
+                continue;
+#endif // WIN32
+            } else if (c == '\n') {
+                if (line == "{ready}") {
+                    break;
+                } else {
+                    if (out) {
+                        buf << line << '\n';
                     }
+                    line = "";
                 }
+            } else {
+                line.push_back(c);
             }
         }
+        if (out) {
+            *out = buf.str();
+        }
+
+        return true;
     }
 
-    std::unique_ptr<subprocess::SubprocessInfo> p_;
     std::mutex mutex_;
-    bool initialized_;
+    std::condition_variable cond_;
+    std::vector<std::unique_ptr<subprocess::SubprocessInfo>> idle_;
+    int live_;
+    bool available_;
 };
 
 //-----------------------------------------------------------------------------
@@ -401,10 +480,19 @@ Exiv2Metadata::Exiv2Metadata(const Glib::ustring &path, bool merge_xmp_sidecar)
 {
 }
 
+Glib::ustring Exiv2Metadata::cacheKey() const
+{
+    // the images with and without the sidecar merged are different entries,
+    // so that the editor (which doesn't merge) and the browser can share the
+    // cache without evicting each other's data
+    return (merge_xmp_ ? "1" : "0") + src_;
+}
+
 void Exiv2Metadata::load() const
 {
     if (!src_.empty() && !image_.get() &&
         Glib::file_test(src_.c_str(), Glib::FILE_TEST_EXISTS)) {
+        const auto key = cacheKey();
         CacheVal val;
         auto finfo = Gio::File::create_for_path(src_)->query_info(
             G_FILE_ATTRIBUTE_TIME_MODIFIED);
@@ -418,7 +506,7 @@ void Exiv2Metadata::load() const
             }
         }
 
-        if (cache_ && cache_->get(src_, val) &&
+        if (cache_ && cache_->get(key, val) &&
             val.image_mtime >= finfo->modification_time() &&
             val.use_xmp == merge_xmp_ && val.xmp_mtime >= xmp_mtime) {
             // if (settings->verbose) {
@@ -443,7 +531,7 @@ void Exiv2Metadata::load() const
                 val.image_mtime = finfo->modification_time();
                 val.xmp_mtime = xmp_mtime;
                 val.use_xmp = merge_xmp_;
-                cache_->set(src_, val);
+                cache_->set(key, val, metadata_weight(image_.get()));
             }
         }
     }
@@ -497,14 +585,68 @@ void Exiv2Metadata::do_merge_xmp(Exiv2::Image *dst, bool keep_all) const
 }
 
 void Exiv2Metadata::saveToImage(ProgressListener *pl, const Glib::ustring &path,
-                                bool preserve_all_tags) const
+                                bool preserve_all_tags,
+                                bool srgb_colorspace) const
 {
     auto dst = open_exiv2(path, false);
+    save_to(pl, dst.get(), path, preserve_all_tags, srgb_colorspace);
+}
+
+std::vector<std::pair<int, std::string>>
+Exiv2Metadata::getJpegSegments(ProgressListener *pl, const Glib::ustring &path,
+                               bool srgb_colorspace) const
+{
+    // let Exiv2 write the metadata into a blank JPEG in memory, and then
+    // extract the resulting APP segments
+    auto img = Exiv2::ImageFactory::create(Exiv2::ImageType::jpeg);
+    std::unique_ptr<Exiv2::Image> dst(img.release());
+    save_to(pl, dst.get(), path, false, srgb_colorspace);
+
+    auto &io = dst->io();
+    std::vector<unsigned char> buf(io.size());
+    if (io.open() != 0) {
+        throw std::runtime_error("exiv2: can't read the metadata buffer");
+    }
+    const bool ok =
+        buf.empty() || size_t(io.read(buf.data(), buf.size())) == buf.size();
+    io.close();
+    if (!ok || buf.size() < 4 || buf[0] != 0xFF || buf[1] != 0xD8) {
+        throw std::runtime_error("exiv2: invalid metadata buffer");
+    }
+
+    std::vector<std::pair<int, std::string>> ret;
+    for (size_t pos = 2; pos + 4 <= buf.size();) {
+        if (buf[pos] != 0xFF) {
+            throw std::runtime_error("exiv2: invalid metadata buffer");
+        }
+        const int marker = buf[pos + 1];
+        if (marker == 0xDA || marker == 0xD9) { // SOS, EOI
+            break;
+        }
+        const size_t len = (size_t(buf[pos + 2]) << 8) | buf[pos + 3];
+        if (len < 2 || pos + 2 + len > buf.size()) {
+            throw std::runtime_error("exiv2: invalid metadata buffer");
+        }
+        // APP1 (Exif and XMP) and APP13 (IPTC)
+        if (marker == 0xE1 || marker == 0xED) {
+            ret.emplace_back(
+                marker, std::string(reinterpret_cast<char *>(&buf[pos + 4]),
+                                    len - 2));
+        }
+        pos += 2 + len;
+    }
+    return ret;
+}
+
+void Exiv2Metadata::save_to(ProgressListener *pl, Exiv2::Image *dst,
+                            const Glib::ustring &path, bool preserve_all_tags,
+                            bool srgb_colorspace) const
+{
     if (image_.get()) {
         dst->setIptcData(image_->iptcData());
         dst->setXmpData(image_->xmpData());
         if (merge_xmp_) {
-            do_merge_xmp(dst.get(), preserve_all_tags);
+            do_merge_xmp(dst, preserve_all_tags);
         }
         auto srcexif = image_->exifData();
         if (!preserve_all_tags) {
@@ -547,6 +689,9 @@ void Exiv2Metadata::saveToImage(ProgressListener *pl, const Glib::ustring &path,
     }
     import_exif_pairs(dst->exifData());
     import_iptc_pairs(dst->iptcData());
+    if (srgb_colorspace) {
+        dst->exifData()["Exif.Photo.ColorSpace"] = 1;
+    }
     bool xmp_tried = false;
     bool iptc_tried = false;
     for (int i = 0; i < 3; ++i) {
@@ -564,7 +709,7 @@ void Exiv2Metadata::saveToImage(ProgressListener *pl, const Glib::ustring &path,
                     !dst->xmpData().empty()) {
                     dst->xmpData().clear();
                     if (!xmp_tried && merge_xmp_) {
-                        do_merge_xmp(dst.get(), preserve_all_tags);
+                        do_merge_xmp(dst, preserve_all_tags);
                         xmp_tried = true;
                     }
                 } else if (msg.find("IPTC") != std::string::npos &&
@@ -789,6 +934,32 @@ void Exiv2Metadata::getDimensions(int &w, int &h) const
     }
 }
 
+std::string Exiv2Metadata::getLargestJpegPreview() const
+{
+    try {
+        // use a private instance rather than the cached one, as reading the
+        // previews moves the file position of the underlying io
+        auto image = open_exiv2(src_, false);
+        Exiv2::PreviewManager pm(*image);
+        auto props = pm.getPreviewProperties();
+        // the list is sorted by increasing size
+        for (auto it = props.rbegin(); it != props.rend(); ++it) {
+            if (it->mimeType_ == "image/jpeg") {
+                Exiv2::PreviewImage preview = pm.getPreviewImage(*it);
+                return std::string(
+                    reinterpret_cast<const char *>(preview.pData()),
+                    preview.size());
+            }
+        }
+    } catch (std::exception &exc) {
+        if (settings->verbose) {
+            std::cerr << "Error reading the embedded previews of " << src_
+                      << ": " << exc.what() << std::endl;
+        }
+    }
+    return "";
+}
+
 Glib::ustring Exiv2Metadata::xmpSidecarPath(const Glib::ustring &path)
 {
     Glib::ustring fn = path;
@@ -812,7 +983,9 @@ Exiv2::XmpData Exiv2Metadata::getXmpSidecar(const Glib::ustring &path)
 void Exiv2Metadata::init(const Glib::ustring &base_dir,
                          const Glib::ustring &user_dir)
 {
-    cache_.reset(new ImageCache(IMAGE_CACHE_SIZE));
+    cache_.reset(new ImageCache(
+        IMAGE_CACHE_MAX_ENTRIES, nullptr,
+        std::max(settings->metadata_cache_memory_limit, 1) * 1024UL * 1024UL));
     jsoncache_.reset(new JSONCache(IMAGE_CACHE_SIZE));
     const gchar *exiftool_base_dir_env = g_getenv("ART_EXIFTOOL_BASE_DIR");
     if (exiftool_base_dir_env) {
@@ -830,8 +1003,41 @@ void Exiv2Metadata::init(const Glib::ustring &base_dir,
 #endif
 }
 
+void Exiv2Metadata::prefetch(const std::vector<Glib::ustring> &fnames)
+{
+    const unsigned gen = ++prefetch_generation;
+    if (!cache_ || fnames.empty()) {
+        return;
+    }
+
+    ThreadPool::add_task(ThreadPool::Priority::LOWEST, [fnames, gen]() {
+        // fill at most half of the cache, so that the metadata of the images
+        // in use is not evicted
+        const size_t budget = cache_->getMaxWeight() / 2;
+        size_t loaded = 0;
+        for (auto &fname : fnames) {
+            if (prefetch_generation != gen || loaded >= budget) {
+                break;
+            }
+            try {
+                Exiv2Metadata md(fname);
+                if (cache_->contains(md.cacheKey())) {
+                    continue;
+                }
+                md.load();
+                if (md.image_) {
+                    loaded += metadata_weight(md.image_.get());
+                }
+            } catch (std::exception &) {
+                // the error is reported again when the file is actually used
+            }
+        }
+    });
+}
+
 void Exiv2Metadata::cleanup()
 {
+    ++prefetch_generation;
     Exiv2::XmpParser::terminate();
     if (exiftool_) {
         exiftool_->shutdown();
@@ -852,50 +1058,104 @@ void Exiv2Metadata::embedProcParamsData(const Glib::ustring &fname,
     }
 }
 
-std::unordered_map<std::string, std::string>
-Exiv2Metadata::getExiftoolMakernotes(const Glib::ustring &fname)
+namespace {
+
+const std::vector<Glib::ustring> makernotes_args = {
+    "-json", "-MakerNotes:all", "-RAF:all", "-PanasonicRaw:all"};
+
+std::unordered_map<std::string, std::string> makernotes_from_json(cJSON *obj)
 {
-    if (fname.empty()) {
-        return {};
+    const auto tostr = [](double d) -> std::string {
+        if (d == int(d)) {
+            return std::to_string(int(d));
+        } else {
+            auto s = std::to_string(d);
+            auto p = s.rfind('.');
+            if (p != std::string::npos) {
+                while (s.back() == '0') {
+                    s.pop_back();
+                }
+                if (s.back() == '.') {
+                    s.pop_back();
+                }
+            }
+            return s;
+        }
+    };
+
+    std::unordered_map<std::string, std::string> ret;
+    if (obj && cJSON_IsObject(obj)) {
+        for (cJSON *e = obj->child; e != nullptr; e = e->next) {
+            if (e->type & cJSON_String) {
+                ret[e->string] = e->valuestring;
+            } else if (e->type & cJSON_Number) {
+                ret[e->string] = tostr(e->valuedouble);
+            } else if (e->type & cJSON_True) {
+                ret[e->string] = "true";
+            } else if (e->type & cJSON_False) {
+                ret[e->string] = "false";
+            }
+        }
     }
+    ret.erase("SourceFile");
+    return ret;
+}
 
-    JSONCacheVal val;
-    Glib::RefPtr<Gio::FileInfo> finfo;
+// exiftool reports the file names with forward slashes also on Windows
+std::string source_file_key(const Glib::ustring &fname)
+{
+    std::string ret = fname;
+    std::replace(ret.begin(), ret.end(), '\\', '/');
+    return ret;
+}
+
+} // namespace
+
+bool Exiv2Metadata::getCachedMakernotes(
+    const Glib::ustring &fname, Glib::TimeVal &mtime,
+    std::unordered_map<std::string, std::string> &out)
+{
     try {
-        finfo = Gio::File::create_for_path(fname)->query_info(
-            G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        mtime = Gio::File::create_for_path(fname)
+                    ->query_info(G_FILE_ATTRIBUTE_TIME_MODIFIED)
+                    ->modification_time();
     } catch (Glib::Error &exc) {
         if (settings->verbose) {
             std::cout << "Error querying the modification time for " << fname
                       << ": " << exc.what() << std::endl;
         }
+        mtime = Glib::TimeVal();
+        return false;
     }
-    if (jsoncache_ && finfo && jsoncache_->get(fname, val) &&
-        val.second >= finfo->modification_time()) {
-        if (settings->verbose > 1) {
-            std::cout << "retrieving exiftool makernotes from cache for: "
-                      << fname << std::endl;
-        }
-        return val.first;
+
+    JSONCacheVal val;
+    if (jsoncache_ && jsoncache_->get(fname, val) && val.second >= mtime) {
+        out = val.first;
+        return true;
     }
+    return false;
+}
 
-    std::unordered_map<std::string, std::string> ret;
+std::unordered_map<std::string, std::string>
+Exiv2Metadata::getExiftoolMakernotes(const Glib::ustring &fname)
+{
+    if (fname.empty()) {
+        return {};
+    }
 
-    auto p = exiftool_->mktemp(fname, "json");
-    auto &templ = p.first;
-    int fd = p.second;
-    if (fd < 0) {
-        if (settings->verbose) {
-            std::cout << "ERROR generating temporary file: "
-                      << Glib::path_get_basename(fname) << std::endl;
+    std::unordered_map<std::string, std::string> ret;
+    Glib::TimeVal mtime;
+    if (getCachedMakernotes(fname, mtime, ret)) {
+        if (settings->verbose > 1) {
+            std::cout << "retrieving exiftool makernotes from cache for: "
+                      << fname << std::endl;
         }
         return ret;
     }
-    Glib::ustring outname = fname_to_utf8(templ);
 
-    std::vector<Glib::ustring> argv = {
-        "-json", "-MakerNotes:all", "-RAF:all", "-PanasonicRaw:all",
-        "-w+",   "%0f" + outname,   fname};
+    // the JSON output is read directly from the persistent exiftool process
+    std::vector<Glib::ustring> argv = makernotes_args;
+    argv.push_back(fname);
     std::string out, err;
     if (!exiftool_->exec(argv, &out, &err)) {
         if (settings->verbose) {
@@ -906,9 +1166,6 @@ Exiv2Metadata::getExiftoolMakernotes(const Glib::ustring &fname)
             std::cout << std::endl;
             std::cout << "output:\n" << out << "\nerror:\n" << err << std::endl;
         }
-        if (Glib::file_test(outname, Glib::FILE_TEST_EXISTS)) {
-            g_remove(outname.c_str());
-        }
         return ret;
     } else if (settings->verbose > 1) {
         std::cout << "exiftool exec with args:";
@@ -916,79 +1173,82 @@ Exiv2Metadata::getExiftoolMakernotes(const Glib::ustring &fname)
             std::cout << " " << a;
         }
         std::cout << std::endl;
-        std::cout << "output:\n" << out << "\nerror:\n" << err << std::endl;
     }
 
-    cJSON *root = nullptr;
-    close(fd);
+    cJSON *root = cJSON_Parse(out.c_str());
+    if (!root) {
+        return ret;
+    }
+
+    if (cJSON_IsArray(root) && cJSON_GetArraySize(root) == 1) {
+        ret = makernotes_from_json(cJSON_GetArrayItem(root, 0));
+    }
 
-    FILE *src = g_fopen(outname.c_str(), "rb");
-    if (src) {
-        std::ostringstream data;
-        int c;
-        while (true) {
-            c = fgetc(src);
-            if (c != EOF) {
-                data << static_cast<unsigned char>(c);
-            } else {
-                break;
-            }
+    cJSON_Delete(root);
+
+    if (jsoncache_ && mtime != Glib::TimeVal()) {
+        jsoncache_->set(fname, JSONCacheVal(ret, mtime));
+    }
+
+    return ret;
+}
+
+void Exiv2Metadata::prefetchExiftoolMakernotes(
+    const std::vector<Glib::ustring> &fnames)
+{
+    if (!jsoncache_) {
+        return;
+    }
+
+    // a single exiftool request for all the files which are not cached yet
+    std::unordered_map<std::string, std::pair<Glib::ustring, Glib::TimeVal>>
+        todo;
+    std::vector<Glib::ustring> argv = makernotes_args;
+    for (auto &fname : fnames) {
+        std::unordered_map<std::string, std::string> mn;
+        Glib::TimeVal mtime;
+        if (!fname.empty() && !getCachedMakernotes(fname, mtime, mn) &&
+            mtime != Glib::TimeVal()) {
+            todo[source_file_key(fname)] = std::make_pair(fname, mtime);
+            argv.push_back(fname);
         }
-        fclose(src);
-        std::string s = data.str();
-        root = cJSON_Parse(s.c_str());
     }
-    if (Glib::file_test(outname, Glib::FILE_TEST_EXISTS)) {
-        g_remove(outname.c_str());
+    if (todo.empty()) {
+        return;
+    }
+
+    if (settings->verbose) {
+        std::cout << "prefetching exiftool makernotes for " << todo.size()
+                  << " files" << std::endl;
     }
 
+    std::string out, err;
+    if (!exiftool_->exec(argv, &out, &err)) {
+        return;
+    }
+
+    cJSON *root = cJSON_Parse(out.c_str());
     if (!root) {
-        return ret;
+        return;
     }
 
-    const auto tostr = [](double d) -> std::string {
-        if (d == int(d)) {
-            return std::to_string(int(d));
-        } else {
-            auto s = std::to_string(d);
-            auto p = s.rfind('.');
-            if (p != std::string::npos) {
-                while (s.back() == '0') {
-                    s.pop_back();
-                }
-                if (s.back() == '.') {
-                    s.pop_back();
-                }
+    if (cJSON_IsArray(root)) {
+        for (int i = 0, n = cJSON_GetArraySize(root); i < n; ++i) {
+            cJSON *obj = cJSON_GetArrayItem(root, i);
+            cJSON *src = cJSON_GetObjectItem(obj, "SourceFile");
+            if (!src || !cJSON_IsString(src)) {
+                continue;
             }
-            return s;
-        }
-    };
-
-    if (cJSON_IsArray(root) && cJSON_GetArraySize(root) == 1) {
-        cJSON *obj = cJSON_GetArrayItem(root, 0);
-        if (obj && cJSON_IsObject(obj)) {
-            for (cJSON *e = obj->child; e != nullptr; e = e->next) {
-                if (e->type & cJSON_String) {
-                    ret[e->string] = e->valuestring;
-                } else if (e->type & cJSON_Number) {
-                    ret[e->string] = tostr(e->valuedouble);
-                } else if (e->type & cJSON_True) {
-                    ret[e->string] = "true";
-                } else if (e->type & cJSON_False) {
-                    ret[e->string] = "false";
-                }
+            auto it = todo.find(source_file_key(src->valuestring));
+            if (it != todo.end()) {
+                jsoncache_->set(it->second.first,
+                                JSONCacheVal(makernotes_from_json(obj),
+                                             it->second.second));
             }
         }
     }
 
     cJSON_Delete(root);
-    ret.erase("SourceFile");
-
-    if (jsoncache_ && finfo) {
-        jsoncache_->set(fname, JSONCacheVal(ret, finfo->modification_time()));
-    }
-
-    return ret;
 }
 
 std::unordered_map<std::string, std::string>
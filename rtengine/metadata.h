@@ -26,6 +26,7 @@
 #include <glibmm.h>
 #include <memory>
 #include <unordered_set>
+#include <vector>
 
 namespace rtengine {
 
@@ -75,8 +76,16 @@ public:
     void setExif(const rtengine::procparams::ExifPairs &exif) { exif_ = exif; }
     void setIptc(const rtengine::procparams::IPTCPairs &iptc) { iptc_ = iptc; }
 
+    /// srgb_colorspace sets Exif.Photo.ColorSpace, for images without an
+    /// embedded ICC profile
     void saveToImage(ProgressListener *pl, const Glib::ustring &path,
-                     bool preserve_all_tags) const;
+                     bool preserve_all_tags, bool srgb_colorspace = false) const;
+    /** the metadata serialised as the APP segments (marker and payload) of a
+        JPEG file, for writing them while encoding the image at path. Throws
+        on failure, like saveToImage() */
+    std::vector<std::pair<int, std::string>>
+    getJpegSegments(ProgressListener *pl, const Glib::ustring &path,
+                    bool srgb_colorspace) const;
     void saveToXmp(const Glib::ustring &path) const;
 
     void setOutputRating(const rtengine::procparams::ProcParams &pparams,
@@ -85,6 +94,9 @@ public:
     void setExifKeys(const std::vector<std::string> *keys);
 
     void getDimensions(int &w, int &h) const;
+    // the data of the largest JPEG preview embedded in the file, or an empty
+    // string if there is none
+    std::string getLargestJpegPreview() const;
     std::unordered_map<std::string, std::string> getMakernotes() const;
 
     Exiv2::ExifData getOutputExifData() const;
@@ -99,9 +111,27 @@ public:
     static void embedProcParamsData(const Glib::ustring &fname,
                                     const std::string &data);
 
+    /** retrieves the makernotes of several files at once (with a single
+        exiftool request), so that the following getMakernotes() calls for
+        them are served from the cache */
+    static void prefetchExiftoolMakernotes(
+        const std::vector<Glib::ustring> &fnames);
+    /** loads the metadata of the given files into the cache in the
+        background, in order. Cancels the previous prefetch, if still
+        running */
+    static void prefetch(const std::vector<Glib::ustring> &fnames);
+
 private:
     static std::unordered_map<std::string, std::string>
     getExiftoolMakernotes(const Glib::ustring &path);
+    // mtime is left at 0 if the file can't be queried
+    static bool
+    getCachedMakernotes(const Glib::ustring &fname, Glib::TimeVal &mtime,
+                        std::unordered_map<std::string, std::string> &out);
+    Glib::ustring cacheKey() const;
+    void save_to(ProgressListener *pl, Exiv2::Image *dst,
+                 const Glib::ustring &path, bool preserve_all_tags,
+                 bool srgb_colorspace) const;
     void do_merge_xmp(Exiv2::Image *dst, bool keep_all) const;
     void import_exif_pairs(Exiv2::ExifData &out) const;
     void import_iptc_pairs(Exiv2::IptcData &out) const;
@@ -129,12 +159,12 @@ private:
         }
     };
     // typedef std::pair<std::shared_ptr<Exiv2::Image>, Glib::TimeVal> CacheVal;
-    typedef Cache<Glib::ustring, CacheVal> ImageCache;
+    typedef ShardedCache<Glib::ustring, CacheVal> ImageCache;
     static std::unique_ptr<ImageCache> cache_;
     typedef std::pair<std::unordered_map<std::string, std::string>,
                       Glib::TimeVal>
         JSONCacheVal;
-    typedef Cache<Glib::ustring, JSONCacheVal> JSONCache;
+    typedef ShardedCache<Glib::ustring, JSONCacheVal> JSONCache;
     static std::unique_ptr<JSONCache> jsoncache_;
 
     static std::unique_ptr<Exiftool> exiftool_;
@@ -48,7 +48,8 @@ namespace denoise {
 //
 
 void NLMeans(array2D<float> &img, float normcoeff, int strength,
-             int detail_thresh, float scale, bool multithread)
+             int detail_thresh, float scale, bool multithread,
+             const CancelToken &cancel)
 {
     if (!strength) {
         return;
@@ -166,6 +167,10 @@ void NLMeans(array2D<float> &img, float normcoeff, int strength,
 #pragma omp for schedule(dynamic, 2)
 #endif
         for (int tile = 0; tile < ntiles; ++tile) {
+            if (cancel && cancel()) {
+                continue;
+            }
+
             const int tile_y = tile / ntiles_x;
             const int tile_x = tile % ntiles_x;
 
@@ -184,30 +189,54 @@ void NLMeans(array2D<float> &img, float normcoeff, int strength,
                 return LIM(x + start_x, 0, WW - 1);
             };
 
-            const auto score = [&](int tx, int ty, int zx, int zy) -> float {
-                return SQR(src[Y(zy)][X(zx)] - src[Y(zy + ty)][X(zx + tx)]);
-            };
-
             array2D<float> St(TW, TH, ARRAY2D_ALIGNED);
             array2D<float> SW(TW, TH, ARRAY2D_ALIGNED | ARRAY2D_CLEAR_DATA);
 
             for (int ty = -search_radius; ty <= search_radius; ++ty) {
                 for (int tx = -search_radius; tx <= search_radius; ++tx) {
-                    // Step 1 — Compute the integral image St
-                    St[0][0] = 0.f;
-                    for (int xx = 1; xx < TW; ++xx) {
-                        St[0][xx] = St[0][xx - 1] + score(tx, ty, xx, 0);
-                    }
-                    for (int yy = 1; yy < TH; ++yy) {
-                        St[yy][0] = St[yy - 1][0] + score(tx, ty, 0, yy);
-                    }
-                    for (int yy = 1; yy < TH; ++yy) {
-                        for (int xx = 1; xx < TW; ++xx) {
-                            // operation grouping tuned for performance
-                            // (empirically)
-                            St[yy][xx] =
-                                (St[yy][xx - 1] + St[yy - 1][xx]) -
-                                (St[yy - 1][xx - 1] - score(tx, ty, xx, yy));
+                    // Step 1 — Compute the integral image St, one row at a
+                    // time: the squared differences are computed with SIMD
+                    // (only the columns whose shifted pixel falls outside of
+                    // src need clamping), accumulated along the row, and then
+                    // added to the previous row
+                    const int x0 = LIM(-(start_x + tx), 0, TW);
+                    const int x1 = LIM(WW - start_x - tx, x0, TW);
+                    for (int yy = 0; yy < TH; ++yy) {
+                        const float *s1 = src[Y(yy)] + start_x;
+                        const float *s2 = src[Y(yy + ty)];
+                        float *row = St[yy];
+                        for (int xx = 0; xx < x0; ++xx) {
+                            row[xx] = SQR(s1[xx] - s2[X(xx + tx)]);
+                        }
+                        int xx = x0;
+                        const int off = start_x + tx;
+#ifdef __SSE2__
+                        for (; xx < x1 - 3; xx += 4) {
+                            const vfloat d = LVFU(s1[xx]) - LVFU(s2[off + xx]);
+                            STVFU(row[xx], d * d);
+                        }
+#endif
+                        for (; xx < x1; ++xx) {
+                            row[xx] = SQR(s1[xx] - s2[off + xx]);
+                        }
+                        for (xx = x1; xx < TW; ++xx) {
+                            row[xx] = SQR(s1[xx] - s2[X(xx + tx)]);
+                        }
+
+                        for (xx = 1; xx < TW; ++xx) {
+                            row[xx] += row[xx - 1];
+                        }
+                        if (yy > 0) {
+                            const float *prev = St[yy - 1];
+                            xx = 0;
+#ifdef __SSE2__
+                            for (; xx < TW - 3; xx += 4) {
+                                STVFU(row[xx], LVFU(row[xx]) + LVFU(prev[xx]));
+                            }
+#endif
+                            for (; xx < TW; ++xx) {
+                                row[xx] += prev[xx];
+                            }
                         }
                     }
                     // Step 2 — Compute weight and estimate for patches
@@ -0,0 +1,333 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pipelineprofiler.h"
+#include "rtengine.h"
+#include "scratcharena.h"
+#include "settings.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <glib.h>
+#include <iostream>
+#include <sstream>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+constexpr size_t MAX_EVENTS = 1 << 20;
+
+double process_cpu_us()
+{
+#ifdef WIN32
+    FILETIME c, e, k, u;
+    if (GetProcessTimes(GetCurrentProcess(), &c, &e, &k, &u)) {
+        ULARGE_INTEGER kk, uu;
+        kk.LowPart = k.dwLowDateTime;
+        kk.HighPart = k.dwHighDateTime;
+        uu.LowPart = u.dwLowDateTime;
+        uu.HighPart = u.dwHighDateTime;
+        return double(kk.QuadPart + uu.QuadPart) / 10.0;
+    }
+    return 0;
+#else
+    timespec t;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t) == 0) {
+        return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+    }
+    return 0;
+#endif
+}
+
+#ifdef __linux__
+int64_t read_proc_status(const char *key)
+{
+    std::ifstream src("/proc/self/status");
+    std::string line;
+    const size_t n = strlen(key);
+    while (std::getline(src, line)) {
+        if (line.compare(0, n, key) == 0 && line.size() > n &&
+            line[n] == ':') {
+            std::istringstream s(line.substr(n + 1));
+            int64_t kb = -1;
+            s >> kb;
+            return kb >= 0 ? kb * 1024 : -1;
+        }
+    }
+    return -1;
+}
+#endif
+
+// resets the peak resident set size, and returns the current one
+int64_t reset_peak_memory()
+{
+#ifdef __linux__
+    {
+        std::ofstream clear("/proc/self/clear_refs");
+        clear << "5";
+    }
+    return read_proc_status("VmRSS");
+#else
+    return -1;
+#endif
+}
+
+int64_t get_peak_memory()
+{
+#ifdef __linux__
+    return read_proc_status("VmHWM");
+#else
+    return -1;
+#endif
+}
+
+int thread_index()
+{
+    static std::atomic<int> next(1);
+    static thread_local int idx = next++;
+    return idx;
+}
+
+} // namespace
+
+PipelineProfiler::PipelineProfiler()
+    : enabled_(false), epoch_(std::chrono::steady_clock::now()),
+      num_threads_(1)
+{
+}
+
+PipelineProfiler *PipelineProfiler::getInstance()
+{
+    static PipelineProfiler instance;
+    return &instance;
+}
+
+void PipelineProfiler::init()
+{
+    const gchar *json = g_getenv("ART_PIPELINE_PROFILE");
+    const gchar *trace = g_getenv("ART_PIPELINE_TRACE");
+    json_file_ = json ? json : "";
+    trace_file_ = trace ? trace : "";
+#ifdef _OPENMP
+    num_threads_ = std::max(omp_get_max_threads(), 1);
+#endif
+    epoch_ = std::chrono::steady_clock::now();
+    enabled_ = !json_file_.empty() || !trace_file_.empty();
+}
+
+void PipelineProfiler::add(const Event &e, double cpu_us)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (events_.size() < MAX_EVENTS && !trace_file_.empty()) {
+        events_.push_back(e);
+    }
+
+    Summary &s = summary_[e.pipeline][e.op];
+    ++s.count;
+    s.total_us += e.duration_us;
+    s.max_us = std::max(s.max_us, e.duration_us);
+    s.cpu_us += cpu_us;
+    s.peak_bytes = std::max(s.peak_bytes, e.peak_bytes);
+    s.scratch_peak_bytes =
+        std::max(s.scratch_peak_bytes, e.scratch_peak_bytes);
+    if (e.scratch_alloc_bytes > 0) {
+        s.scratch_alloc_bytes += e.scratch_alloc_bytes;
+    }
+}
+
+void PipelineProfiler::add_job_time(ProcessingTimings *timings,
+                                    const char *op, double seconds)
+{
+    // the tiles of a job can run concurrently
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto &ops = timings->operators;
+    auto it = std::find_if(ops.begin(), ops.end(),
+                           [op](const std::pair<std::string, double> &p) {
+                               return p.first == op;
+                           });
+    if (it == ops.end()) {
+        ops.emplace_back(op, seconds);
+    } else {
+        it->second += seconds;
+    }
+}
+
+void PipelineProfiler::write_json(std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    out << "{\n  \"threads\": " << num_threads_ << ",\n  \"pipelines\": {";
+    const char *psep = "\n";
+    for (auto &p : summary_) {
+        out << psep << "    \"" << p.first << "\": {";
+        const char *osep = "\n";
+        for (auto &o : p.second) {
+            const Summary &s = o.second;
+            const double util =
+                s.total_us > 0 ? s.cpu_us / (double(s.total_us) * num_threads_)
+                               : 0.0;
+            out << osep << "      \"" << o.first << "\": {"
+                << "\"count\": " << s.count
+                << ", \"total_ms\": " << s.total_us / 1000.0
+                << ", \"mean_ms\": " << s.total_us / 1000.0 / s.count
+                << ", \"max_ms\": " << s.max_us / 1000.0
+                << ", \"thread_utilisation\": " << util
+                << ", \"peak_bytes\": " << s.peak_bytes
+                << ", \"scratch_peak_bytes\": " << s.scratch_peak_bytes
+                << ", \"scratch_alloc_bytes\": " << s.scratch_alloc_bytes
+                << "}";
+            osep = ",\n";
+        }
+        out << "\n    }";
+        psep = ",\n";
+    }
+    out << "\n  }\n}\n";
+}
+
+void PipelineProfiler::write_trace(std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char *sep = "\n";
+    for (auto &e : events_) {
+        out << sep << "{\"name\": \"" << e.op << "\", \"cat\": \""
+            << e.pipeline << "\", \"ph\": \"X\", \"ts\": " << e.start_us
+            << ", \"dur\": " << e.duration_us << ", \"pid\": 1, \"tid\": "
+            << e.thread << ", \"args\": {\"thread_utilisation\": "
+            << e.utilisation << ", \"peak_bytes\": " << e.peak_bytes
+            << ", \"scratch_peak_bytes\": " << e.scratch_peak_bytes
+            << ", \"scratch_alloc_bytes\": " << e.scratch_alloc_bytes
+            << "}}";
+        sep = ",\n";
+    }
+    out << "\n]}\n";
+}
+
+void PipelineProfiler::flush()
+{
+    if (!enabled_) {
+        return;
+    }
+
+    const auto save = [](const std::string &fname,
+                         void (PipelineProfiler::*write)(std::ostream &),
+                         PipelineProfiler *self) -> void {
+        if (fname.empty()) {
+            return;
+        }
+        std::ofstream out(fname);
+        if (!out) {
+            std::cerr << "PipelineProfiler: cannot write " << fname
+                      << std::endl;
+            return;
+        }
+        (self->*write)(out);
+        if (settings->verbose) {
+            std::cout << "PipelineProfiler: saved " << fname << std::endl;
+        }
+    };
+
+    save(json_file_, &PipelineProfiler::write_json, this);
+    save(trace_file_, &PipelineProfiler::write_trace, this);
+}
+
+PipelineProfiler::Scope::Scope(const char *pipeline, const char *op,
+                               ScratchArena *arena,
+                               ProcessingTimings *timings)
+    : prof_(PipelineProfiler::getInstance()), pipeline_(pipeline), op_(op),
+      cpu_start_(0), mem_start_(-1), arena_(arena), scratch_start_(0),
+      scratch_allocated_start_(0), timings_(timings)
+{
+    if (timings_ && !prof_->enabled()) {
+        start_ = std::chrono::steady_clock::now();
+    } else if (prof_->enabled()) {
+        if (arena_) {
+            arena_->resetPeak();
+            const auto st = arena_->getStats();
+            scratch_start_ = st.in_use;
+            scratch_allocated_start_ = st.allocated;
+        }
+        mem_start_ = reset_peak_memory();
+        cpu_start_ = process_cpu_us();
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+PipelineProfiler::Scope::~Scope()
+{
+    if (!prof_->enabled() && !timings_) {
+        return;
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    if (timings_) {
+        prof_->add_job_time(
+            timings_, op_,
+            std::chrono::duration<double>(end - start_).count());
+        if (!prof_->enabled()) {
+            return;
+        }
+    }
+    const double cpu = process_cpu_us() - cpu_start_;
+    const int64_t peak = get_peak_memory();
+
+    Event e;
+    e.pipeline = pipeline_;
+    e.op = op_;
+    e.start_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                     start_ - prof_->epoch_)
+                     .count();
+    e.duration_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start_)
+            .count();
+    e.utilisation = e.duration_us > 0 ? cpu / (double(e.duration_us) *
+                                               prof_->num_threads_)
+                                      : 0.0;
+    e.peak_bytes = (peak >= 0 && mem_start_ >= 0)
+                       ? std::max(peak - mem_start_, int64_t(0))
+                       : -1;
+    e.scratch_peak_bytes = -1;
+    e.scratch_alloc_bytes = -1;
+    if (arena_) {
+        const auto st = arena_->getStats();
+        e.scratch_peak_bytes = st.peak_in_use - scratch_start_;
+        e.scratch_alloc_bytes = st.allocated - scratch_allocated_start_;
+    }
+    e.thread = thread_index();
+
+    prof_->add(e, cpu);
+}
+
+} // namespace rtengine
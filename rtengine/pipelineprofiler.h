@@ -0,0 +1,137 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rtengine {
+
+class ScratchArena;
+class ProcessingTimings;
+
+/**
+ * Runtime instrumentation of the operators executed by
+ * ImProcFunctions::process(). For every operator and pipeline it records the
+ * wall time, the thread utilisation (process CPU time over wall time times
+ * the number of threads) and the peak memory growth while the operator was
+ * running.
+ *
+ * It is enabled by setting the environment variables ART_PIPELINE_PROFILE
+ * (summary per pipeline and operator, in JSON) and/or ART_PIPELINE_TRACE
+ * (every operator run, in Chrome trace format, viewable in about:tracing or
+ * Perfetto) to the name of the file to write at exit.
+ *
+ * CPU time and memory are measured for the whole process, so they are only
+ * accurate when a single pipeline is running. The peak memory is available
+ * only on Linux, -1 is reported elsewhere. When the scope is given the
+ * ScratchArena of the pipeline, the high-water mark of the scratch planes
+ * used by the operator and the bytes that the arena had to allocate for it
+ * are recorded too.
+ *
+ * Independently of the environment, a scope given a ProcessingTimings adds
+ * the wall time of the operator to it (this is how the batch queue reports
+ * the cost of each job).
+ */
+class PipelineProfiler: public NonCopyable {
+public:
+    static PipelineProfiler *getInstance();
+
+    void init();
+    bool enabled() const { return enabled_; }
+
+    // writes the requested output files
+    void flush();
+
+    void write_json(std::ostream &out);
+    void write_trace(std::ostream &out);
+
+    class Scope: public NonCopyable {
+    public:
+        Scope(const char *pipeline, const char *op,
+              ScratchArena *arena = nullptr,
+              ProcessingTimings *timings = nullptr);
+        ~Scope();
+
+    private:
+        PipelineProfiler *prof_;
+        const char *pipeline_;
+        const char *op_;
+        std::chrono::steady_clock::time_point start_;
+        double cpu_start_;
+        int64_t mem_start_;
+        ScratchArena *arena_;
+        size_t scratch_start_;
+        size_t scratch_allocated_start_;
+        ProcessingTimings *timings_;
+    };
+
+private:
+    PipelineProfiler();
+
+    struct Event {
+        const char *pipeline;
+        const char *op;
+        int64_t start_us;
+        int64_t duration_us;
+        double utilisation;
+        int64_t peak_bytes;
+        int64_t scratch_peak_bytes;
+        int64_t scratch_alloc_bytes;
+        int thread;
+    };
+
+    struct Summary {
+        Summary(): count(0), total_us(0), max_us(0), cpu_us(0), peak_bytes(-1),
+                   scratch_peak_bytes(-1), scratch_alloc_bytes(0)
+        {
+        }
+
+        size_t count;
+        int64_t total_us;
+        int64_t max_us;
+        double cpu_us;
+        int64_t peak_bytes;
+        int64_t scratch_peak_bytes;
+        int64_t scratch_alloc_bytes;
+    };
+
+    void add(const Event &e, double cpu_us);
+    void add_job_time(ProcessingTimings *timings, const char *op,
+                      double seconds);
+
+    bool enabled_;
+    std::string json_file_;
+    std::string trace_file_;
+    std::chrono::steady_clock::time_point epoch_;
+    int num_threads_;
+
+    std::mutex mutex_;
+    std::vector<Event> events_;
+    std::map<std::string, std::map<std::string, Summary>> summary_;
+};
+
+} // namespace rtengine
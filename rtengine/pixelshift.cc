@@ -26,6 +26,7 @@
 #include "procparams.h"
 #include "rawimagesource.h"
 #include <cmath>
+#include <vector>
 // #define BENCHMARK
 #include "StopWatch.h"
 
@@ -800,58 +801,6 @@ void RawImageSource::pixelshift(int winx, int winy, int winw, int winh,
     }
 
     if (motionDetection) {
-        // fill channels psRed and psBlue
-        array2D<float> psRed(winw + 32,
-                             winh); // increase width to avoid cache conflicts
-        array2D<float> psBlue(winw + 32, winh);
-
-#ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 16)
-#endif
-
-        for (int i = winy + 1; i < winh - 1; ++i) {
-            float *nonGreenDest0 = psRed[i];
-            float *nonGreenDest1 = psBlue[i];
-            float ngbright[2][4] = {{redBrightness[0], redBrightness[1],
-                                     redBrightness[2], redBrightness[3]},
-                                    {blueBrightness[0], blueBrightness[1],
-                                     blueBrightness[2], blueBrightness[3]}};
-            int ng = 0;
-            int j = winx + 1;
-            int c = FC(i, j);
-
-            if ((c + FC(i, j + 1)) == 3) {
-                // row with blue pixels => swap destination pointers for non
-                // green pixels
-                std::swap(nonGreenDest0, nonGreenDest1);
-                ng ^= 1;
-            }
-
-            // offset to keep the code short. It changes its value between 0 and
-            // 1 for each iteration of the loop
-            unsigned int offset = c & 1;
-
-            for (; j < winw - 1; ++j) {
-                // store the non green values from the 4 frames into 2 temporary
-                // planes
-                nonGreenDest0[j] =
-                    (*rawDataFrames[(offset << 1) + offset])[i][j + offset] *
-                    ngbright[ng][(offset << 1) + offset];
-                nonGreenDest1[j] =
-                    (*rawDataFrames[2 - offset])[i + 1][j - offset + 1] *
-                    ngbright[ng ^ 1][2 - offset];
-                offset ^= 1; // 0 => 1 or 1 => 0
-            }
-        }
-
-        if (plistener) {
-            plistener->setProgress(0.3);
-        }
-
-        // now that the temporary planes are filled for easy access we do the
-        // motion detection
-        array2D<float> psMask(winw, winh);
-
         int offsX = 0, offsY = 0;
 
         if (!bayerParams.pixelShiftMedian) {
@@ -877,132 +826,239 @@ void RawImageSource::pixelshift(int winx, int winy, int winw, int winh,
             }
         }
 
+        // everything the motion mask depends on. When only the options that
+        // affect how the mask is used change (show motion, smoothing,
+        // demosaic method for the motion areas), the mask of the previous
+        // call is reused (the cache is dropped by preprocess())
+        const std::vector<float> motionKey = {
+            float(winx),
+            float(winy),
+            float(winw),
+            float(winh),
+            float(border),
+            float(offsX),
+            float(offsY),
+            eperIsoRed,
+            eperIsoGreen,
+            eperIsoBlue,
+            nRead,
+            clippedRed,
+            clippedBlue,
+            float(checkGreen),
+            float(checkNonGreenCross),
+            float(blurMap),
+            blurMap ? sigma : 0.f,
+            float(holeFill),
+            redBrightness[0],
+            redBrightness[1],
+            redBrightness[2],
+            redBrightness[3],
+            greenBrightness[0],
+            greenBrightness[1],
+            greenBrightness[2],
+            greenBrightness[3],
+            blueBrightness[0],
+            blueBrightness[1],
+            blueBrightness[2],
+            blueBrightness[3]};
+
+        const bool cached = psMotion && psMotion->key == motionKey;
+
+        if (!cached) {
+            psMotion.reset(new PixelShiftMotion());
+            // increase width to avoid cache conflicts
+            psMotion->red(winw + 32, winh);
+            psMotion->blue(winw + 32, winh);
+            psMotion->mask(winw, winh);
+            psMotion->motion(winw, winh, ARRAY2D_CLEAR_DATA);
+        }
+
+        // channels psRed and psBlue
+        array2D<float> &psRed = psMotion->red;
+        array2D<float> &psBlue = psMotion->blue;
+        array2D<float> &psMask = psMotion->mask;
+        array2D<uint8_t> &mask = psMotion->motion;
+
+        if (!cached) {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(dynamic, 16)
 #endif
 
-        for (int i = winy + border - offsY; i < winh - (border + offsY); ++i) {
-            // offset to keep the code short. It changes its value between 0 and
-            // 1 for each iteration of the loop
-            unsigned int offset = FC(i, winx + border - offsX) & 1;
-
-            for (int j = winx + border - offsX; j < winw - (border + offsX);
-                 ++j, offset ^= 1) {
-                psMask[i][j] = noMotion;
-
-                if (checkGreen) {
-                    if (greenDiff(
-                            (*rawDataFrames[1 - offset])[i - offset + 1][j] *
-                                greenBrightness[1 - offset],
-                            (*rawDataFrames[3 - offset])[i + offset][j + 1] *
-                                greenBrightness[3 - offset],
-                            stddevFactorGreen, eperIsoGreen, nRead,
-                            prnu) > 0.f) {
-                        psMask[i][j] = greenWeight;
-                        // do not set the motion pixel values. They have already
-                        // been set by demosaicer
-                        continue;
-                    }
+            for (int i = winy + 1; i < winh - 1; ++i) {
+                float *nonGreenDest0 = psRed[i];
+                float *nonGreenDest1 = psBlue[i];
+                float ngbright[2][4] = {{redBrightness[0], redBrightness[1],
+                                         redBrightness[2], redBrightness[3]},
+                                        {blueBrightness[0], blueBrightness[1],
+                                         blueBrightness[2], blueBrightness[3]}};
+                int ng = 0;
+                int j = winx + 1;
+                int c = FC(i, j);
+
+                if ((c + FC(i, j + 1)) == 3) {
+                    // row with blue pixels => swap destination pointers for non
+                    // green pixels
+                    std::swap(nonGreenDest0, nonGreenDest1);
+                    ng ^= 1;
                 }
 
-                if (checkNonGreenCross) {
-                    // check red cross
-                    float redTop = psRed[i - 1][j];
-                    float redLeft = psRed[i][j - 1];
-                    float redCentre = psRed[i][j];
-                    float redRight = psRed[i][j + 1];
-                    float redBottom = psRed[i + 1][j];
-                    float redDiff = nonGreenDiffCross(
-                        redRight, redLeft, redTop, redBottom, redCentre,
-                        clippedRed, stddevFactorRed, eperIsoRed, nRead, prnu);
-
-                    if (redDiff > 0.f) {
-                        psMask[i][j] = redBlueWeight;
-                        continue;
+                // offset to keep the code short. It changes its value between 0
+                // and 1 for each iteration of the loop
+                unsigned int offset = c & 1;
+
+                for (; j < winw - 1; ++j) {
+                    // store the non green values from the 4 frames into 2
+                    // temporary planes
+                    nonGreenDest0[j] =
+                        (*rawDataFrames[(offset << 1) + offset])[i]
+                                                                [j + offset] *
+                        ngbright[ng][(offset << 1) + offset];
+                    nonGreenDest1[j] =
+                        (*rawDataFrames[2 - offset])[i + 1][j - offset + 1] *
+                        ngbright[ng ^ 1][2 - offset];
+                    offset ^= 1; // 0 => 1 or 1 => 0
+                }
+            }
+
+            if (plistener) {
+                plistener->setProgress(0.3);
+            }
+
+            // now that the temporary planes are filled for easy access we do
+            // the motion detection
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+
+            for (int i = winy + border - offsY; i < winh - (border + offsY);
+                 ++i) {
+                // offset to keep the code short. It changes its value between 0
+                // and 1 for each iteration of the loop
+                unsigned int offset = FC(i, winx + border - offsX) & 1;
+
+                for (int j = winx + border - offsX; j < winw - (border + offsX);
+                     ++j, offset ^= 1) {
+                    psMask[i][j] = noMotion;
+
+                    if (checkGreen) {
+                        if (greenDiff((*rawDataFrames[1 - offset])
+                                              [i - offset + 1][j] *
+                                          greenBrightness[1 - offset],
+                                      (*rawDataFrames[3 - offset])[i + offset]
+                                                                  [j + 1] *
+                                          greenBrightness[3 - offset],
+                                      stddevFactorGreen, eperIsoGreen, nRead,
+                                      prnu) > 0.f) {
+                            psMask[i][j] = greenWeight;
+                            // do not set the motion pixel values. They have
+                            // already been set by demosaicer
+                            continue;
+                        }
                     }
 
-                    // check blue cross
-                    float blueTop = psBlue[i - 1][j];
-                    float blueLeft = psBlue[i][j - 1];
-                    float blueCentre = psBlue[i][j];
-                    float blueRight = psBlue[i][j + 1];
-                    float blueBottom = psBlue[i + 1][j];
-                    float blueDiff = nonGreenDiffCross(
-                        blueRight, blueLeft, blueTop, blueBottom, blueCentre,
-                        clippedBlue, stddevFactorBlue, eperIsoBlue, nRead,
-                        prnu);
-
-                    if (blueDiff > 0.f) {
-                        psMask[i][j] = redBlueWeight;
-                        continue;
+                    if (checkNonGreenCross) {
+                        // check red cross
+                        float redTop = psRed[i - 1][j];
+                        float redLeft = psRed[i][j - 1];
+                        float redCentre = psRed[i][j];
+                        float redRight = psRed[i][j + 1];
+                        float redBottom = psRed[i + 1][j];
+                        float redDiff = nonGreenDiffCross(
+                            redRight, redLeft, redTop, redBottom, redCentre,
+                            clippedRed, stddevFactorRed, eperIsoRed, nRead,
+                            prnu);
+
+                        if (redDiff > 0.f) {
+                            psMask[i][j] = redBlueWeight;
+                            continue;
+                        }
+
+                        // check blue cross
+                        float blueTop = psBlue[i - 1][j];
+                        float blueLeft = psBlue[i][j - 1];
+                        float blueCentre = psBlue[i][j];
+                        float blueRight = psBlue[i][j + 1];
+                        float blueBottom = psBlue[i + 1][j];
+                        float blueDiff = nonGreenDiffCross(
+                            blueRight, blueLeft, blueTop, blueBottom,
+                            blueCentre, clippedBlue, stddevFactorBlue,
+                            eperIsoBlue, nRead, prnu);
+
+                        if (blueDiff > 0.f) {
+                            psMask[i][j] = redBlueWeight;
+                            continue;
+                        }
                     }
                 }
             }
-        }
 
-        if (plistener) {
-            plistener->setProgress(0.45);
-        }
+            if (plistener) {
+                plistener->setProgress(0.45);
+            }
 
-        if (blurMap) {
+            if (blurMap) {
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
-            {
-                gaussianBlur(psMask, psMask, winw, winh, sigma);
-            }
-            if (plistener) {
-                plistener->setProgress(0.6);
+                {
+                    gaussianBlur(psMask, psMask, winw, winh, sigma);
+                }
+                if (plistener) {
+                    plistener->setProgress(0.6);
+                }
             }
-        }
-
-        array2D<uint8_t> mask(winw, winh, ARRAY2D_CLEAR_DATA);
 
 #ifdef _OPENMP
 #pragma omp parallel for schedule(dynamic, 16)
 #endif
 
-        for (int i = winy + border - offsY; i < winh - (border + offsY); ++i) {
-            int j = winx + border - offsX;
-            float v3sum[3] = {0.f};
+            for (int i = winy + border - offsY; i < winh - (border + offsY);
+                 ++i) {
+                int j = winx + border - offsX;
+                float v3sum[3] = {0.f};
 
-            for (int v = -1; v <= 1; v++) {
-                for (int h = -1; h < 1; h++) {
-                    v3sum[1 + h] += psMask[i + v][j + h];
+                for (int v = -1; v <= 1; v++) {
+                    for (int h = -1; h < 1; h++) {
+                        v3sum[1 + h] += psMask[i + v][j + h];
+                    }
                 }
-            }
 
-            float blocksum = v3sum[0] + v3sum[1];
+                float blocksum = v3sum[0] + v3sum[1];
 
-            for (int voffset = 2; j < winw - (border + offsX); ++j, ++voffset) {
-                float colSum = psMask[i - 1][j + 1] + psMask[i][j + 1] +
-                               psMask[i + 1][j + 1];
-                voffset =
-                    voffset == 3 ? 0 : voffset; // faster than voffset %= 3;
-                blocksum -= v3sum[voffset];
-                blocksum += colSum;
-                v3sum[voffset] = colSum;
+                for (int voffset = 2; j < winw - (border + offsX);
+                     ++j, ++voffset) {
+                    float colSum = psMask[i - 1][j + 1] + psMask[i][j + 1] +
+                                   psMask[i + 1][j + 1];
+                    voffset =
+                        voffset == 3 ? 0 : voffset; // faster than voffset %= 3;
+                    blocksum -= v3sum[voffset];
+                    blocksum += colSum;
+                    v3sum[voffset] = colSum;
 
-                if (blocksum >= threshold) {
-                    mask[i][j] = 255;
+                    if (blocksum >= threshold) {
+                        mask[i][j] = 255;
+                    }
                 }
             }
-        }
 
-        if (plistener) {
-            plistener->setProgress(0.75);
-        }
+            if (plistener) {
+                plistener->setProgress(0.75);
+            }
+
+            if (holeFill) {
+                array2D<uint8_t> maskInv(winw, winh);
+                invertMask(winx + border - offsX, winw - (border + offsX),
+                           winy + border - offsY, winh - (border + offsY), mask,
+                           maskInv);
+                floodFill4(winx + border - offsX, winw - (border + offsX),
+                           winy + border - offsY, winh - (border + offsY),
+                           maskInv);
+                xorMasks(winx + border - offsX, winw - (border + offsX),
+                         winy + border - offsY, winh - (border + offsY),
+                         maskInv, mask);
+            }
 
-        if (holeFill) {
-            array2D<uint8_t> maskInv(winw, winh);
-            invertMask(winx + border - offsX, winw - (border + offsX),
-                       winy + border - offsY, winh - (border + offsY), mask,
-                       maskInv);
-            floodFill4(winx + border - offsX, winw - (border + offsX),
-                       winy + border - offsY, winh - (border + offsY), maskInv);
-            xorMasks(winx + border - offsX, winw - (border + offsX),
-                     winy + border - offsY, winh - (border + offsY), maskInv,
-                     mask);
+            psMotion->key = motionKey;
         }
 
         if (plistener) {
@@ -1010,104 +1066,121 @@ void RawImageSource::pixelshift(int winx, int winy, int winw, int winh,
         }
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 16)
+#pragma omp parallel
 #endif
-
-        for (int i = winy + border - offsY; i < winh - (border + offsY); ++i) {
+        {
 #ifdef __SSE2__
+            // blend factors of the current row. psMask is not modified, to keep
+            // it reusable
+            std::vector<float> blendRow(smoothTransitions ? winw : 0);
+#endif
 
-            // pow() is expensive => pre calculate blend factor using SSE
-            if (smoothTransitions) { //
-                vfloat onev = F2V(1.f);
-                vfloat smoothv = F2V(smoothFactor);
-                int j = winx + border - offsX;
-
-                for (; j < winw - (border + offsX) - 3; j += 4) {
-                    vfloat blendv = vmaxf(LVFU(psMask[i][j]), onev) - onev;
-                    blendv = pow_F(blendv, smoothv);
-                    blendv = vself(vmaskf_eq(smoothv, ZEROV), onev, blendv);
-                    STVFU(psMask[i][j], blendv);
-                }
-
-                for (; j < winw - (border + offsX); ++j) {
-                    psMask[i][j] =
-                        smoothFactor == 0.f
-                            ? 1.f
-                            : pow_F(std::max(psMask[i][j] - 1.f, 0.f),
-                                    smoothFactor);
-                }
-            }
-
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
 #endif
-            float *greenDest = green[i + offsY];
-            float *redDest = red[i + offsY];
-            float *blueDest = blue[i + offsY];
 
-            // offset to keep the code short. It changes its value between 0 and
-            // 1 for each iteration of the loop
-            unsigned int offset = FC(i, winx + border - offsX) & 1;
-
-            for (int j = winx + border - offsX; j < winw - (border + offsX);
-                 ++j, offset ^= 1) {
-                if (showOnlyMask) {
-                    if (smoothTransitions) { // we want only motion mask =>
-                                             // paint areas according to their
-                                             // motion (dark = no motion, bright
-                                             // = motion)
+            for (int i = winy + border - offsY; i < winh - (border + offsY);
+                 ++i) {
 #ifdef __SSE2__
-                        // use pre calculated blend factor
-                        const float blend = psMask[i][j];
-#else
-                        const float blend =
+
+                // pow() is expensive => pre calculate blend factor using SSE
+                if (smoothTransitions) { //
+                    vfloat onev = F2V(1.f);
+                    vfloat smoothv = F2V(smoothFactor);
+                    int j = winx + border - offsX;
+
+                    for (; j < winw - (border + offsX) - 3; j += 4) {
+                        vfloat blendv = vmaxf(LVFU(psMask[i][j]), onev) - onev;
+                        blendv = pow_F(blendv, smoothv);
+                        blendv = vself(vmaskf_eq(smoothv, ZEROV), onev, blendv);
+                        STVFU(blendRow[j], blendv);
+                    }
+
+                    for (; j < winw - (border + offsX); ++j) {
+                        blendRow[j] =
                             smoothFactor == 0.f
                                 ? 1.f
                                 : pow_F(std::max(psMask[i][j] - 1.f, 0.f),
                                         smoothFactor);
-#endif
-                        redDest[j + offsX] = greenDest[j + offsX] =
-                            blueDest[j + offsX] = blend * 32768.f;
-                    } else {
-                        redDest[j + offsX] = greenDest[j + offsX] =
-                            blueDest[j + offsX] =
-                                mask[i][j] == 255 ? 65535.f : 0.f;
                     }
-                } else if (mask[i][j] == 255) {
-                    paintMotionMask(j + offsX, showMotion, greenDest, redDest,
-                                    blueDest);
-                } else {
-                    if (smoothTransitions) {
+                }
+
+#endif
+                float *greenDest = green[i + offsY];
+                float *redDest = red[i + offsY];
+                float *blueDest = blue[i + offsY];
+
+                // offset to keep the code short. It changes its value between 0
+                // and 1 for each iteration of the loop
+                unsigned int offset = FC(i, winx + border - offsX) & 1;
+
+                for (int j = winx + border - offsX; j < winw - (border + offsX);
+                     ++j, offset ^= 1) {
+                    if (showOnlyMask) {
+                        if (smoothTransitions) {
+                            // we want only motion mask => paint areas
+                            // according to their motion (dark = no motion,
+                            // bright = motion)
 #ifdef __SSE2__
-                        // use pre calculated blend factor
-                        const float blend = psMask[i][j];
+                            // use pre calculated blend factor
+                            const float blend = blendRow[j];
 #else
-                        const float blend =
-                            smoothFactor == 0.f
-                                ? 1.f
-                                : pow_F(std::max(psMask[i][j] - 1.f, 0.f),
-                                        smoothFactor);
+                            const float blend =
+                                smoothFactor == 0.f
+                                    ? 1.f
+                                    : pow_F(std::max(psMask[i][j] - 1.f, 0.f),
+                                            smoothFactor);
 #endif
-                        redDest[j + offsX] =
-                            intp(blend, showMotion ? 0.f : redDest[j + offsX],
-                                 psRed[i][j]);
-                        greenDest[j + offsX] = intp(
-                            blend, showMotion ? 13500.f : greenDest[j + offsX],
-                            ((*rawDataFrames[1 - offset])[i - offset + 1][j] *
-                                 greenBrightness[1 - offset] +
-                             (*rawDataFrames[3 - offset])[i + offset][j + 1] *
-                                 greenBrightness[3 - offset]) *
-                                0.5f);
-                        blueDest[j + offsX] =
-                            intp(blend, showMotion ? 0.f : blueDest[j + offsX],
-                                 psBlue[i][j]);
+                            redDest[j + offsX] = greenDest[j + offsX] =
+                                blueDest[j + offsX] = blend * 32768.f;
+                        } else {
+                            redDest[j + offsX] = greenDest[j + offsX] =
+                                blueDest[j + offsX] =
+                                    mask[i][j] == 255 ? 65535.f : 0.f;
+                        }
+                    } else if (mask[i][j] == 255) {
+                        paintMotionMask(j + offsX, showMotion, greenDest,
+                                        redDest, blueDest);
                     } else {
-                        redDest[j + offsX] = psRed[i][j];
-                        greenDest[j + offsX] =
-                            ((*rawDataFrames[1 - offset])[i - offset + 1][j] *
-                                 greenBrightness[1 - offset] +
-                             (*rawDataFrames[3 - offset])[i + offset][j + 1] *
-                                 greenBrightness[3 - offset]) *
-                            0.5f;
-                        blueDest[j + offsX] = psBlue[i][j];
+                        if (smoothTransitions) {
+#ifdef __SSE2__
+                            // use pre calculated blend factor
+                            const float blend = blendRow[j];
+#else
+                            const float blend =
+                                smoothFactor == 0.f
+                                    ? 1.f
+                                    : pow_F(std::max(psMask[i][j] - 1.f, 0.f),
+                                            smoothFactor);
+#endif
+                            redDest[j + offsX] = intp(
+                                blend, showMotion ? 0.f : redDest[j + offsX],
+                                psRed[i][j]);
+                            greenDest[j + offsX] = intp(
+                                blend,
+                                showMotion ? 13500.f : greenDest[j + offsX],
+                                ((*rawDataFrames[1 - offset])[i - offset + 1]
+                                                             [j] *
+                                     greenBrightness[1 - offset] +
+                                 (*rawDataFrames[3 - offset])[i + offset]
+                                                             [j + 1] *
+                                     greenBrightness[3 - offset]) *
+                                    0.5f);
+                            blueDest[j + offsX] = intp(
+                                blend, showMotion ? 0.f : blueDest[j + offsX],
+                                psBlue[i][j]);
+                        } else {
+                            redDest[j + offsX] = psRed[i][j];
+                            greenDest[j + offsX] =
+                                ((*rawDataFrames[1 - offset])[i - offset + 1]
+                                                             [j] *
+                                     greenBrightness[1 - offset] +
+                                 (*rawDataFrames[3 - offset])[i + offset]
+                                                             [j + 1] *
+                                     greenBrightness[3 - offset]) *
+                                0.5f;
+                            blueDest[j + offsX] = psBlue[i][j];
+                        }
                     }
                 }
             }
@@ -0,0 +1,293 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "planepool.h"
+#include "memoryusage.h"
+#include "settings.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <glib/gstdio.h>
+#include <glibmm.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+constexpr std::chrono::seconds MAX_IDLE_TIME(60);
+
+int highest_bit(size_t v)
+{
+    int ret = 0;
+    while (v >>= 1) {
+        ++ret;
+    }
+    return ret;
+}
+
+size_t memory_limit()
+{
+    return settings ? size_t(std::max(settings->plane_pool_memory_limit, 0)) *
+                          1024 * 1024
+                    : 0;
+}
+
+size_t swap_threshold()
+{
+    return settings ? size_t(std::max(settings->plane_swap_threshold, 0)) *
+                          1024 * 1024
+                    : 0;
+}
+
+// creates a file of the given size in the swap directory, and maps it in
+// memory. The file is deleted (on Windows, when the mapping is closed) so
+// that nothing is left behind if the process dies
+void *map_temp_file(size_t size)
+{
+    const std::string dir = settings->plane_swap_dir.empty()
+                                ? Glib::get_tmp_dir()
+                                : std::string(settings->plane_swap_dir);
+    const std::string templ = Glib::build_filename(dir, "ART-plane-XXXXXX");
+    std::vector<char> name(templ.begin(), templ.end());
+    name.push_back(0);
+
+    int fd = g_mkstemp(name.data());
+    if (fd < 0) {
+        return nullptr;
+    }
+
+#ifdef WIN32
+    close(fd);
+    std::unique_ptr<wchar_t, GFreeFunc> wname(
+        reinterpret_cast<wchar_t *>(
+            g_utf8_to_utf16(name.data(), -1, NULL, NULL, NULL)),
+        g_free);
+    HANDLE file = CreateFileW(wname.get(), GENERIC_READ | GENERIC_WRITE, 0,
+                              NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY |
+                                  FILE_FLAG_DELETE_ON_CLOSE,
+                              NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        g_unlink(name.data());
+        return nullptr;
+    }
+    // the mapping and the view keep the file alive
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READWRITE,
+                                       DWORD(uint64_t(size) >> 32),
+                                       DWORD(size & 0xffffffff), NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return nullptr;
+    }
+    void *ret = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CloseHandle(mapping);
+    return ret;
+#else
+    g_unlink(name.data());
+#ifdef __APPLE__
+    const bool ok = ftruncate(fd, size) == 0;
+#else
+    // reserve the disk space now, rather than failing on a page fault later
+    const bool ok = posix_fallocate(fd, 0, size) == 0;
+#endif
+    void *ret = ok ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fd, 0)
+                   : MAP_FAILED;
+    close(fd);
+    return ret == MAP_FAILED ? nullptr : ret;
+#endif
+}
+
+void unmap_temp_file(void *block, size_t size)
+{
+#ifdef WIN32
+    UnmapViewOfFile(block);
+#else
+    munmap(block, size);
+#endif
+}
+
+} // namespace
+
+PlanePool *PlanePool::getInstance()
+{
+    // never destroyed, as buffers can be freed during the static destruction
+    static PlanePool *instance = new PlanePool();
+    return instance;
+}
+
+size_t PlanePool::size_class(size_t size)
+{
+    const size_t step = size_t(1) << std::max(highest_bit(size) - 3, 0);
+    return (size + step - 1) / step * step;
+}
+
+void *PlanePool::acquire(size_t size, size_t &capacity, bool &fresh)
+{
+    const size_t c = size_class(size);
+    const size_t limit = memory_limit();
+    const size_t swap = swap_threshold();
+
+    if (swap && c >= swap) {
+        void *ret = map_temp_file(c);
+        if (ret) {
+            capacity = c;
+            // the pages are not touched in advance, so that they are
+            // brought in only when needed
+            fresh = false;
+            MemoryUsage::account(c);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            file_backed_.insert(ret);
+            stats_.in_use += c;
+            stats_.file_backed += c;
+            stats_.peak = std::max(stats_.peak, stats_.in_use + stats_.idle);
+            ++stats_.misses;
+            return ret;
+        } else if (settings->verbose) {
+            std::cout << "PlanePool: could not map a temporary file of "
+                      << (c >> 20) << " MB in "
+                      << (settings->plane_swap_dir.empty()
+                              ? Glib::get_tmp_dir()
+                              : std::string(settings->plane_swap_dir))
+                      << std::endl;
+        }
+    }
+
+    if (limit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = idle_.lower_bound(c);
+        if (it != idle_.end() && it->first <= 2 * c) {
+            void *ret = it->second.ptr;
+            capacity = it->first;
+            fresh = false;
+            idle_.erase(it);
+            stats_.idle -= capacity;
+            stats_.in_use += capacity;
+            ++stats_.hits;
+            MemoryUsage::account(capacity);
+            return ret;
+        }
+    }
+
+    void *ret = malloc(c);
+    if (!ret) {
+        // retry without the memory kept for reuse
+        trim();
+        ret = malloc(c);
+        if (!ret) {
+            return nullptr;
+        }
+    }
+    capacity = c;
+    fresh = true;
+    MemoryUsage::account(c);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.in_use += c;
+    stats_.peak = std::max(stats_.peak, stats_.in_use + stats_.idle);
+    ++stats_.misses;
+    return ret;
+}
+
+void PlanePool::release(void *block, size_t capacity)
+{
+    const size_t limit = memory_limit();
+    MemoryUsage::account(-int64_t(capacity));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.in_use -= capacity;
+    if (file_backed_.erase(block)) {
+        unmap_temp_file(block, capacity);
+        stats_.file_backed -= capacity;
+    } else if (capacity > limit) {
+        free(block);
+        stats_.trimmed += capacity;
+    } else {
+        idle_.emplace(capacity, Block{block, Clock::now()});
+        stats_.idle += capacity;
+    }
+    evict(limit);
+}
+
+void PlanePool::evict(size_t limit)
+{
+    const auto now = Clock::now();
+    for (auto it = idle_.begin(); it != idle_.end();) {
+        if (now - it->second.released > MAX_IDLE_TIME) {
+            free(it->second.ptr);
+            stats_.idle -= it->first;
+            stats_.trimmed += it->first;
+            it = idle_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // drop the least recently used blocks first
+    while (stats_.idle > limit) {
+        auto oldest = idle_.begin();
+        for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+            if (it->second.released < oldest->second.released) {
+                oldest = it;
+            }
+        }
+        free(oldest->second.ptr);
+        stats_.idle -= oldest->first;
+        stats_.trimmed += oldest->first;
+        idle_.erase(oldest);
+    }
+}
+
+PlanePool::Stats PlanePool::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void PlanePool::trim()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    evict(0);
+}
+
+void PlanePool::cleanup()
+{
+    trim();
+    if (settings && settings->verbose) {
+        const auto st = getStats();
+        std::cout << "PlanePool: " << st.hits << " hits, " << st.misses
+                  << " misses, peak " << (st.peak >> 20) << " MB, "
+                  << (st.trimmed >> 20) << " MB trimmed" << std::endl;
+    }
+}
+
+} // namespace rtengine
@@ -0,0 +1,105 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace rtengine {
+
+/**
+ * Process-wide pool of the large memory blocks of AlignedBuffer (and so of
+ * array2D and of the planes of the images), so that the buffers allocated
+ * and freed at every update of the pipelines reuse pages which are already
+ * mapped, instead of getting fresh ones from the OS (which have to be
+ * faulted in and zeroed) every time.
+ *
+ * Blocks are grouped in size classes (8 per power of two); a request is
+ * served by the smallest idle block of the same or of a larger class, up to
+ * twice its size. The idle blocks are bounded by
+ * settings->plane_pool_memory_limit; the ones exceeding it, and the ones
+ * unused for more than a minute, are given back to the OS.
+ *
+ * Blocks of at least settings->plane_swap_threshold MB are instead mapped
+ * from (already deleted) temporary files in settings->plane_swap_dir, so
+ * that the OS can page them out to disk when RAM runs short, instead of the
+ * allocation failing. They are meant for huge images (e.g. stitched
+ * panoramas), processed in tiles so that only a part of each plane is
+ * paged in at any time. They are never kept for reuse.
+ */
+class PlanePool: public NonCopyable {
+public:
+    /// smaller blocks are left to malloc
+    static constexpr size_t MIN_SIZE = size_t(1) << 20;
+
+    struct Stats {
+        Stats():
+            in_use(0), idle(0), peak(0), hits(0), misses(0), trimmed(0),
+            file_backed(0)
+        {
+        }
+
+        size_t in_use;      // bytes of the blocks currently handed out
+        size_t idle;        // bytes of the blocks kept for reuse
+        size_t peak;        // high-water mark of in_use + idle
+        size_t hits;        // requests served by an idle block
+        size_t misses;      // requests that needed a new block
+        size_t trimmed;     // bytes given back to the OS
+        size_t file_backed; // bytes of the blocks in use mapped from files
+    };
+
+    static PlanePool *getInstance();
+
+    /** returns a block of at least size bytes, whose actual size is stored
+        in capacity; fresh is set if the block was not reused (and is not
+        file-backed). nullptr if the allocation fails */
+    void *acquire(size_t size, size_t &capacity, bool &fresh);
+    void release(void *block, size_t capacity);
+
+    Stats getStats() const;
+    /// gives all the idle blocks back to the OS
+    void trim();
+    void cleanup();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Block {
+        void *ptr;
+        Clock::time_point released;
+    };
+
+    PlanePool() = default;
+
+    static size_t size_class(size_t size);
+    // frees the blocks exceeding the limit or too old; called with the
+    // mutex locked
+    void evict(size_t limit);
+
+    mutable std::mutex mutex_;
+    std::multimap<size_t, Block> idle_;
+    std::set<void *> file_backed_;
+    Stats stats_;
+};
+
+} // namespace rtengine
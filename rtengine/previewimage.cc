@@ -40,10 +40,32 @@ PreviewImage::PreviewImage(const Glib::ustring &fname, const Glib::ustring &ext,
                            bool compute_histogram)
     : fname_(fname), ext_(ext), width_(width), height_(height),
       enable_cms_(enable_cms), compute_histogram_(compute_histogram),
-      loaded_(false), imgprof_(nullptr)
+      loaded_(false), use_region_(false), region_(), imgprof_(nullptr)
 {
 }
 
+void PreviewImage::setRegion(double center_x, double center_y,
+                             int view_width, int view_height)
+{
+    use_region_ = view_width > 0 && view_height > 0;
+    region_.center_x = LIM01(center_x);
+    region_.center_y = LIM01(center_y);
+    region_.width = view_width;
+    region_.height = view_height;
+}
+
+void PreviewImage::getRegion(int &x, int &y, int &full_width,
+                             int &full_height)
+{
+    if (!loaded_) {
+        load();
+    }
+    x = region_.x;
+    y = region_.y;
+    full_width = region_.full_width;
+    full_height = region_.full_height;
+}
+
 PreviewImage::~PreviewImage()
 {
     if (imgprof_) {
@@ -134,6 +156,12 @@ void PreviewImage::load()
         img_.reset(load_img(fname_, width_, height_));
     }
 
+    if (img_ && region_.full_width <= 0) {
+        region_.x = region_.y = 0;
+        region_.full_width = img_->getWidth();
+        region_.full_height = img_->getHeight();
+    }
+
     if (img_) {
         try {
             previewImage = Cairo::ImageSurface::create(
@@ -158,6 +186,14 @@ Cairo::RefPtr<Cairo::ImageSurface> PreviewImage::getImage()
     return previewImage;
 }
 
+bool PreviewImage::saveJPEG(const Glib::ustring &fname, int quality)
+{
+    if (!loaded_) {
+        load();
+    }
+    return img_ && img_->saveJPEG(fname, quality) == 0;
+}
+
 Image8 *PreviewImage::load_img(const Glib::ustring &fname, int w, int h)
 {
     StdImageSource imgSrc;
@@ -257,6 +293,68 @@ void PreviewImage::getHistogram(LUTu &r, LUTu &g, LUTu &b)
     b = hist_[2];
 }
 
+// decodes only the part of the embedded preview shown by the view set with
+// setRegion(), whose coordinates are given in the orientation of the
+// displayed image
+Image8 *PreviewImage::load_raw_preview_region(RawImage &ri, int rotate)
+{
+    ImageIO::Region r = region_;
+    // see Image8::rotate()
+    switch (rotate) {
+    case 90:
+        r.center_x = region_.center_y;
+        r.center_y = 1.0 - region_.center_x;
+        std::swap(r.width, r.height);
+        break;
+    case 180:
+        r.center_x = 1.0 - region_.center_x;
+        r.center_y = 1.0 - region_.center_y;
+        break;
+    case 270:
+        r.center_x = 1.0 - region_.center_y;
+        r.center_y = region_.center_x;
+        std::swap(r.width, r.height);
+        break;
+    default:
+        break;
+    }
+
+    Image8 *img = ri.getThumbnail(0, 0, &r);
+    if (!img) {
+        return nullptr;
+    }
+
+    const int W = r.full_width, H = r.full_height;
+    switch (rotate) {
+    case 90:
+        region_.x = H - r.y - r.height;
+        region_.y = r.x;
+        break;
+    case 180:
+        region_.x = W - r.x - r.width;
+        region_.y = H - r.y - r.height;
+        break;
+    case 270:
+        region_.x = r.y;
+        region_.y = W - r.x - r.width;
+        break;
+    default:
+        region_.x = r.x;
+        region_.y = r.y;
+        break;
+    }
+    const bool swap = rotate == 90 || rotate == 270;
+    region_.full_width = swap ? H : W;
+    region_.full_height = swap ? W : H;
+    if (rotate) {
+        img->rotate(rotate);
+    }
+    region_.width = img->getWidth();
+    region_.height = img->getHeight();
+
+    return img;
+}
+
 Image8 *PreviewImage::load_raw_preview(const Glib::ustring &fname, int w, int h)
 {
     RawImage ri(fname);
@@ -267,7 +365,16 @@ Image8 *PreviewImage::load_raw_preview(const Glib::ustring &fname, int w, int h)
         return nullptr;
     }
 
-    Image8 *img = ri.getThumbnail();
+    const int rotate = ri.thumbNeedsRotation() ? ri.get_rotateDegree() : 0;
+    if (rotate == 90 || rotate == 270) {
+        std::swap(w, h);
+    }
+
+    if (use_region_ && w <= 0 && h <= 0 && !compute_histogram_) {
+        return load_raw_preview_region(ri, rotate);
+    }
+
+    Image8 *img = ri.getThumbnail(w, h);
     if (!img) {
         return nullptr;
     }
@@ -275,10 +382,6 @@ Image8 *PreviewImage::load_raw_preview(const Glib::ustring &fname, int w, int h)
     if (w > 0 && h > 0) {
         double fw = img->getWidth();
         double fh = img->getHeight();
-        if ((ri.get_rotateDegree() == 90 || ri.get_rotateDegree() == 270) &&
-            ri.thumbNeedsRotation()) {
-            std::swap(w, h);
-        }
         double sw = std::max(fw / w, 1.0);
         double sh = std::max(fh / h, 1.0);
         if (sw > sh) {
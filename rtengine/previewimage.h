@@ -20,12 +20,15 @@
 #pragma once
 
 #include "image8.h"
+#include "imageio.h"
 #include <cairomm/cairomm.h>
 #include <gtkmm.h>
 #include <memory>
 
 namespace rtengine {
 
+class RawImage;
+
 /** @brief Get a quick preview image out of a raw or standard file
  *
  * This class reads the full size preview image (at least the biggest one
@@ -41,13 +44,29 @@ public:
                  bool compute_histogram = false);
     ~PreviewImage();
 
+    /// when loading the embedded preview of a raw file at full size (width
+    /// and height not given), only decode the part needed by a view of
+    /// view_width x view_height pixels centered at (center_x, center_y),
+    /// relative to the image size. It is ignored when computing the
+    /// histogram, which needs the whole image. Must be called before
+    /// getImage()
+    void setRegion(double center_x, double center_y, int view_width,
+                   int view_height);
+    /// the position of the loaded image in the whole image, and the size of
+    /// the latter
+    void getRegion(int &x, int &y, int &full_width, int &full_height);
+
     Cairo::RefPtr<Cairo::ImageSurface> getImage();
     void getHistogram(LUTu &r, LUTu &g, LUTu &b);
+    /// saves the preview (without monitor color management) as a JPEG
+    /// file. Returns false on errors
+    bool saveJPEG(const Glib::ustring &fname, int quality);
 
 private:
     void load();
     Image8 *load_raw(const Glib::ustring &fname, int width, int height);
     Image8 *load_raw_preview(const Glib::ustring &fname, int width, int height);
+    Image8 *load_raw_preview_region(RawImage &ri, int rotate);
     Image8 *load_img(const Glib::ustring &fname, int width, int height);
     void render(bool enable_cms);
     void get_histogram(Image8 *img);
@@ -59,6 +78,8 @@ private:
     bool enable_cms_;
     bool compute_histogram_;
     bool loaded_;
+    bool use_region_;
+    ImageIO::Region region_;
 
     std::unique_ptr<Image8> img_;
     Cairo::RefPtr<Cairo::ImageSurface> previewImage;
@@ -17,6 +17,7 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <map>
@@ -237,6 +238,111 @@ Glib::ustring KeyFile::to_data() { return kf_.to_data(); }
 
 namespace {
 
+// layout: magic, version, number of groups, then for each group its name,
+// number of keys and (key, raw value) pairs. Integers are 32 bits in native
+// byte order, strings are length-prefixed
+constexpr char binary_magic[4] = {'A', 'R', 'P', 'B'};
+constexpr uint32_t binary_version = 1;
+
+void put_u32(std::string &out, uint32_t v)
+{
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+void put_str(std::string &out, const std::string &s)
+{
+    put_u32(out, s.size());
+    out.append(s);
+}
+
+bool get_u32(const std::string &in, size_t &pos, uint32_t &v)
+{
+    if (in.size() - pos < sizeof(v)) {
+        return false;
+    }
+    std::memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
+
+bool get_str(const std::string &in, size_t &pos, std::string &s)
+{
+    uint32_t n;
+    if (!get_u32(in, pos, n) || in.size() - pos < n) {
+        return false;
+    }
+    s.assign(in, pos, n);
+    pos += n;
+    return true;
+}
+
+} // namespace
+
+bool KeyFile::load_from_binary(const std::string &data)
+{
+    if (data.size() < sizeof(binary_magic) ||
+        data.compare(0, sizeof(binary_magic), binary_magic,
+                     sizeof(binary_magic)) != 0) {
+        return false;
+    }
+    size_t pos = sizeof(binary_magic);
+    uint32_t version, ngroups;
+    if (!get_u32(data, pos, version) || version != binary_version ||
+        !get_u32(data, pos, ngroups)) {
+        return false;
+    }
+
+    struct Entry {
+        std::string group;
+        std::string key;
+        std::string value;
+    };
+    std::vector<Entry> entries;
+    std::string group;
+    for (uint32_t i = 0; i < ngroups; ++i) {
+        uint32_t nkeys;
+        if (!get_str(data, pos, group) || !get_u32(data, pos, nkeys)) {
+            return false;
+        }
+        for (uint32_t j = 0; j < nkeys; ++j) {
+            entries.push_back({group, "", ""});
+            auto &e = entries.back();
+            if (!get_str(data, pos, e.key) || !get_str(data, pos, e.value)) {
+                return false;
+            }
+        }
+    }
+    if (pos != data.size()) {
+        return false;
+    }
+
+    for (const auto &e : entries) {
+        kf_.set_value(e.group, e.key, e.value);
+    }
+    return true;
+}
+
+std::string KeyFile::to_binary() const
+{
+    std::string out(binary_magic, sizeof(binary_magic));
+    put_u32(out, binary_version);
+
+    auto groups = kf_.get_groups();
+    put_u32(out, groups.size());
+    for (const auto &group : groups) {
+        auto keys = kf_.get_keys(group);
+        put_str(out, group.raw());
+        put_u32(out, keys.size());
+        for (const auto &key : keys) {
+            put_str(out, key.raw());
+            put_str(out, kf_.get_value(group, key).raw());
+        }
+    }
+    return out;
+}
+
+namespace {
+
 Glib::ustring expandRelativePath(const Glib::ustring &procparams_fname,
                                  const Glib::ustring &prefix,
                                  Glib::ustring embedded_fname)
@@ -1246,8 +1352,8 @@ bool Mask::load(int ppVersion, const KeyFile &keyfile,
             std::vector<double> vv = unpack_list(raw);
             drawnMask.strokes_from_list(vv);
             if (ppVersion < 1022 && !drawnMask.strokes.empty()) {
-                std::vector<DrawnMask::Stroke> stmp;
-                stmp.swap(drawnMask.strokes);
+                std::vector<DrawnMask::Stroke> stmp = drawnMask.strokes;
+                drawnMask.strokes.clear();
                 drawnMask.strokes.push_back(stmp[0]);
                 for (size_t i = 1; i < stmp.size(); ++i) {
                     auto &p = drawnMask.strokes.back();
@@ -6332,6 +6438,37 @@ std::string ProcParams::to_data() const
     }
 }
 
+bool ProcParams::from_binary(const std::string &data,
+                             const Glib::ustring &fname)
+{
+    setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
+    try {
+        KeyFile kf;
+        if (!kf.load_from_binary(data)) {
+            return false;
+        }
+
+        return load(nullptr, kf, nullptr, true, fname) == 0;
+    } catch (const Glib::Error &e) {
+        return false;
+    }
+}
+
+std::string ProcParams::to_binary(const Glib::ustring &fname) const
+{
+    try {
+        KeyFile kf;
+        int ret = save(nullptr, kf, nullptr, fname);
+        if (ret != 0) {
+            return "";
+        }
+
+        return kf.to_binary();
+    } catch (Glib::KeyFileError &exc) {
+        return "";
+    }
+}
+
 std::vector<const MaskableParams *> ProcParams::get_maskable() const
 {
     std::vector<const MaskableParams *> ret = {&colorcorrection, &smoothing,
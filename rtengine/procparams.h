@@ -32,6 +32,7 @@
 #include "../rtgui/paramsedited.h"
 #include "clutparams.h"
 #include "coord.h"
+#include "cowvector.h"
 #include "noncopyable.h"
 
 class ParamsEdited;
@@ -94,6 +95,11 @@ public:
     bool load_from_data(const Glib::ustring &data);
     Glib::ustring to_data();
 
+    /** compact binary form of the raw key values (without comments), for
+        internal caches only: the text form is the interchange format */
+    bool load_from_binary(const std::string &data);
+    std::string to_binary() const;
+
     Glib::ustring get_prefix() const { return prefix_; }
     void set_prefix(const Glib::ustring &prefix) { prefix_ = prefix; }
 
@@ -237,7 +243,7 @@ struct DrawnMask {
     double opacity;               // [0,1] (1 = opaque, 0 = fully transparent)
     double smoothness;            // [0,1] (0 = harsh edges, 1 = fully blurred)
     std::vector<double> contrast; // curve
-    std::vector<Stroke> strokes;
+    CowVector<Stroke> strokes;
     enum Mode { INTERSECT, ADD, ADD_BOUNDED };
     Mode mode;
 
@@ -1111,7 +1117,7 @@ struct SpotEntry {
  */
 struct SpotParams {
     bool enabled;
-    std::vector<SpotEntry> entries;
+    CowVector<SpotEntry> entries;
 
     // the following constant can be used for experimentation before the final
     // merge
@@ -1667,6 +1673,11 @@ public:
     bool from_data(const char *data);
     std::string to_data() const;
 
+    /** binary counterparts of the above, see KeyFile::to_binary. fname is
+        used to resolve the relative paths, as in load and save */
+    bool from_binary(const std::string &data, const Glib::ustring &fname = "");
+    std::string to_binary(const Glib::ustring &fname = "") const;
+
     std::vector<const MaskableParams *> get_maskable() const;
 
 private:
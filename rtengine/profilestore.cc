@@ -20,15 +20,43 @@
 
 #include "../rtgui/multilangmgr.h"
 #include "../rtgui/options.h"
+#include "../rtgui/ppversion.h"
 #include "dynamicprofile.h"
+#include <glib/gstdio.h>
 
 using namespace rtengine;
 using namespace rtengine::procparams;
 
+namespace {
+
+constexpr size_t DYNAMIC_PROFILE_CACHE_SIZE = 16;
+
+// version of the profile, without loading it completely (that is done on
+// first use). Returns -1 if fname is not a valid profile
+int get_profile_version(const Glib::ustring &fname)
+{
+    try {
+        KeyFile kf;
+        if (!kf.load_from_file(fname)) {
+            return -1;
+        }
+        if (kf.has_key("Version", "Version")) {
+            return kf.get_integer("Version", "Version");
+        }
+        return PPVERSION;
+    } catch (std::exception &) {
+        return -1;
+    } catch (Glib::Error &) {
+        return -1;
+    }
+}
+
+} // namespace
+
 ProfileStore::ProfileStore()
     : storeState(STORESTATE_NOTINITIALIZED), internalDefaultProfile(nullptr),
       internalDefaultEntry(nullptr), internalDynamicEntry(nullptr),
-      loadAll(true), pl_(nullptr)
+      loadAll(true), pl_(nullptr), dynamicCache(DYNAMIC_PROFILE_CACHE_SIZE)
 {
 }
 
@@ -250,11 +278,9 @@ bool ProfileStore::parseDir(Glib::ustring &realPath, Glib::ustring &virtualPath,
 
                     Glib::ustring name = currDir.substr(0, lastdot);
 
-                    // create the partial profile
-                    rtengine::procparams::ProcParams pp;
-                    int res = pp.load(pl_, fname);
-
-                    if (!res && pp.ppVersion >= 220) {
+                    // only the version is checked here, the profile is
+                    // parsed when it is applied
+                    if (get_profile_version(fname) >= 220) {
                         fileFound = true;
 
                         if (options.rtSettings.verbose > 1) {
@@ -539,19 +565,42 @@ ProfileStore::loadDynamicProfile(const FramesMetaData *im)
         return pth;
     };
 
-    for (auto rule : dynamicRules) {
-        if (rule.matches(im)) {
-            auto pth = get_path(rule.profilepath);
-            if (options.rtSettings.verbose) {
-                printf("found matching profile %s\n", rule.profilepath.c_str());
-            }
+    // the result only depends on the matching profiles, which are usually the
+    // same for many images (e.g. for all the ones of a camera): cache it,
+    // keyed by the paths and versions of the profiles
+    std::vector<Glib::ustring> matching;
+    std::string key;
+    for (auto rule : getMatchingRules(im)) {
+        auto pth = get_path(rule->profilepath);
+        if (options.rtSettings.verbose) {
+            printf("found matching profile %s\n", rule->profilepath.c_str());
+        }
+        GStatBuf st;
+        key += pth.raw() + '\0';
+        if (g_stat(pth.c_str(), &st) == 0) {
+            key += std::to_string(st.st_size) + ":" +
+                   std::to_string(int64_t(st.st_mtime));
+        }
+        key += '\n';
+        matching.push_back(pth);
+    }
 
+    std::shared_ptr<const ProcParams> cached;
+    if (dynamicCache.get(key, cached)) {
+        pp = *cached;
+    } else {
+        bool ok = true;
+        for (auto &pth : matching) {
             FilePartialProfile fp(pl_, pth, false);
             if (!fp.applyTo(pp)) {
                 printf("ERROR loading matching profile from: %s\n",
                        pth.c_str());
+                ok = false;
             }
         }
+        if (ok) {
+            dynamicCache.set(key, std::make_shared<const ProcParams>(pp));
+        }
     }
 
     std::unique_ptr<PartialProfile> ret(
@@ -23,6 +23,7 @@
 #include <map>
 #include <vector>
 
+#include "cache.h"
 #include "dynamicprofile.h"
 #include "noncopyable.h"
 #include "rtengine.h"
@@ -153,6 +154,11 @@ private:
 
     rtengine::ProgressListener *pl_;
 
+    /** results of loadDynamicProfile, keyed by the matching profiles */
+    rtengine::Cache<std::string,
+                    std::shared_ptr<const rtengine::procparams::ProcParams>>
+        dynamicCache;
+
     /** @brief Method to recursively parse a profile folder with a level depth
      * arbitrarily limited to 3
      *
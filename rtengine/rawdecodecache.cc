@@ -0,0 +1,309 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rawdecodecache.h"
+#include "../rtgui/options.h"
+#include "settings.h"
+#include "threadpool.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <giomm.h>
+#include <glib/gstdio.h>
+#include <iostream>
+#include <zlib.h>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+constexpr char MAGIC[8] = {'A', 'R', 'T', 'R', 'A', 'W', 'D', '\n'};
+constexpr uint32_t VERSION = 1;
+// written in native byte order, used to reject files from a different
+// architecture
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+const std::string EXTENSION = ".artraw";
+
+template <class T> bool read_val(const IMFILE *f, size_t &pos, T &out)
+{
+    if (pos + sizeof(T) > size_t(f->size)) {
+        return false;
+    }
+    memcpy(&out, f->data + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+template <class T> void write_val(FILE *f, T val)
+{
+    fwrite(&val, sizeof(T), 1, f);
+}
+
+} // namespace
+
+RawDecodeCache::Entry::~Entry()
+{
+    if (f_) {
+        ::fclose(f_);
+    }
+}
+
+bool RawDecodeCache::Entry::read_buffer(size_t i, void *dst) const
+{
+    const Buffer &b = buffers_[i];
+    uLongf sz = b.size;
+    const int res = uncompress(static_cast<Bytef *>(dst), &sz,
+                               reinterpret_cast<const Bytef *>(f_->data) +
+                                   b.offset,
+                               b.compressed_size);
+    return res == Z_OK && sz == b.size;
+}
+
+RawDecodeCache *RawDecodeCache::getInstance()
+{
+    static RawDecodeCache instance;
+    return &instance;
+}
+
+void RawDecodeCache::init()
+{
+    if (settings->raw_decode_cache_size <= 0) {
+        return;
+    }
+
+    dir_ = Glib::build_filename(options.cacheBaseDir, "rawdecode");
+    g_mkdir_with_parents(dir_.c_str(), 0777);
+    cache_.reset(new FileCache(settings->raw_decode_cache_size, &hook_));
+
+    // restore the entries of the previous sessions, from the least recently
+    // used
+    std::vector<std::pair<gint64, Glib::ustring>> entries;
+    try {
+        Glib::Dir dir(dir_);
+        for (auto name : dir) {
+            const Glib::ustring path = Glib::build_filename(dir_, name);
+            if (getFileExtension(name) == "tmp") {
+                // interrupted write
+                g_remove(path.c_str());
+                continue;
+            }
+            if (name.size() <= EXTENSION.size() ||
+                name.substr(name.size() - EXTENSION.size()) != EXTENSION) {
+                continue;
+            }
+            auto info = Gio::File::create_for_path(path)->query_info(
+                G_FILE_ATTRIBUTE_TIME_MODIFIED);
+            entries.emplace_back(info->modification_time().tv_sec, path);
+        }
+    } catch (Glib::Exception &exc) {
+        if (settings->verbose) {
+            std::cout << "RawDecodeCache: error reading " << dir_ << ": "
+                      << exc.what() << std::endl;
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    for (auto &e : entries) {
+        cache_->set(e.second, true);
+    }
+}
+
+void RawDecodeCache::cleanup()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    hook_.enabled = false;
+    cache_.reset();
+}
+
+Glib::ustring RawDecodeCache::get_path(const Glib::ustring &fname,
+                                       unsigned int frame) const
+{
+    // the md5 includes the size and modification time of the file
+    const auto md5 = getMD5(fname, true);
+    if (md5.empty()) {
+        return "";
+    }
+    return Glib::build_filename(dir_, Glib::path_get_basename(fname) + "." +
+                                          md5 + "." + std::to_string(frame) +
+                                          EXTENSION);
+}
+
+std::unique_ptr<RawDecodeCache::Entry>
+RawDecodeCache::lookup(const Glib::ustring &fname, unsigned int frame)
+{
+    std::unique_ptr<Entry> ret;
+    if (!cache_) {
+        return ret;
+    }
+
+    const auto path = get_path(fname, frame);
+    bool dummy;
+    if (path.empty() || !cache_->get(path, dummy)) {
+        return ret;
+    }
+
+    ret.reset(new Entry());
+    ret->f_ = ::gfopen(path.c_str());
+    if (!ret->f_) {
+        cache_->remove(path);
+        ret.reset();
+        return ret;
+    }
+
+    const IMFILE *f = ret->f_;
+    size_t pos = sizeof(MAGIC);
+    uint32_t version = 0, bom = 0, state_size = 0, num_buffers = 0;
+    bool ok = size_t(f->size) > pos && memcmp(f->data, MAGIC, pos) == 0 &&
+              read_val(f, pos, version) && version == VERSION &&
+              read_val(f, pos, bom) && bom == BYTE_ORDER_MARK &&
+              read_val(f, pos, state_size) &&
+              pos + state_size <= size_t(f->size);
+    if (ok) {
+        ret->state_.assign(f->data + pos, state_size);
+        pos += state_size;
+        ok = read_val(f, pos, num_buffers);
+    }
+    for (uint32_t i = 0; ok && i < num_buffers; ++i) {
+        uint64_t size = 0, csize = 0;
+        ok = read_val(f, pos, size) && read_val(f, pos, csize);
+        ret->buffers_.push_back(
+            Entry::Buffer{size_t(size), 0, size_t(csize)});
+    }
+    for (auto &b : ret->buffers_) {
+        b.offset = pos;
+        pos += b.compressed_size;
+    }
+    if (!ok || pos != size_t(f->size)) {
+        if (settings->verbose) {
+            std::cout << "RawDecodeCache: invalid entry " << path << std::endl;
+        }
+        ret.reset();
+        cache_->remove(path);
+        return ret;
+    }
+
+    // keep track of the use across sessions
+    g_utime(path.c_str(), nullptr);
+
+    if (settings->verbose) {
+        std::cout << "RawDecodeCache: using " << path << std::endl;
+    }
+    return ret;
+}
+
+void RawDecodeCache::store(const Glib::ustring &fname, unsigned int frame,
+                           const std::string &state,
+                           const std::vector<Buffer> &buffers)
+{
+    if (!cache_) {
+        return;
+    }
+
+    const auto path = get_path(fname, frame);
+    if (path.empty()) {
+        return;
+    }
+
+    std::shared_ptr<std::vector<std::vector<char>>> data(
+        new std::vector<std::vector<char>>());
+    for (auto &b : buffers) {
+        const char *p = static_cast<const char *>(b.first);
+        data->emplace_back(p, p + b.second);
+    }
+
+    ThreadPool::add_task(ThreadPool::Priority::LOWEST,
+                         [this, path, state, data]() -> void {
+                             if (write(path, state, *data)) {
+                                 std::lock_guard<std::mutex> lock(mutex_);
+                                 if (cache_) {
+                                     cache_->set(path, true);
+                                 }
+                             }
+                         });
+}
+
+bool RawDecodeCache::write(const Glib::ustring &path, const std::string &state,
+                           const std::vector<std::vector<char>> &buffers)
+{
+    std::vector<std::vector<Bytef>> compressed(buffers.size());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        auto &src = buffers[i];
+        auto &dst = compressed[i];
+        uLongf sz = compressBound(src.size());
+        dst.resize(sz);
+        if (compress2(dst.data(), &sz,
+                      reinterpret_cast<const Bytef *>(src.data()), src.size(),
+                      Z_BEST_SPEED) != Z_OK) {
+            return false;
+        }
+        dst.resize(sz);
+    }
+
+    // write to a temporary file first, so that concurrent readers never see
+    // a partial entry
+    const Glib::ustring tmp = path + ".tmp";
+    FILE *f = g_fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    fwrite(MAGIC, sizeof(MAGIC), 1, f);
+    write_val(f, VERSION);
+    write_val(f, BYTE_ORDER_MARK);
+    write_val(f, uint32_t(state.size()));
+    fwrite(state.data(), 1, state.size(), f);
+    write_val(f, uint32_t(buffers.size()));
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        write_val(f, uint64_t(buffers[i].size()));
+        write_val(f, uint64_t(compressed[i].size()));
+    }
+    for (auto &c : compressed) {
+        fwrite(c.data(), 1, c.size(), f);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+
+    if (ok && g_rename(tmp.c_str(), path.c_str()) != 0) {
+        // g_rename doesn't replace existing files on Windows
+        g_remove(path.c_str());
+        ok = g_rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    if (!ok) {
+        g_remove(tmp.c_str());
+        if (settings->verbose) {
+            std::cout << "RawDecodeCache: error writing " << path << std::endl;
+        }
+    } else if (settings->verbose > 1) {
+        std::cout << "RawDecodeCache: stored " << path << std::endl;
+    }
+    return ok;
+}
+
+void RawDecodeCache::Hook::rm(const Glib::ustring &path)
+{
+    if (!enabled) {
+        return;
+    }
+    if (settings->verbose > 1) {
+        std::cout << "RawDecodeCache: removing " << path << std::endl;
+    }
+    g_remove(path.c_str());
+}
+
+} // namespace rtengine
@@ -0,0 +1,129 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "cache.h"
+#include "myfile.h"
+#include "noncopyable.h"
+#include <glibmm.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * On-disk cache of the output of the raw decoders, so that re-opening a
+ * recently used raw file doesn't need to decompress it again.
+ *
+ * Every entry is a file in <cacheBaseDir>/rawdecode made of a small header,
+ * an opaque "state" blob (the decoder variables that the caller needs to
+ * restore) and a sequence of zlib-compressed pixel buffers. Entries are read
+ * through a memory mapping of the file, and each buffer is decompressed
+ * straight into its destination.
+ *
+ * The number of entries is bounded by settings->raw_decode_cache_size (0
+ * disables the cache); the least recently used ones are removed first, also
+ * across sessions.
+ */
+class RawDecodeCache: public NonCopyable {
+public:
+    class Entry: public NonCopyable {
+    public:
+        ~Entry();
+
+        const std::string &state() const { return state_; }
+        size_t num_buffers() const { return buffers_.size(); }
+        size_t buffer_size(size_t i) const { return buffers_[i].size; }
+        // decompresses buffer i into dst, which must be buffer_size(i) bytes
+        bool read_buffer(size_t i, void *dst) const;
+
+    private:
+        friend class RawDecodeCache;
+        Entry(): f_(nullptr) {}
+
+        struct Buffer {
+            size_t size;
+            size_t offset;
+            size_t compressed_size;
+        };
+
+        IMFILE *f_;
+        std::string state_;
+        std::vector<Buffer> buffers_;
+    };
+
+    typedef std::pair<const void *, size_t> Buffer;
+
+    static RawDecodeCache *getInstance();
+
+    void init();
+    void cleanup();
+    bool enabled() const { return cache_ != nullptr; }
+
+    /// returns the cached data for the given frame of fname, or nullptr
+    std::unique_ptr<Entry> lookup(const Glib::ustring &fname,
+                                  unsigned int frame);
+    /// adds an entry. The buffers are copied, and compressed and written to
+    /// disk in the background
+    void store(const Glib::ustring &fname, unsigned int frame,
+               const std::string &state, const std::vector<Buffer> &buffers);
+
+private:
+    RawDecodeCache() = default;
+
+    Glib::ustring get_path(const Glib::ustring &fname,
+                           unsigned int frame) const;
+    static bool write(const Glib::ustring &path, const std::string &state,
+                      const std::vector<std::vector<char>> &buffers);
+
+    // key: path of the cache file, value: unused
+    typedef Cache<Glib::ustring, bool> FileCache;
+
+    class Hook: public FileCache::Hook {
+    public:
+        Hook(): enabled(true) {}
+        void onDiscard(const Glib::ustring &key, const bool &value) override
+        {
+            rm(key);
+        }
+        void onDisplace(const Glib::ustring &key, const bool &value) override
+        {
+        }
+        void onRemove(const Glib::ustring &key, const bool &value) override
+        {
+            rm(key);
+        }
+        void onDestroy() override {}
+
+        void rm(const Glib::ustring &path);
+
+        // false when the cache is destroyed at exit, so that the entries
+        // survive across sessions
+        bool enabled;
+    };
+
+    Glib::ustring dir_;
+    std::mutex mutex_;
+    Hook hook_;
+    std::unique_ptr<FileCache> cache_;
+};
+
+} // namespace rtengine
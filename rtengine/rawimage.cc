@@ -4,6 +4,7 @@
  *  Created on: 20/nov/2010
  */
 
+#include <algorithm>
 #include <strings.h>
 #ifdef WIN32
 #include <winsock2.h>
@@ -16,6 +17,7 @@
 #include "imagedata.h"
 #include "imgiomanager.h"
 #include "metadata.h"
+#include "rawdecodecache.h"
 #include "rawimage.h"
 #include "settings.h"
 #include "utils.h"
@@ -32,8 +34,8 @@ extern MyMutex *librawMutex;
 RawImage::RawImage(const Glib::ustring &name)
     : DCraw(), data(nullptr), prefilters(0), filename(name), rotate_deg(0),
       profile_data(nullptr), allocation(nullptr), thumb_data(nullptr),
-      use_internal_decoder_(true), use_imgio_(ThreeValBool::X),
-      imgio_filename_("")
+      use_internal_decoder_(true), use_decode_cache_(false),
+      use_imgio_(ThreeValBool::X), imgio_filename_("")
 {
     profile_length = 0;
     memset(maximum_c4, 0, sizeof(maximum_c4));
@@ -807,8 +809,14 @@ int RawImage::do_loadRaw(const Glib::ustring &fname, bool loadData,
             }
 
             // Load raw pixels data
-            fseek(ifp, data_offset, SEEK_SET);
-            (this->*load_raw)();
+            RT_decode_reduced = false;
+            if (!use_decode_cache_ || !load_decoded_from_cache()) {
+                fseek(ifp, data_offset, SEEK_SET);
+                (this->*load_raw)();
+                if (use_decode_cache_ && !data_error && !RT_decode_reduced) {
+                    store_decoded_to_cache();
+                }
+            }
         } else {
 #ifdef ART_USE_LIBRAW
             libraw_->imgdata.rawparams.shot_select = shot_select;
@@ -1246,6 +1254,138 @@ int RawImage::loadRaw(bool loadData, unsigned int imageNum, bool closeFile,
     }
 }
 
+namespace {
+
+// the variables of the internal decoder needed to restore its state after
+// load_raw() from the decode cache
+struct DecodedState {
+    // sizes as found by identify(), to check that the entry is compatible
+    unsigned raw_width;
+    unsigned raw_height;
+    unsigned width;
+    unsigned height;
+    unsigned filters;
+    // possibly set by load_raw()
+    unsigned black;
+    unsigned maximum;
+    unsigned cblack[4102];
+    unsigned zero_is_bad;
+    unsigned tiff_bps;
+    // which pixel buffers are stored, in this order
+    bool has_raw_image;
+    bool has_image;
+    bool has_float_raw_image;
+};
+
+} // namespace
+
+bool RawImage::load_decoded_from_cache()
+{
+    auto entry = RawDecodeCache::getInstance()->lookup(ifname, shot_select);
+    if (!entry) {
+        return false;
+    }
+
+    DecodedState st;
+    if (entry->state().size() != sizeof(st)) {
+        return false;
+    }
+    memcpy(&st, entry->state().data(), sizeof(st));
+    if (st.raw_width != raw_width || st.raw_height != raw_height ||
+        st.width != width || st.height != height || st.filters != filters ||
+        (st.has_raw_image && !raw_image)) {
+        return false;
+    }
+
+    const size_t raw_size =
+        (size_t(raw_height) + 7) * size_t(raw_width) * sizeof(ushort);
+    const size_t image_size = size_t(height) * size_t(width) * sizeof(*image);
+    const size_t float_size =
+        size_t(raw_height) * size_t(raw_width) * sizeof(float);
+    const size_t n = st.has_raw_image + st.has_image + st.has_float_raw_image;
+    if (entry->num_buffers() != n) {
+        return false;
+    }
+
+    std::unique_ptr<float[]> fimg;
+    size_t i = 0;
+    bool ok = true;
+    if (st.has_raw_image) {
+        ok = entry->buffer_size(i) == raw_size &&
+             entry->read_buffer(i, raw_image);
+        ++i;
+    }
+    if (ok && st.has_image) {
+        ok = entry->buffer_size(i) == image_size &&
+             entry->read_buffer(i, image);
+        ++i;
+    }
+    if (ok && st.has_float_raw_image) {
+        fimg.reset(new float[size_t(raw_height) * size_t(raw_width)]);
+        ok = entry->buffer_size(i) == float_size &&
+             entry->read_buffer(i, fimg.get());
+    }
+    if (!ok) {
+        // load_raw() will overwrite whatever was partially decoded
+        return false;
+    }
+
+    if (!st.has_raw_image && raw_image) {
+        free(raw_image);
+        raw_image = nullptr;
+    }
+    if (!st.has_image) {
+        memset(image, 0, image_size);
+    }
+    float_raw_image = fimg.release();
+    black = st.black;
+    maximum = st.maximum;
+    memcpy(cblack, st.cblack, sizeof(cblack));
+    zero_is_bad = st.zero_is_bad;
+    tiff_bps = st.tiff_bps;
+    return true;
+}
+
+void RawImage::store_decoded_to_cache()
+{
+    DecodedState st;
+    memset(&st, 0, sizeof(st));
+    st.raw_width = raw_width;
+    st.raw_height = raw_height;
+    st.width = width;
+    st.height = height;
+    st.filters = filters;
+    st.black = black;
+    st.maximum = maximum;
+    memcpy(st.cblack, cblack, sizeof(cblack));
+    st.zero_is_bad = zero_is_bad;
+    st.tiff_bps = tiff_bps;
+
+    std::vector<RawDecodeCache::Buffer> buffers;
+    if (raw_image) {
+        st.has_raw_image = true;
+        buffers.emplace_back(raw_image, (size_t(raw_height) + 7) *
+                                            size_t(raw_width) * sizeof(ushort));
+    }
+    // for mosaic sensors the image buffer is usually left empty
+    const size_t image_size = size_t(height) * size_t(width) * sizeof(*image);
+    const char *p = reinterpret_cast<const char *>(image);
+    if (std::any_of(p, p + image_size, [](char c) { return c != 0; })) {
+        st.has_image = true;
+        buffers.emplace_back(image, image_size);
+    }
+    if (float_raw_image) {
+        st.has_float_raw_image = true;
+        buffers.emplace_back(float_raw_image, size_t(raw_height) *
+                                                  size_t(raw_width) *
+                                                  sizeof(float));
+    }
+
+    RawDecodeCache::getInstance()->store(
+        ifname, shot_select,
+        std::string(reinterpret_cast<const char *>(&st), sizeof(st)), buffers);
+}
+
 void RawImage::set_black_from_masked_areas()
 {
     unsigned mblack[8] = {0};
@@ -1476,7 +1616,53 @@ float RawImage::get_optical_black(int row, int col) const
     return raw_optical_black_med_[row][c];
 }
 
-Image8 *RawImage::getThumbnail()
+Image8 *RawImage::getThumbnail(int maxw_hint, int maxh_hint,
+                               ImageIO::Region *region)
+{
+    ImageIO::Region requested = {};
+    if (region) {
+        region->full_width = 0;
+        requested = *region;
+    }
+    Image8 *img = getEmbeddedThumbnail(maxw_hint, maxh_hint, region);
+    if (!img) {
+        if (region) {
+            *region = requested;
+        }
+        img = getLargestJpegPreview(maxw_hint, maxh_hint, region);
+    }
+    if (img && region && region->full_width <= 0) {
+        // not decoded by region (e.g. a PPM thumbnail)
+        region->x = region->y = 0;
+        region->width = region->full_width = img->getWidth();
+        region->height = region->full_height = img->getHeight();
+    }
+    return img;
+}
+
+Image8 *RawImage::getLargestJpegPreview(int maxw_hint, int maxh_hint,
+                                        ImageIO::Region *region)
+{
+    // the raw decoder doesn't know where the preview is (or can't decode
+    // it), try with exiv2 before giving up
+    const std::string data = Exiv2Metadata(filename).getLargestJpegPreview();
+    if (data.empty()) {
+        return nullptr;
+    }
+
+    Image8 *img = new Image8();
+    img->setSampleFormat(IIOSF_UNSIGNED_CHAR);
+    img->setSampleArrangement(IIOSA_CHUNKY);
+    if (img->loadJPEGFromMemory(data.data(), data.size(), maxw_hint,
+                                maxh_hint, region)) {
+        delete img;
+        img = nullptr;
+    }
+    return img;
+}
+
+Image8 *RawImage::getEmbeddedThumbnail(int maxw_hint, int maxh_hint,
+                                       ImageIO::Region *region)
 {
     if (use_internal_decoder_) {
         if (!checkThumbOk()) {
@@ -1492,7 +1678,8 @@ Image8 *RawImage::getThumbnail()
 
         int err = 1;
         if ((unsigned char)data[1] == 0xd8) {
-            err = img->loadJPEGFromMemory(data, get_thumbLength());
+            err = img->loadJPEGFromMemory(data, get_thumbLength(), maxw_hint,
+                                          maxh_hint, region);
         } else if (is_ppmThumb()) {
             err = img->loadPPMFromMemory(data, get_thumbWidth(),
                                          get_thumbHeight(), get_thumbSwap(),
@@ -1526,7 +1713,8 @@ Image8 *RawImage::getThumbnail()
             img->setSampleFormat(IIOSF_UNSIGNED_CHAR);
             img->setSampleArrangement(IIOSA_CHUNKY);
             if (t.tformat == LIBRAW_THUMBNAIL_JPEG) {
-                err = img->loadJPEGFromMemory(t.thumb, t.tlength);
+                err = img->loadJPEGFromMemory(t.thumb, t.tlength, maxw_hint,
+                                              maxh_hint, region);
             } else {
                 err = img->loadPPMFromMemory(t.thumb, t.twidth, t.theight,
                                              false, 8);
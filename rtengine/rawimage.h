@@ -27,6 +27,7 @@
 #include "dcraw.h"
 #include "gainmap.h"
 #include "imageformat.h"
+#include "imageio.h"
 
 #ifdef ART_USE_LIBRAW
 class LibRaw;
@@ -81,6 +82,7 @@ protected:
     std::vector<std::array<int, 4>> raw_optical_black_med_;
 
     bool use_internal_decoder_;
+    bool use_decode_cache_;
 #ifdef ART_USE_LIBRAW
     std::unique_ptr<LibRaw> libraw_;
 #endif // ART_USE_LIBRAW
@@ -92,9 +94,20 @@ protected:
     ThreeValBool use_imgio_;
     Glib::ustring imgio_filename_;
 
+    bool load_decoded_from_cache();
+    void store_decoded_to_cache();
+
 public:
     bool has_gain_map(std::vector<uint8_t> *out_buf) const;
 
+    // use the on-disk cache of decoded raw data (if enabled in the settings)
+    // in the following calls to loadRaw()
+    void set_use_decode_cache(bool yes) { use_decode_cache_ = yes; }
+    // allow the following calls to loadRaw() to decode at a reduced
+    // resolution (see RT_decode_min_size), for previews and thumbnails
+    void set_decode_min_size(int size) { RT_decode_min_size = size; }
+    bool is_decode_reduced() const { return RT_decode_reduced; }
+
     static void initCameraConstants(Glib::ustring baseDir);
     std::string get_filename() const { return filename; }
     int get_width() const { return width; }
@@ -224,12 +237,21 @@ public:
 
 public:
     bool thumbNeedsRotation() const;
-    Image8 *getThumbnail();
+    // the embedded preview, possibly decoded at a reduced size (not smaller
+    // than maxw_hint x maxh_hint). If region is given, only that part of it
+    // is decoded when possible, see ImageIO::loadJPEGFromMemory(); the
+    // region is set to the whole image otherwise
+    Image8 *getThumbnail(int maxw_hint = 0, int maxh_hint = 0,
+                         ImageIO::Region *region = nullptr);
 
     float get_optical_black(int row, int col) const;
 
 protected:
     void set_black_from_masked_areas();
+    Image8 *getEmbeddedThumbnail(int maxw_hint, int maxh_hint,
+                                 ImageIO::Region *region);
+    Image8 *getLargestJpegPreview(int maxw_hint, int maxh_hint,
+                                  ImageIO::Region *region);
 };
 
 } // namespace rtengine
@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -23,6 +24,7 @@
 #include "camconst.h"
 #include "curves.h"
 #include "dcp.h"
+#include "defectmap.h"
 #include "dfmanager.h"
 #include "ffmanager.h"
 #include "iccstore.h"
@@ -632,8 +634,9 @@ void apply_cat(RawImageSource *src, Imagefloat *img, const ColorTemp &ctemp)
 
     constexpr float noise = 1.f;
 
-    FlatCurve hcurve({FCT_MinMaxCPoints, 0.1, 0.1, 0.35, 0.35, 0.25, 1, 0.35,
-                      0.35, 0.94, 1, 0.35, 0.35});
+    const CurveLUT hcurve(FlatCurve({FCT_MinMaxCPoints, 0.1, 0.1, 0.35, 0.35,
+                                     0.25, 1, 0.35, 0.35, 0.94, 1, 0.35,
+                                     0.35}));
 
 #ifdef _OPENMP
 #pragma omp parallel for
@@ -654,7 +657,7 @@ void apply_cat(RawImageSource *src, Imagefloat *img, const ColorTemp &ctemp)
                 if (!(h <= hue_hi || h >= hue_lo)) {
                     rgb = dot_product(fullconv, rgb);
                 } else {
-                    float blend = deg * hcurve.getVal(h);
+                    float blend = deg * hcurve(h);
                     lms = dot_product(conv, rgb);
                     float s = ws2lms[2][0] * rgb[0] + ws2lms[2][1] * rgb[1] +
                               ws2lms[2][2] * rgb[2];
@@ -695,9 +698,9 @@ RawImageSource::RawImageSource()
     : ImageSource(), W(0), H(0), plistener(nullptr), scale_mul{}, c_black{},
       cblacksom{}, ref_pre_mul{}, refwb_red(0.0), refwb_green(0.0),
       refwb_blue(0.0), rgb_cam{}, cam_rgb{}, xyz_cam{}, cam_xyz{}, fuji(false),
-      d1x(false), border(4), chmax{}, hlmax{}, clmax{}, initialGain(0.0),
+      d1x(false), border(4), previewBinning(1), chmax{}, hlmax{}, clmax{}, initialGain(0.0),
       camInitialGain(0.0), defGain(0.0), ri(nullptr), rawData(0, 0),
-      green(0, 0), red(0, 0), blue(0, 0), rawDirty(true)
+      green(0, 0), red(0, 0), blue(0, 0), rawDirty(true), deconvRadius(-1.f)
 {
     camProfile = nullptr;
     embProfile = nullptr;
@@ -991,6 +994,23 @@ void RawImageSource::getImage(const ColorTemp &ctemp, int tran,
     if (hrp.enabled &&
         (hrp.hrmode == procparams::ExposureParams::HR_COLOR ||
          hrp.hrmode == procparams::ExposureParams::HR_COLORSOFT)) {
+        std::vector<float> hlkey = {float(hrp.hrmode)};
+        if (hrp.hrmode == procparams::ExposureParams::HR_COLOR) {
+            hlkey.push_back(hrp.hrblur);
+        } else {
+            double wr, wg, wb;
+            ctemp.getMultipliers(wr, wg, wb);
+            hlkey.insert(hlkey.end(),
+                         {rm, gm, bm, float(wr), float(wg), float(wb)});
+        }
+
+        // undo the reconstruction done with different parameters
+        if (rgbSourceModified && hlkey != hlBackup.key) {
+            hlRestore();
+            rgbSourceModified = false;
+            binnedRGB.reset();
+        }
+
         if (!rgbSourceModified) {
             if (hrp.hrmode == procparams::ExposureParams::HR_COLOR) {
                 HLRecovery_inpaint(hrp.hrblur);
@@ -998,11 +1018,18 @@ void RawImageSource::getImage(const ColorTemp &ctemp, int tran,
                 float s[3] = {rm, gm, bm};
                 highlight_recovery_opposed(s, ctemp);
             }
+            hlDropUnchanged();
+            hlBackup.key = std::move(hlkey);
             rgbSourceModified = true;
+            binnedRGB.reset();
             if (plistener) {
                 plistener->setProgressStr(M("PROGRESSBAR_PROCESSING"));
             }
         }
+    } else if (rgbSourceModified) {
+        hlRestore();
+        rgbSourceModified = false;
+        binnedRGB.reset();
     }
 
     // now apply the wb coefficients
@@ -1033,6 +1060,34 @@ void RawImageSource::getImage(const ColorTemp &ctemp, int tran,
     gm /= area;
     bm /= area;
 
+    // reuse (or remember) the block sums of the previous call, if it read the
+    // same area of the same demosaiced data
+    const bool binnable =
+        skip > 1 && !d1x && !fuji &&
+        (ri->getSensorType() == ST_BAYER ||
+         ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1 ||
+         ri->get_colors() == 3);
+    BinnedRGB *binned = nullptr;
+    bool useBinned = false;
+    if (binnable) {
+        if (binnedRGB && binnedRGB->x == sx1 && binnedRGB->y == sy1 &&
+            binnedRGB->width == imwidth && binnedRGB->height == imheight &&
+            binnedRGB->skip == skip) {
+            useBinned = true;
+        } else {
+            binnedRGB.reset(new BinnedRGB());
+            binnedRGB->x = sx1;
+            binnedRGB->y = sy1;
+            binnedRGB->width = imwidth;
+            binnedRGB->height = imheight;
+            binnedRGB->skip = skip;
+            binnedRGB->r(imwidth, imheight);
+            binnedRGB->g(imwidth, imheight);
+            binnedRGB->b(imwidth, imheight);
+        }
+        binned = binnedRGB.get();
+    }
+
 #ifdef _OPENMP
 #pragma omp parallel if (                                                      \
         !d1x) // omp disabled for D1x to avoid race conditions (see Issue 1088
@@ -1060,12 +1115,24 @@ void RawImageSource::getImage(const ColorTemp &ctemp, int tran,
 
                     float rtot = 0.f, gtot = 0.f, btot = 0.f;
 
-                    for (int m = 0; m < skip; m++)
-                        for (int n = 0; n < skip; n++) {
-                            rtot += red[i + m][jx + n];
-                            gtot += green[i + m][jx + n];
-                            btot += blue[i + m][jx + n];
+                    if (useBinned) {
+                        rtot = binned->r[ix][j];
+                        gtot = binned->g[ix][j];
+                        btot = binned->b[ix][j];
+                    } else {
+                        for (int m = 0; m < skip; m++)
+                            for (int n = 0; n < skip; n++) {
+                                rtot += red[i + m][jx + n];
+                                gtot += green[i + m][jx + n];
+                                btot += blue[i + m][jx + n];
+                            }
+
+                        if (binned) {
+                            binned->r[ix][j] = rtot;
+                            binned->g[ix][j] = gtot;
+                            binned->b[ix][j] = btot;
                         }
+                    }
 
                     rtot *= rm;
                     gtot *= gm;
@@ -1410,6 +1477,7 @@ int RawImageSource::load(const Glib::ustring &fname, bool firstFrameOnly)
         plistener->setProgress(0.0);
     }
     ri = new RawImage(fname);
+    ri->set_use_decode_cache(true);
     int errCode = ri->loadRaw(false, 0, false);
 
     if (errCode) {
@@ -1696,6 +1764,8 @@ void RawImageSource::preprocess(const RAWParams &raw,
     MyTime t1, t2;
     t1.set();
 
+    deconvRadius = -1.f; // rawData is about to change
+
     { // recompute the pre multipliers with the chosen wb
         float tmp_scale_mul[4];
         float tmp_black[4];
@@ -1888,15 +1958,32 @@ void RawImageSource::preprocess(const RAWParams &raw,
             bitmapBads.reset(new PixelsMap(W, H));
         }
 
-        int nFound =
-            findHotDeadPixels(*(bitmapBads.get()), raw.hotdeadpix_thresh,
-                              raw.hotPixelFilter, raw.deadPixelFilter);
-        totBP += nFound;
+        const std::string dmkey =
+            DefectMap::key(idata, W, H, raw.hotdeadpix_thresh,
+                           raw.hotPixelFilter, raw.deadPixelFilter);
+        std::vector<badPix> defects;
+        int nFound = 0;
 
-        if (settings->verbose && nFound > 0) {
-            printf("Correcting %d hot/dead pixels found inside image\n",
-                   nFound);
+        if (DefectMap::getInstance()->get(dmkey, defects)) {
+            nFound = bitmapBads->set(defects);
+
+            if (settings->verbose && nFound > 0) {
+                printf("Correcting %d hot/dead pixels from the defect map\n",
+                       nFound);
+            }
+        } else {
+            nFound = findHotDeadPixels(
+                *(bitmapBads.get()), raw.hotdeadpix_thresh, raw.hotPixelFilter,
+                raw.deadPixelFilter, dmkey.empty() ? nullptr : &defects);
+            DefectMap::getInstance()->add(dmkey, ri->get_filename(),
+                                          std::move(defects));
+
+            if (settings->verbose && nFound > 0) {
+                printf("Correcting %d hot/dead pixels found inside image\n",
+                       nFound);
+            }
         }
+        totBP += nFound;
     }
 
     if (numFrames == 4) {
@@ -1911,7 +1998,7 @@ void RawImageSource::preprocess(const RAWParams &raw,
     // Correct vignetting of lens profile
     if (!hasFlatField && lensProf.useVign &&
         lensProf.lcMode != LensProfParams::LcMode::NONE) {
-        std::unique_ptr<LensCorrection> pmap;
+        std::shared_ptr<const LensCorrection> pmap;
         if (lensProf.useLensfun()) {
             pmap = LFDatabase::getInstance()->findModifier(lensProf, idata, W,
                                                            H, coarse, -1);
@@ -1926,21 +2013,16 @@ void RawImageSource::preprocess(const RAWParams &raw,
                                                                coarse, -1);
             }
         } else {
-            const std::shared_ptr<LCPProfile> pLCPProf =
-                LCPStore::getInstance()->getProfile(lensProf.lcpFile);
-
-            if (pLCPProf) { // don't check focal length to allow distortion
-                            // correction for lenses without chip, also pass
-                            // dummy focal length 1 in case of 0
-                pmap.reset(new LCPMapper(
-                    pLCPProf, max(idata->getFocalLen(), 1.0),
-                    idata->getFocalLen35mm(), idata->getFocusDist(),
-                    idata->getFNumber(), true, false, W, H, coarse, -1));
-            }
+            // don't check focal length to allow distortion correction for
+            // lenses without chip, also pass dummy focal length 1 in case of 0
+            pmap = LCPStore::getInstance()->getMapper(
+                lensProf.lcpFile, max(idata->getFocalLen(), 1.0),
+                idata->getFocalLen35mm(), idata->getFocusDist(),
+                idata->getFNumber(), true, false, W, H, coarse, -1);
         }
 
         if (pmap) {
-            LensCorrection &map = *pmap;
+            const LensCorrection &map = *pmap;
             if (ri->getSensorType() == ST_BAYER ||
                 ri->getSensorType() == ST_FUJI_XTRANS ||
                 ri->get_colors() == 1) {
@@ -2103,25 +2185,33 @@ void RawImageSource::preprocess(const RAWParams &raw,
             plistener->setProgress(0.0);
         }
         if (numFrames == 4) {
-            double fitParams[64];
+            std::vector<double> fitParams;
             float *buffer = CA_correct_RT(
                 raw.ca_autocorrect, raw.caautoiterations, raw.cared, raw.cablue,
-                raw.ca_avoidcolourshift, *rawDataFrames[0], fitParams, false,
+                raw.ca_avoidcolourshift, *rawDataFrames[0], &fitParams, false,
                 true, nullptr, false);
             for (int i = 1; i < 3; ++i) {
                 CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations,
                               raw.cared, raw.cablue, raw.ca_avoidcolourshift,
-                              *rawDataFrames[i], fitParams, true, false, buffer,
-                              false);
+                              *rawDataFrames[i], &fitParams, true, false,
+                              buffer, false);
             }
             CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared,
                           raw.cablue, raw.ca_avoidcolourshift,
-                          *rawDataFrames[3], fitParams, true, false, buffer,
+                          *rawDataFrames[3], &fitParams, true, false, buffer,
                           true);
         } else {
+            // the fit doesn't depend on the white balance, which is all that
+            // changes between the calls when it is applied before demosaic
+            const bool reuse = raw.ca_autocorrect && caFit &&
+                               caFit->frame == currFrame && caFit->raw == raw;
+            if (raw.ca_autocorrect && !reuse) {
+                caFit.reset(new CAFit{raw, currFrame, {}});
+            }
             CA_correct_RT(raw.ca_autocorrect, raw.caautoiterations, raw.cared,
-                          raw.cablue, raw.ca_avoidcolourshift, rawData, nullptr,
-                          false, false, nullptr, true);
+                          raw.cablue, raw.ca_avoidcolourshift, rawData,
+                          caFit ? &caFit->params : nullptr, reuse, !reuse,
+                          nullptr, true);
         }
     }
 
@@ -2132,6 +2222,7 @@ void RawImageSource::preprocess(const RAWParams &raw,
     }
 
     rawDirty = true;
+    psMotion.reset();
     return;
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -2142,9 +2233,24 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast,
     MyTime t1, t2;
     t1.set();
 
+    binnedRGB.reset();
+
     double raw_expos = raw.enable_whitepoint ? raw.expos : 1.0;
 
-    if (ri->getSensorType() == ST_BAYER) {
+    const bool binned =
+        previewBinning > 1 &&
+        ((ri->getSensorType() == ST_BAYER &&
+          raw.bayersensor.method != RAWParams::BayerSensor::Method::NONE &&
+          raw.bayersensor.method != RAWParams::BayerSensor::Method::MONO &&
+          raw.bayersensor.method !=
+              RAWParams::BayerSensor::Method::PIXELSHIFT) ||
+         (ri->getSensorType() == ST_FUJI_XTRANS &&
+          raw.xtranssensor.method != RAWParams::XTransSensor::Method::NONE &&
+          raw.xtranssensor.method != RAWParams::XTransSensor::Method::MONO));
+
+    if (binned) {
+        superpixel_demosaic(previewBinning);
+    } else if (ri->getSensorType() == ST_BAYER) {
         switch (raw.bayersensor.method) {
         case RAWParams::BayerSensor::Method::HPHD:
             hphd_demosaic();
@@ -2242,9 +2348,14 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast,
     t2.set();
 
     rgbSourceModified = false;
+    hlBackup = HLBackup();
 
     if (settings->verbose) {
-        if (getSensorType() == ST_BAYER) {
+        if (binned) {
+            std::cout << "Demosaicing with " << previewBinning << "x"
+                      << previewBinning << " superpixels - " << t2.etime(t1)
+                      << " usec\n";
+        } else if (getSensorType() == ST_BAYER) {
             std::cout << "Demosaicing Bayer data: "
                       << procparams::RAWParams::BayerSensor::getMethodString(
                              raw.bayersensor.method)
@@ -2263,10 +2374,130 @@ void RawImageSource::flushRawData()
     if (rawData) {
         rawData(0, 0);
     }
+    psMotion.reset();
+    deconvRadius = -1.f;
+}
+
+bool RawImageSource::demosaicRegion(const RAWParams &raw, int tran,
+                                    const PreviewProps &pp)
+{
+    // padding on each side of the region, large enough for the support of
+    // all the demosaicing algorithms
+    constexpr int margin = 48;
+    // the region must start at a multiple of the period of the CFA pattern
+    // (8x2 for Bayer, 6x6 for X-Trans), so that FC() is the same in the
+    // region and in the full frame
+    constexpr int align = 24;
+
+    binnedRGB.reset();
+
+    if (fuji || d1x || !ri) {
+        return false;
+    }
+
+    if (ri->getSensorType() == ST_BAYER) {
+        switch (raw.bayersensor.method) {
+        case RAWParams::BayerSensor::Method::PIXELSHIFT:
+            return false;
+        case RAWParams::BayerSensor::Method::AMAZEBILINEAR:
+        case RAWParams::BayerSensor::Method::AMAZEVNG4:
+        case RAWParams::BayerSensor::Method::DCBBILINEAR:
+        case RAWParams::BayerSensor::Method::DCBVNG4:
+        case RAWParams::BayerSensor::Method::RCDBILINEAR:
+        case RAWParams::BayerSensor::Method::RCDVNG4:
+            // the auto threshold must be computed on the whole frame
+            if (raw.bayersensor.dualDemosaicAutoContrast) {
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+        switch (raw.xtranssensor.method) {
+        case RAWParams::XTransSensor::Method::FOUR_PASS:
+        case RAWParams::XTransSensor::Method::TWO_PASS:
+            if (raw.xtranssensor.dualDemosaicAutoContrast) {
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    } else {
+        return false;
+    }
+
+    int sx1, sy1, sw, sh, dummy;
+    transformRect(PreviewProps(pp.getX(), pp.getY(), pp.getWidth(),
+                               pp.getHeight(), 1),
+                  tran, sx1, sy1, sw, sh, dummy);
+    const int sx2 = min(sx1 + sw, W);
+    const int sy2 = min(sy1 + sh, H);
+
+    const int x1 = max(sx1 - margin, 0) / align * align;
+    const int y1 = max(sy1 - margin, 0) / align * align;
+    const int x2 = min(sx2 + margin, W);
+    const int y2 = min(sy2 + margin, H);
+    const int w = x2 - x1;
+    const int h = y2 - y1;
+
+    if (sx2 <= sx1 || sy2 <= sy1 || size_t(w) * h * 2 > size_t(W) * H) {
+        // nothing to do, or not worth it
+        return false;
+    }
+
+    MyTime t1, t2;
+    t1.set();
+
+    // run the regular code on a copy of the region, by temporarily replacing
+    // the input and output buffers
+    array2D<float> regionRaw(w, h, x1, y1, rawData);
+    array2D<float> regionRed(w, h), regionGreen(w, h), regionBlue(w, h);
+
+    int ww = w, hh = h;
+    const auto swap_buffers = [&]() -> void {
+        rawData.swap(regionRaw);
+        red.swap(regionRed);
+        green.swap(regionGreen);
+        blue.swap(regionBlue);
+        std::swap(W, ww);
+        std::swap(H, hh);
+    };
+
+    swap_buffers();
+    double contrastThreshold = 0;
+    demosaic(raw, false, contrastThreshold);
+    swap_buffers();
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int y = sy1; y < sy2; ++y) {
+        const int i = y - y1;
+        std::copy(regionRed[i] + sx1 - x1, regionRed[i] + sx2 - x1,
+                  red[y] + sx1);
+        std::copy(regionGreen[i] + sx1 - x1, regionGreen[i] + sx2 - x1,
+                  green[y] + sx1);
+        std::copy(regionBlue[i] + sx1 - x1, regionBlue[i] + sx2 - x1,
+                  blue[y] + sx1);
+    }
+
+    t2.set();
+
+    if (settings->verbose) {
+        std::cout << "Demosaicing region " << sx2 - sx1 << "x" << sy2 - sy1
+                  << "+" << sx1 << "+" << sy1 << " - " << t2.etime(t1)
+                  << " usec\n";
+    }
+
+    return true;
 }
 
 void RawImageSource::flushRGB()
 {
+    binnedRGB.reset();
+
     if (green) {
         green(0, 0);
     }
@@ -2304,7 +2535,6 @@ void RawImageSource::processFlatField(const RAWParams &raw,
                                       unsigned short black[4])
 {
     //    BENCHFUN
-    float *cfablur = (float(*))malloc(H * W * sizeof *cfablur);
     int BS = raw.ff_BlurRadius;
     BS += BS & 1;
 
@@ -2317,23 +2547,58 @@ void RawImageSource::processFlatField(const RAWParams &raw,
         riFlatFile->set_filters(tmpfilters);
     }
 
-    // function call to cfabloxblur
-    if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
-                               RAWParams::FlatFieldBlurType::V)) {
-        cfaboxblur(riFlatFile, cfablur, 2 * BS, 0);
-    } else if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
-                                      RAWParams::FlatFieldBlurType::H)) {
-        cfaboxblur(riFlatFile, cfablur, 0, 2 * BS);
-    } else if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
-                                      RAWParams::FlatFieldBlurType::VH)) {
-        // slightly more complicated blur if trying to correct both vertical and
-        // horizontal anomalies
-        cfaboxblur(riFlatFile, cfablur, BS,
-                   BS); // first do area blur to correct vignette
-    } else {            //(raw.ff_BlurType ==
-             //RAWParams::getFlatFieldBlurTypeString(RAWParams::area_ff))
-        cfaboxblur(riFlatFile, cfablur, BS, BS);
-    }
+    const bool vh =
+        raw.ff_BlurType ==
+        RAWParams::getFlatFieldBlurTypeString(RAWParams::FlatFieldBlurType::VH);
+
+    // the blurred flat field only depends on the flat field frame and on the
+    // blur parameters, so it is computed once and reused by the following
+    // preprocess() calls
+    if (!ffBlur || ffBlur->file != riFlatFile->get_filename() ||
+        ffBlur->type != raw.ff_BlurType || ffBlur->radius != BS ||
+        !std::equal(black, black + 4, ffBlur->black)) {
+        ffBlur.reset(new FlatFieldBlur());
+        ffBlur->file = riFlatFile->get_filename();
+        ffBlur->type = raw.ff_BlurType;
+        ffBlur->radius = BS;
+        std::copy(black, black + 4, ffBlur->black);
+        ffBlur->blur.resize(W * H);
+        float *cfablur = &ffBlur->blur[0];
+
+        // function call to cfabloxblur
+        if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
+                                   RAWParams::FlatFieldBlurType::V)) {
+            cfaboxblur(riFlatFile, cfablur, 2 * BS, 0);
+        } else if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
+                                          RAWParams::FlatFieldBlurType::H)) {
+            cfaboxblur(riFlatFile, cfablur, 0, 2 * BS);
+        } else if (vh) {
+            // slightly more complicated blur if trying to correct both
+            // vertical and horizontal anomalies
+            cfaboxblur(riFlatFile, cfablur, BS,
+                       BS); // first do area blur to correct vignette
+        } else { //(raw.ff_BlurType ==
+                 //RAWParams::getFlatFieldBlurTypeString(RAWParams::area_ff))
+            cfaboxblur(riFlatFile, cfablur, BS, BS);
+        }
+
+        if (vh) {
+            // the line correction is applied together with the vignette one,
+            // in the same pass over rawData
+            std::vector<float> cfablur1(W * H);
+            std::vector<float> cfablur2(W * H);
+            cfaboxblur(riFlatFile, &cfablur1[0], 0,
+                       2 * BS); // now do horizontal blur
+            cfaboxblur(riFlatFile, &cfablur2[0], 2 * BS,
+                       0); // now do vertical blur
+            ffBlur->linecorr.resize(W * H);
+            computeFlatFieldLineCorrection(cfablur, &cfablur1[0],
+                                           &cfablur2[0], black,
+                                           &ffBlur->linecorr[0]);
+        }
+    }
+    const float *cfablur = &ffBlur->blur[0];
+    const float *linecorr = vh ? &ffBlur->linecorr[0] : nullptr;
 
     if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
         float refcolor[2][2];
@@ -2468,6 +2733,9 @@ void RawImageSource::processFlatField(const RAWParams &raw,
                 vfloat vignettecorrv = rowRefcolorv / blurv;
                 vignettecorrv =
                     vself(vmaskf_le(blurv, minValuev), onev, vignettecorrv);
+                if (linecorr) {
+                    vignettecorrv *= LVFU(linecorr[row * W + col]);
+                }
                 vfloat valv = LVFU(rawData[row][col]);
                 valv -= rowBlackv;
                 STVFU(rawData[row][col], valv * vignettecorrv + rowBlackv);
@@ -2480,6 +2748,9 @@ void RawImageSource::processFlatField(const RAWParams &raw,
                     cfablur[(row)*W + col] - ffblack[c4[row & 1][col & 1]];
                 float vignettecorr =
                     blur <= minValue ? 1.f : refcolor[row & 1][col & 1] / blur;
+                if (linecorr) {
+                    vignettecorr *= linecorr[row * W + col];
+                }
                 rawData[row][col] =
                     (rawData[row][col] - black[c4[row & 1][col & 1]]) *
                         vignettecorr +
@@ -2573,108 +2844,94 @@ void RawImageSource::processFlatField(const RAWParams &raw,
                 float blur = cfablur[(row)*W + col] - black[c];
                 float vignettecorr =
                     blur <= minValue ? 1.f : refcolor[c] / blur;
+                if (linecorr) {
+                    vignettecorr *= linecorr[row * W + col];
+                }
                 rawData[row][col] =
                     (rawData[row][col] - black[c]) * vignettecorr + black[c];
             }
         }
     }
+}
 
-    if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
-                               RAWParams::FlatFieldBlurType::VH)) {
-        float *cfablur1 = (float(*))malloc(H * W * sizeof *cfablur1);
-        float *cfablur2 = (float(*))malloc(H * W * sizeof *cfablur2);
-        // slightly more complicated blur if trying to correct both vertical and
-        // horizontal anomalies
-        cfaboxblur(riFlatFile, cfablur1, 0, 2 * BS); // now do horizontal blur
-        cfaboxblur(riFlatFile, cfablur2, 2 * BS, 0); // now do vertical blur
-
-        if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
-            unsigned int c[2][2]{};
-            unsigned int c4[2][2]{};
-            if (ri->get_colors() != 1) {
-                for (int i = 0; i < 2; ++i) {
-                    for (int j = 0; j < 2; ++j) {
-                        c[i][j] = FC(i, j);
-                    }
+void RawImageSource::computeFlatFieldLineCorrection(
+    const float *cfablur, const float *cfablur1, const float *cfablur2,
+    const unsigned short black[4], float *linecorr)
+{
+    if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
+        unsigned int c[2][2]{};
+        unsigned int c4[2][2]{};
+        if (ri->get_colors() != 1) {
+            for (int i = 0; i < 2; ++i) {
+                for (int j = 0; j < 2; ++j) {
+                    c[i][j] = FC(i, j);
                 }
-                c4[0][0] = (c[0][0] == 1) ? 3 : c[0][0];
-                c4[0][1] = (c[0][1] == 1) ? 3 : c[0][1];
-                c4[1][0] = c[1][0];
-                c4[1][1] = c[1][1];
             }
+            c4[0][0] = (c[0][0] == 1) ? 3 : c[0][0];
+            c4[0][1] = (c[0][1] == 1) ? 3 : c[0][1];
+            c4[1][0] = c[1][0];
+            c4[1][1] = c[1][1];
+        }
 
 #ifdef __SSE2__
-            vfloat blackv[2] = {_mm_set_ps(black[c4[0][1]], black[c4[0][0]],
-                                           black[c4[0][1]], black[c4[0][0]]),
-                                _mm_set_ps(black[c4[1][1]], black[c4[1][0]],
-                                           black[c4[1][1]], black[c4[1][0]])};
+        vfloat blackv[2] = {_mm_set_ps(black[c4[0][1]], black[c4[0][0]],
+                                       black[c4[0][1]], black[c4[0][0]]),
+                            _mm_set_ps(black[c4[1][1]], black[c4[1][0]],
+                                       black[c4[1][1]], black[c4[1][0]])};
 
-            vfloat epsv = F2V(1e-5f);
+        vfloat epsv = F2V(1e-5f);
 #endif
 #ifdef _OPENMP
 #pragma omp parallel for schedule(dynamic, 16)
 #endif
 
-            for (int row = 0; row < H; row++) {
-                int col = 0;
+        for (int row = 0; row < H; row++) {
+            int col = 0;
 #ifdef __SSE2__
-                vfloat rowBlackv = blackv[row & 1];
-
-                for (; col < W - 3; col += 4) {
-                    vfloat linecorrv =
-                        SQRV(vmaxf(LVFU(cfablur[row * W + col]) - rowBlackv,
-                                   epsv)) /
-                        (vmaxf(LVFU(cfablur1[row * W + col]) - rowBlackv,
-                               epsv) *
-                         vmaxf(LVFU(cfablur2[row * W + col]) - rowBlackv,
-                               epsv));
-                    vfloat valv = LVFU(rawData[row][col]);
-                    valv -= rowBlackv;
-                    STVFU(rawData[row][col], valv * linecorrv + rowBlackv);
-                }
+            vfloat rowBlackv = blackv[row & 1];
+
+            for (; col < W - 3; col += 4) {
+                STVFU(linecorr[row * W + col],
+                      SQRV(vmaxf(LVFU(cfablur[row * W + col]) - rowBlackv,
+                                 epsv)) /
+                          (vmaxf(LVFU(cfablur1[row * W + col]) - rowBlackv,
+                                 epsv) *
+                           vmaxf(LVFU(cfablur2[row * W + col]) - rowBlackv,
+                                 epsv)));
+            }
 
 #endif
 
-                for (; col < W; col++) {
-                    float linecorr =
-                        SQR(max(1e-5f, cfablur[row * W + col] -
-                                           black[c4[row & 1][col & 1]])) /
-                        (max(1e-5f, cfablur1[row * W + col] -
-                                        black[c4[row & 1][col & 1]]) *
-                         max(1e-5f, cfablur2[row * W + col] -
-                                        black[c4[row & 1][col & 1]]));
-                    rawData[row][col] =
-                        (rawData[row][col] - black[c4[row & 1][col & 1]]) *
-                            linecorr +
-                        black[c4[row & 1][col & 1]];
-                }
+            for (; col < W; col++) {
+                linecorr[row * W + col] =
+                    SQR(max(1e-5f, cfablur[row * W + col] -
+                                       black[c4[row & 1][col & 1]])) /
+                    (max(1e-5f, cfablur1[row * W + col] -
+                                    black[c4[row & 1][col & 1]]) *
+                     max(1e-5f, cfablur2[row * W + col] -
+                                    black[c4[row & 1][col & 1]]));
             }
-        } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+        }
+    } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
 
-            for (int row = 0; row < H; row++) {
-                for (int col = 0; col < W; col++) {
-                    int c = ri->XTRANSFC(row, col);
-                    float hlinecorr =
-                        (max(1e-5f, cfablur[(row)*W + col] - black[c]) /
-                         max(1e-5f, cfablur1[(row)*W + col] - black[c]));
-                    float vlinecorr =
-                        (max(1e-5f, cfablur[(row)*W + col] - black[c]) /
-                         max(1e-5f, cfablur2[(row)*W + col] - black[c]));
-                    rawData[row][col] = ((rawData[row][col] - black[c]) *
-                                             hlinecorr * vlinecorr +
-                                         black[c]);
-                }
+        for (int row = 0; row < H; row++) {
+            for (int col = 0; col < W; col++) {
+                int c = ri->XTRANSFC(row, col);
+                float hlinecorr =
+                    (max(1e-5f, cfablur[(row)*W + col] - black[c]) /
+                     max(1e-5f, cfablur1[(row)*W + col] - black[c]));
+                float vlinecorr =
+                    (max(1e-5f, cfablur[(row)*W + col] - black[c]) /
+                     max(1e-5f, cfablur2[(row)*W + col] - black[c]));
+                linecorr[row * W + col] = hlinecorr * vlinecorr;
             }
         }
-
-        free(cfablur1);
-        free(cfablur2);
+    } else {
+        std::fill(linecorr, linecorr + W * H, 1.f);
     }
-
-    free(cfablur);
 }
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -2714,6 +2971,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
             H == riDark->get_height()) { // This works also for xtrans-sensors,
                                          // because black[0] to black[4] are
                                          // equal for these
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     int c = FC(row, col);
@@ -2747,6 +3007,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
         }
 
         if (riDark && W == riDark->get_width() && H == riDark->get_height()) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     rawData[row][col] = max(src->data[row][col] + black[0] -
@@ -2755,6 +3018,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
                 }
             }
         } else {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     rawData[row][col] = src->data[row][col];
@@ -2773,6 +3039,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
         }
 
         if (riDark && W == riDark->get_width() && H == riDark->get_height()) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     int c = FC(row, col);
@@ -2792,6 +3061,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
                 }
             }
         } else {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     rawData[row][3 * col + 0] = src->data[row][3 * col + 0];
@@ -4626,6 +4898,17 @@ void RawImageSource::getRAWHistogram (LUTu & histRedRaw, LUTu & histGreenRaw, LU
 void RawImageSource::getRAWHistogram(LUTu &histRedRaw, LUTu &histGreenRaw,
                                      LUTu &histBlueRaw)
 {
+    // the histograms only depend on the (unprocessed) raw data and on the
+    // black and white levels, so they are computed once per set of levels
+    std::vector<float> key(c_white, c_white + 4);
+    key.insert(key.end(), cblacksom, cblacksom + 4);
+    if (rawHist && rawHist->key == key) {
+        histRedRaw = rawHist->hist[0];
+        histGreenRaw = rawHist->hist[1];
+        histBlueRaw = rawHist->hist[2];
+        return;
+    }
+
     size_t histsize[3];
     histRedRaw.clear();
     histGreenRaw.clear();
@@ -4746,6 +5029,14 @@ void RawImageSource::getRAWHistogram(LUTu &histRedRaw, LUTu &histGreenRaw,
         histGreenRaw += histRedRaw;
         histBlueRaw += histRedRaw;
     }
+
+    if (!rawHist) {
+        rawHist.reset(new RawHistogram());
+    }
+    rawHist->key = std::move(key);
+    rawHist->hist[0] = histRedRaw;
+    rawHist->hist[1] = histGreenRaw;
+    rawHist->hist[2] = histBlueRaw;
 }
 
 #endif // if 0
@@ -27,6 +27,8 @@
 #include "imagesource.h"
 #include "pixelsmap.h"
 #include <iostream>
+#include <memory>
+#include <vector>
 #define HR_SCALE 2
 
 namespace rtengine {
@@ -68,6 +70,7 @@ protected:
     bool fuji;
     bool d1x;
     int border;
+    int previewBinning;
     float chmax[4], hlmax[4], clmax[4];
     double initialGain; // initial gain calculated after scale_colors
     double camInitialGain;
@@ -96,6 +99,67 @@ protected:
     float psRedBrightness[4];
     float psGreenBrightness[4];
     float psBlueBrightness[4];
+    // intermediate results of the motion detection of pixelshift(), reused
+    // when only the options that don't affect the motion mask change
+    struct PixelShiftMotion {
+        std::vector<float> key;
+        array2D<float> red;
+        array2D<float> blue;
+        array2D<float> mask;
+        array2D<uint8_t> motion;
+    };
+    std::unique_ptr<PixelShiftMotion> psMotion;
+    // auto CA fit of the last preprocess(), reused while the raw parameters
+    // don't change (i.e. when only the white balance does)
+    struct CAFit {
+        RAWParams raw;
+        unsigned int frame;
+        std::vector<double> params;
+    };
+    std::unique_ptr<CAFit> caFit;
+    // blurred flat field frame of processFlatField() (and, for the VH blur,
+    // its line correction factors), reused while the flat field and the blur
+    // parameters don't change
+    struct FlatFieldBlur {
+        std::string file;
+        Glib::ustring type;
+        int radius;
+        unsigned short black[4];
+        std::vector<float> blur;
+        std::vector<float> linecorr;
+    };
+    std::unique_ptr<FlatFieldBlur> ffBlur;
+    // the tiles of red, green and blue modified by the highlight
+    // reconstruction, as they were before it, so that it can be undone (to
+    // apply it with different parameters) without demosaicing again
+    struct HLBackup {
+        static constexpr int TILE = 64;
+        std::vector<float> key; // parameters of the reconstruction applied
+        std::vector<std::pair<int, int>> tiles; // top-left corners (x, y)
+        std::vector<float> data; // 3 * TILE * TILE values per tile
+    };
+    HLBackup hlBackup;
+    // sums of the skip x skip blocks of red, green and blue read by the last
+    // downscaled getImage(), before the white balance multipliers: when only
+    // the latter change (e.g. while dragging the temperature slider), the
+    // preview is computed from them without reading the demosaiced planes
+    // again. Dropped whenever red, green or blue change
+    struct BinnedRGB {
+        int x, y, width, height, skip;
+        array2D<float> r, g, b;
+    };
+    std::unique_ptr<BinnedRGB> binnedRGB;
+
+    // raw histograms of the last getRAWHistogram(), with the black and white
+    // levels they were computed for
+    struct RawHistogram {
+        std::vector<float> key;
+        LUTu hist[3];
+    };
+    std::unique_ptr<RawHistogram> rawHist;
+    // auto deconvolution radius of the current rawData (negative if not
+    // computed yet)
+    float deconvRadius;
 
     std::vector<double> histMatchingCache;
     std::vector<double> histMatchingCache2;
@@ -118,6 +182,15 @@ protected:
 
     void HLRecovery_inpaint(int blur);
     void highlight_recovery_opposed(float scale_mul[3], const ColorTemp &wb);
+    /** copies the tiles covering the given (inclusive) rectangle to
+        hlBackup, before the reconstruction modifies them */
+    void hlSaveRegion(int x1, int y1, int x2, int y2);
+    /// drops from hlBackup the tiles the reconstruction didn't change
+    void hlDropUnchanged();
+    /// copies back the tiles of hlBackup, and empties it
+    void hlRestore();
+    /// the uncached part of getDeconvAutoRadius()
+    bool computeDeconvAutoRadius(float *out);
 
 public:
     RawImageSource();
@@ -131,11 +204,14 @@ public:
                     const ColorTemp &wb = ColorTemp()) override;
     void demosaic(const RAWParams &raw, bool autoContrast,
                   double &contrastThreshold) override;
+    bool demosaicRegion(const RAWParams &raw, int tran,
+                        const PreviewProps &pp) override;
     void flushRawData() override;
     void flushRGB() override;
     void HLRecovery_Global(const ExposureParams &hrp) override;
     void refinement(int PassCount);
     void setBorder(unsigned int rawBorder) override { border = rawBorder; }
+    void setPreviewBinning(int factor) override { previewBinning = factor; }
     bool isRGBSourceModified() const override
     {
         return rgbSourceModified; // tracks whether cached rgb output of
@@ -148,6 +224,11 @@ public:
                             RawImage *riDark, RawImage *riFlatFile,
                             array2D<float> &rawData);
     void cfaboxblur(RawImage *riFlatFile, float *cfablur, int boxH, int boxW);
+    void computeFlatFieldLineCorrection(const float *cfablur,
+                                        const float *cfablur1,
+                                        const float *cfablur2,
+                                        const unsigned short black[4],
+                                        float *linecorr);
     void scaleColors(int winx, int winy, int winw, int winh,
                      const RAWParams &raw,
                      array2D<float> &rawData); // raw for cblack
@@ -258,11 +339,30 @@ protected:
                                           float r_mul, float g_mul, float b_mul,
                                           int x1, int width, int skip);
 
+    /** fitParams, if not null, receives the auto CA fit when fitParamsOut is
+        true, or provides it (skipping the estimation) when fitParamsIn is */
     float *CA_correct_RT(bool autoCA, size_t autoIterations, double cared,
                          double cablue, bool avoidColourshift,
                          const array2D<float> &rawData,
-                         double *fitParamsTransfer, bool fitParamsIn,
+                         std::vector<double> *fitParams, bool fitParamsIn,
                          bool fitParamsOut, float *buffer, bool freeBuffer);
+    // variants of CA_correct_RT() for the different instruction sets
+    float *CA_correct_RT_base(bool autoCA, size_t autoIterations,
+                              double cared, double cablue,
+                              bool avoidColourshift,
+                              const array2D<float> &rawData,
+                              std::vector<double> *fitParams,
+                              bool fitParamsIn, bool fitParamsOut,
+                              float *buffer, bool freeBuffer);
+#ifdef ART_SIMD_DISPATCH_AVX2
+    float *CA_correct_RT_avx2(bool autoCA, size_t autoIterations,
+                              double cared, double cablue,
+                              bool avoidColourshift,
+                              const array2D<float> &rawData,
+                              std::vector<double> *fitParams,
+                              bool fitParamsIn, bool fitParamsOut,
+                              float *buffer, bool freeBuffer);
+#endif
     void ddct8x8s(int isgn, float a[8][8]);
 
     int interpolateBadPixelsBayer(const PixelsMap &bitmapBads,
@@ -270,7 +370,8 @@ protected:
     int interpolateBadPixelsNColours(const PixelsMap &bitmapBads, int colours);
     int interpolateBadPixelsXtrans(const PixelsMap &bitmapBads);
     int findHotDeadPixels(PixelsMap &bpMap, float thresh, bool findHotPixels,
-                          bool findDeadPixels) const;
+                          bool findDeadPixels,
+                          std::vector<badPix> *found = nullptr) const;
     int findZeroPixels(PixelsMap &bpMap) const;
     void cfa_linedn(
         float linenoiselevel, bool horizontal, bool vertical,
@@ -282,10 +383,14 @@ protected:
                       array2D<float> &rawData); // Emil's green equilibration
 
     void nodemosaic(bool bw);
+    void superpixel_demosaic(int factor);
     void eahd_demosaic();
     void hphd_demosaic();
+    // if blend is given (the weight of another demosaic the result will be
+    // blended with), the pixels where it is ~1 are skipped
     void vng4_demosaic(const array2D<float> &rawData, array2D<float> &red,
-                       array2D<float> &green, array2D<float> &blue);
+                       array2D<float> &green, array2D<float> &blue,
+                       const float *const *blend = nullptr);
     void ppg_demosaic();
     void jdl_interpolate_omp();
     void igv_interpolate(int winw, int winh);
@@ -297,6 +402,30 @@ protected:
                            const array2D<float> &rawData, array2D<float> &red,
                            array2D<float> &green,
                            array2D<float> &blue); // Emil's code for AMaZE
+    // variants of amaze_demosaic_RT() and rcd_demosaic() for the different
+    // instruction sets (see PROC_DISPATCH_TARGETS in ProcessorTargets.cmake)
+    template <int TS>
+    void amaze_demosaic_RT_base(int winx, int winy, int winw, int winh,
+                                const array2D<float> &rawData,
+                                array2D<float> &red, array2D<float> &green,
+                                array2D<float> &blue);
+    void rcd_demosaic_base(int tileSize);
+#ifdef ART_SIMD_DISPATCH_AVX2
+    template <int TS>
+    void amaze_demosaic_RT_avx2(int winx, int winy, int winw, int winh,
+                                const array2D<float> &rawData,
+                                array2D<float> &red, array2D<float> &green,
+                                array2D<float> &blue);
+    void rcd_demosaic_avx2(int tileSize);
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX512
+    template <int TS>
+    void amaze_demosaic_RT_avx512(int winx, int winy, int winw, int winh,
+                                  const array2D<float> &rawData,
+                                  array2D<float> &red, array2D<float> &green,
+                                  array2D<float> &blue);
+    void rcd_demosaic_avx512(int tileSize);
+#endif
     void dual_demosaic_RT(bool isBayer, const RAWParams &raw, int winw,
                           int winh, const array2D<float> &rawData,
                           array2D<float> &red, array2D<float> &green,
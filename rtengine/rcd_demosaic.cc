@@ -21,9 +21,17 @@
 
 #include "../rtgui/multilangmgr.h"
 #include "StopWatch.h"
+#include "cpuinfo.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
 
+// this file is also compiled for the instruction sets in
+// PROC_DISPATCH_TARGETS (see demosaic_avx2.cc), which define ART_SIMD_VARIANT
+#ifndef ART_SIMD_VARIANT
+#define ART_SIMD_VARIANT(name) name##_base
+#define ART_SIMD_BASE_BUILD
+#endif
+
 namespace {
 unsigned fc(const unsigned int cfa[2][2], int r, int c)
 {
@@ -33,6 +41,38 @@ unsigned fc(const unsigned int cfa[2][2], int r, int c)
 
 namespace rtengine {
 
+#ifdef ART_SIMD_BASE_BUILD
+
+void RawImageSource::rcd_demosaic()
+{
+    // the working set is about 22 bytes per pixel of the tile. Tiles somewhat
+    // larger than the L2 cache were found to be the fastest (194 pixels with
+    // 512KB of L2), the memory traffic being dominated by the borders
+    int tileSize = 194;
+    const size_t l2 = get_l2_cache_size();
+    if (l2 > 0) {
+        tileSize = LIM(int(std::sqrt(1.6 * l2 / 22.0)) & ~1, 130, 386);
+    }
+
+    switch (get_simd_level()) {
+#ifdef ART_SIMD_DISPATCH_AVX512
+    case SIMDLevel::AVX512:
+        rcd_demosaic_avx512(tileSize);
+        break;
+#endif
+#ifdef ART_SIMD_DISPATCH_AVX2
+    case SIMDLevel::AVX2:
+        rcd_demosaic_avx2(tileSize);
+        break;
+#endif
+    default:
+        rcd_demosaic_base(tileSize);
+        break;
+    }
+}
+
+#endif // ART_SIMD_BASE_BUILD
+
 /*
  * RATIO CORRECTED DEMOSAICING
  * Luis Sanz Rodriguez (luis.sanz.rodriguez(at)gmail(dot)com)
@@ -49,7 +89,7 @@ namespace rtengine {
 // cooperation with Hanno Schwalm (hanno@schwalm-bremen.de) and Luis Sanz
 // Rodriguez this has been tuned for performance.
 
-void RawImageSource::rcd_demosaic()
+void RawImageSource::ART_SIMD_VARIANT(rcd_demosaic)(int tileSize)
 {
     constexpr size_t chunkSize = 2;
     constexpr bool measure = false;
@@ -87,12 +127,11 @@ void RawImageSource::rcd_demosaic()
                                         {FC(1, 0), FC(1, 1)}};
     constexpr int tileBorder = 9; // avoid tile-overlap errors
     constexpr int rcdBorder = 9;
-    constexpr int tileSize = 194;
-    constexpr int tileSizeN = tileSize - 2 * tileBorder;
+    const int tileSizeN = tileSize - 2 * tileBorder;
     const int numTh = H / (tileSizeN) + ((H % (tileSizeN)) ? 1 : 0);
     const int numTw = W / (tileSizeN) + ((W % (tileSizeN)) ? 1 : 0);
-    constexpr int w1 = tileSize, w2 = 2 * tileSize, w3 = 3 * tileSize,
-                  w4 = 4 * tileSize;
+    const int w1 = tileSize, w2 = 2 * tileSize, w3 = 3 * tileSize,
+              w4 = 4 * tileSize;
     // Tolerance to avoid dividing by zero
     constexpr float eps = 1e-5f;
     constexpr float epssq = 1e-10f;
@@ -104,8 +143,10 @@ void RawImageSource::rcd_demosaic()
     {
         int progresscounter = 0;
         float *const cfa = (float *)calloc(tileSize * tileSize, sizeof *cfa);
-        float(*const rgb)[tileSize * tileSize] =
-            (float(*)[tileSize * tileSize]) malloc(3 * sizeof *rgb);
+        float *const rgbbuf =
+            (float *)malloc(3 * tileSize * tileSize * sizeof *rgbbuf);
+        float *const rgb[3] = {rgbbuf, rgbbuf + tileSize * tileSize,
+                               rgbbuf + 2 * tileSize * tileSize};
         float *const VH_Dir =
             (float *)calloc(tileSize * tileSize, sizeof *VH_Dir);
         float *const PQ_Dir =
@@ -115,6 +156,9 @@ void RawImageSource::rcd_demosaic()
             (float *)calloc(tileSize * tileSize / 2, sizeof *P_CDiff_Hpf);
         float *const Q_CDiff_Hpf =
             (float *)calloc(tileSize * tileSize / 2, sizeof *Q_CDiff_Hpf);
+        // row buffers of step 1
+        float *const dirbuf =
+            (float *)malloc((4 * tileSize - 30) * sizeof *dirbuf);
 
 #ifdef _OPENMP
 #pragma omp for schedule(dynamic, chunkSize) collapse(2) nowait
@@ -146,7 +190,8 @@ void RawImageSource::rcd_demosaic()
                 }
 
                 // Step 1: Find cardinal and diagonal interpolation directions
-                float bufferV[3][tileSize - 8];
+                float *const bufferV[3] = {dirbuf, dirbuf + tileSize - 8,
+                                           dirbuf + 2 * (tileSize - 8)};
 
                 // Step 1.1: Calculate the square of the vertical and horizontal
                 // color difference high pass filter
@@ -163,7 +208,7 @@ void RawImageSource::rcd_demosaic()
 
                 // Step 1.2: Obtain the vertical and horizontal directional
                 // discrimination strength
-                float bufferH[tileSize - 6] ALIGNED16;
+                float *const bufferH = dirbuf + 3 * (tileSize - 8);
                 float *V0 = bufferV[0];
                 float *V1 = bufferV[1];
                 float *V2 = bufferV[2];
@@ -503,11 +548,12 @@ void RawImageSource::rcd_demosaic()
         }
 
         free(cfa);
-        free(rgb);
+        free(rgbbuf);
         free(VH_Dir);
         free(PQ_Dir);
         free(P_CDiff_Hpf);
         free(Q_CDiff_Hpf);
+        free(dirbuf);
     }
 
     border_interpolate2(W, H, rcdBorder, rawData, red, green, blue);
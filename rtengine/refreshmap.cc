@@ -90,7 +90,7 @@ int refreshmap[NUMOFEVENTS] = {
     TRANSFORM,                        // EvCACorr,
     ALLNORAW,                         // EvHREnabled,
     ALLNORAW,                         // EvHRAmount,
-    ALLNORAW | M_RAW,                 // EvHRMethod,
+    ALLNORAW,                         // EvHRMethod,
     DEMOSAIC,                         // EvWProfile,
     LUMINANCECURVE /*OUTPUTPROFILE*/, // EvOProfile,
     ALLNORAW,                         // EvIProfile,
@@ -0,0 +1,314 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "rescale.h"
+#include "alignedbuffer.h"
+#include "imagefloat.h"
+#include "opthelper.h"
+#include "rt_math.h"
+#include "sleef.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace rtengine {
+
+namespace {
+
+constexpr float LANCZOS_A = 3.f;
+
+inline float Lanc(float x, float a)
+{
+    if (x * x < 1e-6f) {
+        return 1.0f;
+    } else if (x * x > a * a) {
+        return 0.0f;
+    } else {
+        x = static_cast<float>(rtengine::RT_PI) * x;
+        return a * xsinf(x) * xsinf(x / a) / (x * x);
+    }
+}
+
+// Lanczos weights of each output sample along one dimension: index of the
+// first input sample contributing to it and normalized weights, padded with
+// zeros to a multiple of 4 taps
+class ResampleWeights {
+public:
+    ResampleWeights(int src_size, int dst_size, float scale)
+        : start_(dst_size), count_(dst_size)
+    {
+        const float delta = 1.f / scale;
+        const float sc = std::min(scale, 1.f);
+        const float radius = LANCZOS_A / sc;
+        support_ = (int(2.f * radius) + 1 + 3) & ~3;
+        weights_.assign(size_t(support_) * dst_size, 0.f);
+
+        for (int i = 0; i < dst_size; ++i) {
+            // coordinate of the center of the output sample in the input
+            const float x0 = (i + 0.5f) * delta - 0.5f;
+            const int i0 = std::max(0, int(std::floor(x0 - radius)) + 1);
+            const int i1 =
+                std::min(src_size, int(std::floor(x0 + radius)) + 1);
+            float *w = &weights_[size_t(i) * support_];
+            float ws = 0.f;
+            for (int j = i0; j < i1; ++j) {
+                w[j - i0] = Lanc(sc * (x0 - j), LANCZOS_A);
+                ws += w[j - i0];
+            }
+            for (int k = 0; k < i1 - i0; ++k) {
+                w[k] /= ws;
+            }
+            start_[i] = i0;
+            count_[i] = std::max(i1 - i0, 0);
+        }
+    }
+
+    int support() const { return support_; }
+    int start(int i) const { return start_[i]; }
+    int count(int i) const { return count_[i]; }
+    const float *weights(int i) const
+    {
+        return &weights_[size_t(i) * support_];
+    }
+
+private:
+    int support_;
+    std::vector<int> start_;
+    std::vector<int> count_;
+    std::vector<float> weights_;
+};
+
+// computes the rows [y, y + dst->getHeight()) of the resampled image, with
+// the given weights
+void lanczos(const Imagefloat *src, Imagefloat *dst, const ResampleWeights &wx,
+             const ResampleWeights &wy, int y, bool multithread)
+{
+    const int sW = src->getWidth();
+    const int dW = dst->getWidth();
+    const int dH = dst->getHeight();
+    const int nx = wx.support();
+
+    float **const sp[3] = {src->r.ptrs, src->g.ptrs, src->b.ptrs};
+    float **const dp[3] = {dst->r.ptrs, dst->g.ptrs, dst->b.ptrs};
+
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+    {
+        // vertically interpolated rows, with room for the (zero weighted)
+        // padding taps of the horizontal pass
+        const size_t rowsz = sW + nx;
+        AlignedBuffer<float> buffer(3 * rowsz);
+        std::fill(buffer.data, buffer.data + 3 * rowsz, 0.f);
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < dH; ++i) {
+            const int i0 = wy.start(y + i);
+            const int n = wy.count(y + i);
+            const float *w = wy.weights(y + i);
+
+            for (int c = 0; c < 3; ++c) {
+                float *row = buffer.data + c * rowsz;
+                float **in = sp[c] + i0;
+
+                int j = 0;
+#ifdef __SSE2__
+                for (; j < sW - 3; j += 4) {
+                    vfloat v = ZEROV;
+                    for (int k = 0; k < n; ++k) {
+                        v += F2V(w[k]) * LVFU(in[k][j]);
+                    }
+                    STVFU(row[j], v);
+                }
+#endif
+                for (; j < sW; ++j) {
+                    float v = 0.f;
+                    for (int k = 0; k < n; ++k) {
+                        v += w[k] * in[k][j];
+                    }
+                    row[j] = v;
+                }
+            }
+
+            const float *r0 = buffer.data;
+            const float *r1 = r0 + rowsz;
+            const float *r2 = r1 + rowsz;
+            for (int j = 0; j < dW; ++j) {
+                const float *wh = wx.weights(j);
+                const int x0 = wx.start(j);
+#ifdef __SSE2__
+                vfloat v0 = ZEROV, v1 = ZEROV, v2 = ZEROV;
+                for (int k = 0; k < nx; k += 4) {
+                    const vfloat wv = LVFU(wh[k]);
+                    v0 += wv * LVFU(r0[x0 + k]);
+                    v1 += wv * LVFU(r1[x0 + k]);
+                    v2 += wv * LVFU(r2[x0 + k]);
+                }
+                dp[0][i][j] = vhadd(v0);
+                dp[1][i][j] = vhadd(v1);
+                dp[2][i][j] = vhadd(v2);
+#else
+                float v0 = 0.f, v1 = 0.f, v2 = 0.f;
+                for (int k = 0; k < nx; ++k) {
+                    v0 += wh[k] * r0[x0 + k];
+                    v1 += wh[k] * r1[x0 + k];
+                    v2 += wh[k] * r2[x0 + k];
+                }
+                dp[0][i][j] = v0;
+                dp[1][i][j] = v1;
+                dp[2][i][j] = v2;
+#endif
+            }
+        }
+    }
+}
+
+} // namespace
+
+class LanczosRescaler::Data {
+public:
+    Data(const Imagefloat *src, int dst_width, int dst_height, float scale,
+         bool multithread)
+        : src_(src), multithread_(multithread)
+    {
+        // the Lanczos kernel is then applied at a scale between 0.25 and 0.5
+        const int factor = int(1.f / (2.f * scale));
+        if (factor >= 2) {
+            tmp_.reset(new Imagefloat((src->getWidth() + factor - 1) / factor,
+                                      (src->getHeight() + factor - 1) /
+                                          factor));
+            rescaleArea(src, tmp_.get(), factor, multithread);
+            src_ = tmp_.get();
+            scale *= factor;
+        }
+        wx_.reset(new ResampleWeights(src_->getWidth(), dst_width, scale));
+        wy_.reset(new ResampleWeights(src_->getHeight(), dst_height, scale));
+    }
+
+    void getRows(Imagefloat *dst, int y) const
+    {
+        lanczos(src_, dst, *wx_, *wy_, y, multithread_);
+    }
+
+private:
+    const Imagefloat *src_;
+    std::unique_ptr<Imagefloat> tmp_;
+    std::unique_ptr<ResampleWeights> wx_;
+    std::unique_ptr<ResampleWeights> wy_;
+    bool multithread_;
+};
+
+LanczosRescaler::LanczosRescaler(const Imagefloat *src, int dst_width,
+                                 int dst_height, float scale,
+                                 bool multithread)
+    : data_(new Data(src, dst_width, dst_height, scale, multithread))
+{
+}
+
+LanczosRescaler::~LanczosRescaler() {}
+
+void LanczosRescaler::getRows(Imagefloat *dst, int y) const
+{
+    data_->getRows(dst, y);
+}
+
+void rescaleLanczos(const Imagefloat *src, Imagefloat *dst, float scale,
+                    bool multithread)
+{
+    LanczosRescaler(src, dst->getWidth(), dst->getHeight(), scale,
+                    multithread)
+        .getRows(dst, 0);
+}
+
+void rescaleArea(const Imagefloat *src, Imagefloat *dst, int factor,
+                 bool multithread)
+{
+    const int sW = src->getWidth();
+    const int sH = src->getHeight();
+    const int dW = dst->getWidth();
+    const int dH = dst->getHeight();
+
+    float **const sp[3] = {src->r.ptrs, src->g.ptrs, src->b.ptrs};
+    float **const dp[3] = {dst->r.ptrs, dst->g.ptrs, dst->b.ptrs};
+
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+    {
+        AlignedBuffer<float> buffer(sW);
+        float *acc = buffer.data;
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < dH; ++i) {
+            const int y0 = i * factor;
+            const int y1 = std::min(y0 + factor, sH);
+
+            for (int c = 0; c < 3; ++c) {
+                // sum of the rows of the block...
+                std::copy(sp[c][y0], sp[c][y0] + sW, acc);
+                for (int y = y0 + 1; y < y1; ++y) {
+                    const float *in = sp[c][y];
+                    int x = 0;
+#ifdef __SSE2__
+                    for (; x < sW - 3; x += 4) {
+                        STVFU(acc[x], LVFU(acc[x]) + LVFU(in[x]));
+                    }
+#endif
+                    for (; x < sW; ++x) {
+                        acc[x] += in[x];
+                    }
+                }
+
+                // ...and of the columns
+                float *out = dp[c][i];
+                const float norm = 1.f / ((y1 - y0) * factor);
+                int j = 0;
+#ifdef __SSE2__
+                if (factor == 2) {
+                    const vfloat normv = F2V(norm);
+                    for (; j < sW / 2 - 3; j += 4) {
+                        const vfloat a = LVFU(acc[2 * j]);
+                        const vfloat b = LVFU(acc[2 * j + 4]);
+                        STVFU(out[j], (_mm_shuffle_ps(a, b, 0x88) +
+                                       _mm_shuffle_ps(a, b, 0xdd)) *
+                                          normv);
+                    }
+                }
+#endif
+                for (; j < dW; ++j) {
+                    const int x0 = j * factor;
+                    const int x1 = std::min(x0 + factor, sW);
+                    float s = 0.f;
+                    for (int x = x0; x < x1; ++x) {
+                        s += acc[x];
+                    }
+                    out[j] = x1 - x0 == factor ? s * norm
+                                               : s / ((y1 - y0) * (x1 - x0));
+                }
+            }
+        }
+    }
+}
+
+} // namespace rtengine
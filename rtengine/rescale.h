@@ -21,9 +21,53 @@
 #pragma once
 
 #include "array2D.h"
+#include "noncopyable.h"
+#include <memory>
 
 namespace rtengine {
 
+class Imagefloat;
+
+/**
+ * Lanczos (a = 3) resampling of the three channels of src into dst, which
+ * must already have the output size; scale is the ratio between the sizes
+ * of dst and src. The filter is separable, with the weights of the rows and
+ * of the columns computed once. Reductions by 4x or more are preceded by an
+ * area-averaging downscale by an integer factor, which is much cheaper
+ * than the wide Lanczos kernel it replaces.
+ */
+void rescaleLanczos(const Imagefloat *src, Imagefloat *dst, float scale,
+                    bool multithread);
+
+/**
+ * The resampling of rescaleLanczos(), computed a band of rows at a time
+ * (e.g. to process the output in strips). The weights and the
+ * area-averaged copy of src for large reductions are prepared by the
+ * constructor; src must stay alive and unchanged while getRows() is used.
+ */
+class LanczosRescaler: public NonCopyable {
+public:
+    LanczosRescaler(const Imagefloat *src, int dst_width, int dst_height,
+                    float scale, bool multithread);
+    ~LanczosRescaler();
+
+    /// computes the rows [y, y + dst->getHeight()) of the rescaled image
+    /// into dst, which must be dst_width wide
+    void getRows(Imagefloat *dst, int y) const;
+
+private:
+    class Data;
+    std::unique_ptr<Data> data_;
+};
+
+/**
+ * Reduction of src by an integer factor, averaging each factor x factor
+ * block of pixels. dst must be (W + factor - 1) / factor by
+ * (H + factor - 1) / factor.
+ */
+void rescaleArea(const Imagefloat *src, Imagefloat *dst, int factor,
+                 bool multithread);
+
 inline float getBilinearValue(const array2D<float> &src, float x, float y)
 {
     const int W = src.width();
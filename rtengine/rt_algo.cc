@@ -24,12 +24,14 @@
 #include <cstddef>
 #include <cstdint>
 #include <fftw3.h>
+#include <limits>
 #include <vector>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
 #include "../rtgui/threadutils.h"
+#include "fftwplans.h"
 #include "gauss.h"
 #include "imagefloat.h"
 #include "opthelper.h"
@@ -802,7 +804,8 @@ inline int find_fast_dim(int dim)
     return dim;
 }
 
-void do_convolution(fftwf_plan fwd_plan, fftwf_plan inv_plan,
+void do_convolution(const FFTWPlanCache::Plan &fwd_plan,
+                    const FFTWPlanCache::Plan &inv_plan,
                     fftwf_complex *kernel_fft, int kernel_radius, int pH,
                     int pW, float *buf, fftwf_complex *buf_fft, int W, int H,
                     float **const src, float **dst, bool multithread)
@@ -818,7 +821,7 @@ void do_convolution(fftwf_plan fwd_plan, fftwf_plan inv_plan,
         }
     }
 
-    fftwf_execute(fwd_plan);
+    fftwf_execute_dft_r2c(fwd_plan.get(), buf, buf_fft);
 
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
@@ -833,7 +836,7 @@ void do_convolution(fftwf_plan fwd_plan, fftwf_plan inv_plan,
         }
     }
 
-    fftwf_execute(inv_plan);
+    fftwf_execute_dft_c2r(inv_plan.get(), buf_fft, buf);
 
     const int K = 2 * kernel_radius;
     const float norm = pH * pW;
@@ -868,9 +871,9 @@ fftwf_complex *prepare_kernel(const array2D<float> &kernel, float *buf, int pW,
         }
     }
 
-    auto plan = fftwf_plan_dft_r2c_2d(pH, pW, buf, kernel_fft, FFTW_ESTIMATE);
-    fftwf_execute(plan);
-    fftwf_destroy_plan(plan);
+    auto plan = FFTWPlanCache::getInstance()->dft_r2c_2d(
+        pH, pW, buf, kernel_fft, FFTW_ESTIMATE);
+    fftwf_execute_dft_r2c(plan.get(), buf, kernel_fft);
 
     return kernel_fft;
 }
@@ -884,23 +887,21 @@ struct ConvolutionData {
     fftwf_complex *kernel_fft;
     float *buf;
     fftwf_complex *buf_fft;
-    fftwf_plan fwd_plan;
-    fftwf_plan inv_plan;
+    FFTWPlanCache::Plan fwd_plan;
+    FFTWPlanCache::Plan inv_plan;
     bool multithread;
 
     ConvolutionData(const array2D<float> &kernel, int W, int H,
                     bool multithread)
         : K(0), kernel_fft(nullptr), buf(nullptr), buf_fft(nullptr),
-          fwd_plan(nullptr), inv_plan(nullptr), multithread(multithread)
+          multithread(multithread)
     {
         K = kernel.width();
         if (K == kernel.height()) {
-            MyMutex::MyLock lock(*fftwMutex);
-
-#ifdef RT_FFTW3F_OMP
+            int nthreads = 1;
+#ifdef _OPENMP
             if (multithread) {
-                fftwf_init_threads();
-                fftwf_plan_with_nthreads(omp_get_num_procs());
+                nthreads = omp_get_num_procs();
             }
 #endif
 
@@ -913,21 +914,16 @@ struct ConvolutionData {
             buf_fft = fftwf_alloc_complex(pH * (pW / 2 + 1));
             kernel_fft = prepare_kernel(kernel, buf, pW, pH, false);
 
-            fwd_plan =
-                fftwf_plan_dft_r2c_2d(pH, pW, buf, buf_fft, FFTW_ESTIMATE);
-            inv_plan =
-                fftwf_plan_dft_c2r_2d(pH, pW, buf_fft, buf, FFTW_ESTIMATE);
+            auto cache = FFTWPlanCache::getInstance();
+            fwd_plan = cache->dft_r2c_2d(pH, pW, buf, buf_fft, FFTW_ESTIMATE,
+                                         nthreads);
+            inv_plan = cache->dft_c2r_2d(pH, pW, buf_fft, buf, FFTW_ESTIMATE,
+                                         nthreads);
         }
     }
 
     ~ConvolutionData()
     {
-        if (inv_plan) {
-            fftwf_destroy_plan(inv_plan);
-        }
-        if (fwd_plan) {
-            fftwf_destroy_plan(fwd_plan);
-        }
         if (kernel_fft) {
             fftwf_free(kernel_fft);
         }
@@ -967,6 +963,156 @@ void Convolution::operator()(const array2D<float> &src, array2D<float> &dst)
                static_cast<float **>(dst));
 }
 
+namespace {
+
+struct TiledConvolutionData {
+    int K;
+    int W;
+    int H;
+    int tW; // size of the output tiles
+    int tH;
+    int pW; // size of the FFTs
+    int pH;
+    fftwf_complex *kernel_fft;
+    fftwf_complex *flipped_kernel_fft;
+    FFTWPlanCache::Plan fwd_plan;
+    FFTWPlanCache::Plan inv_plan;
+    bool multithread;
+
+    TiledConvolutionData(const array2D<float> &kernel, int W, int H,
+                         bool multithread)
+        : K(kernel.width()), W(W), H(H), kernel_fft(nullptr),
+          flipped_kernel_fft(nullptr), multithread(multithread)
+    {
+        // output tiles of a few times the kernel size keep the overhead of
+        // the overlap low, without making the FFTs large
+        const int tile = std::max(256, 4 * K);
+        pW = find_fast_dim(std::min(W, tile) + K - 1);
+        pH = find_fast_dim(std::min(H, tile) + K - 1);
+        tW = pW - K + 1;
+        tH = pH - K + 1;
+
+        float *buf = static_cast<float *>(fftwf_malloc(sizeof(float) * pH * pW));
+        kernel_fft = prepare_kernel(kernel, buf, pW, pH, false);
+        array2D<float> flipped(K, K);
+        for (int y = 0; y < K; ++y) {
+            for (int x = 0; x < K; ++x) {
+                flipped[y][x] = kernel[K - 1 - y][K - 1 - x];
+            }
+        }
+        flipped_kernel_fft = prepare_kernel(flipped, buf, pW, pH, false);
+
+        // single-threaded plans, the parallelism is on the tiles
+        fftwf_complex *buf_fft = fftwf_alloc_complex(pH * (pW / 2 + 1));
+        auto cache = FFTWPlanCache::getInstance();
+        fwd_plan = cache->dft_r2c_2d(pH, pW, buf, buf_fft, FFTW_ESTIMATE);
+        inv_plan = cache->dft_c2r_2d(pH, pW, buf_fft, buf, FFTW_ESTIMATE);
+        fftwf_free(buf_fft);
+        fftwf_free(buf);
+    }
+
+    ~TiledConvolutionData()
+    {
+        fftwf_free(kernel_fft);
+        fftwf_free(flipped_kernel_fft);
+    }
+};
+
+} // namespace
+
+TiledConvolution::TiledConvolution(const array2D<float> &kernel, int W, int H,
+                                   bool multithread)
+    : data_(nullptr)
+{
+    if (kernel.width() == kernel.height()) {
+        data_ = new TiledConvolutionData(kernel, W, H, multithread);
+    }
+}
+
+TiledConvolution::~TiledConvolution()
+{
+    delete static_cast<TiledConvolutionData *>(data_);
+}
+
+void TiledConvolution::operator()(float **src, float **dst, bool flipped)
+{
+    if (!data_) {
+        return;
+    }
+
+    const TiledConvolutionData &d = *static_cast<TiledConvolutionData *>(data_);
+    const int r = d.K / 2;
+    const int K = 2 * r;
+    const int W = d.W;
+    const int H = d.H;
+    const int pW = d.pW;
+    const int pH = d.pH;
+    const int cW = pW / 2 + 1;
+    const float norm = pH * pW;
+    const fftwf_complex *kernel_fft =
+        flipped ? d.flipped_kernel_fft : d.kernel_fft;
+    const int ntx = (W + d.tW - 1) / d.tW;
+    const int nty = (H + d.tH - 1) / d.tH;
+
+#ifdef _OPENMP
+#pragma omp parallel if (d.multithread)
+#endif
+    {
+        float *buf = static_cast<float *>(fftwf_malloc(sizeof(float) * pH * pW));
+        fftwf_complex *buf_fft = fftwf_alloc_complex(pH * cW);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (int t = 0; t < ntx * nty; ++t) {
+            const int oy = (t / ntx) * d.tH;
+            const int ox = (t % ntx) * d.tW;
+
+            // the input of the tile, extended by the size of the kernel
+            // (replicating the image borders, like Convolution)
+            for (int y = 0; y < pH; ++y) {
+                const int yy = LIM(oy + y - r, 0, H - 1);
+                for (int x = 0; x < pW; ++x) {
+                    const int xx = LIM(ox + x - r, 0, W - 1);
+                    buf[y * pW + x] = src[yy][xx];
+                }
+            }
+
+            fftwf_execute_dft_r2c(d.fwd_plan.get(), buf, buf_fft);
+
+            for (int i = 0; i < pH * cW; ++i) {
+                const float p = buf_fft[i][0], q = buf_fft[i][1];
+                const float rr = kernel_fft[i][0], s = kernel_fft[i][1];
+                buf_fft[i][0] = p * rr - q * s;
+                buf_fft[i][1] = p * s + q * rr;
+            }
+
+            fftwf_execute_dft_c2r(d.inv_plan.get(), buf_fft, buf);
+
+            // the first K rows and columns wrap around, the rest is the
+            // output of the tile
+            const int ey = std::min(oy + d.tH, H);
+            const int ex = std::min(ox + d.tW, W);
+            for (int y = oy; y < ey; ++y) {
+                const float *row = buf + (y - oy + K) * pW + K;
+                for (int x = ox; x < ex; ++x) {
+                    dst[y][x] = row[x - ox] / norm;
+                }
+            }
+        }
+
+        fftwf_free(buf_fft);
+        fftwf_free(buf);
+    }
+}
+
+void TiledConvolution::operator()(const array2D<float> &src,
+                                  array2D<float> &dst, bool flipped)
+{
+    operator()(static_cast<float **>(const_cast<array2D<float> &>(src)),
+               static_cast<float **>(dst), flipped);
+}
+
 void build_gaussian_kernel(float sigma, array2D<float> &res)
 {
     static constexpr float threshold = 0.005f;
@@ -1605,4 +1751,272 @@ void inpaint(Imagefloat *img, const array2D<float> &mask, float threshold,
     }
 }
 
+namespace {
+
+// Perreault and Hebert, "Median Filtering in Constant Time" (2007), on the
+// input quantized to NUM_BINS levels. Every column keeps the histogram of
+// the 2r+1 rows around the current one, and the histogram of the window is
+// updated by adding/removing whole columns. The histograms have two levels:
+// the coarse one is always kept up to date, whereas the fine bins of a coarse
+// bucket are updated only when the median falls in that bucket.
+class HistogramMedian {
+public:
+    static constexpr int FINE_BITS = 6;
+    static constexpr int NUM_FINE = 1 << FINE_BITS;
+    static constexpr int NUM_COARSE = 64;
+    static constexpr int NUM_BINS = NUM_COARSE * NUM_FINE;
+
+    // counts of the column histograms, at most 2 * radius + 1
+    typedef uint16_t Count;
+    // counts of the window histogram
+    typedef uint32_t KCount;
+
+    HistogramMedian(const array2D<uint16_t> &q, int radius, int x0, int x1):
+        q_(q),
+        W_(q.width()),
+        H_(q.height()),
+        r_(radius),
+        x0_(x0),
+        x1_(x1),
+        cs_(std::max(x0 - radius, 0)),
+        ce_(std::min(x1 + radius, q.width())),
+        col_coarse_((ce_ - cs_) * NUM_COARSE),
+        col_fine_(size_t(ce_ - cs_) * NUM_BINS),
+        coarse_(NUM_COARSE),
+        fine_(NUM_BINS),
+        fine_x_(NUM_COARSE)
+    {
+    }
+
+    // calls out(y, x, bin, pos) for all the pixels of the strip, where bin is
+    // the bin of the median and pos its relative position inside the bin
+    template <class Out> void operator()(Out out)
+    {
+        std::fill(col_coarse_.begin(), col_coarse_.end(), 0);
+        std::fill(col_fine_.begin(), col_fine_.end(), 0);
+        for (int y = 0; y < std::min(r_, H_); ++y) {
+            add_row(y, 1);
+        }
+
+        for (int y = 0; y < H_; ++y) {
+            if (y + r_ < H_) {
+                add_row(y + r_, 1);
+            }
+            if (y - r_ - 1 >= 0) {
+                add_row(y - r_ - 1, -1);
+            }
+            const int nrows =
+                std::min(y + r_, H_ - 1) - std::max(y - r_, 0) + 1;
+
+            // kernel histogram at x0
+            std::fill(coarse_.begin(), coarse_.end(), 0);
+            std::fill(fine_x_.begin(), fine_x_.end(), INVALID);
+            for (int c = std::max(x0_ - r_, 0); c <= std::min(x0_ + r_, W_ - 1);
+                 ++c) {
+                update_coarse(c, 1);
+            }
+
+            for (int x = x0_; x < x1_; ++x) {
+                if (x > x0_) {
+                    if (x + r_ < W_) {
+                        update_coarse(x + r_, 1);
+                    }
+                    if (x - r_ - 1 >= 0) {
+                        update_coarse(x - r_ - 1, -1);
+                    }
+                }
+                const int ncols =
+                    std::min(x + r_, W_ - 1) - std::max(x - r_, 0) + 1;
+                const uint32_t k = (uint32_t(nrows) * ncols - 1) / 2;
+
+                uint32_t sum = 0;
+                int b = 0;
+                while (sum + coarse_[b] <= k) {
+                    sum += coarse_[b];
+                    ++b;
+                }
+                update_fine(b, x);
+                const KCount *f = &fine_[b * NUM_FINE];
+                int i = 0;
+                while (sum + f[i] <= k) {
+                    sum += f[i];
+                    ++i;
+                }
+                out(y, x, b * NUM_FINE + i, (k - sum + 0.5f) / f[i]);
+            }
+        }
+    }
+
+private:
+    static constexpr int INVALID = std::numeric_limits<int>::min();
+
+    void add_row(int y, int delta)
+    {
+        const uint16_t *row = q_[y];
+        for (int c = cs_; c < ce_; ++c) {
+            const int v = row[c];
+            col_coarse_[(c - cs_) * NUM_COARSE + (v >> FINE_BITS)] += delta;
+            col_fine_[size_t(c - cs_) * NUM_BINS + v] += delta;
+        }
+    }
+
+    void update_coarse(int c, int delta)
+    {
+        const Count *h = &col_coarse_[(c - cs_) * NUM_COARSE];
+        KCount *k = &coarse_[0];
+        // plain loops, vectorized by the compiler
+        if (delta > 0) {
+            for (int i = 0; i < NUM_COARSE; ++i) {
+                k[i] += h[i];
+            }
+        } else {
+            for (int i = 0; i < NUM_COARSE; ++i) {
+                k[i] -= h[i];
+            }
+        }
+    }
+
+    void update_fine_col(int b, int c, bool add)
+    {
+        const Count *h = &col_fine_[size_t(c - cs_) * NUM_BINS + b * NUM_FINE];
+        KCount *k = &fine_[b * NUM_FINE];
+        if (add) {
+            for (int i = 0; i < NUM_FINE; ++i) {
+                k[i] += h[i];
+            }
+        } else {
+            for (int i = 0; i < NUM_FINE; ++i) {
+                k[i] -= h[i];
+            }
+        }
+    }
+
+    // brings the fine bins of bucket b up to date with the window at x
+    void update_fine(int b, int x)
+    {
+        int &fx = fine_x_[b];
+        if (fx != INVALID && x - fx <= 2 * r_) {
+            for (int xx = fx + 1; xx <= x; ++xx) {
+                if (xx + r_ < W_) {
+                    update_fine_col(b, xx + r_, true);
+                }
+                if (xx - r_ - 1 >= 0) {
+                    update_fine_col(b, xx - r_ - 1, false);
+                }
+            }
+        } else {
+            std::fill(&fine_[b * NUM_FINE], &fine_[(b + 1) * NUM_FINE], 0);
+            for (int c = std::max(x - r_, 0); c <= std::min(x + r_, W_ - 1);
+                 ++c) {
+                update_fine_col(b, c, true);
+            }
+        }
+        fx = x;
+    }
+
+    const array2D<uint16_t> &q_;
+    const int W_;
+    const int H_;
+    const int r_;
+    const int x0_;
+    const int x1_;
+    // range of the columns whose histograms are kept
+    const int cs_;
+    const int ce_;
+    std::vector<Count> col_coarse_;
+    std::vector<Count> col_fine_;
+    std::vector<KCount> coarse_;
+    std::vector<KCount> fine_;
+    // center of the window of the fine bins of each coarse bucket
+    std::vector<int> fine_x_;
+};
+
+} // namespace
+
+void median_filter(float **src, float **dst, int W, int H, int radius,
+                   bool multithread, float upper_bound)
+{
+    // the column histograms count up to 2 * radius + 1 pixels
+    radius = std::min(radius, 32767);
+    if (radius <= 0 || W <= 0 || H <= 0) {
+        if (src != dst) {
+            for (int y = 0; y < H; ++y) {
+                std::copy(src[y], src[y] + W, dst[y]);
+            }
+        }
+        return;
+    }
+
+    float lo = RT_INFINITY_F, hi = -RT_INFINITY_F;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(min : lo) reduction(max : hi) \
+    if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            lo = std::min(lo, src[y][x]);
+            hi = std::max(hi, src[y][x]);
+        }
+    }
+    if (!(hi > lo)) {
+        if (src != dst) {
+            for (int y = 0; y < H; ++y) {
+                std::copy(src[y], src[y] + W, dst[y]);
+            }
+        }
+        return;
+    }
+
+    constexpr int NUM_BINS = HistogramMedian::NUM_BINS;
+    const float to_bin = NUM_BINS / (hi - lo);
+    const float from_bin = (hi - lo) / NUM_BINS;
+    const auto bin = [&](float v) -> int {
+        return std::min(int((v - lo) * to_bin), NUM_BINS - 1);
+    };
+
+    array2D<uint16_t> q(W, H);
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            q[y][x] = bin(src[y][x]);
+        }
+    }
+
+    // vertical strips, wide enough to amortize the columns they share
+#ifdef _OPENMP
+    const int num_threads = multithread ? omp_get_max_threads() : 1;
+#else
+    const int num_threads = 1;
+#endif
+    const int num_strips =
+        LIM(W / std::max(4 * radius, 64), 1, std::max(num_threads, 1));
+    const int strip_width = (W + num_strips - 1) / num_strips;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (multithread)
+#endif
+    for (int s = 0; s < num_strips; ++s) {
+        const int x0 = s * strip_width;
+        const int x1 = std::min(x0 + strip_width, W);
+        if (x0 >= x1) {
+            continue;
+        }
+        HistogramMedian median(q, radius, x0, x1);
+        median([&](int y, int x, int b, float pos) -> void {
+            const float v = src[y][x];
+            if (v > upper_bound) {
+                dst[y][x] = v;
+            } else if (q[y][x] == b) {
+                // the pixel is within one bin of the median: keep it, so
+                // that flat areas are preserved exactly
+                dst[y][x] = v;
+            } else {
+                dst[y][x] = LIM(lo + (b + pos) * from_bin, lo, hi);
+            }
+        });
+    }
+}
+
 } // namespace rtengine
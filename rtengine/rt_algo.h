@@ -22,6 +22,7 @@
 
 #include "array2D.h"
 #include "coord.h"
+#include "rt_math.h"
 #include <cstddef>
 #include <vector>
 
@@ -40,6 +41,14 @@ void buildBlendMask(float **luminance, float **blend, int W, int H,
 
 void markImpulse(int W, int H, float **const src, char **impulse, float thresh);
 
+// median on a (2 * radius + 1)^2 window, in constant time per pixel
+// regardless of the radius. The values are quantized to 4096 levels between
+// the minimum and the maximum of src, so the result is accurate to one
+// level. Pixels above upper_bound are left unchanged. src and dst can be the
+// same
+void median_filter(float **src, float **dst, int W, int H, int radius,
+                   bool multithread, float upper_bound = RT_INFINITY_F);
+
 // implemented in tmo_fattal02
 void buildGradientsMask(int W, int H, float **luminance, float **out,
                         float amount, int nlevels, int detail_level, float alfa,
@@ -66,6 +75,28 @@ private:
     void *data_;
 };
 
+/**
+ * Same as Convolution, but computed by tiles (overlap-save) with FFTs of
+ * size proportional to the kernel rather than to the image. The transforms of
+ * the kernel are computed once, and the tiles are processed in parallel.
+ * Uses much less memory than Convolution for large images, and is faster for
+ * large kernels. src and dst must be different.
+ */
+class TiledConvolution {
+public:
+    explicit TiledConvolution(const array2D<float> &kernel, int W, int H,
+                              bool multithread);
+    ~TiledConvolution();
+
+    /// flipped: convolve with the kernel rotated by 180 degrees
+    void operator()(float **src, float **dst, bool flipped = false);
+    void operator()(const array2D<float> &src, array2D<float> &dst,
+                    bool flipped = false);
+
+private:
+    void *data_;
+};
+
 void get_luminance(const Imagefloat *src, array2D<float> &out,
                    const float ws[3][3], bool multithread);
 
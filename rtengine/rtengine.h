@@ -38,6 +38,7 @@
 #include <glibmm.h>
 #include <lcms2.h>
 #include <string>
+#include <vector>
 
 /**
  * @file
@@ -256,6 +257,15 @@ public:
      * that the preview image has been updated.
      * @param cp holds the coordinates of the current crop rectangle */
     virtual void imageReady(const procparams::CropParams &cp) = 0;
+    /** Same as imageReady(), but only the area (x, y, w, h) of the preview
+     * image has changed since the previous notification (w and h are 0 if
+     * nothing changed).
+     * @param cp holds the coordinates of the current crop rectangle */
+    virtual void imageAreaReady(const procparams::CropParams &cp, int x, int y,
+                                int w, int h)
+    {
+        imageReady(cp);
+    }
 };
 
 /** When the detailed crop image is ready for display during staged processing
@@ -523,6 +533,10 @@ public:
 
     virtual bool getHighQualComputed() = 0;
     virtual void setHighQualComputed() = 0;
+    /** Returns the size of the superpixels the CFA has been binned into for
+     * the preview (1 if it has been interpolated). Detail windows at a
+     * smaller skip need a new demosaic */
+    virtual int getPreviewBinning() = 0;
 
     virtual bool updateTryLock() = 0;
 
@@ -641,6 +655,28 @@ public:
     virtual bool fastPipeline() const = 0;
 };
 
+/** Where the time of a processing job went, in seconds. The operators of
+ * the pipeline are listed in the order they first ran; the time of an
+ * operator run on several tiles is the sum over the tiles. */
+class ProcessingTimings {
+public:
+    ProcessingTimings()
+        : width(0), height(0), total(0), load(0), preprocess(0), demosaic(0),
+          pipeline(0), output(0)
+    {
+    }
+
+    int width; ///< size of the source image
+    int height;
+    double total;
+    double load;       ///< reading and decoding the file
+    double preprocess; ///< raw preprocessing
+    double demosaic;
+    double pipeline;   ///< from the demosaiced image to the output stage
+    double output;     ///< resize, output sharpening and colour conversion
+    std::vector<std::pair<std::string, double>> operators;
+};
+
 /** This function performs all the image processing steps corresponding to the
  * given ProcessingJob. It returns when it is ready, so it can be slow. The
  * ProcessingJob passed becomes invalid, you can not use it any more.
@@ -652,7 +688,36 @@ public:
  * @return the resulting image, with the output profile applied, exif and iptc
  * data set. You have to save it or you can access the pixel data directly.  */
 IImagefloat *processImage(ProcessingJob *job, int &errorCode,
-                          ProgressListener *pl = nullptr, bool flush = false);
+                          ProgressListener *pl = nullptr, bool flush = false,
+                          ProcessingTimings *timings = nullptr);
+
+/** The settings of one of the outputs of a job rendered by the
+ * multiple-output processImage() below. They replace the corresponding
+ * processing parameters of the job. */
+class OutputSpec {
+public:
+    procparams::ResizeParams resize;
+    procparams::SharpeningParams prsharpening;
+    Glib::ustring outputProfile;
+
+    explicit OutputSpec(const procparams::ProcParams &pparams)
+        : resize(pparams.resize), prsharpening(pparams.prsharpening),
+          outputProfile(pparams.icm.outputProfile)
+    {
+    }
+};
+
+/** As above, but renders the image to several outputs at once. The
+ * processing is done only once up to the final resize; the resize, output
+ * sharpening and conversion to the output profile of each output then run
+ * in parallel. The fast pipeline is never used.
+ * @return one image per output (in the same order), or an empty vector in
+ * case of errors */
+std::vector<IImagefloat *> processImage(ProcessingJob *job,
+                                        const std::vector<OutputSpec> &outputs,
+                                        int &errorCode,
+                                        ProgressListener *pl = nullptr,
+                                        bool flush = false);
 
 /** This class is used to control the batch processing. The class implementing
  * this interface will be called when the full processing of an image is ready
@@ -667,6 +732,20 @@ public:
     virtual ProcessingJob *imageReady(IImagefloat *img) = 0;
 
     virtual const procparams::PartialProfile *getBatchProfile() = 0;
+
+    /** This function is called before processing a job. If the listener has
+     * already developed it (e.g. concurrently with the previous job, see
+     * processBatchJob()), it returns true and the result in img and
+     * errorCode, and the job is not processed again. */
+    virtual bool getDevelopedImage(ProcessingJob *job, IImagefloat *&img,
+                                   int &errorCode)
+    {
+        return false;
+    }
+
+    /** This function is called before imageReady() with the timings of the
+     * job just processed (not for the jobs returned by getDevelopedImage) */
+    virtual void jobTimings(const ProcessingTimings &timings) {}
 };
 /** This function performs all the image processing steps corresponding to the
  *given ProcessingJob. It runs in the background, thus it returns immediately,
@@ -680,6 +759,37 @@ public:
  **/
 void startBatchProcessing(ProcessingJob *job, BatchProcessingListener *bpl);
 
+/** Processes a job of the batch queue synchronously, applying the batch
+ * profile of bpl like startBatchProcessing() does, but without reporting
+ * the progress. Used to develop some of the jobs ahead of their turn. */
+IImagefloat *processBatchJob(ProcessingJob *job, BatchProcessingListener *bpl,
+                             int &errorCode,
+                             ProcessingTimings *timings = nullptr);
+
+/** Announces that uses jobs on fname (e.g. the entries of the batch queue
+ * for the same raw file, including the one about to start) are going to be
+ * processed, one after the other. The image loaded by the first of them is
+ * then kept, and the following ones reuse it instead of loading the file
+ * again. When their raw parameters (and white balance, lens and coarse
+ * transform settings) are the same, they also skip preprocess and demosaic.
+ * Each job consumes one use, and the image is released after the last one,
+ * or when uses is set to 0. */
+void setSharedSourceUses(const Glib::ustring &fname, int uses);
+
+/** Releases all the images kept by setSharedSourceUses() */
+void clearSharedSources();
+
+/** Computes for fname the estimate of the film negative reference input
+ * (the channel medians of the central part of the image) made when
+ * FilmNegativeParams::refInput is not set, on a fast and downscaled demosaic.
+ * Used to balance a whole roll of negatives with the same values, instead of
+ * analysing each frame on its own. Returns false if the file can't be
+ * loaded */
+bool estimateFilmNegativeReference(
+    const Glib::ustring &fname, bool isRaw,
+    const procparams::ProcParams &params,
+    procparams::FilmNegativeParams::RGB &refInput);
+
 extern MyMutex *lcmsMutex;
 } // namespace rtengine
 
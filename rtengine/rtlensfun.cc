@@ -20,7 +20,9 @@
 
 #include "rtlensfun.h"
 #include "settings.h"
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 #if LF_VERSION < ((3 << 16) | (99 << 8))
 #define ART_LENSFUN_LEGACY
@@ -105,46 +107,129 @@ void LFModifier::correctCA(double &x, double &y, int cx, int cy,
     y -= cy;
 }
 
-#ifdef _OPENMP
-void LFModifier::processVignette(int width, int height, float **rawData) const
-{
-#pragma omp parallel for schedule(dynamic, 16)
+namespace {
+
+// the vignetting gain is evaluated by lensfun only on the nodes of a grid
+// with this spacing, and bilinearly interpolated in between (it is smooth
+// enough for the interpolation error to be negligible). Must be a multiple
+// of 4, so that 4 consecutive pixels always fall in the same cell
+constexpr int VIGNETTE_GRID_STEP = 16;
 
-    for (int y = 0; y < height; ++y) {
-        data_->ApplyColorModification(rawData[y], 0, y, width, 1,
-                                      LF_CR_1(INTENSITY), 0);
+// gain (a multiplier, as lensfun's model is linear in the pixel value) for
+// each pixel of the row, interpolated from two adjacent rows of grid nodes.
+// row is a buffer for the nx nodes of the row
+void vignette_gain_row(const float *g0, const float *g1, float wy, int nx,
+                       int width, float *row, float *gain)
+{
+    constexpr float s = 1.f / VIGNETTE_GRID_STEP;
+    for (int j = 0; j < nx; ++j) {
+        row[j] = g0[j] + (g1[j] - g0[j]) * wy;
+    }
+    int x = 0;
+#ifdef __SSE2__
+    const vfloat offsetv = _mm_setr_ps(0.f, s, 2.f * s, 3.f * s);
+    for (; x < width - 3; x += 4) {
+        const int j = x / VIGNETTE_GRID_STEP;
+        const vfloat wxv = F2V((x - j * VIGNETTE_GRID_STEP) * s) + offsetv;
+        STVFU(gain[x], F2V(row[j]) + F2V(row[j + 1] - row[j]) * wxv);
+    }
+#endif
+    for (; x < width; ++x) {
+        const int j = x / VIGNETTE_GRID_STEP;
+        const float wx = (x - j * VIGNETTE_GRID_STEP) * s;
+        gain[x] = row[j] + (row[j + 1] - row[j]) * wx;
     }
 }
-#else
+
+} // namespace
+
 void LFModifier::processVignette(int width, int height, float **rawData) const
 {
-    data_->ApplyColorModification(rawData[0], 0, 0, width, height,
-                                  LF_CR_1(INTENSITY), width * sizeof(float));
+    processVignetteGain(width, height, rawData, 1);
 }
 
-#endif
-
-#ifdef _OPENMP
 void LFModifier::processVignette3Channels(int width, int height,
                                           float **rawData) const
 {
-#pragma omp parallel for schedule(dynamic, 16)
-
-    for (int y = 0; y < height; ++y) {
-        data_->ApplyColorModification(rawData[y], 0, y, width, 1,
-                                      LF_CR_3(RED, GREEN, BLUE), 0);
-    }
+    processVignetteGain(width, height, rawData, 3);
 }
-#else
-void LFModifier::processVignette3Channels(int width, int height,
-                                          float **rawData) const
+
+void LFModifier::processVignetteGain(int width, int height, float **rawData,
+                                     int channels) const
 {
-    data_->ApplyColorModification(rawData[0], 0, 0, width, height,
-                                  LF_CR_3(RED, GREEN, BLUE),
-                                  width * 3 * sizeof(float));
-}
+    if (!(flags_ & LF_MODIFY_VIGNETTING) || width <= 0 || height <= 0) {
+        return;
+    }
+
+    const int nx = (width - 1) / VIGNETTE_GRID_STEP + 2;
+    const int ny = (height - 1) / VIGNETTE_GRID_STEP + 2;
+    std::vector<float> grid(nx * ny, 1.f);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int i = 0; i < ny; ++i) {
+            for (int j = 0; j < nx; ++j) {
+                data_->ApplyColorModification(
+                    &grid[i * nx + j], j * VIGNETTE_GRID_STEP,
+                    i * VIGNETTE_GRID_STEP, 1, 1, LF_CR_1(INTENSITY),
+                    sizeof(float));
+            }
+        }
 
+        std::vector<float> row(nx);
+        std::vector<float> gain(width);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
 #endif
+        for (int y = 0; y < height; ++y) {
+            const int i = y / VIGNETTE_GRID_STEP;
+            const float wy =
+                float(y - i * VIGNETTE_GRID_STEP) / VIGNETTE_GRID_STEP;
+            vignette_gain_row(&grid[i * nx], &grid[(i + 1) * nx], wy, nx,
+                              width, row.data(), gain.data());
+            float *line = rawData[y];
+            int x = 0;
+            if (channels == 1) {
+#ifdef __SSE2__
+                for (; x < width - 3; x += 4) {
+                    STVFU(line[x], LVFU(line[x]) * LVFU(gain[x]));
+                }
+#endif
+                for (; x < width; ++x) {
+                    line[x] *= gain[x];
+                }
+            } else {
+#ifdef __SSE2__
+                for (; x < width - 3; x += 4) {
+                    // spread the gains of 4 pixels over their 12 values
+                    const vfloat gv = LVFU(gain[x]);
+                    const vfloat g0 =
+                        _mm_shuffle_ps(gv, gv, _MM_SHUFFLE(1, 0, 0, 0));
+                    const vfloat g1 =
+                        _mm_shuffle_ps(gv, gv, _MM_SHUFFLE(2, 2, 1, 1));
+                    const vfloat g2 =
+                        _mm_shuffle_ps(gv, gv, _MM_SHUFFLE(3, 3, 3, 2));
+                    float *p = line + 3 * x;
+                    STVFU(p[0], LVFU(p[0]) * g0);
+                    STVFU(p[4], LVFU(p[4]) * g1);
+                    STVFU(p[8], LVFU(p[8]) * g2);
+                }
+#endif
+                for (; x < width; ++x) {
+                    for (int c = 0; c < 3; ++c) {
+                        line[3 * x + c] *= gain[x];
+                    }
+                }
+            }
+        }
+    }
+}
+
 Glib::ustring LFModifier::getDisplayString() const
 {
     if (!data_) {
@@ -363,10 +448,12 @@ bool LFDatabase::LoadDirectory(const char *dirname)
 #endif
 }
 
-LFDatabase::LFDatabase(): data_(nullptr) {}
+LFDatabase::LFDatabase(): data_(nullptr), modifiers_(16) {}
 
 LFDatabase::~LFDatabase()
 {
+    // the modifiers refer to the lenses of the database
+    modifiers_.clear();
     if (data_) {
         MyMutex::MyLock lock(lfDBMutex);
 #ifdef ART_LENSFUN_LEGACY
@@ -377,7 +464,17 @@ LFDatabase::~LFDatabase()
     }
 }
 
-const LFDatabase *LFDatabase::getInstance() { return &instance_; }
+const LFDatabase *LFDatabase::getInstance()
+{
+    lazyInit().wait();
+    return &instance_;
+}
+
+LazyInit &LFDatabase::lazyInit()
+{
+    static LazyInit li;
+    return li;
+}
 
 std::vector<LFCamera> LFDatabase::getCameras() const
 {
@@ -461,15 +558,26 @@ LFLens LFDatabase::findLens(const LFCamera &camera,
     return ret;
 }
 
-std::unique_ptr<LFModifier>
+std::shared_ptr<const LFModifier>
 LFDatabase::getModifier(const LFCamera &camera, const LFLens &lens,
                         float focalLen, float aperture, float focusDist,
                         int width, int height, bool swap_xy) const
 {
-    std::unique_ptr<LFModifier> ret;
+    std::shared_ptr<const LFModifier> ret;
     if (data_) {
         MyMutex::MyLock lock(lfDBMutex);
         if (camera && lens) {
+            std::ostringstream buf;
+            buf << camera.getMake() << '\n' << camera.getModel() << '\n'
+                << lens.getMake() << '\n' << lens.getLens() << '\n'
+                << std::setprecision(9) << focalLen << ' ' << aperture << ' '
+                << focusDist << ' ' << width << ' ' << height << ' '
+                << swap_xy;
+            const std::string key = buf.str();
+            if (modifiers_.get(key, ret)) {
+                return ret;
+            }
+
             int flags = LF_MODIFY_DISTORTION | LF_MODIFY_SCALE | LF_MODIFY_TCA;
             if (aperture > 0) {
                 flags |= LF_MODIFY_VIGNETTING;
@@ -495,12 +603,13 @@ LFDatabase::getModifier(const LFCamera &camera, const LFLens &lens,
             flags = mod->GetModFlags();
 #endif // ART_LENSFUN_LEGACY
             ret.reset(new LFModifier(mod, swap_xy, flags));
+            modifiers_.set(key, ret);
         }
     }
     return ret;
 }
 
-std::unique_ptr<LFModifier> LFDatabase::findModifier(
+std::shared_ptr<const LFModifier> LFDatabase::findModifier(
     const LensProfParams &lensProf, const FramesMetaData *idata, int width,
     int height, const CoarseTransformParams &coarse, int rawRotationDeg) const
 {
@@ -542,7 +651,7 @@ std::unique_ptr<LFModifier> LFDatabase::findModifier(
         }
     }
 
-    std::unique_ptr<LFModifier> ret =
+    std::shared_ptr<const LFModifier> ret =
         getModifier(c, l, idata->getFocalLen(), idata->getFNumber(),
                     idata->getFocusDist(), width, height, swap_xy);
 
@@ -28,6 +28,8 @@
 
 #include <lensfun.h>
 
+#include "cache.h"
+#include "lazyinit.h"
 #include "lcp.h"
 #include "noncopyable.h"
 #include "procparams.h"
@@ -54,6 +56,9 @@ public:
 private:
     LFModifier(lfModifier *m, bool swap_xy, int flags);
 
+    void processVignetteGain(int width, int height, float **rawData,
+                             int channels) const;
+
     friend class LFDatabase;
     lfModifier *data_;
     bool swap_xy_;
@@ -101,6 +106,8 @@ class LFDatabase final: public NonCopyable {
 public:
     static bool init(const Glib::ustring &dbdir);
     static const LFDatabase *getInstance();
+    /// deferred loading of the database, see rtengine::init
+    static LazyInit &lazyInit();
 
     ~LFDatabase();
 
@@ -110,17 +117,18 @@ public:
                         const Glib::ustring &model) const;
     LFLens findLens(const LFCamera &camera, const Glib::ustring &name) const;
 
-    std::unique_ptr<LFModifier>
+    // the modifiers are shared: the last ones created are kept, and returned
+    // again for the same camera, lens, shooting parameters and image size
+    std::shared_ptr<const LFModifier>
     findModifier(const LensProfParams &lensProf, const FramesMetaData *idata,
                  int width, int height, const CoarseTransformParams &coarse,
                  int rawRotationDeg) const;
 
 private:
-    std::unique_ptr<LFModifier> getModifier(const LFCamera &camera,
-                                            const LFLens &lens, float focalLen,
-                                            float aperture, float focusDist,
-                                            int width, int height,
-                                            bool swap_xy) const;
+    std::shared_ptr<const LFModifier>
+    getModifier(const LFCamera &camera, const LFLens &lens, float focalLen,
+                float aperture, float focusDist, int width, int height,
+                bool swap_xy) const;
     LFDatabase();
     bool LoadDirectory(const char *dirname);
 
@@ -128,6 +136,7 @@ private:
     static LFDatabase instance_;
     lfDatabase *data_;
     mutable std::set<std::string> notFound;
+    mutable Cache<std::string, std::shared_ptr<const LFModifier>> modifiers_;
 };
 
 } // namespace rtengine
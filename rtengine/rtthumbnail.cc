@@ -20,6 +20,7 @@
 #include "../rtgui/options.h"
 #include "../rtgui/ppversion.h"
 #include "colortemp.h"
+#include "compress.h"
 #include "curves.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
@@ -38,6 +39,7 @@
 #include <glib/gstdio.h>
 #include <glibmm.h>
 #include <lcms2.h>
+#include <cstring>
 #include <locale.h>
 #define BENCHMARK
 #include "StopWatch.h"
@@ -173,6 +175,73 @@ void scale_colors(rtengine::RawImage *ri, float scale_mul[4], float cblack[4],
     }
 }
 
+// rows of the image data, in the order in which they are stored in the
+// cache files
+template <class T>
+std::vector<T *> data_rows(rtengine::PlanarRGBData<T> *img, size_t &row_len)
+{
+    const int h = img->getHeight();
+    std::vector<T *> ret;
+    ret.reserve(3 * h);
+    for (int i = 0; i < h; ++i) {
+        ret.push_back(img->r(i));
+    }
+    for (int i = 0; i < h; ++i) {
+        ret.push_back(img->g(i));
+    }
+    for (int i = 0; i < h; ++i) {
+        ret.push_back(img->b(i));
+    }
+    row_len = img->getWidth() * sizeof(T);
+    return ret;
+}
+
+template <class T>
+std::vector<T *> data_rows(rtengine::ChunkyRGBData<T> *img, size_t &row_len)
+{
+    const int h = img->getHeight();
+    std::vector<T *> ret;
+    ret.reserve(h);
+    for (int i = 0; i < h; ++i) {
+        ret.push_back(img->r(i));
+    }
+    row_len = 3 * img->getWidth() * sizeof(T);
+    return ret;
+}
+
+template <class T>
+std::vector<uint8_t> compress_rows(const std::vector<T *> &rows,
+                                   size_t row_len, rtengine::Codec codec)
+{
+    std::vector<uint8_t> buf(rows.size() * row_len);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        memcpy(&buf[i * row_len], rows[i], row_len);
+    }
+    return rtengine::compress_buffer(buf.data(), buf.size(), codec);
+}
+
+template <class T>
+bool decompress_rows(FILE *f, const std::vector<T *> &rows, size_t row_len,
+                     rtengine::Codec codec)
+{
+    uint64_t sz = 0;
+    if (fread(&sz, sizeof(uint64_t), 1, f) < 1) {
+        return false;
+    }
+    std::vector<uint8_t> data(sz);
+    if (fread(data.data(), 1, sz, f) < sz) {
+        return false;
+    }
+    std::vector<uint8_t> buf(rows.size() * row_len);
+    if (!rtengine::decompress_buffer(data, codec, buf.data(), buf.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+        memcpy(rows[i], &buf[i * row_len], row_len);
+    }
+    return true;
+}
+
 } // namespace
 
 extern Options options;
@@ -295,7 +364,10 @@ Thumbnail *Thumbnail::loadQuickFromRaw(const Glib::ustring &fname,
 
     sensorType = ri->getSensorType();
 
-    Image8 *img = ri->getThumbnail();
+    // decode the embedded jpeg directly at (roughly) the thumbnail size: the
+    // box is square because the image might have to be rotated afterwards
+    const int hint = forHistogramMatching ? 0 : (fixwh == 1 ? h : w);
+    Image8 *img = ri->getThumbnail(hint, hint);
 
     // did we succeed?
     if (!img) {
@@ -367,6 +439,9 @@ Thumbnail *Thumbnail::loadFromRaw(const Glib::ustring &fname,
     RawImage *ri = new RawImage(fname);
     unsigned int tempImageNum = 0;
 
+    // the thumbnail samples the raw data sparsely anyway, so the decoder
+    // doesn't need to produce more detail than the requested size
+    ri->set_decode_min_size(std::max(fixwh == 1 ? h : w, 0));
     int r = ri->loadRaw(true, tempImageNum, false, nullptr, 1.0, false);
 
     if (r) {
@@ -1651,6 +1726,27 @@ bool Thumbnail::writeImage(const Glib::ustring &fname)
         return false;
     }
 
+    // the pixel data is compressed with the fastest codec available, as
+    // the cache is often on slow (e.g. network) storage
+    const Codec codec = Codec::FASTEST;
+    std::vector<uint8_t> data;
+    size_t row_len = 0;
+
+    if (thumbImg->getType() == sImage8) {
+        Image8 *image = static_cast<Image8 *>(thumbImg);
+        data = compress_rows(data_rows(image, row_len), row_len, codec);
+    } else if (thumbImg->getType() == sImage16) {
+        Image16 *image = static_cast<Image16 *>(thumbImg);
+        data = compress_rows(data_rows(image, row_len), row_len, codec);
+    } else if (thumbImg->getType() == sImagefloat) {
+        Imagefloat *image = static_cast<Imagefloat *>(thumbImg);
+        data = compress_rows(data_rows(image, row_len), row_len, codec);
+    }
+
+    if (data.empty()) {
+        return false;
+    }
+
     Glib::ustring fullFName = fname + ".rtti";
 
     FILE *f = g_fopen(fullFName.c_str(), "wb");
@@ -1659,25 +1755,20 @@ bool Thumbnail::writeImage(const Glib::ustring &fname)
         return false;
     }
 
+    // the type is tagged with the codec, so that files without it (written
+    // by older versions, uncompressed) can still be read
     fwrite(thumbImg->getType(), sizeof(char), strlen(thumbImg->getType()), f);
+    fputc(':', f);
+    fwrite(codec_name(codec), sizeof(char), strlen(codec_name(codec)), f);
     fputc('\n', f);
     guint32 w = guint32(thumbImg->getWidth());
     guint32 h = guint32(thumbImg->getHeight());
     fwrite(&w, sizeof(guint32), 1, f);
     fwrite(&h, sizeof(guint32), 1, f);
+    uint64_t sz = data.size();
+    fwrite(&sz, sizeof(uint64_t), 1, f);
+    fwrite(data.data(), 1, data.size(), f);
 
-    if (thumbImg->getType() == sImage8) {
-        Image8 *image = static_cast<Image8 *>(thumbImg);
-        image->writeData(f);
-    } else if (thumbImg->getType() == sImage16) {
-        Image16 *image = static_cast<Image16 *>(thumbImg);
-        image->writeData(f);
-    } else if (thumbImg->getType() == sImagefloat) {
-        Imagefloat *image = static_cast<Imagefloat *>(thumbImg);
-        image->writeData(f);
-    }
-
-    // thumbImg->writeData(f);
     fclose(f);
     return true;
 }
@@ -1704,10 +1795,27 @@ bool Thumbnail::readImage(const Glib::ustring &fname)
 
     char imgType[31]; // 30 -> arbitrary size, but should be enough for all
                       // image type's name
-    fgets(imgType, 30, f);
+    if (!fgets(imgType, 30, f)) {
+        fclose(f);
+        return false;
+    }
     imgType[strlen(imgType) - 1] = '\0'; // imgType has a \n trailing character,
                                          // so we overwrite it by the \0 char
 
+    // "type:codec" for compressed data, just "type" for the old format
+    bool compressed = false;
+    Codec codec = Codec::ZLIB;
+    char *sep = strchr(imgType, ':');
+    if (sep) {
+        *sep = '\0';
+        compressed = true;
+        if (!codec_from_name(sep + 1, codec)) {
+            printf("readImage: Unsupported compression \"%s\"!\n", sep + 1);
+            fclose(f);
+            return false;
+        }
+    }
+
     guint32 width, height;
 
     if (fread(&width, 1, sizeof(guint32), f) < sizeof(guint32)) {
@@ -1719,32 +1827,53 @@ bool Thumbnail::readImage(const Glib::ustring &fname)
     }
 
     bool success = false;
+    size_t row_len = 0;
 
     if (std::min(width, height) > 0) {
         if (!strcmp(imgType, sImage8)) {
             Image8 *image = new Image8(width, height);
-            image->readData(f);
+            if (compressed) {
+                success = decompress_rows(f, data_rows(image, row_len),
+                                          row_len, codec);
+            } else {
+                image->readData(f);
+                success = true;
+            }
             thumbImg = image;
-            success = true;
         } else if (!strcmp(imgType, sImage16)) {
             Image16 *image = new Image16(width, height);
-            image->readData(f);
+            if (compressed) {
+                success = decompress_rows(f, data_rows(image, row_len),
+                                          row_len, codec);
+            } else {
+                image->readData(f);
+                success = true;
+            }
             thumbImg = image;
-            success = true;
         } else if (!strcmp(imgType, sImagefloat)) {
             Imagefloat *image = new Imagefloat(width, height);
-            image->readData(f);
+            if (compressed) {
+                success = decompress_rows(f, data_rows(image, row_len),
+                                          row_len, codec);
+            } else {
+                image->readData(f);
+                success = true;
+            }
             thumbImg = image;
-            success = true;
         } else {
             printf("readImage: Unsupported image type \"%s\"!\n", imgType);
         }
     }
     fclose(f);
+
+    if (!success && thumbImg) {
+        delete thumbImg;
+        thumbImg = nullptr;
+    }
     return success;
 }
 
-bool Thumbnail::readData(const Glib::ustring &fname)
+bool Thumbnail::readData(const std::string &data)
 {
     setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
     Glib::KeyFile keyFile;
@@ -1753,7 +1882,9 @@ bool Thumbnail::readData(const Glib::ustring &fname)
         MyMutex::MyLock thmbLock(thumbMutex);
 
         try {
-            keyFile.load_from_file(fname);
+            if (data.empty() || !keyFile.load_from_data(data)) {
+                return false;
+            }
         } catch (Glib::Error &) {
             return false;
         }
@@ -1836,22 +1967,21 @@ bool Thumbnail::readData(const Glib::ustring &fname)
         return true;
     } catch (Glib::Error &err) {
         if (options.rtSettings.verbose) {
-            printf("Thumbnail::readData / Error code %d while reading values "
-                   "from \"%s\":\n%s\n",
-                   err.code(), fname.c_str(), err.what().c_str());
+            printf("Thumbnail::readData / Error code %d while reading "
+                   "values:\n%s\n",
+                   err.code(), err.what().c_str());
         }
     } catch (...) {
         if (options.rtSettings.verbose) {
             printf("Thumbnail::readData / Unknown exception while trying to "
-                   "load \"%s\"!\n",
-                   fname.c_str());
+                   "load the data!\n");
         }
     }
 
     return false;
 }
 
-bool Thumbnail::writeData(const Glib::ustring &fname)
+bool Thumbnail::writeData(std::string &data)
 {
     MyMutex::MyLock thmbLock(thumbMutex);
 
@@ -1862,7 +1992,9 @@ bool Thumbnail::writeData(const Glib::ustring &fname)
         Glib::KeyFile keyFile;
 
         try {
-            keyFile.load_from_file(fname);
+            if (!data.empty()) {
+                keyFile.load_from_data(data);
+            }
         } catch (Glib::Error &) {
         }
 
@@ -1888,15 +2020,14 @@ bool Thumbnail::writeData(const Glib::ustring &fname)
 
     } catch (Glib::Error &err) {
         if (options.rtSettings.verbose) {
-            printf("Thumbnail::writeData / Error code %d while reading values "
-                   "from \"%s\":\n%s\n",
-                   err.code(), fname.c_str(), err.what().c_str());
+            printf("Thumbnail::writeData / Error code %d while reading "
+                   "values:\n%s\n",
+                   err.code(), err.what().c_str());
         }
     } catch (...) {
         if (options.rtSettings.verbose) {
             printf("Thumbnail::writeData / Unknown exception while trying to "
-                   "save \"%s\"!\n",
-                   fname.c_str());
+                   "save the data!\n");
         }
     }
 
@@ -1904,21 +2035,7 @@ bool Thumbnail::writeData(const Glib::ustring &fname)
         return false;
     }
 
-    FILE *f = g_fopen(fname.c_str(), "wt");
-
-    if (!f) {
-        if (options.rtSettings.verbose) {
-            printf("Thumbnail::writeData / Error: unable to open file \"%s\" "
-                   "with write access!\n",
-                   fname.c_str());
-        }
-
-        return false;
-    } else {
-        fprintf(f, "%s", keyData.c_str());
-        fclose(f);
-    }
-
+    data = keyData;
     return true;
 }
 
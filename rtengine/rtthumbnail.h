@@ -115,8 +115,9 @@ public:
     bool writeImage(const Glib::ustring &fname);
     bool readImage(const Glib::ustring &fname);
 
-    bool readData(const Glib::ustring &fname);
-    bool writeData(const Glib::ustring &fname);
+    // LiveThumbData section of the cache record of the image
+    bool readData(const std::string &data);
+    bool writeData(std::string &data);
 
     bool readEmbProfile(const Glib::ustring &fname);
     bool writeEmbProfile(const Glib::ustring &fname);
@@ -0,0 +1,226 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scratcharena.h"
+#include "settings.h"
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+constexpr size_t MIN_BUCKET = 1024; // in floats
+
+thread_local ScratchArena *current_arena = nullptr;
+
+int highest_bit(size_t v)
+{
+    int ret = 0;
+    while (v >>= 1) {
+        ++ret;
+    }
+    return ret;
+}
+
+} // namespace
+
+ScratchArena::ScratchArena(): idle_bytes_(0) {}
+
+ScratchArena::~ScratchArena()
+{
+    assert(stats_.in_use == 0);
+}
+
+size_t ScratchArena::bucket(size_t size)
+{
+    // 8 buckets per power of two
+    if (size <= MIN_BUCKET) {
+        return MIN_BUCKET;
+    }
+    const size_t step = size_t(1) << std::max(highest_bit(size) - 3, 0);
+    return (size + step - 1) / step * step;
+}
+
+ScratchArena::Buffer *ScratchArena::acquire(size_t size)
+{
+    const size_t b = bucket(size);
+    Buffer *ret = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = idle_.lower_bound(b);
+        if (it != idle_.end() && it->first <= 2 * b) {
+            ret = it->second.release();
+            idle_.erase(it);
+            idle_bytes_ -= ret->size * sizeof(float);
+            ++stats_.hits;
+        }
+    }
+
+    if (!ret) {
+        std::unique_ptr<Buffer> buf(new Buffer());
+        if (!buf->data.resize(b)) {
+            throw std::bad_alloc();
+        }
+        buf->size = b;
+        ret = buf.release();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const size_t bytes = b * sizeof(float);
+        ++stats_.misses;
+        stats_.allocated += bytes;
+        stats_.reserved += bytes;
+        stats_.peak_reserved = std::max(stats_.peak_reserved, stats_.reserved);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.in_use += ret->size * sizeof(float);
+    stats_.peak_in_use = std::max(stats_.peak_in_use, stats_.in_use);
+    return ret;
+}
+
+void ScratchArena::release(Buffer *buf)
+{
+    std::unique_ptr<Buffer> b(buf);
+    const size_t bytes = b->size * sizeof(float);
+    const size_t limit =
+        size_t(std::max(settings->scratch_arena_memory_limit, 0)) * 1024 *
+        1024;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.in_use -= bytes;
+    if (idle_bytes_ + bytes <= limit) {
+        idle_bytes_ += bytes;
+        idle_.emplace(b->size, std::move(b));
+    } else {
+        stats_.reserved -= bytes;
+    }
+}
+
+ScratchArena::Stats ScratchArena::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ScratchArena::resetPeak()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.peak_in_use = stats_.in_use;
+    stats_.peak_reserved = stats_.reserved;
+}
+
+void ScratchArena::trim()
+{
+    std::multimap<size_t, std::unique_ptr<Buffer>> tmp;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tmp.swap(idle_);
+        stats_.reserved -= idle_bytes_;
+        idle_bytes_ = 0;
+    }
+}
+
+ScratchArena::Scope::Scope(ScratchArena *arena)
+    : prev_(current_arena)
+{
+    current_arena = arena;
+}
+
+ScratchArena::Scope::~Scope()
+{
+    current_arena = prev_;
+}
+
+ScratchArena *ScratchArena::current()
+{
+    return current_arena;
+}
+
+ScratchArena::Buffer *ScratchPlane::get_buffer(ScratchArena *arena, int W,
+                                               int H)
+{
+    // rows aligned to 16 bytes, as with ARRAY2D_ALIGNED
+    const size_t stride = (size_t(std::max(W, 0)) + 3) / 4 * 4;
+    const size_t size = stride * std::max(H, 0);
+
+    ScratchArena::Buffer *ret = nullptr;
+    if (arena) {
+        ret = arena->acquire(size);
+    } else {
+        ret = new ScratchArena::Buffer();
+        if (size && !ret->data.resize(size)) {
+            delete ret;
+            throw std::bad_alloc();
+        }
+        ret->size = size;
+    }
+
+    ret->rows.resize(std::max(H, 0));
+    for (int y = 0; y < H; ++y) {
+        ret->rows[y] = ret->data.data + y * stride;
+    }
+    return ret;
+}
+
+ScratchPlane::ScratchPlane(int W, int H, ScratchArena *arena,
+                           ScratchArena::Buffer *buf)
+    : array2D<float>(W, H, buf->rows.data(), ARRAY2D_BYREFERENCE),
+      arena_(arena), buf_(buf)
+{
+}
+
+ScratchPlane::ScratchPlane(int W, int H, unsigned int flags)
+    : ScratchPlane(W, H, ScratchArena::current(),
+                 get_buffer(ScratchArena::current(), W, H))
+{
+    if (flags & ARRAY2D_CLEAR_DATA) {
+        fill(0.f);
+    }
+}
+
+ScratchPlane::ScratchPlane(int W, int H, float *const *src)
+    : ScratchPlane(W, H)
+{
+    for (int y = 0; y < H; ++y) {
+        std::copy(src[y], src[y] + W, (*this)[y]);
+    }
+}
+
+ScratchPlane::ScratchPlane(int W, int H, const array2D<float> &src)
+    : ScratchPlane(W, H)
+{
+    for (int y = 0; y < H; ++y) {
+        std::copy(src[y], src[y] + W, (*this)[y]);
+    }
+}
+
+ScratchPlane::~ScratchPlane()
+{
+    if (arena_) {
+        arena_->release(buf_);
+    } else {
+        delete buf_;
+    }
+}
+
+} // namespace rtengine
@@ -0,0 +1,133 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "alignedbuffer.h"
+#include "array2D.h"
+#include "noncopyable.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Pool of reusable float planes for the temporaries of the image processing
+ * operators, to avoid reallocating several full-size buffers at every
+ * update of the preview.
+ *
+ * Each ImProcFunctions owns an arena, which it makes the current one of the
+ * calling thread while an operator is running (see Scope). The planes are
+ * obtained by constructing a ScratchPlane: its buffer comes from the current
+ * arena if there is one, and from the heap otherwise, so the same code works
+ * also outside of the pipeline (e.g. from worker threads of OpenMP regions).
+ *
+ * Buffers are 64-byte aligned, with 16-byte aligned rows, and are grouped in
+ * size buckets; a request is served by the smallest idle buffer of the
+ * same or of a larger bucket, up to twice its size. The memory kept by the
+ * idle buffers is bounded by settings->scratch_arena_memory_limit.
+ */
+class ScratchArena: public NonCopyable {
+public:
+    struct Stats {
+        Stats()
+            : in_use(0), peak_in_use(0), reserved(0), peak_reserved(0),
+              allocated(0), hits(0), misses(0)
+        {
+        }
+
+        size_t in_use;        // bytes of the planes currently handed out
+        size_t peak_in_use;   // high-water mark of in_use
+        size_t reserved;      // bytes held by the arena (in use + idle)
+        size_t peak_reserved; // high-water mark of reserved
+        size_t allocated;     // total bytes allocated from the heap
+        size_t hits;          // requests served by an idle buffer
+        size_t misses;        // requests that needed a new buffer
+    };
+
+    ScratchArena();
+    ~ScratchArena();
+
+    Stats getStats() const;
+    // restarts the high-water marks from the current usage
+    void resetPeak();
+    // releases all the idle buffers
+    void trim();
+
+    // makes the given arena the current one of the calling thread for the
+    // lifetime of the object
+    class Scope: public NonCopyable {
+    public:
+        explicit Scope(ScratchArena *arena);
+        ~Scope();
+
+    private:
+        ScratchArena *prev_;
+    };
+
+    static ScratchArena *current();
+
+private:
+    friend class ScratchPlane;
+
+    struct Buffer {
+        Buffer(): data(0, 64), size(0) {}
+
+        AlignedBuffer<float> data;
+        std::vector<float *> rows;
+        size_t size; // in floats
+    };
+
+    // the returned buffer has at least size floats
+    Buffer *acquire(size_t size);
+    void release(Buffer *buf);
+    static size_t bucket(size_t size);
+
+    mutable std::mutex mutex_;
+    std::multimap<size_t, std::unique_ptr<Buffer>> idle_;
+    size_t idle_bytes_;
+    Stats stats_;
+};
+
+/**
+ * A temporary W x H plane, returned to the arena it came from at
+ * destruction. It is a regular array2D<float> referencing the buffer of the
+ * arena, so it must not be resized or swapped, and its rows are not
+ * contiguous (the conversion to float * returns nullptr).
+ */
+class ScratchPlane: public array2D<float> {
+public:
+    ScratchPlane(int W, int H, unsigned int flags = 0);
+    // initialized with a copy of src
+    ScratchPlane(int W, int H, float *const *src);
+    ScratchPlane(int W, int H, const array2D<float> &src);
+    ~ScratchPlane();
+
+private:
+    ScratchPlane(int W, int H, ScratchArena *arena,
+                 ScratchArena::Buffer *buf);
+    static ScratchArena::Buffer *get_buffer(ScratchArena *arena, int W,
+                                            int H);
+
+    ScratchArena *arena_;
+    ScratchArena::Buffer *buf_;
+};
+
+} // namespace rtengine
@@ -96,6 +96,84 @@ public:
     static ColorManagementMode color_mgmt_mode;
 
     int imgio_raw_cache_size;
+    int imgio_max_processes; ///< maximum number of custom loaders/savers
+                             ///< running at the same time, 0 for the number
+                             ///< of CPU cores
+    int raw_decode_cache_size; ///< number of decoded raw files kept in the
+                               ///< on-disk cache, 0 to disable it
+
+    int output_tile_size; ///< side of the tiles used by the output pipeline
+                          ///< (in pixels), 0 to process the whole image at once
+    int preview_stage_cache_size; ///< memory budget (in MB) of the cache of
+                                  ///< preview pipeline stages, 0 to disable
+    bool preview_step_checkpoints; ///< re-execute only the operators affected
+                                   ///< by a change in the preview pipeline
+    int preview_proxy_skip; ///< minimum preview downscale factor at which
+                            ///< the detail level tools are approximated at
+                            ///< half size while editing, 0 to disable
+    bool preview_progressive; ///< show the approximated preview first at
+                              ///< every zoom level, and refine it when idle
+    int preview_frame_budget; ///< time (in ms) after a refresh of the detail
+                              ///< windows during which their updates are
+                              ///< interrupted by newer changes, 0 to disable
+    int scratch_arena_memory_limit; ///< memory (in MB) of the idle temporary
+                                    ///< planes kept for reuse by each
+                                    ///< pipeline, 0 to disable the reuse
+    bool fattal_multigrid; ///< use the multigrid Poisson solver in the
+                           ///< dynamic range compression tool, instead of
+                           ///< the FFT one
+    bool fast_monitor_transform; ///< apply the monitor (and soft-proofing)
+                                 ///< transform through a 3D LUT baked from
+                                 ///< the lcms one
+    int clut_cache_memory_limit; ///< memory (in MB) of the decoded
+                                 ///< HaldCLUTs kept by the CLUTStore, 0 for
+                                 ///< no limit
+    int clut_disk_cache_size; ///< size (in MB) of the on-disk cache of the
+                              ///< decoded HaldCLUTs, shared by all the ART
+                              ///< processes, 0 to disable it
+    int extlut_disk_cache_size; ///< size (in MB) of the on-disk cache of the
+                                ///< LUTs generated by external programs, 0
+                                ///< to limit only the number of entries
+    bool half_float_buffers; ///< store the images kept aside by the
+                             ///< pipelines (preview checkpoints, pending
+                             ///< output tiles) as binary16
+    bool early_crop; ///< when saving a cropped image, process only the part
+                     ///< of the frame needed for the crop before the
+                     ///< geometric transformations
+    int mask_processing_scale; ///< downscale factor at which the parametric
+                               ///< and deltaE masks are evaluated before
+                               ///< being upsampled, 1 for full resolution
+    int thumbnail_detail_skip_size; ///< thumbnails whose larger side is at
+                                    ///< most this many pixels skip the
+                                    ///< operators that only affect the fine
+                                    ///< detail (0 to always run them)
+    int histogram_live_stride; ///< sampling step (in rows and columns) of the
+                               ///< histograms computed while more updates are
+                               ///< pending, 1 to always use all the pixels
+    bool color_tables_cache; ///< store the lookup tables of Color in the
+                             ///< cache directory, and map them read-only
+                             ///< (sharing them between the ART processes)
+    int metadata_cache_memory_limit; ///< MB of parsed image metadata kept in
+                                     ///< memory
+    int external_mask_cache_memory_limit; ///< MB of decoded external masks
+                                          ///< (and of their downsampled
+                                          ///< copies) kept in memory
+    int defect_map_min_images; ///< number of images of a camera body after
+                               ///< which the hot/dead pixels learned from
+                               ///< them replace the scan, 0 to disable
+    bool numa_first_touch; ///< on machines with several NUMA nodes, spread
+                           ///< the pages of the large buffers over the
+                           ///< threads that will process them (works best
+                           ///< with OMP_PROC_BIND=spread OMP_PLACES=cores)
+    int plane_pool_memory_limit; ///< memory (in MB) of the idle large
+                                 ///< buffers kept for reuse by the whole
+                                 ///< process, 0 to disable the reuse
+    int plane_swap_threshold; ///< size (in MB) from which the large
+                              ///< buffers are mapped from temporary files,
+                              ///< so that they can be paged out to disk
+                              ///< (for huge images), 0 to disable
+    Glib::ustring plane_swap_dir; ///< directory of the files of the above,
+                                  ///< the temporary directory if empty
 };
 
 } // namespace rtengine
@@ -21,7 +21,9 @@
 #include "clutstore.h"
 #include "colortemp.h"
 #include "curves.h"
+#include "halfimage.h"
 #include "iccstore.h"
+#include "memoryusage.h"
 #include "imagesource.h"
 #include "improcfun.h"
 #include "metadata.h"
@@ -31,7 +33,13 @@
 #include "rescale.h"
 #include "rtengine.h"
 #include "threadpool.h"
+#include "tiling.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <glibmm.h>
+#include <map>
+#include <mutex>
 
 #undef THREAD_PRIORITY_NORMAL
 
@@ -40,25 +48,236 @@ extern const Settings *settings;
 
 namespace {
 
+// adds the time spent in its scope to the given counter
+class ElapsedTime {
+public:
+    explicit ElapsedTime(double &out)
+        : out_(out), start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ElapsedTime()
+    {
+        out_ += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start_)
+                    .count();
+    }
+
+private:
+    double &out_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// The loaded images kept for the upcoming jobs on the same file (see
+// setSharedSourceUses()), together with the parameters of their last
+// preprocess and demosaic. Every job on a file consumes one of its announced
+// uses, and the image is dropped when none is left. An image source is not thread safe, so each image
+// is used by one job at a time: the jobs finding it busy load their own copy
+class SharedSources {
+public:
+    // everything preprocess() and demosaic() depend on
+    class Key {
+    public:
+        Key(): denoise(false), wb{0, 0, 0} {}
+        Key(const procparams::ProcParams &params, const ColorTemp &temp)
+            : raw(params.raw), lensProf(params.lensProf),
+              coarse(params.coarse), denoise(params.denoise.enabled)
+        {
+            temp.getMultipliers(wb[0], wb[1], wb[2]);
+        }
+
+        bool operator==(const Key &other) const
+        {
+            return raw == other.raw && lensProf == other.lensProf &&
+                   coarse == other.coarse && denoise == other.denoise &&
+                   std::equal(wb, wb + 3, other.wb);
+        }
+
+    private:
+        procparams::RAWParams raw;
+        procparams::LensProfParams lensProf;
+        procparams::CoarseTransformParams coarse;
+        bool denoise;
+        double wb[3];
+    };
+
+    static SharedSources *getInstance()
+    {
+        static SharedSources instance;
+        return &instance;
+    }
+
+    void setUses(const Glib::ustring &fname, int uses)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (uses > 0) {
+            entries_[fname].uses = uses;
+        } else {
+            auto it = entries_.find(fname);
+            if (it != entries_.end()) {
+                it->second.uses = 0;
+                if (!it->second.busy) {
+                    drop(it);
+                }
+            }
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            it->second.uses = 0;
+            if (it->second.busy) {
+                ++it;
+            } else {
+                it = drop(it);
+            }
+        }
+    }
+
+    // called by each job on fname, consuming one of the announced uses.
+    // Returns the image of fname if there is one and it is not in use
+    InitialImage *acquire(const Glib::ustring &fname)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(fname);
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+        auto &e = it->second;
+        e.uses = std::max(e.uses - 1, 0);
+        if (!e.ii) {
+            if (!e.uses) {
+                entries_.erase(it);
+            }
+            return nullptr;
+        } else if (e.busy) {
+            return nullptr;
+        }
+        e.busy = true;
+        e.ii->increaseRef();
+        return e.ii;
+    }
+
+    // keeps ii if more jobs on fname are expected after the caller. Returns
+    // true in that case, and ii is then in use by the caller
+    bool store(const Glib::ustring &fname, InitialImage *ii)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(fname);
+        if (it == entries_.end() || it->second.ii || it->second.uses <= 0) {
+            return false;
+        }
+        it->second.ii = ii;
+        it->second.busy = true;
+        it->second.demosaiced = false;
+        ii->increaseRef();
+        return true;
+    }
+
+    // true if the image of fname, in use by the caller, has been
+    // demosaiced with key. Otherwise, the caller is going to do it
+    bool demosaiced(const Glib::ustring &fname, const Key &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &e = entries_[fname];
+        if (e.demosaiced && e.key == key) {
+            return true;
+        }
+        e.demosaiced = true;
+        e.key = key;
+        return false;
+    }
+
+    void release(const Glib::ustring &fname)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(fname);
+        if (it != entries_.end()) {
+            it->second.busy = false;
+            if (it->second.uses <= 0) {
+                drop(it);
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        InitialImage *ii;
+        int uses;
+        bool busy;
+        bool demosaiced;
+        Key key;
+
+        Entry(): ii(nullptr), uses(0), busy(false), demosaiced(false) {}
+    };
+    typedef std::map<Glib::ustring, Entry> EntryMap;
+
+    EntryMap::iterator drop(EntryMap::iterator it)
+    {
+        if (it->second.ii) {
+            it->second.ii->decreaseRef();
+        }
+        return entries_.erase(it);
+    }
+
+    std::mutex mutex_;
+    EntryMap entries_;
+};
+
 class ImageProcessor {
 public:
     ImageProcessor(ProcessingJob *pjob, int &errorCode, ProgressListener *pl,
-                   bool flush)
+                   bool flush, ProcessingTimings *timings = nullptr)
         : job(static_cast<ProcessingJobImpl *>(pjob)), errorCode(errorCode),
-          pl(pl), flush(flush),
+          pl(pl), flush(flush), timings_out(timings),
           // internal state
-          ii(nullptr), imgsrc(nullptr), fw(0), fh(0), scale_factor(1.0), tr(0),
-          pp(0, 0, 0, 0, 0), dnstore(), pipeline_scale(1.0), stop(false)
+          ii(nullptr), shared_source(false), imgsrc(nullptr), fw(0), fh(0),
+          scale_factor(1.0), tr(0),
+          pp(0, 0, 0, 0, 0), dnstore(), early_crop(false), img_x(0),
+          img_y(0), pipeline_scale(1.0), stop(false), estimated_memory(0)
     {
     }
 
     Imagefloat *operator()()
     {
-        if (!job->fast) {
-            return normal_pipeline();
-        } else {
-            return fast_pipeline();
+        MemoryUsage::Scope mem("job");
+        Imagefloat *ret = nullptr;
+        {
+            ElapsedTime t(timings.total);
+            ret = job->fast ? fast_pipeline() : normal_pipeline();
         }
+        if (timings_out) {
+            timings.pipeline = std::max(
+                timings.total - timings.load - timings.preprocess -
+                    timings.demosaic - timings.output,
+                0.0);
+            *timings_out = timings;
+        }
+
+        if (settings->verbose && estimated_memory) {
+            constexpr size_t MB = 1024 * 1024;
+            mem.print(std::cout);
+            std::cout << "  (estimated: " << estimated_memory / MB << " MB)"
+                      << std::endl;
+        }
+        return ret;
+    }
+
+    std::vector<Imagefloat *>
+    operator()(const std::vector<OutputSpec> &outputs)
+    {
+        MemoryUsage::Scope mem("job");
+        auto ret = multi_pipeline(outputs);
+
+        if (settings->verbose && estimated_memory) {
+            constexpr size_t MB = 1024 * 1024;
+            mem.print(std::cout);
+            std::cout << "  (estimated: " << estimated_memory / MB << " MB)"
+                      << std::endl;
+        }
+        return ret;
     }
 
 private:
@@ -111,11 +330,22 @@ private:
         ii = job->initialImage;
 
         if (!ii) {
-            ii = InitialImage::load(job->fname, job->isRaw, &errorCode);
+            auto shared = SharedSources::getInstance();
+            ii = shared->acquire(job->fname);
+            shared_source = (ii != nullptr);
+
+            if (!ii) {
+                ElapsedTime t(timings.load);
+                ii = InitialImage::load(job->fname, job->isRaw, &errorCode);
 
-            if (errorCode) {
-                delete job;
-                return false; // return nullptr;
+                if (errorCode) {
+                    delete job;
+                    return false; // return nullptr;
+                }
+                shared_source = shared->store(job->fname, ii);
+            } else if (settings->verbose) {
+                std::cout << "Reusing the image of " << job->fname
+                          << " loaded by a previous job" << std::endl;
             }
         }
 
@@ -136,6 +366,9 @@ private:
             imgsrc->setBorder(params.raw.xtranssensor.border);
         }
         imgsrc->getFullSize(fw, fh, tr);
+        estimated_memory = estimate_peak_memory(fw, fh, params);
+        timings.width = fw;
+        timings.height = fh;
 
         // check the crop params
         if (params.crop.x > fw || params.crop.y > fh) {
@@ -168,6 +401,9 @@ private:
 
         ipf_p.reset(new ImProcFunctions(&params, true));
         ImProcFunctions &ipf = *(ipf_p.get());
+        if (timings_out) {
+            ipf.setTimings(&timings);
+        }
         scale_factor = 1.0;
         if (is_fast) {
             int imw, imh;
@@ -205,8 +441,21 @@ private:
             }
         }
 
-        imgsrc->preprocess(params.raw, params.lensProf, params.coarse,
-                           params.denoise.enabled, currWB);
+        // a shared image can already be in the state we need
+        const bool demosaiced =
+            shared_source &&
+            SharedSources::getInstance()->demosaiced(
+                job->fname, SharedSources::Key(params, currWB));
+        if (demosaiced && settings->verbose) {
+            std::cout << "Skipping preprocess and demosaic" << std::endl;
+        }
+
+        if (!demosaiced) {
+            MemoryUsage::Scope mem("preprocess");
+            ElapsedTime t(timings.preprocess);
+            imgsrc->preprocess(params.raw, params.lensProf, params.coarse,
+                               params.denoise.enabled, currWB);
+        }
 
         if (pl) {
             pl->setProgress(0.20);
@@ -219,7 +468,11 @@ private:
             imgsrc->getSensorType() == ST_BAYER
                 ? params.raw.bayersensor.dualDemosaicContrast
                 : params.raw.xtranssensor.dualDemosaicContrast;
-        imgsrc->demosaic(params.raw, autoContrast, contrastThreshold);
+        if (!demosaiced) {
+            MemoryUsage::Scope mem("demosaic");
+            ElapsedTime t(timings.demosaic);
+            imgsrc->demosaic(params.raw, autoContrast, contrastThreshold);
+        }
 
         if (params.wb.method == WBParams::AUTO) {
             double rm, gm, bm;
@@ -238,7 +491,21 @@ private:
         if (pl) {
             pl->setProgress(0.30);
         }
-        pp = PreviewProps(0, 0, fw, fh, 1);
+
+        if (params.distortion.enabled && params.distortion.autocompute) {
+            params.distortion.amount =
+                ImProcFunctions::getAutoDistor(imgsrc->getFileName(), 400);
+        }
+
+        img_x = img_y = 0;
+        int img_w = fw, img_h = fh;
+        early_crop = !is_fast && get_early_crop(img_x, img_y, img_w, img_h);
+        if (early_crop && settings->verbose) {
+            std::cout << "Processing only the region " << img_w << "x"
+                      << img_h << "+" << img_x << "+" << img_y
+                      << " before the transformations" << std::endl;
+        }
+        pp = PreviewProps(img_x, img_y, img_w, img_h, 1);
 
         if (pl) {
             pl->setProgress(0.40);
@@ -254,7 +521,7 @@ private:
             ipf.denoiseComputeParams(imgsrc, currWB, dnstore, params.denoise);
         }
 
-        img = new Imagefloat(fw, fh);
+        img = new Imagefloat(img_w, img_h);
         imgsrc->getImage(currWB, tr, img, pp, params.exposure, params.raw);
         img->assignColorSpace(params.icm.workingProfile);
 
@@ -285,7 +552,8 @@ private:
                             nullptr, tr, nullptr);
         }
 
-        if (flush) {
+        // the data of a shared image is needed by the next jobs
+        if (flush && !shared_source) {
             imgsrc->flushRawData();
             imgsrc->flushRGB();
         }
@@ -293,6 +561,64 @@ private:
         return true;
     }
 
+    // Computes the region of the frame that the operators preceding the
+    // transformations need to process to produce the crop: the crop
+    // rectangle mapped back through the geometric corrections, plus a
+    // margin for the operators looking at a neighbourhood of the pixels.
+    // Returns false if the whole frame is needed (or nearly so), in which case
+    // the output parameters are not modified
+    bool get_early_crop(int &out_x, int &out_y, int &out_w, int &out_h)
+    {
+        const procparams::ProcParams &params = job->pparams;
+        ImProcFunctions &ipf = *(ipf_p.get());
+
+        if (!settings->early_crop || !params.crop.enabled ||
+            ipf.getTileHalo(ImProcFunctions::Stage::STAGE_0) < 0) {
+            return false;
+        }
+
+        int x = params.crop.x;
+        int y = params.crop.y;
+        int w = params.crop.w;
+        int h = params.crop.h;
+        int margin = 8; // for the interpolation of the transformations
+        if (params.denoise.enabled) {
+            margin += 128;
+        }
+
+        if (ipf.needsTransform()) {
+            int tx, ty, tw, th;
+            ipf.transCoord(fw, fh, x, y, w, h, tx, ty, tw, th);
+            x = tx;
+            y = ty;
+            w = tw;
+            h = th;
+            // transCoord doesn't account for the perspective and the lens
+            // distortion correction, so use the same estimates as the
+            // detail windows of the editor (see Crop::setCropSizes)
+            if (params.perspective.enabled) {
+                return false;
+            } else if (params.lensProf.useDist && params.lensProf.needed()) {
+                margin += int(0.15 * std::max(fw, fh) / 2);
+            }
+        }
+
+        const int x1 = std::max(x - margin, 0);
+        const int y1 = std::max(y - margin, 0);
+        const int x2 = std::min(x + w + margin, fw);
+        const int y2 = std::min(y + h + margin, fh);
+        if (x2 <= x1 || y2 <= y1 ||
+            double(x2 - x1) * (y2 - y1) > 0.8 * double(fw) * fh) {
+            return false;
+        }
+
+        out_x = x1;
+        out_y = y1;
+        out_w = x2 - x1;
+        out_h = y2 - y1;
+        return true;
+    }
+
     void stage_denoise()
     {
         procparams::ProcParams &params = job->pparams;
@@ -315,6 +641,7 @@ private:
         }
 
         if (params.denoise.enabled) {
+            MemoryUsage::Scope mem("denoise");
             ipf.denoise(imgsrc, currWB, img, dnstore, params.denoise);
         }
     }
@@ -334,80 +661,198 @@ private:
 
         // perform transform (excepted resizing)
         if (ipf.needsTransform()) {
-            if (params.distortion.enabled && params.distortion.autocompute) {
-                params.distortion.amount =
-                    ImProcFunctions::getAutoDistor(imgsrc->getFileName(), 400);
-            }
-
             Imagefloat *trImg = nullptr;
+            int dst_x = img_x, dst_y = img_y;
             if (ipf.needsLuminanceOnly()) {
                 trImg = img;
+            } else if (early_crop) {
+                // only the crop is needed after the transformations
+                dst_x = params.crop.x;
+                dst_y = params.crop.y;
+                trImg = new Imagefloat(params.crop.w, params.crop.h, img);
             } else {
                 trImg = new Imagefloat(fw, fh, img);
             }
-            ipf.transform(img, trImg, 0, 0, 0, 0, fw, fh, fw, fh,
-                          imgsrc->getMetaData(), imgsrc->getRotateDegree(),
-                          true);
+            ipf.transform(img, trImg, dst_x, dst_y, img_x, img_y, fw, fh, fw,
+                          fh, imgsrc->getMetaData(),
+                          imgsrc->getRotateDegree(), true);
             if (trImg != img) {
                 delete img;
                 img = trImg;
             }
+            img_x = dst_x;
+            img_y = dst_y;
         }
     }
 
     Imagefloat *stage_finish(bool is_fast)
+    {
+        stage_render();
+
+        ImProcFunctions &ipf = *(ipf_p.get());
+        Imagefloat *readyImg = nullptr;
+        {
+            ElapsedTime t(timings.output);
+            readyImg = stage_output(img, job->pparams, ipf, is_fast);
+        }
+        img = nullptr;
+
+        if (pl) {
+            pl->setProgress(0.70);
+        }
+
+        set_output_info(readyImg, job->pparams);
+        stage_cleanup();
+
+        if (pl) {
+            pl->setProgress(0.75);
+        }
+
+        return readyImg;
+    }
+
+    // Renders the image once up to STAGE_3, and then the resizing, output
+    // sharpening and conversion to the output profile of each output in
+    // parallel
+    std::vector<Imagefloat *>
+    multi_pipeline(const std::vector<OutputSpec> &outputs)
+    {
+        std::vector<Imagefloat *> ret;
+        if (settings->verbose) {
+            std::cout << "Processing with the normal pipeline, "
+                      << outputs.size() << " outputs" << std::endl;
+        }
+
+        if (!stage_init(false)) {
+            return ret;
+        }
+
+        stage_denoise();
+        stage_transform();
+        stage_render();
+
+        const size_t n = outputs.size();
+        // the operators take their settings from the procparams, so every
+        // output has its own copy of them (and its own ImProcFunctions)
+        std::vector<procparams::ProcParams> params(n, job->pparams);
+        std::vector<Imagefloat *> src(n, nullptr);
+        for (size_t i = 0; i < n; ++i) {
+            params[i].resize = outputs[i].resize;
+            params[i].prsharpening = outputs[i].prsharpening;
+            params[i].icm.outputProfile = outputs[i].outputProfile;
+            // the last output takes the rendered image, the others a copy
+            src[i] = i + 1 < n ? img->copy() : img;
+        }
+        img = nullptr;
+
+        ret.resize(n, nullptr);
+        const auto run = [&](size_t i) -> void {
+            ImProcFunctions ipf(&params[i], true);
+            ret[i] = stage_output(src[i], params[i], ipf, false);
+        };
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 1; i < n; ++i) {
+            tasks.push_back(
+                ThreadPool::add_task(ThreadPool::current_priority(), run, i));
+        }
+        if (n) {
+            run(0);
+        }
+        for (auto &t : tasks) {
+            ThreadPool::wait(t);
+        }
+
+        if (pl) {
+            pl->setProgress(0.70);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            set_output_info(ret[i], params[i]);
+        }
+        stage_cleanup();
+
+        if (pl) {
+            pl->setProgress(0.75);
+        }
+
+        return ret;
+    }
+
+    // crops the image and runs STAGE_1..STAGE_3 on it
+    void stage_render()
     {
         procparams::ProcParams &params = job->pparams;
         ImProcFunctions &ipf = *(ipf_p.get());
 
         int cx = 0, cy = 0, cw = img->getWidth(), ch = img->getHeight();
+        int vw = cw, vh = ch;
         if (params.crop.enabled) {
-            int iw = img->getWidth();
-            int ih = img->getHeight();
+            // size of the full image, of which img is the part at
+            // (img_x, img_y)
+            int iw = early_crop ? fw : img->getWidth();
+            int ih = early_crop ? fh : img->getHeight();
 
             cx = params.crop.x * scale_factor + 0.5;
             cy = params.crop.y * scale_factor + 0.5;
-            cw = std::min(int(params.crop.w * scale_factor + 0.5), iw - cx);
-            ch = std::min(int(params.crop.h * scale_factor + 0.5), ih - cy);
+            cw = std::min(int(params.crop.w * scale_factor + 0.5),
+                          img_x + img->getWidth() - cx);
+            ch = std::min(int(params.crop.h * scale_factor + 0.5),
+                          img_y + img->getHeight() - cy);
 
             ipf.setViewport(cx, cy, iw, ih);
-
-            Imagefloat *tmpimg = new Imagefloat(cw, ch, img);
+            vw = iw;
+            vh = ih;
+
+            if (cx != img_x || cy != img_y || cw != img->getWidth() ||
+                ch != img->getHeight()) {
+                const int ox = cx - img_x;
+                const int oy = cy - img_y;
+                Imagefloat *tmpimg = new Imagefloat(cw, ch, img);
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
-            for (int row = 0; row < ch; row++) {
-                for (int col = 0; col < cw; col++) {
-                    tmpimg->r(row, col) = img->r(row + cy, col + cx);
-                    tmpimg->g(row, col) = img->g(row + cy, col + cx);
-                    tmpimg->b(row, col) = img->b(row + cy, col + cx);
+                for (int row = 0; row < ch; row++) {
+                    for (int col = 0; col < cw; col++) {
+                        tmpimg->r(row, col) = img->r(row + oy, col + ox);
+                        tmpimg->g(row, col) = img->g(row + oy, col + ox);
+                        tmpimg->b(row, col) = img->b(row + oy, col + ox);
+                    }
                 }
-            }
 
-            delete img;
-            img = tmpimg;
+                delete img;
+                img = tmpimg;
+            }
         }
 
         DCPProfile::ApplyState as;
         DCPProfile *dcpProf = imgsrc->getDCP(params.icm, as);
 
         ipf.setDCPProfile(dcpProf, as);
-        stop = stop || ipf.process(ImProcFunctions::Pipeline::OUTPUT,
-                                   ImProcFunctions::Stage::STAGE_1, img);
+        if (!stop && !stage_process_tiled(cx, cy, vw, vh)) {
+            stop = stop || ipf.process(ImProcFunctions::Pipeline::OUTPUT,
+                                       ImProcFunctions::Stage::STAGE_1, img);
 
-        if (pl) {
-            pl->setProgress(0.55);
-        }
+            if (pl) {
+                pl->setProgress(0.55);
+            }
 
-        stop = stop || ipf.process(ImProcFunctions::Pipeline::OUTPUT,
-                                   ImProcFunctions::Stage::STAGE_2, img);
-        stop = stop || ipf.process(ImProcFunctions::Pipeline::OUTPUT,
-                                   ImProcFunctions::Stage::STAGE_3, img);
+            stop = stop || ipf.process(ImProcFunctions::Pipeline::OUTPUT,
+                                       ImProcFunctions::Stage::STAGE_2, img);
+            stop = stop || ipf.process(ImProcFunctions::Pipeline::OUTPUT,
+                                       ImProcFunctions::Stage::STAGE_3, img);
+        }
 
         if (pl) {
             pl->setProgress(0.60);
         }
+    }
 
+    // resizes image, applies the output sharpening and converts it to the
+    // output profile. image is consumed
+    Imagefloat *stage_output(Imagefloat *image,
+                             const procparams::ProcParams &params,
+                             ImProcFunctions &ipf, bool is_fast)
+    {
         if (params.resize.enabled) {
             if (!is_fast) {
                 int imw, imh;
@@ -415,32 +860,113 @@ private:
                 bool allow_upscaling =
                     params.resize.allowUpscaling || params.resize.dataspec == 0;
                 if (scale < 1.0 || (scale > 1.0 && allow_upscaling)) {
-                    Imagefloat *resized = new Imagefloat(imw, imh, img);
-                    ipf.Lanczos(img, resized, scale);
-                    delete img;
-                    img = resized;
+                    Imagefloat *ready =
+                        stage_output_fused(image, params, ipf, scale, imw, imh);
+                    if (ready) {
+                        return ready;
+                    }
+                    Imagefloat *resized = new Imagefloat(imw, imh, image);
+                    ipf.Lanczos(image, resized, scale);
+                    delete image;
+                    image = resized;
                 }
             }
         }
         if (params.prsharpening.enabled) {
             ipf.setScale(1);
-            ipf.prsharpening(img);
+            ipf.prsharpening(image);
         }
 
-        Imagefloat *readyImg = ipf.rgb2out(img, params.icm);
+        // convert in place: the working image is not needed afterwards, and
+        // this saves a full-size copy at the point of highest memory usage
+        Imagefloat *readyImg = ipf.rgb2out(image, params.icm, true);
 
         if (settings->verbose) {
             printf("Output profile_: \"%s\"\n",
                    params.icm.outputProfile.c_str());
         }
 
-        delete img;
-        img = nullptr;
+        return readyImg;
+    }
 
-        if (pl) {
-            pl->setProgress(0.70);
+    // the resizing, output sharpening and conversion to the output profile
+    // of stage_output(), done a band of output rows at a time (each step is
+    // parallel on its own): the intermediate images are only as large as a
+    // band plus the halo needed by the sharpening. Returns nullptr, leaving
+    // image alone, if the output is not processed in bands; otherwise image
+    // is consumed
+    Imagefloat *stage_output_fused(Imagefloat *image,
+                                   const procparams::ProcParams &params,
+                                   ImProcFunctions &ipf, double scale, int imw,
+                                   int imh)
+    {
+        const int band_size = settings->output_tile_size;
+        ipf.setScale(1);
+        const int halo = ipf.getSharpeningHalo(params.prsharpening);
+        if (band_size <= 0 || imh <= band_size || halo < 0 ||
+            halo >= band_size) {
+            return nullptr;
+        }
+
+        if (settings->verbose) {
+            std::cout << "Resizing and converting the output in bands of "
+                      << band_size << " rows with a halo of " << halo
+                      << " pixels" << std::endl;
         }
 
+        const auto mode = image->mode();
+        image->setMode(Imagefloat::Mode::LAB, true);
+
+        Imagefloat *ret = nullptr;
+        {
+            const LanczosRescaler rescaler(image, imw, imh, scale, true);
+            for (int y = 0; y < imh; y += band_size) {
+                const int y1 = std::max(y - halo, 0);
+                const int y2 = std::min(y + band_size + halo, imh);
+                Imagefloat band(imw, y2 - y1, image);
+                rescaler.getRows(&band, y1);
+                band.setMode(mode, true);
+
+                if (params.prsharpening.enabled) {
+                    ipf.setViewport(0, y1, imw, imh);
+                    ipf.prsharpening(&band);
+                }
+                Imagefloat *ready = ipf.rgb2out(&band, params.icm, true);
+
+                if (!ret) {
+                    ret = new Imagefloat(imw, imh, ready);
+                }
+                const int h = std::min(band_size, imh - y);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+                for (int i = 0; i < h; ++i) {
+                    const int row = y - y1 + i;
+                    std::copy(ready->r(row), ready->r(row) + imw,
+                              ret->r(y + i));
+                    std::copy(ready->g(row), ready->g(row) + imw,
+                              ret->g(y + i));
+                    std::copy(ready->b(row), ready->b(row) + imw,
+                              ret->b(y + i));
+                }
+            }
+        }
+
+        delete image;
+        ipf.setViewport(0, 0, imw, imh);
+
+        if (settings->verbose) {
+            printf("Output profile_: \"%s\"\n",
+                   params.icm.outputProfile.c_str());
+        }
+
+        return ret;
+    }
+
+    // sets the metadata and the output ICC profile of readyImg
+    void set_output_info(Imagefloat *readyImg,
+                         const procparams::ProcParams &params)
+    {
         Exiv2Metadata info(imgsrc->getFileName());
         switch (params.metadata.mode) {
         case MetaDataParams::TUNNEL:
@@ -500,18 +1026,175 @@ private:
             // No ICM
             readyImg->setOutputProfile(nullptr, 0);
         }
+    }
 
+    void stage_cleanup()
+    {
         if (!job->initialImage) {
+            if (shared_source) {
+                SharedSources::getInstance()->release(job->fname);
+            }
             ii->decreaseRef();
         }
 
         delete job;
+    }
+
+    // Runs STAGE_1..STAGE_3 on overlapping tiles of img, so that the
+    // temporary buffers of the operators are proportional to the tile size
+    // instead of the image size. (ox, oy, vw, vh) is the viewport of img in
+    // the full image. Returns false if tiling is disabled or not possible
+    // with the current parameters, in which case nothing is done
+    bool stage_process_tiled(int ox, int oy, int vw, int vh)
+    {
+        ImProcFunctions &ipf = *(ipf_p.get());
+
+        const int tile_size = settings->output_tile_size;
+        const int W = img->getWidth();
+        const int H = img->getHeight();
+        if (tile_size <= 0 || (W <= tile_size && H <= tile_size)) {
+            return false;
+        }
+
+        ipf.setViewport(ox, oy, vw, vh);
+        int halo = 0;
+        for (auto s : {ImProcFunctions::Stage::STAGE_1,
+                       ImProcFunctions::Stage::STAGE_2,
+                       ImProcFunctions::Stage::STAGE_3}) {
+            int h = ipf.getTileHalo(s);
+            if (h < 0) {
+                if (settings->verbose) {
+                    std::cout << "Tiled processing not possible with the "
+                                 "current settings"
+                              << std::endl;
+                }
+                return false;
+            }
+            // the halos of consecutive stages add up
+            halo += h;
+        }
+        if (halo >= tile_size) {
+            return false;
+        }
+
+        if (settings->verbose) {
+            std::cout << "Processing in tiles of " << tile_size << "x"
+                      << tile_size << " with a halo of " << halo << " pixels"
+                      << std::endl;
+        }
 
+        img->setMode(Imagefloat::Mode::RGB, true);
+
+        // processed tiles are kept aside until no other tile needs to read
+        // their area from the (unprocessed) image anymore, so peak memory is
+        // about two rows of tiles on top of the image itself (halved when
+        // they are stored as binary16)
+        struct PendingTile {
+            int x;
+            int y;
+            int height;
+            std::unique_ptr<Imagefloat> data;
+            std::unique_ptr<HalfImage> half_data;
+        };
+        std::deque<PendingTile> pending;
+
+        const auto flush = [&](int max_y) -> void {
+            while (!pending.empty() &&
+                   pending.front().y + pending.front().height <= max_y) {
+                const PendingTile &t = pending.front();
+                if (t.half_data) {
+                    t.half_data->copyTo(img, t.x, t.y, true);
+                    pending.pop_front();
+                    continue;
+                }
+                const int w = t.data->getWidth();
+                const int h = t.data->getHeight();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+                for (int y = 0; y < h; ++y) {
+                    for (int x = 0; x < w; ++x) {
+                        img->r(y + t.y, x + t.x) = t.data->r(y, x);
+                        img->g(y + t.y, x + t.x) = t.data->g(y, x);
+                        img->b(y + t.y, x + t.x) = t.data->b(y, x);
+                    }
+                }
+                pending.pop_front();
+            }
+        };
+
+        // the tiles are processed one at a time in row-major order (each
+        // operator is parallel on its own), as required by flush()
+        const TileGrid grid(W, H, tile_size, halo);
+        for (int i = 0; i < grid.size(); ++i) {
+            const TileGrid::Tile &t = grid[i];
+            if (t.x == 0) {
+                flush(t.y - halo);
+            }
+            const int tx = t.x;
+            const int ty = t.y;
+            const int x1 = t.x1;
+            const int y1 = t.y1;
+            const int tw = t.x2 - t.x1;
+            const int th = t.y2 - t.y1;
+
+            Imagefloat tile(tw, th, img);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int y = 0; y < th; ++y) {
+                for (int x = 0; x < tw; ++x) {
+                    tile.r(y, x) = img->r(y + y1, x + x1);
+                    tile.g(y, x) = img->g(y + y1, x + x1);
+                    tile.b(y, x) = img->b(y + y1, x + x1);
+                }
+            }
+
+            ipf.setViewport(ox + x1, oy + y1, vw, vh);
+            ipf.process(ImProcFunctions::Pipeline::OUTPUT,
+                        ImProcFunctions::Stage::STAGE_1, &tile);
+            ipf.process(ImProcFunctions::Pipeline::OUTPUT,
+                        ImProcFunctions::Stage::STAGE_2, &tile);
+            ipf.process(ImProcFunctions::Pipeline::OUTPUT,
+                        ImProcFunctions::Stage::STAGE_3, &tile);
+            tile.setMode(Imagefloat::Mode::RGB, true);
+
+            // keep only the interior of the tile
+            const int iy2 = ty + t.height;
+            const int ix2 = tx + t.width;
+            if (settings->half_float_buffers) {
+                pending.push_back(PendingTile{
+                    tx, ty, iy2 - ty, nullptr,
+                    std::unique_ptr<HalfImage>(
+                        new HalfImage(&tile, tx - x1, ty - y1, ix2 - tx,
+                                      iy2 - ty, true))});
+                continue;
+            }
+            pending.push_back(PendingTile{
+                tx, ty, iy2 - ty,
+                std::unique_ptr<Imagefloat>(
+                    new Imagefloat(ix2 - tx, iy2 - ty, &tile)),
+                nullptr});
+            Imagefloat *dst = pending.back().data.get();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int y = ty; y < iy2; ++y) {
+                for (int x = tx; x < ix2; ++x) {
+                    dst->r(y - ty, x - tx) = tile.r(y - y1, x - x1);
+                    dst->g(y - ty, x - tx) = tile.g(y - y1, x - x1);
+                    dst->b(y - ty, x - tx) = tile.b(y - y1, x - x1);
+                }
+            }
+        }
+        flush(H);
+
+        ipf.setViewport(ox, oy, vw, vh);
         if (pl) {
-            pl->setProgress(0.75);
+            pl->setProgress(0.55);
         }
 
-        return readyImg;
+        return true;
     }
 
     void stage_early_resize()
@@ -583,10 +1266,15 @@ private:
     int &errorCode;
     ProgressListener *pl;
     bool flush;
+    // where the timings are returned, if not null
+    ProcessingTimings *timings_out;
 
     // internal state
+    ProcessingTimings timings;
     std::unique_ptr<ImProcFunctions> ipf_p;
     InitialImage *ii;
+    // true if ii is kept in SharedSources for other jobs
+    bool shared_source;
     ImageSource *imgsrc;
     int fw;
     int fh;
@@ -599,35 +1287,74 @@ private:
 
     ColorTemp currWB;
     Imagefloat *img;
+    // true if img is only the part of the frame needed for the crop, whose
+    // top left corner is at (img_x, img_y)
+    bool early_crop;
+    int img_x;
+    int img_y;
 
     double pipeline_scale;
     bool stop;
+    size_t estimated_memory;
 };
 
 } // namespace
 
 IImagefloat *processImage(ProcessingJob *pjob, int &errorCode,
-                          ProgressListener *pl, bool flush)
+                          ProgressListener *pl, bool flush,
+                          ProcessingTimings *timings)
 {
-    ImageProcessor proc(pjob, errorCode, pl, flush);
+    ImageProcessor proc(pjob, errorCode, pl, flush, timings);
     return proc();
 }
 
+std::vector<IImagefloat *> processImage(ProcessingJob *pjob,
+                                        const std::vector<OutputSpec> &outputs,
+                                        int &errorCode, ProgressListener *pl,
+                                        bool flush)
+{
+    ImageProcessor proc(pjob, errorCode, pl, flush);
+    auto res = proc(outputs);
+    return std::vector<IImagefloat *>(res.begin(), res.end());
+}
+
+namespace {
+
+void applyBatchProfile(ProcessingJob *job, BatchProcessingListener *bpl)
+{
+    auto p = bpl->getBatchProfile();
+    if (p && static_cast<ProcessingJobImpl *>(job)->use_batch_profile) {
+        p->applyTo(static_cast<ProcessingJobImpl *>(job)->pparams);
+    }
+}
+
+} // namespace
+
+IImagefloat *processBatchJob(ProcessingJob *job, BatchProcessingListener *bpl,
+                             int &errorCode, ProcessingTimings *timings)
+{
+    applyBatchProfile(job, bpl);
+    return processImage(job, errorCode, nullptr, true, timings);
+}
+
 void batchProcessingThread(ProcessingJob *job, BatchProcessingListener *bpl)
 {
 
     ProcessingJob *currentJob = job;
 
     while (currentJob) {
-        auto p = bpl->getBatchProfile();
-        if (p &&
-            static_cast<ProcessingJobImpl *>(currentJob)->use_batch_profile) {
-            p->applyTo(static_cast<ProcessingJobImpl *>(currentJob)->pparams);
+        int errorCode = 0;
+        IImagefloat *img = nullptr;
+
+        if (!bpl->getDevelopedImage(currentJob, img, errorCode)) {
+            applyBatchProfile(currentJob, bpl);
+            ProcessingTimings timings;
+            img = processImage(currentJob, errorCode, bpl, true, &timings);
+            if (!errorCode) {
+                bpl->jobTimings(timings);
+            }
         }
 
-        int errorCode;
-        IImagefloat *img = processImage(currentJob, errorCode, bpl, true);
-
         if (errorCode) {
             bpl->error(M("MAIN_MSG_CANNOTLOAD"));
             currentJob = nullptr;
@@ -642,6 +1369,13 @@ void batchProcessingThread(ProcessingJob *job, BatchProcessingListener *bpl)
     }
 }
 
+void setSharedSourceUses(const Glib::ustring &fname, int uses)
+{
+    SharedSources::getInstance()->setUses(fname, uses);
+}
+
+void clearSharedSources() { SharedSources::getInstance()->clear(); }
+
 void startBatchProcessing(ProcessingJob *job, BatchProcessingListener *bpl)
 {
     if (bpl) {
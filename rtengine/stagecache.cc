@@ -0,0 +1,197 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stagecache.h"
+#include "settings.h"
+
+#include <functional>
+#include <iostream>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+// Resets to their defaults all the parameters that can affect only the
+// stages following the given one, so that they don't take part in the key.
+// Everything not listed here (raw, white balance, crop, ...) is considered
+// upstream of all the stages.
+void reset_downstream(ImProcFunctions::Stage stage, ProcParams &pp)
+{
+    typedef ImProcFunctions::Stage Stage;
+    const ProcParams defaults;
+
+    // things that are never part of the preview pipeline
+    pp.resize = defaults.resize;
+    pp.metadata = defaults.metadata;
+    pp.rank = defaults.rank;
+    pp.colorlabel = defaults.colorlabel;
+    pp.inTrash = defaults.inTrash;
+
+    if (stage == Stage::STAGE_3) {
+        return;
+    }
+    pp.gradient = defaults.gradient;
+    pp.pcvignette = defaults.pcvignette;
+    pp.textureBoost = defaults.textureBoost;
+    pp.grain = defaults.grain;
+    pp.logenc = defaults.logenc;
+    pp.saturation = defaults.saturation;
+    pp.filmSimulation = defaults.filmSimulation;
+    pp.toneCurve = defaults.toneCurve;
+    pp.rgbCurves = defaults.rgbCurves;
+    pp.labCurve = defaults.labCurve;
+    pp.softlight = defaults.softlight;
+    pp.localContrast = defaults.localContrast;
+    pp.blackwhite = defaults.blackwhite;
+    pp.prsharpening = defaults.prsharpening;
+
+    if (stage == Stage::STAGE_2) {
+        return;
+    }
+    pp.sharpening = defaults.sharpening;
+    pp.impulseDenoise = defaults.impulseDenoise;
+    pp.defringe = defaults.defringe;
+    pp.colorcorrection = defaults.colorcorrection;
+    pp.smoothing = defaults.smoothing;
+
+    if (stage == Stage::STAGE_1) {
+        return;
+    }
+    pp.chmixer = defaults.chmixer;
+    pp.exposure = defaults.exposure;
+    pp.hsl = defaults.hsl;
+    pp.toneEqualizer = defaults.toneEqualizer;
+
+    // the geometric transformations are applied between STAGE_0 and STAGE_1
+    pp.commonTrans = defaults.commonTrans;
+    pp.rotate = defaults.rotate;
+    pp.perspective = defaults.perspective;
+    pp.distortion = defaults.distortion;
+    pp.cacorrection = defaults.cacorrection;
+    pp.vignetting = defaults.vignetting;
+}
+
+} // namespace
+
+PipelineStageCache::PipelineStageCache(size_t max_bytes)
+    : max_bytes_(max_bytes), cur_bytes_(0)
+{
+}
+
+void PipelineStageCache::set_max_bytes(size_t max_bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    evict(0);
+}
+
+PipelineStageCache::Key
+PipelineStageCache::get_key(Stage stage, const procparams::ProcParams &params,
+                            size_t extra)
+{
+    ProcParams pp = params;
+    reset_downstream(stage, pp);
+    size_t h = std::hash<std::string>()(pp.to_data());
+    // boost::hash_combine
+    const size_t s = static_cast<size_t>(stage) + 1;
+    h ^= s + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= extra + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+bool PipelineStageCache::get(Key key, Imagefloat *dst, bool &stop,
+                             Histograms *hist)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            const Imagefloat *src = it->img.get();
+            if (src->getWidth() != dst->getWidth() ||
+                src->getHeight() != dst->getHeight() ||
+                (hist && !it->hist)) {
+                return false;
+            }
+            src->copyTo(dst);
+            stop = it->stop;
+            if (hist) {
+                *hist = *(it->hist);
+            }
+            entries_.splice(entries_.begin(), entries_, it);
+            if (settings->verbose > 1) {
+                std::cout << "PipelineStageCache: hit for " << key
+                          << std::endl;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void PipelineStageCache::put(Key key, const Imagefloat *src, bool stop,
+                             const Histograms *hist)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const size_t bytes = size_t(src->getWidth()) * src->getHeight() * 3 *
+                         sizeof(float);
+    if (bytes > max_bytes_) {
+        return;
+    }
+
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            cur_bytes_ -= it->bytes;
+            entries_.erase(it);
+            break;
+        }
+    }
+
+    evict(bytes);
+
+    Entry e;
+    e.key = key;
+    e.img.reset(src->copy());
+    e.stop = stop;
+    if (hist) {
+        e.hist.reset(new Histograms());
+        *(e.hist) = *hist;
+    }
+    e.bytes = bytes;
+    entries_.push_front(std::move(e));
+    cur_bytes_ += bytes;
+}
+
+void PipelineStageCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    cur_bytes_ = 0;
+}
+
+void PipelineStageCache::evict(size_t needed)
+{
+    while (!entries_.empty() && cur_bytes_ + needed > max_bytes_) {
+        cur_bytes_ -= entries_.back().bytes;
+        entries_.pop_back();
+    }
+}
+
+} // namespace rtengine
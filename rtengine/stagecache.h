@@ -0,0 +1,93 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "LUT.h"
+#include "imagefloat.h"
+#include "improcfun.h"
+#include "noncopyable.h"
+#include "procparams.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace rtengine {
+
+/**
+ * Memory-bounded LRU cache of the outputs of the pipeline stages, used by
+ * ImProcCoordinator to avoid recomputing a stage when going back to a recent
+ * set of parameters (e.g. when A/B toggling a setting).
+ *
+ * Entries are keyed by a hash of the parameters that can influence the
+ * output of a given stage, i.e. the parameters of the stage itself and of
+ * everything upstream of it.
+ */
+class PipelineStageCache: public NonCopyable {
+public:
+    typedef ImProcFunctions::Stage Stage;
+    typedef size_t Key;
+
+    struct Histograms {
+        LUTu tone_curve;
+        LUTu c_curve;
+        LUTu l_curve;
+    };
+
+    explicit PipelineStageCache(size_t max_bytes = 0);
+
+    void set_max_bytes(size_t max_bytes);
+    bool enabled() const { return max_bytes_ > 0; }
+
+    /**
+     * Computes the key of the output of the given stage. extra is mixed into
+     * the hash, and should identify the state of the input image that is not
+     * captured by params (e.g. the preview scale).
+     */
+    static Key get_key(Stage stage, const procparams::ProcParams &params,
+                       size_t extra);
+
+    /**
+     * If an entry for key exists, copies it to dst (which must have the same
+     * size) and returns true.
+     */
+    bool get(Key key, Imagefloat *dst, bool &stop, Histograms *hist = nullptr);
+    void put(Key key, const Imagefloat *src, bool stop,
+             const Histograms *hist = nullptr);
+
+    void clear();
+
+private:
+    struct Entry {
+        Key key;
+        std::unique_ptr<Imagefloat> img;
+        bool stop;
+        std::unique_ptr<Histograms> hist;
+        size_t bytes;
+    };
+
+    void evict(size_t needed);
+
+    std::mutex mutex_;
+    std::list<Entry> entries_; // most recently used first
+    size_t max_bytes_;
+    size_t cur_bytes_;
+};
+
+} // namespace rtengine
@@ -24,13 +24,17 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <set>
+#include <thread>
 
 #ifdef WIN32
 #include <windows.h>
 #include <fcntl.h>
 #include <io.h>
 #else
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -54,6 +58,29 @@ std::wstring to_wstr(const Glib::ustring &s)
     return ret;
 }
 
+namespace {
+
+// value of PATH in env, empty if not set
+std::string get_env_path(const std::vector<std::string> &env)
+{
+    for (auto &e : env) {
+        if (g_ascii_strncasecmp(e.c_str(), "PATH=", 5) == 0) {
+            return e.substr(5);
+        }
+    }
+    return "";
+}
+
+} // namespace
+
+void exec_sync(const Glib::ustring &workdir,
+               const std::vector<Glib::ustring> &argv, bool search_in_path,
+               std::string *out, std::string *err)
+{
+    exec_sync(workdir, argv, search_in_path, std::vector<std::string>(), out,
+              err);
+}
+
 #ifdef WIN32
 
 std::vector<Glib::ustring> split_command_line(const Glib::ustring &cmdl)
@@ -111,6 +138,20 @@ void add_quoted(std::wostream &out, const std::wstring &ws)
     }
 }
 
+// environment block for CreateProcessW, empty if env is empty
+std::wstring make_env_block(const std::vector<std::string> &env)
+{
+    std::wstring ret;
+    for (auto &e : env) {
+        ret += to_wstr(e);
+        ret.push_back(0);
+    }
+    if (!ret.empty()) {
+        ret.push_back(0);
+    }
+    return ret;
+}
+
 struct HandleCloser {
     ~HandleCloser()
     {
@@ -129,7 +170,8 @@ struct HandleCloser {
 // Therefore, we roll our own
 void exec_sync(const Glib::ustring &workdir,
                const std::vector<Glib::ustring> &argv, bool search_in_path,
-               std::string *out, std::string *err)
+               const std::vector<std::string> &env, std::string *out,
+               std::string *err)
 {
     // TODO - capturing stdout/stderr leads to ReadFile hanging sometimes on
     // windows. I still have to figure out why though. In the meantime, we
@@ -182,7 +224,9 @@ void exec_sync(const Glib::ustring &workdir,
     if (search_in_path) {
         wchar_t pathbuf[MAX_PATH + 1];
         std::wstring suffix = to_wstr(".exe");
-        int n = SearchPathW(nullptr, pth.c_str(), suffix.c_str(), MAX_PATH + 1,
+        const std::wstring envpath = to_wstr(get_env_path(env));
+        int n = SearchPathW(envpath.empty() ? nullptr : envpath.c_str(),
+                            pth.c_str(), suffix.c_str(), MAX_PATH + 1,
                             pathbuf, nullptr);
         if (n > 0) {
             pth = pathbuf;
@@ -204,8 +248,13 @@ void exec_sync(const Glib::ustring &workdir,
     }
 
     std::wstring wd = to_wstr(workdir);
-    if (!CreateProcessW(pth.c_str(), cmdline, nullptr, nullptr, TRUE,
-                        CREATE_NO_WINDOW, (LPVOID) nullptr,
+    std::wstring envblock = make_env_block(env);
+    DWORD flags = CREATE_NO_WINDOW;
+    if (!envblock.empty()) {
+        flags |= CREATE_UNICODE_ENVIRONMENT;
+    }
+    if (!CreateProcessW(pth.c_str(), cmdline, nullptr, nullptr, TRUE, flags,
+                        envblock.empty() ? nullptr : (LPVOID)envblock.data(),
                         wd.empty() ? nullptr : wd.c_str(), &si, &pi)) {
         delete[] cmdline;
         throw(error() << "impossible to create process");
@@ -326,6 +375,15 @@ int SubprocessInfo::read()
     return buf[0];
 }
 
+size_t SubprocessInfo::read(char *buf, size_t n)
+{
+    DWORD r = 0;
+    if (!ReadFile(D(impl_)->child_out, buf, n, &r, nullptr)) {
+        return 0;
+    }
+    return r;
+}
+
 bool SubprocessInfo::write(const char *msg, size_t n)
 {
     DWORD w = 0;
@@ -334,12 +392,22 @@ bool SubprocessInfo::write(const char *msg, size_t n)
 
 bool SubprocessInfo::flush() { return FlushFileBuffers(D(impl_)->child_in); }
 
+void SubprocessInfo::close_in()
+{
+    auto d = D(impl_);
+    if (d->child_in != INVALID_HANDLE_VALUE) {
+        CloseHandle(d->child_in);
+        d->child_in = INVALID_HANDLE_VALUE;
+    }
+}
+
 int SubprocessInfo::id() const { return GetProcessId(D(impl_)->pi.hProcess); }
 
 std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
                                       const std::vector<Glib::ustring> &argv,
                                       bool search_in_path, bool pipe_in,
-                                      bool pipe_out)
+                                      bool pipe_out,
+                                      const std::vector<std::string> &env)
 {
     std::unique_ptr<SubprocessData> data(new SubprocessData());
 
@@ -395,7 +463,9 @@ std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
     if (search_in_path) {
         wchar_t pathbuf[MAX_PATH + 1];
         std::wstring suffix = to_wstr(".exe");
-        int n = SearchPathW(nullptr, pth.c_str(), suffix.c_str(), MAX_PATH + 1,
+        const std::wstring envpath = to_wstr(get_env_path(env));
+        int n = SearchPathW(envpath.empty() ? nullptr : envpath.c_str(),
+                            pth.c_str(), suffix.c_str(), MAX_PATH + 1,
                             pathbuf, nullptr);
         if (n > 0) {
             pth = pathbuf;
@@ -417,8 +487,13 @@ std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
     }
 
     std::wstring wd = to_wstr(workdir);
-    if (!CreateProcessW(pth.c_str(), cmdline, nullptr, nullptr, TRUE,
-                        CREATE_NO_WINDOW, (LPVOID) nullptr,
+    std::wstring envblock = make_env_block(env);
+    DWORD flags = CREATE_NO_WINDOW;
+    if (!envblock.empty()) {
+        flags |= CREATE_UNICODE_ENVIRONMENT;
+    }
+    if (!CreateProcessW(pth.c_str(), cmdline, nullptr, nullptr, TRUE, flags,
+                        envblock.empty() ? nullptr : (LPVOID)envblock.data(),
                         wd.empty() ? nullptr : wd.c_str(), &si, &pi)) {
         delete[] cmdline;
         throw(error() << "impossible to create process");
@@ -447,6 +522,36 @@ std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
 
 #else // WIN32
 
+namespace {
+
+// looks up name in the PATH of env, returns an empty string if not found
+std::string find_program(const std::string &name,
+                         const std::vector<std::string> &env)
+{
+    if (name.find(G_DIR_SEPARATOR) != std::string::npos) {
+        return "";
+    }
+    const std::string path = get_env_path(env);
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find(G_SEARCHPATH_SEPARATOR, start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (end > start) {
+            auto exe =
+                Glib::build_filename(path.substr(start, end - start), name);
+            if (Glib::file_test(exe, Glib::FILE_TEST_IS_EXECUTABLE)) {
+                return exe;
+            }
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+} // namespace
+
 std::vector<Glib::ustring> split_command_line(const Glib::ustring &cmdl)
 {
     try {
@@ -463,13 +568,20 @@ std::vector<Glib::ustring> split_command_line(const Glib::ustring &cmdl)
 
 void exec_sync(const Glib::ustring &workdir,
                const std::vector<Glib::ustring> &argv, bool search_in_path,
-               std::string *out, std::string *err)
+               const std::vector<std::string> &env, std::string *out,
+               std::string *err)
 {
     std::vector<std::string> args;
     args.reserve(argv.size());
     for (auto &s : argv) {
         args.push_back(Glib::filename_from_utf8(s));
     }
+    if (search_in_path && !env.empty() && !args.empty()) {
+        auto exe = find_program(args[0], env);
+        if (!exe.empty()) {
+            args[0] = exe;
+        }
+    }
     try {
         int exit_status = -1;
         auto flags = Glib::SPAWN_DEFAULT;
@@ -477,7 +589,7 @@ void exec_sync(const Glib::ustring &workdir,
             flags |= Glib::SPAWN_SEARCH_PATH;
         }
         std::string wd = Glib::filename_from_utf8(workdir);
-        Glib::spawn_sync(wd, args, get_env(), flags,
+        Glib::spawn_sync(wd, args, env.empty() ? get_env() : env, flags,
                          Glib::SlotSpawnChildSetup(), out, err, &exit_status);
         if (!(WIFEXITED(exit_status) && WEXITSTATUS(exit_status) == 0)) {
             throw(error() << "exit status: " << exit_status);
@@ -548,9 +660,30 @@ int SubprocessInfo::read()
     return buf[0];
 }
 
+size_t SubprocessInfo::read(char *buf, size_t n)
+{
+    ssize_t r = 0;
+    do {
+        r = ::read(D(impl_)->child_out, buf, n);
+    } while (r < 0 && errno == EINTR);
+    return r > 0 ? r : 0;
+}
+
 bool SubprocessInfo::write(const char *msg, size_t n)
 {
-    return ::write(D(impl_)->child_in, msg, n) >= 0;
+    // large writes to a pipe can be partial
+    while (n > 0) {
+        ssize_t w = ::write(D(impl_)->child_in, msg, n);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        msg += w;
+        n -= w;
+    }
+    return true;
 }
 
 bool SubprocessInfo::flush()
@@ -559,10 +692,19 @@ bool SubprocessInfo::flush()
     return true;
 }
 
+void SubprocessInfo::close_in()
+{
+    auto d = D(impl_);
+    if (d->toclose.erase(d->child_in)) {
+        close(d->child_in);
+    }
+}
+
 std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
                                       const std::vector<Glib::ustring> &argv,
                                       bool search_in_path, bool pipe_in,
-                                      bool pipe_out)
+                                      bool pipe_out,
+                                      const std::vector<std::string> &env)
 {
     int fds_to[2];
     int fds_from[2];
@@ -577,7 +719,12 @@ std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
         if (!search_in_path) {
             executable = argv[0];
         } else {
-            executable = Glib::find_program_in_path(argv[0]);
+            if (!env.empty()) {
+                executable = find_program(argv[0], env);
+            }
+            if (executable.empty()) {
+                executable = Glib::find_program_in_path(argv[0]);
+            }
             if (!Glib::file_test(executable, Glib::FILE_TEST_IS_EXECUTABLE) &&
                 argv[0].find('/') == Glib::ustring::npos && !workdir.empty()) {
                 executable = Glib::build_filename(workdir, argv[0]);
@@ -588,12 +735,17 @@ std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
         }
     }
 
+    // the pipes must not leak into other commands started concurrently,
+    // otherwise this child doesn't see the end of its input until those exit
+    // as well (dup2() clears the flag on the standard streams of the child)
     if (pipe_in) {
         if (pipe(fds_to) != 0) {
             throw(error() << "pipe failed");
         } else {
             data->toclose.insert(fds_to[0]);
             data->toclose.insert(fds_to[1]);
+            fcntl(fds_to[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds_to[1], F_SETFD, FD_CLOEXEC);
         }
     }
     if (pipe_out) {
@@ -602,10 +754,12 @@ std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
         } else {
             data->toclose.insert(fds_from[0]);
             data->toclose.insert(fds_from[1]);
+            fcntl(fds_from[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds_from[1], F_SETFD, FD_CLOEXEC);
         }
     }
 
-    auto env = get_env();
+    const auto child_env = env.empty() ? get_env() : env;
 
     data->pid = fork();
     pid_t pid = data->pid;
@@ -638,9 +792,9 @@ std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
         args_vec.back() = nullptr;
         auto args = &args_vec[0];
 
-        std::vector<char *> env_vec(env.size() + 1);
-        for (size_t i = 0; i < env.size(); ++i) {
-            env_vec[i] = const_cast<char *>(env[i].c_str());
+        std::vector<char *> env_vec(child_env.size() + 1);
+        for (size_t i = 0; i < child_env.size(); ++i) {
+            env_vec[i] = const_cast<char *>(child_env[i].c_str());
         }
         env_vec.back() = nullptr;
         auto envp = &env_vec[0];
@@ -702,5 +856,274 @@ std::vector<std::string> get_env()
     return ret;
 }
 
+std::vector<std::string> get_env(const std::vector<Glib::ustring> &extra_path)
+{
+    auto ret = get_env();
+    std::string pth;
+    for (auto &d : extra_path) {
+        if (!pth.empty()) {
+            pth += G_SEARCHPATH_SEPARATOR_S;
+        }
+        pth += d;
+    }
+    if (pth.empty()) {
+        return ret;
+    }
+    for (auto &e : ret) {
+        if (g_ascii_strncasecmp(e.c_str(), "PATH=", 5) == 0) {
+            e = e.substr(0, 5) + pth + G_SEARCHPATH_SEPARATOR_S + e.substr(5);
+            return ret;
+        }
+    }
+    ret.push_back("PATH=" + pth);
+    return ret;
+}
+
+//-----------------------------------------------------------------------------
+// ProcessPool
+//-----------------------------------------------------------------------------
+
+namespace {
+
+bool read_line(SubprocessInfo *p, std::string &out)
+{
+    while (true) {
+        int c = p->read();
+        if (c < 0) {
+            return false;
+        }
+        out.push_back(c);
+        if (c == '\n') {
+            return true;
+        }
+    }
+}
+
+// reads the reply of a server, see the ProcessPool docs
+bool read_reply(SubprocessInfo *p, bool &success, std::string *out)
+{
+    int c = p->read();
+    if (c != 'Y' && c != 'N') {
+        return false;
+    }
+    success = (c == 'Y');
+    std::string buf;
+    if (!read_line(p, buf)) {
+        return false;
+    }
+    int n = atoi(buf.c_str());
+    buf.clear();
+    for (; n > 0; --n) {
+        if (!read_line(p, buf)) {
+            return false;
+        }
+    }
+    if (out) {
+        *out = std::move(buf);
+    }
+    return true;
+}
+
+} // namespace
+
+class ProcessPool::Slot {
+public:
+    Slot(ProcessPool *pool, Priority prio): pool_(pool)
+    {
+        pool_->acquire(prio);
+    }
+    ~Slot() { pool_->release(); }
+
+private:
+    ProcessPool *pool_;
+};
+
+ProcessPool::ProcessPool(): max_processes_(1), running_(0)
+{
+    std::fill(waiting_, waiting_ + NUM_PRIORITIES, 0);
+}
+
+ProcessPool *ProcessPool::getInstance()
+{
+    static ProcessPool instance;
+    return &instance;
+}
+
+void ProcessPool::init(int max_processes)
+{
+    if (max_processes <= 0) {
+        const int n = std::thread::hardware_concurrency();
+        max_processes = n > 0 ? n : 1;
+    }
+#ifndef WIN32
+    // writing to a command which has exited must fail with EPIPE, instead of
+    // terminating ART
+    signal(SIGPIPE, SIG_IGN);
+#endif // WIN32
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_processes_ = max_processes;
+}
+
+void ProcessPool::cleanup()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &p : servers_) {
+        if (settings->verbose > 1) {
+            std::cout << "subprocess - terminating server with id: "
+                      << p.second->id() << std::endl;
+        }
+        p.second->kill();
+    }
+    servers_.clear();
+}
+
+bool ProcessPool::can_run(int prio) const
+{
+    if (running_ >= max_processes_) {
+        return false;
+    }
+    for (int p = prio + 1; p < NUM_PRIORITIES; ++p) {
+        if (waiting_[p]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ProcessPool::acquire(Priority prio)
+{
+    const int p = int(prio);
+    const bool worker = ThreadPool::is_worker();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++waiting_[p];
+    while (!can_run(p)) {
+        if (worker) {
+            // keep the thread pool busy in the meantime. We are not waiting
+            // while running the other task, which might need a slot itself
+            --waiting_[p];
+            lock.unlock();
+            ThreadPool::run_pending();
+            lock.lock();
+            ++waiting_[p];
+        } else {
+            cond_.wait(lock);
+        }
+    }
+    --waiting_[p];
+    ++running_;
+}
+
+void ProcessPool::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --running_;
+    }
+    cond_.notify_all();
+}
+
+void ProcessPool::exec_sync(Priority prio, const Glib::ustring &workdir,
+                            const std::vector<Glib::ustring> &argv,
+                            bool search_in_path,
+                            const std::vector<std::string> &env,
+                            std::string *out, std::string *err)
+{
+    Slot slot(this, prio);
+    subprocess::exec_sync(workdir, argv, search_in_path, env, out, err);
+}
+
+void ProcessPool::exec_pipe(Priority prio, const Glib::ustring &workdir,
+                            const std::vector<Glib::ustring> &argv,
+                            const std::vector<std::string> &env,
+                            const std::function<bool(SubprocessInfo &)> &feed,
+                            std::string *out)
+{
+    Slot slot(this, prio);
+
+    auto p = popen(workdir, argv, true, true, true, env);
+    if (!p) {
+        throw(error() << "impossible to start: " << argv[0]);
+    }
+
+    std::string buf;
+    std::thread reader([&]() {
+        char data[4096];
+        size_t n = 0;
+        while ((n = p->read(data, sizeof(data))) > 0) {
+            buf.append(data, n);
+        }
+    });
+    const bool ok = feed(*p);
+    p->close_in();
+    reader.join();
+    const int exit_status = p->wait();
+
+    if (out) {
+        *out = std::move(buf);
+    }
+    if (!ok) {
+        throw(error() << "error sending data to: " << argv[0]);
+    } else if (exit_status != 0) {
+        throw(error() << "exit status: " << exit_status);
+    }
+}
+
+bool ProcessPool::exec_server(Priority prio, const Glib::ustring &workdir,
+                              const std::vector<Glib::ustring> &argv,
+                              const std::vector<std::string> &env,
+                              const std::vector<std::string> &request,
+                              std::string *out)
+{
+    Slot slot(this, prio);
+
+    std::string key = workdir;
+    for (auto &a : argv) {
+        key += '\n';
+        key += a;
+    }
+
+    std::unique_ptr<SubprocessInfo> p;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = servers_.find(key);
+        while (it != servers_.end() && it->first == key) {
+            if (it->second->live()) {
+                p = std::move(it->second);
+                servers_.erase(it);
+                break;
+            }
+            it = servers_.erase(it);
+        }
+    }
+
+    if (!p) {
+        p = popen(workdir, argv, true, true, true, env);
+        if (!p) {
+            throw(error() << "impossible to start server: " << argv[0]);
+        }
+        if (settings->verbose > 1) {
+            std::cout << "subprocess - started server " << argv[0]
+                      << ", id: " << p->id() << std::endl;
+        }
+    }
+
+    std::string msg;
+    for (auto &r : request) {
+        msg += r;
+        msg += '\n';
+    }
+    bool success = false;
+    if (!p->write(msg.c_str(), msg.size()) || !p->flush() ||
+        !read_reply(p.get(), success, out)) {
+        p->kill();
+        throw(error() << "invalid reply from server: " << argv[0]);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    servers_.emplace(key, std::move(p));
+    return success;
+}
+
 } // namespace subprocess
 } // namespace rtengine
@@ -21,8 +21,13 @@
 #pragma once
 
 #include "noncopyable.h"
+#include "threadpool.h"
+#include <condition_variable>
 #include <exception>
+#include <functional>
 #include <glibmm.h>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -63,7 +68,18 @@ void exec_sync(const Glib::ustring &workdir,
                const std::vector<Glib::ustring> &argv, bool search_in_path,
                std::string *out, std::string *err);
 
+/// as above, but running the command with the given environment (in the
+/// "KEY=value" form returned by get_env()). An empty env means the current
+/// environment. If search_in_path is true, the executable is looked up in the
+/// PATH of env
+void exec_sync(const Glib::ustring &workdir,
+               const std::vector<Glib::ustring> &argv, bool search_in_path,
+               const std::vector<std::string> &env, std::string *out,
+               std::string *err);
+
 std::vector<std::string> get_env();
+/// get_env() with the given directories prepended to PATH
+std::vector<std::string> get_env(const std::vector<Glib::ustring> &extra_path);
 
 class SubprocessInfo: public NonCopyable {
 public:
@@ -71,8 +87,12 @@ public:
     ~SubprocessInfo();
 
     int read();
+    /// reads at most n bytes of output, returning 0 at the end of it
+    size_t read(char *buf, size_t n);
     bool write(const char *s, size_t n);
     bool flush();
+    /// closes the input of the process, which then sees the end of file
+    void close_in();
 
     bool live() const;
     int wait();
@@ -87,7 +107,80 @@ private:
 std::unique_ptr<SubprocessInfo> popen(const Glib::ustring &workdir,
                                       const std::vector<Glib::ustring> &argv,
                                       bool search_in_path, bool pipe_in,
-                                      bool pipe_out);
+                                      bool pipe_out,
+                                      const std::vector<std::string> &env = {});
+
+/**
+ * Bounded pool for running external helpers (e.g. the custom image loaders
+ * and savers) from several threads at once.
+ *
+ * At most max_processes commands run at the same time. Callers waiting for a
+ * slot are served in order of ThreadPool priority, and pool workers keep
+ * executing other pending tasks while they wait.
+ *
+ * Commands can also run as persistent "servers", with the same protocol used
+ * by the external 3D LUT scripts: the process is started once, and then it
+ * receives each request as a sequence of lines on its standard input, and
+ * answers with 'Y' (success) or 'N' (failure), followed by the number of
+ * lines of output, and then the output itself. Idle servers are kept alive
+ * and reused until cleanup().
+ */
+class ProcessPool: public NonCopyable {
+public:
+    typedef ThreadPool::Priority Priority;
+
+    static ProcessPool *getInstance();
+
+    /// max_processes <= 0 means the number of CPU cores
+    void init(int max_processes);
+    /// terminates the idle servers
+    void cleanup();
+
+    /// same as subprocess::exec_sync(), waiting for a free slot first
+    void exec_sync(Priority prio, const Glib::ustring &workdir,
+                   const std::vector<Glib::ustring> &argv, bool search_in_path,
+                   const std::vector<std::string> &env, std::string *out,
+                   std::string *err);
+
+    /// runs argv with its standard input connected to a pipe, to which feed
+    /// writes the data for the command (e.g. an image to encode). The output
+    /// of the command is collected in out (if not null) by a separate
+    /// thread while feed runs, so that the two sides can't block each other
+    /// on a full pipe. Throws subprocess::error if feed returns false or the
+    /// command exits with a non-zero status
+    void exec_pipe(Priority prio, const Glib::ustring &workdir,
+                   const std::vector<Glib::ustring> &argv,
+                   const std::vector<std::string> &env,
+                   const std::function<bool(SubprocessInfo &)> &feed,
+                   std::string *out);
+
+    /// sends request to a server running argv, starting it if needed.
+    /// Returns the result reported by the server, and its output in out (if
+    /// not null). Throws subprocess::error if the server can't be started or
+    /// doesn't follow the protocol
+    bool exec_server(Priority prio, const Glib::ustring &workdir,
+                     const std::vector<Glib::ustring> &argv,
+                     const std::vector<std::string> &env,
+                     const std::vector<std::string> &request,
+                     std::string *out);
+
+private:
+    class Slot;
+    static constexpr int NUM_PRIORITIES = int(Priority::HIGHEST) + 1;
+
+    ProcessPool();
+    bool can_run(int prio) const;
+    void acquire(Priority prio);
+    void release();
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    int max_processes_;
+    int running_;
+    int waiting_[NUM_PRIORITIES];
+    // idle servers, keyed by working directory and command line
+    std::multimap<std::string, std::unique_ptr<SubprocessInfo>> servers_;
+};
 
 } // namespace subprocess
 } // namespace rtengine
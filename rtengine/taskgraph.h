@@ -0,0 +1,222 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "threadpool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rtengine {
+
+// Cooperative cancellation flag, shared by all its copies. Long running tasks
+// are expected to poll cancelled() and return early when it becomes true.
+class CancellationToken {
+public:
+    CancellationToken(): flag_(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { *flag_ = true; }
+    bool cancelled() const { return *flag_; }
+    explicit operator bool() const { return cancelled(); }
+
+    // a fresh token, to be used after the previous one has been cancelled
+    void reset() { flag_ = std::make_shared<std::atomic<bool>>(false); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+// A set of tasks with explicit dependencies, executed on the ThreadPool.
+// A task is submitted as soon as all the tasks it depends on have finished.
+// When the graph is cancelled, tasks that have not started yet are skipped
+// (running ones can poll the token passed to them); continuations are always
+// invoked, with a flag telling whether the task actually ran to completion.
+//
+// Usage:
+//
+//    TaskGraph g(ThreadPool::Priority::NORMAL);
+//    auto a = g.add([](const CancellationToken &t) { ... });
+//    auto b = g.add([](const CancellationToken &t) { ... }, {a});
+//    g.then(b, [](bool done) { ... });
+//    g.run();
+//    ...
+//    g.cancel(); // if the result is no longer needed
+//    g.wait();
+class TaskGraph: public NonCopyable {
+public:
+    typedef size_t TaskId;
+    typedef std::function<void(const CancellationToken &)> Function;
+    typedef std::function<void(bool)> Continuation;
+
+    explicit TaskGraph(
+        ThreadPool::Priority p = ThreadPool::Priority::NORMAL,
+        const CancellationToken &token = CancellationToken())
+        : state_(std::make_shared<State>(p, token))
+    {
+    }
+
+    ~TaskGraph()
+    {
+        if (started_) {
+            wait();
+        }
+    }
+
+    TaskId add(Function f, const std::vector<TaskId> &deps = {})
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        TaskId id = state_->nodes.size();
+        state_->nodes.emplace_back(std::move(f));
+        for (auto d : deps) {
+            if (d < id) {
+                state_->nodes[d].successors.push_back(id);
+                ++state_->nodes[id].missing;
+            }
+        }
+        return id;
+    }
+
+    void then(TaskId id, Continuation c)
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (id < state_->nodes.size()) {
+            state_->nodes[id].continuation = std::move(c);
+        }
+    }
+
+    // submits all the tasks without pending dependencies; can be called only
+    // once
+    void run()
+    {
+        if (started_) {
+            return;
+        }
+        started_ = true;
+        std::vector<TaskId> ready;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->remaining = state_->nodes.size();
+            for (TaskId i = 0; i < state_->nodes.size(); ++i) {
+                if (state_->nodes[i].missing == 0) {
+                    ready.push_back(i);
+                }
+            }
+        }
+        for (auto i : ready) {
+            submit(state_, i);
+        }
+    }
+
+    void cancel() { state_->token.cancel(); }
+    bool cancelled() const { return state_->token.cancelled(); }
+    const CancellationToken &token() const { return state_->token; }
+
+    // blocks until all the tasks have been either executed or skipped
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        if (ThreadPool::is_worker()) {
+            // don't block a worker that might be needed to run our tasks
+            while (state_->remaining > 0) {
+                lock.unlock();
+                ThreadPool::run_pending();
+                lock.lock();
+            }
+        } else {
+            state_->done.wait(lock, [this]() { return state_->remaining == 0; });
+        }
+    }
+
+private:
+    struct Node {
+        explicit Node(Function &&f): func(std::move(f)), missing(0) {}
+
+        Function func;
+        Continuation continuation;
+        std::vector<TaskId> successors;
+        size_t missing;
+    };
+
+    struct State {
+        State(ThreadPool::Priority p, const CancellationToken &t)
+            : priority(p), token(t), remaining(0)
+        {
+        }
+
+        ThreadPool::Priority priority;
+        CancellationToken token;
+        std::vector<Node> nodes;
+        size_t remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    static void submit(std::shared_ptr<State> state, TaskId id)
+    {
+        ThreadPool::add_task(state->priority,
+                             [state, id]() { execute(state, id); });
+    }
+
+    static void execute(std::shared_ptr<State> state, TaskId id)
+    {
+        Function f;
+        Continuation c;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            f = state->nodes[id].func;
+            c = state->nodes[id].continuation;
+        }
+
+        bool completed = false;
+        if (!state->token.cancelled()) {
+            f(state->token);
+            completed = !state->token.cancelled();
+        }
+        if (c) {
+            c(completed);
+        }
+
+        std::vector<TaskId> ready;
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            for (auto s : state->nodes[id].successors) {
+                if (--state->nodes[s].missing == 0) {
+                    ready.push_back(s);
+                }
+            }
+            finished = (--state->remaining == 0);
+        }
+        if (finished) {
+            state->done.notify_all();
+        }
+        for (auto s : ready) {
+            submit(state, s);
+        }
+    }
+
+    std::shared_ptr<State> state_;
+    bool started_ = false;
+};
+
+} // namespace rtengine
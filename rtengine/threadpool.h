@@ -26,21 +26,43 @@ freely, subject to the following restrictions:
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
 #include <limits>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <stdexcept>
 #include <thread>
 #include <vector>
 
 #include "noncopyable.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace rtengine {
 
+// Work-stealing thread pool. Every worker owns a deque of tasks (one per
+// priority level); tasks submitted from inside a worker go to that worker's
+// own deque, tasks submitted from outside go to a shared injection queue.
+// Idle workers pick work in strict priority order, looking first at their own
+// deque (newest first), then at the injection queue, and finally stealing the
+// oldest task of the same priority from the other workers.
+//
+// Tasks can fork subtasks with add_task() and wait for them with
+// ThreadPool::wait(): when called from a worker, wait() keeps executing
+// pending tasks until the future becomes ready, so nested parallelism does not
+// deadlock the pool.
+//
+// The cores are shared among the tasks running at the same time: every task
+// runs its OpenMP regions with (number of threads / running tasks) threads, so
+// that concurrent tasks don't oversubscribe the CPU.
 class ThreadPool: public NonCopyable {
 public:
     enum class Priority { LOWEST, LOW, NORMAL, HIGH, HIGHEST };
@@ -49,8 +71,25 @@ public:
     static auto add_task(Priority p, F &&f, Args &&...args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
 
+    template <class T>
+    static void wait(const std::future<T> &f);
+
+    // true if the calling thread is one of the pool workers
+    static bool is_worker();
+    // executes one pending task on the calling worker thread, if any;
+    // otherwise it sleeps for a short while. Returns true if a task was run
+    static bool run_pending();
+    // priority of the task being executed by the calling thread (NORMAL if
+    // the thread is not running a pool task)
+    static Priority current_priority() { return current_priority_; }
+
     static void init(size_t num_workers);
     static void cleanup();
+    // to be called in a child created with fork(), which has none of the
+    // worker threads of the parent: the old pool is leaked (it can be
+    // neither joined nor destroyed) and a new one with as many workers is
+    // started
+    static void reinit_after_fork();
 
 private:
     ThreadPool(size_t);
@@ -69,59 +108,124 @@ public:
     ~ThreadPool();
 
 private:
-    // need to keep track of threads so we can join them
-    std::vector<std::thread> workers_;
-    // the task queue
-    class Task: public std::function<void()> {
+    typedef std::function<void()> Task;
+    static constexpr int NUM_PRIORITIES = int(Priority::HIGHEST) + 1;
+
+    class TaskQueue {
     public:
-        template <class Fn>
-        explicit Task(Priority p, size_t i, Fn func)
-            : std::function<void()>(func), p_(p), i_(i)
+        void push(Priority p, Task &&t)
         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_[int(p)].emplace_back(std::move(t));
         }
 
-        bool operator<(const Task &other) const
+        // the owner takes the newest task (better cache locality for
+        // nested tasks), thieves take the oldest one
+        bool pop(int p, bool newest, Task &out)
         {
-            return p_ == other.p_ ? i_ > other.i_ : p_ < other.p_;
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &q = tasks_[p];
+            if (q.empty()) {
+                return false;
+            }
+            if (newest) {
+                out = std::move(q.back());
+                q.pop_back();
+            } else {
+                out = std::move(q.front());
+                q.pop_front();
+            }
+            return true;
         }
 
     private:
-        Priority p_;
-        size_t i_;
+        std::mutex mutex_;
+        std::deque<Task> tasks_[NUM_PRIORITIES];
     };
-    std::priority_queue<Task> tasks_;
 
-    // synchronization
-    std::mutex queue_mutex_;
+    bool get_task(int worker, Task &out);
+    void worker_loop(int worker);
+
+    // need to keep track of threads so we can join them
+    std::vector<std::thread> workers_;
+    // one queue per worker, plus the shared injection queue at the end
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::atomic<size_t> pending_;
+    // number of tasks being executed, and of OpenMP threads shared among them
+    std::atomic<int> running_;
+    int num_threads_;
+
+    // synchronization for idle workers
+    std::mutex sleep_mutex_;
     std::condition_variable condition_;
-    bool stop_;
-    size_t idx_;
+    std::atomic<bool> stop_;
 
     static std::unique_ptr<ThreadPool> instance_;
+    // index of the worker running on the current thread, -1 if none
+    static thread_local int worker_index_;
+    static thread_local Priority current_priority_;
 };
 
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads): stop_(false), idx_(0)
+inline ThreadPool::ThreadPool(size_t threads)
+    : pending_(0), running_(0), num_threads_(1), stop_(false)
 {
+#ifdef _OPENMP
+    num_threads_ = omp_get_max_threads();
+#endif
+    threads = std::max(threads, size_t(1));
+    for (size_t i = 0; i <= threads; ++i) {
+        queues_.emplace_back(new TaskQueue());
+    }
     for (size_t i = 0; i < threads; ++i) {
-        workers_.emplace_back([this] {
-            while (true) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex_);
-                    this->condition_.wait(lock, [this] {
-                        return this->stop_ || !this->tasks_.empty();
-                    });
-                    if (this->stop_ && this->tasks_.empty()) {
-                        return;
-                    }
-                    task = std::move(this->tasks_.top());
-                    this->tasks_.pop();
-                }
-
-                task();
+        workers_.emplace_back([this, i] { worker_loop(int(i)); });
+    }
+}
+
+inline bool ThreadPool::get_task(int worker, Task &out)
+{
+    if (pending_.load() == 0) {
+        return false;
+    }
+
+    const int n = int(workers_.size());
+    TaskQueue &shared = *queues_[n];
+
+    for (int p = NUM_PRIORITIES - 1; p >= 0; --p) {
+        if (worker >= 0 && queues_[worker]->pop(p, true, out)) {
+            --pending_;
+            return true;
+        }
+        if (shared.pop(p, false, out)) {
+            --pending_;
+            return true;
+        }
+        for (int k = 1; k <= n; ++k) {
+            const int victim = (std::max(worker, 0) + k) % n;
+            if (victim != worker && queues_[victim]->pop(p, false, out)) {
+                --pending_;
+                return true;
             }
-        });
+        }
+    }
+    return false;
+}
+
+inline void ThreadPool::worker_loop(int worker)
+{
+    worker_index_ = worker;
+    while (true) {
+        Task task;
+        if (get_task(worker, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        condition_.wait(lock, [this] { return stop_ || pending_.load() > 0; });
+        if (stop_ && pending_.load() == 0) {
+            return;
+        }
     }
 }
 
@@ -132,29 +236,82 @@ auto ThreadPool::enqueue(Priority p, F &&f, Args &&...args)
 {
     using return_type = typename std::result_of<F(Args...)>::type;
 
+    // don't allow enqueueing after stopping the pool
+    if (stop_) {
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    }
+
     auto task = std::make_shared<std::packaged_task<return_type()>>(
         std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
     std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
 
-        // don't allow enqueueing after stopping the pool
-        if (stop_) {
-            throw std::runtime_error("enqueue on stopped ThreadPool");
-        }
-
-        tasks_.emplace(p, idx_++, [task]() { (*task)(); });
+    const int w = worker_index_;
+    const bool own =
+        w >= 0 && size_t(w) < workers_.size() && instance_.get() == this;
+    queues_[own ? w : workers_.size()]->push(p, [this, task, p]() {
+        // restored afterwards, as tasks can run nested in wait()
+        const Priority prev = current_priority_;
+        current_priority_ = p;
+#ifdef _OPENMP
+        // the number of threads is a per-thread setting of OpenMP, so this
+        // only affects the parallel regions opened by this task
+        const int prev_threads = omp_get_max_threads();
+        omp_set_num_threads(std::max(num_threads_ / ++running_, 1));
+#endif
+        (*task)();
+#ifdef _OPENMP
+        --running_;
+        omp_set_num_threads(prev_threads);
+#endif
+        current_priority_ = prev;
+    });
+    {
+        // taking the lock here avoids lost wakeups of workers which are
+        // about to go to sleep
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++pending_;
     }
     condition_.notify_one();
     return res;
 }
 
+inline bool ThreadPool::is_worker()
+{
+    return worker_index_ >= 0 && instance_;
+}
+
+inline bool ThreadPool::run_pending()
+{
+    Task task;
+    if (is_worker() && instance_->get_task(worker_index_, task)) {
+        task();
+        return true;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+    return false;
+}
+
+template <class T>
+void ThreadPool::wait(const std::future<T> &f)
+{
+    if (!is_worker()) {
+        f.wait();
+        return;
+    }
+
+    // help executing pending tasks while the result is not ready, so that
+    // tasks blocked on their subtasks don't starve the pool
+    while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        run_pending();
+    }
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool()
 {
     {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
         stop_ = true;
     }
     condition_.notify_all();
@@ -170,6 +327,16 @@ inline void ThreadPool::init(size_t num_workers)
 
 inline void ThreadPool::cleanup() { instance_.reset(nullptr); }
 
+inline void ThreadPool::reinit_after_fork()
+{
+    const size_t n = instance_ ? instance_->workers_.size() : 1;
+    ThreadPool *old = instance_.release();
+    (void)old;
+    worker_index_ = -1;
+    current_priority_ = Priority::NORMAL;
+    instance_.reset(new ThreadPool(n));
+}
+
 template <class F, class... Args>
 auto ThreadPool::add_task(Priority p, F &&f, Args &&...args)
     -> std::future<typename std::result_of<F(Args...)>::type>
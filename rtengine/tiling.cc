@@ -0,0 +1,69 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tiling.h"
+#include <algorithm>
+#include <cmath>
+
+namespace rtengine {
+
+TileGrid::TileGrid(int width, int height, int tile_size, int halo)
+{
+    tile_size = std::max(tile_size, 1);
+    halo = std::max(halo, 0);
+    cols_ = width > 0 ? (width + tile_size - 1) / tile_size : 0;
+    rows_ = height > 0 ? (height + tile_size - 1) / tile_size : 0;
+    tiles_.reserve(rows_ * cols_);
+
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            Tile t;
+            t.x = x;
+            t.y = y;
+            t.width = std::min(tile_size, width - x);
+            t.height = std::min(tile_size, height - y);
+            t.x1 = std::max(x - halo, 0);
+            t.y1 = std::max(y - halo, 0);
+            t.x2 = std::min(x + tile_size + halo, width);
+            t.y2 = std::min(y + tile_size + halo, height);
+            tiles_.push_back(t);
+        }
+    }
+}
+
+int TileGrid::tile_size(int width, int height, int halo,
+                        size_t bytes_per_pixel, size_t cache_budget,
+                        int num_threads)
+{
+    const double pixels =
+        double(cache_budget) / std::max(bytes_per_pixel, size_t(1));
+    int ret = int(std::sqrt(pixels)) - 2 * std::max(halo, 0);
+    if (ret <= 0) {
+        return 0;
+    }
+
+    // don't leave threads idle because of too few tiles
+    const int n = std::max(num_threads, 1);
+    if (n > 1) {
+        const int s = int(std::sqrt(double(width) * height / n));
+        ret = std::min(ret, std::max(s, 1));
+    }
+    return std::min(ret, std::max(width, height));
+}
+
+} // namespace rtengine
@@ -0,0 +1,83 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Division of a width x height image in square tiles, each extended on all
+ * sides by a halo of the pixels needed by the operators to compute the
+ * interior of the tile (clipped at the borders of the image).
+ *
+ * Tiles are numbered in row-major order. parallel_for() processes them with
+ * a dynamic schedule, so that threads which are done with cheap tiles (e.g.
+ * at the borders) pick up the remaining ones instead of waiting.
+ */
+class TileGrid {
+public:
+    struct Tile {
+        // the interior, i.e. the area the tile is responsible for
+        int x;
+        int y;
+        int width;
+        int height;
+        // the interior plus the halo: [x1, x2) x [y1, y2)
+        int x1;
+        int y1;
+        int x2;
+        int y2;
+    };
+
+    TileGrid(int width, int height, int tile_size, int halo);
+
+    /** returns the largest tile size such that a tile with its halo, at
+        bytes_per_pixel, fits in cache_budget bytes, while still giving at
+        least one tile per thread. Returns 0 if the halo alone exceeds the
+        budget */
+    static int tile_size(int width, int height, int halo,
+                         size_t bytes_per_pixel, size_t cache_budget,
+                         int num_threads);
+
+    int size() const { return tiles_.size(); }
+    const Tile &operator[](int i) const { return tiles_[i]; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+
+    /// calls f(tile) for all the tiles, in parallel if multithread is set
+    template <class F> void parallel_for(F &&f, bool multithread) const
+    {
+        const int n = size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) if (multithread)
+#endif
+        for (int i = 0; i < n; ++i) {
+            f(tiles_[i]);
+        }
+    }
+
+private:
+    std::vector<Tile> tiles_;
+    int rows_;
+    int cols_;
+};
+
+} // namespace rtengine
@@ -58,6 +58,8 @@
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <tuple>
 #include <vector>
 
 #include <assert.h>
@@ -66,6 +68,7 @@
 
 #include "StopWatch.h"
 #include "array2D.h"
+#include "fftwplans.h"
 #include "iccstore.h"
 #include "improcfun.h"
 #include "ipdenoise.h"
@@ -130,16 +133,17 @@ void rescale_bilinear(const Array2Df &src, Array2Df &dst, bool multithread);
  * Luminance HDR code (modifications are marked with an RT comment)
  ******************************************************************************/
 
-void downSample(const Array2Df &A, Array2Df &B)
+void downSample(const Array2Df &A, Array2Df &B, bool multithread)
 {
     const int width = B.getCols();
     const int height = B.getRows();
 
-    // Note, I've uncommented all omp directives. They are all ok but are
-    // applied to too small problems and in total don't lead to noticeable
-    // speed improvements. The main issue is the pde solver and in case of the
-    // fft solver uses optimised threaded fftw routines.
-    // #pragma omp parallel for
+    // RT - the omp directives were disabled in the original code, as the pde
+    // solver dominated the run time. With the multigrid solver the pyramids
+    // are a significant part of it, so they are built in parallel too
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
             float p = A(2 * x, 2 * y);
@@ -238,7 +242,7 @@ void createGaussianPyramids(Array2Df **pyramids, int nlevels, bool multithread)
             width /= 2;
             height /= 2;
             pyramids[k] = new Array2Df(width, height);
-            downSample(*L, *pyramids[k]);
+            downSample(*L, *pyramids[k], multithread);
         } else {
             // RT - now nlevels is fixed in tmo_fattal02 (see the comment in
             // there), so it might happen that we have to add some padding to
@@ -301,14 +305,16 @@ float calculateGradients(Array2Df *H, Array2Df *G, int k, bool multithread)
 
 //--------------------------------------------------------------------
 
-void upSample(const Array2Df &A, Array2Df &B)
+void upSample(const Array2Df &A, Array2Df &B, bool multithread)
 {
     const int width = B.getCols();
     const int height = B.getRows();
     const int awidth = A.getCols();
     const int aheight = A.getRows();
 
-    // #pragma omp parallel for shared(A, B)
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
             int ax = static_cast<int>(x * 0.5f); // x / 2.f;
@@ -362,15 +368,29 @@ void calculateFiMatrix(Array2Df *FI, Array2Df *gradients[], float avgGrad[],
             const float a = alfa * avgGrad[k];
             // DEBUG_STR << "calculateFiMatrix: apply gradient to level " << k
             // << endl;
+            const float e = beta - 1.0f;
 #ifdef _OPENMP
 #pragma omp parallel for shared(fi, avgGrad) if (multithread)
 #endif
             for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
+                int x = 0;
+#ifdef __SSE2__
+                const vfloat minv = F2V(1e-4f);
+                const vfloat noisev = F2V(noise);
+                const vfloat iav = F2V(1.f / a);
+                const vfloat ev = F2V(e);
+                for (; x < width - 3; x += 4) {
+                    const vfloat gradv =
+                        vmaxf(LVFU((*gradients[k])[y][x]), minv);
+                    const vfloat valuev = pow_F((gradv + noisev) * iav, ev);
+                    STVFU((*fi[k])[y][x], LVFU((*fi[k])[y][x]) * valuev);
+                }
+#endif
+                for (; x < width; x++) {
                     float grad = ((*gradients[k])(x, y) < 1e-4f)
                                      ? 1e-4
                                      : (*gradients[k])(x, y);
-                    float value = pow((grad + noise) / a, beta - 1.0f);
+                    float value = pow_F((grad + noise) / a, e);
 
                     (*fi[k])(x, y) *= value;
                 }
@@ -387,7 +407,8 @@ void calculateFiMatrix(Array2Df *FI, Array2Df *gradients[], float avgGrad[],
         }
 
         if (k > 0) {
-            upSample(*fi[k], *fi[k - 1]); // upsample to next level
+            // upsample to next level
+            upSample(*fi[k], *fi[k - 1], multithread);
             gaussianBlur(*fi[k - 1], *fi[k - 1], multithread);
         }
     }
@@ -400,10 +421,12 @@ void calculateFiMatrix(Array2Df *FI, Array2Df *gradients[], float avgGrad[],
 }
 
 void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread);
+void solve_pde_multigrid(Array2Df *F, Array2Df *U, Array2Df *buf,
+                         bool multithread);
 
 void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
                   float alfa, float beta, float noise, int detail_level,
-                  bool multithread)
+                  bool multigrid, bool multithread)
 {
     // #ifdef TIMER_PROFILING
     //     msec_timer stop_watch;
@@ -572,23 +595,39 @@ void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
     // the fft solver solves the Poisson pde but with slightly different
     // boundary conditions, so we need to adjust the assembly of the right hand
     // side accordingly (basically fft solver assumes U(-1) = U(1), whereas zero
-    // Neumann conditions assume U(-1)=U(0)), see also divergence calculation
+    // Neumann conditions assume U(-1)=U(0)), see also divergence calculation.
+    // RT - the multigrid solver uses the zero Neumann conditions, i.e. no flux
+    // across the border
+    const size_t xlast = multigrid ? width - 1 : width - 2;
+    const size_t ylast = multigrid ? height - 1 : height - 2;
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
 
     for (size_t y = 0; y < height; y++) {
         // sets index+1 based on the boundary assumption H(N+1)=H(N-1)
-        unsigned int yp1 = (y + 1 >= height ? height - 2 : y + 1);
+        const size_t yp1 = (y + 1 >= height ? ylast : y + 1);
+        size_t x = 0;
+#ifdef __SSE2__
+        const vfloat halfv = F2V(0.5f);
+        for (; x + 4 < width; x += 4) {
+            const vfloat h = LVFU((*H)[y][x]);
+            const vfloat fi = LVFU((*FI)[y][x]);
+            STVFU((*Gx)[y][x], (LVFU((*H)[y][x + 1]) - h) * halfv *
+                                   (LVFU((*FI)[y][x + 1]) + fi));
+            STVFU((*Gy)[y][x], (LVFU((*H)[yp1][x]) - h) * halfv *
+                                   (LVFU((*FI)[yp1][x]) + fi));
+        }
+#endif
 
-        for (size_t x = 0; x < width; x++) {
+        for (; x < width; x++) {
             // sets index+1 based on the boundary assumption H(N+1)=H(N-1)
-            unsigned int xp1 = (x + 1 >= width ? width - 2 : x + 1);
+            const size_t xp1 = (x + 1 >= width ? xlast : x + 1);
             // forward differences in H, so need to use between-points approx of
             // FI
-            (*Gx)(x, y) = ((*H)(xp1, y) - (*H)(x, y)) * 0.5 *
+            (*Gx)(x, y) = ((*H)(xp1, y) - (*H)(x, y)) * 0.5f *
                           ((*FI)(xp1, y) + (*FI)(x, y));
-            (*Gy)(x, y) = ((*H)(x, yp1) - (*H)(x, y)) * 0.5 *
+            (*Gy)(x, y) = ((*H)(x, yp1) - (*H)(x, y)) * 0.5f *
                           ((*FI)(x, yp1) + (*FI)(x, y));
         }
     }
@@ -601,7 +640,7 @@ void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
 #endif
 
     for (size_t y = 0; y < height; ++y) {
-        for (size_t x = 0; x < width; ++x) {
+        const auto divergence = [&](size_t x) -> void {
             (*FI)(x, y) = (*Gx)(x, y) + (*Gy)(x, y);
 
             if (x > 0) {
@@ -612,20 +651,38 @@ void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
                 (*FI)(x, y) -= (*Gy)(x, y - 1);
             }
 
-            if (x == 0) {
+            if (x == 0 && !multigrid) {
                 (*FI)(x, y) += (*Gx)(x, y);
             }
 
-            if (y == 0) {
+            if (y == 0 && !multigrid) {
                 (*FI)(x, y) += (*Gy)(x, y);
             }
+        };
+
+        size_t x = 0;
+#ifdef __SSE2__
+        if (y > 0) {
+            divergence(0);
+            for (x = 1; x + 3 < width; x += 4) {
+                STVFU((*FI)[y][x],
+                      LVFU((*Gx)[y][x]) + LVFU((*Gy)[y][x]) -
+                          LVFU((*Gx)[y][x - 1]) - LVFU((*Gy)[y - 1][x]));
+            }
+        }
+#endif
+
+        for (; x < width; ++x) {
+            divergence(x);
         }
     }
 
     // delete Gx; // RT - reused as temp buffer in solve_pde_fft, deleted later
 
     // solve pde and exponentiate (ie recover compressed image)
-    {
+    if (multigrid) {
+        solve_pde_multigrid(FI, &L, Gx, multithread);
+    } else {
         MyMutex::MyLock lock(*fftwMutex);
         solve_pde_fft(FI, &L, Gx, multithread);
     }
@@ -706,6 +763,22 @@ void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
 
 // returns T = EVy A EVx^tr
 // note, modifies input data
+// 2d discrete cosine transform of A into T, with a plan from the shared
+// cache
+void dct_2d(Array2Df *A, Array2Df *T, bool multithread)
+{
+    int nthreads = 1;
+#ifdef _OPENMP
+    if (multithread) {
+        nthreads = omp_get_num_procs();
+    }
+#endif
+    auto p = FFTWPlanCache::getInstance()->r2r_2d(
+        A->getRows(), A->getCols(), A->data(), T->data(), FFTW_REDFT00,
+        FFTW_REDFT00, FFTW_ESTIMATE, nthreads);
+    fftwf_execute_r2r(p.get(), A->data(), T->data());
+}
+
 void transform_ev2normal(Array2Df *A, Array2Df *T, bool multithread)
 {
     int width = A->getCols();
@@ -743,11 +816,7 @@ void transform_ev2normal(Array2Df *A, Array2Df *T, bool multithread)
     // fftwf_free(in);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d(height, width, A->data(), T->data(), FFTW_REDFT00,
-                          FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute(p);
-    fftwf_destroy_plan(p);
+    dct_2d(A, T, multithread);
 }
 
 // returns T = EVy^-1 * A * (EVx^-1)^tr
@@ -758,11 +827,7 @@ void transform_normal2ev(Array2Df *A, Array2Df *T, bool multithread)
     assert((int)T->getCols() == width && (int)T->getRows() == height);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d(height, width, A->data(), T->data(), FFTW_REDFT00,
-                          FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute(p);
-    fftwf_destroy_plan(p);
+    dct_2d(A, T, multithread);
 
     // need to scale the output matrix to get the right transform
     float factor = (1.0f / ((height - 1) * (width - 1)));
@@ -852,18 +917,6 @@ void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf,
     assert((int)U->getCols() == width && (int)U->getRows() == height);
     assert(buf->getCols() == width && buf->getRows() == height);
 
-    // activate parallel execution of fft routines
-#ifdef RT_FFTW3F_OMP
-
-    if (multithread) {
-        fftwf_init_threads();
-        fftwf_plan_with_nthreads(omp_get_num_procs());
-    }
-
-// #else
-//   fftwf_plan_with_nthreads( 2 );
-#endif
-
     // in general there might not be a solution to the Poisson pde
     // with Neumann boundary conditions unless the boundary satisfies
     // an integral condition, this function modifies the boundary so that
@@ -952,6 +1005,339 @@ void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf,
  * RT code from here on
  *****************************************************************************/
 
+namespace multigrid {
+
+constexpr int MIN_SIZE = 32; // minimum size of the coarsest level
+constexpr int PRE_SMOOTH = 2;
+constexpr int POST_SMOOTH = 2;
+constexpr int FINE_CYCLES = 1;
+
+struct Level {
+    Level(int w, int h, float hh): U(w, h), F(w, h), R(w, h), h2(hh) {}
+    // finest level, referencing the buffers of the caller
+    Level(Array2Df &u, Array2Df &f, Array2Df &r)
+        : U(u.getCols(), u.getRows(), u), F(f.getCols(), f.getRows(), f),
+          R(r.getCols(), r.getRows(), r), h2(1.f)
+    {
+    }
+
+    Array2Df U;
+    Array2Df F;
+    Array2Df R;
+    const float h2; // squared grid spacing
+};
+
+// red-black Gauss-Seidel
+void smooth(Level &l, int iterations, bool multithread)
+{
+    const int W = l.U.getCols();
+    const int H = l.U.getRows();
+    Array2Df &U = l.U;
+    const Array2Df &F = l.F;
+    const float h2 = l.h2;
+
+    const auto update = [&](int x, int y) -> void {
+        float s = 0.f;
+        int n = 0;
+        if (x > 0) {
+            s += U[y][x - 1];
+            ++n;
+        }
+        if (x < W - 1) {
+            s += U[y][x + 1];
+            ++n;
+        }
+        if (y > 0) {
+            s += U[y - 1][x];
+            ++n;
+        }
+        if (y < H - 1) {
+            s += U[y + 1][x];
+            ++n;
+        }
+        U[y][x] = (s - h2 * F[y][x]) / n;
+    };
+
+    for (int i = 0; i < iterations; ++i) {
+        for (int c = 0; c < 2; ++c) {
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+            for (int y = 0; y < H; ++y) {
+                int x = (y + c) & 1;
+                if (y == 0 || y == H - 1) {
+                    for (; x < W; x += 2) {
+                        update(x, y);
+                    }
+                    continue;
+                }
+                if (x == 0) {
+                    update(x, y);
+                    x += 2;
+                }
+                const float *up = U[y - 1];
+                const float *dn = U[y + 1];
+                float *row = U[y];
+                const float *f = F[y];
+                for (; x < W - 1; x += 2) {
+                    row[x] = (row[x - 1] + row[x + 1] + up[x] + dn[x] -
+                              h2 * f[x]) *
+                             0.25f;
+                }
+                if (x == W - 1) {
+                    update(x, y);
+                }
+            }
+        }
+    }
+}
+
+// R = F - Laplace U
+void residual(Level &l, bool multithread)
+{
+    const int W = l.U.getCols();
+    const int H = l.U.getRows();
+    const Array2Df &U = l.U;
+    const float ih2 = 1.f / l.h2;
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            const float u = U[y][x];
+            float s = 0.f;
+            if (x > 0) {
+                s += U[y][x - 1] - u;
+            }
+            if (x < W - 1) {
+                s += U[y][x + 1] - u;
+            }
+            if (y > 0) {
+                s += U[y - 1][x] - u;
+            }
+            if (y < H - 1) {
+                s += U[y + 1][x] - u;
+            }
+            l.R[y][x] = l.F[y][x] - s * ih2;
+        }
+    }
+}
+
+// each coarse cell is the average of the 2x2 fine cells it covers
+void restrict_avg(const Array2Df &src, Array2Df &dst, bool multithread)
+{
+    const int Wc = dst.getCols();
+    const int Hc = dst.getRows();
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < Hc; ++y) {
+        const float *s0 = src[2 * y];
+        const float *s1 = src[2 * y + 1];
+        for (int x = 0; x < Wc; ++x) {
+            dst[y][x] = 0.25f * (s0[2 * x] + s0[2 * x + 1] + s1[2 * x] +
+                                 s1[2 * x + 1]);
+        }
+    }
+}
+
+// dst += bilinear interpolation of src, for a cell-centered grid
+void prolong_add(const Array2Df &src, Array2Df &dst, bool multithread)
+{
+    const int W = dst.getCols();
+    const int H = dst.getRows();
+    const int Wc = src.getCols();
+    const int Hc = src.getRows();
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        // the centre of the fine cell y is at (y - 0.5) / 2 in coarse cells
+        const float sy = LIM((y - 0.5f) * 0.5f, 0.f, float(Hc - 1));
+        const int y0 = std::min(int(sy), Hc - 1);
+        const int y1 = std::min(y0 + 1, Hc - 1);
+        const float fy = sy - y0;
+        for (int x = 0; x < W; ++x) {
+            const float sx = LIM((x - 0.5f) * 0.5f, 0.f, float(Wc - 1));
+            const int x0 = std::min(int(sx), Wc - 1);
+            const int x1 = std::min(x0 + 1, Wc - 1);
+            const float fx = sx - x0;
+            const float a = intp(fx, src[y0][x1], src[y0][x0]);
+            const float b = intp(fx, src[y1][x1], src[y1][x0]);
+            dst[y][x] += intp(fy, b, a);
+        }
+    }
+}
+
+void remove_mean(Array2Df &A, bool multithread)
+{
+    const int W = A.getCols();
+    const int H = A.getRows();
+    double sum = 0.0;
+
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+ : sum) if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            sum += A[y][x];
+        }
+    }
+
+    const float avg = sum / (double(W) * H);
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            A[y][x] -= avg;
+        }
+    }
+}
+
+// conjugate gradient solver for the coarsest level
+void solve_coarsest(Level &l, bool multithread)
+{
+    const int W = l.U.getCols();
+    const int H = l.U.getRows();
+    const size_t n = size_t(W) * H;
+    const float ih2 = 1.f / l.h2;
+
+    remove_mean(l.F, multithread);
+
+    // -Laplace is positive semi-definite, with the constants as null space
+    const auto apply = [&](const std::vector<float> &u,
+                           std::vector<float> &out) -> void {
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; ++x) {
+                const float c = u[y * W + x];
+                float s = 0.f;
+                if (x > 0) {
+                    s += c - u[y * W + x - 1];
+                }
+                if (x < W - 1) {
+                    s += c - u[y * W + x + 1];
+                }
+                if (y > 0) {
+                    s += c - u[(y - 1) * W + x];
+                }
+                if (y < H - 1) {
+                    s += c - u[(y + 1) * W + x];
+                }
+                out[y * W + x] = s * ih2;
+            }
+        }
+    };
+    const auto dot = [n](const std::vector<float> &a,
+                         const std::vector<float> &b) -> double {
+        double ret = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            ret += double(a[i]) * b[i];
+        }
+        return ret;
+    };
+
+    std::vector<float> u(n, 0.f), r(n), p(n), q(n);
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            r[y * W + x] = -l.F[y][x];
+        }
+    }
+    p = r;
+    double rr = dot(r, r);
+    const double stop = rr * 1e-12;
+    for (size_t it = 0; it < n && rr > stop; ++it) {
+        apply(p, q);
+        const double pq = dot(p, q);
+        if (pq <= 0.0) {
+            break;
+        }
+        const float alpha = rr / pq;
+        for (size_t i = 0; i < n; ++i) {
+            u[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        const double rr2 = dot(r, r);
+        const float beta = rr2 / rr;
+        rr = rr2;
+        for (size_t i = 0; i < n; ++i) {
+            p[i] = r[i] + beta * p[i];
+        }
+    }
+
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            l.U[y][x] = u[y * W + x];
+        }
+    }
+}
+
+void vcycle(std::vector<std::unique_ptr<Level>> &levels, size_t k,
+            bool multithread)
+{
+    Level &l = *levels[k];
+    if (k + 1 == levels.size()) {
+        solve_coarsest(l, multithread);
+        return;
+    }
+
+    Level &c = *levels[k + 1];
+    smooth(l, PRE_SMOOTH, multithread);
+    residual(l, multithread);
+    restrict_avg(l.R, c.F, multithread);
+    c.U.fill(0.f);
+    vcycle(levels, k + 1, multithread);
+    prolong_add(c.U, l.U, multithread);
+    smooth(l, POST_SMOOTH, multithread);
+}
+
+} // namespace multigrid
+
+// solves Laplace U = F with zero Neumann boundary conditions, U(-1) = U(0),
+// using a full multigrid cycle followed by FINE_CYCLES V-cycles. F is
+// modified, and buf is used as temporary buffer (same size as F)
+void solve_pde_multigrid(Array2Df *F, Array2Df *U, Array2Df *buf,
+                         bool multithread)
+{
+    using namespace multigrid;
+
+    std::vector<std::unique_ptr<Level>> levels;
+    levels.emplace_back(new Level(*U, *F, *buf));
+    int w = F->getCols();
+    int h = F->getRows();
+    float h2 = 1.f;
+    // the grids are halved for as long as the sizes are even, so each coarse
+    // cell is the average of exactly 2x2 fine cells
+    while (w % 2 == 0 && h % 2 == 0 && std::min(w, h) >= 2 * MIN_SIZE) {
+        w /= 2;
+        h /= 2;
+        h2 *= 4.f;
+        levels.emplace_back(new Level(w, h, h2));
+    }
+
+    remove_mean(levels[0]->F, multithread);
+    for (size_t k = 1; k < levels.size(); ++k) {
+        restrict_avg(levels[k - 1]->F, levels[k]->F, multithread);
+    }
+
+    // full multigrid: the solution of each level is the initial guess of the
+    // next finer one
+    solve_coarsest(*levels.back(), multithread);
+    for (size_t k = levels.size() - 1; k > 0; --k) {
+        Level &l = *levels[k - 1];
+        l.U.fill(0.f);
+        prolong_add(levels[k]->U, l.U, multithread);
+        vcycle(levels, k - 1, multithread);
+    }
+    for (int i = 0; i < FINE_CYCLES; ++i) {
+        vcycle(levels, 0, multithread);
+    }
+}
+
 inline void rescale_bilinear(const Array2Df &src, Array2Df &dst,
                              bool multithread)
 {
@@ -1012,6 +1398,20 @@ inline int find_fast_dim(int dim)
     return dim;
 }
 
+// the multigrid solver can halve the grid only while the sizes are even, so
+// we round them up to a multiple of 2^k, where k is the number of levels that
+// fit in the image. Since 2^k <= min(w, h) / MIN_SIZE, the image is stretched
+// by at most ~3%
+std::pair<int, int> find_multigrid_dims(int w, int h)
+{
+    const int d = std::min(w, h);
+    int k = 1;
+    while (d / (2 * k) >= multigrid::MIN_SIZE) {
+        k *= 2;
+    }
+    return std::make_pair((w + k - 1) / k * k, (h + k - 1) / k * k);
+}
+
 void ToneMapFattal02(Imagefloat *rgb, ImProcFunctions *ipf,
                      const ProcParams *params, bool multiThread)
 {
@@ -1058,8 +1458,12 @@ void ToneMapFattal02(Imagefloat *rgb, ImProcFunctions *ipf,
     // median filter on the deep shadows, to avoid boosting noise
     // because w2 >= w and h2 >= h, we can use the L buffer as temporary buffer
     // for Median_Denoise()
+    const bool multigrid = settings->fattal_multigrid;
     int w2 = find_fast_dim(w) + 1;
     int h2 = find_fast_dim(h) + 1;
+    if (multigrid) {
+        std::tie(w2, h2) = find_multigrid_dims(w, h);
+    }
     Array2Df L(w2, h2);
     {
 #ifdef _OPENMP
@@ -1092,7 +1496,8 @@ void ToneMapFattal02(Imagefloat *rgb, ImProcFunctions *ipf,
     }
 
     rescale_nearest(Yr, L, multiThread);
-    tmo_fattal02(w2, h2, L, L, alpha, beta, noise, detail_level, multiThread);
+    tmo_fattal02(w2, h2, L, L, alpha, beta, noise, detail_level, multigrid,
+                 multiThread);
 
     const float hr = float(h2) / float(h);
     const float wr = float(w2) / float(w);
@@ -306,8 +306,13 @@ std::string getMD5(const Glib::ustring &fname, bool extended)
     if (file) {
 
         try {
-            const auto info =
-                file->query_info("standard::*," G_FILE_ATTRIBUTE_TIME_MODIFIED);
+            // only ask for what is needed: "standard::*" would also guess
+            // the content type, which can mean reading the file
+            const auto info = file->query_info(
+                extended ? G_FILE_ATTRIBUTE_STANDARD_SIZE
+                           "," G_FILE_ATTRIBUTE_TIME_MODIFIED
+                           "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+                         : G_FILE_ATTRIBUTE_STANDARD_SIZE);
             if (info) {
                 // We only use name and size to identify a file.
                 Glib::ustring identifier;
@@ -74,7 +74,8 @@ namespace rtengine
 
 void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
                                    array2D<float> &red, array2D<float> &green,
-                                   array2D<float> &blue)
+                                   array2D<float> &blue,
+                                   const float *const *blend)
 {
     BENCHFUN
     const signed short int *cp,
@@ -310,6 +311,21 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
         plistener->setProgress(progress);
     }
 
+    // when blending with another demosaic, the result is not used where the
+    // weight of the other one is (almost) 1. The red and blue interpolation
+    // needs the green of the neighbours, so those are checked as well
+    constexpr float max_blend = 0.999f;
+    const auto other_only = [blend](int row, int col) -> bool {
+        for (int i = row - 1; i <= row + 1; ++i) {
+            for (int j = col - 1; j <= col + 1; ++j) {
+                if (blend[i][j] <= max_blend) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
@@ -332,6 +348,12 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
             for (int col = 2; col < width - 2; col++) {
                 float *pix = image[row * width + col];
                 int color = fc(row, col);
+                if (blend && other_only(row, col)) {
+                    // just keep the values finite, they get a weight of 0
+                    green[row][col] =
+                        (color & 1) ? pix[color] : (pix[1] + pix[3]) * 0.5f;
+                    continue;
+                }
                 int32_t *ip = code[row & prow][col & pcol];
                 float gval[8] = {};
 
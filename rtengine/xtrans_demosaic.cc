@@ -28,8 +28,26 @@
 #include "rt_algo.h"
 #include "rt_math.h"
 #include "rtengine.h"
+#include <vector>
 
 namespace rtengine {
+
+namespace {
+
+#ifdef __SSE2__
+// loads 4 consecutive bytes as floats
+inline vfloat load_u8x4(const uint8_t *p)
+{
+    int v;
+    memcpy(&v, p, sizeof(v));
+    const vint zerov = _mm_setzero_si128();
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(
+        _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zerov), zerov));
+}
+#endif
+
+} // namespace
+
 const float xyz_rgb[3][3] = { // XYZ from RGB
     {0.412453, 0.357580, 0.180423},
     {0.212671, 0.715160, 0.072169},
@@ -314,8 +332,15 @@ void RawImageSource::xtrans_interpolate(const int passes, const bool useCieLab)
     {
         int progressCounter = 0;
 
-        float *buffer =
-            (float *)malloc((ts * ts * (ndir * 4 + 3) + 128) * sizeof(float));
+        // the tile buffers are kept across calls, to avoid allocating (and
+        // faulting in) about 2MB per thread every time the preview is
+        // demosaiced
+        static thread_local std::vector<float> arena;
+        const size_t bufsize = ts * ts * (ndir * 4 + 3) + 128;
+        if (arena.size() < bufsize) {
+            arena.resize(bufsize);
+        }
+        float *buffer = arena.data();
         float(*rgb)[ts][ts][3] = (float(*)[ts][ts][3])buffer;
         float(*lab)[ts - 8][ts - 8] =
             (float(*)[ts - 8][ts - 8])(buffer + ts * ts * (ndir * 3));
@@ -911,8 +936,27 @@ void RawImageSource::xtrans_interpolate(const int passes, const bool useCieLab)
                         int f = dir[d & 3];
                         f = f == 1 ? 1 : f - 8;
 
-                        for (int row = 5; row < mrow - 5; row++)
-                            for (int col = 5; col < mcol - 5; col++) {
+                        for (int row = 5; row < mrow - 5; row++) {
+                            int col = 5;
+#ifdef __SSE2__
+                            for (; col < mcol - 8; col += 4) {
+                                const float *y = &yuv[0][row - 4][col - 4];
+                                const float *u = &yuv[1][row - 4][col - 4];
+                                const float *v = &yuv[2][row - 4][col - 4];
+                                const vfloat yv = LVFU(y[0]);
+                                const vfloat uv = LVFU(u[0]);
+                                const vfloat vv = LVFU(v[0]);
+                                const vfloat gy =
+                                    yv + yv - LVFU(y[f]) - LVFU(y[-f]);
+                                const vfloat gu =
+                                    uv + uv - LVFU(u[f]) - LVFU(u[-f]);
+                                const vfloat gv =
+                                    vv + vv - LVFU(v[f]) - LVFU(v[-f]);
+                                STVFU(drv[d][row - 5][col - 5],
+                                      gy * gy + gu * gu + gv * gv);
+                            }
+#endif
+                            for (; col < mcol - 5; col++) {
                                 float *y = &yuv[0][row - 4][col - 4];
                                 float *u = &yuv[1][row - 4][col - 4];
                                 float *v = &yuv[2][row - 4][col - 4];
@@ -921,6 +965,7 @@ void RawImageSource::xtrans_interpolate(const int passes, const bool useCieLab)
                                     SQR(2 * u[0] - u[f] - u[-f]) +
                                     SQR(2 * v[0] - v[f] - v[-f]);
                             }
+                        }
                     }
                 }
 
@@ -1140,8 +1185,48 @@ void RawImageSource::xtrans_interpolate(const int passes, const bool useCieLab)
                 /* Average the most homogeneous pixels for the final result: */
                 uint8_t hm[8] = {};
 
-                for (int row = MIN(top, 8); row < mrow - 8; row++)
-                    for (int col = MIN(left, 8); col < mcol - 8; col++) {
+                for (int row = MIN(top, 8); row < mrow - 8; row++) {
+                    int col = MIN(left, 8);
+#ifdef __SSE2__
+                    for (; col < mcol - 11; col += 4) {
+                        vfloat hmv[8];
+
+                        for (int d = 0; d < 4; d++) {
+                            hmv[d] = load_u8x4(&homosum[d][row][col]);
+                        }
+
+                        for (int d = 4; d < ndir; d++) {
+                            hmv[d] = load_u8x4(&homosum[d][row][col]);
+                            const vmask ltv = vmaskf_lt(hmv[d - 4], hmv[d]);
+                            const vmask gtv = vmaskf_gt(hmv[d - 4], hmv[d]);
+                            hmv[d - 4] = vself(ltv, ZEROV, hmv[d - 4]);
+                            hmv[d] = vself(gtv, ZEROV, hmv[d]);
+                        }
+
+                        const vfloat maxvalv =
+                            load_u8x4(&homosummax[row][col]);
+                        vfloat rv = ZEROV, gv = ZEROV, bv = ZEROV, nv = ZEROV;
+
+                        for (int d = 0; d < ndir; d++) {
+                            const vmask selv = vmaskf_ge(hmv[d], maxvalv);
+                            vfloat r, g, b;
+                            vconvertrgbrgbrgbrgb2rrrrggggbbbb(
+                                rgb[d][row][col], r, g, b);
+                            rv += vselfzero(selv, r);
+                            gv += vselfzero(selv, g);
+                            bv += vselfzero(selv, b);
+                            nv += vselfzero(selv, F2V(1.f));
+                        }
+
+                        STVFU(red[row + top][col + left],
+                              vmaxf(ZEROV, rv / nv));
+                        STVFU(green[row + top][col + left],
+                              vmaxf(ZEROV, gv / nv));
+                        STVFU(blue[row + top][col + left],
+                              vmaxf(ZEROV, bv / nv));
+                    }
+#endif
+                    for (; col < mcol - 8; col++) {
 
                         for (int d = 0; d < 4; d++) {
                             hm[d] = homosum[d][row][col];
@@ -1176,6 +1261,7 @@ void RawImageSource::xtrans_interpolate(const int passes, const bool useCieLab)
                         blue[row + top][col + left] =
                             std::max(0.f, avg[2] / avg[3]);
                     }
+                }
 
                 if (plistenerActive && ((++progressCounter) % 32 == 0)) {
 #ifdef _OPENMP
@@ -1188,8 +1274,6 @@ void RawImageSource::xtrans_interpolate(const int passes, const bool useCieLab)
                     }
                 }
             }
-
-        free(buffer);
     }
 
     xtransborder_interpolate(passes > 1 ? 8 : 11, red, green, blue);
@@ -17,6 +17,7 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "../rtengine/rt_math.h"
+#include <algorithm>
 #include <cstring>
 #include <functional>
 #include <glib/gstdio.h>
@@ -27,8 +28,11 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
 #include "../rtengine/imgiomanager.h"
+#include "../rtengine/memoryusage.h"
+#include "../rtengine/threadpool.h"
 #include "batchqueue.h"
 #include "batchqueuebuttonset.h"
 #include "filecatalog.h"
@@ -38,11 +42,19 @@
 #include "thumbnail.h"
 #include <sys/time.h>
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 using namespace rtengine;
 
 BatchQueue::BatchQueue(FileCatalog *aFileCatalog)
     : processing(nullptr), fileCatalog(aFileCatalog), sequence(0),
-      listener(nullptr), batch_profile_(nullptr)
+      listener(nullptr), batch_profile_(nullptr), journal_records_(0),
+      journal_pending_records_(0), pending_saves_(0), pending_bytes_(0),
+      save_failed_(false), stats_megapixels_(0)
 {
     fileCatalog->setBatchQueue(this);
 
@@ -121,6 +133,21 @@ BatchQueue::BatchQueue(FileCatalog *aFileCatalog)
 
 BatchQueue::~BatchQueue()
 {
+    waitForPendingSaves(0, 0);
+    rtengine::clearSharedSources();
+
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex_);
+        for (auto &a : ahead_) {
+            rtengine::ThreadPool::wait(a.second);
+            auto res = a.second.get();
+            if (res.first) {
+                res.first->free();
+            }
+        }
+        ahead_.clear();
+    }
+
     std::set<BatchQueueEntry *> removable_bqes;
 
     mutex_removable_batch_queue_entries.lock();
@@ -276,6 +303,7 @@ void BatchQueue::addEntries(const std::vector<BatchQueueEntry *> &entries,
 
             if (!entry->params.save(this, tempFile)) {
                 entry->savedParamsFile = tempFile;
+                entry->savedParamsData = entry->params.to_binary(tempFile);
             }
 
             entry->selected = false;
@@ -290,7 +318,8 @@ void BatchQueue::addEntries(const std::vector<BatchQueueEntry *> &entries,
                                        return !fdEntry->processing;
                                    });
 
-            fd.insert(pos, entry);
+            pos = fd.insert(pos, entry);
+            journalInsert(pos - fd.begin(), entry);
 
             if (entry->thumbnail)
                 entry->thumbnail->imageEnqueued();
@@ -298,90 +327,394 @@ void BatchQueue::addEntries(const std::vector<BatchQueueEntry *> &entries,
     }
 
     if (save)
-        saveBatchQueue();
+        flushJournal();
 
     redraw();
     notifyListener();
 }
 
+namespace {
+
+// The queue.csv file refers to the params of each entry by the name of its
+// .arp file. Reading thousands of them at startup is slow, so a binary copy
+// of the params is also kept in a single cache file, which is used when it
+// matches the queue and ignored otherwise.
+constexpr char queue_cache_magic[4] = {'A', 'R', 'T', 'Q'};
+constexpr uint32_t queue_cache_version = 1;
+
+// The changes made to the queue after queue.csv was written are appended to
+// a journal, so that adding or removing a job doesn't rewrite the whole
+// queue. The entries are identified by the name of their .arp file, which is
+// unique. Records are:
+//  - 'I' index key row params: insertion of an entry at the given position,
+//    with its queue.csv row and the binary copy of its params
+//  - 'R' key: removal of an entry
+//  - 'M' index key: move of an entry to the given position
+// Replaying a journal on a queue.csv that already includes some of its
+// records (if ART stopped between writing queue.csv and deleting the
+// journal) does no harm besides possibly reordering some entries, as
+// insertions of existing entries and removals of missing ones are ignored.
+constexpr char queue_journal_magic[4] = {'A', 'R', 'T', 'J'};
+constexpr uint32_t queue_journal_version = 1;
+// the journal is compacted (i.e. queue.csv is rewritten) when it has more
+// records than this, and than the entries in the queue
+constexpr size_t queue_journal_min_compact = 256;
+
+Glib::ustring getQueueFileName()
+{
+    return Glib::build_filename(options.user_config_dir, "batch", "queue.csv");
+}
+
+Glib::ustring getQueueCacheFileName()
+{
+    return Glib::build_filename(options.user_config_dir, "batch", "queue.bin");
+}
+
+Glib::ustring getQueueJournalFileName()
+{
+    return Glib::build_filename(options.user_config_dir, "batch",
+                                "queue.journal");
+}
+
+void writeCacheString(std::ostream &file, const std::string &s)
+{
+    uint32_t n = s.size();
+    file.write(reinterpret_cast<const char *>(&n), sizeof(n));
+    file.write(s.data(), n);
+}
+
+bool readCacheString(std::istream &file, std::string &s)
+{
+    uint32_t n;
+    if (!file.read(reinterpret_cast<char *>(&n), sizeof(n))) {
+        return false;
+    }
+    s.resize(n);
+    return n == 0 || bool(file.read(&s[0], n));
+}
+
+void writeCacheIndex(std::ostream &file, size_t index)
+{
+    uint32_t n = index;
+    file.write(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+bool readCacheIndex(std::istream &file, size_t &index)
+{
+    uint32_t n;
+    if (!file.read(reinterpret_cast<char *>(&n), sizeof(n))) {
+        return false;
+    }
+    index = n;
+    return true;
+}
+
+void loadQueueCache(std::unordered_map<std::string, std::string> &out)
+{
+    std::ifstream file(getQueueCacheFileName(), std::ios::binary);
+    char magic[sizeof(queue_cache_magic)];
+    uint32_t version;
+    if (!file.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, queue_cache_magic, sizeof(magic)) != 0 ||
+        !file.read(reinterpret_cast<char *>(&version), sizeof(version)) ||
+        version != queue_cache_version) {
+        return;
+    }
+
+    std::string name, data;
+    while (readCacheString(file, name) && readCacheString(file, data)) {
+        out[name] = std::move(data);
+    }
+}
+
+// the row of queue.csv for the entry
+std::string getQueueRow(const BatchQueueEntry *entry)
+{
+    const auto &saveFormat = entry->saveFormat;
+    std::ostringstream row;
+
+    // Warning: for code's simplicity in loadBatchQueue, each field must
+    // end by the '|' character, safer than ';' or ',' since it can't be
+    // used in paths
+#ifdef WIN32
+    // on windows it crashes if we don't use c_str() and filename etc.
+    // contain special (e.g. chinese) characters, see issue 3387
+    row << entry->filename.c_str() << '|' << entry->savedParamsFile.c_str()
+        << '|' << entry->outFileName.c_str() << '|' << saveFormat.format
+        << '|'
+#else
+    row << entry->filename << '|' << entry->savedParamsFile << '|'
+        << entry->outFileName << '|' << saveFormat.format << '|'
+#endif
+        << saveFormat.jpegQuality << '|' << saveFormat.jpegSubSamp << '|'
+        << saveFormat.pngBits << '|' << saveFormat.tiffBits << '|'
+        << (saveFormat.tiffFloat ? 1 : 0) << '|'
+        << saveFormat.tiffUncompressed << '|' << saveFormat.saveParams << '|'
+        << entry->forceFormatOpts << '|' << entry->fast_pipeline << '|';
+
+    return row.str();
+}
+
+// a queued job as stored in queue.csv, with the binary copy of its params
+// (if any)
+struct QueueRow {
+    std::string key;
+    std::string row;
+    std::string data;
+};
+
+// applies the records of the journal to rows. Returns the number of records
+// read, stopping at the first incomplete one (e.g. if ART crashed while
+// writing it)
+size_t replayQueueJournal(std::vector<QueueRow> &rows)
+{
+    std::ifstream file(getQueueJournalFileName(), std::ios::binary);
+    char magic[sizeof(queue_journal_magic)];
+    uint32_t version;
+    if (!file.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, queue_journal_magic, sizeof(magic)) != 0 ||
+        !file.read(reinterpret_cast<char *>(&version), sizeof(version)) ||
+        version != queue_journal_version) {
+        return 0;
+    }
+
+    const auto find = [&](const std::string &key)
+        -> std::vector<QueueRow>::iterator {
+        return std::find_if(
+            rows.begin(), rows.end(),
+            [&](const QueueRow &r) -> bool { return r.key == key; });
+    };
+
+    size_t count = 0;
+    char op;
+    size_t index;
+    QueueRow r;
+    while (file.get(op)) {
+        if (op == 'I') {
+            if (!readCacheIndex(file, index) || !readCacheString(file, r.key) ||
+                !readCacheString(file, r.row) ||
+                !readCacheString(file, r.data)) {
+                break;
+            }
+            if (find(r.key) == rows.end()) {
+                rows.insert(rows.begin() + std::min(index, rows.size()),
+                            std::move(r));
+            }
+        } else if (op == 'R') {
+            if (!readCacheString(file, r.key)) {
+                break;
+            }
+            auto it = find(r.key);
+            if (it != rows.end()) {
+                rows.erase(it);
+            }
+        } else if (op == 'M') {
+            if (!readCacheIndex(file, index) || !readCacheString(file, r.key)) {
+                break;
+            }
+            auto it = find(r.key);
+            if (it != rows.end()) {
+                QueueRow tmp = std::move(*it);
+                rows.erase(it);
+                rows.insert(rows.begin() + std::min(index, rows.size()),
+                            std::move(tmp));
+            }
+        } else {
+            break;
+        }
+        ++count;
+    }
+    return count;
+}
+
+} // namespace
+
+void BatchQueue::journalInsert(size_t index, const BatchQueueEntry *entry)
+{
+    std::ostringstream rec;
+    rec.put('I');
+    writeCacheIndex(rec, index);
+    writeCacheString(rec, entry->savedParamsFile.raw());
+    writeCacheString(rec, getQueueRow(entry));
+    writeCacheString(rec, entry->savedParamsData);
+
+    std::lock_guard<std::mutex> lock(journal_pending_mutex_);
+    journal_pending_ += rec.str();
+    ++journal_pending_records_;
+}
+
+void BatchQueue::journalRemove(const BatchQueueEntry *entry)
+{
+    std::ostringstream rec;
+    rec.put('R');
+    writeCacheString(rec, entry->savedParamsFile.raw());
+
+    std::lock_guard<std::mutex> lock(journal_pending_mutex_);
+    journal_pending_ += rec.str();
+    ++journal_pending_records_;
+}
+
+void BatchQueue::journalMove(size_t index, const BatchQueueEntry *entry)
+{
+    std::ostringstream rec;
+    rec.put('M');
+    writeCacheIndex(rec, index);
+    writeCacheString(rec, entry->savedParamsFile.raw());
+
+    std::lock_guard<std::mutex> lock(journal_pending_mutex_);
+    journal_pending_ += rec.str();
+    ++journal_pending_records_;
+}
+
+bool BatchQueue::flushJournal()
+{
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+
+    std::string records;
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> plock(journal_pending_mutex_);
+        records.swap(journal_pending_);
+        std::swap(count, journal_pending_records_);
+    }
+    if (!count) {
+        return true;
+    }
+
+    size_t queue_size = 0;
+    {
+        MYREADERLOCK(l, entryRW);
+        queue_size = fd.size();
+    }
+    if (journal_records_ + count >
+        std::max(queue_journal_min_compact, queue_size)) {
+        return writeQueueFile();
+    }
+
+    const auto fileName = getQueueJournalFileName();
+    std::ofstream file(fileName, std::ios::binary | std::ios::app);
+    if (!file.is_open()) {
+        return false;
+    }
+    if (file.tellp() == 0) {
+        file.write(queue_journal_magic, sizeof(queue_journal_magic));
+        file.write(reinterpret_cast<const char *>(&queue_journal_version),
+                   sizeof(queue_journal_version));
+    }
+    file.write(records.data(), records.size());
+    journal_records_ += count;
+
+    return bool(file);
+}
+
 bool BatchQueue::saveBatchQueue()
 {
-    const auto fileName =
-        Glib::build_filename(options.user_config_dir, "batch", "queue.csv");
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    return writeQueueFile();
+}
 
-    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+bool BatchQueue::writeQueueFile()
+{
+    std::ofstream file(getQueueFileName(), std::ios::binary | std::ios::trunc);
 
     if (!file.is_open())
         return false;
 
+    std::ofstream cache(getQueueCacheFileName(),
+                        std::ios::binary | std::ios::trunc);
+    if (cache.is_open()) {
+        cache.write(queue_cache_magic, sizeof(queue_cache_magic));
+        cache.write(reinterpret_cast<const char *>(&queue_cache_version),
+                    sizeof(queue_cache_version));
+    }
+
     {
         MYREADERLOCK(l, entryRW);
 
-        if (fd.empty())
-            return true;
+        // the pending changes of the journal are already in fd
+        {
+            std::lock_guard<std::mutex> plock(journal_pending_mutex_);
+            journal_pending_.clear();
+            journal_pending_records_ = 0;
+        }
 
-        // The column's header is mandatory (the first line will be skipped when
-        // loaded)
-        file << "input image full path|param file full path|output image full "
-                "path|file format|jpeg quality|jpeg subsampling|"
-             << "png bit depth|png compression|tiff bit depth|tiff is "
-                "float|uncompressed tiff|save output params|force format "
-                "options|fast export|<end of line>"
-             << std::endl;
+        if (!fd.empty()) {
+            // The column's header is mandatory (the first line will be
+            // skipped when loaded)
+            file << "input image full path|param file full path|output "
+                    "image full path|file format|jpeg quality|jpeg "
+                    "subsampling|"
+                 << "png bit depth|png compression|tiff bit depth|tiff is "
+                    "float|uncompressed tiff|save output params|force format "
+                    "options|fast export|<end of line>"
+                 << std::endl;
+        }
 
         // method is already running with entryLock, so no need to lock again
         for (const auto fdEntry : fd) {
-
             const auto entry = static_cast<BatchQueueEntry *>(fdEntry);
-            const auto &saveFormat = entry->saveFormat;
 
-            // Warning: for code's simplicity in loadBatchQueue, each field must
-            // end by the '|' character, safer than ';' or ',' since it can't be
-            // used in paths
-#ifdef WIN32
-            // on windows it crashes if we don't use c_str() and filename etc.
-            // contain special (e.g. chinese) characters, see issue 3387
-            file << entry->filename.c_str() << '|'
-                 << entry->savedParamsFile.c_str() << '|'
-                 << entry->outFileName.c_str() << '|' << saveFormat.format
-                 << '|'
-#else
-            file << entry->filename << '|' << entry->savedParamsFile << '|'
-                 << entry->outFileName << '|' << saveFormat.format << '|'
-#endif
-                 << saveFormat.jpegQuality << '|' << saveFormat.jpegSubSamp
-                 << '|' << saveFormat.pngBits << '|' << saveFormat.tiffBits
-                 << '|' << (saveFormat.tiffFloat ? 1 : 0) << '|'
-                 << saveFormat.tiffUncompressed << '|' << saveFormat.saveParams
-                 << '|' << entry->forceFormatOpts << '|' << entry->fast_pipeline
-                 << '|' << std::endl;
+            file << getQueueRow(entry) << std::endl;
+
+            if (cache.is_open() && !entry->savedParamsData.empty()) {
+                writeCacheString(cache, entry->savedParamsFile.raw());
+                writeCacheString(cache, entry->savedParamsData);
+            }
         }
     }
 
+    file.close();
+    if (!file) {
+        return false;
+    }
+
+    // queue.csv is complete, so the journal is no longer needed
+    ::g_remove(getQueueJournalFileName().c_str());
+    journal_records_ = 0;
+
     return true;
 }
 
 bool BatchQueue::loadBatchQueue()
 {
-    const auto fileName =
-        Glib::build_filename(options.user_config_dir, "batch", "queue.csv");
+    std::vector<QueueRow> rows;
+    {
+        std::ifstream file(getQueueFileName(), std::ios::binary);
+
+        std::unordered_map<std::string, std::string> cache;
+        loadQueueCache(cache);
+
+        std::string row;
+
+        // skipping the first row
+        std::getline(file, row);
 
-    std::ifstream file(fileName, std::ios::binary);
+        while (std::getline(file, row)) {
+            QueueRow r;
+            std::istringstream line(row);
+            std::getline(line, r.key, '|');
+            std::getline(line, r.key, '|');
+            auto cached = cache.find(r.key);
+            if (cached != cache.end()) {
+                r.data = std::move(cached->second);
+            }
+            r.row = std::move(row);
+            rows.push_back(std::move(r));
+        }
+    }
+    const size_t replayed = replayQueueJournal(rows);
 
-    if (file.is_open()) {
+    {
         // Yes, it's better to get the lock for the whole file reading,
         // to update the list in one shot without any other concurrent access!
         MYWRITERLOCK(l, entryRW);
 
-        std::string row, column;
+        std::string column;
         std::vector<std::string> values;
 
-        // skipping the first row
-        std::getline(file, row);
-
-        while (std::getline(file, row)) {
+        for (auto &r : rows) {
 
-            std::istringstream line(row);
+            std::istringstream line(r.row);
 
             values.clear();
 
@@ -425,9 +758,14 @@ bool BatchQueue::loadBatchQueue()
             const auto fast = nextIntOr(false);
 
             rtengine::procparams::ProcParams pparams;
+            std::string paramsData;
 
-            if (pparams.load(this, paramsFile)) {
+            if (!r.data.empty() && pparams.from_binary(r.data, paramsFile)) {
+                paramsData = std::move(r.data);
+            } else if (pparams.load(this, paramsFile)) {
                 continue;
+            } else {
+                paramsData = pparams.to_binary(paramsFile);
             }
 
             auto thumb = CacheManager::getInstance()->getEntry(source);
@@ -455,6 +793,7 @@ bool BatchQueue::loadBatchQueue()
             entry->addButtonSet(bqbs);
 
             entry->savedParamsFile = paramsFile;
+            entry->savedParamsData = std::move(paramsData);
             entry->selected = false;
             entry->outFileName = outputFile;
 
@@ -477,6 +816,11 @@ bool BatchQueue::loadBatchQueue()
         }
     }
 
+    // start again from a compact queue file
+    if (replayed) {
+        saveBatchQueue();
+    }
+
     redraw();
     notifyListener();
 
@@ -511,6 +855,7 @@ void BatchQueue::cancelItems(const std::vector<ThumbBrowserEntryBase *> &items,
                              bool immediately)
 {
     std::set<BatchQueueEntry *> removable_bqes;
+    std::set<Glib::ustring> removed_files;
 
     {
         MYWRITERLOCK(l, entryRW);
@@ -528,13 +873,17 @@ void BatchQueue::cancelItems(const std::vector<ThumbBrowserEntryBase *> &items,
                 continue;
 
             fd.erase(pos);
+            journalRemove(entry);
 
-            rtengine::ProcessingJob::destroy(entry->job);
+            if (!discardDevelopedAhead(entry)) {
+                rtengine::ProcessingJob::destroy(entry->job);
+            }
 
             if (entry->thumbnail)
                 entry->thumbnail->imageRemovedFromQueue();
 
             removable_bqes.insert(entry);
+            removed_files.insert(entry->filename);
         }
 
         for (const auto entry : fd)
@@ -544,6 +893,10 @@ void BatchQueue::cancelItems(const std::vector<ThumbBrowserEntryBase *> &items,
         selected.clear();
     }
 
+    for (auto &f : removed_files) {
+        updateSharedSource(f, true);
+    }
+
     if (!removable_bqes.empty()) {
         if (immediately) {
             for (const auto entry : removable_bqes) {
@@ -573,7 +926,7 @@ void BatchQueue::cancelItems(const std::vector<ThumbBrowserEntryBase *> &items,
         }
     }
 
-    saveBatchQueue();
+    flushJournal();
 
     redraw();
     notifyListener();
@@ -604,11 +957,12 @@ void BatchQueue::headItems(const std::vector<ThumbBrowserEntryBase *> &items)
                     return !fdEntry->processing;
                 });
 
+            journalMove(newPos - fd.begin(), entry);
             fd.insert(newPos, entry);
         }
     }
 
-    saveBatchQueue();
+    flushJournal();
 
     redraw();
 }
@@ -633,10 +987,11 @@ void BatchQueue::tailItems(const std::vector<ThumbBrowserEntryBase *> &items)
             fd.erase(pos);
 
             fd.push_back(entry);
+            journalMove(fd.size() - 1, entry);
         }
     }
 
-    saveBatchQueue();
+    flushJournal();
 
     redraw();
 }
@@ -685,6 +1040,13 @@ void BatchQueue::startProcessing()
 {
 
     if (!processing) {
+        save_failed_ = false;
+        if (!hasPendingSaves()) {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_start_ = std::chrono::steady_clock::now();
+            stats_megapixels_ = 0;
+            stats_ = BatchQueueStats();
+        }
         MYWRITERLOCK(l, entryRW);
 
         if (!fd.empty()) {
@@ -714,7 +1076,9 @@ void BatchQueue::startProcessing()
             next->removeButtonSet();
 
             // start batch processing
+            updateSharedSource(next->filename, false);
             rtengine::startBatchProcessing(next->job, this);
+            developAhead();
             queue_draw();
 
             notifyListener();
@@ -754,9 +1118,14 @@ void BatchQueue::error(const Glib::ustring &descr)
         redraw();
     }
 
+    notifyError(descr);
+}
+
+void BatchQueue::notifyError(const Glib::ustring &descr)
+{
     if (listener) {
         BatchQueueListener *const bql = listener;
-        const bool running = processing;
+        const bool running = processing || hasPendingSaves();
         int qsize = 0;
         {
             MYREADERLOCK(l, entryRW);
@@ -954,6 +1323,54 @@ Glib::ustring calcAutoFileNameBase(const Glib::ustring &origFileName,
     return path;
 }
 
+class SaveProgressListener: public rtengine::ProgressListener {
+public:
+    void setProgress(double p) override {}
+    void setProgressStr(const Glib::ustring &str) override {}
+    void setProgressState(bool inProcessing) override {}
+    void error(const Glib::ustring &descr) override
+    {
+        messages.push_back(descr);
+    }
+
+    std::vector<Glib::ustring> messages;
+};
+
+// estimate of the peak memory needed to develop the given entry
+size_t estimate_job_memory(BatchQueueEntry *entry)
+{
+    int w = 0, h = 0;
+    if (entry->thumbnail) {
+        entry->thumbnail->getOriginalSize(w, h);
+    }
+    return rtengine::estimate_peak_memory(w, h, entry->params);
+}
+
+size_t memory_budget()
+{
+    constexpr size_t MB = 1024 * 1024;
+    if (options.batch_queue_memory_limit > 0) {
+        return size_t(options.batch_queue_memory_limit) * MB;
+    }
+
+    // default: half of the physical memory
+    size_t total = 0;
+#ifdef WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status)) {
+        total = status.ullTotalPhys;
+    }
+#else
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0) {
+        total = size_t(pages) * size_t(page_size);
+    }
+#endif
+    return total ? total / 2 : 4096 * MB;
+}
+
 } // namespace
 
 rtengine::ProcessingJob *BatchQueue::imageReady(rtengine::IImagefloat *img)
@@ -987,80 +1404,70 @@ rtengine::ProcessingJob *BatchQueue::imageReady(rtengine::IImagefloat *img)
 
     // printf ("fname=%s, %s\n", fname.c_str(), removeExtension(fname).c_str());
 
-    if (img && fname != "") {
-        int err = 0;
-        processing->processing = false;
+    BatchQueueEntry *entry = processing;
+    entry->processing = false;
+    // entry might be gone after the saving has started
+    const Glib::ustring entry_fname = entry->filename;
 
-        img->setSaveProgressListener(this);
+    // delete from the queue
+    bool remove_button_set = false;
+    size_t next_bytes = 0;
 
-        if (saveFormat.format == "tif") {
-            err = img->saveAsTIFF(fname, saveFormat.tiffBits,
-                                  saveFormat.tiffFloat,
-                                  saveFormat.tiffUncompressed);
-        } else if (saveFormat.format == "png") {
-            err = img->saveAsPNG(fname, saveFormat.pngBits);
-        } else if (saveFormat.format == "jpg") {
-            err = img->saveAsJPEG(fname, saveFormat.jpegQuality,
-                                  saveFormat.jpegSubSamp);
-        } else {
-            err = rtengine::ImageIOManager::getInstance()->save(
-                      img, saveFormat.format, fname, this)
-                      ? 0
-                      : 1;
-        }
+    {
+        MYWRITERLOCK(l, entryRW);
 
-        img->free();
+        processing = nullptr;
+        fd.erase(fd.begin());
+        journalRemove(entry);
+    }
 
-        if (err) {
-            throw Glib::FileError(Glib::FileError::FAILED,
-                                  M("MAIN_MSG_CANNOTSAVE") + ": " + fname);
+    if (img && fname != "") {
+        const size_t bytes =
+            size_t(img->getWidth()) * img->getHeight() * 3 * sizeof(float);
+        {
+            std::lock_guard<std::mutex> lock(save_mutex_);
+            ++pending_saves_;
+            pending_bytes_ += bytes;
         }
-
-        if (saveFormat.saveParams) {
-            // We keep the extension to avoid overwriting the profile when we
-            // have the same output filename with different extension
-            // processing->params.save (removeExtension(fname) +
-            // paramFileExtension);
-            if (batch_profile_ && processing->use_batch_profile) {
-                batch_profile_->applyTo(processing->params);
-            }
-            auto sidecar = fname + ".out" + paramFileExtension;
-            if (!options.params_out_embed) {
-                processing->params.save(this, sidecar);
-            } else if (processing->params.saveEmbedded(this, fname) != 0) {
-                error(Glib::ustring::compose(
-                    M("PROCPARAMS_EMBEDDED_SAVE_WARNING"), fname, sidecar));
-                processing->params.save(this, sidecar);
-            }
+        if (options.batch_queue_max_pending_saves > 0) {
+            rtengine::ThreadPool::add_task(
+                rtengine::ThreadPool::Priority::NORMAL,
+                [this, entry, img, fname, saveFormat, bytes]() -> void {
+                    saveImage(entry, img, fname, saveFormat, bytes);
+                });
+        } else {
+            saveImage(entry, img, fname, saveFormat, bytes);
         }
-
-        if (processing->thumbnail) {
-            processing->thumbnail->imageDeveloped();
-            processing->thumbnail->imageRemovedFromQueue();
+    } else {
+        if (img) {
+            img->free();
         }
+        ::g_remove(entry->savedParamsFile.c_str());
+        delete entry;
     }
 
-    // save temporary params file name: delete as last thing
-    Glib::ustring processedParams = processing->savedParamsFile;
-
-    // delete from the queue
-    bool remove_button_set = false;
-
     {
         MYWRITERLOCK(l, entryRW);
 
-        delete processing;
-        processing = nullptr;
-
-        fd.erase(fd.begin());
-
         // return next job
-        if (!fd.empty() && listener && listener->canStartNext()) {
+        if (!fd.empty() && !save_failed_ && listener &&
+            listener->canStartNext()) {
+            // the other entries on the same file go first, while its image
+            // is still loaded (see updateSharedSource())
+            auto same = std::find_if(
+                fd.begin(), fd.end(), [&](ThumbBrowserEntryBase *e) {
+                    return e->filename == entry_fname;
+                });
+            if (same != fd.end()) {
+                std::rotate(fd.begin(), same, same + 1);
+                journalMove(0, static_cast<BatchQueueEntry *>(fd[0]));
+            }
             BatchQueueEntry *next = static_cast<BatchQueueEntry *>(fd[0]);
             // tag it as selected and set sequence
             next->processing = true;
             next->sequence = ++sequence;
             processing = next;
+            next_bytes = estimate_job_memory(next);
 
             // remove from selection
             if (processing->selected) {
@@ -1086,42 +1493,407 @@ rtengine::ProcessingJob *BatchQueue::imageReady(rtengine::IImagefloat *img)
         processing->removeButtonSet();
     }
 
-    if (saveBatchQueue()) {
-        ::g_remove(processedParams.c_str());
+    updateSharedSource(entry_fname, false);
+    if (processing && processing->filename != entry_fname) {
+        updateSharedSource(processing->filename, false);
+    }
 
-        // Delete all files in directory batch when finished, just to be sure to
-        // remove zombies
-        auto isEmpty = false;
+    if (flushJournal()) {
+        cleanupBatchDir();
+    }
 
-        {
-            MYREADERLOCK(l, entryRW);
-            isEmpty = fd.empty();
+    redraw();
+    notifyListener();
+
+    if (processing) {
+        // don't start the next job while the images still being saved hold
+        // too much memory
+        waitForPendingSaves(options.batch_queue_max_pending_saves, next_bytes);
+        developAhead();
+    }
+
+    return processing ? processing->job : nullptr;
+}
+
+void BatchQueue::updateSharedSource(const Glib::ustring &fname,
+                                    bool started)
+{
+    int uses = 0;
+    {
+        MYREADERLOCK(l, entryRW);
+        // nothing is shared while the queue is stopped
+        if (processing) {
+            for (auto e : fd) {
+                if (e->filename == fname && !(started && e == processing)) {
+                    ++uses;
+                }
+            }
         }
+    }
+    rtengine::setSharedSourceUses(fname, uses);
+}
 
-        if (isEmpty) {
+void BatchQueue::developAhead()
+{
+    const int n = options.fastexport_concurrency - 1;
+    if (n <= 0) {
+        return;
+    }
 
-            const auto batchdir =
-                Glib::build_filename(options.user_config_dir, "batch");
+    size_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(save_mutex_);
+        bytes = pending_bytes_;
+    }
+    const size_t budget = memory_budget();
 
-            try {
+    MYREADERLOCK(l, entryRW);
+    std::lock_guard<std::mutex> lock(ahead_mutex_);
 
-                auto dir = Gio::File::create_for_path(batchdir);
-                auto enumerator = dir->enumerate_children("standard::name");
+    if (processing) {
+        bytes += estimate_job_memory(processing);
+    }
 
-                while (auto file = enumerator->next_file()) {
-                    ::g_remove(Glib::build_filename(batchdir, file->get_name())
-                                   .c_str());
-                }
+    // only the entries right after the one being processed are considered,
+    // so that the results don't pile up waiting for a slow job. The number
+    // of jobs running at the same time is further limited by the memory
+    // they are expected to need
+    for (size_t i = 1; i < fd.size() && i <= size_t(n) &&
+                       ahead_.size() < size_t(n);
+         ++i) {
+        auto entry = static_cast<BatchQueueEntry *>(fd[i]);
+        if (!entry->fast_pipeline) {
+            continue;
+        }
+        // the entries on the file of a running job wait for it, to reuse
+        // its image (see updateSharedSource())
+        if (!ahead_.count(entry)) {
+            bool same_file =
+                processing && processing->filename == entry->filename;
+            for (auto &a : ahead_) {
+                same_file = same_file || a.first->filename == entry->filename;
+            }
+            if (same_file) {
+                continue;
+            }
+        }
+        const size_t entry_bytes = estimate_job_memory(entry);
+        if (ahead_.count(entry)) {
+            bytes += entry_bytes;
+            continue;
+        }
+        if (bytes + entry_bytes > budget) {
+            break;
+        }
+        bytes += entry_bytes;
+
+        auto job = entry->job;
+        ahead_[entry] = rtengine::ThreadPool::add_task(
+            rtengine::ThreadPool::Priority::NORMAL,
+            [this, job]() -> DevelopedImage {
+                DevelopedImage ret;
+                ret.errorCode = 0;
+                ret.img = rtengine::processBatchJob(job, this, ret.errorCode,
+                                                    &ret.timings);
+                return ret;
+            });
+    }
+}
+
+bool BatchQueue::getDevelopedImage(rtengine::ProcessingJob *job,
+                                   rtengine::IImagefloat *&img,
+                                   int &errorCode)
+{
+    std::future<DevelopedImage> f;
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex_);
+        if (!processing || processing->job != job) {
+            return false;
+        }
+        auto it = ahead_.find(processing);
+        if (it == ahead_.end()) {
+            return false;
+        }
+        f = std::move(it->second);
+        ahead_.erase(it);
+    }
 
-            } catch (Glib::Exception &) {
+    rtengine::ThreadPool::wait(f);
+    auto res = f.get();
+    img = res.img;
+    errorCode = res.errorCode;
+    processing->timings = res.timings;
+    return true;
+}
+
+void BatchQueue::jobTimings(const rtengine::ProcessingTimings &timings)
+{
+    if (processing) {
+        processing->timings = timings;
+    }
+}
+
+void BatchQueue::recordJob(const BatchQueueEntry *entry, double save_time)
+{
+    double mp = double(entry->timings.width) * entry->timings.height / 1e6;
+    if (mp <= 0 && entry->thumbnail) {
+        int w = 0, h = 0;
+        entry->thumbnail->getOriginalSize(w, h);
+        mp = double(w) * h / 1e6;
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.done;
+    stats_megapixels_ += mp;
+    stats_.last_file = entry->filename;
+    stats_.last_timings = entry->timings;
+    stats_.last_save = save_time;
+
+    if (options.rtSettings.verbose) {
+        const auto &t = entry->timings;
+        std::cout << "Batch job " << entry->filename << ": " << t.total
+                  << " s (load " << t.load << ", preprocess " << t.preprocess
+                  << ", demosaic " << t.demosaic << ", pipeline "
+                  << t.pipeline << ", output " << t.output << "), save "
+                  << save_time << " s" << std::endl;
+    }
+}
+
+BatchQueueStats BatchQueue::getStats()
+{
+    // the megapixels of the jobs still to do, and how many of them have an
+    // unknown size
+    double todo_mp = 0;
+    int todo_unknown = 0;
+    {
+        MYREADERLOCK(l, entryRW);
+        for (auto e : fd) {
+            int w = 0, h = 0;
+            if (e->thumbnail) {
+                e->thumbnail->getOriginalSize(w, h);
+            }
+            if (w > 0 && h > 0) {
+                todo_mp += double(w) * h / 1e6;
+            } else {
+                ++todo_unknown;
             }
         }
     }
 
-    redraw();
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    BatchQueueStats ret = stats_;
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - stats_start_)
+                               .count();
+    if (ret.done > 0 && elapsed > 0) {
+        ret.images_per_minute = ret.done * 60.0 / elapsed;
+        ret.megapixels_per_second = stats_megapixels_ / elapsed;
+        const double per_image = elapsed / ret.done;
+        if (stats_megapixels_ > 0) {
+            ret.eta = todo_mp * elapsed / stats_megapixels_ +
+                      todo_unknown * per_image;
+        } else {
+            ret.eta = (todo_unknown + (todo_mp > 0 ? 1 : 0)) * per_image;
+        }
+    }
+    return ret;
+}
+
+bool BatchQueue::discardDevelopedAhead(BatchQueueEntry *entry)
+{
+    std::future<DevelopedImage> f;
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex_);
+        auto it = ahead_.find(entry);
+        if (it == ahead_.end()) {
+            return false;
+        }
+        f = std::move(it->second);
+        ahead_.erase(it);
+    }
+
+    rtengine::ThreadPool::wait(f);
+    auto res = f.get();
+    if (res.img) {
+        res.img->free();
+    }
+    return true;
+}
+
+void BatchQueue::saveImage(BatchQueueEntry *entry, rtengine::IImagefloat *img,
+                           const Glib::ustring &fname,
+                           const SaveFormat &saveFormat, size_t bytes)
+{
+    SaveProgressListener pl;
+    Glib::ustring err_msg;
+    const auto save_start = std::chrono::steady_clock::now();
+
+    try {
+        int err = 0;
+
+        img->setSaveProgressListener(&pl);
+
+        if (saveFormat.format == "tif") {
+            err = img->saveAsTIFF(fname, saveFormat.tiffBits,
+                                  saveFormat.tiffFloat,
+                                  saveFormat.tiffUncompressed);
+        } else if (saveFormat.format == "png") {
+            err = img->saveAsPNG(fname, saveFormat.pngBits);
+        } else if (saveFormat.format == "jpg") {
+            err = img->saveAsJPEG(fname, saveFormat.jpegQuality,
+                                  saveFormat.jpegSubSamp);
+        } else {
+            err = rtengine::ImageIOManager::getInstance()->save(
+                      img, saveFormat.format, fname, &pl)
+                      ? 0
+                      : 1;
+        }
+
+        if (err) {
+            err_msg = M("MAIN_MSG_CANNOTSAVE") + ": " + fname;
+        }
+    } catch (Glib::Exception &ex) {
+        err_msg = ex.what();
+    }
+
+    img->free();
+
+    if (err_msg.empty()) {
+        if (saveFormat.saveParams) {
+            // We keep the extension to avoid overwriting the profile when we
+            // have the same output filename with different extension
+            // processing->params.save (removeExtension(fname) +
+            // paramFileExtension);
+            if (batch_profile_ && entry->use_batch_profile) {
+                batch_profile_->applyTo(entry->params);
+            }
+            auto sidecar = fname + ".out" + paramFileExtension;
+            if (!options.params_out_embed) {
+                entry->params.save(&pl, sidecar);
+            } else if (entry->params.saveEmbedded(&pl, fname) != 0) {
+                pl.error(Glib::ustring::compose(
+                    M("PROCPARAMS_EMBEDDED_SAVE_WARNING"), fname, sidecar));
+                entry->params.save(&pl, sidecar);
+            }
+        }
+
+        if (entry->thumbnail) {
+            entry->thumbnail->imageDeveloped();
+            entry->thumbnail->imageRemovedFromQueue();
+        }
+
+        recordJob(entry, std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - save_start)
+                             .count());
+
+        // the temporary params file is deleted as last thing
+        ::g_remove(entry->savedParamsFile.c_str());
+        delete entry;
+    } else {
+        // put the failed entry back in the queue (after the one being
+        // processed, if any), and don't start new jobs
+        BatchQueueButtonSet *bqbs = new BatchQueueButtonSet(entry);
+        bqbs->setButtonListener(this);
+        entry->addButtonSet(bqbs);
+        entry->job = rtengine::ProcessingJob::create(
+            entry->filename, entry->thumbnail->getType() == FT_Raw,
+            entry->params);
+        {
+            MYWRITERLOCK(l, entryRW);
+            const bool busy = !fd.empty() && fd[0] == processing;
+            fd.insert(fd.begin() + (busy ? 1 : 0), entry);
+            journalInsert(busy ? 1 : 0, entry);
+        }
+        save_failed_ = true;
+        flushJournal();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(save_mutex_);
+        --pending_saves_;
+        pending_bytes_ -= bytes;
+    }
+    save_cond_.notify_all();
+
+    for (auto &msg : pl.messages) {
+        notifyError(msg);
+    }
+    if (!err_msg.empty()) {
+        notifyError(err_msg);
+    }
+
+    cleanupBatchDir();
     notifyListener();
 
-    return processing ? processing->job : nullptr;
+    // this might run in the background, so don't acquire the GUI here
+    idle_register.add([this]() -> bool {
+        redraw();
+        return false;
+    });
+}
+
+void BatchQueue::waitForPendingSaves(int max_pending, size_t next_bytes)
+{
+    const size_t budget = memory_budget();
+    std::unique_lock<std::mutex> lock(save_mutex_);
+
+    const auto ready = [&]() -> bool {
+        return pending_saves_ == 0 ||
+               (pending_saves_ < max_pending &&
+                pending_bytes_ + next_bytes <= budget);
+    };
+
+    while (!ready()) {
+        if (rtengine::ThreadPool::is_worker()) {
+            // help the pool (possibly running the saves themselves) instead
+            // of blocking a worker
+            lock.unlock();
+            rtengine::ThreadPool::run_pending();
+            lock.lock();
+        } else {
+            save_cond_.wait(lock);
+        }
+    }
+}
+
+bool BatchQueue::hasPendingSaves()
+{
+    std::lock_guard<std::mutex> lock(save_mutex_);
+    return pending_saves_ > 0;
+}
+
+// Delete all files in directory batch when finished, just to be sure to
+// remove zombies
+void BatchQueue::cleanupBatchDir()
+{
+    {
+        MYREADERLOCK(l, entryRW);
+        if (!fd.empty() || processing) {
+            return;
+        }
+    }
+    if (hasPendingSaves()) {
+        return;
+    }
+
+    const auto batchdir =
+        Glib::build_filename(options.user_config_dir, "batch");
+
+    // the queue file and its journal are removed too
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    journal_records_ = 0;
+
+    try {
+
+        auto dir = Gio::File::create_for_path(batchdir);
+        auto enumerator = dir->enumerate_children("standard::name");
+
+        while (auto file = enumerator->next_file()) {
+            ::g_remove(Glib::build_filename(batchdir, file->get_name()).c_str());
+        }
+
+    } catch (Glib::Exception &) {
+    }
 }
 
 Glib::ustring BatchQueue::autoCompleteFileName(const Glib::ustring &fileName,
@@ -1194,7 +1966,7 @@ void BatchQueue::buttonPressed(LWButton *button, int actionCode,
 
 void BatchQueue::notifyListener()
 {
-    const bool queueRunning = processing;
+    const bool queueRunning = processing || hasPendingSaves();
     if (listener) {
         BatchQueueListener *const bql = listener;
 
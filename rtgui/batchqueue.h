@@ -19,7 +19,13 @@
 #ifndef _BATCHQUEUE_
 #define _BATCHQUEUE_
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
 #include <set>
+#include <string>
 
 #include <gtkmm.h>
 
@@ -42,6 +48,25 @@ public:
 
 class FileCatalog;
 
+// Throughput of the batch queue since it was last started, and cost
+// breakdown of the last job completed (see BatchQueue::getStats())
+class BatchQueueStats {
+public:
+    BatchQueueStats()
+        : done(0), images_per_minute(0), megapixels_per_second(0), eta(-1),
+          last_save(0)
+    {
+    }
+
+    int done;
+    double images_per_minute;
+    double megapixels_per_second;
+    double eta; // seconds to process the rest of the queue, -1 if unknown
+    Glib::ustring last_file;
+    rtengine::ProcessingTimings last_timings;
+    double last_save; // seconds
+};
+
 class BatchQueue final: public ThumbBrowserBase,
                         public rtengine::BatchProcessingListener,
                         public LWButtonListener {
@@ -76,6 +101,15 @@ public:
     void setProgressState(bool inProcessing) override;
     void error(const Glib::ustring &descr) override;
     rtengine::ProcessingJob *imageReady(rtengine::IImagefloat *img) override;
+    bool getDevelopedImage(rtengine::ProcessingJob *job,
+                           rtengine::IImagefloat *&img,
+                           int &errorCode) override;
+    void jobTimings(const rtengine::ProcessingTimings &timings) override;
+
+    // the ETA is extrapolated from the time per megapixel of the jobs
+    // completed so far (wall time, so it accounts for the jobs developed
+    // ahead and the background saves)
+    BatchQueueStats getStats();
 
     void rightClicked(ThumbBrowserEntryBase *entry) override;
     void doubleClicked(ThumbBrowserEntryBase *entry) override;
@@ -106,8 +140,60 @@ private:
     Glib::ustring autoCompleteFileName(const Glib::ustring &fileName,
                                        const Glib::ustring &format);
     Glib::ustring getTempFilenameForParams(const Glib::ustring &filename);
+    // rewrites the whole queue file (see also flushJournal())
     bool saveBatchQueue();
+    bool writeQueueFile();
+    // The changes to fd are recorded (while holding the lock on entryRW, so
+    // that they are in the same order) with the journal*() functions, and
+    // appended to the journal of the queue file by flushJournal(), which
+    // must be called without holding the lock. When the journal grows
+    // larger than the queue, the queue file is rewritten instead
+    void journalInsert(size_t index, const BatchQueueEntry *entry);
+    void journalRemove(const BatchQueueEntry *entry);
+    void journalMove(size_t index, const BatchQueueEntry *entry);
+    bool flushJournal();
     void notifyListener();
+    void notifyError(const Glib::ustring &descr);
+
+    // Saving of the developed images (encoding, metadata and sidecar
+    // writing) is done in the background, overlapping with the processing of
+    // the following jobs, within the limits set by the memory governor (see
+    // Options::batch_queue_max_pending_saves and
+    // Options::batch_queue_memory_limit)
+    void saveImage(BatchQueueEntry *entry, rtengine::IImagefloat *img,
+                   const Glib::ustring &fname, const SaveFormat &saveFormat,
+                   size_t bytes);
+    // waits until less than max_pending saves are in flight, and the memory
+    // they hold leaves room for next_bytes more
+    void waitForPendingSaves(int max_pending, size_t next_bytes);
+    bool hasPendingSaves();
+    void cleanupBatchDir();
+    // adds a saved job to the statistics
+    void recordJob(const BatchQueueEntry *entry, double save_time);
+
+    // Fast export jobs following the one being processed are developed
+    // ahead of their turn, so that up to Options::fastexport_concurrency of
+    // them are processed at the same time (as long as their estimated memory
+    // fits in the budget of the governor). Their results are handed over to
+    // the engine by getDevelopedImage() when their turn comes
+    struct DevelopedImage {
+        rtengine::IImagefloat *img;
+        int errorCode;
+        rtengine::ProcessingTimings timings;
+    };
+    void developAhead();
+    // waits for the entry to be developed (if it was started ahead) and
+    // drops the result. Returns true if it was, i.e. if its job has already
+    // been consumed
+    bool discardDevelopedAhead(BatchQueueEntry *entry);
+
+    // The entries on the same raw file (e.g. with different processing
+    // profiles) are processed one after the other, so that they can share
+    // the image loaded and demosaiced by the first of them (see
+    // rtengine::setSharedSourceUses()). This tells the engine how many of
+    // the queued entries on fname have still to start; started tells
+    // whether the job of the entry being processed is already running
+    void updateSharedSource(const Glib::ustring &fname, bool started);
 
     using ThumbBrowserBase::redrawEntryNeeded;
 
@@ -135,6 +221,28 @@ private:
     const rtengine::procparams::PartialProfile *batch_profile_;
 
     std::unordered_map<std::string, std::string> format2ext_;
+
+    // serializes the writes of the queue file and of its journal
+    std::mutex journal_mutex_;
+    size_t journal_records_;
+    // records not yet written to the journal
+    std::mutex journal_pending_mutex_;
+    std::string journal_pending_;
+    size_t journal_pending_records_;
+
+    std::mutex save_mutex_;
+    std::condition_variable save_cond_;
+    int pending_saves_;
+    size_t pending_bytes_;
+    std::atomic<bool> save_failed_;
+
+    std::mutex ahead_mutex_;
+    std::map<BatchQueueEntry *, std::future<DevelopedImage>> ahead_;
+
+    std::mutex stats_mutex_;
+    std::chrono::steady_clock::time_point stats_start_;
+    double stats_megapixels_;
+    BatchQueueStats stats_;
 };
 
 #endif
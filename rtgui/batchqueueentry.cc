@@ -92,8 +92,17 @@ BatchQueueEntry::~BatchQueueEntry()
 
 void BatchQueueEntry::refreshThumbnailImage()
 {
-    batchQueueEntryUpdater.process(nullptr, origpw, origph, preh, this, &params,
-                                   thumbnail);
+    // the file browser has usually rendered the same image already, in
+    // which case it is only resized instead of being processed again
+    int w, h;
+    guint8 *img =
+        thumbnail ? thumbnail->getRenderedImage(params, preh, w, h) : nullptr;
+    if (img) {
+        batchQueueEntryUpdater.process(img, w, h, preh, this);
+    } else {
+        batchQueueEntryUpdater.process(nullptr, origpw, origph, preh, this,
+                                       &params, thumbnail);
+    }
 }
 
 void BatchQueueEntry::calcThumbnailSize()
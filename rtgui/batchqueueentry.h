@@ -48,6 +48,7 @@ public:
     rtengine::ProcessingJob *job;
     rtengine::procparams::ProcParams params;
     Glib::ustring savedParamsFile;
+    std::string savedParamsData; // binary copy of savedParamsFile
     double progress;
     Glib::ustring outFileName;
     int sequence;
@@ -55,6 +56,7 @@ public:
     bool forceFormatOpts;
     bool fast_pipeline;
     bool use_batch_profile;
+    rtengine::ProcessingTimings timings; // filled when the job is processed
 
     BatchQueueEntry(rtengine::ProcessingJob *job,
                     const rtengine::procparams::ProcParams &pparams,
@@ -23,6 +23,8 @@
 #include "rtimage.h"
 #include "rtwindow.h"
 #include "soundman.h"
+#include <algorithm>
+#include <iomanip>
 
 static Glib::ustring makeFolderLabel(Glib::ustring path)
 {
@@ -189,6 +191,9 @@ BatchQueuePanel::BatchQueuePanel(FileCatalog *aFileCatalog): parent(nullptr)
     bottomBox = Gtk::manage(new Gtk::HBox());
     pack_start(*bottomBox, Gtk::PACK_SHRINK);
 
+    stats_label_ = Gtk::manage(new Gtk::Label());
+    bottomBox->pack_start(*stats_label_, Gtk::PACK_SHRINK, 4);
+
     // thumbnail zoom
     Gtk::HBox *zoomBox = Gtk::manage(new Gtk::HBox());
     zoomBox->pack_start(*Gtk::manage(new Gtk::VSeparator), Gtk::PACK_SHRINK, 4);
@@ -314,6 +319,7 @@ void BatchQueuePanel::queueSizeChanged(int qsize, bool queueRunning,
                                        const Glib::ustring &queueErrorMessage)
 {
     setGuiFromBatchState(queueRunning, qsize);
+    updateStats();
 
     if (!queueRunning && qsize == 0 && queueShouldRun) {
         // There was work, but it is all done now.
@@ -329,6 +335,76 @@ void BatchQueuePanel::queueSizeChanged(int qsize, bool queueRunning,
     }
 }
 
+namespace {
+
+Glib::ustring format_seconds(double s)
+{
+    return Glib::ustring::format(std::fixed, std::setprecision(2), s) + " s";
+}
+
+Glib::ustring format_eta(double s)
+{
+    const int t = int(s + 0.5);
+    return Glib::ustring::compose(
+        "%1:%2:%3", t / 3600,
+        Glib::ustring::format(std::setfill(L'0'), std::setw(2),
+                              (t / 60) % 60),
+        Glib::ustring::format(std::setfill(L'0'), std::setw(2), t % 60));
+}
+
+} // namespace
+
+void BatchQueuePanel::updateStats()
+{
+    const BatchQueueStats st = batchQueue->getStats();
+    if (st.done == 0) {
+        stats_label_->set_text("");
+        stats_label_->set_tooltip_markup("");
+        return;
+    }
+
+    stats_label_->set_text(Glib::ustring::compose(
+        M("QUEUE_STATS"),
+        Glib::ustring::format(std::fixed, std::setprecision(1),
+                              st.images_per_minute),
+        Glib::ustring::format(std::fixed, std::setprecision(1),
+                              st.megapixels_per_second),
+        st.eta >= 0 ? format_eta(st.eta) : Glib::ustring("-")));
+
+    const auto &t = st.last_timings;
+    Glib::ustring tip = Glib::ustring::compose(
+        "%1
+<b>%2</b>
+", M("QUEUE_STATS_TOOLTIP"),
+        Glib::Markup::escape_text(Glib::path_get_basename(st.last_file)));
+    const auto line = [&](const char *key, double s) -> void {
+        tip += Glib::ustring::compose("%1: %2
+", M(key), format_seconds(s));
+    };
+    line("QUEUE_STATS_LOAD", t.load);
+    line("QUEUE_STATS_PREPROCESS", t.preprocess);
+    line("QUEUE_STATS_DEMOSAIC", t.demosaic);
+    line("QUEUE_STATS_PIPELINE", t.pipeline);
+
+    // the most expensive operators
+    auto ops = t.operators;
+    std::sort(ops.begin(), ops.end(),
+              [](const std::pair<std::string, double> &a,
+                 const std::pair<std::string, double> &b) {
+                  return a.second > b.second;
+              });
+    constexpr size_t max_ops = 8;
+    for (size_t i = 0; i < ops.size() && i < max_ops; ++i) {
+        tip += Glib::ustring::compose("    %1: %2
+", ops[i].first,
+                                      format_seconds(ops[i].second));
+    }
+
+    line("QUEUE_STATS_OUTPUT", t.output);
+    line("QUEUE_STATS_SAVE", st.last_save);
+    stats_label_->set_tooltip_markup(tip.substr(0, tip.size() - 1));
+}
+
 void BatchQueuePanel::startOrStopBatchProc()
 {
     if (qStartStop->get_state()) {
@@ -53,6 +53,7 @@ class BatchQueuePanel: public Gtk::VBox,
     BatchQueue *batchQueue;
     Gtk::HBox *bottomBox;
     Gtk::HBox *topBox;
+    Gtk::Label *stats_label_;
 
     Gtk::CheckButton *apply_batch_profile_;
     ProfileStoreComboBox *profiles_cb_;
@@ -61,6 +62,9 @@ class BatchQueuePanel: public Gtk::VBox,
 
     std::atomic<bool> queueShouldRun;
 
+    // shows the throughput and ETA of the queue, and the cost of the last job
+    void updateStats();
+
     IdleRegister idle_register;
 
 public:
@@ -17,13 +17,13 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "bqentryupdater.h"
-#include "../rtengine/threadpool.h"
+#include "../rtengine/taskgraph.h"
 #include "guiutils.h"
 #include <gtkmm.h>
 
 BatchQueueEntryUpdater batchQueueEntryUpdater;
 
-BatchQueueEntryUpdater::BatchQueueEntryUpdater(): tostop_(false), stopped_(true)
+BatchQueueEntryUpdater::BatchQueueEntryUpdater(): stopped_(true)
 {
 }
 
@@ -69,19 +69,21 @@ void BatchQueueEntryUpdater::process(guint8 *oimg, int ow, int oh, int newh,
     // Start thread if not running yet
     if (stopped_) {
         stopped_ = false;
-        tostop_ = false;
+        stop_token_.reset();
 
+        const rtengine::CancellationToken token = stop_token_;
         stopped_future_ = rtengine::ThreadPool::add_task(
             rtengine::ThreadPool::Priority::NORMAL,
-            sigc::mem_fun(*this, &BatchQueueEntryUpdater::process_thread));
+            [this, token]() -> bool { return process_thread(token); });
     }
 }
 
-bool BatchQueueEntryUpdater::process_thread()
+bool BatchQueueEntryUpdater::process_thread(
+    const rtengine::CancellationToken &token)
 {
     bool is_empty = false;
 
-    while (!tostop_ && !is_empty) {
+    while (!token && !is_empty) {
         Job current;
         {
             std::unique_lock<std::mutex> lock(job_queue_mutex_);
@@ -123,7 +125,7 @@ bool BatchQueueEntryUpdater::process_thread()
             }
         }
 
-        if (current.oimg && !is_empty && current.listener) {
+        if (current.oimg && !is_empty && current.listener && !token) {
             int neww = current.newh * current.ow / current.oh;
             guint8 *img = new guint8[current.newh * neww * 3];
             thumbInterp(current.oimg, current.ow, current.oh, img, neww,
@@ -168,7 +170,7 @@ void BatchQueueEntryUpdater::terminate()
         return;
     }
 
-    tostop_ = true;
+    stop_token_.cancel();
     stopped_ = stopped_future_.get();
 
     // Remove remaining jobs
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "../rtengine/rtengine.h"
+#include "../rtengine/taskgraph.h"
 #include "threadutils.h"
 #include "thumbnail.h"
 #include <glibmm.h>
@@ -57,9 +58,9 @@ public:
     void terminate();
 
 private:
-    bool process_thread();
+    bool process_thread(const rtengine::CancellationToken &token);
 
-    std::atomic<bool> tostop_;
+    rtengine::CancellationToken stop_token_;
     bool stopped_;
     std::future<bool> stopped_future_;
     std::list<Job> jqueue_;
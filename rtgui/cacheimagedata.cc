@@ -19,11 +19,194 @@
  */
 #include "cacheimagedata.h"
 #include "version.h"
-#include <glib/gstdio.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <locale.h>
 #include <unordered_map>
 #include <vector>
 
+namespace {
+
+/******************************************************************************
+ * binary format of the values, followed by the KeyFile text of the other
+ * sections of the record (see getExtraData()). All the numbers are little
+ * endian:
+ *
+ * header:
+ *   "ARTI"
+ *   version (uint16)
+ *   size of the fixed part (uint16), newer versions can only make it larger
+ *   size of header, fixed part and strings (uint32)
+ *   reserved (uint32)
+ * fixed part:
+ *   flags (uint8): supported, recentlySaved, timeValid, exifValid, isHDR,
+ *                  isPixelShift
+ *   format (int8)
+ *   month, day, hour, min, sec (uint8), padding (uint8)
+ *   year (int16), frameCount (uint16)
+ *   iso (uint32)
+ *   fnumber, shutter, focalLen, focalLen35mm (float64)
+ *   focusDist (float32)
+ *   sensortype, sampleFormat, rating, colorLabel, thumbImgType, width,
+ *   height (int32)
+ *   timestamp (int64)
+ * strings, each one as length (uint16) and UTF-8 bytes:
+ *   md5, version, expcomp, lens, orientation, camMake, camModel, filetype
+ ******************************************************************************/
+constexpr char BINARY_MAGIC[] = "ARTI";
+constexpr unsigned int BINARY_VERSION = 1;
+constexpr size_t BINARY_HEADER_SIZE = 16;
+constexpr size_t BINARY_FIXED_SIZE = 88;
+
+class BinaryWriter {
+public:
+    void bytes(const char *b, size_t n) { buf_.append(b, n); }
+    void u8(uint8_t v) { buf_.push_back(char(v)); }
+
+    void u16(uint16_t v)
+    {
+        u8(v & 0xff);
+        u8(v >> 8);
+    }
+
+    void u32(uint32_t v)
+    {
+        u16(v & 0xffff);
+        u16(v >> 16);
+    }
+
+    void u64(uint64_t v)
+    {
+        u32(v & 0xffffffff);
+        u32(v >> 32);
+    }
+
+    void f32(float v)
+    {
+        uint32_t u;
+        memcpy(&u, &v, sizeof(u));
+        u32(u);
+    }
+
+    void f64(double v)
+    {
+        uint64_t u;
+        memcpy(&u, &v, sizeof(u));
+        u64(u);
+    }
+
+    void str(const Glib::ustring &s)
+    {
+        const size_t n = std::min(s.bytes(), size_t(0xffff));
+        u16(n);
+        bytes(s.c_str(), n);
+    }
+
+    void set_u32(size_t pos, uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i) {
+            buf_[pos + i] = char((v >> (8 * i)) & 0xff);
+        }
+    }
+
+    size_t size() const { return buf_.size(); }
+    const std::string &data() const { return buf_; }
+
+private:
+    std::string buf_;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(const std::string &data)
+        : data_(data), pos_(0), ok_(true)
+    {
+    }
+
+    void skip(size_t n) { seek(pos_ + n); }
+
+    void seek(size_t pos)
+    {
+        pos_ = pos;
+        ok_ = ok_ && pos_ <= data_.size();
+    }
+
+    uint8_t u8()
+    {
+        if (pos_ >= data_.size()) {
+            ok_ = false;
+            return 0;
+        }
+        return uint8_t(data_[pos_++]);
+    }
+
+    uint16_t u16()
+    {
+        const uint16_t lo = u8();
+        return lo | (uint16_t(u8()) << 8);
+    }
+
+    uint32_t u32()
+    {
+        const uint32_t lo = u16();
+        return lo | (uint32_t(u16()) << 16);
+    }
+
+    uint64_t u64()
+    {
+        const uint64_t lo = u32();
+        return lo | (uint64_t(u32()) << 32);
+    }
+
+    float f32()
+    {
+        const uint32_t u = u32();
+        float v;
+        memcpy(&v, &u, sizeof(v));
+        return v;
+    }
+
+    double f64()
+    {
+        const uint64_t u = u64();
+        double v;
+        memcpy(&v, &u, sizeof(v));
+        return v;
+    }
+
+    Glib::ustring str()
+    {
+        const size_t n = u16();
+        if (!ok_ || pos_ + n > data_.size()) {
+            ok_ = false;
+            return "";
+        }
+        Glib::ustring res(data_.substr(pos_, n));
+        pos_ += n;
+        return res;
+    }
+
+    size_t pos() const { return pos_; }
+    bool ok() const { return ok_; }
+
+private:
+    const std::string &data_;
+    size_t pos_;
+    bool ok_;
+};
+
+// size of the binary part of the record
+size_t binary_size(const std::string &data)
+{
+    BinaryReader r(data);
+    r.skip(8);
+    const size_t size = r.u32();
+    return r.ok() ? std::min(size, data.size()) : data.size();
+}
+
+} // namespace
+
 CacheImageData::CacheImageData()
     : md5(""), supported(false), format(FT_Invalid), recentlySaved(false),
       timeValid(false), year(0), month(0), day(0), hour(0), min(0), sec(0),
@@ -36,18 +219,125 @@ CacheImageData::CacheImageData()
 {
 }
 
+bool CacheImageData::isBinary(const std::string &data)
+{
+    return data.size() >= BINARY_HEADER_SIZE &&
+           data.compare(0, 4, BINARY_MAGIC) == 0;
+}
+
+std::string CacheImageData::getExtraData(const std::string &data)
+{
+    return isBinary(data) ? data.substr(binary_size(data)) : data;
+}
+
+void CacheImageData::setExtraData(std::string &data, const std::string &extra)
+{
+    if (isBinary(data)) {
+        data.resize(binary_size(data));
+        data += extra;
+    } else {
+        data = extra;
+    }
+}
+
+int CacheImageData::loadData(const std::string &data)
+{
+    if (isBinary(data)) {
+        return loadBinary(data);
+    }
+    return loadKeyFile(data);
+}
+
+/*
+ * Load the values from the binary part of the record, by reading the fields
+ * at their fixed offsets
+ */
+int CacheImageData::loadBinary(const std::string &data)
+{
+    BinaryReader r(data);
+    r.skip(4);
+    const unsigned int ver = r.u16();
+    const size_t fixed_size = r.u16();
+    const size_t size = r.u32();
+    r.skip(4);
+    if (ver != BINARY_VERSION || fixed_size < BINARY_FIXED_SIZE ||
+        size > data.size() || BINARY_HEADER_SIZE + fixed_size > size) {
+        return 1;
+    }
+
+    const unsigned int flags = r.u8();
+    supported = flags & 1;
+    recentlySaved = flags & 2;
+    timeValid = flags & 4;
+    exifValid = flags & 8;
+    format = ThFileType(int8_t(r.u8()));
+    month = r.u8();
+    day = r.u8();
+    hour = r.u8();
+    min = r.u8();
+    sec = r.u8();
+    r.skip(1);
+    year = int16_t(r.u16());
+    frameCount = r.u16();
+
+    if (exifValid) {
+        iso = r.u32();
+        fnumber = r.f64();
+        shutter = r.f64();
+        focalLen = r.f64();
+        focalLen35mm = r.f64();
+        focusDist = r.f32();
+        isHDR = flags & 16;
+        isPixelShift = flags & 32;
+    } else {
+        r.skip(4 + 4 * 8 + 4);
+    }
+
+    const int sensor = int32_t(r.u32());
+    sampleFormat = rtengine::IIO_Sample_Format(int32_t(r.u32()));
+    const int rt = int32_t(r.u32());
+    const int cl = int32_t(r.u32());
+    if (exifValid) {
+        rating = rt;
+        colorLabel = cl;
+    }
+    const int thumb_type = int32_t(r.u32());
+    width = int32_t(r.u32());
+    height = int32_t(r.u32());
+    const time_t ts = time_t(int64_t(r.u64()));
+    if (timeValid) {
+        timestamp = ts;
+    }
+
+    if (format == FT_Raw) {
+        thumbImgType = thumb_type;
+        sensortype = sensor;
+    } else {
+        rotate = 0;
+        thumbImgType = 0;
+    }
+
+    r.seek(BINARY_HEADER_SIZE + fixed_size);
+    for (auto str : {&md5, &version, &expcomp, &lens, &orientation, &camMake,
+                     &camModel, &filetype}) {
+        *str = r.str();
+    }
+
+    return r.ok() && r.pos() <= size ? 0 : 1;
+}
+
 /*
  * Load the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of
- * the image data file
+ * the KeyFile records written by older versions
  */
-int CacheImageData::load(const Glib::ustring &fname)
+int CacheImageData::loadKeyFile(const std::string &data)
 {
     setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
 
     Glib::KeyFile keyFile;
 
     try {
-        if (keyFile.load_from_file(fname)) {
+        if (!data.empty() && keyFile.load_from_data(data)) {
 
             if (keyFile.has_group("General")) {
                 if (keyFile.has_key("General", "MD5")) {
@@ -228,15 +518,14 @@ int CacheImageData::load(const Glib::ustring &fname)
         }
     } catch (Glib::Error &err) {
         if (options.rtSettings.verbose) {
-            printf("CacheImageData::load / Error code %d while reading values "
-                   "from \"%s\":\n%s\n",
-                   err.code(), fname.c_str(), err.what().c_str());
+            printf("CacheImageData::loadKeyFile / Error code %d while reading "
+                   "values:\n%s\n",
+                   err.code(), err.what().c_str());
         }
     } catch (...) {
         if (options.rtSettings.verbose) {
-            printf("CacheImageData::load / Unknown exception while trying to "
-                   "load \"%s\"!\n",
-                   fname.c_str());
+            printf("CacheImageData::loadKeyFile / Unknown exception while "
+                   "trying to load the data!\n");
         }
     }
 
@@ -244,113 +533,75 @@ int CacheImageData::load(const Glib::ustring &fname)
 }
 
 /*
- * Save the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of
- * the image data file
+ * Save the General, DateTime, ExifInfo, File info and ExtraRawInfo values in
+ * the binary format, keeping the other sections found in data
  */
-int CacheImageData::save(const Glib::ustring &fname)
+int CacheImageData::saveData(std::string &data)
 {
+    version = RTVERSION;
 
-    Glib::ustring keyData;
-
-    try {
-
-        Glib::KeyFile keyFile;
-
+    std::string extra = getExtraData(data);
+    if (!isBinary(data) && !extra.empty()) {
+        // record of an older version: drop the sections that are now in the
+        // binary part
         try {
-            keyFile.load_from_file(fname);
+            Glib::KeyFile keyFile;
+            keyFile.load_from_data(extra);
+            for (auto g : {"General", "DateTime", "ExifInfo", "FileInfo",
+                           "ExtraRawInfo"}) {
+                if (keyFile.has_group(g)) {
+                    keyFile.remove_group(g);
+                }
+            }
+            extra = keyFile.to_data();
         } catch (Glib::Error &) {
-        }
-
-        keyFile.set_string("General", "MD5", md5);
-        keyFile.set_string("General", "Version", RTVERSION);
-        keyFile.set_boolean("General", "Supported", supported);
-        keyFile.set_integer("General", "Format", format);
-        keyFile.set_boolean("General", "RecentlySaved", recentlySaved);
-
-        // remove the old implementation of Rank and InTrash from cache
-        if (keyFile.has_key("General", "Rank")) {
-            keyFile.remove_key("General", "Rank");
-        }
-
-        if (keyFile.has_key("General", "InTrash")) {
-            keyFile.remove_key("General", "InTrash");
-        }
-
-        if (timeValid) {
-            keyFile.set_integer("DateTime", "Year", year);
-            keyFile.set_integer("DateTime", "Month", month);
-            keyFile.set_integer("DateTime", "Day", day);
-            keyFile.set_integer("DateTime", "Hour", hour);
-            keyFile.set_integer("DateTime", "Min", min);
-            keyFile.set_integer("DateTime", "Sec", sec);
-        }
-
-        keyFile.set_boolean("ExifInfo", "Valid", exifValid);
-
-        if (exifValid) {
-            keyFile.set_double("ExifInfo", "FNumber", fnumber);
-            keyFile.set_double("ExifInfo", "Shutter", shutter);
-            keyFile.set_double("ExifInfo", "FocalLen", focalLen);
-            keyFile.set_double("ExifInfo", "FocalLen35mm", focalLen35mm);
-            keyFile.set_double("ExifInfo", "FocusDist", focusDist);
-            keyFile.set_integer("ExifInfo", "ISO", iso);
-            keyFile.set_boolean("ExifInfo", "IsHDR", isHDR);
-            keyFile.set_boolean("ExifInfo", "IsPixelShift", isPixelShift);
-            keyFile.set_string("ExifInfo", "ExpComp", expcomp);
-            keyFile.set_integer("ExifInfo", "Rating", rating);
-            keyFile.set_integer("ExifInfo", "ColorLabel", colorLabel);
-        }
-
-        keyFile.set_string("ExifInfo", "Lens", lens);
-        keyFile.set_string("ExifInfo", "Orientation", orientation);
-        keyFile.set_string("ExifInfo", "CameraMake", camMake);
-        keyFile.set_string("ExifInfo", "CameraModel", camModel);
-        keyFile.set_string("FileInfo", "Filetype", filetype);
-        keyFile.set_integer("FileInfo", "FrameCount", frameCount);
-        keyFile.set_integer("FileInfo", "SampleFormat", sampleFormat);
-        keyFile.set_integer("FileInfo", "Width", width);
-        keyFile.set_integer("FileInfo", "Height", height);
-
-        if (format == FT_Raw) {
-            keyFile.set_integer("ExtraRawInfo", "ThumbImageType", thumbImgType);
-            keyFile.set_integer("ExtraRawInfo", "SensorType", sensortype);
-        }
-
-        keyData = keyFile.to_data();
-
-    } catch (Glib::Error &err) {
-        if (options.rtSettings.verbose) {
-            printf("CacheImageData::save / Error code %d while reading values "
-                   "from \"%s\":\n%s\n",
-                   err.code(), fname.c_str(), err.what().c_str());
-        }
-    } catch (...) {
-        if (options.rtSettings.verbose) {
-            printf("CacheImageData::save / Unknown exception while trying to "
-                   "save \"%s\"!\n",
-                   fname.c_str());
+            extra.clear();
         }
     }
 
-    if (keyData.empty()) {
-        return 1;
+    BinaryWriter w;
+    w.bytes(BINARY_MAGIC, 4);
+    w.u16(BINARY_VERSION);
+    w.u16(BINARY_FIXED_SIZE);
+    const size_t size_pos = w.size();
+    w.u32(0); // total size, filled below
+    w.u32(0); // reserved
+
+    w.u8((supported ? 1 : 0) | (recentlySaved ? 2 : 0) | (timeValid ? 4 : 0) |
+         (exifValid ? 8 : 0) | (isHDR ? 16 : 0) | (isPixelShift ? 32 : 0));
+    w.u8(uint8_t(int8_t(format)));
+    w.u8(month);
+    w.u8(day);
+    w.u8(hour);
+    w.u8(min);
+    w.u8(sec);
+    w.u8(0);
+    w.u16(uint16_t(year));
+    w.u16(frameCount);
+    w.u32(iso);
+    w.f64(fnumber);
+    w.f64(shutter);
+    w.f64(focalLen);
+    w.f64(focalLen35mm);
+    w.f32(focusDist);
+    w.u32(uint32_t(sensortype));
+    w.u32(uint32_t(sampleFormat));
+    w.u32(uint32_t(rating));
+    w.u32(uint32_t(colorLabel));
+    w.u32(uint32_t(thumbImgType));
+    w.u32(uint32_t(width));
+    w.u32(uint32_t(height));
+    w.u64(uint64_t(int64_t(timestamp)));
+    assert(w.size() == BINARY_HEADER_SIZE + BINARY_FIXED_SIZE);
+
+    for (auto str : {&md5, &version, &expcomp, &lens, &orientation, &camMake,
+                     &camModel, &filetype}) {
+        w.str(*str);
     }
+    w.set_u32(size_pos, w.size());
 
-    FILE *f = g_fopen(fname.c_str(), "wt");
-
-    if (!f) {
-        if (options.rtSettings.verbose) {
-            printf("CacheImageData::save / Error: unable to open file \"%s\" "
-                   "with write access!\n",
-                   fname.c_str());
-        }
-
-        return 1;
-    } else {
-        fprintf(f, "%s", keyData.c_str());
-        fclose(f);
-        return 0;
-    }
+    data = w.data() + extra;
+    return 0;
 }
 
 std::string CacheImageData::getOrientationFilter() const
@@ -82,8 +82,17 @@ public:
 
     CacheImageData();
 
-    int load(const Glib::ustring &fname);
-    int save(const Glib::ustring &fname);
+    // the data is the content of the record of the image in the cache (see
+    // CacheManager::loadData): the values of this class in a binary format,
+    // followed by the KeyFile text of the other sections (LiveThumbData).
+    // The KeyFile records of older versions are still read, and converted
+    // when saved
+    int loadData(const std::string &data);
+    int saveData(std::string &data);
+
+    // the KeyFile text following the binary part of the record
+    static std::string getExtraData(const std::string &data);
+    static void setExtraData(std::string &data, const std::string &extra);
 
     //-------------------------------------------------------------------------
     // FramesMetaData interface
@@ -132,4 +141,9 @@ public:
         w = width;
         h = height;
     }
+
+private:
+    static bool isBinary(const std::string &data);
+    int loadBinary(const std::string &data);
+    int loadKeyFile(const std::string &data);
 };
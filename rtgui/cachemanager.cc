@@ -28,6 +28,8 @@
 #include <windows.h>
 #endif
 
+#include "../rtengine/asyncreader.h"
+#include "../rtengine/threadpool.h"
 #include "../rtengine/utils.h"
 #include "guiutils.h"
 #include "options.h"
@@ -40,12 +42,20 @@
 namespace {
 
 constexpr int cacheDirMode = 0777;
+// the data directory only holds the records of older versions, which are
+// moved to the store when they are accessed
 constexpr const char *cacheDirs[] = {"profiles", "images", "embprofiles",
                                      "data"};
+constexpr const char *storeName = "data.pack";
+// maximum number of prefetched records not yet requested
+constexpr size_t maxPrefetched = 4096;
+// maximum number of entries evicted by a single step of the background
+// trimming of the cache
+constexpr size_t trimBatchSize = 64;
 
 } // namespace
 
-CacheManager::CacheManager(): pl_(nullptr) {}
+CacheManager::CacheManager(): pl_(nullptr), trim_scheduled_(false) {}
 
 CacheManager *CacheManager::getInstance()
 {
@@ -71,6 +81,17 @@ void CacheManager::init()
         std::cerr << "Failed to create all cache directories: "
                   << g_strerror(errno) << std::endl;
     }
+
+    store_.open(Glib::build_filename(baseDir, storeName));
+
+    // the records of older versions are never written again, so they are
+    // trimmed only once per session
+    trim_scheduled_ = true;
+    rtengine::ThreadPool::add_task(rtengine::ThreadPool::Priority::LOWEST,
+                                   [this]() -> void {
+                                       trimLegacyData();
+                                       trimStep();
+                                   });
 }
 
 Thumbnail *CacheManager::getEntry(const Glib::ustring &fname)
@@ -95,20 +116,19 @@ Thumbnail *CacheManager::getEntry(const Glib::ustring &fname)
     }
 
     // build path name
-    const auto md5 = getMD5(fname);
+    const auto md5 = getKey(fname);
 
     if (md5.empty()) {
         return nullptr;
     }
 
-    const auto cacheName = getCacheFileName("data", fname, ".txt", md5);
-
     // let's see if we have it in the cache
     {
         CacheImageData imageData;
+        std::string data;
 
-        const auto error = imageData.load(cacheName);
-        if (error == 0 && imageData.supported) {
+        if (loadData(fname, md5, data) && imageData.loadData(data) == 0 &&
+            imageData.supported) {
 
             thumbnail.reset(new Thumbnail(this, fname, &imageData));
             if (!thumbnail->isSupported()) {
@@ -190,6 +210,14 @@ void CacheManager::renameEntry(const std::string &oldfilename,
 
     const auto newmd5 = getMD5(newfilename);
 
+    {
+        std::string data;
+        if (loadData(oldfilename, oldmd5, data)) {
+            store_.rename(oldmd5, newmd5,
+                          Glib::path_get_basename(newfilename));
+        }
+    }
+
     auto error = g_rename(
         getCacheFileName("profiles", oldfilename, paramFileExtension, oldmd5)
             .c_str(),
@@ -201,9 +229,6 @@ void CacheManager::renameEntry(const std::string &oldfilename,
     error |= g_rename(
         getCacheFileName("embprofiles", oldfilename, ".icc", oldmd5).c_str(),
         getCacheFileName("embprofiles", newfilename, ".icc", newmd5).c_str());
-    error |=
-        g_rename(getCacheFileName("data", oldfilename, ".txt", oldmd5).c_str(),
-                 getCacheFileName("data", newfilename, ".txt", newmd5).c_str());
     error |= g_rename(
         getCacheFileName("images", oldfilename, ".artt", oldmd5).c_str(),
         getCacheFileName("images", newfilename, ".artt", newmd5).c_str());
@@ -241,7 +266,12 @@ void CacheManager::closeCache() const
 {
     MyMutex::MyLock lock(mutex);
 
-    applyCacheSizeLimitation();
+    // normally a no-op, the cache is kept within its size in the background
+    // (see trimStep())
+    for (const auto &e : store_.trim(options.maxCacheEntries)) {
+        deleteFiles(e.second, e.first, false, false);
+    }
+    store_.shrink();
 #ifdef ART_USE_OCIO
     rtengine::ExternalLUT3D::trim_cache();
 #endif
@@ -254,6 +284,7 @@ void CacheManager::clearAll() const
     for (const auto &cacheDir : cacheDirs) {
         deleteDir(cacheDir);
     }
+    clearStore();
 
 #ifdef ART_USE_OCIO
     rtengine::ExternalLUT3D::clear_cache();
@@ -267,6 +298,16 @@ void CacheManager::clearImages() const
     deleteDir("data");
     deleteDir("images");
     deleteDir("aehistograms");
+    deleteDir("histmatching");
+    clearStore();
+}
+
+void CacheManager::clearStore() const
+{
+    store_.clear();
+
+    MyMutex::MyLock lock(prefetch_mutex_);
+    prefetched_.clear();
 }
 
 void CacheManager::clearProfiles() const
@@ -312,7 +353,12 @@ void CacheManager::deleteFiles(const Glib::ustring &fname,
     error |= g_remove(getCacheFileName("images", fname, ".artt", md5).c_str());
 
     if (purgeData) {
-        error |= g_remove(getCacheFileName("data", fname, ".txt", md5).c_str());
+        store_.remove(md5);
+        {
+            MyMutex::MyLock lock(prefetch_mutex_);
+            prefetched_.erase(md5);
+        }
+        g_remove(getCacheFileName("data", fname, ".txt", md5).c_str());
     }
 
     if (purgeProfile) {
@@ -329,7 +375,21 @@ void CacheManager::deleteFiles(const Glib::ustring &fname,
 
 std::string CacheManager::getMD5(const Glib::ustring &fname)
 {
-    return rtengine::getMD5(fname);
+    return rtengine::getMD5(fname, options.thumb_cache_key_mtime);
+}
+
+std::string CacheManager::getKey(const Glib::ustring &fname) const
+{
+    {
+        MyMutex::MyLock lock(prefetch_mutex_);
+        auto it = prefetched_keys_.find(fname);
+        if (it != prefetched_keys_.end()) {
+            std::string res = std::move(it->second);
+            prefetched_keys_.erase(it);
+            return res;
+        }
+    }
+    return getMD5(fname);
 }
 
 Glib::ustring CacheManager::getCacheFileName(const Glib::ustring &subDir,
@@ -342,9 +402,39 @@ Glib::ustring CacheManager::getCacheFileName(const Glib::ustring &subDir,
     return Glib::build_filename(dirName, baseName + fext);
 }
 
-void CacheManager::applyCacheSizeLimitation() const
+void CacheManager::scheduleCacheSizeLimitation()
+{
+    if (store_.size() <= options.maxCacheEntries ||
+        trim_scheduled_.exchange(true)) {
+        return;
+    }
+    rtengine::ThreadPool::add_task(rtengine::ThreadPool::Priority::LOWEST,
+                                   [this]() -> void { trimStep(); });
+}
+
+void CacheManager::trimStep()
 {
-    // first count files without fetching file name and timestamp.
+    // the store keeps its entries in order of last use, so the oldest ones
+    // are found without looking at the others. Only a few of them are
+    // evicted at a time, to bound the I/O done by each step
+    const auto evicted = store_.trim(options.maxCacheEntries, trimBatchSize);
+    for (const auto &e : evicted) {
+        deleteFiles(e.second, e.first, false, false);
+    }
+
+    if (evicted.size() == trimBatchSize &&
+        store_.size() > options.maxCacheEntries) {
+        rtengine::ThreadPool::add_task(rtengine::ThreadPool::Priority::LOWEST,
+                                       [this]() -> void { trimStep(); });
+    } else {
+        trim_scheduled_ = false;
+    }
+}
+
+void CacheManager::trimLegacyData() const
+{
+    // the records of older versions left in the data directory. First count
+    // files without fetching file name and timestamp.
     std::size_t numFiles = 0;
     try {
 
@@ -417,10 +507,8 @@ bool CacheManager::getImageData(const Glib::ustring &fname, CacheImageData &out)
     const auto md5 = getMD5(fname);
 
     if (!md5.empty()) {
-        const auto cacheName = getCacheFileName("data", fname, ".txt", md5);
-
-        const auto error = out.load(cacheName);
-        if (error != 0) {
+        std::string data;
+        if (!loadData(fname, md5, data) || out.loadData(data) != 0) {
             return false;
         }
     } else {
@@ -429,3 +517,99 @@ bool CacheManager::getImageData(const Glib::ustring &fname, CacheImageData &out)
 
     return true;
 }
+
+bool CacheManager::loadData(const Glib::ustring &fname, const std::string &md5,
+                            std::string &data)
+{
+    if (md5.empty()) {
+        return false;
+    }
+
+    {
+        MyMutex::MyLock lock(prefetch_mutex_);
+        auto it = prefetched_.find(md5);
+        if (it != prefetched_.end()) {
+            data = std::move(it->second);
+            prefetched_.erase(it);
+            return true;
+        }
+    }
+
+    if (store_.get(md5, data)) {
+        return true;
+    }
+
+    // record written by an older version, move it to the store
+    const auto cacheName = getCacheFileName("data", fname, ".txt", md5);
+    if (!Glib::file_test(cacheName, Glib::FILE_TEST_EXISTS)) {
+        return false;
+    }
+    try {
+        data = Glib::file_get_contents(cacheName);
+    } catch (Glib::Error &) {
+        return false;
+    }
+    if (store_.put(md5, Glib::path_get_basename(fname), data)) {
+        g_remove(cacheName.c_str());
+    }
+    return true;
+}
+
+bool CacheManager::saveData(const Glib::ustring &fname, const std::string &md5,
+                            const std::string &data)
+{
+    if (md5.empty()) {
+        return false;
+    }
+
+    {
+        MyMutex::MyLock lock(prefetch_mutex_);
+        prefetched_.erase(md5);
+    }
+
+    const bool res = store_.put(md5, Glib::path_get_basename(fname), data);
+    scheduleCacheSizeLimitation();
+    return res;
+}
+
+void CacheManager::prefetch(const std::vector<Glib::ustring> &fnames)
+{
+    std::vector<std::string> keys;
+    keys.reserve(fnames.size());
+    for (const auto &fname : fnames) {
+        keys.push_back(getMD5(fname));
+    }
+
+    std::vector<std::string> data;
+    store_.get(keys, data);
+
+    // the thumbnail images are going to be loaded right after the records
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i].empty()) {
+            continue;
+        }
+        auto reader = rtengine::AsyncReader::getInstance();
+        reader->prefetch(
+            getCacheFileName("images", fnames[i], ".rtti", keys[i]));
+        if (options.thumb_cache_processed) {
+            reader->prefetch(
+                getCacheFileName("images", fnames[i], ".artt", keys[i]));
+        }
+    }
+
+    MyMutex::MyLock lock(prefetch_mutex_);
+    if (prefetched_.size() + keys.size() > maxPrefetched) {
+        prefetched_.clear();
+    }
+    if (prefetched_keys_.size() + keys.size() > maxPrefetched) {
+        prefetched_keys_.clear();
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!keys[i].empty()) {
+            prefetched_keys_[fnames[i]] = keys[i];
+        }
+        if (!data[i].empty()) {
+            prefetched_[keys[i]] = std::move(data[i]);
+        }
+    }
+}
@@ -19,14 +19,18 @@
  */
 #pragma once
 
+#include <atomic>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glibmm/ustring.h>
 
 #include "../rtengine/noncopyable.h"
 #include "../rtengine/rtengine.h"
 #include "cacheimagedata.h"
+#include "cachestore.h"
 #include "threadutils.h"
 
 class Thumbnail;
@@ -39,11 +43,28 @@ private:
     mutable MyMutex mutex;
     rtengine::ProgressListener *pl_;
 
+    // the data records of the images, see CacheStore. They don't need the
+    // lock of the manager
+    mutable CacheStore store_;
+    mutable MyMutex prefetch_mutex_;
+    mutable std::unordered_map<std::string, std::string> prefetched_;
+    // keys computed by prefetch(), so that the files are not looked up
+    // again by getEntry()
+    mutable std::unordered_map<std::string, std::string> prefetched_keys_;
+
+    std::string getKey(const Glib::ustring &fname) const;
+
     void deleteDir(const Glib::ustring &dirName) const;
     void deleteFiles(const Glib::ustring &fname, const std::string &md5,
                      bool purgeData, bool purgeProfile) const;
 
-    void applyCacheSizeLimitation() const;
+    // the cache is kept within options.maxCacheEntries by a low priority
+    // background task, evicting a few entries at a time
+    std::atomic<bool> trim_scheduled_;
+    void scheduleCacheSizeLimitation();
+    void trimStep();
+    void trimLegacyData() const;
+    void clearStore() const;
 
 public:
     CacheManager();
@@ -66,6 +87,9 @@ public:
     void clearProfiles() const;
     void clearFromCache(const Glib::ustring &fname, bool purge) const;
 
+    /** the key of the cache entries of the image. It is computed from the
+        file name, size and (if Options::thumb_cache_key_mtime is set)
+        modification time, without reading the file */
     static std::string getMD5(const Glib::ustring &fname);
 
     Glib::ustring getCacheFileName(const Glib::ustring &subDir,
@@ -74,6 +98,16 @@ public:
                                    const Glib::ustring &md5) const;
 
     bool getImageData(const Glib::ustring &fn, CacheImageData &out);
+
+    /** the data record of the image (see CacheImageData::loadData), false
+        if there is none */
+    bool loadData(const Glib::ustring &fname, const std::string &md5,
+                  std::string &data);
+    bool saveData(const Glib::ustring &fname, const std::string &md5,
+                  const std::string &data);
+    /** reads in a single pass the data records of the given images, which
+        are going to be requested soon */
+    void prefetch(const std::vector<Glib::ustring> &fnames);
 };
 
 #define cacheMgr CacheManager::getInstance()
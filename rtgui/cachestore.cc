@@ -0,0 +1,489 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cachestore.h"
+#include "options.h"
+#include <algorithm>
+#include <cstring>
+#include <glib/gstdio.h>
+#include <iostream>
+
+extern Options options;
+
+namespace {
+
+/******************************************************************************
+ * file format:
+ *
+ * "ARTCS001" header
+ * records, each one made of:
+ *   type ('P' for a put, 'D' for a removal)
+ *   length of the key (uint32)
+ *   length of the name (uint32)
+ *   length of the data (uint32)
+ *   checksum of the rest of the record (uint32)
+ *   key
+ *   name
+ *   data
+ ******************************************************************************/
+constexpr char MAGIC[] = "ARTCS001";
+constexpr size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+constexpr size_t HEADER_SIZE = 1 + 4 * sizeof(uint32_t);
+constexpr uint32_t MAX_KEY_SIZE = 256;
+constexpr uint32_t MAX_NAME_SIZE = 4096;
+constexpr uint32_t MAX_DATA_SIZE = 16 * 1024 * 1024;
+
+constexpr char PUT = 'P';
+constexpr char DEL = 'D';
+
+uint32_t checksum(const char *data, size_t size, uint32_t h = 2166136261u)
+{
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ uint8_t(data[i])) * 16777619u;
+    }
+    return h;
+}
+
+struct Header {
+    char type;
+    uint32_t key_size;
+    uint32_t name_size;
+    uint32_t data_size;
+    uint32_t checksum;
+
+    bool valid() const
+    {
+        return (type == PUT || type == DEL) && key_size > 0 &&
+               key_size <= MAX_KEY_SIZE && name_size <= MAX_NAME_SIZE &&
+               data_size <= MAX_DATA_SIZE;
+    }
+
+    uint32_t record_size() const
+    {
+        return HEADER_SIZE + key_size + name_size + data_size;
+    }
+
+    void encode(char *buf) const
+    {
+        buf[0] = type;
+        memcpy(buf + 1, &key_size, 4);
+        memcpy(buf + 5, &name_size, 4);
+        memcpy(buf + 9, &data_size, 4);
+        memcpy(buf + 13, &checksum, 4);
+    }
+
+    void decode(const char *buf)
+    {
+        type = buf[0];
+        memcpy(&key_size, buf + 1, 4);
+        memcpy(&name_size, buf + 5, 4);
+        memcpy(&data_size, buf + 9, 4);
+        memcpy(&checksum, buf + 13, 4);
+    }
+};
+
+} // namespace
+
+CacheStore::CacheStore(): file_(nullptr), garbage_(0), end_(0) {}
+
+CacheStore::~CacheStore() { close(); }
+
+bool CacheStore::open(const Glib::ustring &fname)
+{
+    MyMutex::MyLock lock(mutex_);
+
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+    index_.clear();
+    order_.clear();
+    garbage_ = 0;
+    end_ = 0;
+    fname_ = fname;
+
+    // the writes always go at the end of the file, also if another ART
+    // process is using the same cache
+    file_ = g_fopen(fname_.c_str(), "a+b");
+    if (!file_) {
+        if (options.rtSettings.verbose) {
+            std::cerr << "CacheStore: cannot open " << fname_ << std::endl;
+        }
+        return false;
+    }
+
+    if (!scan()) {
+        compact();
+    } else if (garbage_ > end_ / 2 && end_ > (1 << 20)) {
+        compact();
+    }
+
+    if (options.rtSettings.verbose) {
+        std::cout << "CacheStore: " << index_.size() << " entries in "
+                  << fname_ << std::endl;
+    }
+
+    return file_ != nullptr;
+}
+
+void CacheStore::close()
+{
+    MyMutex::MyLock lock(mutex_);
+
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+    index_.clear();
+    order_.clear();
+}
+
+// builds the index, returns false if the file has to be rewritten (bad
+// header or truncated/corrupted tail)
+bool CacheStore::scan()
+{
+    fseek(file_, 0, SEEK_END);
+    const int64_t file_size = ftell(file_);
+
+    if (file_size == 0) {
+        fwrite(MAGIC, 1, MAGIC_SIZE, file_);
+        fflush(file_);
+        end_ = MAGIC_SIZE;
+        return true;
+    }
+
+    char magic[MAGIC_SIZE];
+    fseek(file_, 0, SEEK_SET);
+    if (fread(magic, 1, MAGIC_SIZE, file_) != MAGIC_SIZE ||
+        memcmp(magic, MAGIC, MAGIC_SIZE) != 0) {
+        end_ = 0;
+        return false;
+    }
+
+    int64_t offset = MAGIC_SIZE;
+    std::string key;
+    std::string name;
+    char buf[HEADER_SIZE];
+
+    while (offset < file_size) {
+        Header hdr;
+        if (fread(buf, 1, HEADER_SIZE, file_) != HEADER_SIZE) {
+            break;
+        }
+        hdr.decode(buf);
+        if (!hdr.valid() || offset + hdr.record_size() > file_size) {
+            break;
+        }
+        key.resize(hdr.key_size);
+        name.resize(hdr.name_size);
+        if (fread(&key[0], 1, hdr.key_size, file_) != hdr.key_size ||
+            (hdr.name_size &&
+             fread(&name[0], 1, hdr.name_size, file_) != hdr.name_size)) {
+            break;
+        }
+        fseek(file_, hdr.data_size, SEEK_CUR);
+
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            drop(it);
+        }
+        if (hdr.type == PUT) {
+            order_.push_back(key);
+            index_[key] = Entry{offset, hdr.record_size(), name,
+                                std::prev(order_.end())};
+        } else {
+            garbage_ += hdr.record_size();
+        }
+        offset += hdr.record_size();
+    }
+
+    end_ = offset;
+    return offset == file_size;
+}
+
+// reads the record of key at offset, checking that it is valid
+bool CacheStore::read_raw(int64_t offset, uint32_t size,
+                          const std::string &key, std::vector<char> &buf)
+{
+    buf.resize(size);
+    if (size < HEADER_SIZE || fseek(file_, offset, SEEK_SET) != 0 ||
+        fread(&buf[0], 1, size, file_) != size) {
+        return false;
+    }
+
+    Header hdr;
+    hdr.decode(&buf[0]);
+    return hdr.valid() && hdr.type == PUT && hdr.record_size() == size &&
+           checksum(&buf[HEADER_SIZE], size - HEADER_SIZE) == hdr.checksum &&
+           key.compare(0, std::string::npos, &buf[HEADER_SIZE],
+                       hdr.key_size) == 0;
+}
+
+bool CacheStore::read_record(int64_t offset, uint32_t size,
+                             const std::string &key, std::string &data)
+{
+    std::vector<char> buf;
+    if (!read_raw(offset, size, key, buf)) {
+        return false;
+    }
+
+    Header hdr;
+    hdr.decode(&buf[0]);
+    const char *d = &buf[HEADER_SIZE + hdr.key_size + hdr.name_size];
+    data.assign(d, hdr.data_size);
+    return true;
+}
+
+bool CacheStore::append(char type, const std::string &key,
+                        const Glib::ustring &name, const std::string &data,
+                        int64_t &offset, uint32_t &size)
+{
+    if (!file_ || key.empty() || key.size() > MAX_KEY_SIZE ||
+        name.bytes() > MAX_NAME_SIZE || data.size() > MAX_DATA_SIZE) {
+        return false;
+    }
+
+    Header hdr;
+    hdr.type = type;
+    hdr.key_size = key.size();
+    hdr.name_size = name.bytes();
+    hdr.data_size = data.size();
+
+    std::string rec(HEADER_SIZE, '\0');
+    rec += key;
+    rec.append(name.c_str(), name.bytes());
+    rec += data;
+    hdr.checksum = checksum(&rec[HEADER_SIZE], rec.size() - HEADER_SIZE);
+    hdr.encode(&rec[0]);
+
+    fseek(file_, 0, SEEK_END);
+    offset = ftell(file_);
+    size = rec.size();
+    if (fwrite(rec.data(), 1, rec.size(), file_) != rec.size() ||
+        fflush(file_) != 0) {
+        return false;
+    }
+    end_ = offset + size;
+    return true;
+}
+
+void CacheStore::drop(std::unordered_map<std::string, Entry>::iterator it)
+{
+    garbage_ += it->second.size;
+    order_.erase(it->second.pos);
+    index_.erase(it);
+}
+
+bool CacheStore::get(const std::string &key, std::string &data)
+{
+    MyMutex::MyLock lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it == index_.end() || !file_) {
+        return false;
+    }
+    order_.splice(order_.end(), order_, it->second.pos);
+    return read_record(it->second.offset, it->second.size, key, data);
+}
+
+void CacheStore::get(const std::vector<std::string> &keys,
+                     std::vector<std::string> &data)
+{
+    data.assign(keys.size(), std::string());
+
+    MyMutex::MyLock lock(mutex_);
+
+    if (!file_) {
+        return;
+    }
+
+    std::vector<std::pair<const Entry *, size_t>> found;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto it = index_.find(keys[i]);
+        if (it != index_.end()) {
+            order_.splice(order_.end(), order_, it->second.pos);
+            found.emplace_back(&it->second, i);
+        }
+    }
+    std::sort(found.begin(), found.end(),
+              [](const std::pair<const Entry *, size_t> &a,
+                 const std::pair<const Entry *, size_t> &b) {
+                  return a.first->offset < b.first->offset;
+              });
+
+    for (auto &p : found) {
+        read_record(p.first->offset, p.first->size, keys[p.second],
+                    data[p.second]);
+    }
+}
+
+bool CacheStore::put(const std::string &key, const Glib::ustring &name,
+                     const std::string &data)
+{
+    MyMutex::MyLock lock(mutex_);
+
+    int64_t offset = 0;
+    uint32_t size = 0;
+    if (!append(PUT, key, name, data, offset, size)) {
+        return false;
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        drop(it);
+    }
+    order_.push_back(key);
+    index_[key] = Entry{offset, size, name, std::prev(order_.end())};
+    return true;
+}
+
+bool CacheStore::remove(const std::string &key)
+{
+    MyMutex::MyLock lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return false;
+    }
+
+    int64_t offset = 0;
+    uint32_t size = 0;
+    if (append(DEL, key, "", "", offset, size)) {
+        garbage_ += size;
+    }
+    drop(it);
+    return true;
+}
+
+bool CacheStore::rename(const std::string &oldkey, const std::string &newkey,
+                        const Glib::ustring &newname)
+{
+    std::string data;
+    if (!get(oldkey, data)) {
+        return false;
+    }
+    remove(oldkey);
+    return put(newkey, newname, data);
+}
+
+void CacheStore::clear()
+{
+    MyMutex::MyLock lock(mutex_);
+
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+    index_.clear();
+    order_.clear();
+    garbage_ = 0;
+
+    g_remove(fname_.c_str());
+    file_ = g_fopen(fname_.c_str(), "a+b");
+    if (file_) {
+        fwrite(MAGIC, 1, MAGIC_SIZE, file_);
+        fflush(file_);
+    }
+    end_ = MAGIC_SIZE;
+}
+
+CacheStore::Evicted CacheStore::trim(size_t max_entries, size_t max_evicted)
+{
+    MyMutex::MyLock lock(mutex_);
+
+    Evicted res;
+    while (index_.size() > max_entries && res.size() < max_evicted) {
+        auto it = index_.find(order_.front());
+        res.emplace_back(it->first, it->second.name);
+        int64_t offset = 0;
+        uint32_t size = 0;
+        if (append(DEL, it->first, "", "", offset, size)) {
+            garbage_ += size;
+        }
+        drop(it);
+    }
+    return res;
+}
+
+void CacheStore::shrink()
+{
+    MyMutex::MyLock lock(mutex_);
+
+    if (file_ && garbage_ > end_ / 2) {
+        compact();
+    }
+}
+
+size_t CacheStore::size() const
+{
+    MyMutex::MyLock lock(mutex_);
+    return index_.size();
+}
+
+// rewrites the file with only the live records, least recently used first,
+// so that the order of use is kept across sessions
+void CacheStore::compact()
+{
+    const Glib::ustring tmpname = fname_ + ".tmp";
+    FILE *out = g_fopen(tmpname.c_str(), "wb");
+    if (!out) {
+        return;
+    }
+
+    bool ok = fwrite(MAGIC, 1, MAGIC_SIZE, out) == MAGIC_SIZE;
+    int64_t offset = MAGIC_SIZE;
+    std::vector<char> buf;
+
+    for (auto k = order_.begin(); ok && k != order_.end();) {
+        auto it = index_.find(*k);
+        ++k;
+        auto &e = it->second;
+        if (!read_raw(e.offset, e.size, it->first, buf)) {
+            // unreadable, forget about it
+            order_.erase(e.pos);
+            index_.erase(it);
+            continue;
+        }
+        ok = fwrite(&buf[0], 1, e.size, out) == e.size;
+        e.offset = offset;
+        offset += e.size;
+    }
+    ok = (fclose(out) == 0) && ok;
+
+    if (!ok) {
+        g_remove(tmpname.c_str());
+        return;
+    }
+
+    fclose(file_);
+    g_remove(fname_.c_str());
+    if (g_rename(tmpname.c_str(), fname_.c_str()) != 0) {
+        g_remove(tmpname.c_str());
+        index_.clear();
+        order_.clear();
+        offset = 0;
+    }
+    file_ = g_fopen(fname_.c_str(), "a+b");
+    if (file_ && offset == 0) {
+        fwrite(MAGIC, 1, MAGIC_SIZE, file_);
+        fflush(file_);
+        offset = MAGIC_SIZE;
+    }
+    garbage_ = 0;
+    end_ = offset;
+}
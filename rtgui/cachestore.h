@@ -0,0 +1,105 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../rtengine/noncopyable.h"
+#include "threadutils.h"
+#include <cstdint>
+#include <cstdio>
+#include <glibmm/ustring.h>
+#include <limits>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Single file store of the small per-image records of the cache (what used
+ * to be the .txt files of the data directory), keyed by the MD5 of the
+ * image.
+ *
+ * The file is an append-only log of records, each one holding the key, the
+ * base name of the image (needed to remove the other cache files of an
+ * evicted entry) and the data, protected by a checksum. Updates and
+ * removals append a new record, and the index of the live records is
+ * rebuilt by scanning the log when the store is opened. The log is
+ * compacted when more than half of it is garbage.
+ *
+ * The entries are kept in order of last use (read or write), so that the
+ * eviction of the least recently used ones doesn't need to look at the
+ * others. The order is saved when the log is compacted; in between, the
+ * order of the records in the file (i.e. of last write) is used.
+ */
+class CacheStore: public rtengine::NonCopyable {
+public:
+    using Evicted = std::vector<std::pair<std::string, Glib::ustring>>;
+
+    CacheStore();
+    ~CacheStore();
+
+    bool open(const Glib::ustring &fname);
+    void close();
+
+    bool get(const std::string &key, std::string &data);
+    /** batched version of the above: the records are read in file order.
+        data[i] is empty if keys[i] is not found */
+    void get(const std::vector<std::string> &keys,
+             std::vector<std::string> &data);
+    bool put(const std::string &key, const Glib::ustring &name,
+             const std::string &data);
+    bool remove(const std::string &key);
+    bool rename(const std::string &oldkey, const std::string &newkey,
+                const Glib::ustring &newname);
+    void clear();
+
+    /** removes the least recently used entries in excess of max_entries,
+        at most max_evicted of them, returning their keys and names */
+    Evicted trim(size_t max_entries,
+                 size_t max_evicted = std::numeric_limits<size_t>::max());
+    /** rewrites the file if more than half of it is garbage */
+    void shrink();
+    size_t size() const;
+
+private:
+    struct Entry {
+        int64_t offset;
+        uint32_t size;
+        Glib::ustring name;
+        std::list<std::string>::iterator pos;
+    };
+
+    bool scan();
+    bool read_raw(int64_t offset, uint32_t size, const std::string &key,
+                  std::vector<char> &buf);
+    bool read_record(int64_t offset, uint32_t size, const std::string &key,
+                     std::string &data);
+    bool append(char type, const std::string &key, const Glib::ustring &name,
+                const std::string &data, int64_t &offset, uint32_t &size);
+    void drop(std::unordered_map<std::string, Entry>::iterator it);
+    void compact();
+
+    mutable MyMutex mutex_;
+    Glib::ustring fname_;
+    FILE *file_;
+    int64_t garbage_;
+    int64_t end_;
+    std::unordered_map<std::string, Entry> index_;
+    std::list<std::string> order_; // least recently used first
+};
@@ -27,6 +27,8 @@
 #include "cropwindow.h"
 #include "guiutils.h"
 #include "imagearea.h"
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 
 #include "../rtengine/threadpool.h"
@@ -198,6 +200,11 @@ void CropHandler::newImage(std::shared_ptr<StagedImageProcessor> ipc_,
     cx = 0;
     cy = 0;
 
+    cimg.lock();
+    cropimg.clear();
+    cropimgtrue.clear();
+    cimg.unlock();
+
     if (!ipc) {
         return;
     }
@@ -284,6 +291,9 @@ void CropHandler::setZoom(int z, int centerx, int centery)
 
     // maybe demosaic etc. if we cross the border to >100%
     bool needsFullRefresh = (z >= 1000 && zoom < 1000);
+    // or if we zoom in past the superpixels of a binned preview
+    bool needsDemosaic =
+        !needsFullRefresh && z < 1000 && z / 10 < ipc->getPreviewBinning();
 
     zoom = z;
 
@@ -311,11 +321,13 @@ void CropHandler::setZoom(int z, int centerx, int centery)
                     oldCropW != cropW || oldCropH != cropH);
 
     if (needed) {
-        const auto doit = [this, needsFullRefresh]() -> bool {
+        const auto doit = [this, needsFullRefresh, needsDemosaic]() -> bool {
             if (ipc) {
                 if (needsFullRefresh && !ipc->getHighQualComputed()) {
                     ipc->startProcessing(M_HIGHQUAL);
                     ipc->setHighQualComputed();
+                } else if (needsDemosaic) {
+                    ipc->startProcessing(DEMOSAIC);
                 } else {
                     update();
                 }
@@ -326,6 +338,19 @@ void CropHandler::setZoom(int z, int centerx, int centery)
         if (zoom_conn_.connected()) {
             zoom_conn_.disconnect();
         }
+
+        // the last rendering covers the new area at the new zoom level (see
+        // getWindow()): just resample it, without waiting
+        if (!needsFullRefresh && !needsDemosaic && zoom >= 1000) {
+            cimg.lock();
+            const bool cached = cacheCovers();
+            cimg.unlock();
+            if (cached) {
+                update();
+                return;
+            }
+        }
+
         if (cropPixbuf) {
             cropPixbuf.clear();
         }
@@ -451,118 +476,161 @@ void CropHandler::setDetailedCrop(
         return;
     }
 
-    cimg.lock();
-
-    cropParams = cp;
-    colorParams = cmp;
+    // the rendering is copied in the spare buffer without taking cimg, so
+    // that the GUI thread can keep drawing the previous one meanwhile
+    std::shared_ptr<FrameParams> params(new FrameParams{cp, cmp});
+    std::atomic_store(&pending_params_, params);
 
-    if (!cropimg.empty()) {
-        cropimg.clear();
+    std::shared_ptr<Frame> frame = std::atomic_exchange(
+        &spare_frame_, std::shared_ptr<Frame>());
+    if (!frame) {
+        frame.reset(new Frame());
     }
+    frame->width = im->getWidth();
+    frame->height = im->getHeight();
+    const std::size_t size = 3 * frame->width * frame->height;
+    frame->img.assign(im->getData(), im->getData() + size);
+    frame->imgtrue.assign(imtrue->getData(), imtrue->getData() + size);
+    frame->x = ax;
+    frame->y = ay;
+    frame->w = aw;
+    frame->h = ah;
+    frame->skip = askip;
 
-    if (!cropimgtrue.empty()) {
-        cropimgtrue.clear();
+    // a rendering not yet picked up by the GUI is superseded by this one
+    frame = std::atomic_exchange(&pending_frame_, frame);
+    if (frame) {
+        std::atomic_store(&spare_frame_, frame);
     }
 
-    if (ax == cropX && ay == cropY && aw == cropW && ah == cropH &&
-        askip == (zoom >= 1000 ? 1 : zoom / 10)) {
-        cropimg_width = im->getWidth();
-        cropimg_height = im->getHeight();
-        const std::size_t cropimg_size = 3 * cropimg_width * cropimg_height;
-        cropimg.assign(im->getData(), im->getData() + cropimg_size);
-        cropimgtrue.assign(imtrue->getData(), imtrue->getData() + cropimg_size);
-        cix = ax;
-        ciy = ay;
-        ciw = aw;
-        cih = ah;
-        cis = askip;
-
-        bool expected = false;
-
-        if (redraw_needed.compare_exchange_strong(expected, true)) {
-            idle_register.add([this]() -> bool {
-                cimg.lock();
-
-                if (redraw_needed.exchange(false)) {
-                    cropPixbuf.clear();
-                    cropPixbuftrue.clear();
-
-                    if (!enabled) {
-                        cropimg.clear();
-                        cropimgtrue.clear();
-                        cimg.unlock();
-                        return false;
-                    }
-
-                    if (!cropimg.empty()) {
-                        if (cix == cropX && ciy == cropY && ciw == cropW &&
-                            cih == cropH &&
-                            cis == (zoom >= 1000 ? 1 : zoom / 10)) {
-                            // calculate final image size
-                            float czoom =
-                                zoom >= 1000
-                                    ? zoom / 1000.f
-                                    : float((zoom / 10) * 10) / float(zoom);
-                            int imw = cropimg_width * czoom;
-                            int imh = cropimg_height * czoom;
-
-                            if (imw > ww) {
-                                imw = ww;
-                            }
-
-                            if (imh > wh) {
-                                imh = wh;
-                            }
-
-                            cropPixbuf = Gdk::Pixbuf::create_from_data(
-                                cropimg.data(), Gdk::COLORSPACE_RGB, false, 8,
-                                cropimg_width, cropimg_height,
-                                3 * cropimg_width);
-                            cropPixbuf = resample_preview(cropPixbuf, imw, imh,
-                                                          czoom, cis);
-                            // if (czoom < 1.f) {
-                            //     cropPixbuf = resize_lanczos(cropPixbuf, imw,
-                            //     imh, czoom);
-                            // } else if (czoom > 1.f) {
-                            //     cropPixbuf = resize_fast(cropPixbuf, imw,
-                            //     imh, czoom);
-                            // }
-
-                            // sharpen_for_display(cropPixbuf, cis);
-
-                            cropPixbuftrue = Gdk::Pixbuf::create_from_data(
-                                cropimgtrue.data(), Gdk::COLORSPACE_RGB, false,
-                                8, cropimg_width, cropimg_height,
-                                3 * cropimg_width);
-                            if (czoom != 1.f) {
-                                cropPixbuftrue = resize_fast(cropPixbuftrue,
-                                                             imw, imh, czoom);
-                            }
-                        }
-
-                        cropimg.clear();
-                        cropimgtrue.clear();
-                    }
-
-                    cimg.unlock();
-
-                    if (displayHandler) {
-                        displayHandler->cropImageUpdated();
-
-                        if (initial.exchange(false)) {
-                            displayHandler->initialImageArrived();
-                        }
-                    }
-                } else {
-                    cimg.unlock();
+    bool expected = false;
+
+    if (redraw_needed.compare_exchange_strong(expected, true)) {
+        idle_register.add([this]() -> bool {
+            redraw_needed = false;
+
+            std::shared_ptr<FrameParams> params = std::atomic_exchange(
+                &pending_params_, std::shared_ptr<FrameParams>());
+            std::shared_ptr<Frame> frame = std::atomic_exchange(
+                &pending_frame_, std::shared_ptr<Frame>());
+
+            cimg.lock();
+
+            if (params) {
+                cropParams = params->crop;
+                colorParams = params->color;
+            }
+
+            // the rendered window can be larger than the displayed area (see
+            // getWindow()), it just has to cover it
+            const bool covers = frame &&
+                frame->skip == (zoom >= 1000 ? 1 : zoom / 10) &&
+                frame->x <= cropX && frame->y <= cropY &&
+                frame->x + frame->w >= cropX + cropW &&
+                frame->y + frame->h >= cropY + cropH;
+
+            if (!covers) {
+                cimg.unlock();
+                if (frame) {
+                    std::atomic_store(&spare_frame_, frame);
                 }
+                return false;
+            }
+
+            cropPixbuf.clear();
+            cropPixbuftrue.clear();
 
+            if (!enabled) {
+                cropimg.clear();
+                cropimgtrue.clear();
+                cimg.unlock();
                 return false;
-            });
-        }
+            }
+
+            // the displayed buffers become the spare ones
+            cropimg.swap(frame->img);
+            cropimgtrue.swap(frame->imgtrue);
+            cropimg_width = frame->width;
+            cropimg_height = frame->height;
+            cix = frame->x;
+            ciy = frame->y;
+            ciw = frame->w;
+            cih = frame->h;
+            cis = frame->skip;
+
+            if (cacheCovers()) {
+                buildPixbufs();
+            }
+
+            cimg.unlock();
+
+            std::atomic_store(&spare_frame_, frame);
+
+            if (displayHandler) {
+                displayHandler->cropImageUpdated();
+
+                if (initial.exchange(false)) {
+                    displayHandler->initialImageArrived();
+                }
+            }
+
+            return false;
+        });
     }
+}
 
-    cimg.unlock();
+bool CropHandler::cacheCovers()
+{
+    return !cropimg.empty() && cis == (zoom >= 1000 ? 1 : zoom / 10) &&
+           cix <= cropX && ciy <= cropY && cix + ciw >= cropX + cropW &&
+           ciy + cih >= cropY + cropH;
+}
+
+void CropHandler::buildPixbufs()
+{
+    // calculate final image size
+    float czoom =
+        zoom >= 1000 ? zoom / 1000.f : float((zoom / 10) * 10) / float(zoom);
+
+    // only the displayed part of the cache is resampled
+    const int ox = (cropX - cix) / cis;
+    const int oy = (cropY - ciy) / cis;
+    const int w = std::min(cropimg_width - ox, int(std::ceil(ww / czoom)) + 1);
+    const int h = std::min(cropimg_height - oy, int(std::ceil(wh / czoom)) + 1);
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    int imw = w * czoom;
+    int imh = h * czoom;
+
+    if (imw > ww) {
+        imw = ww;
+    }
+
+    if (imh > wh) {
+        imh = wh;
+    }
+
+    // the pixbufs are copied out of the cache, which can be replaced (or
+    // sharpened in place by resample_preview) while they are displayed
+    const std::size_t offset = 3 * (std::size_t(oy) * cropimg_width + ox);
+    const int stride = 3 * cropimg_width;
+
+    cropPixbuf = Gdk::Pixbuf::create_from_data(cropimg.data() + offset,
+                                               Gdk::COLORSPACE_RGB, false, 8,
+                                               w, h, stride)
+                     ->copy();
+    cropPixbuf = resample_preview(cropPixbuf, imw, imh, czoom, cis);
+
+    cropPixbuftrue = Gdk::Pixbuf::create_from_data(cropimgtrue.data() + offset,
+                                                   Gdk::COLORSPACE_RGB, false,
+                                                   8, w, h, stride)
+                         ->copy();
+    if (czoom != 1.f) {
+        cropPixbuftrue = resize_fast(cropPixbuftrue, imw, imh, czoom);
+    }
 }
 
 void CropHandler::getWindow(int &cwx, int &cwy, int &cww, int &cwh, int &cskip)
@@ -582,6 +650,40 @@ void CropHandler::getWindow(int &cwx, int &cwy, int &cww, int &cwh, int &cskip)
     }
 
     cskip = zoom >= 1000 ? 1 : zoom / 10;
+
+    // above 100%, render the area shown at 100% around the same center. It
+    // contains the areas shown at all the zoom levels in between, which are
+    // then only a resampling of this rendering away (see setZoom())
+    if (zoom > 1000 && options.detail_window_zoom_cache && ipc) {
+        const int fw = ipc->getFullWidth();
+        const int fh = ipc->getFullHeight();
+        const int w = std::min(std::max(ww, cww), fw);
+        const int h = std::min(std::max(wh, cwh), fh);
+        if (w > 0 && h > 0) {
+            cwx = rtengine::LIM(cwx + cww / 2 - w / 2, 0, fw - w);
+            cwy = rtengine::LIM(cwy + cwh / 2 - h / 2, 0, fh - h);
+            cww = w;
+            cwh = h;
+        }
+    }
+
+    // render whole tiles around the displayed area, so that the following
+    // small pans don't need a new rendering (see update())
+    const int tile = options.detail_window_tile_size * cskip;
+    if (tile > 0 && ipc) {
+        const int fw = ipc->getFullWidth();
+        const int fh = ipc->getFullHeight();
+        const int x1 = (cwx / tile) * tile;
+        const int y1 = (cwy / tile) * tile;
+        const int x2 = std::min(((cwx + cww + tile - 1) / tile) * tile, fw);
+        const int y2 = std::min(((cwy + cwh + tile - 1) / tile) * tile, fh);
+        if (x2 > x1 && y2 > y1) {
+            cwx = x1;
+            cwy = y1;
+            cww = x2 - x1;
+            cwh = y2 - y1;
+        }
+    }
 }
 
 void CropHandler::update()
@@ -595,8 +697,21 @@ void CropHandler::update()
         cimg.lock();
         cropPixbuf.clear();
         cropPixbuftrue.clear();
+        const bool cached = cacheCovers();
+        if (cached) {
+            buildPixbufs();
+        }
         cimg.unlock();
 
+        // the new area is covered by the last rendering (the parameter
+        // changes trigger a new rendering by themselves)
+        if (cached) {
+            if (displayHandler) {
+                displayHandler->cropImageUpdated();
+            }
+            return;
+        }
+
         // To save threads, try to mark "needUpdate" without a thread first
         if (crop->tryUpdate()) {
             auto i = ipc; // keep a reference around so that ipc doesn't get
@@ -737,6 +852,18 @@ void CropHandler::getSize(int &w, int &h)
     h = cropH;
 }
 
+void CropHandler::getBufferOffset(int &x, int &y)
+{
+    MyMutex::MyLock lock(cimg);
+
+    if (cropimg.empty()) {
+        x = y = 0;
+    } else {
+        x = (cropX - cix) / cis;
+        y = (cropY - ciy) / cis;
+    }
+}
+
 void CropHandler::getFullImageSize(int &w, int &h)
 {
     if (ipc) {
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <vector>
 
 #include <gtkmm.h>
@@ -71,6 +72,9 @@ public:
     void getPosition(int &x, int &y);
     void getSize(int &w, int &h);
     void getFullImageSize(int &w, int &h);
+    // position of the displayed area in the buffers of the crop (which may
+    // cover a larger area, see getWindow())
+    void getBufferOffset(int &x, int &y);
 
     void setEnabled(bool e, bool do_update = true);
     bool getEnabled();
@@ -108,6 +112,11 @@ public:
 
 private:
     void compDim();
+    // the last rendered crop (cropimg, cropimgtrue) is kept as a cache of
+    // the area around the displayed one: these must be called with cimg
+    // locked
+    bool cacheCovers();
+    void buildPixbufs();
 
     int zoom;   // scale factor (e.g. 5 if 1:5 scale) ; if 1:1 scale and bigger,
                 // factor is multiplied by 1000  (i.e. 1000 for 1:1 scale, 2000
@@ -131,6 +140,31 @@ private:
     std::vector<unsigned char> cropimgtrue;
     int cropimg_width, cropimg_height, cix, ciy, ciw, cih, cis;
 
+    // a rendering handed over by setDetailedCrop() to the GUI thread. The
+    // renderings go around three buffers: the one displayed (cropimg and
+    // cropimgtrue, under cimg), the last one completed (pending_frame_) and
+    // a spare one for the next rendering (spare_frame_). The last two are
+    // exchanged atomically, so that neither side waits for the other
+    struct Frame {
+        std::vector<unsigned char> img;
+        std::vector<unsigned char> imgtrue;
+        int width;
+        int height;
+        int x;
+        int y;
+        int w;
+        int h;
+        int skip;
+    };
+    struct FrameParams {
+        rtengine::procparams::CropParams crop;
+        rtengine::procparams::ColorManagementParams color;
+    };
+    // accessed only with std::atomic_load/store/exchange
+    std::shared_ptr<Frame> pending_frame_;
+    std::shared_ptr<Frame> spare_frame_;
+    std::shared_ptr<FrameParams> pending_params_;
+
     std::shared_ptr<rtengine::StagedImageProcessor> ipc;
     rtengine::DetailedCrop *crop;
 
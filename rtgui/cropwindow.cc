@@ -1906,9 +1906,21 @@ void CropWindow::expose(Cairo::RefPtr<Cairo::Context> cr)
                 iarea->getImProcCoordinator().get());
             const bool mask_shown = ipc && ipc->is_mask_image();
 
+            // the crop pixbufs are replaced (not modified) on updates, so the
+            // focus mask computed for them stays valid while they are around
+            const bool focus_mask_cached =
+                showFocusMask && focus_mask_pixbuf_ &&
+                focus_mask_src_ == cropHandler.cropPixbuftrue;
+            if (!showFocusMask) {
+                focus_mask_pixbuf_.reset();
+                focus_mask_src_.reset();
+            }
+
             if (!mask_shown && (showcs || showch || showR || showG || showB ||
                                 showL || showFocusMask || showFalseColors)) {
-                Glib::RefPtr<Gdk::Pixbuf> tmp = cropHandler.cropPixbuf->copy();
+                Glib::RefPtr<Gdk::Pixbuf> tmp =
+                    focus_mask_cached ? focus_mask_pixbuf_
+                                      : cropHandler.cropPixbuf->copy();
                 guint8 *pix = tmp->get_pixels();
                 guint8 *pixWrkSpace = cropHandler.cropPixbuftrue->get_pixels();
 
@@ -1920,7 +1932,11 @@ void CropWindow::expose(Cairo::RefPtr<Cairo::Context> cr)
                 const int bWidth = tmp->get_width();
 
                 if (showFocusMask) { // modulate preview to display focus mask
-                    show_focus_mask(tmp, cropHandler.cropPixbuftrue);
+                    if (!focus_mask_cached) {
+                        show_focus_mask(tmp, cropHandler.cropPixbuftrue);
+                        focus_mask_pixbuf_ = tmp;
+                        focus_mask_src_ = cropHandler.cropPixbuftrue;
+                    }
                 } else if (showFalseColors) {
                     show_false_colors(tmp, cropHandler.cropPixbuftrue);
                 } else { // !showFocusMask
@@ -2622,9 +2638,8 @@ CropWindow::checkValidity(LockableColorPicker *picker,
         return LockableColorPicker::Validity::OUTSIDE;
     }
     rtengine::Coord cropTopLeft, cropBottomRight, cropSize;
-    int skip;
-    cropHandler.getWindow(cropTopLeft.x, cropTopLeft.y, cropSize.x, cropSize.y,
-                          skip);
+    cropHandler.getPosition(cropTopLeft.x, cropTopLeft.y);
+    cropHandler.getSize(cropSize.x, cropSize.y);
     cropBottomRight = cropTopLeft + cropSize;
     rtengine::Coord pickerPos, cropPickerPos;
     picker->getImagePosition(pickerPos);
@@ -2676,8 +2691,10 @@ void CropWindow::screenCoordToCropBuffer(int phyx, int phyy, int &cropx,
         cropy = cropy / czoom;
     }
 
-    cropx += crop->getLeftBorder();
-    cropy += crop->getUpperBorder();
+    int ox, oy;
+    cropHandler.getBufferOffset(ox, oy);
+    cropx += crop->getLeftBorder() + ox;
+    cropy += crop->getUpperBorder() + oy;
 }
 
 void CropWindow::screenCoordToCropBuffer(double phyx, double phyy,
@@ -2698,8 +2715,10 @@ void CropWindow::screenCoordToCropBuffer(double phyx, double phyy,
         cropy = cropy / czoom;
     }
 
-    cropx += double(crop->getLeftBorder());
-    cropy += double(crop->getUpperBorder());
+    int ox, oy;
+    cropHandler.getBufferOffset(ox, oy);
+    cropx += double(crop->getLeftBorder() + ox);
+    cropy += double(crop->getUpperBorder() + oy);
 }
 
 void CropWindow::screenCoordToImage(int phyx, int phyy, int &imgx, int &imgy)
@@ -2786,10 +2805,12 @@ void CropWindow::imageCoordToCropBuffer(int imgx, int imgy, int &phyx,
     int cropX, cropY;
     rtengine::Crop *crop = static_cast<rtengine::Crop *>(cropHandler.getCrop());
     cropHandler.getPosition(cropX, cropY);
+    int ox, oy;
+    cropHandler.getBufferOffset(ox, oy);
     phyx = (imgx - cropX) * zoomSteps[cropZoom].zoom +
-           /*xpos + imgX +*/ crop->getLeftBorder();
+           /*xpos + imgX +*/ crop->getLeftBorder() + ox;
     phyy = (imgy - cropY) * zoomSteps[cropZoom].zoom +
-           /*ypos + imgY +*/ crop->getUpperBorder();
+           /*ypos + imgY +*/ crop->getUpperBorder() + oy;
 }
 
 void CropWindow::imageCoordToCropBuffer(double imgx, double imgy, double &phyx,
@@ -2798,10 +2819,12 @@ void CropWindow::imageCoordToCropBuffer(double imgx, double imgy, double &phyx,
     int cropX, cropY;
     rtengine::Crop *crop = static_cast<rtengine::Crop *>(cropHandler.getCrop());
     cropHandler.getPosition(cropX, cropY);
+    int ox, oy;
+    cropHandler.getBufferOffset(ox, oy);
     phyx = (imgx - double(cropX)) * zoomSteps[cropZoom].zoom +
-           double(/*xpos + imgX +*/ crop->getLeftBorder());
+           double(/*xpos + imgX +*/ crop->getLeftBorder() + ox);
     phyy = (imgy - double(cropY)) * zoomSteps[cropZoom].zoom +
-           double(/*ypos + imgY +*/ crop->getUpperBorder());
+           double(/*ypos + imgY +*/ crop->getUpperBorder() + oy);
 }
 
 void CropWindow::imageCoordToCropImage(int imgx, int imgy, int &phyx, int &phyy)
@@ -161,6 +161,10 @@ class CropWindow: public LWButtonListener,
 
     AreaDrawUpdater *area_updater_;
 
+    // the last crop with the focus mask, reused until the crop is updated
+    Glib::RefPtr<Gdk::Pixbuf> focus_mask_pixbuf_;
+    Glib::RefPtr<Gdk::Pixbuf> focus_mask_src_;
+
 public:
     CropHandler cropHandler;
     CropWindow(ImageArea *parent, bool isLowUpdatePriority_,
@@ -25,6 +25,7 @@
 #include "../rtengine/imagesource.h"
 #include "../rtengine/imgiomanager.h"
 #include "../rtengine/improccoordinator.h"
+#include "../rtengine/previewimage.h"
 #include "../rtengine/processingjob.h"
 #include "fastexport.h"
 #include "guiutils.h"
@@ -931,6 +932,7 @@ EditorPanel::~EditorPanel()
         autosave_conn_.disconnect();
     }
 
+    clearPlaceholder();
     idle_register.destroy();
 
     history->setHistoryBeforeAfterListener(nullptr);
@@ -1185,6 +1187,67 @@ void EditorPanel::open(Thumbnail *tmb, rtengine::InitialImage *isrc)
     }
 }
 
+// the embedded preview is decoded in the background, and is discarded if the
+// panel is destroyed or another image is opened in the meantime
+class EditorPanel::PlaceholderLoader {
+public:
+    explicit PlaceholderLoader(EditorPanel *p): panel(p) {}
+
+    MyMutex mutex;
+    EditorPanel *panel;
+};
+
+void EditorPanel::showPlaceholder(Thumbnail *tmb)
+{
+    clearPlaceholder();
+
+    auto loader = std::make_shared<PlaceholderLoader>(this);
+    placeholder_loader_ = loader;
+
+    // a new panel has not been allocated yet: the preview is then decoded at
+    // the size of the main window, and scaled down when drawn
+    int w = iareapanel->imageArea->get_allocated_width();
+    int h = iareapanel->imageArea->get_allocated_height();
+    if (w <= 1 || h <= 1) {
+        w = options.windowWidth;
+        h = options.windowHeight;
+    }
+    const Glib::ustring fn = tmb->getFileName();
+    const bool enable_cms = options.thumbnail_inspector_enable_cms;
+
+    rtengine::ThreadPool::add_task(
+        rtengine::ThreadPool::Priority::HIGH,
+        [loader, fn, w, h, enable_cms]() -> void {
+            rtengine::PreviewImage pi(fn, getExtension(fn), w, h, enable_cms);
+            auto img = pi.getImage();
+
+            MyMutex::MyLock lock(loader->mutex);
+            if (img && loader->panel) {
+                loader->panel->idle_register.add([loader, img]() -> bool {
+                    // the panel is only detached in the GUI thread
+                    if (loader->panel) {
+                        loader->panel->iareapanel->imageArea->setPlaceholder(
+                            img);
+                    }
+                    return false;
+                });
+            }
+        });
+}
+
+void EditorPanel::clearPlaceholder()
+{
+    if (placeholder_loader_) {
+        MyMutex::MyLock lock(placeholder_loader_->mutex);
+        placeholder_loader_->panel = nullptr;
+    }
+    placeholder_loader_.reset();
+    if (iareapanel) {
+        iareapanel->imageArea->setPlaceholder(
+            Cairo::RefPtr<Cairo::ImageSurface>());
+    }
+}
+
 void EditorPanel::close()
 {
     if (ipc) {
@@ -1427,6 +1490,8 @@ void EditorPanel::refreshProcessingState(bool inProcessingP)
         val = 0.0;
         str = "PROGRESSBAR_READY";
 
+        clearPlaceholder();
+
 #ifdef WIN32
 
         // Maybe accessing "parent", which is a Gtk object, can justify to get
@@ -61,6 +61,9 @@ public:
     ~EditorPanel() override;
 
     void open(Thumbnail *tmb, rtengine::InitialImage *isrc);
+    // shows the embedded preview of the image being loaded, until the first
+    // processing of the image opened with open() is done
+    void showPlaceholder(Thumbnail *tmb);
     void setAspect();
     void on_realize() override;
     void leftPaneButtonReleased(GdkEventButton *event);
@@ -287,4 +290,8 @@ private:
     sigc::connection autosave_conn_;
 
     std::unique_ptr<ToolShortcutManager> shortcut_mgr_;
+
+    class PlaceholderLoader;
+    std::shared_ptr<PlaceholderLoader> placeholder_loader_;
+    void clearPlaceholder();
 };
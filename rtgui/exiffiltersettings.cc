@@ -51,6 +51,28 @@ void ExifFilterSettings::clear()
     filterDate = false;
 }
 
+bool ExifFilterSettings::operator==(const ExifFilterSettings &other) const
+{
+    return filetypes == other.filetypes && cameras == other.cameras &&
+           lenses == other.lenses && orientations == other.orientations &&
+           expcomp == other.expcomp && fnumberFrom == other.fnumberFrom &&
+           fnumberTo == other.fnumberTo && shutterFrom == other.shutterFrom &&
+           shutterTo == other.shutterTo && focalFrom == other.focalFrom &&
+           focalTo == other.focalTo && isoFrom == other.isoFrom &&
+           isoTo == other.isoTo && dateFrom == other.dateFrom &&
+           dateTo == other.dateTo && enabled == other.enabled &&
+           filterFNumber == other.filterFNumber &&
+           filterShutter == other.filterShutter &&
+           filterFocalLen == other.filterFocalLen &&
+           filterISO == other.filterISO &&
+           filterExpComp == other.filterExpComp &&
+           filterCamera == other.filterCamera &&
+           filterLens == other.filterLens &&
+           filterOrientation == other.filterOrientation &&
+           filterFiletype == other.filterFiletype &&
+           filterDate == other.filterDate;
+}
+
 void ExifFilterSettings::load(const Glib::KeyFile &kf,
                               const Glib::ustring &group)
 {
@@ -57,6 +57,12 @@ public:
     ExifFilterSettings();
     void clear();
 
+    bool operator==(const ExifFilterSettings &other) const;
+    bool operator!=(const ExifFilterSettings &other) const
+    {
+        return !(*this == other);
+    }
+
     void load(const Glib::KeyFile &kf, const Glib::ustring &group);
     void save(Glib::KeyFile &kf, const Glib::ustring &group) const;
 };
@@ -32,10 +32,10 @@ Exposure::Exposure()
                         true)
 {
     auto m = ProcEventMapper::getInstance();
-    EvToolEnabled.set_action(rtengine::DARKFRAME);
-    EvToolReset.set_action(rtengine::DARKFRAME);
+    EvToolEnabled.set_action(rtengine::ALLNORAW);
+    EvToolReset.set_action(rtengine::ALLNORAW);
     EvBlack = m->newEvent(rtengine::AUTOEXP, "HISTORY_MSG_EXPOSURE_BLACK");
-    EvHRBlur = m->newEvent(rtengine::DARKFRAME, "HISTORY_MSG_EXPOSURE_HRBLUR");
+    EvHRBlur = m->newEvent(rtengine::ALLNORAW, "HISTORY_MSG_EXPOSURE_HRBLUR");
 
     //-------------- Highlight Reconstruction -----------------
     hrmode = Gtk::manage(new MyComboBoxText());
@@ -21,6 +21,7 @@
 #include "filebrowser.h"
 #include "../rtengine/dfmanager.h"
 #include "../rtengine/ffmanager.h"
+#include "../rtengine/threadpool.h"
 #include "batchqueue.h"
 #include "clipboard.h"
 #include "multilangmgr.h"
@@ -30,7 +31,13 @@
 #include "session.h"
 #include "threadutils.h"
 #include <glibmm.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 extern Options options;
 
@@ -229,13 +236,34 @@ private:
     Options::ThumbnailOrder order_;
 };
 
+// state of a bulk write of sidecar files, shared by the background tasks
+class BulkSaveState: public rtengine::ProgressListener {
+public:
+    explicit BulkSaveState(size_t total): total(total), done(0) {}
+
+    void setProgress(double p) override {}
+    void setProgressStr(const Glib::ustring &str) override {}
+    void setProgressState(bool inProcessing) override {}
+    void error(const Glib::ustring &descr) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        errors.push_back(descr);
+    }
+
+    const size_t total;
+    std::atomic<size_t> done;
+    std::mutex mutex;
+    std::vector<Glib::ustring> errors;
+};
+
 } // namespace
 
 FileBrowser::FileBrowser()
     : menuLabel(nullptr), selectDF(nullptr), thisIsDF(nullptr), autoDF(nullptr),
       selectFF(nullptr), thisIsFF(nullptr), autoFF(nullptr),
       clearFromCache(nullptr), clearFromCacheFull(nullptr),
-      colorLabel_actionData(nullptr), tbl(nullptr), numFiltered(-1)
+      colorLabel_actionData(nullptr), tbl(nullptr), numFiltered(-1),
+      query_filter_gen_(1), exif_filter_gen_(1), query_match_equal_(true)
 {
     session_id_ = 0;
     last_selected_fname_ = "";
@@ -568,6 +596,11 @@ void FileBrowser::build_menu()
                              new Gtk::MenuItem(M("FILEBROWSER_CLEARPROFILE"))),
             0, 1, p, p + 1);
         p++;
+        submenuProfileOperations->attach(
+            *Gtk::manage(filmnegroll = new Gtk::MenuItem(
+                             M("FILEBROWSER_FILMNEGATIVEROLL"))),
+            0, 1, p, p + 1);
+        p++;
 
         submenuProfileOperations->show_all();
         menuProfileOperations->set_submenu(*submenuProfileOperations);
@@ -600,6 +633,10 @@ void FileBrowser::build_menu()
                                        M("FILEBROWSER_CLEARPROFILE"))),
                       0, 1, p, p + 1);
         p++;
+        pmenu->attach(*Gtk::manage(filmnegroll = new Gtk::MenuItem(
+                                       M("FILEBROWSER_FILMNEGATIVEROLL"))),
+                      0, 1, p, p + 1);
+        p++;
     }
 
     pmenu->attach(*Gtk::manage(new Gtk::SeparatorMenuItem()), 0, 1, p, p + 1);
@@ -711,6 +748,8 @@ void FileBrowser::build_menu()
                    resetdefaultprof));
     clearprof->signal_activate().connect(sigc::bind(
         sigc::mem_fun(*this, &FileBrowser::menuItemActivated), clearprof));
+    filmnegroll->signal_activate().connect(sigc::bind(
+        sigc::mem_fun(*this, &FileBrowser::menuItemActivated), filmnegroll));
     cachemenu->signal_activate().connect(sigc::bind(
         sigc::mem_fun(*this, &FileBrowser::menuItemActivated), cachemenu));
 
@@ -795,6 +834,7 @@ void FileBrowser::rightClicked(ThumbBrowserEntryBase *entry)
         partpasteprof->set_sensitive(clipboard.hasProcParams());
         copyprof->set_sensitive(selected.size() == 1);
         clearprof->set_sensitive(!selected.empty());
+        filmnegroll->set_sensitive(!selected.empty());
         copyTo->set_sensitive(!selected.empty());
         // moveTo->set_sensitive (!selected.empty());
     }
@@ -1009,6 +1049,81 @@ void FileBrowser::menuColorlabelActivated(Gtk::MenuItem *m)
         }
 }
 
+void FileBrowser::balanceFilmNegativeRoll(
+    const std::vector<FileBrowserEntry *> &mselected)
+{
+    struct Frame {
+        Thumbnail *thumb;
+        bool isRaw;
+        rtengine::procparams::ProcParams params;
+    };
+
+    // only the frames with the film negative tool enabled (and not in the
+    // legacy modes, which use the reference values differently)
+    std::vector<Frame> frames;
+    for (auto e : mselected) {
+        Thumbnail *t = e->thumbnail;
+        const auto params = t->getProcParams();
+        if (params.filmNegative.enabled &&
+            params.filmNegative.backCompat ==
+                rtengine::procparams::FilmNegativeParams::BackCompat::CURRENT) {
+            t->increaseRef();
+            frames.push_back({t, t->getType() == FT_Raw, params});
+        }
+    }
+
+    if (frames.empty()) {
+        return;
+    }
+
+    // the estimate needs a demosaic of each frame, so it is done in the
+    // background. The result is the median of the per-frame estimates, which
+    // is not thrown off by a few frames with unusual content
+    rtengine::ThreadPool::add_task(
+        rtengine::ThreadPool::Priority::LOW, [this, frames]() -> void {
+            std::vector<float> r, g, b;
+            for (auto &f : frames) {
+                rtengine::procparams::FilmNegativeParams::RGB ref;
+                if (rtengine::estimateFilmNegativeReference(
+                        f.thumb->getFileName(), f.isRaw, f.params, ref)) {
+                    r.push_back(ref.r);
+                    g.push_back(ref.g);
+                    b.push_back(ref.b);
+                }
+            }
+
+            const auto median = [](std::vector<float> &v) -> float {
+                std::nth_element(v.begin(), v.begin() + v.size() / 2,
+                                 v.end());
+                return v[v.size() / 2];
+            };
+            const bool ok = !g.empty();
+            rtengine::procparams::FilmNegativeParams::RGB roll = {0.f, 0.f,
+                                                                  0.f};
+            if (ok) {
+                roll = {median(r), median(g), median(b)};
+                if (options.rtSettings.verbose) {
+                    std::cout << "Film negative roll reference from "
+                              << g.size() << " frames: R=" << roll.r
+                              << " G=" << roll.g << " B=" << roll.b
+                              << std::endl;
+                }
+            }
+
+            idle_register.add([frames, ok, roll]() -> bool {
+                for (auto &f : frames) {
+                    if (ok) {
+                        auto params = f.thumb->getProcParams();
+                        params.filmNegative.refInput = roll;
+                        f.thumb->setProcParams(params, FILEBROWSER);
+                    }
+                    f.thumb->decreaseRef();
+                }
+                return false;
+            });
+        });
+}
+
 void FileBrowser::menuItemActivated(Gtk::MenuItem *m)
 {
     std::vector<FileBrowserEntry *> mselected;
@@ -1248,6 +1363,8 @@ void FileBrowser::menuItemActivated(Gtk::MenuItem *m)
         }
 
         queue_draw();
+    } else if (m == filmnegroll) {
+        balanceFilmNegativeRoll(mselected);
     } else if (m == resetdefaultprof) {
         for (size_t i = 0; i < mselected.size(); i++) {
             mselected[i]->thumbnail->createProcParamsForUpdate(false, true);
@@ -1291,6 +1408,78 @@ void FileBrowser::copyProfile()
     }
 }
 
+void FileBrowser::applyProfile(const std::vector<FileBrowserEntry *> &entries,
+                               const rtengine::procparams::PartialProfile &pp,
+                               bool for_update)
+{
+    // the params are set here, so that the thumbnails are queued for
+    // re-rendering right away, but writing thousands of sidecar files on the
+    // GUI thread would freeze it, so they are written in the background
+    std::vector<Thumbnail *> thumbs;
+    thumbs.reserve(entries.size());
+    for (auto e : entries) {
+        Thumbnail *t = e->thumbnail;
+        if (for_update) {
+            t->createProcParamsForUpdate(false, false);
+        }
+        t->setProcParams(pp, FILEBROWSER, false);
+        t->increaseRef();
+        thumbs.push_back(t);
+    }
+
+    queue_draw();
+
+    if (thumbs.empty()) {
+        return;
+    }
+
+    auto pl = cacheMgr->getProgressListener();
+    if (pl) {
+        pl->setProgressState(true);
+        pl->setProgress(0);
+    }
+
+    auto state = std::make_shared<BulkSaveState>(thumbs.size());
+    const size_t nchunks =
+        std::min(thumbs.size(),
+                 size_t(std::max(std::thread::hardware_concurrency(), 1u)));
+    for (size_t c = 0; c < nchunks; ++c) {
+        std::vector<Thumbnail *> chunk(
+            thumbs.begin() + c * thumbs.size() / nchunks,
+            thumbs.begin() + (c + 1) * thumbs.size() / nchunks);
+        rtengine::ThreadPool::add_task(
+            rtengine::ThreadPool::Priority::LOW,
+            [this, state, chunk, pl]() -> void {
+                for (auto t : chunk) {
+                    t->updateCacheAsync(state.get());
+                }
+                const size_t done = state->done += chunk.size();
+
+                idle_register.add([state, chunk, pl, done]() -> bool {
+                    for (auto t : chunk) {
+                        t->decreaseRef();
+                    }
+                    if (!pl) {
+                        return false;
+                    }
+                    pl->setProgress(double(done) / state->total);
+                    if (done == state->total) {
+                        pl->setProgressState(false);
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        if (!state->errors.empty()) {
+                            Glib::ustring msg;
+                            for (auto &e : state->errors) {
+                                msg += (msg.empty() ? "" : "\n") + e;
+                            }
+                            pl->error(msg);
+                        }
+                    }
+                    return false;
+                });
+            });
+    }
+}
+
 void FileBrowser::pasteProfile()
 {
 
@@ -1309,15 +1498,11 @@ void FileBrowser::pasteProfile()
             return;
         }
 
-        for (unsigned int i = 0; i < mselected.size(); i++) {
-            // applying the PartialProfile to the thumb's ProcParams
-            mselected[i]->thumbnail->setProcParams(
-                rtengine::procparams::FullPartialProfile(
-                    clipboard.getProcParams()),
-                FILEBROWSER);
-        }
-
-        queue_draw();
+        // applying the PartialProfile to the thumb's ProcParams
+        applyProfile(mselected,
+                     rtengine::procparams::FullPartialProfile(
+                         clipboard.getProcParams()),
+                     false);
     }
 }
 
@@ -1349,17 +1534,11 @@ void FileBrowser::partPasteProfile()
         int i = partial_paste_dlg_->run();
 
         if (i == Gtk::RESPONSE_OK) {
-            for (unsigned int i = 0; i < mselected.size(); i++) {
-                mselected[i]->thumbnail->createProcParamsForUpdate(false,
-                                                                   false);
-                const auto &pp = clipboard.getProcParams();
-                auto ped = partial_paste_dlg_->getParamsEdited();
-                mselected[i]->thumbnail->setProcParams(
-                    rtengine::procparams::PEditedPartialProfile(pp, ped),
-                    FILEBROWSER);
-            }
-
-            queue_draw();
+            const auto &pp = clipboard.getProcParams();
+            auto ped = partial_paste_dlg_->getParamsEdited();
+            applyProfile(mselected,
+                         rtengine::procparams::PEditedPartialProfile(pp, ped),
+                         true);
         }
 
         partial_paste_dlg_->hide();
@@ -1552,12 +1731,11 @@ void FileBrowser::applyMenuItemActivated(ProfileStoreLabel *label)
         ProfileStore::getInstance()->getProfile(label->entry);
 
     if (partProfile /*->pparams*/ && !selected.empty()) {
+        std::vector<FileBrowserEntry *> mselected;
         for (size_t i = 0; i < selected.size(); i++) {
-            (static_cast<FileBrowserEntry *>(selected[i]))
-                ->thumbnail->setProcParams(*partProfile, FILEBROWSER);
+            mselected.push_back(static_cast<FileBrowserEntry *>(selected[i]));
         }
-
-        queue_draw();
+        applyProfile(mselected, *partProfile, false);
     }
 }
 
@@ -1586,18 +1764,17 @@ void FileBrowser::applyPartialMenuItemActivated(ProfileStoreLabel *label)
         if (partial_paste_dlg_->run() == Gtk::RESPONSE_OK) {
             MYREADERLOCK(l, entryRW);
 
+            std::vector<FileBrowserEntry *> mselected;
             for (size_t i = 0; i < selected.size(); i++) {
-                selected[i]->thumbnail->createProcParamsForUpdate(false, false);
-                rtengine::procparams::ProcParams pp;
-                srcProfiles->applyTo(pp);
-                auto pe = partial_paste_dlg_->getParamsEdited();
-                (static_cast<FileBrowserEntry *>(selected[i]))
-                    ->thumbnail->setProcParams(
-                        rtengine::procparams::PEditedPartialProfile(pp, pe),
-                        FILEBROWSER);
+                mselected.push_back(
+                    static_cast<FileBrowserEntry *>(selected[i]));
             }
-
-            queue_draw();
+            rtengine::procparams::ProcParams pp;
+            srcProfiles->applyTo(pp);
+            auto pe = partial_paste_dlg_->getParamsEdited();
+            applyProfile(mselected,
+                         rtengine::procparams::PEditedPartialProfile(pp, pe),
+                         true);
         }
 
         partial_paste_dlg_->hide();
@@ -1610,6 +1787,41 @@ void FileBrowser::applyFilter(const BrowserFilter &filter)
         last_selected_fname_ = selected.back()->thumbnail->getFileName();
     }
 
+    // the cached results of the query and of the EXIF filter are only
+    // recomputed if these changed
+    if (filter.queryFileName != this->filter.queryFileName) {
+        ++query_filter_gen_;
+
+        // Determine the match mode - check if the first 2 characters are
+        // equal to "!="
+        Glib::ustring decodedQueryFileName;
+        if (filter.queryFileName.find("!=") == 0) {
+            decodedQueryFileName = filter.queryFileName.substr(
+                2, filter.queryFileName.length() - 2);
+            query_match_equal_ = false;
+        } else {
+            decodedQueryFileName = filter.queryFileName;
+            query_match_equal_ = true;
+        }
+
+        // Consider that queryFileName consist of comma separated values
+        // (FilterString). This will construct OR filter within the
+        // filter.queryFileName. Empty FilterStrings are ignored, otherwise
+        // the filter would always match e.g. if filter.queryFileName ends on
+        // ","
+        query_strings_.clear();
+        for (auto &s :
+             Glib::Regex::split_simple(",", decodedQueryFileName.uppercase())) {
+            if (!s.empty()) {
+                query_strings_.push_back(s);
+            }
+        }
+    }
+    if (filter.exifFilterEnabled != this->filter.exifFilterEnabled ||
+        filter.exifFilter != this->filter.exifFilter) {
+        ++exif_filter_gen_;
+    }
+
     this->filter = filter;
 
     // remove items not complying the filter from the selection
@@ -1705,79 +1917,72 @@ bool FileBrowser::checkFilter(
         return false;
     }
 
-    // return false is query is not satisfied
+    // the results of the query and of the EXIF filter are cached in the
+    // entry, as they don't depend on anything that can be edited
     if (!filter.queryFileName.empty()) {
-        // check if image's FileName contains queryFileName (case insensitive)
-        // TODO should we provide case-sensitive search option via preferences?
-        Glib::ustring FileName;
-        FileName = Glib::path_get_basename(entry->thumbnail->getFileName());
-        FileName = FileName.uppercase();
-        // printf("FileBrowser::checkFilter FileName = '%s'; find() result= %i
-        // \n",FileName.c_str(),
-        // FileName.find(filter.queryFileName.uppercase()));
+        if (entry->query_filter_gen != query_filter_gen_) {
+            entry->query_filter_ok = checkQueryFilter(entry);
+            entry->query_filter_gen = query_filter_gen_;
+        }
+        if (!entry->query_filter_ok) {
+            return false;
+        }
+    }
 
-        Glib::ustring decodedQueryFileName;
-        bool MatchEqual;
+    if (!filter.exifFilterEnabled) {
+        return true;
+    }
 
-        // Determine the match mode - check if the first 2 characters are equal
-        // to "!="
-        if (filter.queryFileName.find("!=") == 0) {
-            decodedQueryFileName = filter.queryFileName.substr(
-                2, filter.queryFileName.length() - 2);
-            MatchEqual = false;
-        } else {
-            decodedQueryFileName = filter.queryFileName;
-            MatchEqual = true;
-        }
+    if (entry->exif_filter_gen != exif_filter_gen_) {
+        entry->exif_filter_ok = checkExifFilter(entry);
+        entry->exif_filter_gen = exif_filter_gen_;
+    }
+    return entry->exif_filter_ok;
+}
 
-        // Consider that queryFileName consist of comma separated values
-        // (FilterString) Evaluate if ANY of these FilterString are contained in
-        // the filename This will construct OR filter within the
-        // filter.queryFileName
-        int iFilenameMatch = 0;
-        std::vector<Glib::ustring> vFilterStrings =
-            Glib::Regex::split_simple(",", decodedQueryFileName.uppercase());
-
-        for (size_t i = 0; i < vFilterStrings.size(); i++) {
-            // ignore empty vFilterStrings. Otherwise filter will always return
-            // true if e.g. filter.queryFileName ends on "," and will stop being
-            // a filter
-            if (!vFilterStrings.at(i).empty()) {
-                if (FileName.find(vFilterStrings.at(i)) !=
-                    Glib::ustring::npos) {
-                    iFilenameMatch++;
-                }
-            }
-        }
+bool FileBrowser::checkQueryFilter(FileBrowserEntry *entry)
+{
+    // check if image's FileName contains queryFileName (case insensitive)
+    // TODO should we provide case-sensitive search option via preferences?
+    if (entry->upper_basename.empty()) {
+        entry->upper_basename =
+            Glib::path_get_basename(entry->thumbnail->getFileName())
+                .uppercase();
+    }
+    const Glib::ustring &FileName = entry->upper_basename;
 
-        if (MatchEqual) {
-            if (iFilenameMatch ==
-                0) { // none of the vFilterStrings found in FileName
-                return false;
-            }
-        } else {
-            if (iFilenameMatch > 0) { // match is found for at least one of
-                                      // vFilterStrings in FileName
-                return false;
-            }
+    // Evaluate if ANY of the FilterString are contained in the filename (see
+    // applyFilter())
+    int iFilenameMatch = 0;
+
+    for (size_t i = 0; i < query_strings_.size(); i++) {
+        if (FileName.find(query_strings_[i]) != Glib::ustring::npos) {
+            iFilenameMatch++;
         }
+    }
 
-        /*experimental Regex support, this is unlikely to be useful to
-         * photographers*/
-        // bool
-        // matchfound=Glib::Regex::match_simple(filter.queryFileName.uppercase(),FileName);
-        // if (!matchfound) return false;
+    if (query_match_equal_) {
+        // none of the vFilterStrings found in FileName
+        return iFilenameMatch > 0;
+    } else {
+        // match is found for at least one of vFilterStrings in FileName
+        return iFilenameMatch == 0;
     }
 
+    /*experimental Regex support, this is unlikely to be useful to
+     * photographers*/
+    // bool
+    // matchfound=Glib::Regex::match_simple(filter.queryFileName.uppercase(),FileName);
+    // if (!matchfound) return false;
+}
+
+bool FileBrowser::checkExifFilter(FileBrowserEntry *entry)
+{
     // check exif filter
     const CacheImageData *cfs = entry->thumbnail->getCacheImageData();
     double tol = 0.01;
     double tol2 = 1e-8;
 
-    if (!filter.exifFilterEnabled) {
-        return true;
-    }
-
     Glib::ustring camera(cfs->getCamera());
 
     if (!cfs->exifValid)
@@ -2167,6 +2372,35 @@ void FileBrowser::openPrevImage()
     }
 }
 
+std::vector<Thumbnail *>
+FileBrowser::getAdjacentImages(const Glib::ustring &fname)
+{
+    MYREADERLOCK(l, entryRW);
+
+    std::vector<Thumbnail *> ret;
+    for (size_t i = 0; i < fd.size(); i++) {
+        if (fd[i]->filename == fname) {
+            // the next image first, as it's the most likely to be requested
+            for (size_t k = i + 1; k < fd.size(); k++) {
+                if (!fd[k]->filtered) {
+                    ret.push_back(
+                        static_cast<FileBrowserEntry *>(fd[k])->thumbnail);
+                    break;
+                }
+            }
+            for (size_t k = i; k > 0; k--) {
+                if (!fd[k - 1]->filtered) {
+                    ret.push_back(
+                        static_cast<FileBrowserEntry *>(fd[k - 1])->thumbnail);
+                    break;
+                }
+            }
+            break;
+        }
+    }
+    return ret;
+}
+
 void FileBrowser::selectImage(const Glib::ustring &fname)
 {
     MYWRITERLOCK(l, entryRW);
@@ -66,6 +66,13 @@ private:
     IdleRegister idle_register;
     unsigned int session_id_;
 
+    // sets the params of the entries, and writes their sidecar files in the
+    // background. If for_update is true, the params are created first if
+    // the entries don't have them yet
+    void applyProfile(const std::vector<FileBrowserEntry *> &entries,
+                      const rtengine::procparams::PartialProfile &pp,
+                      bool for_update);
+
 protected:
     Gtk::MenuItem *rank[6];
     MyImageMenuItem *colorlabel[6];
@@ -109,6 +116,7 @@ protected:
     Gtk::MenuItem *applypartprof;
     Gtk::MenuItem *resetdefaultprof;
     Gtk::MenuItem *clearprof;
+    Gtk::MenuItem *filmnegroll;
     Gtk::MenuItem *cachemenu;
     Gtk::MenuItem *clearFromCache;
     Gtk::MenuItem *clearFromCacheFull;
@@ -126,6 +134,16 @@ protected:
     FileBrowserListener *tbl;
     BrowserFilter filter;
     int numFiltered;
+    // generations of the file name query and of the EXIF filter, incremented
+    // when they change (see FileBrowserEntry::query_filter_gen)
+    unsigned int query_filter_gen_;
+    unsigned int exif_filter_gen_;
+    // the file name query, parsed once per change
+    std::vector<Glib::ustring> query_strings_;
+    bool query_match_equal_;
+
+    bool checkQueryFilter(FileBrowserEntry *entry);
+    bool checkExifFilter(FileBrowserEntry *entry);
     Glib::ustring last_selected_fname_;
     std::unique_ptr<PartialPasteDlg> partial_paste_dlg_;
 
@@ -139,6 +157,10 @@ protected:
     void requestColorLabel(int colorlabel);
     void notifySelectionListener();
     void openRequested(std::vector<FileBrowserEntry *> mselected);
+    // sets the film negative reference input of the selected frames to a
+    // single estimate for the whole roll, computed in the background
+    void balanceFilmNegativeRoll(
+        const std::vector<FileBrowserEntry *> &mselected);
 
     type_trash_changed m_trash_changed;
 
@@ -183,6 +205,9 @@ public:
 
     void openNextImage();
     void openPrevImage();
+    // the images that openNextImage()/openPrevImage() would open when fname
+    // is the current one
+    std::vector<Thumbnail *> getAdjacentImages(const Glib::ustring &fname);
     void copyProfile();
     void pasteProfile();
     void partPasteProfile();
@@ -41,7 +41,8 @@ Glib::RefPtr<Gdk::Pixbuf> FileBrowserEntry::ps;
 FileBrowserEntry::FileBrowserEntry(Thumbnail *thm, const Glib::ustring &fname)
     : ThumbBrowserEntryBase(fname), wasInside(false), press_x(0), press_y(0),
       action_x(0), action_y(0), rot_deg(0.0), coarse_rotate(0), cropgl(nullptr),
-      state(SNormal), crop_custom_ratio(0.f)
+      state(SNormal), crop_custom_ratio(0.f), query_filter_gen(0),
+      query_filter_ok(true), exif_filter_gen(0), exif_filter_ok(true)
 {
     refresh_status_ = RefreshStatus::READY;
     refresh_disabled_ = true;
@@ -242,6 +243,27 @@ void FileBrowserEntry::procParamsChanged(Thumbnail *thm, int whoChangedIt)
     // }
 }
 
+guint8 *FileBrowserEntry::getRenderedImage(
+    const rtengine::procparams::ProcParams &pparams, int min_h, int &w, int &h)
+{
+    MYREADERLOCK(l, lockRW);
+
+    // the preview is cleared when the params change, and the quick
+    // thumbnails don't depend on them
+    if (!thumbnail || thumbnail->isQuick() ||
+        refresh_status_ != RefreshStatus::READY || preh < min_h ||
+        preview.empty() || preview.size() != size_t(prew * preh * 3) ||
+        thumbnail->getProcParams() != pparams) {
+        return nullptr;
+    }
+
+    w = prew;
+    h = preh;
+    guint8 *ret = new guint8[preview.size()];
+    std::copy(preview.begin(), preview.end(), ret);
+    return ret;
+}
+
 void FileBrowserEntry::updateImage(
     rtengine::IImage8 *img, double scale,
     const rtengine::procparams::CropParams &cropParams)
@@ -273,6 +295,13 @@ void FileBrowserEntry::updateImage(
         G_PRIORITY_LOW);
 }
 
+void FileBrowserEntry::updateCancelled()
+{
+    // requested again when the entry is drawn. The updater holds its lock,
+    // so the entry can't be destroyed meanwhile (see removeJobs())
+    refresh_status_ = RefreshStatus::FULL;
+}
+
 void FileBrowserEntry::_updateImage(
     rtengine::IImage8 *img, double s,
     const rtengine::procparams::CropParams &cropParams)
@@ -78,6 +78,15 @@ public:
     static Glib::RefPtr<Gdk::Pixbuf> hdr;
     static Glib::RefPtr<Gdk::Pixbuf> ps;
 
+    // results of the file name query and of the EXIF filter, which depend
+    // only on data of the file that can't be edited. They are valid if the
+    // generation matches the one of the browser (see FileBrowser::checkFilter)
+    unsigned int query_filter_gen;
+    bool query_filter_ok;
+    unsigned int exif_filter_gen;
+    bool exif_filter_ok;
+    Glib::ustring upper_basename; // for the file name query, computed lazily
+
     FileBrowserEntry(Thumbnail *thm, const Glib::ustring &fname);
     ~FileBrowserEntry() override;
     static void init();
@@ -96,10 +105,13 @@ public:
 
     // thumbnaillistener interface
     void procParamsChanged(Thumbnail *thm, int whoChangedIt) override;
+    guint8 *getRenderedImage(const rtengine::procparams::ProcParams &pparams,
+                             int min_h, int &w, int &h) override;
     // thumbimageupdatelistener interface
     void
     updateImage(rtengine::IImage8 *img, double scale,
                 const rtengine::procparams::CropParams &cropParams) override;
+    void updateCancelled() override;
     void _updateImage(rtengine::IImage8 *img, double scale,
                       const rtengine::procparams::CropParams
                           &cropParams); // inside gtk thread
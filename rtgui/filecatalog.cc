@@ -19,6 +19,7 @@
  */
 #include "filecatalog.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -28,11 +29,13 @@
 #include "../rtengine/rt_math.h"
 
 #include "../rtengine/imagedata.h"
+#include "../rtengine/metadata.h"
 #include "batchqueue.h"
 #include "cachemanager.h"
 #include "fastexport.h"
 #include "filepanel.h"
 #include "guiutils.h"
+#include "imageprefetcher.h"
 #include "multilangmgr.h"
 #include "options.h"
 #include "placesbrowser.h"
@@ -148,7 +151,7 @@ FileCatalog::FileCatalog(FilePanel *filepanel)
       actionNextPrevious(NAV_NONE), listener(nullptr), fslistener(nullptr),
       hbToolBar1STB(nullptr), hasValidCurrentEFS(false), filterPanel(nullptr),
       filter_panel_update_(false), previewsToLoad(0), previewsLoaded(0),
-      modifierKey(0), bqueue_(nullptr)
+      modifierKey(0), session_version_(0), bqueue_(nullptr)
 {
     inTabMode = false;
 
@@ -804,6 +807,7 @@ void FileCatalog::closeDir()
     if (dir_refresh_conn_.connected()) {
         dir_refresh_conn_.disconnect();
     }
+    dir_changes_.clear();
     if (dirMonitor) {
         dirMonitor->cancel();
     }
@@ -818,6 +822,9 @@ void FileCatalog::closeDir()
     // terminate thumbnail updater
     thumbImageUpdater->removeAllJobs();
 
+    // release the images loaded in advance for the editor
+    imagePrefetcher->clear();
+
     // remove entries
     selectedDirectory = "";
     fileBrowser->close();
@@ -962,6 +969,7 @@ std::vector<Glib::ustring> FileCatalog::getFileList(bool recursive)
     try {
         if (art::session::check(selectedDirectory)) {
             names = art::session::list();
+            session_version_ = art::session::version();
         } else {
             const auto dir = Gio::File::create_for_path(selectedDirectory);
 
@@ -1081,6 +1089,9 @@ void FileCatalog::dirSelected(const Glib::ustring &dirname,
         const bool recursive = !is_session && button_recurse_->get_active();
 
         fileNameList = getFileList(recursive);
+        // warm up the metadata cache shared by the thumbnails, the filters
+        // and the editor
+        rtengine::Exiv2Metadata::prefetch(fileNameList);
 
         // if openfile exists, we have to open it first (it is a command line
         // argument)
@@ -1088,14 +1099,17 @@ void FileCatalog::dirSelected(const Glib::ustring &dirname,
             addAndOpenFile(openfile, true);
         }
 
+        std::vector<Glib::ustring> to_add;
+        to_add.reserve(fileNameList.size());
         for (unsigned int i = 0; i < fileNameList.size(); i++) {
             file_name_set_.insert(fileNameList[i]);
             if (openfile.empty() ||
                 fileNameList[i] != openfile) { // if we opened a file at the
                                                // beginning don't add it again
-                addFile(fileNameList[i]);
+                to_add.push_back(fileNameList[i]);
             }
         }
+        addFiles(to_add);
 
         _refreshProgressBar();
 
@@ -1984,13 +1998,18 @@ void FileCatalog::reparseDirectory()
     fileNameList = std::move(new_file_list);
     file_name_set_.clear();
 
+    std::vector<Glib::ustring> to_add;
     for (const auto &newName : fileNameList) {
         file_name_set_.insert(newName);
         if (seen.find(newName.collate_key()) == seen.end()) {
-            addFile(newName);
-            _refreshProgressBar();
+            to_add.push_back(newName);
         }
     }
+
+    if (!to_add.empty()) {
+        addFiles(to_add);
+        _refreshProgressBar();
+    }
 }
 
 void FileCatalog::on_dir_changed(const Glib::RefPtr<Gio::File> &file,
@@ -1998,25 +2017,163 @@ void FileCatalog::on_dir_changed(const Glib::RefPtr<Gio::File> &file,
                                  Gio::FileMonitorEvent event_type)
 {
     if (art::session::check(selectedDirectory)) {
-        GThreadLock lock;
-        reparseDirectory();
+        // the session file was written, its list is read again in
+        // processDirChanges()
     } else if (options.has_retained_extention(file->get_parse_name()) &&
                (event_type == Gio::FILE_MONITOR_EVENT_CREATED ||
                 event_type == Gio::FILE_MONITOR_EVENT_DELETED ||
                 event_type == Gio::FILE_MONITOR_EVENT_CHANGED)) {
+        // sidecars and other files which are not images (e.g. the ones
+        // written by ART itself) don't get here
+        bool &changed = dir_changes_[file->get_parse_name()];
+        changed = changed || event_type == Gio::FILE_MONITOR_EVENT_CHANGED;
+    } else {
+        return;
+    }
+
+    // the timer is not restarted by the following events, so that files
+    // written continuously (e.g. when tethering) still show up regularly
+    if (!dir_refresh_conn_.connected()) {
         const auto doit = [this]() -> bool {
             GThreadLock lock;
-            reparseDirectory();
+            processDirChanges();
             return false;
         };
-        if (dir_refresh_conn_.connected()) {
-            dir_refresh_conn_.disconnect();
-        }
         dir_refresh_conn_ = Glib::signal_timeout().connect(
             sigc::slot<bool>(doit), DIR_REFRESH_DELAY);
     }
 }
 
+void FileCatalog::processDirChanges()
+{
+    std::map<Glib::ustring, bool> changes;
+    changes.swap(dir_changes_);
+
+    if (selectedDirectory.empty()) {
+        return;
+    }
+    if (art::session::check(selectedDirectory)) {
+        if (!processSessionChanges()) {
+            reparseDirectory();
+        }
+        return;
+    } else if (!Glib::file_test(selectedDirectory, Glib::FILE_TEST_IS_DIR)) {
+        reparseDirectory();
+        return;
+    }
+
+    const auto is_hidden = [](const Glib::ustring &fname) -> bool {
+        try {
+            auto info = Gio::File::create_for_path(fname)->query_info(
+                "standard::is-hidden");
+            return info && info->is_hidden();
+        } catch (Glib::Exception &) {
+            return false;
+        }
+    };
+
+    std::vector<Glib::ustring> to_add;
+    std::set<Glib::ustring> removed;
+    bool refresh = false;
+
+    for (const auto &c : changes) {
+        const Glib::ustring &fname = c.first;
+        const bool known = file_name_set_.count(fname);
+        const bool exists = Glib::file_test(fname, Glib::FILE_TEST_IS_REGULAR);
+
+        if (known && exists && !c.second) {
+            continue;
+        }
+        if (known) {
+            // deleted, or modified and its thumbnail has to be regenerated.
+            // If its preview is still being loaded, that will pick up the
+            // new content anyway
+            FileBrowserEntry *entry = fileBrowser->delEntry(fname);
+            if (entry) {
+                delete entry;
+                --previewsLoaded;
+                refresh = true;
+            }
+            if (!exists) {
+                cacheMgr->deleteEntry(fname);
+                file_name_set_.erase(fname);
+                removed.insert(fname);
+                continue;
+            } else if (!entry) {
+                continue;
+            }
+        } else if (!exists || (!options.fbShowHidden && is_hidden(fname))) {
+            continue;
+        } else {
+            file_name_set_.insert(fname);
+            fileNameList.push_back(fname);
+        }
+        to_add.push_back(fname);
+    }
+
+    if (!removed.empty()) {
+        fileNameList.erase(
+            std::remove_if(fileNameList.begin(), fileNameList.end(),
+                           [&](const Glib::ustring &n) -> bool {
+                               return removed.count(n);
+                           }),
+            fileNameList.end());
+    }
+
+    if (!to_add.empty()) {
+        addFiles(to_add);
+        refresh = true;
+    }
+    if (refresh) {
+        _refreshProgressBar();
+    }
+}
+
+bool FileCatalog::processSessionChanges()
+{
+    std::vector<Glib::ustring> added, removed;
+    if (!art::session::changes(session_version_, added, removed)) {
+        return false;
+    }
+    session_version_ = art::session::version();
+
+    std::set<Glib::ustring> gone;
+    for (const auto &fname : removed) {
+        if (!file_name_set_.erase(fname)) {
+            continue;
+        }
+        FileBrowserEntry *entry = fileBrowser->delEntry(fname);
+        if (entry) {
+            delete entry;
+            --previewsLoaded;
+        }
+        gone.insert(fname);
+    }
+    if (!gone.empty()) {
+        fileNameList.erase(
+            std::remove_if(fileNameList.begin(), fileNameList.end(),
+                           [&](const Glib::ustring &n) -> bool {
+                               return gone.count(n);
+                           }),
+            fileNameList.end());
+    }
+
+    std::vector<Glib::ustring> to_add;
+    for (const auto &fname : added) {
+        if (file_name_set_.insert(fname).second) {
+            fileNameList.push_back(fname);
+            to_add.push_back(fname);
+        }
+    }
+    if (!to_add.empty()) {
+        addFiles(to_add);
+    }
+    if (!gone.empty() || !to_add.empty()) {
+        _refreshProgressBar();
+    }
+    return true;
+}
+
 void FileCatalog::addFile(const Glib::ustring &fName)
 {
     if (!fName.empty()) {
@@ -2025,6 +2182,14 @@ void FileCatalog::addFile(const Glib::ustring &fName)
     }
 }
 
+void FileCatalog::addFiles(const std::vector<Glib::ustring> &names)
+{
+    // queued in one go, the preview loader reads the files in this (sorted)
+    // order with a bounded number of threads
+    previewLoader->add(selectedDirectoryId, names, this);
+    previewsToLoad += names.size();
+}
+
 void FileCatalog::addAndOpenFile(const Glib::ustring &fname, bool force)
 {
     auto file = Gio::File::create_for_path(fname);
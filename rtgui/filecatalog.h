@@ -30,6 +30,7 @@
 #include "threadutils.h"
 #include "toolbar.h"
 #include <giomm.h>
+#include <map>
 #include <set>
 
 class FilePanel;
@@ -154,6 +155,13 @@ private:
     static const unsigned int DIR_REFRESH_DELAY = 2000;
     Glib::RefPtr<Gio::FileMonitor> dirMonitor;
     sigc::connection dir_refresh_conn_;
+    // files reported by dirMonitor since the last refresh, with whether
+    // their content changed. They are processed together DIR_REFRESH_DELAY
+    // after the first event of a burst
+    std::map<Glib::ustring, bool> dir_changes_;
+    // the version of the session when the entries were last synchronised
+    // with it (see art::session::changes())
+    size_t session_version_;
 
     IdleRegister idle_register;
 
@@ -162,6 +170,7 @@ private:
 
     void addAndOpenFile(const Glib::ustring &fname, bool force = false);
     void addFile(const Glib::ustring &fName);
+    void addFiles(const std::vector<Glib::ustring> &names);
     std::vector<Glib::ustring> getFileList(bool recursive);
     BrowserFilter getFilter();
     void trashChanged();
@@ -174,6 +183,10 @@ private:
     void on_dir_changed(const Glib::RefPtr<Gio::File> &file,
                         const Glib::RefPtr<Gio::File> &other_file,
                         Gio::FileMonitorEvent event_type);
+    // adds, removes or reloads only the entries of dir_changes_
+    void processDirChanges();
+    // adds and removes only the entries changed in the session
+    bool processSessionChanges();
 
 public:
     // thumbnail browsers
@@ -274,6 +287,10 @@ public:
 
     void openNextImage() { fileBrowser->openNextImage(); }
     void openPrevImage() { fileBrowser->openPrevImage(); }
+    std::vector<Thumbnail *> getAdjacentImages(const Glib::ustring &fname)
+    {
+        return fileBrowser->getAdjacentImages(fname);
+    }
     void selectImage(const Glib::ustring &fname, bool clearFilters);
     bool isSelected(const Glib::ustring &fname) const;
     void openNextPreviousEditorImage(Glib::ustring fname, bool clearFilters,
@@ -19,6 +19,7 @@
  */
 #include "../rtengine/imagedata.h"
 #include "../rtengine/metadata.h"
+#include "../rtengine/threadpool.h"
 #include "filecatalog.h"
 #include "filepanel.h"
 #include "multilangmgr.h"
@@ -26,11 +27,17 @@
 #include "pathutils.h"
 #include "rtwindow.h"
 #include "session.h"
+#include <atomic>
 #include <ctype.h>
+#include <deque>
 #include <errno.h>
+#include <functional>
+#include <future>
 #include <glibmm/regex.h>
 #include <gtkmm.h>
 #include <iomanip>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <time.h>
 
@@ -925,11 +932,19 @@ bool get_params(Gtk::Window &parent,
     return (dialog.run() == 1) && getparams();
 }
 
+// the destinations already assigned to other files are in reserved (the
+// targets of all the files are computed before any of them is moved)
 void get_targets(Params &params, FileBrowserEntry *entry,
-                 std::vector<std::pair<Glib::ustring, Glib::ustring>> &out)
+                 std::vector<std::pair<Glib::ustring, Glib::ustring>> &out,
+                 std::set<Glib::ustring> &reserved)
 {
     out.clear();
 
+    const auto exists = [&](const Glib::ustring &path) -> bool {
+        return reserved.count(path) ||
+               Glib::file_test(path, Glib::FILE_TEST_EXISTS);
+    };
+
     auto fn = entry->thumbnail->getFileName();
     auto dir = Glib::path_get_dirname(fn);
     auto name = Glib::path_get_basename(fn);
@@ -937,7 +952,7 @@ void get_targets(Params &params, FileBrowserEntry *entry,
     auto newpath = g_path_is_absolute(newname.c_str())
                        ? newname
                        : Glib::ustring(Glib::build_filename(dir, newname));
-    if (Glib::file_test(newpath, Glib::FILE_TEST_EXISTS)) {
+    if (exists(newpath)) {
         if (params.on_existing == Params::OnExistingAction::RENAME) {
             auto bn = removeExtension(newname);
             auto ext = getExtension(newname);
@@ -947,7 +962,7 @@ void get_targets(Params &params, FileBrowserEntry *entry,
             for (int i = 1;; ++i) {
                 auto nn = bn + "_" + std::to_string(i) + ext;
                 newpath = Glib::build_filename(dir, nn);
-                if (!Glib::file_test(newpath, Glib::FILE_TEST_EXISTS)) {
+                if (!exists(newpath)) {
                     newname = nn;
                     break;
                 }
@@ -956,6 +971,7 @@ void get_targets(Params &params, FileBrowserEntry *entry,
             return; // skip
         }
     }
+    reserved.insert(newpath);
     out.push_back(std::make_pair(fn, newpath));
     auto pf = options.getParamFile(fn);
     if (Glib::file_test(pf, Glib::FILE_TEST_EXISTS)) {
@@ -999,17 +1015,26 @@ void get_targets(Params &params, FileBrowserEntry *entry,
     }
 }
 
-template <class Func>
-void run_with_progress(const std::vector<FileBrowserEntry *> &args, Func func,
-                       const Glib::ustring &msg, Gtk::Window &parent)
+// maximum number of files copied, moved or deleted at the same time
+constexpr size_t MAX_PARALLEL_IO = 4;
+
+// Runs the I/O of a copy, move or delete of n files in the thread pool,
+// while a progress dialog (which can cancel the operation) keeps the GUI
+// responsive. io(i) performs the I/O of the i-th file, and returns false on
+// errors; it runs on up to MAX_PARALLEL_IO files at a time, so it must not
+// touch the GUI. done(i, ok) is then called on the GUI thread, in completion
+// order. After a cancellation, the files already started are completed (and
+// reported) anyway. Returns the number of files processed
+size_t run_in_background(size_t n, std::function<bool(size_t)> io,
+                         std::function<void(size_t, bool)> done,
+                         const Glib::ustring &msg, Gtk::Window &parent)
 {
-    if (args.empty()) {
-        return;
+    if (!n) {
+        return 0;
     }
 
     Gtk::MessageDialog dlg(
-        parent,
-        Glib::ustring::compose("%1 (0/%2)", msg, std::to_string(args.size())),
+        parent, Glib::ustring::compose("%1 (0/%2)", msg, std::to_string(n)),
         false, Gtk::MESSAGE_INFO, Gtk::BUTTONS_CANCEL, true);
     Gtk::ProgressBar progress;
     progress.set_fraction(0);
@@ -1017,27 +1042,70 @@ void run_with_progress(const std::vector<FileBrowserEntry *> &args, Func func,
     dlg.get_message_area()->pack_start(progress, Gtk::PACK_SHRINK, 4);
     dlg.show_all_children();
 
-    unsigned int i = 0;
-    bool done = false;
+    std::mutex mutex;
+    size_t next = 0;
+    std::deque<std::pair<size_t, bool>> completed;
+    std::atomic<bool> cancel(false);
 
-    IdleRegister reg;
-    reg.add([&]() -> bool {
-        if (done || i == args.size()) {
-            dlg.response(Gtk::RESPONSE_CANCEL);
-            return false;
-        } else {
-            func(args[i]);
-            ++i;
-            progress.set_fraction(i / double(args.size()));
-            dlg.set_message(
-                Glib::ustring::compose("%1 (%2/%3)", msg, std::to_string(i),
-                                       std::to_string(args.size())));
-            return true;
+    const auto worker = [&]() -> void {
+        while (true) {
+            size_t i;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (cancel || next == n) {
+                    return;
+                }
+                i = next++;
+            }
+            const bool ok = io(i);
+            std::lock_guard<std::mutex> lock(mutex);
+            completed.emplace_back(i, ok);
+        }
+    };
+
+    std::vector<std::future<void>> workers;
+    for (size_t k = 0; k < std::min(n, MAX_PARALLEL_IO); ++k) {
+        workers.push_back(rtengine::ThreadPool::add_task(
+            rtengine::ThreadPool::Priority::HIGH, worker));
+    }
+
+    size_t num_done = 0;
+    const auto collect = [&]() -> void {
+        std::deque<std::pair<size_t, bool>> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(completed);
+        }
+        for (auto &c : batch) {
+            done(c.first, c.second);
         }
-    });
+        num_done += batch.size();
+    };
+
+    auto conn = Glib::signal_timeout().connect(
+        [&]() -> bool {
+            collect();
+            progress.set_fraction(num_done / double(n));
+            dlg.set_message(Glib::ustring::compose("%1 (%2/%3)", msg,
+                                                   std::to_string(num_done),
+                                                   std::to_string(n)));
+            if (num_done == n) {
+                dlg.response(Gtk::RESPONSE_CANCEL);
+                return false;
+            }
+            return true;
+        },
+        50);
 
     dlg.run();
-    done = true;
+    conn.disconnect();
+
+    cancel = true;
+    for (auto &w : workers) {
+        w.wait();
+    }
+    collect();
+    return num_done;
 }
 
 } // namespace
@@ -1047,37 +1115,23 @@ void FileCatalog::copyMoveRequested(const std::vector<FileBrowserEntry *> &args,
 {
     const auto doit = [&](const Glib::ustring &s,
                           const Glib::ustring &d) -> bool {
-        if (move) {
-            errno = 0;
-            if (::g_rename(s.c_str(), d.c_str()) == 0) {
-                return true;
-            } else if (errno == EXDEV) {
-                try {
-                    auto fs = Gio::File::create_for_path(s);
-                    auto fd = Gio::File::create_for_path(d);
-                    fs->copy(fd);
-                    return ::g_remove(s.c_str()) == 0;
-                } catch (Glib::Error &exc) {
-                    if (options.rtSettings.verbose) {
-                        std::cout << "copy error: " << exc.what() << std::endl;
-                    }
-                    return false;
-                }
+        try {
+            auto fs = Gio::File::create_for_path(s);
+            auto fd = Gio::File::create_for_path(d);
+            if (move) {
+                // a rename when possible (also on the remote side for the
+                // network locations), otherwise a copy and a delete
+                fs->move(fd);
             } else {
-                return false;
-            }
-        } else {
-            try {
-                auto fs = Gio::File::create_for_path(s);
-                auto fd = Gio::File::create_for_path(d);
                 fs->copy(fd);
-                return true;
-            } catch (Glib::Error &exc) {
-                if (options.rtSettings.verbose) {
-                    std::cout << "copy error: " << exc.what() << std::endl;
-                }
-                return false;
             }
+            return true;
+        } catch (Glib::Error &exc) {
+            if (options.rtSettings.verbose) {
+                std::cout << (move ? "move" : "copy")
+                          << " error: " << exc.what() << std::endl;
+            }
+            return false;
         }
     };
 
@@ -1090,35 +1144,56 @@ void FileCatalog::copyMoveRequested(const std::vector<FileBrowserEntry *> &args,
         }
         std::vector<Glib::ustring> session_add, session_rem;
 
-        std::vector<std::pair<Glib::ustring, Glib::ustring>> torename;
+        // the file names are computed upfront, as the entries must not be
+        // accessed by the workers
+        struct Job {
+            std::vector<std::pair<Glib::ustring, Glib::ustring>> files;
+            std::vector<bool> ok;
+            std::string md5;
+        };
+        std::vector<Job> jobs(args.size());
+        std::set<Glib::ustring> reserved;
+        for (size_t i = 0; i < args.size(); ++i) {
+            get_targets(params, args[i], jobs[i].files, reserved);
+            jobs[i].md5 = args[i]->thumbnail->getMD5();
+        }
 
-        const auto func = [&](FileBrowserEntry *e) -> void {
-            get_targets(params, e, torename);
-            bool first = true;
-            for (auto &p : torename) {
+        const auto io = [&](size_t i) -> bool {
+            Job &job = jobs[i];
+            job.ok.assign(job.files.size(), false);
+            bool ret = true;
+            for (size_t k = 0; k < job.files.size(); ++k) {
+                auto &p = job.files[k];
                 auto destdir = Glib::path_get_dirname(p.second);
-                if (::g_mkdir_with_parents(destdir.c_str(), 0755) == 0 &&
-                    doit(p.first, p.second)) {
-                    if (first && move) {
-                        cacheMgr->renameEntry(p.first, e->thumbnail->getMD5(),
-                                              p.second);
-                        if (is_session) {
-                            session_add.push_back(p.second);
-                            session_rem.push_back(p.first);
-                        }
-                    }
-                } else {
+                job.ok[k] =
+                    ::g_mkdir_with_parents(destdir.c_str(), 0755) == 0 &&
+                    doit(p.first, p.second);
+                ret = ret && job.ok[k];
+            }
+            return ret;
+        };
+
+        const auto done = [&](size_t i, bool) -> void {
+            Job &job = jobs[i];
+            for (size_t k = 0; k < job.files.size(); ++k) {
+                auto &p = job.files[k];
+                if (!job.ok[k]) {
                     filepanel->getParent()->error(Glib::ustring::compose(
                         M("RENAME_DIALOG_ERROR"), p.first, p.second));
+                } else if (k == 0 && move) {
+                    cacheMgr->renameEntry(p.first, job.md5, p.second);
+                    if (is_session) {
+                        session_add.push_back(p.second);
+                        session_rem.push_back(p.first);
+                    }
                 }
-                first = false;
             }
         };
 
         {
             ConnectionBlocker blocker(dir_refresh_conn_);
-            run_with_progress(
-                args, func,
+            run_in_background(
+                jobs.size(), io, done,
                 M(move ? "PROGRESSBAR_FILE_RENAME" : "PROGRESSBAR_FILE_COPY"),
                 getToplevelWindow(this));
         }
@@ -1184,16 +1259,28 @@ void FileCatalog::deleteRequested(const std::vector<FileBrowserEntry *> &tbe,
 
             options.renaming.sidecars = sidecars.get_text();
 
-            // for (unsigned int i = 0; i < tbe.size(); i++) {
-            const auto func = [&](FileBrowserEntry *e) -> void {
-                // const auto fname = tbe[i]->filename;
-                const auto fname = e->filename;
+            // the entries are removed from the browser and from the cache
+            // right away, the files are then deleted in the background
+            std::vector<Glib::ustring> fnames;
+            for (auto e : tbe) {
+                fnames.push_back(e->filename);
+            }
+            for (auto &fname : fnames) {
                 // remove from browser
                 delete fileBrowser->delEntry(fname);
                 // remove from cache
                 cacheMgr->deleteEntry(fname);
+                previewsLoaded--;
+
+                if (is_session) {
+                    session_rem.push_back(fname);
+                }
+            }
+
+            const auto io = [&](size_t i) -> bool {
+                const auto &fname = fnames[i];
                 // delete from file system
-                ::g_remove(fname.c_str());
+                bool ok = ::g_remove(fname.c_str()) == 0;
                 // delete also the arp sidecar
                 ::g_remove(options.getParamFile(fname).c_str());
 
@@ -1207,22 +1294,23 @@ void FileCatalog::deleteRequested(const std::vector<FileBrowserEntry *> &tbe,
                             sidename = base_fn + "." + s;
                         }
                         if (Glib::file_test(sidename, Glib::FILE_TEST_EXISTS)) {
-                            ::g_remove(sidename.c_str());
+                            ok = ::g_remove(sidename.c_str()) == 0 && ok;
                         }
                     }
                 }
-
-                previewsLoaded--;
-
-                if (is_session) {
-                    session_rem.push_back(fname);
-                }
+                return ok;
             };
 
+            size_t num_deleted = 0;
             {
                 ConnectionBlocker blocker(dir_refresh_conn_);
-                run_with_progress(tbe, func, M("PROGRESSBAR_FILE_DELETE"),
-                                  getToplevelWindow(this));
+                num_deleted = run_in_background(
+                    fnames.size(), io, [](size_t, bool) {},
+                    M("PROGRESSBAR_FILE_DELETE"), getToplevelWindow(this));
+            }
+            if (num_deleted < fnames.size() && !is_session) {
+                // cancelled, bring back the files left
+                reparseDirectory();
             }
 
             _refreshProgressBar();
@@ -18,6 +18,7 @@
  */
 #include "filepanel.h"
 
+#include "imageprefetcher.h"
 #include "inspector.h"
 #include "placesbrowser.h"
 #include "rtwindow.h"
@@ -289,6 +290,7 @@ FileSelectionListener::Result FilePanel::fileSelected(Thumbnail *thm)
     pl->complete = false;
     pl->pc = nullptr;
     pl->thm = thm;
+    pl->epanel = nullptr;
     pendingLoads.push_back(pl);
     if (!options.tabbedUI) {
         parent->epanel->close();
@@ -298,13 +300,44 @@ FileSelectionListener::Result FilePanel::fileSelected(Thumbnail *thm)
     ProgressConnector<rtengine::InitialImage *> *ld =
         new ProgressConnector<rtengine::InitialImage *>();
     ld->startFunc(
-        sigc::bind(sigc::ptr_fun(&rtengine::InitialImage::load),
+        sigc::bind(sigc::mem_fun(*imagePrefetcher, &ImagePrefetcher::load),
                    thm->getFileName(), thm->getType() == FT_Raw, &error,
                    parent->getProgressListener()),
         sigc::bind(sigc::mem_fun(*this, &FilePanel::imageLoaded), thm, ld));
+
+    // while the image is decoded, build the editor and show the embedded
+    // preview in it. imageLoaded() is called in the GUI thread as well, so
+    // it always finds the editor set
+    if (options.tabbedUI) {
+        pl->epanel = createEditorPanel(thm);
+    } else {
+        parent->SetEditorCurrent();
+        pl->epanel = parent->epanel;
+    }
+    if (pl->epanel) {
+        pl->epanel->showPlaceholder(thm);
+    }
+
     return FileSelectionListener::Result::OK;
 }
 
+EditorPanel *FilePanel::createEditorPanel(Thumbnail *thm)
+{
+#ifdef WIN32
+    int winGdiHandles = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+    // 0 means we don't have the rights to access the function, 8500 because
+    // the limit is 10000 and we need about 1500 free handles
+    if (winGdiHandles <= 0 || winGdiHandles > 8500) {
+        return nullptr;
+    }
+#endif
+    EditorPanel *epanel = Gtk::manage(new EditorPanel());
+    // prevents closing the tab while the image is loading
+    epanel->setIsProcessing();
+    parent->addEditorPanel(epanel, thm->getFileName());
+    return epanel;
+}
+
 bool FilePanel::addBatchQueueJobs(const std::vector<BatchQueueEntry *> &entries)
 {
     if (parent) {
@@ -336,43 +369,25 @@ bool FilePanel::imageLoaded(Thumbnail *thm,
 
         if (pl->pc->returnValue()) {
             if (options.tabbedUI) {
-                EditorPanel *epanel;
-                {
-#ifdef WIN32
-                    int winGdiHandles =
-                        GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
-                    if (winGdiHandles > 0 &&
-                        winGdiHandles <=
-                            8500) // 0 means we don't have the rights to access
-                                  // the function, 8500 because the limit is
-                                  // 10000 and we need about 1500 free handles
-#endif
-                    {
-                        GThreadLock
-                            lock; // Acquiring the GUI... not sure that it's
-                                  // necessary, but it shouldn't harm
-                        epanel = Gtk::manage(new EditorPanel());
-                        parent->addEditorPanel(epanel, pl->thm->getFileName());
-                    }
-#ifdef WIN32
-                    else {
-                        Glib::ustring msg_ =
-                            Glib::ustring("<b>") + M("MAIN_MSG_CANNOTLOAD") +
-                            " \"" + thm->getFileName() + "\" .\n" +
-                            M("MAIN_MSG_TOOMANYOPENEDITORS") + "</b>";
-                        Gtk::MessageDialog msgd(*parent, msg_, true,
-                                                Gtk::MESSAGE_ERROR,
-                                                Gtk::BUTTONS_OK, true);
-                        msgd.run();
-                        goto MAXGDIHANDLESREACHED;
+                if (pl->epanel) {
+                    pl->epanel->open(pl->thm, pl->pc->returnValue());
+
+                    if (!(options.multiDisplayMode > 0)) {
+                        parent->set_title_decorated(pl->thm->getFileName());
                     }
-#endif
                 }
-                epanel->open(pl->thm, pl->pc->returnValue());
-
-                if (!(options.multiDisplayMode > 0)) {
-                    parent->set_title_decorated(pl->thm->getFileName());
+#ifdef WIN32
+                else {
+                    Glib::ustring msg_ =
+                        Glib::ustring("<b>") + M("MAIN_MSG_CANNOTLOAD") +
+                        " \"" + thm->getFileName() + "\" .\n" +
+                        M("MAIN_MSG_TOOMANYOPENEDITORS") + "</b>";
+                    Gtk::MessageDialog msgd(*parent, msg_, true,
+                                            Gtk::MESSAGE_ERROR,
+                                            Gtk::BUTTONS_OK, true);
+                    msgd.run();
                 }
+#endif
             } else {
                 {
                     GThreadLock lock; // Acquiring the GUI... not sure that it's
@@ -381,10 +396,19 @@ bool FilePanel::imageLoaded(Thumbnail *thm,
                 }
                 parent->epanel->open(pl->thm, pl->pc->returnValue());
                 parent->set_title_decorated(pl->thm->getFileName());
+
+                // load in advance the images that next/previous would open
+                if (options.editor_prefetch_memory_limit > 0) {
+                    imagePrefetcher->prefetch(fileCatalog->getAdjacentImages(
+                        pl->thm->getFileName()));
+                }
             }
         } else {
-            if (parent->epanel) {
-                parent->epanel->refreshProcessingState(false);
+            if (pl->epanel) {
+                pl->epanel->refreshProcessingState(false);
+                if (options.tabbedUI) {
+                    parent->remEditorPanel(pl->epanel);
+                }
             }
             Glib::ustring msg_ = Glib::ustring("<b>") +
                                  M("MAIN_MSG_CANNOTLOAD") + " \"" +
@@ -393,9 +417,6 @@ bool FilePanel::imageLoaded(Thumbnail *thm,
                                     Gtk::BUTTONS_OK, true);
             msgd.run();
         }
-#ifdef WIN32
-    MAXGDIHANDLESREACHED:
-#endif
         // delete pl->pc;
         pl->pc->destroy();
 
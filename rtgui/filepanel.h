@@ -31,6 +31,7 @@
 #include <gtkmm.h>
 
 class RTWindow;
+class EditorPanel;
 
 class FilePanel final: public Gtk::HPaned, public FileSelectionListener {
 public:
@@ -99,6 +100,7 @@ private:
         bool complete;
         ProgressConnector<rtengine::InitialImage *> *pc;
         Thumbnail *thm;
+        EditorPanel *epanel; // the tab being built while the image loads
     };
     MyMutex pendingLoadMutex;
     std::vector<struct pendingLoad *> pendingLoads;
@@ -107,4 +109,6 @@ private:
 
     IdleRegister idle_register;
     int pane_pos_;
+
+    EditorPanel *createEditorPanel(Thumbnail *thm);
 };
@@ -18,59 +18,111 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "focusmask.h"
 #include "../rtengine/rt_math.h"
-#include <cairomm/cairomm.h>
-#include <gtkmm.h>
+#include "../rtengine/sleef.h"
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
-void addFocusMask(const unsigned char *src, unsigned char *dst, int W, int H,
-                  int src_stride, int dst_stride, int src_offset,
-                  int dst_offset)
+namespace {
+
+// Copyright (c) 2011 Michael Ezra michael@michaelezra.com
+// determine if a pixel is in the sharp area of the image using standard
+// deviation analysis on two different scales: the 3x3 neighbourhood and the
+// 9x9 one, whose sums are computed from the 3x3 ones
+
+constexpr int small_radius = 1;
+constexpr int small_dim = 2 * small_radius + 1;
+constexpr int big_radius = (small_dim * small_dim) / 2;
+constexpr float small_size = float(small_dim * small_dim);
+constexpr float big_size = float((2 * big_radius + 1) * (2 * big_radius + 1));
+constexpr float focus_thresh = 80.f;
+constexpr float focus_threshby10 = focus_thresh / 10.f;
+
+// out[j] = in[j - d] + in[j] + in[j + d], for d <= j < W - d
+void hsum3(const float *in, float *out, int W, int d)
 {
-    using rtengine::SQR;
-    auto pix = dst;
-    auto pixWrkSpace = const_cast<unsigned char *>(src);
+    int j = d;
+#ifdef __SSE2__
+    for (; j < W - d - 3; j += 4) {
+        STVFU(out[j], LVFU(in[j - d]) + LVFU(in[j]) + LVFU(in[j + d]));
+    }
+#endif
+    for (; j < W - d; ++j) {
+        out[j] = in[j - d] + in[j] + in[j + d];
+    }
+}
 
-    const int pixRowStride = dst_stride;
-    const int pixWSRowStride = src_stride;
+// same as hsum3(), on the squares of in
+void hsum3sq(const float *in, float *out, int W, int d)
+{
+    int j = d;
+#ifdef __SSE2__
+    for (; j < W - d - 3; j += 4) {
+        const vfloat a = LVFU(in[j - d]);
+        const vfloat b = LVFU(in[j]);
+        const vfloat c = LVFU(in[j + d]);
+        STVFU(out[j], a * a + b * b + c * c);
+    }
+#endif
+    for (; j < W - d; ++j) {
+        out[j] = rtengine::SQR(in[j - d]) + rtengine::SQR(in[j]) +
+                 rtengine::SQR(in[j + d]);
+    }
+}
 
-    const int bHeight = H;
-    const int bWidth = W;
+// out[j] = a[j] + b[j] + c[j], for x1 <= j < x2
+void vsum3(const float *a, const float *b, const float *c, float *out, int x1,
+           int x2)
+{
+    int j = x1;
+#ifdef __SSE2__
+    for (; j < x2 - 3; j += 4) {
+        STVFU(out[j], LVFU(a[j]) + LVFU(b[j]) + LVFU(c[j]));
+    }
+#endif
+    for (; j < x2; ++j) {
+        out[j] = a[j] + b[j] + c[j];
+    }
+}
 
-    const int chans = pixRowStride / bWidth;
+// standard deviation of n samples from their sum and sum of squares. The
+// argument of the root can be slightly negative because of rounding
+inline float stddev(float sum, float sumsq, float n)
+{
+    return std::sqrt(std::max(sumsq * n - sum * sum, 0.f)) / n;
+}
 
-    const int blur_radius2 = 1; // radius of small kernel. 1 => 3x3 kernel
-    const int blur_dim2 = 2 * blur_radius2 + 1; // dimension of small kernel
-    const int blur_radius = (blur_dim2 * blur_dim2) / 2; // radius of big kernel
-    const float kernel_size =
-        SQR(2.f * blur_radius + 1.f); // count of pixels in the big blur kernel
-    const float rkernel_size =
-        1.0f / kernel_size; // reciprocal of kernel_size to avoid divisions
-    const float kernel_size2 = SQR(
-        2.f * blur_radius2 + 1.f); // count of pixels in the small blur kernel
-    const float rkernel_size2 =
-        1.0f / kernel_size2; // reciprocal of kernel_size to avoid divisions
+#ifdef __SSE2__
+inline vfloat stddev(vfloat sum, vfloat sumsq, vfloat n, vfloat rn)
+{
+    return rn * vsqrtf(vmaxf(sumsq * n - sum * sum, ZEROV));
+}
+#endif
 
-    // aloocate buffer for precalculated Luminance
-    const size_t bufsz = bHeight * bWidth;
-    std::vector<float> tmpLv(bufsz), tmpLsumv(bufsz), tmpLsumSqv(bufsz),
-        tmpstdDev2v(bufsz);
-    ;
-    // float* tmpL = (float*)malloc(bHeight * bWidth * sizeof(float) );
-    // // aloocate buffers for sums and sums of squares of small kernel
-    // float* tmpLsum = (float*)malloc((bHeight) * (bWidth) * sizeof(float) );
-    // float* tmpLsumSq = (float*)malloc((bHeight) * (bWidth) * sizeof(float) );
-    // float* tmpstdDev2 = (float*)malloc((bHeight) * (bWidth) * sizeof(float)
-    // );
-    float *tmpL = &tmpLv[0];
-    float *tmpLsum = &tmpLsumv[0];
-    float *tmpLsumSq = &tmpLsumSqv[0];
-    float *tmpstdDev2 = &tmpstdDev2v[0];
-    float maxstdDev_L2 = 0.f;
+// radius of the circle painted around the pixels in focus
+constexpr int circle_radius = 3;
+// half width of each row of the circle
+constexpr int circle[2 * circle_radius + 1] = {1, 2, 3, 3, 3, 2, 1};
+
+// opacity of the mask (in [0, 1]) at each pixel, or -1 where the pixel is
+// not in focus. Only the pixels with the 9x9 neighbourhood inside the image
+// are considered. alpha has a border of circle_radius pixels (set to -1) on
+// each side, so that the circles can be drawn without bound checks
+void compute_mask(const unsigned char *src, int W, int H, int src_stride,
+                  int chans, std::vector<float> &alpha)
+{
+    const size_t sz = size_t(W) * size_t(H);
+    std::vector<float> L(sz), hS(sz), hQ(sz), S(sz), Q(sz), sd2(sz);
+    const int aW = W + 2 * circle_radius;
+    alpha.assign(size_t(aW) * (H + 2 * circle_radius), -1.f);
+
+    float max_sd2 = 0.f;
 
 #ifdef _OPENMP
 #pragma omp parallel
@@ -79,49 +131,40 @@ void addFocusMask(const unsigned char *src, unsigned char *dst, int W, int H,
 #ifdef _OPENMP
 #pragma omp for
 #endif
-
-        // precalculate Luminance
-        for (int i = 0; i < bHeight; i++) {
-            guint8 *currWS = pixWrkSpace + i * pixWSRowStride;
-            float *currL = tmpL + i * bWidth;
-
-            for (int j = 0; j < bWidth; j++) {
-                *currL = 0.299f * (currWS)[0] + 0.587f * (currWS)[1] +
-                         0.114f * (currWS)[2];
-                currL++;
-                currWS += chans; // 3;
+        for (int i = 0; i < H; ++i) {
+            const unsigned char *s = src + size_t(i) * src_stride;
+            float *l = &L[size_t(i) * W];
+            for (int j = 0; j < W; ++j, s += chans) {
+                l[j] = 0.299f * s[0] + 0.587f * s[1] + 0.114f * s[2];
             }
+            hsum3(l, &hS[size_t(i) * W], W, 1);
+            hsum3sq(l, &hQ[size_t(i) * W], W, 1);
         }
 
-        float maxthrstdDev_L2 = 0.f;
+        // sums and standard deviation on the small scale
+        float thread_max = 0.f;
 #ifdef _OPENMP
-#pragma omp for nowait
+#pragma omp for
 #endif
-
-        // precalculate sum and sum of squares of small kernel
-        for (int i = blur_radius2; i < bHeight - blur_radius2; i++) {
-            for (int j = blur_radius2; j < bWidth - blur_radius2; j++) {
-                float sumL = 0.f;
-                float sumLSqu = 0.f;
-
-                for (int kh = -blur_radius2; kh <= blur_radius2; kh++) {
-                    for (int kw = -blur_radius2; kw <= blur_radius2; kw++) {
-                        float curL = tmpL[(i + kh) * bWidth + j + kw];
-                        sumL += curL;
-                        sumLSqu += SQR(curL);
-                    }
-                }
-
-                tmpLsum[i * bWidth + j] = sumL;
-                tmpLsumSq[i * bWidth + j] = sumLSqu;
-                float stdDev_L2 =
-                    rkernel_size2 * sqrtf(sumLSqu * kernel_size2 - sumL * sumL);
-
-                if (stdDev_L2 > maxthrstdDev_L2) {
-                    maxthrstdDev_L2 = stdDev_L2;
-                }
-
-                tmpstdDev2[i * bWidth + j] = stdDev_L2;
+        for (int i = small_radius; i < H - small_radius; ++i) {
+            const size_t r = size_t(i) * W;
+            vsum3(&hS[r - W], &hS[r], &hS[r + W], &S[r], 1, W - 1);
+            vsum3(&hQ[r - W], &hQ[r], &hQ[r + W], &Q[r], 1, W - 1);
+            int j = small_radius;
+#ifdef __SSE2__
+            const vfloat nv = F2V(small_size);
+            const vfloat rnv = F2V(1.f / small_size);
+            vfloat maxv = ZEROV;
+            for (; j < W - small_radius - 3; j += 4) {
+                const vfloat v = stddev(LVFU(S[r + j]), LVFU(Q[r + j]), nv, rnv);
+                STVFU(sd2[r + j], v);
+                maxv = vmaxf(maxv, v);
+            }
+            thread_max = std::max(thread_max, vhmax(maxv));
+#endif
+            for (; j < W - small_radius; ++j) {
+                sd2[r + j] = stddev(S[r + j], Q[r + j], small_size);
+                thread_max = std::max(thread_max, sd2[r + j]);
             }
         }
 
@@ -129,179 +172,150 @@ void addFocusMask(const unsigned char *src, unsigned char *dst, int W, int H,
 #pragma omp critical
 #endif
         {
-            if (maxthrstdDev_L2 > maxstdDev_L2) {
-                maxstdDev_L2 = maxthrstdDev_L2;
-            }
+            max_sd2 = std::max(max_sd2, thread_max);
         }
-    }
 
-    const float focus_thresh = 80.f;
-    maxstdDev_L2 = std::min(maxstdDev_L2, focus_thresh);
-    const float focus_threshby10 = focus_thresh / 10.f;
+        // horizontal part of the large scale sums, made of small scale
+        // sums (hS and hQ are reused)
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 16)
+#pragma omp for
 #endif
+        for (int i = small_radius; i < H - small_radius; ++i) {
+            const size_t r = size_t(i) * W;
+            hsum3(&S[r], &hS[r], W, small_dim);
+            hsum3(&Q[r], &hQ[r], W, small_dim);
+        }
+    }
 
-    for (int i = blur_radius + 1; i < bHeight - blur_radius; i++) {
-        guint8 *curr = pix + i * pixRowStride + 3 * (blur_radius + 1);
-        guint8 *currWs =
-            pixWrkSpace + i * pixWSRowStride + 3 * (blur_radius + 1);
-
-        for (int j = blur_radius + 1; j < bWidth - blur_radius; j++) {
-
-            //*************
-            // Copyright (c) 2011 Michael Ezra michael@michaelezra.com
-            // determine if pixel is in the sharp area of the image using
-            // standard deviation analysis on two different scales
-            // float focus_thresh2;
-            // float opacity = 0.9;//TODO: implement opacity
-            // TODO: evaluate effects of altering sampling frequency
-
-            // TODO: dynamically determine appropriate values based on image
-            // analysis
-
-            // calculate average in +-blur_radius pixels area around the current
-            // pixel speed up: calculate sum of squares in the same loops
-
-            float sum_L = 0.f;
-            float sumsq_L = 0.f;
+    max_sd2 = std::min(max_sd2, focus_thresh);
+    if (max_sd2 <= 0.f) {
+        return;
+    }
 
-            // use precalculated values of small kernel to reduce number of
-            // iterations
-            for (int kh = -blur_radius + blur_radius2;
-                 kh <= blur_radius - blur_radius2; kh += blur_dim2) {
-                float *currLsum =
-                    &tmpLsum[(i + kh) * bWidth + j - blur_radius + 1];
-                float *currLsumSqu =
-                    &tmpLsumSq[(i + kh) * bWidth + j - blur_radius + 1];
+    const int x1 = big_radius + 1;
+    const int x2 = W - big_radius;
 
-                for (int k = -blur_radius + blur_radius2;
-                     k <= blur_radius - blur_radius2; k += blur_dim2,
-                         currLsum += blur_dim2, currLsumSqu += blur_dim2) {
-                    sum_L += *currLsum;
-                    sumsq_L += *currLsumSqu;
-                }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = big_radius + 1; i < H - big_radius; ++i) {
+        const size_t r = size_t(i) * W;
+        const size_t d = size_t(small_dim) * W;
+        float *a = &alpha[size_t(i + circle_radius) * aW + circle_radius];
+        std::vector<float> bS(W), bQ(W);
+        vsum3(&hS[r - d], &hS[r], &hS[r + d], bS.data(), x1, x2);
+        vsum3(&hQ[r - d], &hQ[r], &hQ[r + d], bQ.data(), x1, x2);
+
+        // detect focus in texture: the key point is that the standard
+        // deviation on the small scale is higher than on the large one,
+        // which selects fine detail within lower contrast on the larger
+        // scale
+        int j = x1;
+#ifdef __SSE2__
+        const vfloat nv = F2V(big_size);
+        const vfloat rnv = F2V(1.f / big_size);
+        const vfloat threshv = F2V(focus_thresh);
+        const vfloat thresh10v = F2V(focus_threshby10);
+        const vfloat onev = F2V(1.f);
+        const vfloat nonev = F2V(-1.f);
+        const vfloat rmaxv = F2V(1.f / max_sd2);
+        for (; j < x2 - 3; j += 4) {
+            const vfloat sd2v = LVFU(sd2[r + j]);
+            const vfloat sdv = stddev(LVFU(bS[j]), LVFU(bQ[j]), nv, rnv);
+            const vmask m =
+                vandm(vandm(vmaskf_ge(threshv, sd2v), vmaskf_gt(sd2v, sdv)),
+                      vmaskf_gt(sdv, thresh10v));
+            const vfloat t = onev - vminf(sd2v * rmaxv, onev);
+            STVFU(a[j], vself(m, t, nonev));
+        }
+#endif
+        for (; j < x2; ++j) {
+            const float s2 = sd2[r + j];
+            const float s = stddev(bS[j], bQ[j], big_size);
+            if (focus_thresh >= s2 && s2 > s && s > focus_threshby10) {
+                a[j] = 1.f - std::min(s2 / max_sd2, 1.f);
             }
+        }
+    }
+}
 
-            // float sum_L2 = tmpLsum[i * bWidth + j];
-            // float sumsq_L2 = tmpLsumSq[i * bWidth + j];
-            //*************
-            //  averages
-            //  Optimized formulas to avoid divisions
-            float stdDev_L =
-                rkernel_size * sqrtf(sumsq_L * kernel_size - sum_L * sum_L);
-            float stdDev_L2 = tmpstdDev2[i * bWidth + j];
-            //                          float stdDev_L2 = rkernel_size2 *
-            //                          sqrtf(sumsq_L2 * kernel_size2 - sum_L2 *
-            //                          sum_L2);
-
-            // TODO: try to normalize by average L of the entire (preview) image
-
-            // detection method 1: detect focus in features
-            // there is no strict condition between stdDev_L and stdDev_L2
-            // themselves
-            /*                                if (stdDev_L2>focus_thresh2
-                                              && (stdDev_L <focus_thresh)){ //
-               this excludes false positives due to high contrast edges
-
-                                              curr[1]=255;
-                                              curr[0]=0;
-                                              curr[2]=0;
-
-                                              }*/
-
-            // detection method 2: detect focus in texture
-            //  key point is std deviation on lower scale is higher than for the
-            //  larger scale plus some boundary conditions
-            if (focus_thresh >=
-                    stdDev_L2 // TODO: could vary this to bypass noise better
-                && stdDev_L2 > stdDev_L // this is the key to select fine detail
-                                        // within lower contrast on larger scale
-                && stdDev_L > focus_threshby10 // options.highlightThreshold
-            ) {
-                // transpareny depends on sdtDev_L2 and maxstdDev_L2
-                float transparency =
-                    1.f - std::min(stdDev_L2 / maxstdDev_L2, 1.0f);
-                // first row of circle
-                guint8 *currtmp = &curr[0] + (-3 * pixRowStride);
-                guint8 *currtmpWS = &currWs[0] + (-3 * pixWSRowStride);
+} // namespace
 
-                for (int jj = -chans; jj <= chans; jj += chans) {
-                    guint8 *currtmpl = currtmp + jj + dst_offset;
-                    guint8 *currtmpWSl = currtmpWS + jj + src_offset;
-                    // transparent green
-                    currtmpl[0] = transparency * currtmpWSl[0];
-                    currtmpl[1] = transparency * currtmpWSl[1] +
-                                  (1.f - transparency) * 255.f;
-                    currtmpl[2] = transparency * currtmpWSl[2];
-                }
+void addFocusMask(const unsigned char *src, unsigned char *dst, int W, int H,
+                  int src_stride, int dst_stride, int src_offset,
+                  int dst_offset)
+{
+    if (W <= 2 * (big_radius + 1) || H <= 2 * (big_radius + 1)) {
+        return;
+    }
 
-                // second row of circle
-                currtmp = &curr[0] + (-2 * pixRowStride);
-                currtmpWS = &currWs[0] + (-2 * pixWSRowStride);
+    const int chans = dst_stride / W;
 
-                for (int jj = -2 * chans; jj <= 2 * chans; jj += chans) {
-                    guint8 *currtmpl = currtmp + jj + dst_offset;
-                    guint8 *currtmpWSl = currtmpWS + jj + src_offset;
-                    // transparent green
-                    currtmpl[0] = transparency * currtmpWSl[0];
-                    currtmpl[1] = transparency * currtmpWSl[1] +
-                                  (1.f - transparency) * 255.f;
-                    currtmpl[2] = transparency * currtmpWSl[2];
-                }
+    std::vector<float> alpha;
+    compute_mask(src, W, H, src_stride, chans, alpha);
+    const int aW = W + 2 * circle_radius;
 
-                // three middle row of circle
-                for (int ii = -1; ii <= 1; ii++) {
-                    currtmp = &curr[0] + (ii * pixRowStride);
-                    currtmpWS = &currWs[0] + (ii * pixWSRowStride);
+    // a transparent green circle is painted around each pixel in focus. The
+    // circles overlap, and the last one in scan order is the one visible:
+    // rather than painting them one after the other, find for each pixel
+    // the opacity of the circle covering it, which is independent of the
+    // other pixels (and of whether src and dst are the same)
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> row(W);
 
-                    for (int jj = -3 * chans; jj <= 3 * chans; jj += chans) {
-                        guint8 *currtmpl = currtmp + jj + dst_offset;
-                        guint8 *currtmpWSl = currtmpWS + jj + src_offset;
-                        // transparent green
-                        currtmpl[0] = transparency * currtmpWSl[0];
-                        currtmpl[1] = transparency * currtmpWSl[1] +
-                                      (1.f - transparency) * 255.f;
-                        currtmpl[2] = transparency * currtmpWSl[2];
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int i = big_radius + 1 - circle_radius;
+             i < H - big_radius + circle_radius; ++i) {
+            int j = 0;
+#ifdef __SSE2__
+            const vfloat zerov = ZEROV;
+            for (; j < W - 3; j += 4) {
+                vfloat t = F2V(-1.f);
+                for (int ii = circle_radius; ii >= -circle_radius; --ii) {
+                    const float *a =
+                        &alpha[size_t(i - ii + circle_radius) * aW + j +
+                               circle_radius];
+                    const int w = circle[ii + circle_radius];
+                    for (int jj = w; jj >= -w; --jj) {
+                        const vfloat v = LVFU(a[-jj]);
+                        t = vself(vmaskf_ge(v, zerov), v, t);
                     }
                 }
-
-                // second last row of circle
-                currtmp = &curr[0] + (2 * pixRowStride);
-                currtmpWS = &currWs[0] + (2 * pixWSRowStride);
-
-                for (int jj = -2 * chans; jj <= 2 * chans; jj += chans) {
-                    guint8 *currtmpl = currtmp + jj + dst_offset;
-                    guint8 *currtmpWSl = currtmpWS + jj + src_offset;
-                    // transparent green
-                    currtmpl[0] = transparency * currtmpWSl[0];
-                    currtmpl[1] = transparency * currtmpWSl[1] +
-                                  (1.f - transparency) * 255.f;
-                    currtmpl[2] = transparency * currtmpWSl[2];
+                STVFU(row[j], t);
+            }
+#endif
+            for (; j < W; ++j) {
+                float t = -1.f;
+                for (int ii = circle_radius; ii >= -circle_radius; --ii) {
+                    const float *a =
+                        &alpha[size_t(i - ii + circle_radius) * aW + j +
+                               circle_radius];
+                    const int w = circle[ii + circle_radius];
+                    for (int jj = w; jj >= -w; --jj) {
+                        if (a[-jj] >= 0.f) {
+                            t = a[-jj];
+                        }
+                    }
                 }
+                row[j] = t;
+            }
 
-                // last row of circle
-                currtmp = &curr[0] + (3 * pixRowStride);
-                currtmpWS = &currWs[0] + (3 * pixWSRowStride);
-
-                for (int jj = -chans; jj <= chans; jj += chans) {
-                    guint8 *currtmpl = currtmp + jj + dst_offset;
-                    guint8 *currtmpWSl = currtmpWS + jj + src_offset;
-                    // transparent green
-                    currtmpl[0] = transparency * currtmpWSl[0];
-                    currtmpl[1] = transparency * currtmpWSl[1] +
-                                  (1.f - transparency) * 255.f;
-                    currtmpl[2] = transparency * currtmpWSl[2];
+            unsigned char *d = dst + size_t(i) * dst_stride + dst_offset;
+            const unsigned char *s =
+                src + size_t(i) * src_stride + src_offset;
+            for (j = 0; j < W; ++j, d += chans, s += chans) {
+                const float transparency = row[j];
+                if (transparency >= 0.f) {
+                    d[0] = transparency * s[0];
+                    d[1] = transparency * s[1] + (1.f - transparency) * 255.f;
+                    d[2] = transparency * s[2];
                 }
             }
-
-            curr += chans;   // 3;
-            currWs += chans; // 3;
         }
     }
-
-    // free(tmpL);
-    // free(tmpLsum);
-    // free(tmpLsumSq);
-    // free(tmpstdDev2);
 }
@@ -2023,13 +2023,13 @@ public:
     void operator()(float &r, float &g, float &b)
     {
         if (ok_) {
-            v_[0] = gam(r);
-            v_[1] = gam(g);
-            v_[2] = gam(b);
-            v_ = rtengine::dot_product(m_, v_);
-            r = igam(v_[0]);
-            g = igam(v_[1]);
-            b = igam(v_[2]);
+            // no member scratch space, so that the conversion can be used by
+            // the background renderers
+            rtengine::Vec3<float> v(gam(r), gam(g), gam(b));
+            v = rtengine::dot_product(m_, v);
+            r = igam(v[0]);
+            g = igam(v[1]);
+            b = igam(v[2]);
         }
     }
 
@@ -2061,7 +2061,6 @@ private:
 
     bool ok_;
     rtengine::Mat33<float> m_;
-    rtengine::Vec3<float> v_;
 };
 
 GUIColorConversion guiconv;
@@ -20,6 +20,7 @@
 #include "../rtengine/LUT.h"
 #include "../rtengine/array2D.h"
 #include "../rtengine/color.h"
+#include "../rtengine/threadpool.h"
 #include "guiutils.h"
 #include "multilangmgr.h"
 #include "options.h"
@@ -1169,7 +1170,8 @@ HistogramArea::HistogramArea(DrawModeListener *fml, bool is_main)
       needLuma(options.histogramLuma), needChroma(options.histogramChroma),
       isPressed(false), movingPosition(0.0), needPointer(options.histogramBar),
       pointer_red(-1), pointer_green(-1), pointer_blue(-1), pointer_a(0),
-      pointer_b(0), is_main_(is_main)
+      pointer_b(0), is_main_(is_main), traces_rendering_(false),
+      traces_pending_(false)
 {
 
     rhist(256);
@@ -1189,6 +1191,16 @@ HistogramArea::HistogramArea(DrawModeListener *fml, bool is_main)
 
 HistogramArea::~HistogramArea()
 {
+    std::future<void> job;
+    {
+        MyMutex::MyLock lock(traces_mutex_);
+        traces_pending_ = false;
+        job = std::move(traces_job_);
+    }
+    if (job.valid()) {
+        rtengine::ThreadPool::wait(job);
+    }
+
     idle_register.destroy();
 
     if (haih->pending) {
@@ -1237,6 +1249,8 @@ void HistogramArea::get_preferred_width_for_height_vfunc(
 void HistogramArea::updateOptions(bool r, bool g, bool b, bool l, bool c,
                                   int mode, ScopeType type, bool pointer)
 {
+    MyMutex::MyLock lock(traces_mutex_);
+
     wave_buffer_dirty =
         wave_buffer_dirty || needRed != r || needGreen != g || needBlue != b;
 
@@ -1275,6 +1289,8 @@ void HistogramArea::update(
     const array2D<int> &waveformGreen, const array2D<int> &waveformBlue,
     const array2D<int> &waveformLuma)
 {
+    MyMutex::MyLock lock(traces_mutex_);
+
     if (histRed) {
         switch (scopeType) {
         case ScopeType::HISTOGRAM:
@@ -1318,6 +1334,28 @@ void HistogramArea::update(
         valid = false;
     }
 
+    const bool has_traces = valid && (scopeType == ScopeType::PARADE ||
+                                      scopeType == ScopeType::WAVEFORM ||
+                                      scopeType == ScopeType::VECTORSCOPE_HC ||
+                                      scopeType == ScopeType::VECTORSCOPE_HS);
+    if (!has_traces) {
+        lock.unlock();
+        scheduleRedraw();
+    } else if (traces_rendering_) {
+        // the running job will pick up the new data when it's done with the
+        // current one, so that at most one rendering is ever in flight
+        traces_pending_ = true;
+    } else {
+        traces_pending_ = true;
+        traces_rendering_ = true;
+        traces_job_ = rtengine::ThreadPool::add_task(
+            rtengine::ThreadPool::Priority::NORMAL,
+            [this]() { renderTracesInBackground(); });
+    }
+}
+
+void HistogramArea::scheduleRedraw()
+{
     haih->pending++;
 
     // Can be done outside of the GUI thread
@@ -1356,6 +1394,14 @@ void HistogramArea::updateBackBuffer(int custom_w, int custom_h)
         window->get_geometry(winx, winy, winw, winh);
     }
 
+    // the traces are being rendered in the background: keep the current
+    // contents, the job will ask for a redraw when it's done
+    std::unique_lock<MyMutex> lock(traces_mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || traces_pending_) {
+        return;
+    }
+    renderTraces();
+
     // This will create or update the size of the BackBuffer::surface
     setDrawRectangle(Cairo::FORMAT_ARGB32, 0, 0, winw, winh, true);
 
@@ -1979,114 +2025,210 @@ void HistogramArea::drawMarks(Cairo::RefPtr<Cairo::Context> &cr,
     cr->fill();
 }
 
-void HistogramArea::drawParade(Cairo::RefPtr<Cairo::Context> &cr, int w, int h)
-{
-    // Arbitrary scale factor divided by current scale.
-    const float scale = trace_brightness * 32.f * 255.f / waveform_scale;
-    const int wave_width = rwave.width();
-    const int wave_height = rwave.height();
+namespace {
 
-    // See Cairo documentation on stride.
-    const int cairo_stride = Cairo::ImageSurface::format_stride_for_width(
-        Cairo::FORMAT_ARGB32, rwave.width());
-    const auto buffer_size =
-        static_cast<std::vector<unsigned char>::size_type>(wave_height) *
-        cairo_stride;
+inline uint32_t trace_rgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+    return b | (g << 8) | (r << 16) | (a << 24);
+}
 
-    const auto rgba = [](uint32_t r, uint32_t g, uint32_t b,
-                         uint32_t a) -> uint32_t {
-        // return a | (a << 8) | (a << 16) | (a << 24);
-        return b | (g << 8) | (r << 16) | (a << 24);
-    };
+// trace of a single channel of the parade, in the given colour
+void build_parade_trace(const array2D<int> &wave, int channel,
+                        const float color[3], float scale, int cairo_stride,
+                        std::vector<unsigned char> &buffer)
+{
+    constexpr float val_max = 255;
+    const int wave_width = wave.width();
+    const int wave_height = wave.height();
+
+    buffer.assign(static_cast<std::size_t>(wave_height) * cairo_stride, 0);
+    assert(buffer.size() % 4 == 0);
+
+    for (int val = 0; val < wave_height; val++) {
+        const int *const row = wave[val];
+        std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
+            buffer.data() + (255 - val) * cairo_stride);
+        for (int col = 0; col < wave_width; col++) {
+            const int v = std::min<float>(scale * row[col], val_max);
+            if (v != 0) {
+                int rgb[3] = {int(v * color[0]), int(v * color[1]),
+                              int(v * color[2])};
+                rgb[channel] = v;
+                getGUIColor(rgb[0], rgb[1], rgb[2]);
+                buffer_row[col] = trace_rgba(rgb[0], rgb[1], rgb[2], v);
+            }
+        }
+    }
+}
 
+void build_luma_trace(const array2D<int> &wave, float scale, int cairo_stride,
+                      std::vector<unsigned char> &buffer)
+{
     constexpr float val_max = 255;
+    const int wave_width = wave.width();
+    const int wave_height = wave.height();
+
+    buffer.assign(static_cast<std::size_t>(wave_height) * cairo_stride, 0);
+    assert(buffer.size() % 4 == 0);
+
+    for (int val = 0; val < wave_height; val++) {
+        const int *const l_row = wave[val];
+        std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
+            buffer.data() + (255 - val) * cairo_stride);
+        for (int col = 0; col < wave_width; col++) {
+            const unsigned char l = std::min<float>(scale * l_row[col], val_max);
+            buffer_row[col] = trace_rgba(l, l, l, l);
+        }
+    }
+}
 
-    if (parade_buffer_r_dirty && needRed) {
-        parade_buffer_r.assign(buffer_size, 0);
-        assert(parade_buffer_r.size() % 4 == 0);
-
-        for (int val = 0; val < wave_height; val++) {
-            const int *const r_row = rwave[val];
-            std::uint32_t *const buffer_r_row = reinterpret_cast<uint32_t *>(
-                parade_buffer_r.data() + (255 - val) * cairo_stride);
-            for (int col = 0; col < wave_width; col++) {
-                int r = std::min<float>(scale * r_row[col], val_max);
-                if (r != 0) {
-                    int a = r;
-                    int g = r * rgb_R[1];
-                    int b = r * rgb_R[2];
-                    getGUIColor(r, g, b);
-                    buffer_r_row[col] = rgba(r, g, b, a);
-                }
-            }
+} // namespace
+
+void HistogramArea::renderTraces()
+{
+    if (scopeType == ScopeType::PARADE || scopeType == ScopeType::WAVEFORM) {
+        if (rwave.width() <= 0) {
+            return;
         }
 
-        parade_buffer_r_dirty = false;
-    }
-
-    if (parade_buffer_g_dirty && needGreen) {
-        parade_buffer_g.assign(buffer_size, 0);
-        assert(parade_buffer_g.size() % 4 == 0);
-
-        for (int val = 0; val < wave_height; val++) {
-            const int *const g_row = gwave[val];
-            std::uint32_t *const buffer_g_row = reinterpret_cast<uint32_t *>(
-                parade_buffer_g.data() + (255 - val) * cairo_stride);
-            for (int col = 0; col < wave_width; col++) {
-                int g = std::min<float>(scale * g_row[col], val_max);
-                if (g != 0) {
-                    int a = g;
-                    int r = g * rgb_G[0];
-                    int b = g * rgb_G[2];
-                    getGUIColor(r, g, b);
-                    buffer_g_row[col] = rgba(r, g, b, a);
+        // Arbitrary scale factor divided by current scale.
+        const float scale = trace_brightness * 32.f * 255.f / waveform_scale;
+        const int wave_width = rwave.width();
+        const int wave_height = rwave.height();
+        const int cairo_stride = Cairo::ImageSurface::format_stride_for_width(
+            Cairo::FORMAT_ARGB32, wave_width);
+
+        if (wave_buffer_luma_dirty && needLuma) {
+            build_luma_trace(lwave, scale, cairo_stride, wave_buffer_luma);
+            wave_buffer_luma_dirty = false;
+        }
+
+        if (scopeType == ScopeType::PARADE) {
+            if (parade_buffer_r_dirty && needRed) {
+                build_parade_trace(rwave, 0, rgb_R, scale, cairo_stride,
+                                   parade_buffer_r);
+                parade_buffer_r_dirty = false;
+            }
+
+            if (parade_buffer_g_dirty && needGreen) {
+                build_parade_trace(gwave, 1, rgb_G, scale, cairo_stride,
+                                   parade_buffer_g);
+                parade_buffer_g_dirty = false;
+            }
+
+            if (parade_buffer_b_dirty && needBlue) {
+                // Make blue easier to see.
+                build_parade_trace(bwave, 2, rgb_B, scale, cairo_stride,
+                                   parade_buffer_b);
+                parade_buffer_b_dirty = false;
+            }
+        } else if (wave_buffer_dirty && (needRed || needGreen || needBlue)) {
+            constexpr float val_max = 255.f;
+
+            wave_buffer.assign(
+                static_cast<std::size_t>(wave_height) * cairo_stride, 0);
+            assert(wave_buffer.size() % 4 == 0);
+
+            for (int val = 0; val < wave_height; val++) {
+                const int *const r_row = rwave[val];
+                const int *const g_row = gwave[val];
+                const int *const b_row = bwave[val];
+                std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
+                    wave_buffer.data() + (255 - val) * cairo_stride);
+                for (int col = 0; col < wave_width; col++) {
+                    int r = needRed
+                                ? std::min<float>(scale * r_row[col], val_max)
+                                : 0;
+                    int b = needBlue
+                                ? std::min<float>(scale * b_row[col], val_max)
+                                : 0;
+                    int g = needGreen
+                                ? rtengine::LIM(
+                                      std::min<float>(scale * g_row[col],
+                                                      val_max) +
+                                          float(needBlue ? b * rgb_B[1] : 0),
+                                      0.f, val_max)
+                                : 0;
+                    int value = rtengine::max(r, g, b);
+                    if (value != 0) {
+                        // Ensures correct order regardless of endianness.
+                        getGUIColor(r, g, b);
+                        buffer_row[col] = trace_rgba(r, g, b, value);
+                    }
                 }
             }
+
+            wave_buffer_dirty = false;
+        }
+    } else if (scopeType == ScopeType::VECTORSCOPE_HC ||
+               scopeType == ScopeType::VECTORSCOPE_HS) {
+        const auto &vect =
+            (scopeType == ScopeType::VECTORSCOPE_HC) ? vect_hc : vect_hs;
+        auto &vect_buffer = (scopeType == ScopeType::VECTORSCOPE_HC)
+                                ? vect_hc_buffer
+                                : vect_hs_buffer;
+        auto &vect_buffer_dirty = (scopeType == ScopeType::VECTORSCOPE_HC)
+                                      ? vect_hc_buffer_dirty
+                                      : vect_hs_buffer_dirty;
+
+        if (!vect_buffer_dirty || vectorscope_scale <= 0) {
+            return;
         }
 
-        parade_buffer_g_dirty = false;
-    }
-
-    if (parade_buffer_b_dirty && needBlue) {
-        parade_buffer_b.assign(buffer_size, 0);
-        assert(parade_buffer_b.size() % 4 == 0);
-
-        for (int val = 0; val < wave_height; val++) {
-            const int *const b_row = bwave[val];
-            std::uint32_t *const buffer_b_row = reinterpret_cast<uint32_t *>(
-                parade_buffer_b.data() + (255 - val) * cairo_stride);
-            for (int col = 0; col < wave_width; col++) {
-                int b = std::min<float>(scale * b_row[col], val_max);
-                if (b != 0) {
-                    int a = b;
-                    int g = b * rgb_B[1]; // Make blue easier to see.
-                    int r = b * rgb_B[0];
-                    getGUIColor(r, g, b);
-                    buffer_b_row[col] = rgba(r, g, b, a);
-                }
+        const int vect_width = vect.width();
+        const int vect_height = vect.height();
+        // Arbitrary scale factor multiplied by vectorscope area and divided by
+        // current scale.
+        const float scale = trace_brightness * 8.f * vect_width * vect_height /
+                            vectorscope_scale;
+        const int cairo_stride = Cairo::ImageSurface::format_stride_for_width(
+            Cairo::FORMAT_ARGB32, vect_width);
+
+        vect_buffer.resize(static_cast<std::size_t>(cairo_stride) *
+                           vect_height);
+        assert(vect_buffer.size() % 4 == 0);
+
+        for (int y = 0; y < vect_height; y++) {
+            const int *const vect_row = vect[y];
+            std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
+                vect_buffer.data() + (vect_height - 1 - y) * cairo_stride);
+            for (int x = 0; x < vect_width; x++) {
+                const unsigned char value =
+                    std::min<float>(scale * vect_row[x], 0xff);
+                buffer_row[x] =
+                    value | (value << 8) | (value << 16) | (value << 24);
             }
         }
 
-        parade_buffer_b_dirty = false;
+        vect_buffer_dirty = false;
     }
+}
 
-    if (wave_buffer_luma_dirty && needLuma) {
-        wave_buffer_luma.assign(buffer_size, 0);
-        assert(wave_buffer_luma.size() % 4 == 0);
-
-        for (int val = 0; val < wave_height; val++) {
-            const int *const l_row = lwave[val];
-            std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
-                wave_buffer_luma.data() + (255 - val) * cairo_stride);
-            for (int col = 0; col < wave_width; col++) {
-                const unsigned char l =
-                    std::min<float>(scale * l_row[col], val_max);
-                buffer_row[col] = rgba(l, l, l, l);
+void HistogramArea::renderTracesInBackground()
+{
+    while (true) {
+        {
+            MyMutex::MyLock lock(traces_mutex_);
+            if (!traces_pending_) {
+                traces_rendering_ = false;
+                return;
             }
+            traces_pending_ = false;
+            renderTraces();
         }
 
-        wave_buffer_luma_dirty = false;
+        scheduleRedraw();
     }
+}
+
+void HistogramArea::drawParade(Cairo::RefPtr<Cairo::Context> &cr, int w, int h)
+{
+    const int wave_width = rwave.width();
+    const int wave_height = rwave.height();
+
+    // See Cairo documentation on stride.
+    const int cairo_stride = Cairo::ImageSurface::format_stride_for_width(
+        Cairo::FORMAT_ARGB32, rwave.width());
 
     std::vector<unsigned char *> buffers;
     if (needLuma) {
@@ -2133,45 +2275,14 @@ void HistogramArea::drawVectorscope(Cairo::RefPtr<Cairo::Context> &cr, int w,
     auto &vect_buffer = (scopeType == ScopeType::VECTORSCOPE_HC)
                             ? vect_hc_buffer
                             : vect_hs_buffer;
-    auto &vect_buffer_dirty = (scopeType == ScopeType::VECTORSCOPE_HC)
-                                  ? vect_hc_buffer_dirty
-                                  : vect_hs_buffer_dirty;
 
     const int vect_width = vect.width();
     const int vect_height = vect.height();
-    // Arbitrary scale factor multiplied by vectorscope area and divided by
-    // current scale.
-    const float scale =
-        trace_brightness * 8.f * vect_width * vect_height / vectorscope_scale;
 
     // See Cairo documentation on stride.
     const int cairo_stride = Cairo::ImageSurface::format_stride_for_width(
         Cairo::FORMAT_ARGB32, vect_width);
 
-    if (vect_buffer_dirty && vectorscope_scale > 0) {
-        if (vect_buffer.size() !=
-            static_cast<std::size_t>(cairo_stride) * vect_height) {
-            vect_buffer.resize(static_cast<std::size_t>(cairo_stride) *
-                               vect_height);
-        }
-
-        assert(vect_buffer.size() % 4 == 0);
-
-        for (int y = 0; y < vect_height; y++) {
-            const int *const vect_row = vect[y];
-            std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
-                vect_buffer.data() + (vect_height - 1 - y) * cairo_stride);
-            for (int x = 0; x < vect_width; x++) {
-                const unsigned char value =
-                    std::min<float>(scale * vect_row[x], 0xff);
-                buffer_row[x] =
-                    value | (value << 8) | (value << 16) | (value << 24);
-            }
-        }
-
-        vect_buffer_dirty = false;
-    }
-
     const bool fit_width =
         vect_width * (h - 2 * padding) > vect_height * (w - 2 * padding);
     const float scope_scale = fit_width ? (w - 2 * padding) / vect_width
@@ -2328,75 +2439,12 @@ void HistogramArea::drawVectorscope(Cairo::RefPtr<Cairo::Context> &cr, int w,
 void HistogramArea::drawWaveform(Cairo::RefPtr<Cairo::Context> &cr, int w,
                                  int h)
 {
-    // Arbitrary scale factor divided by current scale.
-    const float scale = trace_brightness * 32.f * 255.f / waveform_scale;
     const int wave_width = rwave.width();
     const int wave_height = rwave.height();
 
     // See Cairo documentation on stride.
     const int cairo_stride = Cairo::ImageSurface::format_stride_for_width(
         Cairo::FORMAT_ARGB32, rwave.width());
-    const auto buffer_size =
-        static_cast<std::vector<unsigned char>::size_type>(wave_height) *
-        cairo_stride;
-
-    const auto rgba = [](uint32_t r, uint32_t g, uint32_t b,
-                         uint32_t a) -> uint32_t {
-        return b | (g << 8) | (r << 16) | (a << 24);
-    };
-
-    constexpr float val_max = 255.f;
-
-    if (wave_buffer_dirty && (needRed || needGreen || needBlue)) {
-        wave_buffer.assign(buffer_size, 0);
-        assert(wave_buffer.size() % 4 == 0);
-
-        for (int val = 0; val < wave_height; val++) {
-            const int *const r_row = rwave[val];
-            const int *const g_row = gwave[val];
-            const int *const b_row = bwave[val];
-            std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
-                wave_buffer.data() + (255 - val) * cairo_stride);
-            for (int col = 0; col < wave_width; col++) {
-                int r =
-                    needRed ? std::min<float>(scale * r_row[col], val_max) : 0;
-                int b =
-                    needBlue ? std::min<float>(scale * b_row[col], val_max) : 0;
-                int g = needGreen
-                            ? rtengine::LIM(
-                                  std::min<float>(scale * g_row[col], val_max) +
-                                      float(needBlue ? b * rgb_B[1] : 0),
-                                  0.f, val_max)
-                            : 0;
-                int value = rtengine::max(r, g, b);
-                if (value != 0) {
-                    // Ensures correct order regardless of endianness.
-                    getGUIColor(r, g, b);
-                    buffer_row[col] = rgba(r, g, b, value);
-                }
-            }
-        }
-
-        wave_buffer_dirty = false;
-    }
-
-    if (wave_buffer_luma_dirty && needLuma) {
-        wave_buffer_luma.assign(buffer_size, 0);
-        assert(wave_buffer_luma.size() % 4 == 0);
-
-        for (int val = 0; val < wave_height; val++) {
-            const int *const l_row = lwave[val];
-            std::uint32_t *const buffer_row = reinterpret_cast<uint32_t *>(
-                wave_buffer_luma.data() + (255 - val) * cairo_stride);
-            for (int col = 0; col < wave_width; col++) {
-                const unsigned char l =
-                    std::min<float>(scale * l_row[col], val_max);
-                buffer_row[col] = rgba(l, l, l, l);
-            }
-        }
-
-        wave_buffer_luma_dirty = false;
-    }
 
     Cairo::RefPtr<Cairo::ImageSurface> surface;
     auto orig_matrix = cr->get_matrix();
@@ -2527,10 +2575,12 @@ void HistogramArea::setBrightness(float brightness)
 {
     brightness = LIM<float>(brightness, MIN_BRIGHT, MAX_BRIGHT);
     if (brightness != trace_brightness) {
+        MyMutex::MyLock lock(traces_mutex_);
         parade_buffer_r_dirty = parade_buffer_g_dirty = parade_buffer_b_dirty =
             wave_buffer_dirty = wave_buffer_luma_dirty = vect_hc_buffer_dirty =
                 vect_hs_buffer_dirty = true;
         trace_brightness = brightness;
+        lock.unlock();
         setDirty(true);
         queue_draw();
 
@@ -19,6 +19,7 @@
  */
 #pragma once
 
+#include <future>
 #include <vector>
 
 #include <cairomm/cairomm.h>
@@ -32,6 +33,7 @@
 #include "guiutils.h"
 #include "options.h"
 #include "pointermotionlistener.h"
+#include "threadutils.h"
 
 using rtengine::array2D;
 class HistogramArea;
@@ -215,6 +217,13 @@ protected:
 
     bool is_main_;
 
+    // the trace buffers of the scopes are rendered by a background job; at
+    // most one is in flight, further updates just mark it as pending
+    MyMutex traces_mutex_;
+    bool traces_rendering_;
+    bool traces_pending_;
+    std::future<void> traces_job_;
+
 public:
     explicit HistogramArea(DrawModeListener *fml = nullptr,
                            bool is_main = true);
@@ -255,6 +264,10 @@ private:
     void drawVectorscope(Cairo::RefPtr<Cairo::Context> &cr, int hsize,
                          int vsize);
     void drawWaveform(Cairo::RefPtr<Cairo::Context> &cr, int hsize, int vsize);
+    /// Builds the dirty trace buffers, with traces_mutex_ held.
+    void renderTraces();
+    void renderTracesInBackground();
+    void scheduleRedraw();
     Gtk::SizeRequestMode get_request_mode_vfunc() const override;
     void get_preferred_height_vfunc(int &minimum_height,
                                     int &natural_height) const override;
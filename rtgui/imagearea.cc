@@ -22,6 +22,7 @@
 #include "multilangmgr.h"
 #include "options.h"
 #include "shortcutmanager.h"
+#include <algorithm>
 #include <cmath>
 #include <ctime>
 
@@ -159,6 +160,14 @@ void ImageArea::on_style_updated()
     queue_draw();
 }
 
+void ImageArea::setPlaceholder(Cairo::RefPtr<Cairo::ImageSurface> img)
+{
+    if (img || placeholder_) {
+        placeholder_ = img;
+        queue_draw();
+    }
+}
+
 void ImageArea::setInfoText(Glib::ustring text)
 {
     infotext = text;
@@ -251,6 +260,23 @@ bool ImageArea::on_draw(const ::Cairo::RefPtr<Cairo::Context> &cr)
 
      */
 
+    if (placeholder_) {
+        const int w = get_allocated_width();
+        const int h = get_allocated_height();
+        const int pw = placeholder_->get_width();
+        const int ph = placeholder_->get_height();
+        const double scale = std::min(double(w) / pw, double(h) / ph);
+
+        get_style_context()->render_background(cr, 0, 0, w, h);
+        cr->save();
+        cr->translate((w - pw * scale) / 2, (h - ph * scale) / 2);
+        cr->scale(scale, scale);
+        cr->set_source(placeholder_, 0, 0);
+        cr->paint();
+        cr->restore();
+        return true;
+    }
+
     if (mainCropWindow) {
         mainCropWindow->expose(cr);
     }
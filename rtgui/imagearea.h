@@ -79,6 +79,7 @@ protected:
 
     int fullImageWidth, fullImageHeight;
     AreaDrawListenerProvider *alp_;
+    Cairo::RefPtr<Cairo::ImageSurface> placeholder_;
 
 public:
     CropWindow *mainCropWindow;
@@ -111,6 +112,10 @@ public:
     void setScrollPosition(int x, int y); // called by the imageareapanel when
                                           // the scrollbars have been changed
 
+    // image shown in place of the crop windows (e.g. the embedded preview
+    // while the image is being loaded). An empty pointer removes it
+    void setPlaceholder(Cairo::RefPtr<Cairo::ImageSurface> img);
+
     // enabling and setting text of info area
     void setInfoText(Glib::ustring text);
     void infoEnabled(bool e);
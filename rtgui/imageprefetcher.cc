@@ -0,0 +1,195 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "imageprefetcher.h"
+#include "../rtengine/asyncreader.h"
+#include "../rtengine/imagesource.h"
+#include "../rtengine/threadpool.h"
+#include "options.h"
+#include "thumbnail.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// rough upper bound of the memory used by a loaded image: the raw data plus
+// the float buffers allocated by the image source
+size_t estimate_memory(Thumbnail *thm)
+{
+    int w = 0, h = 0;
+    thm->getOriginalSize(w, h);
+    return (w > 0 && h > 0) ? size_t(w) * size_t(h) *
+                                  (sizeof(uint16_t) + 3 * sizeof(float))
+                            : 0;
+}
+
+} // namespace
+
+ImagePrefetcher *ImagePrefetcher::getInstance()
+{
+    static ImagePrefetcher instance_;
+    return &instance_;
+}
+
+ImagePrefetcher::~ImagePrefetcher() { clear(); }
+
+std::list<ImagePrefetcher::Entry>::iterator
+ImagePrefetcher::find(const Glib::ustring &fname)
+{
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->fname == fname) {
+            return it;
+        }
+    }
+    return entries_.end();
+}
+
+void ImagePrefetcher::release(std::list<Entry>::iterator it)
+{
+    // an image still being loaded is released by process() when done
+    if (it->img) {
+        it->img->decreaseRef();
+    }
+    entries_.erase(it);
+}
+
+void ImagePrefetcher::prefetch(const std::vector<Thumbnail *> &thumbs)
+{
+    const size_t budget =
+        size_t(std::max(options.editor_prefetch_memory_limit, 0)) * 1024 *
+        1024;
+    std::vector<Glib::ustring> to_load;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::list<Entry> keep;
+        size_t used = 0;
+        for (auto thm : thumbs) {
+            const Glib::ustring fname = thm->getFileName();
+            const size_t bytes = estimate_memory(thm);
+            if (!bytes || used + bytes > budget) {
+                continue;
+            }
+            used += bytes;
+
+            auto it = find(fname);
+            if (it != entries_.end()) {
+                keep.splice(keep.end(), entries_, it);
+            } else {
+                Entry e;
+                e.fname = fname;
+                e.raw = thm->getType() == FT_Raw;
+                e.bytes = bytes;
+                e.state = State::QUEUED;
+                e.img = nullptr;
+                keep.push_back(e);
+                to_load.push_back(fname);
+            }
+        }
+
+        while (!entries_.empty()) {
+            release(entries_.begin());
+        }
+        entries_.swap(keep);
+    }
+
+    // the files are read by the I/O threads first, so that the decoding
+    // doesn't keep a worker of the pool waiting for the disk
+    for (auto &fname : to_load) {
+        rtengine::AsyncReader::getInstance()->prefetch(
+            fname, [this, fname](bool) -> void {
+                rtengine::ThreadPool::add_task(
+                    rtengine::ThreadPool::Priority::LOW,
+                    [this, fname]() -> void { process(fname); });
+            });
+    }
+}
+
+void ImagePrefetcher::process(const Glib::ustring &fname)
+{
+    bool raw = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = find(fname);
+        if (it == entries_.end() || it->state != State::QUEUED) {
+            return;
+        }
+        it->state = State::LOADING;
+        raw = it->raw;
+    }
+
+    if (options.rtSettings.verbose) {
+        std::cout << "ImagePrefetcher: loading " << fname << std::endl;
+    }
+
+    int error = 0;
+    rtengine::InitialImage *img =
+        rtengine::InitialImage::load(fname, raw, &error, nullptr);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = find(fname);
+    if (it != entries_.end() &&
+        (it->state == State::LOADING || it->state == State::QUEUED)) {
+        it->img = img;
+        it->state = img ? State::READY : State::FAILED;
+    } else if (img) {
+        // no longer wanted
+        img->decreaseRef();
+    }
+    cond_.notify_all();
+}
+
+rtengine::InitialImage *ImagePrefetcher::load(const Glib::ustring &fname,
+                                              bool isRaw, int *errorCode,
+                                              rtengine::ProgressListener *pl)
+{
+    rtengine::InitialImage *img = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = find(fname);
+        while (it != entries_.end() && it->state == State::LOADING) {
+            cond_.wait(lock);
+            it = find(fname);
+        }
+        if (it != entries_.end()) {
+            std::swap(img, it->img);
+            entries_.erase(it);
+        }
+    }
+
+    if (!img) {
+        return rtengine::InitialImage::load(fname, isRaw, errorCode, pl);
+    }
+
+    if (options.rtSettings.verbose) {
+        std::cout << "ImagePrefetcher: using prefetched " << fname
+                  << std::endl;
+    }
+    img->getImageSource()->setProgressListener(pl);
+    *errorCode = 0;
+    return img;
+}
+
+void ImagePrefetcher::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!entries_.empty()) {
+        release(entries_.begin());
+    }
+}
@@ -0,0 +1,89 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../rtengine/noncopyable.h"
+#include "../rtengine/rtengine.h"
+#include <condition_variable>
+#include <glibmm.h>
+#include <list>
+#include <mutex>
+#include <vector>
+
+class Thumbnail;
+
+/**
+ * Speculative loading of the images adjacent to the one open in the (single
+ * tab) editor, so that moving to the next/previous image of the file browser
+ * doesn't have to wait for the raw file to be decoded.
+ *
+ * Files are first read by rtengine::AsyncReader and then decoded at low
+ * priority in the thread pool, and the total (estimated) memory kept by the
+ * prefetched images is bounded by options.editor_prefetch_memory_limit. A prefetched image is handed over to
+ * the first caller of load() for the same file, and it is not kept in the
+ * cache anymore afterwards.
+ */
+class ImagePrefetcher: public rtengine::NonCopyable {
+public:
+    static ImagePrefetcher *getInstance();
+
+    /**
+     * Sets the images to prefetch, in order of priority. Previously
+     * prefetched images not in the list are released.
+     *
+     * @note expects to be called from the gtk thread
+     */
+    void prefetch(const std::vector<Thumbnail *> &thumbs);
+
+    /**
+     * Same interface as rtengine::InitialImage::load(): returns the
+     * prefetched image for fname if available (waiting for it if it is
+     * being loaded), otherwise loads it.
+     */
+    rtengine::InitialImage *load(const Glib::ustring &fname, bool isRaw,
+                                 int *errorCode,
+                                 rtengine::ProgressListener *pl);
+
+    /// releases all the prefetched images
+    void clear();
+
+private:
+    ImagePrefetcher() = default;
+    ~ImagePrefetcher();
+
+    enum class State { QUEUED, LOADING, READY, FAILED };
+
+    struct Entry {
+        Glib::ustring fname;
+        bool raw;
+        size_t bytes;
+        State state;
+        rtengine::InitialImage *img;
+    };
+
+    std::list<Entry>::iterator find(const Glib::ustring &fname);
+    void release(std::list<Entry>::iterator it);
+    void process(const Glib::ustring &fname);
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::list<Entry> entries_;
+};
+
+#define imagePrefetcher ImagePrefetcher::getInstance()
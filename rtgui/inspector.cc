@@ -20,8 +20,10 @@
 #include <gtkmm.h>
 #include <iomanip>
 
+#include "../rtengine/cache.h"
 #include "../rtengine/imagedata.h"
 #include "../rtengine/previewimage.h"
+#include "../rtengine/threadpool.h"
 #include "cursormanager.h"
 #include "filecatalog.h"
 #include "focusmask.h"
@@ -30,9 +32,39 @@
 #include "multilangmgr.h"
 #include "options.h"
 #include "rtwindow.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <set>
 
 extern Options options;
 
+//-----------------------------------------------------------------------------
+// InspectorRequest
+//-----------------------------------------------------------------------------
+
+/*
+ * What to decode: the image scaled to fit width x height, or at full size
+ * when they are negative. In the latter case, if view_width and view_height
+ * are positive, only the part of the embedded preview of raw files around
+ * (center_x, center_y) (relative to the image size) covering a view of that
+ * size is decoded.
+ */
+struct InspectorRequest {
+    int width;
+    int height;
+    double center_x;
+    double center_y;
+    int view_width;
+    int view_height;
+
+    InspectorRequest()
+        : width(-1), height(-1), center_x(0.5), center_y(0.5), view_width(0),
+          view_height(0)
+    {
+    }
+};
+
 //-----------------------------------------------------------------------------
 // InspectorBuffer
 //-----------------------------------------------------------------------------
@@ -45,14 +77,28 @@ public:
     BackBuffer imgBuffer;
     Glib::ustring imgPath;
     std::array<LUTu, 3> histogram;
-
-    explicit InspectorBuffer(const Glib::ustring &imgagePath, int width = -1,
-                             int height = -1);
+    size_t bytes;
+    // position of imgBuffer in the whole image, and size of the latter
+    int x;
+    int y;
+    int full_width;
+    int full_height;
+
+    InspectorBuffer(const Glib::ustring &imgagePath,
+                    const InspectorRequest &req);
     //~InspectorBuffer();
+
+    // the image with the focus mask, computed on the whole image the first
+    // time it is needed, and then reused while panning and redrawing
+    BackBuffer &focusMask();
+
+private:
+    BackBuffer maskBuffer;
 };
 
-InspectorBuffer::InspectorBuffer(const Glib::ustring &imagePath, int width,
-                                 int height)
+InspectorBuffer::InspectorBuffer(const Glib::ustring &imagePath,
+                                 const InspectorRequest &req)
+    : bytes(0), x(0), y(0), full_width(0), full_height(0)
 {
     if (!imagePath.empty() &&
         Glib::file_test(imagePath, Glib::FILE_TEST_EXISTS) &&
@@ -67,26 +113,198 @@ InspectorBuffer::InspectorBuffer(const Glib::ustring &imagePath, int width,
             return;
         }
 
-        rtengine::PreviewImage pi(imagePath, ext, width, height,
+        rtengine::PreviewImage pi(imagePath, ext, req.width, req.height,
                                   options.thumbnail_inspector_enable_cms,
                                   options.thumbnail_inspector_show_histogram);
+        pi.setRegion(req.center_x, req.center_y, req.view_width,
+                     req.view_height);
         Cairo::RefPtr<Cairo::ImageSurface> imageSurface = pi.getImage();
         pi.getHistogram(histogram[0], histogram[1], histogram[2]);
+        pi.getRegion(x, y, full_width, full_height);
 
         if (imageSurface) {
             imgBuffer.setSurface(imageSurface);
+            bytes = size_t(imageSurface->get_stride()) *
+                    size_t(imageSurface->get_height());
         } else {
             imgPath.clear();
         }
     }
 }
 
+BackBuffer &InspectorBuffer::focusMask()
+{
+    if (!maskBuffer.surfaceCreated() && imgBuffer.surfaceCreated()) {
+        auto src = imgBuffer.getSurface();
+        src->flush();
+        auto dst = Cairo::ImageSurface::create(
+            src->get_format(), src->get_width(), src->get_height());
+        dst->flush();
+        std::copy(src->get_data(),
+                  src->get_data() + src->get_stride() * src->get_height(),
+                  dst->get_data());
+        addFocusMask(src->get_data(), dst->get_data(), src->get_width(),
+                     src->get_height(), src->get_stride(), dst->get_stride(),
+                     0, 0);
+        dst->mark_dirty();
+        maskBuffer.setSurface(dst);
+    }
+    return maskBuffer;
+}
+
+//-----------------------------------------------------------------------------
+// InspectorCache
+//-----------------------------------------------------------------------------
+
+/*
+ * The decoded images, shared by the two sides of the split view, so that an
+ * image shown on both sides (or again after switching side) is decoded only
+ * once. The cache is bounded both in the number of images and in memory
+ * (options.inspector_cache_memory_limit).
+ *
+ * The neighbours of the current image are decoded in the thread pool. A
+ * prefetch request replaces the previous one, so that moving quickly across
+ * the file browser doesn't pile up the decoding of images no longer needed,
+ * and a request for an image whose decoding is in progress waits for it
+ * instead of decoding it again.
+ */
+class InspectorCache: public std::enable_shared_from_this<InspectorCache> {
+public:
+    InspectorCache();
+
+    std::shared_ptr<InspectorBuffer> get(const Glib::ustring &path,
+                                         const InspectorRequest &req);
+    void prefetch(const std::vector<Glib::ustring> &paths,
+                  const InspectorRequest &req);
+    void clear();
+
+private:
+    static Glib::ustring key(const Glib::ustring &path,
+                             const InspectorRequest &req);
+    void decode(const Glib::ustring &path, const InspectorRequest &req,
+                unsigned int gen);
+    void store(const Glib::ustring &k, std::shared_ptr<InspectorBuffer> buf,
+               unsigned int gen);
+
+    rtengine::Cache<Glib::ustring, std::shared_ptr<InspectorBuffer>> cache_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::set<Glib::ustring> pending_; // being decoded
+    std::set<Glib::ustring> wanted_;  // the last prefetch request
+    unsigned int generation_;
+};
+
+InspectorCache::InspectorCache()
+    // room for the images of both sides and for the prefetched ones
+    : cache_(std::max(options.maxInspectorBuffers, 1) + 1, nullptr,
+             size_t(options.inspector_cache_memory_limit) * 1024 * 1024),
+      generation_(0)
+{
+}
+
+Glib::ustring InspectorCache::key(const Glib::ustring &path,
+                                  const InspectorRequest &req)
+{
+    // the same image decoded for areas of different size is not the same
+    if (req.view_width > 0 && req.view_height > 0) {
+        return Glib::ustring::compose("%1x%2@%3,%4/%5x%6:%7", req.width,
+                                      req.height, req.center_x, req.center_y,
+                                      req.view_width, req.view_height, path);
+    }
+    return Glib::ustring::compose("%1x%2:%3", req.width, req.height, path);
+}
+
+std::shared_ptr<InspectorBuffer>
+InspectorCache::get(const Glib::ustring &path, const InspectorRequest &req)
+{
+    const auto k = key(path, req);
+    std::shared_ptr<InspectorBuffer> res;
+    unsigned int gen = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&]() -> bool { return !pending_.count(k); });
+        if (cache_.get(k, res)) {
+            return res;
+        }
+        pending_.insert(k);
+        gen = generation_;
+    }
+
+    res = std::make_shared<InspectorBuffer>(path, req);
+    store(k, res, gen);
+
+    if (res->imgPath.empty()) {
+        res.reset();
+    }
+    return res;
+}
+
+void InspectorCache::prefetch(const std::vector<Glib::ustring> &paths,
+                              const InspectorRequest &req)
+{
+    unsigned int gen = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wanted_.clear();
+        for (auto &p : paths) {
+            wanted_.insert(key(p, req));
+        }
+        gen = generation_;
+    }
+
+    auto self = shared_from_this();
+    for (auto &p : paths) {
+        rtengine::ThreadPool::add_task(
+            rtengine::ThreadPool::Priority::LOW,
+            [self, p, req, gen]() -> void { self->decode(p, req, gen); });
+    }
+}
+
+void InspectorCache::decode(const Glib::ustring &path,
+                            const InspectorRequest &req, unsigned int gen)
+{
+    const auto k = key(path, req);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (gen != generation_ || !wanted_.count(k) || pending_.count(k) ||
+            cache_.contains(k)) {
+            return;
+        }
+        pending_.insert(k);
+    }
+
+    store(k, std::make_shared<InspectorBuffer>(path, req), gen);
+}
+
+void InspectorCache::store(const Glib::ustring &k,
+                           std::shared_ptr<InspectorBuffer> buf,
+                           unsigned int gen)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.erase(k);
+    // images decoded before a clear() are stale (e.g. with a different
+    // display mode)
+    if (gen == generation_ && !buf->imgPath.empty()) {
+        cache_.set(k, buf, buf->bytes);
+    }
+    cond_.notify_all();
+}
+
+void InspectorCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+    wanted_.clear();
+    cache_.clear();
+}
+
 //-----------------------------------------------------------------------------
 // InspectorArea
 //-----------------------------------------------------------------------------
 
 InspectorArea::InspectorArea()
-    : cache_(std::max(options.maxInspectorBuffers, 1)), cur_image_(nullptr),
+    : rel_center_(0.5, 0.5), cache_(std::make_shared<InspectorCache>()),
+      cur_image_(nullptr),
       active_(false), first_active_(true), highlight_(false),
       has_focus_mask_(false), info_text_(""), hist_bb_(nullptr, false)
 {
@@ -109,17 +327,6 @@ InspectorArea::InspectorArea()
 
 InspectorArea::~InspectorArea() { deleteBuffers(); }
 
-namespace {
-
-void show_focus_mask(Cairo::RefPtr<Cairo::ImageSurface> surface)
-{
-    addFocusMask(surface->get_data(), surface->get_data(), surface->get_width(),
-                 surface->get_height(), surface->get_stride(),
-                 surface->get_stride(), 1, 1);
-}
-
-} // namespace
-
 bool InspectorArea::on_draw(const ::Cairo::RefPtr<Cairo::Context> &cr)
 {
     Glib::RefPtr<Gdk::Window> win = get_window();
@@ -145,8 +352,8 @@ bool InspectorArea::on_draw(const ::Cairo::RefPtr<Cairo::Context> &cr)
         rtengine::Coord dest(0, 0);
         availableSize.x = win->get_width();
         availableSize.y = win->get_height();
-        int imW = cur_image_->imgBuffer.getWidth();
-        int imH = cur_image_->imgBuffer.getHeight();
+        int imW = cur_image_->full_width;
+        int imH = cur_image_->full_height;
 
         if (imW < availableSize.x) {
             // center the image in the available space along X
@@ -183,11 +390,14 @@ bool InspectorArea::on_draw(const ::Cairo::RefPtr<Cairo::Context> &cr)
         // define the destination area
         auto dw = rtengine::min<int>(availableSize.x - dest.x, imW);
         auto dh = rtengine::min<int>(availableSize.y - dest.y, imH);
-        cur_image_->imgBuffer.setDrawRectangle(win, dest.x, dest.y, dw, dh,
-                                               false);
-        cur_image_->imgBuffer.setSrcOffset(topLeft.x, topLeft.y);
-
-        if (!cur_image_->imgBuffer.surfaceCreated()) {
+        BackBuffer &buf = has_focus_mask_ ? cur_image_->focusMask()
+                                          : cur_image_->imgBuffer;
+        buf.setDrawRectangle(win, dest.x, dest.y, dw, dh, false);
+        // the buffer can hold only a region of the image
+        buf.setSrcOffset(std::max(topLeft.x - cur_image_->x, 0),
+                         std::max(topLeft.y - cur_image_->y, 0));
+
+        if (!buf.surfaceCreated()) {
             return false;
         }
 
@@ -197,18 +407,7 @@ bool InspectorArea::on_draw(const ::Cairo::RefPtr<Cairo::Context> &cr)
         Glib::RefPtr<Gtk::StyleContext> style = get_style_context();
         style->render_background(cr, 0, 0, get_width(), get_height());
 
-        if (has_focus_mask_) {
-            int sw = std::min(win->get_width(), imW);
-            int sh = std::min(win->get_height(), imH);
-            BackBuffer surf(sw, sh); // win->get_width(), win->get_height());
-            cur_image_->imgBuffer.setDestPosition(0, 0);
-            cur_image_->imgBuffer.copySurface(&surf);
-            show_focus_mask(surf.getSurface());
-            surf.setDestPosition(dest.x, dest.y);
-            surf.copySurface(win);
-        } else {
-            cur_image_->imgBuffer.copySurface(win);
-        }
+        buf.copySurface(win);
 
         // draw the frame
         c = highlight_ ? style->get_color(Gtk::STATE_FLAG_SELECTED)
@@ -268,11 +467,11 @@ void InspectorArea::mouseMove(rtengine::Coord2D pos, int transform)
         return;
     }
 
+    rel_center_.set(rtengine::LIM01(pos.x), rtengine::LIM01(pos.y));
     if (cur_image_) {
-        center.set(int(rtengine::LIM01(pos.x) *
-                       double(cur_image_->imgBuffer.getWidth())),
-                   int(rtengine::LIM01(pos.y) *
-                       double(cur_image_->imgBuffer.getHeight())));
+        center.set(int(rel_center_.x * double(cur_image_->full_width)),
+                   int(rel_center_.y * double(cur_image_->full_height)));
+        updateRegion();
     } else {
         center.set(0, 0);
     }
@@ -280,6 +479,37 @@ void InspectorArea::mouseMove(rtengine::Coord2D pos, int transform)
     queue_draw();
 }
 
+void InspectorArea::updateRegion()
+{
+    Glib::RefPtr<Gdk::Window> win = get_window();
+    if (!win || !cur_image_ || cur_image_->imgPath.empty()) {
+        return;
+    }
+
+    // the area drawn by on_draw()
+    const int W = cur_image_->full_width;
+    const int H = cur_image_->full_height;
+    const int ww = win->get_width();
+    const int wh = win->get_height();
+    const int x =
+        W < ww ? 0 : std::max(std::min(center.x + ww / 2, W) - ww, 0);
+    const int y =
+        H < wh ? 0 : std::max(std::min(center.y + wh / 2, H) - wh, 0);
+
+    if (x < cur_image_->x || y < cur_image_->y ||
+        x + std::min(ww, W) >
+            cur_image_->x + cur_image_->imgBuffer.getWidth() ||
+        y + std::min(wh, H) >
+            cur_image_->y + cur_image_->imgBuffer.getHeight()) {
+        InspectorRequest req;
+        getRequest(req);
+        auto img = cache_->get(cur_image_->imgPath, req);
+        if (img) {
+            cur_image_ = img;
+        }
+    }
+}
+
 void InspectorArea::switchImage(const Glib::ustring &fullPath, bool recenter,
                                 rtengine::Coord2D newcenter)
 {
@@ -306,6 +536,15 @@ bool InspectorArea::doSwitchImage(bool recenter, rtengine::Coord2D newcenter)
 {
     Glib::ustring fullPath = next_image_path_;
 
+    if (recenter) {
+        if (newcenter.x >= 0 && newcenter.y >= 0) {
+            rel_center_.set(rtengine::LIM01(newcenter.x),
+                            rtengine::LIM01(newcenter.y));
+        } else {
+            rel_center_.set(0.5, 0.5);
+        }
+    }
+
     if (fullPath.empty()) {
         cur_image_.reset();
     } else {
@@ -313,15 +552,8 @@ bool InspectorArea::doSwitchImage(bool recenter, rtengine::Coord2D newcenter)
     }
 
     if (cur_image_ && recenter) {
-        if (newcenter.x >= 0 && newcenter.y >= 0) {
-            center.set(rtengine::LIM01(newcenter.x) *
-                           cur_image_->imgBuffer.getWidth(),
-                       rtengine::LIM01(newcenter.y) *
-                           cur_image_->imgBuffer.getHeight());
-        } else {
-            center.set(cur_image_->imgBuffer.getWidth() / 2,
-                       cur_image_->imgBuffer.getHeight() / 2);
-        }
+        center.set(rel_center_.x * cur_image_->full_width,
+                   rel_center_.y * cur_image_->full_height);
     }
 
     if (cur_image_ && options.thumbnail_inspector_show_histogram) {
@@ -333,40 +565,51 @@ bool InspectorArea::doSwitchImage(bool recenter, rtengine::Coord2D newcenter)
     return true;
 }
 
+void InspectorArea::getRequest(InspectorRequest &req)
+{
+    Glib::RefPtr<Gdk::Window> win = get_window();
+    req = InspectorRequest();
+    if (!win) {
+        return;
+    }
+    if (options.thumbnail_inspector_zoom_fit) {
+        req.width = win->get_width();
+        req.height = win->get_height();
+    } else {
+        // at 1:1, only the part around the view is decoded, with a margin
+        // of half the view on every side so that panning around doesn't
+        // need to decode again at every move
+        req.center_x = rel_center_.x;
+        req.center_y = rel_center_.y;
+        req.view_width = 2 * win->get_width();
+        req.view_height = 2 * win->get_height();
+    }
+}
+
 std::shared_ptr<InspectorBuffer>
 InspectorArea::doCacheImage(const Glib::ustring &fullPath)
 {
-    std::shared_ptr<InspectorBuffer> res;
-    if (!cache_.get(fullPath, res)) {
-        Glib::RefPtr<Gdk::Window> win = get_window();
-        int width = -1, height = -1;
-        if (win && options.thumbnail_inspector_zoom_fit) {
-            width = win->get_width();
-            height = win->get_height();
-        }
-
-        // Loading a new image
-        res = std::make_shared<InspectorBuffer>(fullPath, width, height);
+    InspectorRequest req;
+    getRequest(req);
+    return cache_->get(fullPath, req);
+}
 
-        // and add it to the tail
-        if (res->imgPath.empty()) {
-            res.reset();
-        } else {
-            cache_.set(fullPath, res);
-        }
-    }
-    return res;
+void InspectorArea::prefetchImages(const std::vector<Glib::ustring> &paths)
+{
+    InspectorRequest req;
+    getRequest(req);
+    cache_->prefetch(paths, req);
 }
 
-void InspectorArea::preloadImage(const Glib::ustring &fullPath)
+void InspectorArea::setCache(std::shared_ptr<InspectorCache> cache)
 {
-    // std::cout << "PRELOAD: " << fullPath << std::endl;
-    doCacheImage(fullPath);
+    cache_ = cache;
+    cur_image_.reset();
 }
 
 void InspectorArea::deleteBuffers()
 {
-    cache_.clear();
+    cache_->clear();
     cur_image_.reset();
 }
 
@@ -381,8 +624,9 @@ void InspectorArea::flushBuffers()
 
 void InspectorArea::setActive(bool state)
 {
+    // the cache may be shared with other areas, which are still active
     if (!state) {
-        flushBuffers();
+        cur_image_.reset();
     }
 
     active_ = state;
@@ -507,8 +751,8 @@ void InspectorArea::updateHistogram()
 bool InspectorArea::onMouseMove(GdkEventMotion *evt)
 {
     if (active_ && cur_image_ && prev_point_.x >= 0) {
-        double w = cur_image_->imgBuffer.getWidth();
-        double h = cur_image_->imgBuffer.getHeight();
+        double w = cur_image_->full_width;
+        double h = cur_image_->full_height;
         if (w > 0 && h > 0) {
             constexpr double gain = 4.0;
             double dx = center.x - (evt->x - prev_point_.x) * gain;
@@ -526,8 +770,8 @@ bool InspectorArea::onMousePress(GdkEventButton *evt)
         prev_point_.set(evt->x, evt->y);
         CursorManager::setWidgetCursor(get_window(), CSHandClosed);
         if (cur_image_) {
-            double w = cur_image_->imgBuffer.getWidth();
-            double h = cur_image_->imgBuffer.getHeight();
+            double w = cur_image_->full_width;
+            double h = cur_image_->full_height;
             auto win = get_window();
             if (w > 0 && h > 0) {
                 int ww = win->get_width();
@@ -559,7 +803,8 @@ bool InspectorArea::onMouseRelease(GdkEventButton *evt)
 //-----------------------------------------------------------------------------
 
 Inspector::Inspector(FileCatalog *filecatalog)
-    : filecatalog_(filecatalog), focusmask_on_("focusscreen-on.svg"),
+    : filecatalog_(filecatalog), cache_(std::make_shared<InspectorCache>()),
+      focusmask_on_("focusscreen-on.svg"),
       focusmask_off_("focusscreen-off.svg")
 {
     ibox_.pack_start(ins_[0], Gtk::PACK_EXPAND_WIDGET, 3);
@@ -579,6 +824,7 @@ Inspector::Inspector(FileCatalog *filecatalog)
     num_active_ = 1;
     temp_zoom_11_ = false;
     for (size_t i = 0; i < 2; ++i) {
+        ins_[i].setCache(cache_);
         ins_[i].set_can_focus(true);
         ins_[i].add_events(Gdk::BUTTON_PRESS_MASK);
         ins_[i].signal_button_press_event().connect_notify(
@@ -634,9 +880,20 @@ void Inspector::flushBuffers()
     }
 }
 
+void Inspector::reload(bool recenter, rtengine::Coord2D pos)
+{
+    // flush all the sides before switching any of them, as they share the
+    // cache
+    flushBuffers();
+    for (size_t i = 0; i < num_active_; ++i) {
+        ins_[i].switchImage(cur_image_[i], recenter, pos);
+    }
+}
+
 void Inspector::setActive(bool state)
 {
     if (!state) {
+        flushBuffers();
         toolbar_->hide();
     } else {
         toolbar_->show();
@@ -699,32 +956,26 @@ void Inspector::switchImage(const Glib::ustring &fullPath)
     }
     if (j < entries.size()) {
         cur_image_idx_[active_] = j;
-        Glib::ustring prev, next;
-        if (options.maxInspectorBuffers > 2) {
-            for (size_t i = j; i > 0; --i) {
-                if (!entries[i - 1]->filtered) {
-                    prev = entries[i - 1]->filename;
+        // the ring of neighbours to decode in advance, alternating the next
+        // and the previous images, starting from the closest ones
+        std::vector<Glib::ustring> ring;
+        const size_t n = std::max(options.maxInspectorBuffers - 1, 0);
+        size_t next = j + 1, prev = j;
+        while (ring.size() < n && (next < entries.size() || prev > 0)) {
+            for (; next < entries.size(); ++next) {
+                if (!entries[next]->filtered) {
+                    ring.push_back(entries[next++]->filename);
                     break;
                 }
             }
-        }
-        if (options.maxInspectorBuffers > 1) {
-            for (size_t i = j + 1; i < entries.size(); ++i) {
-                if (!entries[i]->filtered) {
-                    next = entries[i]->filename;
+            for (; prev > 0 && ring.size() < n; --prev) {
+                if (!entries[prev - 1]->filtered) {
+                    ring.push_back(entries[--prev]->filename);
                     break;
                 }
             }
         }
-        idle_register_.add([this, prev, next]() -> bool {
-            if (!next.empty()) {
-                ins_[active_].preloadImage(next);
-            }
-            if (!prev.empty()) {
-                ins_[active_].preloadImage(prev);
-            }
-            return false;
-        });
+        ins_[active_].prefetchImages(ring);
     }
 }
 
@@ -943,10 +1194,7 @@ void Inspector::mode_toggled(Gtk::ToggleButton *b)
                 rtengine::Settings::ThumbnailInspectorRawCurve::RAW_CLIPPING;
         }
 
-        for (size_t i = 0; i < num_active_; ++i) {
-            ins_[i].flushBuffers();
-            ins_[i].switchImage(cur_image_[i]);
-        }
+        reload();
     }
 }
 
@@ -966,20 +1214,14 @@ void Inspector::do_toggle_zoom(Gtk::ToggleButton *b, rtengine::Coord2D pos)
 
         options.thumbnail_inspector_zoom_fit = zoomfit_->get_active();
 
-        for (size_t i = 0; i < num_active_; ++i) {
-            ins_[i].flushBuffers();
-            ins_[i].switchImage(cur_image_[i], true, pos);
-        }
+        reload(true, pos);
     }
 }
 
 void Inspector::cms_toggled()
 {
     options.thumbnail_inspector_enable_cms = cms_->get_active();
-    for (size_t i = 0; i < num_active_; ++i) {
-        ins_[i].flushBuffers();
-        ins_[i].switchImage(cur_image_[i]);
-    }
+    reload();
 }
 
 void Inspector::toggleShowInfo() { info_->set_active(!info_->get_active()); }
@@ -1068,10 +1310,7 @@ void Inspector::split_toggled()
 void Inspector::histogram_toggled()
 {
     options.thumbnail_inspector_show_histogram = histogram_->get_active();
-    for (size_t i = 0; i < num_active_; ++i) {
-        ins_[i].flushBuffers();
-        ins_[i].switchImage(cur_image_[i]);
-    }
+    reload();
 }
 
 void Inspector::focus_mask_toggled()
@@ -1162,10 +1401,7 @@ void Inspector::onInspectorResized(Gtk::Allocation &a)
         }
 
         const auto doit = [this]() -> bool {
-            for (size_t i = 0; i < num_active_; ++i) {
-                ins_[i].flushBuffers();
-                ins_[i].switchImage(cur_image_[i]);
-            }
+            reload();
             return false;
         };
 
@@ -19,13 +19,16 @@
  */
 #pragma once
 
-#include "../rtengine/cache.h"
 #include "../rtengine/coord.h"
 #include "guiutils.h"
 #include "histogrampanel.h"
 #include <gtkmm.h>
+#include <memory>
+#include <vector>
 
 class InspectorBuffer;
+class InspectorCache;
+struct InspectorRequest;
 class FileCatalog;
 
 class InspectorArea: public Gtk::DrawingArea {
@@ -96,7 +99,15 @@ public:
 
     void setHighlight(bool yes) { highlight_ = yes; }
 
-    void preloadImage(const Glib::ustring &fullPath);
+    /** @brief Decode the given images in the background, in order of
+     * priority, so that switching to them later doesn't have to wait
+     */
+    void prefetchImages(const std::vector<Glib::ustring> &paths);
+
+    /** @brief Share the decoded images with other inspector areas (e.g. the
+     * two sides of the split view)
+     */
+    void setCache(std::shared_ptr<InspectorCache> cache);
 
 private:
     bool on_draw(const ::Cairo::RefPtr<Cairo::Context> &cr) override;
@@ -109,10 +120,15 @@ private:
     void updateHistogram();
     std::shared_ptr<InspectorBuffer>
     doCacheImage(const Glib::ustring &fullPath);
+    void getRequest(InspectorRequest &req);
+    // decodes a new region of the current image if the view moved out of
+    // the decoded one
+    void updateRegion();
 
     rtengine::Coord center;
-    rtengine::Cache<Glib::ustring, std::shared_ptr<InspectorBuffer>>
-        cache_; // std::vector<InspectorBuffer*> images;
+    // the center relative to the image size, for the region to decode
+    rtengine::Coord2D rel_center_;
+    std::shared_ptr<InspectorCache> cache_;
     // InspectorBuffer* currImage;
     std::shared_ptr<InspectorBuffer> cur_image_;
     // double zoom;
@@ -181,8 +197,11 @@ private:
     void on_released();
     void do_toggle_zoom(Gtk::ToggleButton *b,
                         rtengine::Coord2D pos = rtengine::Coord2D(-1, -1));
+    void reload(bool recenter = false,
+                rtengine::Coord2D pos = rtengine::Coord2D(-1, -1));
 
     FileCatalog *filecatalog_;
+    std::shared_ptr<InspectorCache> cache_;
 
     Gtk::HBox ibox_;
     std::array<Glib::ustring, 2> cur_image_;
@@ -219,6 +238,4 @@ private:
     sigc::connection delayconn_;
 
     bool temp_zoom_11_;
-
-    IdleRegister idle_register_;
 };
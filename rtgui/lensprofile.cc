@@ -749,7 +749,7 @@ bool LensProfilePanel::checkLensfunCanCorrect(bool automatch)
 
     rtengine::procparams::ProcParams lpp;
     write(&lpp);
-    const std::unique_ptr<LFModifier> mod(
+    const std::shared_ptr<const LFModifier> mod(
         LFDatabase::getInstance()->findModifier(lpp.lensProf, metadata, 100,
                                                 100, lpp.coarse, -1));
     return static_cast<bool>(mod);
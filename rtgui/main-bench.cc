@@ -0,0 +1,933 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// ART-bench: runs a corpus of raw files through the raw decoder, all the
+// applicable demosaicing methods and the full output pipeline, and reports
+// the throughput in megapixels per second over several repetitions. With -k,
+// it also times the most used low-level kernels of rtengine on synthetic
+// images, at several sizes and thread counts. With -r, it replays editing
+// sessions recorded by ART (see SessionRecorder) and reports the latency of
+// the preview for each kind of event.
+
+#include "../rtengine/LUT3D.h"
+#include "../rtengine/array2D.h"
+#include "../rtengine/boxblur.h"
+#include "../rtengine/clutstore.h"
+#include "../rtengine/gauss.h"
+#include "../rtengine/guidedfilter.h"
+#include "../rtengine/imagesource.h"
+#include "../rtengine/procparams.h"
+#include "../rtengine/rt_algo.h"
+#include "../rtengine/rtengine.h"
+#include "../rtengine/settings.h"
+#include "config.h"
+#include "options.h"
+#include "pathutils.h"
+#include "sessionrecorder.h"
+#include "version.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <giomm.h>
+#include <iomanip>
+#include <iostream>
+#include <locale.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <tiffio.h>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+extern Options options;
+
+// stores path to data files
+Glib::ustring creditsPath;
+Glib::ustring licensePath;
+Glib::ustring argv1;
+
+namespace {
+
+using rtengine::procparams::ProcParams;
+using rtengine::procparams::RAWParams;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+    Glib::ustring file;
+    Glib::ustring sensor;
+    Glib::ustring test;
+    double megapixels;
+    int threads = 0;
+    std::vector<double> seconds;
+
+    double median() const
+    {
+        std::vector<double> s = seconds;
+        std::sort(s.begin(), s.end());
+        const size_t n = s.size();
+        return n % 2 ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+    }
+
+    double stddev() const
+    {
+        double mean = 0;
+        for (auto s : seconds) {
+            mean += s;
+        }
+        mean /= seconds.size();
+        double var = 0;
+        for (auto s : seconds) {
+            var += (s - mean) * (s - mean);
+        }
+        return std::sqrt(var / std::max(seconds.size() - 1, size_t(1)));
+    }
+
+    double throughput() const { return megapixels / median(); }
+};
+
+struct Config {
+    int repeats = 5;
+    int warmup = 1;
+    std::vector<Glib::ustring> profiles;
+    std::vector<Glib::ustring> files;
+    Glib::ustring json_output;
+    bool decode = true;
+    bool demosaic = true;
+    bool pipeline = true;
+    bool kernels = false;
+    std::vector<std::pair<int, int>> sizes;
+    std::vector<int> threads;
+    Glib::ustring clut;
+    std::vector<Glib::ustring> sessions;
+    std::vector<int> scales;
+};
+
+void print_help(const char *progname)
+{
+    std::cout
+        << "Usage: " << Glib::path_get_basename(progname)
+        << " [options] [<files|dirs>]\n\n"
+        << "Options:\n"
+        << "  -n <N>       Number of timed repetitions (default: 5)\n"
+        << "  -w <N>       Number of untimed warm-up runs (default: 1)\n"
+        << "  -p <file"
+        << paramFileExtension
+        << ">  Processing profile for the full pipeline test;\n"
+        << "               can be given multiple times (default: neutral)\n"
+        << "  -j <file>    Also write the results as JSON\n"
+        << "  -x <tests>   Skip the given tests, a combination of\n"
+        << "               d (decode), m (demosaic), p (pipeline)\n"
+        << "  -k           Also time the individual kernels on synthetic\n"
+        << "               images (no files needed)\n"
+        << "  -s <W>x<H>   Image size for the kernels; can be given\n"
+        << "               multiple times (default: 1000x1000 and 6000x4000)\n"
+        << "  -t <N>       Number of threads for the kernels; can be given\n"
+        << "               multiple times (default: 1 and all)\n"
+        << "  -c <file>    HaldCLUT to use for the kernels\n"
+        << "  -r <dir>     Replay a recorded editing session, and report the\n"
+        << "               preview latency per event; can be given multiple\n"
+        << "               times\n"
+        << "  -z <N>       Preview scale (1 = 100%) for the replay; can be\n"
+        << "               given multiple times (default: 1 and 4)\n"
+        << "  -V           Verbose output\n"
+        << "  -h           Display this help message\n";
+}
+
+// times fn, which must return false on errors
+template <class F>
+bool measure(const Config &cfg, Result &res, F fn)
+{
+    for (int i = 0; i < cfg.warmup; ++i) {
+        if (!fn()) {
+            return false;
+        }
+    }
+    for (int i = 0; i < cfg.repeats; ++i) {
+        const auto start = Clock::now();
+        if (!fn()) {
+            return false;
+        }
+        const std::chrono::duration<double> d = Clock::now() - start;
+        res.seconds.push_back(d.count());
+    }
+    return true;
+}
+
+void report(const Result &r)
+{
+    std::cout << std::left << std::setw(40)
+              << Glib::path_get_basename(r.file).substr(0, 39)
+              << std::setw(8) << r.sensor << std::setw(24) << r.test
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << r.megapixels << std::setprecision(3)
+              << std::setw(10) << r.median() << std::setw(10) << r.stddev()
+              << std::setprecision(2) << std::setw(10) << r.throughput()
+              << std::endl;
+}
+
+bool save_json(const Glib::ustring &fname, const std::vector<Result> &results,
+               const Config &cfg)
+{
+    std::ofstream out(fname.c_str());
+    if (!out) {
+        return false;
+    }
+    const auto quote = [](const Glib::ustring &s) -> std::string {
+        std::string r = "\"";
+        for (char c : std::string(s)) {
+            if (c == '"' || c == '\\') {
+                r += '\\';
+            }
+            r += c;
+        }
+        return r + "\"";
+    };
+    out << "{\n  \"version\": " << quote(RTVERSION)
+        << ",\n  \"repeats\": " << cfg.repeats << ",\n  \"results\": [";
+    const char *sep = "\n";
+    for (auto &r : results) {
+        out << sep << "    {\"file\": " << quote(r.file)
+            << ", \"sensor\": " << quote(r.sensor)
+            << ", \"test\": " << quote(r.test)
+            << ", \"megapixels\": " << r.megapixels
+            << ", \"threads\": " << r.threads
+            << ", \"median_s\": " << r.median()
+            << ", \"stddev_s\": " << r.stddev()
+            << ", \"mp_per_s\": " << r.throughput() << ", \"seconds\": [";
+        for (size_t i = 0; i < r.seconds.size(); ++i) {
+            out << (i ? ", " : "") << r.seconds[i];
+        }
+        out << "]}";
+        sep = ",\n";
+    }
+    out << "\n  ]\n}\n";
+    return bool(out);
+}
+
+Glib::ustring sensor_name(rtengine::ImageSource *src)
+{
+    switch (src->getSensorType()) {
+    case rtengine::ST_BAYER:
+        return src->getFrameCount() > 1 ? "bayer-ps" : "bayer";
+    case rtengine::ST_FUJI_XTRANS:
+        return "xtrans";
+    case rtengine::ST_FOVEON:
+        return "foveon";
+    default:
+        return "other";
+    }
+}
+
+void bench_file(const Glib::ustring &fname, const Config &cfg,
+                std::vector<Result> &results)
+{
+    int error = 0;
+    rtengine::InitialImage *ii =
+        rtengine::InitialImage::load(fname, true, &error, nullptr);
+    if (!ii) {
+        std::cerr << "Error: cannot load " << fname << std::endl;
+        return;
+    }
+    rtengine::ImageSource *src = ii->getImageSource();
+    int w = 0, h = 0;
+    src->getFullSize(w, h);
+
+    Result base;
+    base.file = fname;
+    base.sensor = sensor_name(src);
+    base.megapixels = double(w) * h / 1e6;
+
+    const auto add = [&](Result &r, bool ok) -> void {
+        if (ok) {
+            report(r);
+            results.push_back(r);
+        } else {
+            std::cerr << "Error: " << r.test << " failed on " << fname
+                      << std::endl;
+        }
+    };
+
+    if (cfg.decode) {
+        Result r = base;
+        r.test = "decode";
+        add(r, measure(cfg, r, [&]() -> bool {
+                int err = 0;
+                auto img = rtengine::InitialImage::load(fname, true, &err);
+                if (img) {
+                    img->decreaseRef();
+                }
+                return img && !err;
+            }));
+    }
+
+    if (cfg.demosaic) {
+        ProcParams params;
+        std::vector<std::pair<Glib::ustring, RAWParams>> methods;
+        if (src->getSensorType() == rtengine::ST_BAYER) {
+            typedef RAWParams::BayerSensor::Method Method;
+            const auto &names = RAWParams::BayerSensor::getMethodStrings();
+            for (size_t i = 0; i < names.size(); ++i) {
+                const Method m = Method(i);
+                if (m == Method::NONE ||
+                    (m == Method::PIXELSHIFT && src->getFrameCount() < 4)) {
+                    continue;
+                }
+                RAWParams raw = params.raw;
+                raw.bayersensor.method = m;
+                methods.emplace_back(names[i], raw);
+            }
+        } else if (src->getSensorType() == rtengine::ST_FUJI_XTRANS) {
+            typedef RAWParams::XTransSensor::Method Method;
+            const auto &names = RAWParams::XTransSensor::getMethodStrings();
+            for (size_t i = 0; i < names.size(); ++i) {
+                const Method m = Method(i);
+                if (m == Method::NONE) {
+                    continue;
+                }
+                RAWParams raw = params.raw;
+                raw.xtranssensor.method = m;
+                methods.emplace_back(names[i], raw);
+            }
+        }
+
+        for (auto &m : methods) {
+            Result r = base;
+            r.test = "demosaic:" + m.first;
+            // only the demosaic call is timed, but preprocess() has to run
+            // before each one
+            for (int i = 0; i < cfg.warmup + cfg.repeats; ++i) {
+                double contrast = 0;
+                src->preprocess(m.second, params.lensProf, params.coarse,
+                                false);
+                const auto start = Clock::now();
+                src->demosaic(m.second, false, contrast);
+                const std::chrono::duration<double> d = Clock::now() - start;
+                if (i >= cfg.warmup) {
+                    r.seconds.push_back(d.count());
+                }
+            }
+            add(r, true);
+        }
+    }
+    ii->decreaseRef();
+
+    if (cfg.pipeline) {
+        std::vector<Glib::ustring> profiles = cfg.profiles;
+        if (profiles.empty()) {
+            profiles.push_back("");
+        }
+        for (auto &p : profiles) {
+            ProcParams params;
+            if (!p.empty()) {
+                rtengine::procparams::FilePartialProfile pp(nullptr, p, false);
+                if (!pp.applyTo(params)) {
+                    std::cerr << "Error: cannot load profile " << p
+                              << std::endl;
+                    continue;
+                }
+            }
+            Result r = base;
+            r.test = "pipeline:" + (p.empty() ? Glib::ustring("neutral")
+                                              : Glib::path_get_basename(p));
+            add(r, measure(cfg, r, [&]() -> bool {
+                    int err = 0;
+                    auto job =
+                        rtengine::ProcessingJob::create(fname, true, params);
+                    auto img = rtengine::processImage(job, err, nullptr);
+                    if (img) {
+                        img->free();
+                    }
+                    return img && !err;
+                }));
+        }
+    }
+}
+
+class TestLUT: public rtengine::LUT3D::initializer {
+public:
+    void operator()(float &r, float &g, float &b) override
+    {
+        // anything not trivial, so that the lookups are not all the same
+        std::swap(r, b);
+        g = 1.f - g;
+    }
+};
+
+void bench_kernels(const Config &cfg, std::vector<Result> &results)
+{
+    using rtengine::array2D;
+
+    std::shared_ptr<rtengine::HaldCLUT> clut;
+    if (!cfg.clut.empty()) {
+        clut = rtengine::CLUTStore::getInstance().getHaldClut(cfg.clut);
+        if (!clut) {
+            std::cerr << "Error: cannot load " << cfg.clut << std::endl;
+        }
+    }
+    TestLUT init;
+    rtengine::LUT3D lut;
+    lut.init(33, init);
+
+    for (auto &sz : cfg.sizes) {
+        const int W = sz.first;
+        const int H = sz.second;
+
+        // the same pseudo-random data at every run, with some spatial
+        // correlation like in real images
+        array2D<float> src[3];
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<float> dist(0.f, 1.f);
+        for (int c = 0; c < 3; ++c) {
+            src[c](W, H);
+            for (int y = 0; y < H; ++y) {
+                for (int x = 0; x < W; ++x) {
+                    const float v = 0.5f + 0.25f * std::sin(x * 0.01f + c) *
+                                               std::cos(y * 0.013f);
+                    src[c][y][x] = v + 0.2f * (dist(gen) - 0.5f);
+                }
+            }
+        }
+        array2D<float> dst(W, H);
+        array2D<float> dst2(W, H);
+        array2D<float> dst3(W, H);
+
+        for (int n : cfg.threads) {
+#ifdef _OPENMP
+            omp_set_num_threads(n);
+#endif
+            const bool multithread = n > 1;
+
+            Result base;
+            base.file = std::to_string(W) + "x" + std::to_string(H);
+            base.sensor = "kernel";
+            base.megapixels = double(W) * H / 1e6;
+            base.threads = n;
+
+            const auto run = [&](const char *name,
+                                 const std::function<void()> &fn) -> void {
+                Result r = base;
+                r.test = Glib::ustring(name) + "@" + std::to_string(n) + "t";
+                measure(cfg, r, [&]() -> bool {
+                    fn();
+                    return true;
+                });
+                report(r);
+                results.push_back(r);
+            };
+
+            run("gaussianBlur:s5", [&]() {
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+                gaussianBlur(src[0], dst, W, H, 5.0);
+            });
+            run("gaussianBlur:s30", [&]() {
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+                gaussianBlur(src[0], dst, W, H, 30.0);
+            });
+            run("boxblur:r10", [&]() {
+                rtengine::boxblur(static_cast<float **>(src[0]),
+                                  static_cast<float **>(dst), 10, W, H,
+                                  multithread);
+            });
+            run("guidedFilter:r10", [&]() {
+                rtengine::guidedFilter(src[1], src[0], dst, 10, 1e-3f,
+                                       multithread);
+            });
+            run("guidedFilter3:r10", [&]() {
+                rtengine::guidedFilter(src[1], {&src[0], &src[1], &src[2]},
+                                       {&dst, &dst2, &dst3}, 10, 1e-3f,
+                                       multithread);
+            });
+            run("median_filter:r2", [&]() {
+                rtengine::median_filter(src[0], dst, W, H, 2, multithread);
+            });
+            run("LUT3D::apply", [&]() {
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+                for (int y = 0; y < H; ++y) {
+                    std::vector<float> buf(3 * W);
+                    for (int x = 0; x < W; ++x) {
+                        buf[3 * x] = src[0][y][x];
+                        buf[3 * x + 1] = src[1][y][x];
+                        buf[3 * x + 2] = src[2][y][x];
+                    }
+                    lut.apply(buf.data(), buf.data(), W);
+                    for (int x = 0; x < W; ++x) {
+                        dst[y][x] = buf[3 * x];
+                    }
+                }
+            });
+            if (clut) {
+                run("HaldCLUT::getRGB", [&]() {
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+                    for (int y = 0; y < H; ++y) {
+                        clut->getRGB(1.f, W, src[0][y], src[1][y], src[2][y],
+                                     dst[y], dst2[y], dst3[y]);
+                    }
+                });
+            }
+        }
+    }
+}
+
+// receives the updates of the image processor during a replay: the time of
+// the first update of the crop after an event (i.e. the first pixels the
+// user sees), and the end of the processing
+class ReplayListener: public rtengine::ProgressListener,
+                      public rtengine::PreviewImageListener,
+                      public rtengine::DetailedCropListener {
+public:
+    ReplayListener(int w, int h, int skip)
+        : w_(w), h_(h), skip_(skip), busy_(false), pixels_(-1)
+    {
+    }
+
+    void arm()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        start_ = Clock::now();
+        busy_ = true;
+        pixels_ = -1;
+    }
+
+    // waits for the end of the processing, returns the seconds until the
+    // first pixels (-1 if the crop was not updated) and until the end
+    bool wait(double &pixels, double &idle)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!cond_.wait_for(lock, std::chrono::minutes(5),
+                            [this]() { return !busy_; })) {
+            return false;
+        }
+        pixels = pixels_;
+        idle = std::chrono::duration<double>(end_ - start_).count();
+        return true;
+    }
+
+    void setProgress(double p) override {}
+    void setProgressStr(const Glib::ustring &str) override {}
+    void error(const Glib::ustring &descr) override {}
+
+    void setProgressState(bool inProcessing) override
+    {
+        if (!inProcessing) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            end_ = Clock::now();
+            busy_ = false;
+            cond_.notify_all();
+        }
+    }
+
+    void setImage(rtengine::IImage8 *img, double scale,
+                  const rtengine::procparams::CropParams &cp) override
+    {
+    }
+    void delImage(rtengine::IImage8 *img) override
+    {
+        if (img) {
+            img->free();
+        }
+    }
+    void imageReady(const rtengine::procparams::CropParams &cp) override {}
+
+    void setDetailedCrop(rtengine::IImage8 *img, rtengine::IImage8 *imgtrue,
+                         const rtengine::procparams::ColorManagementParams &cmp,
+                         const rtengine::procparams::CropParams &cp, int cx,
+                         int cy, int cw, int ch, int skip) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (busy_ && pixels_ < 0) {
+            pixels_ =
+                std::chrono::duration<double>(Clock::now() - start_).count();
+        }
+    }
+
+    // a 1600x1000 view in the middle of the image
+    void getWindow(int &cx, int &cy, int &cw, int &ch, int &skip) override
+    {
+        cw = std::min(w_, 1600 * skip_);
+        ch = std::min(h_, 1000 * skip_);
+        cx = (w_ - cw) / 2;
+        cy = (h_ - ch) / 2;
+        skip = skip_;
+    }
+
+private:
+    const int w_;
+    const int h_;
+    const int skip_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    Clock::time_point start_;
+    Clock::time_point end_;
+    bool busy_;
+    double pixels_;
+};
+
+double percentile(std::vector<double> v, double p)
+{
+    std::sort(v.begin(), v.end());
+    const size_t i = std::min(size_t(std::ceil(p * v.size())), v.size());
+    return v[std::max(i, size_t(1)) - 1];
+}
+
+void replay_session(const Glib::ustring &dir, const Config &cfg,
+                    std::vector<Result> &results)
+{
+    struct Event {
+        int flags;
+        Glib::ustring label;
+        ProcParams params;
+    };
+
+    std::ifstream src(Glib::build_filename(dir, "session.txt").c_str());
+    std::string line;
+    Glib::ustring fname;
+    if (std::getline(src, line) && line.compare(0, 6, "image ") == 0) {
+        fname = line.substr(6);
+    }
+    if (fname.empty()) {
+        std::cerr << "Error: " << dir << " is not a recorded session"
+                  << std::endl;
+        return;
+    }
+
+    std::vector<Event> events;
+    while (std::getline(src, line)) {
+        std::istringstream in(line);
+        int n = 0, flags = 0;
+        double t = 0;
+        std::string label;
+        if (!(in >> n >> t >> flags >> label)) {
+            continue;
+        }
+        events.push_back(Event{flags, label, ProcParams()});
+        if (events.back().params.load(
+                nullptr, SessionRecorder::snapshotName(dir, n)) != 0) {
+            std::cerr << "Error: missing parameters of event " << n << " in "
+                      << dir << std::endl;
+            return;
+        }
+    }
+
+    for (int scale : cfg.scales) {
+        int error = 0;
+        rtengine::InitialImage *ii =
+            rtengine::InitialImage::load(fname, true, &error, nullptr);
+        if (!ii) {
+            // not a raw file
+            ii = rtengine::InitialImage::load(fname, false, &error, nullptr);
+        }
+        if (!ii) {
+            std::cerr << "Error: cannot load " << fname << std::endl;
+            return;
+        }
+        int w = 0, h = 0;
+        ii->getImageSource()->getFullSize(w, h);
+        const Glib::ustring sensor = sensor_name(ii->getImageSource());
+
+        ReplayListener listener(w, h, scale);
+        rtengine::StagedImageProcessor *ipc =
+            rtengine::StagedImageProcessor::create(ii);
+        ipc->setProgressListener(&listener);
+        ipc->setPreviewImageListener(&listener);
+        ipc->setPreviewScale(10);
+        rtengine::DetailedCrop *crop = ipc->createCrop(nullptr, false);
+        crop->setListener(&listener);
+
+        // per event kind: seconds until the first pixels and until idle
+        std::map<Glib::ustring, std::pair<std::vector<double>,
+                                          std::vector<double>>>
+            times;
+        bool ok = true;
+        for (auto &ev : events) {
+            *ipc->beginUpdateParams() = ev.params;
+            listener.arm();
+            ipc->endUpdateParams(ev.flags);
+            double pixels = 0, idle = 0;
+            if (!listener.wait(pixels, idle)) {
+                std::cerr << "Error: timeout replaying " << dir << std::endl;
+                ok = false;
+                break;
+            }
+            auto &t = times[ev.label];
+            if (pixels >= 0) {
+                t.first.push_back(pixels);
+            }
+            t.second.push_back(idle);
+        }
+
+        ipc->stopProcessing();
+        delete crop;
+        rtengine::StagedImageProcessor::destroy(ipc);
+        ii->decreaseRef();
+        if (!ok) {
+            return;
+        }
+
+        std::cout << std::endl
+                  << Glib::path_get_basename(dir) << ", scale 1:" << scale
+                  << ", " << events.size() << " events" << std::endl;
+        std::cout << std::left << std::setw(40) << "event" << std::right
+                  << std::setw(8) << "count" << std::setw(10) << "p50 ms"
+                  << std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms"
+                  << std::setw(12) << "idle p50" << std::endl;
+        for (auto &p : times) {
+            auto &px = p.second.first;
+            std::cout << std::left << std::setw(40) << p.first.substr(0, 39)
+                      << std::right << std::setw(8) << p.second.second.size()
+                      << std::fixed << std::setprecision(1);
+            if (px.empty()) {
+                std::cout << std::setw(10) << "-" << std::setw(10) << "-"
+                          << std::setw(10) << "-";
+            } else {
+                std::cout << std::setw(10) << percentile(px, 0.5) * 1e3
+                          << std::setw(10) << percentile(px, 0.95) * 1e3
+                          << std::setw(10) << percentile(px, 0.99) * 1e3;
+            }
+            std::cout << std::setw(12)
+                      << percentile(p.second.second, 0.5) * 1e3 << std::endl;
+
+            if (!px.empty()) {
+                Result r;
+                r.file = fname;
+                r.sensor = sensor;
+                r.test = Glib::ustring::compose("latency:1/%1:%2", scale,
+                                                p.first);
+                r.megapixels = double(w) * h / 1e6;
+                r.seconds = px;
+                results.push_back(r);
+            }
+        }
+    }
+}
+
+void collect_files(const Glib::ustring &path, std::vector<Glib::ustring> &out)
+{
+    if (Glib::file_test(path, Glib::FILE_TEST_IS_DIR)) {
+        std::vector<Glib::ustring> entries;
+        Glib::Dir dir(path);
+        for (const auto &name : dir) {
+            const auto full = Glib::build_filename(path, name);
+            if (Glib::file_test(full, Glib::FILE_TEST_IS_REGULAR) &&
+                options.is_parse_extention(full)) {
+                entries.push_back(full);
+            }
+        }
+        // a stable order, so that runs are comparable
+        std::sort(entries.begin(), entries.end());
+        out.insert(out.end(), entries.begin(), entries.end());
+    } else if (Glib::file_test(path, Glib::FILE_TEST_IS_REGULAR)) {
+        out.push_back(path);
+    } else {
+        std::cerr << "\"" << path << "\" doesn't exist!" << std::endl;
+    }
+}
+
+bool parse_args(int argc, char **argv, Config &cfg)
+{
+    for (int i = 1; i < argc; ++i) {
+        Glib::ustring a(argv[i]);
+        if (a.size() > 1 && a[0] == '-') {
+            const bool has_value = i + 1 < argc;
+            switch (a[1]) {
+            case 'n':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.repeats = std::max(atoi(argv[++i]), 1);
+                break;
+            case 'w':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.warmup = std::max(atoi(argv[++i]), 0);
+                break;
+            case 'p':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.profiles.push_back(fname_to_utf8(argv[++i]));
+                break;
+            case 'j':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.json_output = fname_to_utf8(argv[++i]);
+                break;
+            case 'x':
+                if (!has_value) {
+                    return false;
+                }
+                for (char c : std::string(argv[++i])) {
+                    cfg.decode = cfg.decode && c != 'd';
+                    cfg.demosaic = cfg.demosaic && c != 'm';
+                    cfg.pipeline = cfg.pipeline && c != 'p';
+                }
+                break;
+            case 'k':
+                cfg.kernels = true;
+                break;
+            case 's': {
+                if (!has_value) {
+                    return false;
+                }
+                int w = 0, h = 0;
+                if (sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w <= 0 ||
+                    h <= 0) {
+                    return false;
+                }
+                cfg.sizes.emplace_back(w, h);
+            } break;
+            case 't':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.threads.push_back(std::max(atoi(argv[++i]), 1));
+                break;
+            case 'c':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.clut = fname_to_utf8(argv[++i]);
+                break;
+            case 'r':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.sessions.push_back(fname_to_utf8(argv[++i]));
+                break;
+            case 'z':
+                if (!has_value) {
+                    return false;
+                }
+                cfg.scales.push_back(std::max(atoi(argv[++i]), 1));
+                break;
+            case 'V':
+                ++options.rtSettings.verbose;
+                break;
+            default:
+                return false;
+            }
+        } else {
+            collect_files(fname_to_utf8(argv[i]), cfg.files);
+        }
+    }
+    if (cfg.sizes.empty()) {
+        cfg.sizes = {{1000, 1000}, {6000, 4000}};
+    }
+    if (cfg.threads.empty()) {
+        cfg.threads.push_back(1);
+#ifdef _OPENMP
+        if (omp_get_max_threads() > 1) {
+            cfg.threads.push_back(omp_get_max_threads());
+        }
+#endif
+    }
+    if (cfg.scales.empty()) {
+        cfg.scales = {1, 4};
+    }
+    return cfg.kernels || !cfg.files.empty() || !cfg.sessions.empty();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+#ifndef ART_WIN32_UCRT
+    setlocale(LC_ALL, "");
+#endif
+    setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
+
+    Gio::init();
+
+#ifdef BUILD_BUNDLE
+    Glib::ustring exePath = getExecutablePath(argv[0]);
+
+    if (Glib::path_is_absolute(DATA_SEARCH_PATH)) {
+        options.ART_base_dir = DATA_SEARCH_PATH;
+    } else if (strcmp(DATA_SEARCH_PATH, ".") == 0) {
+        options.ART_base_dir = exePath;
+    } else {
+        options.ART_base_dir = Glib::build_filename(exePath, DATA_SEARCH_PATH);
+    }
+#else
+    options.ART_base_dir = DATA_SEARCH_PATH;
+#endif
+    options.rtSettings.lensfunDbDirectory = LENSFUN_DB_PATH;
+
+    try {
+        Options::load(true, 0);
+    } catch (Options::Error &e) {
+        std::cerr << std::endl << "Error:" << e.get_msg() << std::endl;
+        return -2;
+    }
+
+    TIFFSetWarningHandler(nullptr);
+
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) {
+        print_help(argv[0]);
+        return -1;
+    }
+
+    std::cout << RTNAME << " benchmark, version " << RTVERSION << ", "
+              << cfg.repeats << " repetitions" << std::endl
+              << std::endl;
+    std::cout << std::left << std::setw(40) << "file" << std::setw(8)
+              << "sensor" << std::setw(24) << "test" << std::right
+              << std::setw(8) << "MP" << std::setw(10) << "median s"
+              << std::setw(10) << "stddev" << std::setw(10) << "MP/s"
+              << std::endl;
+
+    std::vector<Result> results;
+    for (auto &f : cfg.files) {
+        bench_file(f, cfg, results);
+    }
+    if (cfg.kernels) {
+        bench_kernels(cfg, results);
+    }
+    for (auto &s : cfg.sessions) {
+        replay_session(s, cfg, results);
+    }
+
+    if (!cfg.json_output.empty() &&
+        !save_json(cfg.json_output, results, cfg)) {
+        std::cerr << "Error: cannot write " << cfg.json_output << std::endl;
+        return -2;
+    }
+
+    return results.empty() ? 1 : 0;
+}
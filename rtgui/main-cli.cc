@@ -23,10 +23,20 @@
 #endif
 #endif
 
+#include "../rtengine/cJSON.h"
 #include "../rtengine/clutstore.h"
+#include "../rtengine/dcp.h"
+#include "../rtengine/deepzoom.h"
+#include "../rtengine/imagefloat.h"
 #include "../rtengine/imgiomanager.h"
+#include "../rtengine/metadata.h"
+#include "../rtengine/pipelineprofiler.h"
+#include "../rtengine/previewimage.h"
 #include "../rtengine/profilestore.h"
+#include "../rtengine/rtlensfun.h"
 #include "../rtengine/settings.h"
+#include "../rtengine/subprocess.h"
+#include "../rtengine/threadpool.h"
 #include "config.h"
 #include "extprog.h"
 #include "fastexport.h"
@@ -37,6 +47,8 @@
 #include "rtimage.h"
 #include "soundman.h"
 #include "version.h"
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <giomm.h>
@@ -50,19 +62,36 @@
 #include <glib/gstdio.h>
 #include <glibmm/fileutils.h>
 #include <glibmm/threads.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 #else
 #include <windows.h>
 #include "conio.h"
 #include <glibmm/thread.h>
 #endif
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <thread>
+#include <unordered_map>
 
 #ifdef WITH_MIMALLOC
 #include <mimalloc.h>
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 extern Options options;
 
 // stores path to data files
@@ -70,6 +99,12 @@ Glib::ustring creditsPath;
 Glib::ustring licensePath;
 Glib::ustring argv1;
 bool progress = false;
+bool server_mode = false;
+Glib::ustring watch_dir;
+std::string watch_job;
+Glib::ustring coordinator_file;
+Glib::ustring zygote_socket;
+int zygote_omp_threads = 1;
 // bool simpleEditor;
 
 namespace {
@@ -84,6 +119,64 @@ bool check_partial_profile(const PartialProfile &pp)
     return pp->applyTo(params);
 }
 
+bool load_default_profile(bool raw, PartialProfile &out)
+{
+    const Glib::ustring &name = raw ? options.defProfRaw : options.defProfImg;
+    Glib::ustring profPath = options.findProfilePath(name);
+    if (profPath == Options::DEFPROFILE_INTERNAL) {
+        out.reset(new rtengine::procparams::FullPartialProfile());
+    } else {
+        Glib::ustring fname = Glib::build_filename(
+            profPath, Glib::path_get_basename(name) + paramFileExtension);
+        out.reset(
+            new rtengine::procparams::FilePartialProfile(nullptr, fname, false));
+    }
+
+    const bool missing =
+        raw ? options.is_defProfRawMissing() : options.is_defProfImgMissing();
+    return !(missing || profPath.empty() ||
+             (profPath != Options::DEFPROFILE_DYNAMIC &&
+              !check_partial_profile(out)));
+}
+
+bool is_raw_file(const Glib::ustring &fname)
+{
+    Glib::ustring ext = getExtension(fname).lowercase();
+    return !(ext == "jpg" || ext == "jpeg" || ext == "tif" || ext == "tiff" ||
+             ext == "png" ||
+             rtengine::ImageIOManager::getInstance()->canLoad(ext));
+}
+
+// returns 0 on success
+int save_image(rtengine::IImagefloat *img, const std::string &outputType,
+               const Glib::ustring &outputFile, int compression,
+               int subsampling, int bits, bool isFloat)
+{
+    if (outputType == "jpg") {
+        return img->saveAsJPEG(outputFile, compression, subsampling);
+    } else if (outputType == "tif") {
+        return img->saveAsTIFF(outputFile, bits, isFloat, compression == 0);
+    } else if (outputType == "png") {
+        return img->saveAsPNG(outputFile, bits);
+    } else {
+        return rtengine::ImageIOManager::getInstance()->save(
+                   img, outputType, outputFile, nullptr)
+                   ? 0
+                   : 1;
+    }
+}
+
+int default_bits(const std::string &outputType)
+{
+    if (outputType == "jpg" || outputType == "png") {
+        return 8;
+    } else if (outputType == "tif") {
+        return 16;
+    } else {
+        return 32;
+    }
+}
+
 } // namespace
 
 /* Process line command options
@@ -96,6 +189,27 @@ bool check_partial_profile(const PartialProfile &pp)
  *  -3 if at least one required procparam file was not found */
 int processLineParams(int argc, char **argv);
 
+/* Runs the jobs read from stdin, one JSON object per line, until EOF or a
+ * "quit" command. Results and progress are written to stdout as JSON lines.
+ * Returns 0 */
+int processServerJobs();
+
+/* Watches watch_dir, and processes the raw files that appear in it (once
+ * they are fully written) according to the watch_job template, with the
+ * output of the server mode. Runs until interrupted */
+int processWatchFolder();
+
+/* Reads the jobs of the server mode from stdin until EOF, and distributes
+ * them to the ART-cli servers started by the commands in coordinator_file
+ * (one per line). Returns 0, or 1 if no server could be started */
+int processCoordinatedJobs();
+
+/* Listens on the unix socket zygote_socket, and serves each connection with
+ * a forked copy of this (already initialised) process, speaking the protocol
+ * of the server mode on the socket. Runs until interrupted; returns 1 if the
+ * socket can't be created */
+int processZygote();
+
 std::pair<bool, int> dontLoadCache(int argc, char **argv);
 
 namespace rtengine {
@@ -186,6 +300,15 @@ int main(int argc, char **argv)
     bool quickstart = p.first;
     int verbose = p.second;
 
+#ifdef _OPENMP
+    // the OpenMP threads would not survive the forks of the zygote, so none
+    // is started in the parent (see processZygote())
+    if (!zygote_socket.empty()) {
+        zygote_omp_threads = omp_get_max_threads();
+        omp_set_num_threads(1);
+    }
+#endif
+
     try {
         Options::load(quickstart, verbose);
     } catch (Options::Error &e) {
@@ -266,15 +389,28 @@ int main(int argc, char **argv)
 
     // printing RT's version in all case, particularly useful for the 'verbose'
     // mode, but also for the batch processing
-    std::cout << RTNAME << ", version " << RTVERSION << ", command line."
-              << std::endl;
-
-    if (argc > 1) {
+    // (on stderr in server mode, where stdout is reserved for the replies)
+    (server_mode ? std::cerr : std::cout)
+        << RTNAME << ", version " << RTVERSION << ", command line."
+        << std::endl;
+
+    if (server_mode) {
+        if (!zygote_socket.empty()) {
+            ret = processZygote();
+        } else if (!coordinator_file.empty()) {
+            ret = processCoordinatedJobs();
+        } else {
+            ret = watch_dir.empty() ? processServerJobs()
+                                    : processWatchFolder();
+        }
+    } else if (argc > 1) {
         ret = processLineParams(argc, argv);
     } else {
         std::cout << "Terminating without anything to do." << std::endl;
     }
 
+    rtengine::PipelineProfiler::getInstance()->flush();
+
     return ret;
 }
 
@@ -306,6 +442,20 @@ std::pair<bool, int> dontLoadCache(int argc, char **argv)
             case '-':
                 if (currParam == "--progress") {
                     progress = true;
+                } else if (currParam == "--server") {
+                    server_mode = true;
+                } else if (currParam == "--watch" && iArg + 1 < argc) {
+                    server_mode = true;
+                    watch_dir = fname_to_utf8(argv[++iArg]);
+                    if (iArg + 1 < argc && argv[iArg + 1][0] == '{') {
+                        watch_job = argv[++iArg];
+                    }
+                } else if (currParam == "--coordinate" && iArg + 1 < argc) {
+                    server_mode = true;
+                    coordinator_file = fname_to_utf8(argv[++iArg]);
+                } else if (currParam == "--zygote" && iArg + 1 < argc) {
+                    server_mode = true;
+                    zygote_socket = fname_to_utf8(argv[++iArg]);
                 }
                 break;
             default:
@@ -314,7 +464,7 @@ std::pair<bool, int> dontLoadCache(int argc, char **argv)
         }
     }
 
-    if (progress) {
+    if (progress || server_mode) {
         verbose = 0;
     }
 
@@ -738,15 +888,7 @@ int processLineParams(int argc, char **argv)
     }
 
     if (bits == -1) {
-        if (outputType == "jpg") {
-            bits = 8;
-        } else if (outputType == "png") {
-            bits = 8;
-        } else if (outputType == "tif") {
-            bits = 16;
-        } else {
-            bits = 32;
-        }
+        bits = default_bits(outputType);
     }
 
     if (!argv1.empty()) {
@@ -766,39 +908,13 @@ int processLineParams(int argc, char **argv)
     output_ext["png"] = "png";
 
     if (useDefault) {
-        Glib::ustring profPath = options.findProfilePath(options.defProfRaw);
-        if (profPath == Options::DEFPROFILE_INTERNAL) {
-            rawParams.reset(new rtengine::procparams::FullPartialProfile());
-        } else {
-            Glib::ustring fname = Glib::build_filename(
-                profPath, Glib::path_get_basename(options.defProfRaw) +
-                              paramFileExtension);
-            rawParams.reset(new rtengine::procparams::FilePartialProfile(
-                nullptr, fname, false));
-        }
-
-        if (options.is_defProfRawMissing() || profPath.empty() ||
-            (profPath != Options::DEFPROFILE_DYNAMIC &&
-             !check_partial_profile(rawParams))) {
+        if (!load_default_profile(true, rawParams)) {
             std::cerr << "Error: default raw processing profile not found."
                       << std::endl;
             return -3;
         }
 
-        profPath = options.findProfilePath(options.defProfImg);
-        if (profPath == Options::DEFPROFILE_INTERNAL) {
-            imgParams.reset(new rtengine::procparams::FullPartialProfile());
-        } else {
-            auto fname = Glib::build_filename(
-                profPath, Glib::path_get_basename(options.defProfImg) +
-                              paramFileExtension);
-            imgParams.reset(new rtengine::procparams::FilePartialProfile(
-                nullptr, fname, false));
-        }
-
-        if (options.is_defProfImgMissing() || profPath.empty() ||
-            (profPath != Options::DEFPROFILE_DYNAMIC &&
-             !check_partial_profile(imgParams))) {
+        if (!load_default_profile(false, imgParams)) {
             std::cerr << "Error: default non-raw processing profile not found."
                       << std::endl;
             return -3;
@@ -818,9 +934,27 @@ int processLineParams(int argc, char **argv)
         std::thread(monitor).detach();
     }
 
+    // when the dynamic profile rules look at the makernotes, read them with
+    // exiftool for several files at once
+    constexpr size_t MAKERNOTES_BATCH_SIZE = 32;
+    const bool prefetch_makernotes =
+        useDefault &&
+        (options.defProfRaw == Options::DEFPROFILE_DYNAMIC ||
+         options.defProfImg == Options::DEFPROFILE_DYNAMIC) &&
+        ProfileStore::getInstance()->usesMakernotes();
+
     for (size_t iFile = 0; iFile < inputFiles.size(); iFile++) {
         cpl.incr();
 
+        if (prefetch_makernotes && iFile % MAKERNOTES_BATCH_SIZE == 0) {
+            rtengine::Exiv2Metadata::prefetchExiftoolMakernotes(
+                std::vector<Glib::ustring>(
+                    inputFiles.begin() + iFile,
+                    inputFiles.begin() +
+                        std::min(iFile + MAKERNOTES_BATCH_SIZE,
+                                 inputFiles.size())));
+        }
+
         // Has to be reinstanciated at each profile to have a ProcParams object
         // with default values
         rtengine::procparams::ProcParams currentParams;
@@ -886,14 +1020,7 @@ int processLineParams(int argc, char **argv)
         }
 
         // Load the image
-        isRaw = true;
-        Glib::ustring ext = getExtension(inputFile).lowercase();
-
-        if (ext == "jpg" || ext == "jpeg" || ext == "tif" || ext == "tiff" ||
-            ext == "png" ||
-            rtengine::ImageIOManager::getInstance()->canLoad(ext)) {
-            isRaw = false;
-        }
+        isRaw = is_raw_file(inputFile);
 
         ii =
             rtengine::InitialImage::load(inputFile, isRaw, &errorCode, nullptr);
@@ -996,21 +1123,8 @@ int processLineParams(int argc, char **argv)
         }
 
         // save image to disk
-        if (outputType == "jpg") {
-            errorCode =
-                resultImage->saveAsJPEG(outputFile, compression, subsampling);
-        } else if (outputType == "tif") {
-            errorCode = resultImage->saveAsTIFF(outputFile, bits, isFloat,
-                                                compression == 0);
-        } else if (outputType == "png") {
-            errorCode = resultImage->saveAsPNG(outputFile, bits);
-        } else {
-            errorCode = rtengine::ImageIOManager::getInstance()->save(
-                            resultImage, outputType, outputFile, nullptr)
-                            ? 0
-                            : 1;
-            // errorCode = resultImage->saveToFile(outputFile);
-        }
+        errorCode = save_image(resultImage, outputType, outputFile, compression,
+                               subsampling, bits, isFloat);
 
         if (errorCode) {
             errors++;
@@ -1037,3 +1151,1036 @@ int processLineParams(int argc, char **argv)
 
     return errors > 0 ? -2 : 0;
 }
+
+namespace {
+
+typedef std::unique_ptr<cJSON, decltype(&cJSON_Delete)> JSONPtr;
+
+class ServerOutput {
+public:
+    void emit(const cJSON *id, const char *event, cJSON *fields = nullptr)
+    {
+        JSONPtr msg(fields ? fields : cJSON_CreateObject(), &cJSON_Delete);
+        if (id) {
+            cJSON_AddItemToObject(msg.get(), "id", cJSON_Duplicate(id, true));
+        }
+        cJSON_AddStringToObject(msg.get(), "event", event);
+        emit(msg.get());
+    }
+
+    // emits an already complete message (e.g. one forwarded from a worker)
+    void emit(const cJSON *msg)
+    {
+        char *s = cJSON_PrintUnformatted(msg);
+        {
+            MyMutex::MyLock l(mutex_);
+            std::cout << s << std::endl;
+        }
+        free(s);
+    }
+
+    void emit_message(const cJSON *id, const char *event,
+                      const Glib::ustring &msg)
+    {
+        cJSON *fields = cJSON_CreateObject();
+        cJSON_AddStringToObject(fields, "message", msg.c_str());
+        emit(id, event, fields);
+    }
+
+private:
+    MyMutex mutex_;
+};
+
+class ServerProgressListener: public rtengine::ProgressListener {
+public:
+    ServerProgressListener(ServerOutput &out, const cJSON *id)
+        : out_(out), id_(id), percent_(-1)
+    {
+    }
+
+    void setProgress(double p)
+    {
+        const int pct = rtengine::LIM(int(p * 100), 0, 100);
+        if (pct != percent_.exchange(pct)) {
+            cJSON *fields = cJSON_CreateObject();
+            cJSON_AddNumberToObject(fields, "progress", pct / 100.0);
+            out_.emit(id_, "progress", fields);
+        }
+    }
+
+    void setProgressStr(const Glib::ustring &str) {}
+    void setProgressState(bool inProcessing) {}
+
+    void error(const Glib::ustring &msg)
+    {
+        out_.emit_message(id_, "warning", msg);
+    }
+
+private:
+    ServerOutput &out_;
+    const cJSON *id_;
+    std::atomic<int> percent_;
+};
+
+Glib::ustring get_string(const cJSON *job, const char *key,
+                         const Glib::ustring &dflt = "")
+{
+    const cJSON *v = cJSON_GetObjectItem(job, key);
+    return cJSON_IsString(v) ? Glib::ustring(v->valuestring) : dflt;
+}
+
+int get_int(const cJSON *job, const char *key, int dflt)
+{
+    const cJSON *v = cJSON_GetObjectItem(job, key);
+    return cJSON_IsNumber(v) ? v->valueint : dflt;
+}
+
+bool get_bool(const cJSON *job, const char *key, bool dflt = false)
+{
+    const cJSON *v = cJSON_GetObjectItem(job, key);
+    return cJSON_IsBool(v) ? cJSON_IsTrue(v) : dflt;
+}
+
+// one of the files written by a server job
+struct ServerJobOutput {
+    std::string type;
+    int compression;
+    int subsampling;
+    int bits;
+    bool isFloat;
+    Glib::ustring file;
+    // size of the box the output is resized to fit in (0: no limit)
+    int width;
+    int height;
+    // output sharpening: -1 as in the processing parameters, 0 off, 1 on
+    int sharpen;
+    // ICC output profile, empty for the one of the processing parameters
+    Glib::ustring profile;
+    // tiles of the "dzi" format
+    int tile_size;
+    int tile_overlap;
+    std::string tile_format;
+};
+
+// reads the settings of an output from spec, which is either the whole job
+// or an element of its "outputs" list merged with the job. Returns an error
+// message or an empty string on success
+Glib::ustring get_server_job_output(const cJSON *spec,
+                                    const Glib::ustring &inputFile,
+                                    const std::unordered_map<std::string,
+                                                             Glib::ustring>
+                                        &output_ext,
+                                    ServerJobOutput &o)
+{
+    o.type = get_string(spec, "format", "jpg").lowercase();
+    o.compression = o.type == "tif" ? (get_bool(spec, "compress") ? 1 : 0)
+                                    : get_int(spec, "quality", 92);
+    o.subsampling = get_int(spec, "subsampling", 3);
+    o.bits = get_int(spec, "bits", default_bits(o.type));
+    o.isFloat = get_bool(spec, "float");
+    o.width = std::max(get_int(spec, "width", 0), 0);
+    o.height = std::max(get_int(spec, "height", 0), 0);
+    const cJSON *sharpen = cJSON_GetObjectItem(spec, "sharpen");
+    o.sharpen = cJSON_IsBool(sharpen) ? int(cJSON_IsTrue(sharpen)) : -1;
+    o.profile = get_string(spec, "profile");
+    o.tile_size = std::max(get_int(spec, "tile_size", 254), 1);
+    o.tile_overlap = std::max(get_int(spec, "tile_overlap", 1), 0);
+    o.tile_format = get_string(spec, "tile_format", "jpg").lowercase();
+
+    auto it = output_ext.find(o.type);
+    const Glib::ustring oext =
+        (it != output_ext.end() && !it->second.empty()) ? it->second
+                                                        : o.type;
+    Glib::ustring outputPath = get_string(spec, "output");
+    if (outputPath.empty()) {
+        outputPath = Glib::path_get_dirname(inputFile);
+    }
+    if (Glib::file_test(outputPath, Glib::FILE_TEST_IS_DIR)) {
+        Glib::ustring s = Glib::path_get_basename(inputFile);
+        o.file = Glib::build_filename(
+            outputPath, s.substr(0, s.find_last_of('.')) +
+                            get_string(spec, "suffix") + "." + oext);
+    } else {
+        o.file = outputPath;
+    }
+
+    if (inputFile == o.file) {
+        return Glib::ustring::compose("cannot overwrite: %1", inputFile);
+    }
+    if (!get_bool(spec, "overwrite") &&
+        Glib::file_test(o.file, Glib::FILE_TEST_EXISTS)) {
+        return Glib::ustring::compose("%1 already exists", o.file);
+    }
+    return "";
+}
+
+rtengine::OutputSpec
+get_output_spec(const ServerJobOutput &o,
+                const rtengine::procparams::ProcParams &params)
+{
+    rtengine::OutputSpec ret(params);
+    if (o.width > 0 || o.height > 0) {
+        auto &r = ret.resize;
+        r.enabled = true;
+        r.appliesTo = "Cropped area";
+        r.unit = rtengine::procparams::ResizeParams::PX;
+        r.allowUpscaling = false;
+        r.width = o.width;
+        r.height = o.height;
+        // 1: width, 2: height, 3: bounding box
+        r.dataspec = o.height <= 0 ? 1 : (o.width <= 0 ? 2 : 3);
+    }
+    if (o.sharpen >= 0) {
+        ret.prsharpening.enabled = o.sharpen;
+    }
+    if (!o.profile.empty()) {
+        ret.outputProfile = o.profile;
+    }
+    return ret;
+}
+
+// Runs a single server job, returns an error message or an empty string on
+// success. See ART_print_help() for the description of the job fields.
+Glib::ustring process_server_job(const cJSON *job, ServerOutput &out,
+                                 const std::unordered_map<std::string,
+                                                          Glib::ustring>
+                                     &output_ext,
+                                 std::vector<Glib::ustring> &outputFiles)
+{
+    const cJSON *id = cJSON_GetObjectItem(job, "id");
+    const Glib::ustring inputFile = get_string(job, "input");
+    if (inputFile.empty()) {
+        return "no input given";
+    }
+
+    // with an "outputs" list, the image is rendered once and then written
+    // to every output (see rtengine::OutputSpec)
+    std::vector<ServerJobOutput> outputs;
+    const cJSON *outlist = cJSON_GetObjectItem(job, "outputs");
+    const bool multi =
+        cJSON_IsArray(outlist) && cJSON_GetArraySize(outlist) > 0;
+    if (multi) {
+        const cJSON *elem = nullptr;
+        cJSON_ArrayForEach(elem, outlist)
+        {
+            if (!cJSON_IsObject(elem)) {
+                return "invalid outputs list";
+            }
+            JSONPtr spec(cJSON_Duplicate(job, true), &cJSON_Delete);
+            cJSON_DeleteItemFromObject(spec.get(), "outputs");
+            const cJSON *field = nullptr;
+            cJSON_ArrayForEach(field, elem)
+            {
+                cJSON_DeleteItemFromObject(spec.get(), field->string);
+                cJSON_AddItemToObject(spec.get(), field->string,
+                                      cJSON_Duplicate(field, true));
+            }
+            outputs.emplace_back();
+            auto err = get_server_job_output(spec.get(), inputFile,
+                                             output_ext, outputs.back());
+            if (!err.empty()) {
+                return err;
+            }
+        }
+    } else {
+        outputs.emplace_back();
+        auto err =
+            get_server_job_output(job, inputFile, output_ext, outputs.back());
+        if (!err.empty()) {
+            return err;
+        }
+    }
+    const Glib::ustring &outputFile = outputs[0].file;
+
+    const bool isRaw = is_raw_file(inputFile);
+    rtengine::procparams::ProcParams currentParams;
+    int errorCode = 0;
+    ServerProgressListener pl(out, id);
+
+    if (get_bool(job, "preview")) {
+        // the embedded preview (or a quick rendering for non-raw files),
+        // available well before the full processing is done
+        const auto start = std::chrono::steady_clock::now();
+        const int sz = get_int(job, "preview_size", -1);
+        const Glib::ustring fname =
+            removeExtension(outputFile) + "-preview.jpg";
+        rtengine::PreviewImage prev(inputFile, getExtension(inputFile), sz,
+                                    sz);
+        if (prev.saveJPEG(fname, 90)) {
+            const double secs =
+                std::chrono::duration_cast<std::chrono::duration<double>>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+            cJSON *fields = cJSON_CreateObject();
+            cJSON_AddStringToObject(fields, "output", fname.c_str());
+            cJSON_AddNumberToObject(fields, "seconds", secs);
+            out.emit(id, "preview", fields);
+        } else {
+            out.emit_message(id, "warning", "no preview available");
+        }
+    }
+
+    rtengine::InitialImage *ii =
+        rtengine::InitialImage::load(inputFile, isRaw, &errorCode, nullptr);
+    if (!ii) {
+        return Glib::ustring::compose("impossible to load file: %1",
+                                      inputFile);
+    }
+
+    const auto fail = [&](const Glib::ustring &msg) -> Glib::ustring {
+        ii->decreaseRef();
+        return msg;
+    };
+
+    if (get_bool(job, "dynamic_profile")) {
+        ProfileStore::getInstance()
+            ->loadDynamicProfile(ii->getMetaData())
+            ->applyTo(currentParams);
+    } else if (get_bool(job, "default_profile")) {
+        PartialProfile dflt;
+        if (!load_default_profile(isRaw, dflt)) {
+            return fail("default processing profile not found");
+        }
+        if ((isRaw ? options.defProfRaw : options.defProfImg) ==
+            Options::DEFPROFILE_DYNAMIC) {
+            dflt = ProfileStore::getInstance()->loadDynamicProfile(
+                ii->getMetaData());
+        }
+        dflt->applyTo(currentParams);
+    }
+
+    const cJSON *profiles = cJSON_GetObjectItem(job, "profiles");
+    const cJSON *prof = nullptr;
+    cJSON_ArrayForEach(prof, profiles)
+    {
+        if (!cJSON_IsString(prof)) {
+            continue;
+        }
+        PartialProfile pp(new rtengine::procparams::FilePartialProfile(
+            nullptr, prof->valuestring, false));
+        if (!pp->applyTo(currentParams)) {
+            return fail(Glib::ustring::compose("\"%1\" not found",
+                                               prof->valuestring));
+        }
+    }
+
+    const cJSON *sidecar = cJSON_GetObjectItem(job, "sidecar");
+    if (cJSON_IsTrue(sidecar) || cJSON_IsString(sidecar)) {
+        Glib::ustring fname = cJSON_IsString(sidecar)
+                                  ? Glib::ustring(sidecar->valuestring)
+                                  : options.getParamFile(inputFile);
+        if (!Glib::file_test(fname, Glib::FILE_TEST_EXISTS) ||
+            currentParams.load(nullptr, fname)) {
+            return fail(Glib::ustring::compose(
+                "no sidecar procparams found for: %1", inputFile));
+        }
+    }
+
+    // with several outputs, the save profile of the first one is used
+    auto p = rtengine::ImageIOManager::getInstance()->getSaveProfile(
+        outputs[0].type);
+    if (p) {
+        p->applyTo(currentParams);
+    }
+    if (!multi) {
+        const auto spec = get_output_spec(outputs[0], currentParams);
+        currentParams.resize = spec.resize;
+        currentParams.prsharpening = spec.prsharpening;
+        currentParams.icm.outputProfile = spec.outputProfile;
+    }
+
+    rtengine::ProcessingJob *pjob = create_processing_job(
+        ii, currentParams, get_bool(job, "fast") && !multi);
+    if (!pjob) {
+        return fail(Glib::ustring::compose(
+            "impossible to create processing job for: %1", inputFile));
+    }
+
+    std::vector<rtengine::IImagefloat *> resultImages;
+    if (multi) {
+        std::vector<rtengine::OutputSpec> specs;
+        for (auto &o : outputs) {
+            specs.push_back(get_output_spec(o, currentParams));
+        }
+        resultImages = rtengine::processImage(pjob, specs, errorCode, &pl);
+    } else {
+        auto img = rtengine::processImage(pjob, errorCode, &pl);
+        if (img) {
+            resultImages.push_back(img);
+        }
+    }
+    if (resultImages.size() != outputs.size()) {
+        rtengine::ProcessingJob::destroy(pjob);
+        for (auto img : resultImages) {
+            img->free();
+        }
+        return fail(
+            Glib::ustring::compose("failure in processing: %1", inputFile));
+    }
+
+    // the outputs are encoded in parallel
+    std::vector<std::future<int>> saved;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        saved.push_back(rtengine::ThreadPool::add_task(
+            rtengine::ThreadPool::Priority::NORMAL,
+            [&, i]() -> int {
+                auto &o = outputs[i];
+                if (o.type == "dzi") {
+                    return rtengine::saveDeepZoom(
+                        static_cast<rtengine::Imagefloat *>(resultImages[i]),
+                        o.file, o.tile_size, o.tile_overlap, o.tile_format,
+                        o.compression);
+                }
+                return save_image(resultImages[i], o.type, o.file,
+                                  o.compression, o.subsampling, o.bits,
+                                  o.isFloat);
+            }));
+    }
+    Glib::ustring err;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        rtengine::ThreadPool::wait(saved[i]);
+        if (saved[i].get() != 0) {
+            if (err.empty()) {
+                err = Glib::ustring::compose("failure in saving to: %1",
+                                             outputs[i].file);
+            }
+            continue;
+        }
+        outputFiles.push_back(outputs[i].file);
+        if (get_bool(job, "copy_params")) {
+            if (!options.params_out_embed ||
+                currentParams.saveEmbedded(&pl, outputs[i].file) != 0) {
+                currentParams.save(&pl, outputs[i].file + paramFileExtension);
+            }
+        }
+    }
+
+    ii->decreaseRef();
+    for (auto img : resultImages) {
+        img->free();
+    }
+
+    return err;
+}
+
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double>>(
+               Clock::now() - start)
+        .count();
+}
+
+std::unordered_map<std::string, Glib::ustring> get_output_extensions()
+{
+    std::unordered_map<std::string, Glib::ustring> output_ext;
+    for (auto &p : rtengine::ImageIOManager::getInstance()->getSaveFormats()) {
+        output_ext[p.first] = p.second.extension;
+    }
+    output_ext["jpg"] = "jpg";
+    output_ext["tif"] = "tif";
+    output_ext["png"] = "png";
+    output_ext["dzi"] = "dzi";
+    return output_ext;
+}
+
+// runs the job and emits the started, done or error events. If detected is
+// given, the done event also reports the time elapsed since then
+void run_server_job(const cJSON *job, ServerOutput &out,
+                    const std::unordered_map<std::string, Glib::ustring>
+                        &output_ext,
+                    const Clock::time_point *detected = nullptr)
+{
+    const cJSON *id = cJSON_GetObjectItem(job, "id");
+    out.emit(id, "started");
+    const auto start = Clock::now();
+    std::vector<Glib::ustring> outputFiles;
+    Glib::ustring err;
+    try {
+        err = process_server_job(job, out, output_ext, outputFiles);
+    } catch (std::exception &e) {
+        err = e.what();
+    }
+
+    if (!err.empty()) {
+        out.emit_message(id, "error", err);
+    } else {
+        cJSON *fields = cJSON_CreateObject();
+        cJSON_AddStringToObject(fields, "output", outputFiles[0].c_str());
+        if (outputFiles.size() > 1) {
+            cJSON *files = cJSON_CreateArray();
+            for (auto &f : outputFiles) {
+                cJSON_AddItemToArray(files, cJSON_CreateString(f.c_str()));
+            }
+            cJSON_AddItemToObject(fields, "outputs", files);
+        }
+        cJSON_AddNumberToObject(fields, "seconds", seconds_since(start));
+        if (detected) {
+            cJSON_AddNumberToObject(fields, "latency",
+                                    seconds_since(*detected));
+        }
+        out.emit(id, "done", fields);
+    }
+}
+
+} // namespace
+
+int processServerJobs()
+{
+    ServerOutput out;
+    const auto output_ext = get_output_extensions();
+
+    {
+        cJSON *fields = cJSON_CreateObject();
+        cJSON_AddStringToObject(fields, "version", RTVERSION);
+        out.emit(nullptr, "ready", fields);
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        JSONPtr job(cJSON_Parse(line.c_str()), &cJSON_Delete);
+        if (!job || !cJSON_IsObject(job.get())) {
+            out.emit_message(nullptr, "error", "invalid request");
+            continue;
+        }
+
+        if (get_string(job.get(), "command") == "quit") {
+            break;
+        }
+        run_server_job(job.get(), out, output_ext);
+    }
+
+    return 0;
+}
+
+int processWatchFolder()
+{
+    ServerOutput out;
+    const auto output_ext = get_output_extensions();
+
+    std::shared_ptr<cJSON> tmpl(
+        cJSON_Parse(watch_job.empty() ? "{}" : watch_job.c_str()),
+        &cJSON_Delete);
+    if (!tmpl || !cJSON_IsObject(tmpl.get())) {
+        out.emit_message(nullptr, "error", "invalid job template");
+        return 1;
+    }
+    if (!cJSON_GetObjectItem(tmpl.get(), "default_profile") &&
+        !cJSON_GetObjectItem(tmpl.get(), "dynamic_profile")) {
+        cJSON_AddTrueToObject(tmpl.get(), "dynamic_profile");
+    }
+    const size_t max_workers = std::max(get_int(tmpl.get(), "workers", 1), 1);
+    const std::chrono::milliseconds settle(
+        std::max(get_int(tmpl.get(), "settle", 1000), 0));
+
+    Glib::RefPtr<Gio::FileMonitor> monitor;
+    try {
+        monitor = Gio::File::create_for_path(watch_dir)->monitor_directory();
+    } catch (Glib::Exception &e) {
+        out.emit_message(nullptr, "error", e.what());
+        return 1;
+    }
+
+    struct Pending {
+        Clock::time_point detected;
+        Clock::time_point last_event;
+        goffset size;
+    };
+    std::map<Glib::ustring, Pending> pending;
+    std::set<Glib::ustring> seen;
+    std::deque<std::pair<Glib::ustring, Clock::time_point>> ready;
+    std::vector<std::future<void>> running;
+
+    const auto on_changed = [&](const Glib::RefPtr<Gio::File> &file,
+                                const Glib::RefPtr<Gio::File> &,
+                                Gio::FileMonitorEvent event) -> void {
+        if (event != Gio::FILE_MONITOR_EVENT_CREATED &&
+            event != Gio::FILE_MONITOR_EVENT_CHANGED &&
+            event != Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+            return;
+        }
+        // only the raw files, so that the outputs (and the sidecars)
+        // written in the same folder are not picked up
+        const Glib::ustring fname = file->get_parse_name();
+        if (!options.is_parse_extention(fname) || !is_raw_file(fname)) {
+            return;
+        }
+        const auto now = Clock::now();
+        auto it = pending.find(fname);
+        if (it != pending.end()) {
+            it->second.last_event = now;
+        } else if (seen.insert(fname).second) {
+            pending[fname] = Pending{now, now, -1};
+            cJSON *fields = cJSON_CreateObject();
+            cJSON_AddStringToObject(fields, "input", fname.c_str());
+            out.emit(nullptr, "detected", fields);
+        }
+    };
+    monitor->signal_changed().connect(
+        sigc::slot<void, const Glib::RefPtr<Gio::File> &,
+                   const Glib::RefPtr<Gio::File> &, Gio::FileMonitorEvent>(
+            on_changed));
+
+    // a file is considered fully written when there were no events for it
+    // during the settle time, and its size didn't change between two checks
+    const auto poll = [&]() -> bool {
+        const auto now = Clock::now();
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (now - it->second.last_event >= settle) {
+                goffset size = -1;
+                try {
+                    size = Gio::File::create_for_path(it->first)
+                               ->query_info("standard::size")
+                               ->get_size();
+                } catch (Glib::Exception &) {
+                }
+                if (size > 0 && size == it->second.size) {
+                    ready.emplace_back(it->first, it->second.detected);
+                    it = pending.erase(it);
+                    continue;
+                }
+                it->second.size = size;
+            }
+            ++it;
+        }
+
+        running.erase(
+            std::remove_if(running.begin(), running.end(),
+                           [](std::future<void> &f) -> bool {
+                               return f.wait_for(std::chrono::seconds(0)) ==
+                                      std::future_status::ready;
+                           }),
+            running.end());
+
+        while (!ready.empty() && running.size() < max_workers) {
+            const Glib::ustring fname = ready.front().first;
+            const Clock::time_point detected = ready.front().second;
+            ready.pop_front();
+
+            std::shared_ptr<cJSON> job(cJSON_Duplicate(tmpl.get(), true),
+                                       &cJSON_Delete);
+            cJSON_DeleteItemFromObject(job.get(), "input");
+            cJSON_AddStringToObject(job.get(), "input", fname.c_str());
+            if (!cJSON_GetObjectItem(job.get(), "id")) {
+                cJSON_AddStringToObject(job.get(), "id", fname.c_str());
+            }
+            running.push_back(rtengine::ThreadPool::add_task(
+                rtengine::ThreadPool::Priority::NORMAL,
+                [&out, &output_ext, job, detected]() -> void {
+                    run_server_job(job.get(), out, output_ext, &detected);
+                }));
+        }
+        return true;
+    };
+    Glib::signal_timeout().connect(sigc::slot<bool>(poll), 100);
+
+    {
+        cJSON *fields = cJSON_CreateObject();
+        cJSON_AddStringToObject(fields, "version", RTVERSION);
+        cJSON_AddStringToObject(fields, "watch", watch_dir.c_str());
+        out.emit(nullptr, "ready", fields);
+    }
+
+    Glib::MainLoop::create()->run();
+    return 0;
+}
+
+namespace {
+
+// a job of the coordinator, with the workers on which it failed
+struct CoordinatorJob {
+    std::shared_ptr<cJSON> job;
+    double cost;
+    int retries;
+    std::set<int> failed_on;
+};
+
+// estimated cost of a job, used to start the most expensive ones first so
+// that the workers don't end up waiting for a big file started last. Without
+// decoding the raw file there are no dimensions to feed to
+// estimate_peak_memory(), so the file size is the proxy of the pixel count
+double estimate_job_cost(const cJSON *job)
+{
+    const Glib::ustring input = get_string(job, "input");
+    double cost = 1;
+    try {
+        cost = std::max(double(Gio::File::create_for_path(input)
+                                   ->query_info("standard::size")
+                                   ->get_size()),
+                        1.0);
+    } catch (Glib::Exception &) {
+    }
+    const cJSON *outputs = cJSON_GetObjectItem(job, "outputs");
+    if (cJSON_IsArray(outputs)) {
+        // one processing, and (cheaper) one saving per output
+        cost *= 1 + 0.25 * cJSON_GetArraySize(outputs);
+    }
+    return cost;
+}
+
+// the jobs still to run, shared by the threads driving the workers
+class CoordinatorQueue {
+public:
+    explicit CoordinatorQueue(int num_workers): live_(num_workers), running_(0)
+    {
+    }
+
+    void add(CoordinatorJob &&job)
+    {
+        pending_.push_back(std::move(job));
+    }
+
+    void sort()
+    {
+        std::stable_sort(pending_.begin(), pending_.end(),
+                         [](const CoordinatorJob &a, const CoordinatorJob &b)
+                             -> bool { return a.cost > b.cost; });
+    }
+
+    // returns false when there is nothing left for the given worker. Jobs
+    // which failed on a worker are given to the others first
+    bool next(int worker, CoordinatorJob &out)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+                if (!it->failed_on.count(worker) ||
+                    int(it->failed_on.size()) >= live_) {
+                    out = std::move(*it);
+                    pending_.erase(it);
+                    ++running_;
+                    return true;
+                }
+            }
+            if (!running_) {
+                return false;
+            }
+            // a running job might fail and come back
+            cond_.wait(lock);
+        }
+    }
+
+    void done()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --running_;
+        cond_.notify_all();
+    }
+
+    // returns true if the job was put back in the queue for another attempt
+    bool failed(int worker, CoordinatorJob &&job)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --running_;
+        bool ret = false;
+        if (job.retries > 0) {
+            --job.retries;
+            job.failed_on.insert(worker);
+            pending_.push_front(std::move(job));
+            ret = true;
+        }
+        cond_.notify_all();
+        return ret;
+    }
+
+    void worker_exited()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --live_;
+        cond_.notify_all();
+    }
+
+    // the jobs left after all the workers exited
+    std::deque<CoordinatorJob> &leftovers() { return pending_; }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<CoordinatorJob> pending_;
+    int live_;
+    int running_;
+};
+
+bool read_line(rtengine::subprocess::SubprocessInfo *p, std::string &line)
+{
+    line.clear();
+    while (true) {
+        int c = p->read();
+        if (c == EOF) {
+            return false;
+        } else if (c == '\n') {
+            return true;
+        }
+        line.push_back(c);
+    }
+}
+
+// starts the worker and runs the jobs of the queue on it, forwarding its
+// events with the worker number added
+void run_coordinator_worker(int worker, const Glib::ustring &cmdline,
+                            CoordinatorQueue &queue, ServerOutput &out)
+{
+    namespace sp = rtengine::subprocess;
+
+    const auto report = [&](const cJSON *id, const char *event,
+                            const Glib::ustring &msg) -> void {
+        cJSON *fields = cJSON_CreateObject();
+        cJSON_AddNumberToObject(fields, "worker", worker);
+        cJSON_AddStringToObject(fields, "message", msg.c_str());
+        out.emit(id, event, fields);
+    };
+
+    std::unique_ptr<sp::SubprocessInfo> proc;
+    try {
+        proc = sp::popen("", sp::split_command_line(cmdline), true, true,
+                         true);
+    } catch (sp::error &e) {
+        report(nullptr, "warning", e.what());
+    }
+
+    std::string line;
+    bool ok = false;
+    while (proc && read_line(proc.get(), line)) {
+        JSONPtr msg(cJSON_Parse(line.c_str()), &cJSON_Delete);
+        if (get_string(msg.get(), "event") == "ready") {
+            ok = true;
+            break;
+        }
+    }
+    if (!ok) {
+        report(nullptr, "warning", "could not start worker: " + cmdline);
+        queue.worker_exited();
+        return;
+    }
+
+    CoordinatorJob job;
+    while (ok && queue.next(worker, job)) {
+        const cJSON *id = cJSON_GetObjectItem(job.job.get(), "id");
+        char *s = cJSON_PrintUnformatted(job.job.get());
+        ok = proc->write(s, strlen(s)) && proc->write("\n", 1) &&
+             proc->flush();
+        free(s);
+
+        Glib::ustring err = "worker terminated";
+        bool done = false;
+        while (ok) {
+            if (!read_line(proc.get(), line)) {
+                ok = false;
+                break;
+            }
+            JSONPtr msg(cJSON_Parse(line.c_str()), &cJSON_Delete);
+            if (!msg || !cJSON_IsObject(msg.get())) {
+                continue;
+            }
+            const std::string event = get_string(msg.get(), "event");
+            if (event == "error") {
+                err = get_string(msg.get(), "message");
+                break;
+            }
+            cJSON_AddNumberToObject(msg.get(), "worker", worker);
+            out.emit(msg.get());
+            if (event == "done") {
+                done = true;
+                break;
+            }
+        }
+
+        if (done) {
+            queue.done();
+        } else {
+            // the queue owns the job from now on, keep the id alive
+            JSONPtr jid(id ? cJSON_Duplicate(id, true) : nullptr,
+                        &cJSON_Delete);
+            if (queue.failed(worker, std::move(job))) {
+                report(jid.get(), "retry", err);
+            } else {
+                report(jid.get(), "error", err);
+            }
+        }
+    }
+
+    if (ok) {
+        const char quit[] = "{\"command\": \"quit\"}\n";
+        proc->write(quit, sizeof(quit) - 1);
+        proc->flush();
+        proc->close_in();
+    } else {
+        report(nullptr, "warning", "lost worker: " + cmdline);
+        proc->kill();
+    }
+    proc->wait();
+    queue.worker_exited();
+}
+
+} // namespace
+
+int processCoordinatedJobs()
+{
+    ServerOutput out;
+
+    std::vector<Glib::ustring> workers;
+    try {
+        std::istringstream src(Glib::file_get_contents(coordinator_file));
+        std::string line;
+        while (std::getline(src, line)) {
+            const auto start = line.find_first_not_of(" \t\r");
+            if (start != std::string::npos && line[start] != '#') {
+                workers.push_back(line.substr(start));
+            }
+        }
+    } catch (Glib::Exception &e) {
+        out.emit_message(nullptr, "error", e.what());
+        return 1;
+    }
+    if (workers.empty()) {
+        out.emit_message(nullptr, "error",
+                         "no workers in " + coordinator_file);
+        return 1;
+    }
+
+    CoordinatorQueue queue(workers.size());
+    {
+        cJSON *fields = cJSON_CreateObject();
+        cJSON_AddStringToObject(fields, "version", RTVERSION);
+        cJSON_AddNumberToObject(fields, "workers", workers.size());
+        out.emit(nullptr, "ready", fields);
+    }
+
+    // the whole queue is read first, so that it can be ordered by cost
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::shared_ptr<cJSON> job(cJSON_Parse(line.c_str()), &cJSON_Delete);
+        if (!job || !cJSON_IsObject(job.get())) {
+            out.emit_message(nullptr, "error", "invalid request");
+            continue;
+        }
+        if (get_string(job.get(), "command") == "quit") {
+            break;
+        }
+        CoordinatorJob j;
+        j.retries = std::max(get_int(job.get(), "retries", 2), 0);
+        j.cost = estimate_job_cost(job.get());
+        j.job = job;
+        queue.add(std::move(j));
+    }
+    queue.sort();
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers.size(); ++i) {
+        threads.emplace_back(run_coordinator_worker, int(i),
+                             std::cref(workers[i]), std::ref(queue),
+                             std::ref(out));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    int ret = 0;
+    for (auto &j : queue.leftovers()) {
+        out.emit_message(cJSON_GetObjectItem(j.job.get(), "id"), "error",
+                         "no worker available");
+        ret = 1;
+    }
+    return ret;
+}
+
+
+#ifdef WIN32
+
+int processZygote()
+{
+    std::cerr << "Error: --zygote is not supported on Windows" << std::endl;
+    return 1;
+}
+
+#else // WIN32
+
+int processZygote()
+{
+    // load now what would otherwise be loaded on first use, so that the
+    // children find it ready (and share it with the parent, copy-on-write)
+    rtengine::LFDatabase::lazyInit().wait();
+    rtengine::DCPStore::lazyInit().wait();
+
+    const std::string path = Glib::filename_from_utf8(zygote_socket);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: socket path too long: " << zygote_socket
+                  << std::endl;
+        return 1;
+    }
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        std::cerr << "Error: cannot create the socket" << std::endl;
+        return 1;
+    }
+    unlink(path.c_str());
+    if (bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        listen(sock, 16) < 0) {
+        std::cerr << "Error: cannot listen on " << zygote_socket << std::endl;
+        close(sock);
+        return 1;
+    }
+
+    // the children are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+    std::cerr << "ART-cli: waiting for connections on " << zygote_socket
+              << std::endl;
+
+    while (true) {
+        int conn = accept(sock, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error: accept failed on " << zygote_socket
+                      << std::endl;
+            break;
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        const pid_t pid = fork();
+        if (pid == 0) {
+            // the child serves the connection as a --server process
+            close(sock);
+            signal(SIGCHLD, SIG_DFL);
+            dup2(conn, 0);
+            dup2(conn, 1);
+            close(conn);
+#ifdef _OPENMP
+            omp_set_num_threads(zygote_omp_threads);
+#endif
+            rtengine::ThreadPool::reinit_after_fork();
+
+            const int ret = processServerJobs();
+
+            rtengine::PipelineProfiler::getInstance()->flush();
+            std::cout.flush();
+            // skip the exit handlers inherited from the parent
+            _exit(ret);
+        } else if (pid < 0) {
+            std::cerr << "Error: fork failed" << std::endl;
+        }
+        close(conn);
+    }
+
+    close(sock);
+    unlink(path.c_str());
+    return 1;
+}
+
+#endif // WIN32
@@ -981,11 +981,31 @@ private:
 
 bool on_release_event_ignore(GdkEventButton *event) { return true; }
 
+void add_button(Gtk::Button *btn, Gtk::Box *box, int h = 20,
+                Gtk::PackType type = Gtk::PackType::PACK_START, int border = 0)
+{
+    setExpandAlignProperties(btn, false, false, Gtk::ALIGN_CENTER,
+                             Gtk::ALIGN_START);
+    btn->set_relief(Gtk::RELIEF_NONE);
+    btn->get_style_context()->add_class(GTK_STYLE_CLASS_FLAT);
+    btn->set_can_focus(false);
+    if (h > 0) {
+        btn->set_size_request(-1, h);
+    }
+    if (type == Gtk::PackType::PACK_START) {
+        box->pack_start(*btn, false, false, border);
+    } else {
+        box->pack_end(*btn, false, false, border);
+    }
+}
+
 } // namespace
 
 MasksPanel::MasksPanel(MasksContentProvider *cp)
-    : Gtk::VBox(), cp_(cp), masks_(), selected_(0), area_shape_index_(0),
-      listEdited(false), adl_(nullptr), deltaE_provider_(nullptr)
+    : Gtk::VBox(), cp_(cp), masks_(), selected_(0), mask_box_(nullptr),
+      mask_box_built_(false), show_mask_(false), edit_provider_(nullptr),
+      area_shape_index_(0), areaMaskToggle(nullptr), listEdited(false),
+      adl_(nullptr), deltaE_provider_(nullptr)
 {
     Gtk::Container *child = cp_->getContainer();
     MasksContentProvider::Events events;
@@ -1013,24 +1033,6 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
 
     CurveListener::setMulti(true);
 
-    const auto add_button = [](Gtk::Button *btn, Gtk::Box *box, int h = 20,
-                               Gtk::PackType type = Gtk::PackType::PACK_START,
-                               int border = 0) -> void {
-        setExpandAlignProperties(btn, false, false, Gtk::ALIGN_CENTER,
-                                 Gtk::ALIGN_START);
-        btn->set_relief(Gtk::RELIEF_NONE);
-        btn->get_style_context()->add_class(GTK_STYLE_CLASS_FLAT);
-        btn->set_can_focus(false);
-        if (h > 0) {
-            btn->set_size_request(-1, h);
-        }
-        if (type == Gtk::PackType::PACK_START) {
-            box->pack_start(*btn, false, false, border);
-        } else {
-            box->pack_end(*btn, false, false, border);
-        }
-    };
-
     int n = cp_->getColumnCount();
 
     list_model_columns_.reset(new ListColumns(n));
@@ -1116,9 +1118,85 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     }
     // pack_start(*Gtk::manage(new Gtk::HSeparator()));
 
-    Gtk::VBox *mask_box = Gtk::manage(new Gtk::VBox());
+    mask_box_ = Gtk::manage(new Gtk::VBox());
+    mask_box_->set_border_width(4);
 
-    hb = Gtk::manage(new Gtk::HBox());
+    MyExpander *mask_exp = nullptr;
+    {
+        Gtk::HBox *hb = Gtk::manage(new Gtk::HBox());
+        Gtk::Label *l = Gtk::manage(new Gtk::Label());
+        l->set_markup("<b>" + M("TP_LABMASKS_MASK") + "</b>");
+        l->set_alignment(Gtk::ALIGN_START, Gtk::ALIGN_CENTER);
+        hb->pack_start(*l);
+        Gtk::Entry *e = Gtk::manage(new Gtk::Entry());
+        hb->pack_start(*e, Gtk::PACK_EXPAND_WIDGET, 2);
+        e->get_style_context()->add_class(GTK_STYLE_CLASS_FLAT);
+        e->set_alignment(Gtk::ALIGN_END);
+        e->set_placeholder_text("(" + M("TP_LABMASKS_MASK_UNNAMED") + ")");
+        mask_exp = Gtk::manage(new MyExpander(false, hb));
+        const auto on_activate = [this]() -> void {
+            onMaskNameFocusOut(nullptr);
+        };
+        e->signal_activate().connect(sigc::slot<void>(on_activate));
+        e->signal_button_release_event().connect(&on_release_event_ignore);
+        e->add_events(Gdk::FOCUS_CHANGE_MASK);
+        e->signal_focus_out_event().connect(
+            sigc::mem_fun(*this, &MasksPanel::onMaskNameFocusOut));
+        maskName = e;
+    }
+    mask_exp->add(*mask_box_, false);
+    mask_exp->setLevel(1);
+    pack_start(*mask_exp);
+
+    mask_exp_ = mask_exp;
+    first_mask_exp_ = true;
+    mask_exp_->signal_button_release_event().connect_notify(
+        sigc::mem_fun(this, &MasksPanel::onMaskFold));
+
+    add_events(Gdk::KEY_PRESS_MASK);
+    const auto keypress = [this](GdkEventKey *evt) -> bool {
+        bool ctrl = evt->state & GDK_CONTROL_MASK;
+        bool shift = evt->state & GDK_SHIFT_MASK;
+        bool alt = evt->state & GDK_MOD1_MASK;
+
+        if (ctrl && !shift && !alt) {
+            switch (getKeyval(evt)) {
+            case GDK_KEY_m:
+            case GDK_KEY_M:
+                buildMaskBox();
+                showMask->set_active(!showMask->get_active());
+                return true;
+            case GDK_KEY_x:
+            case GDK_KEY_X:
+                if (selected_ < masks_.size()) {
+                    listEdited = true;
+                    auto it = list_model_->children().begin();
+                    for (size_t i = 0; i < selected_; ++i) {
+                        ++it;
+                    }
+                    onListEnabledToggled(Gtk::TreePath(it).to_string());
+                    maskShow(selected_, true);
+                }
+                return true;
+            }
+        }
+        return false;
+    };
+    signal_key_press_event().connect(sigc::slot<bool, GdkEventKey *>(keypress),
+                                     false);
+}
+
+// The widgets of the mask section are by far the most expensive part of the
+// panel, and they are built only when the section is shown for the first
+// time. Until then, masks_ is the only state of the panel.
+void MasksPanel::buildMaskBox()
+{
+    if (mask_box_built_) {
+        return;
+    }
+    mask_box_built_ = true;
+
+    Gtk::HBox *hb = Gtk::manage(new Gtk::HBox());
 
     maskCopy = Gtk::manage(new Gtk::Button());
     maskCopy->add(*Gtk::manage(new RTImage("copy.svg")));
@@ -1143,12 +1221,12 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     maskInverted->signal_toggled().connect(
         sigc::mem_fun(*this, &MasksPanel::onMaskInvertedChanged));
     hb->pack_start(*maskInverted);
-    mask_box->pack_start(*hb);
+    mask_box_->pack_start(*hb);
 
     maskOpacity = Gtk::manage(new Adjuster(M("TP_LABMASKS_DRAWNMASK_OPACITY"),
                                            0, 100, 1, 0, nullptr, nullptr,
                                            nullptr, nullptr, false, true));
-    mask_box->pack_start(*maskOpacity);
+    mask_box_->pack_start(*maskOpacity);
     maskOpacity->setAdjusterListener(this);
 
     parametricMask =
@@ -1210,17 +1288,17 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     contrastThreshold = Gtk::manage(new Adjuster(
         M("TP_LABMASKS_CONTRASTTHRESHOLDMASK"), -150, 150, 1, 0, cicon));
     contrastThreshold->setAdjusterListener(this);
-    // mask_box->pack_start(*contrastThreshold);
+    // mask_box_->pack_start(*contrastThreshold);
     tb->pack_start(*contrastThreshold);
 
     maskBlur =
         Gtk::manage(new Adjuster(M("TP_LABMASKS_BLUR"), -10, 500, 0.1, 0));
     maskBlur->setLogScale(10, -10);
     maskBlur->setAdjusterListener(this);
-    // mask_box->pack_start(*maskBlur);
+    // mask_box_->pack_start(*maskBlur);
     tb->pack_start(*maskBlur);
 
-    mask_box->pack_start(*parametricMask);
+    mask_box_->pack_start(*parametricMask);
 
     //-------------------------------------------------------------------------
     deltaEMask = Gtk::manage(new MyExpander(true, M("TP_LABMASKS_DELTAE")));
@@ -1257,7 +1335,7 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     deltaEStrength->setAdjusterListener(this);
     deltaEInverted =
         Gtk::manage(new Gtk::CheckButton(M("TP_LABMASKS_INVERTED")));
-    vb = Gtk::manage(new Gtk::VBox());
+    Gtk::VBox *vb = Gtk::manage(new Gtk::VBox());
     vb->pack_start(*deltaERange);
     vb->pack_start(*deltaEDecay);
     hb = Gtk::manage(new Gtk::HBox());
@@ -1278,7 +1356,7 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     tb->pack_start(*hb);
     deltaEMask->add(*tb, false);
     deltaEMask->setLevel(1);
-    mask_box->pack_start(*deltaEMask);
+    mask_box_->pack_start(*deltaEMask);
     deltaEMask->signal_enabled_toggled().connect(
         sigc::mem_fun(*this, &MasksPanel::onDeltaEMaskEnableToggled));
     dE_area->setEditID(ede, BT_SINGLEPLANE_FLOAT);
@@ -1405,7 +1483,7 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
         areaMaskShapes->get_selection()->signal_changed().connect(
             sigc::mem_fun(this, &MasksPanel::onAreaShapeSelectionChanged));
     hb = Gtk::manage(new Gtk::HBox());
-    scroll = Gtk::manage(new Gtk::ScrolledWindow());
+    Gtk::ScrolledWindow *scroll = Gtk::manage(new Gtk::ScrolledWindow());
     scroll->set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_NEVER);
     scroll->add(*areaMaskShapes);
     hb->pack_start(*scroll, Gtk::PACK_EXPAND_WIDGET);
@@ -1512,10 +1590,10 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     areaMask->add(*vb, false);
     areaMask->setLevel(1);
     vb->signal_unmap().connect(sigc::mem_fun(*this, &MasksPanel::on_hide));
-    mask_box->pack_start(*areaMask);
+    mask_box_->pack_start(*areaMask);
 
     drawnMask = Gtk::manage(new DrawnMaskPanel());
-    mask_box->pack_start(*drawnMask);
+    mask_box_->pack_start(*drawnMask);
     static_cast<DrawnMaskPanel *>(drawnMask)->signal_draw_updated().connect(
         sigc::mem_fun(this, &MasksPanel::onDrawnMaskUpdated));
 
@@ -1550,7 +1628,7 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     hb->pack_start(*external_mask_inverted_, Gtk::PACK_SHRINK, 4);
     external_mask_inverted_->signal_clicked().connect(
         sigc::mem_fun(*this, &MasksPanel::onExternalMaskChanged));
-    mask_box->pack_start(*external_mask_);
+    mask_box_->pack_start(*external_mask_);
 
     tb = Gtk::manage(new ToolParamBlock());
     linked_mask_ =
@@ -1572,7 +1650,7 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
     linked_mask_inverted_->signal_clicked().connect(
         sigc::mem_fun(*this, &MasksPanel::onLinkedMaskChanged));
 
-    mask_box->pack_start(*linked_mask_);
+    mask_box_->pack_start(*linked_mask_);
 
     // -----------------------------------------------------------------------
     MyExpander *ppMask =
@@ -1601,43 +1679,9 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
         cg->curveListComplete();
         tb->pack_start(*cg, Gtk::PACK_SHRINK, 2);
     }
-    mask_box->pack_start(*ppMask);
+    mask_box_->pack_start(*ppMask);
     // -----------------------------------------------------------------------
 
-    mask_box->set_border_width(4);
-
-    MyExpander *mask_exp = nullptr;
-    {
-        Gtk::HBox *hb = Gtk::manage(new Gtk::HBox());
-        Gtk::Label *l = Gtk::manage(new Gtk::Label());
-        l->set_markup("<b>" + M("TP_LABMASKS_MASK") + "</b>");
-        l->set_alignment(Gtk::ALIGN_START, Gtk::ALIGN_CENTER);
-        hb->pack_start(*l);
-        Gtk::Entry *e = Gtk::manage(new Gtk::Entry());
-        hb->pack_start(*e, Gtk::PACK_EXPAND_WIDGET, 2);
-        e->get_style_context()->add_class(GTK_STYLE_CLASS_FLAT);
-        e->set_alignment(Gtk::ALIGN_END);
-        e->set_placeholder_text("(" + M("TP_LABMASKS_MASK_UNNAMED") + ")");
-        mask_exp = Gtk::manage(new MyExpander(false, hb));
-        const auto on_activate = [this]() -> void {
-            onMaskNameFocusOut(nullptr);
-        };
-        e->signal_activate().connect(sigc::slot<void>(on_activate));
-        e->signal_button_release_event().connect(&on_release_event_ignore);
-        e->add_events(Gdk::FOCUS_CHANGE_MASK);
-        e->signal_focus_out_event().connect(
-            sigc::mem_fun(*this, &MasksPanel::onMaskNameFocusOut));
-        maskName = e;
-    }
-    mask_exp->add(*mask_box, false);
-    mask_exp->setLevel(1);
-    pack_start(*mask_exp);
-
-    mask_exp_ = mask_exp;
-    first_mask_exp_ = true;
-    mask_exp_->signal_button_release_event().connect_notify(
-        sigc::mem_fun(this, &MasksPanel::onMaskFold));
-
     maskBlur->delay = options.adjusterMaxDelay;
 
     mask_expanders_ = {parametricMask, areaMask,     deltaEMask, drawnMask,
@@ -1647,36 +1691,26 @@ MasksPanel::MasksPanel(MasksContentProvider *cp)
             sigc::bind(sigc::mem_fun(this, &MasksPanel::onMaskExpanded), e));
     }
 
-    add_events(Gdk::KEY_PRESS_MASK);
-    const auto keypress = [this](GdkEventKey *evt) -> bool {
-        bool ctrl = evt->state & GDK_CONTROL_MASK;
-        bool shift = evt->state & GDK_SHIFT_MASK;
-        bool alt = evt->state & GDK_MOD1_MASK;
+    mask_box_->show_all();
+    for (auto e : mask_expanders_) {
+        e->set_expanded(false);
+    }
 
-        if (ctrl && !shift && !alt) {
-            switch (getKeyval(evt)) {
-            case GDK_KEY_m:
-            case GDK_KEY_M:
-                showMask->set_active(!showMask->get_active());
-                return true;
-            case GDK_KEY_x:
-            case GDK_KEY_X:
-                if (selected_ < masks_.size()) {
-                    listEdited = true;
-                    auto it = list_model_->children().begin();
-                    for (size_t i = 0; i < selected_; ++i) {
-                        ++it;
-                    }
-                    onListEnabledToggled(Gtk::TreePath(it).to_string());
-                    maskShow(selected_, true);
-                }
-                return true;
-            }
-        }
-        return false;
-    };
-    signal_key_press_event().connect(sigc::slot<bool, GdkEventKey *>(keypress),
-                                     false);
+    if (edit_provider_) {
+        setEditProvider(edit_provider_);
+    }
+    if (!external_mask_dir_.empty()) {
+        setExternalMaskPath(external_mask_dir_);
+    }
+
+    disableListener();
+    showMask->set_active(show_mask_);
+    if (selected_ < masks_.size()) {
+        maskWidgetsShow(selected_, false);
+        static_cast<DrawnMaskPanel *>(drawnMask)->setTargetMask(
+            &masks_[selected_].drawnMask, true);
+    }
+    enableListener();
 }
 
 MasksPanel::~MasksPanel() { delete areaMaskToggle; }
@@ -1715,7 +1749,7 @@ void MasksPanel::onSelectionChanged()
         selected_ = idx;
         area_shape_index_ = 0;
         maskShow(selected_);
-        if (showMask->get_active()) {
+        if (mask_box_built_ ? showMask->get_active() : show_mask_) {
             onShowMaskChanged();
         }
     }
@@ -1728,6 +1762,11 @@ void MasksPanel::maskGet(int idx)
     }
 
     auto &r = masks_[idx];
+    r.name = maskName->get_text();
+    if (!mask_box_built_) {
+        return;
+    }
+
     r.parametricMask.enabled = parametricMask->getEnabled();
     r.parametricMask.hue = hueMask->getCurve();
     r.parametricMask.chromaticity = chromaticityMask->getCurve();
@@ -1795,7 +1834,6 @@ void MasksPanel::maskGet(int idx)
     int sgn = deltaEInverted->get_active() ? -1 : 1;
     r.deltaEMask.decay = sgn * deltaEDecay->getValue();
     r.deltaEMask.strength = deltaEStrength->getValue();
-    r.name = maskName->get_text();
     r.curve = maskCurve->getCurve();
     r.posterization = maskPosterization->getValue();
     r.smoothing = maskSmoothing->getValue();
@@ -2024,122 +2062,15 @@ void MasksPanel::maskShow(int idx, bool list_only, bool unsub)
     auto &r = masks_[idx];
     if (!list_only) {
         cp_->selectionChanged(idx);
-        parametricMask->setEnabled(r.parametricMask.enabled);
-        hueMask->setCurve(r.parametricMask.hue);
-        chromaticityMask->setCurve(r.parametricMask.chromaticity);
-        lightnessMask->setCurve(r.parametricMask.lightness);
-        lightnessMaskDetail->setValue(r.parametricMask.lightnessDetail);
-        contrastThreshold->setValue(r.parametricMask.contrastThreshold);
-        maskBlur->setValue(r.parametricMask.blur);
-        maskInverted->set_active(r.inverted);
         maskName->set_text(r.name);
-        maskCurve->setCurve(r.curve);
-        maskPosterization->setValue(r.posterization);
-        maskSmoothing->setValue(r.smoothing);
-        maskOpacity->setValue(r.opacity);
-
-        if (unsub && isCurrentSubscriber()) {
-            if (areaMaskToggle->get_active()) {
-                switchOffEditMode();
-            } else {
-                unsubscribe();
-            }
-        }
-
-        // this will also switch to the correct geometry
-        populateShapeList(idx, area_shape_index_);
-
-        areaMaskToggle->set_active(false);
-        areaMask->setEnabled(r.areaMask.enabled);
-        areaMaskFeather->setValue(r.areaMask.feather);
-        areaMaskBlur->setValue(r.areaMask.blur);
-        areaMaskContrast->setCurve(r.areaMask.contrast);
-        if (area_shape_index_ < r.areaMask.shapes.size()) {
-            auto &a = r.areaMask.shapes[area_shape_index_];
-            areaMaskShapeFeather->setValue(a->feather);
-            areaMaskShapeBlur->setValue(a->blur);
-            switch (a->getType()) {
-            case Shape::Type::RECTANGLE: {
-                auto rect =
-                    static_cast<rtengine::procparams::AreaMask::Rectangle *>(
-                        a.get());
-                areaMaskX->setValue(rect->x);
-                areaMaskY->setValue(rect->y);
-                areaMaskWidth->setValue(rect->width);
-                areaMaskHeight->setValue(rect->height);
-                areaMaskAngle180->setValue(rect->angle);
-                areaMaskRoundness->setValue(rect->roundness);
-                setAdjustersVisibility(true, Shape::Type::RECTANGLE);
-                break;
-            }
-            case Shape::Type::GRADIENT: {
-                auto gradient =
-                    static_cast<rtengine::procparams::AreaMask::Gradient *>(
-                        a.get());
-                areaMaskX->setValue(gradient->x);
-                areaMaskY->setValue(gradient->y);
-                areaMaskStrengthStart->setValue(gradient->strengthStart);
-                areaMaskStrengthEnd->setValue(gradient->strengthEnd);
-                areaMaskAngle360->setValue(gradient->angle);
-                areaMaskGradFeather->setValue(gradient->feather);
-                setAdjustersVisibility(true, Shape::Type::GRADIENT);
-                break;
-            }
-            case Shape::Type::POLYGON: {
-                auto poly =
-                    static_cast<rtengine::procparams::AreaMask::Polygon *>(
-                        a.get());
-                setPolygon(poly->knots);
-                setAdjustersVisibility(false, Shape::Type::POLYGON);
-                break;
-            }
-            default:
-                break;
-            }
-            toggleAreaShapeMode(int(a->mode));
-
-            switch (a->getType()) {
-            case Shape::Type::RECTANGLE:
-                updateRectangleAreaMask(false);
-                setAdjustersVisibility(true, Shape::Type::RECTANGLE);
-                break;
-            case Shape::Type::GRADIENT:
-                updateGradientAreaMask(false);
-                setAdjustersVisibility(true, Shape::Type::GRADIENT);
-                break;
-            case Shape::Type::POLYGON:
-                setAdjustersVisibility(false, Shape::Type::POLYGON);
-                break;
-            default:
-                break;
-            }
-        } else {
-            setAdjustersVisibility(false, Shape::Type::RECTANGLE);
+        if (mask_box_built_) {
+            maskWidgetsShow(idx, unsub);
         }
-
-        deltaEMask->setEnabled(r.deltaEMask.enabled);
-        deltaEL->setValue(r.deltaEMask.weight_L, r.deltaEMask.L);
-        deltaEC->setValue(r.deltaEMask.weight_C, r.deltaEMask.C);
-        deltaEH->setValue(r.deltaEMask.weight_H, r.deltaEMask.H);
-        deltaERange->setValue(r.deltaEMask.range);
-        deltaEDecay->setValue(std::abs(r.deltaEMask.decay));
-        deltaEStrength->setValue(std::abs(r.deltaEMask.strength));
-        deltaEInverted->set_active(r.deltaEMask.decay < 0);
-        static_cast<DeltaEArea *>(deltaEColor)
-            ->setColor(r.deltaEMask.L, r.deltaEMask.C, r.deltaEMask.H);
-
-        external_mask_->setEnabled(r.externalMask.enabled);
-        external_mask_inverted_->set_active(r.externalMask.inverted);
-        external_mask_filename_->set_filename(
-            Glib::filename_from_utf8(r.externalMask.filename));
-        external_mask_feather_->setValue(r.externalMask.feather);
-
-        linked_mask_->setEnabled(r.linkedMask.enabled);
-        linked_mask_inverted_->set_active(r.linkedMask.inverted);
-        updateLinkedMaskList(nullptr);
     }
-    static_cast<DrawnMaskPanel *>(drawnMask)->setTargetMask(&r.drawnMask,
-                                                            !list_only);
+    if (mask_box_built_) {
+        static_cast<DrawnMaskPanel *>(drawnMask)->setTargetMask(&r.drawnMask,
+                                                                !list_only);
+    }
 
     int n = cp_->getColumnCount();
     auto row = list_model_->children()[idx];
@@ -2209,13 +2140,134 @@ void MasksPanel::maskShow(int idx, bool list_only, bool unsub)
     enableListener();
 }
 
+void MasksPanel::maskWidgetsShow(int idx, bool unsub)
+{
+    auto &r = masks_[idx];
+    parametricMask->setEnabled(r.parametricMask.enabled);
+    hueMask->setCurve(r.parametricMask.hue);
+    chromaticityMask->setCurve(r.parametricMask.chromaticity);
+    lightnessMask->setCurve(r.parametricMask.lightness);
+    lightnessMaskDetail->setValue(r.parametricMask.lightnessDetail);
+    contrastThreshold->setValue(r.parametricMask.contrastThreshold);
+    maskBlur->setValue(r.parametricMask.blur);
+    maskInverted->set_active(r.inverted);
+    maskCurve->setCurve(r.curve);
+    maskPosterization->setValue(r.posterization);
+    maskSmoothing->setValue(r.smoothing);
+    maskOpacity->setValue(r.opacity);
+
+    if (unsub && isCurrentSubscriber()) {
+        if (areaMaskToggle->get_active()) {
+            switchOffEditMode();
+        } else {
+            unsubscribe();
+        }
+    }
+
+    // this will also switch to the correct geometry
+    populateShapeList(idx, area_shape_index_);
+
+    areaMaskToggle->set_active(false);
+    areaMask->setEnabled(r.areaMask.enabled);
+    areaMaskFeather->setValue(r.areaMask.feather);
+    areaMaskBlur->setValue(r.areaMask.blur);
+    areaMaskContrast->setCurve(r.areaMask.contrast);
+    if (area_shape_index_ < r.areaMask.shapes.size()) {
+        auto &a = r.areaMask.shapes[area_shape_index_];
+        areaMaskShapeFeather->setValue(a->feather);
+        areaMaskShapeBlur->setValue(a->blur);
+        switch (a->getType()) {
+        case Shape::Type::RECTANGLE: {
+            auto rect =
+                static_cast<rtengine::procparams::AreaMask::Rectangle *>(
+                    a.get());
+            areaMaskX->setValue(rect->x);
+            areaMaskY->setValue(rect->y);
+            areaMaskWidth->setValue(rect->width);
+            areaMaskHeight->setValue(rect->height);
+            areaMaskAngle180->setValue(rect->angle);
+            areaMaskRoundness->setValue(rect->roundness);
+            setAdjustersVisibility(true, Shape::Type::RECTANGLE);
+            break;
+        }
+        case Shape::Type::GRADIENT: {
+            auto gradient =
+                static_cast<rtengine::procparams::AreaMask::Gradient *>(
+                    a.get());
+            areaMaskX->setValue(gradient->x);
+            areaMaskY->setValue(gradient->y);
+            areaMaskStrengthStart->setValue(gradient->strengthStart);
+            areaMaskStrengthEnd->setValue(gradient->strengthEnd);
+            areaMaskAngle360->setValue(gradient->angle);
+            areaMaskGradFeather->setValue(gradient->feather);
+            setAdjustersVisibility(true, Shape::Type::GRADIENT);
+            break;
+        }
+        case Shape::Type::POLYGON: {
+            auto poly =
+                static_cast<rtengine::procparams::AreaMask::Polygon *>(
+                    a.get());
+            setPolygon(poly->knots);
+            setAdjustersVisibility(false, Shape::Type::POLYGON);
+            break;
+        }
+        default:
+            break;
+        }
+        toggleAreaShapeMode(int(a->mode));
+
+        switch (a->getType()) {
+        case Shape::Type::RECTANGLE:
+            updateRectangleAreaMask(false);
+            setAdjustersVisibility(true, Shape::Type::RECTANGLE);
+            break;
+        case Shape::Type::GRADIENT:
+            updateGradientAreaMask(false);
+            setAdjustersVisibility(true, Shape::Type::GRADIENT);
+            break;
+        case Shape::Type::POLYGON:
+            setAdjustersVisibility(false, Shape::Type::POLYGON);
+            break;
+        default:
+            break;
+        }
+    } else {
+        setAdjustersVisibility(false, Shape::Type::RECTANGLE);
+    }
+
+    deltaEMask->setEnabled(r.deltaEMask.enabled);
+    deltaEL->setValue(r.deltaEMask.weight_L, r.deltaEMask.L);
+    deltaEC->setValue(r.deltaEMask.weight_C, r.deltaEMask.C);
+    deltaEH->setValue(r.deltaEMask.weight_H, r.deltaEMask.H);
+    deltaERange->setValue(r.deltaEMask.range);
+    deltaEDecay->setValue(std::abs(r.deltaEMask.decay));
+    deltaEStrength->setValue(std::abs(r.deltaEMask.strength));
+    deltaEInverted->set_active(r.deltaEMask.decay < 0);
+    static_cast<DeltaEArea *>(deltaEColor)
+        ->setColor(r.deltaEMask.L, r.deltaEMask.C, r.deltaEMask.H);
+
+    external_mask_->setEnabled(r.externalMask.enabled);
+    external_mask_inverted_->set_active(r.externalMask.inverted);
+    external_mask_filename_->set_filename(
+        Glib::filename_from_utf8(r.externalMask.filename));
+    external_mask_feather_->setValue(r.externalMask.feather);
+
+    linked_mask_->setEnabled(r.linkedMask.enabled);
+    linked_mask_inverted_->set_active(r.linkedMask.inverted);
+    updateLinkedMaskList(nullptr);
+}
+
 void MasksPanel::setEditProvider(EditDataProvider *provider)
 {
+    edit_provider_ = provider;
+    AreaMask::setEditProvider(provider);
+    if (!mask_box_built_) {
+        return;
+    }
     hueMask->setEditProvider(provider);
     chromaticityMask->setEditProvider(provider);
     lightnessMask->setEditProvider(provider);
     static_cast<DeltaEArea *>(deltaEColor)->setEditProvider(provider);
-    AreaMask::setEditProvider(provider);
     static_cast<DrawnMaskPanel *>(drawnMask)->setEditProvider(provider);
 }
 
@@ -2443,10 +2495,12 @@ bool MasksPanel::onKnotRoundnessUpdated()
 
 void MasksPanel::switchOffEditMode()
 {
-    static_cast<DeltaEArea *>(deltaEColor)->switchOffEditMode();
-    static_cast<DrawnMaskPanel *>(drawnMask)->switchOffEditMode();
+    if (mask_box_built_) {
+        static_cast<DeltaEArea *>(deltaEColor)->switchOffEditMode();
+        static_cast<DrawnMaskPanel *>(drawnMask)->switchOffEditMode();
 
-    areaMaskToggle->set_active(false);
+        areaMaskToggle->set_active(false);
+    }
     AreaMask::switchOffEditMode();
     grab_focus();
 }
@@ -2564,14 +2618,15 @@ void MasksPanel::setMasks(const std::vector<rtengine::procparams::Mask> &masks,
 
     masks_ = masks;
     selected_ = 0;
-    showMask->set_active(false);
+    show_mask_ = false;
     if (selected_idx >= 0 && size_t(selected_idx) < masks.size()) {
         selected_ = selected_idx;
-        if (show_mask) {
-            showMask->set_active(true);
-        }
+        show_mask_ = show_mask;
+    }
+    if (mask_box_built_) {
+        showMask->set_active(show_mask_);
+        static_cast<DrawnMaskPanel *>(drawnMask)->setTargetMask(nullptr);
     }
-    static_cast<DrawnMaskPanel *>(drawnMask)->setTargetMask(nullptr);
     populateList();
     area_shape_index_ = 0;
     maskShow(selected_);
@@ -2583,7 +2638,7 @@ void MasksPanel::getMasks(std::vector<rtengine::procparams::Mask> &masks,
 {
     maskGet(selected_);
     masks = masks_;
-    if (showMask->get_active()) {
+    if (mask_box_built_ ? showMask->get_active() : show_mask_) {
         show_mask_idx = selected_;
     } else {
         show_mask_idx = -1;
@@ -2666,6 +2721,9 @@ float MasksPanel::blendPipetteValues(CurveEditor *ce, float chan1, float chan2,
 void MasksPanel::setEdited(bool yes)
 {
     listEdited = yes;
+    if (!mask_box_built_) {
+        return;
+    }
     hueMask->setUnChanged(!yes);
     chromaticityMask->setUnChanged(!yes);
     lightnessMask->setUnChanged(!yes);
@@ -2681,6 +2739,9 @@ void MasksPanel::setEdited(bool yes)
 
 bool MasksPanel::getEdited()
 {
+    if (!mask_box_built_) {
+        return listEdited;
+    }
     for (auto a : areaMaskAdjusters) {
         if (a->getEditedState() == Edited) {
             return true;
@@ -3234,6 +3295,9 @@ void MasksPanel::onAreaMaskDrawGradientAddPressed()
 
 void MasksPanel::on_map()
 {
+    if (!mask_box_built_ && mask_exp_->get_expanded()) {
+        buildMaskBox();
+    }
     Gtk::VBox::on_map();
     if (first_mask_exp_) {
         // parametricMask->set_expanded(false);
@@ -3250,7 +3314,10 @@ void MasksPanel::on_map()
 
 void MasksPanel::onMaskFold(GdkEventButton *evt)
 {
-    if (mask_exp_->get_expanded()) {
+    if (!mask_box_built_) {
+        // called before the expander is toggled
+        buildMaskBox();
+    } else if (mask_exp_->get_expanded()) {
         if (showMask->get_active()) {
             showMask->set_active(false);
         }
@@ -3449,6 +3516,9 @@ void MasksPanel::updateLinkedMaskList(
             }
         }
     }
+    if (!mask_box_built_) {
+        return;
+    }
     disableListener();
     linked_mask_value_->remove_all();
     linked_mask_value_->append("(" + M("GENERAL_NONE") + ")");
@@ -3497,5 +3567,9 @@ void MasksPanel::onExternalMaskChanged()
 
 void MasksPanel::setExternalMaskPath(const Glib::ustring &dir)
 {
+    external_mask_dir_ = dir;
+    if (!mask_box_built_) {
+        return;
+    }
     external_mask_filename_->set_current_folder(Glib::filename_from_utf8(dir));
 }
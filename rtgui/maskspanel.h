@@ -179,6 +179,7 @@ public:
 private:
     void on_map() override;
     void onMaskFold(GdkEventButton *evt);
+    void buildMaskBox();
 
     ToolPanelListener *getListener();
     void populateList();
@@ -220,6 +221,7 @@ private:
     void updateGradientAreaMask(bool from_mask);
     void maskGet(int idx);
     void maskShow(int idx, bool list_only = false, bool unsub = true);
+    void maskWidgetsShow(int idx, bool unsub);
     void populateShapeList(int idx, int sel);
     void areaShapeSelect(int idx, bool update_list);
 
@@ -252,6 +254,12 @@ private:
     std::vector<rtengine::procparams::Mask> masks_;
     unsigned int selected_;
 
+    Gtk::VBox *mask_box_;
+    bool mask_box_built_;
+    bool show_mask_; // state of showMask while mask_box_ is not built
+    EditDataProvider *edit_provider_;
+    Glib::ustring external_mask_dir_;
+
     rtengine::ProcEvent EvMaskList;
     rtengine::ProcEvent EvParametricMask;
     rtengine::ProcEvent EvHMask;
@@ -22,6 +22,7 @@
 #include "guiutils.h"
 #include "multilangmgr.h"
 #include "version.h"
+#include <algorithm>
 #include <cstdio>
 #include <glib/gstdio.h>
 #include <iostream>
@@ -562,11 +563,20 @@ void Options::setDefaults()
     clutCacheSize = 5;
     thumb_delay_update = false;
     thumb_lazy_caching = true;
+    thumb_loader_io_depth = 0;
+    thumb_cache_key_mtime = false;
+    batch_queue_max_pending_saves = 2;
+    batch_queue_memory_limit = 0;
+    editor_prefetch_memory_limit = 1024;
+    detail_window_tile_size = 128;
+    detail_window_zoom_cache = true;
     thumb_cache_processed = true;
+    session_recording_dir = "";
     profile_append_mode = false;
     maxInspectorBuffers =
         2; //  a rather conservative value for low specced systems...
     inspectorDelay = 0;
+    inspector_cache_memory_limit = 256;
     serializeTiffRead = true;
     denoiseZoomedOut = true;
     wb_preview_mode = WB_BEFORE_HIGH_DETAIL;
@@ -583,6 +593,7 @@ void Options::setDefaults()
 
     fastexport_resize_width = 1920;
     fastexport_resize_height = 1920;
+    fastexport_concurrency = 2;
 
     clutsDir = "./cluts";
 
@@ -684,6 +695,33 @@ void Options::setDefaults()
     rtSettings.thread_pool_size = 0;
     rtSettings.ctl_scripts_fast_preview = true;
     rtSettings.imgio_raw_cache_size = 10;
+    rtSettings.imgio_max_processes = 0;
+    rtSettings.raw_decode_cache_size = 0;
+    rtSettings.output_tile_size = 0;
+    rtSettings.preview_stage_cache_size = 128;
+    rtSettings.preview_step_checkpoints = true;
+    rtSettings.preview_proxy_skip = 3;
+    rtSettings.preview_frame_budget = 100;
+    rtSettings.preview_progressive = true;
+    rtSettings.scratch_arena_memory_limit = 512;
+    rtSettings.fattal_multigrid = false;
+    rtSettings.fast_monitor_transform = true;
+    rtSettings.clut_cache_memory_limit = 256;
+    rtSettings.clut_disk_cache_size = 512;
+    rtSettings.extlut_disk_cache_size = 256;
+    rtSettings.half_float_buffers = false;
+    rtSettings.early_crop = true;
+    rtSettings.mask_processing_scale = 1;
+    rtSettings.thumbnail_detail_skip_size = 320;
+    rtSettings.histogram_live_stride = 4;
+    rtSettings.color_tables_cache = false;
+    rtSettings.metadata_cache_memory_limit = 64;
+    rtSettings.external_mask_cache_memory_limit = 256;
+    rtSettings.defect_map_min_images = 0;
+    rtSettings.numa_first_touch = true;
+    rtSettings.plane_pool_memory_limit = 512;
+    rtSettings.plane_swap_threshold = 0;
+    rtSettings.plane_swap_dir = "";
 
     show_exiftool_makernotes = false;
 
@@ -1326,6 +1364,14 @@ void Options::readFromFile(Glib::ustring fname)
                         keyFile.get_integer("Performance", "InspectorDelay");
                 }
 
+                if (keyFile.has_key("Performance",
+                                    "InspectorCacheMemoryLimit")) {
+                    inspector_cache_memory_limit = std::max(
+                        keyFile.get_integer("Performance",
+                                            "InspectorCacheMemoryLimit"),
+                        0);
+                }
+
                 if (keyFile.has_key("Performance",
                                     "PreviewDemosaicFromSidecar")) {
                     prevdemo = (prevdemo_t)keyFile.get_integer(
@@ -1363,11 +1409,63 @@ void Options::readFromFile(Glib::ustring fname)
                         keyFile.get_boolean("Performance", "ThumbLazyCaching");
                 }
 
+                if (keyFile.has_key("Performance", "ThumbLoaderIODepth")) {
+                    thumb_loader_io_depth = std::max(
+                        keyFile.get_integer("Performance",
+                                            "ThumbLoaderIODepth"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "ThumbCacheKeyMTime")) {
+                    thumb_cache_key_mtime = keyFile.get_boolean(
+                        "Performance", "ThumbCacheKeyMTime");
+                }
+
+                if (keyFile.has_key("Performance",
+                                    "BatchQueueMaxPendingSaves")) {
+                    batch_queue_max_pending_saves = std::max(
+                        keyFile.get_integer("Performance",
+                                            "BatchQueueMaxPendingSaves"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "BatchQueueMemoryLimit")) {
+                    batch_queue_memory_limit = std::max(
+                        keyFile.get_integer("Performance",
+                                            "BatchQueueMemoryLimit"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance",
+                                    "EditorPrefetchMemoryLimit")) {
+                    editor_prefetch_memory_limit = std::max(
+                        keyFile.get_integer("Performance",
+                                            "EditorPrefetchMemoryLimit"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "DetailWindowTileSize")) {
+                    detail_window_tile_size = std::max(
+                        keyFile.get_integer("Performance",
+                                            "DetailWindowTileSize"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "DetailWindowZoomCache")) {
+                    detail_window_zoom_cache = keyFile.get_boolean(
+                        "Performance", "DetailWindowZoomCache");
+                }
+
                 if (keyFile.has_key("Performance", "ThumbCacheProcessed")) {
                     thumb_cache_processed = keyFile.get_boolean(
                         "Performance", "ThumbCacheProcessed");
                 }
 
+                if (keyFile.has_key("Performance", "SessionRecordingDir")) {
+                    session_recording_dir = keyFile.get_string(
+                        "Performance", "SessionRecordingDir");
+                }
+
                 if (keyFile.has_key("Performance", "CTLScriptsFastPreview")) {
                     rtSettings.ctl_scripts_fast_preview = keyFile.get_boolean(
                         "Performance", "CTLScriptsFastPreview");
@@ -1378,6 +1476,164 @@ void Options::readFromFile(Glib::ustring fname)
                         "Performance", "RAWImageIOCacheSize");
                 }
 
+                if (keyFile.has_key("Performance", "ImageIOMaxProcesses")) {
+                    rtSettings.imgio_max_processes = keyFile.get_integer(
+                        "Performance", "ImageIOMaxProcesses");
+                }
+
+                if (keyFile.has_key("Performance", "RawDecodeCacheSize")) {
+                    rtSettings.raw_decode_cache_size = keyFile.get_integer(
+                        "Performance", "RawDecodeCacheSize");
+                }
+
+                if (keyFile.has_key("Performance", "OutputTileSize")) {
+                    rtSettings.output_tile_size = keyFile.get_integer(
+                        "Performance", "OutputTileSize");
+                }
+
+                if (keyFile.has_key("Performance", "PreviewStageCacheSize")) {
+                    rtSettings.preview_stage_cache_size = keyFile.get_integer(
+                        "Performance", "PreviewStageCacheSize");
+                }
+
+                if (keyFile.has_key("Performance", "PreviewStepCheckpoints")) {
+                    rtSettings.preview_step_checkpoints = keyFile.get_boolean(
+                        "Performance", "PreviewStepCheckpoints");
+                }
+
+                if (keyFile.has_key("Performance", "PreviewProxySkip")) {
+                    rtSettings.preview_proxy_skip = keyFile.get_integer(
+                        "Performance", "PreviewProxySkip");
+                }
+
+                if (keyFile.has_key("Performance", "PreviewFrameBudget")) {
+                    rtSettings.preview_frame_budget = std::max(
+                        keyFile.get_integer("Performance",
+                                            "PreviewFrameBudget"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "PreviewProgressive")) {
+                    rtSettings.preview_progressive = keyFile.get_boolean(
+                        "Performance", "PreviewProgressive");
+                }
+
+                if (keyFile.has_key("Performance",
+                                    "ScratchArenaMemoryLimit")) {
+                    rtSettings.scratch_arena_memory_limit =
+                        keyFile.get_integer("Performance",
+                                            "ScratchArenaMemoryLimit");
+                }
+
+                if (keyFile.has_key("Performance", "FattalMultigridSolver")) {
+                    rtSettings.fattal_multigrid = keyFile.get_boolean(
+                        "Performance", "FattalMultigridSolver");
+                }
+
+                if (keyFile.has_key("Performance", "FastMonitorTransform")) {
+                    rtSettings.fast_monitor_transform = keyFile.get_boolean(
+                        "Performance", "FastMonitorTransform");
+                }
+
+                if (keyFile.has_key("Performance", "CLUTCacheMemoryLimit")) {
+                    rtSettings.clut_cache_memory_limit = keyFile.get_integer(
+                        "Performance", "CLUTCacheMemoryLimit");
+                }
+
+                if (keyFile.has_key("Performance", "CLUTDiskCacheSize")) {
+                    rtSettings.clut_disk_cache_size = keyFile.get_integer(
+                        "Performance", "CLUTDiskCacheSize");
+                }
+
+                if (keyFile.has_key("Performance", "ExtLUTDiskCacheSize")) {
+                    rtSettings.extlut_disk_cache_size = keyFile.get_integer(
+                        "Performance", "ExtLUTDiskCacheSize");
+                }
+
+                if (keyFile.has_key("Performance", "HalfFloatBuffers")) {
+                    rtSettings.half_float_buffers = keyFile.get_boolean(
+                        "Performance", "HalfFloatBuffers");
+                }
+
+                if (keyFile.has_key("Performance", "EarlyCrop")) {
+                    rtSettings.early_crop =
+                        keyFile.get_boolean("Performance", "EarlyCrop");
+                }
+
+                if (keyFile.has_key("Performance", "MaskProcessingScale")) {
+                    rtSettings.mask_processing_scale = rtengine::LIM(
+                        keyFile.get_integer("Performance",
+                                            "MaskProcessingScale"),
+                        1, 4);
+                }
+
+                if (keyFile.has_key("Performance",
+                                    "ThumbnailDetailSkipSize")) {
+                    rtSettings.thumbnail_detail_skip_size = std::max(
+                        keyFile.get_integer("Performance",
+                                            "ThumbnailDetailSkipSize"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "HistogramLiveStride")) {
+                    rtSettings.histogram_live_stride = std::max(
+                        keyFile.get_integer("Performance",
+                                            "HistogramLiveStride"),
+                        1);
+                }
+
+                if (keyFile.has_key("Performance", "ColorTablesCache")) {
+                    rtSettings.color_tables_cache = keyFile.get_boolean(
+                        "Performance", "ColorTablesCache");
+                }
+
+                if (keyFile.has_key("Performance",
+                                    "MetadataCacheMemoryLimit")) {
+                    rtSettings.metadata_cache_memory_limit = std::max(
+                        keyFile.get_integer("Performance",
+                                            "MetadataCacheMemoryLimit"),
+                        1);
+                }
+
+                if (keyFile.has_key("Performance",
+                                    "ExternalMaskCacheMemoryLimit")) {
+                    rtSettings.external_mask_cache_memory_limit = std::max(
+                        keyFile.get_integer("Performance",
+                                            "ExternalMaskCacheMemoryLimit"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "DefectMapMinImages")) {
+                    rtSettings.defect_map_min_images = std::max(
+                        keyFile.get_integer("Performance",
+                                            "DefectMapMinImages"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "NUMAFirstTouch")) {
+                    rtSettings.numa_first_touch =
+                        keyFile.get_boolean("Performance", "NUMAFirstTouch");
+                }
+
+                if (keyFile.has_key("Performance", "PlanePoolMemoryLimit")) {
+                    rtSettings.plane_pool_memory_limit = std::max(
+                        keyFile.get_integer("Performance",
+                                            "PlanePoolMemoryLimit"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "PlaneSwapThreshold")) {
+                    rtSettings.plane_swap_threshold = std::max(
+                        keyFile.get_integer("Performance",
+                                            "PlaneSwapThreshold"),
+                        0);
+                }
+
+                if (keyFile.has_key("Performance", "PlaneSwapDir")) {
+                    rtSettings.plane_swap_dir =
+                        keyFile.get_string("Performance", "PlaneSwapDir");
+                }
+
                 if (keyFile.has_key("Performance",
                                     "PreviewResamplingQuality")) {
                     preview_resampling_quality =
@@ -1917,6 +2173,11 @@ void Options::readFromFile(Glib::ustring fname)
                     fastexport_resize_height =
                         keyFile.get_integer("Fast Export", "MaxHeight");
                 }
+
+                if (keyFile.has_key("Fast Export", "Concurrency")) {
+                    fastexport_concurrency = std::max(
+                        keyFile.get_integer("Fast Export", "Concurrency"), 1);
+                }
             }
 
             if (keyFile.has_group("Dialogs")) {
@@ -2265,6 +2526,8 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_integer("Performance", "MaxInspectorBuffers",
                             maxInspectorBuffers);
         keyFile.set_integer("Performance", "InspectorDelay", inspectorDelay);
+        keyFile.set_integer("Performance", "InspectorCacheMemoryLimit",
+                            inspector_cache_memory_limit);
         keyFile.set_integer("Performance", "PreviewDemosaicFromSidecar",
                             prevdemo);
         keyFile.set_boolean("Performance", "SerializeTiffRead",
@@ -2277,13 +2540,82 @@ void Options::saveToFile(Glib::ustring fname)
                             thumb_delay_update);
         keyFile.set_boolean("Performance", "ThumbLazyCaching",
                             thumb_lazy_caching);
+        keyFile.set_integer("Performance", "ThumbLoaderIODepth",
+                            thumb_loader_io_depth);
+        keyFile.set_boolean("Performance", "ThumbCacheKeyMTime",
+                            thumb_cache_key_mtime);
+        keyFile.set_integer("Performance", "BatchQueueMaxPendingSaves",
+                            batch_queue_max_pending_saves);
+        keyFile.set_integer("Performance", "BatchQueueMemoryLimit",
+                            batch_queue_memory_limit);
+        keyFile.set_integer("Performance", "EditorPrefetchMemoryLimit",
+                            editor_prefetch_memory_limit);
+        keyFile.set_integer("Performance", "DetailWindowTileSize",
+                            detail_window_tile_size);
+        keyFile.set_boolean("Performance", "DetailWindowZoomCache",
+                            detail_window_zoom_cache);
         keyFile.set_boolean("Performance", "ThumbCacheProcessed",
                             thumb_cache_processed);
+        keyFile.set_string("Performance", "SessionRecordingDir",
+                           session_recording_dir);
         keyFile.set_boolean("Performance", "CTLScriptsFastPreview",
                             rtSettings.ctl_scripts_fast_preview);
         keyFile.set_integer("Performance", "WBPreviewMode", wb_preview_mode);
         keyFile.set_integer("Performance", "RAWImageIOCacheSize",
                             rtSettings.imgio_raw_cache_size);
+        keyFile.set_integer("Performance", "ImageIOMaxProcesses",
+                            rtSettings.imgio_max_processes);
+        keyFile.set_integer("Performance", "RawDecodeCacheSize",
+                            rtSettings.raw_decode_cache_size);
+        keyFile.set_integer("Performance", "OutputTileSize",
+                            rtSettings.output_tile_size);
+        keyFile.set_integer("Performance", "PreviewStageCacheSize",
+                            rtSettings.preview_stage_cache_size);
+        keyFile.set_boolean("Performance", "PreviewStepCheckpoints",
+                            rtSettings.preview_step_checkpoints);
+        keyFile.set_integer("Performance", "PreviewProxySkip",
+                            rtSettings.preview_proxy_skip);
+        keyFile.set_integer("Performance", "PreviewFrameBudget",
+                            rtSettings.preview_frame_budget);
+        keyFile.set_boolean("Performance", "PreviewProgressive",
+                            rtSettings.preview_progressive);
+        keyFile.set_integer("Performance", "ScratchArenaMemoryLimit",
+                            rtSettings.scratch_arena_memory_limit);
+        keyFile.set_boolean("Performance", "FattalMultigridSolver",
+                            rtSettings.fattal_multigrid);
+        keyFile.set_boolean("Performance", "FastMonitorTransform",
+                            rtSettings.fast_monitor_transform);
+        keyFile.set_integer("Performance", "CLUTCacheMemoryLimit",
+                            rtSettings.clut_cache_memory_limit);
+        keyFile.set_integer("Performance", "CLUTDiskCacheSize",
+                            rtSettings.clut_disk_cache_size);
+        keyFile.set_integer("Performance", "ExtLUTDiskCacheSize",
+                            rtSettings.extlut_disk_cache_size);
+        keyFile.set_boolean("Performance", "HalfFloatBuffers",
+                            rtSettings.half_float_buffers);
+        keyFile.set_boolean("Performance", "EarlyCrop", rtSettings.early_crop);
+        keyFile.set_integer("Performance", "MaskProcessingScale",
+                            rtSettings.mask_processing_scale);
+        keyFile.set_integer("Performance", "ThumbnailDetailSkipSize",
+                            rtSettings.thumbnail_detail_skip_size);
+        keyFile.set_integer("Performance", "HistogramLiveStride",
+                            rtSettings.histogram_live_stride);
+        keyFile.set_boolean("Performance", "ColorTablesCache",
+                            rtSettings.color_tables_cache);
+        keyFile.set_integer("Performance", "MetadataCacheMemoryLimit",
+                            rtSettings.metadata_cache_memory_limit);
+        keyFile.set_integer("Performance", "ExternalMaskCacheMemoryLimit",
+                            rtSettings.external_mask_cache_memory_limit);
+        keyFile.set_integer("Performance", "DefectMapMinImages",
+                            rtSettings.defect_map_min_images);
+        keyFile.set_boolean("Performance", "NUMAFirstTouch",
+                            rtSettings.numa_first_touch);
+        keyFile.set_integer("Performance", "PlanePoolMemoryLimit",
+                            rtSettings.plane_pool_memory_limit);
+        keyFile.set_integer("Performance", "PlaneSwapThreshold",
+                            rtSettings.plane_swap_threshold);
+        keyFile.set_string("Performance", "PlaneSwapDir",
+                           rtSettings.plane_swap_dir);
         keyFile.set_integer("Performance", "PreviewResamplingQuality",
                             int(preview_resampling_quality));
 
@@ -2509,6 +2841,8 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_integer("Fast Export", "MaxWidth", fastexport_resize_width);
         keyFile.set_integer("Fast Export", "MaxHeight",
                             fastexport_resize_height);
+        keyFile.set_integer("Fast Export", "Concurrency",
+                            fastexport_concurrency);
 
         keyFile.set_string("Dialogs", "LastIccDir", lastIccDir);
         keyFile.set_string("Dialogs", "LastDarkframeDir", lastDarkframeDir);
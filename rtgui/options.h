@@ -348,10 +348,40 @@ public:
     int maxInspectorBuffers; // maximum number of buffers (i.e. images) for the
                              // Inspector feature
     int inspectorDelay;
+    // memory budget (in MB) for the images decoded by the Inspector,
+    // including the neighbours of the current one decoded in advance
+    // (0 = bounded only by maxInspectorBuffers)
+    int inspector_cache_memory_limit;
     int clutCacheSize;
     bool thumb_delay_update;
     bool thumb_lazy_caching;
+    // max number of files read at the same time while loading the thumbnails
+    // of a directory (0 = one per core). Lower values help on network shares
+    int thumb_loader_io_depth;
+    // include the modification time in the key of the cached thumbnails, so
+    // that files modified in place (with the same size) are refreshed
+    bool thumb_cache_key_mtime;
+    // max number of developed images being saved in the background while the
+    // batch queue processes the next ones (0 = save synchronously)
+    int batch_queue_max_pending_saves;
+    // memory budget (in MB) for the images being developed and saved by the
+    // batch queue (0 = half of the physical memory)
+    int batch_queue_memory_limit;
+    // memory budget (in MB) for the images adjacent to the one open in the
+    // editor that are loaded in advance (0 = disabled)
+    int editor_prefetch_memory_limit;
+    // the detail windows render a larger area than the visible one, aligned
+    // to a grid of this size (in pixels at the current scale), so that
+    // small pans are served from the last rendering (0 = disabled)
+    int detail_window_tile_size;
+    // above 100%, the detail windows render the area they would show at
+    // 100%, so that zooming between 100% and the current level doesn't need
+    // a new rendering
+    bool detail_window_zoom_cache;
     bool thumb_cache_processed;
+    // if not empty, the parameter changes made in the editor are recorded
+    // in a subdirectory of this one per image, for the replay of ART-bench
+    Glib::ustring session_recording_dir;
     bool profile_append_mode; // Used as reminder for the ProfilePanel "mode"
     prevdemo_t prevdemo;      // Demosaicing method used for the <100% preview
     bool serializeTiffRead;
@@ -372,6 +402,9 @@ public:
     // fast export options
     int fastexport_resize_width;
     int fastexport_resize_height;
+    // number of fast export jobs of the batch queue developed concurrently
+    // (1 = one at a time, like the other jobs)
+    int fastexport_concurrency;
 
     std::vector<Glib::ustring> favorites;
     // Dialog settings
@@ -197,7 +197,7 @@ void PlacesBrowser::refreshPlacesList()
     setRow(*(placesModel->append()),
            Gio::ThemedIcon::create("document-open-recent"),
            M("SESSION_LABEL") + " (" +
-               std::to_string(art::session::list().size()) + ")",
+               std::to_string(art::session::size()) + ")",
            art::session::path(), PlaceType::DEFAULT_DIR_OR_SESSION, false);
 
     // append favorites
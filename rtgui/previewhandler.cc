@@ -18,6 +18,7 @@
  */
 #include "previewhandler.h"
 #include "../rtengine/rtengine.h"
+#include <cmath>
 #include <gtkmm.h>
 
 using namespace rtengine;
@@ -127,13 +128,7 @@ void PreviewHandler::imageReady(const rtengine::procparams::CropParams &cp)
             return false;
         }
 
-        pih->phandler->previewImgMutex.lock();
-        pih->phandler->previewImg = Gdk::Pixbuf::create_from_data(
-            pih->phandler->image->getData(), Gdk::COLORSPACE_RGB, false, 8,
-            pih->phandler->image->getWidth(), pih->phandler->image->getHeight(),
-            3 * pih->phandler->image->getWidth());
-        pih->phandler->previewImgMutex.unlock();
-
+        pih->phandler->updatePreviewImg();
         pih->phandler->cropParams = cp;
         pih->phandler->previewImageChanged();
         --pih->pending;
@@ -142,6 +137,45 @@ void PreviewHandler::imageReady(const rtengine::procparams::CropParams &cp)
     });
 }
 
+void PreviewHandler::imageAreaReady(const rtengine::procparams::CropParams &cp,
+                                    int x, int y, int w, int h)
+{
+    pih->pending++;
+
+    idle_register.add([this, cp, x, y, w, h]() -> bool {
+        if (pih->destroyed) {
+            if (pih->pending == 1) {
+                delete pih;
+            } else {
+                --pih->pending;
+            }
+
+            return false;
+        }
+
+        pih->phandler->updatePreviewImg();
+
+        if (pih->phandler->cropParams == cp) {
+            pih->phandler->previewImageAreaChanged(x, y, w, h);
+        } else {
+            // the crop frame is drawn over the image
+            pih->phandler->cropParams = cp;
+            pih->phandler->previewImageChanged();
+        }
+        --pih->pending;
+
+        return false;
+    });
+}
+
+void PreviewHandler::updatePreviewImg()
+{
+    MyMutex::MyLock lock(previewImgMutex);
+    previewImg = Gdk::Pixbuf::create_from_data(
+        image->getData(), Gdk::COLORSPACE_RGB, false, 8, image->getWidth(),
+        image->getHeight(), 3 * image->getWidth());
+}
+
 Glib::RefPtr<Gdk::Pixbuf> PreviewHandler::getRoughImage(int x, int y, int w,
                                                         int h, double zoom)
 {
@@ -205,6 +239,42 @@ PreviewHandler::getRoughImage(int desiredW, int desiredH, double &zoom_)
     return resPixbuf;
 }
 
+bool PreviewHandler::updateRoughImage(const Glib::RefPtr<Gdk::Pixbuf> &dst,
+                                      double zoom, int x, int y, int w, int h,
+                                      int &dx, int &dy, int &dw, int &dh)
+{
+    MyMutex::MyLock lock(previewImgMutex);
+
+    if (!previewImg || !dst) {
+        return false;
+    }
+
+    const double z = zoom * previewScale;
+    const int W = dst->get_width();
+    const int H = dst->get_height();
+
+    if (W != int(image->getWidth() * z) || H != int(image->getHeight() * z)) {
+        return false;
+    }
+
+    // the interpolation spreads each source pixel over its neighbours
+    const int border = 1 + int(std::ceil(z));
+    dx = rtengine::LIM(int(std::floor(x * z)) - border, 0, W);
+    dy = rtengine::LIM(int(std::floor(y * z)) - border, 0, H);
+    dw = rtengine::LIM(int(std::ceil((x + w) * z)) + border, 0, W) - dx;
+    dh = rtengine::LIM(int(std::ceil((y + h) * z)) + border, 0, H) - dy;
+
+    if (w > 0 && h > 0 && dw > 0 && dh > 0) {
+        // same transformation as getRoughImage(), restricted to the area
+        previewImg->scale(dst, dx, dy, dw, dh, 0, 0, z, z,
+                          Gdk::INTERP_BILINEAR);
+    } else {
+        dw = dh = 0;
+    }
+
+    return true;
+}
+
 void PreviewHandler::previewImageChanged()
 {
 
@@ -213,3 +283,10 @@ void PreviewHandler::previewImageChanged()
         (*i)->previewImageChanged();
     }
 }
+
+void PreviewHandler::previewImageAreaChanged(int x, int y, int w, int h)
+{
+    for (auto l : listeners) {
+        l->previewImageAreaChanged(x, y, w, h);
+    }
+}
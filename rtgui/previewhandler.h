@@ -32,6 +32,11 @@ class PreviewListener {
 public:
     virtual ~PreviewListener() = default;
     virtual void previewImageChanged() = 0;
+    // only the area (x, y, w, h) of the preview image has changed
+    virtual void previewImageAreaChanged(int x, int y, int w, int h)
+    {
+        previewImageChanged();
+    }
 };
 
 class PreviewHandler;
@@ -59,6 +64,8 @@ protected:
     MyMutex previewImgMutex;
     Glib::RefPtr<Gdk::Pixbuf> previewImg;
 
+    void updatePreviewImg();
+
 public:
     PreviewHandler();
     ~PreviewHandler() override;
@@ -70,9 +77,12 @@ public:
                   const rtengine::procparams::CropParams &cp) override;
     void delImage(rtengine::IImage8 *img) override;
     void imageReady(const rtengine::procparams::CropParams &cp) override;
+    void imageAreaReady(const rtengine::procparams::CropParams &cp, int x,
+                        int y, int w, int h) override;
 
     // this function is called when a new preview image arrives from rtengine
     void previewImageChanged();
+    void previewImageAreaChanged(int x, int y, int w, int h);
 
     // with this function it is possible to ask for a rough approximation of a
     // (possibly zoomed) crop of the image
@@ -80,6 +90,13 @@ public:
                                             double zoom);
     Glib::RefPtr<Gdk::Pixbuf> getRoughImage(int desiredW, int desiredH,
                                             double &zoom);
+    // rescales the area (x, y, w, h) of the preview image into dst, an image
+    // returned by the function above with the same zoom. Returns false if dst
+    // doesn't match the current preview image, otherwise the area of dst
+    // that has been updated is stored in (dx, dy, dw, dh)
+    bool updateRoughImage(const Glib::RefPtr<Gdk::Pixbuf> &dst, double zoom,
+                          int x, int y, int w, int h, int &dx, int &dy,
+                          int &dw, int &dh);
     rtengine::procparams::CropParams getCropParams() { return cropParams; }
 };
 
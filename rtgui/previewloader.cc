@@ -22,11 +22,13 @@
 #include "guiutils.h"
 #include "options.h"
 #include "threadutils.h"
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <deque>
 #include <set>
 #include <thread>
+#include <vector>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -73,40 +75,114 @@ public:
 
     typedef std::set<Job, JobCompare> JobSet;
 
-    Impl(): num_concurrent_threads_(0), job_count_(0) {}
+    Impl(): runners_(0), job_count_(0), prefetched_jobs_(0) {}
+
+    // number of jobs whose cache records are read together
+    static constexpr size_t PREFETCH_SIZE = 64;
 
     MyMutex mutex_;
     std::deque<Job> jobs_;
-    std::atomic<int> num_concurrent_threads_;
-    size_t job_count_;
+    int runners_; // tasks currently queued or running in the thread pool
+    std::atomic<size_t> job_count_;
+    size_t prefetched_jobs_; // jobs at the front of the queue whose cache
+                             // records have already been requested
+
+    // max number of jobs processed concurrently, i.e. of files being read at
+    // the same time
+    static int maxRunners()
+    {
+        if (options.thumb_loader_io_depth > 0) {
+            return options.thumb_loader_io_depth;
+        }
+        return std::max(int(std::thread::hardware_concurrency()), 1);
+    }
+
+    // must be called with mutex_ locked. Returns the number of tasks to add
+    // to the thread pool
+    int newRunners()
+    {
+        const int n = std::min(maxRunners() - runners_, int(jobs_.size()));
+        if (n <= 0) {
+            return 0;
+        }
+        runners_ += n;
+        return n;
+    }
+
+    void startRunners(int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            rtengine::ThreadPool::add_task(
+                rtengine::ThreadPool::Priority::LOWEST,
+                sigc::mem_fun(*this, &PreviewLoader::Impl::run));
+        }
+    }
 
-    void processNextJob()
+    // a runner processes one job and then goes back to the end of the thread
+    // pool queue, so that it doesn't keep the worker busy while there are
+    // tasks with higher priority
+    void run()
     {
         Job j;
+        const bool done = processNextJob(j);
+
+        bool finished = false;
+        {
+            MyMutex::MyLock lock(mutex_);
+            if (jobs_.empty() || runners_ > maxRunners()) {
+                --runners_;
+                finished = runners_ == 0 && jobs_.empty();
+            } else {
+                lock.release();
+                startRunners(1);
+            }
+        }
+
+        // signal at end
+        if (finished && done) {
+            j.listener_->previewsFinished(j.dir_id_);
+        }
+    }
+
+    bool processNextJob(Job &j)
+    {
+        std::vector<Glib::ustring> prefetch;
         {
             MyMutex::MyLock lock(mutex_);
 
             // nothing to do; could be jobs have been removed
             if (jobs_.empty()) {
                 DEBUG("processing: nothing to do");
-                return;
+                return false;
             }
 
             // copy and remove front job
             j = jobs_.front();
             jobs_.pop_front();
+
+            if (prefetched_jobs_ > 0) {
+                --prefetched_jobs_;
+            } else {
+                for (size_t i = 0; i < jobs_.size() && i < PREFETCH_SIZE;
+                     ++i) {
+                    prefetch.push_back(jobs_[i].dir_entry_);
+                }
+                prefetched_jobs_ = prefetch.size();
+                prefetch.push_back(j.dir_entry_);
+            }
             DEBUG("processing %s", j.dir_entry_.c_str());
             DEBUG("%d job(s) remaining", jobs_.size());
         }
 
-        ++num_concurrent_threads_; // to detect when last thread in pool has run
-                                   // out
         try {
-            Thumbnail *tmb = nullptr;
-            if (Glib::file_test(j.dir_entry_, Glib::FILE_TEST_EXISTS)) {
-                tmb = cacheMgr->getEntry(j.dir_entry_);
+            if (prefetch.size() > 1) {
+                cacheMgr->prefetch(prefetch);
             }
 
+            // getEntry() returns null if the file doesn't exist (anymore), no
+            // need to stat it here as well
+            Thumbnail *tmb = cacheMgr->getEntry(j.dir_entry_);
+
             if (tmb) {
                 DEBUG("Preview Ready\n");
                 j.listener_->previewReady(
@@ -121,12 +197,7 @@ public:
         } catch (...) {
         }
 
-        bool last = num_concurrent_threads_--;
-
-        // signal at end
-        if (last && jobs_.empty()) {
-            j.listener_->previewsFinished(j.dir_id_);
-        }
+        return true;
     }
 };
 
@@ -142,22 +213,30 @@ PreviewLoader *PreviewLoader::getInstance()
 
 void PreviewLoader::add(int dir_id, const Glib::ustring &dir_entry,
                         PreviewLoaderListener *l)
+{
+    add(dir_id, std::vector<Glib::ustring>{dir_entry}, l);
+}
+
+void PreviewLoader::add(int dir_id, const std::vector<Glib::ustring> &entries,
+                        PreviewLoaderListener *l)
 {
     // somebody listening?
-    if (l != nullptr) {
+    if (l != nullptr && !entries.empty()) {
+        int n = 0;
         {
             MyMutex::MyLock lock(impl_->mutex_);
 
-            // create a new job and append to queue
-            DEBUG("saving job %s", dir_entry.c_str());
-            impl_->jobs_.push_back(Impl::Job(dir_id, dir_entry, l));
+            // create the new jobs and append them to the queue
+            for (const auto &e : entries) {
+                DEBUG("saving job %s", e.c_str());
+                impl_->jobs_.push_back(Impl::Job(dir_id, e, l));
+            }
+            n = impl_->newRunners();
         }
 
-        // queue a run request
-        DEBUG("adding run request %s", dir_entry.c_str());
-        rtengine::ThreadPool::add_task(
-            rtengine::ThreadPool::Priority::LOWEST,
-            sigc::mem_fun(*impl_, &PreviewLoader::Impl::processNextJob));
+        // queue the run requests
+        DEBUG("adding %d run requests", n);
+        impl_->startRunners(n);
     }
 }
 
@@ -165,4 +244,5 @@ void PreviewLoader::removeAllJobs()
 {
     MyMutex::MyLock lock(impl_->mutex_);
     impl_->jobs_.clear();
+    impl_->prefetched_jobs_ = 0;
 }
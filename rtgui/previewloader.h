@@ -22,6 +22,7 @@
 
 #include <glibmm.h>
 #include <set>
+#include <vector>
 
 #include "../rtengine/noncopyable.h"
 
@@ -69,6 +70,19 @@ public:
     void add(int dir_id, const Glib::ustring &dir_entry,
              PreviewLoaderListener *l);
 
+    /**
+     * @brief Add the update requests of several entries at once.
+     *
+     * The entries are processed in the given order, by at most
+     * Options::thumb_loader_io_depth threads at the same time.
+     *
+     * @param dir_id directory we're looking at
+     * @param entries entries in it
+     * @param l listener
+     */
+    void add(int dir_id, const std::vector<Glib::ustring> &entries,
+             PreviewLoaderListener *l);
+
     /**
      * @brief Stop processing and remove all jobs.
      *
@@ -81,6 +81,7 @@ void PreviewWindow::updatePreviewImage()
     if (previewHandler) {
         Glib::RefPtr<Gdk::Pixbuf> resPixbuf =
             previewHandler->getRoughImage(W, H, zoom);
+        roughImage = resPixbuf;
 
         if (resPixbuf) {
             imgW = resPixbuf->get_width();
@@ -187,6 +188,37 @@ void PreviewWindow::previewImageChanged()
     queue_draw();
 }
 
+void PreviewWindow::previewImageAreaChanged(int x, int y, int w, int h)
+{
+    if (!backBuffer || !roughImage || needsUpdate ||
+        backBuffer->getWidth() != get_width() ||
+        backBuffer->getHeight() != get_height() ||
+        previewHandler->getCropParams().enabled) {
+        // the crop frame is drawn over the image: redraw everything
+        previewImageChanged();
+        return;
+    }
+
+    int dx, dy, dw, dh;
+    if (!previewHandler->updateRoughImage(roughImage, zoom, x, y, w, h, dx, dy,
+                                          dw, dh)) {
+        previewImageChanged();
+        return;
+    } else if (dw <= 0 || dh <= 0) {
+        return;
+    }
+
+    Cairo::RefPtr<Cairo::Context> cc =
+        Cairo::Context::create(backBuffer->getSurface());
+    cc->set_operator(Cairo::OPERATOR_SOURCE);
+    cc->set_antialias(Cairo::ANTIALIAS_NONE);
+    Gdk::Cairo::set_source_pixbuf(cc, roughImage, imgX, imgY);
+    cc->rectangle(imgX + dx, imgY + dy, dw, dh);
+    cc->fill();
+
+    queue_draw_area(imgX + dx, imgY + dy, dw, dh);
+}
+
 void PreviewWindow::setImageArea(ImageArea *ia)
 {
 
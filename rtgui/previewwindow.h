@@ -31,6 +31,7 @@ class PreviewWindow: public Gtk::DrawingArea,
 
 private:
     Cairo::RefPtr<BackBuffer> backBuffer;
+    Glib::RefPtr<Gdk::Pixbuf> roughImage; // scaled image in backBuffer
     PreviewHandler *previewHandler;
     sigc::connection rconn;
     CropWindow *mainCropWin;
@@ -71,6 +72,7 @@ public:
 
     // PreviewListener interface
     void previewImageChanged() override;
+    void previewImageAreaChanged(int x, int y, int w, int h) override;
 
     // CropWindowListener interface
     void cropPositionChanged(CropWindow *w) override;
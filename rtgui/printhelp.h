@@ -61,6 +61,22 @@ inline void ART_print_help(std::ostream &out, const char *progname, bool gui)
             << " --check-lut <lut-filename>   Check the validity of the given "
                "LUT file."
             << std::endl;
+        out << "  " << pn
+            << " --server [-q]   Process the jobs read from stdin (see below)."
+            << std::endl;
+        out << "  " << pn
+            << " --watch <dir> [<job>] [-q]   Process the raw files appearing "
+               "in <dir>\n"
+            << "      (see below)." << std::endl;
+        out << "  " << pn
+            << " --coordinate <workers-file> [-q]   Distribute the jobs read "
+               "from stdin to\n"
+            << "      several servers (see below)." << std::endl;
+        out << "  " << pn
+            << " --zygote <socket> [-q]   Serve the connections to a unix "
+               "socket with\n"
+            << "      pre-initialised copies of the server (see below)."
+            << std::endl;
         out << std::endl;
         out << "Options:" << std::endl;
         out << "  " << pn
@@ -197,6 +213,82 @@ inline void ART_print_help(std::ostream &out, const char *progname, bool gui)
         out << "  The processing profiles are processed in the order specified "
                "on the\n"
             << "  command line." << std::endl;
+        out << std::endl;
+        out << "In --server mode, ART keeps running and reads jobs from stdin, "
+               "one JSON object\n"
+            << "per line, e.g.:\n"
+            << "  {\"id\": 1, \"input\": \"a.nef\", \"output\": \"out/\", "
+               "\"format\": \"tif\", \"sidecar\": true}\n"
+            << "The fields are: id (echoed in the replies), input, output (file "
+               "or folder),\n"
+            << "format (jpg, tif, png or a custom type), quality, subsampling, "
+               "bits, float,\n"
+            << "compress (tif), default_profile, profiles (list of files), "
+               "sidecar (true or\n"
+            << "a file), overwrite, fast and copy_params, with the same meaning "
+               "as the options\n"
+            << "above. {\"command\": \"quit\"} or EOF terminates. Replies "
+               "are JSON lines on stdout\n"
+            << "with an \"event\" field: ready, started, progress, warning, "
+               "done or error.\n"
+            << "Two more fields are accepted: dynamic_profile (apply the "
+               "dynamic profile rules)\n"
+            << "and preview (write the embedded preview, as "
+               "<output>-preview.jpg, before the\n"
+            << "processing, reported by a preview event; preview_size limits "
+               "its size).\n"
+            << "The width and height fields resize the output to fit in a "
+               "box, sharpen turns the\n"
+            << "output sharpening on or off and profile sets the output ICC "
+               "profile. With \"outputs\",\n"
+            << "a list of objects overriding the fields above (plus suffix, "
+               "appended to the\n"
+            << "output file name), the image is processed once and written "
+               "to all of them, e.g.\n"
+            << "  \"outputs\": [{\"format\": \"tif\"}, {\"width\": 2048, "
+               "\"height\": 2048},\n"
+            << "              {\"width\": 400, \"height\": 400, \"suffix\": "
+               "\"-web\"}]\n"
+            << "The done event then lists all the files in \"outputs\".\n"
+            << "The \"dzi\" format writes a Deep Zoom tile pyramid: the "
+               ".dzi descriptor and the\n"
+            << "<name>_files directory, with tiles of tile_size pixels "
+               "(default 254) overlapping\n"
+            << "by tile_overlap (default 1), as tile_format (jpg or png) "
+               "files.\n\n"
+            << "In --watch mode, the raw files created in <dir> are processed "
+               "as soon as they are\n"
+            << "fully written, i.e. when their size doesn't change for "
+               "\"settle\" ms (default 1000).\n"
+            << "<job> is a JSON template of the jobs (without input), with "
+               "dynamic_profile set by\n"
+            << "default, and where \"workers\" (default 1) sets how many "
+               "files are processed at\n"
+            << "once. The events are those of the server mode, plus "
+               "\"detected\"; done also\n"
+            << "reports the latency since the detection. E.g.:\n"
+            << "  --watch incoming '{\"output\": \"out/\", \"preview\": "
+               "true, \"workers\": 2}'\n\n"
+            << "In --coordinate mode, each line of <workers-file> is a command "
+               "starting a server,\n"
+            << "e.g. \"ssh node1 ART-cli --server -q\". The jobs read from "
+               "stdin (until EOF) are\n"
+            << "started from the most expensive (largest input), each on the "
+               "first worker to\n"
+            << "become free. The events of the workers are forwarded with a "
+               "\"worker\" field;\n"
+            << "a failed job is retried on another worker up to \"retries\" "
+               "times (default 2),\n"
+            << "with a \"retry\" event. Input and output paths are those "
+               "seen by the workers.\n\n"
+            << "In --zygote mode (not on Windows), the initialisation is done "
+               "once; then each\n"
+            << "connection to <socket> is served by a forked copy of the "
+               "process, which reads\n"
+            << "the jobs from the connection and writes the events to it, as "
+               "in --server mode.\n"
+            << "E.g.: socat - UNIX-CONNECT:<socket> < jobs.txt"
+            << std::endl;
     }
 }
 
@@ -23,60 +23,284 @@
 #include <giomm.h>
 #include <glib/gstdio.h>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
-#include <unordered_set>
 
 namespace art {
 namespace session {
 
 namespace {
 
-std::unordered_set<std::string> get_file_list(const Glib::ustring &fname)
+// The session file is a journal: a header line with a generation tag,
+// followed by one line per change, either a file name (added) or a file name
+// prefixed by REMOVED_MARK (removed). Changes are appended, and the file is
+// rewritten only when the stale lines dominate. Files without header (the
+// session lists saved by the user, or written by older versions) are plain
+// lists of names
+const std::string HEADER = "#ART-session ";
+const char REMOVED_MARK = '-';
+
+// the journal is compacted when it has more than
+// COMPACT_RATIO * (session size) + COMPACT_SLACK lines
+constexpr size_t COMPACT_RATIO = 2;
+constexpr size_t COMPACT_SLACK = 1000;
+
+// number of changes kept for changes(); older listeners reload everything
+constexpr size_t MAX_LOG_SIZE = 100000;
+
+class State {
+public:
+    std::mutex mutex;
+    std::set<std::string> names;
+    // the changes with versions in (version - log.size(), version]
+    std::vector<std::pair<std::string, bool>> log;
+    size_t version = 0;
+    size_t base_version = 0;
+    // the part of the session file already read
+    std::string generation;
+    gint64 offset = 0;
+    size_t lines = 0;
+    bool loaded = false;
+
+    // brings the state in sync with the session file, reading only what was
+    // appended since the last call (e.g. by ART -Sa in another process)
+    void sync();
+    void append(const std::vector<std::pair<std::string, bool>> &changes);
+    void rewrite();
+    void reset(std::set<std::string> &&n);
+
+private:
+    void record(const std::string &name, bool added);
+};
+
+State state;
+
+std::string new_generation()
+{
+    return std::to_string(g_get_real_time()) + "." +
+           std::to_string(g_random_int());
+}
+
+// reads the file list from fname, starting at offset. If offset is 0 and the
+// file has a journal header, the generation is stored in generation (and
+// left empty for plain lists). Returns the new offset
+gint64 read_changes(const Glib::ustring &fname, gint64 offset,
+                    std::string &generation,
+                    std::vector<std::pair<std::string, bool>> &out)
 {
-    std::unordered_set<std::string> res;
+    FILE *src = g_fopen(fname.c_str(), "rb");
+    if (!src) {
+        return offset;
+    }
+    if (offset > 0) {
+        fseek(src, offset, SEEK_SET);
+    }
 
-    if (Glib::file_test(fname, Glib::FILE_TEST_EXISTS)) {
-        auto dir = Gio::File::create_for_path(fname);
-        auto src = dir->read();
-        std::stringstream sbuf;
-        char buf[4097];
-        while (true) {
-            auto n = src->read(buf, 4096);
-            if (!n) {
+    std::string line;
+    gint64 pos = offset;
+    bool first = (offset == 0);
+    char buf[4096];
+    while (fgets(buf, sizeof(buf), src)) {
+        line += buf;
+        if (line.empty() || line.back() != '\n') {
+            if (feof(src)) {
+                // incomplete line, possibly still being written
                 break;
+            }
+            continue;
+        }
+        pos += line.size();
+        line.pop_back();
+        // handle crlf files
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (first && line.compare(0, HEADER.size(), HEADER) == 0) {
+            generation = line.substr(HEADER.size());
+        } else if (!line.empty()) {
+            if (line[0] == REMOVED_MARK) {
+                out.emplace_back(line.substr(1), false);
             } else {
-                buf[n] = 0;
-                sbuf << buf;
+                out.emplace_back(line, true);
             }
         }
-        sbuf.seekg(0);
-        std::string line;
-        while (src && std::getline(sbuf, line)) {
-            Glib::ustring name = line;
-            // handle crlf files
-            if (name.size() && name[name.size() - 1] == '\r') {
-                name.resize(name.size() - 1);
+        first = false;
+        line.clear();
+    }
+    fclose(src);
+    return pos;
+}
+
+void State::record(const std::string &name, bool added)
+{
+    log.emplace_back(name, added);
+    ++version;
+    if (log.size() > MAX_LOG_SIZE) {
+        const size_t n = log.size() / 2;
+        log.erase(log.begin(), log.begin() + n);
+        base_version += n;
+    }
+}
+
+void State::reset(std::set<std::string> &&n)
+{
+    names = std::move(n);
+    log.clear();
+    ++version;
+    base_version = version;
+}
+
+void State::sync()
+{
+    const auto fn = filename();
+    std::string gen;
+    std::vector<std::pair<std::string, bool>> changes;
+
+    if (loaded) {
+        // check whether the file was rewritten in the meantime
+        FILE *src = g_fopen(fn.c_str(), "rb");
+        if (src) {
+            char buf[256];
+            if (fgets(buf, sizeof(buf), src)) {
+                std::string l(buf);
+                while (!l.empty() && (l.back() == '\n' || l.back() == '\r')) {
+                    l.pop_back();
+                }
+                if (l.compare(0, HEADER.size(), HEADER) == 0) {
+                    gen = l.substr(HEADER.size());
+                }
             }
-            if (Glib::file_test(name, Glib::FILE_TEST_EXISTS)) {
-                res.insert(name);
+            fseek(src, 0, SEEK_END);
+            const gint64 size = ftell(src);
+            fclose(src);
+            if (gen == generation && !gen.empty() && size >= offset) {
+                if (size > offset) {
+                    offset = read_changes(fn, offset, gen, changes);
+                    lines += changes.size();
+                    for (auto &c : changes) {
+                        const bool present = names.count(c.first);
+                        if (c.second && !present &&
+                            Glib::file_test(c.first, Glib::FILE_TEST_EXISTS)) {
+                            names.insert(c.first);
+                            record(c.first, true);
+                        } else if (!c.second && present) {
+                            names.erase(c.first);
+                            record(c.first, false);
+                        }
+                    }
+                }
+                return;
             }
+        } else if (names.empty()) {
+            return;
         }
+        gen.clear();
+        changes.clear();
     }
 
-    return res;
+    // first access, or rewritten by someone else: read it all
+    offset = read_changes(fn, 0, gen, changes);
+    std::set<std::string> n;
+    for (auto &c : changes) {
+        if (c.second) {
+            n.insert(c.first);
+        } else {
+            n.erase(c.first);
+        }
+    }
+    for (auto it = n.begin(); it != n.end();) {
+        if (!Glib::file_test(*it, Glib::FILE_TEST_EXISTS)) {
+            it = n.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    const bool was_loaded = loaded;
+    loaded = true;
+    if (!was_loaded || n != names) {
+        reset(std::move(n));
+    }
+    if (gen.empty() || changes.size() != names.size()) {
+        // a plain list, or a journal with stale entries
+        rewrite();
+    } else {
+        generation = gen;
+        lines = changes.size();
+    }
 }
 
-void save(const Glib::ustring &fname,
-          const std::unordered_set<std::string> &names)
+void State::append(const std::vector<std::pair<std::string, bool>> &changes)
 {
-    std::vector<std::string> l(names.begin(), names.end());
-    std::sort(l.begin(), l.end());
-    FILE *out = g_fopen(fname.c_str(), "wb");
-    for (auto &s : l) {
+    if (changes.empty()) {
+        return;
+    }
+    for (auto &c : changes) {
+        record(c.first, c.second);
+    }
+    if (lines + changes.size() > COMPACT_RATIO * names.size() + COMPACT_SLACK) {
+        rewrite();
+        return;
+    }
+
+    const auto fn = filename();
+    FILE *out = g_fopen(fn.c_str(), "ab");
+    if (!out) {
+        return;
+    }
+    for (auto &c : changes) {
+        if (!c.second) {
+            fputc(REMOVED_MARK, out);
+        }
+        fputs(c.first.c_str(), out);
+        fputs("\n", out);
+    }
+    offset = ftell(out);
+    fclose(out);
+    lines += changes.size();
+}
+
+void State::rewrite()
+{
+    const auto fn = filename();
+    const auto tmp = fn + ".tmp";
+    FILE *out = g_fopen(tmp.c_str(), "wb");
+    if (!out) {
+        return;
+    }
+    generation = new_generation();
+    fputs((HEADER + generation + "\n").c_str(), out);
+    for (auto &s : names) {
         fputs(s.c_str(), out);
         fputs("\n", out);
     }
+    offset = ftell(out);
     fclose(out);
+    lines = names.size();
+    if (g_rename(tmp.c_str(), fn.c_str()) != 0) {
+        // e.g. on Windows, if the destination is open
+        g_remove(fn.c_str());
+        g_rename(tmp.c_str(), fn.c_str());
+    }
+}
+
+// the file list in a session file saved by the user
+std::set<std::string> get_file_list(const Glib::ustring &fname)
+{
+    std::string gen;
+    std::vector<std::pair<std::string, bool>> changes;
+    read_changes(fname, 0, gen, changes);
+
+    std::set<std::string> res;
+    for (auto &c : changes) {
+        if (!c.second) {
+            res.erase(c.first);
+        } else if (Glib::file_test(c.first, Glib::FILE_TEST_EXISTS)) {
+            res.insert(c.first);
+        }
+    }
+    return res;
 }
 
 } // namespace
@@ -93,50 +317,106 @@ Glib::ustring filename()
 
 void load(const Glib::ustring &fname)
 {
-    auto fn = filename();
     auto cur = get_file_list(fname);
-    save(fn, cur);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.loaded = true;
+    state.reset(std::move(cur));
+    state.rewrite();
 }
 
 void save(const Glib::ustring &fname)
 {
-    auto fn = filename();
-    auto cur = get_file_list(fn);
-    save(fname, cur);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sync();
+    // a plain list, readable also by older versions
+    FILE *out = g_fopen(fname.c_str(), "wb");
+    if (!out) {
+        return;
+    }
+    for (auto &s : state.names) {
+        fputs(s.c_str(), out);
+        fputs("\n", out);
+    }
+    fclose(out);
 }
 
 void clear()
 {
-    std::unordered_set<std::string> empty;
-    save(filename(), empty);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.loaded = true;
+    state.reset(std::set<std::string>());
+    state.rewrite();
 }
 
 void add(const std::vector<Glib::ustring> &fnames)
 {
-    auto fn = filename();
-    auto prev = get_file_list(fn);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sync();
+    std::vector<std::pair<std::string, bool>> changes;
     for (auto &n : fnames) {
-        prev.insert(n);
+        if (!state.names.count(n) &&
+            Glib::file_test(n, Glib::FILE_TEST_EXISTS)) {
+            state.names.insert(n);
+            changes.emplace_back(n, true);
+        }
     }
-    save(fn, prev);
+    state.append(changes);
 }
 
 void remove(const std::vector<Glib::ustring> &fnames)
 {
-    auto fn = filename();
-    auto prev = get_file_list(fn);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sync();
+    std::vector<std::pair<std::string, bool>> changes;
     for (auto &n : fnames) {
-        prev.erase(n);
+        if (state.names.erase(n)) {
+            changes.emplace_back(n, false);
+        }
     }
-    save(fn, prev);
+    state.append(changes);
 }
 
 std::vector<Glib::ustring> list()
 {
-    auto prev = get_file_list(filename());
-    std::vector<Glib::ustring> ret(prev.begin(), prev.end());
-    std::sort(ret.begin(), ret.end());
-    return ret;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sync();
+    return std::vector<Glib::ustring>(state.names.begin(), state.names.end());
+}
+
+size_t size()
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sync();
+    return state.names.size();
+}
+
+size_t version()
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sync();
+    return state.version;
+}
+
+bool changes(size_t since, std::vector<Glib::ustring> &added,
+             std::vector<Glib::ustring> &removed)
+{
+    added.clear();
+    removed.clear();
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sync();
+    if (since < state.base_version || since > state.version) {
+        return false;
+    }
+    // only the net effect of the changes is reported
+    std::map<std::string, bool> net;
+    for (size_t i = since - state.base_version; i < state.log.size(); ++i) {
+        net[state.log[i].first] = state.log[i].second;
+    }
+    for (auto &c : net) {
+        (c.second ? added : removed).push_back(c.first);
+    }
+    return true;
 }
 
 Glib::ustring path() { return Options::SESSION_PATH; }
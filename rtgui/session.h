@@ -36,6 +36,15 @@ void clear();
 void add(const std::vector<Glib::ustring> &fnames);
 void remove(const std::vector<Glib::ustring> &fnames);
 std::vector<Glib::ustring> list();
+size_t size();
+
+// Each change to the session bumps its version. changes() gives the files
+// added and removed since the given version, or returns false if they are
+// not known anymore (e.g. the session was cleared or loaded), in which case
+// list() has to be read again
+size_t version();
+bool changes(size_t since, std::vector<Glib::ustring> &added,
+             std::vector<Glib::ustring> &removed);
 
 } // namespace session
 } // namespace art
@@ -0,0 +1,63 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sessionrecorder.h"
+#include "../rtengine/threadpool.h"
+#include "eventmapper.h"
+#include <glib/gstdio.h>
+#include <glibmm.h>
+#include <memory>
+
+SessionRecorder::SessionRecorder(const Glib::ustring &dir,
+                                 const Glib::ustring &fname)
+    : start_(Clock::now()), count_(0)
+{
+    const Glib::ustring stamp =
+        Glib::DateTime::create_now_local().format("%Y%m%d-%H%M%S");
+    dir_ = Glib::build_filename(dir, Glib::path_get_basename(fname) + "-" +
+                                         stamp);
+    if (g_mkdir_with_parents(dir_.c_str(), 0777) == 0) {
+        index_.open(Glib::build_filename(dir_, "session.txt").c_str());
+        index_ << "image " << fname << std::endl;
+    }
+}
+
+void SessionRecorder::record(const rtengine::ProcEvent &event, int flags,
+                             const rtengine::procparams::ProcParams &params)
+{
+    if (!index_) {
+        return;
+    }
+
+    const std::chrono::duration<double> t = Clock::now() - start_;
+    const int n = count_++;
+    std::string label = ProcEventMapper::getInstance()->getHistoryMsg(event);
+    if (label.empty()) {
+        label = "EVENT_" + std::to_string(int(event));
+    }
+    index_ << n << " " << t.count() << " " << flags << " " << label
+           << std::endl;
+
+    // writing the snapshot takes a few ms, keep it out of the GUI thread
+    auto pp = std::make_shared<rtengine::procparams::ProcParams>(params);
+    const Glib::ustring fname = snapshotName(dir_, n);
+    rtengine::ThreadPool::add_task(rtengine::ThreadPool::Priority::LOW,
+                                   [pp, fname]() -> void {
+                                       pp->save(nullptr, fname);
+                                   });
+}
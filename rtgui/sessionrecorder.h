@@ -0,0 +1,64 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../rtengine/noncopyable.h"
+#include "../rtengine/procevents.h"
+#include "../rtengine/procparams.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <glibmm/miscutils.h>
+#include <glibmm/ustring.h>
+
+/**
+ * Records the parameter updates sent to the image processor of the editor,
+ * so that ART-bench can replay them (option -r) and measure the latency of
+ * the preview.
+ *
+ * A session is a directory with a "session.txt" file, whose first line is
+ * "image <file name>" and the others "<n> <seconds> <flags> <event>", one
+ * per update, and a snapshot of the parameters of each update, in
+ * <n>.arp (with n zero-padded to 6 digits). The refresh flags are recorded
+ * instead of the event codes, as the latter are assigned at runtime.
+ */
+class SessionRecorder: public rtengine::NonCopyable {
+public:
+    /// creates a new session in a subdirectory of dir
+    SessionRecorder(const Glib::ustring &dir, const Glib::ustring &fname);
+
+    bool ok() const { return bool(index_); }
+
+    void record(const rtengine::ProcEvent &event, int flags,
+                const rtengine::procparams::ProcParams &params);
+
+    static Glib::ustring snapshotName(const Glib::ustring &dir, int n)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%06d.arp", n);
+        return Glib::build_filename(dir, buf);
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Glib::ustring dir_;
+    std::ofstream index_;
+    Clock::time_point start_;
+    int count_;
+};
@@ -14,6 +14,10 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <numeric>
 
@@ -889,7 +893,7 @@ void ThumbBrowserBase::on_style_updated()
 
 ThumbBrowserBase::Internal::Internal()
     : // ofsX(0), ofsY(0),
-      parent(nullptr), dirty(true)
+      parent(nullptr), dirty(true), last_scroll_pos_(0), scroll_dir_(0)
 {
     Glib::RefPtr<Gtk::StyleContext> style = get_style_context();
     set_name("FileCatalog");
@@ -1021,16 +1025,48 @@ bool ThumbBrowserBase::Internal::on_draw(
 
     // std::cout << "\nREDRAWING\n" << std::endl;
 
+    // the thumbnail updates are scheduled by distance from the visible area,
+    // looking ahead in the direction of scrolling
+    const bool vertical = parent->arrangement == TB_Vertical;
+    const double scroll_pos = vertical ? parent->vscroll.get_value()
+                                       : parent->hscroll.get_value();
+    if (scroll_pos != last_scroll_pos_) {
+        scroll_dir_ = scroll_pos > last_scroll_pos_ ? 1 : -1;
+        last_scroll_pos_ = scroll_pos;
+    }
+    const int extent = std::max(vertical ? h : w, 1);
+
+    // GTK merges all the areas invalidated since the last drawing into the
+    // clip region: the entries outside of it are unchanged on screen and
+    // don't need to be painted again
+    double clip_x1 = 0, clip_y1 = 0, clip_x2 = w, clip_y2 = h;
+    cr->get_clip_extents(clip_x1, clip_y1, clip_x2, clip_y2);
+    const int cx = std::floor(clip_x1), cy = std::floor(clip_y1);
+    const int cw = std::ceil(clip_x2) - cx, ch = std::ceil(clip_y2) - cy;
+
     {
         MYWRITERLOCK(l, parent->entryRW);
 
         for (size_t i = 0; i < parent->fd.size() && !dirty;
              i++) { // if dirty meanwhile, cancel and wait for next redraw
-            if (!parent->fd[i]->drawable ||
-                !parent->fd[i]->insideWindow(0, 0, w, h)) {
+            if (!parent->fd[i]->drawable) {
                 parent->fd[i]->updatepriority = false;
+                parent->fd[i]->update_distance = INT_MAX;
+            } else if (!parent->fd[i]->insideWindow(0, 0, w, h)) {
+                parent->fd[i]->updatepriority = false;
+                const int d =
+                    parent->fd[i]->distanceFromWindow(0, 0, w, h, vertical);
+                int dist = int(std::min(std::abs(d) * 1000.0 / extent, 1e6));
+                if ((d > 0) == (scroll_dir_ > 0) && scroll_dir_ != 0) {
+                    dist /= 2;
+                }
+                parent->fd[i]->update_distance = dist;
             } else {
+                parent->fd[i]->update_distance = 0;
                 parent->fd[i]->updatepriority = true;
+                if (!parent->fd[i]->insideWindow(cx, cy, cw, ch)) {
+                    continue;
+                }
                 // if (parent->fd[i]->requestDraw()) {
                 //     // to_draw.push_back(parent->fd[i]);
                 // } else {
@@ -1315,10 +1351,14 @@ void ThumbBrowserBase::redrawEntryNeeded(ThumbBrowserEntryBase *entry)
                             internal.get_height())) {
         // std::cout << "REDRAW NEEDED: " << entry->shortname << std::endl;
 
+        // only the area of the entry is invalidated, so that the other
+        // thumbnails are not painted again (see Internal::on_draw()). Nothing
+        // to do if a redraw of the whole window is pending already
         if (!internal.isDirty()) {
             // std::cout << "   QUEUING" << std::endl;
-            internal.setDirty();
-            internal.queue_draw();
+            internal.queue_draw_area(entry->getX(), entry->getY(),
+                                     entry->getEffectiveWidth(),
+                                     entry->getEffectiveHeight());
         }
     }
 }
@@ -38,6 +38,8 @@ class ThumbBrowserBase: public Gtk::Grid {
         //  int ofsX, ofsY;
         ThumbBrowserBase *parent;
         bool dirty;
+        double last_scroll_pos_;
+        int scroll_dir_; // last scrolling direction (-1, 0, 1)
 
         // caching some very often used values
         Glib::RefPtr<Gtk::StyleContext> style;
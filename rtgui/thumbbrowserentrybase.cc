@@ -129,7 +129,7 @@ ThumbBrowserEntryBase::ThumbBrowserEntryBase(const Glib::ustring &fname)
       thumbnail(nullptr), filename(fname), selected(false), drawable(false),
       filtered(false), framed(false), processing(false), italicstyle(false),
       edited(false), recentlysaved(false), updatepriority(false),
-      withFilename(WFNAME_NONE)
+      update_distance(0), withFilename(WFNAME_NONE)
 {
 }
 
@@ -771,6 +771,22 @@ bool ThumbBrowserEntryBase::insideWindow(int x, int y, int w, int h) const
              ofsY + starty > y + h || ofsY + starty + exp_height < y);
 }
 
+int ThumbBrowserEntryBase::distanceFromWindow(int x, int y, int w, int h,
+                                              bool vertical) const
+{
+    const int lo = vertical ? ofsY + starty : ofsX + startx;
+    const int hi = lo + (vertical ? exp_height : exp_width);
+    const int wlo = vertical ? y : x;
+    const int whi = wlo + (vertical ? h : w);
+
+    if (hi < wlo) {
+        return hi - wlo;
+    } else if (lo > whi) {
+        return lo - whi;
+    }
+    return 0;
+}
+
 std::vector<Glib::RefPtr<Gdk::Pixbuf>>
 ThumbBrowserEntryBase::getIconsOnImageArea()
 {
@@ -108,6 +108,10 @@ public:
     bool edited;
     bool recentlysaved;
     bool updatepriority;
+    // distance from the visible area of the browser, in thousandths of its
+    // size (0 = visible), used to schedule the thumbnail updates. Entries
+    // lying in the direction of scrolling count as nearer
+    std::atomic<int> update_distance;
     eWithFilename withFilename;
 
     explicit ThumbBrowserEntryBase(const Glib::ustring &fname);
@@ -134,6 +138,9 @@ public:
     bool inside(int x, int y) const;
     rtengine::Coord2D getPosInImgSpace(int x, int y) const;
     bool insideWindow(int x, int y, int w, int h) const;
+    /** distance of the entry from the window along the layout direction,
+        negative if the entry comes before it */
+    int distanceFromWindow(int x, int y, int w, int h, bool vertical) const;
     void setPosition(int x, int y, int w, int h);
     void setOffset(int x, int y);
 
@@ -18,6 +18,7 @@
  */
 
 #include <atomic>
+#include <climits>
 #include <set>
 
 #include <gtkmm.h>
@@ -66,6 +67,11 @@ public:
 
     typedef std::list<Job> JobList;
 
+    // distance from the visible area (see
+    // ThumbBrowserEntryBase::update_distance) beyond which the jobs are
+    // dropped, i.e. three window sizes
+    static constexpr int DROP_DISTANCE = 3000;
+
     Impl(): active_(0), inactive_waiting_(false) {}
 
     std::mutex mutex_;
@@ -90,34 +96,37 @@ public:
                 return;
             }
 
-            JobList::iterator i;
-
-            // see if any priority jobs exist
-            for (i = jobs_.begin(); i != jobs_.end(); ++i) {
-                if (*(i->priority_)) {
-                    DEBUG("processing(priority) %s",
-                          i->tbe_->thumbnail->getFileName().c_str());
-                    break;
+            // pick the job of the entry nearest to the visible area (the
+            // priority ones are visible), preferring the jobs that are not
+            // upgrades at the same distance. The jobs of the entries that
+            // scrolled far away are dropped
+            JobList::iterator i = jobs_.end();
+            int best = INT_MAX;
+
+            for (auto it = jobs_.begin(); it != jobs_.end();) {
+                const int dist =
+                    *(it->priority_) ? -1 : it->tbe_->update_distance.load();
+                if (dist > DROP_DISTANCE) {
+                    DEBUG("dropping %s",
+                          it->tbe_->thumbnail->getFileName().c_str());
+                    it->listener_->updateCancelled();
+                    it = jobs_.erase(it);
+                    continue;
                 }
-            }
-
-            // see if any none upgrade jobs exist
-            if (i == jobs_.end()) {
-                for (i = jobs_.begin(); i != jobs_.end(); ++i) {
-                    if (!i->upgrade_) {
-                        DEBUG("processing(not-upgrade) %s",
-                              i->tbe_->thumbnail->getFileName().c_str());
-                        break;
-                    }
+                if (dist < best ||
+                    (dist == best && i->upgrade_ && !it->upgrade_)) {
+                    i = it;
+                    best = dist;
                 }
+                ++it;
             }
 
-            // if none, then use first
             if (i == jobs_.end()) {
-                i = jobs_.begin();
-                DEBUG("processing(first) %s",
-                      i->tbe_->thumbnail->getFileName().c_str());
+                DEBUG("processing: all jobs dropped");
+                return;
             }
+            DEBUG("processing(distance %d) %s", best,
+                  i->tbe_->thumbnail->getFileName().c_str());
 
             // copy found job
             j = *i;
@@ -43,6 +43,14 @@ public:
     virtual void
     updateImage(rtengine::IImage8 *img, double scale,
                 const rtengine::procparams::CropParams &cropParams) = 0;
+
+    /**
+     * @brief Called when a queued update is dropped because the entry is far
+     * from the visible area
+     *
+     * @note called with the lock of the updater held
+     */
+    virtual void updateCancelled() {}
 };
 
 class ThumbImageUpdater: public rtengine::NonCopyable {
@@ -63,7 +71,8 @@ public:
      * @param t thumbnail
      * @param params processing params (?)
      * @param height how big
-     * @param priority if \c true then run as soon as possible
+     * @param priority if \c true then run as soon as possible, otherwise the
+     * jobs are run in order of ThumbBrowserEntryBase::update_distance
      * @param l listener waiting on update
      */
     void add(ThumbBrowserEntryBase *tbe, bool *priority, bool upgrade,
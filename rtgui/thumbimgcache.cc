@@ -23,32 +23,28 @@
 #include "options.h"
 #include <glib/gstdio.h>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 extern Options options;
 
 namespace art {
 namespace thumbimgcache {
 
-/******************************************************************************
- * file format:
- *
- * "ART\n" header
- * monitor hash
- * size of the procparams
- * compressed procparams
- * width
- * height
- * image data
- ******************************************************************************/
-rtengine::IImage8 *load(const Glib::ustring &cache_fname,
-                        const rtengine::procparams::ProcParams &pparams, int h)
-{
-    if (!options.thumb_cache_processed) {
-        return nullptr;
-    }
+namespace {
 
-    Glib::ustring fname = cache_fname + ".artt";
+// the levels of the pyramid are halved down to this height
+constexpr int MIN_LEVEL_HEIGHT = 64;
 
+/*
+ * Opens the file and checks that it was saved for the given monitor and
+ * procparams. On success, the file is positioned on the first level and
+ * num_levels is set
+ */
+FILE *open_file(const Glib::ustring &fname,
+                const rtengine::procparams::ProcParams &pparams,
+                guint32 &num_levels)
+{
     if (!Glib::file_test(fname, Glib::FILE_TEST_EXISTS)) {
         return nullptr;
     }
@@ -59,15 +55,21 @@ rtengine::IImage8 *load(const Glib::ustring &cache_fname,
         return nullptr;
     }
 
-    // header
+    // header: "ART\n" is the single-image format of older versions
     char buffer[64];
-    fgets(buffer, 5, f);
-    if (strcmp(buffer, "ART\n") != 0) {
+    if (!fgets(buffer, 5, f)) {
+        fclose(f);
+        return nullptr;
+    }
+    const bool pyramid = strcmp(buffer, "ARP\n") == 0;
+    if (!pyramid && strcmp(buffer, "ART\n") != 0) {
+        fclose(f);
         return nullptr;
     }
 
     // monitor hash
     if (fread(buffer, sizeof(char), 33, f) < 33) {
+        fclose(f);
         return nullptr;
     }
     buffer[33] = '\0';
@@ -103,24 +105,108 @@ rtengine::IImage8 *load(const Glib::ustring &cache_fname,
         return nullptr;
     }
 
-    guint32 width = 0, height = 0;
-
-    if (fread(&width, 1, sizeof(guint32), f) < sizeof(guint32)) {
+    num_levels = 1;
+    if (pyramid &&
+        fread(&num_levels, 1, sizeof(guint32), f) < sizeof(guint32)) {
         fclose(f);
         return nullptr;
     }
 
-    if (fread(&height, 1, sizeof(guint32), f) < sizeof(guint32)) {
-        fclose(f);
+    return f;
+}
+
+bool read_size(FILE *f, guint32 &width, guint32 &height)
+{
+    return fread(&width, 1, sizeof(guint32), f) == sizeof(guint32) &&
+           fread(&height, 1, sizeof(guint32), f) == sizeof(guint32) &&
+           std::min(width, height) > 0;
+}
+
+bool skip_image(FILE *f, guint32 width, guint32 height)
+{
+    return fseek(f, long(width) * long(height) * 3, SEEK_CUR) == 0;
+}
+
+// 2x2 box filter
+rtengine::Image8 *halve(const rtengine::IImage8 *src)
+{
+    const int W = src->getWidth() / 2;
+    const int H = src->getHeight() / 2;
+    rtengine::Image8 *res = new rtengine::Image8(W, H);
+
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            const int sy = 2 * y, sx = 2 * x;
+            res->r(y, x) = (src->r(sy, sx) + src->r(sy, sx + 1) +
+                            src->r(sy + 1, sx) + src->r(sy + 1, sx + 1) + 2) /
+                           4;
+            res->g(y, x) = (src->g(sy, sx) + src->g(sy, sx + 1) +
+                            src->g(sy + 1, sx) + src->g(sy + 1, sx + 1) + 2) /
+                           4;
+            res->b(y, x) = (src->b(sy, sx) + src->b(sy, sx + 1) +
+                            src->b(sy + 1, sx) + src->b(sy + 1, sx + 1) + 2) /
+                           4;
+        }
+    }
+
+    return res;
+}
+
+} // namespace
+
+/******************************************************************************
+ * file format:
+ *
+ * "ARP\n" header
+ * monitor hash
+ * size of the procparams
+ * compressed procparams
+ * number of levels
+ * for each level, from the largest:
+ *   width
+ *   height
+ *   image data
+ *
+ * The files of older versions ("ART\n" header) have a single level, without
+ * the number of levels.
+ ******************************************************************************/
+rtengine::IImage8 *load(const Glib::ustring &cache_fname,
+                        const rtengine::procparams::ProcParams &pparams, int h)
+{
+    if (!options.thumb_cache_processed) {
         return nullptr;
     }
 
-    if (std::min(width, height) <= 0) {
-        fclose(f);
+    Glib::ustring fname = cache_fname + ".artt";
+
+    guint32 num_levels = 0;
+    FILE *f = open_file(fname, pparams, num_levels);
+
+    if (!f) {
         return nullptr;
     }
 
-    if (guint32(h) != height) {
+    // look for the smallest level not smaller than the requested height
+    long best_pos = -1;
+    guint32 width = 0, height = 0;
+
+    for (guint32 i = 0; i < num_levels; ++i) {
+        guint32 lw = 0, lh = 0;
+        if (!read_size(f, lw, lh)) {
+            break;
+        }
+        if (lh < guint32(h)) {
+            break;
+        }
+        best_pos = ftell(f);
+        width = lw;
+        height = lh;
+        if (lh == guint32(h) || !skip_image(f, lw, lh)) {
+            break;
+        }
+    }
+
+    if (best_pos < 0 || fseek(f, best_pos, SEEK_SET) != 0) {
         fclose(f);
         return nullptr;
     }
@@ -129,17 +215,19 @@ rtengine::IImage8 *load(const Glib::ustring &cache_fname,
     image->readData(f);
     fclose(f);
 
-    // if (guint32(h) < height) {
-    //     int w = int(float(width) * float(guint32(h) / height));
-    //     rtengine::Image8 *resized = new rtengine::Image8(w, h);
-    //     image->resizeImgTo<>(w, h, rtengine::TI_Nearest, resized);
-    //     delete image;
-    //     image = resized;
-    // }
+    if (guint32(h) < height) {
+        const int w =
+            std::max(int(float(width) * float(h) / float(height) + 0.5f), 1);
+        rtengine::Image8 *resized = new rtengine::Image8(w, h);
+        image->resizeImgTo<>(w, h, rtengine::TI_Bilinear, resized);
+        delete image;
+        image = resized;
+    }
 
     if (options.rtSettings.verbose > 1) {
         std::cout << "read from cache: " << fname << " " << width << "x"
-                  << height << std::endl;
+                  << height << " -> " << image->getWidth() << "x"
+                  << image->getHeight() << std::endl;
     }
 
     return image;
@@ -154,13 +242,43 @@ bool store(const Glib::ustring &cache_fname,
     }
 
     Glib::ustring fname = cache_fname + ".artt";
+
+    // the levels larger than the new image are still valid if they were
+    // generated with the same parameters
+    std::vector<std::unique_ptr<rtengine::Image8>> larger;
+    {
+        guint32 num_levels = 0;
+        FILE *f = open_file(fname, pparams, num_levels);
+        if (f) {
+            for (guint32 i = 0; i < num_levels; ++i) {
+                guint32 lw = 0, lh = 0;
+                if (!read_size(f, lw, lh) || lh <= guint32(img->getHeight())) {
+                    break;
+                }
+                larger.emplace_back(new rtengine::Image8(lw, lh));
+                larger.back()->readData(f);
+            }
+            fclose(f);
+        }
+    }
+
+    // and the smaller ones are generated from it
+    std::vector<std::unique_ptr<rtengine::Image8>> smaller;
+    {
+        const rtengine::IImage8 *src = img;
+        while (src->getHeight() / 2 >= MIN_LEVEL_HEIGHT) {
+            smaller.emplace_back(halve(src));
+            src = smaller.back().get();
+        }
+    }
+
     FILE *f = g_fopen(fname.c_str(), "wb");
 
     if (!f) {
         return false;
     }
 
-    fputs("ART\n", f);
+    fputs("ARP\n", f);
     fputs(rtengine::ICCStore::getInstance()->getThumbnailMonitorHash().c_str(),
           f);
     std::vector<uint8_t> profzdata = rtengine::compress(pparams.to_data(), 1);
@@ -168,18 +286,31 @@ bool store(const Glib::ustring &cache_fname,
     fwrite(&profsz, sizeof(guint32), 1, f);
     fwrite(&profzdata[0], sizeof(uint8_t), profsz, f);
 
-    guint32 w = guint32(img->getWidth());
-    guint32 h = guint32(img->getHeight());
-    fwrite(&w, sizeof(guint32), 1, f);
-    fwrite(&h, sizeof(guint32), 1, f);
+    guint32 num_levels = larger.size() + 1 + smaller.size();
+    fwrite(&num_levels, sizeof(guint32), 1, f);
+
+    const auto write_level = [f](const rtengine::IImage8 *level) -> void {
+        guint32 w = guint32(level->getWidth());
+        guint32 h = guint32(level->getHeight());
+        fwrite(&w, sizeof(guint32), 1, f);
+        fwrite(&h, sizeof(guint32), 1, f);
+        level->writeData(f);
+    };
 
-    img->writeData(f);
+    for (auto &level : larger) {
+        write_level(level.get());
+    }
+    write_level(img);
+    for (auto &level : smaller) {
+        write_level(level.get());
+    }
 
     fclose(f);
 
     if (options.rtSettings.verbose > 1) {
-        std::cout << "saved in cache: " << fname << " " << w << "x" << h
-                  << std::endl;
+        std::cout << "saved in cache: " << fname << " " << img->getWidth()
+                  << "x" << img->getHeight() << " (" << num_levels
+                  << " levels)" << std::endl;
     }
 
     return true;
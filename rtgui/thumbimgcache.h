@@ -31,15 +31,11 @@ namespace art {
 namespace thumbimgcache {
 
 /******************************************************************************
- * file format:
- *
- * "ART\n" header
- * monitor hash
- * size of the procparams
- * compressed procparams
- * width
- * height
- * image data
+ * The processed thumbnails are cached as a small pyramid: the image as
+ * generated, the half-size versions of it down to 64 pixels, and the larger
+ * levels generated earlier with the same parameters. load() returns the
+ * image at the requested height, downscaled from the nearest level not
+ * smaller than that, or null if there is none.
  ******************************************************************************/
 rtengine::IImage8 *load(const Glib::ustring &cache_fname,
                         const rtengine::procparams::ProcParams &pparams, int h);
@@ -195,7 +195,7 @@ void Thumbnail::_generateThumbnailImage(bool save_in_cache, bool info_only)
         needsReProcessing = true;
 
         if (save_in_cache) {
-            cfs.save(getCacheFileName("data", ".txt"));
+            saveCacheImageData();
         }
 
         generateExifDateTimeStrings();
@@ -582,7 +582,7 @@ void Thumbnail::imageDeveloped()
 {
 
     cfs.recentlySaved = true;
-    cfs.save(getCacheFileName("data", ".txt"));
+    saveCacheImageData();
 
     if (options.saveParamsCache) {
         pparams.save(cachemgr->getProgressListener(),
@@ -729,7 +729,7 @@ Thumbnail::processThumbImage(const rtengine::procparams::ProcParams &pparams,
             return nullptr;
         } else if (options.thumb_lazy_caching) {
             _saveThumbnail();
-            cfs.save(getCacheFileName("data", ".txt"));
+            saveCacheImageData();
         }
     }
 
@@ -940,7 +940,9 @@ void Thumbnail::_loadThumbnail(bool firstTrial, bool info_only)
     tpp->isRaw = (cfs.format == (int)FT_Raw);
 
     // load supplementary data
-    bool succ = tpp->readData(getCacheFileName("data", ".txt"));
+    std::string data;
+    bool succ = cachemgr->loadData(fname, cfs.md5, data) &&
+                tpp->readData(CacheImageData::getExtraData(data));
 
     if (succ) {
         tpp->getAutoWBMultipliers(cfs.redAWBMul, cfs.greenAWBMul,
@@ -1019,7 +1021,26 @@ void Thumbnail::_saveThumbnail()
     tpp->writeEmbProfile(getCacheFileName("embprofiles", ".icc"));
 
     // save supplementary data
-    tpp->writeData(getCacheFileName("data", ".txt"));
+    std::string data;
+    cachemgr->loadData(fname, cfs.md5, data);
+    std::string extra = CacheImageData::getExtraData(data);
+    if (tpp->writeData(extra)) {
+        CacheImageData::setExtraData(data, extra);
+        cachemgr->saveData(fname, cfs.md5, data);
+    }
+}
+
+/*
+ * Save the CacheImageData values to the record of the image in the cache
+ * - NON PROTECTED
+ */
+void Thumbnail::saveCacheImageData()
+{
+    std::string data;
+    cachemgr->loadData(fname, cfs.md5, data);
+    if (cfs.saveData(data) == 0) {
+        cachemgr->saveData(fname, cfs.md5, data);
+    }
 }
 
 /*
@@ -1045,11 +1066,24 @@ void Thumbnail::saveThumbnail()
  * ExtraRawInfo,
  */
 void Thumbnail::updateCache(bool updatePParams, bool updateCacheImageData)
+{
+    doUpdateCache(updatePParams, updateCacheImageData,
+                  cachemgr->getProgressListener());
+}
+
+void Thumbnail::updateCacheAsync(rtengine::ProgressListener *pl)
+{
+    MyMutex::MyLock lock(mutex);
+    doUpdateCache(true, true, pl);
+}
+
+void Thumbnail::doUpdateCache(bool updatePParams, bool updateCacheImageData,
+                              rtengine::ProgressListener *pl)
 {
     saveRating();
 
     if (updatePParams && pparamsValid) {
-        pparams.save(cachemgr->getProgressListener(),
+        pparams.save(pl,
                      options.saveParamsFile ? options.getParamFile(fname) : "",
                      options.saveParamsCache
                          ? getCacheFileName("profiles", paramFileExtension)
@@ -1057,7 +1091,7 @@ void Thumbnail::updateCache(bool updatePParams, bool updateCacheImageData)
     }
 
     if (updateCacheImageData) {
-        cfs.save(getCacheFileName("data", ".txt"));
+        saveCacheImageData();
     }
 
     if (updatePParams && pparamsValid) {
@@ -1106,6 +1140,19 @@ void Thumbnail::removeThumbnailListener(ThumbnailListener *tnl)
     }
 }
 
+guint8 *
+Thumbnail::getRenderedImage(const rtengine::procparams::ProcParams &pparams,
+                            int min_h, int &w, int &h)
+{
+    for (auto l : listeners) {
+        guint8 *ret = l->getRenderedImage(pparams, min_h, w, h);
+        if (ret) {
+            return ret;
+        }
+    }
+    return nullptr;
+}
+
 bool Thumbnail::imageLoad(bool loading)
 {
     MyMutex::MyLock lock(mutex);
@@ -104,6 +104,7 @@ class Thumbnail: public PParamsSnapshotListener {
 
     void _loadThumbnail(bool firstTrial = true, bool info_only = false);
     void _saveThumbnail();
+    void saveCacheImageData();
     void _generateThumbnailImage(bool save_in_cache = true,
                                  bool info_only = false);
     int infoFromImage(const Glib::ustring &fname);
@@ -116,6 +117,8 @@ class Thumbnail: public PParamsSnapshotListener {
     void saveRating();
     void loadRating();
     void saveMetadata();
+    void doUpdateCache(bool updatePParams, bool updateCacheImageData,
+                       rtengine::ProgressListener *pl);
 
 public:
     Thumbnail(CacheManager *cm, const Glib::ustring &fname, CacheImageData *cf);
@@ -221,12 +224,20 @@ public:
 
     void addThumbnailListener(ThumbnailListener *tnl);
     void removeThumbnailListener(ThumbnailListener *tnl);
+    // an image of the thumbnail already rendered by one of the listeners
+    // (see ThumbnailListener::getRenderedImage()), if any
+    guint8 *getRenderedImage(const rtengine::procparams::ProcParams &pparams,
+                             int min_h, int &w, int &h);
 
     void increaseRef();
     void decreaseRef();
 
     void updateCache(bool updatePParams = true,
                      bool updateCacheImageData = true);
+    // like updateCache(), but it takes the lock and reports errors to pl
+    // instead of the (GUI) listener of the cache manager, so that it can
+    // be called from a background thread
+    void updateCacheAsync(rtengine::ProgressListener *pl);
     void saveThumbnail();
 
     bool imageLoad(bool loading);
@@ -19,12 +19,29 @@
 #ifndef _THUMBNAILLISTENER_
 #define _THUMBNAILLISTENER_
 
+#include <glib.h>
+
 class Thumbnail;
 
+namespace rtengine {
+namespace procparams {
+class ProcParams;
+} // namespace procparams
+} // namespace rtengine
+
 class ThumbnailListener {
 public:
     virtual ~ThumbnailListener() = default;
     virtual void procParamsChanged(Thumbnail *thm, int whoChangedIt) = 0;
+    // returns a copy (allocated with new[]) of the RGB image of the
+    // thumbnail rendered by the listener, if it is up to date with pparams
+    // and at least min_h pixels high, nullptr otherwise
+    virtual guint8 *
+    getRenderedImage(const rtengine::procparams::ProcParams &pparams,
+                     int min_h, int &w, int &h)
+    {
+        return nullptr;
+    }
 };
 
 #endif
@@ -544,6 +544,9 @@ void ToolPanelCoordinator::panelChanged(const rtengine::ProcEvent &event,
         resize->write(params);
     }
 
+    if (recorder_) {
+        recorder_->record(event, changeFlags, *params);
+    }
     ipc->endUpdateParams(changeFlags); // starts the IPC processing
 
     hasChanged = true;
@@ -638,13 +641,14 @@ void ToolPanelCoordinator::profileChange(const PartialProfile *nparams,
     }
 
     // start the IPC processing
+    int changeFlags = rtengine::RefreshMapper::getInstance()->getAction(event);
     if (filterRawRefresh) {
-        ipc->endUpdateParams(
-            rtengine::RefreshMapper::getInstance()->getAction(event) &
-            rtengine::ALLNORAW);
-    } else {
-        ipc->endUpdateParams(event);
+        changeFlags &= rtengine::ALLNORAW;
     }
+    if (recorder_) {
+        recorder_->record(event, changeFlags, *params);
+    }
+    ipc->endUpdateParams(changeFlags);
 
     hasChanged = event != rtengine::EvProfileChangeNotification;
 
@@ -693,6 +697,14 @@ void ToolPanelCoordinator::initImage(rtengine::StagedImageProcessor *ipc_,
         ipc->setFilmNegListener(filmNegative);
 
         auto dn = Glib::path_get_dirname(ipc->getInitialImage()->getFileName());
+        if (!options.session_recording_dir.empty()) {
+            recorder_.reset(new SessionRecorder(
+                options.session_recording_dir,
+                ipc->getInitialImage()->getFileName()));
+            if (!recorder_->ok()) {
+                recorder_.reset();
+            }
+        }
         flatfield->setShortcutPath(dn);
         colorcorrection->setExternalMaskPath(dn);
         localContrast->setExternalMaskPath(dn);
@@ -716,6 +728,7 @@ void ToolPanelCoordinator::closeImage()
         ipc->stopProcessing();
         ipc = nullptr;
     }
+    recorder_.reset();
 }
 
 void ToolPanelCoordinator::closeAllTools()
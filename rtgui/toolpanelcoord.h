@@ -45,6 +45,7 @@
 #include "resize.h"
 #include "rotate.h"
 #include "saturation.h"
+#include "sessionrecorder.h"
 #include "sharpening.h"
 #include "textureboost.h"
 #include "tonecurve.h"
@@ -54,6 +55,7 @@
 #include "vignetting.h"
 #include "whitebalance.h"
 #include <gtkmm.h>
+#include <memory>
 #include <vector>
 // #include "dirpyrequalizer.h"
 #include "../rtengine/noncopyable.h"
@@ -163,6 +165,8 @@ protected:
     std::vector<PParamsChangeListener *> paramcListeners;
 
     rtengine::StagedImageProcessor *ipc;
+    // see Options::session_recording_dir
+    std::unique_ptr<SessionRecorder> recorder_;
 
     std::vector<ToolPanel *> toolPanels;
     std::vector<FoldableToolPanel *> favorites;